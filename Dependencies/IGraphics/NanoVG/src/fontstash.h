@@ -202,13 +202,14 @@ int fons__tt_getGlyphIndex(FONSttFontImpl *font, int codepoint)
 	return FT_Get_Char_Index(font->font, codepoint);
 }
 
-int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale,
+int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale, float shiftX,
 							  int *advance, int *lsb, int *x0, int *y0, int *x1, int *y1)
 {
 	FT_Error ftError;
 	FT_GlyphSlot ftGlyph;
 	FT_Fixed advFixed;
 	FONS_NOTUSED(scale);
+	FONS_NOTUSED(shiftX);
 
 	ftError = FT_Set_Pixel_Sizes(font->font, 0, (FT_UInt)(size * (float)font->font->units_per_EM / (float)(font->font->ascender - font->font->descender)));
 	if (ftError) return 0;
@@ -227,7 +228,7 @@ int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float
 }
 
 void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
-								float scaleX, float scaleY, int glyph)
+								float scaleX, float scaleY, float shiftX, int glyph)
 {
 	FT_GlyphSlot ftGlyph = font->font->glyph;
 	int ftGlyphOffset = 0;
@@ -236,6 +237,7 @@ void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int
 	FONS_NOTUSED(outHeight);
 	FONS_NOTUSED(scaleX);
 	FONS_NOTUSED(scaleY);
+	FONS_NOTUSED(shiftX);
 	FONS_NOTUSED(glyph);	// glyph has already been loaded by fons__tt_buildGlyphBitmap
 
 	for ( y = 0; y < ftGlyph->bitmap.rows; y++ ) {
@@ -308,19 +310,19 @@ int fons__tt_getGlyphIndex(FONSttFontImpl *font, int codepoint)
 	return stbtt_FindGlyphIndex(&font->font, codepoint);
 }
 
-int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale,
+int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size, float scale, float shiftX,
 							  int *advance, int *lsb, int *x0, int *y0, int *x1, int *y1)
 {
 	FONS_NOTUSED(size);
 	stbtt_GetGlyphHMetrics(&font->font, glyph, advance, lsb);
-	stbtt_GetGlyphBitmapBox(&font->font, glyph, scale, scale, x0, y0, x1, y1);
+	stbtt_GetGlyphBitmapBoxSubpixel(&font->font, glyph, scale, scale, shiftX, 0.0f, x0, y0, x1, y1);
 	return 1;
 }
 
 void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
-								float scaleX, float scaleY, int glyph)
+								float scaleX, float scaleY, float shiftX, int glyph)
 {
-	stbtt_MakeGlyphBitmap(&font->font, output, outWidth, outHeight, outStride, scaleX, scaleY, glyph);
+	stbtt_MakeGlyphBitmapSubpixel(&font->font, output, outWidth, outHeight, outStride, scaleX, scaleY, shiftX, 0.0f, glyph);
 }
 
 int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
@@ -333,6 +335,17 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 #ifndef FONS_SCRATCH_BUF_SIZE
 #	define FONS_SCRATCH_BUF_SIZE 96000
 #endif
+// Number of horizontal subpixel positions a glyph is rasterized at. Pen positions are kept
+// fractional and each glyph is drawn from the variant nearest its position, instead of
+// snapping every glyph and advance to whole pixels. 1 disables subpixel positioning.
+// FreeType renders hinted bitmaps at whole pixels only.
+#ifdef FONS_USE_FREETYPE
+#	undef FONS_SUBPIXEL_STEPS
+#	define FONS_SUBPIXEL_STEPS 1
+#endif
+#ifndef FONS_SUBPIXEL_STEPS
+#	define FONS_SUBPIXEL_STEPS 4
+#endif
 #ifndef FONS_HASH_LUT_SIZE
 #	define FONS_HASH_LUT_SIZE 256
 #endif
@@ -381,7 +394,7 @@ struct FONSglyph
 	unsigned int codepoint;
 	int index;
 	int next;
-	short size, blur;
+	short size, blur, subpixel;
 	short x0,y0,x1,y1;
 	short xadv,xoff,yoff;
 };
@@ -1055,7 +1068,7 @@ static void fons__blur(FONScontext* stash, unsigned char* dst, int w, int h, int
 }
 
 static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
-								 short isize, short iblur, int bitmapOption)
+								 short isize, short iblur, short isubpixel, int bitmapOption)
 {
 	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
 	float scale;
@@ -1078,7 +1091,7 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	h = fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1);
 	i = font->lut[h];
 	while (i != -1) {
-		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur) {
+		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur && font->glyphs[i].subpixel == isubpixel) {
 			glyph = &font->glyphs[i];
 			if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL || (glyph->x0 >= 0 && glyph->y0 >= 0)) {
 			  return glyph;
@@ -1106,7 +1119,7 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 		// In that case the glyph index 'g' is 0, and we'll proceed below and cache empty glyph.
 	}
 	scale = fons__tt_getPixelHeightScale(&renderFont->font, size);
-	fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, &advance, &lsb, &x0, &y0, &x1, &y1);
+	fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, (float)isubpixel / FONS_SUBPIXEL_STEPS, &advance, &lsb, &x0, &y0, &x1, &y1);
 	gw = x1-x0 + pad*2;
 	gh = y1-y0 + pad*2;
 
@@ -1132,6 +1145,7 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 		glyph->codepoint = codepoint;
 		glyph->size = isize;
 		glyph->blur = iblur;
+		glyph->subpixel = isubpixel;
 		glyph->next = 0;
 
 		// Insert char to hash lookup.
@@ -1153,7 +1167,7 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 
 	// Rasterize
 	dst = &stash->texData[(glyph->x0+pad) + (glyph->y0+pad) * stash->params.width];
-	fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale, scale, g);
+	fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale, scale, (float)isubpixel / FONS_SUBPIXEL_STEPS, g);
 
 	// Make sure there is one pixel empty border.
 	dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
@@ -1191,17 +1205,55 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	return glyph;
 }
 
-static void fons__getQuad(FONScontext* stash, FONSfont* font,
-						   int prevGlyphIndex, FONSglyph* glyph,
-						   float scale, float spacing, float* x, float* y, FONSquad* q)
+// The subpixel variant nearest to pen position x, see fons__penPixel()
+static short fons__getSubpixel(float x)
 {
-	float rx,ry,xoff,yoff,x0,y0,x1,y1;
+#if FONS_SUBPIXEL_STEPS > 1
+	float p = x + 0.5f / FONS_SUBPIXEL_STEPS;
+	int s = (int)((p - floorf(p)) * FONS_SUBPIXEL_STEPS);
+	return (short)(s < FONS_SUBPIXEL_STEPS ? s : FONS_SUBPIXEL_STEPS - 1);
+#else
+	FONS_NOTUSED(x);
+	return 0;
+#endif
+}
+
+// The whole pixel that the subpixel variant at pen position x is drawn from
+static float fons__penPixel(float x)
+{
+#if FONS_SUBPIXEL_STEPS > 1
+	return floorf(x + 0.5f / FONS_SUBPIXEL_STEPS);
+#else
+	return x;
+#endif
+}
+
+// Finds the glyph for the next codepoint and applies kerning to the pen position,
+// picking the subpixel variant at the kerned position.
+static FONSglyph* fons__getPlacedGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
+									   short isize, short iblur, int prevGlyphIndex,
+									   float scale, float spacing, float* x, int bitmapOption)
+{
+	FONSglyph* glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, fons__getSubpixel(*x), bitmapOption);
 
-	if (prevGlyphIndex != -1) {
+	if (glyph != NULL && prevGlyphIndex != -1) {
 		float adv = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index) * scale;
+#if FONS_SUBPIXEL_STEPS > 1
+		*x += adv + spacing;
+		if (glyph->subpixel != fons__getSubpixel(*x))
+			glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, fons__getSubpixel(*x), bitmapOption);
+#else
 		*x += (int)(adv + spacing + 0.5f);
+#endif
 	}
 
+	return glyph;
+}
+
+static void fons__getQuad(FONScontext* stash, FONSglyph* glyph, float* x, float* y, FONSquad* q)
+{
+	float rx,ry,xoff,yoff,x0,y0,x1,y1;
+
 	// Each glyph has 2px border to allow good interpolation,
 	// one pixel to prevent leaking, and one to allow good interpolation for rendering.
 	// Inset the texture region by one pixel for correct interpolation.
@@ -1213,7 +1265,7 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 	y1 = (float)(glyph->y1-1);
 
 	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-		rx = (float)(int)(*x + xoff);
+		rx = (float)(int)(fons__penPixel(*x) + xoff);
 		ry = (float)(int)(*y + yoff);
 
 		q->x0 = rx;
@@ -1226,7 +1278,7 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 		q->s1 = x1 * stash->itw;
 		q->t1 = y1 * stash->ith;
 	} else {
-		rx = (float)(int)(*x + xoff);
+		rx = (float)(int)(fons__penPixel(*x) + xoff);
 		ry = (float)(int)(*y - yoff);
 
 		q->x0 = rx;
@@ -1240,7 +1292,11 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 		q->t1 = y1 * stash->ith;
 	}
 
+#if FONS_SUBPIXEL_STEPS > 1
+	*x += glyph->xadv / 10.0f;
+#else
 	*x += (int)(glyph->xadv / 10.0f + 0.5f);
+#endif
 }
 
 static void fons__flush(FONScontext* stash)
@@ -1342,9 +1398,9 @@ float fonsDrawText(FONScontext* stash,
 	for (; str != end; ++str) {
 		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
 			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, FONS_GLYPH_BITMAP_REQUIRED);
+		glyph = fons__getPlacedGlyph(stash, font, codepoint, isize, iblur, prevGlyphIndex, scale, state->spacing, &x, FONS_GLYPH_BITMAP_REQUIRED);
 		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+			fons__getQuad(stash, glyph, &x, &y, &q);
 
 			if (stash->nverts+6 > FONS_VERTEX_COUNT)
 				fons__flush(stash);
@@ -1426,10 +1482,10 @@ int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad* quad)
 		// Get glyph and quad
 		iter->x = iter->nextx;
 		iter->y = iter->nexty;
-		glyph = fons__getGlyph(stash, iter->font, iter->codepoint, iter->isize, iter->iblur, iter->bitmapOption);
+		glyph = fons__getPlacedGlyph(stash, iter->font, iter->codepoint, iter->isize, iter->iblur, iter->prevGlyphIndex, iter->scale, iter->spacing, &iter->nextx, iter->bitmapOption);
 		// If the iterator was initialized with FONS_GLYPH_BITMAP_OPTIONAL, then the UV coordinates of the quad will be invalid.
 		if (glyph != NULL)
-			fons__getQuad(stash, iter->font, iter->prevGlyphIndex, glyph, iter->scale, iter->spacing, &iter->nextx, &iter->nexty, quad);
+			fons__getQuad(stash, glyph, &iter->nextx, &iter->nexty, quad);
 		iter->prevGlyphIndex = glyph != NULL ? glyph->index : -1;
 		break;
 	}
@@ -1524,9 +1580,9 @@ float fonsTextBounds(FONScontext* stash,
 	for (; str != end; ++str) {
 		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
 			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur, FONS_GLYPH_BITMAP_OPTIONAL);
+		glyph = fons__getPlacedGlyph(stash, font, codepoint, isize, iblur, prevGlyphIndex, scale, state->spacing, &x, FONS_GLYPH_BITMAP_OPTIONAL);
 		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+			fons__getQuad(stash, glyph, &x, &y, &q);
 			if (q.x0 < minx) minx = q.x0;
 			if (q.x1 > maxx) maxx = q.x1;
 			if (stash->params.flags & FONS_ZERO_TOPLEFT) {
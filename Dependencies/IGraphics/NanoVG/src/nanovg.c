@@ -34,8 +34,18 @@
 #pragma warning(disable: 4706)  // assignment within conditional expression
 #endif
 
+// Each glyph can be rasterized at FONS_SUBPIXEL_STEPS positions, so start with an atlas that
+// holds a few text sizes without being reset (and every glyph rasterized again) mid-frame.
+#ifndef NVG_INIT_FONTIMAGE_SIZE
+#if FONS_SUBPIXEL_STEPS > 1
+#define NVG_INIT_FONTIMAGE_SIZE  1024
+#else
 #define NVG_INIT_FONTIMAGE_SIZE  512
+#endif
+#endif
+#ifndef NVG_MAX_FONTIMAGE_SIZE
 #define NVG_MAX_FONTIMAGE_SIZE   2048
+#endif
 #define NVG_MAX_FONTIMAGES       4
 
 #define NVG_INIT_COMMANDS_SIZE 256
@@ -3,8 +3,10 @@
 rm -r VST3_SDK
 rm -r WAM_AWP
 rm -r WAM_SDK
+rm -r CLAP_SDK
 git clone https://github.com/iplug2/audioworklet-polyfill WAM_AWP
 git clone https://github.com/iplug2/api.git WAM_SDK
+git clone https://github.com/free-audio/clap.git CLAP_SDK
 
 git clone https://github.com/steinbergmedia/vst3sdk.git VST3_SDK
 cd VST3_SDK
@@ -59,7 +59,7 @@ public:
 private:
   static constexpr int kScopeBufferSize = 128;
   
-  IBufferSender<2, kScopeBufferSize, kScopeBufferSize*2> mScopeSender;
+  IBufferSnapshotSender<2, kScopeBufferSize*2> mScopeSender;
   IBufferSender<1> mDisplaySender;
   IPeakSender<2> mMeterSender;
   ISender<1> mRTTextSender;
@@ -54,6 +54,7 @@ void IPlugFaustDSP::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 
 void IPlugFaustDSP::OnReset()
 {
+  mFaustProcessor.SetBlockSize(GetBlockSize());
   mFaustProcessor.SetSampleRate(GetSampleRate());
 }
 
@@ -38,7 +38,7 @@ IPlugInstrument::IPlugInstrument(const InstanceInfo& info)
     const IRECT lfoPanel = b.GetFromLeft(300.f).GetFromTop(200.f);
     IRECT keyboardBounds = b.GetFromBottom(300);
     IRECT wheelsBounds = keyboardBounds.ReduceFromLeft(100.f).GetPadded(-10.f);
-    pGraphics->AttachControl(new IVKeyboardControl(keyboardBounds), kCtrlTagKeyboard);
+    pGraphics->AttachControl(new IVKeyboardControl(keyboardBounds), kCtrlTagKeyboard)->SetWantsMidi(false); // the keys are lit by the key states sent from OnIdle()
     pGraphics->AttachControl(new IWheelControl(wheelsBounds.FracRectHorizontal(0.5)), kCtrlTagBender);
     pGraphics->AttachControl(new IWheelControl(wheelsBounds.FracRectHorizontal(0.5, true), IMidiMsg::EControlChangeMsg::kModWheel));
 //    pGraphics->AttachControl(new IVMultiSliderControl<4>(b.GetGridCell(0, 2, 2).GetPadded(-30), "", DEFAULT_STYLE, kParamAttack, EDirection::Vertical, 0.f, 1.f));
@@ -101,6 +101,15 @@ void IPlugInstrument::OnIdle()
 {
   mMeterSender.TransmitData(*this);
   mLFOVisSender.TransmitData(*this);
+
+  const IVKeyboardControl::KeyStates keyStates = (IVKeyboardControl::KeyStates(mNotesOn[1].load(std::memory_order_relaxed)) << 64)
+                                               | IVKeyboardControl::KeyStates(mNotesOn[0].load(std::memory_order_relaxed));
+
+  if (keyStates != mKeyStatesSent)
+  {
+    mKeyStatesSent = keyStates;
+    SendControlMsgFromDelegate(kCtrlTagKeyboard, IVKeyboardControl::kMsgTagSetKeyStates, sizeof(keyStates), &keyStates);
+  }
 }
 
 void IPlugInstrument::OnReset()
@@ -132,6 +141,22 @@ void IPlugInstrument::ProcessMidiMsg(const IMidiMsg& msg)
   }
   
 handle:
+  if (status == IMidiMsg::kNoteOn || status == IMidiMsg::kNoteOff)
+  {
+    const int noteNum = msg.NoteNumber();
+    const uint64_t bit = uint64_t(1) << (noteNum & 63);
+
+    if (status == IMidiMsg::kNoteOn && msg.Velocity())
+      mNotesOn[noteNum >> 6].fetch_or(bit, std::memory_order_relaxed);
+    else
+      mNotesOn[noteNum >> 6].fetch_and(~bit, std::memory_order_relaxed);
+  }
+  else if (status == IMidiMsg::kControlChange && msg.ControlChangeIdx() == IMidiMsg::kAllNotesOff)
+  {
+    mNotesOn[0].store(0, std::memory_order_relaxed);
+    mNotesOn[1].store(0, std::memory_order_relaxed);
+  }
+
   mDSP.ProcessMidiMsg(msg);
   SendMidiMsg(msg);
 }
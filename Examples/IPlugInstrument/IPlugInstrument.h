@@ -58,5 +58,7 @@ private:
   IPlugInstrumentDSP<sample> mDSP {16};
   IPeakAvgSender<2> mMeterSender;
   ISender<1> mLFOVisSender;
+  std::atomic<uint64_t> mNotesOn[2] {}; // a bit for each note that is on, set on the audio thread
+  IVKeyboardControl::KeyStates mKeyStatesSent; // the key states last sent to the keyboard, main thread
 #endif
 };
@@ -31,6 +31,9 @@
 #define ID_SHOW_DRAWN                   40026
 #define ID_SHOW_FPS                     40027
 #define ID_SHOW_BOUNDS                  40028
+#define IDC_CB_LOW_LATENCY              40029
+#define IDC_BUTTON_MEASURE_LATENCY      40030
+#define IDC_STATIC_LATENCY              40031
 
 // Next default values for new objects
 //
@@ -22,6 +22,14 @@ IPlugOSCEditor::IPlugOSCEditor(const InstanceInfo& info)
   OSCReceiver::SetLogFunc(logFunc);
   OSCSender::SetLogFunc(logFunc);
 
+  AddOSCHandler("/gain", [&](const OscMessageView& msg, int offset) {
+    double value;
+    IGraphics* pGraphics = GetUI();
+
+    if (pGraphics && msg.GetNumberArg(0, value))
+      pGraphics->GetControlWithTag(kCtrlTagGain)->SetValueFromDelegate(value);
+  });
+
 #if IPLUG_EDITOR // http://bit.ly/2S64BDd
   mMakeGraphicsFunc = [&]() {
     return MakeGraphics(*this, PLUG_WIDTH, PLUG_HEIGHT, PLUG_FPS, GetScaleForScreen(PLUG_WIDTH, PLUG_HEIGHT));
@@ -88,15 +96,6 @@ void IPlugOSCEditor::OnOSCMessage(OscMessageRead& msg)
 
   IGraphics* pGraphics = GetUI();
 
-  if(strcmp(msg.GetMessage(), "/gain") == 0)
-  {
-    auto* pValue = msg.PopFloatArg(true);
-    if (pValue) {
-      if(pGraphics)
-        pGraphics->GetControlWithTag(kCtrlTagGain)->SetValueFromDelegate(*pValue);
-    }
-  }
-
   WDL_String oscStr;
 
   oscStr.Append(msg.GetMessage());
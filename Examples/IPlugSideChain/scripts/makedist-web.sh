@@ -19,6 +19,7 @@ LAUNCH_EMRUN=1
 EMRUN_SERVER=1
 EMRUN_SERVER_PORT=8001
 SITE_ORIGIN="/"
+LAZY_RESOURCES=1 # fetch the pngs and fonts as the UI loads them, rather than preloading them all before it starts, see IGraphicsWeb::LoadAPIBitmap()
 
 cd $PROJECT_ROOT
 
@@ -61,7 +62,7 @@ if [ -f ./build-web/fonts.js ]; then rm ./build-web/fonts.js; fi
 FILE_PACKAGER=$EMSDK/upstream/emscripten/tools/file_packager.py
 #package fonts
 FOUND_FONTS=0
-if [ "$(ls -A ./resources/fonts/*.ttf)" ]; then
+if [ "$LAZY_RESOURCES" -eq "0" ] && [ "$(ls -A ./resources/fonts/*.ttf)" ]; then
   FOUND_FONTS=1
   python3 $FILE_PACKAGER fonts.data --preload ./resources/fonts/ --exclude *DS_Store --js-output=./fonts.js
 fi
@@ -75,14 +76,14 @@ fi
 
 #package @1x pngs
 FOUND_PNGS=0
-if [ "$(ls -A ./resources/img/*.png)" ]; then
+if [ "$LAZY_RESOURCES" -eq "0" ] && [ "$(ls -A ./resources/img/*.png)" ]; then
   FOUND_PNGS=1
   python3 $FILE_PACKAGER imgs.data --use-preload-plugins --preload ./resources/img/ --use-preload-cache --indexedDB-name="/$PROJECT_NAME_pkg" --exclude *DS_Store --exclude  *@2x.png --exclude  *.svg >> ./imgs.js
 fi
 
 # package @2x pngs into separate .data file
 FOUND_2XPNGS=0
-if [ "$(ls -A ./resources/img/*@2x*.png)" ]; then
+if [ "$LAZY_RESOURCES" -eq "0" ] && [ "$(ls -A ./resources/img/*@2x*.png)" ]; then
   FOUND_2XPNGS=1
   mkdir ./build-web/2x/
   cp ./resources/img/*@2x* ./build-web/2x
@@ -90,6 +91,17 @@ if [ "$(ls -A ./resources/img/*@2x*.png)" ]; then
   rm -r ./build-web/2x
 fi
 
+# or copy the fonts and pngs to be fetched as they're loaded, and list their sizes in resources.js
+FOUND_LAZY_RESOURCES=0
+if [ -f ./build-web/resources.js ]; then rm ./build-web/resources.js; fi
+if [ -d ./build-web/resources ]; then rm -r ./build-web/resources; fi
+if [ "$LAZY_RESOURCES" -eq "1" ]; then
+  mkdir -p ./build-web/resources/img ./build-web/resources/fonts
+  if [ "$(ls -A ./resources/img/*.png)" ]; then cp ./resources/img/*.png ./build-web/resources/img/; fi
+  if [ "$(ls -A ./resources/fonts/*.ttf)" ]; then cp ./resources/fonts/*.ttf ./build-web/resources/fonts/; fi
+  FOUND_LAZY_RESOURCES=$(python3 $IPLUG2_ROOT/Scripts/make_web_manifest.py ./build-web/resources ./build-web/resources.js)
+fi
+
 if [ -f ./imgs.js ]; then mv ./imgs.js ./build-web/imgs.js; fi
 if [ -f ./imgs@2x.js ]; then mv ./imgs@2x.js ./build-web/imgs@2x.js; fi
 if [ -f ./svgs.js ]; then mv ./svgs.js ./build-web/svgs.js; fi
@@ -112,8 +124,8 @@ if [ "$WEBSOCKET_MODE" -eq "0" ]; then
 
   cd $PROJECT_ROOT/build-web/scripts
 
-  # prefix the -wam.js script with scope
-  echo "AudioWorkletGlobalScope.WAM = AudioWorkletGlobalScope.WAM || {}; AudioWorkletGlobalScope.WAM.$PROJECT_NAME = { ENVIRONMENT: 'WEB' };" > $PROJECT_NAME-wam.tmp.js;
+  # prefix the -wam.js script with scope, and its Module, which the processor instantiates from the -wam.wasm compiled on the main thread
+  sed s/NAME_PLACEHOLDER/$PROJECT_NAME/g $IPLUG2_ROOT/IPlug/WEB/Template/scripts/IPlugWAM-module.js > $PROJECT_NAME-wam.tmp.js
   cat $PROJECT_NAME-wam.js >> $PROJECT_NAME-wam.tmp.js
   mv $PROJECT_NAME-wam.tmp.js $PROJECT_NAME-wam.js
   
@@ -147,11 +159,13 @@ if [ $FOUND_FONTS -eq "0" ]; then sed -i.bak s/'<script async src="fonts.js"><\/
 if [ $FOUND_SVGS -eq "0" ]; then sed -i.bak s/'<script async src="svgs.js"><\/script>'/'<!--<script async src="svgs.js"><\/script>-->'/g index.html; fi
 if [ $FOUND_PNGS -eq "0" ]; then sed -i.bak s/'<script async src="imgs.js"><\/script>'/'<!--<script async src="imgs.js"><\/script>-->'/g index.html; fi
 if [ $FOUND_2XPNGS -eq "0" ]; then sed -i.bak s/'<script async src="imgs@2x.js"><\/script>'/'<!--<script async src="imgs@2x.js"><\/script>-->'/g index.html; fi
+if [ $FOUND_LAZY_RESOURCES -eq "0" ]; then sed -i.bak s/'<script src="resources.js"><\/script>'/'<!--<script src="resources.js"><\/script>-->'/g index.html; fi
 if [ $WEBSOCKET_MODE -eq "1" ]; then
   cp $IPLUG2_ROOT/Dependencies/IPlug/WAM_SDK/wamsdk/wam-controller.js scripts/wam-controller.js
   cp $IPLUG2_ROOT/IPlug/WEB/Template/scripts/websocket.js scripts/websocket.js
   sed -i.bak s/'<script src="scripts\/audioworklet.js"><\/script>'/'<!--<script src="scripts\/audioworklet.js"><\/script>-->'/g index.html;
   sed -i.bak s/'let WEBSOCKET_MODE=false;'/'let WEBSOCKET_MODE=true;'/g index.html;
+  sed -i.bak s,"var ${PROJECT_NAME}_WAM_WASM = ","// var ${PROJECT_NAME}_WAM_WASM = ",g index.html;
 else
   sed -i.bak s/'<script src="scripts\/websocket.js"><\/script>'/'<!--<script src="scripts\/websocket.js"><\/script>-->'/g index.html;
 
@@ -161,7 +175,7 @@ else
 
   if [ $MAXNINPUTS -eq "0" ]; then 
     MAXNINPUTS="";
-    sed -i.bak '181,203d' index.html; # hack to remove GetUserMedia() from code, and allow WKWebKitView usage for instruments
+    sed -i.bak '192,214d' index.html; # hack to remove GetUserMedia() from code, and allow WKWebKitView usage for instruments
   fi
   sed -i.bak s/"MAXNINPUTS_PLACEHOLDER"/"$MAXNINPUTS"/g index.html;
   sed -i.bak s/"MAXNOUTPUTS_PLACEHOLDER"/"$MAXNOUTPUTS"/g index.html;
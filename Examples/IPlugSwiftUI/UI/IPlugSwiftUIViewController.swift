@@ -3,8 +3,8 @@ import SwiftUI
 public typealias MIDINoteNumber = UInt8
 public typealias MIDIVelocity = UInt8
 
-func floatValue(data: Data) -> Float {
-  return Float(bitPattern: UInt32(littleEndian: data.withUnsafeBytes { $0.load(fromByteOffset: 12, as: UInt32.self) }))
+func floatValue(buffer: UnsafeRawBufferPointer) -> Float {
+  return Float(bitPattern: UInt32(littleEndian: buffer.load(fromByteOffset: 12, as: UInt32.self)))
 }
 
 
@@ -59,9 +59,10 @@ func floatValue(data: Data) -> Float {
     return false
   }
   
-  override func sendControlMsgFromDelegate(ctrlTag: Int, msgTag: Int, msg: Data!) {
-    if msgTag==kUpdateMessage {
-      self.state.lastVolume = floatValue(data: msg)
+  // reads the ISenderData in place, rather than having it copied into a Data for each update
+  override func sendControlBufferFromDelegate(ctrlTag: Int, msgTag: Int, data: UnsafeRawPointer!, size: Int) {
+    if msgTag==kUpdateMessage && size >= 16 {
+      self.state.lastVolume = floatValue(buffer: UnsafeRawBufferPointer(start: data, count: size))
     }
   }
   
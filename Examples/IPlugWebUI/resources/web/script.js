@@ -5,16 +5,19 @@ function SPVFD(paramIdx, val) {
   OnParamChange(paramIdx, val);
 }
 
-function SCVFD(ctrlTag, val) {
+// minVal and maxVal are the range of the values sent to the control since the last flush, val is the newest
+function SCVFD(ctrlTag, val, minVal, maxVal) {
   OnControlChange(ctrlTag, val);
 //  console.log("SCVFD ctrlTag: " + ctrlTag + " value:" + val);
 }
 
-function SCMFD(ctrlTag, msgTag, msg) {
+// msg is a base64 string, or a Uint8Array if the delegate has called SetBinaryMessages(true)
+function SCMFD(ctrlTag, msgTag, dataSize, msg) {
 //  var decodedData = window.atob(msg);
   console.log("SCMFD ctrlTag: " + ctrlTag + " msgTag:" + msgTag + "msg:" + msg);
 }
 
+// msg is a base64 string, or a Uint8Array if the delegate has called SetBinaryMessages(true)
 function SAMFD(msgTag, dataSize, msg) {
   //  var decodedData = window.atob(msg);
   console.log("SAMFD msgTag:" + msgTag + " msg:" + msg);
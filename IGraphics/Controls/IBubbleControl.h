@@ -285,6 +285,7 @@ protected:
     if(pCaller != mCaller)
     {
       mRECT = mBubbleBounds;
+      NotifyBoundsChanged();
       GetUI()->SetAllControlsDirty();
     }
     
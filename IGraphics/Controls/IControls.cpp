@@ -1205,9 +1205,7 @@ void IVGroupControl::SetBoundsBasedOnGroup(const char* groupName, float padL, fl
   GetUI()->ForControlInGroup(mGroupName.Get(), [&unionRect](IControl* pControl) { unionRect = unionRect.Union(pControl->GetRECT()); });
   float halfLabelHeight = mLabelBounds.H()/2.f;
   unionRect.GetVPadded(halfLabelHeight);
-  mRECT = unionRect.GetPadded(padL, padT, padR, padB);
-  
-  OnResize();
+  SetRECT(unionRect.GetPadded(padL, padT, padR, padB));
 }
 
 IVColorSwatchControl::IVColorSwatchControl(const IRECT& bounds, const char* label, ColorChosenFunc func, const IVStyle& style, ECellLayout layout,
@@ -23,6 +23,7 @@
 #include "IVScopeControl.h"
 #include "IVMultiSliderControl.h"
 #include "IRTTextControl.h"
+#include "IProfilerDisplayControl.h"
 #include "IVDisplayControl.h"
 #include "ILEDControl.h"
 #include "IPopupMenuControl.h"
@@ -23,6 +23,7 @@ BEGIN_IGRAPHICS_NAMESPACE
 
 /** Performance display meter, based on code from NanoVG
  *  This is a special control that lives outside the main IGraphics control stack.
+ *  Click it to cycle through the frame rate, frame time, percentage and memory styles. The memory style shows the IMemoryReport of the delegate and the IGraphics, refreshed a few times a second
  * @ingroup SpecialControls */
 class IFPSDisplayControl : public IControl
                          , public IVectorBase
@@ -35,6 +36,7 @@ public:
     kFPS,
     kMS,
     kPercentage,
+    kMemory,
     kNumStyles
   };
 
@@ -45,6 +47,7 @@ public:
   , mNameLabel(label)
   {
     AttachIControl(this, label);
+    SetPollDirty(true); // IsDirty() is overridden
 
     SetColor(kBG, COLOR_WHITE);
 
@@ -72,6 +75,12 @@ public:
 
   void Draw(IGraphics& g) override
   {
+    if (mStyle == kMemory)
+    {
+      DrawMemory(g);
+      return;
+    }
+
     float avg = 0.f;
     for (int i = 0; i < MAXBUF; i++)
       avg += mBuffer[i];
@@ -155,11 +164,51 @@ public:
       g.DrawText(mTopLabelText, str.Get(), padded);
     }
   }
+
+  /** @return The last memory report shown in the kMemory style */
+  const IMemoryReport& GetMemoryReport() const { return mMemoryReport; }
+
 private:
+  static constexpr int kMemoryReportInterval = 15; // draws between memory reports, gathering one serializes the state
+
+  void DrawMemory(IGraphics& g)
+  {
+    if (mMemoryReportCountdown-- <= 0)
+    {
+      mMemoryReport.Clear();
+
+      if (GetDelegate())
+        GetDelegate()->GetMemoryReport(mMemoryReport);
+
+      g.GetMemoryReport(mMemoryReport);
+      mMemoryReportCountdown = kMemoryReportInterval;
+    }
+
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    IRECT padded = mRECT.GetPadded(-2);
+
+    g.DrawText(mAPILabelText, g.GetDrawingAPIStr(), padded);
+
+    // the name label shows the largest per-instance category, to point at the memory hog
+    g.DrawText(mNameLabelText, IMemoryReport::GetCategoryName(mMemoryReport.GetLargestInstanceCategory()), padded);
+
+    WDL_String str;
+    str.SetFormatted(32, "%.2f MB", mMemoryReport.GetInstanceTotal() / 1048576.);
+    g.DrawText(mTopLabelText, str.Get(), padded);
+
+    str.SetFormatted(32, "%.2f MB shared", mMemoryReport.GetSharedTotal() / 1048576.);
+    g.DrawText(mBottomLabelText, str.Get(), padded);
+  }
+
+
   int mStyle;
   WDL_String mNameLabel;
   float mBuffer[MAXBUF] = {};
   int mReadPos = 0;
+  IMemoryReport mMemoryReport;
+  int mMemoryReportCountdown = 0;
 
   float mPadding = 1.f;
   IText& mNameLabelText = mText;
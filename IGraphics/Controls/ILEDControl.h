@@ -42,15 +42,31 @@ public:
 
   void Draw(IGraphics& g) override
   {
-    const float v = static_cast<float>(GetValue() * 0.65f);
+    if (g.GetSharedSpritesEnabled())
+    {
+      // LEDs of the same hue and size share a raster per brightness level
+      const int level = static_cast<int>(std::round(GetValue() * kNumSharedLevels));
+      const uint64_t key = 0x4C45440000000000ull ^ (static_cast<uint64_t>(std::hash<float>()(mHue)) << 8) ^ static_cast<uint64_t>(level);
+
+      g.DrawSharedSprite(key, mRECT, 1.f, [this, level](IGraphics& g, const IRECT& r) {
+        DrawLED(g, r, static_cast<float>(level) / kNumSharedLevels);
+      });
+    }
+    else
+      DrawLED(g, mRECT, static_cast<float>(GetValue()));
+  }
+
+  void DrawLED(IGraphics& g, const IRECT& bounds, float value)
+  {
+    const float v = value * 0.65f;
     const IColor c = IColor::FromHSLA(mHue, 1.f, v);
-    IRECT innerPart = mRECT.GetCentredInside(mRECT.W()/2.f);
+    IRECT innerPart = bounds.GetCentredInside(bounds.W()/2.f);
     IRECT flare = innerPart.GetScaledAboutCentre(1.f + v);
     g.FillEllipse(c, innerPart, nullptr);
     g.DrawEllipse(COLOR_BLACK, innerPart, nullptr, 1.f);
     g.PathEllipse(flare);
     IBlend b = {EBlend::Default, v};
-    g.PathFill(IPattern::CreateRadialGradient(mRECT.MW(), mRECT.MH(), mRECT.W()/2.f, {{c, 0.f}, {COLOR_TRANSPARENT, 1.f}}), {}, &b);
+    g.PathFill(IPattern::CreateRadialGradient(bounds.MW(), bounds.MH(), bounds.W()/2.f, {{c, 0.f}, {COLOR_TRANSPARENT, 1.f}}), {}, &b);
   }
   
   void TriggerWithDecay(int decayTimeMs)
@@ -69,6 +85,8 @@ public:
   }
 
 private:
+  static constexpr int kNumSharedLevels = 64; // the brightness levels that are rasterized when sprites are shared
+
   float mHue = 0.f;
 };
 
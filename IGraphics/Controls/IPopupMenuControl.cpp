@@ -863,6 +863,7 @@ void IPopupMenuControl::OnEndAnimation()
   else if(mState == kCollapsing)
   {
     mTargetRECT = mSpecifiedCollapsedBounds;
+    NotifyBoundsChanged();
     
     for (auto i = 0; i < mMenuPanels.GetSize(); i++) {
       mMenuPanels.Get(i)->mBlend.mWeight = 0.;
@@ -881,6 +882,7 @@ void IPopupMenuControl::OnEndAnimation()
     
     mMenuPanels.Empty(true);
     mRECT = mSpecifiedCollapsedBounds;
+    NotifyBoundsChanged();
     mState = kCollapsed;
   }
   
@@ -0,0 +1,106 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @ingroup SpecialControls
+ * @copydoc IProfilerDisplayControl
+ */
+
+#include "IControl.h"
+#include "IPlugProfiler.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** Audio thread load display, fed with IProfileStats by IPlugAPIBase::OnTimer(). Shows the highest block load of each timer tick as a graph,
+ * and the load percentiles and overrun count as text. Give it a control tag and pass that to IPlugProfiler::SetDisplayControlTag()
+ * e.g. GetProfiler().SetEnabled(true); GetProfiler().SetDisplayControlTag(kCtrlTagProfiler);
+ * @ingroup SpecialControls */
+class IProfilerDisplayControl : public IControl
+                              , public IVectorBase
+{
+private:
+  static constexpr int MAXBUF = 100;
+public:
+  IProfilerDisplayControl(const IRECT& bounds, const char* label = "DSP Load")
+  : IControl(bounds)
+  , IVectorBase(DEFAULT_STYLE)
+  , mNameLabel(label)
+  {
+    AttachIControl(this, label);
+
+    SetColor(kBG, COLOR_WHITE);
+
+    mNameLabelText = IText(14, GetColor(kFR), DEFAULT_FONT, EAlign::Near, EVAlign::Bottom);
+  }
+
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    if (msgTag == IPlugProfiler::kUpdateMessage && dataSize == sizeof(IProfileStats))
+    {
+      mStats = *static_cast<const IProfileStats*>(pData);
+      mReadPos = (mReadPos + 1) % MAXBUF;
+      mBuffer[mReadPos] = mStats.mRecentMaxLoad;
+      SetDirty(false);
+    }
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mRECT);
+    g.DrawRect(COLOR_BLACK, mRECT);
+
+    IRECT padded = mRECT.GetPadded(-2);
+
+    float x = padded.L;
+    float y = padded.T;
+    float w = padded.W();
+    float h = padded.H();
+
+    g.PathMoveTo(x, y+h);
+
+    for (int i = 0; i < MAXBUF; i++)
+    {
+      float v = mBuffer[(mReadPos+1+i) % MAXBUF];
+      if (v > 1.0f) v = 1.0f;
+      g.PathLineTo(x + ((float)i/(MAXBUF-1)) * w, y + h - (v * h));
+    }
+
+    g.PathLineTo(mRECT.R, mRECT.B);
+    g.PathFill(mStats.mRecentMaxLoad > 1.0f ? COLOR_RED : GetColor(kFG));
+
+    if (mNameLabel.GetLength())
+      g.DrawText(mNameLabelText, mNameLabel.Get(), padded);
+
+    WDL_String str;
+
+    str.SetFormatted(64, "p50 %.1f%% p99 %.1f%% max %.1f%%", mStats.mMedianLoad * 100.f, mStats.mP99Load * 100.f, mStats.mMaxLoad * 100.f);
+    g.DrawText(mTopLabelText, str.Get(), padded);
+
+    str.SetFormatted(64, "%d overruns", mStats.mNOverruns);
+    g.DrawText(mBottomLabelText, str.Get(), padded);
+  }
+
+private:
+  WDL_String mNameLabel;
+  IProfileStats mStats;
+  float mBuffer[MAXBUF] = {};
+  int mReadPos = 0;
+
+  IText& mNameLabelText = mText;
+  IText mTopLabelText = IText(14, GetColor(kFR), DEFAULT_FONT, EAlign::Far, EVAlign::Top);
+  IText mBottomLabelText = IText(14, GetColor(kFR), DEFAULT_FONT, EAlign::Far, EVAlign::Bottom);
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
@@ -19,13 +19,95 @@
  * @copydoc IShaderControl
  */
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "IControl.h"
+#include "ISender.h"
+#include "IGraphicsResourceLoader.h"
 #include "SkRuntimeEffect.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
-/** This control allows you to draw to the UI via a shader written using the Skia shading language, which is similar to GLSL */
+/** Compiled SkSL programs, shared by all the IShaderControls in the process (across IGraphics instances), keyed by their source.
+ * An SkRuntimeEffect is immutable and doesn't belong to a GPU context, so each source only needs compiling once, and the compile can happen on a worker thread */
+class IShaderProgramCache
+{
+public:
+  struct Program
+  {
+    std::atomic<bool> mReady { false };
+    sk_sp<SkRuntimeEffect> mEffect; // written before mReady is set, null if the compile failed
+    std::string mError;
+  };
+
+  using ProgramPtr = std::shared_ptr<const Program>;
+
+  static IShaderProgramCache& Get()
+  {
+    static IShaderProgramCache sCache;
+    return sCache;
+  }
+
+  /** Find the program for a shader source, compiling it if this is the first time it is used
+   * @param source The SkSL source
+   * @param async \c true to compile on a worker thread, in which case the program isn't ready when it's first returned. If \c false, the program is ready on return
+   * @return The program */
+  ProgramPtr Find(const char* source, bool async)
+  {
+    std::shared_ptr<Program> pProgram;
+    bool compile = false;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto& entry = mPrograms[source];
+
+      if (!entry)
+      {
+        entry = std::make_shared<Program>();
+        compile = true;
+      }
+
+      pProgram = entry;
+    }
+
+    if (compile && async)
+      mCompiler.Add(source, [pProgram, src = std::string(source)]() { Compile(*pProgram, src.c_str()); });
+    else if (compile)
+      Compile(*pProgram, source);
+    else if (!async && !pProgram->mReady.load(std::memory_order_acquire))
+    {
+      // the program is being compiled asynchronously for another control
+      mCompiler.Wait(source);
+    }
+
+    return pProgram;
+  }
+
+private:
+  IShaderProgramCache() = default;
+
+  static void Compile(Program& program, const char* source)
+  {
+    auto [effect, errorText] = SkRuntimeEffect::MakeForShader(SkString(source));
+    program.mEffect = effect;
+    program.mError = errorText.c_str();
+    program.mReady.store(true, std::memory_order_release);
+  }
+
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::shared_ptr<Program>> mPrograms;
+  IResourceLoader mCompiler; // declared last, so that its threads are joined before the programs are freed
+};
+
+/** This control allows you to draw to the UI via a shader written using the Skia shading language, which is similar to GLSL.
+ * Shaders are compiled once per source for the whole process, see IShaderProgramCache. The shader's uniforms live in a persistent buffer that the shader reads when it's drawn,
+ * the first kNumUniforms floats being the built in uniforms below. Further uniforms can be set by name with SetUniform(), or fed from an ISender with SetSenderUniform() */
 class IShaderControl : public IControl
 {
 public:
@@ -64,9 +146,7 @@ public:
 //      }, 10000);
 //    });
 
-    WDL_String err;
-    
-    SetShaderStr(shaderStr ? shaderStr :
+    SetShaderStrAsync(shaderStr ? shaderStr :
     R"(
       uniform float uTime;
       uniform float2 uDim;
@@ -77,16 +157,36 @@ public:
        float2 pos = uMouse.xy/uDim.xy;
        return half4(pos.x, pos.y, 1, 1);
       }
-    )", err);
-    
-    if(err.GetLength())
-      DBGMSG("%s\n", err.Get());
+    )");
+  }
+
+  bool IsDirty() override
+  {
+    // poll for an asynchronous compile to finish
+    if (mPendingProgram && mPendingProgram->mReady.load(std::memory_order_acquire))
+    {
+      WDL_String err;
+
+      if (!UseProgram(mPendingProgram, err))
+        DBGMSG("%s\n", err.Get());
+
+      mPendingProgram = nullptr;
+      SetPollDirty(false);
+      SetDirty(false);
+    }
+
+    return IControl::IsDirty();
   }
 
   void Draw(IGraphics& g) override
   {
     if(mRTEffect)
+    {
+      memcpy(mUniformData.data(), mUniforms.data(), std::min(sizeof(mUniforms), mUniformData.size() * sizeof(float)));
       DrawShader(g, GetShaderBounds());
+    }
+    else
+      DrawFallback(g, GetShaderBounds());
     
 //    WDL_String str;
 //    str.SetFormatted(32, "%i:%i", (int) mUniforms[kX], (int) mUniforms[kY]);
@@ -130,32 +230,123 @@ public:
     SetDirty(false);
   }
   
+  /** Set the shader, compiling it now if no control has used the same source before
+   * @param str The SkSL source
+   * @param error Set to the compiler's errors if it fails
+   * @return \c true if the shader compiled */
   bool SetShaderStr(const char* str, WDL_String& error)
   {
     mShaderStr = SkString(str);
-    
-    auto [effect, errorText] = SkRuntimeEffect::MakeForShader(mShaderStr);
-    
-    if (!effect)
+    mPendingProgram = nullptr;
+    SetPollDirty(false);
+    return UseProgram(IShaderProgramCache::Get().Find(str, false), error);
+  }
+
+  /** Set the shader, compiling it on a worker thread if no control has used the same source before. DrawFallback() is called until it is ready, and errors are reported with DBGMSG()
+   * @param str The SkSL source */
+  void SetShaderStrAsync(const char* str)
+  {
+    mShaderStr = SkString(str);
+    mPendingProgram = IShaderProgramCache::Get().Find(str, true);
+    SetPollDirty(true);
+  }
+
+  /** Set a uniform declared in the shader by name. The values are copied into the buffer the shader reads when it is drawn, so this doesn't rebuild the shader
+   * @param name The name of the uniform
+   * @param pValues The values, e.g. 2 for a float2
+   * @param nValues The number of values, any more than the uniform holds are ignored
+   * @return \c false if the shader doesn't have a uniform with that name, or isn't compiled yet */
+  bool SetUniform(const char* name, const float* pValues, int nValues)
+  {
+    return SetUniformData(name, pValues, nValues * static_cast<int>(sizeof(float)));
+  }
+
+  /** Set a float uniform declared in the shader by name, see SetUniform() */
+  bool SetUniform(const char* name, float value)
+  {
+    return SetUniform(name, &value, 1);
+  }
+
+  /** Feed the float values sent by an ISender (e.g. IPeakSender, or an ISender<MAXNC> with the control's tag) into a uniform array, see OnMsgFromDelegate()
+   * @param name The name of the uniform, e.g. "uLevels" declared as "uniform float uLevels[2];", or nullptr to stop */
+  void SetSenderUniform(const char* name)
+  {
+    mSenderUniform.Set(name ? name : "");
+  }
+
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    // ISenderData<MAXNC, float> is ctrlTag, nChans and chanOffset, then the values
+    constexpr int headerSize = 3 * sizeof(int);
+
+    if (msgTag != ISender<>::kUpdateMessage || !mSenderUniform.GetLength() || dataSize < headerSize)
+      return;
+
+    int header[3];
+    memcpy(header, pData, sizeof(header));
+    const int nChans = header[1];
+    const int chanOffset = header[2];
+    const int nValues = (dataSize - headerSize) / static_cast<int>(sizeof(float));
+
+    if (nChans > 0 && chanOffset >= 0 && chanOffset + nChans <= nValues)
     {
-      error.Set(errorText.c_str());
+      const uint8_t* pValues = static_cast<const uint8_t*>(pData) + headerSize + chanOffset * sizeof(float);
+
+      if (SetUniformData(mSenderUniform.Get(), pValues, nChans * static_cast<int>(sizeof(float))))
+        SetDirty(false);
+    }
+  }
+
+protected:
+  /* Override this method to only draw the shader in a sub region of the control's mRECT */
+  virtual IRECT GetShaderBounds() const
+  {
+    return mRECT;
+  }
+
+  /** Called instead of drawing the shader while it is being compiled, or if it failed to compile
+   * @param g The graphics context
+   * @param r The shader bounds */
+  virtual void DrawFallback(IGraphics& g, const IRECT& r)
+  {
+    // NO-OP
+  }
+
+private:
+  bool UseProgram(const IShaderProgramCache::ProgramPtr& pProgram, WDL_String& error)
+  {
+    if (!pProgram->mEffect)
+    {
+      error.Set(pProgram->mError.c_str());
       return false;
     }
 
-    mRTEffect = effect;
-    
-    auto inputs = SkData::MakeWithoutCopy(mUniforms.data(), mRTEffect->uniformSize());
+    if (mRTEffect == pProgram->mEffect)
+      return true;
+
+    mRTEffect = pProgram->mEffect;
+
+    const size_t uniformSize = mRTEffect->uniformSize();
+
+    // The shader reads the uniforms from this buffer each time it is drawn. It is only resized here, before the shader that refers to it is made
+    mUniformData.assign((uniformSize + sizeof(float) - 1) / sizeof(float), 0.f);
+    auto inputs = SkData::MakeWithoutCopy(mUniformData.data(), uniformSize);
     auto shader = mRTEffect->makeShader(std::move(inputs), nullptr, 0, nullptr, false);
     mPaint.setShader(std::move(shader));
+    SetDirty(false);
 
     return true;
   }
-  
-private:
-  /* Override this method to only draw the shader in a sub region of the control's mRECT */
-  virtual IRECT GetShaderBounds() const
+
+  bool SetUniformData(const char* name, const void* pData, int size)
   {
-    return mRECT;
+    const SkRuntimeEffect::Uniform* pUniform = mRTEffect ? mRTEffect->findUniform(name) : nullptr;
+
+    if (!pUniform || size <= 0)
+      return false;
+
+    memcpy(reinterpret_cast<uint8_t*>(mUniformData.data()) + pUniform->offset, pData, std::min(static_cast<size_t>(size), pUniform->sizeInBytes()));
+    return true;
   }
 
   void DrawShader(IGraphics& g, const IRECT& r)
@@ -171,6 +362,9 @@ private:
   SkPaint mPaint;
   SkString mShaderStr;
   sk_sp<SkRuntimeEffect> mRTEffect;
+  IShaderProgramCache::ProgramPtr mPendingProgram;
+  std::vector<float> mUniformData;
+  WDL_String mSenderUniform;
   std::array<float, kNumUniforms> mUniforms {0.f};
 };
 
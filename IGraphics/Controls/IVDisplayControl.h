@@ -22,7 +22,9 @@
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
-/** A control to display a rolling graphics of historical values */
+/** A control to display a rolling graphics of historical values.
+ * The history is a ring buffer, and the line is cached in a layer that is used as a ring too: each new value only clears and strokes the segment of the layer around it,
+ * and the layer is drawn scrolled so that the newest value is at the end of the plot. Redrawing it doesn't depend on the size of the history */
 class IVDisplayControl : public IControl
                        , public IVectorBase
 {
@@ -32,7 +34,7 @@ public:
   IVDisplayControl(const IRECT& bounds, const char* label = "", const IVStyle& style = DEFAULT_STYLE, EDirection dir = EDirection::Horizontal, float lo = 0., float hi = 1.f, float defaultVal = 0., uint32_t bufferSize = 100, float strokeThickness = 2.f)
   : IControl(bounds)
   , IVectorBase(style)
-  , mBuffer(bufferSize, defaultVal)
+  , mBuffer(2 * bufferSize, (defaultVal - lo) / (hi - lo))
   , mLoValue(lo)
   , mHiValue(hi)
   , mStrokeThickness(strokeThickness)
@@ -67,51 +69,61 @@ public:
 
   void DrawWidget(IGraphics& g) override
   {
-    float x = mPlotBounds.L;
-    float y = mPlotBounds.T;
-    float w = mPlotBounds.W();
-    float h = mPlotBounds.H();
-    
-    const int sz = static_cast<int>(mBuffer.size());
+    if (NIntervals() < 1 || mPlotBounds.Empty())
+      return;
 
-    auto getPlotPos = [&](int pos, float axis, float extrem) {
-      float v = mBuffer[(mReadPos+pos) % sz];
-      v = (v - mLoValue) / (mHiValue - mLoValue);
-      return axis + extrem - (v * extrem);
-    };
-    
-    if(mDirection == EDirection::Horizontal)
+    UpdateLineLayer(g);
+
+    const float length = GetPlotLength();
+    const float start = GetPlotStart();
+    const float scale = g.GetTotalScale();
+
+    // the ring position of the newest value is moved to the end of the plot, by whole pixels so that the layer isn't resampled
+    const float shift = std::round((length - RingOffset(NewestIdx())) * scale) / scale;
+
+    if (!g.CheckLayer(mDisplayLayer))
+      g.StartLayer(this, mWidgetBounds);
+    else
     {
-      g.PathMoveTo(x, getPlotPos(0, y, h));
-      
-      for (int i = 0; i < sz; i++)
-      {
-        float vx = x + ((float)i/(sz-1)) * w;
-        float vy = getPlotPos(i, y, h);
-        g.PathLineTo(vx, vy);
-      }
+      g.ResumeLayer(mDisplayLayer);
+      ClearLayer(g, mWidgetBounds);
     }
-    else
+
+    // the newest values, then the oldest, which wrap around to the start of the ring
+    for (const float offset : {shift, shift - length})
     {
-      g.PathMoveTo(getPlotPos(0, x, w), y);
-      
-      for (int i = 0; i < sz; i++)
-      {
-        float vx = getPlotPos(i, x, w);
-        float vy = y + ((float)i/(sz-1)) * h;
-        g.PathLineTo(vx, vy);
-      }
+      const IRECT clip = GetAlongRange(mWidgetBounds, start + offset, start + offset + length).Intersect(mWidgetBounds);
+
+      if (clip.Empty())
+        continue;
+
+      g.PathClipRegion(clip);
+      g.PathTransformSave();
+      g.PathTransformTranslate(mDirection == EDirection::Horizontal ? offset : 0.f, mDirection == EDirection::Horizontal ? 0.f : offset);
+      g.DrawBitmap(mLineLayer->GetBitmap(), mLineLayer->Bounds(), 0, 0, nullptr);
+      g.PathTransformRestore();
     }
-    IStrokeOptions strokeOptions;
-    strokeOptions.mJoinOption = ELineJoin::Bevel;
-    g.PathStroke(IPattern::CreateLinearGradient(mPlotBounds, mDirection, {{COLOR_TRANSPARENT, 0.f}, {GetColor(kX1), 1.f}}), mStrokeThickness, strokeOptions, &mBlend);
+
+    // the fade is applied here rather than stroked into the line layer, because it stays put while the line scrolls
+    const IBlend fadeBlend(EBlend::DstIn);
+    g.PathClipRegion(mWidgetBounds);
+    g.PathRect(mWidgetBounds);
+    g.PathFill(IPattern::CreateLinearGradient(mPlotBounds, mDirection, {{COLOR_TRANSPARENT, 0.f}, {COLOR_BLACK, 1.f}}), IFillOptions(), &fadeBlend);
+
+    mDisplayLayer = g.EndLayer();
+    g.DrawLayer(mDisplayLayer, &mBlend);
   }
   
   void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
   {
     auto Update = [&](float v) {
-      mBuffer[mReadPos] = v;
-      mReadPos = (mReadPos+1) % mBuffer.size();
+      const int sz = NValues();
+      const float normalized = (v - mLoValue) / (mHiValue - mLoValue);
+      // each value is also written a buffer length on, so that the history (oldest first) is always contiguous from mReadPos
+      mBuffer[mReadPos] = normalized;
+      mBuffer[mReadPos + sz] = normalized;
+      mReadPos = (mReadPos+1) % sz;
+      mNValuesReceived++;
       SetDirty(false);
     };
 
@@ -127,13 +139,159 @@ public:
   }
   
 private:
-  std::vector<float> mBuffer;
+  /** @return The number of values in the history */
+  int NValues() const { return static_cast<int>(mBuffer.size() / 2); }
+
+  /** @return The number of steps between the values in the history, which is also the number of steps round the ring */
+  int NIntervals() const { return NValues() - 1; }
+
+  /** @return The index of the newest value, counting the values received. The initial history has negative indices */
+  int64_t NewestIdx() const { return mNValuesReceived - 1; }
+
+  float GetPlotStart() const { return mDirection == EDirection::Horizontal ? mPlotBounds.L : mPlotBounds.T; }
+  float GetPlotLength() const { return mDirection == EDirection::Horizontal ? mPlotBounds.W() : mPlotBounds.H(); }
+  float GetStep() const { return GetPlotLength() / static_cast<float>(NIntervals()); }
+
+  /** @return The distance of a value from the start of the ring in the line layer */
+  float RingOffset(int64_t idx) const
+  {
+    const int64_t n = NIntervals();
+    return static_cast<float>(((idx % n) + n) % n) * GetStep();
+  }
+
+  /** @return r with [from, to] as its extent along the direction of the plot */
+  IRECT GetAlongRange(const IRECT& r, float from, float to) const
+  {
+    if (mDirection == EDirection::Horizontal)
+      return IRECT(from, r.T, to, r.B);
+    else
+      return IRECT(r.L, from, r.R, to);
+  }
+
+  /** Call a function with each offset by which the ring repeats that brings [from, to] into the widget bounds */
+  template <class F>
+  void ForEachRingOffset(float from, float to, F&& func) const
+  {
+    const float length = GetPlotLength();
+    const IRECT& b = mWidgetBounds;
+    const float lo = mDirection == EDirection::Horizontal ? b.L : b.T;
+    const float hi = mDirection == EDirection::Horizontal ? b.R : b.B;
+
+    for (int lap = -1; lap <= 2; lap++)
+    {
+      const float offset = lap * length;
+
+      if (from + offset < hi && to + offset > lo)
+        func(offset);
+    }
+  }
+
+  /** Clear part of the current layer, by erasing it with an opaque fill */
+  void ClearLayer(IGraphics& g, const IRECT& r)
+  {
+    const IBlend clearBlend(EBlend::DstOut);
+
+    if (!r.Empty())
+      g.FillRect(COLOR_BLACK, r, &clearBlend);
+  }
+
+  /** Stroke the values [firstIdx, lastIdx] into the line layer, clipped to the ring positions [from, to], which are relative to the ring position of the newest value */
+  void StrokeValues(IGraphics& g, int64_t firstIdx, int64_t lastIdx, float from, float to)
+  {
+    const int64_t newestIdx = NewestIdx();
+    const int nPoints = static_cast<int>(lastIdx - firstIdx) + 1;
+    const float newestPos = GetPlotStart() + RingOffset(newestIdx);
+    const float step = GetStep();
+    const float firstPos = newestPos - static_cast<float>(newestIdx - firstIdx) * step;
+    const float lastPos = newestPos - static_cast<float>(newestIdx - lastIdx) * step;
+    const float* pValues = mBuffer.data() + mReadPos + static_cast<int>(firstIdx - (newestIdx - NIntervals()));
+
+    IStrokeOptions strokeOptions;
+    strokeOptions.mJoinOption = ELineJoin::Bevel;
+
+    if (nPoints < 2)
+      return;
+
+    ForEachRingOffset(newestPos + from, newestPos + to, [&](float offset) {
+      const IRECT clip = GetAlongRange(mWidgetBounds, newestPos + from + offset, newestPos + to + offset).Intersect(mWidgetBounds);
+
+      if (clip.Empty())
+        return;
+
+      g.PathClipRegion(clip);
+      g.PathData(GetAlongRange(mPlotBounds, firstPos + offset, lastPos + offset), pValues, nPoints, mDirection);
+      g.PathStroke(GetColor(kX1), mStrokeThickness, strokeOptions);
+    });
+  }
+
+  /** Bring the line layer up to date with the history. Only the segment between the last value it was drawn with and the newest one is redrawn,
+   * along with a stroke's width either side of it, unless the layer is invalid or more than a ring's worth of values arrived */
+  void UpdateLineLayer(IGraphics& g)
+  {
+    const int64_t newestIdx = NewestIdx();
+    const int64_t oldestIdx = newestIdx - NIntervals();
+    const float step = GetStep();
+    const float length = GetPlotLength();
+    // the extra values either side of a cleared range whose strokes reach into it
+    const int64_t nOverlap = static_cast<int64_t>(std::ceil(1.5f * mStrokeThickness / step)) + 1;
+    const float newSegment = static_cast<float>(newestIdx - mLineLayerIdx) * step;
+
+    const bool layerValid = g.CheckLayer(mLineLayer) && mLineLayerBounds == mPlotBounds;
+    const bool linesValid = layerValid && mLineLayerColor == GetColor(kX1);
+
+    if (linesValid && newestIdx == mLineLayerIdx)
+      return;
+
+    if (linesValid && newSegment + 2.f * mStrokeThickness < length)
+    {
+      const float newestPos = GetPlotStart() + RingOffset(newestIdx);
+      const float newSegmentStart = -newSegment - mStrokeThickness;
+
+      g.ResumeLayer(mLineLayer);
+
+      ForEachRingOffset(newestPos + newSegmentStart, newestPos + mStrokeThickness, [&](float offset) {
+        ClearLayer(g, GetAlongRange(mWidgetBounds, newestPos + newSegmentStart + offset, newestPos + mStrokeThickness + offset).Intersect(mWidgetBounds));
+      });
+
+      // the new values end at the ring position of the newest one, where the oldest values start
+      StrokeValues(g, std::max(oldestIdx, mLineLayerIdx - nOverlap), newestIdx, newSegmentStart, 0.f);
+      StrokeValues(g, oldestIdx, std::min(newestIdx, oldestIdx + nOverlap), -length, -length + mStrokeThickness);
+    }
+    else
+    {
+      if (layerValid)
+      {
+        g.ResumeLayer(mLineLayer);
+        ClearLayer(g, mWidgetBounds);
+      }
+      else
+      {
+        g.StartLayer(this, mWidgetBounds);
+        mDisplayLayer = nullptr;
+      }
+
+      StrokeValues(g, oldestIdx, newestIdx, -length, 0.f);
+    }
+
+    mLineLayer = g.EndLayer();
+    mLineLayerIdx = newestIdx;
+    mLineLayerBounds = mPlotBounds;
+    mLineLayerColor = GetColor(kX1);
+  }
+
+  std::vector<float> mBuffer; // normalized values, twice over
   float mLoValue = 0.f;
   float mHiValue = 1.f;
-  int mReadPos = 0;
+  int mReadPos = 0; // the oldest value, where the next one is written
+  int64_t mNValuesReceived = 0;
   float mStrokeThickness = 2.f;
   EDirection mDirection;
   IRECT mPlotBounds;
+  ILayerPtr mLineLayer; // the line, with the values at their ring positions
+  ILayerPtr mDisplayLayer; // the line layer scrolled into place and faded
+  int64_t mLineLayerIdx = 0; // the newest value drawn in mLineLayer
+  IRECT mLineLayerBounds;
+  IColor mLineLayerColor;
 };
 
 END_IGRAPHICS_NAMESPACE
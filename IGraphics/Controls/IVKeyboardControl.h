@@ -16,6 +16,8 @@
  * @copydoc IVKeyboardControl
  */
 
+#include <bitset>
+
 #include "IControl.h"
 #include "IPlugMidi.h"
 
@@ -55,10 +57,20 @@ BEGIN_IGRAPHICS_NAMESPACE
  */
 
 /** Vectorial keyboard control
+ * The keys are cached in two layers, the white keys and the black keys with the frame, and only the pressed-state overlays are drawn on each refresh.
+ * A key whose state changes dirties only its own region, see IControl::SetDirtyRegion().
+ * To light the keys from the DSP, send the notes that are on with SendControlMsgFromDelegate(ctrlTag, IVKeyboardControl::kMsgTagSetKeyStates, sizeof(KeyStates), &states)
+ * from OnIdle(), rather than forwarding each note to the UI
  * @ingroup IControls */
 class IVKeyboardControl : public IControl
 {
 public:
+  /** A bit for each MIDI note number, set if the note is on */
+  using KeyStates = std::bitset<128>;
+
+  /** OnMsgFromDelegate() tag that sets the pressed state of every key at once, the data is a KeyStates */
+  static constexpr int kMsgTagSetKeyStates = 0;
+
   static const IColor DEFAULT_BK_COLOR;
   static const IColor DEFAULT_WK_COLOR;
   static const IColor DEFAULT_PK_COLOR;
@@ -197,6 +209,7 @@ public:
     }
 
     mTargetRECT = mRECT;
+    NotifyBoundsChanged();
     RecreateKeyBounds(true);
     SetDirty(false);
   }
@@ -217,8 +230,22 @@ public:
         break;
       default: break;
     }
+  }
 
-    SetDirty(false);
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    if (msgTag == kMsgTagSetKeyStates && dataSize == sizeof(KeyStates))
+    {
+      KeyStates states;
+      memcpy(&states, pData, sizeof(KeyStates)); // the message data isn't necessarily aligned
+      SetKeyStates(states);
+    }
+  }
+
+  void SetDisabled(bool disable) override
+  {
+    IControl::SetDisabled(disable);
+    InvalidateLayers(); // the black keys are drawn with less contrast
   }
 
   void DrawKey(IGraphics& g, const IRECT& bounds, const IColor& color)
@@ -233,58 +260,63 @@ public:
 
   void Draw(IGraphics& g) override
   {
-    IColor shadowColor = IColor(60, 0, 0, 0);
+    if (!g.CheckLayer(mWhiteKeysLayer))
+    {
+      g.StartLayer(this, mRECT);
+      DrawWhiteKeys(g);
+      mWhiteKeysLayer = g.EndLayer();
+    }
 
-    float BKBottom = mRECT.T + mRECT.H() * mBKHeightRatio;
-    float BKWidth = GetBKWidth();
+    if (!g.CheckLayer(mBlackKeysLayer))
+    {
+      g.StartLayer(this, mRECT);
+      DrawBlackKeys(g);
+      mBlackKeysLayer = g.EndLayer();
+    }
+
+    const IColor shadowColor = IColor(60, 0, 0, 0);
+    const IRECT dirtyBounds = GetDirtyRECT();
+    const float BKBottom = mRECT.T + mRECT.H() * mBKHeightRatio;
+    const float BKWidth = GetBKWidth();
 
-    // first draw white keys
+    g.DrawLayer(mWhiteKeysLayer);
+
+    // pressed white keys
     for (int i = 0; i < NKeys(); ++i)
     {
-      if (!IsBlackKey(i))
+      if (!IsBlackKey(i) && GetKeyIsPressed(i))
       {
         float kL = *GetKeyXPos(i);
         IRECT keyBounds = IRECT(kL, mRECT.T, kL + mWKWidth, mRECT.B);
 
-        DrawKey(g, keyBounds, i == mHighlight ? mHK_COLOR : mWK_COLOR);
+        if (!keyBounds.Intersects(dirtyBounds))
+          continue;
 
-        if (GetKeyIsPressed(i))
+        DrawKey(g, keyBounds, mPK_COLOR);
+
+        if (mDrawShadows)
         {
-          // draw played white key
-          DrawKey(g, keyBounds, mPK_COLOR);
+          IRECT shadowBounds = keyBounds;
+          shadowBounds.R = shadowBounds.L + 0.35f * shadowBounds.W();
 
-          if (mDrawShadows)
-          {
-            IRECT shadowBounds = keyBounds;
-            shadowBounds.R = shadowBounds.L + 0.35f * shadowBounds.W();
-            
-            if(!mRoundedKeys)
-              g.FillRect(shadowColor, shadowBounds, &mBlend);
-            else {
-              g.FillRoundRect(shadowColor, shadowBounds, 0., 0., mRoundness, mRoundness, &mBlend); // this one looks strange with rounded corners
-            }
+          if(!mRoundedKeys)
+            g.FillRect(shadowColor, shadowBounds, &mBlend);
+          else {
+            g.FillRoundRect(shadowColor, shadowBounds, 0., 0., mRoundness, mRoundness, &mBlend); // this one looks strange with rounded corners
           }
         }
-        if (mDrawFrame && i != 0)
-        { // only draw the left border if it doesn't overlay mRECT left border
-          g.DrawLine(mFR_COLOR, kL, mRECT.T, kL, mRECT.B, &mBlend, mFrameThickness);
-          if (i == NKeys() - 2 && IsBlackKey(NKeys() - 1))
-            g.DrawLine(mFR_COLOR, kL + mWKWidth, mRECT.T, kL + mWKWidth, mRECT.B, &mBlend, mFrameThickness);
-        }
       }
     }
 
-    // then blacks
-    for (int i = 0; i < NKeys(); ++i)
+    // the shadows under the black keys depend on which keys are pressed
+    if (mDrawShadows)
     {
-      if (IsBlackKey(i))
+      for (int i = 0; i < NKeys() - 1; ++i)
       {
-        float kL = *GetKeyXPos(i);
-        IRECT keyBounds = IRECT(kL, mRECT.T, kL + BKWidth, BKBottom);
-        // first draw underlying shadows
-        if (mDrawShadows && !GetKeyIsPressed(i) && i < NKeys() - 1)
+        if (IsBlackKey(i) && !GetKeyIsPressed(i))
         {
-          IRECT shadowBounds = keyBounds;
+          float kL = *GetKeyXPos(i);
+          IRECT shadowBounds = IRECT(kL, mRECT.T, kL + BKWidth, BKBottom);
           float w = shadowBounds.W();
           shadowBounds.L += 0.6f * w;
           if (GetKeyIsPressed(i + 1))
@@ -294,33 +326,30 @@ public:
             shadowBounds.B = shadowBounds.T + 1.05f * shadowBounds.H();
           }
           shadowBounds.R = shadowBounds.L + w;
-          DrawKey(g, shadowBounds, shadowColor);
-        }
-        DrawKey(g, keyBounds, (i == mHighlight ? mHK_COLOR : mBK_COLOR.WithContrast(IsDisabled() ? GRAYED_ALPHA : 0.f)));
-
-        if (GetKeyIsPressed(i))
-        {
-          // draw pressed black key
-          IColor cBP = mPK_COLOR;
-          cBP.A = (int) mBKAlpha;
-          g.FillRect(cBP, keyBounds, &mBlend);
-        }
 
-        if(!mRoundedKeys)
-        {
-          // draw l, r and bottom if they don't overlay the mRECT borders
-          if (mBKHeightRatio != 1.0)
-            g.DrawLine(mFR_COLOR, kL, BKBottom, kL + BKWidth, BKBottom, &mBlend);
-          if (i > 0)
-            g.DrawLine(mFR_COLOR, kL, mRECT.T, kL, BKBottom, &mBlend);
-          if (i != NKeys() - 1)
-            g.DrawLine(mFR_COLOR, kL + BKWidth, mRECT.T, kL + BKWidth, BKBottom, &mBlend);
+          if (shadowBounds.Intersects(dirtyBounds))
+            DrawKey(g, shadowBounds, shadowColor);
         }
       }
     }
 
-    if (mDrawFrame)
-      g.DrawRect(mFR_COLOR, mRECT, &mBlend, mFrameThickness);
+    g.DrawLayer(mBlackKeysLayer);
+
+    // pressed black keys
+    IColor cBP = mPK_COLOR;
+    cBP.A = (int) mBKAlpha;
+
+    for (int i = 0; i < NKeys(); ++i)
+    {
+      if (IsBlackKey(i) && GetKeyIsPressed(i))
+      {
+        float kL = *GetKeyXPos(i);
+        IRECT keyBounds = IRECT(kL, mRECT.T, kL + BKWidth, BKBottom);
+
+        if (keyBounds.Intersects(dirtyBounds))
+          g.FillRect(cBP, keyBounds, &mBlend);
+      }
+    }
 
     if (mShowNoteAndVel)
     {
@@ -388,22 +417,40 @@ public:
     SetKeyIsPressed(noteNum - mMinNote, played);
   }
 
+  /** Set the pressed state of a key, only the key's own region is redrawn if it changes
+   * @param key The index of the key, from the lowest note of the range
+   * @param pressed \c true if the key is pressed */
   void SetKeyIsPressed(int key, bool pressed)
   {
+    if (key < 0 || key >= NKeys() || GetKeyIsPressed(key) == pressed)
+      return;
+
     mPressedKeys.Get()[key] = pressed;
-    SetDirty(false);
+    SetDirtyRegion(GetKeyDirtyBounds(key));
+  }
+
+  /** Set the pressed state of every key in the range at once, e.g. from a kMsgTagSetKeyStates message. Only the keys whose state changed are redrawn
+   * @param states A bit for each MIDI note number, set if the note is on */
+  void SetKeyStates(const KeyStates& states)
+  {
+    for (int i = 0; i < NKeys(); ++i)
+    {
+      const int noteNum = mMinNote + i;
+      SetKeyIsPressed(i, noteNum < static_cast<int>(states.size()) && states.test(noteNum));
+    }
   }
   
   void SetKeyHighlight(int key)
   {
     mHighlight = key;
+    InvalidateLayers();
     SetDirty(false);
   }
 
   void ClearNotesFromMidi()
   {
-    memset(mPressedKeys.Get(), 0, mPressedKeys.GetSize() * sizeof(bool));
-    SetDirty(false);
+    for (int i = 0; i < NKeys(); ++i)
+      SetKeyIsPressed(i, false);
   }
 
   void SetBlackToWhiteRatios(float widthRatio, float heightRatio = 0.6)
@@ -428,6 +475,7 @@ public:
       }
     }
 
+    InvalidateLayers();
     SetDirty(false);
   }
 
@@ -438,6 +486,7 @@ public:
     mRECT.B = mRECT.T + mRECT.H() * r;
 
     mTargetRECT = mRECT;
+    NotifyBoundsChanged();
 
     if (keepAspectRatio)
       SetWidth(mRECT.W() * r);
@@ -458,6 +507,7 @@ public:
     }
 
     mTargetRECT = mRECT;
+    NotifyBoundsChanged();
 
     if (keepAspectRatio)
       SetHeight(mRECT.H() * r);
@@ -499,6 +549,7 @@ public:
       mBKAlpha = Clip(mBKAlpha, 15.f, 255.f);
     }
 
+    InvalidateLayers();
     SetDirty(false);
   }
 
@@ -594,9 +645,96 @@ private:
     }
 
     mTargetRECT = mRECT;
+    NotifyBoundsChanged();
+    InvalidateLayers();
     SetDirty(false);
   }
 
+  /** Draw the white keys as they are when none is pressed, into mWhiteKeysLayer */
+  void DrawWhiteKeys(IGraphics& g)
+  {
+    for (int i = 0; i < NKeys(); ++i)
+    {
+      if (!IsBlackKey(i))
+      {
+        float kL = *GetKeyXPos(i);
+        IRECT keyBounds = IRECT(kL, mRECT.T, kL + mWKWidth, mRECT.B);
+
+        DrawKey(g, keyBounds, i == mHighlight ? mHK_COLOR : mWK_COLOR);
+      }
+    }
+  }
+
+  /** Draw the borders of the white keys, then the black keys as they are when none is pressed and the frame, into mBlackKeysLayer, which is drawn over the pressed white keys */
+  void DrawBlackKeys(IGraphics& g)
+  {
+    float BKBottom = mRECT.T + mRECT.H() * mBKHeightRatio;
+    float BKWidth = GetBKWidth();
+
+    if (mDrawFrame)
+    {
+      for (int i = 1; i < NKeys(); ++i)
+      {
+        if (!IsBlackKey(i))
+        { // only draw the left border if it doesn't overlay mRECT left border
+          float kL = *GetKeyXPos(i);
+          g.DrawLine(mFR_COLOR, kL, mRECT.T, kL, mRECT.B, &mBlend, mFrameThickness);
+          if (i == NKeys() - 2 && IsBlackKey(NKeys() - 1))
+            g.DrawLine(mFR_COLOR, kL + mWKWidth, mRECT.T, kL + mWKWidth, mRECT.B, &mBlend, mFrameThickness);
+        }
+      }
+    }
+
+    for (int i = 0; i < NKeys(); ++i)
+    {
+      if (IsBlackKey(i))
+      {
+        float kL = *GetKeyXPos(i);
+        IRECT keyBounds = IRECT(kL, mRECT.T, kL + BKWidth, BKBottom);
+
+        DrawKey(g, keyBounds, (i == mHighlight ? mHK_COLOR : mBK_COLOR.WithContrast(IsDisabled() ? GRAYED_ALPHA : 0.f)));
+
+        if(!mRoundedKeys)
+        {
+          // draw l, r and bottom if they don't overlay the mRECT borders
+          if (mBKHeightRatio != 1.0)
+            g.DrawLine(mFR_COLOR, kL, BKBottom, kL + BKWidth, BKBottom, &mBlend);
+          if (i > 0)
+            g.DrawLine(mFR_COLOR, kL, mRECT.T, kL, BKBottom, &mBlend);
+          if (i != NKeys() - 1)
+            g.DrawLine(mFR_COLOR, kL + BKWidth, mRECT.T, kL + BKWidth, BKBottom, &mBlend);
+        }
+      }
+    }
+
+    if (mDrawFrame)
+      g.DrawRect(mFR_COLOR, mRECT, &mBlend, mFrameThickness);
+  }
+
+  void InvalidateLayers()
+  {
+    if (mWhiteKeysLayer)
+      mWhiteKeysLayer->Invalidate();
+
+    if (mBlackKeysLayer)
+      mBlackKeysLayer->Invalidate();
+  }
+
+  /** @return The region a change of the key's pressed state redraws, a black key's includes the shadow it casts on the white key to its right */
+  IRECT GetKeyDirtyBounds(int key)
+  {
+    float kL = *GetKeyXPos(key);
+
+    if (IsBlackKey(key))
+    {
+      float BKWidth = GetBKWidth();
+      float BKHeight = mRECT.H() * mBKHeightRatio;
+      return IRECT(kL, mRECT.T, kL + 1.9f * BKWidth, mRECT.T + 1.05f * BKHeight).Intersect(mRECT);
+    }
+    else
+      return IRECT(kL, mRECT.T, kL + mWKWidth, mRECT.B);
+  }
+
   int GetKeyAtPoint(float x, float y)
   {
     IRECT clipRect = mRECT.GetPadded(-2);
@@ -726,6 +864,8 @@ protected:
   WDL_TypedBuf<bool> mPressedKeys;
   WDL_TypedBuf<float> mKeyXPos;
   int mHighlight = -1;
+  ILayerPtr mWhiteKeysLayer; // the white keys, none pressed
+  ILayerPtr mBlackKeysLayer; // the key borders, the black keys, none pressed, and the frame
 };
 
 /** Vectorial "wheel" control for pitchbender/modwheel
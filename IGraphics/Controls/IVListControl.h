@@ -0,0 +1,637 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IVListControl
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "IControl.h"
+#include "IPlugPluginBase.h"
+#include "dirscan.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** The items shown by an IVListControl. The control only asks for the names of the rows it draws, and for every name once, when it is first searched,
+ * so a data source can fetch them on demand */
+class IListDataSource
+{
+public:
+  virtual ~IListDataSource() {}
+
+  /** @return The number of items */
+  virtual int NItems() = 0;
+
+  /** @param itemIdx The item, from 0 to NItems() - 1
+   * @return The item's name, which only needs to stay valid until the next call */
+  virtual const char* GetItemName(int itemIdx) = 0;
+};
+
+/** An IListDataSource for a plug-in's "baked in" factory presets */
+class IPresetListDataSource : public IListDataSource
+{
+public:
+  IPresetListDataSource(IPluginBase& plugin)
+  : mPlugin(plugin)
+  {
+  }
+
+  int NItems() override { return mPlugin.NPresets(); }
+  const char* GetItemName(int itemIdx) override { return mPlugin.GetPresetName(itemIdx); }
+
+private:
+  IPluginBase& mPlugin;
+};
+
+/** An IListDataSource for the files with an extension in a folder and its subfolders, e.g. a preset library.
+ * The folder is only scanned when the list first needs its items, and only the names and paths are kept; the files themselves are read by whoever the
+ * chosen item is passed to, see GetItemPath() */
+class IFileListDataSource : public IListDataSource
+{
+public:
+  /** @param path The folder to scan
+   * @param extension The extension of the files to list, without the dot, e.g. "fxp"
+   * @param showFileExtensions If this is \c false, the names are shown without the extension */
+  IFileListDataSource(const char* path, const char* extension, bool showFileExtensions = false)
+  : mPath(path)
+  , mExtension(extension)
+  , mShowFileExtensions(showFileExtensions)
+  {
+  }
+
+  int NItems() override
+  {
+    Scan();
+    return static_cast<int>(mItems.size());
+  }
+
+  const char* GetItemName(int itemIdx) override
+  {
+    Scan();
+    return mItems[itemIdx].mName.c_str();
+  }
+
+  /** @return The full path of an item's file */
+  const char* GetItemPath(int itemIdx)
+  {
+    Scan();
+    return mItems[itemIdx].mPath.c_str();
+  }
+
+  /** Forget the files, so that the folder is scanned again when the list next needs them */
+  void Rescan()
+  {
+    mItems.clear();
+    mScanned = false;
+  }
+
+private:
+  struct Item
+  {
+    std::string mName;
+    std::string mPath;
+  };
+
+  void Scan()
+  {
+    if (mScanned)
+      return;
+
+    mScanned = true;
+    ScanDirectory(mPath.Get());
+    auto lessNoCase = [](const Item& a, const Item& b) {
+      return std::lexicographical_compare(a.mName.begin(), a.mName.end(), b.mName.begin(), b.mName.end(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) < std::tolower(static_cast<unsigned char>(y));
+      });
+    };
+
+    std::sort(mItems.begin(), mItems.end(), lessNoCase);
+  }
+
+  void ScanDirectory(const char* path)
+  {
+    WDL_DirScan d;
+
+    if (!d.First(path))
+    {
+      do
+      {
+        const char* f = d.GetCurrentFN();
+
+        if (f && f[0] != '.')
+        {
+          WDL_String fullPath;
+          d.GetCurrentFullFN(&fullPath);
+
+          if (d.GetCurrentIsDirectory())
+            ScanDirectory(fullPath.Get());
+          else
+          {
+            const char* a = strstr(f, mExtension.Get());
+
+            if (a && a > f && a[-1] == '.' && strlen(a) == mExtension.GetLength())
+            {
+              const size_t nameLength = mShowFileExtensions ? strlen(f) : static_cast<size_t>(a - f - 1);
+              mItems.push_back({ std::string(f, nameLength), std::string(fullPath.Get()) });
+            }
+          }
+        }
+      } while (!d.Next());
+    }
+  }
+
+  WDL_String mPath;
+  WDL_String mExtension;
+  bool mShowFileExtensions;
+  bool mScanned = false;
+  std::vector<Item> mItems;
+};
+
+/** A case-insensitive substring search over the names of an IListDataSource. The names are lowercased once, into one buffer, so a search is a scan
+ * of contiguous memory rather than a call to the data source per item. A search for a query that extends the previous one only checks the previous matches */
+class IListSearchIndex
+{
+public:
+  /** Lowercase and keep every item's name */
+  void Build(IListDataSource& dataSource)
+  {
+    const int nItems = dataSource.NItems();
+    mText.clear();
+    mOffsets.resize(nItems);
+
+    for (int i = 0; i < nItems; i++)
+    {
+      mOffsets[i] = static_cast<int>(mText.size());
+      AppendLower(mText, dataSource.GetItemName(i));
+      mText.push_back('\0');
+    }
+
+    mBuilt = true;
+    mLastQuery.clear();
+  }
+
+  bool IsBuilt() const { return mBuilt; }
+
+  void Clear()
+  {
+    mText.clear();
+    mOffsets.clear();
+    mLastQuery.clear();
+    mBuilt = false;
+  }
+
+  /** Find the items whose names contain query
+   * @param query The text to find, matched case-insensitively
+   * @param matches The matching items, in order. If query extends the query of the previous call, these must be that call's matches */
+  void Search(const char* query, std::vector<int>& matches)
+  {
+    std::string lowerQuery;
+    AppendLower(lowerQuery, query);
+
+    const bool narrow = mLastQuery.size() && lowerQuery.compare(0, mLastQuery.size(), mLastQuery) == 0;
+    mLastQuery = lowerQuery;
+
+    auto isMatch = [&](int itemIdx) { return strstr(mText.c_str() + mOffsets[itemIdx], lowerQuery.c_str()) != nullptr; };
+
+    if (narrow)
+    {
+      matches.erase(std::remove_if(matches.begin(), matches.end(), [&](int itemIdx) { return !isMatch(itemIdx); }), matches.end());
+    }
+    else
+    {
+      matches.clear();
+
+      for (int i = 0; i < static_cast<int>(mOffsets.size()); i++)
+      {
+        if (isMatch(i))
+          matches.push_back(i);
+      }
+    }
+  }
+
+private:
+  static void AppendLower(std::string& dest, const char* str)
+  {
+    for (const char* c = str; c && *c; c++)
+      dest.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(*c))));
+  }
+
+  std::string mText;
+  std::vector<int> mOffsets;
+  std::string mLastQuery;
+  bool mBuilt = false;
+};
+
+/** A vectorial scrolling list, which only lays out and draws the rows that can be seen, so that it can show a huge list such as a preset library.
+ * Typing while the mouse is over the list searches it incrementally (Backspace and Escape edit or clear the search), the mouse wheel, the scroll bar and
+ * the arrow, Page Up/Down, Home and End keys scroll it, and clicking a row or pressing Return chooses an item
+ * @ingroup IControls */
+class IVListControl : public IControl
+                    , public IVectorBase
+{
+public:
+  using ItemChosenFunc = std::function<void(int itemIdx)>;
+
+  /** Constructs a vector list control
+   * @param bounds The control's bounds
+   * @param pDataSource The items to list, which must outlive the control, or nullptr to set them later with SetDataSource()
+   * @param label The label for the vector control, leave empty for no label
+   * @param style The styling of this vector control \see IVStyle
+   * @param rowHeight The height of each row */
+  IVListControl(const IRECT& bounds, IListDataSource* pDataSource = nullptr, const char* label = "", const IVStyle& style = DEFAULT_STYLE, float rowHeight = 20.f)
+  : IControl(bounds)
+  , IVectorBase(style)
+  , mDataSource(pDataSource)
+  , mRowHeight(rowHeight)
+  {
+    mText = style.valueText.WithAlign(EAlign::Near).WithVAlign(EVAlign::Middle);
+    AttachIControl(this, label);
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    DrawBackground(g, mRECT);
+    DrawWidget(g);
+    DrawLabel(g);
+
+    if (mStyle.drawFrame)
+      g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
+  }
+
+  void DrawWidget(IGraphics& g) override
+  {
+    g.FillRect(GetColor(kBG), mWidgetBounds, &mBlend);
+    DrawSearch(g, mSearchBounds);
+
+    if (!NRows())
+      return;
+
+    int first, last;
+    GetVisibleRows(first, last);
+
+    g.PathClipRegion(mListBounds.Intersect(g.GetDrawRegion()));
+
+    for (int row = first; row <= last; row++)
+    {
+      const int itemIdx = GetItemForRow(row);
+      DrawRow(g, GetRowBounds(row), itemIdx, itemIdx == mSelectedItem, row == mMouseOverRow);
+    }
+
+    g.PathClipRegion();
+
+    if (GetMaxScroll() > 0.f)
+      DrawScrollBar(g, GetScrollThumbBounds());
+  }
+
+  /** Draw one row, override to customise the rows
+   * @param r The row's bounds
+   * @param itemIdx The item in the data source
+   * @param selected \c true if the item is the selected one
+   * @param mouseOver \c true if the mouse is over the row */
+  virtual void DrawRow(IGraphics& g, const IRECT& r, int itemIdx, bool selected, bool mouseOver)
+  {
+    if (selected)
+      g.FillRect(GetColor(kPR), r, &mBlend);
+    else if (mouseOver)
+      g.FillRect(GetColor(kHL), r, &mBlend);
+
+    g.DrawText(mText, mDataSource->GetItemName(itemIdx), r.GetHPadded(-4.f), &mBlend);
+  }
+
+  virtual void DrawSearch(IGraphics& g, const IRECT& r)
+  {
+    if (r.Empty())
+      return;
+
+    g.FillRect(GetColor(kFG), r, &mBlend);
+
+    if (mQuery.GetLength())
+      g.DrawText(mText, mQuery.Get(), r.GetHPadded(-4.f), &mBlend);
+    else
+      g.DrawText(mText.WithFGColor(GetColor(kSH)), "Type to search", r.GetHPadded(-4.f), &mBlend);
+  }
+
+  virtual void DrawScrollBar(IGraphics& g, const IRECT& thumb)
+  {
+    g.FillRoundRect(mDraggingScrollBar ? GetColor(kPR) : GetColor(kFR), thumb, thumb.W() * 0.5f, &mBlend);
+  }
+
+  void OnResize() override
+  {
+    SetTargetRECT(MakeRects(mRECT));
+    mListBounds = mWidgetBounds;
+    mSearchBounds = mShowSearch ? mListBounds.ReduceFromTop(mRowHeight) : IRECT();
+    mScrollBarBounds = mListBounds.GetFromRight(kScrollBarWidth);
+    SetScroll(mScroll);
+    SetDirty(false);
+  }
+
+  void OnMouseDown(float x, float y, const IMouseMod& mod) override
+  {
+    if (GetMaxScroll() > 0.f && mScrollBarBounds.Contains(x, y))
+    {
+      mDraggingScrollBar = true;
+
+      // clicking outside of the thumb jumps to where it was clicked
+      if (!GetScrollThumbBounds().Contains(x, y))
+        SetScroll((y - mListBounds.T) / mListBounds.H() * GetContentHeight() - mListBounds.H() * 0.5f);
+
+      SetDirty(false);
+      return;
+    }
+
+    const int row = GetRowForPos(x, y);
+
+    if (row > -1)
+      ChooseItem(GetItemForRow(row));
+  }
+
+  void OnMouseUp(float x, float y, const IMouseMod& mod) override
+  {
+    if (mDraggingScrollBar)
+    {
+      mDraggingScrollBar = false;
+      SetDirty(false);
+    }
+  }
+
+  void OnMouseDrag(float x, float y, float dX, float dY, const IMouseMod& mod) override
+  {
+    if (mDraggingScrollBar)
+      SetScroll(mScroll + dY * GetContentHeight() / mListBounds.H());
+  }
+
+  void OnMouseWheel(float x, float y, const IMouseMod& mod, float d) override
+  {
+    SetScroll(mScroll - d * mRowHeight * 3.f);
+    OnMouseOver(x, y, mod);
+  }
+
+  void OnMouseOver(float x, float y, const IMouseMod& mod) override
+  {
+    const int row = GetRowForPos(x, y);
+
+    if (row != mMouseOverRow)
+    {
+      mMouseOverRow = row;
+      SetDirty(false);
+    }
+  }
+
+  void OnMouseOut() override
+  {
+    mMouseOverRow = -1;
+    SetDirty(false);
+  }
+
+  bool OnKeyDown(float x, float y, const IKeyPress& key) override
+  {
+    const int page = std::max(static_cast<int>(mListBounds.H() / mRowHeight) - 1, 1);
+
+    switch (key.VK)
+    {
+      case kVK_UP: MoveSelection(-1); return true;
+      case kVK_DOWN: MoveSelection(1); return true;
+      case kVK_PRIOR: MoveSelection(-page); return true;
+      case kVK_NEXT: MoveSelection(page); return true;
+      case kVK_HOME: MoveSelection(-NRows()); return true;
+      case kVK_END: MoveSelection(NRows()); return true;
+      case kVK_RETURN:
+        if (mSelectedItem > -1)
+          ChooseItem(mSelectedItem);
+        return true;
+      case kVK_ESCAPE:
+        if (!mQuery.GetLength())
+          return false;
+        SetSearch("");
+        return true;
+      case kVK_BACK:
+      {
+        int len = mQuery.GetLength();
+
+        if (!len)
+          return true;
+
+        // remove a whole UTF-8 character
+        while (len > 0 && (static_cast<unsigned char>(mQuery.Get()[len - 1]) & 0xC0) == 0x80)
+          len--;
+
+        WDL_String query(mQuery.Get(), std::max(len - 1, 0));
+        SetSearch(query.Get());
+        return true;
+      }
+      default:
+        break;
+    }
+
+    if (mShowSearch && !key.C && !key.A && static_cast<unsigned char>(key.utf8[0]) >= 0x20 && key.utf8[0] != 0x7F)
+    {
+      WDL_String query(mQuery);
+      query.Append(key.utf8);
+      SetSearch(query.Get());
+      return true;
+    }
+
+    return false;
+  }
+
+  /** Set the items to list, e.g. after the data source's items have changed
+   * @param pDataSource The items, which must outlive the control */
+  void SetDataSource(IListDataSource* pDataSource)
+  {
+    mDataSource = pDataSource;
+    mSearchIndex.Clear();
+    mSelectedItem = -1;
+    mMouseOverRow = -1;
+    SetSearch(mQuery.Get());
+  }
+
+  /** Show only the items whose names contain query, case-insensitively. The search index is built the first time this is called with some text */
+  void SetSearch(const char* query)
+  {
+    const bool hadQuery = mQuery.GetLength() > 0;
+    mQuery.Set(query);
+
+    if (mQuery.GetLength() && mDataSource)
+    {
+      if (!mSearchIndex.IsBuilt())
+        mSearchIndex.Build(*mDataSource);
+
+      if (!hadQuery)
+        mMatches.clear();
+
+      mSearchIndex.Search(mQuery.Get(), mMatches);
+    }
+    else
+      mMatches.clear();
+
+    mMouseOverRow = -1;
+    SetScroll(0.f);
+    EnsureItemVisible(mSelectedItem);
+    SetDirty(false);
+  }
+
+  /** Select an item and scroll to it, without calling the ItemChosenFunc */
+  void SetSelectedItem(int itemIdx)
+  {
+    mSelectedItem = itemIdx;
+    EnsureItemVisible(itemIdx);
+    SetDirty(false);
+  }
+
+  int GetSelectedItem() const { return mSelectedItem; }
+
+  /** Set a function to call when the user chooses an item, by clicking it or pressing Return, e.g. to load a preset */
+  void SetItemChosenFunc(ItemChosenFunc func) { mItemChosenFunc = func; }
+
+  void SetRowHeight(float rowHeight) { mRowHeight = rowHeight; OnResize(); }
+
+  void SetShowSearch(bool show) { mShowSearch = show; SetSearch(""); OnResize(); }
+
+  /** @return The number of rows, i.e. items that match the search */
+  int NRows() const
+  {
+    if (!mDataSource)
+      return 0;
+
+    return mQuery.GetLength() ? static_cast<int>(mMatches.size()) : mDataSource->NItems();
+  }
+
+protected:
+  /** @return The item shown in a row. Without a search, rows and items are the same, so nothing is allocated per item */
+  int GetItemForRow(int row) const { return mQuery.GetLength() ? mMatches[row] : row; }
+
+  /** @return The row showing an item, or -1 if it doesn't match the search */
+  int GetRowForItem(int itemIdx) const
+  {
+    if (!mQuery.GetLength())
+      return itemIdx;
+
+    auto it = std::lower_bound(mMatches.begin(), mMatches.end(), itemIdx);
+    return (it != mMatches.end() && *it == itemIdx) ? static_cast<int>(it - mMatches.begin()) : -1;
+  }
+
+  float GetContentHeight() const { return NRows() * mRowHeight; }
+
+  float GetMaxScroll() const { return std::max(GetContentHeight() - mListBounds.H(), 0.f); }
+
+  void SetScroll(float scroll)
+  {
+    scroll = Clip(scroll, 0.f, GetMaxScroll());
+
+    if (scroll != mScroll)
+    {
+      mScroll = scroll;
+      SetDirty(false);
+    }
+  }
+
+  /** Get the rows that are at least partly visible, found from the scroll position rather than by laying out every row
+   * @param first The first row
+   * @param last The last row */
+  void GetVisibleRows(int& first, int& last) const
+  {
+    const int nRows = NRows();
+    first = Clip(static_cast<int>(std::floor(mScroll / mRowHeight)), 0, std::max(nRows - 1, 0));
+    last = Clip(static_cast<int>(std::ceil((mScroll + mListBounds.H()) / mRowHeight)) - 1, first, std::max(nRows - 1, 0));
+  }
+
+  IRECT GetRowBounds(int row) const
+  {
+    const float t = mListBounds.T + row * mRowHeight - mScroll;
+    const float r = GetMaxScroll() > 0.f ? mScrollBarBounds.L : mListBounds.R;
+    return IRECT(mListBounds.L, t, r, t + mRowHeight);
+  }
+
+  /** @return The row at a position, or -1 */
+  int GetRowForPos(float x, float y) const
+  {
+    if (!mListBounds.Contains(x, y) || (GetMaxScroll() > 0.f && mScrollBarBounds.Contains(x, y)))
+      return -1;
+
+    const int row = static_cast<int>(std::floor((y - mListBounds.T + mScroll) / mRowHeight));
+    return row < NRows() ? row : -1;
+  }
+
+  IRECT GetScrollThumbBounds() const
+  {
+    const float viewFrac = mListBounds.H() / GetContentHeight();
+    const float thumbH = std::max(mListBounds.H() * viewFrac, kScrollBarWidth * 2.f);
+    const float t = mListBounds.T + (mListBounds.H() - thumbH) * (mScroll / GetMaxScroll());
+    return IRECT(mScrollBarBounds.L, t, mScrollBarBounds.R, t + thumbH).GetPadded(-2.f);
+  }
+
+  void EnsureItemVisible(int itemIdx)
+  {
+    const int row = itemIdx > -1 ? GetRowForItem(itemIdx) : -1;
+
+    if (row < 0)
+      return;
+
+    const float t = row * mRowHeight;
+
+    if (t < mScroll)
+      SetScroll(t);
+    else if (t + mRowHeight > mScroll + mListBounds.H())
+      SetScroll(t + mRowHeight - mListBounds.H());
+  }
+
+  /** Move the selection up (delta < 0) or down by some rows, or select the first or last row if the selected item isn't shown */
+  void MoveSelection(int delta)
+  {
+    const int nRows = NRows();
+
+    if (!nRows)
+      return;
+
+    const int row = mSelectedItem > -1 ? GetRowForItem(mSelectedItem) : -1;
+    const int newRow = row < 0 ? (delta > 0 ? 0 : nRows - 1) : Clip(row + delta, 0, nRows - 1);
+    SetSelectedItem(GetItemForRow(newRow));
+  }
+
+  void ChooseItem(int itemIdx)
+  {
+    SetSelectedItem(itemIdx);
+
+    if (mItemChosenFunc)
+      mItemChosenFunc(itemIdx);
+  }
+
+  static constexpr float kScrollBarWidth = 10.f;
+
+  IListDataSource* mDataSource = nullptr;
+  IListSearchIndex mSearchIndex;
+  std::vector<int> mMatches; // the items that match mQuery, in order
+  WDL_String mQuery;
+  ItemChosenFunc mItemChosenFunc = nullptr;
+  IRECT mListBounds;
+  IRECT mSearchBounds;
+  IRECT mScrollBarBounds;
+  float mRowHeight;
+  float mScroll = 0.f;
+  int mSelectedItem = -1;
+  int mMouseOverRow = -1;
+  bool mShowSearch = true;
+  bool mDraggingScrollBar = false;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
@@ -49,21 +49,45 @@ public:
     SetDirty(false);
   }
 
+  void SetDirty(bool triggerAction = true, int valIdx = kNoValIdx) override
+  {
+    IVTrackControlBase::SetDirty(triggerAction, valIdx);
+    InvalidateLayers();
+  }
+
   void Draw(IGraphics& g) override
   {
-    DrawBackground(g, mRECT);
+    // The background, label, markers and frame only change when the whole control is dirtied, so they are cached in layers under and over the tracks
+    if (!g.CheckLayer(mBackgroundLayer))
+    {
+      g.StartLayer(this, mRECT);
+      DrawBackground(g, mRECT);
+      DrawLabel(g);
+      mBackgroundLayer = g.EndLayer();
+    }
+
+    g.DrawLayer(mBackgroundLayer);
     DrawWidget(g);
-    DrawLabel(g);
     
-    if (mResponse == EResponse::Log)
+    if (mResponse == EResponse::Log || mStyle.drawFrame)
     {
-      DrawMarkers(g);
+      if (!g.CheckLayer(mOverlayLayer))
+      {
+        g.StartLayer(this, mRECT);
+
+        if (mResponse == EResponse::Log)
+          DrawMarkers(g);
+
+        if (mStyle.drawFrame)
+          g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
+
+        mOverlayLayer = g.EndLayer();
+      }
+
+      g.DrawLayer(mOverlayLayer);
     }
-    
-    if (mStyle.drawFrame)
-      g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
   }
-  
+
   void DrawPeak(IGraphics& g, const IRECT& r, int chIdx, bool aboveBaseValue) override
   {
     g.FillRect(IVTrackControlBase::GetColor(kX1), r, &mBlend);
@@ -118,21 +142,40 @@ public:
         {
           auto ampValue = AmpToDB(static_cast<double>(d.vals[c]));
           auto linearPos = (ampValue + lowPointAbs)/rangeDB;
-          SetValue(Clip(linearPos, 0., 1.), c);
+          SetTrackValue(c, Clip(linearPos, 0., 1.));
         }
       }
       else
       {
         for (auto c = d.chanOffset; c < (d.chanOffset + d.nChans); c++)
         {
-          SetValue(Clip(static_cast<double>(d.vals[c]), 0., 1.), c);
+          SetTrackValue(c, Clip(static_cast<double>(d.vals[c]), 0., 1.));
         }
       }
-
-      SetDirty(false);
     }
   }
 protected:
+  /** Set the value of a channel, marking only its track dirty if the value changed */
+  void SetTrackValue(int chIdx, double value)
+  {
+    if (value != GetValue(chIdx))
+    {
+      SetValue(value, chIdx);
+      SetTrackDirty(chIdx);
+    }
+  }
+
+  void InvalidateLayers()
+  {
+    if (mBackgroundLayer)
+      mBackgroundLayer->Invalidate();
+
+    if (mOverlayLayer)
+      mOverlayLayer->Invalidate();
+  }
+
+  ILayerPtr mBackgroundLayer;
+  ILayerPtr mOverlayLayer;
   float mHighRangeDB;
   float mLowRangeDB;
   EResponse mResponse = EResponse::Linear;
@@ -203,16 +246,21 @@ public:
         double linearPeakPos = (peakValue + lowPointAbs)/rangeDB;
         double linearAvgPos = (avgValue + lowPointAbs)/rangeDB;
 
-        IVTrackControlBase::SetValue(Clip(linearAvgPos, 0., 1.), c);
-        mPeakValues[c] = static_cast<float>(linearPeakPos);
-      }
+        const double avgPos = Clip(linearAvgPos, 0., 1.);
+        const float peakPos = static_cast<float>(linearPeakPos);
 
-      IVTrackControlBase::SetDirty(false);
+        if (avgPos != IVTrackControlBase::GetValue(c) || peakPos != mPeakValues[c])
+        {
+          IVTrackControlBase::SetValue(avgPos, c);
+          mPeakValues[c] = peakPos;
+          IVMeterControl<MAXNC>::SetTrackDirty(c);
+        }
+      }
     }
   }
   
 protected:
-  std::array<float, MAXNC> mPeakValues;
+  std::array<float, MAXNC> mPeakValues = {};
 };
 
 const static IColor LED1 = {255, 36, 157, 16};
@@ -84,10 +84,10 @@ public:
   void SnapToMouse(float x, float y, EDirection direction, const IRECT& bounds, int valIdx = -1 /* TODO:: not used*/, double minClip = 0., double maxClip = 1.) override
   {
     bounds.Constrain(x, y);
-    int nVals = NVals();
 
     double value = 0.;
     int sliderTest = -1;
+    const int prevMouseOverTrack = mMouseOverTrack;
     
     int step = GetStepIdxForPos(x, y);
         
@@ -107,14 +107,7 @@ public:
         value = 1.f - (y-bounds.T) / bounds.H();
       }
       
-      for(auto i = 0; i < nVals; i++)
-      {
-        if(mTrackBounds.Get()[i].ContainsEdge(x, mTrackBounds.Get()[i].MH()))
-        {
-          sliderTest = i;
-          break;
-        }
-      }
+      sliderTest = FindTrack(x, [x](const IRECT& r) { return r.ContainsEdge(x, r.MH()); });
     }
     else
     {
@@ -131,14 +124,7 @@ public:
       {
         value = (x-bounds.L) / bounds.W();
       }
-      for(auto i = 0; i < nVals; i++)
-      {
-        if(mTrackBounds.Get()[i].ContainsEdge(mTrackBounds.Get()[i].MW(), y))
-        {
-          sliderTest = i;
-          break;
-        }
-      }
+      sliderTest = FindTrack(y, [y](const IRECT& r) { return r.ContainsEdge(r.MW(), y); });
     }
         
     if(!GetStepped())
@@ -151,6 +137,8 @@ public:
 
       mSliderHit = sliderTest;
       mMouseOverTrack = mSliderHit;
+      int dirtyLo = mSliderHit;
+      int dirtyHi = mSliderHit;
       
       if (!GetStepped() && mPrevSliderHit != -1) // LERP disabled when stepped
       {
@@ -175,16 +163,23 @@ public:
             SetValue(iplug::Lerp(GetValue(lowBounds), GetValue(highBounds), frac), i);
             OnNewValue(i, GetValue(i));
           }
+
+          dirtyLo = lowBounds;
+          dirtyHi = highBounds;
         }
       }
       mPrevSliderHit = mSliderHit;
+
+      // only the tracks this drag changed are redrawn and sent to the delegate
+      SetTracksDirty(dirtyLo, dirtyHi, true);
     }
     else
     {
       mSliderHit = -1;
     }
 
-    SetDirty(true); // will send all param vals to delegate
+    if (prevMouseOverTrack != mMouseOverTrack)
+      SetTrackDirty(prevMouseOverTrack);
   }
 
   void OnMouseDown(float x, float y, const IMouseMod& mod) override
@@ -207,7 +202,7 @@ public:
           {
             SetValue(0., ch);
             OnNewValue(ch, 0.);
-            SetDirty(true);
+            SetTracksDirty(ch, ch, true);
             return;
           }
         }
@@ -41,20 +41,36 @@ public:
     AttachIControl(this, label);
   }
   
+  void SetDirty(bool triggerAction = true, int valIdx = kNoValIdx) override
+  {
+    IControl::SetDirty(triggerAction, valIdx);
+
+    if (mBackgroundLayer)
+      mBackgroundLayer->Invalidate();
+  }
+
   void Draw(IGraphics& g) override
   {
-    DrawBackground(g, mRECT);
+    // Everything but the traces only changes when the whole control is dirtied, so it is cached in a layer
+    if (!g.CheckLayer(mBackgroundLayer))
+    {
+      g.StartLayer(this, mRECT);
+      DrawBackground(g, mRECT);
+      DrawLabel(g);
+      g.DrawHorizontalLine(GetColor(kSH), mWidgetBounds, 0.5, &mBlend, mStyle.frameThickness);
+
+      if (mStyle.drawFrame)
+        g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
+
+      mBackgroundLayer = g.EndLayer();
+    }
+
+    g.DrawLayer(mBackgroundLayer);
     DrawWidget(g);
-    DrawLabel(g);
-    
-    if (mStyle.drawFrame)
-      g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
   }
 
   void DrawWidget(IGraphics& g) override
   {
-    g.DrawHorizontalLine(GetColor(kSH), mWidgetBounds, 0.5, &mBlend, mStyle.frameThickness);
-    
     IRECT r = mWidgetBounds.GetPadded(-mPadding);
 
     for (int c=0; c<mBuf.nChans; c++)
@@ -77,9 +93,19 @@ public:
       IByteStream stream(pData, dataSize);
 
       int pos = 0;
-      pos = stream.Get(&mBuf, pos);
+      pos = stream.Get(&mNextBuf, pos);
+
+      // Only the traces are redrawn, and not at all while the data doesn't change (e.g. while the input is silent)
+      bool changed = mNextBuf.nChans != mBuf.nChans;
+
+      for (int c = 0; !changed && c < mBuf.nChans; c++)
+        changed = memcmp(mNextBuf.vals[c].data(), mBuf.vals[c].data(), mBufferSize * sizeof(float)) != 0;
 
-      SetDirty(false);
+      if (changed)
+      {
+        mBuf = mNextBuf;
+        SetDirtyRegion(mRECT);
+      }
     }
   }
   
@@ -92,6 +118,8 @@ public:
 
 private:
   ISenderData<MAXNC, std::array<float, MAXBUF>> mBuf;
+  ISenderData<MAXNC, std::array<float, MAXBUF>> mNextBuf;
+  ILayerPtr mBackgroundLayer;
   float mPadding = 2.f;
   int mBufferSize = MAXBUF;
 };
@@ -28,6 +28,7 @@ public:
    : IControl(bounds)
   {
     SetWantsMultiTouch(true);
+    SetPollDirty(true); // IsDirty() is overridden
   }
   
   void Draw(IGraphics& g) override
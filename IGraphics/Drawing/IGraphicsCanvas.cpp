@@ -9,6 +9,7 @@
 */
 
 #include "IGraphicsCanvas.h"
+#include "IPlugResourcePack.h"
 #include <string>
 #include <utility>
 #include <stdio.h>
@@ -49,6 +50,17 @@ public:
   {
     delete GetBitmap();
   }
+
+  val GetContext() const
+  {
+    if (mContext.isUndefined())
+      mContext = GetBitmap()->call<val>("getContext", std::string("2d"));
+
+    return mContext;
+  }
+
+private:
+  mutable val mContext = val::undefined();
 };
 
 struct IGraphicsCanvas::Font
@@ -94,6 +106,28 @@ IGraphicsCanvas::IGraphicsCanvas(IGEditorDelegate& dlg, int w, int h, int fps, f
 {
   StaticStorage<Font>::Accessor storage(sFontCache);
   storage.Retain();
+
+  // Replays the commands buffered by AddPathCommand() to a context, or a Path2D if there is no kPathBegin, the opcodes match EPathCommand
+  EM_ASM({
+    Module.iplugCanvasPath = function(ctx, ptr, size) {
+      var h = HEAPF32;
+      var i = ptr >>> 2;
+      var end = i + size;
+      while (i < end) {
+        switch (h[i++]) {
+          case 0: ctx.beginPath(); break;
+          case 1: ctx.closePath(); break;
+          case 2: ctx.moveTo(h[i], h[i + 1]); i += 2; break;
+          case 3: ctx.lineTo(h[i], h[i + 1]); i += 2; break;
+          case 4: ctx.bezierCurveTo(h[i], h[i + 1], h[i + 2], h[i + 3], h[i + 4], h[i + 5]); i += 6; break;
+          case 5: ctx.quadraticCurveTo(h[i], h[i + 1], h[i + 2], h[i + 3]); i += 4; break;
+          case 6: ctx.arc(h[i], h[i + 1], h[i + 2], h[i + 3], h[i + 4], h[i + 5] != 0); i += 6; break;
+        }
+      }
+    };
+  });
+
+  mPathFunc = val::module_property("iplugCanvasPath");
 }
 
 IGraphicsCanvas::~IGraphicsCanvas()
@@ -104,6 +138,9 @@ IGraphicsCanvas::~IGraphicsCanvas()
 
 void IGraphicsCanvas::DrawBitmap(const IBitmap& bitmap, const IRECT& bounds, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->DrawBitmap(bitmap, bounds, srcX, srcY, pBlend);
+
   val context = GetContext();
   val img = *bitmap.GetAPIBitmap()->GetBitmap();
   context.call<void>("save");
@@ -121,44 +158,139 @@ void IGraphicsCanvas::DrawBitmap(const IBitmap& bitmap, const IRECT& bounds, int
   PathClear();
 }
 
+val IGraphicsCanvas::GetContext() const
+{
+  FlushPathCommands();
+  return GetTargetContext();
+}
+
+val IGraphicsCanvas::GetTargetContext() const
+{
+  if (!mLayers.empty())
+    return static_cast<const Bitmap*>(mLayers.top()->GetAPIBitmap())->GetContext();
+
+  if (mCanvasContext.isUndefined())
+    mCanvasContext = val::global("document").call<val>("getElementById", std::string("canvas")).call<val>("getContext", std::string("2d"));
+
+  return mCanvasContext;
+}
+
+void IGraphicsCanvas::AddPathCommand(EPathCommand command, std::initializer_list<float> args)
+{
+  const APIBitmap* pTarget = mLayers.empty() ? nullptr : mLayers.top()->GetAPIBitmap();
+
+  // beginPath() discards the path that the buffered commands would build
+  if (command == kPathBegin && pTarget == mPathTarget)
+    mPathCommands.clear();
+
+  if (mPathCommands.empty() || pTarget != mPathTarget)
+  {
+    FlushPathCommands();
+    mPathTarget = pTarget;
+    mPathContext = GetTargetContext();
+  }
+
+  mPathCommands.push_back(static_cast<float>(command));
+  mPathCommands.insert(mPathCommands.end(), args);
+}
+
+void IGraphicsCanvas::FlushPathCommands() const
+{
+  if (mPathCommands.empty())
+    return;
+
+  mPathFunc(mPathContext, reinterpret_cast<uintptr_t>(mPathCommands.data()), static_cast<int>(mPathCommands.size()));
+  mPathCommands.clear();
+}
+
+val IGraphicsCanvas::GetCachedPath()
+{
+  const APIBitmap* pTarget = mLayers.empty() ? nullptr : mLayers.top()->GetAPIBitmap();
+
+  // Anything that changes the transform flushes the commands first, so a path is still all in the buffer if it was drawn with one transform
+  if (mPathCommands.size() < 2 || mPathCommands[0] != static_cast<float>(kPathBegin) || pTarget != mPathTarget)
+    return val::undefined();
+
+  const float* pCommands = mPathCommands.data() + 1;
+  const size_t nCommands = mPathCommands.size() - 1;
+  mCacheKey.assign(reinterpret_cast<const char*>(pCommands), nCommands * sizeof(float));
+
+  val path = mPathCache.Find(mCacheKey);
+
+  if (path.isUndefined())
+  {
+    path = val::global("Path2D").new_();
+    mPathFunc(path, reinterpret_cast<uintptr_t>(pCommands), static_cast<int>(nCommands));
+    mPathCache.Add(mCacheKey, path);
+  }
+
+  return path;
+}
+
 void IGraphicsCanvas::PathClear()
 {
-  GetContext().call<void>("beginPath");
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathClear();
+
+  AddPathCommand(kPathBegin);
 }
 
 void IGraphicsCanvas::PathClose()
 {
-  GetContext().call<void>("closePath");
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathClose();
+
+  AddPathCommand(kPathClose);
 }
 
 void IGraphicsCanvas::PathArc(float cx, float cy, float r, float a1, float a2, EWinding winding)
 {
-  GetContext().call<void>("arc", cx, cy, r, DegToRad(a1 - 90.f), DegToRad(a2 - 90.f), winding == EWinding::CCW);
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathArc(cx, cy, r, a1, a2, winding);
+
+  AddPathCommand(kPathArc, { cx, cy, r, DegToRad(a1 - 90.f), DegToRad(a2 - 90.f), winding == EWinding::CCW ? 1.f : 0.f });
 }
 
 void IGraphicsCanvas::PathMoveTo(float x, float y)
 {
-  GetContext().call<void>("moveTo", x, y);
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathMoveTo(x, y);
+
+  AddPathCommand(kPathMoveTo, { x, y });
 }
 
 void IGraphicsCanvas::PathLineTo(float x, float y)
 {
-  GetContext().call<void>("lineTo", x, y);
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathLineTo(x, y);
+
+  AddPathCommand(kPathLineTo, { x, y });
 }
 
 void IGraphicsCanvas::PathCubicBezierTo(float c1x, float c1y, float c2x, float c2y, float x2, float y2)
 {
-  GetContext().call<void>("bezierCurveTo", c1x, c1y, c2x, c2y, x2, y2);
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathCubicBezierTo(c1x, c1y, c2x, c2y, x2, y2);
+
+  AddPathCommand(kPathCubicTo, { c1x, c1y, c2x, c2y, x2, y2 });
 }
 
 void IGraphicsCanvas::PathQuadraticBezierTo(float cx, float cy, float x2, float y2)
 {
-  GetContext().call<void>("quadraticCurveTo", cx, cy, x2, y2);
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathQuadraticBezierTo(cx, cy, x2, y2);
+
+  AddPathCommand(kPathQuadraticTo, { cx, cy, x2, y2 });
 }
 
 void IGraphicsCanvas::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
-  val context = GetContext();
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathStroke(pattern, thickness, options, pBlend);
+
+  // The buffered commands are left for the context, in case the path is preserved and used for something else
+  val path = GetCachedPath();
+  val context = path.isUndefined() ? GetContext() : GetTargetContext();
   
   switch (options.mCapOption)
   {
@@ -187,7 +319,10 @@ void IGraphicsCanvas::PathStroke(const IPattern& pattern, float thickness, const
   
   SetCanvasSourcePattern(context, pattern, pBlend);
 
-  context.call<void>("stroke");
+  if (path.isUndefined())
+    context.call<void>("stroke");
+  else
+    context.call<void>("stroke", path);
   
   if (!options.mPreserve)
     PathClear();
@@ -195,12 +330,19 @@ void IGraphicsCanvas::PathStroke(const IPattern& pattern, float thickness, const
 
 void IGraphicsCanvas::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
 {
-  val context = GetContext();
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathFill(pattern, options, pBlend);
+
+  val path = GetCachedPath();
+  val context = path.isUndefined() ? GetContext() : GetTargetContext();
   std::string fillRule(options.mFillRule == EFillRule::Winding ? "nonzero" : "evenodd");
   
   SetCanvasSourcePattern(context, pattern, pBlend);
 
-  context.call<void>("fill", fillRule);
+  if (path.isUndefined())
+    context.call<void>("fill", fillRule);
+  else
+    context.call<void>("fill", path, fillRule);
 
   if (!options.mPreserve)
     PathClear();
@@ -225,19 +367,7 @@ void IGraphicsCanvas::SetCanvasSourcePattern(val& context, const IPattern& patte
     case EPatternType::Linear:
     case EPatternType::Radial:
     {
-      double x, y;
-      IMatrix m = IMatrix(pattern.mTransform).Invert();
-      m.TransformPoint(x, y, 0.0, 1.0);
-        
-      val gradient = (pattern.mType == EPatternType::Linear) ?
-        context.call<val>("createLinearGradient", m.mTX, m.mTY, x, y) :
-        context.call<val>("createRadialGradient", m.mTX, m.mTY, 0.0, m.mTX, m.mTY, m.mXX);
-      
-      for (int i = 0; i < pattern.NStops(); i++)
-      {
-        const IColorStop& stop = pattern.GetStop(i);
-        gradient.call<void>("addColorStop", stop.mOffset, CanvasColor(stop.mColor));
-      }
+      val gradient = GetCachedGradient(context, pattern);
       
       context.set("fillStyle", gradient);
       context.set("strokeStyle", gradient);
@@ -248,6 +378,48 @@ void IGraphicsCanvas::SetCanvasSourcePattern(val& context, const IPattern& patte
   }
 }
 
+val IGraphicsCanvas::GetCachedGradient(val& context, const IPattern& pattern)
+{
+  // A CanvasGradient isn't tied to the context that made it, so the layers share them
+  auto append = [this](const auto& value) { mCacheKey.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+  mCacheKey.clear();
+  append(pattern.mType);
+  append(pattern.mTransform.mXX); append(pattern.mTransform.mYX);
+  append(pattern.mTransform.mXY); append(pattern.mTransform.mYY);
+  append(pattern.mTransform.mTX); append(pattern.mTransform.mTY);
+
+  for (int i = 0; i < pattern.NStops(); i++)
+  {
+    const IColorStop& stop = pattern.GetStop(i);
+    append(stop.mOffset);
+    append(stop.mColor.A); append(stop.mColor.R); append(stop.mColor.G); append(stop.mColor.B);
+  }
+
+  val gradient = mGradientCache.Find(mCacheKey);
+
+  if (gradient.isUndefined())
+  {
+    double x, y;
+    IMatrix m = IMatrix(pattern.mTransform).Invert();
+    m.TransformPoint(x, y, 0.0, 1.0);
+      
+    gradient = (pattern.mType == EPatternType::Linear) ?
+      context.call<val>("createLinearGradient", m.mTX, m.mTY, x, y) :
+      context.call<val>("createRadialGradient", m.mTX, m.mTY, 0.0, m.mTX, m.mTY, m.mXX);
+    
+    for (int i = 0; i < pattern.NStops(); i++)
+    {
+      const IColorStop& stop = pattern.GetStop(i);
+      gradient.call<void>("addColorStop", stop.mOffset, CanvasColor(stop.mColor));
+    }
+
+    mGradientCache.Add(mCacheKey, gradient);
+  }
+
+  return gradient;
+}
+
 void IGraphicsCanvas::SetCanvasBlendMode(val& context, const IBlend* pBlend)
 {
   if (!pBlend)
@@ -268,20 +440,25 @@ void IGraphicsCanvas::SetCanvasBlendMode(val& context, const IBlend* pBlend)
   }
 }
 
-void IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const
+void IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, bool setFont) const
 {
   StaticStorage<Font>::Accessor storage(sFontCache);
   Font* pFont = storage.Find(text.mFont);
     
   assert(pFont && "No font found - did you forget to load it?");
   
-  FontDescriptor descriptor = &pFont->mDescriptor;
-  val context = GetContext();
-  std::string fontString = GetFontString(descriptor->first.Get(), descriptor->second.Get(), text.mSize * pFont->mEMRatio);
+  const TextLayout* pLayout = mTextLayoutCache.Find(text, str);
   
-  context.set("font", fontString);
+  if (!pLayout || setFont)
+  {
+    val context = GetContext();
+    SetCanvasFont(context, text, pFont);
+    
+    if (!pLayout)
+      pLayout = &mTextLayoutCache.Add(text, str, { context.call<val>("measureText", std::string(str))["width"].as<double>() });
+  }
   
-  const double textWidth = context.call<val>("measureText", std::string(str))["width"].as<double>();
+  const double textWidth = pLayout->mWidth;
   const double textHeight = text.mSize;
   const double ascender = pFont->mAscenderRatio * textHeight;
   const double descender = -(1.0 - pFont->mAscenderRatio) * textHeight;
@@ -303,6 +480,12 @@ void IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str,
   r = IRECT((float) x, (float) (y - ascender), (float) (x + textWidth), (float) (y + textHeight - ascender));
 }
 
+void IGraphicsCanvas::SetCanvasFont(val& context, const IText& text, const Font* pFont) const
+{
+  const Font::FontDesc* descriptor = &pFont->mDescriptor;
+  context.set("font", GetFontString(descriptor->first.Get(), descriptor->second.Get(), text.mSize * pFont->mEMRatio));
+}
+
 float IGraphicsCanvas::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
 {
   IRECT r = bounds;
@@ -318,7 +501,7 @@ void IGraphicsCanvas::DoDrawText(const IText& text, const char* str, const IRECT
   val context = GetContext();
   double x, y;
   
-  PrepareAndMeasureText(text, str, measured, x, y);
+  PrepareAndMeasureText(text, str, measured, x, y, true);
   PathTransformSave();
   DoTextRotation(text, bounds, measured);
   context.set("textBaseline", std::string("alphabetic"));
@@ -355,6 +538,13 @@ bool IGraphicsCanvas::BitmapExtSupported(const char* ext)
 
 APIBitmap* IGraphicsCanvas::LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext)
 {
+  if (location == EResourceLocation::kResourcePack)
+  {
+    int size = 0;
+    const void* pData = IResourcePack::GetRegistered(fileNameOrResID, size);
+    return pData ? LoadAPIBitmap(fileNameOrResID, pData, size, scale) : nullptr;
+  }
+
   return new Bitmap(GetPreloadedImages()[fileNameOrResID], fileNameOrResID + 1, scale);
 }
 
@@ -510,6 +700,10 @@ bool IGraphicsCanvas::AssetsLoaded()
     }
   }
   
+  // anything measured while the fonts were loading was measured with a fallback font
+  if (!mLoadingFonts.empty())
+    mTextLayoutCache.Clear();
+  
   mLoadingFonts.clear();
     
   return true;
@@ -517,6 +711,8 @@ bool IGraphicsCanvas::AssetsLoaded()
 
 void IGraphicsCanvas::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data)
 {
+  FlushPathCommands();
+
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
   int size = pBitmap->GetWidth() * pBitmap->GetHeight() * 4;
   val context = pBitmap->GetBitmap()->call<val>("getContext", std::string("2d"));
@@ -536,6 +732,8 @@ void IGraphicsCanvas::GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData&
 
 void IGraphicsCanvas::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow)
 {
+  FlushPathCommands();
+
   const APIBitmap* pBitmap = layer->GetAPIBitmap();
   int size = pBitmap->GetWidth() * pBitmap->GetHeight() * 4;
   
@@ -577,3 +775,51 @@ void IGraphicsCanvas::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, con
     layerContext.call<void>("drawImage", localCanvas, 0, 0, width, height, x, y, width, height);
   }
 }
+
+bool IGraphicsCanvas::ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma)
+{
+  FlushPathCommands();
+
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  int width = pBitmap->GetWidth();
+  int height = pBitmap->GetHeight();
+  double scale = pBitmap->GetScale() * pBitmap->GetDrawScale();
+  double x = shadow.mXOffset * scale;
+  double y = shadow.mYOffset * scale;
+  val layerCanvas = *pBitmap->GetBitmap();
+  val layerContext = layerCanvas.call<val>("getContext", std::string("2d"));
+  
+  Bitmap localBitmap(width, height, pBitmap->GetScale(), pBitmap->GetDrawScale());
+  val localCanvas = *localBitmap.GetBitmap();
+  val localContext = localCanvas.call<val>("getContext", std::string("2d"));
+  
+  // Browsers without the context filter property (older Safari) fall back to the CPU blur
+  if (localContext["filter"].isUndefined())
+    return false;
+  
+  // The browser blurs the layer when it's drawn, instead of it being read back with getImageData()
+  WDL_String filter;
+  filter.SetFormatted(64, "blur(%fpx)", blurSigma);
+  localContext.set("filter", std::string(filter.Get()));
+  localContext.call<void>("drawImage", layerCanvas, 0, 0);
+  localContext.set("filter", std::string("none"));
+  
+  IBlend blend(EBlend::SrcIn, shadow.mOpacity);
+  localContext.call<void>("rect", 0, 0, width, height);
+  localContext.call<void>("scale", scale, scale);
+  localContext.call<void>("translate", -(layer->Bounds().L + shadow.mXOffset), -(layer->Bounds().T + shadow.mYOffset));
+  SetCanvasSourcePattern(localContext, shadow.mPattern, &blend);
+  localContext.call<void>("fill");
+  
+  layerContext.call<void>("setTransform");
+  
+  if (!shadow.mDrawForeground)
+  {
+    layerContext.call<void>("clearRect", 0, 0, width, height);
+  }
+  
+  layerContext.set("globalCompositeOperation", "destination-over");
+  layerContext.call<void>("drawImage", localCanvas, 0, 0, width, height, x, y, width, height);
+  
+  return true;
+}
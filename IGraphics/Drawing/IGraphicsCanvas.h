@@ -13,9 +13,18 @@
 #include <emscripten/val.h>
 #include <emscripten/bind.h>
 
+#include <initializer_list>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "IPlugPlatform.h"
 
 #include "IGraphics.h"
+#include "IGraphicsTextCache.h"
 
 using namespace emscripten;
 
@@ -26,6 +35,9 @@ BEGIN_IGRAPHICS_NAMESPACE
 std::string CanvasColor(const IColor& color, float alpha = 1.0);
 
 /** IGraphics draw class HTML5 canvas
+* Each call into JavaScript has a fixed cost, so the path building calls (PathMoveTo(), PathLineTo()...) are buffered and replayed by a single call,
+* when the path is stroked or filled, or anything else uses the context. A path that is stroked or filled as it was built is kept as a Path2D, keyed by its commands,
+* so drawing the same path again (e.g. when a display list is replayed, or a control that hasn't changed is redrawn) is one call. Gradients are kept in the same way, keyed by the IPattern
 * @ingroup DrawClasses */
 class IGraphicsCanvas : public IGraphics
 {
@@ -72,19 +84,89 @@ protected:
 
   void GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data) override;
   void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) override;
+  bool ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma) override;
 
   float DoMeasureText(const IText& text, const char* str, IRECT& bounds) const override;
   void DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend) override;
     
 private:
-  void PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const;
+  struct TextLayout
+  {
+    double mWidth;
+  };
+
+  /** A least recently used cache of JavaScript objects that take several calls to make, keyed by the bytes that describe them
+   * @tparam MAXENTRIES The number of objects to keep before the least recently used ones are released */
+  template <int MAXENTRIES>
+  class JSObjectCache
+  {
+  public:
+    /** Find an object, and mark it as the most recently used
+     * @return The object, or undefined if it isn't cached */
+    val Find(const std::string& key)
+    {
+      auto it = mIndex.find(std::string_view(key));
+
+      if (it == mIndex.end())
+        return val::undefined();
+
+      mEntries.splice(mEntries.begin(), mEntries, it->second);
+      return it->second->second;
+    }
+
+    /** Add an object that Find() didn't return, releasing the least recently used one if the cache is full */
+    void Add(const std::string& key, val object)
+    {
+      mEntries.emplace_front(key, std::move(object));
+      mIndex[std::string_view(mEntries.front().first)] = mEntries.begin();
+
+      if (static_cast<int>(mEntries.size()) > MAXENTRIES)
+      {
+        mIndex.erase(std::string_view(mEntries.back().first));
+        mEntries.pop_back();
+      }
+    }
+
+  private:
+    using Entry = std::pair<std::string, val>;
+
+    // the index's keys view the strings in the list nodes, which don't move
+    std::list<Entry> mEntries;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> mIndex;
+  };
+  
+  void PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, bool setFont = false) const;
+  void SetCanvasFont(val& context, const IText& text, const Font* pFont) const;
     
-  val GetContext() const
+  /** @return The context for the main canvas or the current layer, after replaying any buffered path commands to it */
+  val GetContext() const;
+
+  /** @return The context for the main canvas or the current layer, cached rather than looked up again */
+  val GetTargetContext() const;
+
+  enum EPathCommand
   {
-    val canvas = mLayers.empty() ? val::global("document").call<val>("getElementById", std::string("canvas")) : *(mLayers.top()->GetAPIBitmap()->GetBitmap());
-      
-    return canvas.call<val>("getContext", std::string("2d"));
-  }
+    kPathBegin = 0,
+    kPathClose,
+    kPathMoveTo,
+    kPathLineTo,
+    kPathCubicTo,
+    kPathQuadraticTo,
+    kPathArc
+  };
+
+  /** Buffer a path command and its arguments, to be replayed by FlushPathCommands() */
+  void AddPathCommand(EPathCommand command, std::initializer_list<float> args = {});
+
+  /** Replay the buffered path commands to the context they were added for, with one call into JavaScript */
+  void FlushPathCommands() const;
+
+  /** Get the current path as a Path2D from mPathCache, making it if it isn't cached, rather than replaying it to the context
+   * @return The path, or undefined if part of it was already replayed to the context, or the transform was changed since it was started, so that it must be drawn from there */
+  val GetCachedPath();
+
+  /** @return The CanvasGradient for a linear or radial pattern from mGradientCache, made if it isn't cached */
+  val GetCachedGradient(val& context, const IPattern& pattern);
     
   void GetFontMetrics(const char* font, const char* style, double& ascenderRatio, double& EMRatio);
   bool CompareFontMetrics(const char* style, const char* font1, const char* font2);
@@ -100,6 +182,16 @@ private:
   void SetCanvasBlendMode(val& context, const IBlend* pBlend);
     
   std::vector<val> mLoadingFonts;
+  mutable val mCanvasContext = val::undefined();
+  mutable val mPathContext = val::undefined(); // the context that the buffered path commands are for
+  const APIBitmap* mPathTarget = nullptr; // the layer that the buffered path commands are for, or nullptr for the main canvas
+  mutable std::vector<float> mPathCommands;
+  val mPathFunc = val::undefined(); // Module.iplugCanvasPath(), which replays mPathCommands
+  JSObjectCache<512> mPathCache;
+  JSObjectCache<128> mGradientCache;
+  std::string mCacheKey; // reused for the lookups, so they don't allocate once it has grown
+  // measureText() is a call into JavaScript, so the widths are kept for the strings that are drawn again
+  mutable ITextLayoutCache<TextLayout> mTextLayoutCache;
 
   static StaticStorage<Font> sFontCache;
 };
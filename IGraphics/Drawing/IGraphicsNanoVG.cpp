@@ -12,6 +12,8 @@
 
 #include "IGraphicsNanoVG.h"
 #include "ITextEntryControl.h"
+#include "IPlugResourcePack.h"
+#include "IGraphicsBitmapCache.h"
 
 #if defined IGRAPHICS_GL
   #if defined OS_MAC
@@ -42,7 +44,13 @@
       #error Define either IGRAPHICS_GL2 or IGRAPHICS_GL3 when using IGRAPHICS_GL and IGRAPHICS_NANOVG with OS_WIN
     #endif
   #elif defined OS_LINUX
-    #error NOT IMPLEMENTED
+    #if defined IGRAPHICS_GL2
+      #define NANOVG_GL2_IMPLEMENTATION
+    #elif defined IGRAPHICS_GL3
+      #define NANOVG_GL3_IMPLEMENTATION
+    #else
+      #error Define either IGRAPHICS_GL2 or IGRAPHICS_GL3 when using IGRAPHICS_GL and IGRAPHICS_NANOVG with OS_LINUX
+    #endif
   #elif defined OS_WEB
     #if defined IGRAPHICS_GLES2
       #define NANOVG_GLES2_IMPLEMENTATION
@@ -64,6 +72,9 @@
   #error you must define either IGRAPHICS_GL2, IGRAPHICS_GLES2 etc or IGRAPHICS_METAL when using IGRAPHICS_NANOVG
 #endif
 
+#include "stb_image.h" // implemented in nanovg.c
+
+#include <algorithm>
 #include <string>
 #include <map>
 
@@ -72,19 +83,251 @@ using namespace igraphics;
 
 #pragma mark - Private Classes and Structs
 
+/** Read a whole file
+ * @param path The absolute path of the file
+ * @param result Filled with the file data
+ * @return \c true if the file was read */
+static bool ReadBitmapFile(const char* path, std::vector<unsigned char>& result)
+{
+  FILE* fd = fopen(path, "rb");
+
+  if (!fd)
+    return false;
+
+  bool success = false;
+
+  if (!fseek(fd, 0, SEEK_END))
+  {
+    const long size = ftell(fd);
+
+    if (size > 0 && !fseek(fd, 0, SEEK_SET))
+    {
+      result.resize(static_cast<size_t>(size));
+      success = fread(result.data(), 1, result.size(), fd) == result.size();
+    }
+  }
+
+  fclose(fd);
+  return success;
+}
+
+/** Bitmaps that have their own texture get mipmaps, so that they can be drawn at any scale without a scaled copy. GLES2 can only mipmap power of two textures */
+static int BitmapImageFlags(int width, int height)
+{
+#if defined IGRAPHICS_GLES2
+  if ((width & (width - 1)) || (height & (height - 1)))
+    return 0;
+#endif
+  return NVG_IMAGE_GENERATE_MIPMAPS;
+}
+
+/** A shared texture that small bitmaps and filmstrip frames are packed into, so that consecutive bitmap draws don't need to rebind textures.
+ * The rows that images have been packed into are kept on the CPU, and the rows changed since the last upload are uploaded once per frame, or when the page is drawn.
+ * Once there is no room for another row of images the page is sealed: the CPU copy is freed and images go on other pages */
+class IGraphicsNanoVG::AtlasPage
+{
+public:
+  static constexpr int kSize = 2048;
+  /** Images (or frames) bigger than this in either dimension get their own texture */
+  static constexpr int kMaxImageSize = 512;
+  /** Each image is surrounded by copies of its edge pixels, so that filtering at its edges (including the antialiasing fringe) matches a clamped texture */
+  static constexpr int kGutter = 2;
+
+  AtlasPage(NVGcontext* pContext)
+  : mVG(pContext)
+  {
+    // only the parts of the texture that images are packed into are ever sampled, so it doesn't need clearing
+    mImage = nvgCreateImageRGBA(mVG, kSize, kSize, 0, nullptr);
+  }
+
+  ~AtlasPage()
+  {
+    if (mImage)
+      nvgDeleteImage(mVG, mImage);
+  }
+
+  AtlasPage(const AtlasPage&) = delete;
+  AtlasPage& operator=(const AtlasPage&) = delete;
+
+  /** Copy RGBA pixels into free space on the page
+   * @param pPixels The first pixel of the image
+   * @param stride The number of pixels between the starts of the image's rows
+   * @param x Set to the left of the image on the page, in pixels
+   * @param y Set to the top of the image on the page, in pixels
+   * @return \c true if the image fit */
+  bool Add(const uint32_t* pPixels, int stride, int width, int height, int& x, int& y)
+  {
+    if (mSealed || !Allocate(width + 2 * kGutter, height + 2 * kGutter, x, y))
+      return false;
+
+    // the copy grows to the bottom of the last row of images, but no further than the page
+    const size_t nPixels = static_cast<size_t>(mNextShelfY) * kSize;
+
+    if (nPixels > mPixels.capacity())
+      mPixels.reserve(std::min(std::max(nPixels, 2 * mPixels.capacity()), static_cast<size_t>(kSize) * kSize));
+
+    mPixels.resize(nPixels);
+    mDirtyTop = std::min(mDirtyTop, y);
+    mDirtyBottom = std::max(mDirtyBottom, y + height + 2 * kGutter);
+
+    x += kGutter;
+    y += kGutter;
+
+    for (int row = -kGutter; row < height + kGutter; row++)
+    {
+      const uint32_t* pSrc = pPixels + Clip(row, 0, height - 1) * stride;
+      uint32_t* pDst = mPixels.data() + (y + row) * kSize + x;
+
+      for (int col = -kGutter; col < width + kGutter; col++)
+        pDst[col] = pSrc[Clip(col, 0, width - 1)];
+    }
+
+    return true;
+  }
+
+  /** Upload the rows that images were added to since the last upload, then seal the page if it is full */
+  void Upload()
+  {
+    if (mDirtyTop < mDirtyBottom)
+    {
+      // the backends offset the data by the first row, so the copy is passed from its start
+      const NVGparams* pParams = nvgInternalParams(mVG);
+      pParams->renderUpdateTexture(pParams->userPtr, mImage, 0, mDirtyTop, kSize, mDirtyBottom - mDirtyTop, reinterpret_cast<const unsigned char*>(mPixels.data()));
+      mDirtyTop = kSize;
+      mDirtyBottom = 0;
+    }
+
+    if (!mSealed && kSize - mNextShelfY < kMaxImageSize + 2 * kGutter)
+    {
+      std::vector<uint32_t>().swap(mPixels);
+      mSealed = true;
+    }
+  }
+
+  int GetImage() const { return mImage; }
+
+  /** @return The bytes of the texture and of the CPU copy */
+  size_t GetMemorySize() const { return static_cast<size_t>(kSize) * kSize * 4 + mPixels.capacity() * sizeof(uint32_t); }
+
+private:
+  struct Shelf
+  {
+    int mY;
+    int mHeight;
+    int mX;
+  };
+
+  // Shelf packing: images go on the shortest row they fit, unless that would waste more than half its height and there's room for a new row
+  bool Allocate(int width, int height, int& x, int& y)
+  {
+    Shelf* pBest = nullptr;
+
+    for (auto& shelf : mShelves)
+    {
+      if (height <= shelf.mHeight && shelf.mX + width <= kSize && (!pBest || shelf.mHeight < pBest->mHeight))
+        pBest = &shelf;
+    }
+
+    if ((!pBest || pBest->mHeight > 2 * height) && mNextShelfY + height <= kSize)
+    {
+      mShelves.push_back({ mNextShelfY, height, 0 });
+      mNextShelfY += height;
+      pBest = &mShelves.back();
+    }
+
+    if (!pBest)
+      return false;
+
+    x = pBest->mX;
+    y = pBest->mY;
+    pBest->mX += width;
+    return true;
+  }
+
+  NVGcontext* mVG;
+  int mImage = 0;
+  std::vector<uint32_t> mPixels;
+  std::vector<Shelf> mShelves;
+  int mNextShelfY = 0;
+  int mDirtyTop = kSize;
+  int mDirtyBottom = 0;
+  bool mSealed = false;
+};
+
 class IGraphicsNanoVG::Bitmap : public APIBitmap
 {
 public:
+  /** Where a frame of an atlased bitmap is */
+  struct AtlasFrame
+  {
+    std::shared_ptr<AtlasPage> mPage;
+    int mX;
+    int mY;
+  };
+
   Bitmap(NVGcontext* pContext, const char* path, double sourceScale, int nvgImageID, bool shared = false);
   Bitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, int width, int height, float scale, float drawScale);
   Bitmap(NVGcontext* pContext, int width, int height, const uint8_t* pData, float scale, float drawScale);
+  Bitmap(NVGcontext* pContext, std::vector<AtlasFrame>&& frames, int frameWidth, int frameHeight, bool framesAreHorizontal, int width, int height, double sourceScale);
+  Bitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, std::vector<unsigned char>&& encodedData, bool fromFile, int width, int height, double sourceScale);
   virtual ~Bitmap();
   NVGframebuffer* GetFBO() const { return mFBO; }
+
+  /** @return \c true if the bitmap keeps its encoded data and is only decoded into a texture while it's in use, see Decode() */
+  bool IsLazy() const { return !mEncodedData.empty(); }
+
+  /** @return \c true if a lazy bitmap currently has a texture */
+  bool IsDecoded() const { return GetBitmap() != 0; }
+
+  /** Create the texture of a lazy bitmap if it was evicted or hasn't been drawn yet. Does nothing for other bitmaps */
+  void Decode();
+
+  /** Free the texture of a lazy bitmap, it is decoded again the next time it is drawn */
+  void Evict();
+
+  /** Mark the bitmap as drawn or visible since the last eviction check */
+  void SetInUse(bool inUse) { mInUse = inUse; }
+  bool GetInUse() const { return mInUse; }
+
+  /** @return \c true if the bitmap is packed into atlas pages rather than having its own texture */
+  bool IsAtlased() const { return !mAtlasFrames.empty(); }
+
+  /** @return The bytes of the bitmap's own texture, if it has one, and of its encoded data if it's lazy. Atlas pages are counted separately */
+  size_t GetMemorySize() const
+  {
+    const size_t textureBytes = (IsDecoded() && !IsAtlased() && !mSharedTexture) ? static_cast<size_t>(GetWidth()) * GetHeight() * 4 : 0;
+    return textureBytes + mEncodedData.size();
+  }
+
+  /** Find a pixel of an atlased bitmap in the atlas
+   * @param x The x offset into the bitmap in pixels
+   * @param y The y offset into the bitmap in pixels
+   * @param atlasX Set to the x position of that pixel in the page
+   * @param atlasY Set to the y position of that pixel in the page
+   * @return The page holding the frame that contains the pixel */
+  AtlasPage* GetAtlasPosition(int x, int y, int& atlasX, int& atlasY) const
+  {
+    const int nFrames = static_cast<int>(mAtlasFrames.size());
+    const int frame = Clip(mFramesAreHorizontal ? x / mFrameWidth : y / mFrameHeight, 0, nFrames - 1);
+    const AtlasFrame& atlasFrame = mAtlasFrames[frame];
+
+    atlasX = atlasFrame.mX + x - (mFramesAreHorizontal ? frame * mFrameWidth : 0);
+    atlasY = atlasFrame.mY + y - (mFramesAreHorizontal ? 0 : frame * mFrameHeight);
+    return atlasFrame.mPage.get();
+  }
+
 private:
   IGraphicsNanoVG *mGraphics = nullptr;
   NVGcontext* mVG;
   NVGframebuffer* mFBO = nullptr;
   bool mSharedTexture = false;
+  std::vector<AtlasFrame> mAtlasFrames;
+  int mFrameWidth = 0;
+  int mFrameHeight = 0;
+  bool mFramesAreHorizontal = false;
+  std::vector<unsigned char> mEncodedData;
+  bool mFromFile = false;
+  bool mInUse = true;
 };
 
 IGraphicsNanoVG::Bitmap::Bitmap(NVGcontext* pContext, const char* path, double sourceScale, int nvgImageID, bool shared)
@@ -103,7 +346,7 @@ IGraphicsNanoVG::Bitmap::Bitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext
 {
   mGraphics = pGraphics;
   mVG = pContext;
-  mFBO = nvgCreateFramebuffer(pContext, width, height, 0);
+  mFBO = pGraphics->AcquireFBO(width, height);
   
   nvgBindFramebuffer(mFBO);
   
@@ -122,22 +365,89 @@ IGraphicsNanoVG::Bitmap::Bitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext
 
 IGraphicsNanoVG::Bitmap::Bitmap(NVGcontext* pContext, int width, int height, const uint8_t* pData, float scale, float drawScale)
 {
-  int idx = nvgCreateImageRGBA(pContext, width, height, 0, pData);
+  int idx = nvgCreateImageRGBA(pContext, width, height, BitmapImageFlags(width, height), pData);
   mVG = pContext;
   SetBitmap(idx, width, height, scale, drawScale);
 }
 
+IGraphicsNanoVG::Bitmap::Bitmap(NVGcontext* pContext, std::vector<AtlasFrame>&& frames, int frameWidth, int frameHeight, bool framesAreHorizontal, int width, int height, double sourceScale)
+{
+  assert(!frames.empty());
+
+  mVG = pContext;
+  mSharedTexture = true; // the pages are freed when the last bitmap using them is
+  mAtlasFrames = std::move(frames);
+  mFrameWidth = frameWidth;
+  mFrameHeight = frameHeight;
+  mFramesAreHorizontal = framesAreHorizontal;
+
+  SetBitmap(mAtlasFrames[0].mPage->GetImage(), width, height, sourceScale, 1.f);
+}
+
+IGraphicsNanoVG::Bitmap::Bitmap(IGraphicsNanoVG* pGraphics, NVGcontext* pContext, std::vector<unsigned char>&& encodedData, bool fromFile, int width, int height, double sourceScale)
+{
+  assert(!encodedData.empty());
+
+  mGraphics = pGraphics;
+  mVG = pContext;
+  mEncodedData = std::move(encodedData);
+  mFromFile = fromFile;
+
+  SetBitmap(0, width, height, sourceScale, 1.f);
+  mGraphics->mLazyBitmaps.push_back(this);
+}
+
 IGraphicsNanoVG::Bitmap::~Bitmap()
 {
-  if(!mSharedTexture)
+  if (IsLazy())
+  {
+    Evict();
+    auto& lazyBitmaps = mGraphics->mLazyBitmaps;
+    lazyBitmaps.erase(std::remove(lazyBitmaps.begin(), lazyBitmaps.end(), this), lazyBitmaps.end());
+  }
+  else if(!mSharedTexture)
   {
     if(mFBO)
-      mGraphics->DeleteFBO(mFBO);
+      mGraphics->ReleaseFBO(mFBO, GetWidth(), GetHeight());
     else
       nvgDeleteImage(mVG, GetBitmap());
   }
 }
 
+void IGraphicsNanoVG::Bitmap::Decode()
+{
+  if (!IsLazy() || IsDecoded())
+    return;
+
+  // Decode the same way as LoadPixelsBitmap()
+  if (mFromFile)
+  {
+    stbi_set_unpremultiply_on_load(1);
+    stbi_convert_iphone_png_to_rgb(1);
+  }
+
+  int width = 0, height = 0, nComponents = 0;
+  unsigned char* pPixels = stbi_load_from_memory(mEncodedData.data(), static_cast<int>(mEncodedData.size()), &width, &height, &nComponents, 4);
+  int idx = 0;
+
+  if (pPixels)
+  {
+    idx = nvgCreateImageRGBA(mVG, width, height, BitmapImageFlags(width, height), pPixels);
+    stbi_image_free(pPixels);
+  }
+
+  SetBitmap(idx, GetWidth(), GetHeight(), GetScale(), GetDrawScale());
+}
+
+void IGraphicsNanoVG::Bitmap::Evict()
+{
+  if (IsLazy() && IsDecoded())
+  {
+    nvgDeleteImage(mVG, GetBitmap());
+    SetBitmap(0, GetWidth(), GetHeight(), GetScale(), GetDrawScale());
+  }
+}
+
 // Fonts
 static StaticStorage<IFontData> sFontCache;
 
@@ -262,6 +572,34 @@ const char* IGraphicsNanoVG::GetDrawingAPIStr()
 #endif
 }
 
+void IGraphicsNanoVG::GetMemoryReport(IMemoryReport& report)
+{
+  IGraphics::GetMemoryReport(report);
+
+  // bitmaps are textures of this context, so they belong to the instance even though they're loaded through a cache
+  size_t bytes = 0;
+
+  {
+    StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
+    storage.ForEach([&bytes](const APIBitmap& bitmap) { bytes += static_cast<const Bitmap&>(bitmap).GetMemorySize(); });
+  }
+
+  for (const auto& pPage : mAtlasPages)
+    bytes += pPage->GetMemorySize();
+
+  report.Add(kMemoryBitmaps, bytes);
+  report.Add(kMemoryBitmaps, IDecodedBitmapCache::Get().GetStats().mBytes, true);
+
+  size_t fontBytes = 0;
+
+  {
+    StaticStorage<IFontData>::Accessor storage(sFontCache);
+    storage.ForEach([&fontBytes](IFontData& font) { fontBytes += font.GetSize(); });
+  }
+
+  report.Add(kMemoryFonts, fontBytes, true);
+}
+
 bool IGraphicsNanoVG::BitmapExtSupported(const char* ext)
 {
   char extLower[32];
@@ -297,29 +635,70 @@ IBitmap IGraphicsNanoVG::LoadBitmap(const char* name, int nStates, bool framesAr
       return IBitmap(); // return invalid IBitmap
     }
 
-    pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
-    
-    storage.Add(pAPIBitmap, name, sourceScale);
+    // The bitmap is drawn at whatever scale it was loaded at, so reuse it if it's already loaded at the source scale
+    if (sourceScale != targetScale)
+      pAPIBitmap = storage.Find(name, sourceScale);
 
-    assert(pAPIBitmap && "Bitmap not loaded");
+    if (!pAPIBitmap)
+    {
+      mLoadingStates = nStates;
+      mLoadingFramesAreHorizontal = framesAreHorizontal;
+      pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
+      mLoadingStates = 1;
+      mLoadingFramesAreHorizontal = false;
+      
+      storage.Add(pAPIBitmap, name, sourceScale);
+
+      assert(pAPIBitmap && "Bitmap not loaded");
+    }
   }
   
   return IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name);
 }
 
+void IGraphicsNanoVG::ReleaseBitmap(const IBitmap& bitmap)
+{
+  StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
+  storage.Remove(bitmap.GetAPIBitmap());
+  PruneAtlasPages();
+}
+
+void IGraphicsNanoVG::RetainBitmap(const IBitmap& bitmap, const char* cacheName)
+{
+  StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
+
+  // Bitmaps loaded by LoadAPIBitmap() are already in the cache
+  if (storage.Find(cacheName, bitmap.GetScale()) != bitmap.GetAPIBitmap())
+    storage.Add(bitmap.GetAPIBitmap(), cacheName, bitmap.GetScale());
+}
+
 APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext)
 {
   int idx = 0;
-  int nvgImageFlags = 0;
+  APIBitmap* pBitmap = nullptr;
   
 #ifdef OS_IOS
   if (location == EResourceLocation::kPreloadedTexture)
   {
+    int nvgImageFlags = 0;
     idx = mnvgCreateImageFromHandle(mVG, gTextureMap[fileNameOrResID], nvgImageFlags);
   }
   else
 #endif
   
+  if (location == EResourceLocation::kResourcePack)
+  {
+    int size = 0;
+    const void* pResData = IResourcePack::GetRegistered(fileNameOrResID, size);
+
+    if (pResData)
+    {
+      ActivateGLContext(); // no-op on non WIN/GL
+      pBitmap = LoadPixelsBitmap((const unsigned char*) pResData, size, nullptr, fileNameOrResID, scale);
+      DeactivateGLContext(); // no-op on non WIN/GL
+    }
+  }
+  else
 #ifdef OS_WIN
   if (location == EResourceLocation::kWinBinary)
   {
@@ -331,7 +710,7 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* fileNameOrResID, int scale
     if (pResData)
     {
       ActivateGLContext(); // no-op on non WIN/GL
-      idx = nvgCreateImageMem(mVG, nvgImageFlags, (unsigned char*) pResData, size);
+      pBitmap = LoadPixelsBitmap((const unsigned char*) pResData, size, nullptr, fileNameOrResID, scale);
       DeactivateGLContext(); // no-op on non WIN/GL
     }
   }
@@ -340,10 +719,13 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* fileNameOrResID, int scale
   if (location == EResourceLocation::kAbsolutePath)
   {
     ActivateGLContext(); // no-op on non WIN/GL
-    idx = nvgCreateImage(mVG, fileNameOrResID, nvgImageFlags);
+    pBitmap = LoadPixelsBitmap(nullptr, 0, fileNameOrResID, fileNameOrResID, scale);
     DeactivateGLContext(); // no-op on non WIN/GL
   }
 
+  if (pBitmap)
+    return pBitmap;
+
   return new Bitmap(mVG, fileNameOrResID, scale, idx, location == EResourceLocation::kPreloadedTexture);
 }
 
@@ -354,14 +736,12 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* name, const void* pData, i
 
   if (!pBitmap)
   {
-    int idx = 0;
-    int nvgImageFlags = 0;
-
     ActivateGLContext();
-    idx = idx = nvgCreateImageMem(mVG, nvgImageFlags, (unsigned char*)pData, dataSize);
+    pBitmap = LoadPixelsBitmap((const unsigned char*) pData, dataSize, nullptr, name, scale);
     DeactivateGLContext();
 
-    pBitmap = new Bitmap(mVG, name, scale, idx, false);
+    if (!pBitmap)
+      pBitmap = new Bitmap(mVG, name, scale, 0, false);
 
     storage.Add(pBitmap, name, scale);
   }
@@ -369,6 +749,169 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* name, const void* pData, i
   return pBitmap;
 }
 
+APIBitmap* IGraphicsNanoVG::CreateBlankBitmap(int width, int height, int scale)
+{
+  // The texture's contents are undefined until SetBitmapPixels(), WebGL clears it
+  return new Bitmap(mVG, width, height, nullptr, static_cast<float>(scale), 1.f);
+}
+
+void IGraphicsNanoVG::SetBitmapPixels(APIBitmap* pBitmap, const unsigned char* pRGBA)
+{
+  const int width = pBitmap->GetWidth();
+  const int height = pBitmap->GetHeight();
+
+  // Replace the texture rather than nvgUpdateImage() it, so that the mipmaps are made from the new pixels
+  ActivateGLContext(); // no-op on non WIN/GL
+  nvgDeleteImage(mVG, pBitmap->GetBitmap());
+  pBitmap->SetBitmap(nvgCreateImageRGBA(mVG, width, height, BitmapImageFlags(width, height), pRGBA), width, height, pBitmap->GetScale(), pBitmap->GetDrawScale());
+  DeactivateGLContext(); // no-op on non WIN/GL
+}
+
+APIBitmap* IGraphicsNanoVG::LoadPixelsBitmap(const unsigned char* pData, int dataSize, const char* path, const char* cacheName, int scale)
+{
+  int width = 0, height = 0, nComponents = 0;
+  unsigned char* pPixels = nullptr;
+
+  // Filmstrips that would fill more than an atlas page keep their encoded data, and are only decoded while they're drawn or visible, see EvictHiddenBitmaps()
+  if (mLoadingStates > 1 && (pData ? stbi_info_from_memory(pData, dataSize, &width, &height, &nComponents) : stbi_info(path, &width, &height, &nComponents))
+      && static_cast<int64_t>(width) * height > AtlasPage::kSize * AtlasPage::kSize)
+  {
+    std::vector<unsigned char> encodedData;
+
+    if (pData)
+      encodedData.assign(pData, pData + dataSize);
+    else if (!ReadBitmapFile(path, encodedData))
+      return nullptr;
+
+    return new Bitmap(this, mVG, std::move(encodedData), !pData, width, height, scale);
+  }
+
+  auto createBitmap = [this, scale](const unsigned char* pRGBA, int w, int h) {
+    APIBitmap* pBitmap = CreateAtlasBitmap(pRGBA, w, h, scale);
+
+    if (!pBitmap)
+      pBitmap = new Bitmap(mVG, w, h, pRGBA, static_cast<float>(scale), 1.f);
+
+    return pBitmap;
+  };
+
+  // A bitmap decoded for an editor that has since been closed only needs uploading again
+  if (IDecodedBitmapCache::BitmapPtr pDecoded = IDecodedBitmapCache::Get().Find(cacheName, scale))
+    return createBitmap(pDecoded->mPixels.data(), pDecoded->mWidth, pDecoded->mHeight);
+
+  // Decode the same way as nvgCreateImage() and nvgCreateImageMem()
+  if (pData)
+  {
+    pPixels = stbi_load_from_memory(pData, dataSize, &width, &height, &nComponents, 4);
+  }
+  else
+  {
+    stbi_set_unpremultiply_on_load(1);
+    stbi_convert_iphone_png_to_rgb(1);
+    pPixels = stbi_load(path, &width, &height, &nComponents, 4);
+  }
+
+  if (!pPixels)
+    return nullptr;
+
+  IDecodedBitmapCache::Get().Add(cacheName, scale, width, height, pPixels);
+
+  APIBitmap* pBitmap = createBitmap(pPixels, width, height);
+  stbi_image_free(pPixels);
+
+  return pBitmap;
+}
+
+APIBitmap* IGraphicsNanoVG::CreateAtlasBitmap(const unsigned char* pPixels, int width, int height, int scale)
+{
+  const bool horizontal = mLoadingFramesAreHorizontal;
+  int nFrames = 1;
+  int frameWidth = width;
+  int frameHeight = height;
+
+  // Small bitmaps are packed whole, bigger filmstrips are packed frame by frame
+  if (width > AtlasPage::kMaxImageSize || height > AtlasPage::kMaxImageSize)
+  {
+    const int length = horizontal ? width : height;
+
+    if (mLoadingStates <= 1 || length % mLoadingStates)
+      return nullptr;
+
+    nFrames = mLoadingStates;
+    frameWidth = horizontal ? width / nFrames : width;
+    frameHeight = horizontal ? height : height / nFrames;
+
+    if (frameWidth > AtlasPage::kMaxImageSize || frameHeight > AtlasPage::kMaxImageSize)
+      return nullptr;
+  }
+
+  std::vector<Bitmap::AtlasFrame> frames(nFrames);
+  const uint32_t* pImage = reinterpret_cast<const uint32_t*>(pPixels);
+
+  for (int i = 0; i < nFrames; i++)
+  {
+    const uint32_t* pFrame = pImage + (horizontal ? i * frameWidth : i * frameHeight * width);
+    Bitmap::AtlasFrame& frame = frames[i];
+
+    for (auto& pPage : mAtlasPages)
+    {
+      if (pPage->Add(pFrame, width, frameWidth, frameHeight, frame.mX, frame.mY))
+      {
+        frame.mPage = pPage;
+        break;
+      }
+    }
+
+    if (!frame.mPage)
+    {
+      auto pPage = std::make_shared<AtlasPage>(mVG);
+
+      if (!pPage->GetImage() || !pPage->Add(pFrame, width, frameWidth, frameHeight, frame.mX, frame.mY))
+        return nullptr;
+
+      mAtlasPages.push_back(pPage);
+      frame.mPage = pPage;
+    }
+  }
+
+  return new Bitmap(mVG, std::move(frames), frameWidth, frameHeight, horizontal, width, height, scale);
+}
+
+void IGraphicsNanoVG::EvictHiddenBitmaps()
+{
+  // Roughly once a second while the UI is drawing
+  if (mLazyBitmaps.empty() || ++mFramesSinceEvictionCheck < FPS())
+    return;
+
+  mFramesSinceEvictionCheck = 0;
+
+  if (std::none_of(mLazyBitmaps.begin(), mLazyBitmaps.end(), [](const Bitmap* pBitmap) { return pBitmap->IsDecoded(); }))
+    return;
+
+  // A bitmap control that isn't redrawn is still on screen, so keep the bitmaps of visible controls as well as those drawn since the last check
+  ForAllControlsFunc([](IControl* pControl) {
+    IBitmapBase* pBitmapBase = dynamic_cast<IBitmapBase*>(pControl);
+
+    if (pBitmapBase && !pControl->IsHidden() && pBitmapBase->GetBitmap().GetAPIBitmap())
+      static_cast<Bitmap*>(pBitmapBase->GetBitmap().GetAPIBitmap())->SetInUse(true);
+  });
+
+  for (Bitmap* pBitmap : mLazyBitmaps)
+  {
+    if (!pBitmap->GetInUse())
+      pBitmap->Evict();
+
+    pBitmap->SetInUse(false);
+  }
+}
+
+void IGraphicsNanoVG::PruneAtlasPages()
+{
+  mAtlasPages.erase(std::remove_if(mAtlasPages.begin(), mAtlasPages.end(), [](const std::shared_ptr<AtlasPage>& pPage) {
+    return pPage.use_count() == 1;
+  }), mAtlasPages.end());
+}
+
 APIBitmap* IGraphicsNanoVG::CreateAPIBitmap(int width, int height, float scale, double drawScale, bool cacheable)
 {
   if (mInDraw)
@@ -411,39 +954,151 @@ void IGraphicsNanoVG::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, con
   
   if (mask.GetSize() >= size)
   {
-    if (!shadow.mDrawForeground)
-    {
-      PushLayer(layer.get());
-      nvgGlobalCompositeBlendFunc(mVG, NVG_ZERO, NVG_ZERO);
-      PathRect(layer->Bounds());
-      nvgFillColor(mVG, NanoVGColor(COLOR_TRANSPARENT));
-      nvgFill(mVG);
-      PopLayer();
-    }
-    
-    IRECT bounds(layer->Bounds());
-    
     Bitmap maskRawBitmap(mVG, width, height, mask.Get(), pBitmap->GetScale(), pBitmap->GetDrawScale());
-    APIBitmap* shadowBitmap = CreateAPIBitmap(width, height, pBitmap->GetScale(), pBitmap->GetDrawScale());
-    IBitmap tempLayerBitmap(shadowBitmap, 1, false);
     IBitmap maskBitmap(&maskRawBitmap, 1, false);
-    ILayer shadowLayer(shadowBitmap, layer->Bounds(), nullptr, IRECT());
+    ApplyShadowBitmap(layer, maskBitmap, shadow);
+  }
+}
+
+bool IGraphicsNanoVG::ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma)
+{
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  const int width = pBitmap->GetWidth();
+  const int height = pBitmap->GetHeight();
+  
+  // Halve the resolution until the remaining blur is a couple of pixels, blur that with two tap passes and scale it back up, all in framebuffers on the GPU
+  int nLevels = 0;
+  
+  while (nLevels < 6 && blurSigma / (1 << nLevels) > 2.f && (width >> (nLevels + 1)) > 0 && (height >> (nLevels + 1)) > 0)
+    nLevels++;
+  
+  const int smallWidth = width >> nLevels;
+  const int smallHeight = height >> nLevels;
+  
+  std::vector<std::unique_ptr<APIBitmap>> levels; // the intermediate downsampled levels
+  std::unique_ptr<APIBitmap> pingPong[2];
+  std::unique_ptr<APIBitmap> pMask(CreateAPIBitmap(width, height, pBitmap->GetScale(), pBitmap->GetDrawScale()));
+  
+  for (int l = 1; l < nLevels; l++)
+    levels.emplace_back(CreateAPIBitmap(width >> l, height >> l, 1.f, 1.));
+  
+  for (auto& pBuffer : pingPong)
+    pBuffer.reset(CreateAPIBitmap(smallWidth, smallHeight, 1.f, 1.));
+  
+  if (mInDraw)
+    nvgEndFrame(mVG);
+  
+  auto RenderTo = [this](APIBitmap* pDest, auto&& draw) {
+    const int w = pDest->GetWidth();
+    const int h = pDest->GetHeight();
+    
+    nvgBindFramebuffer(static_cast<Bitmap*>(pDest)->GetFBO());
+#ifdef IGRAPHICS_METAL
+    mnvgClearWithColor(mVG, nvgRGBAf(0, 0, 0, 0));
+#else
+    glViewport(0, 0, w, h);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+#endif
+    nvgBeginFrame(mVG, w, h, 1.f);
+    draw(static_cast<float>(w), static_cast<float>(h));
+    nvgEndFrame(mVG);
+  };
+  
+  auto FillWithImage = [this](int image, float x, float y, float w, float h, float alpha) {
+    NVGpaint paint = nvgImagePattern(mVG, x, y, w, h, 0.f, image, alpha);
+    nvgBeginPath(mVG);
+    nvgRect(mVG, 0.f, 0.f, w, h);
+    nvgFillPaint(mVG, paint);
+    nvgFill(mVG);
+  };
+  
+  // Downsample, each step averaging 2x2 pixels with bilinear filtering
+  int srcImage = pBitmap->GetBitmap();
+  const int nSteps = std::max(nLevels, 1);
+  
+  for (int step = 1; step <= nSteps; step++)
+  {
+    APIBitmap* pDest = step == nSteps ? pingPong[0].get() : levels[step - 1].get();
+    RenderTo(pDest, [&](float w, float h) { FillWithImage(srcImage, 0.f, 0.f, w, h, 1.f); });
+    srcImage = pDest->GetBitmap();
+  }
+  
+  // Each pass averages two taps offset by +/- offset pixels, adding offset^2 to the variance. The rescaling accounts for roughly half a pixel^2
+  const float smallSigma = blurSigma / (1 << nLevels);
+  const float variance = smallSigma * smallSigma - (nLevels > 0 ? 0.5f : 0.f);
+  const int nPasses = 3;
+  int current = 0;
+  
+  if (variance > 0.f)
+  {
+    const float offset = std::sqrt(variance / nPasses);
     
-    PathTransformSave();
+    for (int pass = 0; pass < nPasses * 2; pass++)
+    {
+      const float dx = pass < nPasses ? offset : 0.f;
+      const float dy = pass < nPasses ? 0.f : offset;
+      const int image = pingPong[current]->GetBitmap();
+      
+      RenderTo(pingPong[current ^ 1].get(), [&](float w, float h) {
+        nvgGlobalCompositeBlendFunc(mVG, NVG_ONE, NVG_ONE);
+        FillWithImage(image, -dx, -dy, w, h, 0.5f);
+        FillWithImage(image, dx, dy, w, h, 0.5f);
+      });
+      
+      current ^= 1;
+    }
+  }
+  
+  // Upsample into the mask
+  const int blurredImage = pingPong[current]->GetBitmap();
+  RenderTo(pMask.get(), [&](float w, float h) { FillWithImage(blurredImage, 0.f, 0.f, w, h, 1.f); });
+  
+  if (mInDraw)
+    UpdateLayer();
+  
+  IBitmap maskBitmap(pMask.get(), 1, false);
+  ApplyShadowBitmap(layer, maskBitmap, shadow);
+  
+  return true;
+}
+
+void IGraphicsNanoVG::ApplyShadowBitmap(ILayerPtr& layer, const IBitmap& maskBitmap, const IShadow& shadow)
+{
+  const APIBitmap* pBitmap = layer->GetAPIBitmap();
+  int width = pBitmap->GetWidth();
+  int height = pBitmap->GetHeight();
+  
+  if (!shadow.mDrawForeground)
+  {
     PushLayer(layer.get());
-    PushLayer(&shadowLayer);
-    DrawBitmap(maskBitmap, bounds, 0, 0, nullptr);
-    IBlend blend1(EBlend::SrcIn, 1.0);
+    nvgGlobalCompositeBlendFunc(mVG, NVG_ZERO, NVG_ZERO);
     PathRect(layer->Bounds());
-    PathTransformTranslate(-shadow.mXOffset, -shadow.mYOffset);
-    PathFill(shadow.mPattern, IFillOptions(), &blend1);
+    nvgFillColor(mVG, NanoVGColor(COLOR_TRANSPARENT));
+    nvgFill(mVG);
     PopLayer();
-    IBlend blend2(EBlend::DstOver, shadow.mOpacity);
-    bounds.Translate(shadow.mXOffset, shadow.mYOffset);
-    DrawBitmap(tempLayerBitmap, bounds, 0, 0, &blend2);
-    PopLayer();
-    PathTransformRestore();
   }
+  
+  IRECT bounds(layer->Bounds());
+  
+  APIBitmap* shadowBitmap = CreateAPIBitmap(width, height, pBitmap->GetScale(), pBitmap->GetDrawScale());
+  IBitmap tempLayerBitmap(shadowBitmap, 1, false);
+  ILayer shadowLayer(shadowBitmap, layer->Bounds(), nullptr, IRECT());
+  
+  PathTransformSave();
+  PushLayer(layer.get());
+  PushLayer(&shadowLayer);
+  DrawBitmap(maskBitmap, bounds, 0, 0, nullptr);
+  IBlend blend1(EBlend::SrcIn, 1.0);
+  PathRect(layer->Bounds());
+  PathTransformTranslate(-shadow.mXOffset, -shadow.mYOffset);
+  PathFill(shadow.mPattern, IFillOptions(), &blend1);
+  PopLayer();
+  IBlend blend2(EBlend::DstOver, shadow.mOpacity);
+  bounds.Translate(shadow.mXOffset, shadow.mYOffset);
+  DrawBitmap(tempLayerBitmap, bounds, 0, 0, &blend2);
+  PopLayer();
+  PathTransformRestore();
 }
 
 void IGraphicsNanoVG::OnViewInitialized(void* pContext)
@@ -465,11 +1120,27 @@ void IGraphicsNanoVG::OnViewDestroyed()
 
   StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
   storage.Clear();
+  mAtlasPages.clear();
+
+  {
+    WDL_MutexLock lock(&mFBOMutex);
+    TrimFBOPool(0);
+  }
+
+  ClearFBOStack();
   
   if(mMainFrameBuffer != nullptr)
     nvgDeleteFramebuffer(mMainFrameBuffer);
   
   mMainFrameBuffer = nullptr;
+
+#if defined IGRAPHICS_GL3
+  if (mGPUTimerQueries[0])
+    glDeleteQueries(2, mGPUTimerQueries);
+
+  mGPUTimerQueries[0] = mGPUTimerQueries[1] = 0;
+  mGPUTimerPending[0] = mGPUTimerPending[1] = false;
+#endif
   
   if(mVG)
     nvgDeleteContext(mVG);
@@ -504,7 +1175,23 @@ void IGraphicsNanoVG::BeginFrame()
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &mInitialFBO); // stash apple fbo
   #endif
 #endif
+
+#if defined IGRAPHICS_GL3
+  if (DrawBenchmarkRunning())
+  {
+    if (!mGPUTimerQueries[0])
+      glGenQueries(2, mGPUTimerQueries);
+
+    glBeginQuery(GL_TIME_ELAPSED, mGPUTimerQueries[mGPUTimerIdx]);
+    mGPUTimerPending[mGPUTimerIdx] = false;
+    mGPUTimerActive = true;
+  }
+#endif
   
+  // images packed since the last frame go up in one upload per page
+  for (auto& pPage : mAtlasPages)
+    pPage->Upload();
+
   nvgBindFramebuffer(mMainFrameBuffer); // begin main frame buffer update
   nvgBeginFrame(mVG, WindowWidth(), WindowHeight(), GetScreenScale());
 }
@@ -531,13 +1218,51 @@ void IGraphicsNanoVG::EndFrame()
 #endif
 
   nvgEndFrame(mVG);
+
+#if defined IGRAPHICS_GL3
+  if (mGPUTimerActive)
+  {
+    glEndQuery(GL_TIME_ELAPSED);
+    mGPUTimerPending[mGPUTimerIdx] = true;
+    mGPUTimerIdx ^= 1;
+    mGPUTimerActive = false;
+  }
+#endif
   
   mInDraw = false;
   ClearFBOStack();
+  EvictHiddenBitmaps();
+}
+
+double IGraphicsNanoVG::GetGPUFrameTime()
+{
+#if defined IGRAPHICS_GL3
+  // the query after the one that has just ended is the previous frame's, which has had a frame to complete
+  const int idx = mGPUTimerIdx;
+
+  if (mGPUTimerPending[idx])
+  {
+    GLint available = 0;
+    glGetQueryObjectiv(mGPUTimerQueries[idx], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available)
+    {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(mGPUTimerQueries[idx], GL_QUERY_RESULT, &elapsed);
+      mGPUTimerPending[idx] = false;
+      return elapsed * 1e-9;
+    }
+  }
+#endif
+
+  return -1.;
 }
 
 void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->DrawBitmap(bitmap, dest, srcX, srcY, pBlend);
+
   APIBitmap* pAPIBitmap = bitmap.GetAPIBitmap();
   
   assert(pAPIBitmap);
@@ -548,11 +1273,34 @@ void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int s
 
   nvgTransformScale(imgPaint.xform, scale, scale);
 
-  imgPaint.xform[4] = dest.L - srcX;
-  imgPaint.xform[5] = dest.T - srcY;
-  imgPaint.extent[0] = bitmap.W() * bitmap.GetScale();
-  imgPaint.extent[1] = bitmap.H() * bitmap.GetScale();
-  imgPaint.image = pAPIBitmap->GetBitmap();
+  Bitmap* pBitmap = static_cast<Bitmap*>(pAPIBitmap);
+
+  pBitmap->Decode();
+  pBitmap->SetInUse(true);
+
+  if (pBitmap->IsAtlased())
+  {
+    // Offset the pattern so that the source pixel lands at the top left of dest
+    const double pixelScale = pAPIBitmap->GetScale() * pAPIBitmap->GetDrawScale();
+    int atlasX, atlasY;
+    AtlasPage* pPage = pBitmap->GetAtlasPosition(static_cast<int>(std::round(srcX * pixelScale)), static_cast<int>(std::round(srcY * pixelScale)), atlasX, atlasY);
+
+    pPage->Upload(); // in case the bitmap was packed during this frame
+
+    imgPaint.xform[4] = dest.L - atlasX * scale;
+    imgPaint.xform[5] = dest.T - atlasY * scale;
+    imgPaint.extent[0] = imgPaint.extent[1] = AtlasPage::kSize;
+    imgPaint.image = pPage->GetImage();
+  }
+  else
+  {
+    imgPaint.xform[4] = dest.L - srcX;
+    imgPaint.xform[5] = dest.T - srcY;
+    imgPaint.extent[0] = bitmap.W() * bitmap.GetScale();
+    imgPaint.extent[1] = bitmap.H() * bitmap.GetScale();
+    imgPaint.image = pAPIBitmap->GetBitmap();
+  }
+
   imgPaint.radius = imgPaint.feather = 0.f;
   imgPaint.innerColor = imgPaint.outerColor = nvgRGBAf(1, 1, 1, BlendWeight(pBlend));
     
@@ -569,41 +1317,65 @@ void IGraphicsNanoVG::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int s
 
 void IGraphicsNanoVG::PathClear()
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathClear();
+
   nvgBeginPath(mVG);
 }
 
 void IGraphicsNanoVG::PathClose()
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathClose();
+
   nvgClosePath(mVG);
 }
 
 void IGraphicsNanoVG::PathArc(float cx, float cy, float r, float a1, float a2, EWinding winding)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathArc(cx, cy, r, a1, a2, winding);
+
   nvgArc(mVG, cx, cy, r, DegToRad(a1 - 90.f), DegToRad(a2 - 90.f), winding == EWinding::CW ? NVG_CW : NVG_CCW);
 }
 
 void IGraphicsNanoVG::PathMoveTo(float x, float y)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathMoveTo(x, y);
+
   nvgMoveTo(mVG, x, y);
 }
 
 void IGraphicsNanoVG::PathLineTo(float x, float y)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathLineTo(x, y);
+
   nvgLineTo(mVG, x, y);
 }
 
 void IGraphicsNanoVG::PathCubicBezierTo(float c1x, float c1y, float c2x, float c2y, float x2, float y2)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathCubicBezierTo(c1x, c1y, c2x, c2y, x2, y2);
+
   nvgBezierTo(mVG, c1x, c1y, c2x, c2y, x2, y2);
 }
 
 void IGraphicsNanoVG::PathQuadraticBezierTo(float cx, float cy, float x2, float y2)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathQuadraticBezierTo(cx, cy, x2, y2);
+
   nvgQuadTo(mVG, cx, cy, x2, y2);
 }
 
 void IGraphicsNanoVG::PathSetWinding(bool clockwise)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathSetWinding(clockwise);
+
   nvgPathWinding(mVG, clockwise ? NVG_CW : NVG_CCW);
 }
 
@@ -671,6 +1443,9 @@ void IGraphicsNanoVG::DoDrawText(const IText& text, const char* str, const IRECT
 
 void IGraphicsNanoVG::PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathStroke(pattern, thickness, options, pBlend);
+
   // First set options
   switch (options.mCapOption)
   {
@@ -706,6 +1481,9 @@ void IGraphicsNanoVG::PathStroke(const IPattern& pattern, float thickness, const
 
 void IGraphicsNanoVG::PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathFill(pattern, options, pBlend);
+
   switch(options.mFillRule)
   {
     // This concept of fill vs. even/odd winding does not really translate to nanovg.
@@ -901,8 +1679,73 @@ void IGraphicsNanoVG::ClearFBOStack()
   }
 }
 
+NVGframebuffer* IGraphicsNanoVG::AcquireFBO(int width, int height)
+{
+  {
+    WDL_MutexLock lock(&mFBOMutex);
+
+    // the most recently freed first, it is the likeliest to be the previous version of the layer being drawn again
+    for (auto it = mFBOPool.rbegin(); it != mFBOPool.rend(); ++it)
+    {
+      if (it->mWidth == width && it->mHeight == height)
+      {
+        NVGframebuffer* pBuffer = it->mFBO;
+        mFBOPoolBytes -= static_cast<size_t>(width) * height * kFBOBytesPerPixel;
+        mFBOPool.erase(std::next(it).base());
+        return pBuffer;
+      }
+    }
+  }
+
+  return nvgCreateFramebuffer(mVG, width, height, 0);
+}
+
+void IGraphicsNanoVG::ReleaseFBO(NVGframebuffer* pBuffer, int width, int height)
+{
+  const size_t bytes = static_cast<size_t>(width) * height * kFBOBytesPerPixel;
+
+  {
+    WDL_MutexLock lock(&mFBOMutex);
+
+    if (bytes <= mLayerPoolBudget)
+    {
+      mFBOPool.push_back({ pBuffer, width, height });
+      mFBOPoolBytes += bytes;
+      TrimFBOPool(mLayerPoolBudget);
+      return;
+    }
+  }
+
+  DeleteFBO(pBuffer);
+}
+
+void IGraphicsNanoVG::TrimFBOPool(size_t budget)
+{
+  // N.B. called with mFBOMutex locked, which is recursive, pooled framebuffers are only freed at the end of the frame since they may have been drawn in it
+  size_t nEvicted = 0;
+
+  while (nEvicted < mFBOPool.size() && mFBOPoolBytes > budget)
+  {
+    const PooledFBO& pooled = mFBOPool[nEvicted++];
+    mFBOPoolBytes -= static_cast<size_t>(pooled.mWidth) * pooled.mHeight * kFBOBytesPerPixel;
+    DeleteFBO(pooled.mFBO);
+  }
+
+  mFBOPool.erase(mFBOPool.begin(), mFBOPool.begin() + nEvicted);
+}
+
+void IGraphicsNanoVG::SetLayerPoolBudget(size_t bytes)
+{
+  WDL_MutexLock lock(&mFBOMutex);
+  mLayerPoolBudget = bytes;
+  TrimFBOPool(bytes);
+}
+
 void IGraphicsNanoVG::DrawFastDropShadow(const IRECT& innerBounds, const IRECT& outerBounds, float xyDrop, float roundness, float blur, IBlend* pBlend)
 {
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->DrawFastDropShadow(innerBounds, outerBounds, xyDrop, roundness, blur, pBlend);
+
   NVGpaint shadowPaint = nvgBoxGradient(mVG, innerBounds.L + xyDrop, innerBounds.T + xyDrop, innerBounds.W(), innerBounds.H(), roundness, blur, NanoVGColor(COLOR_BLACK_DROP_SHADOW, pBlend), NanoVGColor(COLOR_TRANSPARENT, nullptr));
   nvgBeginPath(mVG);
   nvgRect(mVG, outerBounds.L, outerBounds.T, outerBounds.W(), outerBounds.H());
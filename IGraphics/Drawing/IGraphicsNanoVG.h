@@ -15,7 +15,9 @@
 
 #include "nanovg.h"
 #include "mutex.h"
+#include <memory>
 #include <stack>
+#include <vector>
 
 // Thanks to Olli Wang/MOUI for much of this macro magic  https://github.com/ollix/moui
 
@@ -82,15 +84,18 @@ class IGraphicsNanoVG : public IGraphics
 {
 private:
   class Bitmap;
+  class AtlasPage;
   
 public:
   IGraphicsNanoVG(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
   ~IGraphicsNanoVG();
 
   const char* GetDrawingAPIStr() override;
+  void GetMemoryReport(IMemoryReport& report) override;
 
   void BeginFrame() override;
   void EndFrame() override;
+  double GetGPUFrameTime() override;
   void OnViewInitialized(void* pContext) override;
   void OnViewDestroyed() override;
   void DrawResize() override;
@@ -117,11 +122,15 @@ public:
   void* GetDrawContext() override { return (void*) mVG; }
     
   IBitmap LoadBitmap(const char* name, int nStates, bool framesAreHorizontal, int targetScale) override;
-  void ReleaseBitmap(const IBitmap& bitmap) override { }; // NO-OP
-  void RetainBitmap(const IBitmap& bitmap, const char * cacheName) override { }; // NO-OP
+  void ReleaseBitmap(const IBitmap& bitmap) override;
+  void RetainBitmap(const IBitmap& bitmap, const char * cacheName) override;
   bool BitmapExtSupported(const char* ext) override;
 
   void DeleteFBO(NVGframebuffer* pBuffer);
+
+  /** Set how much memory the framebuffers of freed layers can use while they are kept for new layers of the same size
+   * @param bytes The budget, or 0 to free every layer's framebuffer straight away */
+  void SetLayerPoolBudget(size_t bytes);
   
 protected:
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
@@ -130,6 +139,18 @@ protected:
 
   bool LoadAPIFont(const char* fontID, const PlatformFontPtr& font) override;
 
+  /** Create a bitmap without pixels, which are set later by SetBitmapPixels(), e.g. when an image that is being downloaded arrives
+   * @param width The width in pixels
+   * @param height The height in pixels
+   * @param scale The scale of the image
+   * @return The new bitmap */
+  APIBitmap* CreateBlankBitmap(int width, int height, int scale);
+
+  /** Set the pixels of a bitmap made by CreateBlankBitmap()
+   * @param pBitmap The bitmap
+   * @param pRGBA The bitmap's width * height RGBA pixels */
+  void SetBitmapPixels(APIBitmap* pBitmap, const unsigned char* pRGBA);
+
   int AlphaChannel() const override { return 3; }
   
   bool FlippedBitmap() const override
@@ -143,6 +164,7 @@ protected:
 
   void GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data) override;
   void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) override;
+  bool ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma) override;
 
   float DoMeasureText(const IText& text, const char* str, IRECT& bounds) const override;
   void DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend) override;
@@ -153,14 +175,70 @@ private:
   void SetClipRegion(const IRECT& r) override;
   void UpdateLayer() override;
   void ClearFBOStack();
+
+  /** @return A framebuffer of exactly this size from the layer pool, or a new one if there isn't one */
+  NVGframebuffer* AcquireFBO(int width, int height);
+
+  /** Keep the framebuffer of a layer that is being freed for the next layer of the same size, freeing the least recently used ones over the budget */
+  void ReleaseFBO(NVGframebuffer* pBuffer, int width, int height);
+
+  /** Free the pooled framebuffers until they fit in the budget, with mFBOMutex locked */
+  void TrimFBOPool(size_t budget);
+
+  /** Colour a blurred shadow mask with the shadow's pattern and composite it under (or instead of) the layer's contents */
+  void ApplyShadowBitmap(ILayerPtr& layer, const IBitmap& maskBitmap, const IShadow& shadow);
+
+  /** Decode an image and create a bitmap for it, packed into a shared atlas texture if it (or each of its frames) is small enough
+   * @param pData Encoded image data, or nullptr to load from path
+   * @param dataSize The size of pData in bytes
+   * @param path The absolute path of the image file, if pData is nullptr
+   * @param cacheName The name the decoded pixels are kept under in IDecodedBitmapCache, so that reopening the editor doesn't decode the image again
+   * @return The new bitmap, or nullptr if the image couldn't be decoded */
+  APIBitmap* LoadPixelsBitmap(const unsigned char* pData, int dataSize, const char* path, const char* cacheName, int scale);
+
+  /** Try to pack decoded RGBA pixels into the atlas pages, using the frame layout given to LoadBitmap()
+   * @return The new bitmap, or nullptr if the image or its frames are too big to share a texture */
+  APIBitmap* CreateAtlasBitmap(const unsigned char* pPixels, int width, int height, int scale);
+
+  /** Free the atlas pages no bitmap is using any more */
+  void PruneAtlasPages();
+
+  /** Free the textures of lazily decoded filmstrips that haven't been drawn since the last check and don't belong to a visible bitmap control */
+  void EvictHiddenBitmaps();
   
   bool mInDraw = false;
   WDL_Mutex mFBOMutex;
   std::stack<NVGframebuffer*> mFBOStack; // A stack of FBOs that requires freeing at the end of the frame
+
+  struct PooledFBO
+  {
+    NVGframebuffer* mFBO;
+    int mWidth;
+    int mHeight;
+  };
+
+  static constexpr size_t kDefaultLayerPoolBudget = 64 * 1024 * 1024;
+  static constexpr size_t kFBOBytesPerPixel = 8; // the colour texture and the stencil buffer
+
+  // framebuffers of freed layers and shadow buffers, least recently freed first, for controls that redraw their layers on hover or resize, guarded by mFBOMutex
+  std::vector<PooledFBO> mFBOPool;
+  size_t mFBOPoolBytes = 0;
+  size_t mLayerPoolBudget = kDefaultLayerPoolBudget;
+  std::vector<Bitmap*> mLazyBitmaps; // big filmstrips that are decoded on first draw, and evicted while they're hidden (declared before the cache, which unregisters them when it's destroyed)
+  int mFramesSinceEvictionCheck = 0;
   StaticStorage<APIBitmap> mBitmapCache; //not actually static (doesn't require retaining or releasing)
   NVGcontext* mVG = nullptr;
   NVGframebuffer* mMainFrameBuffer = nullptr;
   int mInitialFBO = 0;
+  std::vector<std::shared_ptr<AtlasPage>> mAtlasPages; // shared textures that small bitmaps and filmstrip frames are packed into, to avoid texture rebinds between draws
+  int mLoadingStates = 1; // the frame layout of the bitmap LoadBitmap() is loading, so that filmstrips can be split across atlas pages
+  bool mLoadingFramesAreHorizontal = false;
+#if defined IGRAPHICS_GL3
+  unsigned int mGPUTimerQueries[2] = {}; // GL_TIME_ELAPSED queries for draw benchmarks, alternating so that one frame's result can be read while the next is measured
+  bool mGPUTimerPending[2] = {};
+  int mGPUTimerIdx = 0;
+  bool mGPUTimerActive = false;
+#endif
 };
 
 END_IGRAPHICS_NAMESPACE
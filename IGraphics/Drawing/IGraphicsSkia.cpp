@@ -1,12 +1,24 @@
 #include <cmath>
 #include <map>
 
+#ifdef OS_WIN
+  #include <algorithm>
+  #include <atomic>
+  #include <condition_variable>
+  #include <deque>
+  #include <functional>
+  #include <mutex>
+  #include <thread>
+#endif
+
 #include "IGraphicsSkia.h"
+#include "IPlugResourcePack.h"
 
 #pragma warning( push )
 #pragma warning( disable : 4244 )
 #include "SkDashPathEffect.h"
 #include "SkGradientShader.h"
+#include "SkImageFilters.h"
 #include "SkMaskFilter.h"
 #include "SkFont.h"
 #include "SkFontMetrics.h"
@@ -37,6 +49,9 @@
   #pragma comment(lib, "skshaper.lib")
   #pragma comment(lib, "skunicode.lib")
   #pragma comment(lib, "opengl32.lib")
+  #pragma comment(lib, "d3d11.lib")
+  #include <d3d11.h>
+  #include <dxgi1_3.h>
 #endif
 
 #if defined IGRAPHICS_GL
@@ -50,6 +65,12 @@ extern std::map<std::string, MTLTexturePtr> gTextureMap;
 
 #pragma mark - Private Classes and Structs
 
+struct SkiaDisplayList : public APIDisplayList
+{
+  SkiaDisplayList(sk_sp<SkPicture> picture) : mPicture(picture) {}
+  sk_sp<SkPicture> mPicture;
+};
+
 class IGraphicsSkia::Bitmap : public APIBitmap
 {
 public:
@@ -114,6 +135,431 @@ IGraphicsSkia::Bitmap::Bitmap(sk_sp<SkImage> image, double sourceScale)
   SetBitmap(&mDrawable, mDrawable.mImage->width(), mDrawable.mImage->height(), sourceScale, 1.f);
 }
 
+#ifdef OS_WIN
+/** A frame recorded for the render thread */
+struct IGraphicsSkia::RenderThreadFrame
+{
+  sk_sp<SkPicture> mPicture;
+  HRGN mRegion = nullptr; // the window's update region, in device pixels, deleted by the render thread once the frame has been copied to the window
+  SkIRect mBounds; // the region's bounds
+};
+
+/** Replays recorded frames on a worker thread, in the order they were submitted. Each frame is rasterized in horizontal bands,
+ * shared between the render thread and up to kMaxHelperThreads helper threads */
+class IGraphicsSkia::RenderThread
+{
+public:
+  using Frame = RenderThreadFrame;
+  using RenderFunc = std::function<void(RenderThread&, const Frame&)>;
+  using BandFunc = std::function<void(int)>;
+
+  /** The UI thread waits in Submit() once this many frames are queued, so that it can't run ahead of the render thread */
+  static constexpr int kMaxQueuedFrames = 2;
+  static constexpr int kMaxHelperThreads = 3;
+
+  RenderThread(RenderFunc&& renderFunc)
+  : mRenderFunc(std::move(renderFunc))
+  {
+    const int numHelpers = std::min(static_cast<int>(std::thread::hardware_concurrency()) - 1, kMaxHelperThreads);
+
+    for (int i = 0; i < numHelpers; i++)
+      mHelpers.emplace_back([this]() { RunHelper(); });
+
+    mThread = std::thread([this]() { Run(); });
+  }
+
+  ~RenderThread()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+
+    mWakeRenderer.notify_one();
+    mThread.join();
+
+    {
+      std::lock_guard<std::mutex> lock(mBandMutex);
+      mStopHelpers = true;
+    }
+
+    mWakeHelpers.notify_all();
+
+    for (auto& helper : mHelpers)
+      helper.join();
+  }
+
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+
+  void Submit(Frame&& frame)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mFrameDone.wait(lock, [this]() { return static_cast<int>(mFrames.size()) < kMaxQueuedFrames; });
+      mFrames.push_back(std::move(frame));
+    }
+
+    mWakeRenderer.notify_one();
+  }
+
+  /** Wait until all the submitted frames have been rendered */
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFrameDone.wait(lock, [this]() { return mFrames.empty() && !mRendering; });
+  }
+
+  /** @return The number of threads that ForEachBand() shares the bands between */
+  int GetNumThreads() const { return static_cast<int>(mHelpers.size()) + 1; }
+
+  /** Call func(band) for each band in [0, numBands), on this thread and the helper threads, returning when they have all finished. Only called by the render function */
+  void ForEachBand(int numBands, const BandFunc& func)
+  {
+    std::unique_lock<std::mutex> lock(mBandMutex);
+    mBandFunc = &func;
+    mNumBands = numBands;
+    mNextBand = 0;
+    mBandsDone = 0;
+    mBandGeneration++;
+    mWakeHelpers.notify_all();
+    RunBands(lock);
+    mBandsFinished.wait(lock, [this]() { return mBandsDone == mNumBands; });
+    mBandFunc = nullptr;
+  }
+
+private:
+  void Run()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+      mWakeRenderer.wait(lock, [this]() { return mStop || !mFrames.empty(); });
+
+      // finish the queued frames before stopping, they may have parts of the UI that won't be drawn again
+      if (mFrames.empty())
+        return;
+
+      Frame frame = std::move(mFrames.front());
+      mFrames.pop_front();
+      mRendering = true;
+      lock.unlock();
+      mRenderFunc(*this, frame);
+      DeleteObject(frame.mRegion);
+      lock.lock();
+      mRendering = false;
+      mFrameDone.notify_all();
+    }
+  }
+
+  void RunHelper()
+  {
+    std::unique_lock<std::mutex> lock(mBandMutex);
+    int generation = mBandGeneration;
+
+    while (true)
+    {
+      mWakeHelpers.wait(lock, [&]() { return mStopHelpers || mBandGeneration != generation; });
+
+      if (mStopHelpers)
+        return;
+
+      generation = mBandGeneration;
+      RunBands(lock);
+    }
+  }
+
+  /** Take bands until there are none left, called with mBandMutex locked */
+  void RunBands(std::unique_lock<std::mutex>& lock)
+  {
+    while (mBandFunc && mNextBand < mNumBands)
+    {
+      const int band = mNextBand++;
+      const BandFunc& func = *mBandFunc;
+      lock.unlock();
+      func(band);
+      lock.lock();
+
+      if (++mBandsDone == mNumBands)
+        mBandsFinished.notify_all();
+    }
+  }
+
+  RenderFunc mRenderFunc;
+  std::mutex mMutex;
+  std::condition_variable mWakeRenderer;
+  std::condition_variable mFrameDone;
+  std::deque<Frame> mFrames;
+  std::thread mThread;
+  bool mRendering = false;
+  bool mStop = false;
+
+  std::mutex mBandMutex;
+  std::condition_variable mWakeHelpers;
+  std::condition_variable mBandsFinished;
+  std::vector<std::thread> mHelpers;
+  const BandFunc* mBandFunc = nullptr;
+  int mNumBands = 0;
+  int mNextBand = 0;
+  int mBandsDone = 0;
+  int mBandGeneration = 0;
+  bool mStopHelpers = false;
+};
+
+/** Presents CPU rasterized frames through a Direct3D 11 swap chain with the DXGI flip model, which the compositor shows without first copying the window's contents,
+ * as it has to for GDI. Only the update region is uploaded and passed to Present1() as dirty rects. With a frame latency waitable object, IsReadyForFrame() tells the
+ * platform class whether a frame can be queued without Present() blocking the UI thread, which every open editor in the host shares */
+class IGraphicsSkia::FlipPresenter
+{
+public:
+  static constexpr int kNumBuffers = 2; // Present() relies on there being two, to know which rects the back buffer is missing
+  static constexpr int kMaxDirtyRects = 64; // a more fragmented update region is presented as its bounds
+  static constexpr DWORD kMaxFrameWaitMS = 100; // how long Present() waits for the swap chain if IsReadyForFrame() wasn't called first
+
+  /** @return A presenter for the window, or nullptr if Direct3D 11 or flip model swap chains aren't available, e.g. before Windows 8 */
+  static std::unique_ptr<FlipPresenter> Create(HWND hWnd, int w, int h)
+  {
+    std::unique_ptr<FlipPresenter> pPresenter(new FlipPresenter);
+    const UINT flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT | D3D11_CREATE_DEVICE_SINGLETHREADED; // only one thread presents at a time, the UI thread or the render thread
+
+    if (FAILED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags, nullptr, 0, D3D11_SDK_VERSION, &pPresenter->mDevice, nullptr, &pPresenter->mContext)))
+      return nullptr;
+
+    IDXGIDevice* pDXGIDevice = nullptr;
+    IDXGIAdapter* pAdapter = nullptr;
+    IDXGIFactory2* pFactory = nullptr;
+
+    if (SUCCEEDED(pPresenter->mDevice->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&pDXGIDevice))) &&
+        SUCCEEDED(pDXGIDevice->GetAdapter(&pAdapter)))
+      pAdapter->GetParent(__uuidof(IDXGIFactory2), reinterpret_cast<void**>(&pFactory));
+
+    if (pDXGIDevice)
+      pDXGIDevice->Release();
+    if (pAdapter)
+      pAdapter->Release();
+
+    if (!pFactory)
+      return nullptr;
+
+    DXGI_SWAP_CHAIN_DESC1 desc = {};
+    desc.Width = w;
+    desc.Height = h;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM; // Skia's N32 on Windows
+    desc.SampleDesc.Count = 1;
+    desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    desc.BufferCount = kNumBuffers;
+    desc.Scaling = DXGI_SCALING_NONE;
+    desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+    desc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
+    desc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
+    HRESULT result = pFactory->CreateSwapChainForHwnd(pPresenter->mDevice, hWnd, &desc, nullptr, nullptr, &pPresenter->mSwapChain);
+
+    // the waitable object needs DXGI 1.3 (Windows 8.1), try again without it
+    if (FAILED(result))
+    {
+      desc.Flags = 0;
+      result = pFactory->CreateSwapChainForHwnd(pPresenter->mDevice, hWnd, &desc, nullptr, nullptr, &pPresenter->mSwapChain);
+    }
+
+    if (SUCCEEDED(result))
+      pFactory->MakeWindowAssociation(hWnd, DXGI_MWA_NO_ALT_ENTER);
+
+    pFactory->Release();
+
+    if (FAILED(result))
+      return nullptr;
+
+    pPresenter->mSwapChainFlags = desc.Flags;
+    pPresenter->mWidth = w;
+    pPresenter->mHeight = h;
+
+    IDXGISwapChain2* pSwapChain2 = nullptr;
+
+    if (desc.Flags && SUCCEEDED(pPresenter->mSwapChain->QueryInterface(__uuidof(IDXGISwapChain2), reinterpret_cast<void**>(&pSwapChain2))))
+    {
+      pSwapChain2->SetMaximumFrameLatency(1);
+      pPresenter->mFrameLatencyWaitable = pSwapChain2->GetFrameLatencyWaitableObject();
+      pSwapChain2->Release();
+    }
+
+    return pPresenter;
+  }
+
+  ~FlipPresenter()
+  {
+    if (mFrameLatencyWaitable)
+      CloseHandle(mFrameLatencyWaitable);
+    if (mSwapChain)
+      mSwapChain->Release();
+    if (mContext)
+      mContext->Release();
+    if (mDevice)
+      mDevice->Release();
+  }
+
+  FlipPresenter(const FlipPresenter&) = delete;
+  FlipPresenter& operator=(const FlipPresenter&) = delete;
+
+  /** Resize the swap chain's buffers, with no frame in flight on another thread
+   * @return \c false if they couldn't be resized, and the presenter should be replaced with GDI */
+  bool Resize(int w, int h)
+  {
+    if (w == mWidth && h == mHeight)
+      return true;
+
+    mContext->ClearState();
+    mContext->Flush();
+
+    if (FAILED(mSwapChain->ResizeBuffers(kNumBuffers, w, h, DXGI_FORMAT_B8G8R8A8_UNORM, mSwapChainFlags)))
+      return false;
+
+    mWidth = w;
+    mHeight = h;
+    mFullUploads = kNumBuffers;
+    return true;
+  }
+
+  /** Called on the UI thread before drawing a frame. It never blocks
+   * @return \c true if the swap chain can take another frame without Present() waiting for the display */
+  bool IsReadyForFrame()
+  {
+    if (!mFrameLatencyWaitable || mFailed.load() || mFramesAcquired.load() > 0)
+      return true;
+
+    if (WaitForSingleObjectEx(mFrameLatencyWaitable, 0, FALSE) != WAIT_OBJECT_0)
+      return false;
+
+    mFramesAcquired++;
+    return true;
+  }
+
+  /** @return \c true if Present() has failed, e.g. because the GPU was removed, and the draw class should go back to GDI */
+  bool HasFailed() const { return mFailed.load(); }
+
+  /** Upload the changed part of a frame to the back buffer and present it. Called on the UI thread, or the render thread when it is enabled
+   * @param pixmap The frame, the size of the swap chain's buffers
+   * @param region The part of the frame that has changed, in device pixels
+   * @return \c false if the frame couldn't be presented */
+  bool Present(const SkPixmap& pixmap, HRGN region)
+  {
+    if (mFailed.load())
+      return false;
+
+    RECT rects[kMaxDirtyRects];
+    const int nRects = GetDirtyRects(region, rects);
+
+    if (mFramesAcquired.load() > 0)
+      mFramesAcquired--;
+    else if (mFrameLatencyWaitable)
+      WaitForSingleObjectEx(mFrameLatencyWaitable, kMaxFrameWaitMS, FALSE);
+
+    ID3D11Texture2D* pBackBuffer = nullptr;
+
+    if (FAILED(mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&pBackBuffer))))
+    {
+      mFailed = true;
+      return false;
+    }
+
+    // with the flip model the back buffer still holds the frame from two presents ago, so it is also missing the last frame's changes
+    const bool fullUpload = mFullUploads > 0 || !nRects;
+
+    if (fullUpload)
+      Upload(pBackBuffer, pixmap, RECT { 0, 0, mWidth, mHeight });
+    else
+    {
+      for (int i = 0; i < mNumPreviousRects; i++)
+        Upload(pBackBuffer, pixmap, mPreviousRects[i]);
+
+      for (int i = 0; i < nRects; i++)
+        Upload(pBackBuffer, pixmap, rects[i]);
+    }
+
+    pBackBuffer->Release();
+
+    DXGI_PRESENT_PARAMETERS params = {};
+
+    if (!fullUpload)
+    {
+      params.DirtyRectsCount = nRects;
+      params.pDirtyRects = rects;
+    }
+
+    const HRESULT result = mSwapChain->Present1(1, 0, &params);
+
+    if (FAILED(result))
+    {
+      mFailed = true;
+      return false;
+    }
+
+    std::copy(rects, rects + nRects, mPreviousRects);
+    mNumPreviousRects = nRects;
+
+    // a whole frame leaves the other buffer out of date everywhere, and after a resize both buffers need one
+    if (!nRects)
+      mFullUploads = kNumBuffers - 1;
+    else if (mFullUploads > 0)
+      mFullUploads--;
+
+    return true;
+  }
+
+private:
+  FlipPresenter() = default;
+
+  /** Get the rects of a region, clipped to the buffers
+   * @return The number of rects, at most kMaxDirtyRects, or 0 if the whole frame should be presented */
+  int GetDirtyRects(HRGN region, RECT* pRects) const
+  {
+    constexpr int bufferSize = sizeof(RGNDATAHEADER) + sizeof(RECT) * kMaxDirtyRects;
+    alignas(RGNDATA) unsigned char buffer[bufferSize];
+    RGNDATA* pData = reinterpret_cast<RGNDATA*>(buffer);
+    const RECT bounds = { 0, 0, mWidth, mHeight };
+    int nRects = 0;
+
+    if (region && GetRegionData(region, bufferSize, pData) && pData->rdh.nCount <= kMaxDirtyRects)
+    {
+      const RECT* pRegionRects = reinterpret_cast<const RECT*>(pData->Buffer);
+
+      for (DWORD i = 0; i < pData->rdh.nCount; i++)
+      {
+        if (IntersectRect(&pRects[nRects], &pRegionRects[i], &bounds))
+          nRects++;
+      }
+    }
+    else if (region && GetRgnBox(region, &pRects[0]) != NULLREGION && IntersectRect(&pRects[0], &pRects[0], &bounds))
+      nRects = 1;
+
+    return nRects;
+  }
+
+  void Upload(ID3D11Texture2D* pBackBuffer, const SkPixmap& pixmap, const RECT& r)
+  {
+    if (r.right <= r.left || r.bottom <= r.top)
+      return;
+
+    const D3D11_BOX box = { static_cast<UINT>(r.left), static_cast<UINT>(r.top), 0, static_cast<UINT>(r.right), static_cast<UINT>(r.bottom), 1 };
+    mContext->UpdateSubresource(pBackBuffer, 0, &box, pixmap.addr(r.left, r.top), static_cast<UINT>(pixmap.rowBytes()), 0);
+  }
+
+  ID3D11Device* mDevice = nullptr;
+  ID3D11DeviceContext* mContext = nullptr;
+  IDXGISwapChain1* mSwapChain = nullptr;
+  HANDLE mFrameLatencyWaitable = nullptr;
+  UINT mSwapChainFlags = 0;
+  int mWidth = 0;
+  int mHeight = 0;
+  int mFullUploads = kNumBuffers; // the number of frames to come that have to be uploaded whole, because their back buffer doesn't hold the previous frame
+  RECT mPreviousRects[kMaxDirtyRects];
+  int mNumPreviousRects = 0;
+  std::atomic<int> mFramesAcquired {0}; // waits on the waitable object made by IsReadyForFrame() that Present() hasn't used yet
+  std::atomic<bool> mFailed {false};
+};
+#endif
+
 struct IGraphicsSkia::Font
 {
   Font(IFontDataPtr&& data, sk_sp<SkTypeface> typeFace)
@@ -306,6 +752,13 @@ APIBitmap* IGraphicsSkia::LoadAPIBitmap(const char* fileNameOrResID, int scale,
 //  }
 //  else
 //#endif
+  if (location == EResourceLocation::kResourcePack)
+  {
+    int size = 0;
+    const void* pData = IResourcePack::GetRegistered(fileNameOrResID, size);
+    return new Bitmap(pData, size, scale);
+  }
+  else
 #ifdef OS_WIN
   if (location == EResourceLocation::kWinBinary)
   {
@@ -323,11 +776,67 @@ APIBitmap* IGraphicsSkia::LoadAPIBitmap(const char* name, const void* pData, int
   return new Bitmap(pData, dataSize, scale);
 }
 
+std::function<APIBitmap*()> IGraphicsSkia::GetAPIBitmapLoader(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext)
+{
+  sk_sp<SkData> data;
+  std::string path;
+
+  if (location == EResourceLocation::kResourcePack)
+  {
+    int size = 0;
+    const void* pData = IResourcePack::GetRegistered(fileNameOrResID, size);
+
+    if (!pData)
+      return nullptr;
+
+    data = SkData::MakeWithoutCopy(pData, size);
+  }
+  else
+#ifdef OS_WIN
+  if (location == EResourceLocation::kWinBinary)
+  {
+    int size = 0;
+    const void* pData = LoadWinResource(fileNameOrResID, ext, size, GetWinModuleHandle());
+
+    if (!pData)
+      return nullptr;
+
+    data = SkData::MakeWithoutCopy(pData, size);
+  }
+  else
+#endif
+  if (location == EResourceLocation::kAbsolutePath)
+    path = fileNameOrResID;
+  else
+    return nullptr;
+
+  // Decode eagerly, since SkImage::MakeFromEncoded() would otherwise defer it to the first draw on the main thread
+  return [data, path, scale]() -> APIBitmap* {
+    sk_sp<SkData> encoded = data ? data : SkData::MakeFromFileName(path.c_str());
+    sk_sp<SkImage> image = encoded ? SkImage::MakeFromEncoded(encoded) : nullptr;
+
+    if (image)
+      image = image->makeRasterImage();
+
+    return image ? new Bitmap(image, scale) : nullptr;
+  };
+}
+
 void IGraphicsSkia::OnViewInitialized(void* pContext)
 {
 #if defined IGRAPHICS_GL
-  auto glInterface = GrGLMakeNativeInterface();
-  mGrContext = GrDirectContext::MakeGL(glInterface);
+  #ifdef OS_WIN
+  if (!mPreferCPURaster)
+  #endif
+  {
+    auto glInterface = GrGLMakeNativeInterface();
+    mGrContext = GrDirectContext::MakeGL(glInterface);
+  }
+
+  #ifdef OS_WIN
+  // e.g. a remote desktop session that only has Windows' GL 1.1 software implementation, rasterize on the CPU and draw with GDI instead
+  mCPURaster = !mGrContext;
+  #endif
 #elif defined IGRAPHICS_METAL
   CAMetalLayer* pMTLLayer = (CAMetalLayer*) pContext;
   id<MTLDevice> device = pMTLLayer.device;
@@ -348,6 +857,11 @@ void IGraphicsSkia::OnViewDestroyed()
 {
   RemoveAllControls();
 
+#ifdef OS_WIN
+  mRenderThread = nullptr;
+  mFlipPresenter = nullptr;
+#endif
+
 #if defined IGRAPHICS_GL
   mSurface = nullptr;
   mScreenSurface = nullptr;
@@ -371,8 +885,11 @@ void IGraphicsSkia::DrawResize()
     SkImageInfo info = SkImageInfo::MakeN32Premul(w, h);
     mSurface = SkSurface::MakeRenderTarget(mGrContext.get(), SkBudgeted::kYes, info);
   }
-#else
-  #ifdef OS_WIN
+#endif
+#ifdef OS_WIN
+  if (mCPURaster)
+  {
+    WaitForRenderThread();
     mSurface.reset();
    
     const size_t bmpSize = sizeof(BITMAPINFOHEADER) + (w * h * sizeof(uint32_t));
@@ -389,9 +906,11 @@ void IGraphicsSkia::DrawResize()
 
     SkImageInfo info = SkImageInfo::Make(w, h, kN32_SkColorType, kPremul_SkAlphaType, nullptr);
     mSurface = SkSurface::MakeRasterDirect(info, pixels, sizeof(uint32_t) * w);
-  #else
-    mSurface = SkSurface::MakeRasterN32Premul(w, h);
-  #endif
+  }
+
+  UpdateFlipPresenter();
+#elif defined IGRAPHICS_CPU
+  mSurface = SkSurface::MakeRasterN32Premul(w, h);
 #endif
   if (mSurface)
   {
@@ -446,11 +965,82 @@ void IGraphicsSkia::BeginFrame()
   }
 #endif
 
+#ifdef OS_WIN
+  // e.g. the GPU was removed, go back to GDI and draw the whole UI again, since the window's contents were in the swap chain
+  if (mFlipPresenter && mFlipPresenter->HasFailed())
+  {
+    WaitForRenderThread();
+    mFlipPresenter = nullptr;
+    SetAllControlsDirty();
+  }
+
+  if (mCPURaster && mUseRenderThread && mSurface)
+  {
+    if (!mRenderThread)
+      mRenderThread = std::make_unique<RenderThread>([this](RenderThread& renderThread, const RenderThreadFrame& frame) { RenderFrame(renderThread, frame); });
+
+    // the window surface belongs to the render thread until the frame has been replayed
+    mCanvas = mFrameRecorder.beginRecording(SkRect::MakeWH(mSurface->width(), mSurface->height()));
+  }
+#endif
+
   IGraphics::BeginFrame();
 }
 
 void IGraphicsSkia::EndFrame()
 {
+#ifdef OS_WIN
+  if (mCPURaster)
+  {
+    HWND hWnd = (HWND) GetWindow();
+
+    if (mFrameRecorder.getRecordingCanvas())
+    {
+      RenderThreadFrame frame;
+      frame.mPicture = mFrameRecorder.finishRecordingAsPicture();
+      mCanvas = nullptr;
+
+      // the render thread only rasterizes and copies the update region, the window procedure validates it once the frame has been submitted
+      frame.mRegion = CreateRectRgn(0, 0, 0, 0);
+      const int regionType = GetUpdateRgn(hWnd, frame.mRegion, FALSE);
+
+      if (regionType != SIMPLEREGION && regionType != COMPLEXREGION)
+        SetRectRgn(frame.mRegion, 0, 0, mSurface->width(), mSurface->height());
+
+      RECT bounds;
+      GetRgnBox(frame.mRegion, &bounds);
+      frame.mBounds = SkIRect::MakeLTRB(bounds.left, bounds.top, bounds.right, bounds.bottom);
+
+      mRenderThread->Submit(std::move(frame));
+      return;
+    }
+
+    if (mFlipPresenter)
+    {
+      HRGN region = CreateRectRgn(0, 0, 0, 0);
+      const int regionType = GetUpdateRgn(hWnd, region, FALSE);
+
+      if (regionType != SIMPLEREGION && regionType != COMPLEXREGION)
+        SetRectRgn(region, 0, 0, mSurface->width(), mSurface->height());
+
+      PresentRegion(region);
+      DeleteObject(region);
+      return;
+    }
+
+    // BeginPaint() clips the copy to the update region
+    auto w = WindowWidth() * GetScreenScale();
+    auto h = WindowHeight() * GetScreenScale();
+    BITMAPINFO* bmpInfo = reinterpret_cast<BITMAPINFO*>(mSurfaceMemory.Get());
+    PAINTSTRUCT ps;
+    HDC hdc = BeginPaint(hWnd, &ps);
+    StretchDIBits(hdc, 0, 0, w, h, 0, 0, w, h, bmpInfo->bmiColors, bmpInfo, DIB_RGB_COLORS, SRCCOPY);
+    ReleaseDC(hWnd, hdc);
+    EndPaint(hWnd, &ps);
+    return;
+  }
+#endif
+
 #ifdef IGRAPHICS_CPU
   #if defined OS_MAC || defined OS_IOS
     SkPixmap pixmap;
@@ -462,17 +1052,7 @@ void IGraphicsSkia::EndFrame()
     CGContextScaleCTM(pCGContext, 1.0 / GetScreenScale(), 1.0 / GetScreenScale());
     SkCGDrawBitmap(pCGContext, bmp, 0, 0);
     CGContextRestoreGState(pCGContext);
-  #elif defined OS_WIN
-    auto w = WindowWidth() * GetScreenScale();
-    auto h = WindowHeight() * GetScreenScale();
-    BITMAPINFO* bmpInfo = reinterpret_cast<BITMAPINFO*>(mSurfaceMemory.Get());
-    HWND hWnd = (HWND) GetWindow();
-    PAINTSTRUCT ps;
-    HDC hdc = BeginPaint(hWnd, &ps);
-    StretchDIBits(hdc, 0, 0, w, h, 0, 0, w, h, bmpInfo->bmiColors, bmpInfo, DIB_RGB_COLORS, SRCCOPY);
-    ReleaseDC(hWnd, hdc);
-    EndPaint(hWnd, &ps);
-  #else
+  #elif !defined OS_WIN
     #error NOT IMPLEMENTED
   #endif
 #else // GPU
@@ -510,11 +1090,11 @@ void IGraphicsSkia::DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int src
   mCanvas->scale(scale1, scale1);
   mCanvas->translate(-srcX * scale2, -srcY * scale2);
   
-#ifdef IGRAPHICS_CPU
-  auto samplingOptions = SkSamplingOptions(SkFilterMode::kLinear, SkMipmapMode::kNone);
-#else
-  auto samplingOptions = SkSamplingOptions(SkCubicResampler::Mitchell());
-#endif
+  // Bitmaps drawn smaller than their resolution (e.g. 2x bitmaps on a 1x screen, see DrawsBitmapsAtAnyScale()) are sampled from mipmaps, which Skia builds once per image
+  const bool downscaled = !image->mIsSurface && scale2 > GetBackingPixelScale();
+
+  auto samplingOptions = mCPURaster ? SkSamplingOptions(SkFilterMode::kLinear, downscaled ? SkMipmapMode::kLinear : SkMipmapMode::kNone)
+                                    : downscaled ? SkSamplingOptions(SkFilterMode::kLinear, SkMipmapMode::kLinear) : SkSamplingOptions(SkCubicResampler::Mitchell());
     
   if (image->mIsSurface)
     image->mSurface->draw(mCanvas, 0.0, 0.0, samplingOptions, &p);
@@ -558,6 +1138,15 @@ IColor IGraphicsSkia::GetPoint(int x, int y)
 {
   SkBitmap bitmap;
   bitmap.allocPixels(SkImageInfo::MakeN32Premul(1, 1));
+#ifdef OS_WIN
+  // a recording canvas has no pixels, so read from the surface once the render thread has caught up
+  if (mRenderThread && mLayers.empty())
+  {
+    WaitForRenderThread();
+    mSurface->readPixels(bitmap, x, y);
+  }
+  else
+#endif
   mCanvas->readPixels(bitmap, x, y);
   auto color = bitmap.getColor(0,0);
   return IColor(SkColorGetA(color), SkColorGetR(color), SkColorGetG(color), SkColorGetB(color));
@@ -589,30 +1178,42 @@ bool IGraphicsSkia::LoadAPIFont(const char* fontID, const PlatformFontPtr& font)
   return false;
 }
 
-void IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const
+const IGraphicsSkia::TextLayout& IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const
 {
-  SkFontMetrics metrics;
-  SkPaint paint;
-  //SkRect bounds;
-  
-  StaticStorage<Font>::Accessor storage(sFontCache);
-  Font* pFont = storage.Find(text.mFont);
-  
-  assert(pFont && "No font found - did you forget to load it?");
-
-  font.setTypeface(pFont->mTypeface);
-  font.setHinting(SkFontHinting::kSlight);
-  font.setForceAutoHinting(false);
-  font.setSubpixel(true);
-  font.setSize(text.mSize * pFont->mData->GetHeightEMRatio());
+  const TextLayout* pLayout = mTextLayoutCache.Find(text, str);
   
-  // Draw / measure
-  const double textWidth = font.measureText(str, strlen(str), SkTextEncoding::kUTF8, nullptr/* &bounds*/);
-  font.getMetrics(&metrics);
+  if (!pLayout)
+  {
+    SkFont font;
+    SkFontMetrics metrics;
+    
+    StaticStorage<Font>::Accessor storage(sFontCache);
+    Font* pFont = storage.Find(text.mFont);
+    
+    assert(pFont && "No font found - did you forget to load it?");
+
+    font.setEdging(SkFont::Edging::kSubpixelAntiAlias);
+    font.setTypeface(pFont->mTypeface);
+    font.setHinting(SkFontHinting::kSlight);
+    font.setForceAutoHinting(false);
+    font.setSubpixel(true);
+    font.setSize(text.mSize * pFont->mData->GetHeightEMRatio());
+    font.getMetrics(&metrics);
+    
+    // Shape once, the blob is drawn at the aligned position
+    const size_t len = strlen(str);
+    TextLayout layout;
+    layout.mWidth = font.measureText(str, len, SkTextEncoding::kUTF8, nullptr);
+    layout.mAscender = metrics.fAscent;
+    layout.mDescender = metrics.fDescent;
+    layout.mBlob = SkTextBlob::MakeFromText(str, len, font, SkTextEncoding::kUTF8);
+    pLayout = &mTextLayoutCache.Add(text, str, std::move(layout));
+  }
   
+  const double textWidth = pLayout->mWidth;
   const double textHeight = text.mSize;
-  const double ascender = metrics.fAscent;
-  const double descender = metrics.fDescent;
+  const double ascender = pLayout->mAscender;
+  const double descender = pLayout->mDescender;
   
   switch (text.mAlign)
   {
@@ -629,16 +1230,15 @@ void IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IR
   }
   
   r = IRECT((float) x, (float) y + ascender, (float) (x + textWidth), (float) (y + ascender + textHeight));
+  
+  return *pLayout;
 }
 
 float IGraphicsSkia::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
 {
-  SkFont font;
-  font.setEdging(SkFont::Edging::kSubpixelAntiAlias);
-
   IRECT r = bounds;
   double x, y;
-  PrepareAndMeasureText(text, str, bounds, x, y, font);
+  PrepareAndMeasureText(text, str, bounds, x, y);
   DoMeasureTextRotation(text, r, bounds);
   return bounds.W();
 }
@@ -646,18 +1246,18 @@ float IGraphicsSkia::DoMeasureText(const IText& text, const char* str, IRECT& bo
 void IGraphicsSkia::DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend)
 {
   IRECT measured = bounds;
-  
-  SkFont font;
-  font.setEdging(SkFont::Edging::kSubpixelAntiAlias);
-
   double x, y;
 
-  PrepareAndMeasureText(text, str, measured, x, y, font);
+  const TextLayout& layout = PrepareAndMeasureText(text, str, measured, x, y);
+  
+  if (!layout.mBlob)
+    return;
+  
   PathTransformSave();
   DoTextRotation(text, bounds, measured);
   SkPaint paint;
   paint.setColor(SkiaColor(text.mFGColor, pBlend));
-  mCanvas->drawSimpleText(str, strlen(str), SkTextEncoding::kUTF8, x, y, font, paint);
+  mCanvas->drawTextBlob(layout.mBlob, x, y, paint);
   PathTransformRestore();
 }
 
@@ -857,7 +1457,7 @@ APIBitmap* IGraphicsSkia::CreateAPIBitmap(int width, int height, float scale, do
   
   #ifndef IGRAPHICS_CPU
   SkImageInfo info = SkImageInfo::MakeN32Premul(width, height);
-  if (cacheable)
+  if (cacheable || !mGrContext)
   {
     surface = SkSurface::MakeRasterN32Premul(width, height);
   }
@@ -874,10 +1474,178 @@ APIBitmap* IGraphicsSkia::CreateAPIBitmap(int width, int height, float scale, do
   return new Bitmap(std::move(surface), width, height, scale, drawScale);
 }
 
+bool IGraphicsSkia::StartDisplayList(IDisplayList& list)
+{
+  if (!mCanvas || !mLayers.empty() || mPictureList)
+    return false;
+  
+  list.Reset(GetTotalScale());
+  mPictureList = &list;
+  mMainCanvas = mCanvas;
+  mCanvas = mPictureRecorder.beginRecording(SkRect::MakeWH(WindowWidth() * GetScreenScale(), WindowHeight() * GetScreenScale()));
+  // N.B. the picture is replayed with an identity matrix, so record the matrix set up by PrepareRegion()
+  mCanvas->setMatrix(mFinalMatrix);
+  return true;
+}
+
+void IGraphicsSkia::EndDisplayList(IDisplayList& list)
+{
+  if (mPictureList != &list)
+    return;
+  
+  sk_sp<SkPicture> picture = FinishPicture();
+  DrawPicture(picture);
+  list.SetAPIData(std::make_unique<SkiaDisplayList>(picture));
+  list.SetValid();
+}
+
+void IGraphicsSkia::AbortDisplayList()
+{
+  if (!mPictureList)
+    return;
+  
+  // draw what has been recorded so far, so that it is still drawn in order
+  mPictureList->Invalidate();
+  DrawPicture(FinishPicture());
+}
+
+void IGraphicsSkia::DrawDisplayList(const IDisplayList& list)
+{
+  if (auto pData = static_cast<SkiaDisplayList*>(list.GetAPIData()))
+    DrawPicture(pData->mPicture);
+}
+
+sk_sp<SkPicture> IGraphicsSkia::FinishPicture()
+{
+  sk_sp<SkPicture> picture = mPictureRecorder.finishRecordingAsPicture();
+  mCanvas = mMainCanvas;
+  mCanvas->setMatrix(mFinalMatrix);
+  mMainCanvas = nullptr;
+  mPictureList = nullptr;
+  return picture;
+}
+
+void IGraphicsSkia::DrawPicture(const sk_sp<SkPicture>& picture)
+{
+  mCanvas->save();
+  mCanvas->resetMatrix();
+  mCanvas->drawPicture(picture);
+  mCanvas->restore();
+}
+
 void IGraphicsSkia::UpdateLayer()
 {
-  mCanvas = mLayers.empty() ? mSurface->getCanvas() : mLayers.top()->GetAPIBitmap()->GetBitmap()->mSurface->getCanvas();
+  mCanvas = mLayers.empty() ? GetFrameCanvas() : mLayers.top()->GetAPIBitmap()->GetBitmap()->mSurface->getCanvas();
+}
+
+SkCanvas* IGraphicsSkia::GetFrameCanvas()
+{
+#ifdef OS_WIN
+  if (SkCanvas* pCanvas = mFrameRecorder.getRecordingCanvas())
+    return pCanvas;
+#endif
+  return mSurface->getCanvas();
+}
+
+#ifdef OS_WIN
+void IGraphicsSkia::EnableRenderThread(bool enable)
+{
+  mUseRenderThread = enable;
+
+  if (!enable)
+  {
+    mRenderThread = nullptr;
+
+    if (mSurface)
+      mCanvas = mSurface->getCanvas();
+  }
+}
+
+void IGraphicsSkia::RenderFrame(RenderThread& renderThread, const RenderThreadFrame& frame)
+{
+  // Called on the render thread. The surface isn't touched by the UI thread while frames are queued
+  SkPixmap pixmap;
+  mSurface->peekPixels(&pixmap);
+
+  SkIRect bounds = frame.mBounds;
+
+  if (bounds.intersect(SkIRect::MakeWH(pixmap.width(), pixmap.height())))
+  {
+    const int numBands = Clip(bounds.height() / kMinRenderBandHeight, 1, renderThread.GetNumThreads());
+    const int bandHeight = (bounds.height() + numBands - 1) / numBands;
+
+    // each band replays the whole picture, into a canvas over its own rows of the surface
+    renderThread.ForEachBand(numBands, [&](int band) {
+      const int top = bounds.top() + band * bandHeight;
+      const int bottom = std::min(top + bandHeight, bounds.bottom());
+
+      if (top >= bottom)
+        return;
+
+      SkImageInfo info = pixmap.info().makeWH(pixmap.width(), bottom - top);
+      std::unique_ptr<SkCanvas> pCanvas = SkCanvas::MakeRasterDirect(info, pixmap.writable_addr(0, top), pixmap.rowBytes());
+      pCanvas->translate(0.f, static_cast<float>(-top));
+      pCanvas->clipRect(SkRect::Make(SkIRect::MakeLTRB(bounds.left(), top, bounds.right(), bottom)));
+      pCanvas->drawPicture(frame.mPicture);
+    });
+  }
+
+  PresentRegion(frame.mRegion);
+}
+
+void IGraphicsSkia::PresentRegion(HRGN region)
+{
+  if (mFlipPresenter)
+  {
+    SkPixmap pixmap;
+    mSurface->peekPixels(&pixmap);
+
+    // if it fails, the next BeginFrame() goes back to GDI
+    if (mFlipPresenter->Present(pixmap, region))
+      return;
+  }
+
+  // only the update region is copied, which is also all that a remote desktop connection has to send
+  const int w = mSurface->width();
+  const int h = mSurface->height();
+  BITMAPINFO* bmpInfo = reinterpret_cast<BITMAPINFO*>(mSurfaceMemory.Get());
+  HWND hWnd = (HWND) GetWindow();
+  HDC hdc = GetDC(hWnd);
+  SelectClipRgn(hdc, region);
+  StretchDIBits(hdc, 0, 0, w, h, 0, 0, w, h, bmpInfo->bmiColors, bmpInfo, DIB_RGB_COLORS, SRCCOPY);
+  SelectClipRgn(hdc, nullptr);
+  ReleaseDC(hWnd, hdc);
+}
+
+void IGraphicsSkia::UpdateFlipPresenter()
+{
+  HWND hWnd = (HWND) GetWindow();
+
+  if (!mUseFlipPresent || !mCPURaster || !mSurface || !hWnd)
+  {
+    mFlipPresenter = nullptr;
+    return;
+  }
+
+  if (mFlipPresenter && !mFlipPresenter->HasFailed() && mFlipPresenter->Resize(mSurface->width(), mSurface->height()))
+    return;
+
+  // the old swap chain has to be released before another can be made for the window
+  mFlipPresenter = nullptr;
+  mFlipPresenter = FlipPresenter::Create(hWnd, mSurface->width(), mSurface->height());
+}
+
+bool IGraphicsSkia::IsReadyForFrame()
+{
+  return !mFlipPresenter || mFlipPresenter->IsReadyForFrame();
+}
+
+void IGraphicsSkia::WaitForRenderThread()
+{
+  if (mRenderThread)
+    mRenderThread->Wait();
 }
+#endif
 
 static size_t CalcRowBytes(int width)
 {
@@ -943,6 +1711,44 @@ void IGraphicsSkia::ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const
   }
 }
 
+bool IGraphicsSkia::ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma)
+{
+  SkiaDrawable* pDrawable = layer->GetAPIBitmap()->GetBitmap();
+  double scale = layer->GetAPIBitmap()->GetDrawScale() * layer->GetAPIBitmap()->GetScale();
+  
+  SkCanvas* pCanvas = pDrawable->mSurface->getCanvas();
+  
+  SkMatrix m;
+  m.reset();
+  
+  // Skia blurs the snapshot on the GPU, or with its own vectorized code on the CPU, so the layer is never read back
+  sk_sp<SkImage> foreground = pDrawable->mSurface->makeImageSnapshot();
+  
+  SkPaint blurPaint;
+  blurPaint.setImageFilter(SkImageFilters::Blur(blurSigma, blurSigma, SkTileMode::kDecal, nullptr));
+  
+  pCanvas->clear(SK_ColorTRANSPARENT);
+  
+  IBlend blend(EBlend::Default, shadow.mOpacity);
+  pCanvas->setMatrix(m);
+  pCanvas->drawImage(foreground.get(), shadow.mXOffset * scale, shadow.mYOffset * scale, SkSamplingOptions(), &blurPaint);
+  m = SkMatrix::Scale(scale, scale);
+  pCanvas->setMatrix(m);
+  pCanvas->translate(-layer->Bounds().L, -layer->Bounds().T);
+  SkPaint p = SkiaPaint(shadow.mPattern, &blend);
+  p.setBlendMode(SkBlendMode::kSrcIn);
+  pCanvas->drawPaint(p);
+  
+  if (shadow.mDrawForeground)
+  {
+    m.reset();
+    pCanvas->setMatrix(m);
+    pCanvas->drawImage(foreground.get(), 0.0, 0.0);
+  }
+  
+  return true;
+}
+
 void IGraphicsSkia::DrawFastDropShadow(const IRECT& innerBounds, const IRECT& outerBounds, float xyDrop, float roundness, float blur, IBlend* pBlend)
 {
   SkRect r = SkiaRect(innerBounds.GetTranslated(xyDrop, xyDrop));
@@ -956,6 +1762,11 @@ void IGraphicsSkia::DrawFastDropShadow(const IRECT& innerBounds, const IRECT& ou
 
 const char* IGraphicsSkia::GetDrawingAPIStr()
 {
+#ifdef OS_WIN
+  if (mCPURaster)
+    return "SKIA | CPU";
+#endif
+
 #ifdef IGRAPHICS_CPU
   return "SKIA | CPU";
 #elif defined IGRAPHICS_GL2
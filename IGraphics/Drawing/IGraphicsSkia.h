@@ -2,6 +2,7 @@
 
 #include "IPlugPlatform.h"
 #include "IGraphics.h"
+#include "IGraphicsTextCache.h"
 
 // N.B. - this must be defined according to the skia build, not the iPlug build
 #if (defined OS_MAC || defined OS_IOS) && !defined IGRAPHICS_SKIA_NO_METAL
@@ -18,6 +19,9 @@
 #include "SkPath.h"
 #include "SkCanvas.h"
 #include "SkImage.h"
+#include "SkPicture.h"
+#include "SkPictureRecorder.h"
+#include "SkTextBlob.h"
 #include "GrDirectContext.h"
 #pragma warning( pop )
 
@@ -46,6 +50,11 @@ class IGraphicsSkia : public IGraphics
 private:
   class Bitmap;
   struct Font;
+#ifdef OS_WIN
+  class RenderThread;
+  struct RenderThreadFrame;
+  class FlipPresenter;
+#endif
 public:
   IGraphicsSkia(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
   ~IGraphicsSkia();
@@ -115,30 +124,81 @@ public:
   bool BitmapExtSupported(const char* ext) override;
   int AlphaChannel() const override { return 3; }
   bool FlippedBitmap() const override { return false; }
+  bool DrawsBitmapsAtAnyScale() const override { return true; }
 
   APIBitmap* CreateAPIBitmap(int width, int height, float scale, double drawScale, bool cacheable = false) override;
 
   void GetLayerBitmapData(const ILayerPtr& layer, RawBitmapData& data) override;
   void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) override;
+  bool ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma) override;
 
   void UpdateLayer() override;
+
+#ifdef OS_WIN
+  /** Rasterize and present frames on a dedicated render thread. Draw() then only records each frame into an SkPicture on the UI thread,
+   * and the render thread replays it into the window surface, in bands shared with up to three helper threads, and copies the update region to the window.
+   * Off by default, and only used while IsCPURaster()
+   * @param enable \c true to use the render thread */
+  void EnableRenderThread(bool enable);
+
+  /** Rasterize on the CPU and copy frames to the window with GDI in an IGRAPHICS_GL build, e.g. for remote desktop sessions where GL is a slow software implementation.
+   * IGRAPHICS_GL builds also do this if Skia can't create its GL context. Takes effect when the window is next opened
+   * @param prefer \c true to rasterize on the CPU */
+  void SetPreferCPURaster(bool prefer) { mPreferCPURaster = prefer; }
+
+  /** @return \c true if SetPreferCPURaster() was called to rasterize on the CPU */
+  bool GetPreferCPURaster() const { return mPreferCPURaster; }
+
+  /** Present CPU rasterized frames through a Direct3D 11 swap chain with the DXGI flip model, rather than copying them to the window with GDI.
+   * Only the update region is uploaded and presented, and IsReadyForFrame() paces frames with the swap chain's waitable object, so the UI thread isn't blocked by vsync.
+   * Off by default. Takes effect when the window is next opened or resized, and falls back to GDI if the swap chain can't be created, e.g. before Windows 8
+   * @param enable \c true to present with DXGI */
+  void EnableFlipPresent(bool enable) { mUseFlipPresent = enable; }
+
+  /** Called by the platform class before it draws the dirty controls, which it leaves dirty for its next display timer tick if this returns \c false.
+   * Never blocks
+   * @return \c false if frames are presented with DXGI and the swap chain can't take another one yet */
+  bool IsReadyForFrame();
+#endif
+
+  /** @return \c true if frames are rasterized on the CPU: always with IGRAPHICS_CPU, and on Windows with IGRAPHICS_GL after SetPreferCPURaster() or if the GL context couldn't be created */
+  bool IsCPURaster() const { return mCPURaster; }
     
 protected:
     
   float DoMeasureText(const IText& text, const char* str, IRECT& bounds) const override;
   void DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend) override;
 
+  bool StartDisplayList(IDisplayList& list) override;
+  void EndDisplayList(IDisplayList& list) override;
+  void AbortDisplayList() override;
+  void DrawDisplayList(const IDisplayList& list) override;
+
   bool LoadAPIFont(const char* fontID, const PlatformFontPtr& font) override;
 
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
   APIBitmap* LoadAPIBitmap(const char* name, const void* pData, int dataSize, int scale) override;
+  std::function<APIBitmap*()> GetAPIBitmapLoader(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
 private:  
-  void PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const;
+  struct TextLayout
+  {
+    double mWidth = 0.;
+    double mAscender = 0.;
+    double mDescender = 0.;
+    sk_sp<SkTextBlob> mBlob;
+  };
+  
+  const TextLayout& PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const;
 
   void PathTransformSetMatrix(const IMatrix& m) override;
   void SetClipRegion(const IRECT& r) override;
     
   void RenderPath(SkPaint& paint);
+  sk_sp<SkPicture> FinishPicture();
+  void DrawPicture(const sk_sp<SkPicture>& picture);
+
+  /** @return The canvas that draws to the window: the frame recorder when using the render thread, otherwise the window surface */
+  SkCanvas* GetFrameCanvas();
     
   sk_sp<SkSurface> mSurface;
   SkCanvas* mCanvas = nullptr;
@@ -147,8 +207,42 @@ private:
   SkMatrix mClipMatrix;
   SkMatrix mFinalMatrix;
 
-#if defined OS_WIN && defined IGRAPHICS_CPU
+  // display lists are recorded as SkPictures, by swapping mCanvas for the recording canvas
+  SkPictureRecorder mPictureRecorder;
+  SkCanvas* mMainCanvas = nullptr;
+  IDisplayList* mPictureList = nullptr;
+
+  // the measured and shaped strings, so that labels aren't shaped again every frame
+  mutable ITextLayoutCache<TextLayout> mTextLayoutCache;
+
+#ifdef IGRAPHICS_CPU
+  bool mCPURaster = true;
+#else
+  bool mCPURaster = false;
+#endif
+
+#ifdef OS_WIN
+  static constexpr int kMinRenderBandHeight = 64; // in pixels, a frame's update region is only split between the render threads if it is taller than this
+
   WDL_TypedBuf<uint8_t> mSurfaceMemory;
+  bool mPreferCPURaster = false;
+
+  void RenderFrame(RenderThread& renderThread, const RenderThreadFrame& frame);
+  void WaitForRenderThread();
+
+  /** Copy the region of the window surface to the window, with the flip presenter if there is one that works, otherwise with GDI
+   * @param region The region, in device pixels */
+  void PresentRegion(HRGN region);
+
+  /** Create, resize or destroy the flip presenter for the current surface size, with the render thread idle */
+  void UpdateFlipPresenter();
+
+  // N.B. declared after the surface, and the presenter before the render thread, so that the render thread is stopped before either is destroyed
+  std::unique_ptr<FlipPresenter> mFlipPresenter;
+  bool mUseFlipPresent = false;
+  SkPictureRecorder mFrameRecorder;
+  std::unique_ptr<RenderThread> mRenderThread;
+  bool mUseRenderThread = false;
 #endif
   
 #ifndef IGRAPHICS_CPU
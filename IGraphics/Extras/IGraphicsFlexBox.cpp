@@ -9,6 +9,8 @@
 */
 
 #include "IGraphicsFlexBox.h"
+#include "IGraphics.h"
+#include "IControl.h"
 
 using namespace iplug;
 using namespace igraphics;
@@ -27,8 +29,7 @@ IFlexBox::~IFlexBox()
 
 void IFlexBox::Init(const IRECT& r, YGFlexDirection direction, YGJustify justify, YGWrap wrap, float padding, float margin)
 {
-  YGNodeStyleSetWidth(mRootNodeRef, r.W());
-  YGNodeStyleSetHeight(mRootNodeRef, r.H());
+  SetBounds(r);
   YGNodeStyleSetFlexDirection(mRootNodeRef, direction);
   YGNodeStyleSetJustifyContent(mRootNodeRef, justify);
   YGNodeStyleSetFlexWrap(mRootNodeRef, wrap);
@@ -41,6 +42,59 @@ void IFlexBox::CalcLayout(YGDirection direction)
   YGNodeCalculateLayout(mRootNodeRef, YGUndefined, YGUndefined, direction);
 }
 
+void IFlexBox::SetBounds(const IRECT& r)
+{
+  mX = r.L;
+  mY = r.T;
+  // N.B. Yoga only marks the node dirty if the value changed
+  YGNodeStyleSetWidth(mRootNodeRef, r.W());
+  YGNodeStyleSetHeight(mRootNodeRef, r.H());
+}
+
+void IFlexBox::BindControl(YGNodeRef node, IControl* pControl)
+{
+  for (auto& binding : mBindings)
+  {
+    if (binding.mControl == pControl)
+    {
+      binding.mNode = node;
+      return;
+    }
+  }
+
+  mBindings.push_back({ node, pControl });
+}
+
+void IFlexBox::ClearBindings()
+{
+  mBindings.clear();
+}
+
+bool IFlexBox::ApplyLayout(IGraphics* pGraphics, YGDirection direction)
+{
+  CalcLayout(direction);
+
+  mApplyControls.clear();
+  mApplyBounds.clear();
+
+  for (const auto& binding : mBindings)
+  {
+    const IRECT bounds = GetNodeBounds(binding.mNode);
+    const IControl* pControl = binding.mControl;
+
+    if (bounds != pControl->GetRECT() || bounds != pControl->GetTargetRECT())
+    {
+      mApplyControls.push_back(binding.mControl);
+      mApplyBounds.push_back(bounds);
+    }
+  }
+
+  if (mApplyControls.empty())
+    return false;
+
+  return pGraphics->SetControlBounds(mApplyControls.data(), mApplyBounds.data(), static_cast<int>(mApplyControls.size()));
+}
+
 YGNodeRef IFlexBox::AddItem(float width, float height, YGAlign alignSelf, float grow, float shrink, float margin)
 {
   int index = mNodeCounter;
@@ -84,6 +138,21 @@ IRECT IFlexBox::GetRootBounds() const
                YGNodeLayoutGetTop(mRootNodeRef)  + YGNodeLayoutGetHeight(mRootNodeRef));
 }
 
+IRECT IFlexBox::GetNodeBounds(YGNodeRef node) const
+{
+  // Yoga positions each node relative to its parent
+  float x = mX;
+  float y = mY;
+
+  for (YGNodeRef parent = node; parent; parent = YGNodeGetParent(parent))
+  {
+    x += YGNodeLayoutGetLeft(parent);
+    y += YGNodeLayoutGetTop(parent);
+  }
+
+  return IRECT(x, y, x + YGNodeLayoutGetWidth(node), y + YGNodeLayoutGetHeight(node));
+}
+
 IRECT IFlexBox::GetItemBounds(int nodeIndex) const
 {
   YGNodeRef child = YGNodeGetChild(mRootNodeRef, nodeIndex);
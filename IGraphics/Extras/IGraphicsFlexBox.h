@@ -10,14 +10,21 @@
 
 #pragma once
 
+#include <vector>
+
 #include "Yoga.h"
 #include "IGraphicsStructs.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
+class IGraphics;
+class IControl;
+
 /** IFlexBox is a basic C++ helper for Yoga https://yogalayout.com. 
- * For advanced use, probably best just to use Yoga directly */
+ * For advanced use, probably best just to use Yoga directly.
+ * The node tree persists, so for a responsive layout build it once, bind the controls to their nodes with BindControl(), and on resize call SetBounds() and ApplyLayout().
+ * Yoga only marks nodes dirty when a style value actually changes and reuses the cached layout of the rest, and only the controls whose bounds changed are updated */
 class IFlexBox
 {
 public:
@@ -51,15 +58,48 @@ public:
   /** Calculate the layout, call after add all items
    * @param direction https://yogalayout.com/docs/layout-direction */
   void CalcLayout(YGDirection direction = YGDirectionLTR);
+
+  /** Set the bounds of the flex container after Init(), e.g. when the UI is resized. The layout is only marked dirty if the size changed
+   * @param r The IRECT bounds for the flex container */
+  void SetBounds(const IRECT& r);
+
+  /** Bind a control to a node, so that ApplyLayout() sets its bounds. The control must stay attached while it is bound
+   * @param node A node in this flex box's tree, e.g. as returned from AddItem()
+   * @param pControl The control */
+  void BindControl(YGNodeRef node, IControl* pControl);
+
+  /** Remove all control bindings, e.g. before the controls are removed from the graphics context */
+  void ClearBindings();
+
+  /** Calculate the layout, and set the bounds of the bound controls whose bounds changed, with one redraw
+   * @param pGraphics The graphics context the controls are attached to
+   * @param direction https://yogalayout.com/docs/layout-direction
+   * @return \c true if any control's bounds changed */
+  bool ApplyLayout(IGraphics* pGraphics, YGDirection direction = YGDirectionLTR);
   
   /** Get an IRECT of the root node bounds */
   IRECT GetRootBounds() const;
 
   /** Get the bounds for a particular flex item */
   IRECT GetItemBounds(int nodeIndex) const;
+
+  /** Get the bounds of any node in the tree, including nested ones, offset by the container's position
+   * @param node A node in this flex box's tree */
+  IRECT GetNodeBounds(YGNodeRef node) const;
   
 private:
+  struct Binding
+  {
+    YGNodeRef mNode;
+    IControl* mControl;
+  };
+
   int mNodeCounter = 0;
+  float mX = 0.f;
+  float mY = 0.f;
+  std::vector<Binding> mBindings;
+  std::vector<IControl*> mApplyControls;
+  std::vector<IRECT> mApplyBounds;
   YGConfigRef mConfigRef;
   YGNodeRef mRootNodeRef;
 };
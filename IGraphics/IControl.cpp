@@ -203,6 +203,11 @@ void IControl::SetDirty(bool triggerAction, int valIdx)
   ForValIdx(valIdx, setValue);
   
   mDirty = true;
+  mDirtyRegion = IRECT();
+  InvalidateDisplayList();
+
+  if (mGraphics)
+    mGraphics->MarkControlActive(this);
   
   if (triggerAction)
   {
@@ -222,6 +227,23 @@ void IControl::SetDirty(bool triggerAction, int valIdx)
   }
 }
 
+void IControl::SetDirtyRegion(const IRECT& bounds)
+{
+  if (bounds.Empty())
+    return;
+
+  if (!mDirty)
+    mDirtyRegion = bounds;
+  else if (!mDirtyRegion.Empty())
+    mDirtyRegion = mDirtyRegion.Union(bounds);
+
+  mDirty = true;
+  InvalidateDisplayList();
+
+  if (mGraphics)
+    mGraphics->MarkControlActive(this);
+}
+
 void IControl::Animate()
 {
   if (GetAnimationFunction())
@@ -426,6 +448,9 @@ void IControl::StartAnimation(int duration)
 {
   mAnimationStartTime = std::chrono::high_resolution_clock::now();
   mAnimationDuration = Milliseconds(duration);
+
+  if (mAnimationFunc && mGraphics)
+    mGraphics->ScheduleAnimation(this);
 }
 
 double IControl::GetAnimationProgress() const
@@ -433,7 +458,9 @@ double IControl::GetAnimationProgress() const
   if(!mAnimationFunc)
     return 0.;
   
-  auto elapsed = Milliseconds(std::chrono::high_resolution_clock::now() - mAnimationStartTime);
+  const TimePoint now = mGraphics ? mGraphics->GetAnimationFrameTime() : TimePoint(std::chrono::high_resolution_clock::now());
+  // an animation started since the frame began hasn't made any progress yet
+  auto elapsed = std::max(Milliseconds(now - mAnimationStartTime), Milliseconds(0.));
   return elapsed.count() / mAnimationDuration.count();
 }
 
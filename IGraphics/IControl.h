@@ -76,7 +76,14 @@ public:
   void operator=(const IControl&) = delete;
   
   /** Destructor. Clean up any resources that your control owns. */
-  virtual ~IControl() {}
+  virtual ~IControl()
+  {
+    if (mIsActive && mGraphics)
+      mGraphics->RemoveActiveControl(this);
+
+    if (mIsAnimating && mGraphics)
+      mGraphics->UnscheduleAnimation(this);
+  }
 
   /** Implement this method to respond to a mouse down event on this control. 
    * @param x The X coordinate of the mouse event
@@ -247,6 +254,13 @@ public:
    * @param value Normalised incoming value
    * @param valIdx The index of the value to set, which should be between 0 and NVals() */
   virtual void SetValueFromDelegate(double value, int valIdx = 0);
+
+  /** Called once per frame by the IGraphics editor delegate with the values sent to the control's tag with SendControlValueFromDelegate() since the last frame.
+   * The default sets the newest one with SetValueFromDelegate(). Override it to use the range, e.g. so that a meter shows the peak of values sent more often than it is drawn
+   * @param value The newest normalised value
+   * @param minValue The lowest normalised value sent since the last frame
+   * @param maxValue The highest normalised value sent since the last frame */
+  virtual void SetCoalescedValuesFromDelegate(double value, double minValue, double maxValue) { SetValueFromDelegate(value); }
   
   /** Set the control's value after user input.
    * This method is called after a text entry or popup menu prompt triggered by PromptUserInput(), calling SetDirty(true), which will mean that the new value gets sent back to the delegate
@@ -306,7 +320,7 @@ public:
 
   /** Set the rectangular draw area for this control, within the graphics context
    * @param bounds The control's bounds */
-  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; OnResize(); NotifyBoundsChanged(); }
   
   /** Get the rectangular mouse tracking target area, within the graphics context for this control
    * @return The control's target bounds within the graphics context */
@@ -314,11 +328,11 @@ public:
 
   /** Set the rectangular mouse tracking target area, within the graphics context for this control
    * @param bounds The control's new target bounds within the graphics context */
-  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; }
+  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; NotifyBoundsChanged(); }
   
   /** Set BOTH the draw rect and the target area, within the graphics context for this control
    * @param bounds The control's new draw and target bounds within the graphics context */
-  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; OnResize(); NotifyBoundsChanged(); }
 
   /** Set the position of the control, preserving the width and height. This may need to be overriden if you maintain custom positioning data in your control
    * @param x the new x coordinate of the top left corner of the control
@@ -381,6 +395,7 @@ public:
   /** Hit test the control. Override this method if you want the control to be hit only if a visible part of it is hit, or whatever.
    * @param x The X coordinate within the control to test 
    * @param y The y coordinate within the control to test
+   * NOTE: IGraphics only hit tests a control at points within its RECT or target RECT, so overrides should not return true outside of those
    * @return \c Return true if the control was hit. */
   virtual bool IsHit(float x, float y) const { return mTargetRECT.Contains(x, y); }
 
@@ -390,16 +405,67 @@ public:
    * NOTE: it is easy to forget that this method always sets the control dirty, the argument refers to whether a consecutive action should be performed */
   virtual void SetDirty(bool triggerAction = true, int valIdx = kNoValIdx);
 
+  /** Mark part of the control as dirty, so that only that region is redrawn on the next display refresh (Draw() is still called, clipped to it).
+   * Regions accumulate until the control is drawn, and a control that SetDirty() was called on stays dirty as a whole. Unlike SetDirty(), this doesn't trigger any actions
+   * @param bounds The region that changed, in the same coordinates as the control's bounds */
+  void SetDirtyRegion(const IRECT& bounds);
+
+  /** @return The region to redraw: the bounds passed to SetDirtyRegion() since the control was last drawn, or the whole control */
+  IRECT GetDirtyRECT() const { return mDirtyRegion.Empty() ? mRECT : mDirtyRegion.Intersect(mRECT); }
+
   /* Set the control clean, i.e. Called by IGraphics draw loop after control has been drawn */
-  virtual void SetClean() { mDirty = false; }
+  virtual void SetClean() { mDirty = false; mDirtyRegion = IRECT(); }
 
-  /* Called at each display refresh by the IGraphics draw loop, triggers the control's AnimationFunc if it is set */
+  /* Called at each display refresh by the IGraphics draw loop while the control is scheduled (see SetAnimation()), triggers the control's AnimationFunc if it is set */
   void Animate();
 
   /** Called at each display refresh by the IGraphics draw loop, after IControl::Animate(), to determine if the control is marked as dirty. 
    * @return \c true if the control is marked dirty. */
   virtual bool IsDirty();
 
+  /** Call this if the control overrides IsDirty() to become dirty without calling SetDirty(), so that it is still checked every frame when IGraphics::EnableDirtyTracking() is on
+   * @param poll \c true if IsDirty() should be called every frame */
+  void SetPollDirty(bool poll) { mPollDirty = poll; if (poll && mGraphics) mGraphics->MarkControlActive(this); }
+
+  /** @return \c true if IsDirty() is called every frame, see SetPollDirty() */
+  bool GetPollDirty() const { return mPollDirty; }
+
+  /** Record the drawing calls made by Draw() into a display list and replay them instead of calling Draw(), until the control is marked dirty or its bounds change.
+   * This suits controls with expensive, mostly static vector drawing that get redrawn because other controls overlapping them are dirty.
+   * Draw() must only depend on state that marks the control dirty when it changes. Controls that draw layers are not recorded
+   * @param use \c true to enable display list recording */
+  void SetUseDisplayList(bool use)
+  {
+    if (use && !mDisplayList)
+      mDisplayList = std::make_unique<IDisplayList>();
+    else if (!use)
+      mDisplayList = nullptr;
+  }
+
+  /** @return \c true if the control records its drawing into a display list, see SetUseDisplayList() */
+  bool GetUseDisplayList() const { return mDisplayList != nullptr; }
+
+  /** @return The control's display list, or nullptr if it doesn't use one */
+  IDisplayList* GetDisplayList() { return mDisplayList.get(); }
+
+  /** Mark the control's display list (if it has one) as out of date, so that Draw() is called and recorded next time the control is drawn. SetDirty() calls this */
+  void InvalidateDisplayList() { if (mDisplayList) mDisplayList->Invalidate(); }
+
+  /** Opt out of IGraphics' SVG raster cache, for controls that draw SVGs whose content changes between draws, see IGraphics::EnableSVGCache()
+   * @param use \c false to always draw this control's SVGs as vectors */
+  void SetUseSVGCache(bool use) { mUseSVGCache = use; }
+
+  /** @return \c true if SVGs drawn by this control can use IGraphics' SVG raster cache */
+  bool GetUseSVGCache() const { return mUseSVGCache; }
+
+  /** Mark the control as a visualization (e.g. a spectrum, scope or meter), whose drawing IGraphics may render at a reduced resolution and upscale while frames are over budget, see IGraphics::SetDynamicResolution().
+   * Only mark controls whose content tolerates softening: text and chrome should stay in normal controls, which are always drawn at the native resolution
+   * @param isVisualization \c true to allow reduced resolution drawing */
+  void SetIsVisualization(bool isVisualization) { mIsVisualization = isVisualization; mVisualizationLayer = nullptr; }
+
+  /** @return \c true if the control may be drawn at a reduced resolution, see SetIsVisualization() */
+  bool GetIsVisualization() const { return mIsVisualization; }
+
   /** Disable/enable default prompt for user input
    * @param disable Set true to disable prompt */
   void DisablePrompt(bool disable) { mDisablePrompt = disable; }
@@ -421,6 +487,13 @@ public:
   
   /** @return /c true if this control supports multiple touches */
   bool GetWantsMultiTouch() const { return mWantsMultiTouch; }
+
+  /** Specify whether this control needs every drag event, rather than one per frame with the deltas added up. See IGraphics::EnableDragCoalescing()
+   * @param enable Set \c true for a control that uses every point of a drag, e.g. one that draws the path of the mouse or pen */
+  void SetWantsEveryDrag(bool enable = true) { mWantsEveryDrag = enable; }
+
+  /** @return /c true if this control gets every drag event, even when the graphics context coalesces them */
+  bool GetWantsEveryDrag() const { return mWantsEveryDrag; }
   
   /** Add a IGestureFunc that should be triggered in response to a certain type of gesture
    * @param type The type of gesture to recognize on this control
@@ -443,6 +516,10 @@ public:
   {
     mDelegate = &dlg;
     mGraphics = dlg.GetUI();
+
+    if (mAnimationFunc)
+      mGraphics->ScheduleAnimation(this);
+
     OnInit();
     OnResize();
     OnRescale();
@@ -472,14 +549,23 @@ public:
   /** @param duration Duration in milliseconds for the animation  */
   void StartAnimation(int duration);
   
-  /** Set the animation function
+  /** Set the animation function. The control is scheduled with IGraphics, which calls it each frame until OnEndAnimation()
    * @param func A std::function conforming to IAnimationFunction */
-  void SetAnimation(IAnimationFunction func) { mAnimationFunc = func;}
+  void SetAnimation(IAnimationFunction func)
+  {
+    mAnimationFunc = func;
+
+    if (func && mGraphics)
+    {
+      mGraphics->MarkControlActive(this);
+      mGraphics->ScheduleAnimation(this);
+    }
+  }
   
   /** Set the animation function and starts it
    * @param func A std::function conforming to IAnimationFunction
    * @param duration Duration in milliseconds for the animation */
-  void SetAnimation(IAnimationFunction func, int duration) { mAnimationFunc = func; StartAnimation(duration); }
+  void SetAnimation(IAnimationFunction func, int duration) { SetAnimation(func); StartAnimation(duration); }
 
   /** Get the control's animation function, if it exists */
   IAnimationFunction GetAnimationFunction() { return mAnimationFunc; }
@@ -487,7 +573,8 @@ public:
   /** Get the control's action function, if it exists */
   IActionFunction GetActionFunction() { return mActionFunc; }
 
-  /** Get the progress in a control's animation, in the range 0-1 */
+  /** Get the progress in a control's animation, from 0 at StartAnimation(), 1 once the duration has passed and beyond.
+   * It is measured at IGraphics::GetAnimationFrameTime(), so all the animations drawn in a frame are in step */
   double GetAnimationProgress() const;
   
   /** Get the duration of animations applied to the control */
@@ -504,6 +591,10 @@ public:
 #pragma mark - IControl Member variables
 protected:
   
+  /** Call this after writing mRECT or mTargetRECT directly, rather than through SetRECT(), SetTargetRECT() or SetTargetAndDrawRECTs(),
+   * so that the display list and the graphics context's spatial index of the controls follow the new bounds */
+  void NotifyBoundsChanged() { InvalidateDisplayList(); if (mGraphics) mGraphics->OnControlBoundsChanged(this); }
+
   /** A helper template function to call a method for an individual value, or for all values
    * @param valIdx If this is > kNoValIdx execute the function for an individual value. If equal to kNoValIdx call the function for all values
    * @param func A function that takes a single integer argument, the value index
@@ -531,6 +622,7 @@ protected:
   IBlend mBlend;
   int mTextEntryLength = DEFAULT_TEXT_ENTRY_LEN;
   bool mDirty = true;
+  IRECT mDirtyRegion; // empty if the whole control is dirty, see SetDirtyRegion()
   bool mHide = false;
   bool mDisabled = false;
   bool mDisablePrompt = true;
@@ -540,6 +632,7 @@ protected:
   bool mIgnoreMouse = false;
   bool mWantsMidi = false;
   bool mWantsMultiTouch = false;
+  bool mWantsEveryDrag = false;
   bool mPromptShowsParamLabel = false;
   /** if mGraphics::mHandleMouseOver = true, this will be true when the mouse is over control. If you need finer grained control of mouseovers, you can override OnMouseOver() and OnMouseOut() */
   bool mMouseIsOver = false;
@@ -573,6 +666,15 @@ private:
   std::vector<ParamTuple> mVals { {kNoParameter, 0.} };
   std::unordered_map<EGestureType, IGestureFunc> mGestureFuncs;
   EGestureType mLastGesture = EGestureType::Unknown;
+  bool mPollDirty = false;
+  std::unique_ptr<IDisplayList> mDisplayList;
+  bool mUseSVGCache = true;
+  bool mIsActive = false; // in IGraphics' list of controls visited each frame
+  bool mIsAnimating = false; // in IGraphics' list of animations run each frame
+  bool mIsVisualization = false;
+  ILayerPtr mVisualizationLayer; // the reduced resolution raster, while IGraphics::GetDynamicResolutionScale() is less than 1
+
+  friend class IGraphics;
 };
 
 #pragma mark - Base Controls
@@ -598,6 +700,9 @@ public:
   /** Call in the constructor of your IBControl to link the IBitmapBase and IControl
    * @param pControl Ptr to the control */
   void AttachIControl(IControl* pControl) { mControl = pControl; }
+
+  /** @return The bitmap the control draws */
+  const IBitmap& GetBitmap() const { return mBitmap; }
   
   /** Draw a frame of a multi-frame bitmap based on the IControl value
    * @param g The IGraphics context */
@@ -765,7 +870,7 @@ public:
     }
   }
   
-  /** Call one of the DrawPressableShape methods
+  /** Call one of the DrawPressableShape methods. Controls that share a style draw identical shapes from a shared raster if IGraphics::EnableSharedSprites() is on
    * @param g The IGraphics context
    * @param shape The shape to draw
    * @param bounds The bounds in which to draw the shape
@@ -773,6 +878,47 @@ public:
    * @param mouseOver /c true if the mouse is over the bounds
    * @param disabled /c true if the shape should be drawn disabled */
   virtual void DrawPressableShape(IGraphics& g, EVShape shape, const IRECT& bounds, bool pressed, bool mouseOver, bool disabled)
+  {
+    // The splash animation is different for every control
+    if (g.GetSharedSpritesEnabled() && !(pressed && mControl->GetAnimationFunction()))
+    {
+      const float padding = mStyle.shadowOffset + mStyle.frameThickness + 1.f;
+
+      g.DrawSharedSprite(GetPressableShapeKey(shape, pressed, mouseOver, disabled), bounds, padding, [&](IGraphics& g, const IRECT& r) {
+        DrawPressableShapeDirect(g, shape, r, pressed, mouseOver, disabled);
+      });
+    }
+    else
+      DrawPressableShapeDirect(g, shape, bounds, pressed, mouseOver, disabled);
+  }
+
+  /** @return A hash of everything DrawPressableShape() draws apart from the bounds, so that controls with the same style share rasters, see IGraphics::DrawSharedSprite() */
+  uint64_t GetPressableShapeKey(EVShape shape, bool pressed, bool mouseOver, bool disabled) const
+  {
+    uint64_t hash = 14695981039346656037ull;
+
+    auto add = [&hash](const void* pData, size_t size) {
+      for (size_t i = 0; i < size; i++)
+        hash = (hash ^ static_cast<const uint8_t*>(pData)[i]) * 1099511628211ull;
+    };
+
+    for (int i = 0; i < kNumVColors; i++)
+    {
+      const IColor& color = GetColor(static_cast<EVColor>(i));
+      const int argb[4] = { color.A, color.R, color.G, color.B };
+      add(argb, sizeof(argb));
+    }
+
+    const IBlend blend = mControl->GetBlend();
+    const float floats[] = { mStyle.roundness, mStyle.frameThickness, mStyle.shadowOffset, mStyle.angle, blend.mWeight };
+    const int ints[] = { static_cast<int>(shape), static_cast<int>(blend.mMethod), pressed, mouseOver, disabled, mStyle.drawFrame, mStyle.drawShadows, mStyle.emboss };
+    add(floats, sizeof(floats));
+    add(ints, sizeof(ints));
+    return hash;
+  }
+
+  /** Call one of the DrawPressableShape methods, without the shared raster */
+  void DrawPressableShapeDirect(IGraphics& g, EVShape shape, const IRECT& bounds, bool pressed, bool mouseOver, bool disabled)
   {
     switch (shape)
     {
@@ -1245,7 +1391,10 @@ protected:
 };
 
 /** A base class for mult-strip/track controls, such as multi-sliders, meters
- * Track refers to the channel/strip, Step refers to cross-axis steps, e.g. integer quantization */
+ * Track refers to the channel/strip, Step refers to cross-axis steps, e.g. integer quantization
+ * With the tracks and steps laid out by MakeTrackRects() and MakeStepRects(), controls with many tracks stay cheap: the track or step at a position is found
+ * without searching, only the tracks in the region being drawn are drawn, their plain handles, peaks and frames are filled or stroked as one path each,
+ * and a change to some tracks only marks those tracks dirty, see SetTrackDirty() */
 class IVTrackControlBase : public IControl
                          , public IVectorBase
 {
@@ -1340,18 +1489,36 @@ public:
   
   void OnMouseOver(float x, float y, const IMouseMod& mod) override
   {
-    mMouseOverTrack = GetValIdxForPos(x, y);
-    SetDirty(false);
+    const int track = GetValIdxForPos(x, y);
+
+    if (track != mMouseOverTrack)
+    {
+      SetTrackDirty(mMouseOverTrack);
+      mMouseOverTrack = track;
+      SetTrackDirty(track);
+    }
   }
 
   void OnMouseOut() override
   {
+    SetTrackDirty(mMouseOverTrack);
     mMouseOverTrack = -1;
-    SetDirty(false);
+  }
+
+  void SetValueFromDelegate(double value, int valIdx = 0) override
+  {
+    if (!GetUI()->ControlIsCaptured(this) && GetValue(valIdx) != value)
+    {
+      SetValue(value, valIdx);
+      SetTrackDirty(valIdx);
+    }
   }
   
   virtual void OnResize() override
   {
+    // set again by MakeTrackRects() and MakeStepRects(), unless they are overridden
+    mUniformTracks = false;
+    mUniformSteps = false;
     SetTargetRECT(MakeRects(mRECT));
     MakeTrackRects(mWidgetBounds);
     MakeStepRects(mWidgetBounds, mNSteps);
@@ -1360,27 +1527,27 @@ public:
   
   int GetValIdxForPos(float x, float y) const override
   {
-    int nVals = NVals();
-    
-    for (auto v = 0; v < nVals; v++)
-    {
-      if (mTrackBounds.Get()[v].Contains(x, y))
-      {
-        return v;
-      }
-    }
-
-    return kNoValIdx;
+    const int track = FindTrack(GetCrossPos(x, y), [&](const IRECT& r) { return r.Contains(x, y); });
+    return track > -1 ? track : kNoValIdx;
   }
   
   void DrawWidget(IGraphics& g) override
   {
-    const int nVals = NVals();
-    
-    for (int ch = 0; ch < nVals; ch++)
+    const IRECT region = g.GetDrawRegion();
+    int lo, hi;
+    GetTracksInRegion(region, lo, hi);
+
+    // Only the tracks that changed are in the region, see SetTrackDirty()
+    mBatchTrackDrawing = true;
+
+    for (int ch = lo; ch <= hi; ch++)
     {
-      DrawTrack(g, mTrackBounds.Get()[ch], ch);
+      if (mTrackBounds.Get()[ch].Intersects(region))
+        DrawTrack(g, mTrackBounds.Get()[ch], ch);
     }
+
+    mBatchTrackDrawing = false;
+    DrawTrackBatches(g);
   }
   
   /** Update the parameters based on a parameter group name.
@@ -1453,8 +1620,9 @@ public:
 
   void SetHighlightedTrack(int highlightIdx)
   {
+    SetTrackDirty(mHighlightedTrack);
     mHighlightedTrack = highlightIdx;
-    SetDirty(false);
+    SetTrackDirty(highlightIdx);
   }
   
   void SetZeroValueStepHasBounds(bool val)
@@ -1586,12 +1754,18 @@ protected:
     }
 
     if(mStyle.drawFrame && mDrawTrackFrame)
-      g.DrawRect(GetColor(kFR), r, &mBlend, mStyle.frameThickness);
+    {
+      if (mBatchTrackDrawing)
+        mFrameBatch.push_back(r);
+      else
+        g.DrawRect(GetColor(kFR), r, &mBlend, mStyle.frameThickness);
+    }
   }
 
   virtual void DrawTrackBackground(IGraphics& g, const IRECT& r, int chIdx)
   {
-    g.FillRect(chIdx == mHighlightedTrack ? this->GetColor(kHL) : COLOR_TRANSPARENT, r);
+    if (chIdx == mHighlightedTrack)
+      g.FillRect(this->GetColor(kHL), r);
   }
   
   virtual void DrawTrackName(IGraphics& g, const IRECT& r, int chIdx)
@@ -1606,6 +1780,12 @@ protected:
    * @param aboveBaseValue true if the handle channel value is above the base value */
   virtual void DrawTrackHandle(IGraphics& g, const IRECT& r, int chIdx, bool aboveBaseValue)
   {
+    if (mBatchTrackDrawing && chIdx != mHighlightedTrack && chIdx != mMouseOverTrack)
+    {
+      mHandleBatch.push_back(r);
+      return;
+    }
+
     g.FillRect(chIdx == mHighlightedTrack ? GetColor(kX1) : GetColor(kFG), r, &mBlend);
 
     if(chIdx == mMouseOverTrack)
@@ -1614,14 +1794,27 @@ protected:
   
   virtual void DrawPeak(IGraphics& g, const IRECT& r, int chIdx, bool aboveBaseValue)
   {
-    g.FillRect(GetColor(kFR), r, &mBlend);
+    if (mBatchTrackDrawing)
+      mPeakBatch.push_back(r);
+    else
+      g.FillRect(GetColor(kFR), r, &mBlend);
   }
     
   int GetStepIdxForPos(float x, float y) const
   {
-    int nSteps = mStepBounds.GetSize();
+    const int nSteps = mStepBounds.GetSize();
+    int lo = 0, hi = nSteps - 1;
+
+    if (mUniformSteps && nSteps)
+    {
+      // steps are numbered from the bottom (or the right), the slices of mStepArea from the top (or the left)
+      const bool vertical = mDirection == EDirection::Vertical;
+      const int slice = GetSliceIdx(vertical ? y : x, vertical ? mStepArea.T : mStepArea.L, vertical ? mStepArea.H() : mStepArea.W(), nSteps);
+      lo = std::max(nSteps - 2 - slice, 0);
+      hi = std::min(nSteps - slice, nSteps - 1);
+    }
     
-    for (auto v = 0; v < nSteps; v++)
+    for (auto v = lo; v <= hi; v++)
     {
       if (mStepBounds.Get()[v].ContainsEdge(x, y))
       {
@@ -1641,6 +1834,9 @@ protected:
       mTrackBounds.Get()[ch] = bounds.SubRect(EDirection(!dir), nVals, ch).
                                      GetPadded(0, -mTrackPadding * (float) dir, -mTrackPadding * (float) !dir, -mTrackPadding);
     }
+
+    mTrackArea = bounds;
+    mUniformTracks = true;
   }
   
   virtual void MakeStepRects(const IRECT& bounds, int nSteps)
@@ -1660,6 +1856,9 @@ protected:
     }
     else
       mStepBounds.Resize(0);
+
+    mStepArea = bounds;
+    mUniformSteps = true;
   }
   
   bool GetStepped() const
@@ -1667,6 +1866,145 @@ protected:
     return mStepBounds.GetSize() > 0;
   }
 
+  /** Mark one track dirty, so that the other tracks aren't redrawn. If the tracks aren't laid out by MakeTrackRects() the whole control is marked dirty
+   * @param chIdx The track, nothing is marked if it is out of range */
+  void SetTrackDirty(int chIdx)
+  {
+    if (chIdx < 0 || chIdx >= NVals())
+      return;
+
+    if (mUniformTracks)
+      SetDirtyRegion(mTrackBounds.Get()[chIdx]);
+    else
+      SetDirty(false);
+  }
+
+  /** Mark a range of tracks dirty, e.g. those a drag has changed, and if triggerAction send only their values to the delegate (unlike SetDirty(true), which sends every track's)
+   * @param lo The first track
+   * @param hi The last track
+   * @param triggerAction If this is true, the tracks linked to parameters are sent to the delegate and the action function is called */
+  void SetTracksDirty(int lo, int hi, bool triggerAction)
+  {
+    lo = std::max(lo, 0);
+    hi = std::min(hi, NVals() - 1);
+
+    if (lo > hi)
+      return;
+
+    if (mUniformTracks)
+      SetDirtyRegion(mTrackBounds.Get()[lo].Union(mTrackBounds.Get()[hi]));
+    else
+      SetDirty(false);
+
+    if (triggerAction)
+    {
+      for (int v = lo; v <= hi; v++)
+      {
+        if (GetParamIdx(v) > kNoParameter)
+        {
+          GetDelegate()->SendParameterValueFromUI(GetParamIdx(v), GetValue(v));
+          GetUI()->UpdatePeers(this, v);
+        }
+      }
+
+      if (IActionFunction actionFunc = GetActionFunction())
+        actionFunc(this);
+    }
+  }
+
+  /** @return The position across the tracks: x if they are vertical (side by side), y if they are horizontal */
+  float GetCrossPos(float x, float y) const
+  {
+    return mDirection == EDirection::Vertical ? x : y;
+  }
+
+  /** Find the first track that pred accepts, looking only at the tracks around crossPos if they are laid out by MakeTrackRects()
+   * @param crossPos The position across the tracks, see GetCrossPos()
+   * @param pred Called with a track's bounds
+   * @return The track's index, or -1 */
+  template <typename Pred>
+  int FindTrack(float crossPos, Pred pred) const
+  {
+    const int nVals = NVals();
+    int lo = 0, hi = nVals - 1;
+
+    if (mUniformTracks && nVals)
+    {
+      const bool vertical = mDirection == EDirection::Vertical;
+      const int slice = GetSliceIdx(crossPos, vertical ? mTrackArea.L : mTrackArea.T, vertical ? mTrackArea.W() : mTrackArea.H(), nVals);
+      lo = std::max(slice - 1, 0);
+      hi = std::min(slice + 1, nVals - 1);
+    }
+
+    for (int ch = lo; ch <= hi; ch++)
+    {
+      if (pred(mTrackBounds.Get()[ch]))
+        return ch;
+    }
+
+    return -1;
+  }
+
+  /** Get the range of tracks that could intersect a region, all of them if they aren't laid out by MakeTrackRects()
+   * @param region The region being drawn
+   * @param lo The first track
+   * @param hi The last track, lower than lo if there are none */
+  void GetTracksInRegion(const IRECT& region, int& lo, int& hi) const
+  {
+    const int nVals = NVals();
+    lo = 0;
+    hi = nVals - 1;
+
+    if (mUniformTracks && nVals)
+    {
+      const bool vertical = mDirection == EDirection::Vertical;
+      const float start = vertical ? mTrackArea.L : mTrackArea.T;
+      const float size = vertical ? mTrackArea.W() : mTrackArea.H();
+      lo = GetSliceIdx(vertical ? region.L : region.T, start, size, nVals);
+      hi = GetSliceIdx(vertical ? region.R : region.B, start, size, nVals);
+    }
+  }
+
+  /** Fill the handles and peaks, and stroke the track frames, that DrawWidget() batched, one path each */
+  void DrawTrackBatches(IGraphics& g)
+  {
+    auto fillRects = [&](std::vector<IRECT>& rects, const IColor& color) {
+      if (rects.empty())
+        return;
+
+      g.PathClear();
+
+      for (auto& r : rects)
+        g.PathRect(r);
+
+      g.PathFill(color, IFillOptions(), &mBlend);
+      rects.clear();
+    };
+
+    fillRects(mHandleBatch, GetColor(kFG));
+    fillRects(mPeakBatch, GetColor(kFR));
+
+    if (mFrameBatch.size())
+    {
+      g.PathClear();
+
+      for (auto& r : mFrameBatch)
+        g.PathRect(r);
+
+      g.PathStroke(GetColor(kFR), mStyle.frameThickness, IStrokeOptions(), &mBlend);
+      mFrameBatch.clear();
+    }
+  }
+
+  /** @return The slice of a length divided into nSlices equal slices that pos is in, clamped to the first and last slice */
+  static int GetSliceIdx(float pos, float start, float size, int nSlices)
+  {
+    if (size <= 0.f)
+      return 0;
+
+    return Clip(static_cast<int>(std::floor((pos - start) * static_cast<float>(nSlices) / size)), 0, nSlices - 1);
+  }
+
 protected:
   EDirection mDirection = EDirection::Vertical;
   WDL_TypedBuf<IRECT> mTrackBounds;
@@ -1680,6 +2018,14 @@ protected:
   double mBaseValue = 0.; // 0-1 value to represent the mid-point, i.e. for displaying bipolar data
   bool mDrawTrackFrame = true;
   bool mZeroValueStepHasBounds = true; // If this is true, there is a separate step for zero, when mNSteps > 0
+  IRECT mTrackArea; // the bounds MakeTrackRects() divided into tracks
+  IRECT mStepArea; // the bounds MakeStepRects() divided into steps
+  bool mUniformTracks = false; // true if the tracks are equal slices of mTrackArea, so they can be found from a position
+  bool mUniformSteps = false;
+  bool mBatchTrackDrawing = false; // set by DrawWidget() while it draws the tracks
+  std::vector<IRECT> mHandleBatch;
+  std::vector<IRECT> mPeakBatch;
+  std::vector<IRECT> mFrameBatch;
 };
 
 /** A base class for buttons/momentary switches - cannot be linked to parameters.
@@ -8,6 +8,8 @@
  ==============================================================================
 */
 
+#include <typeinfo>
+
 #include "IGraphics.h"
 
 #define NANOSVG_IMPLEMENTATION
@@ -27,6 +29,7 @@ using VST3_API_BASE = iplug::IPlugVST3Controller;
 
 #include "IPlugParameter.h"
 #include "IPlugPluginBase.h"
+#include "IPlugResourcePack.h"
 
 #include "IControl.h"
 #include "IControls.h"
@@ -65,6 +68,9 @@ IGraphics::~IGraphics()
     
   mCursorHidden = false;
   RemoveAllControls();
+
+  // Preloads put their results in the static storage, so they must finish before it is released
+  mResourceLoader.Cancel();
     
   StaticStorage<APIBitmap>::Accessor bitmapStorage(sBitmapCache);
   bitmapStorage.Release();
@@ -79,18 +85,35 @@ void IGraphics::SetScreenScale(float scale)
   int windowHeight = WindowHeight() * GetPlatformWindowScale();
     
   PlatformResize(GetDelegate()->EditorResizeFromUI(windowWidth, windowHeight, true));
+  ClearSVGCache();
+  ClearSpriteCache();
   ForAllControls(&IControl::OnRescale);
   SetAllControlsDirty();
   DrawResize();
 }
 
 void IGraphics::Resize(int w, int h, float scale, bool needsPlatformResize)
+{
+  if (!ResizeWindow(w, h, scale, needsPlatformResize))
+    return;
+
+  // while the preview is shown, the controls are laid out once the drag ends
+  if (mResizingInProcess && mResizePreview)
+  {
+    mResizeLayoutPending = true;
+    return;
+  }
+
+  LayoutAfterResize();
+}
+
+bool IGraphics::ResizeWindow(int w, int h, float scale, bool needsPlatformResize)
 {
   GetDelegate()->ConstrainEditorResize(w, h);
   
   scale = Clip(scale, mMinScale, mMaxScale);
   
-  if (w == Width() && h == Height() && scale == GetDrawScale()) return;
+  if (w == Width() && h == Height() && scale == GetDrawScale()) return false;
   
   //DBGMSG("resize %i, resize %i, scale %f\n", w, h, scale);
   ReleaseMouseCapture();
@@ -106,9 +129,18 @@ void IGraphics::Resize(int w, int h, float scale, bool needsPlatformResize)
   int windowHeight = WindowHeight() * GetPlatformWindowScale();
     
   PlatformResize(GetDelegate()->EditorResizeFromUI(windowWidth, windowHeight, needsPlatformResize));
+  DrawResize();
+  return true;
+}
+
+void IGraphics::LayoutAfterResize()
+{
+  mResizeLayoutPending = false;
+  mSpatialIndex.Invalidate();
+  ClearSVGCache();
+  ClearSpriteCache();
   ForAllControls(&IControl::OnResize);
   SetAllControlsDirty();
-  DrawResize();
   
   if(mLayoutOnResize)
     GetDelegate()->LayoutUI(this);
@@ -123,6 +155,7 @@ void IGraphics::RemoveControlWithTag(int ctrlTag)
 {
   mControls.DeletePtr(GetControlWithTag(ctrlTag), true);
   mCtrlTags.erase(ctrlTag);
+  mSpatialIndex.Invalidate();
   SetAllControlsDirty();
 }
 
@@ -151,6 +184,7 @@ void IGraphics::RemoveControls(int fromIdx)
     mControls.Delete(idx--, true);
   }
   
+  mSpatialIndex.Invalidate();
   SetAllControlsDirty();
 }
 
@@ -178,6 +212,7 @@ void IGraphics::RemoveControl(IControl* pControl)
   
   mControls.DeletePtr(pControl, true);
   
+  mSpatialIndex.Invalidate();
   SetAllControlsDirty();
 }
 
@@ -197,8 +232,25 @@ void IGraphics::RemoveAllControls()
   
   mBubbleControls.Empty(true);
   
+  // N.B. clear the flags first, so that the controls don't search the list as they are deleted
+  for (auto pControl : mActiveControls)
+    pControl->mIsActive = false;
+
+  mActiveControls.clear();
+
+  for (auto pControl : mAnimatingControls)
+    pControl->mIsAnimating = false;
+
+  mAnimatingControls.clear();
+
   mCtrlTags.clear();
   mControls.Empty(true);
+  mSpatialIndex.Invalidate();
+  mResizePreview = nullptr;
+
+  // N.B. the cached layers hold drawing API bitmaps, which the back ends free (with the controls) before destroying their context
+  ClearSVGCache();
+  ClearSpriteCache();
 }
 
 void IGraphics::SetControlPosition(int idx, float x, float y)
@@ -225,6 +277,29 @@ void IGraphics::SetControlBounds(int idx, const IRECT& r)
     SetAllControlsDirty();
 }
 
+bool IGraphics::SetControlBounds(IControl* const* pControls, const IRECT* pBounds, int nControls)
+{
+  bool changed = false;
+  bool redraw = false;
+
+  for (int i = 0; i < nControls; i++)
+  {
+    IControl* pControl = pControls[i];
+
+    if (pControl->GetRECT() == pBounds[i] && pControl->GetTargetRECT() == pBounds[i])
+      continue;
+
+    pControl->SetTargetAndDrawRECTs(pBounds[i]);
+    changed = true;
+    redraw |= !pControl->IsHidden();
+  }
+
+  if (redraw)
+    SetAllControlsDirty();
+
+  return changed;
+}
+
 void IGraphics::SetControlValueAfterTextEdit(const char* str)
 {
   if (!mInTextEntry)
@@ -275,6 +350,8 @@ void IGraphics::AttachBackground(const char* fileName)
   IControl* pBG = new IBitmapControl(0, 0, LoadBitmap(fileName, 1, false), kNoParameter, EBlend::Default);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  mSpatialIndex.Invalidate();
+  MarkControlActive(pBG);
 }
 
 void IGraphics::AttachSVGBackground(const char* fileName)
@@ -282,6 +359,8 @@ void IGraphics::AttachSVGBackground(const char* fileName)
   IControl* pBG = new ISVGControl(GetBounds(), LoadSVG(fileName), true);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  mSpatialIndex.Invalidate();
+  MarkControlActive(pBG);
 }
 
 void IGraphics::AttachPanelBackground(const IPattern& color)
@@ -289,6 +368,8 @@ void IGraphics::AttachPanelBackground(const IPattern& color)
   IControl* pBG = new IPanelControl(GetBounds(), color);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  mSpatialIndex.Invalidate();
+  MarkControlActive(pBG);
 }
 
 IControl* IGraphics::AttachControl(IControl* pControl, int ctrlTag, const char* group)
@@ -305,6 +386,15 @@ IControl* IGraphics::AttachControl(IControl* pControl, int ctrlTag, const char*
   pControl->SetDelegate(*GetDelegate());
   pControl->SetGroup(group);
   mControls.Add(pControl);
+
+  if (mSpatialIndex.IsValid())
+  {
+    const int idx = NControls() - 1;
+    mSpatialIndex.Add(idx, GetSpatialIndexBounds(pControl));
+    mSpatialIndexIdx[pControl] = idx;
+  }
+
+  MarkControlActive(pControl);
     
   pControl->OnAttached();
   return pControl;
@@ -419,6 +509,108 @@ void IGraphics::ShowBubbleControl(IControl* pCaller, float x, float y, const cha
     mBubbleControls.Get(0)->ShowBubble(pCaller, x, y, str, dir, minimumContentBounds);
 }
 
+void IGraphics::StartDrawBenchmark(int nFrames, IDrawBenchmarkCompletionFunc completionFunc)
+{
+  if (nFrames > 0)
+    mDrawBenchmark.Start(nFrames, completionFunc);
+}
+
+void IGraphics::SetDynamicResolution(bool enable, double frameBudgetMs, float minScale)
+{
+  mDynamicResolution = enable;
+  mFrameBudget = std::max(frameBudgetMs, 0.) / 1000.;
+  mMinResolutionScale = Clip(minScale, 0.25f, 1.f);
+  mOverBudgetFrames = 0;
+  mUnderBudgetFrames = 0;
+  mUnderBudgetFramesNeeded = kDynamicResolutionUpFrames;
+  mFramesSinceScaleUp = 0;
+
+  if (!enable || mDynamicResolutionScale < mMinResolutionScale)
+    SetDynamicResolutionScale(enable ? mMinResolutionScale : 1.f);
+}
+
+void IGraphics::SetDynamicResolutionScale(float scale)
+{
+  if (scale == mDynamicResolutionScale)
+    return;
+
+  mDynamicResolutionScale = scale;
+
+  ForAllControlsFunc([scale](IControl* pControl) {
+    if (pControl->mIsVisualization)
+    {
+      if (scale >= 1.f)
+        pControl->mVisualizationLayer = nullptr;
+
+      pControl->SetDirty(false);
+    }
+  });
+}
+
+void IGraphics::UpdateDynamicResolution(double frameTime)
+{
+  // discrete levels, so that the layers are reallocated only when the level changes
+  static constexpr float kLevels[] = { 1.f, 0.75f, 0.5f, 0.35f, 0.25f };
+  static constexpr int kDownFrames = 3;
+  static constexpr int kMaxUpFrames = 16 * kDynamicResolutionUpFrames;
+
+  const double budget = mFrameBudget > 0. ? mFrameBudget : 1. / std::max(FPS(), 1);
+
+  mFramesSinceScaleUp++;
+
+  if (frameTime > budget)
+  {
+    mUnderBudgetFrames = 0;
+
+    if (++mOverBudgetFrames >= kDownFrames && mDynamicResolutionScale > mMinResolutionScale)
+    {
+      float scale = mMinResolutionScale;
+
+      for (auto level : kLevels)
+      {
+        if (level < mDynamicResolutionScale)
+        {
+          scale = std::max(level, mMinResolutionScale);
+          break;
+        }
+      }
+
+      // stepping back down soon after stepping up means the higher level doesn't fit, so wait longer before trying it again
+      if (mFramesSinceScaleUp < 2 * mUnderBudgetFramesNeeded)
+        mUnderBudgetFramesNeeded = std::min(2 * mUnderBudgetFramesNeeded, kMaxUpFrames);
+      else
+        mUnderBudgetFramesNeeded = kDynamicResolutionUpFrames;
+
+      mOverBudgetFrames = 0;
+      SetDynamicResolutionScale(scale);
+    }
+  }
+  else
+  {
+    mOverBudgetFrames = 0;
+
+    if (frameTime < 0.6 * budget && mDynamicResolutionScale < 1.f)
+    {
+      if (++mUnderBudgetFrames >= mUnderBudgetFramesNeeded)
+      {
+        float scale = 1.f;
+
+        for (auto level : kLevels)
+        {
+          if (level > mDynamicResolutionScale)
+            scale = level;
+        }
+
+        mUnderBudgetFrames = 0;
+        mFramesSinceScaleUp = 0;
+        SetDynamicResolutionScale(scale);
+      }
+    }
+    else
+      mUnderBudgetFrames = 0;
+  }
+}
+
 void IGraphics::ShowFPSDisplay(bool enable)
 {
   if (enable)
@@ -438,6 +630,19 @@ void IGraphics::ShowFPSDisplay(bool enable)
   SetAllControlsDirty();
 }
 
+void IGraphics::GetMemoryReport(IMemoryReport& report)
+{
+  size_t bytes = 0;
+
+  {
+    StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
+    storage.ForEach([&bytes](const APIBitmap& bitmap) { bytes += static_cast<size_t>(bitmap.GetWidth()) * bitmap.GetHeight() * 4; });
+  }
+
+  report.Add(kMemoryBitmaps, bytes, true);
+  report.Add(kMemoryLayers, *mLayerBytes);
+}
+
 IControl* IGraphics::GetControlWithTag(int ctrlTag) const
 {
   const auto it = mCtrlTags.find(ctrlTag);
@@ -516,7 +721,11 @@ void IGraphics::ForStandardControlsFunc(std::function<void(IControl* pControl)>
 void IGraphics::ForAllControlsFunc(std::function<void(IControl* pControl)> func)
 {
   ForStandardControlsFunc(func);
-  
+  ForSpecialControlsFunc(func);
+}
+
+void IGraphics::ForSpecialControlsFunc(const std::function<void(IControl* pControl)>& func)
+{
   if (mPerfDisplay)
     func(mPerfDisplay.get());
   
@@ -543,6 +752,26 @@ void IGraphics::ForAllControlsFunc(std::function<void(IControl* pControl)> func)
   }
 }
 
+bool IGraphics::IsSpecialControl(const IControl* pControl) const
+{
+  // N.B. the special controls are always visited each frame, so they are never put in the active list
+  if (pControl == mPerfDisplay.get() || pControl == mCornerResizer.get() || pControl == mTextEntryControl.get() || pControl == mPopupControl.get())
+    return true;
+
+#ifndef NDEBUG
+  if (pControl == mLiveEdit.get())
+    return true;
+#endif
+
+  for (int i = 0; i < mBubbleControls.GetSize(); i++)
+  {
+    if (pControl == mBubbleControls.Get(i))
+      return true;
+  }
+
+  return false;
+}
+
 template<typename T, typename... Args>
 void IGraphics::ForAllControls(T method, Args... args)
 {
@@ -562,7 +791,136 @@ void IGraphics::SetAllControlsDirty()
 
 void IGraphics::SetAllControlsClean()
 {
-  ForAllControls(&IControl::SetClean);
+  if (mTrackDirtyControls)
+  {
+    for (auto pControl : mActiveControls)
+      pControl->SetClean();
+
+    ForSpecialControlsFunc([](IControl* pControl) { pControl->SetClean(); });
+  }
+  else
+    ForAllControls(&IControl::SetClean);
+}
+
+void IGraphics::EnableDirtyTracking(bool enable)
+{
+  if (enable == mTrackDirtyControls)
+    return;
+
+  for (auto pControl : mActiveControls)
+    pControl->mIsActive = false;
+
+  mActiveControls.clear();
+  mTrackDirtyControls = enable;
+
+  // start from everything so that nothing that is already dirty or animating is missed
+  if (enable)
+    ForStandardControlsFunc([this](IControl* pControl) { MarkControlActive(pControl); });
+}
+
+void IGraphics::MarkControlActive(IControl* pControl)
+{
+  RequestFrame();
+
+  if (mTrackDirtyControls && !pControl->mIsActive && !IsSpecialControl(pControl))
+  {
+    pControl->mIsActive = true;
+    mActiveControls.push_back(pControl);
+  }
+}
+
+void IGraphics::RemoveActiveControl(IControl* pControl)
+{
+  auto itr = std::find(mActiveControls.begin(), mActiveControls.end(), pControl);
+
+  if (itr != mActiveControls.end())
+    mActiveControls.erase(itr);
+
+  pControl->mIsActive = false;
+}
+
+void IGraphics::ScheduleAnimation(IControl* pControl)
+{
+  RequestFrame();
+
+  if (!pControl->mIsAnimating)
+  {
+    pControl->mIsAnimating = true;
+    mAnimatingControls.push_back(pControl);
+  }
+}
+
+void IGraphics::UnscheduleAnimation(IControl* pControl)
+{
+  auto itr = std::find(mAnimatingControls.begin(), mAnimatingControls.end(), pControl);
+
+  if (itr != mAnimatingControls.end())
+    mAnimatingControls.erase(itr);
+
+  pControl->mIsAnimating = false;
+}
+
+bool IGraphics::AnimateControls()
+{
+  mAnimationFrameTime = std::chrono::high_resolution_clock::now();
+
+  // N.B. indexed loop, since an animation (or its end action) may start others, or delete controls
+  for (size_t i = 0; i < mAnimatingControls.size(); i++)
+    mAnimatingControls[i]->Animate();
+
+  size_t nAnimating = 0;
+
+  for (size_t i = 0; i < mAnimatingControls.size(); i++)
+  {
+    IControl* pControl = mAnimatingControls[i];
+
+    if (pControl->GetAnimationFunction())
+      mAnimatingControls[nAnimating++] = pControl;
+    else
+      pControl->mIsAnimating = false;
+  }
+
+  mAnimatingControls.resize(nAnimating);
+
+  return nAnimating > 0;
+}
+
+void IGraphics::OnControlBoundsChanged(IControl* pControl)
+{
+  if (!mSpatialIndex.IsValid())
+    return;
+
+  auto itr = mSpatialIndexIdx.find(pControl);
+
+  if (itr != mSpatialIndexIdx.end())
+    mSpatialIndex.Update(itr->second, GetSpatialIndexBounds(pControl));
+}
+
+IRECT IGraphics::GetSpatialIndexBounds(const IControl* pControl)
+{
+  // N.B. padding as for DrawControl(), with a margin for pixel alignment
+  return pControl->GetRECT().GetPadded(2.f).Union(pControl->GetTargetRECT());
+}
+
+bool IGraphics::UseSpatialIndex()
+{
+  if (NControls() < IControlSpatialIndex::kMinControls)
+    return false;
+
+  if (!mSpatialIndex.IsValid())
+  {
+    mSpatialIndex.Reset(GetBounds(), NControls());
+    mSpatialIndexIdx.clear();
+
+    for (auto c = 0; c < NControls(); c++)
+    {
+      IControl* pControl = GetControl(c);
+      mSpatialIndex.Add(c, GetSpatialIndexBounds(pControl));
+      mSpatialIndexIdx[pControl] = c;
+    }
+  }
+
+  return true;
 }
 
 void IGraphics::AssignParamNameToolTips()
@@ -647,8 +1005,16 @@ void IGraphics::DrawText(const IText& text, const char* str, const IRECT& bounds
 {
   if (!str || str[0] == '\0')
     return;
-    
+  
+  // N.B. the text is recorded as a whole, so don't record any transforms or paths the back end uses to draw it
+  IDisplayList* pRecorder = mDisplayListRecorder;
+  
+  if (pRecorder)
+    pRecorder->DrawText(text, str, bounds, pBlend);
+  
+  mDisplayListRecorder = nullptr;
   DoDrawText(text, str, bounds, pBlend);
+  mDisplayListRecorder = pRecorder;
 }
 
 float IGraphics::MeasureText(const IText& text, const char* str, IRECT& bounds) const
@@ -790,12 +1156,59 @@ void IGraphics::PathRadialLine(float cx, float cy, float angle, float rMin, floa
   PathLine(data[0][0], data[0][1], data[1][0], data[1][1]);
 }
 
+void IGraphics::SetOccluded(bool occluded)
+{
+  if (occluded == mOccluded)
+    return;
+
+  mOccluded = occluded;
+
+  // nothing was drawn while hidden, and the platform may have thrown the window's contents away
+  if (!occluded)
+  {
+    SetAllControlsDirty();
+    RequestFrame();
+  }
+}
+
 bool IGraphics::IsDirty(IRECTList& rects)
 {
+  if (mOccluded)
+    return false;
+
+  FlushPendingDrags();
+
+  if (mDelegate)
+    mDelegate->DeliverCoalescedControlMsgs();
+
   if (mDisplayTickFunc)
     mDisplayTickFunc();
 
-  ForAllControlsFunc([](IControl* pControl) { pControl->Animate(); } );
+  bool resized = false;
+
+  // apply drag resize events once per frame, but only once the preview has been captured at the old size
+  if (mDragResizePending && !mCaptureResizePreview)
+  {
+    mDragResizePending = false;
+    resized = ResizeWindow(mDragResizeWidth, mDragResizeHeight, mDragResizeScale, true);
+
+    if (resized)
+    {
+      if (mResizePreview)
+        mResizeLayoutPending = true;
+      else
+        LayoutAfterResize();
+    }
+  }
+
+  if (mCaptureResizePreview || (mResizePreview && mResizingInProcess))
+  {
+    // only the preview is drawn until the drag ends
+    if (mCaptureResizePreview || resized)
+      rects.Add(GetBounds());
+
+    return rects.Size() > 0;
+  }
 
   bool dirty = false;
     
@@ -803,12 +1216,56 @@ bool IGraphics::IsDirty(IRECTList& rects)
     if (pControl->IsDirty())
     {
       // N.B padding outlines for single line outlines
-      rects.Add(pControl->GetRECT().GetPadded(0.75));
+      rects.Add(pControl->GetDirtyRECT().GetPadded(0.75));
       dirty = true;
     }
   };
-    
-  ForAllControlsFunc(func);
+
+  if (mTrackDirtyControls)
+  {
+    AnimateControls();
+
+    // N.B. indexed loop, since checking a control may mark more controls as active
+    size_t nActive = 0;
+
+    for (size_t i = 0; i < mActiveControls.size(); i++)
+    {
+      IControl* pControl = mActiveControls[i];
+      const bool controlDirty = pControl->IsDirty();
+
+      if (controlDirty)
+      {
+        rects.Add(pControl->GetDirtyRECT().GetPadded(0.75));
+        dirty = true;
+      }
+
+      // keep the controls that still need checking next frame (dirty ones are cleaned after drawing, then dropped)
+      if (controlDirty || pControl->GetAnimationFunction() || pControl->GetPollDirty())
+        mActiveControls[nActive++] = pControl;
+      else
+        pControl->mIsActive = false;
+    }
+
+    mActiveControls.resize(nActive);
+
+    ForSpecialControlsFunc(func);
+  }
+  else
+  {
+    AnimateControls();
+    ForAllControlsFunc(func);
+  }
+
+  // a draw benchmark redraws everything every frame
+  if (mDrawBenchmark.IsRunning())
+  {
+    rects.Add(GetBounds());
+    dirty = true;
+  }
+
+  // merge the rects here as well as in Draw(), so that the platform layers invalidate fewer regions
+  if (dirty && !mStrict)
+    rects.MergeByCost(mRedrawRectOverhead, mMaxRedrawRects);
 
 #ifdef USE_IDLE_CALLS
   if (dirty)
@@ -849,7 +1306,35 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
       return;
     
     PrepareRegion(clipBounds);
-    pControl->Draw(*this);
+    
+    IDisplayList* pList = pControl->GetDisplayList();
+    
+    mSVGCacheAllowed = pControl->GetUseSVGCache();
+
+    const bool benchmark = mDrawBenchmark.IsRunning();
+    const double startTime = benchmark ? GetTimestamp() : 0.;
+
+    if (pControl->mIsVisualization)
+      mNVisualizationsDrawn++;
+
+    if (pControl->mIsVisualization && mDynamicResolutionScale < 1.f)
+      DrawVisualizationControl(pControl, clipBounds);
+    else if (pList && pList->IsValid(GetTotalScale()))
+      DrawDisplayList(*pList);
+    else if (pList && clipBounds == controlBounds && StartDisplayList(*pList))
+    {
+      // N.B. only record when the whole control is drawn, since the recorded clip regions are limited to the region being drawn
+      pControl->Draw(*this);
+      EndDisplayList(*pList);
+    }
+    else
+      pControl->Draw(*this);
+
+    if (benchmark)
+      mDrawBenchmark.AddControl(pControl, pControl->GetTag(), typeid(*pControl).name(), GetTimestamp() - startTime);
+
+    mSVGCacheAllowed = true;
+    
 #ifdef AAX_API
     pControl->DrawPTHighlight(*this);
 #endif
@@ -866,9 +1351,48 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
   }
 }
 
+void IGraphics::DrawVisualizationControl(IControl* pControl, const IRECT& clipBounds)
+{
+  ILayerPtr& layer = pControl->mVisualizationLayer;
+
+  // the same approach as ScaleBitmap(): draw into a layer with a reduced draw scale, which DrawBitmap() takes into account when the layer is drawn
+  const float drawScale = mDrawScale;
+  mDrawScale = drawScale * mDynamicResolutionScale;
+
+  if (CheckLayer(layer))
+  {
+    const IBlend clearBlend(EBlend::DstOut);
+    ResumeLayer(layer);
+    FillRect(COLOR_BLACK, layer->Bounds(), &clearBlend);
+  }
+  else
+    StartLayer(pControl, pControl->GetRECT().GetPadded(0.75));
+
+  pControl->Draw(*this);
+  layer = EndLayer();
+
+  mDrawScale = drawScale;
+
+  // popping the layer resets the transform and clip
+  PrepareRegion(clipBounds);
+  DrawLayer(layer);
+}
+
 void IGraphics::Draw(const IRECT& bounds, float scale)
 {
-  ForAllControlsFunc([this, bounds, scale](IControl* pControl) { DrawControl(pControl, bounds, scale); });
+  auto drawFunc = [this, bounds, scale](IControl* pControl) { DrawControl(pControl, bounds, scale); };
+
+  if (UseSpatialIndex())
+  {
+    mSpatialIndex.GetCandidatesIn(bounds, mSpatialIndexQuery);
+
+    for (auto idx : mSpatialIndexQuery)
+      DrawControl(GetControl(idx), bounds, scale);
+
+    ForSpecialControlsFunc(drawFunc);
+  }
+  else
+    ForAllControlsFunc(drawFunc);
 
 #ifndef NDEBUG
   if (mShowAreaDrawn)
@@ -888,10 +1412,32 @@ void IGraphics::Draw(IRECTList& rects)
     return;
   
   float scale = GetBackingPixelScale();
+
+  const bool benchmark = mDrawBenchmark.IsRunning();
+  const double frameStartTime = (benchmark || mDynamicResolution) ? GetTimestamp() : 0.;
+  mNVisualizationsDrawn = 0;
     
   BeginFrame();
-    
-  if (mStrict)
+
+  if (mCaptureResizePreview)
+  {
+    mCaptureResizePreview = false;
+    StartLayer(nullptr, GetBounds());
+    Draw(GetBounds(), scale);
+    mResizePreview = EndLayer();
+  }
+  else if (mResizePreview && !mResizingInProcess)
+  {
+    mResizePreview = nullptr;
+  }
+
+  if (mResizePreview)
+  {
+    PrepareRegion(GetBounds());
+    DrawFittedLayer(mResizePreview, GetBounds(), nullptr);
+    CompleteRegion(GetBounds());
+  }
+  else if (mStrict)
   {
     IRECT r = rects.Bounds();
     r.PixelAlign(scale);
@@ -900,6 +1446,7 @@ void IGraphics::Draw(IRECTList& rects)
   else
   {
     rects.PixelAlign(scale);
+    rects.MergeByCost(mRedrawRectOverhead, mMaxRedrawRects);
     rects.Optimize();
 
     for (auto i = 0; i < rects.Size(); i++)
@@ -907,6 +1454,84 @@ void IGraphics::Draw(IRECTList& rects)
   }
   
   EndFrame();
+
+  // only frames that drew visualizations tell whether their resolution fits the budget
+  if (mDynamicResolution && mNVisualizationsDrawn && !mResizePreview)
+    UpdateDynamicResolution(GetTimestamp() - frameStartTime);
+
+  if (benchmark)
+  {
+    const double frameTime = GetTimestamp() - frameStartTime;
+    mDrawBenchmark.EndFrame(frameTime, GetGPUFrameTime(), GetDrawingAPIStr(), [this](const IControl* pControl) {
+      return GetControlIdx(const_cast<IControl*>(pControl));
+    });
+  }
+}
+
+bool IGraphics::StartDisplayList(IDisplayList& list)
+{
+  if (!mLayers.empty())
+    return false;
+  
+  list.Reset(GetTotalScale());
+  mDisplayListRecorder = &list;
+  return true;
+}
+
+void IGraphics::EndDisplayList(IDisplayList& list)
+{
+  if (mDisplayListRecorder == &list)
+    list.SetValid();
+  
+  mDisplayListRecorder = nullptr;
+}
+
+void IGraphics::AbortDisplayList()
+{
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->Invalidate();
+  
+  mDisplayListRecorder = nullptr;
+}
+
+void IGraphics::DrawDisplayList(const IDisplayList& list)
+{
+  using ECommand = IDisplayList::ECommand;
+  
+  for (auto i = 0; i < list.NCommands(); i++)
+  {
+    const IDisplayList::Command& cmd = list.GetCommand(i);
+    const float* a = list.GetArgs(cmd);
+    
+    switch (cmd.mType)
+    {
+      case ECommand::PathClear:             PathClear();                                                    break;
+      case ECommand::PathClose:             PathClose();                                                    break;
+      case ECommand::PathArc:               PathArc(a[0], a[1], a[2], a[3], a[4], static_cast<EWinding>(static_cast<int>(a[5]))); break;
+      case ECommand::PathMoveTo:            PathMoveTo(a[0], a[1]);                                         break;
+      case ECommand::PathLineTo:            PathLineTo(a[0], a[1]);                                         break;
+      case ECommand::PathCubicBezierTo:     PathCubicBezierTo(a[0], a[1], a[2], a[3], a[4], a[5]);          break;
+      case ECommand::PathQuadraticBezierTo: PathQuadraticBezierTo(a[0], a[1], a[2], a[3]);                  break;
+      case ECommand::PathSetWinding:        PathSetWinding(a[0] != 0.f);                                    break;
+      case ECommand::PathStroke:            PathStroke(list.GetPattern(cmd), a[0], list.GetStrokeOptions(cmd), list.GetBlend(cmd)); break;
+      case ECommand::PathFill:              PathFill(list.GetPattern(cmd), list.GetFillOptions(cmd), list.GetBlend(cmd)); break;
+      case ECommand::SetTransform:
+        mTransform = IMatrix(a[0], a[1], a[2], a[3], a[4], a[5]);
+        PathTransformSetMatrix(mTransform);
+        break;
+      case ECommand::PathClipRegion:        PathClipRegion(IRECT(a[0], a[1], a[2], a[3]));                  break;
+      case ECommand::DrawText:              DoDrawText(list.GetText(cmd), list.GetString(cmd), IRECT(a[0], a[1], a[2], a[3]), list.GetBlend(cmd)); break;
+      case ECommand::DrawBitmap:
+        DrawBitmap(list.GetBitmap(cmd), IRECT(a[0], a[1], a[2], a[3]), static_cast<int>(a[4]), static_cast<int>(a[5]), list.GetBlend(cmd));
+        break;
+      case ECommand::DrawFastDropShadow:
+      {
+        IBlend blend = list.GetBlend(cmd) ? *list.GetBlend(cmd) : IBlend();
+        DrawFastDropShadow(IRECT(a[0], a[1], a[2], a[3]), IRECT(a[4], a[5], a[6], a[7]), a[8], a[9], a[10], list.GetBlend(cmd) ? &blend : nullptr);
+        break;
+      }
+    }
+  }
 }
 
 void IGraphics::SetStrictDrawing(bool strict)
@@ -915,8 +1540,56 @@ void IGraphics::SetStrictDrawing(bool strict)
   SetAllControlsDirty();
 }
 
+void IGraphics::SetRedrawRegionOptimization(float rectOverhead, int maxRects)
+{
+  mRedrawRectOverhead = std::max(rectOverhead, 0.f);
+  mMaxRedrawRects = std::max(maxRects, 1);
+}
+
+void IGraphics::EnableSVGCache(bool enable)
+{
+  mEnableSVGCache = enable;
+
+  if (!enable)
+    ClearSVGCache();
+}
+
+void IGraphics::ClearSVGCache()
+{
+  if (mSVGCache.empty())
+    return;
+
+  mSVGCache.clear();
+
+  // Display lists may have recorded draws of the cached bitmaps
+  ForStandardControlsFunc([](IControl* pControl) { pControl->InvalidateDisplayList(); });
+}
+
+void IGraphics::EnableSharedSprites(bool enable)
+{
+  if (enable != mEnableSharedSprites)
+  {
+    mEnableSharedSprites = enable;
+    ClearSpriteCache();
+    SetAllControlsDirty();
+  }
+}
+
+void IGraphics::ClearSpriteCache()
+{
+  if (mSpriteCache.empty())
+    return;
+
+  mSpriteCache.clear();
+
+  // Display lists may have recorded draws of the cached bitmaps
+  ForStandardControlsFunc([](IControl* pControl) { pControl->InvalidateDisplayList(); });
+}
+
 void IGraphics::OnMouseDown(const std::vector<IMouseInfo>& points)
 {
+  FlushPendingDrags();
+
 //  Trace("IGraphics::OnMouseDown", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i", x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
 
   bool singlePoint = points.size() == 1;
@@ -1003,6 +1676,8 @@ void IGraphics::OnMouseDown(const std::vector<IMouseInfo>& points)
 
 void IGraphics::OnMouseUp(const std::vector<IMouseInfo>& points)
 {
+  FlushPendingDrags();
+
 //  Trace("IGraphics::OnMouseUp", __LINE__, "x:%0.2f, y:%0.2f, mod:LRSCA: %i%i%i%i%i", x, y, mod.L, mod.R, mod.S, mod.C, mod.A);
   
   if (ControlIsCaptured())
@@ -1044,6 +1719,8 @@ void IGraphics::OnMouseUp(const std::vector<IMouseInfo>& points)
 
 void IGraphics::OnTouchCancelled(const std::vector<IMouseInfo>& points)
 {
+  FlushPendingDrags();
+
   if (ControlIsCaptured())
   {
     //work out which of mCapturedMap controls the cancel relates to
@@ -1100,6 +1777,65 @@ void IGraphics::OnMouseOut()
 }
 
 void IGraphics::OnMouseDrag(const std::vector<IMouseInfo>& points)
+{
+  if (!mEnableDragCoalescing)
+  {
+    DispatchMouseDrag(points);
+    return;
+  }
+
+  for (auto& point : points)
+  {
+    auto itr = mCapturedMap.find(point.ms.touchID);
+
+    if (itr != mCapturedMap.end() && itr->second->GetWantsEveryDrag())
+    {
+      // this touch's drags have never been coalesced, so there is nothing pending to send first
+      DispatchMouseDrag({ point });
+      continue;
+    }
+
+    auto pending = std::find_if(mPendingDrags.rbegin(), mPendingDrags.rend(), [&point](const IMouseInfo& info) { return info.ms.touchID == point.ms.touchID; });
+
+    // a modifier changing part way through a drag, e.g. shift for fine adjustment, starts a new event, so that the deltas before it aren't scaled by it
+    auto sameMods = [](const IMouseMod& a, const IMouseMod& b) {
+      return a.L == b.L && a.R == b.R && a.S == b.S && a.C == b.C && a.A == b.A;
+    };
+
+    if (pending != mPendingDrags.rend() && sameMods(pending->ms, point.ms))
+    {
+      const float dX = pending->dX + point.dX;
+      const float dY = pending->dY + point.dY;
+      *pending = point;
+      pending->dX = dX;
+      pending->dY = dY;
+    }
+    else
+      mPendingDrags.push_back(point);
+  }
+}
+
+void IGraphics::FlushPendingDrags()
+{
+  if (mPendingDrags.empty())
+    return;
+
+  // a control can release the capture, and so clear mPendingDrags, from OnMouseDrag()
+  std::vector<IMouseInfo> points;
+  points.swap(mPendingDrags);
+
+  // each pending drag is sent on its own, as the platform would have sent it, so OnDragResize() still sees single points
+  for (auto& point : points)
+    DispatchMouseDrag({ point });
+
+  // keep the capacity, so that coalescing doesn't allocate once the vector has been used
+  points.clear();
+
+  if (mPendingDrags.empty())
+    mPendingDrags.swap(points);
+}
+
+void IGraphics::DispatchMouseDrag(const std::vector<IMouseInfo>& points)
 {
   Trace("IGraphics::OnMouseDrag:", __LINE__, "x:%0.2f, y:%0.2f, dX:%0.2f, dY:%0.2f, mod:LRSCA: %i%i%i%i%i",
         points[0].x, points[0].y, points[0].dX, points[0].dY, points[0].ms.L, points[0].ms.R, points[0].ms.S, points[0].ms.C, points[0].ms.A);
@@ -1219,6 +1955,7 @@ void IGraphics::OnDrop(const char* str, float x, float y)
 void IGraphics::ReleaseMouseCapture()
 {
   mCapturedMap.clear();
+  mPendingDrags.clear();
   if (mCursorHidden)
     HideMouseCursor(false);
 }
@@ -1227,11 +1964,9 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
 {
   if (!mouseOver || mEnableMouseOver)
   {
-    // Search from front to back
-    for (auto c = NControls() - 1; c >= (mouseOver ? 1 : 0); --c)
-    {
-      IControl* pControl = GetControl(c);
+    const int lowestIdx = mouseOver ? 1 : 0;
 
+    auto isHit = [&](IControl* pControl) {
 #ifndef NDEBUG
       if(!mLiveEdit)
       {
@@ -1240,19 +1975,36 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
         {
           if ((!pControl->IsDisabled() || (mouseOver ? pControl->GetMouseOverWhenDisabled() : pControl->GetMouseEventsWhenDisabled())))
           {
-            if (pControl->IsHit(x, y))
-            {
-              return c;
-            }
+            return pControl->IsHit(x, y);
           }
         }
+        return false;
 #ifndef NDEBUG
       }
-      else if (pControl->GetRECT().Contains(x, y))
+      else
+        return pControl->GetRECT().Contains(x, y);
+#endif
+    };
+
+    const std::vector<int>* pCandidates = UseSpatialIndex() ? mSpatialIndex.GetCandidatesAt(x, y) : nullptr;
+
+    if (pCandidates)
+    {
+      // Search from front to back, only through the controls in the grid cell under the point
+      for (auto itr = pCandidates->rbegin(); itr != pCandidates->rend() && *itr >= lowestIdx; ++itr)
       {
-        return c;
+        if (isHit(GetControl(*itr)))
+          return *itr;
+      }
+    }
+    else
+    {
+      // Search from front to back
+      for (auto c = NControls() - 1; c >= lowestIdx; --c)
+      {
+        if (isHit(GetControl(c)))
+          return c;
       }
-#endif
     }
   }
   
@@ -1411,17 +2163,24 @@ void IGraphics::OnGUIIdle()
 
 void IGraphics::OnDragResize(float x, float y)
 {
+  // N.B. the last event is applied on the next frame, see IsDirty()
   if(mGUISizeMode == EUIResizerMode::Scale)
   {
     float scaleX = (x * GetDrawScale()) / mMouseDownX;
     float scaleY = (y * GetDrawScale()) / mMouseDownY;
 
-    Resize(Width(), Height(), std::min(scaleX, scaleY));
+    mDragResizeWidth = Width();
+    mDragResizeHeight = Height();
+    mDragResizeScale = std::min(scaleX, scaleY);
   }
   else
   {
-    Resize(static_cast<int>(x), static_cast<int>(y), GetDrawScale());
+    mDragResizeWidth = static_cast<int>(x);
+    mDragResizeHeight = static_cast<int>(y);
+    mDragResizeScale = GetDrawScale();
   }
+
+  mDragResizePending = true;
 }
 
 void IGraphics::OnAppearanceChanged(EUIAppearance appearance)
@@ -1466,77 +2225,136 @@ void IGraphics::EnableLiveEdit(bool enable)
 #endif
 }
 
-// Skia has its own implementation for SVGs. On all other platforms we use NanoSVG, because it works.
-#ifdef SVG_USE_SKIA
-ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
+/** Read a whole file
+ * @param path The absolute path of the file
+ * @param result Filled with the file data, or left empty if the file couldn't be read */
+static void ReadResourceFile(const char* path, WDL_TypedBuf<uint8_t>& result)
 {
-  StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
-  SVGHolder* pHolder = storage.Find(fileName);
+  FILE* fd = fopen(path, "rb");
+  if (!fd)
+    return;
   
-  if(!pHolder)
+  // First we determine the file size
+  if (fseek(fd, 0, SEEK_END))
   {
-    WDL_TypedBuf<uint8_t> svgData = LoadResource(fileName, "svg");
-    if (svgData.GetSize() == 0)
-    {
-      return ISVG(nullptr);
-    }
-    else
-    {
-      return LoadSVG(fileName, svgData.Get(), svgData.GetSize(), units, dpi);
-    }
+    fclose(fd);
+    return;
   }
-  
-  return ISVG(pHolder->mSVGDom);
+  long size = ftell(fd);
+
+  // Now reset to the start of the file so we can actually read it.
+  if (fseek(fd, 0, SEEK_SET))
+  {
+    fclose(fd);
+    return;
+  }
+
+  result.Resize((int)size);
+  size_t bytesRead = fread(result.Get(), 1, (size_t)size, fd);
+  if (bytesRead != (size_t)size)
+  {
+    fclose(fd);
+    result.Resize(0, true);
+    return;
+  }
+  fclose(fd);
 }
 
-ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const char* units, float dpi)
+// Skia has its own implementation for SVGs. On all other platforms we use NanoSVG, because it works.
+#ifdef SVG_USE_SKIA
+static SVGHolder* ParseSVG(const void* pData, int dataSize, const char* units, float dpi)
 {
-  StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
-  SVGHolder* pHolder = storage.Find(name);
+  sk_sp<SkSVGDOM> svgDOM;
+  SkDOM xmlDom;
 
-  if (!pHolder)
+  SkMemoryStream svgStream(pData, dataSize);
+  svgDOM = SkSVGDOM::MakeFromStream(svgStream);
+  
+  if (!svgDOM)
+    return nullptr;
+
+  // If an SVG doesn't have a container size, SKIA doesn't seem to have access to any meaningful size info.
+  // So use NanoSVG to get the size.
+  if (svgDOM->containerSize().width() == 0)
   {
-    sk_sp<SkSVGDOM> svgDOM;
-    SkDOM xmlDom;
+    NSVGimage* pImage = nullptr;
 
-    SkMemoryStream svgStream(pData, dataSize);
-    svgDOM = SkSVGDOM::MakeFromStream(svgStream);
+    WDL_String svgStr;
+    svgStr.Set((const char*)pData, dataSize);
+    pImage = nsvgParse(svgStr.Get(), units, dpi);
     
-    if (!svgDOM)
-      return ISVG(nullptr); // return invalid SVG
+    assert(pImage);
 
-    // If an SVG doesn't have a container size, SKIA doesn't seem to have access to any meaningful size info.
-    // So use NanoSVG to get the size.
-    if (svgDOM->containerSize().width() == 0)
-    {
-      NSVGimage* pImage = nullptr;
+    svgDOM->setContainerSize(SkSize::Make(pImage->width, pImage->height));
 
-      WDL_String svgStr;
-      svgStr.Set((const char*)pData, dataSize);
-      pImage = nsvgParse(svgStr.Get(), units, dpi);
-      
-      assert(pImage);
+    nsvgDelete(pImage);
+  }
 
-      svgDOM->setContainerSize(SkSize::Make(pImage->width, pImage->height));
+  return new SVGHolder(svgDOM);
+}
 
-      nsvgDelete(pImage);
-    }
+static ISVG GetSVG(const SVGHolder* pHolder)
+{
+  return ISVG(pHolder->mSVGDom);
+}
+#else
+static SVGHolder* ParseSVG(const void* pData, int dataSize, const char* units, float dpi)
+{
+  NSVGimage* pImage = nullptr;
+
+  // Because we're taking a const void* pData, but NanoSVG takes a void*, 
+  WDL_String svgStr;
+  svgStr.Set((const char*)pData, dataSize);
+  pImage = nsvgParse(svgStr.Get(), units, dpi);
 
-    pHolder = new SVGHolder(svgDOM);
-    storage.Add(pHolder, name);
+  if (!pImage)
+    return nullptr;
+  
+  return new SVGHolder(pImage);
+}
+
+static ISVG GetSVG(const SVGHolder* pHolder)
+{
+  return ISVG(pHolder->mImage);
+}
+#endif
+
+/** Add a parsed SVG to the cache, unless another thread or instance got there first
+ * @return The SVG in the cache */
+static SVGHolder* CacheSVG(SVGHolder* pHolder, const char* name)
+{
+  StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
+  SVGHolder* pExisting = storage.Find(name);
+
+  if (pExisting)
+  {
+    delete pHolder;
+    return pExisting;
   }
 
-  return ISVG(pHolder->mSVGDom);
+  storage.Add(pHolder, name);
+  return pHolder;
 }
 
-#else
 ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
 {
-  StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
-  SVGHolder* pHolder = storage.Find(fileName);
+  mResourceLoader.Wait(fileName);
+
+  SVGHolder* pHolder = nullptr;
+
+  {
+    StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
+    pHolder = storage.Find(fileName);
+  }
 
   if(!pHolder)
   {
+    int packSize = 0;
+
+    // Parse a packed SVG in place rather than copying it
+    if (const uint8_t* pPackData = IResourcePack::GetRegistered(fileName, packSize))
+      return LoadSVG(fileName, pPackData, packSize, units, dpi);
+
     WDL_TypedBuf<uint8_t> svgData = LoadResource(fileName, "svg");
     if (svgData.GetSize() == 0)
     {
@@ -1548,39 +2366,87 @@ ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
     }
   }
 
-  return ISVG(pHolder->mImage);
+  return GetSVG(pHolder);
 }
 
-ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const char* units, float dpi)
-{
-  StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
-  SVGHolder* pHolder = storage.Find(name);
+ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const char* units, float dpi)
+{
+  SVGHolder* pHolder = nullptr;
+
+  {
+    StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
+    pHolder = storage.Find(name);
+  }
+
+  if (!pHolder)
+  {
+    // Parse without holding the cache, so that other instances and preloads can parse in parallel
+    pHolder = ParseSVG(pData, dataSize, units, dpi);
+
+    if (!pHolder)
+      return ISVG(nullptr); // return invalid SVG
+
+    pHolder = CacheSVG(pHolder, name);
+  }
+
+  return GetSVG(pHolder);
+}
+
+void IGraphics::PreloadSVG(const char* fileName, const char* units, float dpi)
+{
+  {
+    StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
+
+    if (storage.Find(fileName))
+      return;
+  }
+
+  // Locate the resource here, since that needs the platform
+  WDL_String path;
+  int resSize = 0;
+  const void* pResData = IResourcePack::GetRegistered(fileName, resSize);
+  EResourceLocation location = pResData ? EResourceLocation::kResourcePack : LocateResource(fileName, "svg", path, GetBundleID(), GetWinModuleHandle(), GetSharedResourcesSubPath());
+
+  if (location == EResourceLocation::kNotFound)
+    return;
 
-  if (!pHolder)
-  {
-    NSVGimage* pImage = nullptr;
+#ifdef OS_WIN
+  if (location == EResourceLocation::kWinBinary)
+    pResData = LoadWinResource(path.Get(), "svg", resSize, GetWinModuleHandle());
+#endif
 
-    // Because we're taking a const void* pData, but NanoSVG takes a void*, 
-    WDL_String svgStr;
-    svgStr.Set((const char*)pData, dataSize);
-    pImage = nsvgParse(svgStr.Get(), units, dpi);
+  std::string name(fileName), pathStr(path.Get()), unitsStr(units);
 
-    if (!pImage)
-      return ISVG(nullptr);
-    
-    pHolder = new SVGHolder(pImage);
+  mResourceLoader.Add(fileName, [name, pathStr, unitsStr, dpi, pResData, resSize]() {
+    WDL_TypedBuf<uint8_t> data;
 
-    storage.Add(pHolder, name);
-  }
+    if (pResData)
+      data.Set((const uint8_t*) pResData, resSize);
+    else
+      ReadResourceFile(pathStr.c_str(), data);
 
-  return ISVG(pHolder->mImage);
+    if (data.GetSize())
+    {
+      SVGHolder* pHolder = ParseSVG(data.Get(), data.GetSize(), unitsStr.c_str(), dpi);
+
+      if (pHolder)
+        CacheSVG(pHolder, name.c_str());
+    }
+  });
 }
-#endif
 
 WDL_TypedBuf<uint8_t> IGraphics::LoadResource(const char* fileNameOrResID, const char* fileType)
 {
   WDL_TypedBuf<uint8_t> result;
 
+  int packSize = 0;
+
+  if (const uint8_t* pPackData = IResourcePack::GetRegistered(fileNameOrResID, packSize))
+  {
+    result.Set(pPackData, packSize);
+    return result;
+  }
+
   WDL_String path;
   EResourceLocation resourceFound = LocateResource(fileNameOrResID, fileType, path, GetBundleID(), GetWinModuleHandle(), GetSharedResourcesSubPath());
 
@@ -1597,36 +2463,7 @@ WDL_TypedBuf<uint8_t> IGraphics::LoadResource(const char* fileNameOrResID, const
   }
 #endif
   if (resourceFound == EResourceLocation::kAbsolutePath)
-  {
-    FILE* fd = fopen(path.Get(), "rb");
-    if (!fd)
-      return result;
-    
-    // First we determine the file size
-    if (fseek(fd, 0, SEEK_END))
-    {
-      fclose(fd);
-      return result;
-    }
-    long size = ftell(fd);
-
-    // Now reset to the start of the file so we can actually read it.
-    if (fseek(fd, 0, SEEK_SET))
-    {
-      fclose(fd);
-      return result;
-    }
-
-    result.Resize((int)size);
-    size_t bytesRead = fread(result.Get(), 1, (size_t)size, fd);
-    if (bytesRead != (size_t)size)
-    {
-      fclose(fd);
-      result.Resize(0, true);
-      return result;
-    }
-    fclose(fd);
-  }
+    ReadResourceFile(path.Get(), result);
 
   return result;
 }
@@ -1636,6 +2473,8 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
   if (targetScale == 0)
     targetScale = GetRoundedScreenScale();
 
+  mResourceLoader.Wait(name);
+
   StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
   APIBitmap* pAPIBitmap = storage.Find(name, targetScale);
 
@@ -1680,7 +2519,7 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
     assert(pAPIBitmap && "Bitmap not found");
 
     // Scale or retain if needed (N.B. - scaling retains in the cache)
-    if (pAPIBitmap->GetScale() != targetScale)
+    if (pAPIBitmap->GetScale() != targetScale && !DrawsBitmapsAtAnyScale())
     {
       return ScaleBitmap(IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name), name, targetScale);
     }
@@ -1693,6 +2532,60 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
   return IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name);
 }
 
+void IGraphics::PreloadBitmap(const char* name, int targetScale)
+{
+  if (targetScale == 0)
+    targetScale = GetRoundedScreenScale();
+
+  const char* ext = name + strlen(name) - 1;
+  while (ext >= name && *ext != '.') --ext;
+  ++ext;
+
+  if (!BitmapExtSupported(ext))
+    return;
+
+  {
+    StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
+
+    if (storage.Find(name, targetScale))
+      return;
+  }
+
+  WDL_String fullPath;
+  int sourceScale = 0;
+  EResourceLocation resourceLocation = SearchImageResource(name, ext, fullPath, targetScale, sourceScale);
+
+  if (resourceLocation == EResourceLocation::kNotFound)
+    return;
+
+  std::function<APIBitmap*()> loader = GetAPIBitmapLoader(fullPath.Get(), sourceScale, resourceLocation, ext);
+
+  if (!loader)
+    return;
+
+  std::string cacheName(name);
+
+  // LoadBitmap() scales the bitmap if sourceScale isn't targetScale, since that needs the drawing context
+  mResourceLoader.Add(name, [loader, cacheName, sourceScale]() {
+    {
+      StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
+
+      if (storage.Find(cacheName.c_str(), sourceScale))
+        return;
+    }
+
+    std::unique_ptr<APIBitmap> pBitmap(loader());
+
+    if (pBitmap)
+    {
+      StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
+
+      if (!storage.Find(cacheName.c_str(), sourceScale))
+        storage.Add(pBitmap.release(), cacheName.c_str(), sourceScale);
+    }
+  });
+}
+
 IBitmap IGraphics::LoadBitmap(const char *name, const void *pData, int dataSize, int nStates, bool framesAreHorizontal, int targetScale)
 {
   if (targetScale == 0)
@@ -1731,7 +2624,7 @@ IBitmap IGraphics::LoadBitmap(const char *name, const void *pData, int dataSize,
     assert(pAPIBitmap && "Bitmap not found");
 
     // Scale or retain if needed (N.B. - scaling retains in the cache)
-    if (pAPIBitmap->GetScale() != targetScale)
+    if (pAPIBitmap->GetScale() != targetScale && !DrawsBitmapsAtAnyScale())
     {
       return ScaleBitmap(IBitmap(pAPIBitmap, nStates, framesAreHorizontal, name), name, targetScale);
     }
@@ -1799,6 +2692,12 @@ EResourceLocation IGraphics::SearchImageResource(const char* name, const char* t
       fullName.SetFormatted((int) (strlen(name) + strlen("@2x")), "%s@%dx%s", baseName.Get(), sourceScale, ext.Get());
     }
 
+    if (IResourcePack::ContainsRegistered(fullName.Get()))
+    {
+      result.Set(fullName.Get());
+      return EResourceLocation::kResourcePack;
+    }
+
     EResourceLocation found = LocateResource(fullName.Get(), type, result, GetBundleID(), GetWinModuleHandle(), GetSharedResourcesSubPath());
 
     if (found > EResourceLocation::kNotFound)
@@ -1875,9 +2774,28 @@ void IGraphics::CreatePopupMenu(IControl& control, IPopupMenu& menu, const IRECT
   DoCreatePopupMenu(control, menu, bounds, valIdx, false);
 }
 
+void IGraphics::StartDragResize()
+{
+  mResizingInProcess = true;
+  mCaptureResizePreview = mEnableResizePreview;
+}
+
 void IGraphics::EndDragResize()
 {
   mResizingInProcess = false;
+  mCaptureResizePreview = false;
+
+  if (mDragResizePending)
+  {
+    mDragResizePending = false;
+    Resize(mDragResizeWidth, mDragResizeHeight, mDragResizeScale);
+  }
+
+  if (mResizeLayoutPending)
+    LayoutAfterResize();
+
+  // N.B. the preview is released on the next frame, with the drawing context current
+  SetAllControlsDirty();
   
   if (GetResizerMode() == EUIResizerMode::Scale)
   {
@@ -1889,16 +2807,24 @@ void IGraphics::EndDragResize()
 
 void IGraphics::StartLayer(IControl* pControl, const IRECT& r, bool cacheable)
 {
+  AbortDisplayList();
+
   auto pixelBackingScale = GetBackingPixelScale();
   IRECT alignedBounds = r.GetPixelAligned(pixelBackingScale);
   const int w = static_cast<int>(std::ceil(pixelBackingScale * std::ceil(alignedBounds.W())));
   const int h = static_cast<int>(std::ceil(pixelBackingScale * std::ceil(alignedBounds.H())));
 
-  PushLayer(new ILayer(CreateAPIBitmap(w, h, GetScreenScale(), GetDrawScale(), cacheable), alignedBounds, pControl, pControl ? pControl->GetRECT() : IRECT()));
+  ILayer* pLayer = new ILayer(CreateAPIBitmap(w, h, GetScreenScale(), GetDrawScale(), cacheable), alignedBounds, pControl, pControl ? pControl->GetRECT() : IRECT());
+  pLayer->mByteCounter = mLayerBytes;
+  pLayer->mBytes = static_cast<size_t>(w) * h * 4;
+  *mLayerBytes += pLayer->mBytes;
+  PushLayer(pLayer);
 }
 
 void IGraphics::ResumeLayer(ILayerPtr& layer)
 {
+  AbortDisplayList();
+
   ILayerPtr ownedLayer;
     
   ownedLayer.swap(layer);
@@ -1957,6 +2883,8 @@ bool IGraphics::CheckLayer(const ILayerPtr& layer)
 
 void IGraphics::DrawLayer(const ILayerPtr& layer, const IBlend* pBlend)
 {
+  AbortDisplayList();
+
   PathTransformSave();
   PathTransformReset();
   DrawBitmap(layer->GetBitmap(), layer->Bounds(), 0, 0, pBlend);
@@ -1965,6 +2893,8 @@ void IGraphics::DrawLayer(const ILayerPtr& layer, const IBlend* pBlend)
 
 void IGraphics::DrawFittedLayer(const ILayerPtr& layer, const IRECT& bounds, const IBlend* pBlend)
 {
+  AbortDisplayList();
+
   IBitmap bitmap = layer->GetBitmap();
   IRECT layerBounds = layer->Bounds();
   PathTransformSave();
@@ -1977,6 +2907,8 @@ void IGraphics::DrawFittedLayer(const ILayerPtr& layer, const IRECT& bounds, con
 
 void IGraphics::DrawRotatedLayer(const ILayerPtr& layer, double angle)
 {
+  AbortDisplayList();
+
   PathTransformSave();
   PathTransformReset();
   IBitmap bitmap = layer->GetBitmap();
@@ -1985,109 +2917,156 @@ void IGraphics::DrawRotatedLayer(const ILayerPtr& layer, double angle)
   PathTransformRestore();
 }
 
-void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
+// Blur one plane of bytes with a box of 2 * radius + 1 pixels along rows (or along columns, swapping the strides), treating pixels outside it as 0
+static void BoxBlurPlane(uint8_t* pDest, const uint8_t* pSrc, int width, int height, int radius, bool vertical, WDL_TypedBuf<uint32_t>& sums)
 {
-  auto GaussianBlurSwap = [](uint8_t* out, uint8_t* in, uint8_t* kernel, int width, int height,
-                             int outStride, int inStride, int kernelSize, uint32_t norm)
-  {
-    int repeats = 0;
-    int fullKernelSize = kernelSize * 2 + 1;
-    uint32_t last = 0;
+  const uint32_t inv = (1u << 24) / (2 * radius + 1); // sum * inv can't overflow, as sum <= 255 * (2 * radius + 1)
 
-    auto RepeatCheck = [&](int idx)
-    {
-      repeats = last == in[idx * 4] ? std::min(repeats + 1, fullKernelSize) : 1;
-      last = in[idx * 4];
-        
-      return repeats == fullKernelSize;
-    };
-      
-    for (int i = 0; i < height; i++, in += inStride)
+  if (!vertical)
+  {
+    for (int y = 0; y < height; y++)
     {
-      for (int j = 0; j < kernelSize - 1; j++)
+      const uint8_t* pIn = pSrc + y * width;
+      uint8_t* pOut = pDest + y * width;
+      uint32_t sum = 0;
+
+      for (int x = 0; x <= std::min(radius, width - 1); x++)
+        sum += pIn[x];
+
+      for (int x = 0; x < width; x++)
       {
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < j + 1; k++)
-          accum += kernel[k] * in[(j - k) * 4];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * in[(j + k) * 4];
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        pOut[x] = static_cast<uint8_t>((sum * inv + (1u << 23)) >> 24);
+
+        if (x + radius + 1 < width)
+          sum += pIn[x + radius + 1];
+        if (x - radius >= 0)
+          sum -= pIn[x - radius];
       }
-      for (int j = 0; j < kernelSize * 2 - 2; j++)
-        RepeatCheck(j);
-      for (int j = kernelSize - 1; j < (width - kernelSize) + 1; j++)
+    }
+  }
+  else
+  {
+    // the columns are summed a row at a time, so that the inner loops run over contiguous pixels and vectorize
+    sums.Resize(width, false);
+    uint32_t* pSums = sums.Get();
+    std::fill(pSums, pSums + width, 0u);
+
+    for (int y = 0; y <= std::min(radius, height - 1); y++)
+    {
+      const uint8_t* pIn = pSrc + y * width;
+
+      for (int x = 0; x < width; x++)
+        pSums[x] += pIn[x];
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+      uint8_t* pOut = pDest + y * width;
+
+      for (int x = 0; x < width; x++)
+        pOut[x] = static_cast<uint8_t>((pSums[x] * inv + (1u << 23)) >> 24);
+
+      if (y + radius + 1 < height)
       {
-        if (RepeatCheck(j + kernelSize - 1))
-        {
-            out[j * outStride + (i * 4)] = static_cast<uint8_t>(last);
-            continue;
-        }
-          
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * (in[(j - k) * 4] + in[(j + k) * 4]);
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        const uint8_t* pIn = pSrc + (y + radius + 1) * width;
+
+        for (int x = 0; x < width; x++)
+          pSums[x] += pIn[x];
       }
-      for (int j = (width - kernelSize) + 1; j < width; j++)
+
+      if (y - radius >= 0)
       {
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * in[(j - k) * 4];
-        for (int k = 1; k < width - j; k++)
-          accum += kernel[k] * in[(j + k) * 4];
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        const uint8_t* pIn = pSrc + (y - radius) * width;
+
+        for (int x = 0; x < width; x++)
+          pSums[x] -= pIn[x];
       }
     }
-  };
-  
-  RawBitmapData temp1;
-  RawBitmapData temp2;
-  RawBitmapData kernel;
+  }
+}
+
+void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
+{
+  // Reference blurSize from zero (which will be no blur). The blur approximates a gaussian with weights exp(-i^2 * 4.5 / blurSize^2), which has a sigma of blurSize / 3
+  const float scale = layer->GetAPIBitmap()->GetScale() * layer->GetAPIBitmap()->GetDrawScale();
+  const float blurSize = std::max(1.f, (shadow.mBlurSize * scale) + 1.f);
+  const float sigma = blurSize / 3.f;
+
+  if (ApplyShadowBlur(layer, shadow, sigma))
+    return;
+
+  RawBitmapData data;
+  RawBitmapData plane1;
+  RawBitmapData plane2;
+  WDL_TypedBuf<uint32_t> sums;
     
   // Get bitmap in 32-bit form
-  GetLayerBitmapData(layer, temp1);
+  GetLayerBitmapData(layer, data);
     
-  if (!temp1.GetSize())
+  if (!data.GetSize())
       return;
-  temp2.Resize(temp1.GetSize());
-    
-  // Form kernel (reference blurSize from zero (which will be no blur))
-  bool flipped = FlippedBitmap();
-  float scale = layer->GetAPIBitmap()->GetScale() * layer->GetAPIBitmap()->GetDrawScale();
-  float blurSize = std::max(1.f, (shadow.mBlurSize * scale) + 1.f);
-  float blurConst = 4.5f / (blurSize * blurSize);
-  int iSize = static_cast<int>(ceil(blurSize));
-  int width = layer->GetAPIBitmap()->GetWidth();
-  int height = layer->GetAPIBitmap()->GetHeight();
-  int stride1 = temp1.GetSize() / width;
-  int stride2 = flipped ? -temp1.GetSize() / height : temp1.GetSize() / height;
-  int stride3 = flipped ? -stride2 : stride2;
-
-  kernel.Resize(iSize);
-        
-  for (int i = 0; i < iSize; i++)
-    kernel.Get()[i] = static_cast<uint8_t>(std::round(255.f * std::expf(-(i * i) * blurConst)));
-  
-  // Kernel normalisation
-  int normFactor = kernel.Get()[0];
-    
-  for (int i = 1; i < iSize; i++)
-    normFactor += kernel.Get()[i] + kernel.Get()[i];
-  
-  // Do blur
-  uint8_t* asRows = temp1.Get() + AlphaChannel();
-  uint8_t* inRows = flipped ? asRows + stride3 * (height - 1) : asRows;
-  uint8_t* asCols = temp2.Get() + AlphaChannel();
-  
-  GaussianBlurSwap(asCols, inRows, kernel.Get(), width, height, stride1, stride2, iSize, normFactor);
-  GaussianBlurSwap(asRows, asCols, kernel.Get(), height, width, stride3, stride1, iSize, normFactor);
+
+  const int width = layer->GetAPIBitmap()->GetWidth();
+  const int height = layer->GetAPIBitmap()->GetHeight();
+  const int rowBytes = data.GetSize() / height;
+  const int alpha = AlphaChannel();
+
+  plane1.Resize(width * height);
+  plane2.Resize(width * height);
+  uint8_t* pPlane = plane1.Get();
+  uint8_t* pTemp = plane2.Get();
+
+  // Extract the alphas. Row order doesn't matter to the blur, so flipped bitmaps don't need special treatment
+  for (int y = 0; y < height; y++)
+  {
+    const uint8_t* pIn = data.Get() + y * rowBytes + alpha;
+    uint8_t* pOut = pPlane + y * width;
+
+    for (int x = 0; x < width; x++)
+      pOut[x] = pIn[x * 4];
+  }
+
+  // Three box blurs in each direction approximate the gaussian, with box sizes chosen for sigma (see "Fast Almost-Gaussian Filtering", Kovesi)
+  const int nPasses = 3;
+  const int idealSize = static_cast<int>(std::sqrt(12.f * sigma * sigma / nPasses + 1.f));
+  const int sizeLo = idealSize - ((idealSize % 2) ? 0 : 1);
+  const int sizeHi = sizeLo + 2;
+  const int nLo = static_cast<int>(std::round((12.f * sigma * sigma - nPasses * sizeLo * sizeLo - 4 * nPasses * sizeLo - 3 * nPasses) / (-4 * sizeLo - 4)));
+
+  for (int dir = 0; dir < 2; dir++)
+  {
+    for (int pass = 0; pass < nPasses; pass++)
+    {
+      const int radius = ((pass < nLo ? sizeLo : sizeHi) - 1) / 2;
+
+      if (radius > 0)
+      {
+        BoxBlurPlane(pTemp, pPlane, width, height, radius, dir == 1, sums);
+        std::swap(pPlane, pTemp);
+      }
+    }
+  }
+
+  for (int y = 0; y < height; y++)
+  {
+    const uint8_t* pIn = pPlane + y * width;
+    uint8_t* pOut = data.Get() + y * rowBytes + alpha;
+
+    for (int x = 0; x < width; x++)
+      pOut[x * 4] = pIn[x];
+  }
   
   // Apply alphas to the pattern and recombine/replace the image
-  ApplyShadowMask(layer, temp1, shadow);
+  ApplyShadowMask(layer, data, shadow);
 }
 
 bool IGraphics::LoadFont(const char* fontID, const char* fileNameOrResID)
 {
+  int packSize = 0;
+
+  if (const uint8_t* pPackData = IResourcePack::GetRegistered(fileNameOrResID, packSize))
+    return LoadFont(fontID, const_cast<uint8_t*>(pPackData), packSize);
+
   PlatformFontPtr font = LoadPlatformFont(fontID, fileNameOrResID);
   
   if (font)
@@ -2367,19 +3346,15 @@ void IGraphics::DrawData(const IColor& color, const IRECT& bounds, float* normYP
   
   PathClear();
   
-  float xPos = bounds.L;
-
-  PathMoveTo(xPos, bounds.B - (bounds.H() * normYPoints[0]));
-
-  for (auto i = 1; i < nPoints; i++)
+  if (normXPoints)
   {
-    if (normXPoints)
-      xPos = bounds.L + (bounds.W() * normXPoints[i]);
-    else
-      xPos = bounds.L + ((bounds.W() / (float) (nPoints - 1) * i));
-    
-    PathLineTo(xPos, bounds.B - (bounds.H() * normYPoints[i]));
+    PathMoveTo(bounds.L + (bounds.W() * normXPoints[0]), bounds.B - (bounds.H() * normYPoints[0]));
+
+    for (auto i = 1; i < nPoints; i++)
+      PathLineTo(bounds.L + (bounds.W() * normXPoints[i]), bounds.B - (bounds.H() * normYPoints[i]));
   }
+  else
+    PathData(bounds, normYPoints, nPoints);
   
   if (pFillColor)
   {
@@ -2389,6 +3364,25 @@ void IGraphics::DrawData(const IColor& color, const IRECT& bounds, float* normYP
   PathStroke(color, thickness, IStrokeOptions(), pBlend);
 }
 
+void IGraphics::DrawData(const IColor& color, const IRECT& bounds, const IPeakCache& peaks, int startIdx, int nPoints, const IBlend* pBlend, float thickness, const IColor* pFillColor)
+{
+  if (nPoints < 0)
+    nPoints = peaks.NPoints() - startIdx;
+
+  if (nPoints <= 0)
+    return;
+
+  PathClear();
+  PathData(bounds, peaks, startIdx, nPoints);
+
+  if (pFillColor)
+  {
+    PathFill(*pFillColor, IFillOptions(true), pBlend);
+  }
+
+  PathStroke(color, thickness, IStrokeOptions(), pBlend);
+}
+
 void IGraphics::DrawDottedLine(const IColor& color, float x1, float y1, float x2, float y2, const IBlend* pBlend, float thickness, float dashLen)
 {
   PathClear();
@@ -2612,6 +3606,74 @@ void IGraphics::PathConvexPolygon(float* x, float* y, int nPoints)
     PathLineTo(x[i], y[i]);
   PathClose();
 }
+
+// Adds the path for PathData(), with one column per point, or one column per pixel if there are more than two points per pixel.
+// getRange(i0, i1, min, max) gives the range of the values in [i0, i1). A column spanning several values draws a vertical segment, starting from the end nearest the previous column
+template <typename F>
+static void PathDataColumns(IGraphics& g, const IRECT& bounds, int nPoints, EDirection dir, F&& getRange)
+{
+  if (nPoints <= 0)
+    return;
+
+  const float extent = dir == EDirection::Horizontal ? bounds.W() : bounds.H();
+  const int nPixels = std::max(1, static_cast<int>(std::ceil(extent * g.GetTotalScale())));
+  const int nColumns = nPoints > 2 * nPixels ? nPixels : nPoints;
+  const float posScale = nColumns > 1 ? 1.f / static_cast<float>(nColumns - 1) : 0.f;
+
+  auto addPoint = [&](float pos, float v, bool move) {
+    const float x = dir == EDirection::Horizontal ? bounds.L + bounds.W() * pos : bounds.R - bounds.W() * v;
+    const float y = dir == EDirection::Horizontal ? bounds.B - bounds.H() * v : bounds.T + bounds.H() * pos;
+
+    if (move)
+      g.PathMoveTo(x, y);
+    else
+      g.PathLineTo(x, y);
+  };
+
+  float prev = 0.f;
+
+  for (int c = 0; c < nColumns; c++)
+  {
+    const int i0 = static_cast<int>(static_cast<int64_t>(c) * nPoints / nColumns);
+    const int i1 = static_cast<int>(static_cast<int64_t>(c + 1) * nPoints / nColumns);
+    const float pos = c * posScale;
+    float min, max;
+    getRange(i0, i1, min, max);
+
+    const bool minFirst = c == 0 || std::fabs(prev - min) < std::fabs(prev - max);
+    const float first = minFirst ? min : max;
+    const float last = minFirst ? max : min;
+
+    addPoint(pos, first, c == 0);
+
+    if (last != first)
+      addPoint(pos, last, false);
+
+    prev = last;
+  }
+}
+
+void IGraphics::PathData(const IRECT& bounds, const float* normPoints, int nPoints, EDirection dir)
+{
+  PathDataColumns(*this, bounds, nPoints, dir, [normPoints](int i0, int i1, float& min, float& max) {
+    min = max = normPoints[i0];
+
+    if (i1 - i0 > 1)
+      VectorMinMax(normPoints + i0 + 1, i1 - i0 - 1, min, max);
+  });
+}
+
+void IGraphics::PathData(const IRECT& bounds, const IPeakCache& peaks, int startIdx, int nPoints, EDirection dir)
+{
+  const float* pData = peaks.GetData() + startIdx;
+
+  PathDataColumns(*this, bounds, nPoints, dir, [&peaks, pData, startIdx](int i0, int i1, float& min, float& max) {
+    if (i1 - i0 > 1)
+      peaks.GetMinMax(startIdx + i0, startIdx + i1, min, max);
+    else
+      min = max = pData[i0];
+  });
+}
   
 void IGraphics::PathTransformSave()
 {
@@ -2624,7 +3686,7 @@ void IGraphics::PathTransformRestore()
   {
     mTransform = mTransformStates.top();
     mTransformStates.pop();
-    PathTransformSetMatrix(mTransform);
+    SetPathTransform();
   }
 }
 
@@ -2637,19 +3699,19 @@ void IGraphics::PathTransformReset(bool clearStates)
   }
   
   mTransform = IMatrix();
-  PathTransformSetMatrix(mTransform);
+  SetPathTransform();
 }
 
 void IGraphics::PathTransformTranslate(float x, float y)
 {
   mTransform.Translate(x, y);
-  PathTransformSetMatrix(mTransform);
+  SetPathTransform();
 }
 
 void IGraphics::PathTransformScale(float scaleX, float scaleY)
 {
   mTransform.Scale(scaleX, scaleY);
-  PathTransformSetMatrix(mTransform);
+  SetPathTransform();
 }
 
 void IGraphics::PathTransformScale(float scale)
@@ -2660,24 +3722,37 @@ void IGraphics::PathTransformScale(float scale)
 void IGraphics::PathTransformRotate(float angle)
 {
   mTransform.Rotate(angle);
-  PathTransformSetMatrix(mTransform);
+  SetPathTransform();
 }
   
 void IGraphics::PathTransformSkew(float xAngle, float yAngle)
 {
   mTransform.Skew(xAngle, yAngle);
-  PathTransformSetMatrix(mTransform);
+  SetPathTransform();
 }
 
 void IGraphics::PathTransformMatrix(const IMatrix& matrix)
 {
   mTransform.Transform(matrix);
+  SetPathTransform();
+}
+
+void IGraphics::SetPathTransform()
+{
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->SetTransform(mTransform);
+  
   PathTransformSetMatrix(mTransform);
 }
 
 void IGraphics::PathClipRegion(const IRECT r)
 {
-  IRECT drawArea = mLayers.empty() ? mClipRECT : mLayers.top()->Bounds();
+  if (mDisplayListRecorder)
+    mDisplayListRecorder->PathClipRegion(r);
+
+  mPathClipRECT = r;
+  
+  IRECT drawArea = GetDrawRegion();
   IRECT clip = r.Empty() ? drawArea : r.Intersect(drawArea);
   PathTransformSetMatrix(IMatrix());
   SetClipRegion(clip);
@@ -2699,6 +3774,9 @@ void IGraphics::DrawSVG(const ISVG& svg, const IRECT& dest, const IBlend* pBlend
   float xScale = dest.W() / svg.W();
   float yScale = dest.H() / svg.H();
   float scale = xScale < yScale ? xScale : yScale;
+
+  if (mEnableSVGCache && mSVGCacheAllowed && DrawCachedSVG(svg, dest, scale, pBlend))
+    return;
   
   PathTransformSave();
   PathTransformTranslate(dest.L, dest.T);
@@ -2707,6 +3785,108 @@ void IGraphics::DrawSVG(const ISVG& svg, const IRECT& dest, const IBlend* pBlend
   PathTransformRestore();
 }
 
+bool IGraphics::DrawCachedSVG(const ISVG& svg, const IRECT& dest, float scale, const IBlend* pBlend)
+{
+  // Only translations can be drawn from a raster without resampling, and other blend methods need the destination
+  if (mTransform.mXX != 1.0 || mTransform.mYY != 1.0 || mTransform.mXY != 0.0 || mTransform.mYX != 0.0)
+    return false;
+
+  if (pBlend && pBlend->mMethod != EBlend::SrcOver)
+    return false;
+
+#ifdef SVG_USE_SKIA
+  const void* pSVG = svg.mSVGDom.get();
+#else
+  const void* pSVG = svg.mImage;
+#endif
+
+  const IRECT bounds = dest.GetTranslated(static_cast<float>(mTransform.mTX), static_cast<float>(mTransform.mTY));
+  const SVGCacheKey key { pSVG, bounds, pBlend ? pBlend->mWeight : -1.f };
+  SVGCacheEntry& entry = mSVGCache[key];
+  entry.mLastUsed = ++mSVGCacheUses;
+
+  if (!CheckLayer(entry.mLayer))
+  {
+    if (mSVGCache.size() > kMaxSVGCacheEntries)
+    {
+      auto lru = std::min_element(mSVGCache.begin(), mSVGCache.end(), [](const auto& a, const auto& b) { return a.second.mLastUsed < b.second.mLastUsed; });
+      mSVGCache.erase(lru);
+      ForStandardControlsFunc([](IControl* pControl) { pControl->InvalidateDisplayList(); });
+    }
+
+    // Drawing into a layer resets the transform and clip, so restore them afterwards
+    const IRECT clip = mPathClipRECT;
+    PathTransformSave();
+    StartLayer(nullptr, bounds);
+    PathTransformTranslate(bounds.L, bounds.T);
+    PathTransformScale(scale);
+    DoDrawSVG(svg, pBlend);
+    entry.mLayer = EndLayer();
+    PathTransformRestore();
+    PathClipRegion(clip);
+  }
+
+  // N.B. not DrawLayer(), which stops display list recording. The cached bitmap only changes when the cache clears, which invalidates the display lists
+  PathTransformSave();
+  PathTransformReset();
+  DrawBitmap(entry.mLayer->GetBitmap(), entry.mLayer->Bounds(), 0, 0, nullptr);
+  PathTransformRestore();
+  return true;
+}
+
+void IGraphics::DrawSharedSprite(uint64_t key, const IRECT& bounds, float padding, const std::function<void(IGraphics&, const IRECT&)>& drawFunc)
+{
+  // Only translations can be drawn from a raster without resampling
+  if (!mEnableSharedSprites || mTransform.mXX != 1.0 || mTransform.mYY != 1.0 || mTransform.mXY != 0.0 || mTransform.mYX != 0.0)
+  {
+    drawFunc(*this, bounds);
+    return;
+  }
+
+  const float scale = GetBackingPixelScale();
+  const IRECT absBounds = bounds.GetTranslated(static_cast<float>(mTransform.mTX), static_cast<float>(mTransform.mTY));
+
+  auto subpixel = [scale](float pos) {
+    const float pixels = pos * scale;
+    return static_cast<int>(std::round((pixels - std::floor(pixels)) * 4.f)) & 3;
+  };
+
+  const SpriteCacheKey spriteKey { key, bounds.W(), bounds.H(), subpixel(absBounds.L), subpixel(absBounds.T) };
+  SpriteCacheEntry& entry = mSpriteCache[spriteKey];
+  entry.mLastUsed = ++mSpriteCacheUses;
+
+  if (!CheckLayer(entry.mLayer))
+  {
+    // N.B. the entry is the most recently used, so it isn't the one evicted, and erasing other elements doesn't invalidate the reference
+    if (mSpriteCache.size() > kMaxSpriteCacheEntries)
+    {
+      auto lru = std::min_element(mSpriteCache.begin(), mSpriteCache.end(), [](const auto& a, const auto& b) { return a.second.mLastUsed < b.second.mLastUsed; });
+      mSpriteCache.erase(lru);
+      ForStandardControlsFunc([](IControl* pControl) { pControl->InvalidateDisplayList(); });
+    }
+
+    // Drawing into a layer resets the transform and clip, so restore them afterwards
+    const IRECT clip = mPathClipRECT;
+    PathTransformSave();
+    StartLayer(nullptr, absBounds.GetPadded(padding));
+    drawFunc(*this, absBounds);
+    entry.mLayer = EndLayer();
+    entry.mBounds = absBounds;
+    PathTransformRestore();
+    PathClipRegion(clip);
+  }
+
+  // Move the raster by whole pixels, so that it isn't resampled
+  const float dx = std::round((absBounds.L - entry.mBounds.L) * scale) / scale;
+  const float dy = std::round((absBounds.T - entry.mBounds.T) * scale) / scale;
+
+  // N.B. not DrawLayer(), which stops display list recording. The cached bitmap only changes when the cache clears, which invalidates the display lists
+  PathTransformSave();
+  PathTransformReset();
+  DrawBitmap(entry.mLayer->GetBitmap(), entry.mLayer->Bounds().GetTranslated(dx, dy), 0, 0, nullptr);
+  PathTransformRestore();
+}
+
 void IGraphics::DrawRotatedSVG(const ISVG& svg, float destCtrX, float destCtrY, float width, float height, double angle, const IBlend* pBlend)
 {
   PathTransformSave();
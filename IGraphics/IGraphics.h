@@ -47,6 +47,11 @@
 #include "IGraphicsConstants.h"
 #include "IGraphicsStructs.h"
 #include "IGraphicsPopupMenu.h"
+#include "IGraphicsSpatialIndex.h"
+#include "IGraphicsDisplayList.h"
+#include "IGraphicsDrawBenchmark.h"
+#include "IGraphicsPeakCache.h"
+#include "IGraphicsResourceLoader.h"
 #include "IGraphicsEditorDelegate.h"
 
 #include "nanosvg.h"
@@ -99,6 +104,10 @@ public:
   /** Called by some drawing API classes to finally blit the draw bitmap onto the screen or perform other cleanup after drawing */
   virtual void EndFrame() {};
 
+  /** Called after EndFrame() while a draw benchmark is running. Drawing classes that can time the GPU override this, measuring frames while DrawBenchmarkRunning() is \c true
+   * @return The GPU time of the most recent frame whose result is available, in seconds, or -1. if there is none */
+  virtual double GetGPUFrameTime() { return -1.; }
+
   /** Draw an SVG image to the graphics context
    * @param svg The SVG image to the graphics context
    * @param bounds The rectangular region to draw the image in
@@ -468,7 +477,7 @@ public:
    * @param thickness Optional line thickness */
   virtual void DrawGrid(const IColor& color, const IRECT& bounds, float gridSizeH, float gridSizeV, const IBlend* pBlend = 0, float thickness = 1.f);
 
-  /** Draw a line between a collection of normalized points
+  /** Draw a line between a collection of normalized points. Without normXPoints, data with more than two points per pixel column is reduced to the minimum and maximum in each column, see PathData()
    * @param color The color to draw the line with
    * @param bounds The rectangular region to draw the line in
    * @param normYPoints Ptr to float array - the normalized Y positions of the points
@@ -478,6 +487,17 @@ public:
    * @param thickness Optional line thickness
    * @param pFillColor Optional color for the fill area */
   virtual void DrawData(const IColor& color, const IRECT& bounds, float* normYPoints, int nPoints, float* normXPoints = nullptr, const IBlend* pBlend = 0, float thickness = 1.f, const IColor* pFillColor = nullptr);
+
+  /** Draw a line through a span of the normalized values in a peak cache, e.g. a static waveform. The minimum and maximum for each pixel column are taken from the cache, rather than scanning the values
+   * @param color The color to draw the line with
+   * @param bounds The rectangular region to draw the line in
+   * @param peaks The peak cache
+   * @param startIdx The index of the first value to draw
+   * @param nPoints The number of values to draw, or -1 for all the values from startIdx
+   * @param pBlend Optional blend method
+   * @param thickness Optional line thickness
+   * @param pFillColor Optional color for the fill area */
+  void DrawData(const IColor& color, const IRECT& bounds, const IPeakCache& peaks, int startIdx = 0, int nPoints = -1, const IBlend* pBlend = 0, float thickness = 1.f, const IColor* pFillColor = nullptr);
   
   /** Load a font to be used by the graphics context
    * @param fontID A CString that will be used to reference the font
@@ -541,7 +561,33 @@ public:
   * @param shadow - the shadow to add */
   void ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow);
 
+  /** Draw vector content that many controls draw identically (e.g. the handles of knobs that share a style and size) from one shared raster, see EnableSharedSprites().
+   * The content is drawn once per key, size and subpixel offset, and every control drawing it after that draws a single bitmap. If sharing is off, or the transform isn't a translation, drawFunc is called directly
+   * @param key Identifies the content: calls with the same key must draw the same thing relative to bounds, so it should hash everything the content depends on apart from its position
+   * @param bounds The bounds of the content
+   * @param padding How far the content extends outside bounds, e.g. for shadows and frames
+   * @param drawFunc Draws the content in the bounds it is passed */
+  void DrawSharedSprite(uint64_t key, const IRECT& bounds, float padding, const std::function<void(IGraphics&, const IRECT&)>& drawFunc);
+
 protected:
+#pragma mark - Display lists
+
+  /** Start recording the drawing calls made to this IGraphics into a display list, see IControl::SetUseDisplayList(). The recorded calls have been drawn by the time EndDisplayList() returns
+   * @param list The list to record into, which is cleared
+   * @return \c true if recording started, \c false if the drawing back end can't record at the moment, in which case the control should be drawn normally */
+  virtual bool StartDisplayList(IDisplayList& list);
+
+  /** Finish recording a display list started with StartDisplayList(), marking it valid unless recording was aborted
+   * @param list The list being recorded */
+  virtual void EndDisplayList(IDisplayList& list);
+
+  /** Stop recording the current display list, if there is one, without marking it valid. Called before drawing anything that can't be recorded, such as a layer */
+  virtual void AbortDisplayList();
+
+  /** Draw a display list recorded with StartDisplayList(). The base implementation replays the recorded calls through the path, transform, text and bitmap methods
+   * @param list The list to draw */
+  virtual void DrawDisplayList(const IDisplayList& list);
+
   /** Get the contents of a layers pixels as bitmap data
    * @param layer The layer to get the data from
    * @param data The pixel data extracted from the layer */
@@ -552,6 +598,13 @@ protected:
    * @param mask The mask of the shadow as raw bitmap data
    * @param shadow The shadow specification */
   virtual void ApplyShadowMask(ILayerPtr& layer, RawBitmapData& mask, const IShadow& shadow) = 0;
+
+  /** Implemented by a graphics backend that can blur a layer itself (on the GPU, or with its own vectorized code) to apply a drop shadow without reading the layer back
+   * @param layer The layer to apply the shadow to
+   * @param shadow The shadow specification
+   * @param blurSigma The standard deviation of the gaussian blur, in pixels of the layer's bitmap
+   * @return \c true if the shadow was applied, otherwise ApplyLayerDropShadow() blurs the layer on the CPU and calls ApplyShadowMask() */
+  virtual bool ApplyShadowBlur(ILayerPtr& layer, const IShadow& shadow, float blurSigma) { return false; }
   
   /** Implemented by a graphics backend to prepare for drawing to the layer at the top of the stack */
   virtual void UpdateLayer() {}
@@ -649,6 +702,22 @@ public:
    * @param nPoints The number of points in the coordinate arrays */
   void PathConvexPolygon(float* x, float* y, int nPoints);
 
+  /** Add a line through evenly spaced normalized values to the current path. When there are more than two values per pixel column,
+   * the line is reduced to the minimum and maximum of the values in each column, so the path has no more than two points per pixel
+   * @param bounds The rectangular region to plot the values in
+   * @param normPoints The values, between 0 and 1
+   * @param nPoints The number of values
+   * @param dir EDirection::Horizontal plots the values upwards from bounds.B, spaced along the x axis. EDirection::Vertical plots them leftwards from bounds.R, spaced down the y axis */
+  void PathData(const IRECT& bounds, const float* normPoints, int nPoints, EDirection dir = EDirection::Horizontal);
+
+  /** Add a line through a span of the values in a peak cache to the current path, see PathData()
+   * @param bounds The rectangular region to plot the values in
+   * @param peaks The peak cache, holding values between 0 and 1
+   * @param startIdx The index of the first value
+   * @param nPoints The number of values
+   * @param dir See PathData() */
+  void PathData(const IRECT& bounds, const IPeakCache& peaks, int startIdx, int nPoints, EDirection dir = EDirection::Horizontal);
+
   /** Move the current point in the current path
    * @param x The X coordinate
    * @param y The Y coordinate */
@@ -732,6 +801,9 @@ public:
   /** Clip the current path to a particular region
    * @param r The rectangular region to clip */
   void PathClipRegion(const IRECT r = IRECT());
+
+  /** @return The region being drawn: the part of the control being redrawn, or the bounds of the layer being drawn into. Controls can skip drawing things that are outside it */
+  IRECT GetDrawRegion() const { return mLayers.empty() ? mClipRECT : mLayers.top()->Bounds(); }
   
   virtual void PathTransformSetMatrix(const IMatrix& matrix) = 0;
 
@@ -761,6 +833,7 @@ private:
     PathClear();
     SetClipRegion(bounds);
     mClipRECT = bounds;
+    mPathClipRECT = IRECT();
   }
 
   /** Indicate that a particular area of the display has been drawn (for instance to transfer a temporary backing) Always called after a matching call to PrepareRegion.
@@ -968,6 +1041,14 @@ public:
   /** Called by some platform IGraphics classes in order to translate the graphics context, in response to e.g. iOS onscreen keyboard appearing */
   void SetTranslation(float x, float y) { mXTranslation = x; mYTranslation = y; }
   
+  /** Called by the platform class when the editor window stops or starts being visible, e.g. because it is minimized, on another desktop or fully covered.
+   * While it is occluded the platform class pauses its frame timer and IsDirty() returns \c false without checking the controls. When it is visible again every control is redrawn once
+   * @param occluded \c true if the window can't be seen */
+  void SetOccluded(bool occluded);
+
+  /** @return \c true if the platform class has reported that the editor window can't be seen, see SetOccluded() */
+  bool IsOccluded() const { return mOccluded; }
+
   /** Called repeatedly at frame rate by the platform class to check what the graphics context says is dirty.
    * @param rects The rectangular regions which will be added to to mark what is dirty in the context
    * @return /c true if a control is dirty */
@@ -1032,11 +1113,36 @@ public:
    * @param needsPlatformResize This should be true for a "manual" resize from the plug-in UI and false
    * if being called from IEditorDelegate::OnParentWindowResize(), in order to avoid feedback */
   void Resize(int w, int h, float scale, bool needsPlatformResize = true);
+
+  /** Show a scaled snapshot of the UI while the corner resizer is dragged, and only lay out the controls (and re-rasterize their layers) once, when the drag ends.
+   * Drag resize events are coalesced to one resize per display frame either way. On by default
+   * @param enable \c false to lay out the controls on every frame of the drag */
+  void EnableResizePreview(bool enable) { mEnableResizePreview = enable; }
   
   /** Enables strict drawing mode. \todo explain strict drawing
    * @param strict Set /c true to enable strict drawing mode */
   void SetStrictDrawing(bool strict);
 
+  /** Sets how the dirty rects are merged before drawing, see IRECTList::MergeByCost(). A rect is merged with another if drawing their union costs less than drawing them separately,
+   * so many small dirty controls close together are drawn as a single region, but a single animating control doesn't cause the whole UI to redraw
+   * @param rectOverhead The fixed cost of drawing a separate region, as an area in points (the default is equivalent to a 64x64 region)
+   * @param maxRects The maximum number of regions to draw per frame */
+  void SetRedrawRegionOptimization(float rectOverhead, int maxRects);
+
+  /** Cache rasterized SVGs, so that DrawSVG() draws a bitmap rather than the SVG's shapes when the same SVG is drawn again with the same bounds and blend.
+   * The cache is keyed on the SVG, its bounds in the UI, and the blend weight. It is only used when the transform is a translation and the blend is source over,
+   * and is emptied when the UI is resized or rescaled. Controls whose SVGs change between draws can opt out with IControl::SetUseSVGCache()
+   * @param enable \c true to enable the cache (off by default) */
+  void EnableSVGCache(bool enable);
+
+  /** Let controls that draw identical vector content share rasters of it, see DrawSharedSprite(). The IVControls use this for their pressable shapes (e.g. knob and slider handles), and ILEDControl for its glow.
+   * Rasters are placed on whole pixels, so content drawn at a position that doesn't line up with its raster can move by up to an eighth of a pixel. The rasters are emptied when the UI is resized or rescaled
+   * @param enable \c true to share rasters (off by default) */
+  void EnableSharedSprites(bool enable);
+
+  /** @return \c true if controls draw shared rasters, see EnableSharedSprites() */
+  bool GetSharedSpritesEnabled() const { return mEnableSharedSprites; }
+
   /* Enables layout on resize. This means IGEditorDelegate:LayoutUI() will be called when the GUI is resized */
   void SetLayoutOnResize(bool layoutOnResize);
 
@@ -1126,6 +1232,22 @@ public:
 
   /** @return /c true if the platform supports multi touch */
   virtual bool PlatformSupportsMultiTouch() const { return false; }
+
+  /** Enable/disable coalescing of drag events. When enabled, which is the default, the drags the platform sends between two frames are merged, for each touch,
+   * into one call of IControl::OnMouseDrag() at the start of the next frame, with the latest position and the deltas added up. With a high rate mouse or a pen
+   * that is one call and one parameter change sent to the host per frame, rather than hundreds per second. Controls that need every point can opt out with
+   * IControl::SetWantsEveryDrag()
+   * @param enable Set \c false to send every drag event to the captured control as it arrives */
+  void EnableDragCoalescing(bool enable)
+  {
+    if (!enable)
+      FlushPendingDrags();
+
+    mEnableDragCoalescing = enable;
+  }
+
+  /** @return /c true if drag events are coalesced into one per frame */
+  bool DragCoalescingEnabled() const { return mEnableDragCoalescing; }
   
   /** @param enable Set \c true to enable tool tips when the user mouses over a control */
   void EnableTooltips(bool enable);
@@ -1190,6 +1312,9 @@ private:
   
   /** \todo */
   virtual void DrawResize() {}
+
+  /** Called when a control becomes dirty or starts animating, so that a platform whose frame loop slows down or stops while nothing is happening can wake it */
+  virtual void RequestFrame() {}
   
   /** Draw a region of the graphics (redrawing all contained items)
    * @param bounds \todo
@@ -1201,6 +1326,22 @@ private:
    * @param bounds \todo
    * @param scale \todo */
   void DrawControl(IControl* pControl, const IRECT& bounds, float scale);
+
+  /** Draw a visualization control into its reduced resolution layer and upscale the layer into the region being drawn, see SetDynamicResolution()
+   * @param pControl The control to draw
+   * @param clipBounds The region being drawn */
+  void DrawVisualizationControl(IControl* pControl, const IRECT& clipBounds);
+
+  /** Step the dynamic resolution scale down or up after a frame, see SetDynamicResolution()
+   * @param frameTime The CPU time the frame took to draw, in seconds */
+  void UpdateDynamicResolution(double frameTime);
+
+  /** Change the dynamic resolution scale, redrawing the visualization controls
+   * @param scale The new scale */
+  void SetDynamicResolutionScale(float scale);
+
+  /** Record the current path transform into the display list being recorded, if any, and pass it to the drawing back end */
+  void SetPathTransform();
   
   /** Shows a pop up/contextual menu in relation to a rectangular region of the graphics context
    * @param control A reference to the IControl creating this pop-up menu. If it exists IControl::OnPopupMenuSelection() will be called on successful selection
@@ -1211,7 +1352,7 @@ private:
   void DoCreatePopupMenu(IControl& control, IPopupMenu& menu, const IRECT& bounds, int valIdx, bool isContext);
   
   /** Called by ICornerResizer when drag resize commences */
-  void StartDragResize() { mResizingInProcess = true; }
+  void StartDragResize();
   
   /** Called when drag resize ends */
   void EndDragResize();
@@ -1299,6 +1440,37 @@ public:
   
   /** @return \c true if performance display is shown */
   bool ShowingFPSDisplay() { return mPerfDisplay != nullptr; }
+
+  /** Add an estimate of the memory this graphics context uses to a report: the bitmaps it has loaded, its layers and font data. The perf display shows this with the delegate's own report
+   * Bitmaps in the static cache, which the editors of every instance share, are reported as shared. A drawing backend that keeps its own bitmaps or fonts overrides this to add them
+   * @param report The report to add to */
+  virtual void GetMemoryReport(IMemoryReport& report);
+
+  /** Redraw the whole UI on each of the next nFrames frames, timing every frame and the drawing of every control, then report the results (also with DBGMSG).
+   * Run it once per drawing backend to compare them on the same UI.
+   * @param nFrames The number of frames to measure
+   * @param completionFunc Called on the UI thread after the last frame has been drawn */
+  void StartDrawBenchmark(int nFrames = 300, IDrawBenchmarkCompletionFunc completionFunc = nullptr);
+
+  /** Stop a draw benchmark without reporting */
+  void CancelDrawBenchmark() { mDrawBenchmark.Cancel(); }
+
+  /** @return \c true while a draw benchmark is running */
+  bool DrawBenchmarkRunning() const { return mDrawBenchmark.IsRunning(); }
+
+  /** Render the controls marked with IControl::SetIsVisualization() at a reduced resolution while frames take too long to draw, upscaling the result into place.
+   * The CPU time of each frame is measured: after a few frames over the budget the resolution steps down, and after a run of frames well under it, it steps back up.
+   * Other controls, such as text and chrome, are always drawn at the native resolution
+   * @param enable \c true to enable, \c false to go back to the native resolution
+   * @param frameBudgetMs The time a frame may take to draw, in milliseconds. 0 uses the frame interval, 1000 / FPS()
+   * @param minScale The lowest resolution scale, as a fraction of the native resolution, from 0.25 to 1 */
+  void SetDynamicResolution(bool enable, double frameBudgetMs = 0., float minScale = 0.5f);
+
+  /** @return \c true if dynamic resolution is enabled, see SetDynamicResolution() */
+  bool GetDynamicResolution() const { return mDynamicResolution; }
+
+  /** @return The resolution scale visualization controls are currently drawn at, 1 unless dynamic resolution has reduced it */
+  float GetDynamicResolutionScale() const { return mDynamicResolutionScale; }
   
   /** Attach an IControl to the graphics context and add it to the top of the control stack. The control is owned by the graphics context and will be deleted when the context is deleted.
    * @param pControl A pointer to an IControl to attach.
@@ -1442,8 +1614,62 @@ public:
    @param idx The index of the control 
    @param r The new bounds for the control's target and draw rect */
   void SetControlBounds(int idx, const IRECT& r);
+
+  /** Set the target and draw rects of several controls at once, e.g. from a layout pass. Controls whose bounds are unchanged are skipped, and the interface is redrawn once if any visible control moved
+   @param pControls The controls
+   @param pBounds The new bounds for each control's target and draw rect
+   @param nControls The number of controls
+   @return \c true if any control's bounds changed */
+  bool SetControlBounds(IControl* const* pControls, const IRECT* pBounds, int nControls);
+
+  /** Only visit the controls that are dirty or animating each frame, rather than every control.
+   * Controls are tracked when IControl::SetDirty() or IControl::SetAnimation() is called. A control that overrides IControl::IsDirty() to become dirty
+   * without calling SetDirty() must call IControl::SetPollDirty() to be checked every frame
+   * @param enable \c true to enable dirty tracking (off by default) */
+  void EnableDirtyTracking(bool enable);
+
+  /** @return \c true if dirty tracking is enabled, see EnableDirtyTracking() */
+  bool DirtyTrackingEnabled() const { return mTrackDirtyControls; }
+
+  /** Called by IControl when it becomes dirty, starts animating or needs polling, to add it to the controls visited each frame if dirty tracking is enabled */
+  void MarkControlActive(IControl* pControl);
+
+  /** Called by IControl when it is destroyed, to remove it from the controls visited each frame */
+  void RemoveActiveControl(IControl* pControl);
+
+  /** Called by IControl when it is given an animation function or starts its animation, to add it to the animations run each frame.
+   * It is dropped once its animation function has been cleared, normally by IControl::OnEndAnimation() */
+  void ScheduleAnimation(IControl* pControl);
+
+  /** Called by IControl when it is destroyed, to remove it from the animations run each frame */
+  void UnscheduleAnimation(IControl* pControl);
+
+  /** @return \c true if any control is animating. Once nothing is animating or dirty, a platform's frame loop can go idle */
+  bool IsAnimating() const { return !mAnimatingControls.empty(); }
+
+  /** @return The time the current frame's animations are run at, shared by all of them, see IControl::GetAnimationProgress() */
+  TimePoint GetAnimationFrameTime() const { return mAnimationFrameTime; }
+
+  /** Called by IControl when its draw or target bounds change, to keep the spatial index used for hit testing and drawing in sync */
+  void OnControlBoundsChanged(IControl* pControl);
   
 private:
+  /** Calls func for the "special controls" (perf display, live edit, corner resizer, text entry, popup and bubbles) in drawing order */
+  void ForSpecialControlsFunc(const std::function<void(IControl* pControl)>& func);
+
+  /** Run every scheduled animation once, at a timestamp shared by all of them, and drop those that have ended. Called by IsDirty()
+   * @return \c true if any animations remain */
+  bool AnimateControls();
+
+  /** @return \c true if there are enough controls for the spatial index to be worth using, in which case it is rebuilt if needed */
+  bool UseSpatialIndex();
+
+  /** @return \c true if pControl is one of the special controls */
+  bool IsSpecialControl(const IControl* pControl) const;
+
+  /** @return The bounds a control is indexed with, which cover where it can draw and be hit */
+  static IRECT GetSpatialIndexBounds(const IControl* pControl);
+
   /** Get the index of the control at x and y coordinates on mouse event
    * @param x The X coordinate to test
    * @param y The Y coordinate to test
@@ -1468,7 +1694,7 @@ public:
   /** Called when the platform class sends mouse up events */
   void OnMouseUp(const std::vector<IMouseInfo>& points);
 
-  /** Called when the platform class sends drag events */
+  /** Called when the platform class sends drag events, which are coalesced until the next frame unless the captured control wants every drag, see EnableDragCoalescing() */
   void OnMouseDrag(const std::vector<IMouseInfo>& points);
   
   /** Called when the platform class sends touch cancel events */
@@ -1630,6 +1856,23 @@ public:
    * @return A WDL_TypedBuf containing the data, or with a length of 0 if the resource was not found */
   virtual WDL_TypedBuf<uint8_t> LoadResource(const char* fileNameOrResID, const char* fileType);
 
+  /** Start decoding a bitmap on a worker thread, so that a later LoadBitmap() call for it finds it in the cache, or only has to wait for the decode to finish.
+   * Call this for all of a UI's bitmaps before creating its controls, so that they are decoded in parallel. The result is shared with other plug-in instances.
+   * Does nothing if the drawing back end can't load bitmaps off the main thread, see GetAPIBitmapLoader()
+   * @param fileNameOrResID CString file name or resource ID
+   * @param targetScale Set \c to a number > 0 to explicity load e.g. an @2x.png */
+  void PreloadBitmap(const char* fileNameOrResID, int targetScale = 0);
+
+  /** Start parsing an SVG on a worker thread, so that a later LoadSVG() call for it finds it in the cache, or only has to wait for the parse to finish.
+   * The result is shared with other plug-in instances
+   * @param fileNameOrResID A CString absolute path or resource ID
+   * @param units See LoadSVG()
+   * @param dpi See LoadSVG() */
+  void PreloadSVG(const char* fileNameOrResID, const char* units = "px", float dpi = 72.f);
+
+  /** Block until all the bitmaps and SVGs passed to PreloadBitmap() and PreloadSVG() have loaded */
+  void WaitForPreloads() { mResourceLoader.WaitAll(); }
+
   /** Registers a gesture recognizer with the graphics context
    * @param type The type of gesture recognizer */
   virtual void AttachGestureRecognizer(EGestureType type);
@@ -1660,6 +1903,15 @@ protected:
    * @return APIBitmap* Drawing API bitmap abstraction */
   virtual APIBitmap* LoadAPIBitmap(const char* name, const void* pData, int dataSize, int scale) = 0;
 
+  /** Drawing API method to get a function that loads a bitmap on a worker thread, called internally by PreloadBitmap().
+   * The function must not use the IGraphics instance, or a drawing context that belongs to the main thread
+   * @param fileNameOrResID A CString absolute path or resource ID
+   * @param scale Integer to identify the scale of the resource, for multi-scale bitmaps
+   * @param location Identifies the kind of resource location
+   * @param ext CString for the file extension
+   * @return The function, or an empty function if the drawing API can't load bitmaps off the main thread */
+  virtual std::function<APIBitmap*()> GetAPIBitmapLoader(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) { return nullptr; }
+
   /** Creates a new API bitmap, either in memory or as a GPU texture
    * @param width The desired width
    * @param height The desired height
@@ -1684,6 +1936,9 @@ protected:
   /** @return bool \c true if the drawing backend flips images (e.g. OpenGL) */
   virtual bool FlippedBitmap() const = 0;
 
+  /** @return bool \c true if the drawing backend samples bitmaps well at any scale (e.g. with mipmaps), so that LoadBitmap() can return a bitmap at the nearest available scale rather than a scaled copy */
+  virtual bool DrawsBitmapsAtAnyScale() const { return false; }
+
   /** Search for a bitmap image resource matching the target scale 
    * @param fileName \todo
    * @param type \todo 
@@ -1740,10 +1995,101 @@ private:
     mMouseOver = nullptr;
     mMouseOverIdx = -1;
   }
+
+  /** Draw an SVG from the raster cache, rendering it into the cache first if needed
+   * @return \c false if the SVG can't be cached with the current transform and blend */
+  bool DrawCachedSVG(const ISVG& svg, const IRECT& dest, float scale, const IBlend* pBlend);
+
+  void ClearSVGCache();
+
+  void ClearSpriteCache();
+
+  /** Resize the window and the drawing backend's surfaces, without laying out the controls
+   * @return \c false if the size and scale didn't change */
+  bool ResizeWindow(int w, int h, float scale, bool needsPlatformResize);
+
+  /** Lay out the controls after the window was resized */
+  void LayoutAfterResize();
+
+  /** Send drag events to the captured controls, or resize the window if a corner resizer is being dragged */
+  void DispatchMouseDrag(const std::vector<IMouseInfo>& points);
+
+  /** Send the coalesced drags to the captured controls, at the start of a frame and before any other mouse event, so that the controls see them in order */
+  void FlushPendingDrags();
+
+  struct SVGCacheKey
+  {
+    const void* mSVG;
+    IRECT mBounds; // in UI coordinates
+    float mBlendWeight;
+
+    bool operator==(const SVGCacheKey& other) const { return mSVG == other.mSVG && mBounds == other.mBounds && mBlendWeight == other.mBlendWeight; }
+  };
+
+  struct SVGCacheKeyHash
+  {
+    size_t operator()(const SVGCacheKey& key) const
+    {
+      size_t hash = std::hash<const void*>()(key.mSVG);
+      for (float f : { key.mBounds.L, key.mBounds.T, key.mBounds.R, key.mBounds.B, key.mBlendWeight })
+        hash = hash * 31 + std::hash<float>()(f);
+      return hash;
+    }
+  };
+
+  struct SVGCacheEntry
+  {
+    ILayerPtr mLayer;
+    uint64_t mLastUsed;
+  };
+
+  static constexpr int kMaxSVGCacheEntries = 128;
+
+  struct SpriteCacheKey
+  {
+    uint64_t mKey;
+    float mWidth;
+    float mHeight;
+    int mSubpixelX; // the position of the content within a pixel, in quarters
+    int mSubpixelY;
+
+    bool operator==(const SpriteCacheKey& other) const
+    {
+      return mKey == other.mKey && mWidth == other.mWidth && mHeight == other.mHeight && mSubpixelX == other.mSubpixelX && mSubpixelY == other.mSubpixelY;
+    }
+  };
+
+  struct SpriteCacheKeyHash
+  {
+    size_t operator()(const SpriteCacheKey& key) const
+    {
+      size_t hash = std::hash<uint64_t>()(key.mKey);
+      for (float f : { key.mWidth, key.mHeight })
+        hash = hash * 31 + std::hash<float>()(f);
+      return (hash * 31 + key.mSubpixelX) * 31 + key.mSubpixelY;
+    }
+  };
+
+  struct SpriteCacheEntry
+  {
+    ILayerPtr mLayer;
+    IRECT mBounds; // the bounds the content was drawn at, in UI coordinates
+    uint64_t mLastUsed;
+  };
+
+  static constexpr int kMaxSpriteCacheEntries = 256;
   
   WDL_PtrList<IControl> mControls;
   std::unordered_map<int, IControl*> mCtrlTags;
 
+  IControlSpatialIndex mSpatialIndex;
+  std::unordered_map<const IControl*, int> mSpatialIndexIdx; // index of each control in mControls, valid while mSpatialIndex is
+  std::vector<int> mSpatialIndexQuery;
+  std::vector<IControl*> mActiveControls; // dirty, animating or polled controls, used when mTrackDirtyControls is set
+  std::vector<IControl*> mAnimatingControls; // controls with an animation function, see ScheduleAnimation()
+  TimePoint mAnimationFrameTime;
+  bool mTrackDirtyControls = false;
+
   // Order (front-to-back) ToolTip / PopUp / TextEntry / LiveEdit / Corner / PerfDisplay
   std::unique_ptr<ICornerResizerControl> mCornerResizer;
   WDL_PtrList<IBubbleControl> mBubbleControls;
@@ -1755,6 +2101,7 @@ private:
   IPopupMenu mPromptPopupMenu;
   
   WDL_String mSharedResourcesSubPath;
+  IResourceLoader mResourceLoader;
   
   ECursor mCursorType = ECursor::ARROW;
   int mWidth;
@@ -1784,14 +2131,45 @@ private:
   int mLastClickedParam = kNoParameter;
   bool mEnableMouseOver = false;
   bool mStrict = false;
+  float mRedrawRectOverhead = 64.f * 64.f;
+  int mMaxRedrawRects = 16;
+  std::unordered_map<SVGCacheKey, SVGCacheEntry, SVGCacheKeyHash> mSVGCache;
+  uint64_t mSVGCacheUses = 0;
+  bool mEnableSVGCache = false;
+  bool mSVGCacheAllowed = true; // false while drawing a control that opted out of the cache
+  std::unordered_map<SpriteCacheKey, SpriteCacheEntry, SpriteCacheKeyHash> mSpriteCache;
+  uint64_t mSpriteCacheUses = 0;
+  bool mEnableSharedSprites = false;
   bool mEnableTooltips = false;
+  bool mOccluded = false;
   bool mShowControlBounds = false;
   bool mShowAreaDrawn = false;
   bool mResizingInProcess = false;
   bool mLayoutOnResize = false;
+  bool mEnableResizePreview = true;
+  bool mCaptureResizePreview = false; // snapshot the UI into mResizePreview on the next frame
+  bool mResizeLayoutPending = false; // the window was resized while the preview was shown
+  bool mDragResizePending = false; // a drag resize event is waiting for the next frame
+  bool mEnableDragCoalescing = true;
+  std::vector<IMouseInfo> mPendingDrags; // drags waiting for the next frame, at most one per touch and set of modifiers, with their deltas added up
+  int mDragResizeWidth = 0;
+  int mDragResizeHeight = 0;
+  float mDragResizeScale = 1.f;
+  ILayerPtr mResizePreview;
   bool mEnableMultiTouch = false;
   EUIResizerMode mGUISizeMode = EUIResizerMode::Scale;
   double mPrevTimestamp = 0.;
+  IDrawBenchmark mDrawBenchmark;
+  bool mDynamicResolution = false;
+  double mFrameBudget = 0.; // seconds, 0 for the frame interval
+  float mMinResolutionScale = 0.5f;
+  float mDynamicResolutionScale = 1.f;
+  int mOverBudgetFrames = 0; // consecutive frames over the budget
+  int mUnderBudgetFrames = 0; // consecutive frames with headroom
+  int mUnderBudgetFramesNeeded = kDynamicResolutionUpFrames; // before stepping up, longer after a step up didn't hold
+  int mFramesSinceScaleUp = 0;
+  int mNVisualizationsDrawn = 0; // in the current frame
+  static constexpr int kDynamicResolutionUpFrames = 30;
   IKeyHandlerFunc mKeyHandlerFunc = nullptr;
   IDisplayTickFunc mDisplayTickFunc = nullptr;
   IUIAppearanceChangedFunc mAppearanceChangedFunc = nullptr;
@@ -1811,10 +2189,15 @@ protected:
   friend class ITextEntryControl;
   
   std::stack<ILayer*> mLayers;
+  std::shared_ptr<std::atomic<size_t>> mLayerBytes = std::make_shared<std::atomic<size_t>>(0); // the bitmaps of the layers that exist, wherever they're owned
 
   IRECT mClipRECT;
+  IRECT mPathClipRECT; // the region last passed to PathClipRegion(), so that it can be restored after drawing into a layer
   IMatrix mTransform;
   std::stack<IMatrix> mTransformStates;
+
+  /** The display list the drawing back end should record its path and bitmap calls into, if a control is being recorded by the base implementation of StartDisplayList() */
+  IDisplayList* mDisplayListRecorder = nullptr;
 };
 
 END_IGRAPHICS_NAMESPACE
@@ -0,0 +1,236 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IDecodedBitmapCache
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mutex.h"
+#include "wdlstring.h"
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** The decoded pixels of a bitmap, 4 bytes per pixel in RGBA order */
+struct IDecodedBitmap
+{
+  int mWidth = 0;
+  int mHeight = 0;
+  std::vector<unsigned char> mPixels;
+};
+
+/** The counters of an IDecodedBitmapCache, for tuning its budget */
+struct IDecodedBitmapCacheStats
+{
+  /** The number of Find() calls that found a bitmap */
+  uint64_t mHits = 0;
+  /** The number of Find() calls that didn't */
+  uint64_t mMisses = 0;
+  /** The number of bitmaps dropped to keep within the budget */
+  uint64_t mEvictions = 0;
+  /** The number of times the cache was purged while it held bitmaps, e.g. on memory pressure */
+  uint64_t mPurges = 0;
+  /** The number of bytes held now */
+  size_t mBytes = 0;
+  /** The number of bitmaps held now */
+  int mNBitmaps = 0;
+};
+
+/** A process-wide cache of decoded bitmaps that outlives the editors. A drawing backend that keeps its bitmaps as GPU textures (NanoVG) frees them when the editor closes,
+ * but the decoded pixels are kept here, so that reopening the editor only uploads them again rather than reading and decoding the files.
+ * The least recently used bitmaps are evicted once the cache holds more than its budget, and the platform classes purge it when the OS reports memory pressure.
+ * All the methods are thread safe. Call GetReport() to see how well the budget fits a UI, and SetBudget(0) to turn the cache off */
+class IDecodedBitmapCache
+{
+public:
+  using BitmapPtr = std::shared_ptr<const IDecodedBitmap>;
+
+  static constexpr size_t kDefaultBudget = 64 << 20;
+
+  /** @return The cache shared by every editor in the process */
+  static IDecodedBitmapCache& Get()
+  {
+    static IDecodedBitmapCache sCache;
+    return sCache;
+  }
+
+  IDecodedBitmapCache(const IDecodedBitmapCache&) = delete;
+  IDecodedBitmapCache& operator=(const IDecodedBitmapCache&) = delete;
+
+  /** Look up a bitmap, making it the most recently used
+   * @param name The bitmap's resource name or path
+   * @param scale The scale it was loaded at
+   * @return The bitmap, or nullptr if it isn't cached */
+  BitmapPtr Find(const char* name, int scale)
+  {
+    WDL_MutexLock lock(&mMutex);
+    auto it = mIndex.find(Key(name, scale));
+
+    if (it == mIndex.end())
+    {
+      mStats.mMisses++;
+      return nullptr;
+    }
+
+    mStats.mHits++;
+    mEntries.splice(mEntries.begin(), mEntries, it->second);
+    return it->second->mBitmap;
+  }
+
+  /** Copy a decoded bitmap into the cache, evicting the least recently used ones if it goes over budget. A bitmap bigger than the budget isn't cached
+   * @param name The bitmap's resource name or path
+   * @param scale The scale it was loaded at
+   * @param width The width in pixels
+   * @param height The height in pixels
+   * @param pPixels width * height RGBA pixels
+   * @return \c true if the bitmap was cached */
+  bool Add(const char* name, int scale, int width, int height, const unsigned char* pPixels)
+  {
+    const size_t size = static_cast<size_t>(width) * height * 4;
+
+    {
+      WDL_MutexLock lock(&mMutex);
+
+      if (size > mBudget)
+        return false;
+    }
+
+    // copy outside the lock
+    auto pBitmap = std::make_shared<IDecodedBitmap>();
+    pBitmap->mWidth = width;
+    pBitmap->mHeight = height;
+    pBitmap->mPixels.assign(pPixels, pPixels + size);
+
+    WDL_MutexLock lock(&mMutex);
+    std::string key = Key(name, scale);
+    auto it = mIndex.find(key);
+
+    if (it != mIndex.end())
+    {
+      mStats.mBytes -= it->second->mBitmap->mPixels.size();
+      mEntries.erase(it->second);
+      mIndex.erase(it);
+    }
+
+    mEntries.push_front({key, std::move(pBitmap)});
+    mIndex[key] = mEntries.begin();
+    mStats.mBytes += size;
+    Trim(mBudget);
+    return true;
+  }
+
+  /** @param bytes The most decoded pixel data to keep, 0 keeps nothing */
+  void SetBudget(size_t bytes)
+  {
+    WDL_MutexLock lock(&mMutex);
+    mBudget = bytes;
+    Trim(mBudget);
+  }
+
+  /** @return The most decoded pixel data kept, in bytes */
+  size_t GetBudget() const
+  {
+    WDL_MutexLock lock(&mMutex);
+    return mBudget;
+  }
+
+  /** Drop every bitmap, called by the platform classes on memory pressure. Bitmaps that are in use by an open editor are not affected */
+  void Purge()
+  {
+    WDL_MutexLock lock(&mMutex);
+
+    if (mEntries.empty())
+      return;
+
+    mIndex.clear();
+    mEntries.clear();
+    mStats.mBytes = 0;
+    mStats.mPurges++;
+  }
+
+  /** @return The counters, and what the cache holds now */
+  IDecodedBitmapCacheStats GetStats() const
+  {
+    WDL_MutexLock lock(&mMutex);
+    IDecodedBitmapCacheStats stats = mStats;
+    stats.mNBitmaps = static_cast<int>(mEntries.size());
+    return stats;
+  }
+
+  /** Reset the hit, miss, eviction and purge counters */
+  void ResetStats()
+  {
+    WDL_MutexLock lock(&mMutex);
+    const size_t bytes = mStats.mBytes;
+    mStats = IDecodedBitmapCacheStats();
+    mStats.mBytes = bytes;
+  }
+
+  /** @param str Receives a one line summary of the stats, e.g. for DBGMSG() */
+  void GetReport(WDL_String& str) const
+  {
+    const IDecodedBitmapCacheStats stats = GetStats();
+    const size_t budget = GetBudget();
+    const uint64_t lookups = stats.mHits + stats.mMisses;
+
+    str.SetFormatted(256, "decoded bitmap cache: %d bitmaps, %.1f of %.1f MB, %llu hits, %llu misses (%.0f%% hit rate), %llu evictions, %llu purges",
+                     stats.mNBitmaps, stats.mBytes / 1048576., budget / 1048576., (unsigned long long) stats.mHits, (unsigned long long) stats.mMisses,
+                     lookups ? 100. * stats.mHits / lookups : 0., (unsigned long long) stats.mEvictions, (unsigned long long) stats.mPurges);
+  }
+
+private:
+  IDecodedBitmapCache() {}
+
+  struct Entry
+  {
+    std::string mKey;
+    BitmapPtr mBitmap;
+  };
+
+  static std::string Key(const char* name, int scale)
+  {
+    return std::string(name) + "@" + std::to_string(scale);
+  }
+
+  /** Evict the least recently used bitmaps until the cache holds no more than budget bytes, with mMutex locked */
+  void Trim(size_t budget)
+  {
+    while (mStats.mBytes > budget && !mEntries.empty())
+    {
+      const Entry& entry = mEntries.back();
+      mStats.mBytes -= entry.mBitmap->mPixels.size();
+      mStats.mEvictions++;
+      mIndex.erase(entry.mKey);
+      mEntries.pop_back();
+    }
+  }
+
+  mutable WDL_Mutex mMutex;
+  std::list<Entry> mEntries; // the most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+  size_t mBudget = kDefaultBudget;
+  IDecodedBitmapCacheStats mStats;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
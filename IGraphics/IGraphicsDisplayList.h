@@ -0,0 +1,203 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IDisplayList
+ */
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IGraphicsStructs.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** Base class for drawing back end specific recordings held by an IDisplayList (e.g. an SkPicture) */
+class APIDisplayList
+{
+public:
+  virtual ~APIDisplayList() {}
+};
+
+/** A recording of the drawing calls made by an IControl's Draw() method, that can be replayed without calling Draw() again.
+ * IGraphics records the path, transform, clip, text and bitmap calls into a command buffer and replays them through the same virtual methods,
+ * which saves re-evaluating the control's drawing code (and any layout, SVG traversal or text measurement it does).
+ * Drawing back ends that have a native equivalent (IGraphicsSkia uses SkPicture) store that in the APIDisplayList instead.
+ * Recordings are made in the control's coordinates, but are only valid for the scale they were recorded at, see IsValid()
+ * @see IControl::SetUseDisplayList() */
+class IDisplayList
+{
+public:
+  enum class ECommand
+  {
+    PathClear,
+    PathClose,
+    PathArc,
+    PathMoveTo,
+    PathLineTo,
+    PathCubicBezierTo,
+    PathQuadraticBezierTo,
+    PathSetWinding,
+    PathStroke,
+    PathFill,
+    SetTransform,
+    PathClipRegion,
+    DrawText,
+    DrawBitmap,
+    DrawFastDropShadow
+  };
+
+  /** A recorded call. mArgs indexes the float arguments, mObj indexes the vector holding the call's object argument (pattern, text or bitmap),
+   * mOptions indexes the stroke or fill options and mBlend indexes the blends, or is -1 for no blend */
+  struct Command
+  {
+    ECommand mType;
+    int mArgs;
+    int mObj;
+    int mOptions;
+    int mBlend;
+  };
+
+  IDisplayList() = default;
+  IDisplayList(const IDisplayList&) = delete;
+  IDisplayList& operator=(const IDisplayList&) = delete;
+
+  /** @param scale The total scale IGraphics is drawing at
+   * @return \c true if the list holds a complete recording made at this scale */
+  bool IsValid(float scale) const { return mValid && mScale == scale; }
+
+  /** Mark the recording as out of date, so that it is recorded again next time the control draws. Doesn't free any memory */
+  void Invalidate() { mValid = false; }
+
+  /** Clear the recording, keeping the memory allocated for it
+   * @param scale The total scale the new recording is made at */
+  void Reset(float scale)
+  {
+    mCommands.clear();
+    mArgs.clear();
+    mPatterns.clear();
+    mStrokeOptions.clear();
+    mFillOptions.clear();
+    mBlends.clear();
+    mTexts.clear();
+    mStrings.clear();
+    mBitmaps.clear();
+    mAPIData = nullptr;
+    mScale = scale;
+    mValid = false;
+  }
+
+  /** Mark the recording as complete */
+  void SetValid() { mValid = true; }
+
+  /** @return The number of recorded calls */
+  int NCommands() const { return static_cast<int>(mCommands.size()); }
+
+  /** Set the drawing back end specific recording */
+  void SetAPIData(std::unique_ptr<APIDisplayList> pData) { mAPIData = std::move(pData); }
+
+  /** @return The drawing back end specific recording, if there is one */
+  APIDisplayList* GetAPIData() const { return mAPIData.get(); }
+
+#pragma mark - Recording
+
+  void PathClear() { Add(ECommand::PathClear); }
+  void PathClose() { Add(ECommand::PathClose); }
+  void PathArc(float cx, float cy, float r, float a1, float a2, EWinding winding) { Add(ECommand::PathArc, { cx, cy, r, a1, a2, static_cast<float>(winding) }); }
+  void PathMoveTo(float x, float y) { Add(ECommand::PathMoveTo, { x, y }); }
+  void PathLineTo(float x, float y) { Add(ECommand::PathLineTo, { x, y }); }
+  void PathCubicBezierTo(float c1x, float c1y, float c2x, float c2y, float x2, float y2) { Add(ECommand::PathCubicBezierTo, { c1x, c1y, c2x, c2y, x2, y2 }); }
+  void PathQuadraticBezierTo(float cx, float cy, float x2, float y2) { Add(ECommand::PathQuadraticBezierTo, { cx, cy, x2, y2 }); }
+  void PathSetWinding(bool clockwise) { Add(ECommand::PathSetWinding, { clockwise ? 1.f : 0.f }); }
+
+  void PathStroke(const IPattern& pattern, float thickness, const IStrokeOptions& options, const IBlend* pBlend)
+  {
+    Add(ECommand::PathStroke, { thickness }, static_cast<int>(mPatterns.size()), pBlend, static_cast<int>(mStrokeOptions.size()));
+    mPatterns.push_back(pattern);
+    mStrokeOptions.push_back(options);
+  }
+
+  void PathFill(const IPattern& pattern, const IFillOptions& options, const IBlend* pBlend)
+  {
+    Add(ECommand::PathFill, {}, static_cast<int>(mPatterns.size()), pBlend, static_cast<int>(mFillOptions.size()));
+    mPatterns.push_back(pattern);
+    mFillOptions.push_back(options);
+  }
+
+  void SetTransform(const IMatrix& m) { Add(ECommand::SetTransform, { static_cast<float>(m.mXX), static_cast<float>(m.mYX), static_cast<float>(m.mXY), static_cast<float>(m.mYY), static_cast<float>(m.mTX), static_cast<float>(m.mTY) }); }
+  void PathClipRegion(const IRECT& r) { Add(ECommand::PathClipRegion, { r.L, r.T, r.R, r.B }); }
+
+  void DrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend)
+  {
+    Add(ECommand::DrawText, { bounds.L, bounds.T, bounds.R, bounds.B }, static_cast<int>(mTexts.size()), pBlend);
+    mTexts.push_back(text);
+    mStrings.push_back(str);
+  }
+
+  void DrawBitmap(const IBitmap& bitmap, const IRECT& dest, int srcX, int srcY, const IBlend* pBlend)
+  {
+    Add(ECommand::DrawBitmap, { dest.L, dest.T, dest.R, dest.B, static_cast<float>(srcX), static_cast<float>(srcY) }, static_cast<int>(mBitmaps.size()), pBlend);
+    mBitmaps.push_back(bitmap);
+  }
+
+  void DrawFastDropShadow(const IRECT& innerBounds, const IRECT& outerBounds, float xyDrop, float roundness, float blur, const IBlend* pBlend)
+  {
+    Add(ECommand::DrawFastDropShadow, { innerBounds.L, innerBounds.T, innerBounds.R, innerBounds.B, outerBounds.L, outerBounds.T, outerBounds.R, outerBounds.B, xyDrop, roundness, blur }, -1, pBlend);
+  }
+
+#pragma mark - Playback
+
+  const Command& GetCommand(int idx) const { return mCommands[idx]; }
+  const float* GetArgs(const Command& cmd) const { return mArgs.data() + cmd.mArgs; }
+  const IPattern& GetPattern(const Command& cmd) const { return mPatterns[cmd.mObj]; }
+  const IStrokeOptions& GetStrokeOptions(const Command& cmd) const { return mStrokeOptions[cmd.mOptions]; }
+  const IFillOptions& GetFillOptions(const Command& cmd) const { return mFillOptions[cmd.mOptions]; }
+  const IText& GetText(const Command& cmd) const { return mTexts[cmd.mObj]; }
+  const char* GetString(const Command& cmd) const { return mStrings[cmd.mObj].c_str(); }
+  const IBitmap& GetBitmap(const Command& cmd) const { return mBitmaps[cmd.mObj]; }
+  const IBlend* GetBlend(const Command& cmd) const { return cmd.mBlend < 0 ? nullptr : &mBlends[cmd.mBlend]; }
+
+private:
+  void Add(ECommand type, std::initializer_list<float> args = {}, int obj = -1, const IBlend* pBlend = nullptr, int options = -1)
+  {
+    int blendIdx = -1;
+
+    if (pBlend)
+    {
+      blendIdx = static_cast<int>(mBlends.size());
+      mBlends.push_back(*pBlend);
+    }
+
+    mCommands.push_back({ type, static_cast<int>(mArgs.size()), obj, options, blendIdx });
+    mArgs.insert(mArgs.end(), args);
+  }
+
+  std::vector<Command> mCommands;
+  std::vector<float> mArgs;
+  std::vector<IPattern> mPatterns;
+  std::vector<IStrokeOptions> mStrokeOptions;
+  std::vector<IFillOptions> mFillOptions;
+  std::vector<IBlend> mBlends;
+  std::vector<IText> mTexts;
+  std::vector<std::string> mStrings;
+  std::vector<IBitmap> mBitmaps;
+  std::unique_ptr<APIDisplayList> mAPIData;
+  float mScale = 0.f;
+  bool mValid = false;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
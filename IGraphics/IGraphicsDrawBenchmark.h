@@ -0,0 +1,235 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IDrawBenchmark
+ */
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "wdlstring.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugLogger.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+class IControl;
+
+/** The draw timing of one control over a draw benchmark */
+struct IControlDrawTiming
+{
+  /** The control's index in the graphics context, or -1 for a special control such as the corner resizer */
+  int mIdx = -1;
+  /** The control's tag */
+  int mTag = kNoTag;
+  /** The control's class, as reported by typeid() */
+  const char* mClassName = "";
+  /** The number of times the control was drawn. This can be more than the number of frames if a frame was drawn as several regions */
+  int mNDraws = 0;
+  /** The total time spent drawing the control, in seconds */
+  double mTotalTime = 0.;
+  /** The longest time spent drawing the control in one frame, in seconds */
+  double mMaxTime = 0.;
+};
+
+/** The results of a draw benchmark, see IGraphics::StartDrawBenchmark(). Times are CPU times in seconds unless stated otherwise.
+ * Note that backends that batch their drawing (e.g. NanoVG) do most of the work of a frame in IGraphics::EndFrame(), so there the control timings measure building the commands and the frame times include the rest */
+struct IDrawBenchmarkResult
+{
+  /** The drawing backend, from IGraphics::GetDrawingAPIStr() */
+  const char* mDrawingAPI = "";
+  /** The number of frames that were measured */
+  int mNFrames = 0;
+  /** CPU time from IGraphics::BeginFrame() to the end of IGraphics::EndFrame() */
+  double mMeanFrameTime = 0.;
+  double mMedianFrameTime = 0.;
+  double mP95FrameTime = 0.;
+  double mMaxFrameTime = 0.;
+  /** The mean time the GPU spent on a frame, or -1. if the backend can't measure it */
+  double mMeanGPUFrameTime = -1.;
+  /** The number of frames mMeanGPUFrameTime is taken over */
+  int mNGPUFrames = 0;
+  /** The controls that were drawn, slowest (by total time) first */
+  std::vector<IControlDrawTiming> mControls;
+
+  /** Format the results as text
+   * @param str The string to write to
+   * @param nControls The number of slowest controls to list */
+  void GetReport(WDL_String& str, int nControls = 10) const
+  {
+    str.SetFormatted(256, "%s, %d frames: CPU frame ms mean %.3f p50 %.3f p95 %.3f max %.3f", mDrawingAPI, mNFrames,
+                     mMeanFrameTime * 1000., mMedianFrameTime * 1000., mP95FrameTime * 1000., mMaxFrameTime * 1000.);
+
+    if (mMeanGPUFrameTime >= 0.)
+      str.AppendFormatted(64, ", GPU frame ms mean %.3f", mMeanGPUFrameTime * 1000.);
+
+    str.Append("\n");
+
+    const int n = std::min(nControls, static_cast<int>(mControls.size()));
+
+    for (int i = 0; i < n; i++)
+    {
+      const IControlDrawTiming& c = mControls[i];
+      str.AppendFormatted(256, "  #%d tag %d %s: %d draws, ms mean %.4f max %.4f\n", c.mIdx, c.mTag, c.mClassName, c.mNDraws,
+                          c.mNDraws ? c.mTotalTime / c.mNDraws * 1000. : 0., c.mMaxTime * 1000.);
+    }
+  }
+};
+
+using IDrawBenchmarkCompletionFunc = std::function<void(const IDrawBenchmarkResult& result)>;
+
+/** Collects the timings of a draw benchmark. IGraphics owns one and feeds it from Draw() and DrawControl() while a benchmark is running */
+class IDrawBenchmark
+{
+public:
+  /** Start measuring
+   * @param nFrames The number of frames to measure
+   * @param completionFunc Called with the results after the last frame */
+  void Start(int nFrames, IDrawBenchmarkCompletionFunc completionFunc)
+  {
+    mNFramesRemaining = nFrames;
+    mCompletionFunc = completionFunc;
+    mFrameTimes.clear();
+    mFrameTimes.reserve(nFrames);
+    mGPUTimes.clear();
+    mControls.clear();
+  }
+
+  /** Stop measuring without reporting */
+  void Cancel() { mNFramesRemaining = 0; mCompletionFunc = nullptr; }
+
+  /** @return \c true while frames are being measured */
+  bool IsRunning() const { return mNFramesRemaining > 0; }
+
+  /** Add the time taken to draw a control in the current frame
+   * @param pControl The control, which is only used to identify it
+   * @param tag The control's tag
+   * @param className The control's class name, which must outlive the benchmark
+   * @param time The time in seconds */
+  void AddControl(const IControl* pControl, int tag, const char* className, double time)
+  {
+    Control& c = mControls[pControl];
+
+    if (!c.mTiming.mNDraws)
+    {
+      c.mTiming.mTag = tag;
+      c.mTiming.mClassName = className;
+    }
+
+    if (c.mFrame != static_cast<int>(mFrameTimes.size()))
+    {
+      c.mFrame = static_cast<int>(mFrameTimes.size());
+      c.mFrameTime = 0.;
+    }
+
+    c.mFrameTime += time;
+    c.mTiming.mNDraws++;
+    c.mTiming.mTotalTime += time;
+    c.mTiming.mMaxTime = std::max(c.mTiming.mMaxTime, c.mFrameTime);
+  }
+
+  /** Finish a frame
+   * @param frameTime The CPU time the frame took
+   * @param gpuFrameTime The GPU time of a recent frame, or a negative value if none is available
+   * @param drawingAPI The backend's name
+   * @param getControlIdx Returns the index of a control that was drawn, or -1 if it isn't in the control list
+   * @return \c true if this was the last frame, in which case the completion function has been called */
+  template <typename F>
+  bool EndFrame(double frameTime, double gpuFrameTime, const char* drawingAPI, F getControlIdx)
+  {
+    if (!IsRunning())
+      return false;
+
+    mFrameTimes.push_back(frameTime);
+
+    if (gpuFrameTime >= 0.)
+      mGPUTimes.push_back(gpuFrameTime);
+
+    if (--mNFramesRemaining > 0)
+      return false;
+
+    IDrawBenchmarkResult result;
+    result.mDrawingAPI = drawingAPI;
+    result.mNFrames = static_cast<int>(mFrameTimes.size());
+
+    std::vector<double> sorted(mFrameTimes);
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.;
+    for (auto t : sorted)
+      sum += t;
+
+    result.mMeanFrameTime = sum / sorted.size();
+    result.mMedianFrameTime = sorted[sorted.size() / 2];
+    result.mP95FrameTime = sorted[std::min(static_cast<size_t>(0.95 * sorted.size()), sorted.size() - 1)];
+    result.mMaxFrameTime = sorted.back();
+
+    if (!mGPUTimes.empty())
+    {
+      double gpuSum = 0.;
+      for (auto t : mGPUTimes)
+        gpuSum += t;
+
+      result.mMeanGPUFrameTime = gpuSum / mGPUTimes.size();
+      result.mNGPUFrames = static_cast<int>(mGPUTimes.size());
+    }
+
+    for (auto& entry : mControls)
+    {
+      IControlDrawTiming timing = entry.second.mTiming;
+      timing.mIdx = getControlIdx(entry.first);
+      result.mControls.push_back(timing);
+    }
+
+    std::sort(result.mControls.begin(), result.mControls.end(), [](const IControlDrawTiming& a, const IControlDrawTiming& b) {
+      return a.mTotalTime > b.mTotalTime;
+    });
+
+    mControls.clear();
+
+    IDrawBenchmarkCompletionFunc completionFunc = std::move(mCompletionFunc);
+    mCompletionFunc = nullptr;
+
+    WDL_String report;
+    result.GetReport(report);
+    DBGMSG("%s", report.Get());
+
+    if (completionFunc)
+      completionFunc(result);
+
+    return true;
+  }
+
+private:
+  struct Control
+  {
+    IControlDrawTiming mTiming;
+    int mFrame = -1;
+    double mFrameTime = 0.;
+  };
+
+  int mNFramesRemaining = 0;
+  IDrawBenchmarkCompletionFunc mCompletionFunc;
+  std::vector<double> mFrameTimes;
+  std::vector<double> mGPUTimes;
+  std::unordered_map<const IControl*, Control> mControls;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
@@ -28,6 +28,7 @@ void* IGEditorDelegate::OpenWindow(void* pParent)
 {
   if(!mGraphics)
   {
+    TRACE_SCOPE("CreateGraphics");
     mGraphics = std::unique_ptr<IGraphics>(CreateGraphics());
     if (mLastWidth && mLastHeight && mLastScale)
       GetUI()->Resize(mLastWidth, mLastHeight, mLastScale);
@@ -45,6 +46,7 @@ void IGEditorDelegate::CloseWindow()
   {
     mClosing = true;
     IEditorDelegate::CloseWindow();
+    GetControlCoalescer().Clear();
   
     if (mGraphics)
     {
@@ -70,20 +72,20 @@ void IGEditorDelegate::SendControlValueFromDelegate(int ctrlTag, double normaliz
   if(!mGraphics)
     return;
 
-  IControl* pControl = mGraphics->GetControlWithTag(ctrlTag);
-  
-  assert(pControl);
-  
-  if(pControl)
-  {
-    pControl->SetValueFromDelegate(normalizedValue);
-  }
+  // delivered at the start of the next frame, see DeliverCoalescedControlMsgs()
+  GetControlCoalescer().AddValue(ctrlTag, normalizedValue);
 }
 
 void IGEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
 {
   if(!mGraphics)
     return;
+
+  if (GetControlCoalescer().GetMsgCoalescing(ctrlTag))
+  {
+    GetControlCoalescer().AddMsg(ctrlTag, msgTag, dataSize, pData);
+    return;
+  }
   
   IControl* pControl = mGraphics->GetControlWithTag(ctrlTag);
   
@@ -95,6 +97,26 @@ void IGEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int d
   }
 }
 
+void IGEditorDelegate::DeliverCoalescedControlMsgs()
+{
+  GetControlCoalescer().Flush([this](const IControlCoalescer::ValueSlot& slot) {
+    IControl* pControl = mGraphics->GetControlWithTag(slot.mCtrlTag);
+
+    assert(pControl);
+
+    if (pControl)
+      pControl->SetCoalescedValuesFromDelegate(slot.mValue, slot.mMin, slot.mMax);
+  },
+  [this](int ctrlTag, int msgTag, int dataSize, const void* pData) {
+    IControl* pControl = mGraphics->GetControlWithTag(ctrlTag);
+
+    assert(pControl);
+
+    if (pControl)
+      pControl->OnMsgFromDelegate(msgTag, dataSize, pData);
+  });
+}
+
 void IGEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
 {
   if(mGraphics)
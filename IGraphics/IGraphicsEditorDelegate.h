@@ -67,6 +67,7 @@ public:
   /** Called to layout controls when the GUI is initially opened and again if the UI size changes. On subsequent calls you can check for the existence of controls and behave accordingly. Default impl calls  mLayoutFunc */
   virtual void LayoutUI(IGraphics* pGraphics)
   {
+    TRACE_SCOPE("LayoutUI");
     if(mLayoutFunc)
       mLayoutFunc(pGraphics);
   }
@@ -92,6 +93,9 @@ protected:
   std::function<IGraphics*()> mMakeGraphicsFunc = nullptr;
   std::function<void(IGraphics* pGraphics)> mLayoutFunc = nullptr;
 private:
+  /** Called by IGraphics at the start of each frame, delivers the values and messages coalesced since the last one */
+  void DeliverCoalescedControlMsgs();
+
   std::unique_ptr<IGraphics> mGraphics;
   int mLastWidth = 0;
   int mLastHeight = 0;
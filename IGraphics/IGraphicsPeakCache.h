@@ -0,0 +1,157 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPeakCache
+ */
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** A multi-resolution min/max pyramid over a static array of values (e.g. a waveform), so that the range of any span of values can be found without scanning it.
+ * Level 0 holds the minimum and maximum of each block of kBlockSize values, and each coarser level combines pairs of blocks from the level below.
+ * A query scans at most kBlockSize values at each end of the span, and two blocks per level in between.
+ * Building the cache allocates, so build it when the data changes rather than when it is drawn
+ * @see IGraphics::DrawData() */
+class IPeakCache
+{
+public:
+  static constexpr int kBlockSize = 16;
+
+  /** Build the cache, copying the values
+   * @param pData The values, normalized between 0 and 1 if the cache is going to be drawn with IGraphics::DrawData()
+   * @param nPoints The number of values */
+  void Build(const float* pData, int nPoints)
+  {
+    mData.assign(pData, pData + nPoints);
+    mLevels.clear();
+
+    const int nBlocks = nPoints / kBlockSize;
+
+    if (nBlocks < 2)
+      return;
+
+    mLevels.emplace_back();
+    Level& base = mLevels.back();
+    base.mMin.resize(nBlocks);
+    base.mMax.resize(nBlocks);
+
+    for (int b = 0; b < nBlocks; b++)
+    {
+      base.mMin[b] = base.mMax[b] = pData[b * kBlockSize];
+      VectorMinMax(pData + b * kBlockSize, kBlockSize, base.mMin[b], base.mMax[b]);
+    }
+
+    while (mLevels.back().Size() > 1)
+    {
+      const int nPrev = mLevels.back().Size();
+      const int nNext = (nPrev + 1) / 2;
+      Level next;
+      next.mMin.resize(nNext);
+      next.mMax.resize(nNext);
+
+      const Level& prev = mLevels.back();
+
+      for (int b = 0; b < nNext; b++)
+      {
+        const int b2 = std::min(2 * b + 1, nPrev - 1);
+        next.mMin[b] = std::min(prev.mMin[2 * b], prev.mMin[b2]);
+        next.mMax[b] = std::max(prev.mMax[2 * b], prev.mMax[b2]);
+      }
+
+      mLevels.push_back(std::move(next));
+    }
+  }
+
+  /** Empty the cache, releasing its memory */
+  void Clear()
+  {
+    mData = std::vector<float>();
+    mLevels = std::vector<Level>();
+  }
+
+  /** @return The number of values in the cache */
+  int NPoints() const { return static_cast<int>(mData.size()); }
+
+  /** @return The values the cache was built from */
+  const float* GetData() const { return mData.data(); }
+
+  /** Get the range of a span of values
+   * @param start The index of the first value
+   * @param end One past the index of the last value, greater than start
+   * @param min Set to the smallest value in the span
+   * @param max Set to the largest value in the span */
+  void GetMinMax(int start, int end, float& min, float& max) const
+  {
+    min = std::numeric_limits<float>::max();
+    max = std::numeric_limits<float>::lowest();
+
+    // whole level 0 blocks in the span
+    int b0 = mLevels.empty() ? 0 : (start + kBlockSize - 1) / kBlockSize;
+    int b1 = mLevels.empty() ? 0 : end / kBlockSize;
+
+    if (b0 >= b1)
+    {
+      VectorMinMax(mData.data() + start, end - start, min, max);
+      return;
+    }
+
+    VectorMinMax(mData.data() + start, b0 * kBlockSize - start, min, max);
+    VectorMinMax(mData.data() + b1 * kBlockSize, end - b1 * kBlockSize, min, max);
+
+    // take the blocks at the ends of the span that don't pair up, and move up a level
+    for (int level = 0; b0 < b1; level++)
+    {
+      const Level& l = mLevels[level];
+
+      if (b0 & 1)
+      {
+        min = std::min(min, l.mMin[b0]);
+        max = std::max(max, l.mMax[b0]);
+        b0++;
+      }
+
+      if (b1 & 1)
+      {
+        b1--;
+        min = std::min(min, l.mMin[b1]);
+        max = std::max(max, l.mMax[b1]);
+      }
+
+      b0 >>= 1;
+      b1 >>= 1;
+    }
+  }
+
+private:
+  struct Level
+  {
+    int Size() const { return static_cast<int>(mMin.size()); }
+
+    std::vector<float> mMin;
+    std::vector<float> mMax;
+  };
+
+  std::vector<float> mData;
+  std::vector<Level> mLevels;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
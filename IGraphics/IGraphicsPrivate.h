@@ -73,7 +73,7 @@
 #elif defined OS_WIN
   #include "wingdi.h"
   #define FONT_DESCRIPTOR_TYPE HFONT
-#elif defined OS_WEB
+#elif defined OS_WEB || defined OS_LINUX
   #define FONT_DESCRIPTOR_TYPE std::pair<WDL_String, WDL_String>*
 #else 
   // NO_IGRAPHICS
@@ -508,6 +508,11 @@ public:
     void Clear()                                              { return mStorage.Clear(); }
     void Retain()                                             { return mStorage.Retain(); }
     void Release()                                            { return mStorage.Release(); }
+
+    /** Call a function for each item, e.g. to add up their sizes
+     * @param func Called with each item */
+    template <typename F>
+    void ForEach(F func)                                      { for (int i = 0; i < mStorage.mDatas.GetSize(); i++) func(*mStorage.mDatas.Get(i)->data); }
       
   private:
     StaticStorage& mStorage;
@@ -0,0 +1,184 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IResourceLoader
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** A small pool of worker threads that IGraphics uses to decode bitmaps and parse SVGs ahead of the calls that need them.
+ * Each task is identified by the name of the resource it loads, so that the loading methods can wait for a pending task instead of loading the resource again.
+ * Tasks must not call back into IGraphics, since they may still be running while it is destroyed. They put their results in the static caches, which are shared between plug-in instances
+ * @see IGraphics::PreloadBitmap() IGraphics::PreloadSVG() */
+class IResourceLoader
+{
+public:
+  using Task = std::function<void()>;
+
+  static constexpr int kMaxThreads = 4;
+
+  IResourceLoader() = default;
+
+  ~IResourceLoader()
+  {
+    Cancel();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+
+    mWakeWorkers.notify_all();
+
+    for (auto& thread : mThreads)
+      thread.join();
+  }
+
+  IResourceLoader(const IResourceLoader&) = delete;
+  IResourceLoader& operator=(const IResourceLoader&) = delete;
+
+  /** Queue a task, starting the worker threads the first time this is called. Does nothing if a task with the same key is already pending
+   * @param key The name of the resource the task loads
+   * @param task The task */
+  void Add(const char* key, Task&& task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+
+      if (!mPending.insert(key).second)
+        return;
+
+      if (mThreads.empty())
+      {
+        const int nThreads = std::max(1, std::min(kMaxThreads, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+
+        for (int i = 0; i < nThreads; i++)
+          mThreads.emplace_back([this]() { WorkerLoop(); });
+      }
+
+      mQueue.push_back({ key, std::move(task) });
+    }
+
+    mWakeWorkers.notify_one();
+  }
+
+  /** If a task for a resource is pending, wait for it to finish. A task that hasn't started yet is run on the calling thread instead
+   * @param key The name of the resource */
+  void Wait(const char* key)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (mPending.empty() || !mPending.count(key))
+      return;
+
+    auto it = std::find_if(mQueue.begin(), mQueue.end(), [key](const QueuedTask& queued) { return queued.mKey == key; });
+
+    if (it != mQueue.end())
+    {
+      QueuedTask queued = std::move(*it);
+      mQueue.erase(it);
+      lock.unlock();
+      queued.mTask();
+      lock.lock();
+      mPending.erase(queued.mKey);
+      mTaskDone.notify_all();
+      return;
+    }
+
+    mTaskDone.wait(lock, [this, key]() { return !mPending.count(key); });
+  }
+
+  /** Wait for all pending tasks to finish, helping the workers with the ones that haven't started */
+  void WaitAll()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mQueue.empty())
+    {
+      QueuedTask queued = std::move(mQueue.front());
+      mQueue.pop_front();
+      lock.unlock();
+      queued.mTask();
+      lock.lock();
+      mPending.erase(queued.mKey);
+      mTaskDone.notify_all();
+    }
+
+    mTaskDone.wait(lock, [this]() { return mPending.empty(); });
+  }
+
+  /** Drop the tasks that haven't started, and wait for the running ones to finish */
+  void Cancel()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (auto& queued : mQueue)
+      mPending.erase(queued.mKey);
+
+    mQueue.clear();
+    mTaskDone.wait(lock, [this]() { return mPending.empty(); });
+  }
+
+private:
+  struct QueuedTask
+  {
+    std::string mKey;
+    Task mTask;
+  };
+
+  void WorkerLoop()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+      mWakeWorkers.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+
+      if (mStop)
+        return;
+
+      QueuedTask queued = std::move(mQueue.front());
+      mQueue.pop_front();
+      lock.unlock();
+      queued.mTask();
+      lock.lock();
+      mPending.erase(queued.mKey);
+      mTaskDone.notify_all();
+    }
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mWakeWorkers;
+  std::condition_variable mTaskDone;
+  std::deque<QueuedTask> mQueue;
+  std::unordered_set<std::string> mPending; // keys of the queued and running tasks
+  std::vector<std::thread> mThreads;
+  bool mStop = false;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
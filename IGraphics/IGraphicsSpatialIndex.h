@@ -0,0 +1,180 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IControlSpatialIndex
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "IGraphicsStructs.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** A uniform grid over the UI bounds, used by IGraphics to find the controls under a point or within a region without scanning every control.
+ * Each cell holds the indexes (in IGraphics' control list, ascending) of the controls whose bounds touch it. Bounds outside the grid are clamped to the edge cells. */
+class IControlSpatialIndex
+{
+public:
+  /** Below this number of controls a linear scan is cheaper than maintaining the grid */
+  static constexpr int kMinControls = 64;
+  /** The grid is kCellsPerSide x kCellsPerSide cells at most, and cells are no smaller than kMinCellSize */
+  static constexpr int kCellsPerSide = 32;
+  static constexpr float kMinCellSize = 16.f;
+
+  /** Clear the index and lay the grid out over new bounds
+   * @param bounds The UI bounds
+   * @param nControls The number of controls that will be inserted */
+  void Reset(const IRECT& bounds, int nControls)
+  {
+    mBounds = bounds;
+    mCols = std::max(1, std::min(kCellsPerSide, static_cast<int>(bounds.W() / kMinCellSize)));
+    mRows = std::max(1, std::min(kCellsPerSide, static_cast<int>(bounds.H() / kMinCellSize)));
+    mCellW = bounds.W() / mCols;
+    mCellH = bounds.H() / mRows;
+
+    mCells.resize(mCols * mRows);
+
+    for (auto& cell : mCells)
+      cell.clear();
+
+    mRects.assign(nControls, IRECT());
+    mValid = true;
+  }
+
+  /** Mark the index as needing a rebuild, e.g. after controls were inserted or removed, which changes their indexes */
+  void Invalidate() { mValid = false; }
+
+  /** @return \c true if the index is up to date */
+  bool IsValid() const { return mValid; }
+
+  /** @return The number of controls in the index */
+  int NControls() const { return static_cast<int>(mRects.size()); }
+
+  /** Add a control to the index. Controls must be added in ascending index order
+   * @param idx The index of the control
+   * @param bounds The bounds the control can draw and be hit in */
+  void Add(int idx, const IRECT& bounds)
+  {
+    if (idx >= NControls())
+      mRects.resize(idx + 1);
+
+    mRects[idx] = bounds;
+    ForCells(bounds, [idx](std::vector<int>& cell) { cell.push_back(idx); });
+  }
+
+  /** Move a control that is already in the index
+   * @param idx The index of the control
+   * @param bounds The new bounds of the control */
+  void Update(int idx, const IRECT& bounds)
+  {
+    if (mRects[idx] == bounds)
+      return;
+
+    ForCells(mRects[idx], [idx](std::vector<int>& cell) {
+      cell.erase(std::lower_bound(cell.begin(), cell.end(), idx));
+    });
+
+    mRects[idx] = bounds;
+
+    ForCells(bounds, [idx](std::vector<int>& cell) {
+      cell.insert(std::lower_bound(cell.begin(), cell.end(), idx), idx);
+    });
+  }
+
+  /** Get the controls that might contain a point
+   * @param x The x coordinate
+   * @param y The y coordinate
+   * @return The indexes of the candidate controls in ascending order, or nullptr if the point is outside the grid and every control needs to be checked */
+  const std::vector<int>* GetCandidatesAt(float x, float y) const
+  {
+    if (!mBounds.Contains(x, y))
+      return nullptr;
+
+    const int col = std::min(mCols - 1, static_cast<int>((x - mBounds.L) / mCellW));
+    const int row = std::min(mRows - 1, static_cast<int>((y - mBounds.T) / mCellH));
+
+    return &mCells[row * mCols + col];
+  }
+
+  /** Get the controls that might intersect a region
+   * @param bounds The region
+   * @param result Filled with the indexes of the candidate controls in ascending order, without duplicates */
+  void GetCandidatesIn(const IRECT& bounds, std::vector<int>& result) const
+  {
+    result.clear();
+
+    ForCells(bounds, [&result](const std::vector<int>& cell) {
+      result.insert(result.end(), cell.begin(), cell.end());
+    });
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+  }
+
+private:
+  template <typename F>
+  void ForCells(const IRECT& bounds, F&& func)
+  {
+    int c0, c1, r0, r1;
+
+    if (CellRange(bounds, c0, c1, r0, r1))
+    {
+      for (auto r = r0; r <= r1; r++)
+        for (auto c = c0; c <= c1; c++)
+          func(mCells[r * mCols + c]);
+    }
+  }
+
+  template <typename F>
+  void ForCells(const IRECT& bounds, F&& func) const
+  {
+    int c0, c1, r0, r1;
+
+    if (CellRange(bounds, c0, c1, r0, r1))
+    {
+      for (auto r = r0; r <= r1; r++)
+        for (auto c = c0; c <= c1; c++)
+          func(mCells[r * mCols + c]);
+    }
+  }
+
+  bool CellRange(const IRECT& bounds, int& c0, int& c1, int& r0, int& r1) const
+  {
+    if (bounds.Empty() || mCells.empty())
+      return false;
+
+    auto clampCol = [this](float x) { return std::max(0, std::min(mCols - 1, static_cast<int>((x - mBounds.L) / mCellW))); };
+    auto clampRow = [this](float y) { return std::max(0, std::min(mRows - 1, static_cast<int>((y - mBounds.T) / mCellH))); };
+
+    c0 = clampCol(bounds.L);
+    c1 = clampCol(bounds.R);
+    r0 = clampRow(bounds.T);
+    r1 = clampRow(bounds.B);
+    return true;
+  }
+
+  IRECT mBounds;
+  int mCols = 0;
+  int mRows = 0;
+  float mCellW = 1.f;
+  float mCellH = 1.f;
+  std::vector<std::vector<int>> mCells;
+  std::vector<IRECT> mRects; // the bounds each control was indexed with
+  bool mValid = false;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
@@ -16,9 +16,12 @@
  * @{
  */
 
+#include <atomic>
 #include <functional>
 #include <chrono>
 #include <numeric>
+#include <limits>
+#include <memory>
 
 #include "IPlugUtilities.h"
 #include "IPlugLogger.h"
@@ -466,7 +469,7 @@ struct IColor
     };
 
     IColor col;
-    h = std::fmodf(h, 1.0f);
+    h = std::fmod(h, 1.0f);
     if (h < 0.0f) h += 1.0f;
     s = Clip(s, 0.0f, 1.0f);
     l = Clip(l, 0.0f, 1.0f);
@@ -1942,6 +1945,83 @@ public:
       }
     }
   }
+
+  /** Greedily merge pairs of rects into their union while doing so is cheaper than drawing them separately, then keep merging until there are no more than maxRects.
+   * The cost of a rect is its area plus rectOverhead, which accounts for the fixed cost of each separate region (visiting the controls, setting the clip, etc.)
+   * so nearby rects are merged, but rects at opposite corners of the UI are not merged into one covering everything in between.
+   * The pairwise search is cubic in the number of rects, so a list of more than 4 * maxRects is first reduced by a union of the rects in each cell of a grid over its bounds.
+   * Calling it again on a list it has merged is cheap, the list is no longer than maxRects
+   * @param rectOverhead The fixed cost of a region, as an area in the same units as the rects
+   * @param maxRects The maximum number of rects to leave in the list */
+  void MergeByCost(float rectOverhead, int maxRects)
+  {
+    maxRects = std::max(maxRects, 1);
+
+    if (Size() > 4 * maxRects)
+      MergeInGrid(static_cast<int>(std::ceil(std::sqrt(4.f * maxRects))));
+
+    while (Size() > 1)
+    {
+      int bestI = -1, bestJ = -1;
+      float bestCost = std::numeric_limits<float>::max();
+
+      for (int i = 0; i < Size(); i++)
+      {
+        const IRECT& ri = Get(i);
+
+        for (int j = i + 1; j < Size(); j++)
+        {
+          const IRECT& rj = Get(j);
+          const IRECT overlap = ri.Intersect(rj);
+          // area that would be drawn in addition to the two rects, minus what is saved by not drawing the overlap twice and the saved overhead
+          const float cost = ri.Union(rj).Area() - ri.Area() - rj.Area() + overlap.Area() - rectOverhead;
+
+          if (cost < bestCost)
+          {
+            bestCost = cost;
+            bestI = i;
+            bestJ = j;
+          }
+        }
+      }
+
+      if (bestCost > 0.f && Size() <= maxRects)
+        break;
+
+      Set(bestI, Get(bestI).Union(Get(bestJ)));
+      mRects.Delete(bestJ);
+    }
+  }
+
+  /** Replace the rects with the union of the rects whose centres are in each cell of a grid over their bounds, in a single pass
+   * @param gridSize The number of rows and columns of the grid */
+  void MergeInGrid(int gridSize)
+  {
+    const IRECT bounds = Bounds();
+    const float cellW = std::max(bounds.W() / gridSize, 1.f);
+    const float cellH = std::max(bounds.H() / gridSize, 1.f);
+
+    WDL_TypedBuf<IRECT> cells;
+    cells.Resize(gridSize * gridSize);
+    std::fill_n(cells.Get(), gridSize * gridSize, IRECT());
+
+    for (int i = 0; i < Size(); i++)
+    {
+      const IRECT& r = Get(i);
+      const int col = Clip(static_cast<int>((r.MW() - bounds.L) / cellW), 0, gridSize - 1);
+      const int row = Clip(static_cast<int>((r.MH() - bounds.T) / cellH), 0, gridSize - 1);
+      IRECT& cell = cells.Get()[row * gridSize + col];
+      cell = cell.Union(r);
+    }
+
+    Clear();
+
+    for (int i = 0; i < cells.GetSize(); i++)
+    {
+      if (!cells.Get()[i].Empty())
+        Add(cells.Get()[i]);
+    }
+  }
   
 private:
   /** \todo 
@@ -2343,6 +2423,12 @@ public:
   , mInvalid(false)
   {}
 
+  ~ILayer()
+  {
+    if (mByteCounter)
+      *mByteCounter -= mBytes;
+  }
+
   ILayer(const ILayer&) = delete;
   ILayer operator=(const ILayer&) = delete;
   
@@ -2364,6 +2450,8 @@ private:
   IRECT mControlRECT;
   IRECT mRECT;
   bool mInvalid;
+  std::shared_ptr<std::atomic<size_t>> mByteCounter; // the IGraphics' count of layer bytes, see IGraphics::GetMemoryReport()
+  size_t mBytes = 0;
 };
 
 /** ILayerPtr is a managed pointer for transferring the ownership of layers */
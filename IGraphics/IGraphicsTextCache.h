@@ -0,0 +1,108 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ITextLayoutCache
+ */
+
+#include <cstring>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "IPlugPlatform.h"
+#include "IGraphicsStructs.h"
+
+BEGIN_IPLUG_NAMESPACE
+BEGIN_IGRAPHICS_NAMESPACE
+
+/** A least recently used cache of the backend's text measurements (and shaped glyph runs where the backend has them), keyed by the font, size and string.
+ * DrawText() and MeasureText() share it, so a label that doesn't change isn't measured again every frame. The alignment and bounds only position the cached
+ * run, so they aren't part of the key. Not thread safe, like the rest of the drawing API
+ * @tparam T The backend's cached layout
+ * @tparam MAXENTRIES The number of strings to keep before the least recently used ones are evicted */
+template <typename T, int MAXENTRIES = 1024>
+class ITextLayoutCache
+{
+public:
+  ITextLayoutCache()
+  {
+    mIndex.reserve(MAXENTRIES + 1);
+  }
+
+  ITextLayoutCache(const ITextLayoutCache&) = delete;
+  ITextLayoutCache& operator=(const ITextLayoutCache&) = delete;
+
+  /** Find a layout, and mark it as the most recently used
+   * @return The layout, or \c nullptr if it isn't cached */
+  T* Find(const IText& text, const char* str)
+  {
+    MakeKey(text, str);
+    auto it = mIndex.find(std::string_view(mKey));
+
+    if (it == mIndex.end())
+      return nullptr;
+
+    mEntries.splice(mEntries.begin(), mEntries, it->second);
+    return &it->second->second;
+  }
+
+  /** Add a layout that Find() didn't return, evicting the least recently used one if the cache is full
+   * @return The cached layout */
+  T& Add(const IText& text, const char* str, T&& layout)
+  {
+    MakeKey(text, str);
+    mEntries.emplace_front(mKey, std::move(layout));
+    mIndex[std::string_view(mEntries.front().first)] = mEntries.begin();
+
+    if (static_cast<int>(mEntries.size()) > MAXENTRIES)
+    {
+      mIndex.erase(std::string_view(mEntries.back().first));
+      mEntries.pop_back();
+    }
+
+    return mEntries.front().second;
+  }
+
+  /** Remove all the layouts, e.g. when the backend's fonts change */
+  void Clear()
+  {
+    mIndex.clear();
+    mEntries.clear();
+  }
+
+  /** @return The number of cached layouts */
+  int Size() const { return static_cast<int>(mEntries.size()); }
+
+private:
+  // the key buffer is reused, so a lookup doesn't allocate once it has grown to the longest string
+  void MakeKey(const IText& text, const char* str)
+  {
+    mKey.assign(text.mFont);
+    mKey.push_back('\0');
+    mKey.append(reinterpret_cast<const char*>(&text.mSize), sizeof(text.mSize));
+    mKey.append(str);
+  }
+
+  using Entry = std::pair<std::string, T>;
+
+  // the index's keys view the strings in the list nodes, which don't move
+  std::list<Entry> mEntries;
+  std::unordered_map<std::string_view, typename std::list<Entry>::iterator> mIndex;
+  std::string mKey;
+};
+
+END_IGRAPHICS_NAMESPACE
+END_IPLUG_NAMESPACE
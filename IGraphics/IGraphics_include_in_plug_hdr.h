@@ -34,7 +34,7 @@
     #include <GLES3/gl3.h>
   #endif
 #elif defined IGRAPHICS_GL2 || defined IGRAPHICS_GL3
-  #if defined OS_WIN
+  #if defined OS_WIN || defined OS_LINUX
     #include <glad/glad.h>
   #elif defined OS_MAC
     #if defined IGRAPHICS_GL2
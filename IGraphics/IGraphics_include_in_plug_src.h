@@ -29,8 +29,8 @@
 
   void StartMainLoopTimer()
   {
-    iplug::igraphics::IGraphicsWeb* pGraphics = gGraphics;
-    emscripten_set_main_loop(pGraphics->OnMainLoopTimer, 0 /*pGraphics->FPS()*/, 1);
+    // IGraphicsWeb requests animation frames itself, only when there is something to draw. This just keeps the runtime alive once main() returns
+    emscripten_exit_with_live_runtime();
   }
 
   #elif defined OS_WIN
@@ -70,6 +70,11 @@
     gGraphics = new IGraphicsWeb(dlg, w, h, fps, scale);
     return gGraphics;
   }
+  #elif defined OS_LINUX
+  IGraphics* MakeGraphics(IGEditorDelegate& dlg, int w, int h, int fps = 0, float scale = 1.)
+  {
+    return new IGraphicsLinux(dlg, w, h, fps, scale);
+  }
   #else
     #error "No OS defined!"
   #endif
@@ -31,7 +31,7 @@
     #endif
   #elif defined IGRAPHICS_GL2 || defined IGRAPHICS_GL3
     #define IGRAPHICS_GL
-    #if defined OS_WIN
+    #if defined OS_WIN || defined OS_LINUX
       #include <glad/glad.h>
     #elif defined OS_MAC
       #if defined IGRAPHICS_GL2
@@ -10,31 +10,68 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+
 #include <CoreText/CoreText.h>
 #include "IGraphicsStructs.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
-class CoreTextFont : public PlatformFont
+/** The Core Text objects for a font file, an installed font or a block of font data, and the font's data once something has asked for it.
+ * CoreTextHelpers keeps one for each font it loads, for the lifetime of the process, and shares it between every CoreTextFont loaded from the same source,
+ * so a font isn't located, parsed and copied again each time an editor is opened, or by each instance of a plug-in */
+class CoreTextFontFace
 {
 public:
-  CoreTextFont(CTFontDescriptorRef descriptor, CGDataProviderRef provider, const char * styleString, bool system)
-  : PlatformFont(system)
-  , mDescriptor(descriptor)
+  /** @param descriptor The face's descriptor, which it takes ownership of
+   * @param provider The provider of the face's data, which it takes ownership of
+   * @param styleString The style to find in a collection, or an empty string for the first face */
+  CoreTextFontFace(CTFontDescriptorRef descriptor, CGDataProviderRef provider, const char* styleString)
+  : mDescriptor(descriptor)
   , mProvider(provider)
   , mStyleString(styleString)
   {}
   
-  ~CoreTextFont();
+  ~CoreTextFontFace();
   
-  FontDescriptor GetDescriptor() override { return mDescriptor; }
-  IFontDataPtr GetFontData() override;
+  CoreTextFontFace(const CoreTextFontFace&) = delete;
+  CoreTextFontFace& operator=(const CoreTextFontFace&) = delete;
+  
+  CTFontDescriptorRef GetDescriptor() const { return mDescriptor; }
   
 private:
+  friend class CoreTextFont;
+  
+  std::mutex mMutex;
   CTFontDescriptorRef mDescriptor;
   CGDataProviderRef mProvider;
   WDL_String mStyleString;
+  IFontDataPtr mData; // read by the first CoreTextFont to need it, then never modified
+};
+
+using CoreTextFontFacePtr = std::shared_ptr<CoreTextFontFace>;
+
+class CoreTextFont : public PlatformFont
+{
+public:
+  CoreTextFont(CoreTextFontFacePtr face, bool system)
+  : PlatformFont(system)
+  , mFace(std::move(face))
+  {}
+  
+  FontDescriptor GetDescriptor() override { return mFace->GetDescriptor(); }
+  IFontDataPtr GetFontData() override;
+  
+  /** @return The font's height to EM ratio, or 1 if its data can't be read */
+  double GetEMRatio();
+  
+private:
+  /** @return The face's data, which is read from the provider and searched for the style only the first time any font sharing the face asks for it */
+  IFontData* GetFaceData();
+  
+  CoreTextFontFacePtr mFace;
 };
 
 template <class T>
@@ -8,87 +8,158 @@
  ==============================================================================
 */
 
+#include <map>
+#include <string>
+#include <string_view>
+
 #include "IGraphicsCoreText.h"
 #include "IPlugPaths.h"
 
 using namespace iplug;
 using namespace igraphics;
 
-IFontDataPtr CoreTextFont::GetFontData()
+CoreTextFontFace::~CoreTextFontFace()
 {
-  CFLocal<CFDataRef> rawData(CGDataProviderCopyData(mProvider));
-  const UInt8* bytes = CFDataGetBytePtr(rawData.Get());
-  int faceIdx = 0;
+  CGDataProviderRelease(mProvider);
+  if (mDescriptor)
+    CFRelease(mDescriptor);
+}
+
+IFontData* CoreTextFont::GetFaceData()
+{
+  std::lock_guard<std::mutex> lock(mFace->mMutex);
+  
+  if (!mFace->mData)
+  {
+    CFLocal<CFDataRef> rawData(CGDataProviderCopyData(mFace->mProvider));
+    
+    if (!rawData.Get())
+      return nullptr;
     
-  if (mStyleString.GetLength())
-      faceIdx = GetFaceIdx(bytes, static_cast<int>(CFDataGetLength(rawData.Get())), mStyleString.Get());
+    const UInt8* bytes = CFDataGetBytePtr(rawData.Get());
+    const int size = static_cast<int>(CFDataGetLength(rawData.Get()));
+    int faceIdx = 0;
     
-  IFontDataPtr fontData(new IFontData(bytes, static_cast<int>(CFDataGetLength(rawData.Get())), faceIdx));
+    if (mFace->mStyleString.GetLength())
+      faceIdx = GetFaceIdx(bytes, size, mFace->mStyleString.Get());
+    
+    mFace->mData.reset(new IFontData(bytes, size, faceIdx));
+  }
   
-  return fontData;
+  return mFace->mData.get();
 }
 
-CoreTextFont::~CoreTextFont()
+IFontDataPtr CoreTextFont::GetFontData()
 {
-  CGDataProviderRelease(mProvider);
-  if (mDescriptor)
-    CFRelease(mDescriptor);
-};
+  IFontData* pData = GetFaceData();
+  
+  if (!pData)
+    return IFontDataPtr(new IFontData());
+  
+  return IFontDataPtr(new IFontData(pData->Get(), pData->GetSize(), pData->GetFaceIdx()));
+}
 
-PlatformFontPtr CoreTextHelpers::LoadPlatformFont(const char* fontID, const char* fileNameOrResID, const char* bundleID, const char* sharedResourceSubPath)
+double CoreTextFont::GetEMRatio()
 {
-  WDL_String fullPath;
-  const EResourceLocation fontLocation = LocateResource(fileNameOrResID, "ttf", fullPath, bundleID, nullptr, sharedResourceSubPath);
+  IFontData* pData = GetFaceData();
   
-  if (fontLocation == kNotFound)
-    return nullptr;
+  return pData && pData->IsValid() ? pData->GetHeightEMRatio() : 1.0;
+}
+
+/** Get the face loaded from a source, loading it if this is the first time the process has asked for it. Faces that fail to load are not kept, so they are tried again next time
+ * @param key The source, e.g. the font's path
+ * @param load A function that returns the face for the source, or nullptr if it can't be loaded
+ * @return The face, or nullptr */
+template <typename Loader>
+static CoreTextFontFacePtr GetFontFace(const std::string& key, Loader&& load)
+{
+  static std::mutex sMutex;
+  static std::map<std::string, CoreTextFontFacePtr> sFaces;
+  
+  std::lock_guard<std::mutex> lock(sMutex);
+  
+  auto it = sFaces.find(key);
+  
+  if (it != sFaces.end())
+    return it->second;
+  
+  CoreTextFontFacePtr face = load();
+  
+  if (face)
+    sFaces[key] = face;
   
-  CFLocal<CFStringRef> path(CFStringCreateWithCString(NULL, fullPath.Get(), kCFStringEncodingUTF8));
-  CFLocal<CFURLRef> url(CFURLCreateWithFileSystemPath(NULL, path.Get(), kCFURLPOSIXPathStyle, false));
-  CFLocal<CGDataProviderRef> provider(url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr); // CGDataProviderCreateWithURL will fail in macOS sandbox!
+  return face;
+}
+
+static CoreTextFontFacePtr CreateFontFace(CGDataProviderRef provider)
+{
+  CFLocal<CGDataProviderRef> ownedProvider(provider);
   
-  if (!provider.Get())
+  if (!ownedProvider.Get())
     return nullptr;
   
-  CFLocal<CGFontRef> cgFont(CGFontCreateWithDataProvider(provider.Get()));
+  CFLocal<CGFontRef> cgFont(CGFontCreateWithDataProvider(ownedProvider.Get()));
   CFLocal<CTFontRef> ctFont(CTFontCreateWithGraphicsFont(cgFont.Get(), 0.f, NULL, NULL));
   CFLocal<CTFontDescriptorRef> descriptor(CTFontCopyFontDescriptor(ctFont.Get()));
   
   if (!descriptor.Get())
     return nullptr;
   
-  return PlatformFontPtr(new CoreTextFont(descriptor.Release(), provider.Release(), "", false));
+  return std::make_shared<CoreTextFontFace>(descriptor.Release(), ownedProvider.Release(), "");
+}
+
+PlatformFontPtr CoreTextHelpers::LoadPlatformFont(const char* fontID, const char* fileNameOrResID, const char* bundleID, const char* sharedResourceSubPath)
+{
+  WDL_String fullPath;
+  const EResourceLocation fontLocation = LocateResource(fileNameOrResID, "ttf", fullPath, bundleID, nullptr, sharedResourceSubPath);
+  
+  if (fontLocation == kNotFound)
+    return nullptr;
+  
+  CoreTextFontFacePtr face = GetFontFace(std::string("file:") + fullPath.Get(), [&fullPath]() -> CoreTextFontFacePtr {
+    CFLocal<CFStringRef> path(CFStringCreateWithCString(NULL, fullPath.Get(), kCFStringEncodingUTF8));
+    CFLocal<CFURLRef> url(CFURLCreateWithFileSystemPath(NULL, path.Get(), kCFURLPOSIXPathStyle, false));
+    return CreateFontFace(url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr); // CGDataProviderCreateWithURL will fail in macOS sandbox!
+  });
+  
+  return face ? PlatformFontPtr(new CoreTextFont(face, false)) : nullptr;
 }
 
 PlatformFontPtr CoreTextHelpers::LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style)
 {
-  CFLocal<CFStringRef> fontStr(CFStringCreateWithCString(NULL, fontName, kCFStringEncodingUTF8));
-  CFLocal<CFStringRef> styleStr(CFStringCreateWithCString(NULL, TextStyleString(style), kCFStringEncodingUTF8));
+  const std::string key = std::string("name:") + fontName + "/" + TextStyleString(style);
   
-  CFStringRef keys[] = { kCTFontFamilyNameAttribute, kCTFontStyleNameAttribute };
-  CFTypeRef values[] = { fontStr.Get(), styleStr.Get() };
+  CoreTextFontFacePtr face = GetFontFace(key, [fontName, style]() -> CoreTextFontFacePtr {
+    CFLocal<CFStringRef> fontStr(CFStringCreateWithCString(NULL, fontName, kCFStringEncodingUTF8));
+    CFLocal<CFStringRef> styleStr(CFStringCreateWithCString(NULL, TextStyleString(style), kCFStringEncodingUTF8));
   
-  CFLocal<CFDictionaryRef> dictionary(CFDictionaryCreate(NULL, (const void**)&keys, (const void**)&values, 2, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks));
-  CFLocal<CTFontDescriptorRef> descriptor(CTFontDescriptorCreateWithAttributes(dictionary.Get()));
-  CFLocal<CFSetRef> keysAsSet(CFSetCreate(NULL, (const void**)&keys, 2, &kCFTypeSetCallBacks));
-  CFLocal<CFArrayRef> matched(CTFontDescriptorCreateMatchingFontDescriptors(descriptor.Get(), keysAsSet.Get()));
+    CFStringRef keys[] = { kCTFontFamilyNameAttribute, kCTFontStyleNameAttribute };
+    CFTypeRef values[] = { fontStr.Get(), styleStr.Get() };
   
-  for (int i = 0; i < CFArrayGetCount(matched.Get()); i++)
-  {
-    // Loop until we get a font which provides data
+    CFLocal<CFDictionaryRef> dictionary(CFDictionaryCreate(NULL, (const void**)&keys, (const void**)&values, 2, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks));
+    CFLocal<CTFontDescriptorRef> descriptor(CTFontDescriptorCreateWithAttributes(dictionary.Get()));
+    CFLocal<CFSetRef> keysAsSet(CFSetCreate(NULL, (const void**)&keys, 2, &kCFTypeSetCallBacks));
+    CFLocal<CFArrayRef> matched(CTFontDescriptorCreateMatchingFontDescriptors(descriptor.Get(), keysAsSet.Get()));
+  
+    for (int i = 0; i < CFArrayGetCount(matched.Get()); i++)
+    {
+      // Loop until we get a font which provides data
     
-    CTFontDescriptorRef testDescriptor = (CTFontDescriptorRef) CFArrayGetValueAtIndex(matched.Get(), i);
-    CFLocal<CFURLRef> url((CFURLRef) CTFontDescriptorCopyAttribute(testDescriptor, kCTFontURLAttribute));
-    CFLocal<CGDataProviderRef> provider(url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr);
+      CTFontDescriptorRef testDescriptor = (CTFontDescriptorRef) CFArrayGetValueAtIndex(matched.Get(), i);
+      CFLocal<CFURLRef> url((CFURLRef) CTFontDescriptorCopyAttribute(testDescriptor, kCTFontURLAttribute));
+      CFLocal<CGDataProviderRef> provider(url.Get() ? CGDataProviderCreateWithURL(url.Get()) : nullptr);
     
-    if (provider.Get())
-    {
-      CFRetain(testDescriptor);
-      return PlatformFontPtr(new CoreTextFont(testDescriptor, provider.Release(), TextStyleString(style), true));
+      if (provider.Get())
+      {
+        CFRetain(testDescriptor);
+        return std::make_shared<CoreTextFontFace>(testDescriptor, provider.Release(), TextStyleString(style));
+      }
     }
-  }
-        
-  return nullptr;
+  
+    return nullptr;
+  });
+  
+  return face ? PlatformFontPtr(new CoreTextFont(face, true)) : nullptr;
 }
 
 void releaseFontData(void* info, const void* data, size_t size)
@@ -99,33 +170,29 @@ void releaseFontData(void* info, const void* data, size_t size)
 
 PlatformFontPtr CoreTextHelpers::LoadPlatformFont(const char* fontID, void* pData, int dataSize)
 {
-  uint8_t* dataCopy = new uint8_t[dataSize];
-  memcpy((void*)dataCopy, pData, dataSize);
-
-  CFLocal<CGDataProviderRef> provider(CGDataProviderCreateWithData(nullptr, dataCopy, (size_t)dataSize, &releaseFontData));
-  
-  if (!provider.Get())
-    return nullptr;
+  // keyed by the data itself, a plug-in's embedded fonts are usually at the same address, but a pointer could be reused for different data
+  const size_t hash = std::hash<std::string_view>()(std::string_view(static_cast<const char*>(pData), dataSize));
+  const std::string key = "data:" + std::to_string(dataSize) + ":" + std::to_string(hash);
   
-  CFLocal<CGFontRef> cgFont(CGFontCreateWithDataProvider(provider.Get()));
-  CFLocal<CTFontRef> ctFont(CTFontCreateWithGraphicsFont(cgFont.Get(), 0.f, NULL, NULL));
-  CFLocal<CTFontDescriptorRef> descriptor(CTFontCopyFontDescriptor(ctFont.Get()));
-  
-  if (!descriptor.Get())
-    return nullptr;
+  CoreTextFontFacePtr face = GetFontFace(key, [pData, dataSize]() -> CoreTextFontFacePtr {
+    uint8_t* dataCopy = new uint8_t[dataSize];
+    memcpy((void*)dataCopy, pData, dataSize);
+    
+    return CreateFontFace(CGDataProviderCreateWithData(nullptr, dataCopy, (size_t)dataSize, &releaseFontData));
+  });
   
-  return PlatformFontPtr(new CoreTextFont(descriptor.Release(), provider.Release(), "", false));
+  return face ? PlatformFontPtr(new CoreTextFont(face, false)) : nullptr;
 }
 
 void CoreTextHelpers::CachePlatformFont(const char* fontID, const PlatformFontPtr& font, StaticStorage<CoreTextFontDescriptor>& cache)
 {
   StaticStorage<CoreTextFontDescriptor>::Accessor storage(cache);
   
-  CTFontDescriptorRef descriptor = font->GetDescriptor();
-  IFontDataPtr data = font->GetFontData();
-    
-  if (!storage.Find(fontID))
-    storage.Add(new CoreTextFontDescriptor(descriptor, data->GetHeightEMRatio()), fontID);
+  if (storage.Find(fontID))
+    return;
+  
+  CoreTextFont* pFont = static_cast<CoreTextFont*>(font.get());
+  storage.Add(new CoreTextFontDescriptor(pFont->GetDescriptor(), pFont->GetEMRatio()), fontID);
 }
 
 CoreTextFontDescriptor* CoreTextHelpers::GetCTFontDescriptor(const IText& text, StaticStorage<CoreTextFontDescriptor>& cache)
@@ -79,7 +79,12 @@ protected:
   IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT bounds, bool& isAsync) override;
   void CreatePlatformTextEntry(int paramIdx, const IText& text, const IRECT& bounds, int length, const char* str) override;
 
+  static constexpr int kIdleFPS = 4; // display link rate when nothing is dirty, so that controls made dirty by the delegate are still drawn
+  static constexpr int kIdleTimeoutMS = 500;
+
 private:
+  void RequestFrame() override;
+
   void* mView = nullptr;
   WDL_String mBundleID;
 };
@@ -14,6 +14,7 @@
 
 #include "IGraphicsIOS.h"
 #include "IGraphicsCoreText.h"
+#include "IGraphicsBitmapCache.h"
 
 #import "IGraphicsIOS_view.h"
 
@@ -48,6 +49,38 @@ using namespace igraphics;
 
 StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
 
+/** Purges IDecodedBitmapCache when the system is short of memory, for as long as the plug-in is loaded */
+struct MemoryPressureMonitor
+{
+  MemoryPressureMonitor()
+  {
+    IDecodedBitmapCache::Get(); // so that the cache outlives the monitor
+    mSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+
+    if (mSource)
+    {
+      dispatch_source_set_event_handler_f(mSource, OnMemoryPressure);
+      dispatch_resume(mSource);
+    }
+  }
+
+  ~MemoryPressureMonitor()
+  {
+    if (mSource)
+    {
+      dispatch_source_cancel(mSource);
+      dispatch_release(mSource);
+    }
+  }
+
+  static void OnMemoryPressure(void*)
+  {
+    IDecodedBitmapCache::Get().Purge();
+  }
+
+  dispatch_source_t mSource = nullptr;
+};
+
 #pragma mark -
 
 std::map<std::string, MTLTexturePtr> gTextureMap;
@@ -56,6 +89,7 @@ NSArray<id<MTLTexture>>* gTextures;
 IGraphicsIOS::IGraphicsIOS(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 : IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
 {
+  static MemoryPressureMonitor sMemoryPressureMonitor;
  
 #if defined IGRAPHICS_METAL && !defined IGRAPHICS_SKIA
   if(!gTextureMap.size())
@@ -99,6 +133,7 @@ void* IGraphicsIOS::OpenWindow(void* pParent)
 {
   TRACE
   CloseWindow();
+  SetOccluded(false); // a new view starts out visible
   IGRAPHICS_VIEW* view = [[IGRAPHICS_VIEW alloc] initWithIGraphics: this];
   mView = (void*) view;
   
@@ -137,6 +172,12 @@ bool IGraphicsIOS::WindowIsOpen()
   return mView;
 }
 
+void IGraphicsIOS::RequestFrame()
+{
+  if (mView)
+    [(IGRAPHICS_VIEW*) mView wakeFromIdle];
+}
+
 void IGraphicsIOS::PlatformResize(bool parentHasResized)
 {
   if (mView)
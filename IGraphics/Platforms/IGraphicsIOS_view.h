@@ -75,6 +75,8 @@ UIColorPickerViewControllerDelegate
   IColorPickerHandlerFunc mColorPickerHandlerFunc;
   IFileDialogCompletionHandlerFunc mFileDialogFunc;
   float mPrevX, mPrevY;
+  CFTimeInterval mLastActiveTime;
+  BOOL mIdlePacing;
 }
 - (id) initWithIGraphics: (IGraphicsIOS*) pGraphics;
 - (BOOL) isOpaque;
@@ -108,6 +110,16 @@ UIColorPickerViewControllerDelegate
 
 - (void) getLastTouchLocation: (float&) x : (float&) y;
 
+//frame pacing
+- (void) updateFramePacing: (BOOL) active;
+- (void) wakeFromIdle;
+- (void) setDisplayLinkRate: (int) fps;
+
+//occlusion
+- (void) setOccluded: (BOOL) occluded;
+- (void) sceneDidEnterBackgroundNotification: (NSNotification*) notification;
+- (void) sceneWillEnterForegroundNotification: (NSNotification*) notification;
+
 - (void) traitCollectionDidChange: (UITraitCollection*) previousTraitCollection;
 
 @property (readonly) CAMetalLayer* metalLayer;
@@ -216,6 +216,12 @@ extern StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
   
   [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackgroundNotification:) name:UIApplicationDidEnterBackgroundNotification object:nil];
   [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationWillEnterForegroundNotification:) name:UIApplicationWillEnterForegroundNotification object:nil];
+
+  if (@available(iOS 13.0, *))
+  {
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(sceneDidEnterBackgroundNotification:) name:UISceneDidEnterBackgroundNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(sceneWillEnterForegroundNotification:) name:UISceneWillEnterForegroundNotification object:nil];
+  }
   mColorPickerHandlerFunc = nullptr;
   
   return self;
@@ -252,6 +258,8 @@ extern StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
 {
   if(mGraphics == nullptr) //TODO: why?
     return;
+
+  [self wakeFromIdle];
   
   NSEnumerator* pEnumerator = [[event allTouches] objectEnumerator];
   UITouch* pTouch;
@@ -331,7 +339,10 @@ extern StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
   {
     self.displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(redraw:)];
     [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
-    self.displayLink.preferredFramesPerSecond = mGraphics->FPS();
+    mIdlePacing = NO;
+    mLastActiveTime = CACurrentMediaTime();
+    [self setDisplayLinkRate:mGraphics->FPS()];
+    [self.displayLink setPaused:mGraphics->IsOccluded()];
   }
   else
   {
@@ -348,11 +359,59 @@ extern StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
   {
     mGraphics->SetPlatformContext(UIGraphicsGetCurrentContext());
     
-    if (mGraphics->IsDirty(rects))
+    const bool dirty = mGraphics->IsDirty(rects);
+
+    if (dirty)
     {
       mGraphics->SetAllControlsClean();
       mGraphics->Draw(rects);
     }
+
+    [self updateFramePacing:dirty];
+  }
+}
+
+- (void) updateFramePacing: (BOOL) active
+{
+  const CFTimeInterval now = CACurrentMediaTime();
+
+  if (active)
+  {
+    mLastActiveTime = now;
+
+    if (mIdlePacing)
+      [self wakeFromIdle];
+  }
+  else if (!mIdlePacing && now - mLastActiveTime > IGraphicsIOS::kIdleTimeoutMS / 1000.0)
+  {
+    // nothing has been drawn for a while, so don't wake the app on every vsync. RequestFrame() and touches wake it up again
+    mIdlePacing = YES;
+    [self setDisplayLinkRate:IGraphicsIOS::kIdleFPS];
+  }
+}
+
+- (void) wakeFromIdle
+{
+  mLastActiveTime = CACurrentMediaTime();
+
+  if (mIdlePacing && self.displayLink)
+  {
+    mIdlePacing = NO;
+    [self setDisplayLinkRate:mGraphics->FPS()];
+  }
+}
+
+- (void) setDisplayLinkRate: (int) fps
+{
+  if (@available(iOS 15.0, *))
+  {
+    // a ProMotion display can drop its refresh rate to match, rather than only skipping callbacks
+    const float rate = static_cast<float>(fps);
+    self.displayLink.preferredFrameRateRange = CAFrameRateRangeMake(rate, rate, rate);
+  }
+  else
+  {
+    self.displayLink.preferredFramesPerSecond = fps;
   }
 }
 
@@ -816,12 +875,40 @@ extern StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
 
 - (void) applicationDidEnterBackgroundNotification:(NSNotification*) notification
 {
-  [self.displayLink setPaused:YES];
+  [self setOccluded:YES];
 }
 
 - (void) applicationWillEnterForegroundNotification:(NSNotification*) notification
 {
-  [self.displayLink setPaused:NO];
+  [self setOccluded:NO];
+}
+
+- (void) sceneDidEnterBackgroundNotification:(NSNotification*) notification
+{
+  // with several scenes, only the one showing this view matters
+  if (@available(iOS 13.0, *))
+  {
+    if (notification.object == self.window.windowScene)
+      [self setOccluded:YES];
+  }
+}
+
+- (void) sceneWillEnterForegroundNotification:(NSNotification*) notification
+{
+  if (@available(iOS 13.0, *))
+  {
+    if (notification.object == self.window.windowScene)
+      [self setOccluded:NO];
+  }
+}
+
+- (void) setOccluded: (BOOL) occluded
+{
+  if (!mGraphics || static_cast<bool>(occluded) == mGraphics->IsOccluded())
+    return;
+
+  mGraphics->SetOccluded(occluded);
+  [self.displayLink setPaused:occluded];
 }
 
 - (BOOL) delaysContentTouches
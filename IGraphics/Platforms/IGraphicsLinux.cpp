@@ -8,4 +8,1476 @@
  ==============================================================================
 */
 
-/\todo
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <fontconfig/fontconfig.h>
+
+#include "IGraphicsLinux.h"
+#include "IPlugParameter.h"
+#include "IPlugPaths.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/cursorfont.h>
+#include <GL/glx.h>
+
+#include "wdlutf8.h"
+
+#ifndef IGRAPHICS_GL
+  #error IGraphicsLinux needs IGRAPHICS_GL2 or IGRAPHICS_GL3
+#endif
+
+extern char** environ;
+
+using namespace iplug;
+using namespace igraphics;
+
+#ifndef GLX_CONTEXT_MAJOR_VERSION_ARB
+#define GLX_CONTEXT_MAJOR_VERSION_ARB     0x2091
+#define GLX_CONTEXT_MINOR_VERSION_ARB     0x2092
+#define GLX_CONTEXT_PROFILE_MASK_ARB      0x9126
+#define GLX_CONTEXT_CORE_PROFILE_BIT_ARB  0x00000001
+#endif
+
+typedef GLXContext (*GLXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
+typedef void (*GLXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int (*GLXSwapIntervalMESAProc)(unsigned int);
+typedef Bool (*GLXGetMscRateOMLProc)(Display*, GLXDrawable, int32_t*, int32_t*);
+
+#pragma mark - Private Classes and Structs
+
+class IGraphicsLinux::Font : public PlatformFont
+{
+public:
+  Font(const char* fontName, const char* fontStyle, bool system)
+  : PlatformFont(system), mDescriptor{fontName, fontStyle}
+  {}
+
+  FontDescriptor GetDescriptor() override { return &mDescriptor; }
+
+private:
+  std::pair<WDL_String, WDL_String> mDescriptor;
+};
+
+class IGraphicsLinux::FileFont : public Font
+{
+public:
+  FileFont(const char* fontName, const char* fontStyle, const char* fontPath, int faceIdx, bool system)
+  : Font(fontName, fontStyle, system), mPath(fontPath), mFaceIdx(faceIdx)
+  {}
+
+  IFontDataPtr GetFontData() override;
+
+private:
+  WDL_String mPath;
+  int mFaceIdx;
+};
+
+IFontDataPtr IGraphicsLinux::FileFont::GetFontData()
+{
+  IFontDataPtr fontData(new IFontData());
+  FILE* fp = fopen(mPath.Get(), "rb");
+
+  if (!fp)
+    return fontData;
+
+  fseek(fp, 0, SEEK_END);
+  fontData = std::make_unique<IFontData>((int) ftell(fp));
+
+  if (fontData->GetSize())
+  {
+    fseek(fp, 0, SEEK_SET);
+    size_t readSize = fread(fontData->Get(), 1, fontData->GetSize(), fp);
+
+    if (readSize && readSize == static_cast<size_t>(fontData->GetSize()))
+      fontData->SetFaceIdx(mFaceIdx);
+  }
+
+  fclose(fp);
+  return fontData;
+}
+
+class IGraphicsLinux::MemoryFont : public Font
+{
+public:
+  MemoryFont(const char* fontName, const void* pData, int dataSize)
+  : Font(fontName, "", false)
+  {
+    mData.Set((const uint8_t*) pData, dataSize);
+  }
+
+  IFontDataPtr GetFontData() override
+  {
+    return IFontDataPtr(new IFontData(mData.Get(), mData.GetSize(), 0));
+  }
+
+private:
+  WDL_TypedBuf<uint8_t> mData;
+};
+
+#pragma mark - Helpers
+
+static int64_t GetTimeMS()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The scale of the UI, from the Xft.dpi resource that desktops set for high DPI displays, where 96 DPI is 1
+static float GetScaleForDisplay(Display* pDisplay)
+{
+  const char* resources = XResourceManagerString(pDisplay);
+  const char* dpi = resources ? strstr(resources, "Xft.dpi:") : nullptr;
+
+  if (dpi)
+  {
+    const float value = static_cast<float>(atof(dpi + strlen("Xft.dpi:")));
+
+    if (value > 0.f)
+      return std::max(std::round(value / 96.f * 4.f) / 4.f, 1.f);
+  }
+
+  return 1.f;
+}
+
+// Append an argument to a shell command, in single quotes so nothing in it is interpreted by the shell
+static void AppendShellArg(WDL_String& cmd, const char* arg)
+{
+  cmd.Append(" '");
+
+  for (const char* c = arg; *c; c++)
+  {
+    if (*c == '\'')
+      cmd.Append("'\\''");
+    else
+      cmd.Append(c, 1);
+  }
+
+  cmd.Append("'");
+}
+
+// Run a dialog command, e.g. zenity, which blocks until it is dismissed
+// @return The exit status, 0 for OK, or -1 if it couldn't be run
+static int RunDialog(const WDL_String& cmd, WDL_String* pOutput = nullptr)
+{
+  FILE* pPipe = popen(cmd.Get(), "r");
+
+  if (!pPipe)
+    return -1;
+
+  char buf[1024];
+  size_t len;
+
+  while ((len = fread(buf, 1, sizeof(buf), pPipe)) > 0)
+  {
+    if (pOutput)
+      pOutput->Append(buf, static_cast<int>(len));
+  }
+
+  const int status = pclose(pPipe);
+
+  if (pOutput && pOutput->GetLength() && pOutput->Get()[pOutput->GetLength() - 1] == '\n')
+    pOutput->SetLen(pOutput->GetLength() - 1);
+
+  return WIFEXITED(status) && WEXITSTATUS(status) != 127 ? WEXITSTATUS(status) : -1;
+}
+
+// Run a program without waiting for it, detached from this process so it isn't left a zombie
+static bool Spawn(const char* program, const char* arg)
+{
+  WDL_String cmd(program);
+  AppendShellArg(cmd, arg);
+  cmd.Append(" >/dev/null 2>&1 &");
+
+  const char* argv[] = { "sh", "-c", cmd.Get(), nullptr };
+  pid_t pid;
+
+  if (posix_spawn(&pid, "/bin/sh", nullptr, nullptr, const_cast<char**>(argv), environ) != 0)
+    return false;
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the events the window selects, to which the input context adds the ones its input method needs
+static constexpr long kWindowEventMask = ExposureMask | StructureNotifyMask | VisibilityChangeMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask
+                                       | EnterWindowMask | LeaveWindowMask | KeyPressMask | KeyReleaseMask | FocusChangeMask;
+
+/** The text of a key without an input method (and of key releases, which input methods don't look up): Latin-1 keysyms are their code points, and 0x01000000 + the code point is the keysym of any other Unicode character
+ * @return The length in bytes, written to str without a terminator */
+static int KeySymToUTF8(KeySym keySym, char* str, int maxLen)
+{
+  int codePoint = 0;
+
+  if ((keySym >= 0x20 && keySym <= 0x7E) || (keySym >= 0xA0 && keySym <= 0xFF))
+    codePoint = static_cast<int>(keySym);
+  else if ((keySym & 0xFF000000) == 0x01000000)
+    codePoint = static_cast<int>(keySym & 0x00FFFFFF);
+  else
+    return 0;
+
+  return std::max(wdl_utf8_makechar(codePoint, str, maxLen), 0);
+}
+
+static int KeySymToVK(KeySym keySym)
+{
+  if (keySym >= XK_a && keySym <= XK_z)
+    return static_cast<int>(keySym - XK_a) + kVK_A;
+
+  if (keySym >= XK_A && keySym <= XK_Z)
+    return static_cast<int>(keySym - XK_A) + kVK_A;
+
+  if (keySym >= XK_0 && keySym <= XK_9)
+    return static_cast<int>(keySym - XK_0) + kVK_0;
+
+  if (keySym >= XK_KP_0 && keySym <= XK_KP_9)
+    return static_cast<int>(keySym - XK_KP_0) + kVK_NUMPAD0;
+
+  if (keySym >= XK_F1 && keySym <= XK_F12)
+    return static_cast<int>(keySym - XK_F1) + kVK_F1;
+
+  switch (keySym)
+  {
+    case XK_BackSpace: return kVK_BACK;
+    case XK_Tab: return kVK_TAB;
+    case XK_Clear: return kVK_CLEAR;
+    case XK_Return: return kVK_RETURN;
+    case XK_KP_Enter: return kVK_RETURN;
+    case XK_Pause: return kVK_PAUSE;
+    case XK_Escape: return kVK_ESCAPE;
+    case XK_space: return kVK_SPACE;
+    case XK_Prior: return kVK_PRIOR;
+    case XK_Next: return kVK_NEXT;
+    case XK_End: return kVK_END;
+    case XK_Home: return kVK_HOME;
+    case XK_Left: return kVK_LEFT;
+    case XK_Up: return kVK_UP;
+    case XK_Right: return kVK_RIGHT;
+    case XK_Down: return kVK_DOWN;
+    case XK_Select: return kVK_SELECT;
+    case XK_Print: return kVK_PRINT;
+    case XK_Insert: return kVK_INSERT;
+    case XK_Delete: return kVK_DELETE;
+    case XK_Help: return kVK_HELP;
+    case XK_KP_Multiply: return kVK_MULTIPLY;
+    case XK_KP_Add: return kVK_ADD;
+    case XK_KP_Separator: return kVK_SEPARATOR;
+    case XK_KP_Subtract: return kVK_SUBTRACT;
+    case XK_KP_Decimal: return kVK_DECIMAL;
+    case XK_KP_Divide: return kVK_DIVIDE;
+    case XK_Num_Lock: return kVK_NUMLOCK;
+    case XK_Scroll_Lock: return kVK_SCROLL;
+    case XK_Shift_L: case XK_Shift_R: return kVK_SHIFT;
+    case XK_Control_L: case XK_Control_R: return kVK_CONTROL;
+    case XK_Alt_L: case XK_Alt_R: return kVK_MENU;
+    default: return kVK_NONE;
+  }
+}
+
+#pragma mark - Frame pacing
+
+int IGraphicsLinux::GetTimerInterval() const
+{
+  const float fps = std::min(static_cast<float>(FPS() > 0 ? FPS() : DEFAULT_FPS), mDisplayRefreshRate);
+  return std::max(static_cast<int>(std::floor(1000.f / fps)), 1);
+}
+
+void IGraphicsLinux::StartDisplayTimer(int intervalMS)
+{
+  if (mTimerID && mTimerInterval == intervalMS)
+    return;
+
+  StopDisplayTimer();
+
+  if (mRunLoop)
+  {
+    mTimerID = mRunLoop->AddTimer(intervalMS, DisplayTimerCallback, this);
+    mTimerInterval = intervalMS;
+  }
+}
+
+void IGraphicsLinux::StopDisplayTimer()
+{
+  if (mTimerID)
+    mRunLoop->RemoveTimer(mTimerID);
+
+  mTimerID = 0;
+  mTimerInterval = 0;
+}
+
+void IGraphicsLinux::UpdateFramePacing(bool active)
+{
+  if (!mAdaptiveFrameRate)
+    return;
+
+  if (active)
+  {
+    WakeFromIdle();
+    return;
+  }
+
+  if (!mIdlePacing && GetTimeMS() - mLastActiveTime > kIdleTimeoutMS)
+  {
+    mIdlePacing = true;
+
+    if (mVisible)
+      StartDisplayTimer(1000 / kIdleFPS);
+  }
+}
+
+void IGraphicsLinux::WakeFromIdle()
+{
+  mLastActiveTime = GetTimeMS();
+
+  if (!mIdlePacing)
+    return;
+
+  mIdlePacing = false;
+
+  if (mVisible)
+    StartDisplayTimer(GetTimerInterval());
+}
+
+void IGraphicsLinux::SetVisible(bool visible)
+{
+  if (mVisible == visible)
+    return;
+
+  mVisible = visible;
+
+  if (visible)
+  {
+    mIdlePacing = false;
+    mLastActiveTime = GetTimeMS();
+    SetOccluded(false);
+    StartDisplayTimer(GetTimerInterval());
+  }
+  else
+  {
+    SetOccluded(true);
+    StopDisplayTimer(); // an unseen window doesn't wake at all, it is redrawn when it is exposed again
+  }
+}
+
+void IGraphicsLinux::OnDisplayTimer()
+{
+  IRECTList rects;
+  const bool dirty = IsDirty(rects);
+
+  UpdateFramePacing(dirty || mMouseCaptured || GetControlInTextEntry());
+
+  if (dirty)
+  {
+    SetAllControlsClean();
+    Paint(rects);
+  }
+}
+
+void IGraphicsLinux::Paint(IRECTList& rects)
+{
+  ActivateGLContext();
+  Draw(rects);
+  glXSwapBuffers(mDisplay, mWindow);
+  DeactivateGLContext();
+}
+
+#pragma mark - Events
+
+IMouseInfo IGraphicsLinux::GetMouseInfo(int x, int y, unsigned int state)
+{
+  IMouseInfo info;
+  const float scale = GetTotalScale();
+  info.x = mCursorX = x / scale;
+  info.y = mCursorY = y / scale;
+  info.ms = IMouseMod((state & Button1Mask), (state & Button3Mask), (state & ShiftMask), (state & ControlMask), (state & Mod1Mask));
+  return info;
+}
+
+void IGraphicsLinux::ProcessEvents()
+{
+  while (mDisplay && XPending(mDisplay))
+  {
+    XEvent event;
+    XNextEvent(mDisplay, &event);
+
+    // keys that are part of an input method's composition go to the input method
+    if (XFilterEvent(&event, None))
+      continue;
+
+    // only the latest of a run of motion events matters, the drags are relative to the last position handled
+    if (event.type == MotionNotify)
+    {
+      XEvent next;
+
+      while (XEventsQueued(mDisplay, QueuedAlready) && (XPeekEvent(mDisplay, &next), next.type == MotionNotify && next.xmotion.window == event.xmotion.window))
+        XNextEvent(mDisplay, &event);
+    }
+
+    HandleEvent(event);
+  }
+
+  // closing the window deletes this, so it is the last thing done
+  if (mCloseRequested)
+  {
+    mCloseRequested = false;
+    GetDelegate()->CloseWindow();
+  }
+}
+
+void IGraphicsLinux::HandleEvent(XEvent& event)
+{
+  if (event.xany.window != mWindow)
+    return;
+
+  switch (event.type)
+  {
+    case ButtonPress:
+    case ButtonRelease:
+    case MotionNotify:
+    case KeyPress:
+    case KeyRelease:
+    case LeaveNotify:
+      WakeFromIdle();
+      break;
+  }
+
+  switch (event.type)
+  {
+    case Expose:
+    {
+      const float scale = GetTotalScale();
+      IRECT r(event.xexpose.x, event.xexpose.y, event.xexpose.x + event.xexpose.width, event.xexpose.y + event.xexpose.height);
+      r.Scale(1.f / scale);
+      r.PixelAlign();
+      mExposedRects.Add(r);
+
+      // the last of a series
+      if (event.xexpose.count == 0)
+      {
+        SetVisible(true);
+        Paint(mExposedRects);
+        mExposedRects.Clear();
+      }
+      break;
+    }
+    case MapNotify:
+      SetVisible(true);
+      break;
+    case UnmapNotify:
+      SetVisible(false);
+      break;
+    case VisibilityNotify:
+      SetVisible(event.xvisibility.state != VisibilityFullyObscured);
+      break;
+    case ButtonPress:
+    {
+      const XButtonEvent& e = event.xbutton;
+
+      if (e.button == Button4 || e.button == Button5)
+      {
+        IMouseInfo info = GetMouseInfo(e.x, e.y, e.state);
+        OnMouseWheel(info.x, info.y, info.ms, e.button == Button4 ? 1.f : -1.f);
+        break;
+      }
+
+      if (e.button != Button1 && e.button != Button3)
+        break;
+
+      // state is the buttons held before this one was pressed
+      IMouseInfo info = GetMouseInfo(e.x, e.y, e.state | (e.button == Button1 ? Button1Mask : Button3Mask));
+
+      // X has no double clicks of its own
+      const bool dblClick = e.button == mLastClickButton && e.time - mLastClickTime < kDoubleClickMS
+                            && std::abs(e.x - mLastClickX) < 4 && std::abs(e.y - mLastClickY) < 4;
+
+      mLastClickButton = dblClick ? 0 : e.button;
+      mLastClickTime = e.time;
+      mLastClickX = e.x;
+      mLastClickY = e.y;
+
+      if (dblClick)
+        mMouseCaptured = OnMouseDblClick(info.x, info.y, info.ms);
+      else
+      {
+        mMouseCaptured = true;
+        std::vector<IMouseInfo> list{ info };
+        OnMouseDown(list);
+      }
+      break;
+    }
+    case ButtonRelease:
+    {
+      const XButtonEvent& e = event.xbutton;
+
+      if (e.button != Button1 && e.button != Button3)
+        break;
+
+      // state is the buttons held before this one was released
+      IMouseInfo info = GetMouseInfo(e.x, e.y, e.state & ~(e.button == Button1 ? Button1Mask : Button3Mask));
+      mMouseCaptured = false;
+      std::vector<IMouseInfo> list{ info };
+      OnMouseUp(list);
+
+      // keys go to the host, until a text entry needs them
+      if (GetControlInTextEntry())
+        XSetInputFocus(mDisplay, mWindow, RevertToParent, CurrentTime);
+      break;
+    }
+    case MotionNotify:
+    {
+      const XMotionEvent& e = event.xmotion;
+
+      if (mMouseCaptured && (e.state & (Button1Mask | Button3Mask)))
+      {
+        const float oldX = mCursorX;
+        const float oldY = mCursorY;
+        IMouseInfo info = GetMouseInfo(e.x, e.y, e.state);
+        info.dX = info.x - oldX;
+        info.dY = info.y - oldY;
+
+        if (info.dX || info.dY)
+        {
+          std::vector<IMouseInfo> list{ info };
+          OnMouseDrag(list);
+
+          if (mCursorLock)
+          {
+            const float x = mHiddenCursorX;
+            const float y = mHiddenCursorY;
+
+            MoveMouseCursor(x, y);
+            mHiddenCursorX = x;
+            mHiddenCursorY = y;
+          }
+        }
+      }
+      else
+      {
+        IMouseInfo info = GetMouseInfo(e.x, e.y, e.state);
+        OnMouseOver(info.x, info.y, info.ms);
+      }
+      break;
+    }
+    case FocusIn:
+      if (mXIC)
+        XSetICFocus(mXIC);
+      break;
+    case FocusOut:
+      if (mXIC)
+        XUnsetICFocus(mXIC);
+      break;
+    case LeaveNotify:
+      if (!mMouseCaptured)
+        OnMouseOut();
+      break;
+    case KeyPress:
+    case KeyRelease:
+    {
+      XKeyEvent& e = event.xkey;
+      char buf[64];
+      WDL_TypedBuf<char> longText;
+      const char* text = buf;
+      KeySym keySym = NoSymbol;
+      int len = 0;
+
+      if (mXIC && event.type == KeyPress)
+      {
+        Status status = 0;
+        len = Xutf8LookupString(mXIC, &e, buf, sizeof(buf), &keySym, &status);
+
+        // e.g. a long string committed by an input method
+        if (status == XBufferOverflow)
+        {
+          longText.Resize(len);
+          len = Xutf8LookupString(mXIC, &e, longText.Get(), longText.GetSize(), &keySym, &status);
+          text = longText.Get();
+        }
+
+        if (status != XLookupChars && status != XLookupBoth)
+          len = 0;
+
+        if (status != XLookupKeySym && status != XLookupBoth)
+          keySym = NoSymbol;
+      }
+      else
+      {
+        XLookupString(&e, nullptr, 0, &keySym, nullptr);
+        len = KeySymToUTF8(keySym, buf, sizeof(buf));
+      }
+
+      const float scale = GetTotalScale();
+      const bool shift = e.state & ShiftMask;
+      const bool ctrl = e.state & ControlMask;
+      const bool alt = e.state & Mod1Mask;
+      bool handled = false;
+      int pos = 0;
+
+      // one key press per character, the first with the key's virtual key code. A key without text, e.g. an arrow, is one with an empty string
+      do
+      {
+        char utf8[5] = {};
+        const int charLen = pos < len ? std::min(wdl_utf8_parsechar(text + pos, nullptr), len - pos) : 0;
+
+        if (charLen <= 4)
+          memcpy(utf8, text + pos, charLen);
+
+        IKeyPress keyPress{ utf8, pos ? 0 : KeySymToVK(keySym), shift, ctrl, alt };
+        handled |= event.type == KeyPress ? OnKeyDown(e.x / scale, e.y / scale, keyPress) : OnKeyUp(e.x / scale, e.y / scale, keyPress);
+        pos += std::max(charLen, 1);
+      }
+      while (pos < len);
+
+      // pass unhandled keys on to the host, e.g. its transport shortcuts
+      if (!handled && mParentWindow && !mTopLevel)
+      {
+        e.window = mParentWindow;
+        XSendEvent(mDisplay, mParentWindow, False, event.type == KeyPress ? KeyPressMask : KeyReleaseMask, &event);
+      }
+      break;
+    }
+    case SelectionRequest:
+    {
+      const XSelectionRequestEvent& req = event.xselectionrequest;
+      XEvent reply = {};
+      reply.xselection.type = SelectionNotify;
+      reply.xselection.display = req.display;
+      reply.xselection.requestor = req.requestor;
+      reply.xselection.selection = req.selection;
+      reply.xselection.target = req.target;
+      reply.xselection.time = req.time;
+      reply.xselection.property = None;
+
+      if (req.target == mTargets)
+      {
+        const Atom targets[] = { mTargets, mUTF8String, XA_STRING };
+        XChangeProperty(mDisplay, req.requestor, req.property, XA_ATOM, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(targets), 3);
+        reply.xselection.property = req.property;
+      }
+      else if (req.target == mUTF8String || req.target == XA_STRING)
+      {
+        XChangeProperty(mDisplay, req.requestor, req.property, req.target, 8, PropModeReplace, reinterpret_cast<const unsigned char*>(mClipboardText.Get()), mClipboardText.GetLength());
+        reply.xselection.property = req.property;
+      }
+
+      XSendEvent(mDisplay, req.requestor, False, 0, &reply);
+      break;
+    }
+    case SelectionClear:
+      mClipboardText.Set("");
+      break;
+    case ClientMessage:
+      if (static_cast<unsigned long>(event.xclient.data.l[0]) == mWMDeleteWindow)
+        mCloseRequested = true;
+      break;
+  }
+}
+
+#pragma mark - Window
+
+IGraphicsLinux::IGraphicsLinux(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
+: IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
+{
+#ifdef IGRAPHICS_DISABLE_VSYNC
+  mVSYNCEnabled = false;
+#endif
+
+#ifdef IGRAPHICS_DISABLE_ADAPTIVE_FPS
+  mAdaptiveFrameRate = false;
+#endif
+}
+
+IGraphicsLinux::~IGraphicsLinux()
+{
+  CloseWindow();
+}
+
+IPollRunLoop& IGraphicsLinux::GetDefaultRunLoop()
+{
+  return IPollRunLoop::GetDefault();
+}
+
+void IGraphicsLinux::CreateInputContext()
+{
+  // the input method is chosen by XMODIFIERS, for the locale the host has set. Without one, keys are looked up without it, see KeySymToUTF8()
+  XSetLocaleModifiers("");
+  mXIM = XOpenIM(mDisplay, nullptr, nullptr, nullptr);
+
+  if (!mXIM)
+    return;
+
+  mXIC = XCreateIC(mXIM, XNInputStyle, XIMPreeditNothing | XIMStatusNothing, XNClientWindow, mWindow, XNFocusWindow, mWindow, nullptr);
+
+  if (!mXIC)
+  {
+    XCloseIM(mXIM);
+    mXIM = nullptr;
+    return;
+  }
+
+  long filterEvents = 0;
+  XGetICValues(mXIC, XNFilterEvents, &filterEvents, nullptr);
+  XSelectInput(mDisplay, mWindow, kWindowEventMask | filterEvents);
+}
+
+void IGraphicsLinux::DestroyInputContext()
+{
+  if (mXIC)
+    XDestroyIC(mXIC);
+
+  if (mXIM)
+    XCloseIM(mXIM);
+
+  mXIC = nullptr;
+  mXIM = nullptr;
+}
+
+bool IGraphicsLinux::CreateGLContext()
+{
+  const int fbAttribs[] = {
+    GLX_X_RENDERABLE, True,
+    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    GLX_RED_SIZE, 8,
+    GLX_GREEN_SIZE, 8,
+    GLX_BLUE_SIZE, 8,
+    GLX_ALPHA_SIZE, 8,
+    GLX_DEPTH_SIZE, 24,
+    GLX_STENCIL_SIZE, 8,
+    GLX_DOUBLEBUFFER, True,
+    None
+  };
+
+  const int screen = DefaultScreen(mDisplay);
+  int nConfigs = 0;
+  GLXFBConfig* pConfigs = glXChooseFBConfig(mDisplay, screen, fbAttribs, &nConfigs);
+
+  if (!pConfigs || !nConfigs)
+  {
+    DBGMSG("No suitable GLX framebuffer config\n");
+    return false;
+  }
+
+  GLXFBConfig config = pConfigs[0];
+  XFree(pConfigs);
+
+  XVisualInfo* pVisual = glXGetVisualFromFBConfig(mDisplay, config);
+
+  if (!pVisual)
+    return false;
+
+  const float scale = GetScreenScale();
+  mColormap = XCreateColormap(mDisplay, mParentWindow, pVisual->visual, AllocNone);
+
+  XSetWindowAttributes attributes = {};
+  attributes.colormap = mColormap;
+  attributes.border_pixel = 0;
+  attributes.event_mask = kWindowEventMask;
+
+  mWindow = XCreateWindow(mDisplay, mParentWindow, 0, 0, static_cast<unsigned int>(WindowWidth() * scale), static_cast<unsigned int>(WindowHeight() * scale), 0,
+                          pVisual->depth, InputOutput, pVisual->visual, CWColormap | CWBorderPixel | CWEventMask, &attributes);
+  XFree(pVisual);
+
+#ifdef IGRAPHICS_GL3
+  auto glXCreateContextAttribsARB = (GLXCreateContextAttribsARBProc) glXGetProcAddressARB((const GLubyte*) "glXCreateContextAttribsARB");
+
+  if (glXCreateContextAttribsARB)
+  {
+    const int contextAttribs[] = {
+      GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+      GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+      GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+      None
+    };
+
+    mGLContext = glXCreateContextAttribsARB(mDisplay, config, nullptr, True, contextAttribs);
+  }
+#else
+  mGLContext = glXCreateNewContext(mDisplay, config, GLX_RGBA_TYPE, nullptr, True);
+#endif
+
+  if (!mGLContext)
+  {
+    DBGMSG("Could not create a GLX context\n");
+    return false;
+  }
+
+  ActivateGLContext();
+
+  if (!gladLoadGL())
+    DBGMSG("Error initializing glad");
+
+  glGetError();
+
+  // swaps are synced to vblank, the display timer paces the frames at the refresh rate so a swap doesn't wait for long
+  const char* extensions = glXQueryExtensionsString(mDisplay, screen);
+  const int swapInterval = mVSYNCEnabled ? 1 : 0;
+
+  if (extensions && strstr(extensions, "GLX_EXT_swap_control"))
+  {
+    auto glXSwapIntervalEXT = (GLXSwapIntervalEXTProc) glXGetProcAddressARB((const GLubyte*) "glXSwapIntervalEXT");
+    if (glXSwapIntervalEXT)
+      glXSwapIntervalEXT(mDisplay, mWindow, swapInterval);
+  }
+  else if (extensions && strstr(extensions, "GLX_MESA_swap_control"))
+  {
+    auto glXSwapIntervalMESA = (GLXSwapIntervalMESAProc) glXGetProcAddressARB((const GLubyte*) "glXSwapIntervalMESA");
+    if (glXSwapIntervalMESA)
+      glXSwapIntervalMESA(swapInterval);
+  }
+
+  if (extensions && strstr(extensions, "GLX_OML_sync_control"))
+  {
+    auto glXGetMscRateOML = (GLXGetMscRateOMLProc) glXGetProcAddressARB((const GLubyte*) "glXGetMscRateOML");
+    int32_t numerator = 0, denominator = 0;
+
+    if (glXGetMscRateOML && glXGetMscRateOML(mDisplay, mWindow, &numerator, &denominator) && numerator > 0 && denominator > 0)
+      mDisplayRefreshRate = static_cast<float>(numerator) / static_cast<float>(denominator);
+  }
+
+  DeactivateGLContext();
+  return true;
+}
+
+void IGraphicsLinux::DestroyGLContext()
+{
+  if (mGLContext)
+  {
+    glXMakeCurrent(mDisplay, None, nullptr);
+    glXDestroyContext(mDisplay, mGLContext);
+  }
+
+  mGLContext = nullptr;
+}
+
+void IGraphicsLinux::ActivateGLContext()
+{
+  // the host may have a context of its own current on this thread
+  mStartDisplay = glXGetCurrentDisplay();
+  mStartDrawable = glXGetCurrentDrawable();
+  mStartGLContext = glXGetCurrentContext();
+  glXMakeCurrent(mDisplay, mWindow, mGLContext);
+}
+
+void IGraphicsLinux::DeactivateGLContext()
+{
+  if (mStartDisplay && mStartGLContext)
+    glXMakeCurrent(mStartDisplay, mStartDrawable, mStartGLContext);
+  else
+    glXMakeCurrent(mDisplay, None, nullptr);
+}
+
+void* IGraphicsLinux::OpenWindow(void* pParent)
+{
+  if (mWindow)
+    CloseWindow();
+
+  mDisplay = XOpenDisplay(nullptr);
+
+  if (!mDisplay)
+  {
+    DBGMSG("Could not open the X display\n");
+    return nullptr;
+  }
+
+  mTopLevel = !pParent;
+  mParentWindow = pParent ? reinterpret_cast<Window>(pParent) : DefaultRootWindow(mDisplay);
+
+  SetScreenScale(GetScaleForDisplay(mDisplay));
+
+  if (!CreateGLContext())
+  {
+    CloseWindow();
+    return nullptr;
+  }
+
+  CreateInputContext();
+
+  mWMDeleteWindow = XInternAtom(mDisplay, "WM_DELETE_WINDOW", False);
+  mClipboard = XInternAtom(mDisplay, "CLIPBOARD", False);
+  mUTF8String = XInternAtom(mDisplay, "UTF8_STRING", False);
+  mTargets = XInternAtom(mDisplay, "TARGETS", False);
+  mSelectionProperty = XInternAtom(mDisplay, "IPLUG_SELECTION", False);
+
+  if (mTopLevel)
+  {
+    Atom protocols[] = { mWMDeleteWindow };
+    XSetWMProtocols(mDisplay, mWindow, protocols, 1);
+    XStoreName(mDisplay, mWindow, "IPlug");
+  }
+
+  ActivateGLContext();
+  OnViewInitialized(nullptr);
+  SetScreenScale(GetScreenScale()); // resizes draw context
+  GetDelegate()->LayoutUI(this);
+  DeactivateGLContext();
+
+  AttachTextEntryControl();
+  AttachPopupMenuControl();
+  SetAllControlsDirty();
+
+  XMapWindow(mDisplay, mWindow);
+  XFlush(mDisplay);
+
+  mRunLoop = GetDelegate()->GetHostRunLoop();
+
+  if (!mRunLoop)
+    mRunLoop = &GetDefaultRunLoop();
+
+  mRunLoop->AddFD(ConnectionNumber(mDisplay), ProcessEventsCallback, this);
+
+  mVisible = true;
+  SetOccluded(false);
+  mIdlePacing = false;
+  mLastActiveTime = GetTimeMS();
+  StartDisplayTimer(GetTimerInterval());
+
+  GetDelegate()->OnUIOpen();
+
+  return reinterpret_cast<void*>(mWindow);
+}
+
+void IGraphicsLinux::CloseWindow()
+{
+  if (mRunLoop)
+  {
+    StopDisplayTimer();
+    mRunLoop->RemoveFD(ConnectionNumber(mDisplay));
+    mRunLoop = nullptr;
+  }
+
+  if (mWindow && mGLContext)
+  {
+    ActivateGLContext();
+    OnViewDestroyed();
+    DeactivateGLContext();
+  }
+
+  if (mDisplay)
+  {
+    DestroyGLContext();
+
+    for (auto& cursor : mCursors)
+    {
+      if (cursor)
+        XFreeCursor(mDisplay, cursor);
+
+      cursor = 0;
+    }
+
+    if (mInvisibleCursor)
+      XFreeCursor(mDisplay, mInvisibleCursor);
+
+    mInvisibleCursor = 0;
+
+    DestroyInputContext();
+
+    if (mWindow)
+      XDestroyWindow(mDisplay, mWindow);
+
+    if (mColormap)
+      XFreeColormap(mDisplay, mColormap);
+
+    XCloseDisplay(mDisplay);
+  }
+
+  mWindow = 0;
+  mColormap = 0;
+  mDisplay = nullptr;
+  mExposedRects.Clear();
+  mMouseCaptured = false;
+}
+
+void IGraphicsLinux::PlatformResize(bool parentHasResized)
+{
+  if (WindowIsOpen())
+  {
+    const float scale = GetScreenScale();
+    XResizeWindow(mDisplay, mWindow, static_cast<unsigned int>(WindowWidth() * scale), static_cast<unsigned int>(WindowHeight() * scale));
+    XFlush(mDisplay);
+  }
+}
+
+void IGraphicsLinux::DrawResize()
+{
+  ActivateGLContext();
+  IGRAPHICS_DRAW_CLASS::DrawResize();
+  DeactivateGLContext();
+}
+
+#pragma mark - Mouse cursor
+
+void IGraphicsLinux::HideMouseCursor(bool hide, bool lock)
+{
+  if (mCursorHidden == hide || !mWindow)
+    return;
+
+  if (hide)
+  {
+    mHiddenCursorX = mCursorX;
+    mHiddenCursorY = mCursorY;
+
+    if (!mInvisibleCursor)
+    {
+      const char data = 0;
+      XColor black = {};
+      Pixmap pixmap = XCreateBitmapFromData(mDisplay, mWindow, &data, 1, 1);
+      mInvisibleCursor = XCreatePixmapCursor(mDisplay, pixmap, pixmap, &black, &black, 0, 0);
+      XFreePixmap(mDisplay, pixmap);
+    }
+
+    XDefineCursor(mDisplay, mWindow, mInvisibleCursor);
+    mCursorHidden = true;
+    mCursorLock = lock && !mTabletInput;
+  }
+  else
+  {
+    if (mCursorLock)
+      MoveMouseCursor(mHiddenCursorX, mHiddenCursorY);
+
+    mCursorHidden = false;
+    mCursorLock = false;
+    SetMouseCursor(mCursor);
+  }
+
+  XFlush(mDisplay);
+}
+
+void IGraphicsLinux::MoveMouseCursor(float x, float y)
+{
+  if (mTabletInput || !mWindow)
+    return;
+
+  const float scale = GetTotalScale();
+  XWarpPointer(mDisplay, None, mWindow, 0, 0, 0, 0, static_cast<int>(std::round(x * scale)), static_cast<int>(std::round(y * scale)));
+  XFlush(mDisplay);
+
+  // the warp's motion event then has no delta
+  mHiddenCursorX = mCursorX = x;
+  mHiddenCursorY = mCursorY = y;
+}
+
+ECursor IGraphicsLinux::SetMouseCursor(ECursor cursorType)
+{
+  static const unsigned int shapes[kNumCursors] = {
+    XC_left_ptr, XC_xterm, XC_watch, XC_crosshair, XC_sb_up_arrow, XC_bottom_right_corner, XC_bottom_left_corner,
+    XC_sb_h_double_arrow, XC_sb_v_double_arrow, XC_fleur, XC_X_cursor, XC_hand2, XC_watch, XC_question_arrow
+  };
+
+  const int idx = static_cast<int>(cursorType);
+  mCursor = cursorType;
+
+  if (mWindow && !mCursorHidden && idx >= 0 && idx < kNumCursors)
+  {
+    if (!mCursors[idx])
+      mCursors[idx] = XCreateFontCursor(mDisplay, shapes[idx]);
+
+    XDefineCursor(mDisplay, mWindow, mCursors[idx]);
+    XFlush(mDisplay);
+  }
+
+  return IGraphics::SetMouseCursor(cursorType);
+}
+
+void IGraphicsLinux::GetMouseLocation(float& x, float&y) const
+{
+  Window root, child;
+  int rootX = 0, rootY = 0, winX = 0, winY = 0;
+  unsigned int mask = 0;
+
+  if (mWindow && XQueryPointer(mDisplay, mWindow, &root, &child, &rootX, &rootY, &winX, &winY, &mask))
+  {
+    const float scale = GetTotalScale();
+    x = winX / scale;
+    y = winY / scale;
+  }
+  else
+  {
+    x = mCursorX;
+    y = mCursorY;
+  }
+}
+
+#pragma mark - Clipboard
+
+bool IGraphicsLinux::GetTextFromClipboard(WDL_String& str)
+{
+  str.Set("");
+
+  if (!mWindow)
+    return false;
+
+  const Window owner = XGetSelectionOwner(mDisplay, mClipboard);
+
+  if (owner == mWindow)
+  {
+    str.Set(mClipboardText.Get());
+    return true;
+  }
+
+  if (owner == None)
+    return false;
+
+  XConvertSelection(mDisplay, mClipboard, mUTF8String, mSelectionProperty, mWindow, CurrentTime);
+  XFlush(mDisplay);
+
+  // the owner replies with a SelectionNotify, other events wait in the queue until the run loop next calls ProcessEvents()
+  const int64_t timeout = GetTimeMS() + 500;
+  XEvent event;
+
+  while (!XCheckTypedWindowEvent(mDisplay, mWindow, SelectionNotify, &event))
+  {
+    const int remaining = static_cast<int>(timeout - GetTimeMS());
+
+    if (remaining <= 0)
+      return false;
+
+    pollfd pfd = { ConnectionNumber(mDisplay), POLLIN, 0 };
+    poll(&pfd, 1, remaining);
+  }
+
+  if (event.xselection.property == None)
+    return false;
+
+  Atom type;
+  int format;
+  unsigned long nItems, bytesAfter;
+  unsigned char* pData = nullptr;
+
+  if (XGetWindowProperty(mDisplay, mWindow, mSelectionProperty, 0, 1 << 20, True, AnyPropertyType, &type, &format, &nItems, &bytesAfter, &pData) == Success && pData)
+  {
+    if (format == 8)
+      str.Set(reinterpret_cast<const char*>(pData), static_cast<int>(nItems));
+
+    XFree(pData);
+  }
+
+  return str.GetLength() > 0;
+}
+
+bool IGraphicsLinux::SetTextInClipboard(const char* str)
+{
+  if (!mWindow)
+    return false;
+
+  // X clipboards are owned rather than copied to, the text is served on request from HandleEvent() until another client takes the selection
+  mClipboardText.Set(str);
+  XSetSelectionOwner(mDisplay, mClipboard, mWindow, CurrentTime);
+  XFlush(mDisplay);
+
+  return XGetSelectionOwner(mDisplay, mClipboard) == mWindow;
+}
+
+#pragma mark - Dialogs
+
+EMsgBoxResult IGraphicsLinux::ShowMessageBox(const char* str, const char* caption, EMsgBoxType type, IMsgBoxCompletionHandlerFunc completionHandler)
+{
+  ReleaseMouseCapture();
+
+  WDL_String cmd("zenity");
+  EMsgBoxResult okResult = kOK, cancelResult = kCANCEL;
+
+  switch (type)
+  {
+    case kMB_OK:
+      cmd.Append(" --info");
+      break;
+    case kMB_OKCANCEL:
+      cmd.Append(" --question --ok-label=OK --cancel-label=Cancel");
+      break;
+    case kMB_YESNO:
+    case kMB_YESNOCANCEL:
+      cmd.Append(type == kMB_YESNO ? " --question --ok-label=Yes --cancel-label=No" : " --question --ok-label=Yes --cancel-label=No --extra-button=Cancel");
+      okResult = kYES;
+      cancelResult = kNO;
+      break;
+    case kMB_RETRYCANCEL:
+      cmd.Append(" --question --ok-label=Retry --cancel-label=Cancel");
+      okResult = kRETRY;
+      break;
+  }
+
+  cmd.Append(" --title");
+  AppendShellArg(cmd, caption ? caption : "");
+  cmd.Append(" --text");
+  AppendShellArg(cmd, str ? str : "");
+
+  WDL_String output;
+  const int status = RunDialog(cmd, &output);
+  EMsgBoxResult result = status == 0 ? okResult : status > 0 ? cancelResult : kNoResult;
+
+  // the extra button prints its label and exits with 1
+  if (type == kMB_YESNOCANCEL && status == 1 && !strcmp(output.Get(), "Cancel"))
+    result = kCANCEL;
+
+  if (completionHandler)
+    completionHandler(result);
+
+  return result;
+}
+
+void IGraphicsLinux::PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action, const char* ext, IFileDialogCompletionHandlerFunc completionHandler)
+{
+  ReleaseMouseCapture();
+
+  WDL_String cmd("zenity --file-selection");
+
+  if (action == EFileAction::Save)
+    cmd.Append(" --save --confirm-overwrite");
+
+  WDL_String start(path.Get());
+
+  if (start.GetLength() && start.Get()[start.GetLength() - 1] != '/')
+    start.Append("/");
+
+  start.Append(fileName.get_filepart());
+
+  if (start.GetLength())
+  {
+    cmd.Append(" --filename");
+    AppendShellArg(cmd, start.Get());
+  }
+
+  // ext is a space separated list, e.g. "fxp fxb"
+  if (CStringHasContents(ext))
+  {
+    WDL_String filter;
+
+    for (const char* e = ext; *e; )
+    {
+      const char* end = strchr(e, ' ');
+      const int len = end ? static_cast<int>(end - e) : static_cast<int>(strlen(e));
+
+      if (len)
+      {
+        filter.Append(filter.GetLength() ? " *." : "*.");
+        filter.Append(e, len);
+      }
+
+      e += len + (end ? 1 : 0);
+    }
+
+    cmd.Append(" --file-filter");
+    AppendShellArg(cmd, filter.Get());
+  }
+
+  WDL_String output;
+
+  if (RunDialog(cmd, &output) == 0 && output.GetLength())
+  {
+    fileName.Set(output.Get());
+    path.Set(output.Get());
+    path.remove_filepart(true);
+  }
+  else
+    fileName.Set("");
+
+  if (completionHandler)
+    completionHandler(fileName, path);
+}
+
+void IGraphicsLinux::PromptForDirectory(WDL_String& dir, IFileDialogCompletionHandlerFunc completionHandler)
+{
+  ReleaseMouseCapture();
+
+  WDL_String cmd("zenity --file-selection --directory --title");
+  AppendShellArg(cmd, "Choose a Directory");
+
+  if (dir.GetLength())
+  {
+    cmd.Append(" --filename");
+    AppendShellArg(cmd, dir.Get());
+  }
+
+  WDL_String output;
+
+  if (RunDialog(cmd, &output) == 0 && output.GetLength())
+  {
+    dir.Set(output.Get());
+    dir.Append("/");
+  }
+  else
+    dir.Set("");
+
+  if (completionHandler)
+  {
+    WDL_String fileName; // not used
+    completionHandler(fileName, dir);
+  }
+}
+
+bool IGraphicsLinux::PromptForColor(IColor& color, const char* str, IColorPickerHandlerFunc func)
+{
+  ReleaseMouseCapture();
+
+  WDL_String cmd("zenity --color-selection");
+  WDL_String initial;
+  initial.SetFormatted(64, "rgb(%d,%d,%d)", color.R, color.G, color.B);
+  cmd.Append(" --color");
+  AppendShellArg(cmd, initial.Get());
+
+  if (CStringHasContents(str))
+  {
+    cmd.Append(" --title");
+    AppendShellArg(cmd, str);
+  }
+
+  WDL_String output;
+  int r, g, b;
+
+  // zenity answers rgb(r,g,b), or rgba(r,g,b,a)
+  if (RunDialog(cmd, &output) != 0 || (sscanf(output.Get(), "rgb(%d,%d,%d)", &r, &g, &b) != 3 && sscanf(output.Get(), "rgba(%d,%d,%d", &r, &g, &b) != 3))
+    return false;
+
+  color.R = r;
+  color.G = g;
+  color.B = b;
+
+  if (func)
+    func(color);
+
+  return true;
+}
+
+bool IGraphicsLinux::OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure)
+{
+  if (confirmMsg && ShowMessageBox(confirmMsg, msgWindowTitle, kMB_YESNO, nullptr) != kYES)
+    return false;
+
+  if (Spawn("xdg-open", url))
+    return true;
+
+  if (errMsgOnFailure)
+    ShowMessageBox(errMsgOnFailure, msgWindowTitle, kMB_OK, nullptr);
+
+  return false;
+}
+
+bool IGraphicsLinux::RevealPathInExplorerOrFinder(WDL_String& path, bool select)
+{
+  WDL_String dir(path.Get());
+
+  // file managers don't agree on a way to select a file, so this opens the folder it is in
+  if (select)
+    dir.remove_filepart(true);
+
+  return dir.GetLength() && Spawn("xdg-open", dir.Get());
+}
+
+#pragma mark - Text entry and menus
+
+IPopupMenu* IGraphicsLinux::CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT bounds, bool& isAsync)
+{
+  // menus are drawn by the IPopupMenuControl attached in OpenWindow(), unless the plug-in removes it
+  isAsync = false;
+  return nullptr;
+}
+
+void IGraphicsLinux::CreatePlatformTextEntry(int paramIdx, const IText& text, const IRECT& bounds, int length, const char* str)
+{
+  // text is entered in the ITextEntryControl attached in OpenWindow(), unless the plug-in removes it, then in a dialog
+  WDL_String cmd("zenity --entry --text=\"\" --entry-text");
+  AppendShellArg(cmd, str ? str : "");
+
+  WDL_String output;
+
+  if (RunDialog(cmd, &output) == 0)
+  {
+    if (length > 0 && output.GetLength() > length)
+      output.SetLen(length);
+
+    SetControlValueAfterTextEdit(output.Get());
+  }
+  else
+    ClearInTextEntryControl();
+}
+
+#pragma mark - Fonts
+
+PlatformFontPtr IGraphicsLinux::LoadPlatformFont(const char* fontID, const char* fileNameOrResID)
+{
+  WDL_String fullPath;
+  const EResourceLocation fontLocation = LocateResource(fileNameOrResID, "ttf", fullPath, GetBundleID(), nullptr, nullptr);
+
+  if (fontLocation == kNotFound)
+    return nullptr;
+
+  return PlatformFontPtr(new FileFont(fontID, "", fullPath.Get(), 0, false));
+}
+
+PlatformFontPtr IGraphicsLinux::LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style)
+{
+  // fontconfig finds the installed font that best matches the family and style, which may be a substitute
+  FcPattern* pPattern = FcPatternCreate();
+  FcPatternAddString(pPattern, FC_FAMILY, reinterpret_cast<const FcChar8*>(fontName));
+  FcPatternAddInteger(pPattern, FC_WEIGHT, style == ETextStyle::Bold ? FC_WEIGHT_BOLD : FC_WEIGHT_REGULAR);
+  FcPatternAddInteger(pPattern, FC_SLANT, style == ETextStyle::Italic ? FC_SLANT_ITALIC : FC_SLANT_ROMAN);
+  FcConfigSubstitute(nullptr, pPattern, FcMatchPattern);
+  FcDefaultSubstitute(pPattern);
+
+  FcResult result;
+  FcPattern* pMatch = FcFontMatch(nullptr, pPattern, &result);
+  FcPatternDestroy(pPattern);
+
+  if (!pMatch)
+    return nullptr;
+
+  FcChar8* pFile = nullptr;
+  int faceIdx = 0;
+  PlatformFontPtr font;
+
+  if (FcPatternGetString(pMatch, FC_FILE, 0, &pFile) == FcResultMatch && pFile)
+  {
+    FcPatternGetInteger(pMatch, FC_INDEX, 0, &faceIdx);
+    font = PlatformFontPtr(new FileFont(fontName, TextStyleString(style), reinterpret_cast<const char*>(pFile), faceIdx, true));
+  }
+
+  FcPatternDestroy(pMatch);
+  return font;
+}
+
+PlatformFontPtr IGraphicsLinux::LoadPlatformFont(const char* fontID, void* pData, int dataSize)
+{
+  return PlatformFontPtr(new MemoryFont(fontID, pData, dataSize));
+}
+
+// Xlib's macros clash with names in the draw classes, which are compiled into this file below
+#undef None
+#undef Bool
+#undef Status
+#undef Success
+#undef Always
+#undef True
+#undef False
+#undef Complex
+#undef Convex
+#undef KeyPress
+#undef KeyRelease
+#undef FocusIn
+#undef FocusOut
+#undef Expose
+#undef DestroyAll
+#undef CursorShape
+
+#ifndef NO_IGRAPHICS
+#if defined IGRAPHICS_SKIA
+  #include "IGraphicsSkia.cpp"
+  #include "glad.c"
+#elif defined IGRAPHICS_NANOVG
+  #include "IGraphicsNanoVG.cpp"
+#ifdef IGRAPHICS_FREETYPE
+#define FONS_USE_FREETYPE
+#endif
+  #include "nanovg.c"
+  #include "glad.c"
+#else
+  #error
+#endif
+#endif
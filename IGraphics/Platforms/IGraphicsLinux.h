@@ -10,49 +10,182 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include "IPlugPlatform.h"
+#include "IPlugRunLoop.h"
+
 #include "IGraphics_select.h"
 
+// Xlib and GLX are only included in IGraphicsLinux.cpp, their macros (None, Bool, Status...) clash with names in IGraphics and the draw classes
+struct _XDisplay;
+union _XEvent;
+struct __GLXcontextRec;
+struct _XIM;
+struct _XIC;
+
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
 
-/** IGraphics platform class for linux
-*   @ingroup PlatformClasses
-*/
+/** IGraphics platform class for Linux, an X11 window with a GLX context, for IGraphicsNanoVG or IGraphicsSkia with IGRAPHICS_GL2 or IGRAPHICS_GL3.
+ * Each window has its own X connection, which has no loop of its own to run it: the connection's file descriptor and the display timer are registered with an IRunLoop,
+ * the host's if it has given one to IEditorDelegate::SetHostRunLoop() (VST3 does), otherwise GetDefaultRunLoop(), which whoever opened the window must Dispatch() or Run().
+ * Nothing polls, the window is woken by X events and by a display timer that:
+ * - runs at the display's refresh rate, or FPS() if that is lower, with buffer swaps synced to vblank unless IGRAPHICS_DISABLE_VSYNC is defined
+ * - drops to kIdleFPS once nothing has been dirty for kIdleTimeoutMS, unless IGRAPHICS_DISABLE_ADAPTIVE_FPS is defined
+ * - stops altogether while the window is unmapped or fully obscured
+ *
+ * Text entry and pop-up menus are drawn by IGraphics' own ITextEntryControl and IPopupMenuControl. Message boxes and file, directory and color choosers use zenity.
+ * @ingroup PlatformClasses */
 class IGraphicsLinux final : public IGRAPHICS_DRAW_CLASS
 {
+  class Font;
+  class FileFont;
+  class MemoryFont;
 public:
   IGraphicsLinux(IGEditorDelegate& dlg, int w, int h, int fps, float scale);
-  virtual ~IGraphicsLinux);
+  ~IGraphicsLinux();
 
-  void* OpenWindow(void* pWindow) override;
+  void* OpenWindow(void* pParent) override;
   void CloseWindow() override;
-  bool WindowIsOpen() override;
+  bool WindowIsOpen() override { return mWindow; }
+  void* GetWindow() override { return reinterpret_cast<void*>(mWindow); }
   void PlatformResize(bool parentHasResized) override;
 
-  void HideMouseCursor() override;
-  void ShowMouseCursor() override;
+#ifdef IGRAPHICS_GL
+  void DrawResize() override; // overriden here to make the GLX context current
+#endif
+
+  void HideMouseCursor(bool hide, bool lock) override;
+  void MoveMouseCursor(float x, float y) override;
+  ECursor SetMouseCursor(ECursor cursorType) override;
+  void GetMouseLocation(float& x, float&y) const override;
 
   EMsgBoxResult ShowMessageBox(const char* str, const char* caption, EMsgBoxType type, IMsgBoxCompletionHandlerFunc completionHandler) override;
-  void ForceEndUserEdit() override;
+  void ForceEndUserEdit() override {}
 
-  const char* GetPlatformAPIStr() override;
+  const char* GetPlatformAPIStr() override { return "X11"; }
 
-  void UpdateTooltips() override;
+  void UpdateTooltips() override {}
 
   bool RevealPathInExplorerOrFinder(WDL_String& path, bool select) override;
-  void PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action,  const char* ext, IColorPickerHandlerFunc func) override;
-  bool PromptForColor(IColor& color, const char* str) override;
+  void PromptForFile(WDL_String& fileName, WDL_String& path, EFileAction action, const char* ext, IFileDialogCompletionHandlerFunc completionHandler) override;
+  void PromptForDirectory(WDL_String& dir, IFileDialogCompletionHandlerFunc completionHandler) override;
+  bool PromptForColor(IColor& color, const char* str, IColorPickerHandlerFunc func) override;
 
   bool OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure) override;
 
-  static int GetUserOSVersion();
   bool GetTextFromClipboard(WDL_String& str) override;
-  bool SetTextInClipboard(const char* str) override { return false; } // TODO
+  bool SetTextInClipboard(const char* str) override;
+
+  /** @return The loop the window is registered with, the host's or GetDefaultRunLoop() */
+  IRunLoop* GetRunLoop() { return mRunLoop; }
+
+  /** @return IPollRunLoop::GetDefault(), the loop for windows whose host doesn't have one, e.g. an app's, which it runs with IPollRunLoop::Run() until the last window is closed */
+  static IPollRunLoop& GetDefaultRunLoop();
 
 protected:
-  IPopupMenu* CreatePlatformPopupMenu(const IPopupMenu& menu, IRECT& bounds) override;
+  IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT bounds, bool& isAsync) override;
   void CreatePlatformTextEntry(int paramIdx, const IText& text, const IRECT& bounds, int length, const char* str) override;
-}
+
+private:
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fileNameOrResID) override;
+  PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style) override;
+  PlatformFontPtr LoadPlatformFont(const char* fontID, void* pData, int dataSize) override;
+  void CachePlatformFont(const char* fontID, const PlatformFontPtr& font) override {}
+
+  /** Handle every event that has arrived on the X connection, called by the run loop when its file descriptor is readable */
+  void ProcessEvents();
+  void HandleEvent(_XEvent& event);
+
+  /** Draw whatever is dirty, called by the run loop's display timer */
+  void OnDisplayTimer();
+
+  /** Draw and swap, with the GLX context current
+   * @param rects The areas to draw, in UI coordinates */
+  void Paint(IRECTList& rects);
+
+  IMouseInfo GetMouseInfo(int x, int y, unsigned int state);
+
+  /** Register the display timer with the run loop, replacing any timer at another interval */
+  void StartDisplayTimer(int intervalMS);
+  void StopDisplayTimer();
+
+  /** @return The interval of the display timer when the UI is active, from FPS() and the display's refresh rate */
+  int GetTimerInterval() const;
+
+  /** Switch to the idle frame rate once nothing has been dirty for kIdleTimeoutMS, called from OnDisplayTimer()
+   * @param active \c true if something was drawn, or the user is interacting with the UI */
+  void UpdateFramePacing(bool active);
+
+  /** Return to the full frame rate immediately, e.g. on user input */
+  void WakeFromIdle();
+
+  void RequestFrame() override { if (mWindow) WakeFromIdle(); }
+
+  /** Stop the display timer while the window can't be seen, and restart it when it can */
+  void SetVisible(bool visible);
+
+  bool CreateGLContext();
+  void DestroyGLContext();
+
+  /** Open the input method and its input context, so that keys are looked up as UTF-8 text, including text composed by the input method */
+  void CreateInputContext();
+  void DestroyInputContext();
+
+  void ActivateGLContext() override;
+  void DeactivateGLContext() override;
+
+  static void ProcessEventsCallback(void* pContext) { static_cast<IGraphicsLinux*>(pContext)->ProcessEvents(); }
+  static void DisplayTimerCallback(void* pContext) { static_cast<IGraphicsLinux*>(pContext)->OnDisplayTimer(); }
+
+  static constexpr int kIdleFPS = 4; // display timer rate when nothing is dirty, so that controls made dirty by the delegate are still drawn
+  static constexpr int kIdleTimeoutMS = 500;
+  static constexpr int kDoubleClickMS = 400;
+  static constexpr int kNumCursors = static_cast<int>(ECursor::HELP) + 1;
+
+  _XDisplay* mDisplay = nullptr;
+  unsigned long mWindow = 0; // X Window IDs, Atoms and Cursors are XIDs
+  unsigned long mParentWindow = 0;
+  unsigned long mColormap = 0;
+  unsigned long mWMDeleteWindow = 0;
+  unsigned long mClipboard = 0;
+  unsigned long mUTF8String = 0;
+  unsigned long mTargets = 0;
+  unsigned long mSelectionProperty = 0;
+  unsigned long mCursors[kNumCursors] = {};
+  unsigned long mInvisibleCursor = 0;
+  ECursor mCursor = ECursor::ARROW;
+  bool mTopLevel = false;
+  _XIM* mXIM = nullptr;
+  _XIC* mXIC = nullptr;
+
+  __GLXcontextRec* mGLContext = nullptr;
+  __GLXcontextRec* mStartGLContext = nullptr;
+  unsigned long mStartDrawable = 0;
+  _XDisplay* mStartDisplay = nullptr;
+
+  IRunLoop* mRunLoop = nullptr;
+  int mTimerID = 0;
+  int mTimerInterval = 0;
+  float mDisplayRefreshRate = 60.f;
+  bool mVSYNCEnabled = true;
+  bool mAdaptiveFrameRate = true;
+  bool mIdlePacing = false;
+  bool mVisible = true;
+  int64_t mLastActiveTime = 0;
+
+  IRECTList mExposedRects;
+  WDL_String mClipboardText; // while this window owns the CLIPBOARD selection
+  unsigned long mLastClickTime = 0;
+  unsigned int mLastClickButton = 0;
+  int mLastClickX = 0;
+  int mLastClickY = 0;
+  bool mMouseCaptured = false;
+  bool mCloseRequested = false;
+  float mHiddenCursorX = 0.f;
+  float mHiddenCursorY = 0.f;
+};
 
 END_IGRAPHICS_NAMESPACE
 END_IPLUG_NAMESPACE
@@ -13,6 +13,7 @@
 
 #include "IControl.h"
 #include "IPopupMenuControl.h"
+#include "IGraphicsBitmapCache.h"
 
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 
@@ -43,6 +44,38 @@ static int GetSystemVersion()
 
 StaticStorage<CoreTextFontDescriptor> sFontDescriptorCache;
 
+/** Purges IDecodedBitmapCache when the system is short of memory, for as long as the plug-in is loaded */
+struct MemoryPressureMonitor
+{
+  MemoryPressureMonitor()
+  {
+    IDecodedBitmapCache::Get(); // so that the cache outlives the monitor
+    mSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+
+    if (mSource)
+    {
+      dispatch_source_set_event_handler_f(mSource, OnMemoryPressure);
+      dispatch_resume(mSource);
+    }
+  }
+
+  ~MemoryPressureMonitor()
+  {
+    if (mSource)
+    {
+      dispatch_source_cancel(mSource);
+      dispatch_release(mSource);
+    }
+  }
+
+  static void OnMemoryPressure(void*)
+  {
+    IDecodedBitmapCache::Get().Purge();
+  }
+
+  dispatch_source_t mSource = nullptr;
+};
+
 #pragma mark -
 
 IGraphicsMac::IGraphicsMac(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
@@ -51,6 +84,8 @@ IGraphicsMac::IGraphicsMac(IGEditorDelegate& dlg, int w, int h, int fps, float s
   NSApplicationLoad();
   StaticStorage<CoreTextFontDescriptor>::Accessor storage(sFontDescriptorCache);
   storage.Retain();
+
+  static MemoryPressureMonitor sMemoryPressureMonitor;
 }
 
 IGraphicsMac::~IGraphicsMac()
@@ -90,6 +125,7 @@ void* IGraphicsMac::OpenWindow(void* pParent)
 {
   TRACE
   CloseWindow();
+  SetOccluded(false); // a new view starts out visible
   IGRAPHICS_VIEW* pView = [[IGRAPHICS_VIEW alloc] initWithIGraphics: this];
   mView = (void*) pView;
     
@@ -138,6 +138,9 @@ using namespace igraphics;
 - (void) drawRect: (NSRect) bounds;
 - (void) render;
 - (void) killTimer;
+- (void) pauseTimer: (BOOL) pause;
+- (void) updateOcclusion;
+- (void) windowDidChangeOcclusionState: (NSNotification*) pNotification;
 - (void) onTimer: (NSTimer*) pTimer;
 - (void) viewDidChangeEffectiveAppearance;
 //mouse
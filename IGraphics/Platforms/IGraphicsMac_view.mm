@@ -456,6 +456,93 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
   return kCVReturnSuccess;
 }
 
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+// With IGRAPHICS_SHARED_RENDER_SCHEDULER every view in the process is rendered from one display link (or timer) tick, instead of each view scheduling its own
+static std::vector<IGRAPHICS_VIEW*> sScheduledViews;
+#ifdef IGRAPHICS_CVDISPLAYLINK
+static CVDisplayLinkRef sSharedDisplayLink = nullptr;
+static dispatch_source_t sSharedDisplaySource = nullptr;
+#else
+static CFRunLoopTimerRef sSharedTimer = nullptr;
+#endif
+
+static void RenderScheduledViews()
+{
+  // a view can be closed while another one is rendering, e.g. by a control action
+  const std::vector<IGRAPHICS_VIEW*> views = sScheduledViews;
+
+  for (IGRAPHICS_VIEW* pView : views)
+  {
+    if (std::find(sScheduledViews.begin(), sScheduledViews.end(), pView) != sScheduledViews.end())
+      [pView render];
+  }
+}
+
+static void ScheduleView(IGRAPHICS_VIEW* pView)
+{
+  if (std::find(sScheduledViews.begin(), sScheduledViews.end(), pView) != sScheduledViews.end())
+    return;
+
+  sScheduledViews.push_back(pView);
+
+  if (sScheduledViews.size() > 1)
+    return;
+
+#ifdef IGRAPHICS_CVDISPLAYLINK
+  sSharedDisplaySource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, dispatch_get_main_queue());
+  dispatch_source_set_event_handler(sSharedDisplaySource, ^(){
+    RenderScheduledViews();
+  });
+  dispatch_resume(sSharedDisplaySource);
+
+  CVReturn cvReturn;
+
+  cvReturn = CVDisplayLinkCreateWithActiveCGDisplays(&sSharedDisplayLink);
+  assert(cvReturn == kCVReturnSuccess);
+
+  cvReturn = CVDisplayLinkSetOutputCallback(sSharedDisplayLink, &displayLinkCallback, (void*) sSharedDisplaySource);
+  assert(cvReturn == kCVReturnSuccess);
+
+  CGDirectDisplayID viewDisplayID =
+      (CGDirectDisplayID) [pView.window.screen.deviceDescription[@"NSScreenNumber"] unsignedIntegerValue];
+
+  CVDisplayLinkSetCurrentCGDisplay(sSharedDisplayLink, viewDisplayID);
+  CVDisplayLinkStart(sSharedDisplayLink);
+#else
+  const double sec = 1.0 / (double) pView->mGraphics->FPS();
+  sSharedTimer = CFRunLoopTimerCreateWithHandler(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + sec, sec, 0, 0, ^(CFRunLoopTimerRef){
+    RenderScheduledViews();
+  });
+  CFRunLoopAddTimer(CFRunLoopGetMain(), sSharedTimer, kCFRunLoopCommonModes);
+#endif
+}
+
+static void UnscheduleView(IGRAPHICS_VIEW* pView)
+{
+  auto it = std::find(sScheduledViews.begin(), sScheduledViews.end(), pView);
+
+  if (it == sScheduledViews.end())
+    return;
+
+  sScheduledViews.erase(it);
+
+  if (!sScheduledViews.empty())
+    return;
+
+#ifdef IGRAPHICS_CVDISPLAYLINK
+  CVDisplayLinkStop(sSharedDisplayLink);
+  dispatch_source_cancel(sSharedDisplaySource);
+  CVDisplayLinkRelease(sSharedDisplayLink);
+  sSharedDisplayLink = nullptr;
+  sSharedDisplaySource = nullptr;
+#else
+  CFRunLoopTimerInvalidate(sSharedTimer);
+  CFRelease(sSharedTimer);
+  sSharedTimer = nullptr;
+#endif
+}
+#endif
+
 - (void) onTimer: (NSTimer*) pTimer
 {
   [self render];
@@ -463,7 +550,9 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
 
 - (void) setTimer
 {
-#ifdef IGRAPHICS_CVDISPLAYLINK
+#if defined IGRAPHICS_SHARED_RENDER_SCHEDULER
+  ScheduleView(self);
+#elif defined IGRAPHICS_CVDISPLAYLINK
   mDisplaySource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, dispatch_get_main_queue());
   dispatch_source_set_event_handler(mDisplaySource, ^(){
     [self render];
@@ -502,7 +591,9 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
 
 - (void) killTimer
 {
-#ifdef IGRAPHICS_CVDISPLAYLINK
+#if defined IGRAPHICS_SHARED_RENDER_SCHEDULER
+  UnscheduleView(self);
+#elif defined IGRAPHICS_CVDISPLAYLINK
   CVDisplayLinkStop(mDisplayLink);
   dispatch_source_cancel(mDisplaySource);
   CVDisplayLinkRelease(mDisplayLink);
@@ -513,6 +604,60 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
 #endif
 }
 
+- (void) pauseTimer: (BOOL) pause
+{
+#if defined IGRAPHICS_SHARED_RENDER_SCHEDULER
+  if (pause)
+    UnscheduleView(self);
+  else
+    ScheduleView(self);
+#elif defined IGRAPHICS_CVDISPLAYLINK
+  if (mDisplayLink)
+  {
+    if (pause)
+      CVDisplayLinkStop(mDisplayLink);
+    else
+      CVDisplayLinkStart(mDisplayLink);
+  }
+#else
+  [mTimer setFireDate: pause ? [NSDate distantFuture] : [NSDate date]];
+#endif
+}
+
+- (void) updateOcclusion
+{
+  NSWindow* pWindow = [self window];
+  
+  if (!mGraphics || !pWindow)
+    return;
+  
+  // the window is minimized, fully covered, or on another Space, or the host has hidden the view
+  const bool occluded = !([pWindow occlusionState] & NSWindowOcclusionStateVisible) || [self isHiddenOrHasHiddenAncestor];
+  
+  if (occluded == mGraphics->IsOccluded())
+    return;
+  
+  mGraphics->SetOccluded(occluded);
+  [self pauseTimer: occluded];
+}
+
+- (void) windowDidChangeOcclusionState: (NSNotification*) pNotification
+{
+  [self updateOcclusion];
+}
+
+- (void) viewDidHide
+{
+  [super viewDidHide];
+  [self updateOcclusion];
+}
+
+- (void) viewDidUnhide
+{
+  [super viewDidUnhide];
+  [self updateOcclusion];
+}
+
 - (void) dealloc
 {
   if([NSColorPanel sharedColorPanelExists])
@@ -554,6 +699,16 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
   return YES;
 }
 
+- (void) viewWillMoveToWindow: (NSWindow*) pNewWindow
+{
+  NSWindow* pWindow = [self window];
+  
+  if (pWindow)
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:NSWindowDidChangeOcclusionStateNotification object:pWindow];
+  
+  [super viewWillMoveToWindow: pNewWindow];
+}
+
 - (void) viewDidMoveToWindow
 {
   NSWindow* pWindow = [self window];
@@ -563,6 +718,12 @@ static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeSt
     [pWindow makeFirstResponder: self];
     [pWindow setAcceptsMouseMovedEvents: YES];
     
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(windowDidChangeOcclusionState:)
+                                                 name:NSWindowDidChangeOcclusionStateNotification
+                                               object:pWindow];
+    [self updateOcclusion];
+    
     CGFloat newScale = [pWindow backingScaleFactor];
 
     if (mGraphics)
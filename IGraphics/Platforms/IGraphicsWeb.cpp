@@ -11,9 +11,11 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdint>
+#include <vector>
 #include <emscripten/key_codes.h>
 
 #include "IGraphicsWeb.h"
+#include "IControl.h"
 
 BEGIN_IPLUG_NAMESPACE
 BEGIN_IGRAPHICS_NAMESPACE
@@ -570,6 +572,13 @@ static EM_BOOL uievent_callback(int eventType, const EmscriptenUiEvent* pEvent,
   return false;
 }
 
+static EM_BOOL visibilitychange_callback(int eventType, const EmscriptenVisibilityChangeEvent* pEvent, void* pUserData)
+{
+  IGraphicsWeb* pGraphics = (IGraphicsWeb*) pUserData;
+  pGraphics->OnVisibilityChange(pEvent->hidden);
+  return true;
+}
+
 IColorPickerHandlerFunc gColorPickerHandlerFunc = nullptr;
 
 static void color_picker_callback(val e)
@@ -597,10 +606,14 @@ static void file_dialog_callback(val e)
 EMSCRIPTEN_BINDINGS(events) {
   function("color_picker_callback", color_picker_callback);
   function("file_dialog_callback", file_dialog_callback);
+  function("resource_fetched_callback", &IGraphicsWeb::OnResourceFetched);
 }
 
 #pragma mark -
 
+std::unordered_map<int, IGraphicsWeb*> IGraphicsWeb::sResourceRequests;
+int IGraphicsWeb::sLastResourceRequestID = 0;
+
 IGraphicsWeb::IGraphicsWeb(IGEditorDelegate& dlg, int w, int h, int fps, float scale)
 : IGRAPHICS_DRAW_CLASS(dlg, w, h, fps, scale)
 {
@@ -621,10 +634,20 @@ IGraphicsWeb::IGraphicsWeb(IGEditorDelegate& dlg, int w, int h, int fps, float s
   emscripten_set_touchmove_callback("#canvas", this, 1, touch_callback);
   emscripten_set_touchcancel_callback("#canvas", this, 1, touch_callback);
   emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, this, 1, uievent_callback);
+  emscripten_set_visibilitychange_callback(this, 1, visibilitychange_callback);
 }
 
 IGraphicsWeb::~IGraphicsWeb()
 {
+  if (mFrameRequestID)
+    emscripten_cancel_animation_frame(mFrameRequestID);
+
+  if (mIdleTimeoutID)
+    emscripten_clear_timeout(mIdleTimeoutID);
+
+  // resources arriving after this are ignored
+  for (auto& request : mPendingResources)
+    sResourceRequests.erase(request.first);
 }
 
 void* IGraphicsWeb::OpenWindow(void* pHandle)
@@ -646,6 +669,8 @@ void* IGraphicsWeb::OpenWindow(void* pHandle)
 
   GetDelegate()->LayoutUI(this);
   GetDelegate()->OnUIOpen();
+
+  RequestFrame();
   
   return nullptr;
 }
@@ -713,25 +738,101 @@ void IGraphicsWeb::GetMouseLocation(float& x, float&y) const
   y = mPrevY;
 }
 
+void IGraphicsWeb::RequestFrame()
+{
+  mLastActiveTime = emscripten_get_now();
+
+  if (!mFrameRequestID && !IsOccluded())
+    mFrameRequestID = emscripten_request_animation_frame(AnimationFrameCallback, this);
+}
+
 //static
-void IGraphicsWeb::OnMainLoopTimer()
+EM_BOOL IGraphicsWeb::AnimationFrameCallback(double time, void* pUserData)
+{
+  IGraphicsWeb* pGraphics = static_cast<IGraphicsWeb*>(pUserData);
+  pGraphics->mFrameRequestID = 0;
+  pGraphics->OnFrame();
+  return EM_FALSE;
+}
+
+//static
+void IGraphicsWeb::IdleTimeoutCallback(void* pUserData)
+{
+  IGraphicsWeb* pGraphics = static_cast<IGraphicsWeb*>(pUserData);
+  pGraphics->mIdleTimeoutID = 0;
+
+  // a frame requested in the meantime will do the check
+  if (!pGraphics->mFrameRequestID)
+    pGraphics->OnFrame();
+}
+
+void IGraphicsWeb::OnVisibilityChange(bool hidden)
+{
+  if (hidden == IsOccluded())
+    return;
+
+  if (hidden)
+  {
+    if (mFrameRequestID)
+      emscripten_cancel_animation_frame(mFrameRequestID);
+
+    if (mIdleTimeoutID)
+      emscripten_clear_timeout(mIdleTimeoutID);
+
+    mFrameRequestID = 0;
+    mIdleTimeoutID = 0;
+  }
+
+  // becoming visible redraws everything and calls RequestFrame()
+  SetOccluded(hidden);
+}
+
+void IGraphicsWeb::OnFrame()
 {
+  if (IsOccluded())
+    return;
+
   IRECTList rects;
   int screenScale = (int) std::ceil(std::max(emscripten_get_device_pixel_ratio(), 1.));
-  
-  // Don't draw if there are no graphics or if assets are still loading
-  if (!gGraphics || !gGraphics->AssetsLoaded())
-    return;
-  
-  if (screenScale != gGraphics->GetScreenScale())
+  bool active = false;
+
+  // Don't draw while assets are still loading, but keep checking
+  if (!AssetsLoaded())
+    active = true;
+  else
   {
-    gGraphics->SetScreenScale(screenScale);
+    if (screenScale != GetScreenScale())
+      SetScreenScale(screenScale);
+
+    if (IsDirty(rects))
+    {
+      SetAllControlsClean();
+      Draw(rects);
+      active = true;
+    }
+
+    active |= IsAnimating();
   }
 
-  if (gGraphics->IsDirty(rects))
+  const double now = emscripten_get_now();
+
+  if (active)
+    mLastActiveTime = now;
+
+#ifdef IGRAPHICS_DISABLE_ADAPTIVE_FPS
+  const bool idle = false;
+#else
+  const bool idle = now - mLastActiveTime > kIdleTimeoutMS;
+#endif
+
+  if (!idle)
   {
-    gGraphics->SetAllControlsClean();
-    gGraphics->Draw(rects);
+    if (!mFrameRequestID)
+      mFrameRequestID = emscripten_request_animation_frame(AnimationFrameCallback, this);
+  }
+  else if (!mIdleTimeoutID && !mFrameRequestID)
+  {
+    mIdleTimeoutID = emscripten_set_timeout(IdleTimeoutCallback, 1000. / kIdleFPS, this);
   }
 }
 
@@ -899,6 +1000,17 @@ PlatformFontPtr IGraphicsWeb::LoadPlatformFont(const char* fontID, const char* f
   if (fontLocation == kNotFound)
     return nullptr;
 
+  // A font in the manifest isn't in the file system, it is loaded from memory when it arrives, see OnResourceFetched()
+  val manifest = GetResourceManifest();
+
+  if (!manifest.isUndefined() && manifest.call<bool>("hasOwnProperty", std::string(fullPath.Get())))
+  {
+    if (!IsFontPending(fontID))
+      FetchResource(fullPath.Get(), nullptr, fontID);
+
+    return nullptr;
+  }
+
   return PlatformFontPtr(new FileFont(fontID, "", fullPath.Get()));
 }
 
@@ -914,6 +1026,174 @@ PlatformFontPtr IGraphicsWeb::LoadPlatformFont(const char* fontID, void* pData,
   return PlatformFontPtr(new MemoryFont(fontID, "", pData, dataSize));
 }
 
+#pragma mark - Resource fetching
+
+APIBitmap* IGraphicsWeb::LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext)
+{
+  val manifest = GetResourceManifest();
+
+  if (location != EResourceLocation::kAbsolutePath || manifest.isUndefined() || !manifest.call<bool>("hasOwnProperty", std::string(fileNameOrResID)))
+    return IGRAPHICS_DRAW_CLASS::LoadAPIBitmap(fileNameOrResID, scale, location, ext);
+
+  // Create the bitmap at its final size, so that the layout doesn't change when the image arrives
+  val entry = manifest[std::string(fileNameOrResID)];
+  const int width = entry["w"].as<int>();
+  const int height = entry["h"].as<int>();
+
+#if defined IGRAPHICS_CANVAS
+  APIBitmap* pBitmap = CreateAPIBitmap(width, height, scale, 1.);
+#else
+  APIBitmap* pBitmap = CreateBlankBitmap(width, height, scale);
+#endif
+
+  FetchResource(fileNameOrResID, pBitmap, nullptr);
+
+  return pBitmap;
+}
+
+void IGraphicsWeb::ReleaseBitmap(const IBitmap& bitmap)
+{
+  for (auto it = mPendingResources.begin(); it != mPendingResources.end();)
+  {
+    if (it->second.mBitmap == bitmap.GetAPIBitmap())
+    {
+      sResourceRequests.erase(it->first);
+      it = mPendingResources.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  IGRAPHICS_DRAW_CLASS::ReleaseBitmap(bitmap);
+}
+
+void IGraphicsWeb::FetchResource(const char* path, APIBitmap* pBitmap, const char* fontID)
+{
+  const int requestID = ++sLastResourceRequestID;
+  PendingResource& pending = mPendingResources[requestID];
+  pending.mBitmap = pBitmap;
+  pending.mFontID.Set(fontID ? fontID : "");
+  sResourceRequests[requestID] = this;
+
+  // Images are decoded by the browser, off the main thread. The files are next to the page, at their paths in the manifest
+  EM_ASM({
+    var url = UTF8ToString($1).substring(1);
+    var isBitmap = $2;
+
+    fetch(url).then(function(response) {
+      if (!response.ok)
+        throw new Error(response.statusText);
+
+      if (isBitmap)
+        return response.blob().then(function(blob) { return createImageBitmap(blob, { premultiplyAlpha: "none", colorSpaceConversion: "none" }); });
+      else
+        return response.arrayBuffer();
+    }).then(function(data) {
+      Module.resource_fetched_callback($0, data);
+    }).catch(function(error) {
+      console.log("Could not fetch " + url + ": " + error);
+      Module.resource_fetched_callback($0, null);
+    });
+  }, requestID, path, pBitmap ? 1 : 0);
+}
+
+//static
+void IGraphicsWeb::OnResourceFetched(int requestID, val data)
+{
+  auto request = sResourceRequests.find(requestID);
+
+  // The bitmap was released or the UI closed in the meantime
+  if (request == sResourceRequests.end())
+  {
+    if (!data.isNull() && !data["close"].isUndefined())
+      data.call<void>("close");
+
+    return;
+  }
+
+  IGraphicsWeb* pGraphics = request->second;
+  sResourceRequests.erase(request);
+
+  auto it = pGraphics->mPendingResources.find(requestID);
+  const PendingResource pending = it->second;
+  pGraphics->mPendingResources.erase(it);
+
+  if (data.isNull())
+    return; // the bitmap stays blank, the font isn't loaded
+
+  if (pending.mBitmap)
+  {
+    pGraphics->SetBitmapImage(pending.mBitmap, data);
+    data.call<void>("close");
+  }
+  else
+  {
+    // copy the font out of the ArrayBuffer
+    val bytes = val::global("Uint8Array").new_(data);
+    std::vector<uint8_t> fontData(bytes["length"].as<size_t>());
+    val(typed_memory_view(fontData.size(), fontData.data())).call<void>("set", bytes);
+
+    if (pGraphics->LoadFont(pending.mFontID.Get(), fontData.data(), static_cast<int>(fontData.size())))
+      pGraphics->ForAllControlsFunc([](IControl* pControl) { pControl->OnResize(); }); // for controls that measure their text
+  }
+
+  pGraphics->SetAllControlsDirty();
+  pGraphics->RequestFrame();
+}
+
+void IGraphicsWeb::SetBitmapImage(APIBitmap* pBitmap, val image)
+{
+#if defined IGRAPHICS_CANVAS
+  pBitmap->GetBitmap()->call<val>("getContext", std::string("2d")).call<void>("drawImage", image, 0, 0);
+#else
+  const int width = pBitmap->GetWidth();
+  const int height = pBitmap->GetHeight();
+
+  // Read the pixels back through a 2D canvas, since NanoVG takes them as RGBA
+  val canvas = val::global("document").call<val>("createElement", std::string("canvas"));
+  canvas.set("width", width);
+  canvas.set("height", height);
+  val context = canvas.call<val>("getContext", std::string("2d"));
+  context.call<void>("drawImage", image, 0, 0);
+  val pixels = context.call<val>("getImageData", 0, 0, width, height)["data"];
+
+  std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+  val(typed_memory_view(rgba.size(), rgba.data())).call<void>("set", pixels);
+  SetBitmapPixels(pBitmap, rgba.data());
+#endif
+}
+
+bool IGraphicsWeb::IsFontPending(const char* fontID) const
+{
+  for (auto& request : mPendingResources)
+  {
+    if (!request.second.mBitmap && !strcmp(request.second.mFontID.Get(), fontID))
+      return true;
+  }
+
+  return false;
+}
+
+float IGraphicsWeb::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
+{
+  // Until the font arrives the text is measured as empty
+  if (!mPendingResources.empty() && IsFontPending(text.mFont))
+  {
+    bounds = IRECT(bounds.L, bounds.T, bounds.L, bounds.T);
+    return 0.f;
+  }
+
+  return IGRAPHICS_DRAW_CLASS::DoMeasureText(text, str, bounds);
+}
+
+void IGraphicsWeb::DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend)
+{
+  if (!mPendingResources.empty() && IsFontPending(text.mFont))
+    return;
+
+  IGRAPHICS_DRAW_CLASS::DoDrawText(text, str, bounds, pBlend);
+}
+
 #if defined IGRAPHICS_CANVAS
 #include "IGraphicsCanvas.cpp"
 #elif defined IGRAPHICS_NANOVG
@@ -15,6 +15,7 @@
 #include <emscripten/bind.h>
 #include <emscripten/html5.h>
 
+#include <unordered_map>
 #include <utility>
 
 #include "IPlugPlatform.h"
@@ -36,9 +37,22 @@ static val GetPreloadedImages()
   return val::global("preloadedImages");
 }
 
+/** @return The manifest of the resources that are fetched when they're first loaded, written to resources.js by Scripts/make_web_manifest.py, or undefined if there isn't one */
+static val GetResourceManifest()
+{
+  return val::global("iplugResources");
+}
+
 extern void GetScreenDimensions(int& width, int& height);
 
 /** IGraphics platform class for the web
+* Frames are drawn from requestAnimationFrame() callbacks, which are only requested while something is happening: a control is dirty or animating, or was within
+* the last kIdleTimeoutMS. After that the UI is only checked kIdleFPS times a second (for controls that become dirty without telling IGraphics), until RequestFrame()
+* wakes it. Define IGRAPHICS_DISABLE_ADAPTIVE_FPS to request a frame on every display refresh
+*
+* The PNGs and fonts listed in the resource manifest (see makedist-web.sh) aren't preloaded into the file system, but fetched when they are first loaded, so that the UI can start
+* before they have all arrived. Such a bitmap is created at its final size straight away and is blank until the image is decoded, with createImageBitmap(), off the main thread.
+* LoadFont() returns \c false for such a font, and text in it isn't drawn until it has arrived and been loaded. Either way the controls are redrawn when it arrives
 * @ingroup PlatformClasses */
 class IGraphicsWeb final : public IGRAPHICS_DRAW_CLASS
 {
@@ -51,6 +65,10 @@ public:
 
   void DrawResize() override;
 
+  /** Called on the document's visibilitychange event. While the page is hidden no frames or idle checks are scheduled, and it is redrawn in full when it is shown again
+   * @param hidden \c true if the page is hidden, e.g. in a background tab or a minimized window */
+  void OnVisibilityChange(bool hidden);
+
   const char* GetPlatformAPIStr() override { return "WEB"; }
 
   void HideMouseCursor(bool hide, bool lock) override;
@@ -74,23 +92,75 @@ public:
   bool OpenURL(const char* url, const char* msgWindowTitle, const char* confirmMsg, const char* errMsgOnFailure) override;
 
   bool PlatformSupportsMultiTouch() const override { return true; }
+
+  void ReleaseBitmap(const IBitmap& bitmap) override;
+
+  /** Called from JavaScript when a resource requested by FetchResource() has arrived or failed
+   * @param requestID The request
+   * @param data The decoded ImageBitmap for a bitmap, or an ArrayBuffer for a font, or null if it couldn't be fetched */
+  static void OnResourceFetched(int requestID, val data);
   
   //IGraphicsWeb
-  static void OnMainLoopTimer();
   double mPrevX = 0.;
   double mPrevY = 0.;
   
 protected:
   IPopupMenu* CreatePlatformPopupMenu(IPopupMenu& menu, const IRECT bounds, bool& isAsync) override;
   void CreatePlatformTextEntry(int paramIdx, const IText& text, const IRECT& bounds, int length, const char* str) override;
+
+  APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
+  using IGRAPHICS_DRAW_CLASS::LoadAPIBitmap;
+
+  float DoMeasureText(const IText& text, const char* str, IRECT& bounds) const override;
+  void DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend) override;
     
 private:
+  /** A resource in the manifest that is being fetched */
+  struct PendingResource
+  {
+    APIBitmap* mBitmap = nullptr; // the bitmap the image is drawn into, or nullptr for a font
+    WDL_String mFontID;
+  };
+
+  /** Fetch a resource in the manifest, OnResourceFetched() is called when it arrives
+   * @param path The resource's path in the manifest, which is also its URL relative to the page
+   * @param pBitmap The blank bitmap to draw the image into, or nullptr to fetch a font
+   * @param fontID The ID to load the font as, if pBitmap is nullptr */
+  void FetchResource(const char* path, APIBitmap* pBitmap, const char* fontID);
+
+  /** Draw a fetched image into the blank bitmap created for it
+   * @param pBitmap The bitmap
+   * @param image The decoded ImageBitmap */
+  void SetBitmapImage(APIBitmap* pBitmap, val image);
+
+  /** @return \c true if the font with this ID is being fetched */
+  bool IsFontPending(const char* fontID) const;
+
+
   PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fileNameOrResID) override;
   PlatformFontPtr LoadPlatformFont(const char* fontID, const char* fontName, ETextStyle style) override;
   PlatformFontPtr LoadPlatformFont(const char* fontID, void* pData, int dataSize) override;
   void CachePlatformFont(const char* fontID, const PlatformFontPtr& font) override {}
 
+  void RequestFrame() override;
+
+  /** Check what is dirty and draw it, then request the next frame, or an idle check if nothing has happened for kIdleTimeoutMS */
+  void OnFrame();
+
+  static EM_BOOL AnimationFrameCallback(double time, void* pUserData);
+  static void IdleTimeoutCallback(void* pUserData);
+
+  static constexpr int kIdleFPS = 4;
+  static constexpr int kIdleTimeoutMS = 500;
+
   WDL_String mClipboardText;
+  long mFrameRequestID = 0; // the pending requestAnimationFrame() callback, if any
+  long mIdleTimeoutID = 0; // the pending idle check, if any
+  double mLastActiveTime = 0.;
+
+  std::unordered_map<int, PendingResource> mPendingResources; // by request ID
+  static std::unordered_map<int, IGraphicsWeb*> sResourceRequests; // the instance waiting for each request, since JavaScript can only be given the ID
+  static int sLastResourceRequestID;
 };
 
 END_IGRAPHICS_NAMESPACE
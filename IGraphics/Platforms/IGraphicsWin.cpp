@@ -18,9 +18,14 @@
 #include "IGraphicsWin.h"
 #include "IPopupMenuControl.h"
 #include "IPlugPaths.h"
+#include "IGraphicsBitmapCache.h"
 
 #include <wininet.h>
 #include <VersionHelpers.h>
+#include <atomic>
+#include <dwmapi.h>
+
+#pragma comment(lib, "dwmapi.lib")
 
 using namespace iplug;
 using namespace igraphics;
@@ -33,6 +38,67 @@ static int nWndClassReg = 0;
 static const char* wndClassName = "IPlugWndClass";
 static double sFPS = 0.0;
 
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+// With IGRAPHICS_SHARED_RENDER_SCHEDULER one vsync thread, owned by one of the windows, notifies every open window in the process
+static WDL_Mutex sVBlankMutex;
+static WDL_PtrList<IGraphicsWin> sVBlankClients;
+static IGraphicsWin* sVBlankOwner = nullptr;
+#endif
+
+/** Purges IDecodedBitmapCache when Windows reports that memory is low. The notification stays signalled while memory is low, so the wait runs once,
+ * and is armed again when an editor opens and can fill the cache again */
+struct LowMemoryMonitor
+{
+  LowMemoryMonitor()
+  {
+    IDecodedBitmapCache::Get(); // so that the cache outlives the monitor
+    mNotification = ::CreateMemoryResourceNotification(LowMemoryResourceNotification);
+  }
+
+  ~LowMemoryMonitor()
+  {
+    if (mWait)
+      ::UnregisterWait(mWait);
+
+    if (mNotification)
+      ::CloseHandle(mNotification);
+  }
+
+  void Arm()
+  {
+    if (!mNotification || (mWait && !mFired))
+      return;
+
+    if (mWait)
+      ::UnregisterWait(mWait);
+
+    mFired = false;
+
+    if (!::RegisterWaitForSingleObject(&mWait, mNotification, OnLowMemory, this, INFINITE, WT_EXECUTEONLYONCE))
+      mWait = nullptr;
+  }
+
+  static VOID CALLBACK OnLowMemory(PVOID pContext, BOOLEAN timedOut)
+  {
+    IDecodedBitmapCache::Get().Purge();
+    static_cast<LowMemoryMonitor*>(pContext)->mFired = true;
+  }
+
+  HANDLE mNotification = nullptr;
+  HANDLE mWait = nullptr;
+  std::atomic<bool> mFired {false};
+};
+
+// WinEvent hooks shared by every window, see IGraphicsWin::StartOcclusionTracking()
+static WDL_PtrList<IGraphicsWin> sOcclusionClients;
+static HWINEVENTHOOK sMinimizeHook = nullptr;
+static HWINEVENTHOOK sCloakHook = nullptr;
+
+#ifndef EVENT_OBJECT_CLOAKED
+#define EVENT_OBJECT_CLOAKED 0x8017
+#define EVENT_OBJECT_UNCLOAKED 0x8018
+#endif
+
 #define PARAM_EDIT_ID 99
 #define IPLUG_TIMER_ID 2
 
@@ -193,6 +259,148 @@ void IGraphicsWin::DestroyEditWindow()
  }
 }
 
+int IGraphicsWin::GetTimerInterval() const
+{
+  // its best to get below 16ms because the windows time quanta is slightly above 15ms.
+  int mSec = static_cast<int>(std::floorf(1000.0f / (FPS())));
+  if (mSec < 20) mSec = 15;
+  return mSec;
+}
+
+void IGraphicsWin::UpdateFramePacing(bool active)
+{
+  if (!mAdaptiveFrameRate)
+    return;
+  
+  if (active)
+  {
+    WakeFromIdle();
+    return;
+  }
+
+  if (!mIdlePacing && ::GetTickCount() - mLastActiveTime > kIdleTimeoutMS)
+  {
+    mIdlePacing = true;
+
+    if (!mVSYNCEnabled)
+      SetTimer(mPlugWnd, IPLUG_TIMER_ID, 1000 / kIdleFPS, NULL);
+  }
+}
+
+void IGraphicsWin::WakeFromIdle()
+{
+  mLastActiveTime = ::GetTickCount();
+
+  // the display timer stays paused until SetWindowOccluded() resumes it
+  if (!mIdlePacing || IsOccluded())
+    return;
+
+  mIdlePacing = false;
+
+  if (mVSYNCEnabled)
+    WakeVBlankThread();
+  else
+    SetTimer(mPlugWnd, IPLUG_TIMER_ID, GetTimerInterval(), NULL);
+}
+
+void IGraphicsWin::WakeVBlankThread()
+{
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  WDL_MutexLock lock(&sVBlankMutex);
+
+  if (sVBlankOwner)
+    ::SetEvent(sVBlankOwner->mVBlankWakeEvent);
+#else
+  if (mVBlankWakeEvent)
+    ::SetEvent(mVBlankWakeEvent);
+#endif
+}
+
+void IGraphicsWin::StartOcclusionTracking()
+{
+  sOcclusionClients.Add(this);
+
+  if (!sMinimizeHook)
+  {
+    // only the host's windows matter, so only listen to this process
+    sMinimizeHook = SetWinEventHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, NULL, OnWinEvent, GetCurrentProcessId(), 0, WINEVENT_OUTOFCONTEXT);
+    sCloakHook = SetWinEventHook(EVENT_OBJECT_CLOAKED, EVENT_OBJECT_UNCLOAKED, NULL, OnWinEvent, GetCurrentProcessId(), 0, WINEVENT_OUTOFCONTEXT);
+  }
+}
+
+void IGraphicsWin::StopOcclusionTracking()
+{
+  sOcclusionClients.DeletePtr(this);
+
+  if (!sOcclusionClients.GetSize() && sMinimizeHook)
+  {
+    UnhookWinEvent(sMinimizeHook);
+
+    if (sCloakHook)
+      UnhookWinEvent(sCloakHook);
+
+    sMinimizeHook = nullptr;
+    sCloakHook = nullptr;
+  }
+}
+
+void CALLBACK IGraphicsWin::OnWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD threadId, DWORD time)
+{
+  if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+    return;
+
+  for (int i = 0; i < sOcclusionClients.GetSize(); i++)
+  {
+    IGraphicsWin* pGraphics = sOcclusionClients.Get(i);
+
+    if (::GetAncestor(pGraphics->mPlugWnd, GA_ROOT) == hWnd)
+      pGraphics->UpdateOcclusion(event);
+  }
+}
+
+void IGraphicsWin::UpdateOcclusion(DWORD event)
+{
+  if (!mPlugWnd)
+    return;
+
+  HWND hRoot = ::GetAncestor(mPlugWnd, GA_ROOT);
+
+  // the events arrive as the state changes, so they are trusted over IsIconic() and DWMWA_CLOAKED
+  bool minimized = event == EVENT_SYSTEM_MINIMIZESTART || (event != EVENT_SYSTEM_MINIMIZEEND && ::IsIconic(hRoot));
+  BOOL cloaked = event == EVENT_OBJECT_CLOAKED;
+
+  if (!cloaked && event != EVENT_OBJECT_UNCLOAKED && FAILED(DwmGetWindowAttribute(hRoot, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))))
+    cloaked = FALSE;
+
+  SetWindowOccluded(!mWindowShown || minimized || cloaked);
+}
+
+void IGraphicsWin::SetWindowOccluded(bool occluded)
+{
+  if (!mPlugWnd || occluded == IsOccluded())
+    return;
+
+  if (occluded)
+  {
+    SetOccluded(true);
+
+    // the vsync thread waits for WakeVBlankThread() once nothing it notifies can be seen
+    if (!mVSYNCEnabled)
+      KillTimer(mPlugWnd, IPLUG_TIMER_ID);
+  }
+  else
+  {
+    mIdlePacing = false;
+    mLastActiveTime = ::GetTickCount();
+    SetOccluded(false);
+
+    if (mVSYNCEnabled)
+      WakeVBlankThread();
+    else
+      SetTimer(mPlugWnd, IPLUG_TIMER_ID, GetTimerInterval(), NULL);
+  }
+}
+
 void IGraphicsWin::OnDisplayTimer(int vBlankCount)
 {
   // Check the message vblank with the current one to see if we are way behind. If so, then throw these away.
@@ -242,6 +450,10 @@ void IGraphicsWin::OnDisplayTimer(int vBlankCount)
     return; // TODO: check this!
   }
 
+  // a tick that was already queued when the window was occluded
+  if (IsOccluded())
+    return;
+
   // TODO: move this... listen to the right messages in windows for screen resolution changes, etc.
   if (!GetCapture()) // workaround Windows issues with window sizing during mouse move
   {
@@ -250,11 +462,19 @@ void IGraphicsWin::OnDisplayTimer(int vBlankCount)
       SetScreenScale(scale);
   }
 
-  // TODO: this is far too aggressive for slow drawing animations and data changing.  We need to
-  // gate the rate of updates to a certain percentage of the wall clock time.
   IRECTList rects;
   const float totalScale = GetTotalScale();
-  if (IsDirty(rects))
+  const bool dirty = IsDirty(rects);
+
+  UpdateFramePacing(dirty || GetCapture() == mPlugWnd || mParamEditWnd);
+
+#ifdef IGRAPHICS_SKIA
+  // with a DXGI swap chain that still has a frame queued, leave the controls dirty for the next tick rather than blocking the UI thread in Present()
+  if (dirty && !IsReadyForFrame())
+    return;
+#endif
+
+  if (dirty)
   {
     SetAllControlsClean();
 
@@ -307,16 +527,16 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
     SetWindowLongPtr(hWnd, GWLP_USERDATA, (LPARAM)(lpcs->lpCreateParams));
     IGraphicsWin* pGraphics = (IGraphicsWin*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
 
+    pGraphics->mIdlePacing = false;
+    pGraphics->mLastActiveTime = ::GetTickCount();
+
     if(pGraphics->mVSYNCEnabled) // use VBLANK thread
     {
-      assert((pGraphics->FPS() == 60) && "If you want to run at frame rates other than 60FPS");
       pGraphics->StartVBlankThread(hWnd);
     }
-    else // use WM_TIMER -- its best to get below 16ms because the windows time quanta is slightly above 15ms.
+    else // use WM_TIMER
     {
-      int mSec = static_cast<int>(std::floorf(1000.0f / (pGraphics->FPS())));
-      if (mSec < 20) mSec = 15;
-      SetTimer(hWnd, IPLUG_TIMER_ID, mSec, NULL);
+      SetTimer(hWnd, IPLUG_TIMER_ID, pGraphics->GetTimerInterval(), NULL);
     }
 
     SetFocus(hWnd); // gets scroll wheel working straight away
@@ -350,6 +570,9 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
 
   pGraphics->CheckTabletInput(msg);
 
+  if ((msg >= WM_MOUSEFIRST && msg <= WM_MOUSELAST) || (msg >= WM_KEYFIRST && msg <= WM_KEYLAST) || msg == WM_TOUCH || msg == WM_MOUSELEAVE || msg == WM_DROPFILES)
+    pGraphics->WakeFromIdle();
+
   switch (msg)
   {
     case WM_VBLANK:
@@ -365,6 +588,11 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
     case WM_ERASEBKGND:
       return 0;
 
+    case WM_SHOWWINDOW:
+      pGraphics->mWindowShown = wParam != FALSE;
+      pGraphics->UpdateOcclusion();
+      return DefWindowProc(hWnd, msg, wParam, lParam);
+
     case WM_RBUTTONDOWN:
     case WM_LBUTTONDOWN:
     case WM_MBUTTONDOWN:
@@ -645,24 +873,37 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
           addDrawRect(rects, r);
         }
 
+#if defined IGRAPHICS_GL && defined IGRAPHICS_SKIA
+        // the Skia draw class copies CPU rasterized frames to the window itself, see IGraphicsSkia::SetPreferCPURaster()
+        const bool useGL = !pGraphics->IsCPURaster();
+#elif defined IGRAPHICS_GL
+        const bool useGL = true;
+#endif
+
 #if defined IGRAPHICS_GL //|| IGRAPHICS_D2D
         PAINTSTRUCT ps;
-        BeginPaint(hWnd, &ps);
+        if (useGL)
+          BeginPaint(hWnd, &ps);
 #endif
 
 #ifdef IGRAPHICS_GL
-        pGraphics->ActivateGLContext();
+        if (useGL)
+          pGraphics->ActivateGLContext();
 #endif
 
         pGraphics->Draw(rects);
 
         #ifdef IGRAPHICS_GL
-        SwapBuffers((HDC) pGraphics->GetPlatformContext());
-        pGraphics->DeactivateGLContext();
+        if (useGL)
+        {
+          SwapBuffers((HDC) pGraphics->GetPlatformContext());
+          pGraphics->DeactivateGLContext();
+        }
         #endif
 
 #if defined IGRAPHICS_GL || IGRAPHICS_D2D
-        EndPaint(hWnd, &ps);
+        if (useGL)
+          EndPaint(hWnd, &ps);
 #endif
       }
 
@@ -829,9 +1070,16 @@ IGraphicsWin::IGraphicsWin(IGEditorDelegate& dlg, int w, int h, int fps, float s
   fontStorage.Retain();
   hfontStorage.Retain();
 
+  static LowMemoryMonitor sLowMemoryMonitor;
+  sLowMemoryMonitor.Arm();
+
 #ifndef IGRAPHICS_DISABLE_VSYNC
   mVSYNCEnabled = IsWindows8OrGreater();
 #endif
+
+#ifdef IGRAPHICS_DISABLE_ADAPTIVE_FPS
+  mAdaptiveFrameRate = false;
+#endif
 }
 
 IGraphicsWin::~IGraphicsWin()
@@ -1114,6 +1362,10 @@ void* IGraphicsWin::OpenWindow(void* pParent)
 {
   mParentWnd = (HWND) pParent;
   int screenScale = GetScaleForHWND(mParentWnd);
+
+  // a new window starts out visible
+  mWindowShown = true;
+  SetOccluded(false);
   int x = 0, y = 0, w = WindowWidth() * screenScale, h = WindowHeight() * screenScale;
 
   if (mPlugWnd)
@@ -1136,11 +1388,20 @@ void* IGraphicsWin::OpenWindow(void* pParent)
 
   mPlugWnd = CreateWindow(wndClassName, "IPlug", WS_CHILD | WS_VISIBLE | WS_CLIPCHILDREN | WS_CLIPSIBLINGS, x, y, w, h, mParentWnd, 0, mHInstance, this);
 
+  if (mPlugWnd)
+  {
+    StartOcclusionTracking();
+    UpdateOcclusion();
+  }
+
   HDC dc = GetDC(mPlugWnd);
   SetPlatformContext(dc);
   ReleaseDC(mPlugWnd, dc);
 
 #ifdef IGRAPHICS_GL
+  #ifdef IGRAPHICS_SKIA
+  if (!GetPreferCPURaster())
+  #endif
   CreateGLContext();
 #endif
 
@@ -1268,6 +1529,8 @@ void IGraphicsWin::CloseWindow()
 {
   if (mPlugWnd)
   {
+    StopOcclusionTracking();
+
     if(mVSYNCEnabled)
       StopVBlankThread();
     else
@@ -2060,23 +2323,88 @@ DWORD WINAPI VBlankRun(LPVOID lpParam)
   return pGraphics->OnVBlankRun();
 }
 
+// Get the refresh rate of a window's monitor, falling back to 60Hz
+static float GetMonitorRefreshRate(HWND hWnd)
+{
+  MONITORINFOEX monitorInfo = {};
+  monitorInfo.cbSize = sizeof(MONITORINFOEX);
+  DEVMODE displayMode = {};
+  displayMode.dmSize = sizeof(DEVMODE);
+
+  if (GetMonitorInfo(MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST), &monitorInfo)
+      && EnumDisplaySettings(monitorInfo.szDevice, ENUM_CURRENT_SETTINGS, &displayMode) && displayMode.dmDisplayFrequency > 1)
+  {
+    return static_cast<float>(displayMode.dmDisplayFrequency);
+  }
+
+  return 60.0f;
+}
+
 void IGraphicsWin::StartVBlankThread(HWND hWnd)
 {
   mVBlankWindow = hWnd;
+
+  // Draw on every nth vblank to get as close to FPS() as the refresh rate allows
+  const int divider = static_cast<int>(std::round(GetMonitorRefreshRate(hWnd) / FPS()));
+  mVBlankDivider = divider > 1 ? divider : 1;
+
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  // One vsync thread, started by the first window to open, notifies every window in the process
+  WDL_MutexLock lock(&sVBlankMutex);
+  sVBlankClients.Add(this);
+
+  if (sVBlankOwner)
+    return;
+
+  sVBlankOwner = this;
+#endif
+
+  LaunchVBlankThread();
+}
+
+void IGraphicsWin::LaunchVBlankThread()
+{
   mVBlankShutdown = false;
+  mVBlankWakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
   DWORD threadId = 0;
   mVBlankThread = ::CreateThread(NULL, 0, VBlankRun, this, 0, &threadId);
 }
 
 void IGraphicsWin::StopVBlankThread()
 {
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  {
+    WDL_MutexLock lock(&sVBlankMutex);
+    sVBlankClients.DeletePtr(this);
+
+    if (sVBlankOwner == this)
+      sVBlankOwner = nullptr;
+  }
+#endif
+
   if (mVBlankThread != INVALID_HANDLE_VALUE)
   {
     mVBlankShutdown = true;
+    ::SetEvent(mVBlankWakeEvent);
     ::WaitForSingleObject(mVBlankThread, 10000);
+    ::CloseHandle(mVBlankThread);
+    ::CloseHandle(mVBlankWakeEvent);
     mVBlankThread = INVALID_HANDLE_VALUE;
-    mVBlankWindow = 0;
+    mVBlankWakeEvent = nullptr;
+
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+    // The thread waits on this window's adapter, so hand it over to one of the windows that are still open
+    WDL_MutexLock lock(&sVBlankMutex);
+
+    if (!sVBlankOwner && sVBlankClients.GetSize())
+    {
+      sVBlankOwner = sVBlankClients.Get(0);
+      sVBlankOwner->LaunchVBlankThread();
+    }
+#endif
   }
+
+  mVBlankWindow = 0;
 }
 
 // Nasty kernel level definitions for wait for vblank.  Including the
@@ -2116,10 +2444,8 @@ DWORD IGraphicsWin::OnVBlankRun()
 {
   SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 
-  // TODO: get expected vsync value.  For now we will use a fallback
-  // of 60Hz
-  float rateFallback = 60.0f;
-  int rateMS = (int)(1000.0f / rateFallback);
+  int rateMS = (int)(1000.0f / GetMonitorRefreshRate(mVBlankWindow));
+  const int idleMS = 1000 / kIdleFPS;
 
   // We need to try to load the module and entry points to wait on v blank.
   // if anything fails, we try to gracefully fallback to sleeping for some
@@ -2146,8 +2472,9 @@ DWORD IGraphicsWin::OnVBlankRun()
   {
     while (mVBlankShutdown == false)
     {
-      Sleep(rateMS);
-      VBlankNotify();
+      const bool idle = VBlankThreadIsIdle();
+      ::WaitForSingleObject(mVBlankWakeEvent, VBlankThreadIsOccluded() ? INFINITE : idle ? idleMS : rateMS);
+      VBlankNotify(idle);
     }
   }
   else
@@ -2160,6 +2487,14 @@ DWORD IGraphicsWin::OnVBlankRun()
 
     while (mVBlankShutdown == false)
     {
+      if (VBlankThreadIsIdle())
+      {
+        // Nothing is being drawn, so don't wake the UI thread on every vblank, nor at all while nothing can be seen. WakeVBlankThread() signals the event
+        ::WaitForSingleObject(mVBlankWakeEvent, VBlankThreadIsOccluded() ? INFINITE : idleMS);
+        VBlankNotify(true);
+        continue;
+      }
+
       if (!adapterIsOpen)
       {
         // reacquire the adapter (at most once a second).
@@ -2209,7 +2544,7 @@ DWORD IGraphicsWin::OnVBlankRun()
       }
 
       // notify logic
-      VBlankNotify();
+      VBlankNotify(false);
     }
 
     // cleanup adapter before leaving
@@ -2232,10 +2567,74 @@ DWORD IGraphicsWin::OnVBlankRun()
   return 0;
 }
 
-void IGraphicsWin::VBlankNotify()
+void IGraphicsWin::VBlankNotify(bool idleTick)
+{
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  WDL_MutexLock lock(&sVBlankMutex);
+
+  for (int i = 0; i < sVBlankClients.GetSize(); i++)
+    sVBlankClients.Get(i)->PostVBlank(idleTick);
+#else
+  PostVBlank(idleTick);
+#endif
+}
+
+void IGraphicsWin::PostVBlank(bool idleTick)
 {
   mVBlankCount++;
-  ::PostMessage(mVBlankWindow, WM_VBLANK, mVBlankCount, 0);
+
+  if (IsOccluded())
+    return;
+
+  if (mIdlePacing)
+  {
+    // Idle windows sharing the thread with an active one are woken on every vblank, so pace them here
+    const DWORD now = ::GetTickCount();
+
+    if (idleTick || now - mLastIdleVBlank >= 1000 / kIdleFPS)
+    {
+      mLastIdleVBlank = now;
+      ::PostMessage(mVBlankWindow, WM_VBLANK, mVBlankCount, 0);
+    }
+  }
+  else if (mVBlankCount % mVBlankDivider == 0)
+    ::PostMessage(mVBlankWindow, WM_VBLANK, mVBlankCount, 0);
+}
+
+bool IGraphicsWin::VBlankThreadIsIdle() const
+{
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  WDL_MutexLock lock(&sVBlankMutex);
+
+  for (int i = 0; i < sVBlankClients.GetSize(); i++)
+  {
+    IGraphicsWin* pClient = sVBlankClients.Get(i);
+
+    if (!pClient->mIdlePacing && !pClient->IsOccluded())
+      return false;
+  }
+
+  return true;
+#else
+  return mIdlePacing || IsOccluded();
+#endif
+}
+
+bool IGraphicsWin::VBlankThreadIsOccluded() const
+{
+#ifdef IGRAPHICS_SHARED_RENDER_SCHEDULER
+  WDL_MutexLock lock(&sVBlankMutex);
+
+  for (int i = 0; i < sVBlankClients.GetSize(); i++)
+  {
+    if (!sVBlankClients.Get(i)->IsOccluded())
+      return false;
+  }
+
+  return true;
+#else
+  return IsOccluded();
+#endif
 }
 
 #ifndef NO_IGRAPHICS
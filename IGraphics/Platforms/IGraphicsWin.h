@@ -145,13 +145,64 @@ private:
 
   void StartVBlankThread(HWND hWnd);
   void StopVBlankThread();
-  void VBlankNotify();
+  void LaunchVBlankThread();
+
+  /** Called from the vsync thread on every vblank, or on every wake from its idle wait. Posts WM_VBLANK to each window that is due a frame
+   * @param idleTick \c true if the thread woke from its idle wait rather than a vblank */
+  void VBlankNotify(bool idleTick);
+
+  /** Post WM_VBLANK to this window if it is due a frame, see VBlankNotify() */
+  void PostVBlank(bool idleTick);
+
+  /** @return \c true if the vsync thread can wait for the idle interval instead of the next vblank. With IGRAPHICS_SHARED_RENDER_SCHEDULER, every window must be idle */
+  bool VBlankThreadIsIdle() const;
+
+  /** @return The interval for the WM_TIMER fallback, from the FPS */
+  int GetTimerInterval() const;
+
+  /** Switch to the idle frame rate once nothing has been dirty for kIdleTimeoutMS, called from OnDisplayTimer()
+   * @param active \c true if something was drawn, or the user is interacting with the UI */
+  void UpdateFramePacing(bool active);
+
+  /** Return to the full frame rate immediately, e.g. on user input */
+  void WakeFromIdle();
+
+  void RequestFrame() override { if (mPlugWnd) WakeFromIdle(); }
+
+  /** Wake the vsync thread from its idle or occluded wait */
+  void WakeVBlankThread();
+
+  /** @return \c true if the vsync thread can wait until it is woken, because every window it notifies is occluded */
+  bool VBlankThreadIsOccluded() const;
+
+  /** Follow the host's top level window being minimized or cloaked by DWM (e.g. on another virtual desktop) through WinEvent hooks shared by every window in the process */
+  void StartOcclusionTracking();
+  void StopOcclusionTracking();
+
+  /** Work out if the window can be seen, and pause or resume the display timer accordingly
+   * @param event The WinEvent that prompted the check, or 0 */
+  void UpdateOcclusion(DWORD event = 0);
+
+  /** Pause the display timer while the window is occluded, and resume it at full rate when it is visible again, see IGraphics::SetOccluded() */
+  void SetWindowOccluded(bool occluded);
+
+  static void CALLBACK OnWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hWnd, LONG idObject, LONG idChild, DWORD threadId, DWORD time);
+
+  static constexpr int kIdleFPS = 4; // display timer rate when nothing is dirty, so that controls made dirty by the delegate are still drawn
+  static constexpr DWORD kIdleTimeoutMS = 500;
   HWND mVBlankWindow = 0; // Window to post messages to for every vsync
   volatile bool mVBlankShutdown = false; // Flag to indiciate that the vsync thread should shutdown
   HANDLE mVBlankThread = INVALID_HANDLE_VALUE; //ID of thread.
   volatile DWORD mVBlankCount = 0; // running count of vblank events since the start of the window.
   int mVBlankSkipUntil = 0; // support for skipping vblank notification if the last callback took  too long.  This helps keep the message pump clear in the case of overload.
   bool mVSYNCEnabled = false;
+  HANDLE mVBlankWakeEvent = nullptr; // wakes the vsync thread from its idle wait
+  volatile int mVBlankDivider = 1; // the vsync thread posts every nth vblank, for FPS below the display's refresh rate
+  volatile bool mIdlePacing = false; // the display timer runs at kIdleFPS
+  DWORD mLastIdleVBlank = 0; // when WM_VBLANK was last posted while idle
+  bool mAdaptiveFrameRate = true;
+  DWORD mLastActiveTime = 0;
+  bool mWindowShown = true; // from WM_SHOWWINDOW, for hosts that hide the editor rather than close it
   
   const IParam* mEditParam = nullptr;
   IText mEditText;
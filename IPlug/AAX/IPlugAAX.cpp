@@ -41,6 +41,7 @@ void AAX_CEffectGUI_IPLUG::CreateViewContainer()
   
   if (pWindow && mPlug->HasUI())
   {
+    mPlug->SetEditorOpen(true);
     mPlug->OpenWindow(pWindow);
     
     IPlugAAXView_Interface* pViewInterface = (IPlugAAXView_Interface*) mPlug->GetAAXViewInterface();
@@ -53,6 +54,7 @@ void AAX_CEffectGUI_IPLUG::CreateViewContainer()
 void AAX_CEffectGUI_IPLUG::DeleteViewContainer() 
 {
   mPlug->CloseWindow();
+  mPlug->SetEditorOpen(false);
 }
 
 AAX_Result AAX_CEffectGUI_IPLUG::GetViewSize(AAX_Point* pNewViewSize) const
@@ -99,20 +101,23 @@ IPlugAAX::IPlugAAX(const InstanceInfo& info, const Config& config)
 {
   Trace(TRACELOC, "%s%s", config.pluginName, config.channelIOStr);
 
+  AttachParamSnapshot(*this);
+
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true);
   
   if (MaxNChannels(ERoute::kInput)) 
-  {
-    mLatencyDelay = std::unique_ptr<NChanDelayLine<PLUG_SAMPLE_DST>>(new NChanDelayLine<PLUG_SAMPLE_DST>(MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput)));
-    mLatencyDelay->SetDelayTime(config.latency);
-  }
+    CreateLatencyDelay();
   
-  SetBlockSize(DEFAULT_BLOCK_SIZE);
+  SetBlockSize(AAX_FIXED_BLOCK_SIZE > 0 ? AAX_FIXED_BLOCK_SIZE : DEFAULT_BLOCK_SIZE);
   
   mMaxNChansForMainInputBus = MaxNChannelsForBus(kInput, 0);
+
+  mQueuedParamValues.Resize(NParams());
+  mParamValueQueued.Resize(NParams());
+  memset(mParamValueQueued.Get(), 0, NParams() * sizeof(bool));
   
-  CreateTimer();
+  CreateTimer(true);
 }
 
 IPlugAAX::~IPlugAAX()
@@ -144,6 +149,12 @@ AAX_Result IPlugAAX::EffectInit()
     IParam* pParam = GetParam(i);
     AAX_IParameter* pAAXParam = nullptr;
     
+#if AAX_NORMALIZATION_TABLE_SIZE > 0
+    // the taper delegate's NormalizedToReal() is called for every host and control surface query, a table saves the shape's pow()/exp()
+    if (pParam->Type() == IParam::kTypeDouble && pParam->DisplayType() != IParam::kDisplayLinear && !pParam->GetNormalizationTableSize())
+      pParam->SetNormalizationTableSize(AAX_NORMALIZATION_TABLE_SIZE);
+#endif
+
     WDL_String* pParamIDStr = new WDL_String("_", 1);
     pParamIDStr->SetFormatted(MAX_AAX_PARAMID_LEN, "%i", i+kAAXParamIdxOffset);
     mParamIDs.Add(pParamIDStr);
@@ -156,7 +167,7 @@ AAX_Result IPlugAAX::EffectInit()
                                           AAX_CString(pParam->GetName()),
                                           pParam->GetDefault(),
                                           AAX_CIPlugTaperDelegate<double>(*pParam),
-                                          AAX_CUnitDisplayDelegateDecorator<double>(AAX_CNumberDisplayDelegate<double>(), AAX_CString(pParam->GetLabel())),
+                                          AAX_CUnitDisplayDelegateDecorator<double>(AAX_CIPlugDisplayDelegate<double>(*pParam), AAX_CString(pParam->GetLabel())),
                                           pParam->GetCanAutomate());
         
         pAAXParam->SetNumberOfSteps(128); // TODO: check this https://developer.digidesign.com/index.php?L1=5&L2=13&L3=56
@@ -170,7 +181,7 @@ AAX_Result IPlugAAX::EffectInit()
                                         AAX_CString(pParam->GetName()),
                                         (int)pParam->GetDefault(),
                                         AAX_CLinearTaperDelegate<int,1>((int)pParam->GetMin(), (int)pParam->GetMax()),
-                                        AAX_CUnitDisplayDelegateDecorator<int>(AAX_CNumberDisplayDelegate<int,0>(), AAX_CString(pParam->GetLabel())),
+                                        AAX_CUnitDisplayDelegateDecorator<int>(AAX_CIPlugDisplayDelegate<int>(*pParam), AAX_CString(pParam->GetLabel())),
                                         pParam->GetCanAutomate());
         
         pAAXParam->SetNumberOfSteps(128);
@@ -215,11 +226,117 @@ AAX_Result IPlugAAX::EffectInit()
   AAX_CSampleRate sr;
   Controller()->GetSampleRate(&sr);
   SetSampleRate(sr);
+  
+  // An instance keeps its stem formats, so the channel counts and pointer maps are set up once here rather than in every RenderAudio()
+  AAX_EStemFormat inFormat, outFormat;
+  Controller()->GetInputStemFormat(&inFormat);
+  Controller()->GetOutputStemFormat(&outFormat);
+  mNInChans = AAX_STEM_FORMAT_CHANNEL_COUNT(inFormat);
+  mNOutChans = AAX_STEM_FORMAT_CHANNEL_COUNT(outFormat);
+  
+  mInputPtrs.Resize(mNInChans + 1); // + the side chain
+  mOutputPtrs.Resize(MaxNChannels(ERoute::kOutput));
+  mFixedBlockMidiQueue.Resize(DEFAULT_BLOCK_SIZE);
+  
+  ConnectChannels(0);
+  
+#if AAX_DOES_HYBRID
+  const int nHybridChans = mNInChans + mNOutChans;
+  mHybridData.Resize(nHybridChans * AAX_HYBRID_MAX_BLOCK_SIZE);
+  mHybridPtrs.Resize(nHybridChans);
+  
+  for (int c = 0; c < nHybridChans; c++)
+    mHybridPtrs.Get()[c] = mHybridData.Get() + c * AAX_HYBRID_MAX_BLOCK_SIZE;
+#endif
+  
+  InitDeferred();
   OnReset();
   
   return AAX_SUCCESS;
 }
 
+void IPlugAAX::ConnectChannels(int sideChainChannel)
+{
+  if (!IsInstrument())
+  {
+    SetChannelConnections(ERoute::kInput, 0, mNInChans, true);
+    SetChannelConnections(ERoute::kInput, mNInChans, MaxNChannels(ERoute::kInput) - mNInChans, false);
+    
+    if (sideChainChannel)
+      SetChannelConnections(ERoute::kInput, mMaxNChansForMainInputBus, 1, true);
+  }
+  
+  const int maxNOutChans = MaxNChannels(ERoute::kOutput);
+  
+  SetChannelConnections(ERoute::kOutput, 0, maxNOutChans, true);
+  
+  if (MaxNBuses(kOutput) == 1) // single output bus, only connect available channels
+    SetChannelConnections(ERoute::kOutput, mNOutChans, maxNOutChans - mNOutChans, false);
+  // multi output buses, connect all buffers including AOS
+  
+  mSideChainChannel = sideChainChannel;
+}
+
+void IPlugAAX::AttachRenderBuffers(AAX_SIPlugRenderInfo* pRenderInfo, int sideChainChannel, int offset, int nFrames)
+{
+  if (!IsInstrument())
+  {
+    float** ppIn = mInputPtrs.Get();
+    
+    for (int c = 0; c < mNInChans; c++)
+      ppIn[c] = pRenderInfo->mAudioInputs[c] + offset;
+    
+    AttachBuffers(ERoute::kInput, 0, mNInChans, ppIn, nFrames);
+    
+    if (sideChainChannel)
+    {
+      ppIn[mNInChans] = pRenderInfo->mAudioInputs[sideChainChannel] + offset;
+      AttachBuffers(ERoute::kInput, mMaxNChansForMainInputBus, 1, ppIn + mNInChans, nFrames);
+    }
+  }
+  
+  float** ppOut = mOutputPtrs.Get();
+  const int nOutChans = mOutputPtrs.GetSize();
+  
+  for (int c = 0; c < nOutChans; c++)
+    ppOut[c] = pRenderInfo->mAudioOutputs[c] + offset;
+  
+  AttachBuffers(ERoute::kOutput, 0, nOutChans, ppOut, nFrames);
+}
+
+void IPlugAAX::ProcessFixedBlocks(AAX_SIPlugRenderInfo* pRenderInfo, int sideChainChannel, const ITimeInfo& timeInfo, int nFrames)
+{
+  ITimeInfo blockTimeInfo = timeInfo;
+  const double ppqPerSample = timeInfo.mTempo / (60. * GetHostSampleRate());
+  
+  for (int pos = 0; pos < nFrames; pos += AAX_FIXED_BLOCK_SIZE)
+  {
+    const int blockFrames = std::min(AAX_FIXED_BLOCK_SIZE, nFrames - pos);
+    mFixedBlockOffset = pos;
+    
+    while (!mFixedBlockMidiQueue.Empty() && mFixedBlockMidiQueue.Peek().mOffset < pos + blockFrames)
+    {
+      IMidiMsg msg = mFixedBlockMidiQueue.Peek();
+      msg.mOffset = std::max(msg.mOffset - pos, 0);
+      ProcessMidiMsgFromAPI(msg);
+      mFixedBlockMidiQueue.Remove();
+    }
+    
+    if (timeInfo.mTransportIsRunning)
+    {
+      blockTimeInfo.mSamplePos = timeInfo.mSamplePos + pos;
+      blockTimeInfo.mPPQPos = timeInfo.mPPQPos + pos * ppqPerSample;
+    }
+    
+    SetTimeInfo(blockTimeInfo);
+    AttachRenderBuffers(pRenderInfo, sideChainChannel, pos, blockFrames);
+    ProcessBuffers(0.0f, blockFrames);
+  }
+  
+  mFixedBlockOffset = 0;
+  mFixedBlockMidiQueue.Clear();
+}
+
 AAX_Result IPlugAAX::UpdateParameterNormalizedValue(AAX_CParamID paramID, double iValue, AAX_EUpdateSource iSource)
 {
   TRACE
@@ -256,15 +373,12 @@ AAX_Result IPlugAAX::UpdateParameterNormalizedValue(AAX_CParamID paramID, double
 void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo, const TParamValPair* inSynchronizedParamValues[], int32_t inNumSynchronizedParamValues)
 {
   TRACE
+  auto denormalScope = MakeDenormalScope();
 
   // Get bypass parameter value
   bool bypass;
   mBypassParameter->GetValueAsBool(&bypass);
   
-  AAX_EStemFormat inFormat, outFormat;
-  Controller()->GetInputStemFormat(&inFormat);
-  Controller()->GetOutputStemFormat(&outFormat);
-  
   if (DoesMIDIIn()) 
   {
     AAX_IMIDINode* pMidiIn = pRenderInfo->mInputNode;
@@ -275,7 +389,12 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo, const TParamValPai
     for (auto i = 0; i<packets_count; i++, pMidiPacket++)
     {
       IMidiMsg msg(pMidiPacket->mTimestamp, pMidiPacket->mData[0], pMidiPacket->mData[1], pMidiPacket->mData[2]);
-      ProcessMidiMsg(msg);
+      
+      if (AAX_FIXED_BLOCK_SIZE > 0 && !bypass)
+        mFixedBlockMidiQueue.Add(msg); // delivered with the block it falls in
+      else
+        ProcessMidiMsgFromAPI(msg);
+      
       mMidiMsgsFromProcessor.Push(msg);
     }
   }
@@ -284,45 +403,21 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo, const TParamValPai
   mTransport = pTransportNode->GetTransport();
 
   int32_t numSamples = *(pRenderInfo->mNumSamples);
-  int32_t numInChannels = AAX_STEM_FORMAT_CHANNEL_COUNT(inFormat);
-  int32_t numOutChannels = AAX_STEM_FORMAT_CHANNEL_COUNT(outFormat);
+  const int blockSize = AAX_FIXED_BLOCK_SIZE > 0 ? std::min(numSamples, (int32_t) AAX_FIXED_BLOCK_SIZE) : numSamples;
 
-  if (numSamples > GetBlockSize())
+  if (blockSize > GetHostBlockSize())
   {
-    SetBlockSize(numSamples);
+    SetBlockSize(blockSize);
     OnReset();
   }
 
-  if (!IsInstrument())
-  {
-    SetChannelConnections(ERoute::kInput, 0, numInChannels, true);
-    SetChannelConnections(ERoute::kInput, numInChannels, MaxNChannels(ERoute::kInput) - numInChannels, false);
-    
-    int sideChainChannel = HasSidechainInput() ? *pRenderInfo->mSideChainP : 0;
-
-    if (sideChainChannel)
-    {
-      SetChannelConnections(ERoute::kInput, mMaxNChansForMainInputBus, 1, true);
-      AttachBuffers(ERoute::kInput, 0, numInChannels, pRenderInfo->mAudioInputs, numSamples);
-      AttachBuffers(ERoute::kInput, mMaxNChansForMainInputBus, 1, pRenderInfo->mAudioInputs + sideChainChannel, numSamples);
-    }
-    else
-      AttachBuffers(ERoute::kInput, 0, numInChannels, pRenderInfo->mAudioInputs, numSamples);
-  }
-    
-  int maxNOutChans = MaxNChannels(ERoute::kOutput);
+  const int sideChainChannel = (!IsInstrument() && HasSidechainInput()) ? *pRenderInfo->mSideChainP : 0;
   
-  SetChannelConnections(ERoute::kOutput, 0, maxNOutChans, true);
+  if (sideChainChannel != mSideChainChannel)
+    ConnectChannels(sideChainChannel);
   
-  if (MaxNBuses(kOutput) == 1) // single output bus, only connect available channels
-  {
-    SetChannelConnections(ERoute::kOutput, numOutChannels, maxNOutChans - numOutChannels, false);
-    AttachBuffers(ERoute::kOutput, 0, maxNOutChans, pRenderInfo->mAudioOutputs, numSamples);
-  }
-  else // multi output buses, connect all buffers including AOS
-  {
-    AttachBuffers(ERoute::kOutput, 0, maxNOutChans, pRenderInfo->mAudioOutputs, numSamples);
-  }
+  if (bypass || AAX_FIXED_BLOCK_SIZE <= 0)
+    AttachRenderBuffers(pRenderInfo, sideChainChannel, 0, numSamples);
   
   if (bypass) 
     PassThroughBuffers(0.0f, numSamples);
@@ -359,11 +454,32 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo, const TParamValPai
     
     while (mMidiMsgsFromEditor.Pop(msg))
     {
-      ProcessMidiMsg(msg);
+      if (AAX_FIXED_BLOCK_SIZE > 0)
+        mFixedBlockMidiQueue.Add(msg);
+      else
+        ProcessMidiMsgFromAPI(msg);
+    }
+    
+    // AAX native only delivers parameters that were registered via AddSynchronizedParameter() in sync with the audio, always at the start of the block
+    if (GetSampleAccurateAutomation())
+    {
+      for (int32_t i = 0; i < inNumSynchronizedParamValues; i++)
+      {
+        const int paramIdx = atoi(inSynchronizedParamValues[i]->first) - kAAXParamIdxOffset;
+        double value;
+
+        if ((paramIdx > kNoParameter) && (paramIdx < NParams()) && inSynchronizedParamValues[i]->second->GetValueAsDouble(&value))
+          AddParamChange(paramIdx, value, 0);
+      }
     }
     
     ENTER_PARAMS_MUTEX
-    ProcessBuffers(0.0f, numSamples);
+    ProcessParamValuesFromUI(numSamples);
+    
+    if (AAX_FIXED_BLOCK_SIZE > 0)
+      ProcessFixedBlocks(pRenderInfo, sideChainChannel, timeInfo, numSamples);
+    else
+      ProcessBuffers(0.0f, numSamples);
     LEAVE_PARAMS_MUTEX
   }
   
@@ -427,6 +543,8 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* pRenderInfo, const TParamValPai
             midiOut->PostMIDIPacket (&packet);
           }
         }
+
+        mSysExDataFromEditor.Release();
       }
     }
   }
@@ -451,13 +569,17 @@ AAX_Result IPlugAAX::GetChunkSize(AAX_CTypeID chunkID, uint32_t* pSize) const
     
   if (chunkID == GetUniqueID())
   {
-    IByteChunk chunk;
+    // Pro Tools asks for the size and then the chunk, so the chunk is serialized once for both
+    mChunkCache.Clear();
     
     //IByteChunk::InitChunkWithIPlugVer(&IPlugChunk);
     
-    if (SerializeState(chunk))
+    mChunkCacheValid = SerializeState(mChunkCache);
+    mChunkCacheVersion = GetStateVersion();
+
+    if (mChunkCacheValid)
     {
-      *pSize = chunk.Size();
+      *pSize = mChunkCache.Size();
     }
     
     return AAX_SUCCESS;
@@ -475,16 +597,23 @@ AAX_Result IPlugAAX::GetChunk(AAX_CTypeID chunkID, AAX_SPlugInChunk* pChunk) con
 
   if (chunkID == GetUniqueID())
   {
-    IByteChunk chunk;
+    // only used once, so that a plug-in that doesn't call DirtyState() for its custom data is serialized afresh next time
+    const bool cached = mChunkCacheValid && mChunkCacheVersion == GetStateVersion();
+    mChunkCacheValid = false;
+
+    if (!cached)
+    {
+      mChunkCache.Clear();
     
-    //IByteChunk::InitChunkWithIPlugVer(&IPlugChunk); // TODO: IPlugVer should be in chunk!
+      //IByteChunk::InitChunkWithIPlugVer(&IPlugChunk); // TODO: IPlugVer should be in chunk!
     
-    if (SerializeState(chunk))
-    {
-      pChunk->fSize = chunk.Size();
-      memcpy(pChunk->fData, chunk.GetData(), chunk.Size());
-      return AAX_SUCCESS;
+      if (!SerializeState(mChunkCache))
+        return AAX_ERROR_INVALID_CHUNK_ID;
     }
+
+    pChunk->fSize = mChunkCache.Size();
+    memcpy(pChunk->fData, mChunkCache.GetData(), mChunkCache.Size());
+    return AAX_SUCCESS;
   }
   
   return AAX_ERROR_INVALID_CHUNK_ID;
@@ -502,6 +631,13 @@ AAX_Result IPlugAAX::SetChunk(AAX_CTypeID chunkID, const AAX_SPlugInChunk* pChun
     int pos = 0;
     //IByteChunk::GetIPlugVerFromChunk(chunk, pos); // TODO: IPlugVer should be in chunk!
     pos = UnserializeState(chunk, pos);
+    DirtyState();
+
+    // values queued by the UI before the state was set would overwrite it
+    for (int i = 0; i < mQueuedParams.GetSize(); i++)
+      mParamValueQueued.Get()[mQueuedParams.Get()[i]] = false;
+
+    mQueuedParams.Resize(0, false);
     
     for (int i = 0; i< NParams(); i++)
       SetParameterNormalizedValue(mParamIDs.Get(i)->Get(), GetParam(i)->GetNormalized());
@@ -563,21 +699,53 @@ AAX_Result IPlugAAX::NotificationReceived (AAX_CTypeID type, const void* pData,
 void IPlugAAX::BeginInformHostOfParamChange(int idx)
 {
   TRACE
+  PostQueuedParamValue(idx);
   TouchParameter(mParamIDs.Get(idx)->Get());
 }
 
 void IPlugAAX::InformHostOfParamChange(int idx, double normalizedValue)
 {
   TRACE
-  SetParameterNormalizedValue(mParamIDs.Get(idx)->Get(), normalizedValue);
+  // each post goes through the host's automation and compare state, and is reflected to every control surface, so they are batched per timer tick
+  mQueuedParamValues.Get()[idx] = normalizedValue;
+
+  if (!mParamValueQueued.Get()[idx])
+  {
+    mParamValueQueued.Get()[idx] = true;
+    mQueuedParams.Add(idx);
+  }
 }
 
 void IPlugAAX::EndInformHostOfParamChange(int idx)
 {
   TRACE
+  PostQueuedParamValue(idx); // the last value belongs inside the touch
   ReleaseParameter(mParamIDs.Get(idx)->Get());
 }
 
+void IPlugAAX::PostQueuedParamValue(int idx)
+{
+  if (mParamValueQueued.Get()[idx])
+  {
+    // the index stays in mQueuedParams, and is skipped by PostQueuedParamValues() while the flag is clear
+    mParamValueQueued.Get()[idx] = false;
+    SetParameterNormalizedValue(mParamIDs.Get(idx)->Get(), mQueuedParamValues.Get()[idx]);
+  }
+}
+
+void IPlugAAX::PostQueuedParamValues()
+{
+  for (int i = 0; i < mQueuedParams.GetSize(); i++)
+    PostQueuedParamValue(mQueuedParams.Get()[i]);
+
+  mQueuedParams.Resize(0, false);
+}
+
+void IPlugAAX::TransmitMsgBatch()
+{
+  PostQueuedParamValues();
+}
+
 bool IPlugAAX::EditorResize(int viewWidth, int viewHeight)
 {
   if (HasUI())
@@ -611,6 +779,44 @@ void IPlugAAX::SetLatency(int latency)
 
 bool IPlugAAX::SendMidiMsg(const IMidiMsg& msg)
 {
-  mMidiOutputQueue.Add(msg);
+  IMidiMsg hostMsg = msg;
+  hostMsg.mOffset += mFixedBlockOffset; // relative to the host buffer, not the fixed block
+  mMidiOutputQueue.Add(hostMsg);
   return true;
 }
+
+#if AAX_DOES_HYBRID
+AAX_Result IPlugAAX::RenderAudio_Hybrid(AAX_SHybridRenderInfo* pRenderInfo)
+{
+  auto denormalScope = MakeDenormalScope();
+  const int nFrames = *(pRenderInfo->mNumSamples);
+  sample** ppIn = mHybridPtrs.Get();
+  sample** ppOut = ppIn + mNInChans;
+  
+  for (int pos = 0; pos < nFrames; pos += AAX_HYBRID_MAX_BLOCK_SIZE)
+  {
+    const int blockFrames = std::min(AAX_HYBRID_MAX_BLOCK_SIZE, nFrames - pos);
+    
+    for (int c = 0; c < mNInChans; c++)
+      VectorCopy(ppIn[c], pRenderInfo->mAudioInputs[c] + pos, blockFrames);
+    
+    ProcessHybridBlock(ppIn, ppOut, blockFrames);
+    
+    for (int c = 0; c < mNOutChans; c++)
+      VectorCopy(pRenderInfo->mAudioOutputs[c] + pos, ppOut[c], blockFrames);
+  }
+  
+  return AAX_SUCCESS;
+}
+
+void IPlugAAX::ProcessHybridBlock(sample** inputs, sample** outputs, int nFrames)
+{
+  for (int c = 0; c < mNOutChans; c++)
+  {
+    if (c < mNInChans)
+      VectorCopy(outputs[c], inputs[c], nFrames);
+    else
+      VectorZero(outputs[c], nFrames);
+  }
+}
+#endif
@@ -48,6 +48,25 @@ BEGIN_IPLUG_NAMESPACE
 
 const int kAAXParamIdxOffset = 1;
 
+/** Define AAX_FIXED_BLOCK_SIZE in config.h to a number of frames (e.g. 32, the AAX DSP quantum) to have IPlugAAX split each host buffer into blocks of that size,
+ * so that ProcessBlock() sees the same fixed block contract as it would on AAX DSP. Only the last block of a host buffer that isn't a multiple of it is shorter.
+ * 0 (the default) processes the host buffer in one block */
+#ifndef AAX_FIXED_BLOCK_SIZE
+  #define AAX_FIXED_BLOCK_SIZE 0
+#endif
+
+/** The largest block IPlugAAX::ProcessHybridBlock() is called with, when AAX_DOES_HYBRID is enabled. Larger host buffers are split */
+#ifndef AAX_HYBRID_MAX_BLOCK_SIZE
+  #define AAX_HYBRID_MAX_BLOCK_SIZE 4096
+#endif
+
+/** Define AAX_NORMALIZATION_TABLE_SIZE in config.h to a number of segments (e.g. IParam::kDefaultNormalizationTableSize) to give each non-linear double parameter
+ * that hasn't got one a normalization table in EffectInit(), see IParam::SetNormalizationTableSize(). Pro Tools and EUCON surfaces convert the values through the taper delegate
+ * for every query, and the table replaces the shape's pow()/exp() calls. Off by default, because it moves the values existing automation plays back by a tiny amount */
+#ifndef AAX_NORMALIZATION_TABLE_SIZE
+  #define AAX_NORMALIZATION_TABLE_SIZE 0
+#endif
+
 /** Used to pass various instance info to the API class */
 struct InstanceInfo {};
 
@@ -116,15 +135,61 @@ public:
   //IPlugAAX
   /** This is needed in chunks based plug-ins to tell PT a non-indexed param changed and to turn on the compare light. You can call this method from your plug-in implementation by doing a dynamic_cast in order to convert an "IPlug" into a "IPlugAAX"
    */
-  void DirtyPTCompareState() { mNumPlugInChanges++; }
+  void DirtyPTCompareState() { DirtyState(); mNumPlugInChanges++; }
+
+#if AAX_DOES_HYBRID
+  //AAX_CEffectParameters Overrides
+  AAX_Result RenderAudio_Hybrid(AAX_SHybridRenderInfo* pRenderInfo) override;
+
+  /** Override this to process the AAX Hybrid path, which Pro Tools runs on large buffers alongside RenderAudio(). Use it for the tail-heavy part of an effect (e.g. a long convolution) that doesn't fit the low latency path.
+   * Called on the hybrid thread with up to AAX_HYBRID_MAX_BLOCK_SIZE frames, and the same channel counts as the main bus. The default passes the input through
+   * @param inputs Two-dimensional array containing the hybrid input samples
+   * @param outputs Two-dimensional array to write the hybrid output samples to
+   * @param nFrames The number of frames to process */
+  virtual void ProcessHybridBlock(sample** inputs, sample** outputs, int nFrames);
+#endif
 
 private:
+  /** Connect the channels of the stem formats set up in EffectInit(), and the side chain channel if there is one */
+  void ConnectChannels(int sideChainChannel);
+
+  /** Attach a range of the host's buffers to the processor, through the precomputed pointer maps */
+  void AttachRenderBuffers(AAX_SIPlugRenderInfo* pRenderInfo, int sideChainChannel, int offset, int nFrames);
+
+  /** Process the host buffer in blocks of AAX_FIXED_BLOCK_SIZE, delivering the incoming MIDI and moving the transport with each block */
+  void ProcessFixedBlocks(AAX_SIPlugRenderInfo* pRenderInfo, int sideChainChannel, const ITimeInfo& timeInfo, int nFrames);
+
+  /** Post the parameter values from the UI that were queued since the last timer tick, the last value of each parameter, see InformHostOfParamChange() */
+  void PostQueuedParamValues();
+
+  /** Post the queued value of one parameter straight away, if it has one, so that it arrives before a TouchParameter() or ReleaseParameter() */
+  void PostQueuedParamValue(int idx);
+
+  void TransmitMsgBatch() override;
+
   AAX_CParameter<bool>* mBypassParameter = nullptr;
   AAX_ITransport* mTransport = nullptr;
   WDL_PtrList<WDL_String> mParamIDs;
+  WDL_TypedBuf<double> mQueuedParamValues; // normalized values from the UI, waiting for PostQueuedParamValues(), main thread
+  WDL_TypedBuf<bool> mParamValueQueued;
+  WDL_TypedBuf<int> mQueuedParams; // the parameters that were queued since the last tick, in the order they changed
   IMidiQueue mMidiOutputQueue;
   int mMaxNChansForMainInputBus = 0;
   WDL_String mTrackName;
+  int mNInChans = 0; // channel counts of the stem formats, set in EffectInit()
+  int mNOutChans = 0;
+  int mSideChainChannel = -1; // the connected side chain channel, -1 until the first block
+  int mFixedBlockOffset = 0; // the offset of the current fixed block in the host buffer, added to outgoing MIDI
+  WDL_TypedBuf<float*> mInputPtrs; // the host's buffers offset to the current block
+  WDL_TypedBuf<float*> mOutputPtrs;
+  IMidiQueue mFixedBlockMidiQueue;
+  mutable IByteChunk mChunkCache; // serialized by GetChunkSize() for the GetChunk() that follows it, at mChunkCacheVersion
+  mutable uint32_t mChunkCacheVersion = 0;
+  mutable bool mChunkCacheValid = false;
+#if AAX_DOES_HYBRID
+  WDL_TypedBuf<sample> mHybridData;
+  WDL_TypedBuf<sample*> mHybridPtrs; // inputs then outputs
+#endif
 };
 
 IPlugAAX* MakePlug(const InstanceInfo& info);
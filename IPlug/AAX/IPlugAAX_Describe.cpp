@@ -139,6 +139,12 @@ AAX_Result GetEffectDescriptions(AAX_ICollection* pC)
 
     setupInfo.mOutputStemFormat = (AAX_EStemFormat) GetAPIBusTypeForChannelIOConfig(configIdx, ERoute::kOutput, 0 /* first bus */, pConfig);
     
+#if AAX_DOES_HYBRID
+    // the hybrid path runs on the main bus channels, see IPlugAAX::ProcessHybridBlock()
+    setupInfo.mHybridInputStemFormat = setupInfo.mInputStemFormat;
+    setupInfo.mHybridOutputStemFormat = setupInfo.mOutputStemFormat;
+#endif
+    
     setupInfo.mNumAuxOutputStems = pConfig->NBuses(ERoute::kOutput) - 1;
         
     for (int i = 0; i < setupInfo.mNumAuxOutputStems; ++i)
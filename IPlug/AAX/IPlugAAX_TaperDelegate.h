@@ -13,6 +13,8 @@
 #include <cmath>
 
 #include "AAX_ITaperDelegate.h"
+#include "AAX_IDisplayDelegate.h"
+#include "AAX_CString.h"
 #include "AAX.h"
 
 #include "IPlugParameter.h"
@@ -37,6 +39,24 @@ private:
   IParam& mParam;
 };
 
+/** An AAX display delegate that formats values with IParam::GetDisplay(), so that Pro Tools and control surfaces show the same strings as the other formats, and the host's
+ * repeated queries for the same values are answered from the parameter's display cache. The label is added by an AAX_CUnitDisplayDelegateDecorator */
+template <typename T>
+class AAX_CIPlugDisplayDelegate : public AAX_IDisplayDelegate<T>
+{
+public:
+  AAX_CIPlugDisplayDelegate(IParam& iParam);
+
+  //Virtual AAX_IDisplayDelegate Overrides
+  AAX_CIPlugDisplayDelegate<T>* Clone() const;
+  bool ValueToString(T value, AAX_CString* pValueString) const;
+  bool ValueToString(T value, int32_t maxNumChars, AAX_CString* pValueString) const;
+  bool StringToValue(const AAX_CString& valueString, T* pValue) const;
+
+private:
+  IParam& mParam;
+};
+
 template <typename T>
 AAX_CIPlugTaperDelegate<T>::AAX_CIPlugTaperDelegate(IParam& iParam):AAX_ITaperDelegate<T>(),
   mParam(iParam)
@@ -67,4 +87,45 @@ double AAX_CIPlugTaperDelegate<T>::RealToNormalized(T realValue) const
   return mParam.ToNormalized(realValue);
 }
 
+template <typename T>
+AAX_CIPlugDisplayDelegate<T>::AAX_CIPlugDisplayDelegate(IParam& iParam):AAX_IDisplayDelegate<T>(),
+  mParam(iParam)
+{
+}
+
+template <typename T>
+AAX_CIPlugDisplayDelegate<T>* AAX_CIPlugDisplayDelegate<T>::Clone() const
+{
+  return new AAX_CIPlugDisplayDelegate(*this);
+}
+
+template <typename T>
+bool AAX_CIPlugDisplayDelegate<T>::ValueToString(T value, AAX_CString* pValueString) const
+{
+  WDL_String str;
+  mParam.GetDisplay((double) value, false, str);
+  pValueString->Set(str.Get());
+  return true;
+}
+
+template <typename T>
+bool AAX_CIPlugDisplayDelegate<T>::ValueToString(T value, int32_t maxNumChars, AAX_CString* pValueString) const
+{
+  WDL_String str;
+  mParam.GetDisplay((double) value, false, str);
+
+  if (maxNumChars >= 0 && str.GetLength() > maxNumChars)
+    str.SetLen(maxNumChars);
+
+  pValueString->Set(str.Get());
+  return true;
+}
+
+template <typename T>
+bool AAX_CIPlugDisplayDelegate<T>::StringToValue(const AAX_CString& valueString, T* pValue) const
+{
+  *pValue = (T) mParam.StringToValue(valueString.Get());
+  return true;
+}
+
 END_IPLUG_NAMESPACE
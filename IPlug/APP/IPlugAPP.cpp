@@ -33,6 +33,8 @@ IPlugAPP::IPlugAPP(const InstanceInfo& info, const Config& config)
 : IPlugAPIBase(config, kAPIAPP)
 , IPlugProcessor(config, kAPIAPP)
 {
+  AttachParamSnapshot(*this);
+
   mAppHost = (IPlugAPPHost*) info.pAppHost;
   
   Trace(TRACELOC, "%s%s", config.pluginName, config.channelIOStr);
@@ -42,7 +44,7 @@ IPlugAPP::IPlugAPP(const InstanceInfo& info, const Config& config)
 
   SetBlockSize(DEFAULT_BLOCK_SIZE);
   
-  CreateTimer();
+  CreateTimer(true);
 }
 
 bool IPlugAPP::EditorResize(int viewWidth, int viewHeight)
@@ -73,7 +75,7 @@ bool IPlugAPP::EditorResize(int viewWidth, int viewHeight)
 
 bool IPlugAPP::SendMidiMsg(const IMidiMsg& msg)
 {
-  if (DoesMIDIOut() && mAppHost->mMidiOut)
+  if (DoesMIDIOut() && mAppHost && mAppHost->mMidiOut)
   {
     //TODO: midi out channel
 //    uint8_t status;
@@ -97,7 +99,7 @@ bool IPlugAPP::SendMidiMsg(const IMidiMsg& msg)
 
 bool IPlugAPP::SendSysEx(const ISysEx& msg)
 {
-  if (DoesMIDIOut() && mAppHost->mMidiOut)
+  if (DoesMIDIOut() && mAppHost && mAppHost->mMidiOut)
   {
     //TODO: midi out channel
     std::vector<uint8_t> message;
@@ -119,20 +121,32 @@ void IPlugAPP::SendSysexMsgFromUI(const ISysEx& msg)
   SendSysEx(msg);
 }
 
-void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
+void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames, double blockTime)
 {
+  auto denormalScope = MakeDenormalScope();
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), !IsInstrument()); //TODO: go elsewhere - enable inputs
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true); //TODO: go elsewhere
-  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, GetBlockSize());
-  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, GetBlockSize());
+  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, GetHostBlockSize());
+  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, GetHostBlockSize());
   
   if(mMidiMsgsFromCallback.ElementsAvailable())
   {
-    IMidiMsg msg;
-    
-    while (mMidiMsgsFromCallback.Pop(msg))
+    const double sampleRate = GetSampleRate();
+    const double blockEnd = blockTime + nFrames / sampleRate;
+    TimedMidiMsg timedMsg;
+
+    while (mMidiMsgsFromCallback.ElementsAvailable())
     {
-      ProcessMidiMsg(msg);
+      // the messages arrive in order, so the rest are for a later block too
+      if (blockTime >= 0. && mMidiMsgsFromCallback.Peek().mTime >= blockEnd)
+        break;
+
+      mMidiMsgsFromCallback.Pop(timedMsg);
+
+      IMidiMsg& msg = timedMsg.mMsg;
+      msg.mOffset = blockTime >= 0. ? Clip(static_cast<int>((timedMsg.mTime - blockTime) * sampleRate), 0, nFrames - 1) : 0;
+
+      ProcessMidiMsgFromAPI(msg);
       mMidiMsgsFromProcessor.Push(msg); // queue incoming MIDI for UI
     }
   }
@@ -147,6 +161,8 @@ void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
       ProcessSysEx(msg);
       mSysExDataFromProcessor.Push(data); // queue incoming Sysex for UI
     }
+
+    mSysExMsgsFromCallback.Release();
   }
   
   if(mMidiMsgsFromEditor.ElementsAvailable())
@@ -155,13 +171,51 @@ void IPlugAPP::AppProcess(double** inputs, double** outputs, int nFrames)
 
     while (mMidiMsgsFromEditor.Pop(msg))
     {
-      ProcessMidiMsg(msg);
+      ProcessMidiMsgFromAPI(msg);
     }
   }
 
   //Do not handle Sysex messages here - SendSysexMsgFromUI overridden
 
   ENTER_PARAMS_MUTEX
-  ProcessBuffers(0.0, GetBlockSize());
+  ProcessParamValuesFromUI(GetHostBlockSize());
+  ProcessBuffers(0.0, GetHostBlockSize());
   LEAVE_PARAMS_MUTEX
 }
+
+void IPlugAPP::PrepareOfflineRender(double sampleRate, int blockSize, int nInputs, int nOutputs)
+{
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), false);
+  SetChannelConnections(ERoute::kInput, 0, std::min(std::max(nInputs, 0), MaxNChannels(ERoute::kInput)), true);
+  SetChannelConnections(ERoute::kOutput, 0, std::min(std::max(nOutputs, 0), MaxNChannels(ERoute::kOutput)), true);
+
+  SetSampleRate(sampleRate);
+  SetBlockSize(blockSize);
+  SetRenderingOffline(true);
+  mOfflineSamplePos = 0.;
+
+  InitDeferred();
+  OnParamReset(kReset);
+  OnReset();
+  OnActivate(true);
+}
+
+void IPlugAPP::ProcessOffline(sample** inputs, sample** outputs, int nFrames)
+{
+  auto denormalScope = MakeDenormalScope();
+  ITimeInfo timeInfo;
+  timeInfo.mSamplePos = mOfflineSamplePos;
+  timeInfo.mPPQPos = mOfflineSamplePos / GetHostSampleRate() * timeInfo.mTempo / 60.;
+  timeInfo.mTransportIsRunning = true;
+  SetTimeInfo(timeInfo);
+
+  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, nFrames);
+  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, nFrames);
+
+  ENTER_PARAMS_MUTEX
+  ProcessBuffers((sample) 0, nFrames);
+  LEAVE_PARAMS_MUTEX
+
+  mOfflineSamplePos += nFrames;
+}
@@ -28,6 +28,13 @@ struct InstanceInfo
   void* pAppHost;
 };
 
+/** A MIDI message from the host's MIDI input, with the time it arrived in seconds on the host's clock, see IPlugAPPHost::GetHostTime() */
+struct TimedMidiMsg
+{
+  IMidiMsg mMsg;
+  double mTime = -1.;
+};
+
 class IPlugAPPHost;
 
 /**  Standalone application base class for an IPlug plug-in
@@ -53,12 +60,32 @@ public:
   bool SendSysEx(const ISysEx& msg) override;
   
   //IPlugAPP
-  void AppProcess(double** inputs, double** outputs, int nFrames);
+  /** Process a block from the audio device
+   * @param inputs The input buffers
+   * @param outputs The output buffers
+   * @param nFrames The block size
+   * @param blockTime The host clock time the block's window for MIDI input starts at. MIDI messages that arrived during the window are delivered at the matching offset in the block,
+   * later ones are left for the next block. Pass -1 to deliver all of the waiting messages at the start of the block */
+  void AppProcess(double** inputs, double** outputs, int nFrames, double blockTime = -1.);
+
+  /** Set up the plug-in to render offline, without an audio device, see IPlugAPPRenderer
+   * @param sampleRate The sample rate
+   * @param blockSize The maximum number of frames that will be passed to ProcessOffline()
+   * @param nInputs The number of input channels to connect, clamped to the plug-in's maximum
+   * @param nOutputs The number of output channels to connect, clamped to the plug-in's maximum */
+  void PrepareOfflineRender(double sampleRate, int blockSize, int nInputs, int nOutputs);
+
+  /** Render a block offline, with the transport running from the start of the render
+   * @param inputs NChannelsConnected(ERoute::kInput) buffers of nFrames samples
+   * @param outputs NChannelsConnected(ERoute::kOutput) buffers of nFrames samples
+   * @param nFrames The number of frames, no more than the block size passed to PrepareOfflineRender() */
+  void ProcessOffline(sample** inputs, sample** outputs, int nFrames);
 
 private:
-  IPlugAPPHost* mAppHost = nullptr;
-  IPlugQueue<IMidiMsg> mMidiMsgsFromCallback {MIDI_TRANSFER_SIZE};
-  IPlugQueue<SysExData> mSysExMsgsFromCallback {SYSEX_TRANSFER_SIZE};
+  IPlugAPPHost* mAppHost = nullptr; // nullptr when rendering offline
+  double mOfflineSamplePos = 0.;
+  IPlugQueue<TimedMidiMsg> mMidiMsgsFromCallback {MIDI_TRANSFER_SIZE};
+  IPlugSysExQueue mSysExMsgsFromCallback {SYSEX_TRANSFER_BYTES};
 
   friend class IPlugAPPHost;
 };
@@ -14,6 +14,7 @@
 
 #ifdef OS_WIN
 #include "asio.h"
+#include <Dbt.h>
 #define GET_MENU() GetMenu(gHWND)
 #elif defined OS_MAC
 #define GET_MENU() SWELL_GetCurrentMenu()
@@ -30,6 +31,8 @@ using namespace igraphics;
 extern int GetTitleBarOffset();
 #endif
 
+static const UINT_PTR kLatencyMeasurementTimerID = 1;
+
 // check the input and output devices, find matching srs
 void IPlugAPPHost::PopulateSampleRateList(HWND hwndDlg, RtAudio::DeviceInfo* inputDevInfo, RtAudio::DeviceInfo* outputDevInfo)
 {
@@ -209,6 +212,30 @@ void IPlugAPPHost::PopulateAudioDialogs(HWND hwndDlg)
 
   LRESULT iovsidx = SendDlgItemMessage(hwndDlg, IDC_COMBO_AUDIO_BUF_SIZE, CB_FINDSTRINGEXACT, -1, (LPARAM) str.Get());
   SendDlgItemMessage(hwndDlg, IDC_COMBO_AUDIO_BUF_SIZE, CB_SETCURSEL, iovsidx, 0);
+
+#ifdef IDC_CB_LOW_LATENCY
+  SendDlgItemMessage(hwndDlg, IDC_CB_LOW_LATENCY, BM_SETCHECK, mState.mLowLatency ? BST_CHECKED : BST_UNCHECKED, 0);
+  PopulateLatencyText(hwndDlg);
+#endif
+}
+
+void IPlugAPPHost::PopulateLatencyText(HWND hwndDlg)
+{
+#ifdef IDC_STATIC_LATENCY
+  WDL_String str;
+  const int reported = GetReportedLatency();
+  const int measured = GetMeasuredLatency();
+
+  if (reported > 0)
+    str.SetFormatted(64, "Latency %.1f ms", reported * 1000. / mSampleRate);
+
+  if (IsMeasuringLatency())
+    str.Append("\nmeasuring...");
+  else if (measured >= 0)
+    str.AppendFormatted(64, "\nmeasured %.1f ms", measured * 1000. / mSampleRate);
+
+  SetDlgItemText(hwndDlg, IDC_STATIC_LATENCY, str.Get());
+#endif
 }
 
 bool IPlugAPPHost::PopulateMidiDialogs(HWND hwndDlg)
@@ -316,6 +343,7 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
   switch(uMsg)
   {
     case WM_INITDIALOG:
+      _this->WaitForDeviceProbe(); // usually finished in the background by now
       _this->PopulatePreferencesDialog(hwndDlg);
       mTempState = mState;
       
@@ -332,6 +360,7 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
           break;
         case IDAPPLY:
           _this->TryToChangeAudio();
+          _this->PopulateLatencyText(hwndDlg);
           break;
         case IDCANCEL:
           EndDialog(hwndDlg, IDCANCEL);
@@ -343,7 +372,7 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
             mState = mTempState;
 
             _this->TryToChangeAudioDriverType();
-            _this->ProbeAudioIO();
+            _this->WaitForDeviceProbe();
             _this->TryToChangeAudio();
           }
 
@@ -359,7 +388,7 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
               mState.mAudioDriverType = v;
 
               _this->TryToChangeAudioDriverType();
-              _this->ProbeAudioIO();
+              _this->WaitForDeviceProbe();
 
               if (_this->mAudioInputDevs.size())
                 mState.mAudioInDev.Set(_this->GetAudioDeviceName(_this->mAudioInputDevs[0]).c_str());
@@ -479,6 +508,28 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
           }
           break;
 
+#ifdef IDC_CB_LOW_LATENCY
+        case IDC_CB_LOW_LATENCY:
+          if (HIWORD(wParam) == BN_CLICKED)
+          {
+            mState.mLowLatency = !mState.mLowLatency;
+            SendDlgItemMessage(hwndDlg, IDC_CB_LOW_LATENCY, BM_SETCHECK, mState.mLowLatency ? BST_CHECKED : BST_UNCHECKED, 0);
+          }
+          break;
+
+        case IDC_BUTTON_MEASURE_LATENCY:
+          if (HIWORD(wParam) == BN_CLICKED && _this->mDAC->isStreamRunning())
+          {
+            if (MessageBox(hwndDlg, "Connect the first output to the first input (this will play a click), then press OK", "Measure Latency", MB_OKCANCEL) == IDOK)
+            {
+              _this->StartLatencyMeasurement();
+              _this->PopulateLatencyText(hwndDlg);
+              SetTimer(hwndDlg, kLatencyMeasurementTimerID, 100, NULL);
+            }
+          }
+          break;
+#endif
+
         case IDC_COMBO_MIDI_IN_DEV:
           if (HIWORD(wParam) == CBN_SELCHANGE)
           {
@@ -511,6 +562,18 @@ WDL_DLGRET IPlugAPPHost::PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wPar
           break;
       }
       break;
+#ifdef IDC_CB_LOW_LATENCY
+    case WM_TIMER:
+      if (wParam == kLatencyMeasurementTimerID && !_this->IsMeasuringLatency())
+      {
+        KillTimer(hwndDlg, kLatencyMeasurementTimerID);
+        _this->PopulateLatencyText(hwndDlg);
+
+        if (_this->GetMeasuredLatency() < 0)
+          MessageBox(hwndDlg, "The click wasn't detected on the first input", "Measure Latency", MB_OK);
+      }
+      break;
+#endif
     default:
       return FALSE;
   }
@@ -583,6 +646,13 @@ WDL_DLGRET IPlugAPPHost::MainDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPA
     case WM_CLOSE:
       DestroyWindow(hwndDlg);
       return 0;
+#ifdef OS_WIN
+    case WM_DEVICECHANGE:
+      // sent to top level windows when audio or MIDI devices are plugged in or removed
+      if (wParam == DBT_DEVNODES_CHANGED)
+        pAppHost->OnDevicesChanged();
+      return TRUE;
+#endif
     case WM_COMMAND:
       switch (LOWORD(wParam))
       {
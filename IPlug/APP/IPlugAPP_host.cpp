@@ -10,10 +10,22 @@
 
 #include "IPlugAPP_host.h"
 
+#include <chrono>
+#include <cmath>
+
 #ifdef OS_WIN
 #include <sys/stat.h>
 #endif
 
+#ifdef OS_MAC
+#include <CoreAudio/CoreAudio.h>
+#include <CoreMIDI/CoreMIDI.h>
+#include <dispatch/dispatch.h>
+#ifdef MAC_OS_VERSION_11_0
+#define IPLUG_APP_AUDIO_WORKGROUPS
+#endif
+#endif
+
 #include "IPlugLogger.h"
 
 using namespace iplug;
@@ -24,9 +36,41 @@ using namespace iplug;
 
 #define STRBUFSZ 100
 
+static constexpr double kLatencyMeasurementImpulse = 0.5;
+static constexpr double kLatencyMeasurementThreshold = 0.1;
+/** How far a MIDI message's time, from RtMidi's delta times, may be behind its arrival before it is timestamped with the arrival instead */
+static constexpr double kMaxMidiDeliveryDelay = 0.01;
+/** How quickly the stream time offset follows callbacks that are later than the earliest, so that it can follow the drift between the device and host clocks */
+static constexpr double kStreamTimeOffsetTracking = 0.001;
+
 std::unique_ptr<IPlugAPPHost> IPlugAPPHost::sInstance;
 UINT gSCROLLMSG;
 
+#ifdef OS_MAC
+static const AudioObjectPropertyAddress kDeviceListAddress = { kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal, 0 /* main element */ };
+
+static void DevicesChangedOnMainThread(void*)
+{
+  // the host may have gone by the time the main queue runs this
+  if (IPlugAPPHost::sInstance)
+    IPlugAPPHost::sInstance->OnDevicesChanged();
+}
+
+// called on a Core Audio notification thread
+static OSStatus AudioDevicesChanged(AudioObjectID, UInt32, const AudioObjectPropertyAddress*, void*)
+{
+  dispatch_async_f(dispatch_get_main_queue(), nullptr, DevicesChangedOnMainThread);
+  return noErr;
+}
+
+// called on the run loop of the thread that created the client, the main thread
+static void MIDISetupChanged(const MIDINotification* pNotification, void*)
+{
+  if (pNotification->messageID == kMIDIMsgSetupChanged)
+    DevicesChangedOnMainThread(nullptr);
+}
+#endif
+
 IPlugAPPHost::IPlugAPPHost()
 : mIPlug(MakePlug(InstanceInfo{this}))
 {
@@ -35,6 +79,16 @@ IPlugAPPHost::IPlugAPPHost()
 IPlugAPPHost::~IPlugAPPHost()
 {
   mExiting = true;
+
+#ifdef OS_MAC
+  AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &kDeviceListAddress, AudioDevicesChanged, nullptr);
+
+  if (mMIDIClient)
+    MIDIClientDispose((MIDIClientRef) mMIDIClient);
+#endif
+
+  if (mDeviceProbeThread.joinable())
+    mDeviceProbeThread.join();
   
   CloseAudio();
   
@@ -60,12 +114,22 @@ bool IPlugAPPHost::Init()
     return false;
   
   TryToChangeAudioDriverType(); // will init RTAudio with an API type based on gState->mAudioDriverType
-  ProbeAudioIO(); // find out what audio IO devs are available and put their IDs in the global variables gAudioInputDevs / gAudioOutputDevs
   InitMidi(); // creates RTMidiIn and RTMidiOut objects
-  ProbeMidiIO(); // find out what midi IO devs are available and put their names in the global variables gMidiInputDevs / gMidiOutputDevs
+  StartDeviceProbe(); // find out what audio and midi IO devs are available in the background, TryToChangeAudio() opens the saved devices without waiting for it if they haven't moved
+
+#ifdef OS_MAC
+  // windows gets WM_DEVICECHANGE, see MainDlgProc()
+  AudioObjectAddPropertyListener(kAudioObjectSystemObject, &kDeviceListAddress, AudioDevicesChanged, nullptr);
+
+  MIDIClientRef client = 0;
+  if (MIDIClientCreate(CFSTR(BUNDLE_NAME), MIDISetupChanged, nullptr, &client) == noErr)
+    mMIDIClient = (uint32_t) client;
+#endif
+
   SelectMIDIDevice(ERoute::kInput, mState.mMidiInDev.Get());
   SelectMIDIDevice(ERoute::kOutput, mState.mMidiOutDev.Get());
   
+  mIPlug->InitDeferred();
   mIPlug->OnParamReset(kReset);
   mIPlug->OnActivate(true);
   
@@ -74,12 +138,14 @@ bool IPlugAPPHost::Init()
 
 bool IPlugAPPHost::OpenWindow(HWND pParent)
 {
+  mIPlug->SetEditorOpen(true);
   return mIPlug->OpenWindow(pParent) != nullptr;
 }
 
 void IPlugAPPHost::CloseWindow()
 {
   mIPlug->CloseWindow();
+  mIPlug->SetEditorOpen(false);
 }
 
 bool IPlugAPPHost::InitState()
@@ -120,6 +186,9 @@ bool IPlugAPPHost::InitState()
 
       mState.mBufferSize = GetPrivateProfileInt("audio", "buffer", 512, mINIPath.Get());
       mState.mAudioSR = GetPrivateProfileInt("audio", "sr", 44100, mINIPath.Get());
+      mState.mLowLatency = GetPrivateProfileInt("audio", "lowlatency", 0, mINIPath.Get());
+      mState.mAudioInDevIdx = GetPrivateProfileInt("audio", "indevidx", -1, mINIPath.Get());
+      mState.mAudioOutDevIdx = GetPrivateProfileInt("audio", "outdevidx", -1, mINIPath.Get());
 
       //midi
       GetPrivateProfileString("midi", "indev", "no input", buf, STRBUFSZ, mINIPath.Get()); mState.mMidiInDev.Set(buf);
@@ -190,6 +259,14 @@ void IPlugAPPHost::UpdateINI()
   str.SetFormatted(32, "%i", mState.mAudioSR);
   WritePrivateProfileString("audio", "sr", str.Get(), ini);
 
+  sprintf(buf, "%u", mState.mLowLatency);
+  WritePrivateProfileString("audio", "lowlatency", buf, ini);
+
+  sprintf(buf, "%i", mState.mAudioInDevIdx);
+  WritePrivateProfileString("audio", "indevidx", buf, ini);
+  sprintf(buf, "%i", mState.mAudioOutDevIdx);
+  WritePrivateProfileString("audio", "outdevidx", buf, ini);
+
   WritePrivateProfileString("midi", "indev", mState.mMidiInDev.Get(), ini);
   WritePrivateProfileString("midi", "outdev", mState.mMidiOutDev.Get(), ini);
 
@@ -201,7 +278,11 @@ void IPlugAPPHost::UpdateINI()
 
 std::string IPlugAPPHost::GetAudioDeviceName(int idx) const
 {
-  return mAudioIDDevNames.at(idx);
+  // the devices may not have been probed yet
+  if (idx < 0 || idx >= (int) mAudioIDDevNames.size())
+    return std::string();
+
+  return mAudioIDDevNames[idx];
 }
 
 int IPlugAPPHost::GetAudioDeviceIdx(const char* deviceNameToTest) const
@@ -253,32 +334,41 @@ int IPlugAPPHost::GetMIDIPortNumber(ERoute direction, const char* nameToTest) co
   return -1;
 }
 
-void IPlugAPPHost::ProbeAudioIO()
+std::string IPlugAPPHost::TruncateDeviceName(const std::string& name)
+{
+  std::string deviceName = name;
+
+#ifdef OS_MAC
+  size_t colonIdx = deviceName.rfind(": ");
+
+  if(colonIdx != std::string::npos && deviceName.length() >= 2)
+    deviceName = deviceName.substr(colonIdx + 2, deviceName.length() - colonIdx - 2);
+#endif
+
+  return deviceName;
+}
+
+//static
+void IPlugAPPHost::ProbeAudioIO(RtAudio& dac, DeviceList& list)
 {
   std::cout << "\nRtAudio Version " << RtAudio::getVersion() << std::endl;
 
   RtAudio::DeviceInfo info;
 
-  mAudioInputDevs.clear();
-  mAudioOutputDevs.clear();
-  mAudioIDDevNames.clear();
+  list.mAudioInputDevs.clear();
+  list.mAudioOutputDevs.clear();
+  list.mAudioIDDevNames.clear();
+  list.mDefaultInputDev = -1;
+  list.mDefaultOutputDev = -1;
 
-  uint32_t nDevices = mDAC->getDeviceCount();
+  uint32_t nDevices = dac.getDeviceCount();
 
   for (int i=0; i<nDevices; i++)
   {
-    info = mDAC->getDeviceInfo(i);
-    std::string deviceName = info.name;
+    info = dac.getDeviceInfo(i);
+    std::string deviceName = TruncateDeviceName(info.name);
     
-#ifdef OS_MAC
-    size_t colonIdx = deviceName.rfind(": ");
-
-    if(colonIdx != std::string::npos && deviceName.length() >= 2)
-      deviceName = deviceName.substr(colonIdx + 2, deviceName.length() - colonIdx - 2);
-
-#endif
-    
-    mAudioIDDevNames.push_back(deviceName);
+    list.mAudioIDDevNames.push_back(deviceName);
 
     if ( info.probed == false )
       std::cout << deviceName << ": Probe Status = Unsuccessful\n";
@@ -287,53 +377,174 @@ void IPlugAPPHost::ProbeAudioIO()
     else
     {
       if(info.inputChannels > 0)
-        mAudioInputDevs.push_back(i);
+        list.mAudioInputDevs.push_back(i);
 
       if(info.outputChannels > 0)
-        mAudioOutputDevs.push_back(i);
+        list.mAudioOutputDevs.push_back(i);
 
       if (info.isDefaultInput)
-        mDefaultInputDev = i;
+        list.mDefaultInputDev = i;
 
       if (info.isDefaultOutput)
-        mDefaultOutputDev = i;
+        list.mDefaultOutputDev = i;
     }
   }
+
+  list.mAudioProbed = true;
 }
 
-void IPlugAPPHost::ProbeMidiIO()
+//static
+void IPlugAPPHost::ProbeMidiIO(RtMidiIn& midiIn, RtMidiOut& midiOut, DeviceList& list)
 {
-  if ( !mMidiIn || !mMidiOut )
-    return;
-  else
+  list.mMidiInputDevNames.clear();
+  list.mMidiOutputDevNames.clear();
+
+  int nInputPorts = midiIn.getPortCount();
+
+  list.mMidiInputDevNames.push_back(OFF_TEXT);
+
+#ifdef OS_MAC
+  list.mMidiInputDevNames.push_back("virtual input");
+#endif
+
+  for (int i=0; i<nInputPorts; i++ )
   {
-    int nInputPorts = mMidiIn->getPortCount();
+    list.mMidiInputDevNames.push_back(midiIn.getPortName(i));
+  }
 
-    mMidiInputDevNames.push_back(OFF_TEXT);
+  int nOutputPorts = midiOut.getPortCount();
+
+  list.mMidiOutputDevNames.push_back(OFF_TEXT);
 
 #ifdef OS_MAC
-    mMidiInputDevNames.push_back("virtual input");
+  list.mMidiOutputDevNames.push_back("virtual output");
 #endif
 
-    for (int i=0; i<nInputPorts; i++ )
+  for (int i=0; i<nOutputPorts; i++ )
+  {
+    list.mMidiOutputDevNames.push_back(midiOut.getPortName(i));
+    //This means the virtual output port wont be added as an input
+  }
+}
+
+void IPlugAPPHost::StartDeviceProbe()
+{
+  if (mDeviceProbeThread.joinable())
+  {
+    // the running probe may have missed the change
+    mDeviceProbeRestart = true;
+    return;
+  }
+
+  const RtAudio::Api api = mDAC ? mDAC->getCurrentApi() : RtAudio::UNSPECIFIED;
+  // a second ASIO instance would unload the driver of an open stream
+  const bool probeAudio = mDAC && api != RtAudio::WINDOWS_ASIO;
+  const bool probeMidi = mMidiIn && mMidiOut;
+
+  mDeviceProbeThread = std::thread([this, api, probeAudio, probeMidi]() {
+    DeviceList list;
+
+    try
+    {
+      if (probeAudio)
+      {
+        RtAudio dac(api);
+        ProbeAudioIO(dac, list);
+      }
+    }
+    catch (RtAudioError& e)
     {
-      mMidiInputDevNames.push_back(mMidiIn->getPortName(i));
+      e.printMessage();
     }
 
-    int nOutputPorts = mMidiOut->getPortCount();
+    try
+    {
+      if (probeMidi)
+      {
+        RtMidiIn midiIn;
+        RtMidiOut midiOut;
+        ProbeMidiIO(midiIn, midiOut, list);
+      }
+    }
+    catch (RtMidiError& e)
+    {
+      e.printMessage();
+    }
 
-    mMidiOutputDevNames.push_back(OFF_TEXT);
+    mProbedDevices = std::move(list);
+  });
+}
 
-#ifdef OS_MAC
-    mMidiOutputDevNames.push_back("virtual output");
-#endif
+void IPlugAPPHost::WaitForDeviceProbe()
+{
+  if (!mDevicesProbed && !mDeviceProbeThread.joinable())
+    StartDeviceProbe();
+
+  while (mDeviceProbeThread.joinable())
+  {
+    mDeviceProbeThread.join();
+
+    if (mDeviceProbeRestart)
+    {
+      mDeviceProbeRestart = false;
+      StartDeviceProbe();
+      continue;
+    }
+
+    DeviceList& list = mProbedDevices;
 
-    for (int i=0; i<nOutputPorts; i++ )
+    if (!list.mAudioProbed && mDAC)
     {
-      mMidiOutputDevNames.push_back(mMidiOut->getPortName(i));
-      //This means the virtual output port wont be added as an input
+      // ASIO, see StartDeviceProbe(). If a stream is open RtAudio returns the results it saved when opening it
+      try
+      {
+        ProbeAudioIO(*mDAC, list);
+      }
+      catch (RtAudioError& e)
+      {
+        e.printMessage();
+      }
+    }
+
+    mAudioInputDevs = std::move(list.mAudioInputDevs);
+    mAudioOutputDevs = std::move(list.mAudioOutputDevs);
+    mAudioIDDevNames = std::move(list.mAudioIDDevNames);
+    mDefaultInputDev = list.mDefaultInputDev;
+    mDefaultOutputDev = list.mDefaultOutputDev;
+    mMidiInputDevNames = std::move(list.mMidiInputDevNames);
+    mMidiOutputDevNames = std::move(list.mMidiOutputDevNames);
+    list = DeviceList();
+
+    mDevicesProbed = true;
+  }
+}
+
+void IPlugAPPHost::OnDevicesChanged()
+{
+  DBGMSG("devices changed, probing again\n");
+
+  StartDeviceProbe();
+}
+
+int IPlugAPPHost::FindAudioDevice(const char* name, int savedIdx)
+{
+  if (!mDevicesProbed && mDAC && savedIdx > -1)
+  {
+    // only probe the device it was last time, the background probe continues
+    try
+    {
+      if (savedIdx < (int) mDAC->getDeviceCount() && TruncateDeviceName(mDAC->getDeviceInfo(savedIdx).name) == name)
+        return savedIdx;
+    }
+    catch (RtAudioError& e)
+    {
+      e.printMessage();
     }
   }
+
+  WaitForDeviceProbe();
+
+  return GetAudioDeviceIdx(name);
 }
 
 bool IPlugAPPHost::AudioSettingsInStateAreEqual(AppState& os, AppState& ns)
@@ -347,6 +558,7 @@ bool IPlugAPPHost::AudioSettingsInStateAreEqual(AppState& os, AppState& ns)
   if (os.mAudioInChanR != ns.mAudioInChanR) return false;
   if (os.mAudioOutChanL != ns.mAudioOutChanL) return false;
   if (os.mAudioOutChanR != ns.mAudioOutChanR) return false;
+  if (os.mLowLatency != ns.mLowLatency) return false;
 //  if (os.mAudioInIsMono != ns.mAudioInIsMono) return false;
 
   return true;
@@ -371,6 +583,12 @@ bool IPlugAPPHost::TryToChangeAudioDriverType()
     mDAC = nullptr;
   }
 
+  // the lists are for the previous driver
+  mDevicesProbed = false;
+
+  if (mDeviceProbeThread.joinable())
+    mDeviceProbeRestart = true;
+
 #if defined OS_WIN
   if(mState.mAudioDriverType == kDeviceASIO)
     mDAC = std::make_unique<RtAudio>(RtAudio::WINDOWS_ASIO);
@@ -398,15 +616,15 @@ bool IPlugAPPHost::TryToChangeAudio()
 
 #if defined OS_WIN
   if(mState.mAudioDriverType == kDeviceASIO)
-    inputID = GetAudioDeviceIdx(mState.mAudioOutDev.Get());
+    inputID = FindAudioDevice(mState.mAudioOutDev.Get(), mState.mAudioOutDevIdx);
   else
-    inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
+    inputID = FindAudioDevice(mState.mAudioInDev.Get(), mState.mAudioInDevIdx);
 #elif defined OS_MAC
-  inputID = GetAudioDeviceIdx(mState.mAudioInDev.Get());
+  inputID = FindAudioDevice(mState.mAudioInDev.Get(), mState.mAudioInDevIdx);
 #else
   #error NOT IMPLEMENTED
 #endif
-  outputID = GetAudioDeviceIdx(mState.mAudioOutDev.Get());
+  outputID = FindAudioDevice(mState.mAudioOutDev.Get(), mState.mAudioOutDevIdx);
 
   bool failedToFindDevice = false;
   bool resetToDefault = false;
@@ -452,7 +670,18 @@ bool IPlugAPPHost::TryToChangeAudio()
 
   if (inputID != -1 && outputID != -1)
   {
-    return InitAudio(inputID, outputID, mState.mAudioSR, mState.mBufferSize);
+    if (!InitAudio(inputID, outputID, mState.mAudioSR, mState.mBufferSize))
+      return false;
+
+    // remember where the devices are, so that they can be opened before probing next time
+    if (mState.mAudioInDevIdx != inputID || mState.mAudioOutDevIdx != outputID)
+    {
+      mState.mAudioInDevIdx = mActiveState.mAudioInDevIdx = inputID;
+      mState.mAudioOutDevIdx = mActiveState.mAudioOutDevIdx = outputID;
+      UpdateINI();
+    }
+
+    return true;
   }
 
   return false;
@@ -571,6 +800,46 @@ void IPlugAPPHost::CloseAudio()
     
     mDAC->closeStream();
   }
+
+  UpdateAudioWorkgroup(-1);
+}
+
+void IPlugAPPHost::UpdateAudioWorkgroup(int deviceIdx)
+{
+  void* pWorkgroup = nullptr;
+
+#ifdef IPLUG_APP_AUDIO_WORKGROUPS
+  if (__builtin_available(macOS 11.0, *))
+  {
+    // RtAudio's CoreAudio device indices are positions in the system's device list
+    AudioObjectPropertyAddress address = { kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal, 0 /* main element */ };
+    UInt32 size = 0;
+
+    if (deviceIdx >= 0 && AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &address, 0, nullptr, &size) == noErr)
+    {
+      std::vector<AudioDeviceID> devices(size / sizeof(AudioDeviceID));
+
+      if (AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, 0, nullptr, &size, devices.data()) == noErr && deviceIdx < (int) devices.size())
+      {
+        os_workgroup_t workgroup = nullptr;
+        address.mSelector = kAudioDevicePropertyIOThreadOSWorkgroup;
+        size = sizeof(workgroup);
+
+        // the workgroup is returned retained
+        if (AudioObjectGetPropertyData(devices[deviceIdx], &address, 0, nullptr, &size, &workgroup) == noErr)
+          pWorkgroup = (void*) workgroup;
+      }
+    }
+  }
+#endif
+
+  if (GetPlug())
+    GetPlug()->SetAudioWorkgroup(pWorkgroup);
+
+  if (mpAudioWorkgroup)
+    CFRelease(mpAudioWorkgroup);
+
+  mpAudioWorkgroup = pWorkgroup;
 }
 
 bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_t iovs)
@@ -593,22 +862,58 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
 
   RtAudio::StreamOptions options;
   options.flags = RTAUDIO_NONINTERLEAVED;
-  // options.streamName = BUNDLE_NAME; // JACK stream name, not used on other streams
+  options.streamName = BUNDLE_NAME; // JACK stream name, not used on other streams
+
+  if (mState.mLowLatency)
+  {
+    // RtAudio takes the device for exclusive use where it can (CoreAudio hog mode, OSS) and runs its own callback threads (ALSA, OSS, PulseAudio) with realtime scheduling,
+    // clamping the priority to the maximum. The CoreAudio and JACK callback threads are realtime already, the DirectSound and ASIO ones are promoted in AudioCallback()
+    options.flags |= RTAUDIO_MINIMIZE_LATENCY | RTAUDIO_HOG_DEVICE | RTAUDIO_SCHEDULE_REALTIME;
+    options.priority = std::numeric_limits<int>::max();
+  }
+
+  mPromoteAudioThread = mState.mLowLatency;
 
-  mBufIndex = 0;
   mSamplesElapsed = 0;
   mSampleRate = (double) sr;
   mVecWait = 0;
+  mStreamTimeOffsetValid = false;
   mAudioEnding = false;
   mAudioDone = false;
-  
-  mIPlug->SetBlockSize(APP_SIGNAL_VECTOR_SIZE);
-  mIPlug->SetSampleRate(mSampleRate);
-  mIPlug->OnReset();
 
   try
   {
-    mDAC->openStream(&oParams, iParams.nChannels > 0 ? &iParams : nullptr, RTAUDIO_FLOAT64, sr, &mBufferSize, &AudioCallback, this, &options /*, &ErrorCallback */);
+    try
+    {
+      mDAC->openStream(&oParams, iParams.nChannels > 0 ? &iParams : nullptr, RTAUDIO_FLOAT64, sr, &mBufferSize, &AudioCallback, this, &options /*, &ErrorCallback */);
+    }
+    catch (RtAudioError& e)
+    {
+      if (!(options.flags & RTAUDIO_HOG_DEVICE))
+        throw;
+
+      // the device may be in use by another application, try sharing it
+      e.printMessage();
+      options.flags &= ~RTAUDIO_HOG_DEVICE;
+      mBufferSize = iovs;
+      mDAC->openStream(&oParams, iParams.nChannels > 0 ? &iParams : nullptr, RTAUDIO_FLOAT64, sr, &mBufferSize, &AudioCallback, this, &options /*, &ErrorCallback */);
+    }
+
+    // the stream has now set mBufferSize, start the plug-in and allocate the FIFO before the callback can run
+    mBlockSize = APP_SIGNAL_VECTOR_SIZE > 0 ? APP_SIGNAL_VECTOR_SIZE : mBufferSize;
+    mIPlug->SetBlockSize(mBlockSize);
+    mIPlug->SetSampleRate(mSampleRate);
+    mIPlug->InitDeferred();
+    mIPlug->OnReset();
+
+    mFIFOCapacity = 2 * (mBlockSize + mBufferSize);
+    mInputFIFO.Resize(mFIFOCapacity * std::max(iParams.nChannels, 1u));
+    mOutputFIFO.Resize(mFIFOCapacity * std::max(oParams.nChannels, 1u));
+    mInputFIFOCount = mOutputFIFOCount = 0;
+    mUseFIFO = false;
+
+    mInputBufPtrs.Empty();
+    mOutputBufPtrs.Empty();
     
     for (int i = 0; i < iParams.nChannels; i++)
     {
@@ -621,6 +926,7 @@ bool IPlugAPPHost::InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_
     }
     
     mDAC->startStream();
+    UpdateAudioWorkgroup((int) outId);
 
     mActiveState = mState;
   }
@@ -682,6 +988,28 @@ void ApplyFades(double *pBuffer, int nChans, int nFrames, bool down)
   }
 }
 
+/** Registers the calling audio thread for realtime scheduling, where RtAudio doesn't */
+static void PromoteAudioThread()
+{
+#ifdef OS_WIN
+  // the DirectSound and ASIO callback threads aren't registered with MMCSS
+  typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsFunc)(LPCSTR taskName, LPDWORD taskIndex);
+
+  HMODULE avrt = LoadLibraryA("avrt.dll");
+
+  if (avrt)
+  {
+    auto avSetMmThreadCharacteristics = (AvSetMmThreadCharacteristicsFunc) GetProcAddress(avrt, "AvSetMmThreadCharacteristicsA");
+    DWORD taskIndex = 0;
+
+    if (avSetMmThreadCharacteristics)
+      avSetMmThreadCharacteristics("Pro Audio", &taskIndex);
+
+    FreeLibrary(avrt);
+  }
+#endif
+}
+
 // static
 int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData)
 {
@@ -693,6 +1021,26 @@ int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_
   double* pInputBufferD = static_cast<double*>(pInputBuffer);
   double* pOutputBufferD = static_cast<double*>(pOutputBuffer);
 
+  if (_this->mPromoteAudioThread)
+  {
+    _this->mPromoteAudioThread = false;
+    PromoteAudioThread();
+  }
+
+  // RtAudio's stream time counts frames, so map it to the host clock with the earliest callback, the one that was delayed least by scheduling.
+  // MIDI that arrived during the previous buffer's worth of time goes at the same position in this buffer, which delays it by a buffer but without jitter
+  const double streamTimeOffset = GetHostTime() - streamTime;
+
+  if (!_this->mStreamTimeOffsetValid || streamTimeOffset < _this->mStreamTimeOffset)
+  {
+    _this->mStreamTimeOffset = streamTimeOffset;
+    _this->mStreamTimeOffsetValid = true;
+  }
+  else
+    _this->mStreamTimeOffset += (streamTimeOffset - _this->mStreamTimeOffset) * kStreamTimeOffsetTracking;
+
+  const double bufferTime = _this->mStreamTimeOffset + streamTime - nFrames / _this->mSampleRate;
+
   bool startWait = _this->mVecWait >= APP_N_VECTOR_WAIT; // wait APP_N_VECTOR_WAIT * iovs before processing audio, to avoid clicks
   bool doFade = _this->mVecWait == APP_N_VECTOR_WAIT || _this->mAudioEnding;
   
@@ -701,33 +1049,15 @@ int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_
     if (doFade)
       ApplyFades(pInputBufferD, nins, nFrames, _this->mAudioEnding);
     
-    for (int i = 0; i < nFrames; i++)
-    {
-      _this->mBufIndex %= APP_SIGNAL_VECTOR_SIZE;
-
-      if (_this->mBufIndex == 0)
-      {
-        for (int c = 0; c < nins; c++)
-        {
-          _this->mInputBufPtrs.Set(c, (pInputBufferD + (c * nFrames)) + i);
-        }
-        
-        for (int c = 0; c < nouts; c++)
-        {
-          _this->mOutputBufPtrs.Set(c, (pOutputBufferD + (c * nFrames)) + i);
-        }
-        
-        _this->mIPlug->AppProcess(_this->mInputBufPtrs.GetList(), _this->mOutputBufPtrs.GetList(), APP_SIGNAL_VECTOR_SIZE);
-
-        _this->mSamplesElapsed += APP_SIGNAL_VECTOR_SIZE;
-      }
-      
-      for (int c = 0; c < nouts; c++)
-      {
-        pOutputBufferD[c * nFrames + i] *= APP_MULT;
-      }
+    if (_this->mLatencyMeasurement.load() != ELatencyMeasurement::kIdle)
+      _this->ProcessLatencyMeasurement(pInputBufferD, pOutputBufferD, nins, nouts, nFrames);
+    else
+      _this->ProcessDeviceBuffer(pInputBufferD, pOutputBufferD, nins, nouts, nFrames, bufferTime);
 
-      _this->mBufIndex++;
+    if (APP_MULT != 1)
+    {
+      for (int i = 0; i < nouts * (int) nFrames; i++)
+        pOutputBufferD[i] *= APP_MULT;
     }
     
     if (doFade)
@@ -746,6 +1076,137 @@ int IPlugAPPHost::AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_
   return 0;
 }
 
+void IPlugAPPHost::ProcessDeviceBuffer(double* pInputBuffer, double* pOutputBuffer, int nIns, int nOuts, uint32_t nFrames, double bufferTime)
+{
+  const uint32_t blockSize = mBlockSize;
+
+  if (!mUseFIFO && nFrames % blockSize != 0)
+  {
+    // start with a block of silence in the output FIFO, so that there is always a device buffer's worth of output ready
+    mUseFIFO = true;
+    mInputFIFOCount = 0;
+    mOutputFIFOCount = blockSize;
+    memset(mOutputFIFO.Get(), 0, mOutputFIFO.GetSize() * sizeof(double));
+  }
+
+  if (!mUseFIFO)
+  {
+    for (uint32_t s = 0; s < nFrames; s += blockSize)
+    {
+      for (int c = 0; c < nIns; c++)
+        mInputBufPtrs.Set(c, pInputBuffer + c * nFrames + s);
+
+      for (int c = 0; c < nOuts; c++)
+        mOutputBufPtrs.Set(c, pOutputBuffer + c * nFrames + s);
+
+      mIPlug->AppProcess(mInputBufPtrs.GetList(), mOutputBufPtrs.GetList(), blockSize, bufferTime + s / mSampleRate);
+      mSamplesElapsed += blockSize;
+    }
+
+    return;
+  }
+
+  if (mInputFIFOCount + nFrames > mFIFOCapacity || mOutputFIFOCount + mInputFIFOCount + nFrames > mFIFOCapacity)
+  {
+    // a much bigger buffer than the stream was opened with, which RtAudio doesn't deliver. The FIFO can't be reallocated here
+    memset(pOutputBuffer, 0, nOuts * nFrames * sizeof(double));
+    return;
+  }
+
+  double* pInputFIFO = mInputFIFO.Get();
+  double* pOutputFIFO = mOutputFIFO.Get();
+  const uint32_t capacity = mFIFOCapacity;
+
+  for (int c = 0; c < nIns; c++)
+    memcpy(pInputFIFO + c * capacity + mInputFIFOCount, pInputBuffer + c * nFrames, nFrames * sizeof(double));
+
+  // the frames left in the FIFO came from the previous buffer
+  const double fifoTime = bufferTime - mInputFIFOCount / mSampleRate;
+  mInputFIFOCount += nFrames;
+
+  uint32_t consumed = 0;
+
+  for (; consumed + blockSize <= mInputFIFOCount; consumed += blockSize)
+  {
+    for (int c = 0; c < nIns; c++)
+      mInputBufPtrs.Set(c, pInputFIFO + c * capacity + consumed);
+
+    for (int c = 0; c < nOuts; c++)
+      mOutputBufPtrs.Set(c, pOutputFIFO + c * capacity + mOutputFIFOCount);
+
+    mIPlug->AppProcess(mInputBufPtrs.GetList(), mOutputBufPtrs.GetList(), blockSize, fifoTime + consumed / mSampleRate);
+    mSamplesElapsed += blockSize;
+    mOutputFIFOCount += blockSize;
+  }
+
+  mInputFIFOCount -= consumed;
+
+  for (int c = 0; c < nIns; c++)
+    memmove(pInputFIFO + c * capacity, pInputFIFO + c * capacity + consumed, mInputFIFOCount * sizeof(double));
+
+  for (int c = 0; c < nOuts; c++)
+  {
+    memcpy(pOutputBuffer + c * nFrames, pOutputFIFO + c * capacity, nFrames * sizeof(double));
+    memmove(pOutputFIFO + c * capacity, pOutputFIFO + c * capacity + nFrames, (mOutputFIFOCount - nFrames) * sizeof(double));
+  }
+
+  mOutputFIFOCount -= nFrames;
+}
+
+void IPlugAPPHost::ProcessLatencyMeasurement(const double* pInputBuffer, double* pOutputBuffer, int nIns, int nOuts, uint32_t nFrames)
+{
+  memset(pOutputBuffer, 0, nOuts * nFrames * sizeof(double));
+
+  if (nIns < 1 || nOuts < 1)
+  {
+    mLatencyMeasurement = ELatencyMeasurement::kIdle;
+    return;
+  }
+
+  if (mLatencyMeasurement.load() == ELatencyMeasurement::kSend)
+  {
+    pOutputBuffer[0] = kLatencyMeasurementImpulse;
+    mLatencyMeasurementFrames = 0;
+    mLatencyMeasurement = ELatencyMeasurement::kListen;
+  }
+
+  for (uint32_t i = 0; i < nFrames; i++)
+  {
+    if (std::fabs(pInputBuffer[i]) > kLatencyMeasurementThreshold)
+    {
+      mMeasuredLatency = (int) (mLatencyMeasurementFrames + i);
+      mLatencyMeasurement = ELatencyMeasurement::kIdle;
+      return;
+    }
+  }
+
+  mLatencyMeasurementFrames += nFrames;
+
+  if (mLatencyMeasurementFrames > mSampleRate)
+    mLatencyMeasurement = ELatencyMeasurement::kIdle; // nothing came back, mMeasuredLatency stays -1
+}
+
+int IPlugAPPHost::GetReportedLatency() const
+{
+  if (!mDAC || !mDAC->isStreamOpen())
+    return 0;
+
+  const bool hasInput = mIPlug->MaxNChannels(ERoute::kInput) > 0;
+
+  return (int) mDAC->getStreamLatency() + mBufferSize * (hasInput ? 2 : 1) + (mUseFIFO ? mBlockSize : 0);
+}
+
+void IPlugAPPHost::StartLatencyMeasurement()
+{
+  mMeasuredLatency = -1;
+  mLatencyMeasurement = ELatencyMeasurement::kSend;
+}
+
+bool IPlugAPPHost::IsMeasuringLatency() const
+{
+  return mLatencyMeasurement.load() != ELatencyMeasurement::kIdle;
+}
+
 // static
 void IPlugAPPHost::MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, void* pUserData)
 {
@@ -756,28 +1217,41 @@ void IPlugAPPHost::MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, vo
   
   if (pMsg->size() > 3)
   {
-    if(pMsg->size() > MAX_SYSEX_SIZE)
-    {
-      DBGMSG("SysEx message exceeds MAX_SYSEX_SIZE\n");
-      return;
-    }
-    
     SysExData data { 0, static_cast<int>(pMsg->size()), pMsg->data() };
     
-    _this->mIPlug->mSysExMsgsFromCallback.Push(data);
+    if (!_this->mIPlug->mSysExMsgsFromCallback.Push(data)) // copies data
+      DBGMSG("SysEx message dropped, it doesn't fit in SYSEX_TRANSFER_BYTES\n");
+    
     return;
   }
   else if (pMsg->size())
   {
-    IMidiMsg msg;
+    // RtMidi's delta times come from the driver's timestamps, so they keep the spacing of messages that are delivered together
+    const double now = GetHostTime();
+    double time = _this->mLastMidiTime + deltatime;
+
+    if (_this->mLastMidiTime < 0. || time > now || time < now - kMaxMidiDeliveryDelay)
+      time = now;
+
+    _this->mLastMidiTime = time;
+
+    TimedMidiMsg timedMsg;
+    IMidiMsg& msg = timedMsg.mMsg;
     msg.mStatus = pMsg->at(0);
     pMsg->size() > 1 ? msg.mData1 = pMsg->at(1) : msg.mData1 = 0;
     pMsg->size() > 2 ? msg.mData2 = pMsg->at(2) : msg.mData2 = 0;
+    timedMsg.mTime = time;
 
-    _this->mIPlug->mMidiMsgsFromCallback.Push(msg);
+    _this->mIPlug->mMidiMsgsFromCallback.Push(timedMsg);
   }
 }
 
+// static
+double IPlugAPPHost::GetHostTime()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 // static
 void IPlugAPPHost::ErrorCallback(RtAudioError::Type type, const std::string &errorText )
 {
@@ -33,6 +33,8 @@
 #include <vector>
 #include <limits>
 #include <memory>
+#include <atomic>
+#include <thread>
 
 #include "wdltypes.h"
 #include "wdlstring.h"
@@ -99,6 +101,12 @@ public:
     uint32_t mAudioInChanR;
     uint32_t mAudioOutChanL;
     uint32_t mAudioOutChanR;
+
+    uint32_t mLowLatency;
+
+    /** The RtAudio indices the devices had when they were last opened, or -1. Only a hint for opening them before the devices have been probed, so not compared */
+    int32_t mAudioInDevIdx;
+    int32_t mAudioOutDevIdx;
     
     AppState()
     : mAudioInDev(DEFAULT_INPUT_DEV)
@@ -115,6 +123,9 @@ public:
     , mAudioInChanR(2)
     , mAudioOutChanL(1)
     , mAudioOutChanR(2)
+    , mLowLatency(0)
+    , mAudioInDevIdx(-1)
+    , mAudioOutDevIdx(-1)
     {
     }
     
@@ -133,6 +144,9 @@ public:
     , mAudioInChanR(obj.mAudioInChanR)
     , mAudioOutChanL(obj.mAudioInChanL)
     , mAudioOutChanR(obj.mAudioInChanR)
+    , mLowLatency(obj.mLowLatency)
+    , mAudioInDevIdx(obj.mAudioInDevIdx)
+    , mAudioOutDevIdx(obj.mAudioOutDevIdx)
     {
     }
     
@@ -150,12 +164,26 @@ public:
               rhs.mAudioInChanL == mAudioInChanL &&
               rhs.mAudioInChanR == mAudioInChanR &&
               rhs.mAudioOutChanL == mAudioOutChanL &&
-              rhs.mAudioOutChanR == mAudioOutChanR
+              rhs.mAudioOutChanR == mAudioOutChanR &&
+              rhs.mLowLatency == mLowLatency
 
       );
     }
     bool operator!=(const AppState& rhs) const { return !operator==(rhs); }
   };
+
+  /** The devices found by a probe, see StartDeviceProbe() */
+  struct DeviceList
+  {
+    std::vector<uint32_t> mAudioInputDevs;
+    std::vector<uint32_t> mAudioOutputDevs;
+    std::vector<std::string> mAudioIDDevNames;
+    std::vector<std::string> mMidiInputDevNames;
+    std::vector<std::string> mMidiOutputDevNames;
+    int32_t mDefaultInputDev = -1;
+    int32_t mDefaultOutputDev = -1;
+    bool mAudioProbed = false;
+  };
   
   static IPlugAPPHost* Create();
   static std::unique_ptr<IPlugAPPHost> sInstance;
@@ -167,6 +195,7 @@ public:
   void PopulateAudioDialogs(HWND hwndDlg);
   bool PopulateMidiDialogs(HWND hwndDlg);
   void PopulatePreferencesDialog(HWND hwndDlg);
+  void PopulateLatencyText(HWND hwndDlg);
   
   IPlugAPPHost();
   ~IPlugAPPHost();
@@ -194,21 +223,68 @@ public:
    * @return An integer specifying the output port number, where 0 means any */
   int GetMIDIPortNumber(ERoute direction, const char* name) const;
   
-  /** find out which devices have input channels & which have output channels, add their ids to the lists */
-  void ProbeAudioIO();
-  void ProbeMidiIO();
+  /** find out which devices have input channels & which have output channels, add their ids to the lists. Can be called on any thread, with its own RtAudio instance */
+  static void ProbeAudioIO(RtAudio& dac, DeviceList& list);
+  static void ProbeMidiIO(RtMidiIn& midiIn, RtMidiOut& midiOut, DeviceList& list);
+
+  /** Start probing the devices on a background thread, with RtAudio and RtMidi instances of its own, so that drivers that are slow to enumerate don't stall the app.
+   * Called by Init() and when the system's devices change. ASIO can only load one driver at a time, so its audio devices are probed on the main thread by WaitForDeviceProbe() */
+  void StartDeviceProbe();
+
+  /** Wait for a running probe, or probe the devices if they haven't been, and update the device lists with the results. The lists are only read on the main thread, after this */
+  void WaitForDeviceProbe();
+
+  /** Called on the main thread when audio or MIDI devices are added or removed, to probe them again */
+  void OnDevicesChanged();
+
+  /** Find an audio device for TryToChangeAudio(). Before the devices have been probed a device that is still at its saved index is opened without waiting for the probe
+   * @param name The (truncated) device name
+   * @param savedIdx The index the device had when it was last opened, or -1
+   * @return The RtAudio device index, or -1 if it wasn't found */
+  int FindAudioDevice(const char* name, int savedIdx);
+
+  /** @return The device name RtAudio reports, with the Core Audio manufacturer prefix removed */
+  static std::string TruncateDeviceName(const std::string& name);
+
   bool InitMidi();
   void CloseAudio();
   bool InitAudio(uint32_t inId, uint32_t outId, uint32_t sr, uint32_t iovs);
+  /** Hand the plug-in the audio workgroup of the device its stream runs on, see IPlugProcessor::GetAudioWorkgroup(). Only does anything on macOS 11 or later
+   * @param deviceIdx The RtAudio index of the output device, or -1 to clear the workgroup */
+  void UpdateAudioWorkgroup(int deviceIdx);
   bool AudioSettingsInStateAreEqual(AppState& os, AppState& ns);
   bool MIDISettingsInStateAreEqual(AppState& os, AppState& ns);
 
   bool TryToChangeAudioDriverType();
   bool TryToChangeAudio();
   bool SelectMIDIDevice(ERoute direction, const char* portName);
+
+  /** @return The round-trip latency in frames that the device buffers, the driver and the host's FIFO add up to, or 0 if no stream is open */
+  int GetReportedLatency() const;
+
+  /** Measure the round-trip latency with a loopback: the plug-in is muted, an impulse is sent to the first output and the first input is listened to for up to a second.
+   * The first output must be connected to the first input, e.g. with a cable. Poll GetMeasuredLatency() for the result */
+  void StartLatencyMeasurement();
+
+  /** @return \c true while a latency measurement is running */
+  bool IsMeasuringLatency() const;
+
+  /** @return The last measured round-trip latency in frames, or -1 if nothing has been measured or the impulse wasn't detected */
+  int GetMeasuredLatency() const { return mMeasuredLatency.load(); }
   
   static int AudioCallback(void* pOutputBuffer, void* pInputBuffer, uint32_t nFrames, double streamTime, RtAudioStreamStatus status, void* pUserData);
+
+  /** Process a device buffer in blocks of mBlockSize. If the device buffer is a multiple of the block size the blocks are processed in place,
+   * otherwise they go through a FIFO which adds one block of latency
+   * @param bufferTime The host clock time the buffer's window for MIDI input starts at, see AudioCallback() */
+  void ProcessDeviceBuffer(double* pInputBuffer, double* pOutputBuffer, int nIns, int nOuts, uint32_t nFrames, double bufferTime);
+
+  /** Replaces the plug-in's processing while a latency measurement is running, see StartLatencyMeasurement() */
+  void ProcessLatencyMeasurement(const double* pInputBuffer, double* pOutputBuffer, int nIns, int nOuts, uint32_t nFrames);
   static void MIDICallback(double deltatime, std::vector<uint8_t>* pMsg, void* pUserData);
+
+  /** @return The time in seconds on a monotonic clock shared by the MIDI and audio callbacks, that MIDI input is timestamped with */
+  static double GetHostTime();
   static void ErrorCallback(RtAudioError::Type type, const std::string& errorText);
 
   static WDL_DLGRET PreferencesDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
@@ -234,7 +310,7 @@ private:
   uint32_t mSamplesElapsed = 0;
   uint32_t mVecWait = 0;
   uint32_t mBufferSize = 512;
-  uint32_t mBufIndex = 0; // index for signal vector, loops from 0 to mSigVS
+  uint32_t mBlockSize = 512; // the plug-in's block size, APP_SIGNAL_VECTOR_SIZE or the device buffer size if that is 0
   bool mExiting = false;
   bool mAudioEnding = false;
   bool mAudioDone = false;
@@ -251,10 +327,43 @@ private:
   std::vector<std::string> mAudioIDDevNames;
   std::vector<std::string> mMidiInputDevNames;
   std::vector<std::string> mMidiOutputDevNames;
+
+  /** The background probe, see StartDeviceProbe(). mProbedDevices is written by it and read on the main thread after it has been joined */
+  std::thread mDeviceProbeThread;
+  DeviceList mProbedDevices;
+  /** \c true once the lists above have been filled by a probe for the current driver */
+  bool mDevicesProbed = false;
+  /** Set if the devices or the driver changed while a probe was running, so it has to run again */
+  bool mDeviceProbeRestart = false;
+#ifdef OS_MAC
+  uint32_t mMIDIClient = 0; // MIDIClientRef, notified of MIDI setup changes
+#endif
   
   WDL_PtrList<double> mInputBufPtrs;
   WDL_PtrList<double> mOutputBufPtrs;
 
+  /** The FIFO for device buffers that aren't a multiple of the block size, non-interleaved with mFIFOCapacity frames per channel. Allocated in InitAudio() */
+  WDL_TypedBuf<double> mInputFIFO;
+  WDL_TypedBuf<double> mOutputFIFO;
+  uint32_t mFIFOCapacity = 0;
+  uint32_t mInputFIFOCount = 0;
+  uint32_t mOutputFIFOCount = 0;
+  bool mUseFIFO = false; // set for the rest of the stream once the device delivers a buffer that isn't a multiple of the block size
+
+  bool mPromoteAudioThread = false; // set by InitAudio() in low latency mode, so that the first callback can register its thread for realtime scheduling
+  void* mpAudioWorkgroup = nullptr; // retained os_workgroup_t of the current output device
+
+  enum class ELatencyMeasurement { kIdle, kSend, kListen };
+  std::atomic<ELatencyMeasurement> mLatencyMeasurement {ELatencyMeasurement::kIdle};
+  std::atomic<int> mMeasuredLatency {-1};
+  uint32_t mLatencyMeasurementFrames = 0; // frames since the impulse was sent
+
+  /** The host clock time at stream time 0, estimated from the earliest callbacks, see AudioCallback(). Reset by InitAudio() */
+  double mStreamTimeOffset = 0.;
+  bool mStreamTimeOffsetValid = false;
+  /** The time the last MIDI message arrived, on the MIDI callback thread */
+  double mLastMidiTime = -1.;
+
   friend class IPlugAPP;
 };
 
@@ -14,6 +14,7 @@
 
 #include "IPlugPlatform.h"
 #include "IPlugAPP_host.h"
+#include "IPlugAPP_render.h"
 
 #include "config.h"
 #include "resource.h"
@@ -33,6 +34,19 @@ UINT gScrollMessage;
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpszCmdParam, int nShowCmd)
 {
+  // a console render doesn't open a window, so it doesn't count as another instance
+  if (IPlugAPPRenderer::IsRenderCommandLine(__argc, __argv))
+  {
+    if (AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+      freopen("CONOUT$", "w", stdout);
+      freopen("CONOUT$", "w", stderr);
+    }
+
+    gHINSTANCE = hInstance;
+    return IPlugAPPRenderer::Run(__argc, __argv);
+  }
+
   try
   {
 #ifndef APP_ALLOW_MULTIPLE_INSTANCES
@@ -165,6 +179,9 @@ int main(int argc, char *argv[])
   }
 #endif
   
+  if (IPlugAPPRenderer::IsRenderCommandLine(argc, argv))
+    return IPlugAPPRenderer::Run(argc, argv);
+
   if(AppIsSandboxed())
     DBGMSG("App is sandboxed, file system access etc restricted!\n");
   
@@ -0,0 +1,322 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugAPPRenderer
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "IPlugAPP.h"
+#include "WAVReader.h"
+#include "fileread.h"
+#include "wavwrite.h"
+#include "wdlstring.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Headless offline rendering of WAV files through the plug-in, for batch processing from the command line without a DAW. When the app is started with --render
+ * as its first argument, it renders the files and exits instead of opening its window and audio device:
+ *
+ *   MyPlugin --render [options] in1.wav in2.wav ...
+ *
+ * Options:
+ *   --out DIR               Where to write the results (default: next to each input, with the suffix)
+ *   --suffix STR            Appended to the name of each result (default "-render", or nothing with --out)
+ *   --block N               Frames per block (default 8192). Offline, the largest block the plug-in copes with is the fastest
+ *   --bits 16|24            The bit depth of the results (default 24), which are at the sample rate of their input
+ *   --jobs N                The number of files to render in parallel, each on its own plug-in instance (default: the number of cores)
+ *   --tail SECONDS          Render this long past the end of each input, for reverb tails (default 0)
+ *   --param IDX=VALUE       Set a parameter, in its own units, before rendering. Can be repeated
+ *   --no-latency-compensation  Keep the plug-in's latency at the start of the results, rather than trimming it
+ *
+ * The plug-in is rendered with IPlugProcessor::GetRenderingOffline() \c true, so it can use its higher quality offline code paths.
+ * The instances are made on the main thread, as a host would, and each one renders whole files on its own thread.
+ * This is header only so that the app projects don't need another source file, IPlugAPP_main.cpp includes it */
+class IPlugAPPRenderer
+{
+public:
+  /** @return \c true if the command line asks for an offline render */
+  static bool IsRenderCommandLine(int argc, const char* const* argv)
+  {
+    return argc > 1 && !strcmp(argv[1], "--render");
+  }
+
+  /** Render the files on the command line
+   * @return The exit code, 0 if all the files were rendered */
+  static int Run(int argc, const char* const* argv)
+  {
+    Options options;
+
+    if (!ParseOptions(argc, argv, options))
+    {
+      PrintUsage();
+      return 1;
+    }
+
+    const int nJobs = std::max(1, std::min(options.mNJobs > 0 ? options.mNJobs : static_cast<int>(std::thread::hardware_concurrency()), static_cast<int>(options.mFiles.size())));
+
+    std::vector<std::unique_ptr<IPlugAPP>> plugs;
+
+    for (int i = 0; i < nJobs; i++)
+    {
+      plugs.emplace_back(MakePlug(InstanceInfo{nullptr}));
+
+      for (auto& param : options.mParams)
+      {
+        if (param.first >= 0 && param.first < plugs.back()->NParams())
+          plugs.back()->GetParam(param.first)->Set(param.second);
+      }
+    }
+
+    std::atomic<int> nextFile{0};
+    std::atomic<int> nFailed{0};
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < nJobs; i++)
+    {
+      threads.emplace_back([&, i]() {
+        for (int f = nextFile++; f < static_cast<int>(options.mFiles.size()); f = nextFile++)
+        {
+          if (!RenderFile(*plugs[i], options, options.mFiles[f].c_str()))
+            nFailed++;
+        }
+      });
+    }
+
+    for (auto& thread : threads)
+      thread.join();
+
+    return nFailed ? 2 : 0;
+  }
+
+private:
+  struct Options
+  {
+    std::string mOutDir;
+    std::string mSuffix;
+    bool mHasSuffix = false;
+    int mBlockSize = 8192;
+    int mBits = 24;
+    int mNJobs = 0;
+    double mTailSeconds = 0.;
+    bool mCompensateLatency = true;
+    std::vector<std::pair<int, double>> mParams;
+    std::vector<std::string> mFiles;
+  };
+
+  static void PrintUsage()
+  {
+    fprintf(stderr, "usage: --render [--out DIR] [--suffix STR] [--block N] [--bits 16|24] [--jobs N] [--tail SECONDS]\n"
+                    "                [--param IDX=VALUE]... [--no-latency-compensation] in1.wav [in2.wav ...]\n");
+  }
+
+  static bool ParseOptions(int argc, const char* const* argv, Options& options)
+  {
+    for (int i = 2; i < argc; i++)
+    {
+      const char* arg = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+      auto needsValue = [&]() {
+        if (!value)
+          fprintf(stderr, "%s needs a value\n", arg);
+        else
+          i++;
+
+        return value != nullptr;
+      };
+
+      if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+        return false;
+      else if (!strcmp(arg, "--out"))
+      {
+        if (!needsValue()) return false;
+        options.mOutDir = value;
+      }
+      else if (!strcmp(arg, "--suffix"))
+      {
+        if (!needsValue()) return false;
+        options.mSuffix = value;
+        options.mHasSuffix = true;
+      }
+      else if (!strcmp(arg, "--block"))
+      {
+        if (!needsValue()) return false;
+        options.mBlockSize = std::max(atoi(value), 1);
+      }
+      else if (!strcmp(arg, "--bits"))
+      {
+        if (!needsValue()) return false;
+        options.mBits = atoi(value);
+
+        if (options.mBits != 16 && options.mBits != 24)
+          return false;
+      }
+      else if (!strcmp(arg, "--jobs"))
+      {
+        if (!needsValue()) return false;
+        options.mNJobs = atoi(value);
+      }
+      else if (!strcmp(arg, "--tail"))
+      {
+        if (!needsValue()) return false;
+        options.mTailSeconds = std::max(atof(value), 0.);
+      }
+      else if (!strcmp(arg, "--param"))
+      {
+        int idx;
+        double paramValue;
+
+        if (!needsValue() || sscanf(value, "%d=%lf", &idx, &paramValue) != 2) return false;
+        options.mParams.push_back({idx, paramValue});
+      }
+      else if (!strcmp(arg, "--no-latency-compensation"))
+        options.mCompensateLatency = false;
+      else if (arg[0] == '-' && arg[1] == '-')
+      {
+        fprintf(stderr, "unknown option %s\n", arg);
+        return false;
+      }
+      else
+        options.mFiles.push_back(arg);
+    }
+
+    if (!options.mHasSuffix)
+      options.mSuffix = options.mOutDir.empty() ? "-render" : "";
+
+    return !options.mFiles.empty();
+  }
+
+  static void MakeOutputPath(const Options& options, const char* inPath, WDL_String& outPath)
+  {
+    WDL_String name(inPath);
+    name.remove_fileext();
+    name.Append(options.mSuffix.c_str());
+    name.Append(".wav");
+
+    if (options.mOutDir.empty())
+      outPath.Set(name.Get());
+    else
+    {
+      outPath.Set(options.mOutDir.c_str());
+
+      if (outPath.GetLength() && outPath.Get()[outPath.GetLength() - 1] != WDL_DIRCHAR)
+        outPath.Append(WDL_DIRCHAR_STR);
+
+      outPath.Append(name.get_filepart());
+    }
+  }
+
+  static void WriteFrames(WaveWriter& writer, double** outputs, int offset, int nFrames) { writer.WriteDoublesNI(outputs, offset, nFrames); }
+  static void WriteFrames(WaveWriter& writer, float** outputs, int offset, int nFrames) { writer.WriteFloatsNI(outputs, offset, nFrames); }
+
+  /** Render one file on an instance, on the calling thread */
+  static bool RenderFile(IPlugAPP& plug, const Options& options, const char* inPath)
+  {
+    WDL_FileRead file(inPath);
+    WAVReader reader;
+
+    if (!file.IsOpen() || !reader.ReadHeader(file))
+    {
+      fprintf(stderr, "can't read %s\n", inPath);
+      return false;
+    }
+
+    const int blockSize = options.mBlockSize;
+    const int nFileChans = reader.NChans();
+    const double sampleRate = reader.GetSampleRate();
+
+    plug.PrepareOfflineRender(sampleRate, blockSize, plug.MaxNChannels(ERoute::kInput), plug.MaxNChannels(ERoute::kOutput));
+
+    const int nIn = plug.NChannelsConnected(ERoute::kInput);
+    const int nOut = plug.NChannelsConnected(ERoute::kOutput);
+
+    if (!nOut)
+    {
+      fprintf(stderr, "the plug-in has no outputs\n");
+      return false;
+    }
+
+    WDL_String outPath;
+    MakeOutputPath(options, inPath, outPath);
+    WaveWriter writer(outPath.Get(), options.mBits, nOut, static_cast<int>(sampleRate), 0);
+
+    if (!writer.Status())
+    {
+      fprintf(stderr, "can't write %s\n", outPath.Get());
+      return false;
+    }
+
+    std::vector<float> interleaved(static_cast<size_t>(blockSize) * nFileChans);
+    std::vector<std::vector<sample>> inputData(nIn, std::vector<sample>(blockSize));
+    std::vector<std::vector<sample>> outputData(nOut, std::vector<sample>(blockSize));
+    std::vector<sample*> inputs(nIn + 1), outputs(nOut + 1);
+
+    for (int c = 0; c < nIn; c++) inputs[c] = inputData[c].data();
+    for (int c = 0; c < nOut; c++) outputs[c] = outputData[c].data();
+
+    // the input is followed by silence for the tail, and for the latency that is trimmed from the start
+    const int latency = options.mCompensateLatency ? plug.GetLatency() : 0;
+    const int64_t nInputFrames = reader.NFrames();
+    const int64_t nOutputFrames = nInputFrames + static_cast<int64_t>(options.mTailSeconds * sampleRate + 0.5);
+    int64_t toSkip = latency;
+    int64_t nWritten = 0;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    for (int64_t pos = 0; nWritten < nOutputFrames; pos += blockSize)
+    {
+      const int nRead = pos < nInputFrames ? reader.ReadFrames(file, pos, blockSize, interleaved.data()) : 0;
+
+      // an input without a channel in the file gets the file's last channel, so a mono file feeds both sides of a stereo effect
+      for (int c = 0; c < nIn; c++)
+      {
+        const int fileChan = std::min(c, nFileChans - 1);
+
+        for (int s = 0; s < nRead; s++)
+          inputData[c][s] = static_cast<sample>(interleaved[static_cast<size_t>(s) * nFileChans + fileChan]);
+
+        std::fill(inputData[c].begin() + nRead, inputData[c].end(), static_cast<sample>(0));
+      }
+
+      plug.ProcessOffline(inputs.data(), outputs.data(), blockSize);
+
+      const int skip = static_cast<int>(std::min<int64_t>(toSkip, blockSize));
+      const int nWrite = static_cast<int>(std::min<int64_t>(blockSize - skip, nOutputFrames - nWritten));
+      toSkip -= skip;
+
+      if (nWrite > 0)
+      {
+        WriteFrames(writer, outputs.data(), skip, nWrite);
+        nWritten += nWrite;
+      }
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    printf("%s -> %s (%.1fx realtime)\n", inPath, outPath.Get(), elapsed > 0. ? nOutputFrames / sampleRate / elapsed : 0.);
+    return true;
+  }
+};
+
+END_IPLUG_NAMESPACE
@@ -498,7 +498,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pWriteable = true;
       if (pData)
       {
-        *((Float64*) pData) = GetSampleRate();
+        *((Float64*) pData) = GetHostSampleRate();
       }
       return noErr;
     }
@@ -543,7 +543,8 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
 
         const char* paramName = pParam->GetName();
         pInfo->cfNameString = CFStringCreateWithCString(0, pParam->GetName(), kCFStringEncodingUTF8);
-        strcpy(pInfo->name, paramName);   // Max 52.
+        strncpy(pInfo->name, paramName, sizeof(pInfo->name) - 1);   // Max 52.
+        pInfo->name[sizeof(pInfo->name) - 1] = '\0';
 
         switch (pParam->Type())
         {
@@ -670,7 +671,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
           nChannels = pBus->mNPlugChannels;
         }
         STREAM_DESC* pASBD = (STREAM_DESC*) pData;
-        MakeDefaultASBD(pASBD, GetSampleRate(), nChannels, false);
+        MakeDefaultASBD(pASBD, GetHostSampleRate(), nChannels, false);
       }
       return noErr;
     }
@@ -698,7 +699,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pDataSize = sizeof(Float64);
       if (pData)
       {
-        *((Float64*) pData) = (double) GetLatency() / GetSampleRate();
+        *((Float64*) pData) = (double) GetLatency() / GetHostSampleRate();
       }
       return noErr;
     }
@@ -737,7 +738,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       *pWriteable = true;
       if (pData)
       {
-        *((UInt32*) pData) = GetBlockSize();
+        *((UInt32*) pData) = GetHostBlockSize();
       }
       return noErr;
     }
@@ -785,7 +786,7 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       
       if (pData)
       {
-        *((Float64*) pData) = (double) GetTailSize() / GetSampleRate();
+        *((Float64*) pData) = (double) GetTailSize() / GetHostSampleRate();
       }
       return noErr;
     }
@@ -962,8 +963,9 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
         AudioUnitParameterIDName* pIDName = (AudioUnitParameterIDName*) pData;
         char cStr[MAX_PARAM_NAME_LEN];
         ENTER_PARAMS_MUTEX
-        strcpy(cStr, GetParam(pIDName->inID)->GetName());
+        strncpy(cStr, GetParam(pIDName->inID)->GetName(), MAX_PARAM_NAME_LEN - 1);
         LEAVE_PARAMS_MUTEX
+        cStr[MAX_PARAM_NAME_LEN - 1] = '\0';
         if (pIDName->inDesiredLength != kAudioUnitParameterName_Full)
         {
           int n = std::min<int>(MAX_PARAM_NAME_LEN - 1, pIDName->inDesiredLength);
@@ -1096,6 +1098,27 @@ OSStatus IPlugAU::GetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       }
       return noErr;
     }
+#ifdef IPLUG_AU_RENDER_CONTEXT_OBSERVER
+    case kAudioUnitProperty_RenderContextObserver: // 60
+    {
+      ASSERT_SCOPE(kAudioUnitScope_Global);
+
+      if (!mRenderContextObserver)
+        return kAudioUnitErr_InvalidProperty;
+
+      if(pData == 0)
+      {
+        *pWriteable = false;
+        *pDataSize = sizeof(AURenderContextObserver);
+      }
+      else
+      {
+        // the block lives as long as the plug-in, the host copies it if it needs to keep it longer
+        *((AURenderContextObserver*) pData) = mRenderContextObserver;
+      }
+      return noErr;
+    }
+#endif
     default:
     {
       return kAudioUnitErr_InvalidProperty;
@@ -1163,6 +1186,7 @@ OSStatus IPlugAU::SetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
     case kAudioUnitProperty_SampleRate:                  // 2,
     {
       SetSampleRate(*((Float64*) pData));
+      InitDeferred();
       OnReset();
       return noErr;
     }
@@ -1216,6 +1240,7 @@ OSStatus IPlugAU::SetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
     {
       SetBlockSize(*((UInt32*) pData));
       ResizeScratchBuffers();
+      InitDeferred();
       OnReset();
       return noErr;
     }
@@ -1230,6 +1255,7 @@ OSStatus IPlugAU::SetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
       SetBypassed(bypassed);
       
       // TODO: should the following be called here?
+      InitDeferred();
       OnActivate(!bypassed);
       OnReset();
       return noErr;
@@ -1282,7 +1308,8 @@ OSStatus IPlugAU::SetProperty(AudioUnitPropertyID propID, AudioUnitScope scope,
     case kAudioUnitProperty_PresentPreset:               // 36,
     {
       int presetIdx = ((AUPreset*) pData)->presetNumber;
-      RestorePreset(presetIdx);
+      if (RestorePreset(presetIdx))
+        NotifyAllParamsChanged();
       return noErr;
     }
     case kAudioUnitProperty_OfflineRender:                // 37,
@@ -1439,6 +1466,60 @@ void IPlugAU::AssessInputConnections()
 
     Trace(TRACELOC, "%d:%s:%d:%d:%d", i, AUInputTypeStr(pInBusConn->mInputType), startChannelIdx, pInBus->mNPlugChannels, pInBus->mNHostChannels);
   }
+
+  PrepareInputBufferLists();
+}
+
+void IPlugAU::PrepareInputBufferLists()
+{
+  const int blockSize = GetHostBlockSize();
+  const int nIn = mInBuses.GetSize();
+
+  for (int i = 0; i < nIn; ++i)
+  {
+    BusChannels* pInBus = mInBuses.Get(i);
+    InputBusConnection* pInBusConn = mInBusConnections.Get(i);
+    BufferList& bufList = pInBusConn->mBufList;
+
+    bufList.mNumberBuffers = pInBus->mConnected ? std::min(pInBus->mNHostChannels, AU_MAX_IO_CHANNELS) : 0;
+
+    if (pInBusConn->mInputType == eRenderCallback && mInScratchBuf.GetSize() >= (pInBus->mPlugChannelStartIdx + bufList.mNumberBuffers) * blockSize)
+      pInBusConn->mScratch = mInScratchBuf.Get() + pInBus->mPlugChannelStartIdx * blockSize;
+    else
+      pInBusConn->mScratch = nullptr;
+
+    for (int b = 0; b < bufList.mNumberBuffers; ++b)
+    {
+      AudioBuffer* pBuffer = &(bufList.mBuffers[b]);
+      pBuffer->mNumberChannels = 1;
+      pBuffer->mDataByteSize = blockSize * sizeof(AudioSampleType);
+      pBuffer->mData = pInBusConn->mScratch ? pInBusConn->mScratch + b * blockSize : nullptr;
+    }
+  }
+}
+
+void IPlugAU::UpdateOutputConnections()
+{
+  mLastConnectedOutputBus = -1;
+
+  for (int i = 0; i < mOutBuses.GetSize(); i++)
+  {
+    if (!mOutBuses.Get(i)->mConnected)
+      break;
+
+    mLastConnectedOutputBus++;
+  }
+
+  int nConnectedBuses = mLastConnectedOutputBus + 1;
+
+  if (nConnectedBuses < mOutBuses.GetSize() /*&& (GetHost() != kHostAbletonLive)*/)
+  {
+    int totalNumChans = mOutBuses.GetSize() * 2; // stereo only for the time being
+    int nConnected = nConnectedBuses * 2;
+    SetChannelConnections(ERoute::kOutput, nConnected, totalNumChans - nConnected, false); // this will disconnect the channels that are on the unconnected buses
+  }
+
+  mOutputConnectionsChanged = false;
 }
 
 OSStatus IPlugAU::GetState(CFPropertyListRef* ppPropList)
@@ -1505,6 +1586,7 @@ OSStatus IPlugAU::SetState(CFPropertyListRef pPropList)
   }
 
   OnRestoreState();
+  NotifyAllParamsChanged();
   return noErr;
 }
 
@@ -1591,10 +1673,11 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
   Trace(TRACELOC, "%d:%d:%d", outputBusIdx, pOutBufList->mNumberBuffers, nFrames);
 
   IPlugAU* _this = (IPlugAU*) pPlug;
+  auto denormalScope = _this->MakeDenormalScope();
   
   _this->mLastRenderTimeStamp = *pTimestamp;
 
-  if (!(pTimestamp->mFlags & kAudioTimeStampSampleTimeValid) /*|| outputBusIdx >= _this->mOutBuses.GetSize()*/ || nFrames > _this->GetBlockSize())
+  if (!(pTimestamp->mFlags & kAudioTimeStampSampleTimeValid) /*|| outputBusIdx >= _this->mOutBuses.GetSize()*/ || nFrames > _this->GetHostBlockSize())
   {
     return kAudioUnitErr_InvalidPropertyValue;
   }
@@ -1620,10 +1703,9 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
     // Pull input buffers.
     if (renderSampleTime != _this->mLastRenderSampleTime)
     {
-      BufferList bufList;
-      AudioBufferList* pInBufList = (AudioBufferList*) &bufList;
-
+      const int blockSize = _this->GetHostBlockSize();
       int nIn = _this->mInBuses.GetSize();
+      bool inputsSilent = true;
 
       for (int i = 0; i < nIn; ++i)
       {
@@ -1632,14 +1714,15 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
 
         if (pInBus->mConnected)
         {
-          pInBufList->mNumberBuffers = pInBus->mNHostChannels;
+          AudioBufferList* pInBufList = (AudioBufferList*) &(pInBusConn->mBufList);
+          const int nBuffers = pInBufList->mNumberBuffers;
 
-          for (int b = 0; b < pInBufList->mNumberBuffers; ++b)
+          // the upstream unit may have replaced the data pointers and byte sizes when it was last pulled, the rest of the list is prepared
+          for (int b = 0; b < nBuffers; ++b)
           {
             AudioBuffer* pBuffer = &(pInBufList->mBuffers[b]);
-            pBuffer->mNumberChannels = 1;
             pBuffer->mDataByteSize = nFrames * sizeof(AudioSampleType);
-            pBuffer->mData = 0;
+            pBuffer->mData = pInBusConn->mScratch ? pInBusConn->mScratch + b * blockSize : nullptr;
           }
 
           AudioUnitRenderActionFlags flags = 0;
@@ -1659,13 +1742,6 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
             }
             case eRenderCallback:
             {
-              AudioSampleType* pScratchInput = _this->mInScratchBuf.Get() + pInBus->mPlugChannelStartIdx * nFrames;
-
-              for (int b = 0; b < pInBufList->mNumberBuffers; ++b, pScratchInput += nFrames)
-              {
-                pInBufList->mBuffers[b].mData = pScratchInput;
-              }
-
               r = RenderCallback(&(pInBusConn->mUpstreamRenderCallback), &flags, pTimestamp, i, nFrames, pInBufList);
               break;
             }
@@ -1678,12 +1754,18 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
             return r;   // Something went wrong upstream.
           }
 
-          for (int c = 0, chIdx = pInBus->mPlugChannelStartIdx; c < pInBus->mNHostChannels; ++c, ++chIdx)
-          {
-            _this->AttachBuffers(ERoute::kInput, chIdx, 1, (AudioSampleType**) &(pInBufList->mBuffers[c].mData), nFrames);
-          }
+          // the upstream unit still zeroes silent buffers, but the flag saves scanning them
+          inputsSilent = inputsSilent && (flags & kAudioUnitRenderAction_OutputIsSilence);
+
+          AudioSampleType* pInputs[AU_MAX_IO_CHANNELS];
+
+          for (int c = 0; c < nBuffers; ++c)
+            pInputs[c] = (AudioSampleType*) pInBufList->mBuffers[c].mData;
+
+          _this->AttachBuffers(ERoute::kInput, pInBus->mPlugChannelStartIdx, nBuffers, pInputs, nFrames);
         }
       }
+      _this->SetInputSilentFromHost(inputsSilent);
       _this->mLastRenderSampleTime = renderSampleTime;
     }
   
@@ -1700,40 +1782,30 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
       _this->SetChannelConnections(ERoute::kOutput, startChannelIdx, nConnected, true);
       _this->SetChannelConnections(ERoute::kOutput, startChannelIdx + nConnected, nUnconnected, false); // This will disconnect the right hand channel on a single stereo bus
       pOutBus->mConnected = true;
+      _this->mOutputConnectionsChanged = true;
     }
 
-    for (int c = 0, chIdx = pOutBus->mPlugChannelStartIdx; c < pOutBufList->mNumberBuffers; ++c, ++chIdx)
+    const int nOutBuffers = std::min(static_cast<int>(pOutBufList->mNumberBuffers), AU_MAX_IO_CHANNELS);
+    AudioSampleType* pOutputs[AU_MAX_IO_CHANNELS];
+
+    for (int c = 0, chIdx = pOutBus->mPlugChannelStartIdx; c < nOutBuffers; ++c, ++chIdx)
     {
       if (!(pOutBufList->mBuffers[c].mData)) // Downstream unit didn't give us buffers.
-        pOutBufList->mBuffers[c].mData = _this->mOutScratchBuf.Get() + chIdx * nFrames;
+        pOutBufList->mBuffers[c].mData = _this->mOutScratchBuf.Get() + chIdx * _this->GetHostBlockSize();
 
-      _this->AttachBuffers(ERoute::kOutput, chIdx, 1, (AudioSampleType**) &(pOutBufList->mBuffers[c].mData), nFrames);
+      pOutputs[c] = (AudioSampleType*) pOutBufList->mBuffers[c].mData;
     }
 
-    for(int i = 0; i < _this->mOutBuses.GetSize(); i++)
-    {
-      if(!_this->mOutBuses.Get(i)->mConnected)
-      {
-        break;
-      }
-      else
-      {
-        lastConnectedOutputBus++;
-      }
-    }
+    _this->AttachBuffers(ERoute::kOutput, pOutBus->mPlugChannelStartIdx, nOutBuffers, pOutputs, nFrames);
+
+    if (_this->mOutputConnectionsChanged)
+      _this->UpdateOutputConnections();
+
+    lastConnectedOutputBus = _this->mLastConnectedOutputBus;
   }
 
   if (_this->IsMidiEffect() || outputBusIdx == lastConnectedOutputBus)
   {
-    int busIdx1based = outputBusIdx+1;
-
-    if (busIdx1based < _this->mOutBuses.GetSize() /*&& (_this->GetHost() != kHostAbletonLive)*/)
-    {
-      int totalNumChans = _this->mOutBuses.GetSize() * 2; // stereo only for the time being
-      int nConnected = busIdx1based * 2;
-      _this->SetChannelConnections(ERoute::kOutput, nConnected, totalNumChans - nConnected, false); // this will disconnect the channels that are on the unconnected buses
-    }
-
     if (_this->GetBypassed())
     {
       _this->PassThroughBuffers((AudioSampleType) 0, nFrames);
@@ -1746,14 +1818,18 @@ OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, co
         
         while (_this->mMidiMsgsFromEditor.Pop(msg))
         {
-          _this->ProcessMidiMsg(msg);
+          _this->ProcessMidiMsgFromAPI(msg);
         }
       }
       
       _this->PreProcess();
       ENTER_PARAMS_MUTEX_STATIC
+      _this->ProcessParamValuesFromUI(nFrames);
       _this->ProcessBuffers((AudioSampleType) 0, nFrames);
       LEAVE_PARAMS_MUTEX_STATIC
+
+      if (_this->GetOutputSilent())
+        *pFlags |= kAudioUnitRenderAction_OutputIsSilence;
     }
   }
 
@@ -1808,6 +1884,7 @@ void IPlugAU::ClearConnections()
     pOutBus->mConnected = false;
     pOutBus->mNHostChannels = -1;
   }
+  mOutputConnectionsChanged = true;
 }
 
 #pragma mark - IPlugAU Constructor
@@ -1818,6 +1895,8 @@ IPlugAU::IPlugAU(const InstanceInfo& info, const Config& config)
 {
   Trace(TRACELOC, "%s", config.pluginName);
 
+  AttachParamSnapshot(*this);
+
   memset(&mHostCallbacks, 0, sizeof(HostCallbackInfo));
   memset(&mMidiCallback, 0, sizeof(AUMIDIOutputCallbackStruct));
 
@@ -1869,12 +1948,31 @@ IPlugAU::IPlugAU(const InstanceInfo& info, const Config& config)
 
   SetBlockSize(DEFAULT_BLOCK_SIZE);
   ResizeScratchBuffers();
+
+  mParamNotifyFlags.Resize(NParams());
+  memset(mParamNotifyFlags.Get(), 0, NParams() * sizeof(uint8_t));
+
+#ifdef IPLUG_AU_RENDER_CONTEXT_OBSERVER
+  if (__builtin_available(macOS 11.0, *))
+  {
+    // the host calls this on its render thread whenever the workgroup the plug-in renders in changes
+    mRenderContextObserver = Block_copy(^(const AudioUnitRenderContext* pContext) {
+      SetAudioWorkgroupFromHost(pContext ? (void*) pContext->workgroup : nullptr);
+    });
+  }
+#endif
   
   CreateTimer();
 }
 
 IPlugAU::~IPlugAU()
 {
+#ifdef IPLUG_AU_RENDER_CONTEXT_OBSERVER
+  if (mRenderContextObserver)
+    Block_release(mRenderContextObserver);
+#endif
+
+  SetAudioWorkgroupFromHost(nullptr);
   mRenderNotify.Empty(true);
   mInBuses.Empty(true);
   mOutBuses.Empty(true);
@@ -1882,6 +1980,22 @@ IPlugAU::~IPlugAU()
   mPropertyListeners.Empty(true);
 }
 
+void IPlugAU::SetAudioWorkgroupFromHost(void* pWorkgroup)
+{
+  void* pPrevious = GetAudioWorkgroup();
+
+  if (pWorkgroup == pPrevious)
+    return;
+
+  if (pWorkgroup)
+    CFRetain(pWorkgroup);
+
+  SetAudioWorkgroup(pWorkgroup);
+
+  if (pPrevious)
+    CFRelease(pPrevious);
+}
+
 void IPlugAU::SendAUEvent(AudioUnitEventType type, AudioComponentInstance ci, int idx)
 {
   AudioUnitEvent auEvent;
@@ -1897,18 +2011,30 @@ void IPlugAU::SendAUEvent(AudioUnitEventType type, AudioComponentInstance ci, in
 void IPlugAU::BeginInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  FlushParamChangeNotification(idx);
+  mParamNotifyFlags.Get()[idx] |= kParamNotifyInGesture;
   SendAUEvent(kAudioUnitEvent_BeginParameterChangeGesture, mCI, idx);
 }
 
 void IPlugAU::InformHostOfParamChange(int idx, double normalizedValue)
 {
   Trace(TRACELOC, "%d:%f", idx, normalizedValue);
-  SendAUEvent(kAudioUnitEvent_ParameterValueChange, mCI, idx);
+
+  // the listeners read the current value when they are notified, so the changes are coalesced until the next timer tick, see FlushParamChangeNotifications()
+  uint8_t& flags = mParamNotifyFlags.Get()[idx];
+
+  if (!(flags & kParamNotifyValuePending))
+  {
+    flags |= kParamNotifyValuePending;
+    mParamNotifyPending.Add(idx);
+  }
 }
 
 void IPlugAU::EndInformHostOfParamChange(int idx)
 {
   Trace(TRACELOC, "%d", idx);
+  FlushParamChangeNotification(idx); // the last value belongs inside the gesture
+  mParamNotifyFlags.Get()[idx] &= ~kParamNotifyInGesture;
   SendAUEvent(kAudioUnitEvent_EndParameterChangeGesture, mCI, idx);
 }
 
@@ -1916,6 +2042,74 @@ void IPlugAU::InformHostOfPresetChange()
 {
   //InformListeners(kAudioUnitProperty_CurrentPreset, kAudioUnitScope_Global);
   InformListeners(kAudioUnitProperty_PresentPreset, kAudioUnitScope_Global);
+  mAllParamsChangedPending = true;
+}
+
+void IPlugAU::DirtyParametersFromUI()
+{
+  mAllParamsChangedPending = true;
+}
+
+void IPlugAU::FlushParamChangeNotification(int idx)
+{
+  uint8_t& flags = mParamNotifyFlags.Get()[idx];
+
+  if (flags & kParamNotifyValuePending)
+  {
+    // the index stays in mParamNotifyPending, and is skipped by FlushParamChangeNotifications() while the flag is clear
+    flags &= ~kParamNotifyValuePending;
+    SendAUEvent(kAudioUnitEvent_ParameterValueChange, mCI, idx);
+  }
+}
+
+void IPlugAU::FlushParamChangeNotifications()
+{
+  const int nPending = mParamNotifyPending.GetSize();
+
+  if (!nPending && !mAllParamsChangedPending)
+    return;
+
+  const bool notifyAll = mAllParamsChangedPending || nPending > kMaxParamNotificationsPerTick;
+  const int* pPending = mParamNotifyPending.Get();
+  uint8_t* pFlags = mParamNotifyFlags.Get();
+
+  for (int i = 0; i < nPending; i++)
+  {
+    const int idx = pPending[i];
+
+    if (!(pFlags[idx] & kParamNotifyValuePending))
+      continue;
+
+    pFlags[idx] &= ~kParamNotifyValuePending;
+
+    // hosts record automation from the value changes inside a gesture, so those are sent individually even when all parameters are notified
+    if (!notifyAll || (pFlags[idx] & kParamNotifyInGesture))
+      SendAUEvent(kAudioUnitEvent_ParameterValueChange, mCI, idx);
+  }
+
+  mParamNotifyPending.Resize(0, false);
+  mAllParamsChangedPending = false;
+
+  if (notifyAll)
+  {
+    AudioUnitParameter param;
+    param.mAudioUnit = mCI;
+    param.mParameterID = kAUParameterListener_AnyParameter;
+    param.mScope = kAudioUnitScope_Global;
+    param.mElement = 0;
+    AUParameterListenerNotify(0, 0, &param);
+  }
+}
+
+void IPlugAU::NotifyAllParamsChanged()
+{
+  mAllParamsChangedPending = true;
+  FlushParamChangeNotifications();
+}
+
+void IPlugAU::TransmitMsgBatch()
+{
+  FlushParamChangeNotifications();
 }
 
 void IPlugAU::InformHostOfParameterDetailsChange()
@@ -1979,12 +2173,13 @@ void IPlugAU::PreProcess()
 void IPlugAU::ResizeScratchBuffers()
 {
   TRACE
-  int NInputs = MaxNChannels(ERoute::kInput) * GetBlockSize();
-  int NOutputs = MaxNChannels(ERoute::kOutput) * GetBlockSize();
+  int NInputs = MaxNChannels(ERoute::kInput) * GetHostBlockSize();
+  int NOutputs = MaxNChannels(ERoute::kOutput) * GetHostBlockSize();
   mInScratchBuf.Resize(NInputs);
   mOutScratchBuf.Resize(NOutputs);
   memset(mInScratchBuf.Get(), 0, NInputs * sizeof(AudioSampleType));
   memset(mOutScratchBuf.Get(), 0, NOutputs * sizeof(AudioSampleType));
+  PrepareInputBufferLists();
 }
 
 void IPlugAU::InformListeners(AudioUnitPropertyID propID, AudioUnitScope scope)
@@ -2111,6 +2306,8 @@ void IPlugAU::OutputSysexFromEditor()
       ISysEx smsg {mSysexBuf.mOffset, mSysexBuf.mData, mSysexBuf.mSize};
       SendSysEx(smsg);
     }
+
+    mSysExDataFromEditor.Release();
   }
 }
 
@@ -2257,6 +2454,7 @@ OSStatus IPlugAU::DoInitialize(IPlugAU* _this)
   }
 
   _this->mActive = true;
+  _this->InitDeferred();
   _this->OnParamReset(kReset);
   _this->OnActivate(true);
   
@@ -2428,6 +2626,28 @@ OSStatus IPlugAU::DoScheduleParameters(IPlugAU* _this, const AudioUnitParameterE
       {
         return r;
       }
+
+      if (pEvent->scope == kAudioUnitScope_Global)
+        _this->AddParamChange(pEvent->parameter, pEvent->eventValues.immediate.value, pEvent->eventValues.immediate.bufferOffset);
+    }
+    else if (pEvent->eventType == kParameterEvent_Ramped && _this->GetSampleAccurateAutomation())
+    {
+      // scheduled parameters arrive on the render thread, prior to the render call for the block they apply to
+      const int startOffset = pEvent->eventValues.ramp.startBufferOffset;
+      const int endOffset = startOffset + pEvent->eventValues.ramp.durationInFrames;
+
+      OSStatus r = SetParamProc(_this, pEvent->parameter, pEvent->scope, pEvent->element,
+                                pEvent->eventValues.ramp.endValue, endOffset);
+      if (r != noErr)
+      {
+        return r;
+      }
+
+      if (pEvent->scope == kAudioUnitScope_Global)
+      {
+        _this->AddParamChange(pEvent->parameter, pEvent->eventValues.ramp.startValue, startOffset);
+        _this->AddParamChange(pEvent->parameter, pEvent->eventValues.ramp.endValue, endOffset);
+      }
     }
   }
   return noErr;
@@ -2442,6 +2662,7 @@ OSStatus IPlugAU::DoRender(IPlugAU* _this, AudioUnitRenderActionFlags* ioActionF
 //static
 OSStatus IPlugAU::DoReset(IPlugAU* _this)
 {
+  _this->InitDeferred();
   _this->OnReset();
   return noErr;
 }
@@ -2456,7 +2677,7 @@ OSStatus IPlugAU::DoMIDIEvent(IPlugAU* _this, UInt32 inStatus, UInt32 inData1, U
     msg.mData1 = inData1;
     msg.mData2 = inData2;
     msg.mOffset = inOffsetSampleFrame;
-    _this->ProcessMidiMsg(msg);
+    _this->ProcessMidiMsgFromAPI(msg);
     _this->mMidiMsgsFromProcessor.Push(msg);
     return noErr;
   }
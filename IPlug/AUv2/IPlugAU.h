@@ -23,6 +23,11 @@
 #include <AudioToolbox/AudioUnitUtilities.h>
 #include <AvailabilityMacros.h>
 
+#if defined MAC_OS_VERSION_11_0
+  #include <Block.h>
+  #define IPLUG_AU_RENDER_CONTEXT_OBSERVER
+#endif
+
 #include "IPlugAPIBase.h"
 #include "IPlugProcessor.h"
 
@@ -66,6 +71,7 @@ public:
   void EndInformHostOfParamChange(int idx) override;
   void InformHostOfPresetChange() override;
   void InformHostOfParameterDetailsChange() override;
+  void DirtyParametersFromUI() override;
   
   /** Get the name of the track that the plug-in is inserted on */
   virtual void GetTrackName(WDL_String& str) override { str = mTrackName; };
@@ -116,6 +122,8 @@ private:
     AudioUnitRenderProc mUpstreamRenderProc;
     AURenderCallbackStruct mUpstreamRenderCallback;
     EAUInputType mInputType;
+    BufferList mBufList; // the buffer list passed upstream, built by PrepareInputBufferLists()
+    AudioSampleType* mScratch; // the bus's channels in mInScratchBuf for eRenderCallback, otherwise nullptr as the upstream unit supplies the buffers
   };
   
   struct PropertyListener
@@ -131,6 +139,10 @@ private:
   bool CheckLegalIO(AudioUnitScope scope, int busIdx, int nChannels);
   bool CheckLegalIO();
   void AssessInputConnections();
+  /** Build the buffer lists that RenderProc() pulls the input buses with. Called when the input connections or the block size change */
+  void PrepareInputBufferLists();
+  /** Find the last connected output bus and disconnect the plug-in channels on the buses after it. Called from RenderProc() after an output connection changed */
+  void UpdateOutputConnections();
 
   UInt32 GetTagForNumChannels(int numChannels);
   UInt32 GetChannelLayoutTags(AudioUnitScope scope, AudioUnitElement element, AudioChannelLayoutTag* pTags);
@@ -145,6 +157,18 @@ private:
   virtual OSStatus SetState(CFPropertyListRef pPropList);
   void InformListeners(AudioUnitPropertyID propID, AudioUnitScope scope);
   void SendAUEvent(AudioUnitEventType type, AudioComponentInstance ci, int idx);
+
+  /** Sends the parameter value notifications coalesced since the last timer tick, one per changed parameter, or a single "all parameters changed" notification
+   * if there are more than kMaxParamNotificationsPerTick of them or every parameter was dirtied. Main thread */
+  void FlushParamChangeNotifications();
+
+  /** Sends the coalesced value notification of one parameter straight away, if it has one pending, so that the host receives it before a gesture notification */
+  void FlushParamChangeNotification(int idx);
+
+  /** Tells the host and the AU parameter listeners that all parameters have changed, with a single kAUParameterListener_AnyParameter notification, after a preset or state is loaded */
+  void NotifyAllParamsChanged();
+
+  void TransmitMsgBatch() override;
   
   static OSStatus GetParamProc(void* pPlug, AudioUnitParameterID paramID, AudioUnitScope scope, AudioUnitElement element, AudioUnitParameterValue* pValue);
   static OSStatus SetParamProc(void* pPlug, AudioUnitParameterID paramID, AudioUnitScope scope, AudioUnitElement element, AudioUnitParameterValue value, UInt32 offsetFrames);
@@ -200,6 +224,8 @@ protected:
   static bool GetDataFromDict(CFDictionaryRef pDict, const char* key, IByteChunk* pChunk);
 
 private:
+  /** Called by the host's render context observer, keeps the workgroup alive while it is current and hands it to IPlugProcessor */
+  void SetAudioWorkgroupFromHost(void* pWorkgroup);
 
 #pragma mark -
 
@@ -209,6 +235,8 @@ private:
   AudioComponentInstance mCI = nullptr;
   HostCallbackInfo mHostCallbacks;
   WDL_PtrList<BusChannels> mInBuses, mOutBuses;
+  int mLastConnectedOutputBus = -1;
+  bool mOutputConnectionsChanged = true;
   WDL_PtrList<InputBusConnection> mInBusConnections;
   WDL_PtrList<PropertyListener> mPropertyListeners;
   WDL_TypedBuf<AudioSampleType> mInScratchBuf;
@@ -217,6 +245,21 @@ private:
   AUMIDIOutputCallbackStruct mMidiCallback;
   AudioTimeStamp mLastRenderTimeStamp;
   WDL_String mTrackName;
+
+  enum EParamNotifyFlags
+  {
+    kParamNotifyValuePending = 1 << 0,
+    kParamNotifyInGesture = 1 << 1
+  };
+
+  static constexpr int kMaxParamNotificationsPerTick = 32;
+
+  WDL_TypedBuf<uint8_t> mParamNotifyFlags; // EParamNotifyFlags for each parameter, main thread
+  WDL_TypedBuf<int> mParamNotifyPending; // the parameters that were given kParamNotifyValuePending since the last tick, in the order they changed
+  bool mAllParamsChangedPending = false;
+#ifdef IPLUG_AU_RENDER_CONTEXT_OBSERVER
+  AURenderContextObserver mRenderContextObserver = nullptr;
+#endif
   template <class Plug, bool DoesMIDIIn>
   friend class IPlugAUFactory;
 };
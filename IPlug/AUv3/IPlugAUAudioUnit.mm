@@ -415,7 +415,7 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
   
   // start timer on main thread
   dispatch_async(dispatch_get_main_queue(), ^{
-    pPlug->CreateTimer();
+    pPlug->CreateTimer(true);
   });
   
   mParameterTree.implementorValueObserver = ^(AUParameter *param, AUValue value) {
@@ -523,6 +523,7 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
   double sr = mBufferedOutputBuses.Get(0)->bus.format.sampleRate;
   
   mPlug->Prepare(sr, maxBlockSize);
+  mPlug->InitDeferred();
   mPlug->OnReset();
   
   return YES;
@@ -547,6 +548,18 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
 
 #pragma mark - AUAudioUnit (AUAudioUnitImplementation)
 
+#if defined MAC_OS_VERSION_11_0 || defined __IPHONE_14_0
+- (AURenderContextObserver) renderContextObserver API_AVAILABLE(macos(11.0), ios(14.0))
+{
+  __block IPlugAUv3* pPlug = mPlug;
+
+  // called by the host on its render thread whenever the workgroup the plug-in renders in changes
+  return ^(const AudioUnitRenderContext* pContext) {
+    pPlug->SetAudioWorkgroupFromHost(pContext ? (__bridge void*) pContext->workgroup : nullptr);
+  };
+}
+#endif
+
 - (AUInternalRenderBlock) internalRenderBlock
 {
   __block IPlugAUv3* pPlug = mPlug;
@@ -566,7 +579,7 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
     AudioUnitRenderActionFlags pullFlags = 0;
     AUAudioUnitStatus err = 0;
     
-    if (frameCount > pPlug->GetBlockSize())
+    if (frameCount > pPlug->GetHostBlockSize())
     {
       err = kAudioUnitErr_InvalidPropertyValue;
       return err;
@@ -714,12 +727,12 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
 
 - (NSTimeInterval) latency
 {
-  return (NSTimeInterval) mPlug->GetLatency() / mPlug->GetSampleRate();
+  return (NSTimeInterval) mPlug->GetLatency() / mPlug->GetHostSampleRate();
 }
 
 - (NSTimeInterval) tailTime
 {
-  return (double) mPlug->GetTailSize() / mPlug->GetSampleRate();
+  return (double) mPlug->GetTailSize() / mPlug->GetHostSampleRate();
 }
 
 - (NSDictionary<NSString*, id>*)fullState
@@ -822,6 +835,7 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
 
 - (PLATFORM_VIEW*) openWindow: (PLATFORM_VIEW*) pParent
 {
+  mPlug->SetEditorOpen(true);
   PLATFORM_VIEW* pView = (__bridge PLATFORM_VIEW*) mPlug->OpenWindow((__bridge void*) pParent);
 
   return pView;
@@ -830,6 +844,7 @@ static AUAudioUnitPreset* NewAUPreset(NSInteger number, NSString* pName)
 - (void) closeWindow
 {
   mPlug->CloseWindow();
+  mPlug->SetEditorOpen(false);
 }
 
 - (NSInteger) width
@@ -30,6 +30,7 @@
 
 union AURenderEvent;
 struct AUMIDIEvent;
+struct AUMIDIEventList;
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -45,6 +46,7 @@ class IPlugAUv3 : public IPlugAPIBase
 {
 public:
   IPlugAUv3(const InstanceInfo& info, const Config& config);
+  ~IPlugAUv3();
   
   //IPlugAPIBase
   void BeginInformHostOfParamChange(int idx) override;
@@ -73,25 +75,60 @@ public:
     mAddressParamMap.insert({paramAddress, paramIdx});
   }
   
-  uint64_t GetParamAddress(int paramIdx) { return mParamAddressMap[paramIdx]; }
-  int GetParamIdx(uint64_t paramAddress) { return mAddressParamMap[paramAddress]; }
+  // find() rather than operator[], which inserts (and allocates) for an unknown key. Unknown keys map to 0, as they did with operator[]
+  uint64_t GetParamAddress(int paramIdx) const { auto it = mParamAddressMap.find(paramIdx); return it != mParamAddressMap.end() ? it->second : 0; }
+  int GetParamIdx(uint64_t paramAddress) const { auto it = mAddressParamMap.find(paramAddress); return it != mAddressParamMap.end() ? it->second : 0; }
   
   void SetAUAudioUnit(void* pAUAudioUnit);
 
   void SetOffline(bool renderingOffline) { IPlugProcessor::SetRenderingOffline(renderingOffline); }
 
+  /** Called by the host's render context observer, keeps the workgroup alive while it is current and hands it to IPlugProcessor */
+  void SetAudioWorkgroupFromHost(void* pWorkgroup);
+
   /** Override this method, in special cases, to request data from the iOS app wrapper
    * the data must exist!
    */
   virtual void* GetDataFromExternal(int& dataSize) { return nullptr; }
 
 private:
-  // void HandleOneEvent(AURenderEvent const* event, int64_t startTime);
-  // void PerformAllSimultaneousEvents(int64_t now, AURenderEvent const*& event);
+  /** A host parameter ramp (AURenderEventParameterRamp), which can span several render calls */
+  struct ParamRamp
+  {
+    int mParamIdx;
+    double mStartValue;
+    double mEndValue;
+    int64_t mStartTime; // sample time
+    int64_t mEndTime;
+
+    double ValueAt(int64_t time) const
+    {
+      if (time >= mEndTime)
+        return mEndValue;
+
+      return mStartValue + (mEndValue - mStartValue) * (double) (time - mStartTime) / (double) (mEndTime - mStartTime);
+    }
+  };
+
+  /** Set a parameter from the host, at a sample offset in the current block. Cancels a ramp on the parameter */
+  void SetParamFromHost(int paramIdx, double value, int offset);
+  /** Start a ramp from the parameter's current value to endValue */
+  void StartParamRamp(int paramIdx, double endValue, int64_t startTime, int64_t duration, int64_t now, int nFrames);
+  /** Add the automation points of a ramp for the current block, and set the parameter to the ramp's value at the end of the block
+   * @return \c true if the ramp ends in this block */
+  bool RenderParamRamp(const ParamRamp& ramp, int64_t now, int nFrames);
+  /** Render the ramps that started in previous blocks */
+  void ContinueParamRamps(int64_t now, int nFrames);
+  /** Deliver the UMP (MIDI 1.0 or MIDI 2.0 protocol) messages of an AUMIDIEventList as IMidiMsgs */
+  void ProcessMidiEventList(const AUMIDIEventList& eventList, int64_t now);
+  void ProcessMidiMsgFromHost(const IMidiMsg& msg);
+
   std::unordered_map<int, uint64_t> mParamAddressMap;
   std::unordered_map<uint64_t, int> mAddressParamMap;
   void* mAUAudioUnit = nullptr;
   AudioTimeStamp mLastTimeStamp;
+  WDL_TypedBuf<ParamRamp> mParamRamps; // the active ramps, at most one per parameter. Allocated in the constructor
+  int mNParamRamps = 0;
 };
 
 IPlugAUv3* MakePlug(const InstanceInfo& info);
@@ -18,13 +18,113 @@
 #error This file must be compiled with Arc. Use -fobjc-arc flag
 #endif
 
+#if (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 120000) || (defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 150000)
+  #define IPLUG_AUV3_MIDI_EVENT_LIST 1
+#endif
+
 using namespace iplug;
 
+/** Convert one Universal MIDI Packet message to MIDI 1.0 messages, following the MIDI 2.0 to MIDI 1.0 translation in the UMP specification:
+ * values are scaled down to 7 or 14 bits, a note on with velocity 0 becomes velocity 1, a bank change becomes bank select CCs and (N)RPNs become their CC sequences.
+ * Utility, SysEx, data and per-note messages are ignored
+ * @param pWords The message's words
+ * @param pMsgs Receives up to 4 messages
+ * @return The number of messages written */
+static int UMPToMidiMsgs(const uint32_t* pWords, IMidiMsg* pMsgs, int offset)
+{
+  const uint32_t w0 = pWords[0];
+  const uint8_t type = w0 >> 28;
+
+  if (type == 0x1 || type == 0x2) // system and MIDI 1.0 channel voice messages, which are MIDI 1.0 bytes
+  {
+    pMsgs[0] = IMidiMsg(offset, (w0 >> 16) & 0xFF, (w0 >> 8) & 0x7F, w0 & 0x7F);
+    return 1;
+  }
+
+  if (type != 0x4) // MIDI 2.0 channel voice
+    return 0;
+
+  const uint32_t w1 = pWords[1];
+  const uint8_t opcode = (w0 >> 20) & 0xF;
+  const uint8_t channel = (w0 >> 16) & 0xF;
+  const uint8_t index = (w0 >> 8) & 0x7F;
+  const uint8_t value7 = w1 >> 25;
+
+  switch (opcode)
+  {
+    case 0x8: // note off
+      pMsgs[0] = IMidiMsg(offset, 0x80 | channel, index, (w1 >> 25) & 0x7F);
+      return 1;
+    case 0x9: // note on, velocity 0 is a valid velocity in MIDI 2.0
+      pMsgs[0] = IMidiMsg(offset, 0x90 | channel, index, std::max(w1 >> 25, 1u));
+      return 1;
+    case 0xA: // poly pressure
+      pMsgs[0] = IMidiMsg(offset, 0xA0 | channel, index, value7);
+      return 1;
+    case 0xB: // control change
+      pMsgs[0] = IMidiMsg(offset, 0xB0 | channel, index, value7);
+      return 1;
+    case 0xC: // program change, with an optional bank
+    {
+      int n = 0;
+
+      if (w0 & 0x1)
+      {
+        pMsgs[n++] = IMidiMsg(offset, 0xB0 | channel, 0, (w1 >> 8) & 0x7F);
+        pMsgs[n++] = IMidiMsg(offset, 0xB0 | channel, 32, w1 & 0x7F);
+      }
+
+      pMsgs[n++] = IMidiMsg(offset, 0xC0 | channel, (w1 >> 24) & 0x7F, 0);
+      return n;
+    }
+    case 0xD: // channel pressure
+      pMsgs[0] = IMidiMsg(offset, 0xD0 | channel, value7, 0);
+      return 1;
+    case 0xE: // pitch bend
+    {
+      const uint32_t value14 = w1 >> 18;
+      pMsgs[0] = IMidiMsg(offset, 0xE0 | channel, value14 & 0x7F, (value14 >> 7) & 0x7F);
+      return 1;
+    }
+    case 0x2: // registered controller (RPN)
+    case 0x3: // assignable controller (NRPN)
+    {
+      const uint8_t bank = (w0 >> 8) & 0x7F;
+      const uint8_t ctrl = w0 & 0x7F;
+      const uint32_t value14 = w1 >> 18;
+      const bool rpn = opcode == 0x2;
+      pMsgs[0] = IMidiMsg(offset, 0xB0 | channel, rpn ? 101 : 99, bank);
+      pMsgs[1] = IMidiMsg(offset, 0xB0 | channel, rpn ? 100 : 98, ctrl);
+      pMsgs[2] = IMidiMsg(offset, 0xB0 | channel, 6, (value14 >> 7) & 0x7F);
+      pMsgs[3] = IMidiMsg(offset, 0xB0 | channel, 38, value14 & 0x7F);
+      return 4;
+    }
+    default:
+      return 0;
+  }
+}
+
+/** @return The number of 32 bit words in a Universal MIDI Packet message of a type */
+static int UMPNumWords(uint8_t type)
+{
+  static const int sNumWords[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+  return sNumWords[type & 0xF];
+}
+
 IPlugAUv3::IPlugAUv3(const InstanceInfo& instanceInfo, const Config& config)
 : IPlugAPIBase(config, kAPIAUv3)
 , IPlugProcessor(config, kAPIAUv3)
 {
   Trace(TRACELOC, "%s", config.pluginName);
+
+  AttachParamSnapshot(*this);
+
+  mParamRamps.Resize(NParams());
+}
+
+IPlugAUv3::~IPlugAUv3()
+{
+  SetAudioWorkgroupFromHost(nullptr);
 }
 
 void IPlugAUv3::SetAUAudioUnit(void* pAUAudioUnit)
@@ -32,6 +132,22 @@ void IPlugAUv3::SetAUAudioUnit(void* pAUAudioUnit)
   mAUAudioUnit = pAUAudioUnit;
 }
 
+void IPlugAUv3::SetAudioWorkgroupFromHost(void* pWorkgroup)
+{
+  void* pPrevious = GetAudioWorkgroup();
+
+  if (pWorkgroup == pPrevious)
+    return;
+
+  if (pWorkgroup)
+    CFRetain(pWorkgroup);
+
+  SetAudioWorkgroup(pWorkgroup);
+
+  if (pPrevious)
+    CFRelease(pPrevious);
+}
+
 void IPlugAUv3::BeginInformHostOfParamChange(int paramIdx)
 {
   const AUParameterAddress address = GetParamAddress(paramIdx);
@@ -120,17 +236,20 @@ bool IPlugAUv3::SendSysEx(const ISysEx& msg)
 
 void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t frameCount, AURenderEvent const* pEvents, ITimeInfo& timeInfo)
 {
+  auto denormalScope = MakeDenormalScope();
   SetTimeInfo(timeInfo);
   
   IMidiMsg midiMsg;
   while (mMidiMsgsFromEditor.Pop(midiMsg))
   {
-    ProcessMidiMsg(midiMsg);
+    ProcessMidiMsgFromAPI(midiMsg);
   }
   
   mLastTimeStamp = *pTimestamp;
   AUEventSampleTime now = AUEventSampleTime(pTimestamp->mSampleTime);
   uint32_t framesRemaining = frameCount;
+
+  ContinueParamRamps(now, (int) frameCount);
   
   for (const AURenderEvent* pEvent = pEvents; pEvent != nullptr; pEvent = pEvent->head.next)
   {
@@ -141,11 +260,16 @@ void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t fra
         const AUMIDIEvent& midiEvent = pEvent->MIDI;
 
         midiMsg = {static_cast<int>(midiEvent.eventSampleTime - now), midiEvent.data[0], midiEvent.data[1], midiEvent.data[2] };
-        ProcessMidiMsg(midiMsg);
-        mMidiMsgsFromProcessor.Push(midiMsg);
+        ProcessMidiMsgFromHost(midiMsg);
       }
       break;
 
+#ifdef IPLUG_AUV3_MIDI_EVENT_LIST
+      case AURenderEventMIDIEventList:
+        ProcessMidiEventList(pEvent->MIDIEventsList, now);
+        break;
+#endif
+
       case AURenderEventParameter:
       case AURenderEventParameterRamp:
       {
@@ -154,13 +278,13 @@ void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t fra
         if (paramEvent.parameterAddress < NParams())
         {
           const int paramIdx = GetParamIdx(paramEvent.parameterAddress);
-          
           const double value = (double) paramEvent.value;
-          const int sampleOffset = (int) (paramEvent.eventSampleTime - now);
-          ENTER_PARAMS_MUTEX
-          GetParam(paramIdx)->Set(value);
-          LEAVE_PARAMS_MUTEX
-          OnParamChange(paramIdx, EParamSource::kHost, sampleOffset);
+          const AUEventSampleTime eventTime = std::max(paramEvent.eventSampleTime, now); // late events start now
+
+          if (pEvent->head.eventType == AURenderEventParameterRamp && paramEvent.rampDurationSampleFrames > 0)
+            StartParamRamp(paramIdx, value, eventTime, paramEvent.rampDurationSampleFrames, now, (int) frameCount);
+          else
+            SetParamFromHost(paramIdx, value, (int) (eventTime - now));
         }
 
         break;
@@ -173,6 +297,7 @@ void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t fra
   }
 
   ENTER_PARAMS_MUTEX;
+  ProcessParamValuesFromUI(framesRemaining);
   ProcessBuffers(0.f, framesRemaining); // what about bufferOffset
   LEAVE_PARAMS_MUTEX;
     
@@ -182,6 +307,8 @@ void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t fra
     ISysEx smsg {mSysexBuf.mOffset, mSysexBuf.mData, mSysexBuf.mSize};
     SendSysEx(smsg);
   }
+
+  mSysExDataFromEditor.Release();
   
 
 //  while (framesRemaining > 0) {
@@ -216,6 +343,123 @@ void IPlugAUv3::ProcessWithEvents(AudioTimeStamp const* pTimestamp, uint32_t fra
 //  }
 }
 
+void IPlugAUv3::ProcessMidiMsgFromHost(const IMidiMsg& msg)
+{
+  ProcessMidiMsgFromAPI(msg);
+  mMidiMsgsFromProcessor.Push(msg);
+}
+
+void IPlugAUv3::ProcessMidiEventList(const AUMIDIEventList& eventList, int64_t now)
+{
+#ifdef IPLUG_AUV3_MIDI_EVENT_LIST
+  // the packets' time stamps aren't sample times, all of the list's messages are at its eventSampleTime
+  const int offset = static_cast<int>(std::max(eventList.eventSampleTime - now, (int64_t) 0));
+  const MIDIEventPacket* pPacket = &(eventList.eventList.packet[0]);
+
+  for (UInt32 p = 0; p < eventList.eventList.numPackets; p++)
+  {
+    for (UInt32 w = 0; w < pPacket->wordCount; )
+    {
+      const int nWords = UMPNumWords(pPacket->words[w] >> 28);
+
+      if (w + nWords > pPacket->wordCount)
+        break;
+
+      IMidiMsg msgs[4];
+      const int nMsgs = UMPToMidiMsgs(&(pPacket->words[w]), msgs, offset);
+
+      for (int i = 0; i < nMsgs; i++)
+        ProcessMidiMsgFromHost(msgs[i]);
+
+      w += nWords;
+    }
+
+    pPacket = reinterpret_cast<const MIDIEventPacket*>(&(pPacket->words[pPacket->wordCount])); // MIDIEventPacketNext()
+  }
+#endif
+}
+
+void IPlugAUv3::SetParamFromHost(int paramIdx, double value, int offset)
+{
+  for (int i = 0; i < mNParamRamps; i++)
+  {
+    if (mParamRamps.Get()[i].mParamIdx == paramIdx)
+    {
+      mParamRamps.Get()[i] = mParamRamps.Get()[--mNParamRamps];
+      break;
+    }
+  }
+
+  AddParamChange(paramIdx, value, offset);
+  ENTER_PARAMS_MUTEX
+  GetParam(paramIdx)->Set(value);
+  LEAVE_PARAMS_MUTEX
+  OnParamChange(paramIdx, EParamSource::kHost, offset);
+}
+
+void IPlugAUv3::StartParamRamp(int paramIdx, double endValue, int64_t startTime, int64_t duration, int64_t now, int nFrames)
+{
+  int rampIdx = 0;
+
+  // a new ramp replaces the parameter's current one
+  while (rampIdx < mNParamRamps && mParamRamps.Get()[rampIdx].mParamIdx != paramIdx)
+    rampIdx++;
+
+  if (rampIdx == mNParamRamps)
+  {
+    if (mNParamRamps >= mParamRamps.GetSize())
+    {
+      SetParamFromHost(paramIdx, endValue, (int) (startTime - now));
+      return;
+    }
+
+    mNParamRamps++;
+  }
+
+  ParamRamp& ramp = mParamRamps.Get()[rampIdx];
+  ramp.mParamIdx = paramIdx;
+  ramp.mStartValue = GetParam(paramIdx)->Value(); // which includes the events that came before this one in the block
+  ramp.mEndValue = endValue;
+  ramp.mStartTime = startTime;
+  ramp.mEndTime = startTime + duration;
+
+  AddParamChange(paramIdx, ramp.mStartValue, (int) (startTime - now));
+
+  if (RenderParamRamp(ramp, now, nFrames))
+    mParamRamps.Get()[rampIdx] = mParamRamps.Get()[--mNParamRamps];
+}
+
+bool IPlugAUv3::RenderParamRamp(const ParamRamp& ramp, int64_t now, int nFrames)
+{
+  const bool ends = ramp.mEndTime <= now + nFrames;
+  const int offset = ends ? (int) (ramp.mEndTime - now) : nFrames;
+  const double value = ramp.ValueAt(now + offset);
+
+  // the list interpolates linearly between the points, so one point at the end of the ramp (or block) is enough
+  AddParamChange(ramp.mParamIdx, value, offset);
+  ENTER_PARAMS_MUTEX
+  GetParam(ramp.mParamIdx)->Set(value);
+  LEAVE_PARAMS_MUTEX
+  OnParamChange(ramp.mParamIdx, EParamSource::kHost, std::min(offset, nFrames - 1));
+
+  return ends;
+}
+
+void IPlugAUv3::ContinueParamRamps(int64_t now, int nFrames)
+{
+  for (int i = 0; i < mNParamRamps; )
+  {
+    const ParamRamp& ramp = mParamRamps.Get()[i];
+
+    AddParamChange(ramp.mParamIdx, ramp.ValueAt(now), 0);
+
+    if (RenderParamRamp(ramp, now, nFrames))
+      mParamRamps.Get()[i] = mParamRamps.Get()[--mNParamRamps];
+    else
+      i++;
+  }
+}
+
 // this is called on a secondary thread (not main thread, not audio thread)
 void IPlugAUv3::SetParameterFromValueObserver(uint64_t address, float value)
 {
@@ -282,7 +526,7 @@ void IPlugAUv3::AttachInputBuffers(AudioBufferList* pInBufList)
     {
       int nConnected = pInBufList->mBuffers[i].mNumberChannels;
       SetChannelConnections(ERoute::kInput, chanIdx, nConnected, true);
-      AttachBuffers(ERoute::kInput, chanIdx, nConnected, (float**) &(pInBufList->mBuffers[i].mData), GetBlockSize());
+      AttachBuffers(ERoute::kInput, chanIdx, nConnected, (float**) &(pInBufList->mBuffers[i].mData), GetHostBlockSize());
       chanIdx += nConnected;
     }
     
@@ -302,7 +546,7 @@ void IPlugAUv3::AttachOutputBuffers(AudioBufferList* pOutBufList, uint32_t busNu
     {
       int nConnected = pOutBufList->mBuffers[i].mNumberChannels;
       SetChannelConnections(ERoute::kOutput, (busNumber * numChannelsInBus) + chanIdx, nConnected, true);
-      AttachBuffers(ERoute::kOutput, (busNumber * numChannelsInBus) + chanIdx, nConnected, (float**) &(pOutBufList->mBuffers[i].mData), GetBlockSize());
+      AttachBuffers(ERoute::kOutput, (busNumber * numChannelsInBus) + chanIdx, nConnected, (float**) &(pOutBufList->mBuffers[i].mData), GetHostBlockSize());
       chanIdx += nConnected;
     }
     SetChannelConnections(ERoute::kInput, chanIdx, MaxNChannels(kOutput) - chanIdx, false);
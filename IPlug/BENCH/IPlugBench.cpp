@@ -0,0 +1,84 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include "IPlugBench.h"
+
+using namespace iplug;
+
+IPlugBench::IPlugBench(const InstanceInfo& info, const Config& config)
+: IPlugAPIBase(config, kAPIBENCH)
+, IPlugProcessor(config, kAPIBENCH)
+{
+  Trace(TRACELOC, "%s%s", config.pluginName, config.channelIOStr);
+
+  AttachParamSnapshot(*this);
+
+  SetBlockSize(DEFAULT_BLOCK_SIZE);
+}
+
+void IPlugBench::Prepare(double sampleRate, int blockSize, int nInputs, int nOutputs)
+{
+  const int nIn = std::min(std::max(nInputs, 0), MaxNChannels(ERoute::kInput));
+  const int nOut = std::min(std::max(nOutputs, 0), MaxNChannels(ERoute::kOutput));
+
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), false);
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), false);
+  SetChannelConnections(ERoute::kInput, 0, nIn, true);
+  SetChannelConnections(ERoute::kOutput, 0, nOut, true);
+
+  SetSampleRate(sampleRate);
+  SetBlockSize(blockSize);
+  SetRenderingOffline(false); // measure the realtime code path
+  mSamplePos = 0.;
+
+  InitDeferred();
+  OnParamReset(kReset);
+  OnReset();
+  OnActivate(true);
+}
+
+void IPlugBench::AddMidiMsg(const IMidiMsg& msg)
+{
+  ProcessMidiMsgFromAPI(msg);
+}
+
+void IPlugBench::AddParamAutomation(int paramIdx, double normalizedValue, int offset)
+{
+  if (paramIdx < 0 || paramIdx >= NParams())
+    return;
+
+  IParam* pParam = GetParam(paramIdx);
+  const double value = pParam->FromNormalized(normalizedValue);
+
+  ENTER_PARAMS_MUTEX
+  AddParamChange(paramIdx, value, offset);
+  pParam->Set(value);
+  OnParamChange(paramIdx, kHost, offset);
+  LEAVE_PARAMS_MUTEX
+}
+
+void IPlugBench::Process(sample** inputs, sample** outputs, int nFrames)
+{
+  auto denormalScope = MakeDenormalScope();
+  ITimeInfo timeInfo;
+  timeInfo.mSamplePos = mSamplePos;
+  timeInfo.mPPQPos = mSamplePos / GetHostSampleRate() * timeInfo.mTempo / 60.;
+  timeInfo.mTransportIsRunning = true;
+  SetTimeInfo(timeInfo);
+
+  AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), inputs, nFrames);
+  AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), outputs, nFrames);
+
+  ENTER_PARAMS_MUTEX
+  ProcessBuffers((sample) 0, nFrames);
+  LEAVE_PARAMS_MUTEX
+
+  mSamplePos += nFrames;
+}
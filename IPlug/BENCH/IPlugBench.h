@@ -0,0 +1,78 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugBench
+ */
+
+#include "IPlugPlatform.h"
+#include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+struct InstanceInfo
+{
+};
+
+/** Headless API class used by the command line DSP benchmark in IPlugBench_main.cpp. There is no host, window, timer or audio device:
+ * the benchmark calls the same IPlugAPIBase and IPlugProcessor methods that the other API classes call from their host callbacks, on its own thread.
+ * Build it with BENCH_API IPLUG_DSP=1 IPLUG_EDITOR=0 NO_IGRAPHICS, see IPlugBench_main.cpp for the options
+ * @ingroup APIClasses */
+class IPlugBench : public IPlugAPIBase
+                 , public IPlugProcessor
+{
+public:
+  IPlugBench(const InstanceInfo& info, const Config& config);
+
+  //IPlugAPIBase
+  void BeginInformHostOfParamChange(int idx) override {};
+  void InformHostOfParamChange(int idx, double normalizedValue) override {};
+  void EndInformHostOfParamChange(int idx) override {};
+  void InformHostOfPresetChange() override {};
+
+  //IPlugProcessor
+  bool SendMidiMsg(const IMidiMsg& msg) override { return true; } // MIDI output is discarded
+  bool SendSysEx(const ISysEx& msg) override { return true; }
+
+  //IPlugBench
+  /** Set up the plug-in for rendering, as a host does when it activates a plug-in
+   * @param sampleRate The sample rate
+   * @param blockSize The maximum number of frames that will be passed to Process()
+   * @param nInputs The number of input channels to connect, clamped to the plug-in's maximum
+   * @param nOutputs The number of output channels to connect, clamped to the plug-in's maximum */
+  void Prepare(double sampleRate, int blockSize, int nInputs, int nOutputs);
+
+  /** Deliver a MIDI message to the plug-in. Call this before Process() for the block it falls in
+   * @param msg The message, with its offset relative to the start of the block */
+  void AddMidiMsg(const IMidiMsg& msg);
+
+  /** Automate a parameter as the host does. Call this before Process() for the block the point falls in
+   * @param paramIdx The parameter
+   * @param normalizedValue The value in the range 0. to 1.
+   * @param offset The sample offset of the point within the block */
+  void AddParamAutomation(int paramIdx, double normalizedValue, int offset);
+
+  /** Render a block
+   * @param inputs NChannelsConnected(ERoute::kInput) buffers of nFrames samples
+   * @param outputs NChannelsConnected(ERoute::kOutput) buffers of nFrames samples
+   * @param nFrames The number of frames, no more than the block size passed to Prepare() */
+  void Process(sample** inputs, sample** outputs, int nFrames);
+
+private:
+  double mSamplePos = 0.;
+};
+
+IPlugBench* MakePlug(const InstanceInfo& info);
+
+END_IPLUG_NAMESPACE
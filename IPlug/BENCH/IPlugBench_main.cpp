@@ -0,0 +1,586 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+/**
+ * @file
+ * @brief Command line DSP benchmark for an IPlug plug-in, using the IPlugBench API class.
+ * Renders a number of seconds of audio for every combination of sample rate and block size, optionally playing a MIDI file and automating parameters,
+ * and reports the realtime factor and a histogram of the per-block processing time, so that DSP performance can be compared between builds.
+ *
+ * Build the plug-in's source files, IPlugAPIBase.cpp, IPlugPluginBase.cpp, IPlugParameter.cpp, IPlugProcessor.cpp, IPlugPaths.cpp, IPlugTimer.cpp, WDL/resample.cpp and the files in this folder
+ * with BENCH_API IPLUG_DSP=1 IPLUG_EDITOR=0 NO_IGRAPHICS (BENCH_DEFS in common-mac.xcconfig and common-win.props), then run e.g.
+ *
+ *   MyPlugin-bench --seconds 30 --sr 44100,96000 --block 32,512 --midi test.mid --automate 0:2:sine --json results.json
+ *
+ * Options:
+ *   --seconds S              Seconds of audio to render for each configuration (default 10)
+ *   --sr R1,R2,...           Sample rates (default 48000)
+ *   --block B1,B2,...        Block sizes (default 512)
+ *   --channels IN:OUT        Channels to connect (default all)
+ *   --midi PATH              Standard MIDI file to play from the start of each run
+ *   --automate IDX[:HZ[:SHAPE]]  Automate parameter IDX with a sine, ramp, square or random lane at HZ (default 1 Hz sine). Can be repeated
+ *   --automation-interval N  Samples between automation points (default 64)
+ *   --input noise|sine|silence  The input signal (default noise)
+ *   --json PATH              Also write the results as JSON
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "IPlugBench.h"
+
+using namespace iplug;
+
+namespace {
+
+struct MidiEvent
+{
+  double mTime; // seconds
+  uint8_t mStatus, mData1, mData2;
+};
+
+struct AutomationLane
+{
+  int mParamIdx = 0;
+  double mRate = 1.;
+  std::string mShape = "sine";
+};
+
+struct Options
+{
+  double mSeconds = 10.;
+  std::vector<double> mSampleRates { 48000. };
+  std::vector<int> mBlockSizes { 512 };
+  int mNInputs = -1;
+  int mNOutputs = -1;
+  std::string mMidiPath;
+  std::vector<AutomationLane> mLanes;
+  int mAutomationInterval = 64;
+  std::string mInput = "noise";
+  std::string mJsonPath;
+};
+
+// the upper edges of the load histogram buckets, as a fraction of the block's duration
+const double kLoadBuckets[] = { 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 0.75, 1. };
+const int kNLoadBuckets = sizeof(kLoadBuckets) / sizeof(kLoadBuckets[0]) + 1; // the last bucket is the overruns
+
+struct Result
+{
+  double mSampleRate;
+  int mBlockSize;
+  int mNInputs;
+  int mNOutputs;
+  int mNBlocks;
+  double mRealtimeFactor;
+  double mMeanUs, mP50Us, mP90Us, mP99Us, mP999Us, mMaxUs;
+  int mNOverruns;
+  int mHistogram[kNLoadBuckets];
+};
+
+void PrintUsage()
+{
+  printf("usage: bench [--seconds S] [--sr R1,R2,...] [--block B1,B2,...] [--channels IN:OUT] [--midi PATH]\n"
+         "             [--automate IDX[:HZ[:sine|ramp|square|random]]]... [--automation-interval N] [--input noise|sine|silence] [--json PATH]\n");
+}
+
+template <typename T>
+std::vector<T> ParseList(const char* str)
+{
+  std::vector<T> values;
+
+  for (const char* p = str; *p; )
+  {
+    char* pEnd;
+    const double v = strtod(p, &pEnd);
+
+    if (pEnd == p)
+      break;
+
+    values.push_back(static_cast<T>(v));
+    p = *pEnd == ',' ? pEnd + 1 : pEnd;
+  }
+
+  return values;
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    auto needsValue = [&]() {
+      if (!value)
+        fprintf(stderr, "%s needs a value\n", arg);
+      else
+        i++;
+
+      return value != nullptr;
+    };
+
+    if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+      return false;
+    else if (!strcmp(arg, "--seconds"))
+    {
+      if (!needsValue()) return false;
+      options.mSeconds = atof(value);
+    }
+    else if (!strcmp(arg, "--sr"))
+    {
+      if (!needsValue()) return false;
+      options.mSampleRates = ParseList<double>(value);
+    }
+    else if (!strcmp(arg, "--block"))
+    {
+      if (!needsValue()) return false;
+      options.mBlockSizes = ParseList<int>(value);
+    }
+    else if (!strcmp(arg, "--channels"))
+    {
+      if (!needsValue() || sscanf(value, "%d:%d", &options.mNInputs, &options.mNOutputs) != 2) return false;
+    }
+    else if (!strcmp(arg, "--midi"))
+    {
+      if (!needsValue()) return false;
+      options.mMidiPath = value;
+    }
+    else if (!strcmp(arg, "--automate"))
+    {
+      if (!needsValue()) return false;
+
+      AutomationLane lane;
+      char shape[32] = "";
+
+      if (sscanf(value, "%d:%lf:%31s", &lane.mParamIdx, &lane.mRate, shape) < 1)
+        return false;
+
+      if (shape[0])
+        lane.mShape = shape;
+
+      options.mLanes.push_back(lane);
+    }
+    else if (!strcmp(arg, "--automation-interval"))
+    {
+      if (!needsValue()) return false;
+      options.mAutomationInterval = std::max(atoi(value), 1);
+    }
+    else if (!strcmp(arg, "--input"))
+    {
+      if (!needsValue()) return false;
+      options.mInput = value;
+    }
+    else if (!strcmp(arg, "--json"))
+    {
+      if (!needsValue()) return false;
+      options.mJsonPath = value;
+    }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return false;
+    }
+  }
+
+  return options.mSeconds > 0. && !options.mSampleRates.empty() && !options.mBlockSizes.empty();
+}
+
+#pragma mark - MIDI file
+
+uint32_t ReadVarLen(const uint8_t*& p, const uint8_t* pEnd)
+{
+  uint32_t value = 0;
+
+  while (p < pEnd)
+  {
+    const uint8_t byte = *p++;
+    value = (value << 7) | (byte & 0x7F);
+
+    if (!(byte & 0x80))
+      break;
+  }
+
+  return value;
+}
+
+uint32_t ReadBE(const uint8_t* p, int nBytes)
+{
+  uint32_t value = 0;
+
+  for (int i = 0; i < nBytes; i++)
+    value = (value << 8) | p[i];
+
+  return value;
+}
+
+/** Read the channel messages of a format 0 or 1 standard MIDI file, with their times in seconds following the file's tempo map */
+bool LoadMidiFile(const char* path, std::vector<MidiEvent>& events)
+{
+  FILE* fp = fopen(path, "rb");
+
+  if (!fp)
+    return false;
+
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  size_t n;
+
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    data.insert(data.end(), buf, buf + n);
+
+  fclose(fp);
+
+  if (data.size() < 14 || memcmp(data.data(), "MThd", 4) || ReadBE(&data[4], 4) < 6)
+    return false;
+
+  const int nTracks = ReadBE(&data[10], 2);
+  const uint32_t division = ReadBE(&data[12], 2);
+  const double ticksPerSecondSMPTE = (division & 0x8000) ? (256 - (division >> 8)) * (division & 0xFF) : 0.;
+
+  struct TickEvent { uint64_t mTick; int mOrder; bool mTempo; uint32_t mValue; uint8_t mStatus, mData1, mData2; };
+  std::vector<TickEvent> tickEvents;
+
+  const uint8_t* p = data.data() + 8 + ReadBE(&data[4], 4);
+  const uint8_t* pFileEnd = data.data() + data.size();
+
+  for (int track = 0; track < nTracks && p + 8 <= pFileEnd; track++)
+  {
+    const uint32_t chunkSize = ReadBE(p + 4, 4);
+    const bool isTrack = !memcmp(p, "MTrk", 4);
+    p += 8;
+    const uint8_t* pEnd = std::min(p + chunkSize, pFileEnd);
+
+    if (!isTrack)
+    {
+      p = pEnd;
+      track--;
+      continue;
+    }
+
+    uint64_t tick = 0;
+    uint8_t runningStatus = 0;
+
+    while (p < pEnd)
+    {
+      tick += ReadVarLen(p, pEnd);
+
+      if (p >= pEnd)
+        break;
+
+      uint8_t status = *p;
+
+      if (status == 0xFF) // meta event
+      {
+        if (p + 2 > pEnd)
+          break;
+
+        const uint8_t type = p[1];
+        p += 2;
+        const uint32_t len = ReadVarLen(p, pEnd);
+
+        if (type == 0x51 && len == 3 && p + 3 <= pEnd)
+          tickEvents.push_back({ tick, static_cast<int>(tickEvents.size()), true, ReadBE(p, 3), 0, 0, 0 });
+
+        p += len;
+        continue;
+      }
+      else if (status == 0xF0 || status == 0xF7) // sysex is skipped
+      {
+        p++;
+        p += ReadVarLen(p, pEnd);
+        continue;
+      }
+
+      if (status & 0x80)
+      {
+        runningStatus = status;
+        p++;
+      }
+      else
+        status = runningStatus;
+
+      const int nDataBytes = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+
+      if (!status || p + nDataBytes > pEnd)
+        break;
+
+      const uint8_t data1 = p[0];
+      const uint8_t data2 = nDataBytes == 2 ? p[1] : 0;
+      p += nDataBytes;
+
+      tickEvents.push_back({ tick, static_cast<int>(tickEvents.size()), false, 0, status, data1, data2 });
+    }
+
+    p = pEnd;
+  }
+
+  std::sort(tickEvents.begin(), tickEvents.end(), [](const TickEvent& a, const TickEvent& b) {
+    return a.mTick != b.mTick ? a.mTick < b.mTick : a.mOrder < b.mOrder;
+  });
+
+  double secondsPerTick = ticksPerSecondSMPTE > 0. ? 1. / ticksPerSecondSMPTE : 0.5 / division; // 120 bpm until the first tempo event
+  double time = 0.;
+  uint64_t lastTick = 0;
+
+  for (const TickEvent& e : tickEvents)
+  {
+    time += (e.mTick - lastTick) * secondsPerTick;
+    lastTick = e.mTick;
+
+    if (e.mTempo)
+    {
+      if (ticksPerSecondSMPTE == 0.)
+        secondsPerTick = e.mValue / 1000000. / division;
+    }
+    else
+      events.push_back({ time, e.mStatus, e.mData1, e.mData2 });
+  }
+
+  return true;
+}
+
+#pragma mark - Rendering
+
+double LaneValue(const AutomationLane& lane, double time)
+{
+  const double phase = time * lane.mRate - std::floor(time * lane.mRate);
+
+  if (lane.mShape == "ramp")
+    return phase;
+  else if (lane.mShape == "square")
+    return phase < 0.5 ? 0. : 1.;
+  else if (lane.mShape == "random")
+  {
+    // a new value each cycle
+    uint32_t x = static_cast<uint32_t>(std::floor(time * lane.mRate)) * 2654435761u + static_cast<uint32_t>(lane.mParamIdx);
+    x ^= x >> 15; x *= 2246822519u; x ^= x >> 13;
+    return (x & 0xFFFFFF) / static_cast<double>(0xFFFFFF);
+  }
+
+  return 0.5 + 0.5 * std::sin(2. * PI * phase);
+}
+
+Result Run(const Options& options, const std::vector<MidiEvent>& midiEvents, double sampleRate, int blockSize)
+{
+  std::unique_ptr<IPlugBench> pPlug(MakePlug(InstanceInfo()));
+  pPlug->Prepare(sampleRate, blockSize,
+                 options.mNInputs < 0 ? pPlug->MaxNChannels(ERoute::kInput) : options.mNInputs,
+                 options.mNOutputs < 0 ? pPlug->MaxNChannels(ERoute::kOutput) : options.mNOutputs);
+
+  const int nIn = pPlug->NChannelsConnected(ERoute::kInput);
+  const int nOut = pPlug->NChannelsConnected(ERoute::kOutput);
+
+  std::vector<std::vector<sample>> inputData(nIn, std::vector<sample>(blockSize));
+  std::vector<std::vector<sample>> outputData(nOut, std::vector<sample>(blockSize));
+  std::vector<sample*> inputs(nIn + 1), outputs(nOut + 1);
+
+  for (int c = 0; c < nIn; c++) inputs[c] = inputData[c].data();
+  for (int c = 0; c < nOut; c++) outputs[c] = outputData[c].data();
+
+  const int64_t totalFrames = static_cast<int64_t>(std::ceil(options.mSeconds * sampleRate));
+  std::vector<double> blockTimes;
+  blockTimes.reserve(static_cast<size_t>(totalFrames / blockSize + 1));
+
+  size_t midiIdx = 0;
+  uint32_t noise = 22222;
+  double totalTime = 0.;
+  int nOverruns = 0;
+  int histogram[kNLoadBuckets] = {};
+
+  for (int64_t pos = 0; pos < totalFrames; pos += blockSize)
+  {
+    const int nFrames = static_cast<int>(std::min<int64_t>(blockSize, totalFrames - pos));
+
+    // the input signal isn't part of the measurement
+    for (int c = 0; c < nIn; c++)
+    {
+      sample* pIn = inputs[c];
+
+      for (int s = 0; s < nFrames; s++)
+      {
+        if (options.mInput == "sine")
+          pIn[s] = static_cast<sample>(0.5 * std::sin(2. * PI * 440. * (pos + s) / sampleRate));
+        else if (options.mInput == "silence")
+          pIn[s] = 0;
+        else
+        {
+          noise = noise * 1664525u + 1013904223u;
+          pIn[s] = static_cast<sample>((noise >> 8) / 16777216. - 0.5);
+        }
+      }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (midiIdx < midiEvents.size() && midiEvents[midiIdx].mTime * sampleRate < pos + nFrames)
+    {
+      const MidiEvent& e = midiEvents[midiIdx++];
+      const int offset = std::max(static_cast<int>(e.mTime * sampleRate - pos), 0);
+      pPlug->AddMidiMsg(IMidiMsg(offset, e.mStatus, e.mData1, e.mData2));
+    }
+
+    for (const AutomationLane& lane : options.mLanes)
+    {
+      const int64_t firstPoint = ((pos + options.mAutomationInterval - 1) / options.mAutomationInterval) * options.mAutomationInterval;
+
+      for (int64_t point = firstPoint; point < pos + nFrames; point += options.mAutomationInterval)
+        pPlug->AddParamAutomation(lane.mParamIdx, LaneValue(lane, point / sampleRate), static_cast<int>(point - pos));
+    }
+
+    pPlug->Process(inputs.data(), outputs.data(), nFrames);
+
+    const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double load = duration * sampleRate / nFrames;
+    int bucket = 0;
+
+    while (bucket < kNLoadBuckets - 1 && load > kLoadBuckets[bucket])
+      bucket++;
+
+    histogram[bucket]++;
+    nOverruns += load > 1.;
+    totalTime += duration;
+    blockTimes.push_back(duration);
+  }
+
+  Result result = {};
+  result.mSampleRate = sampleRate;
+  result.mBlockSize = blockSize;
+  result.mNInputs = nIn;
+  result.mNOutputs = nOut;
+  result.mNBlocks = static_cast<int>(blockTimes.size());
+  result.mRealtimeFactor = totalTime > 0. ? totalFrames / sampleRate / totalTime : 0.;
+  result.mNOverruns = nOverruns;
+  std::copy(histogram, histogram + kNLoadBuckets, result.mHistogram);
+
+  if (!blockTimes.empty())
+  {
+    std::sort(blockTimes.begin(), blockTimes.end());
+    auto percentile = [&](double p) { return blockTimes[std::min(static_cast<size_t>(p * blockTimes.size()), blockTimes.size() - 1)] * 1e6; };
+    result.mMeanUs = totalTime / blockTimes.size() * 1e6;
+    result.mP50Us = percentile(0.5);
+    result.mP90Us = percentile(0.9);
+    result.mP99Us = percentile(0.99);
+    result.mP999Us = percentile(0.999);
+    result.mMaxUs = blockTimes.back() * 1e6;
+  }
+
+  return result;
+}
+
+void PrintResult(const Result& r)
+{
+  printf("%6.0f Hz %5d frames %2d in %2d out: %8.1fx realtime, block us mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f, %d overruns\n",
+         r.mSampleRate, r.mBlockSize, r.mNInputs, r.mNOutputs, r.mRealtimeFactor, r.mMeanUs, r.mP50Us, r.mP90Us, r.mP99Us, r.mP999Us, r.mMaxUs, r.mNOverruns);
+
+  for (int b = 0; b < kNLoadBuckets; b++)
+  {
+    const double fraction = static_cast<double>(r.mHistogram[b]) / std::max(r.mNBlocks, 1);
+
+    if (b < kNLoadBuckets - 1)
+      printf("    load <= %5.1f%%", kLoadBuckets[b] * 100.);
+    else
+      printf("    overrun       ");
+
+    printf(" %7d %6.2f%% |%.*s\n", r.mHistogram[b], fraction * 100., static_cast<int>(std::ceil(fraction * 50.)), "##################################################");
+  }
+}
+
+bool WriteJson(const char* path, const char* pluginName, const std::vector<Result>& results)
+{
+  FILE* fp = fopen(path, "w");
+
+  if (!fp)
+    return false;
+
+  fprintf(fp, "{\"plugin\":\"%s\",\"results\":[", pluginName);
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    fprintf(fp, "%s\n{\"sampleRate\":%.0f,\"blockSize\":%d,\"inputs\":%d,\"outputs\":%d,\"blocks\":%d,\"realtimeFactor\":%.3f,"
+                "\"meanUs\":%.3f,\"p50Us\":%.3f,\"p90Us\":%.3f,\"p99Us\":%.3f,\"p999Us\":%.3f,\"maxUs\":%.3f,\"overruns\":%d,\"loadHistogram\":[",
+            i ? "," : "", r.mSampleRate, r.mBlockSize, r.mNInputs, r.mNOutputs, r.mNBlocks, r.mRealtimeFactor,
+            r.mMeanUs, r.mP50Us, r.mP90Us, r.mP99Us, r.mP999Us, r.mMaxUs, r.mNOverruns);
+
+    for (int b = 0; b < kNLoadBuckets; b++)
+      fprintf(fp, "%s%d", b ? "," : "", r.mHistogram[b]);
+
+    fprintf(fp, "]}");
+  }
+
+  fprintf(fp, "\n]}\n");
+  return fclose(fp) == 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Options options;
+
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage();
+    return 1;
+  }
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE__)
+  // hosts run plug-ins with denormals flushed to zero
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+  std::vector<MidiEvent> midiEvents;
+
+  if (!options.mMidiPath.empty() && !LoadMidiFile(options.mMidiPath.c_str(), midiEvents))
+  {
+    fprintf(stderr, "couldn't read MIDI file %s\n", options.mMidiPath.c_str());
+    return 1;
+  }
+
+  std::vector<Result> results;
+  WDL_String pluginName;
+
+  {
+    std::unique_ptr<IPlugBench> pPlug(MakePlug(InstanceInfo()));
+    pluginName.Set(pPlug->GetPluginName());
+    printf("%s %s, %.1f s per run, %d MIDI events, %d automation lanes\n", pPlug->GetPluginName(), pPlug->GetArchStr(), options.mSeconds,
+           static_cast<int>(midiEvents.size()), static_cast<int>(options.mLanes.size()));
+  }
+
+  for (double sampleRate : options.mSampleRates)
+  {
+    for (int blockSize : options.mBlockSizes)
+    {
+      if (sampleRate <= 0. || blockSize <= 0)
+        continue;
+
+      results.push_back(Run(options, midiEvents, sampleRate, blockSize));
+      PrintResult(results.back());
+    }
+  }
+
+  if (!options.mJsonPath.empty() && !WriteJson(options.mJsonPath.c_str(), pluginName.Get(), results))
+  {
+    fprintf(stderr, "couldn't write %s\n", options.mJsonPath.c_str());
+    return 1;
+  }
+
+  return 0;
+}
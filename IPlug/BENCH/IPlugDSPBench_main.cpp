@@ -0,0 +1,795 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+/**
+ * @file
+ * @brief Command line microbenchmark for the DSP primitives in IPlug/Extras and WDL, and the IPlugSIMD kernels.
+ * Each primitive is run for every combination of block size and channel count, for float and double where it is templated on the sample type,
+ * and for each instruction set variant the CPU supports where it has them. It reports the time per sample (per channel) and, on x86, the TSC cycles per sample,
+ * so that changes to the primitives can be compared between builds. Unlike IPlugBench, no plug-in is involved. Build it with e.g.
+ *
+ *   cc -O3 -c WDL/fft.c -o fft.o
+ *   c++ -std=c++17 -O3 -DNDEBUG -IIPlug -IIPlug/Extras -IWDL IPlug/BENCH/IPlugDSPBench_main.cpp WDL/convoengine.cpp WDL/resample.cpp fft.o -o iplug-dspbench
+ *
+ * then run e.g.
+ *
+ *   iplug-dspbench --block 32,512 --channels 2 --filter SVF --json results.json
+ *
+ * Options:
+ *   --block B1,B2,...     Block sizes (default 16,64,256,1024). The FFT benchmarks use them as the transform size
+ *   --channels C1,C2,...  Channel counts (default 1,2,8)
+ *   --time S              Seconds to measure each benchmark for (default 0.2)
+ *   --reps N              Repetitions that the time is split into, the median and minimum are reported (default 5)
+ *   --filter TEXT         Only run the benchmarks whose name contains TEXT
+ *   --list                Print the benchmark names and exit
+ *   --json PATH           Also write the results as JSON
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+  #endif
+  #define DSPBENCH_HAS_TSC
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// the Extras expect the utilities that plug-in sources include first
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+#include "IPlugSIMD.h"
+#include "SVF.h"
+#include "Oversampler.h"
+#include "ADSREnvelope.h"
+#include "LFO.h"
+#include "NChanDelay.h"
+
+#include "convoengine.h"
+#include "resample.h"
+#include "fft.h"
+
+using namespace iplug;
+
+namespace {
+
+struct Options
+{
+  std::vector<int> mBlockSizes { 16, 64, 256, 1024 };
+  std::vector<int> mChannels { 1, 2, 8 };
+  double mSeconds = 0.2;
+  int mReps = 5;
+  std::string mFilter;
+  bool mList = false;
+  std::string mJsonPath;
+};
+
+/** One configuration of a primitive, processing a block of frames in a number of channels per call */
+class Bench
+{
+public:
+  virtual ~Bench() {}
+  virtual void ProcessBlock() = 0;
+};
+
+struct BenchInfo
+{
+  std::string mName;
+  const char* mSampleType;
+  const char* mISA;
+  int mBlockSize;
+  int mNChans;
+  std::function<std::unique_ptr<Bench>()> mMake;
+};
+
+struct Result
+{
+  const BenchInfo* mInfo;
+  int64_t mNBlocks; // per repetition
+  double mNsPerSample; // median of the repetitions
+  double mMinNsPerSample;
+  double mCyclesPerSample; // median, 0 without a cycle counter
+};
+
+const int kMaxChans = 8;
+const double kSampleRate = 48000.;
+
+template <typename T> const char* SampleTypeName();
+template <> const char* SampleTypeName<float>() { return "float"; }
+template <> const char* SampleTypeName<double>() { return "double"; }
+
+const char* GetISAName(ESIMDLevel level)
+{
+  switch (level)
+  {
+    case ESIMDLevel::kSSE2: return "sse2";
+    case ESIMDLevel::kAVX:  return "avx";
+    case ESIMDLevel::kNEON: return "neon";
+    case ESIMDLevel::kWASM: return "wasm";
+    default:                return "scalar";
+  }
+}
+
+inline uint64_t ReadCycleCounter()
+{
+#ifdef DSPBENCH_HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/** Per channel input and output buffers, the input filled with deterministic noise */
+template <typename T>
+struct Buffers
+{
+  Buffers(int nChans, int nFrames, int nOutFrames = -1)
+  : mIn(nChans, std::vector<T>(nFrames))
+  , mOut(nChans, std::vector<T>(nOutFrames < 0 ? nFrames : nOutFrames))
+  {
+    uint32_t seed = 1;
+
+    for (int c = 0; c < nChans; c++)
+    {
+      for (auto& s : mIn[c])
+      {
+        seed = seed * 1664525u + 1013904223u;
+        s = static_cast<T>(static_cast<int32_t>(seed) * (0.5 / 2147483648.));
+      }
+
+      mInPtrs.push_back(mIn[c].data());
+      mOutPtrs.push_back(mOut[c].data());
+    }
+  }
+
+  std::vector<std::vector<T>> mIn, mOut;
+  std::vector<T*> mInPtrs, mOutPtrs;
+};
+
+/** Ties a lambda that processes a block to the state it needs */
+template <typename State, typename Func>
+class LambdaBench : public Bench
+{
+public:
+  LambdaBench(std::unique_ptr<State> pState, Func func) : mState(std::move(pState)), mFunc(func) {}
+  void ProcessBlock() override { mFunc(*mState); }
+
+private:
+  std::unique_ptr<State> mState;
+  Func mFunc;
+};
+
+template <typename State, typename Func>
+std::unique_ptr<Bench> MakeBench(std::unique_ptr<State> pState, Func func)
+{
+  return std::unique_ptr<Bench>(new LambdaBench<State, Func>(std::move(pState), func));
+}
+
+#pragma mark - IPlug Extras
+
+template <typename T>
+void AddExtrasBenches(std::vector<BenchInfo>& benches, int blockSize, int nChans)
+{
+  const char* type = SampleTypeName<T>();
+
+  benches.push_back({"SVF/LowPass", type, "native", blockSize, nChans, [=]() {
+    struct State : Buffers<T> { using Buffers<T>::Buffers; SVF<T, kMaxChans> mFilter; };
+    auto pState = std::make_unique<State>(nChans, blockSize);
+    pState->mFilter.SetSampleRate(kSampleRate);
+    pState->mFilter.SetFreqCPS(1000.);
+    pState->mFilter.SetQ(2.);
+    return MakeBench(std::move(pState), [=](State& s) { s.mFilter.ProcessBlock(s.mInPtrs.data(), s.mOutPtrs.data(), nChans, blockSize); });
+  }});
+
+  for (const auto engine : {EOverSamplingEngine::kIIR, EOverSamplingEngine::kFIR})
+  {
+    for (const auto factor : {k2x, k4x})
+    {
+      const std::string name = std::string("OverSampler/") + (engine == EOverSamplingEngine::kIIR ? "IIR/" : "FIR/") + (factor == k2x ? "2x" : "4x");
+
+      benches.push_back({name, type, "native", blockSize, nChans, [=]() {
+        struct State : Buffers<T>
+        {
+          State(int nChans, int blockSize, EOverSamplingEngine engine, EFactor factor)
+          : Buffers<T>(nChans, blockSize), mOverSampler(factor, true, nChans, nChans, engine, EFIRQuality::kMedium, factor) {}
+          OverSampler<T> mOverSampler;
+        };
+        auto pState = std::make_unique<State>(nChans, blockSize, engine, factor);
+        pState->mOverSampler.Reset(blockSize);
+        return MakeBench(std::move(pState), [=](State& s) {
+          // a gain at the higher rate, so that the cost is the resampling
+          s.mOverSampler.ProcessBlockContiguous(s.mInPtrs.data(), s.mOutPtrs.data(), blockSize, nChans, nChans, [nChans](T** inputs, T** outputs, int nFrames) {
+            for (int c = 0; c < nChans; c++)
+              for (int i = 0; i < nFrames; i++)
+                outputs[c][i] = inputs[c][i] * static_cast<T>(0.5);
+          });
+        });
+      }});
+    }
+  }
+
+  // the channels are separate envelopes, e.g. voices, and notes are started and released every few thousand samples so that all of the stages are run
+  benches.push_back({"ADSREnvelope", type, "native", blockSize, nChans, [=]() {
+    struct State : Buffers<T>
+    {
+      State(int nChans, int blockSize) : Buffers<T>(nChans, blockSize), mEnvs(nChans) {}
+      std::vector<ADSREnvelope<T>> mEnvs;
+      int64_t mPos = 0;
+    };
+    auto pState = std::make_unique<State>(nChans, blockSize);
+    for (auto& env : pState->mEnvs)
+    {
+      env.SetSampleRate(static_cast<T>(kSampleRate));
+      env.SetStageTime(ADSREnvelope<T>::kAttack, static_cast<T>(5.));
+      env.SetStageTime(ADSREnvelope<T>::kDecay, static_cast<T>(20.));
+      env.SetStageTime(ADSREnvelope<T>::kRelease, static_cast<T>(30.));
+    }
+    return MakeBench(std::move(pState), [=](State& s) {
+      const int64_t note = s.mPos % 4096;
+
+      for (int c = 0; c < nChans; c++)
+      {
+        if (note < blockSize)
+          s.mEnvs[c].Start(static_cast<T>(1.));
+        else if (note >= 2048 && note < 2048 + blockSize)
+          s.mEnvs[c].Release();
+
+        s.mEnvs[c].ProcessBlock(s.mOutPtrs[c], blockSize, static_cast<T>(0.5));
+      }
+
+      s.mPos += blockSize;
+    });
+  }});
+
+  for (const auto shape : {LFO<T>::kSine, LFO<T>::kTriangle})
+  {
+    benches.push_back({shape == LFO<T>::kSine ? "LFO/Sine" : "LFO/Triangle", type, "native", blockSize, nChans, [=]() {
+      struct State : Buffers<T> { State(int nChans, int blockSize) : Buffers<T>(nChans, blockSize), mLFOs(nChans) {} std::vector<LFO<T>> mLFOs; };
+      auto pState = std::make_unique<State>(nChans, blockSize);
+      for (int c = 0; c < nChans; c++)
+      {
+        pState->mLFOs[c].SetSampleRate(kSampleRate);
+        pState->mLFOs[c].SetShape(shape);
+        pState->mLFOs[c].SetFreqCPS(1. + c);
+      }
+      return MakeBench(std::move(pState), [=](State& s) {
+        for (int c = 0; c < nChans; c++)
+          s.mLFOs[c].ProcessBlock(s.mOutPtrs[c], blockSize);
+      });
+    }});
+  }
+
+  benches.push_back({"NChanDelayLine", type, "native", blockSize, nChans, [=]() {
+    struct State : Buffers<T> { State(int nChans, int blockSize) : Buffers<T>(nChans, blockSize), mDelay(nChans, nChans) {} NChanDelayLine<T> mDelay; };
+    auto pState = std::make_unique<State>(nChans, blockSize);
+    pState->mDelay.SetDelayTime(1000);
+    return MakeBench(std::move(pState), [=](State& s) { s.mDelay.ProcessBlock(s.mInPtrs.data(), s.mOutPtrs.data(), blockSize); });
+  }});
+}
+
+#pragma mark - IPlugSIMD kernels
+
+/** The kernels of a simd::Kernels table for a sample type */
+template <typename T> struct TypedKernels;
+
+template <> struct TypedKernels<float>
+{
+  static auto Accumulate(const simd::Kernels& k) { return k.accumulateFloat; }
+  static auto MultiplyAccumulate(const simd::Kernels& k) { return k.multiplyAccumulateFloat; }
+  static auto Peak(const simd::Kernels& k) { return k.peakFloat; }
+  static auto PeakSumSquares(const simd::Kernels& k) { return k.peakSumSquaresFloat; }
+};
+
+template <> struct TypedKernels<double>
+{
+  static auto Accumulate(const simd::Kernels& k) { return k.accumulateDouble; }
+  static auto MultiplyAccumulate(const simd::Kernels& k) { return k.multiplyAccumulateDouble; }
+  static auto Peak(const simd::Kernels& k) { return k.peakDouble; }
+  static auto PeakSumSquares(const simd::Kernels& k) { return k.peakSumSquaresDouble; }
+};
+
+template <typename T>
+void AddKernelBenches(std::vector<BenchInfo>& benches, int blockSize, int nChans, ESIMDLevel level)
+{
+  const char* type = SampleTypeName<T>();
+  const char* isa = GetISAName(level);
+
+  struct State : Buffers<T>
+  {
+    State(int nChans, int blockSize, ESIMDLevel level) : Buffers<T>(nChans, blockSize), mKernels(level), mWide(blockSize) {}
+    simd::Kernels mKernels;
+    std::vector<double> mWide;
+    T mResult = 0;
+  };
+
+  benches.push_back({"VectorAccumulate", type, isa, blockSize, nChans, [=]() {
+    auto pState = std::make_unique<State>(nChans, blockSize, level);
+    const auto fn = TypedKernels<T>::Accumulate(pState->mKernels);
+    return MakeBench(std::move(pState), [=](State& s) {
+      for (int c = 0; c < nChans; c++)
+        fn(s.mOutPtrs[c], s.mInPtrs[c], blockSize);
+    });
+  }});
+
+  benches.push_back({"VectorMultiplyAccumulate", type, isa, blockSize, nChans, [=]() {
+    auto pState = std::make_unique<State>(nChans, blockSize, level);
+    const auto fn = TypedKernels<T>::MultiplyAccumulate(pState->mKernels);
+    return MakeBench(std::move(pState), [=](State& s) {
+      for (int c = 0; c < nChans; c++)
+        fn(s.mOutPtrs[c], s.mInPtrs[c], blockSize, static_cast<T>(0.5), static_cast<T>(0.0001));
+    });
+  }});
+
+  benches.push_back({"VectorPeak", type, isa, blockSize, nChans, [=]() {
+    auto pState = std::make_unique<State>(nChans, blockSize, level);
+    const auto fn = TypedKernels<T>::Peak(pState->mKernels);
+    return MakeBench(std::move(pState), [=](State& s) {
+      for (int c = 0; c < nChans; c++)
+        s.mResult += fn(s.mInPtrs[c], blockSize);
+    });
+  }});
+
+  benches.push_back({"VectorPeakSumSquares", type, isa, blockSize, nChans, [=]() {
+    auto pState = std::make_unique<State>(nChans, blockSize, level);
+    const auto fn = TypedKernels<T>::PeakSumSquares(pState->mKernels);
+    return MakeBench(std::move(pState), [=](State& s) {
+      T peak = 0, sum = 0;
+      for (int c = 0; c < nChans; c++)
+        fn(s.mInPtrs[c], blockSize, &peak, &sum);
+      s.mResult += peak + sum;
+    });
+  }});
+}
+
+/** The float only kernels */
+void AddFloatKernelBenches(std::vector<BenchInfo>& benches, int blockSize, int nChans, ESIMDLevel level)
+{
+  const char* isa = GetISAName(level);
+
+  struct State : Buffers<float>
+  {
+    State(int nChans, int blockSize, ESIMDLevel level) : Buffers<float>(nChans, blockSize), mKernels(level), mWide(blockSize) {}
+    simd::Kernels mKernels;
+    std::vector<double> mWide;
+    float mResult = 0.f;
+  };
+
+  benches.push_back({"VectorMinMax", "float", isa, blockSize, nChans, [=]() {
+    return MakeBench(std::make_unique<State>(nChans, blockSize, level), [=](State& s) {
+      float min = 0.f, max = 0.f;
+      for (int c = 0; c < nChans; c++)
+        s.mKernels.minMaxFloat(s.mInPtrs[c], blockSize, &min, &max);
+      s.mResult += max - min;
+    });
+  }});
+
+  benches.push_back({"VectorCopy/FloatToDouble", "float", isa, blockSize, nChans, [=]() {
+    return MakeBench(std::make_unique<State>(nChans, blockSize, level), [=](State& s) {
+      for (int c = 0; c < nChans; c++)
+        s.mKernels.convertFloatToDouble(s.mWide.data(), s.mInPtrs[c], blockSize);
+    });
+  }});
+}
+
+#pragma mark - WDL
+
+void AddWDLBenches(std::vector<BenchInfo>& benches, int blockSize, int nChans)
+{
+  const char* fftType = SampleTypeName<WDL_FFT_REAL>();
+  const char* resampleType = SampleTypeName<WDL_ResampleSample>();
+
+  // a decaying noise impulse, as a reverb would load
+  auto makeImpulse = [](WDL_ImpulseBuffer& impulse, int nChans, int length) {
+    impulse.samplerate = kSampleRate;
+    impulse.SetNumChannels(nChans);
+    impulse.SetLength(length);
+    uint32_t seed = 1;
+
+    for (int c = 0; c < nChans; c++)
+    {
+      WDL_FFT_REAL* pImpulse = impulse.impulses[c].Get();
+
+      for (int i = 0; i < length; i++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        pImpulse[i] = static_cast<WDL_FFT_REAL>(static_cast<int32_t>(seed) * (0.5 / 2147483648.) * std::exp(-6. * i / length));
+      }
+    }
+  };
+
+  struct ConvolutionState : Buffers<WDL_FFT_REAL>
+  {
+    ConvolutionState(int nChans, int blockSize) : Buffers<WDL_FFT_REAL>(nChans, blockSize) {}
+    WDL_ImpulseBuffer mImpulse;
+  };
+
+  const int kImpulseLength = 16384;
+
+  benches.push_back({"WDL_ConvolutionEngine/16384", fftType, "native", blockSize, nChans, [=]() {
+    struct State : ConvolutionState { using ConvolutionState::ConvolutionState; WDL_ConvolutionEngine mEngine; };
+    auto pState = std::make_unique<State>(nChans, blockSize);
+    makeImpulse(pState->mImpulse, nChans, kImpulseLength);
+    pState->mEngine.SetImpulse(&pState->mImpulse);
+    return MakeBench(std::move(pState), [=](State& s) {
+      s.mEngine.Add(s.mInPtrs.data(), blockSize, nChans);
+      const int avail = std::min(s.mEngine.Avail(blockSize), blockSize);
+      WDL_FFT_REAL** pOutputs = s.mEngine.Get();
+      for (int c = 0; c < nChans; c++)
+        memcpy(s.mOutPtrs[c], pOutputs[c], avail * sizeof(WDL_FFT_REAL));
+      s.mEngine.Advance(avail);
+    });
+  }});
+
+  benches.push_back({"WDL_ConvolutionEngine_Div/16384", fftType, "native", blockSize, nChans, [=]() {
+    struct State : ConvolutionState { using ConvolutionState::ConvolutionState; WDL_ConvolutionEngine_Div mEngine; };
+    auto pState = std::make_unique<State>(nChans, blockSize);
+    makeImpulse(pState->mImpulse, nChans, kImpulseLength);
+    pState->mEngine.SetImpulse(&pState->mImpulse, 0, blockSize);
+    return MakeBench(std::move(pState), [=](State& s) {
+      s.mEngine.Add(s.mInPtrs.data(), blockSize, nChans);
+      const int avail = std::min(s.mEngine.Avail(blockSize), blockSize);
+      WDL_FFT_REAL** pOutputs = s.mEngine.Get();
+      for (int c = 0; c < nChans; c++)
+        memcpy(s.mOutPtrs[c], pOutputs[c], avail * sizeof(WDL_FFT_REAL));
+      s.mEngine.Advance(avail);
+    });
+  }});
+
+  // 44.1 to 48 kHz, blockSize is the number of output frames. WDL_Resampler's buffers are interleaved
+  for (const bool sinc : {true, false})
+  {
+    benches.push_back({sinc ? "WDL_Resampler/Sinc64" : "WDL_Resampler/Linear", resampleType, "native", blockSize, nChans, [=]() {
+      struct State
+      {
+        State(int nChans, int blockSize) : mOut(nChans * blockSize), mNoise(nChans * blockSize * 2) {}
+        WDL_Resampler mResampler;
+        std::vector<WDL_ResampleSample> mOut, mNoise;
+      };
+      auto pState = std::make_unique<State>(nChans, blockSize);
+      for (size_t i = 0; i < pState->mNoise.size(); i++)
+        pState->mNoise[i] = static_cast<WDL_ResampleSample>(std::sin(i * 0.1));
+      pState->mResampler.SetMode(true, 0, sinc, 64, 32);
+      pState->mResampler.SetRates(44100., kSampleRate);
+      return MakeBench(std::move(pState), [=](State& s) {
+        WDL_ResampleSample* pIn = nullptr;
+        const int nIn = s.mResampler.ResamplePrepare(blockSize, nChans, &pIn);
+        memcpy(pIn, s.mNoise.data(), std::min<size_t>(nIn * nChans, s.mNoise.size()) * sizeof(WDL_ResampleSample));
+        s.mResampler.ResampleOut(s.mOut.data(), nIn, blockSize, nChans);
+      });
+    }});
+  }
+
+  // a forward and an inverse transform of blockSize points per channel. The backend WDL_fft_init() chose (e.g. vDSP) is compared with the built-in implementation
+  if (blockSize >= 16 && blockSize <= WDL_FFT_MAX_SIZE && !(blockSize & (blockSize - 1)))
+  {
+    std::vector<const WDL_fft_backend*> backends { nullptr };
+
+    if (WDL_fft_get_backend())
+      backends.push_back(WDL_fft_get_backend());
+
+    for (const WDL_fft_backend* pBackend : backends)
+    {
+      const char* isa = pBackend ? "backend" : "builtin";
+
+      benches.push_back({"WDL_real_fft", fftType, isa, blockSize, nChans, [=]() {
+        WDL_fft_set_backend(pBackend);
+        return MakeBench(std::make_unique<Buffers<WDL_FFT_REAL>>(nChans, blockSize), [=](Buffers<WDL_FFT_REAL>& s) {
+          for (int c = 0; c < nChans; c++)
+          {
+            WDL_real_fft(s.mInPtrs[c], blockSize, 0);
+            WDL_real_fft(s.mInPtrs[c], blockSize, 1);
+          }
+        });
+      }});
+
+      benches.push_back({"WDL_fft", fftType, isa, blockSize, nChans, [=]() {
+        WDL_fft_set_backend(pBackend);
+        return MakeBench(std::make_unique<Buffers<WDL_FFT_REAL>>(nChans, blockSize * 2), [=](Buffers<WDL_FFT_REAL>& s) {
+          for (int c = 0; c < nChans; c++)
+          {
+            WDL_fft(reinterpret_cast<WDL_FFT_COMPLEX*>(s.mInPtrs[c]), blockSize, 0);
+            WDL_fft(reinterpret_cast<WDL_FFT_COMPLEX*>(s.mInPtrs[c]), blockSize, 1);
+          }
+        });
+      }});
+    }
+  }
+}
+
+#pragma mark - Running
+
+std::vector<BenchInfo> MakeBenches(const Options& options)
+{
+  std::vector<BenchInfo> benches;
+  std::vector<ESIMDLevel> levels { ESIMDLevel::kScalar };
+  const ESIMDLevel best = simd::Kernels().level;
+
+  // the levels below the best one that the CPU runs too
+  if (best == ESIMDLevel::kAVX)
+    levels.push_back(ESIMDLevel::kSSE2);
+  if (best != ESIMDLevel::kScalar)
+    levels.push_back(best);
+
+  for (int blockSize : options.mBlockSizes)
+  {
+    for (int nChans : options.mChannels)
+    {
+      if (blockSize <= 0 || nChans <= 0 || nChans > kMaxChans)
+        continue;
+
+      AddExtrasBenches<float>(benches, blockSize, nChans);
+      AddExtrasBenches<double>(benches, blockSize, nChans);
+
+      for (ESIMDLevel level : levels)
+      {
+        AddKernelBenches<float>(benches, blockSize, nChans, level);
+        AddKernelBenches<double>(benches, blockSize, nChans, level);
+        AddFloatKernelBenches(benches, blockSize, nChans, level);
+      }
+
+      AddWDLBenches(benches, blockSize, nChans);
+    }
+  }
+
+  if (!options.mFilter.empty())
+    benches.erase(std::remove_if(benches.begin(), benches.end(), [&](const BenchInfo& b) { return b.mName.find(options.mFilter) == std::string::npos; }), benches.end());
+
+  std::stable_sort(benches.begin(), benches.end(), [](const BenchInfo& a, const BenchInfo& b) { return a.mName < b.mName; });
+
+  return benches;
+}
+
+Result Run(const Options& options, const BenchInfo& info)
+{
+  using clock = std::chrono::steady_clock;
+
+  std::unique_ptr<Bench> pBench = info.mMake();
+  const double samplesPerBlock = static_cast<double>(info.mBlockSize) * info.mNChans;
+  const double repSeconds = options.mSeconds / options.mReps;
+
+  // warm up the caches and branch predictors, doubling the blocks per repetition until one takes long enough to time
+  int64_t nBlocks = 1;
+
+  for (;;)
+  {
+    const auto start = clock::now();
+
+    for (int64_t b = 0; b < nBlocks; b++)
+      pBench->ProcessBlock();
+
+    const double duration = std::chrono::duration<double>(clock::now() - start).count();
+
+    if (duration >= repSeconds * 0.5 || nBlocks >= (int64_t(1) << 40))
+    {
+      nBlocks = std::max<int64_t>(1, static_cast<int64_t>(nBlocks * repSeconds / std::max(duration, 1e-9)));
+      break;
+    }
+
+    nBlocks *= 2;
+  }
+
+  std::vector<double> nsPerSample, cyclesPerSample;
+
+  for (int r = 0; r < options.mReps; r++)
+  {
+    const auto start = clock::now();
+    const uint64_t startCycles = ReadCycleCounter();
+
+    for (int64_t b = 0; b < nBlocks; b++)
+      pBench->ProcessBlock();
+
+    const uint64_t cycles = ReadCycleCounter() - startCycles;
+    const double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    nsPerSample.push_back(ns / (nBlocks * samplesPerBlock));
+    cyclesPerSample.push_back(static_cast<double>(cycles) / (nBlocks * samplesPerBlock));
+  }
+
+  std::sort(nsPerSample.begin(), nsPerSample.end());
+  std::sort(cyclesPerSample.begin(), cyclesPerSample.end());
+
+  return { &info, nBlocks, nsPerSample[nsPerSample.size() / 2], nsPerSample.front(), cyclesPerSample[cyclesPerSample.size() / 2] };
+}
+
+void PrintUsage()
+{
+  printf("usage: dspbench [--block B1,B2,...] [--channels C1,C2,...] [--time S] [--reps N] [--filter TEXT] [--list] [--json PATH]\n");
+}
+
+template <typename T>
+std::vector<T> ParseList(const char* str)
+{
+  std::vector<T> values;
+
+  for (const char* p = str; *p; )
+  {
+    char* pEnd;
+    const double v = strtod(p, &pEnd);
+
+    if (pEnd == p)
+      break;
+
+    values.push_back(static_cast<T>(v));
+    p = *pEnd == ',' ? pEnd + 1 : pEnd;
+  }
+
+  return values;
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    auto needsValue = [&]() {
+      if (!value)
+        fprintf(stderr, "%s needs a value\n", arg);
+      else
+        i++;
+
+      return value != nullptr;
+    };
+
+    if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+      return false;
+    else if (!strcmp(arg, "--block"))
+    {
+      if (!needsValue()) return false;
+      options.mBlockSizes = ParseList<int>(value);
+    }
+    else if (!strcmp(arg, "--channels"))
+    {
+      if (!needsValue()) return false;
+      options.mChannels = ParseList<int>(value);
+    }
+    else if (!strcmp(arg, "--time"))
+    {
+      if (!needsValue()) return false;
+      options.mSeconds = atof(value);
+    }
+    else if (!strcmp(arg, "--reps"))
+    {
+      if (!needsValue()) return false;
+      options.mReps = atoi(value);
+    }
+    else if (!strcmp(arg, "--filter"))
+    {
+      if (!needsValue()) return false;
+      options.mFilter = value;
+    }
+    else if (!strcmp(arg, "--list"))
+      options.mList = true;
+    else if (!strcmp(arg, "--json"))
+    {
+      if (!needsValue()) return false;
+      options.mJsonPath = value;
+    }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return false;
+    }
+  }
+
+  return options.mSeconds > 0. && options.mReps > 0 && !options.mBlockSizes.empty() && !options.mChannels.empty();
+}
+
+void PrintResult(const Result& r)
+{
+  const BenchInfo& info = *r.mInfo;
+  printf("%-32s %-6s %-7s %5d frames %d ch: %9.3f ns/sample (min %9.3f)", info.mName.c_str(), info.mSampleType, info.mISA, info.mBlockSize, info.mNChans, r.mNsPerSample, r.mMinNsPerSample);
+
+#ifdef DSPBENCH_HAS_TSC
+  printf(" %9.3f cycles/sample", r.mCyclesPerSample);
+#endif
+
+  printf("\n");
+}
+
+bool WriteJson(const char* path, const std::vector<Result>& results)
+{
+  FILE* fp = fopen(path, "w");
+
+  if (!fp)
+    return false;
+
+  fprintf(fp, "{\"simdLevel\":\"%s\",\"fftReal\":\"%s\",\"resampleSample\":\"%s\",\"cycleCounter\":%s,\"results\":[",
+          GetISAName(simd::Kernels().level), SampleTypeName<WDL_FFT_REAL>(), SampleTypeName<WDL_ResampleSample>(),
+#ifdef DSPBENCH_HAS_TSC
+          "\"tsc\"");
+#else
+          "null");
+#endif
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    const BenchInfo& info = *r.mInfo;
+    fprintf(fp, "%s\n{\"name\":\"%s\",\"sampleType\":\"%s\",\"isa\":\"%s\",\"blockSize\":%d,\"channels\":%d,\"blocks\":%lld,"
+                "\"nsPerSample\":%.4f,\"minNsPerSample\":%.4f,\"cyclesPerSample\":",
+            i ? "," : "", info.mName.c_str(), info.mSampleType, info.mISA, info.mBlockSize, info.mNChans, static_cast<long long>(r.mNBlocks),
+            r.mNsPerSample, r.mMinNsPerSample);
+
+#ifdef DSPBENCH_HAS_TSC
+    fprintf(fp, "%.4f}", r.mCyclesPerSample);
+#else
+    fprintf(fp, "null}");
+#endif
+  }
+
+  fprintf(fp, "\n]}\n");
+  return fclose(fp) == 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Options options;
+
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage();
+    return 1;
+  }
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE__)
+  // hosts run plug-ins with denormals flushed to zero
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+  WDL_fft_init();
+
+  const std::vector<BenchInfo> benches = MakeBenches(options);
+
+  if (options.mList)
+  {
+    for (const BenchInfo& info : benches)
+      printf("%s %s %s %d frames %d ch\n", info.mName.c_str(), info.mSampleType, info.mISA, info.mBlockSize, info.mNChans);
+
+    return 0;
+  }
+
+  printf("%d benchmarks, best SIMD level %s, %.2f s each\n", static_cast<int>(benches.size()), GetISAName(simd::Kernels().level), options.mSeconds);
+
+  std::vector<Result> results;
+  const WDL_fft_backend* pDefaultBackend = WDL_fft_get_backend();
+
+  for (const BenchInfo& info : benches)
+  {
+    results.push_back(Run(options, info));
+    PrintResult(results.back());
+    WDL_fft_set_backend(pDefaultBackend);
+  }
+
+  if (!options.mJsonPath.empty() && !WriteJson(options.mJsonPath.c_str(), results))
+  {
+    fprintf(stderr, "couldn't write %s\n", options.mJsonPath.c_str());
+    return 1;
+  }
+
+  return 0;
+}
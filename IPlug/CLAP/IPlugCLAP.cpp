@@ -0,0 +1,1081 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "IPlugCLAP.h"
+#include "IPlugPluginBase.h"
+
+#if defined OS_LINUX
+  #include "IPlugRunLoop.h"
+#endif
+
+using namespace iplug;
+
+#if defined OS_LINUX
+/** Adapts the host's posix-fd-support and timer-support extensions to an iplug::IRunLoop, so that the UI is called back by the host when it has X events or its display timer is due */
+class IPlugCLAP::RunLoop final : public IRunLoop
+{
+public:
+  RunLoop(const clap_host_t* pHost, const clap_host_posix_fd_support_t* pFDSupport, const clap_host_timer_support_t* pTimerSupport)
+  : mHost(pHost)
+  , mFDSupport(pFDSupport)
+  , mTimerSupport(pTimerSupport)
+  {}
+
+  ~RunLoop()
+  {
+    for (auto& fd : mFDs)
+      mFDSupport->unregister_fd(mHost, fd.mFD);
+
+    for (auto& timer : mTimers)
+      mTimerSupport->unregister_timer(mHost, timer.mCLAPID);
+  }
+
+  RunLoop(const RunLoop&) = delete;
+  RunLoop& operator=(const RunLoop&) = delete;
+
+  bool AddFD(int fd, Callback func, void* pContext) override
+  {
+    if (std::any_of(mFDs.begin(), mFDs.end(), [fd](const FD& f) { return f.mFD == fd; }))
+      return false;
+
+    if (!mFDSupport->register_fd(mHost, fd, CLAP_POSIX_FD_READ))
+      return false;
+
+    mFDs.push_back({fd, func, pContext});
+    return true;
+  }
+
+  void RemoveFD(int fd) override
+  {
+    auto it = std::find_if(mFDs.begin(), mFDs.end(), [fd](const FD& f) { return f.mFD == fd; });
+
+    if (it != mFDs.end())
+    {
+      mFDSupport->unregister_fd(mHost, fd);
+      mFDs.erase(it);
+    }
+  }
+
+  int AddTimer(int intervalMS, Callback func, void* pContext) override
+  {
+    clap_id clapID = CLAP_INVALID_ID;
+
+    if (!mTimerSupport->register_timer(mHost, static_cast<uint32_t>(std::max(intervalMS, 1)), &clapID))
+      return 0;
+
+    // the host's ids can be 0, which IRunLoop reserves for failure
+    mTimers.push_back({++mLastTimerID, clapID, func, pContext});
+    return mLastTimerID;
+  }
+
+  void RemoveTimer(int timerID) override
+  {
+    auto it = std::find_if(mTimers.begin(), mTimers.end(), [timerID](const Timer& t) { return t.mID == timerID; });
+
+    if (it != mTimers.end())
+    {
+      mTimerSupport->unregister_timer(mHost, it->mCLAPID);
+      mTimers.erase(it);
+    }
+  }
+
+  void OnFD(int fd)
+  {
+    for (auto& f : mFDs)
+    {
+      if (f.mFD == fd)
+      {
+        f.mFunc(f.mpContext);
+        break;
+      }
+    }
+  }
+
+  void OnTimer(clap_id clapID)
+  {
+    for (auto& t : mTimers)
+    {
+      if (t.mCLAPID == clapID)
+      {
+        t.mFunc(t.mpContext);
+        break;
+      }
+    }
+  }
+
+private:
+  struct FD
+  {
+    int mFD;
+    Callback mFunc;
+    void* mpContext;
+  };
+
+  struct Timer
+  {
+    int mID;
+    clap_id mCLAPID;
+    Callback mFunc;
+    void* mpContext;
+  };
+
+  const clap_host_t* mHost;
+  const clap_host_posix_fd_support_t* mFDSupport;
+  const clap_host_timer_support_t* mTimerSupport;
+  std::vector<FD> mFDs;
+  std::vector<Timer> mTimers;
+  int mLastTimerID = 0;
+};
+#endif
+
+#pragma mark - Extensions
+
+const clap_plugin_params_t IPlugCLAP::sParams = {
+  // count
+  [](const clap_plugin_t* pPlugin) -> uint32_t {
+    return static_cast<uint32_t>(FromPlugin(pPlugin)->NParams());
+  },
+  // get_info
+  [](const clap_plugin_t* pPlugin, uint32_t paramIdx, clap_param_info_t* pInfo) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (paramIdx >= static_cast<uint32_t>(_this->NParams()))
+      return false;
+
+    const IParam* pParam = _this->GetParam(paramIdx);
+
+    memset(pInfo, 0, sizeof(clap_param_info_t));
+    pInfo->id = paramIdx;
+    pInfo->flags = 0;
+
+    if (pParam->GetCanAutomate())
+      pInfo->flags |= CLAP_PARAM_IS_AUTOMATABLE;
+
+    if (pParam->Type() != IParam::kTypeDouble || pParam->GetStepped())
+      pInfo->flags |= CLAP_PARAM_IS_STEPPED;
+
+    strncpy(pInfo->name, pParam->GetName(), CLAP_NAME_SIZE - 1);
+    strncpy(pInfo->module, pParam->GetGroup(), CLAP_PATH_SIZE - 1);
+    pInfo->min_value = pParam->GetMin();
+    pInfo->max_value = pParam->GetMax();
+    pInfo->default_value = pParam->GetDefault();
+    return true;
+  },
+  // get_value
+  [](const clap_plugin_t* pPlugin, clap_id paramID, double* pValue) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (paramID >= static_cast<clap_id>(_this->NParams()))
+      return false;
+
+    *pValue = _this->GetParam(paramID)->Value();
+    return true;
+  },
+  // value_to_text
+  [](const clap_plugin_t* pPlugin, clap_id paramID, double value, char* pDisplay, uint32_t size) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (paramID >= static_cast<clap_id>(_this->NParams()) || !size)
+      return false;
+
+    const IParam* pParam = _this->GetParam(paramID);
+    WDL_String str;
+    pParam->GetDisplay(value, false, str);
+
+    if (CStringHasContents(pParam->GetLabel()))
+    {
+      str.Append(" ");
+      str.Append(pParam->GetLabel());
+    }
+
+    strncpy(pDisplay, str.Get(), size - 1);
+    pDisplay[size - 1] = '\0';
+    return true;
+  },
+  // text_to_value
+  [](const clap_plugin_t* pPlugin, clap_id paramID, const char* display, double* pValue) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (paramID >= static_cast<clap_id>(_this->NParams()))
+      return false;
+
+    *pValue = _this->GetParam(paramID)->StringToValue(display);
+    return true;
+  },
+  // flush
+  [](const clap_plugin_t* pPlugin, const clap_input_events_t* pInEvents, const clap_output_events_t* pOutEvents) {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+    _this->ProcessInputEvents(pInEvents, false);
+    _this->ProcessOutputParamChanges(pOutEvents);
+  }
+};
+
+const clap_plugin_state_t IPlugCLAP::sState = {
+  // save
+  [](const clap_plugin_t* pPlugin, const clap_ostream_t* pStream) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+    IByteChunk chunk;
+    IByteChunk::InitChunkWithIPlugVer(chunk);
+
+    if (!_this->SerializeState(chunk))
+      return false;
+
+    const uint8_t* pData = chunk.GetData();
+    int64_t remaining = chunk.Size();
+
+    // the stream can take less than it's given
+    while (remaining > 0)
+    {
+      const int64_t written = pStream->write(pStream, pData, static_cast<uint64_t>(remaining));
+
+      if (written <= 0)
+        return false;
+
+      pData += written;
+      remaining -= written;
+    }
+
+    return true;
+  },
+  // load
+  [](const clap_plugin_t* pPlugin, const clap_istream_t* pStream) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+    IByteChunk chunk;
+    uint8_t buffer[4096];
+
+    while (true)
+    {
+      const int64_t bytesRead = pStream->read(pStream, buffer, sizeof(buffer));
+
+      if (bytesRead < 0)
+        return false;
+
+      if (bytesRead == 0)
+        break;
+
+      chunk.PutBytes(buffer, static_cast<int>(bytesRead));
+    }
+
+    int pos = 0;
+    IByteChunk::GetIPlugVerFromChunk(chunk, pos);
+    pos = _this->UnserializeState(chunk, pos);
+
+    if (pos < 0)
+      return false;
+
+    _this->OnRestoreState();
+    return true;
+  }
+};
+
+const clap_plugin_audio_ports_t IPlugCLAP::sAudioPorts = {
+  // count
+  [](const clap_plugin_t* pPlugin, bool isInput) -> uint32_t {
+    return static_cast<uint32_t>(FromPlugin(pPlugin)->MaxNBuses(isInput ? ERoute::kInput : ERoute::kOutput));
+  },
+  // get
+  [](const clap_plugin_t* pPlugin, uint32_t index, bool isInput, clap_audio_port_info_t* pInfo) -> bool {
+    return FromPlugin(pPlugin)->GetAudioPortInfo(index, isInput, pInfo);
+  }
+};
+
+const clap_plugin_note_ports_t IPlugCLAP::sNotePorts = {
+  // count
+  [](const clap_plugin_t* pPlugin, bool isInput) -> uint32_t {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+    return (isInput ? _this->DoesMIDIIn() : _this->DoesMIDIOut()) ? 1 : 0;
+  },
+  // get
+  [](const clap_plugin_t* pPlugin, uint32_t index, bool isInput, clap_note_port_info_t* pInfo) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (index != 0 || !(isInput ? _this->DoesMIDIIn() : _this->DoesMIDIOut()))
+      return false;
+
+    memset(pInfo, 0, sizeof(clap_note_port_info_t));
+    pInfo->id = 0;
+    pInfo->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI;
+    pInfo->preferred_dialect = CLAP_NOTE_DIALECT_MIDI;
+    strncpy(pInfo->name, isInput ? "MIDI Input" : "MIDI Output", CLAP_NAME_SIZE - 1);
+    return true;
+  }
+};
+
+const clap_plugin_latency_t IPlugCLAP::sLatency = {
+  // get
+  [](const clap_plugin_t* pPlugin) -> uint32_t {
+    return static_cast<uint32_t>(std::max(FromPlugin(pPlugin)->GetLatency(), 0));
+  }
+};
+
+const clap_plugin_tail_t IPlugCLAP::sTail = {
+  // get
+  [](const clap_plugin_t* pPlugin) -> uint32_t {
+    const int tailSize = FromPlugin(pPlugin)->GetTailSize();
+    // a negative tail size is an infinite tail, which CLAP reports as INT32_MAX or more
+    return tailSize < 0 ? static_cast<uint32_t>(INT32_MAX) : static_cast<uint32_t>(tailSize);
+  }
+};
+
+const clap_plugin_render_t IPlugCLAP::sRender = {
+  // has_hard_realtime_requirement
+  [](const clap_plugin_t* pPlugin) -> bool {
+    return false;
+  },
+  // set
+  [](const clap_plugin_t* pPlugin, clap_plugin_render_mode mode) -> bool {
+    FromPlugin(pPlugin)->SetRenderingOffline(mode == CLAP_RENDER_OFFLINE);
+    return true;
+  }
+};
+
+const clap_plugin_gui_t IPlugCLAP::sGUI = {
+  // is_api_supported
+  [](const clap_plugin_t* pPlugin, const char* api, bool isFloating) -> bool {
+    return FromPlugin(pPlugin)->GUIIsAPISupported(api, isFloating);
+  },
+  // get_preferred_api
+  [](const clap_plugin_t* pPlugin, const char** pAPI, bool* pIsFloating) -> bool {
+#if defined OS_MAC
+    *pAPI = CLAP_WINDOW_API_COCOA;
+#elif defined OS_WIN
+    *pAPI = CLAP_WINDOW_API_WIN32;
+#else
+    *pAPI = CLAP_WINDOW_API_X11;
+#endif
+    *pIsFloating = false;
+    return FromPlugin(pPlugin)->HasUI();
+  },
+  // create
+  [](const clap_plugin_t* pPlugin, const char* api, bool isFloating) -> bool {
+    return FromPlugin(pPlugin)->GUIIsAPISupported(api, isFloating);
+  },
+  // destroy
+  [](const clap_plugin_t* pPlugin) {
+    FromPlugin(pPlugin)->GUIDestroy();
+  },
+  // set_scale
+  [](const clap_plugin_t* pPlugin, double scale) -> bool {
+#if defined OS_MAC
+    // cocoa views are scaled by the OS
+    return false;
+#else
+    FromPlugin(pPlugin)->SetScreenScale(static_cast<float>(scale));
+    return true;
+#endif
+  },
+  // get_size
+  [](const clap_plugin_t* pPlugin, uint32_t* pWidth, uint32_t* pHeight) -> bool {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+    *pWidth = static_cast<uint32_t>(_this->GetEditorWidth());
+    *pHeight = static_cast<uint32_t>(_this->GetEditorHeight());
+    return true;
+  },
+  // can_resize
+  [](const clap_plugin_t* pPlugin) -> bool {
+    return FromPlugin(pPlugin)->GetHostResizeEnabled();
+  },
+  // get_resize_hints
+  [](const clap_plugin_t* pPlugin, clap_gui_resize_hints_t* pHints) -> bool {
+    const bool canResize = FromPlugin(pPlugin)->GetHostResizeEnabled();
+    pHints->can_resize_horizontally = canResize;
+    pHints->can_resize_vertically = canResize;
+    pHints->preserve_aspect_ratio = false;
+    pHints->aspect_ratio_width = 1;
+    pHints->aspect_ratio_height = 1;
+    return true;
+  },
+  // adjust_size
+  [](const clap_plugin_t* pPlugin, uint32_t* pWidth, uint32_t* pHeight) -> bool {
+    int w = static_cast<int>(*pWidth);
+    int h = static_cast<int>(*pHeight);
+    FromPlugin(pPlugin)->ConstrainEditorResize(w, h);
+    *pWidth = static_cast<uint32_t>(w);
+    *pHeight = static_cast<uint32_t>(h);
+    return true;
+  },
+  // set_size
+  [](const clap_plugin_t* pPlugin, uint32_t width, uint32_t height) -> bool {
+    FromPlugin(pPlugin)->OnParentWindowResize(static_cast<int>(width), static_cast<int>(height));
+    return true;
+  },
+  // set_parent
+  [](const clap_plugin_t* pPlugin, const clap_window_t* pWindow) -> bool {
+    return FromPlugin(pPlugin)->GUISetParent(pWindow);
+  },
+  // set_transient
+  [](const clap_plugin_t* pPlugin, const clap_window_t* pWindow) -> bool {
+    return false;
+  },
+  // suggest_title
+  [](const clap_plugin_t* pPlugin, const char* title) {},
+  // show
+  [](const clap_plugin_t* pPlugin) -> bool {
+    return true;
+  },
+  // hide
+  [](const clap_plugin_t* pPlugin) -> bool {
+    return true;
+  }
+};
+
+const clap_plugin_thread_pool_t IPlugCLAP::sThreadPool = {
+  // exec, on one of the host's threads during RequestExec()
+  [](const clap_plugin_t* pPlugin, uint32_t taskIdx) {
+    IPlugThreadPool* pPool = FromPlugin(pPlugin)->mExecPool;
+
+    if (pPool)
+      pPool->RunHostTask();
+  }
+};
+
+#if defined OS_LINUX
+const clap_plugin_timer_support_t IPlugCLAP::sTimerSupport = {
+  // on_timer
+  [](const clap_plugin_t* pPlugin, clap_id timerID) {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (_this->mRunLoop)
+      _this->mRunLoop->OnTimer(timerID);
+  }
+};
+
+const clap_plugin_posix_fd_support_t IPlugCLAP::sPosixFDSupport = {
+  // on_fd
+  [](const clap_plugin_t* pPlugin, int fd, clap_posix_fd_flags_t flags) {
+    IPlugCLAP* _this = FromPlugin(pPlugin);
+
+    if (_this->mRunLoop)
+      _this->mRunLoop->OnFD(fd);
+  }
+};
+#endif
+
+#pragma mark - IPlugCLAP Constructor/Destructor
+
+IPlugCLAP::IPlugCLAP(const InstanceInfo& info, const Config& config)
+: IPlugAPIBase(config, kAPICLAP)
+, IPlugProcessor(config, kAPICLAP)
+, mCLAPHost(info.mCLAPHost)
+, mParamsToHost(PARAM_TRANSFER_SIZE)
+{
+  Trace(TRACELOC, "%s", config.pluginName);
+
+  AttachParamSnapshot(*this);
+
+  mPlugin.desc = info.mDescriptor;
+  mPlugin.plugin_data = this;
+  mPlugin.init = [](const clap_plugin_t* pPlugin) -> bool { return FromPlugin(pPlugin)->Init(); };
+  mPlugin.destroy = [](const clap_plugin_t* pPlugin) { delete FromPlugin(pPlugin); };
+  mPlugin.activate = [](const clap_plugin_t* pPlugin, double sampleRate, uint32_t minFrames, uint32_t maxFrames) -> bool { return FromPlugin(pPlugin)->Activate(sampleRate, minFrames, maxFrames); };
+  mPlugin.deactivate = [](const clap_plugin_t* pPlugin) { FromPlugin(pPlugin)->Deactivate(); };
+  mPlugin.start_processing = [](const clap_plugin_t* pPlugin) -> bool { return true; };
+  mPlugin.stop_processing = [](const clap_plugin_t* pPlugin) {};
+  mPlugin.reset = [](const clap_plugin_t* pPlugin) { FromPlugin(pPlugin)->Reset(); };
+  mPlugin.process = [](const clap_plugin_t* pPlugin, const clap_process_t* pProcess) -> clap_process_status { return FromPlugin(pPlugin)->Process(pProcess); };
+  mPlugin.get_extension = [](const clap_plugin_t* pPlugin, const char* id) -> const void* { return FromPlugin(pPlugin)->GetExtension(id); };
+  mPlugin.on_main_thread = [](const clap_plugin_t* pPlugin) { FromPlugin(pPlugin)->OnMainThread(); };
+
+  SetBlockSize(DEFAULT_BLOCK_SIZE);
+  mMidiOutputQueue.Resize(DEFAULT_BLOCK_SIZE);
+
+  CreateTimer(true);
+}
+
+IPlugCLAP::~IPlugCLAP()
+{
+  GUIDestroy();
+  SetHostRunLoop(nullptr); // before mRunLoop is destroyed
+}
+
+#pragma mark - clap_plugin
+
+bool IPlugCLAP::Init()
+{
+  TRACE
+
+  auto getHostExtension = [this](const char* id) { return mCLAPHost->get_extension(mCLAPHost, id); };
+
+  mHostParams = static_cast<const clap_host_params_t*>(getHostExtension(CLAP_EXT_PARAMS));
+  mHostState = static_cast<const clap_host_state_t*>(getHostExtension(CLAP_EXT_STATE));
+  mHostLatency = static_cast<const clap_host_latency_t*>(getHostExtension(CLAP_EXT_LATENCY));
+  mHostTail = static_cast<const clap_host_tail_t*>(getHostExtension(CLAP_EXT_TAIL));
+  mHostGUI = static_cast<const clap_host_gui_t*>(getHostExtension(CLAP_EXT_GUI));
+  mHostThreadPool = static_cast<const clap_host_thread_pool_t*>(getHostExtension(CLAP_EXT_THREAD_POOL));
+
+#if defined OS_LINUX
+  auto pFDSupport = static_cast<const clap_host_posix_fd_support_t*>(getHostExtension(CLAP_EXT_POSIX_FD_SUPPORT));
+  auto pTimerSupport = static_cast<const clap_host_timer_support_t*>(getHostExtension(CLAP_EXT_TIMER_SUPPORT));
+
+  if (pFDSupport && pTimerSupport)
+  {
+    mRunLoop = std::make_unique<RunLoop>(mCLAPHost, pFDSupport, pTimerSupport);
+    SetHostRunLoop(mRunLoop.get());
+  }
+#endif
+
+  // CLAP hosts report a version string, e.g. "6.80" or "5.0.1"
+  int maj = 0, min = 0, pat = 0;
+
+  if (mCLAPHost->version)
+    sscanf(mCLAPHost->version, "%d.%d.%d", &maj, &min, &pat);
+
+  SetHost(mCLAPHost->name ? mCLAPHost->name : "", (maj << 16) | ((min & 0xFF) << 8) | (pat & 0xFF));
+  EnsureDefaultPreset();
+  OnParamReset(kReset);
+  return true;
+}
+
+bool IPlugCLAP::Activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames)
+{
+  TRACE
+
+  InitDeferred();
+  SetSampleRate(sampleRate);
+  SetBlockSize(static_cast<int>(maxFrames));
+  mMidiOutputQueue.Resize(static_cast<int>(maxFrames));
+  OnReset();
+
+  mActive = true;
+  OnActivate(true);
+  return true;
+}
+
+void IPlugCLAP::Deactivate()
+{
+  TRACE
+
+  mActive = false;
+  OnActivate(false);
+}
+
+void IPlugCLAP::Reset()
+{
+  OnReset();
+}
+
+clap_process_status IPlugCLAP::Process(const clap_process_t* pProcess)
+{
+  TRACE
+
+  auto denormalScope = MakeDenormalScope();
+  const int nFrames = static_cast<int>(pProcess->frames_count);
+
+  // tasks the plug-in waits for in this block can run on the host's threads
+  IPlugThreadPool::SetHostExecutor(mHostThreadPool ? this : nullptr);
+  mOutEvents = pProcess->out_events;
+
+  ProcessTransport(pProcess->transport);
+  ProcessInputEvents(pProcess->in_events, true);
+
+  IMidiMsg msg;
+
+  while (mMidiMsgsFromEditor.Pop(msg))
+  {
+    ProcessMidiMsgFromAPI(msg);
+  }
+
+  // the ports don't offer 64 bit processing, but a host can still send it
+  const clap_audio_buffer_t* pFirstBus = pProcess->audio_outputs_count ? pProcess->audio_outputs : (pProcess->audio_inputs_count ? pProcess->audio_inputs : nullptr);
+  const bool doublePrecision = pFirstBus && !pFirstBus->data32 && pFirstBus->data64;
+
+  AttachBuses(pProcess, doublePrecision);
+
+  auto allChannels = [](uint32_t nChans) { return nChans >= 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << nChans) - 1; };
+
+  if (GetBypassed())
+  {
+    if (doublePrecision)
+      PassThroughBuffers(0.0, nFrames);
+    else
+      PassThroughBuffers(0.f, nFrames);
+  }
+  else
+  {
+    // the host flags constant channels, which are silent if their first sample is 0
+    bool inputsSilent = pProcess->audio_inputs_count > 0;
+
+    for (uint32_t inBus = 0; inBus < pProcess->audio_inputs_count && inputsSilent; inBus++)
+    {
+      const clap_audio_buffer_t& bus = pProcess->audio_inputs[inBus];
+      const uint64_t mask = allChannels(bus.channel_count);
+      inputsSilent = (bus.constant_mask & mask) == mask;
+
+      for (uint32_t c = 0; c < bus.channel_count && inputsSilent && nFrames; c++)
+        inputsSilent = doublePrecision ? bus.data64[c][0] == 0.0 : bus.data32[c][0] == 0.f;
+    }
+
+    ENTER_PARAMS_MUTEX
+    ProcessParamValuesFromUI(nFrames);
+    SetInputSilentFromHost(inputsSilent);
+
+    if (doublePrecision)
+      ProcessBuffers(0.0, nFrames);
+    else
+      ProcessBuffers(0.f, nFrames);
+    LEAVE_PARAMS_MUTEX
+
+    for (uint32_t outBus = 0; outBus < pProcess->audio_outputs_count; outBus++)
+      pProcess->audio_outputs[outBus].constant_mask = GetOutputSilent() ? allChannels(pProcess->audio_outputs[outBus].channel_count) : 0;
+  }
+
+  ProcessOutputParamChanges(pProcess->out_events);
+  ProcessOutputMidi(pProcess->out_events, nFrames);
+
+  mOutEvents = nullptr;
+  IPlugThreadPool::SetHostExecutor(nullptr);
+
+  return GetSilenceSkipping() && GetOutputSilent() ? CLAP_PROCESS_CONTINUE_IF_NOT_QUIET : CLAP_PROCESS_CONTINUE;
+}
+
+const void* IPlugCLAP::GetExtension(const char* id)
+{
+  if (!strcmp(id, CLAP_EXT_PARAMS)) return &sParams;
+  if (!strcmp(id, CLAP_EXT_STATE)) return &sState;
+  if (!strcmp(id, CLAP_EXT_AUDIO_PORTS)) return &sAudioPorts;
+  if (!strcmp(id, CLAP_EXT_NOTE_PORTS) && (DoesMIDIIn() || DoesMIDIOut())) return &sNotePorts;
+  if (!strcmp(id, CLAP_EXT_LATENCY)) return &sLatency;
+  if (!strcmp(id, CLAP_EXT_TAIL)) return &sTail;
+  if (!strcmp(id, CLAP_EXT_RENDER)) return &sRender;
+  if (!strcmp(id, CLAP_EXT_GUI) && HasUI()) return &sGUI;
+  if (!strcmp(id, CLAP_EXT_THREAD_POOL)) return &sThreadPool;
+#if defined OS_LINUX
+  if (!strcmp(id, CLAP_EXT_TIMER_SUPPORT)) return &sTimerSupport;
+  if (!strcmp(id, CLAP_EXT_POSIX_FD_SUPPORT)) return &sPosixFDSupport;
+#endif
+  return nullptr;
+}
+
+void IPlugCLAP::OnMainThread()
+{
+}
+
+#pragma mark - Events
+
+void IPlugCLAP::ProcessTransport(const clap_event_transport_t* pTransport)
+{
+  ITimeInfo timeInfo;
+
+  if (pTransport)
+  {
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_TEMPO && pTransport->tempo > 0.0)
+      timeInfo.mTempo = pTransport->tempo;
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_BEATS_TIMELINE)
+    {
+      timeInfo.mPPQPos = static_cast<double>(pTransport->song_pos_beats) / CLAP_BEATTIME_FACTOR;
+      timeInfo.mLastBar = static_cast<double>(pTransport->bar_start) / CLAP_BEATTIME_FACTOR;
+      timeInfo.mCycleStart = static_cast<double>(pTransport->loop_start_beats) / CLAP_BEATTIME_FACTOR;
+      timeInfo.mCycleEnd = static_cast<double>(pTransport->loop_end_beats) / CLAP_BEATTIME_FACTOR;
+    }
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_SECONDS_TIMELINE)
+      timeInfo.mSamplePos = static_cast<double>(pTransport->song_pos_seconds) / CLAP_SECTIME_FACTOR * GetSampleRate();
+
+    if (pTransport->flags & CLAP_TRANSPORT_HAS_TIME_SIGNATURE && pTransport->tsig_num > 0 && pTransport->tsig_denom > 0)
+    {
+      timeInfo.mNumerator = pTransport->tsig_num;
+      timeInfo.mDenominator = pTransport->tsig_denom;
+    }
+
+    timeInfo.mTransportIsRunning = pTransport->flags & CLAP_TRANSPORT_IS_PLAYING;
+    timeInfo.mTransportLoopEnabled = pTransport->flags & CLAP_TRANSPORT_IS_LOOP_ACTIVE;
+  }
+
+  SetTimeInfo(timeInfo);
+}
+
+void IPlugCLAP::ProcessInputEvents(const clap_input_events_t* pInEvents, bool inProcess)
+{
+  if (!pInEvents)
+    return;
+
+  const uint32_t nEvents = pInEvents->size(pInEvents);
+
+  // the events are in time order, their offsets place them in the block, see SetBlockSlicing()
+  for (uint32_t i = 0; i < nEvents; i++)
+  {
+    const clap_event_header_t* pEvent = pInEvents->get(pInEvents, i);
+
+    if (pEvent && pEvent->space_id == CLAP_CORE_EVENT_SPACE_ID)
+      ProcessInputEvent(pEvent, inProcess);
+  }
+}
+
+void IPlugCLAP::ProcessInputEvent(const clap_event_header_t* pEvent, bool inProcess)
+{
+  const int offset = static_cast<int>(pEvent->time);
+
+  switch (pEvent->type)
+  {
+    case CLAP_EVENT_PARAM_VALUE:
+    {
+      const clap_event_param_value_t* pParamEvent = reinterpret_cast<const clap_event_param_value_t*>(pEvent);
+      const int idx = static_cast<int>(pParamEvent->param_id);
+
+      if (idx < 0 || idx >= NParams())
+        break;
+
+      ENTER_PARAMS_MUTEX
+      IParam* pParam = GetParam(idx);
+
+      // the values are plain, as the parameters were reported
+      if (inProcess)
+        AddParamChange(idx, pParamEvent->value, offset);
+
+      pParam->Set(pParamEvent->value);
+      OnParamChange(idx, kHost, inProcess ? offset : -1);
+      LEAVE_PARAMS_MUTEX
+
+      SendParameterValueFromAPI(idx, pParamEvent->value, false);
+      break;
+    }
+    case CLAP_EVENT_NOTE_ON:
+    case CLAP_EVENT_NOTE_OFF:
+    {
+      const clap_event_note_t* pNote = reinterpret_cast<const clap_event_note_t*>(pEvent);
+
+      if (!inProcess || pNote->key < 0 || pNote->key > 127)
+        break;
+
+      const int channel = Clip<int>(pNote->channel, 0, 15);
+      IMidiMsg msg;
+
+      if (pEvent->type == CLAP_EVENT_NOTE_ON)
+        msg.MakeNoteOnMsg(pNote->key, Clip(static_cast<int>(pNote->velocity * 127.), 1, 127), offset, channel);
+      else
+        msg.MakeNoteOffMsg(pNote->key, offset, channel);
+
+      ProcessMidiMsgFromAPI(msg);
+      mMidiMsgsFromProcessor.Push(msg);
+      break;
+    }
+    case CLAP_EVENT_MIDI:
+    {
+      const clap_event_midi_t* pMidi = reinterpret_cast<const clap_event_midi_t*>(pEvent);
+
+      if (!inProcess)
+        break;
+
+      IMidiMsg msg(offset, pMidi->data[0], pMidi->data[1], pMidi->data[2]);
+      ProcessMidiMsgFromAPI(msg);
+      mMidiMsgsFromProcessor.Push(msg);
+      break;
+    }
+    case CLAP_EVENT_MIDI_SYSEX:
+    {
+      const clap_event_midi_sysex_t* pSysEx = reinterpret_cast<const clap_event_midi_sysex_t*>(pEvent);
+
+      if (!inProcess)
+        break;
+
+      ISysEx sysex(offset, pSysEx->buffer, static_cast<int>(pSysEx->size));
+      ProcessSysEx(sysex);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void IPlugCLAP::ProcessOutputParamChanges(const clap_output_events_t* pOutEvents)
+{
+  ParamToHost change;
+
+  while (mParamsToHost.Pop(change))
+  {
+    if (!pOutEvents)
+      continue;
+
+    if (change.mType == ParamToHost::kValue)
+    {
+      clap_event_param_value_t event;
+      event.header.size = sizeof(clap_event_param_value_t);
+      event.header.time = 0;
+      event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+      event.header.type = CLAP_EVENT_PARAM_VALUE;
+      event.header.flags = 0;
+      event.param_id = static_cast<clap_id>(change.mIdx);
+      event.cookie = nullptr;
+      event.note_id = -1;
+      event.port_index = -1;
+      event.channel = -1;
+      event.key = -1;
+      event.value = change.mValue;
+      pOutEvents->try_push(pOutEvents, &event.header);
+    }
+    else
+    {
+      clap_event_param_gesture_t event;
+      event.header.size = sizeof(clap_event_param_gesture_t);
+      event.header.time = 0;
+      event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+      event.header.type = change.mType == ParamToHost::kBegin ? CLAP_EVENT_PARAM_GESTURE_BEGIN : CLAP_EVENT_PARAM_GESTURE_END;
+      event.header.flags = 0;
+      event.param_id = static_cast<clap_id>(change.mIdx);
+      pOutEvents->try_push(pOutEvents, &event.header);
+    }
+  }
+}
+
+void IPlugCLAP::ProcessOutputMidi(const clap_output_events_t* pOutEvents, int nFrames)
+{
+  // SysEx from the editor, which has bypassed ProcessSysEx(), goes at the start of the block, ahead of the processor's events
+  // the events point into the queue's arena, so the messages from the last block are only released now that the host has taken them
+  mSysExDataFromEditor.Release();
+
+  while (mSysExDataFromEditor.Pop(mSysexBuf))
+  {
+    clap_event_midi_sysex_t event;
+    event.header.size = sizeof(clap_event_midi_sysex_t);
+    event.header.time = 0;
+    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event.header.type = CLAP_EVENT_MIDI_SYSEX;
+    event.header.flags = 0;
+    event.port_index = 0;
+    event.buffer = mSysexBuf.mData;
+    event.size = static_cast<uint32_t>(mSysexBuf.mSize);
+    pOutEvents->try_push(pOutEvents, &event.header);
+  }
+
+  while (!mMidiOutputQueue.Empty())
+  {
+    const IMidiMsg& msg = mMidiOutputQueue.Peek();
+
+    if (msg.mOffset >= nFrames)
+      break;
+
+    clap_event_midi_t event;
+    event.header.size = sizeof(clap_event_midi_t);
+    event.header.time = static_cast<uint32_t>(std::max(msg.mOffset, 0));
+    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event.header.type = CLAP_EVENT_MIDI;
+    event.header.flags = 0;
+    event.port_index = 0;
+    event.data[0] = msg.mStatus;
+    event.data[1] = msg.mData1;
+    event.data[2] = msg.mData2;
+    pOutEvents->try_push(pOutEvents, &event.header);
+
+    mMidiOutputQueue.Remove();
+  }
+
+  mMidiOutputQueue.Flush(nFrames);
+}
+
+#pragma mark - Audio
+
+void IPlugCLAP::AttachBuses(const clap_process_t* pProcess, bool doublePrecision)
+{
+  const int nFrames = static_cast<int>(pProcess->frames_count);
+
+  // the buses' channels follow on from each other, as the ports were reported by GetAudioPortInfo()
+  for (int d = 0; d < 2; d++)
+  {
+    const ERoute dir = d == 0 ? ERoute::kInput : ERoute::kOutput;
+    const clap_audio_buffer_t* pBuses = dir == ERoute::kInput ? pProcess->audio_inputs : pProcess->audio_outputs;
+    const int nBuses = static_cast<int>(dir == ERoute::kInput ? pProcess->audio_inputs_count : pProcess->audio_outputs_count);
+    const int maxNChans = MaxNChannels(dir);
+
+    SetChannelConnections(dir, 0, maxNChans, false);
+
+    for (int bus = 0, chanOffset = 0; bus < nBuses && chanOffset < maxNChans; bus++)
+    {
+      const int nChans = std::min(static_cast<int>(pBuses[bus].channel_count), maxNChans - chanOffset);
+
+      SetChannelConnections(dir, chanOffset, nChans, true);
+
+      if (doublePrecision)
+        AttachBuffers(dir, chanOffset, nChans, pBuses[bus].data64, nFrames);
+      else
+        AttachBuffers(dir, chanOffset, nChans, pBuses[bus].data32, nFrames);
+
+      chanOffset += MaxNChannelsForBus(dir, bus);
+    }
+  }
+}
+
+bool IPlugCLAP::GetAudioPortInfo(uint32_t index, bool isInput, clap_audio_port_info_t* pInfo) const
+{
+  const ERoute dir = isInput ? ERoute::kInput : ERoute::kOutput;
+  const int nBuses = MaxNBuses(dir);
+
+  if (index >= static_cast<uint32_t>(nBuses))
+    return false;
+
+  const int nChans = MaxNChannelsForBus(dir, static_cast<int>(index));
+  WDL_String busName;
+  GetBusName(dir, static_cast<int>(index), nBuses, busName);
+
+  memset(pInfo, 0, sizeof(clap_audio_port_info_t));
+  pInfo->id = index;
+  strncpy(pInfo->name, busName.Get(), CLAP_NAME_SIZE - 1);
+  pInfo->flags = index == 0 ? CLAP_AUDIO_PORT_IS_MAIN : 0;
+  pInfo->channel_count = static_cast<uint32_t>(nChans);
+  pInfo->port_type = nChans == 1 ? CLAP_PORT_MONO : (nChans == 2 ? CLAP_PORT_STEREO : nullptr);
+  pInfo->in_place_pair = CLAP_INVALID_ID;
+  return true;
+}
+
+#pragma mark - GUI
+
+bool IPlugCLAP::GUIIsAPISupported(const char* api, bool isFloating) const
+{
+  if (!HasUI() || isFloating)
+    return false;
+
+#if defined OS_MAC
+  return !strcmp(api, CLAP_WINDOW_API_COCOA);
+#elif defined OS_WIN
+  return !strcmp(api, CLAP_WINDOW_API_WIN32);
+#elif defined OS_LINUX
+  return !strcmp(api, CLAP_WINDOW_API_X11);
+#else
+  return false;
+#endif
+}
+
+bool IPlugCLAP::GUISetParent(const clap_window_t* pWindow)
+{
+  GUIDestroy();
+
+#if defined OS_LINUX
+  void* pParent = reinterpret_cast<void*>(pWindow->x11);
+#else
+  void* pParent = pWindow->ptr;
+#endif
+
+  SetEditorOpen(true);
+  OpenWindow(pParent);
+  mGUIOpen = true;
+  return true;
+}
+
+void IPlugCLAP::GUIDestroy()
+{
+  if (mGUIOpen)
+  {
+    CloseWindow();
+    SetEditorOpen(false);
+    mGUIOpen = false;
+  }
+}
+
+#pragma mark - IPlugAPIBase
+
+void IPlugCLAP::BeginInformHostOfParamChange(int idx)
+{
+  mParamsToHost.Push({ParamToHost::kBegin, idx, 0.});
+
+  if (mHostParams)
+    mHostParams->request_flush(mCLAPHost);
+}
+
+void IPlugCLAP::InformHostOfParamChange(int idx, double normalizedValue)
+{
+  mParamsToHost.Push({ParamToHost::kValue, idx, GetParam(idx)->FromNormalized(normalizedValue)});
+
+  if (mHostParams)
+    mHostParams->request_flush(mCLAPHost);
+}
+
+void IPlugCLAP::EndInformHostOfParamChange(int idx)
+{
+  mParamsToHost.Push({ParamToHost::kEnd, idx, 0.});
+
+  if (mHostParams)
+    mHostParams->request_flush(mCLAPHost);
+}
+
+void IPlugCLAP::InformHostOfPresetChange()
+{
+  if (mHostState)
+    mHostState->mark_dirty(mCLAPHost);
+}
+
+void IPlugCLAP::InformHostOfParameterDetailsChange()
+{
+  if (mHostParams)
+    mHostParams->rescan(mCLAPHost, CLAP_PARAM_RESCAN_VALUES | CLAP_PARAM_RESCAN_TEXT | CLAP_PARAM_RESCAN_INFO);
+}
+
+bool IPlugCLAP::EditorResize(int viewWidth, int viewHeight)
+{
+  bool resized = false;
+
+  if (HasUI())
+  {
+    if (viewWidth != GetEditorWidth() || viewHeight != GetEditorHeight())
+    {
+      SetEditorSize(viewWidth, viewHeight);
+
+      if (mHostGUI && mGUIOpen)
+        resized = mHostGUI->request_resize(mCLAPHost, static_cast<uint32_t>(viewWidth), static_cast<uint32_t>(viewHeight));
+    }
+  }
+
+  return resized;
+}
+
+#pragma mark - IPlugProcessor
+
+void IPlugCLAP::SetLatency(int samples)
+{
+  IPlugProcessor::SetLatency(samples);
+
+  // the host can only take a new latency while the plug-in is inactive, otherwise it has to restart it
+  if (mHostLatency && !mActive)
+    mHostLatency->changed(mCLAPHost);
+  else
+    mCLAPHost->request_restart(mCLAPHost);
+}
+
+bool IPlugCLAP::SendMidiMsg(const IMidiMsg& msg)
+{
+  mMidiOutputQueue.Add(msg);
+  return true;
+}
+
+bool IPlugCLAP::SendSysEx(const ISysEx& msg)
+{
+  if (!mOutEvents)
+    return false;
+
+  clap_event_midi_sysex_t event;
+  event.header.size = sizeof(clap_event_midi_sysex_t);
+  event.header.time = static_cast<uint32_t>(std::max(msg.mOffset, 0));
+  event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+  event.header.type = CLAP_EVENT_MIDI_SYSEX;
+  event.header.flags = 0;
+  event.port_index = 0;
+  event.buffer = msg.mData;
+  event.size = static_cast<uint32_t>(msg.mSize);
+  return mOutEvents->try_push(mOutEvents, &event.header);
+}
+
+#pragma mark - IThreadPoolHostExecutor
+
+bool IPlugCLAP::RequestExec(IPlugThreadPool& pool, int nTasks)
+{
+  if (!mHostThreadPool)
+    return false;
+
+  // request_exec() blocks until the host has called exec() nTasks times
+  mExecPool = &pool;
+  const bool executed = mHostThreadPool->request_exec(mCLAPHost, static_cast<uint32_t>(nTasks));
+  mExecPool = nullptr;
+  return executed;
+}
@@ -0,0 +1,146 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#ifndef _IPLUGAPI_
+#define _IPLUGAPI_
+// Only load one API class!
+
+/**
+ * @file
+ * @copydoc IPlugCLAP
+ */
+
+#include <memory>
+
+#include "clap/clap.h"
+
+#include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
+#include "IPlugThreadPool.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Used to pass various instance info to the API class */
+struct InstanceInfo
+{
+  const clap_host_t* mCLAPHost;
+  const clap_plugin_descriptor_t* mDescriptor;
+};
+
+/** CLAP API base class for an IPlug plug-in.
+ * Parameters are exposed with their plain values, so the host shows the same range as the UI. Host events are delivered at their sample offsets, through the block slicing driver
+ * when SetBlockSlicing() is on, and as automation points when SetSampleAccurateAutomation() is on, the same as with VST3. When the host implements the thread-pool
+ * extension, the tasks that IPlugThreadPool::Wait() is waiting for on the audio thread are run on the host's threads, see IThreadPoolHostExecutor
+ * @ingroup APIClasses */
+class IPlugCLAP : public IPlugAPIBase
+                , public IPlugProcessor
+                , public IThreadPoolHostExecutor
+{
+public:
+  IPlugCLAP(const InstanceInfo& info, const Config& config);
+  ~IPlugCLAP();
+
+  //IPlugAPIBase
+  void BeginInformHostOfParamChange(int idx) override;
+  void InformHostOfParamChange(int idx, double normalizedValue) override;
+  void EndInformHostOfParamChange(int idx) override;
+  void InformHostOfPresetChange() override;
+  void InformHostOfParameterDetailsChange() override;
+  bool EditorResize(int viewWidth, int viewHeight) override;
+
+  //IPlugProcessor
+  void SetLatency(int samples) override;
+  bool SendMidiMsg(const IMidiMsg& msg) override;
+  bool SendSysEx(const ISysEx& msg) override;
+
+  //IThreadPoolHostExecutor
+  bool RequestExec(IPlugThreadPool& pool, int nTasks) override;
+
+  //IPlugCLAP
+  const clap_plugin_t* GetCLAPPlugin() const { return &mPlugin; }
+  const clap_host_t* GetCLAPHost() const { return mCLAPHost; }
+
+private:
+  /** A parameter change from the UI, queued for the host's event list */
+  struct ParamToHost
+  {
+    enum EType { kBegin, kValue, kEnd };
+
+    EType mType;
+    int mIdx;
+    double mValue;
+  };
+
+  // clap_plugin
+  bool Init();
+  bool Activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames);
+  void Deactivate();
+  void Reset();
+  clap_process_status Process(const clap_process_t* pProcess);
+  const void* GetExtension(const char* id);
+  void OnMainThread();
+
+  // events
+  void ProcessTransport(const clap_event_transport_t* pTransport);
+  void ProcessInputEvent(const clap_event_header_t* pEvent, bool inProcess);
+  void ProcessInputEvents(const clap_input_events_t* pInEvents, bool inProcess);
+  void ProcessOutputParamChanges(const clap_output_events_t* pOutEvents);
+  void ProcessOutputMidi(const clap_output_events_t* pOutEvents, int nFrames);
+
+  // audio
+  void AttachBuses(const clap_process_t* pProcess, bool doublePrecision);
+  bool GetAudioPortInfo(uint32_t index, bool isInput, clap_audio_port_info_t* pInfo) const;
+
+  // gui
+  bool GUIIsAPISupported(const char* api, bool isFloating) const;
+  bool GUISetParent(const clap_window_t* pWindow);
+  void GUIDestroy();
+
+  static IPlugCLAP* FromPlugin(const clap_plugin_t* pPlugin) { return static_cast<IPlugCLAP*>(pPlugin->plugin_data); }
+
+  static const clap_plugin_params_t sParams;
+  static const clap_plugin_state_t sState;
+  static const clap_plugin_audio_ports_t sAudioPorts;
+  static const clap_plugin_note_ports_t sNotePorts;
+  static const clap_plugin_latency_t sLatency;
+  static const clap_plugin_tail_t sTail;
+  static const clap_plugin_render_t sRender;
+  static const clap_plugin_gui_t sGUI;
+  static const clap_plugin_thread_pool_t sThreadPool;
+#if defined OS_LINUX
+  static const clap_plugin_timer_support_t sTimerSupport;
+  static const clap_plugin_posix_fd_support_t sPosixFDSupport;
+
+  class RunLoop;
+  std::unique_ptr<RunLoop> mRunLoop;
+#endif
+
+  clap_plugin_t mPlugin;
+  const clap_host_t* mCLAPHost;
+  const clap_host_params_t* mHostParams = nullptr;
+  const clap_host_state_t* mHostState = nullptr;
+  const clap_host_latency_t* mHostLatency = nullptr;
+  const clap_host_tail_t* mHostTail = nullptr;
+  const clap_host_gui_t* mHostGUI = nullptr;
+  const clap_host_thread_pool_t* mHostThreadPool = nullptr;
+
+  IPlugMPMCQueue<ParamToHost> mParamsToHost; // gestures and values from the UI, sent in the next process() or params flush()
+  IMidiQueue mMidiOutputQueue;
+  const clap_output_events_t* mOutEvents = nullptr; // the host's output events, during process()
+  IPlugThreadPool* mExecPool = nullptr; // the pool whose tasks the host is running, during RequestExec()
+  bool mActive = false;
+  bool mGUIOpen = false;
+};
+
+IPlugCLAP* MakePlug(const InstanceInfo& info);
+
+END_IPLUG_NAMESPACE
+
+#endif
@@ -13,8 +13,10 @@
 #include "IPlugPlatform.h"
 #include "IPlugUtilities.h"
 
+#include <algorithm>
 #include <functional>
 #include <cmath>
+#include <limits>
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -298,7 +300,231 @@ public:
     return mPrevOutput;
   }
 
+  /** Process a block of the envelope. Rather than stepping through the stages per sample, each stage is rendered as one closed-form segment, as far as the point where it ends,
+  * which is found analytically. Linear stages are a ramp, exponential ones are scaled from a table of the powers of the stage's multiplier, and sustain and idle are a fill.
+  * The values are those of Process(), to within rounding. Retriggers and other changes are sample accurate if the block is split where they happen,
+  * e.g. rendering up to a note's offset, calling Retrigger(), then rendering the rest
+  * @param pOutput Receives nFrames values
+  * @param nFrames The number of values to output
+  * @param sustainLevel The sustain level, constant for the block. See Process() */
+  void ProcessBlock(T* pOutput, int nFrames, T sustainLevel = 0.)
+  {
+    int s = 0;
+
+    while (s < nFrames)
+    {
+      const int remaining = nFrames - s;
+      T* pOut = pOutput + s;
+
+      switch (mStage)
+      {
+        case kAttack:
+        {
+          const T step = mAttackIncr * mScalar;
+          const int n = (mAttackIncr == 0.) ? 1 : SamplesUntilAbove(mEnvValue, step, ENV_VALUE_HIGH);
+          const int len = std::min(n - 1, remaining);
+          RenderLinear(pOut, len, mEnvValue, step, mLevel);
+          s += len;
+
+          if (len < remaining)
+          {
+            mStage = kDecay;
+            mEnvValue = 1.;
+            SetResult(1., pOutput[s++]);
+          }
+          else
+            mPrevResult = mEnvValue;
+          break;
+        }
+        case kDecay:
+        {
+          const T mul = 1. - mDecayIncr * mScalar;
+          const int n = SamplesUntilBelowExp(mEnvValue, mul);
+          const int len = std::min(n - 1, remaining);
+          const T* pPowers = GetPowers(mul, mDecayPowers, mDecayPowersMul);
+          RenderExp(pOut, len, mEnvValue, pPowers, (1. - sustainLevel) * mLevel, sustainLevel * mLevel);
+          const T prevResult = len ? (mEnvValue * (1. - sustainLevel)) + sustainLevel : mPrevResult;
+          s += len;
+
+          if (len < remaining)
+          {
+            mEnvValue *= mul;
+
+            if (mSustainEnabled)
+            {
+              mStage = kSustain;
+              mEnvValue = 1.;
+              SetResult(sustainLevel, pOutput[s++]);
+            }
+            else
+            {
+              const T result = (mEnvValue * (1. - sustainLevel)) + sustainLevel;
+              mPrevResult = prevResult;
+              Release();
+              SetResult(result, pOutput[s++]);
+            }
+          }
+          else
+            mPrevResult = prevResult;
+          break;
+        }
+        case kRelease:
+        {
+          const T mul = 1. - mReleaseIncr * mScalar;
+          const int n = (mReleaseIncr == 0.) ? 1 : SamplesUntilBelowExp(mEnvValue, mul);
+          const int len = std::min(n - 1, remaining);
+          RenderExp(pOut, len, mEnvValue, GetPowers(mul, mReleasePowers, mReleasePowersMul), mReleaseLevel * mLevel, 0.);
+          s += len;
+
+          if (len < remaining)
+          {
+            mStage = kIdle;
+            mEnvValue = 0.;
+
+            if (mEndReleaseFunc)
+              mEndReleaseFunc();
+
+            SetResult(0., pOutput[s++]);
+          }
+          else
+            mPrevResult = mEnvValue * mReleaseLevel;
+          break;
+        }
+        case kReleasedToRetrigger:
+        case kReleasedToEndEarly:
+        {
+          const T step = (mStage == kReleasedToRetrigger) ? -mRetriggerReleaseIncr : -mEarlyReleaseIncr;
+          const int n = SamplesUntilBelowLinear(mEnvValue, step);
+          const int len = std::min(n - 1, remaining);
+          RenderLinear(pOut, len, mEnvValue, step, mReleaseLevel * mLevel);
+          s += len;
+
+          if (len < remaining)
+          {
+            const bool retrigger = mStage == kReleasedToRetrigger;
+            mStage = retrigger ? kAttack : kIdle;
+            mLevel = retrigger ? mNewStartLevel : 0.;
+            mEnvValue = 0.;
+            mReleaseLevel = 0.;
+
+            if (retrigger && mResetFunc)
+              mResetFunc();
+            else if (!retrigger && mEndReleaseFunc)
+              mEndReleaseFunc();
+
+            SetResult(0., pOutput[s++]);
+          }
+          else
+            mPrevResult = mEnvValue * mReleaseLevel;
+          break;
+        }
+        case kSustain:
+        case kIdle:
+        default:
+        {
+          // values don't change in these stages until the next call to Start(), Release() etc
+          mPrevResult = (mStage == kSustain) ? sustainLevel : mEnvValue;
+          mPrevOutput = mPrevResult * mLevel;
+          std::fill_n(pOut, remaining, mPrevOutput);
+          return;
+        }
+      }
+    }
+
+    if (nFrames > 0)
+      mPrevOutput = pOutput[nFrames - 1];
+  }
+
 private:
+  /** The number of powers of a stage's multiplier that RenderExp() scales the envelope value by, in runs of this many samples */
+  static constexpr int kNumPowers = 16;
+  /** A stage that never ends, e.g. a decay whose time hasn't been set */
+  static constexpr int kForever = std::numeric_limits<int>::max() / 2;
+
+  /** Record a transition sample's result, as Process() does */
+  inline void SetResult(T result, T& output)
+  {
+    mPrevResult = result;
+    mPrevOutput = output = result * mLevel;
+  }
+
+  /** @return The number of samples until a linear stage's value, env + k * step, rises above a threshold, the sample whose value does counting as the last. At least 1 */
+  static int SamplesUntilAbove(T env, T step, T threshold)
+  {
+    if (!(step > 0.))
+      return kForever;
+
+    return ClampSamples(std::floor((threshold - env) / step) + 1.);
+  }
+
+  /** @return The number of samples until a linear stage's value, env + k * step with a negative step, falls below ENV_VALUE_LOW, the sample whose value does counting as the last. At least 1 */
+  static int SamplesUntilBelowLinear(T env, T step)
+  {
+    return SamplesUntilAbove(-env, -step, -ENV_VALUE_LOW);
+  }
+
+  /** @return The number of samples until an exponential stage's value, env * mul^k, falls below ENV_VALUE_LOW, the sample whose value does counting as the last. At least 1 */
+  static int SamplesUntilBelowExp(T env, T mul)
+  {
+    if (env < ENV_VALUE_LOW || mul <= 0.)
+      return 1;
+
+    if (!(mul < 1.))
+      return kForever;
+
+    return ClampSamples(std::floor(std::log(ENV_VALUE_LOW / env) / std::log(mul)) + 1.);
+  }
+
+  static int ClampSamples(T k)
+  {
+    return k < 1. ? 1 : (k > T(kForever)) ? kForever : static_cast<int>(k);
+  }
+
+  /** Output a linear segment, (env + (k + 1) * step) * gain for k < nFrames, and advance env to the last value */
+  static void RenderLinear(T* pOutput, int nFrames, T& env, T step, T gain)
+  {
+    const T start = env;
+
+    for (int k = 0; k < nFrames; k++)
+      pOutput[k] = (start + T(k + 1) * step) * gain;
+
+    if (nFrames > 0)
+      env = start + T(nFrames) * step;
+  }
+
+  /** @return A table of mul^1 to mul^kNumPowers, rebuilt if it was made for another multiplier, i.e. the stage time or the time scalar has changed */
+  static const T* GetPowers(T mul, T* pTable, T& tableMul)
+  {
+    if (mul != tableMul)
+    {
+      T power = 1.;
+
+      for (int k = 0; k < kNumPowers; k++)
+        pTable[k] = power *= mul;
+
+      tableMul = mul;
+    }
+
+    return pTable;
+  }
+
+  /** Output an exponential segment, env * mul^(k + 1) * gain + offset for k < nFrames, kNumPowers samples at a time from the table of the powers of mul, and advance env to the last value */
+  static void RenderExp(T* pOutput, int nFrames, T& env, const T* pPowers, T gain, T offset)
+  {
+    while (nFrames > 0)
+    {
+      const int n = std::min(nFrames, kNumPowers);
+      const T scale = env * gain;
+
+      for (int k = 0; k < n; k++)
+        pOutput[k] = scale * pPowers[k] + offset;
+
+      env *= pPowers[n - 1];
+      pOutput += n;
+      nFrames -= n;
+    }
+  }
+
   inline T CalcIncrFromTimeLinear(T timeMS, T sr) const
   {
     if (timeMS <= 0.) return 0.;
@@ -318,6 +544,349 @@ private:
       return r;
     }
   }
+
+  // tables of the powers of the decay and release multipliers for ProcessBlock(), and the multipliers they were built for
+  T mDecayPowers[kNumPowers] = {};
+  T mReleasePowers[kNumPowers] = {};
+  T mDecayPowersMul = -1.;
+  T mReleasePowersMul = -1.;
+};
+
+/** N independent ADSREnvelopes sharing the same stage times, with their state stored in lanes.
+ * Each sample, the envelope values of all lanes are updated with one multiply-add per lane (env = env * mul + add), and the outputs are computed
+ * with another, both in loops that can be vectorized. Only lanes whose value leaves the range of their current stage take the branchy path.
+ * Callbacks receive the lane index. Outputs are interleaved by lane: pOutput[s * N + lane] */
+template <typename T, int N>
+class ADSREnvelopeLanes
+{
+public:
+  using EStage = typename ADSREnvelope<T>::EStage;
+  static constexpr int kNumLanes = N;
+
+  ADSREnvelopeLanes(std::function<void(int lane)> resetFunc = nullptr, bool sustainEnabled = true)
+  : mResetFunc(resetFunc)
+  , mSustainEnabled(sustainEnabled)
+  {
+    SetSampleRate(44100.);
+
+    for (auto l = 0; l < N; l++)
+    {
+      mScalar[l] = 1.;
+      mReleased[l] = true;
+      SetStage(l, ADSREnvelope<T>::kIdle);
+    }
+  }
+
+  /** Sets the time for a particular envelope stage, for all lanes */
+  void SetStageTime(int stage, T timeMS)
+  {
+    switch(stage)
+    {
+      case ADSREnvelope<T>::kAttack:
+        mAttackIncr = CalcIncrFromTimeLinear(Clip(timeMS, ADSREnvelope<T>::MIN_ENV_TIME_MS, ADSREnvelope<T>::MAX_ENV_TIME_MS), mSampleRate);
+        break;
+      case ADSREnvelope<T>::kDecay:
+        mDecayIncr = CalcIncrFromTimeExp(Clip(timeMS, ADSREnvelope<T>::MIN_ENV_TIME_MS, ADSREnvelope<T>::MAX_ENV_TIME_MS), mSampleRate);
+        break;
+      case ADSREnvelope<T>::kRelease:
+        mReleaseIncr = CalcIncrFromTimeExp(Clip(timeMS, ADSREnvelope<T>::MIN_ENV_TIME_MS, ADSREnvelope<T>::MAX_ENV_TIME_MS), mSampleRate);
+        break;
+      default:
+        return;
+    }
+
+    // lanes that are in the changed stage pick up the new rate
+    for (auto l = 0; l < N; l++)
+      SetStage(l, mStage[l]);
+  }
+
+  void SetSampleRate(T sr)
+  {
+    mSampleRate = sr;
+    mEarlyReleaseIncr = CalcIncrFromTimeLinear(ADSREnvelope<T>::EARLY_RELEASE_TIME, sr);
+    mRetriggerReleaseIncr = CalcIncrFromTimeLinear(ADSREnvelope<T>::RETRIGGER_RELEASE_TIME, sr);
+  }
+
+  /** @return /c true if the lane's envelope is not idle */
+  bool GetBusy(int lane) const { return mStage[lane] != ADSREnvelope<T>::kIdle; }
+
+  /** @return /c true if any lane's envelope is not idle */
+  bool GetAnyBusy() const
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      if (mStage[l] != ADSREnvelope<T>::kIdle)
+        return true;
+    }
+    return false;
+  }
+
+  bool GetReleased(int lane) const { return mReleased[lane]; }
+
+  T GetPrevOutput(int lane) const { return mPrevResult[lane] * mLevel[lane]; }
+
+  /** @see ADSREnvelope::Start() */
+  void Start(int lane, T level, T timeScalar = 1.)
+  {
+    mEnvValue[lane] = 0.;
+    mLevel[lane] = level;
+    mScalar[lane] = 1./timeScalar;
+    mReleased[lane] = false;
+    SetStage(lane, ADSREnvelope<T>::kAttack);
+  }
+
+  /** @see ADSREnvelope::Release() */
+  void Release(int lane)
+  {
+    mReleaseLevel[lane] = mPrevResult[lane];
+    mEnvValue[lane] = 1.;
+    mReleased[lane] = true;
+    SetStage(lane, ADSREnvelope<T>::kRelease);
+  }
+
+  /** @see ADSREnvelope::Retrigger() */
+  void Retrigger(int lane, T newStartLevel, T timeScalar = 1.)
+  {
+    mEnvValue[lane] = 1.;
+    mNewStartLevel[lane] = newStartLevel;
+    mScalar[lane] = 1./timeScalar;
+    mReleaseLevel[lane] = mPrevResult[lane];
+    mReleased[lane] = false;
+    SetStage(lane, ADSREnvelope<T>::kReleasedToRetrigger);
+  }
+
+  /** @see ADSREnvelope::Kill() */
+  void Kill(int lane, bool hard)
+  {
+    if (mStage[lane] == ADSREnvelope<T>::kIdle)
+      return;
+
+    if (hard)
+    {
+      mReleaseLevel[lane] = 0.;
+      mEnvValue[lane] = 0.;
+      SetStage(lane, ADSREnvelope<T>::kIdle);
+    }
+    else
+    {
+      mReleaseLevel[lane] = mPrevResult[lane];
+      mEnvValue[lane] = 1.;
+      SetStage(lane, ADSREnvelope<T>::kReleasedToEndEarly);
+    }
+  }
+
+  /** Sets a function to call when a lane's envelope gets released, called when the ramp is at zero
+   * WARNING: don't call this on the audio thread, std::function can malloc */
+  void SetEndReleaseFunc(std::function<void(int lane)> func) { mEndReleaseFunc = func; }
+
+  /** Process one sample of every lane
+   * @param pOutput Receives N samples
+   * @param sustainLevel The sustain level, shared by all lanes */
+  inline void Process(T* pOutput, T sustainLevel = 0.)
+  {
+    for (auto l = 0; l < N; l++)
+      mEnvValue[l] = mEnvValue[l] * mMul[l] + mAdd[l];
+
+    for (auto l = 0; l < N; l++)
+    {
+      if (mEnvValue[l] < mCheckBelow[l] || mEnvValue[l] > mCheckAbove[l])
+        CheckStage(l);
+    }
+
+    // result = env * k1 + sustain * (k2 - env * k3), see SetStage()
+    for (auto l = 0; l < N; l++)
+    {
+      const T result = mEnvValue[l] * mK1[l] + sustainLevel * (mK2[l] - mEnvValue[l] * mK3[l]);
+      mPrevResult[l] = result;
+      pOutput[l] = result * mLevel[l];
+    }
+  }
+
+  /** @param pOutput Receives nFrames * N samples, interleaved by lane */
+  void ProcessBlock(T* pOutput, int nFrames, T sustainLevel = 0.)
+  {
+    if (nFrames > 0 && AllLanesSettled())
+    {
+      // values don't change in the sustain and idle stages, so compute one frame and repeat it
+      Process(pOutput, sustainLevel);
+
+      for (auto s = 1; s < nFrames; s++)
+        std::copy_n(pOutput, N, pOutput + s * N);
+
+      return;
+    }
+
+    for (auto s = 0; s < nFrames; s++)
+      Process(pOutput + s * N, sustainLevel);
+  }
+
+private:
+  bool AllLanesSettled() const
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      if (mStage[l] != ADSREnvelope<T>::kSustain && mStage[l] != ADSREnvelope<T>::kIdle)
+        return false;
+    }
+    return true;
+  }
+
+  /** Move a lane to a new stage, caching the per-sample update and output coefficients for it */
+  void SetStage(int l, int stage)
+  {
+    constexpr T kNever = std::numeric_limits<T>::max();
+
+    mStage[l] = stage;
+    mMul[l] = 1.; mAdd[l] = 0.;
+    mK1[l] = 1.; mK2[l] = 0.; mK3[l] = 0.;
+    mCheckBelow[l] = -kNever; mCheckAbove[l] = kNever;
+
+    switch (stage)
+    {
+      case ADSREnvelope<T>::kAttack:
+        mAdd[l] = mAttackIncr * mScalar[l];
+        mCheckAbove[l] = ADSREnvelope<T>::ENV_VALUE_HIGH;
+        if (mAttackIncr == 0.) mCheckBelow[l] = kNever; // check every sample
+        break;
+      case ADSREnvelope<T>::kDecay:
+        mMul[l] = 1. - mDecayIncr * mScalar[l];
+        mK2[l] = 1.; mK3[l] = 1.;
+        mCheckBelow[l] = ADSREnvelope<T>::ENV_VALUE_LOW;
+        break;
+      case ADSREnvelope<T>::kSustain:
+        mK1[l] = 0.; mK2[l] = 1.;
+        break;
+      case ADSREnvelope<T>::kRelease:
+        mMul[l] = 1. - mReleaseIncr * mScalar[l];
+        mK1[l] = mReleaseLevel[l];
+        mCheckBelow[l] = (mReleaseIncr == 0.) ? kNever : ADSREnvelope<T>::ENV_VALUE_LOW;
+        break;
+      case ADSREnvelope<T>::kReleasedToRetrigger:
+        mAdd[l] = -mRetriggerReleaseIncr;
+        mK1[l] = mReleaseLevel[l];
+        mCheckBelow[l] = ADSREnvelope<T>::ENV_VALUE_LOW;
+        break;
+      case ADSREnvelope<T>::kReleasedToEndEarly:
+        mAdd[l] = -mEarlyReleaseIncr;
+        mK1[l] = mReleaseLevel[l];
+        mCheckBelow[l] = ADSREnvelope<T>::ENV_VALUE_LOW;
+        break;
+      case ADSREnvelope<T>::kIdle:
+      default:
+        break;
+    }
+  }
+
+  /** Handle the stage transitions of ADSREnvelope::Process() for a lane */
+  void CheckStage(int l)
+  {
+    const T env = mEnvValue[l];
+
+    switch (mStage[l])
+    {
+      case ADSREnvelope<T>::kAttack:
+        if (env > ADSREnvelope<T>::ENV_VALUE_HIGH || mAttackIncr == 0.)
+        {
+          mEnvValue[l] = 1.;
+          SetStage(l, ADSREnvelope<T>::kDecay);
+        }
+        break;
+      case ADSREnvelope<T>::kDecay:
+        if (env < ADSREnvelope<T>::ENV_VALUE_LOW)
+        {
+          if (mSustainEnabled)
+          {
+            mEnvValue[l] = 1.;
+            SetStage(l, ADSREnvelope<T>::kSustain);
+          }
+          else
+            Release(l);
+        }
+        break;
+      case ADSREnvelope<T>::kRelease:
+        if (env < ADSREnvelope<T>::ENV_VALUE_LOW || mReleaseIncr == 0.)
+        {
+          mEnvValue[l] = 0.;
+          SetStage(l, ADSREnvelope<T>::kIdle);
+
+          if (mEndReleaseFunc)
+            mEndReleaseFunc(l);
+        }
+        break;
+      case ADSREnvelope<T>::kReleasedToRetrigger:
+        if (env < ADSREnvelope<T>::ENV_VALUE_LOW)
+        {
+          mLevel[l] = mNewStartLevel[l];
+          mEnvValue[l] = 0.;
+          mPrevResult[l] = 0.;
+          mReleaseLevel[l] = 0.;
+          SetStage(l, ADSREnvelope<T>::kAttack);
+
+          if (mResetFunc)
+            mResetFunc(l);
+        }
+        break;
+      case ADSREnvelope<T>::kReleasedToEndEarly:
+        if (env < ADSREnvelope<T>::ENV_VALUE_LOW)
+        {
+          mLevel[l] = 0.;
+          mEnvValue[l] = 0.;
+          mPrevResult[l] = 0.;
+          mReleaseLevel[l] = 0.;
+          SetStage(l, ADSREnvelope<T>::kIdle);
+
+          if (mEndReleaseFunc)
+            mEndReleaseFunc(l);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  inline T CalcIncrFromTimeLinear(T timeMS, T sr) const
+  {
+    if (timeMS <= 0.) return 0.;
+    else return (1./sr) / (timeMS/1000.);
+  }
+
+  inline T CalcIncrFromTimeExp(T timeMS, T sr) const
+  {
+    if (timeMS <= 0.0) return 0.;
+
+    T r = -std::expm1(1000.0 * std::log(0.001) / (sr * timeMS));
+    if (!(r < 1.0)) r = 1.0;
+    return r;
+  }
+
+  // per lane state
+  T mEnvValue[N] = {};
+  T mMul[N] = {};
+  T mAdd[N] = {};
+  T mK1[N] = {};
+  T mK2[N] = {};
+  T mK3[N] = {};
+  T mLevel[N] = {};
+  T mReleaseLevel[N] = {};
+  T mNewStartLevel[N] = {};
+  T mPrevResult[N] = {};
+  T mScalar[N] = {};
+  T mCheckBelow[N] = {}; // CheckStage() is called when the envelope value leaves this range
+  T mCheckAbove[N] = {};
+  int mStage[N] = {};
+  bool mReleased[N] = {};
+
+  // shared settings
+  T mEarlyReleaseIncr = 0.;
+  T mRetriggerReleaseIncr = 0.;
+  T mAttackIncr = 0.;
+  T mDecayIncr = 0.;
+  T mReleaseIncr = 0.;
+  T mSampleRate;
+
+  std::function<void(int lane)> mResetFunc = nullptr;
+  std::function<void(int lane)> mEndReleaseFunc = nullptr;
+  bool mSustainEnabled = true;
 };
 
 END_IPLUG_NAMESPACE
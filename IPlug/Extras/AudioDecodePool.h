@@ -0,0 +1,519 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Decodes audio files on a pool of worker threads, resampling them to the session's sample rate as they are decoded
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "WAVReader.h"
+#include "fileread.h"
+#include "heapbuf.h"
+#include "resample.h"
+
+#if defined IPLUG_DECODE_VORBIS
+  #include "vorbisencdec.h"
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Decodes one audio file format into interleaved float frames. Register a decoder for other formats (e.g. MP3 or FLAC, wrapping a library) with AudioDecodePool::RegisterDecoder() */
+class IAudioFileDecoder
+{
+public:
+  virtual ~IAudioFileDecoder() {}
+
+  /** @return \c true if the file is in this decoder's format, and NChans() and GetSampleRate() are known */
+  virtual bool Open(const char* path) = 0;
+
+  virtual int NChans() const = 0;
+
+  virtual double GetSampleRate() const = 0;
+
+  /** @return The number of frames, or -1 if it isn't known until they are decoded */
+  virtual int64_t NFrames() const { return -1; }
+
+  /** Decode the next frames
+   * @param pDest Receives up to maxFrames interleaved frames
+   * @return The number of frames decoded, 0 at the end of the file */
+  virtual int Decode(float* pDest, int maxFrames) = 0;
+};
+
+/** Decodes WAV files, see WAVReader */
+class WAVFileDecoder final : public IAudioFileDecoder
+{
+public:
+  bool Open(const char* path) override
+  {
+    mFile = std::make_unique<WDL_FileRead>(path);
+    return mFile->IsOpen() && mReader.ReadHeader(*mFile);
+  }
+
+  int NChans() const override { return mReader.NChans(); }
+  double GetSampleRate() const override { return mReader.GetSampleRate(); }
+  int64_t NFrames() const override { return mReader.NFrames(); }
+
+  int Decode(float* pDest, int maxFrames) override
+  {
+    const int nFrames = mReader.ReadFrames(*mFile, mPos, maxFrames, pDest);
+    mPos += nFrames;
+    return nFrames;
+  }
+
+private:
+  std::unique_ptr<WDL_FileRead> mFile;
+  WAVReader mReader;
+  int64_t mPos = 0;
+};
+
+#if defined IPLUG_DECODE_VORBIS
+/** Decodes Ogg Vorbis files with WDL's VorbisDecoder. Define IPLUG_DECODE_VORBIS, and link libogg and libvorbis, to register it */
+class VorbisFileDecoder final : public IAudioFileDecoder
+{
+public:
+  bool Open(const char* path) override
+  {
+    mFile = std::make_unique<WDL_FileRead>(path);
+
+    if (!mFile->IsOpen())
+      return false;
+
+    while (!mDecoder.Available() && Feed()) {} // the headers are parsed by the time there are frames
+
+    return mDecoder.Available() > 0;
+  }
+
+  int NChans() const override { return const_cast<VorbisDecoder&>(mDecoder).GetNumChannels(); }
+  double GetSampleRate() const override { return const_cast<VorbisDecoder&>(mDecoder).GetSampleRate(); }
+
+  int Decode(float* pDest, int maxFrames) override
+  {
+    const int nChans = NChans();
+
+    while (mDecoder.Available() < maxFrames * nChans && Feed()) {}
+
+    const int nFrames = std::min(maxFrames, mDecoder.Available() / nChans);
+    std::copy_n(mDecoder.Get(), nFrames * nChans, pDest);
+    mDecoder.Skip(nFrames * nChans);
+    return nFrames;
+  }
+
+private:
+  static constexpr int kReadSize = 16384;
+
+  bool Feed()
+  {
+    void* pBuf = mDecoder.DecodeGetSrcBuffer(kReadSize);
+    const int nRead = pBuf ? mFile->Read(pBuf, kReadSize) : 0;
+
+    if (nRead <= 0)
+      return false;
+
+    mDecoder.DecodeWrote(nRead);
+    return true;
+  }
+
+  std::unique_ptr<WDL_FileRead> mFile;
+  VorbisDecoder mDecoder;
+};
+#endif
+
+/** A decoded file, one buffer per channel */
+struct DecodedAudio
+{
+  /** The sample rate of the frames, which is the rate that was asked for unless it was 0 */
+  double mSampleRate = 0.;
+
+  /** The file's sample rate */
+  double mSourceSampleRate = 0.;
+
+  std::vector<WDL_TypedBuf<WDL_ResampleSample>> mChannels;
+
+  int NChans() const { return static_cast<int>(mChannels.size()); }
+
+  int NFrames() const { return mChannels.empty() ? 0 : mChannels[0].GetSize(); }
+
+  /** Copy the frames to a WDL_ImpulseBuffer (or anything with its interface), to load an impulse response into a WDL_ConvolutionEngine */
+  template <class ImpulseBuffer>
+  void CopyTo(ImpulseBuffer& impulse) const
+  {
+    impulse.samplerate = mSampleRate;
+    impulse.SetNumChannels(std::max(NChans(), 1), false);
+
+    const int nFrames = impulse.SetLength(NFrames());
+
+    for (int c = 0; c < NChans(); c++)
+      std::copy_n(mChannels[c].Get(), nFrames, impulse.impulses[c].Get());
+  }
+};
+
+/** One file queued on an AudioDecodePool. Cancel() it when it is no longer wanted, e.g. when another preset is loaded before the last one has finished */
+class AudioDecodeJob final
+{
+public:
+  enum class EStatus
+  {
+    kPending,
+    kDecoding,
+    kDone,
+    kFailed,
+    kCancelled
+  };
+
+  AudioDecodeJob(const char* path, double sampleRate)
+  : mPath(path)
+  , mSampleRate(sampleRate)
+  , mFinished(mFinishedPromise.get_future().share())
+  {
+  }
+
+  AudioDecodeJob(const AudioDecodeJob&) = delete;
+  AudioDecodeJob& operator=(const AudioDecodeJob&) = delete;
+
+  /** Stop decoding, the worker checks between chunks. The completion function is still called, with the status kCancelled */
+  void Cancel() { mCancelled.store(true, std::memory_order_relaxed); }
+
+  bool IsCancelled() const { return mCancelled.load(std::memory_order_relaxed); }
+
+  EStatus GetStatus() const { return mStatus.load(std::memory_order_acquire); }
+
+  /** @return \c true once the job is done, has failed or was cancelled. This doesn't block, so it can be polled from OnIdle() */
+  bool IsFinished() const { return GetStatus() > EStatus::kDecoding; }
+
+  /** Block until the job is finished */
+  void Wait() const { mFinished.wait(); }
+
+  const char* GetPath() const { return mPath.c_str(); }
+
+  /** @return The frames, once the status is kDone */
+  DecodedAudio& GetResult() { return mResult; }
+
+private:
+  friend class AudioDecodePool;
+
+  void Finish(EStatus status)
+  {
+    mStatus.store(status, std::memory_order_release);
+    mFinishedPromise.set_value();
+  }
+
+  std::string mPath;
+  double mSampleRate;
+  std::function<void(AudioDecodeJob&)> mOnComplete;
+  std::atomic<bool> mCancelled{false};
+  std::atomic<EStatus> mStatus{EStatus::kPending};
+  std::promise<void> mFinishedPromise;
+  std::shared_future<void> mFinished;
+  DecodedAudio mResult;
+};
+
+/** Decodes audio files on worker threads, rather than on the UI thread in OnReset() or while loading a preset. Each file is decoded in chunks, which are resampled
+ * (with WDL_Resampler's sinc mode) to the sample rate that was asked for in the same pass, so a file is only held once in memory.
+ * Files are matched to a decoder by their extension, then by trying each decoder. WAV is built in, Ogg Vorbis is with IPLUG_DECODE_VORBIS, and other formats can be registered */
+class AudioDecodePool final
+{
+public:
+  using DecoderFactory = std::function<std::unique_ptr<IAudioFileDecoder>()>;
+  using CompletionFunc = std::function<void(AudioDecodeJob& job)>;
+  using JobPtr = std::shared_ptr<AudioDecodeJob>;
+
+  /** @param nThreads The number of worker threads, or 0 for one less than the number of cores, up to kMaxDefaultThreads */
+  explicit AudioDecodePool(int nThreads = 0)
+  {
+    RegisterDecoder("wav", []() { return std::unique_ptr<IAudioFileDecoder>(new WAVFileDecoder); });
+#if defined IPLUG_DECODE_VORBIS
+    RegisterDecoder("ogg", []() { return std::unique_ptr<IAudioFileDecoder>(new VorbisFileDecoder); });
+#endif
+
+    if (nThreads <= 0)
+      nThreads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, kMaxDefaultThreads);
+
+    for (int i = 0; i < nThreads; i++)
+      mThreads.emplace_back([this]() { ThreadProc(); });
+  }
+
+  /** Cancels the jobs, and waits for the workers to stop */
+  ~AudioDecodePool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mRunning = false;
+
+      for (auto& pJob : mQueue)
+        pJob->Cancel();
+
+      for (auto& pJob : mActive)
+        pJob->Cancel();
+    }
+
+    mCondition.notify_all();
+
+    for (auto& thread : mThreads)
+      thread.join();
+
+    for (auto& pJob : mQueue)
+      Complete(*pJob, AudioDecodeJob::EStatus::kCancelled);
+  }
+
+  AudioDecodePool(const AudioDecodePool&) = delete;
+  AudioDecodePool& operator=(const AudioDecodePool&) = delete;
+
+  /** Add a decoder for a file extension, which is tried before the decoders that were registered earlier
+   * @param extension The extension without the dot, matched without case */
+  void RegisterDecoder(const char* extension, DecoderFactory factory)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDecoders.insert(mDecoders.begin(), {ToLower(extension), std::move(factory)});
+  }
+
+  /** Queue a file to be decoded
+   * @param sampleRate The sample rate to resample to, or 0 to keep the file's
+   * @param onComplete Called on the worker thread when the job is finished, whatever its status. Hand the result to the audio thread with a lock-free queue or a swap it is safe to make there
+   * @return The job, which can be polled or waited for, and cancelled */
+  JobPtr Decode(const char* path, double sampleRate = 0., CompletionFunc onComplete = nullptr)
+  {
+    auto pJob = std::make_shared<AudioDecodeJob>(path, sampleRate);
+    pJob->mOnComplete = std::move(onComplete);
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQueue.push_back(pJob);
+    }
+
+    mCondition.notify_one();
+    return pJob;
+  }
+
+  /** Cancel every job that is queued or being decoded */
+  void CancelAll()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto& pJob : mQueue)
+      pJob->Cancel();
+
+    for (auto& pJob : mActive)
+      pJob->Cancel();
+  }
+
+private:
+  static constexpr int kMaxDefaultThreads = 4;
+  static constexpr int kChunkFrames = 4096;
+  static constexpr int kSincSize = 64;
+
+  void ThreadProc()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+      mCondition.wait(lock, [this]() { return !mRunning || !mQueue.empty(); });
+
+      if (!mRunning)
+        return;
+
+      JobPtr pJob = mQueue.front();
+      mQueue.pop_front();
+      mActive.push_back(pJob);
+      auto decoders = mDecoders;
+
+      lock.unlock();
+      Complete(*pJob, Run(*pJob, decoders));
+      lock.lock();
+
+      mActive.erase(std::find(mActive.begin(), mActive.end(), pJob));
+    }
+  }
+
+  static void Complete(AudioDecodeJob& job, AudioDecodeJob::EStatus status)
+  {
+    if (status != AudioDecodeJob::EStatus::kDone)
+      job.mResult = DecodedAudio();
+
+    job.mStatus.store(status, std::memory_order_release);
+
+    if (job.mOnComplete)
+      job.mOnComplete(job);
+
+    job.Finish(status);
+  }
+
+  static AudioDecodeJob::EStatus Run(AudioDecodeJob& job, const std::vector<std::pair<std::string, DecoderFactory>>& decoders)
+  {
+    using EStatus = AudioDecodeJob::EStatus;
+
+    if (job.IsCancelled())
+      return EStatus::kCancelled;
+
+    job.mStatus.store(EStatus::kDecoding, std::memory_order_release);
+
+    std::unique_ptr<IAudioFileDecoder> pDecoder = OpenDecoder(job.GetPath(), decoders);
+
+    if (!pDecoder || pDecoder->NChans() < 1 || pDecoder->GetSampleRate() <= 0.)
+      return EStatus::kFailed;
+
+    DecodedAudio& result = job.mResult;
+    const int nChans = pDecoder->NChans();
+    const double srcRate = pDecoder->GetSampleRate();
+    const double dstRate = job.mSampleRate > 0. ? job.mSampleRate : srcRate;
+    const double ratio = dstRate / srcRate;
+    const bool resample = dstRate != srcRate;
+
+    result.mSampleRate = dstRate;
+    result.mSourceSampleRate = srcRate;
+    result.mChannels.resize(nChans);
+
+    WDL_Resampler resampler;
+    std::vector<float> decoded(kChunkFrames * nChans);
+    std::vector<WDL_ResampleSample*> ptrs(nChans);
+    int nOut = 0;
+    int64_t nIn = 0;
+
+    if (resample)
+    {
+      resampler.SetMode(false, 0, true, kSincSize);
+      resampler.SetFeedMode(true);
+      resampler.SetRates(srcRate, dstRate);
+    }
+
+    // the whole result is allocated at once when the length is known
+    if (pDecoder->NFrames() > 0)
+      Reserve(result, static_cast<int>(pDecoder->NFrames() * ratio) + kChunkFrames);
+
+    // a chunk of zeros once the file has ended flushes the resampler
+    auto process = [&](const float* pSrc, int nFrames) {
+      if (!resample)
+      {
+        Reserve(result, nOut + nFrames);
+
+        for (int c = 0; c < nChans; c++)
+        {
+          WDL_ResampleSample* pDest = result.mChannels[c].Get() + nOut;
+
+          for (int s = 0; s < nFrames; s++)
+            pDest[s] = pSrc ? pSrc[s * nChans + c] : 0.;
+        }
+
+        nOut += nFrames;
+        return;
+      }
+
+      const int nReq = resampler.ResamplePreparePlanar(nFrames, nChans, ptrs.data());
+      nFrames = std::min(nFrames, nReq);
+
+      for (int c = 0; c < nChans; c++)
+      {
+        for (int s = 0; s < nFrames; s++)
+          ptrs[c][s] = pSrc ? pSrc[s * nChans + c] : 0.;
+      }
+
+      const int maxOut = static_cast<int>(nFrames * ratio) + 2;
+      Reserve(result, nOut + maxOut);
+
+      for (int c = 0; c < nChans; c++)
+        ptrs[c] = result.mChannels[c].Get() + nOut;
+
+      nOut += resampler.ResampleOutPlanar(ptrs.data(), nFrames, maxOut, nChans);
+    };
+
+    while (true)
+    {
+      if (job.IsCancelled())
+        return EStatus::kCancelled;
+
+      const int nFrames = pDecoder->Decode(decoded.data(), kChunkFrames);
+
+      if (nFrames <= 0)
+        break;
+
+      process(decoded.data(), nFrames);
+      nIn += nFrames;
+    }
+
+    if (!nIn)
+      return EStatus::kFailed;
+
+    const int nExpected = resample ? static_cast<int>(nIn * ratio + 0.5) : nOut;
+
+    for (int i = 0; nOut < nExpected && i < 16; i++)
+      process(nullptr, kSincSize);
+
+    for (auto& channel : result.mChannels)
+      channel.Resize(std::min(nOut, nExpected), false);
+
+    return EStatus::kDone;
+  }
+
+  static void Reserve(DecodedAudio& result, int nFrames)
+  {
+    for (auto& channel : result.mChannels)
+    {
+      if (channel.GetSize() < nFrames)
+        channel.Resize(std::max(nFrames, channel.GetSize() * 3 / 2), false);
+    }
+  }
+
+  static std::unique_ptr<IAudioFileDecoder> OpenDecoder(const char* path, const std::vector<std::pair<std::string, DecoderFactory>>& decoders)
+  {
+    const char* pDot = strrchr(path, '.');
+    const std::string extension = pDot ? ToLower(pDot + 1) : std::string();
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (auto& decoder : decoders)
+      {
+        if ((decoder.first == extension) == (pass == 0))
+        {
+          std::unique_ptr<IAudioFileDecoder> pDecoder = decoder.second();
+
+          if (pDecoder && pDecoder->Open(path))
+            return pDecoder;
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  static std::string ToLower(const char* str)
+  {
+    std::string lower(str);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower;
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<JobPtr> mQueue;
+  std::vector<JobPtr> mActive;
+  std::vector<std::pair<std::string, DecoderFactory>> mDecoders;
+  std::vector<std::thread> mThreads;
+  bool mRunning = true;
+};
+
+END_IPLUG_NAMESPACE
@@ -11,13 +11,19 @@
 #pragma once
 
 #include "IPlugEditorDelegate.h"
-
-/** This EditorDelegate communicates... */
+#include "IPlugTimer.h"
+#include <memory>
+#include <vector>
 
 BEGIN_IPLUG_NAMESPACE
 
+/** This EditorDelegate communicates with an IPlugCocoaViewController, e.g. a SwiftUI or AppKit/UIKit UI.
+ * Control values are coalesced and sent to the view controller together once every kFlushIntervalMs, with only the latest value for each control.
+ * Message data is passed to the view controller in place, see IPlugCocoaViewController's sendControlBufferFromDelegate and onMessageBuffer */
 class CocoaEditorDelegate : public IEditorDelegate
 {
+  static constexpr int kFlushIntervalMs = 16;
+
 public:
   CocoaEditorDelegate(int nParams);
   virtual ~CocoaEditorDelegate();
@@ -32,8 +38,17 @@ public:
   void SendControlValueFromDelegate(int ctrlTag, double normalizedValue) override;
   void SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData) override;
   void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
+
+  /** Send the coalesced control values to the view controller now, rather than waiting for the next flush. Called on the main thread */
+  void FlushControlValues();
+
 protected:
   void* mViewController = nullptr;
+
+private:
+  std::unique_ptr<Timer> mFlushTimer;
+  std::vector<long> mPendingCtrlTags; // NSInteger, which this header can't include
+  std::vector<double> mPendingCtrlValues;
 };
 
 END_IPLUG_NAMESPACE
@@ -13,6 +13,8 @@
 
 using namespace iplug;
 
+static_assert(sizeof(NSInteger) == sizeof(long), "the pending control tags are passed to the view controller as NSIntegers");
+
 CocoaEditorDelegate::CocoaEditorDelegate(int nParams)
 : IEditorDelegate(nParams)
 {
@@ -35,14 +37,16 @@ void* CocoaEditorDelegate::OpenWindow(void* pParent)
 
 void CocoaEditorDelegate::CloseWindow()
 {
+  mFlushTimer = nullptr;
+  mPendingCtrlTags.clear();
+  mPendingCtrlValues.clear();
   mViewController = nil;
 }
 
 bool CocoaEditorDelegate::OnMessage(int msgTag, int ctrlTag, int dataSize, const void* pData)
 {
   IPlugCocoaViewController* vc = (IPlugCocoaViewController*) mViewController;
-  NSData* pNSData = [NSData dataWithBytes:pData length:dataSize];
-  return [vc onMessage:msgTag : ctrlTag : pNSData];
+  return [vc onMessageBuffer:msgTag : ctrlTag : pData : dataSize];
 }
 
 void CocoaEditorDelegate::OnParamChangeUI(int paramIdx, EParamSource source)
@@ -67,14 +71,39 @@ void CocoaEditorDelegate::OnSysexMsgUI(const ISysEx& msg)
 
 void CocoaEditorDelegate::SendControlValueFromDelegate(int ctrlTag, double normalizedValue)
 {
-  [(IPlugCocoaViewController*) mViewController sendControlValueFromDelegate:ctrlTag :normalizedValue];
+  if (!mViewController)
+    return;
+
+  for (size_t i = 0; i < mPendingCtrlTags.size(); i++)
+  {
+    if (mPendingCtrlTags[i] == ctrlTag)
+    {
+      mPendingCtrlValues[i] = normalizedValue;
+      return;
+    }
+  }
+
+  mPendingCtrlTags.push_back(ctrlTag);
+  mPendingCtrlValues.push_back(normalizedValue);
+
+  if (!mFlushTimer)
+    mFlushTimer = std::unique_ptr<Timer>(Timer::Create([this](Timer& t) { FlushControlValues(); }, kFlushIntervalMs));
 }
 
-void CocoaEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
+void CocoaEditorDelegate::FlushControlValues()
 {
-  NSData* pNSData = [NSData dataWithBytes:pData length:dataSize];
+  if (mPendingCtrlTags.empty())
+    return;
 
-  [(IPlugCocoaViewController*) mViewController sendControlMsgFromDelegate: ctrlTag : msgTag : pNSData];
+  [(IPlugCocoaViewController*) mViewController sendControlValuesFromDelegate: reinterpret_cast<const NSInteger*>(mPendingCtrlTags.data()) : mPendingCtrlValues.data() : static_cast<NSInteger>(mPendingCtrlTags.size())];
+
+  mPendingCtrlTags.clear();
+  mPendingCtrlValues.clear();
+}
+
+void CocoaEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
+{
+  [(IPlugCocoaViewController*) mViewController sendControlBufferFromDelegate: ctrlTag : msgTag : pData : dataSize];
 }
 
 void CocoaEditorDelegate::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
@@ -35,11 +35,18 @@
 - (void) setEditorDelegate: (void*) editorDelegate;
 
 - (BOOL) onMessage: (NSInteger) msgTag : (NSInteger) ctrlTag : (NSData*) msg;
+/** Called with a message's data in place, which is only valid during the call. Override this rather than onMessage to avoid creating an NSData for each message. By default it calls onMessage */
+- (BOOL) onMessageBuffer: (NSInteger) msgTag : (NSInteger) ctrlTag : (const void*) data : (NSInteger) size NS_SWIFT_NAME(onMessageBuffer(msgTag:ctrlTag:data:size:));
 - (void) onParamChangeUI: (NSInteger) paramIdx : (double) value;
 - (void) onMidiMsgUI: (UInt8) status : (UInt8) data1 : (UInt8) data2 : (NSInteger) offset;
 - (void) onSysexMsgUI: (NSData*) msg : (NSInteger) offset;
 - (void) sendControlValueFromDelegate: (NSInteger) ctrlTag : (double) normalizedValue NS_SWIFT_NAME(sendControlValueFromDelegate(ctrlTag:normalizedValue:));
+/** Called once per display frame with the latest value of each control that has changed, in place of sendControlValueFromDelegate. The arrays are only valid during the call. By default it calls sendControlValueFromDelegate for each */
+- (void) sendControlValuesFromDelegate: (const NSInteger*) ctrlTags : (const double*) normalizedValues : (NSInteger) count NS_SWIFT_NAME(sendControlValuesFromDelegate(ctrlTags:normalizedValues:count:));
 - (void) sendControlMsgFromDelegate: (NSInteger) ctrlTag : (NSInteger) msgTag : (NSData*) msg NS_SWIFT_NAME(sendControlMsgFromDelegate(ctrlTag:msgTag:msg:));
+/** Called with a control message's data in place, e.g. an ISender's ISenderData, which is only valid during the call.
+ * Override this rather than sendControlMsgFromDelegate to read the data through an UnsafeRawBufferPointer without creating an NSData for each message. By default it calls sendControlMsgFromDelegate */
+- (void) sendControlBufferFromDelegate: (NSInteger) ctrlTag : (NSInteger) msgTag : (const void*) data : (NSInteger) size NS_SWIFT_NAME(sendControlBufferFromDelegate(ctrlTag:msgTag:data:size:));
 - (void) sendParameterValueFromDelegate: (NSInteger) paramIdx : (double) value : (BOOL) normalized NS_SWIFT_NAME(sendParameterValueFromDelegate(paramIdx:value:isNormalized:));
 
 - (void) sendParameterValueFromUI: (NSInteger) paramIdx : (double) normalizedValue NS_SWIFT_NAME(sendParameterValueFromUI(paramIdx:normalizedValue:));
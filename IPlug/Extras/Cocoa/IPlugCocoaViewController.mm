@@ -26,6 +26,11 @@ using namespace iplug;
   return FALSE;
 }
 
+- (BOOL) onMessageBuffer: (NSInteger) msgTag : (NSInteger) ctrlTag : (const void*) data : (NSInteger) size
+{
+  return [self onMessage: msgTag : ctrlTag : [NSData dataWithBytesNoCopy: const_cast<void*>(data) length: size freeWhenDone: NO]];
+}
+
 - (void) onParamChangeUI: (NSInteger) paramIdx : (double) value
 {
   //NO-OP
@@ -46,11 +51,22 @@ using namespace iplug;
   //NO-OP
 }
 
+- (void) sendControlValuesFromDelegate: (const NSInteger*) ctrlTags : (const double*) normalizedValues : (NSInteger) count
+{
+  for (NSInteger i = 0; i < count; i++)
+    [self sendControlValueFromDelegate: ctrlTags[i] : normalizedValues[i]];
+}
+
 - (void) sendControlMsgFromDelegate: (NSInteger) ctrlTag : (NSInteger) msgTag : (NSData*) msg
 {
   //NO-OP
 }
 
+- (void) sendControlBufferFromDelegate: (NSInteger) ctrlTag : (NSInteger) msgTag : (const void*) data : (NSInteger) size
+{
+  [self sendControlMsgFromDelegate: ctrlTag : msgTag : [NSData dataWithBytesNoCopy: const_cast<void*>(data) length: size freeWhenDone: NO]];
+}
+
 - (void) sendParameterValueFromDelegate: (NSInteger) paramIdx : (double) value : (BOOL) normalized
 {
   [self onParamChangeUI: paramIdx : value];
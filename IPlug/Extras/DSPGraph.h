@@ -0,0 +1,861 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc DSPGraph
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugQueue.h"
+#include "IPlugThreadPool.h"
+#include "Oversampler.h"
+#include "SVF.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A block of DSP in a DSPGraph, with a fixed number of input and output channels.
+ * A node must not write to its input buffers, which it may share with other nodes, and the graph may run it on a thread pool worker rather than the audio thread */
+class IDSPNode
+{
+public:
+  IDSPNode(int nInputs, int nOutputs)
+  : mNInputs(nInputs)
+  , mNOutputs(nOutputs)
+  {}
+
+  virtual ~IDSPNode() {}
+
+  IDSPNode(const IDSPNode&) = delete;
+  IDSPNode& operator=(const IDSPNode&) = delete;
+
+  /** Called by DSPGraph::Reset(), and by DSPGraph::AddNode() once the graph has been reset, on a non-realtime thread. Allocate and clear state here
+   * @param sampleRate The sample rate the node will run at
+   * @param blockSize The maximum number of frames ProcessBlock() will be called with */
+  virtual void OnReset(double sampleRate, int blockSize) {}
+
+  /** Process a block. The input buffers must not be written to. An input with nothing connected to it reads silence
+   * @param inputs NInputs() buffers of nFrames
+   * @param outputs NOutputs() buffers of nFrames, to overwrite
+   * @param nFrames The number of frames, up to the block size passed to OnReset() */
+  virtual void ProcessBlock(sample** inputs, sample** outputs, int nFrames) = 0;
+
+  int NInputs() const { return mNInputs; }
+
+  int NOutputs() const { return mNOutputs; }
+
+private:
+  const int mNInputs;
+  const int mNOutputs;
+};
+
+/** A node that runs a multi-channel SVF, with the same number of inputs and outputs. Set the filter through GetFilter() */
+template <int NC = 1>
+class SVFNode final : public IDSPNode
+{
+public:
+  SVFNode(typename SVF<sample, NC>::EMode mode = SVF<sample, NC>::kLowPass, double freqCPS = 1000.)
+  : IDSPNode(NC, NC)
+  , mFilter(mode, freqCPS)
+  {}
+
+  void OnReset(double sampleRate, int blockSize) override
+  {
+    mFilter.SetSampleRate(sampleRate);
+    mFilter.Reset();
+  }
+
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+  {
+    mFilter.ProcessBlock(inputs, outputs, NC, nFrames);
+  }
+
+  SVF<sample, NC>& GetFilter() { return mFilter; }
+
+private:
+  SVF<sample, NC> mFilter;
+};
+
+/** A node that runs any DSP class with the block interface the Extras share, SetSampleRate(double) and ProcessBlock(sample** inputs, sample** outputs, int nFrames),
+ * such as a FAUST class (IPlugFaust), an EEL2DSP script or a convolution engine. The object is constructed in place from the arguments after the channel counts
+ * @code
+ * auto pReverb = std::make_shared<DSPBlockNode<Faust1>>(2, 2, "Reverb", "Reverb.dsp", 1, 1);
+ * @endcode */
+template <typename T>
+class DSPBlockNode final : public IDSPNode
+{
+public:
+  template <typename... Args>
+  DSPBlockNode(int nInputs, int nOutputs, Args&&... args)
+  : IDSPNode(nInputs, nOutputs)
+  , mBlock(std::forward<Args>(args)...)
+  {}
+
+  void OnReset(double sampleRate, int blockSize) override
+  {
+    mBlock.SetSampleRate(sampleRate);
+  }
+
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+  {
+    mBlock.ProcessBlock(inputs, outputs, nFrames);
+  }
+
+  T& GetBlock() { return mBlock; }
+
+private:
+  T mBlock;
+};
+
+/** A node that calls a function, e.g. a lambda for a gain stage or a mix. Constructing the std::function may allocate, calling it doesn't */
+class DSPFuncNode final : public IDSPNode
+{
+public:
+  using BlockFunc = std::function<void(sample** inputs, sample** outputs, int nFrames)>;
+  using ResetFunc = std::function<void(double sampleRate, int blockSize)>;
+
+  DSPFuncNode(int nInputs, int nOutputs, BlockFunc blockFunc, ResetFunc resetFunc = nullptr)
+  : IDSPNode(nInputs, nOutputs)
+  , mBlockFunc(std::move(blockFunc))
+  , mResetFunc(std::move(resetFunc))
+  {}
+
+  void OnReset(double sampleRate, int blockSize) override
+  {
+    if (mResetFunc)
+      mResetFunc(sampleRate, blockSize);
+  }
+
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+  {
+    mBlockFunc(inputs, outputs, nFrames);
+  }
+
+private:
+  BlockFunc mBlockFunc;
+  ResetFunc mResetFunc;
+};
+
+/** A node that runs another node at a multiple of the sample rate through an OverSampler, e.g. a waveshaper. The inner node is reset at the oversampled rate
+ * and block size, and processes each up-sampled block in one call. The factor is fixed, since changing it means resetting the inner node */
+class OverSampledNode final : public IDSPNode
+{
+public:
+  OverSampledNode(std::unique_ptr<IDSPNode> pInner, EFactor factor, EOverSamplingEngine engine = EOverSamplingEngine::kIIR)
+  : IDSPNode(pInner->NInputs(), pInner->NOutputs())
+  , mpInner(std::move(pInner))
+  , mOverSampler(factor, true, NInputs(), NOutputs(), engine, EFIRQuality::kMedium, factor)
+  {}
+
+  void OnReset(double sampleRate, int blockSize) override
+  {
+    mOverSampler.Reset(blockSize);
+    mpInner->OnReset(sampleRate * mOverSampler.GetRate(), blockSize * mOverSampler.GetRate());
+  }
+
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+  {
+    IDSPNode* pInner = mpInner.get();
+
+    mOverSampler.ProcessBlockContiguous(inputs, outputs, nFrames, NInputs(), NOutputs(), [pInner](sample** in, sample** out, int n) {
+      pInner->ProcessBlock(in, out, n);
+    });
+  }
+
+  IDSPNode& GetInner() { return *mpInner; }
+
+private:
+  std::unique_ptr<IDSPNode> mpInner;
+  OverSampler<sample> mOverSampler;
+};
+
+/** A graph of IDSPNodes, for effects and instruments that are more than one chain of Extras, such as multi-band processors or modular synths.
+ * - Edges connect a node's output channel to another node's input channel, or the graph's own inputs and outputs, as kGraphIO. Edges into one channel are summed
+ * - Commit() compiles the edits into a plan, on the main thread: chains of nodes that only feed each other become one task, and the tasks are ordered into levels,
+ *   where a level's tasks only depend on earlier levels, e.g. the bands of a multi-band effect
+ * - Each edge's buffer comes from an arena allocated by the plan, and is reused by later levels once its last reader has run, so a long graph needs few buffers
+ * - With SetThreadPool(), a level's tasks run in parallel on IPlugThreadPool, the audio thread running one itself and helping with the rest until the level is done
+ * - The audio thread swaps to a committed plan at the start of its next block, so an edit never applies halfway through a block. The previous plan, and any node only it
+ *   used, is freed on the main thread, by the next Commit() or CollectGarbage()
+ *
+ * Nodes keep their state across commits, so reconnecting them doesn't click any more than the new routing does.
+ * Edits, Commit() and CollectGarbage() are for the main thread, Reset() is for OnReset(), when the audio isn't processing, and ProcessBlock() is for the audio thread.
+ * Node settings, e.g. an SVFNode's cutoff, can be changed on the audio thread before ProcessBlock().
+ * @code
+ * // three band split, with each band processed in parallel
+ * mGraph = std::make_unique<DSPGraph>(2, 2);
+ * auto lo = mGraph->AddNode(std::make_shared<SVFNode<2>>(SVF<sample, 2>::kLowPass, 200.));
+ * auto mid = mGraph->AddNode(std::make_shared<SVFNode<2>>(SVF<sample, 2>::kBandPass, 1500.));
+ * auto hi = mGraph->AddNode(std::make_shared<SVFNode<2>>(SVF<sample, 2>::kHighPass, 5000.));
+ * for (auto band : {lo, mid, hi})
+ * {
+ *   auto drive = mGraph->AddNode(std::make_shared<OverSampledNode>(std::make_unique<DriveNode>(), k4x));
+ *   for (auto c = 0; c < 2; c++)
+ *   {
+ *     mGraph->Connect(DSPGraph::kGraphIO, c, band, c);
+ *     mGraph->Connect(band, c, drive, c);
+ *     mGraph->Connect(drive, c, DSPGraph::kGraphIO, c);
+ *   }
+ * }
+ * mGraph->SetThreadPool(IPlugThreadPool::Get());
+ * mGraph->Commit();
+ * @endcode */
+class DSPGraph final
+{
+public:
+  using NodeID = int;
+
+  /** Stands for the graph's inputs, as an edge's source, or its outputs, as an edge's destination */
+  static constexpr NodeID kGraphIO = -1;
+  /** How many superseded plans the audio thread can hand back before the main thread frees them. It takes no new plan while the queue is full */
+  static constexpr int kRetireQueueSize = 16;
+
+  DSPGraph(int nInputs, int nOutputs)
+  : mNInputs(nInputs)
+  , mNOutputs(nOutputs)
+  , mRetired(kRetireQueueSize)
+  {
+    mChunkInputs.Resize(nInputs);
+    mChunkOutputs.Resize(nOutputs);
+  }
+
+  ~DSPGraph()
+  {
+    delete mPending.exchange(nullptr);
+    delete mpCurrent;
+    CollectGarbage();
+  }
+
+  DSPGraph(const DSPGraph&) = delete;
+  DSPGraph& operator=(const DSPGraph&) = delete;
+
+  /** Add a node. It isn't processed until the next Commit(). If the graph has been reset the node is reset now
+   * @param pNode The node, which the caller can keep a pointer to, to change its settings
+   * @return The node's ID */
+  NodeID AddNode(std::shared_ptr<IDSPNode> pNode)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    if (mBlockSize > 0)
+      pNode->OnReset(mSampleRate, mBlockSize);
+
+    const NodeID id = mNextID++;
+    mNodes.emplace(id, std::move(pNode));
+    return id;
+  }
+
+  /** Remove a node and its edges, from the next Commit(). The node is freed once no plan uses it
+   * @return \c false if there is no such node */
+  bool RemoveNode(NodeID id)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    if (!mNodes.erase(id))
+      return false;
+
+    mEdges.erase(std::remove_if(mEdges.begin(), mEdges.end(), [id](const Edge& e) { return e.mSrc == id || e.mDst == id; }), mEdges.end());
+    return true;
+  }
+
+  /** Connect an output channel to an input channel, from the next Commit()
+   * @param src The source node, or kGraphIO for the graph's inputs
+   * @param srcChan The source's output channel
+   * @param dst The destination node, or kGraphIO for the graph's outputs
+   * @param dstChan The destination's input channel
+   * @return \c false if a node or channel doesn't exist, or the edge already does */
+  bool Connect(NodeID src, int srcChan, NodeID dst, int dstChan)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    if (!IsValidChannel(src, srcChan, true) || !IsValidChannel(dst, dstChan, false))
+      return false;
+
+    const Edge edge {src, srcChan, dst, dstChan};
+
+    if (std::find(mEdges.begin(), mEdges.end(), edge) != mEdges.end())
+      return false;
+
+    mEdges.push_back(edge);
+    return true;
+  }
+
+  /** Remove an edge, from the next Commit()
+   * @return \c false if there is no such edge */
+  bool Disconnect(NodeID src, int srcChan, NodeID dst, int dstChan)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    const auto itr = std::find(mEdges.begin(), mEdges.end(), Edge {src, srcChan, dst, dstChan});
+
+    if (itr == mEdges.end())
+      return false;
+
+    mEdges.erase(itr);
+    return true;
+  }
+
+  /** Run independent tasks on a pool, from the next Commit(). Without one, every task runs on the audio thread
+   * @param pPool The pool, e.g. IPlugThreadPool::Get(), or nullptr */
+  void SetThreadPool(std::shared_ptr<IPlugThreadPool> pPool)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+    mpPool = std::move(pPool);
+  }
+
+  /** Reset every node, and rebuild the plan, with any edits not yet committed, for the block size. Call from OnReset(), while the audio isn't processing */
+  void Reset(double sampleRate, int blockSize)
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    mSampleRate = sampleRate;
+    mBlockSize = std::max(blockSize, 1);
+
+    for (auto& node : mNodes)
+      node.second->OnReset(mSampleRate, mBlockSize);
+
+    Plan* pPlan = nullptr;
+    BuildPlan(pPlan);
+
+    delete mPending.exchange(nullptr, std::memory_order_acq_rel);
+    delete mpCurrent;
+    mpCurrent = pPlan;
+    FreeRetiredPlans();
+  }
+
+  /** Compile the edits into a plan, which the audio thread starts on at its next block. Call on the main thread
+   * @return \c false if the edges form a cycle, in which case the current plan carries on */
+  bool Commit()
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+
+    FreeRetiredPlans();
+
+    Plan* pPlan = nullptr;
+
+    if (!BuildPlan(pPlan))
+      return false;
+
+    if (pPlan)
+      delete mPending.exchange(pPlan, std::memory_order_acq_rel); // a plan the audio thread never took
+
+    return true;
+  }
+
+  /** Free the plans the audio thread has finished with, and the nodes only they used. Call on the main thread, e.g. from OnIdle() */
+  void CollectGarbage()
+  {
+    std::lock_guard<std::mutex> lock(mEditMutex);
+    FreeRetiredPlans();
+  }
+
+  /** Process a block through the graph, on the audio thread. Graph outputs are written after every node has run, so the inputs and outputs can be the same buffers,
+   * unless a graph input is connected straight to a different graph output. Blocks longer than the reset block size are processed in parts
+   * @param inputs The graph's input channels
+   * @param outputs The graph's output channels
+   * @param nFrames The number of frames */
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+  {
+    TakePendingPlan();
+
+    if (!mpCurrent)
+    {
+      for (auto c = 0; c < mNOutputs; c++)
+        memset(outputs[c], 0, nFrames * sizeof(sample));
+
+      return;
+    }
+
+    const int blockSize = mpCurrent->mBlockSize;
+
+    for (int offset = 0; offset < nFrames; offset += blockSize)
+    {
+      const int n = std::min(blockSize, nFrames - offset);
+
+      for (auto c = 0; c < mNInputs; c++)
+        mChunkInputs.Get()[c] = inputs[c] + offset;
+
+      for (auto c = 0; c < mNOutputs; c++)
+        mChunkOutputs.Get()[c] = outputs[c] + offset;
+
+      mpCurrent->Run(mChunkInputs.Get(), mChunkOutputs.Get(), n);
+    }
+  }
+
+  /** @return The number of levels in the plan last built, which bounds how many tasks can run at once */
+  int GetNumLevels() const { return mNumLevels.load(std::memory_order_relaxed); }
+
+  /** @return The number of arena buffers the plan last built uses, one per edge without reuse */
+  int GetNumBuffers() const { return mNumBuffers.load(std::memory_order_relaxed); }
+
+private:
+  struct Edge
+  {
+    NodeID mSrc;
+    int mSrcChan;
+    NodeID mDst;
+    int mDstChan;
+
+    bool operator==(const Edge& other) const
+    {
+      return mSrc == other.mSrc && mSrcChan == other.mSrcChan && mDst == other.mDst && mDstChan == other.mDstChan;
+    }
+  };
+
+  /** Where a channel reads from, a graph input or an arena buffer */
+  struct Source
+  {
+    int mGraphChan = -1;
+    sample* mpBuffer = nullptr;
+
+    const sample* Get(sample** graphInputs) const { return mGraphChan >= 0 ? graphInputs[mGraphChan] : mpBuffer; }
+  };
+
+  /** An input channel with more than one source, summed into its own buffer before the node runs */
+  struct Mix
+  {
+    int mChan;
+    std::vector<Source> mSources;
+  };
+
+  struct NodeStep
+  {
+    IDSPNode* mpNode;
+    std::vector<sample*> mInputs;
+    std::vector<sample*> mOutputs;
+    /** Input channels that read a graph input directly, patched each block */
+    std::vector<std::pair<int, int>> mGraphInputs;
+    std::vector<Mix> mMixes;
+  };
+
+  struct Plan;
+
+  /** A chain of nodes that run one after another on one thread */
+  struct Task
+  {
+    Plan* mpPlan = nullptr;
+    std::vector<int> mSteps;
+    IThreadPoolTask mPoolTask;
+
+    static void RunFunc(void* pContext)
+    {
+      Task* pTask = static_cast<Task*>(pContext);
+      pTask->mpPlan->RunTask(*pTask);
+    }
+  };
+
+  /** An immutable compiled graph, built on the main thread and only run by the audio thread */
+  struct Plan
+  {
+    std::vector<std::shared_ptr<IDSPNode>> mNodes; // keeps the nodes alive while the plan is in use
+    std::vector<NodeStep> mSteps;
+    std::vector<Task> mTasks;
+    std::vector<std::vector<int>> mLevels;
+    std::vector<std::vector<Source>> mOutputs;
+    WDL_TypedBuf<sample> mArena;
+    std::shared_ptr<IPlugThreadPool> mpPool;
+    IThreadPoolGroup mGroup;
+    double mSampleRate = DEFAULT_SAMPLE_RATE;
+    int mBlockSize = 0;
+    sample** mpGraphInputs = nullptr;
+    int mNFrames = 0;
+
+    void Run(sample** inputs, sample** outputs, int nFrames)
+    {
+      mpGraphInputs = inputs;
+      mNFrames = nFrames;
+
+      IPlugThreadPool* pPool = mpPool.get();
+      const auto deadline = pPool ? IPlugThreadPool::DeadlineIn(nFrames / mSampleRate) : IPlugThreadPool::Clock::time_point();
+
+      for (const auto& level : mLevels)
+      {
+        if (!pPool || level.size() == 1)
+        {
+          for (auto t : level)
+            RunTask(mTasks[t]);
+
+          continue;
+        }
+
+        for (size_t i = 1; i < level.size(); i++)
+        {
+          Task& task = mTasks[level[i]];
+
+          if (!pPool->Submit(task.mPoolTask, mGroup, deadline))
+            RunTask(task);
+        }
+
+        RunTask(mTasks[level[0]]);
+        pPool->Wait(mGroup);
+      }
+
+      for (size_t o = 0; o < mOutputs.size(); o++)
+        SumSources(mOutputs[o], outputs[o], nFrames);
+    }
+
+    void RunTask(Task& task)
+    {
+      for (auto s : task.mSteps)
+      {
+        NodeStep& step = mSteps[s];
+
+        for (const auto& graphInput : step.mGraphInputs)
+          step.mInputs[graphInput.first] = mpGraphInputs[graphInput.second];
+
+        for (const auto& mix : step.mMixes)
+          SumSources(mix.mSources, step.mInputs[mix.mChan], mNFrames);
+
+        step.mpNode->ProcessBlock(step.mInputs.data(), step.mOutputs.data(), mNFrames);
+      }
+    }
+
+    void SumSources(const std::vector<Source>& sources, sample* pDst, int nFrames) const
+    {
+      if (sources.empty())
+      {
+        memset(pDst, 0, nFrames * sizeof(sample));
+        return;
+      }
+
+      const sample* pFirst = sources[0].Get(mpGraphInputs);
+
+      if (pFirst != pDst)
+        memmove(pDst, pFirst, nFrames * sizeof(sample));
+
+      for (size_t i = 1; i < sources.size(); i++)
+      {
+        const sample* pSrc = sources[i].Get(mpGraphInputs);
+
+        for (auto s = 0; s < nFrames; s++)
+          pDst[s] += pSrc[s];
+      }
+    }
+  };
+
+  bool IsValidChannel(NodeID id, int chan, bool isSource) const
+  {
+    if (chan < 0)
+      return false;
+
+    if (id == kGraphIO)
+      return chan < (isSource ? mNInputs : mNOutputs);
+
+    const auto itr = mNodes.find(id);
+    return itr != mNodes.end() && chan < (isSource ? itr->second->NOutputs() : itr->second->NInputs());
+  }
+
+  /** Build a plan from the edits, or leave pPlan null if the graph hasn't been reset yet
+   * @return \c false if the edges form a cycle */
+  bool BuildPlan(Plan*& pPlan)
+  {
+    const int nNodes = static_cast<int>(mNodes.size());
+    std::map<NodeID, int> indices;
+    std::vector<std::shared_ptr<IDSPNode>> nodes;
+
+    for (const auto& node : mNodes)
+    {
+      indices[node.first] = static_cast<int>(nodes.size());
+      nodes.push_back(node.second);
+    }
+
+    // node to node dependencies, without duplicates from multi-channel edges
+    std::vector<std::vector<int>> preds(nNodes), succs(nNodes);
+
+    for (const auto& e : mEdges)
+    {
+      if (e.mSrc == kGraphIO || e.mDst == kGraphIO)
+        continue;
+
+      const int src = indices[e.mSrc];
+      const int dst = indices[e.mDst];
+
+      if (std::find(preds[dst].begin(), preds[dst].end(), src) == preds[dst].end())
+      {
+        preds[dst].push_back(src);
+        succs[src].push_back(dst);
+      }
+    }
+
+    // topological order
+    std::vector<int> order, nPending(nNodes);
+
+    for (auto n = 0; n < nNodes; n++)
+    {
+      nPending[n] = static_cast<int>(preds[n].size());
+
+      if (!nPending[n])
+        order.push_back(n);
+    }
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      for (auto s : succs[order[i]])
+      {
+        if (--nPending[s] == 0)
+          order.push_back(s);
+      }
+    }
+
+    if (static_cast<int>(order.size()) != nNodes)
+      return false;
+
+    if (mBlockSize <= 0)
+      return true;
+
+    // a node whose only dependency is a node it is the only dependent of continues that node's task. Tasks are levelled after the tasks they depend on
+    std::vector<int> taskOf(nNodes), taskLevels;
+    std::vector<std::vector<int>> taskNodes;
+
+    for (auto n : order)
+    {
+      if (preds[n].size() == 1 && succs[preds[n][0]].size() == 1)
+      {
+        taskOf[n] = taskOf[preds[n][0]];
+      }
+      else
+      {
+        int level = 0;
+
+        for (auto p : preds[n])
+          level = std::max(level, taskLevels[taskOf[p]] + 1);
+
+        taskOf[n] = static_cast<int>(taskNodes.size());
+        taskNodes.emplace_back();
+        taskLevels.push_back(level);
+      }
+
+      taskNodes[taskOf[n]].push_back(n);
+    }
+
+    const int nLevels = taskLevels.empty() ? 0 : *std::max_element(taskLevels.begin(), taskLevels.end()) + 1;
+
+    // every output channel and every summed input channel needs a buffer, from the level it is written to the last level that reads it
+    struct Lifetime { int mStart; int mEnd; int mSlot; };
+    std::vector<Lifetime> lifetimes;
+    std::vector<std::vector<int>> outputBuffers(nNodes);
+    std::vector<std::vector<int>> mixBuffers(nNodes);
+
+    auto levelOf = [&](int n) { return taskLevels[taskOf[n]]; };
+
+    for (auto n = 0; n < nNodes; n++)
+    {
+      const int level = levelOf(n);
+
+      for (auto c = 0; c < nodes[n]->NOutputs(); c++)
+      {
+        int end = level;
+
+        for (const auto& e : mEdges)
+        {
+          if (e.mSrc != kGraphIO && indices[e.mSrc] == n && e.mSrcChan == c)
+            end = std::max(end, e.mDst == kGraphIO ? nLevels : levelOf(indices[e.mDst]));
+        }
+
+        outputBuffers[n].push_back(static_cast<int>(lifetimes.size()));
+        lifetimes.push_back({level, end, -1});
+      }
+
+      for (auto c = 0; c < nodes[n]->NInputs(); c++)
+      {
+        int nSources = 0;
+
+        for (const auto& e : mEdges)
+        {
+          if (e.mDst != kGraphIO && indices[e.mDst] == n && e.mDstChan == c)
+            nSources++;
+        }
+
+        mixBuffers[n].push_back(nSources > 1 ? static_cast<int>(lifetimes.size()) : -1);
+
+        if (nSources > 1)
+          lifetimes.push_back({level, level, -1});
+      }
+    }
+
+    // reuse a buffer once the level after its last reader starts
+    std::vector<int> byStart(lifetimes.size());
+
+    for (size_t i = 0; i < byStart.size(); i++)
+      byStart[i] = static_cast<int>(i);
+
+    std::stable_sort(byStart.begin(), byStart.end(), [&](int a, int b) { return lifetimes[a].mStart < lifetimes[b].mStart; });
+
+    std::vector<int> slotEnds;
+
+    for (auto i : byStart)
+    {
+      Lifetime& lifetime = lifetimes[i];
+
+      for (size_t s = 0; s < slotEnds.size() && lifetime.mSlot < 0; s++)
+      {
+        if (slotEnds[s] < lifetime.mStart)
+          lifetime.mSlot = static_cast<int>(s);
+      }
+
+      if (lifetime.mSlot < 0)
+      {
+        lifetime.mSlot = static_cast<int>(slotEnds.size());
+        slotEnds.push_back(0);
+      }
+
+      slotEnds[lifetime.mSlot] = lifetime.mEnd;
+    }
+
+    std::unique_ptr<Plan> pNewPlan(new Plan);
+    Plan& plan = *pNewPlan;
+    const int nSlots = static_cast<int>(slotEnds.size());
+
+    plan.mNodes = std::move(nodes);
+    plan.mpPool = mpPool;
+    plan.mSampleRate = mSampleRate;
+    plan.mBlockSize = mBlockSize;
+    plan.mArena.Resize((nSlots + 1) * mBlockSize);
+    memset(plan.mArena.Get(), 0, plan.mArena.GetSize() * sizeof(sample));
+
+    // the last buffer is never written, for inputs with nothing connected
+    sample* pSilence = plan.mArena.Get() + nSlots * mBlockSize;
+    auto buffer = [&](int lifetime) { return plan.mArena.Get() + lifetimes[lifetime].mSlot * mBlockSize; };
+
+    auto sourceOf = [&](const Edge& e) {
+      Source source;
+
+      if (e.mSrc == kGraphIO)
+        source.mGraphChan = e.mSrcChan;
+      else
+        source.mpBuffer = buffer(outputBuffers[indices[e.mSrc]][e.mSrcChan]);
+
+      return source;
+    };
+
+    plan.mSteps.resize(nNodes);
+
+    for (auto n = 0; n < nNodes; n++)
+    {
+      NodeStep& step = plan.mSteps[n];
+      step.mpNode = plan.mNodes[n].get();
+      step.mInputs.assign(step.mpNode->NInputs(), pSilence);
+
+      for (auto c = 0; c < step.mpNode->NOutputs(); c++)
+        step.mOutputs.push_back(buffer(outputBuffers[n][c]));
+
+      for (auto c = 0; c < step.mpNode->NInputs(); c++)
+      {
+        Mix mix {c, {}};
+
+        for (const auto& e : mEdges)
+        {
+          if (e.mDst != kGraphIO && indices[e.mDst] == n && e.mDstChan == c)
+            mix.mSources.push_back(sourceOf(e));
+        }
+
+        if (mix.mSources.size() > 1)
+        {
+          step.mInputs[c] = buffer(mixBuffers[n][c]);
+          step.mMixes.push_back(std::move(mix));
+        }
+        else if (mix.mSources.size() == 1)
+        {
+          if (mix.mSources[0].mGraphChan >= 0)
+            step.mGraphInputs.emplace_back(c, mix.mSources[0].mGraphChan);
+          else
+            step.mInputs[c] = mix.mSources[0].mpBuffer;
+        }
+      }
+    }
+
+    plan.mOutputs.resize(mNOutputs);
+
+    for (const auto& e : mEdges)
+    {
+      if (e.mDst == kGraphIO)
+        plan.mOutputs[e.mDstChan].push_back(sourceOf(e));
+    }
+
+    plan.mTasks.resize(taskNodes.size());
+    plan.mLevels.resize(nLevels);
+
+    for (size_t t = 0; t < taskNodes.size(); t++)
+    {
+      Task& task = plan.mTasks[t];
+      task.mpPlan = &plan;
+      task.mSteps = taskNodes[t];
+      task.mPoolTask.Set(Task::RunFunc, &task);
+      plan.mLevels[taskLevels[t]].push_back(static_cast<int>(t));
+    }
+
+    mNumLevels.store(nLevels, std::memory_order_relaxed);
+    mNumBuffers.store(nSlots, std::memory_order_relaxed);
+    pPlan = pNewPlan.release();
+    return true;
+  }
+
+  /** Called on the audio thread at the start of a block */
+  void TakePendingPlan()
+  {
+    // only the audio thread pushes, so the queue can't fill up between the check and the push
+    if (!mPending.load(std::memory_order_relaxed) || mRetired.ElementsAvailable() >= kRetireQueueSize)
+      return;
+
+    Plan* pPlan = mPending.exchange(nullptr, std::memory_order_acq_rel);
+
+    if (!pPlan)
+      return;
+
+    if (mpCurrent)
+      mRetired.Push(mpCurrent);
+
+    mpCurrent = pPlan;
+  }
+
+  void FreeRetiredPlans()
+  {
+    Plan* pPlan = nullptr;
+
+    while (mRetired.Pop(pPlan))
+      delete pPlan;
+  }
+
+  const int mNInputs;
+  const int mNOutputs;
+
+  std::mutex mEditMutex;
+  std::map<NodeID, std::shared_ptr<IDSPNode>> mNodes;
+  std::vector<Edge> mEdges;
+  std::shared_ptr<IPlugThreadPool> mpPool;
+  NodeID mNextID = 0;
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  int mBlockSize = 0;
+
+  std::atomic<Plan*> mPending {nullptr};
+  IPlugQueue<Plan*> mRetired;
+  Plan* mpCurrent = nullptr;
+  WDL_TypedBuf<sample*> mChunkInputs;
+  WDL_TypedBuf<sample*> mChunkOutputs;
+
+  std::atomic<int> mNumLevels {0};
+  std::atomic<int> mNumBuffers {0};
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,530 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc DynamicsProcessor
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+#include "IPlugUtilities.h"
+#include "NChanDelay.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A feed-forward compressor and lookahead limiter, detecting the peak level of the inputs or of an external sidechain, linked across channels or per channel.
+ * A block is processed in stages, rather than per sample through a branchy envelope follower. The peak level is held over the lookahead window by a sliding
+ * window maximum, a monotonic deque that costs O(1) per sample however long the window is. The static curve (threshold, ratio and soft knee) is computed four
+ * samples to a SIMD vector, in the log2 domain with polynomial log2 and exp2 approximations good to 1e-4 dB. Only the attack and release smoothing is a
+ * recursion per sample, with the coefficient selected rather than branched on.
+ *
+ * In kLimiter mode the ratio is infinite, attacks are instant and the held gain is averaged over the lookahead window, so with no knee the output peak never
+ * exceeds the threshold by more than the approximations' error, and the lookahead is the attack time. In kCompressor mode the lookahead only moves the detector ahead of the audio.
+ * The audio is delayed by the lookahead, report GetLatency() with IPlugProcessor::SetLatency() after Reset().
+ * Setters other than SetLookahead() take effect at the next ProcessBlock(). Its buffers are allocated by Reset(), call it from OnReset()
+ * @tparam T The sample type
+ * @tparam MAXNC The maximum number of channels */
+template <typename T = sample, int MAXNC = 8>
+class DynamicsProcessor
+{
+public:
+  enum class EMode
+  {
+    kCompressor,
+    kLimiter
+  };
+
+  /** How the channels are detected */
+  enum class ELink
+  {
+    kLinked,  // the loudest channel sets the gain of all of them, keeping the image steady
+    kUnlinked // each channel has its own gain
+  };
+
+  /** @param nChans The number of channels processed, up to MAXNC */
+  DynamicsProcessor(int nChans = 2)
+  : mNChans(nChans)
+  , mDelay(nChans, nChans)
+  {
+    assert(nChans > 0 && nChans <= MAXNC);
+    for (auto& gr : mGainReduction)
+      gr.store(0.f, std::memory_order_relaxed);
+    Reset(DEFAULT_SAMPLE_RATE);
+  }
+
+  DynamicsProcessor(const DynamicsProcessor&) = delete;
+  DynamicsProcessor& operator=(const DynamicsProcessor&) = delete;
+
+  void SetMode(EMode mode) { mMode = mode; }
+  void SetLink(ELink link) { mLink = link; }
+
+  /** @param thresholdDB The level above which the gain is reduced, or the limiter's ceiling */
+  void SetThreshold(double thresholdDB) { mThreshold = static_cast<float>(thresholdDB / kDBPerOctave); }
+
+  /** @param ratio The input level change in dB for each dB of output level change above the threshold, 1 or more. Ignored by kLimiter */
+  void SetRatio(double ratio) { mSlope = static_cast<float>(1. / std::max(ratio, 1.) - 1.); }
+
+  /** @param kneeDB The width of the soft knee centred on the threshold, 0 for a hard knee */
+  void SetKnee(double kneeDB) { mKnee = static_cast<float>(std::max(kneeDB, 0.) / kDBPerOctave); }
+
+  /** @param attackMs The time the gain takes to fall by 63% of a step. Ignored by kLimiter, which attacks over the lookahead */
+  void SetAttack(double attackMs) { mAttackMs = attackMs; UpdateCoefficients(); }
+
+  /** @param releaseMs The time the gain takes to rise by 63% of a step */
+  void SetRelease(double releaseMs) { mReleaseMs = releaseMs; UpdateCoefficients(); }
+
+  /** @param gainDB A gain applied to the output */
+  void SetMakeupGain(double gainDB) { mMakeup = static_cast<float>(DBToAmp(gainDB)); }
+
+  /** Set the lookahead, which takes effect at the next Reset() since it changes the latency
+   * @param lookaheadMs The time the detector runs ahead of the audio */
+  void SetLookahead(double lookaheadMs) { mLookaheadMs = std::max(lookaheadMs, 0.); }
+
+  /** Set up for a sample rate, allocating the lookahead delay, and clear the state
+   * @param sampleRate The sample rate
+   * @param maxBlockSize The largest block processed at once, larger blocks are processed in pieces of this size */
+  void Reset(double sampleRate, int maxBlockSize = DEFAULT_BLOCK_SIZE)
+  {
+    mSampleRate = sampleRate;
+    mMaxBlockSize = std::max(maxBlockSize, 1);
+    mLookahead = static_cast<int>(std::round(mLookaheadMs * 0.001 * sampleRate));
+    mWindow = mLookahead + 1;
+    UpdateCoefficients();
+
+    mDelay.SetDelayTime(mLookahead);
+    mDetector.Resize(MAXNC * mMaxBlockSize);
+    mDequeValues.Resize(MAXNC * mWindow);
+    mDequeIndices.Resize(MAXNC * mWindow);
+    mHeld.Resize(MAXNC * mWindow);
+
+    for (auto i = 0; i < MAXNC; i++)
+    {
+      Stream& stream = mStreams[i];
+      stream.env = 0.f;
+      stream.dequeFront = stream.dequeSize = 0;
+      stream.heldPos = 0;
+      stream.heldSum = 0.;
+      mGainReduction[i].store(0.f, std::memory_order_relaxed);
+    }
+
+    memset(mHeld.Get(), 0, mHeld.GetSize() * sizeof(float));
+    mSampleIdx = 0;
+  }
+
+  /** @return The latency in samples, the lookahead */
+  int GetLatency() const { return mLookahead; }
+
+  /** Process a block. This can be called on the realtime audio thread.
+   * @param inputs nChans buffers of nFrames
+   * @param outputs nChans buffers of nFrames, which may be the inputs
+   * @param nFrames The number of frames
+   * @param sideChain Buffers to detect the level of instead of the inputs, or nullptr. Unlinked, channel c is detected from sideChain[c % nSideChans]
+   * @param nSideChans The number of sidechain buffers */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, T** sideChain = nullptr, int nSideChans = 0)
+  {
+    T** detect = sideChain && nSideChans > 0 ? sideChain : inputs;
+    const int nDetectChans = sideChain && nSideChans > 0 ? nSideChans : mNChans;
+    const int nStreams = mLink == ELink::kLinked ? 1 : mNChans;
+    float minGain[MAXNC];
+    std::fill(minGain, minGain + MAXNC, 0.f);
+
+    for (auto s0 = 0; s0 < nFrames;)
+    {
+      const int n = std::min(nFrames - s0, mMaxBlockSize);
+      T* in[MAXNC];
+      T* out[MAXNC];
+
+      for (auto c = 0; c < mNChans; c++)
+      {
+        in[c] = inputs[c] + s0;
+        out[c] = outputs[c] + s0;
+      }
+
+      for (auto i = 0; i < nStreams; i++)
+      {
+        float* pLevel = mDetector.Get() + i * mMaxBlockSize;
+
+        if (nStreams == 1)
+          DetectLinked(detect, nDetectChans, s0, n, pLevel);
+        else
+          DetectPeak(detect[i % nDetectChans] + s0, n, pLevel);
+
+        if (mLookahead > 0)
+          HoldPeak(i, pLevel, n);
+
+        ComputeGain(pLevel, n);
+        minGain[i] = std::min(minGain[i], Smooth(i, pLevel, n));
+        ToLinear(pLevel, n);
+      }
+
+      // read the detector before the delay overwrites in-place buffers
+      mDelay.ProcessBlock(in, out, n);
+
+      for (auto c = 0; c < mNChans; c++)
+      {
+        const float* pGain = mDetector.Get() + (nStreams == 1 ? 0 : c) * mMaxBlockSize;
+        for (auto s = 0; s < n; s++)
+          out[c][s] *= static_cast<T>(pGain[s]);
+      }
+
+      mSampleIdx += n;
+      s0 += n;
+    }
+
+    for (auto i = 0; i < MAXNC; i++)
+      mGainReduction[i].store(i < nStreams ? minGain[i] * static_cast<float>(kDBPerOctave) : 0.f, std::memory_order_relaxed);
+  }
+
+  /** Get the largest gain reduction of the last block, for a meter. This can be called from any thread
+   * @param chan The channel, which is ignored when linked
+   * @return The gain change in dB, 0 or less */
+  float GetGainReductionDB(int chan = 0) const
+  {
+    return mGainReduction[mLink == ELink::kLinked ? 0 : Clip(chan, 0, MAXNC - 1)].load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr double kDBPerOctave = 6.020599913279624; // 20 * log10(2), the gain is computed in log2 units
+  static constexpr float kSilence = 1e-30f;
+
+  struct Stream
+  {
+    float env; // the smoothed gain in log2 units
+    int dequeFront, dequeSize;
+    int heldPos;
+    double heldSum;
+  };
+
+  void UpdateCoefficients()
+  {
+    auto coeff = [this](double ms) {
+      const double samples = ms * 0.001 * mSampleRate;
+      return samples > 0. ? static_cast<float>(std::exp(-1. / samples)) : 0.f;
+    };
+
+    mAttackCoeff = coeff(mAttackMs);
+    mReleaseCoeff = coeff(mReleaseMs);
+  }
+
+  void DetectPeak(const T* pIn, int n, float* pLevel)
+  {
+    for (auto s = 0; s < n; s++)
+      pLevel[s] = static_cast<float>(std::fabs(pIn[s]));
+  }
+
+  void DetectLinked(T** detect, int nChans, int s0, int n, float* pLevel)
+  {
+    DetectPeak(detect[0] + s0, n, pLevel);
+
+    for (auto c = 1; c < nChans; c++)
+    {
+      const T* pIn = detect[c] + s0;
+      for (auto s = 0; s < n; s++)
+        pLevel[s] = std::max(pLevel[s], static_cast<float>(std::fabs(pIn[s])));
+    }
+  }
+
+  /** Replace each level with the largest over the last mWindow samples. The deque holds the samples that could still be the largest,
+   * decreasing from the front, so each sample is pushed and popped once */
+  void HoldPeak(int streamIdx, float* pLevel, int n)
+  {
+    Stream& stream = mStreams[streamIdx];
+    float* pValues = mDequeValues.Get() + streamIdx * mWindow;
+    int64_t* pIndices = mDequeIndices.Get() + streamIdx * mWindow;
+    const int window = mWindow;
+
+    int front = stream.dequeFront, size = stream.dequeSize;
+    auto wrap = [window](int pos) { return pos >= window ? pos - window : pos; };
+
+    for (auto s = 0; s < n; s++)
+    {
+      const int64_t idx = mSampleIdx + s;
+      const float v = pLevel[s];
+
+      // at most one sample leaves the window each time, which makes room for the new one
+      if (size && pIndices[front] <= idx - window)
+      {
+        front = wrap(front + 1);
+        size--;
+      }
+
+      while (size && pValues[wrap(front + size - 1)] <= v)
+        size--;
+
+      const int back = wrap(front + size);
+      pValues[back] = v;
+      pIndices[back] = idx;
+      size++;
+
+      pLevel[s] = pValues[front];
+    }
+
+    stream.dequeFront = front;
+    stream.dequeSize = size;
+  }
+
+  /** The static curve, levels to gain changes in log2 units, with the soft knee of Giannoulis, Massberg and Reiss folded into one branchless expression */
+  void ComputeGain(float* pLevel, int n)
+  {
+    const float knee = mKnee;
+    const V threshold = Splat(mThreshold), halfKnee = Splat(0.5f * knee), kneeWidth = Splat(knee);
+    const V invTwoKnee = Splat(knee > 0.f ? 0.5f / knee : 0.f);
+    const V slope = Splat(mMode == EMode::kLimiter ? -1.f : mSlope);
+    const V zero = Splat(0.f), silence = Splat(kSilence);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+    {
+      const V over = Sub(Log2(Max(Load(pLevel + s), silence)), threshold);
+      const V inKnee = Min(Max(Add(over, halfKnee), zero), kneeWidth);
+      Store(pLevel + s, Mul(slope, Add(Mul(Mul(inKnee, inKnee), invTwoKnee), Max(Sub(over, halfKnee), zero))));
+    }
+
+    if (s < n)
+    {
+      float tail[4] = {kSilence, kSilence, kSilence, kSilence};
+      std::copy(pLevel + s, pLevel + n, tail);
+      ComputeGain(tail, 4);
+      std::copy(tail, tail + (n - s), pLevel + s);
+    }
+  }
+
+  /** Smooth the gain changes in place
+   * @return The smallest gain change */
+  float Smooth(int streamIdx, float* pGain, int n)
+  {
+    Stream& stream = mStreams[streamIdx];
+    const float release = mReleaseCoeff;
+    float env = stream.env;
+    float minGain = 0.f;
+
+    if (mMode == EMode::kLimiter)
+    {
+      // instant attack, so the smoothed gain never exceeds the held gain, then an average over the window that reaches each held gain by the time its audio is output
+      float* pHeld = mHeld.Get() + streamIdx * mWindow;
+      const double scale = 1. / mWindow;
+
+      for (auto s = 0; s < n; s++)
+      {
+        env = std::min(pGain[s], pGain[s] + release * (env - pGain[s]));
+        stream.heldSum += env - pHeld[stream.heldPos];
+        pHeld[stream.heldPos] = env;
+
+        if (++stream.heldPos == mWindow)
+        {
+          // start the running sum again from the window once per lap, so that rounding doesn't accumulate
+          stream.heldPos = 0;
+          double sum = 0.;
+          for (auto i = 0; i < mWindow; i++)
+            sum += pHeld[i];
+          stream.heldSum = sum;
+        }
+
+        pGain[s] = static_cast<float>(stream.heldSum * scale);
+        minGain = std::min(minGain, pGain[s]);
+      }
+    }
+    else
+    {
+      const float attack = mAttackCoeff;
+
+      for (auto s = 0; s < n; s++)
+      {
+        const float coeff = pGain[s] < env ? attack : release;
+        env = pGain[s] + coeff * (env - pGain[s]);
+        pGain[s] = env;
+        minGain = std::min(minGain, env);
+      }
+    }
+
+    stream.env = std::fabs(env) < kSilence ? 0.f : env;
+    return minGain;
+  }
+
+  /** Gain changes in log2 units to linear gains, with the makeup gain */
+  void ToLinear(float* pGain, int n)
+  {
+    const V makeup = Splat(mMakeup);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+      Store(pGain + s, Mul(Exp2(Load(pGain + s)), makeup));
+
+    if (s < n)
+    {
+      float tail[4] = {};
+      std::copy(pGain + s, pGain + n, tail);
+      Store(tail, Mul(Exp2(Load(tail)), makeup));
+      std::copy(tail, tail + (n - s), pGain + s);
+    }
+  }
+
+#pragma mark - Vectors of four samples
+
+#if defined IPLUG_SIMD_SSE2
+  using V = __m128;
+  static inline V Load(const float* p) { return _mm_loadu_ps(p); }
+  static inline void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+  static inline V Splat(float f) { return _mm_set1_ps(f); }
+  static inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+  static inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static inline V Min(V a, V b) { return _mm_min_ps(a, b); }
+  static inline V Max(V a, V b) { return _mm_max_ps(a, b); }
+  /** Split a positive value into its exponent and mantissa - 1, in [0, 1) */
+  static inline void Split(V x, V& exponent, V& mantissa)
+  {
+    const __m128i bits = _mm_castps_si128(x);
+    exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    mantissa = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))), _mm_set1_ps(1.f));
+  }
+  static inline V Floor(V x)
+  {
+    const V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
+  }
+  /** 2 to the power of a whole number */
+  static inline V Pow2(V i) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(i), _mm_set1_epi32(127)), 23)); }
+#elif defined IPLUG_SIMD_NEON
+  using V = float32x4_t;
+  static inline V Load(const float* p) { return vld1q_f32(p); }
+  static inline void Store(float* p, V v) { vst1q_f32(p, v); }
+  static inline V Splat(float f) { return vdupq_n_f32(f); }
+  static inline V Add(V a, V b) { return vaddq_f32(a, b); }
+  static inline V Sub(V a, V b) { return vsubq_f32(a, b); }
+  static inline V Mul(V a, V b) { return vmulq_f32(a, b); }
+  static inline V Min(V a, V b) { return vminq_f32(a, b); }
+  static inline V Max(V a, V b) { return vmaxq_f32(a, b); }
+  static inline void Split(V x, V& exponent, V& mantissa)
+  {
+    const int32x4_t bits = vreinterpretq_s32_f32(x);
+    exponent = vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(127)));
+    mantissa = vsubq_f32(vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007FFFFF)), vdupq_n_s32(0x3F800000))), vdupq_n_f32(1.f));
+  }
+  static inline V Floor(V x) { return vrndmq_f32(x); }
+  static inline V Pow2(V i) { return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(i), vdupq_n_s32(127)), 23)); }
+#elif defined IPLUG_SIMD_WASM
+  using V = v128_t;
+  static inline V Load(const float* p) { return wasm_v128_load(p); }
+  static inline void Store(float* p, V v) { wasm_v128_store(p, v); }
+  static inline V Splat(float f) { return wasm_f32x4_splat(f); }
+  static inline V Add(V a, V b) { return wasm_f32x4_add(a, b); }
+  static inline V Sub(V a, V b) { return wasm_f32x4_sub(a, b); }
+  static inline V Mul(V a, V b) { return wasm_f32x4_mul(a, b); }
+  static inline V Min(V a, V b) { return wasm_f32x4_pmin(a, b); }
+  static inline V Max(V a, V b) { return wasm_f32x4_pmax(a, b); }
+  static inline void Split(V x, V& exponent, V& mantissa)
+  {
+    exponent = wasm_f32x4_convert_i32x4(wasm_i32x4_sub(wasm_i32x4_shr(x, 23), wasm_i32x4_splat(127)));
+    mantissa = wasm_f32x4_sub(wasm_v128_or(wasm_v128_and(x, wasm_i32x4_splat(0x007FFFFF)), wasm_i32x4_splat(0x3F800000)), wasm_f32x4_splat(1.f));
+  }
+  static inline V Floor(V x) { return wasm_f32x4_floor(x); }
+  static inline V Pow2(V i) { return wasm_i32x4_shl(wasm_i32x4_add(wasm_i32x4_trunc_sat_f32x4(i), wasm_i32x4_splat(127)), 23); }
+#else
+  struct V { float v[4]; };
+  static inline V Load(const float* p) { V r; memcpy(r.v, p, sizeof(r.v)); return r; }
+  static inline void Store(float* p, V v) { memcpy(p, v.v, sizeof(v.v)); }
+  static inline V Splat(float f) { return {{f, f, f, f}}; }
+  static inline V Add(V a, V b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+  static inline V Sub(V a, V b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+  static inline V Mul(V a, V b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+  static inline V Min(V a, V b) { return {{std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3])}}; }
+  static inline V Max(V a, V b) { return {{std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3])}}; }
+  static inline void Split(V x, V& exponent, V& mantissa)
+  {
+    for (auto i = 0; i < 4; i++)
+    {
+      uint32_t bits;
+      memcpy(&bits, &x.v[i], sizeof(bits));
+      exponent.v[i] = static_cast<float>(static_cast<int>(bits >> 23) - 127);
+      bits = (bits & 0x007FFFFF) | 0x3F800000;
+      memcpy(&mantissa.v[i], &bits, sizeof(bits));
+      mantissa.v[i] -= 1.f;
+    }
+  }
+  static inline V Floor(V x) { return {{std::floor(x.v[0]), std::floor(x.v[1]), std::floor(x.v[2]), std::floor(x.v[3])}}; }
+  static inline V Pow2(V i)
+  {
+    V r;
+    for (auto k = 0; k < 4; k++)
+    {
+      const uint32_t bits = static_cast<uint32_t>(static_cast<int>(i.v[k]) + 127) << 23;
+      memcpy(&r.v[k], &bits, sizeof(bits));
+    }
+    return r;
+  }
+#endif
+
+  /** log2 of a positive value, a least squares polynomial in the mantissa accurate to 2e-5 (1e-4 dB) */
+  static inline V Log2(V x)
+  {
+    V exponent, t;
+    Split(x, exponent, t);
+    V p = Add(Mul(Splat(0.0452682932f), t), Splat(-0.193516526f));
+    p = Add(Mul(p, t), Splat(0.415245562f));
+    p = Add(Mul(p, t), Splat(-0.708865218f));
+    p = Add(Mul(p, t), Splat(1.4418799f));
+    return Add(exponent, Mul(p, t));
+  }
+
+  /** 2 to the power of x, clamped to the normal floats, a polynomial in the fraction accurate to 2e-7 and exact at 0 */
+  static inline V Exp2(V x)
+  {
+    x = Min(Max(x, Splat(-126.f)), Splat(126.f));
+    const V i = Floor(x);
+    const V f = Sub(x, i);
+    V p = Add(Mul(Splat(0.00189510727f), f), Splat(0.00894621476f));
+    p = Add(Mul(p, f), Splat(0.0558632825f));
+    p = Add(Mul(p, f), Splat(0.24014077f));
+    p = Add(Mul(p, f), Splat(0.69315462f));
+    p = Add(Mul(p, f), Splat(1.f));
+    return Mul(Pow2(i), p);
+  }
+
+  int mNChans;
+  EMode mMode = EMode::kCompressor;
+  ELink mLink = ELink::kLinked;
+  float mThreshold = 0.f; // log2 units
+  float mSlope = -0.75f; // 1 / ratio - 1
+  float mKnee = 0.f; // log2 units
+  float mMakeup = 1.f;
+  double mAttackMs = 5.;
+  double mReleaseMs = 100.;
+  double mLookaheadMs = 0.;
+  float mAttackCoeff = 0.f;
+  float mReleaseCoeff = 0.f;
+
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  int mMaxBlockSize = DEFAULT_BLOCK_SIZE;
+  int mLookahead = 0;
+  int mWindow = 1;
+  int64_t mSampleIdx = 0;
+
+  NChanDelayLine<T> mDelay;
+  WDL_TypedBuf<float> mDetector; // each stream's levels, then gains, for a block
+  WDL_TypedBuf<float> mDequeValues;
+  WDL_TypedBuf<int64_t> mDequeIndices;
+  WDL_TypedBuf<float> mHeld; // the limiter's held gains over the window
+  Stream mStreams[MAXNC];
+  std::atomic<float> mGainReduction[MAXNC];
+};
+
+END_IPLUG_NAMESPACE
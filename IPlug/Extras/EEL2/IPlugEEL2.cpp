@@ -0,0 +1,1389 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#include "IPlugEEL2.h"
+#include "IPlugDenormal.h"
+#include "IPlugSIMD.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+
+using namespace iplug;
+
+#ifndef IPLUG_EEL2_NO_HOSTSTUBS
+// EEL2 locks this while it changes state that is shared between VMs, e.g. when a VM allocates gmem[] or is freed.
+// Define IPLUG_EEL2_NO_HOSTSTUBS if something else in the binary already implements these
+static std::recursive_mutex& GetEELMutex()
+{
+  static std::recursive_mutex sMutex;
+  return sMutex;
+}
+
+void NSEEL_HOSTSTUB_EnterMutex() { GetEELMutex().lock(); }
+void NSEEL_HOSTSTUB_LeaveMutex() { GetEELMutex().unlock(); }
+#endif
+
+#pragma mark - Vectorized @sample
+
+namespace {
+
+/** EEL_F, without the alignment attribute that it has in some builds, which can't be used in templates */
+#if EEL_F_SIZE == 8
+using VectorValue = double;
+#else
+using VectorValue = float;
+#endif
+
+/** A kernel of a vectorized \@sample section, which applies one operation to n frames of its operands. Unary operations ignore pB */
+using VectorKernel = void (*)(VectorValue* pDest, const VectorValue* pA, const VectorValue* pB, int n);
+
+// the operations, with the same results as EEL2's own. Those with kSIMD also have SSE2, AVX and NEON versions, the others are applied to one frame at a time
+struct AddOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a + b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vaddq_f64(a, b); }
+#endif
+};
+
+struct SubOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a - b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vsubq_f64(a, b); }
+#endif
+};
+
+struct MulOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a * b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vmulq_f64(a, b); }
+#endif
+};
+
+struct DivOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a / b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_div_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_div_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vdivq_f64(a, b); }
+#endif
+};
+
+struct NegOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue) { return -a; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d) { return _mm_xor_pd(a, _mm_set1_pd(-0.)); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.)); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t) { return vnegq_f64(a); }
+#endif
+};
+
+struct AbsOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue) { return std::fabs(a); }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d) { return _mm_andnot_pd(_mm_set1_pd(-0.), a); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d) { return _mm256_andnot_pd(_mm256_set1_pd(-0.), a); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t) { return vabsq_f64(a); }
+#endif
+};
+
+struct SqrOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue) { return a * a; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d) { return _mm_mul_pd(a, a); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d) { return _mm256_mul_pd(a, a); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t) { return vmulq_f64(a, a); }
+#endif
+};
+
+// EEL2's sqrt() is of the absolute value
+struct SqrtOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue) { return std::sqrt(std::fabs(a)); }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d) { return _mm_sqrt_pd(_mm_andnot_pd(_mm_set1_pd(-0.), a)); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d) { return _mm256_sqrt_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.), a)); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t) { return vsqrtq_f64(vabsq_f64(a)); }
+#endif
+};
+
+// EEL2's min() and max() return the second operand when the comparison fails, as minpd and maxpd do
+struct MinOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a < b ? a : b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_min_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_min_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vbslq_f64(vcltq_f64(a, b), a, b); }
+#endif
+};
+
+struct MaxOp
+{
+  static constexpr bool kSIMD = true;
+  static VectorValue Scalar(VectorValue a, VectorValue b) { return a > b ? a : b; }
+#ifdef IPLUG_SIMD_SSE2
+  static __m128d SSE2(__m128d a, __m128d b) { return _mm_max_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_AVX
+  static IPLUG_SIMD_TARGET_AVX __m256d AVX(__m256d a, __m256d b) { return _mm256_max_pd(a, b); }
+#endif
+#ifdef IPLUG_SIMD_NEON
+  static float64x2_t NEON(float64x2_t a, float64x2_t b) { return vbslq_f64(vcgtq_f64(a, b), a, b); }
+#endif
+};
+
+#define IPLUG_EEL2_SCALAR_OP(NAME, EXPR) \
+  struct NAME \
+  { \
+    static constexpr bool kSIMD = false; \
+    static VectorValue Scalar(VectorValue a, VectorValue b) { (void) b; return EXPR; } \
+  };
+
+IPLUG_EEL2_SCALAR_OP(PowOp, std::pow(a, b))
+IPLUG_EEL2_SCALAR_OP(Atan2Op, std::atan2(a, b))
+IPLUG_EEL2_SCALAR_OP(SinOp, std::sin(a))
+IPLUG_EEL2_SCALAR_OP(CosOp, std::cos(a))
+IPLUG_EEL2_SCALAR_OP(TanOp, std::tan(a))
+IPLUG_EEL2_SCALAR_OP(AsinOp, std::asin(a))
+IPLUG_EEL2_SCALAR_OP(AcosOp, std::acos(a))
+IPLUG_EEL2_SCALAR_OP(AtanOp, std::atan(a))
+IPLUG_EEL2_SCALAR_OP(ExpOp, std::exp(a))
+IPLUG_EEL2_SCALAR_OP(LogOp, std::log(a))
+IPLUG_EEL2_SCALAR_OP(Log10Op, std::log10(a))
+IPLUG_EEL2_SCALAR_OP(FloorOp, std::floor(a))
+IPLUG_EEL2_SCALAR_OP(CeilOp, std::ceil(a))
+IPLUG_EEL2_SCALAR_OP(SignOp, a > 0. ? 1. : a < 0. ? -1. : 0.)
+
+#undef IPLUG_EEL2_SCALAR_OP
+
+template <typename Op>
+void VectorScalar(VectorValue* pDest, const VectorValue* pA, const VectorValue* pB, int n)
+{
+  for (int i = 0; i < n; i++)
+    pDest[i] = Op::Scalar(pA[i], pB[i]);
+}
+
+#if EEL_F_SIZE == 8
+#ifdef IPLUG_SIMD_SSE2
+template <typename Op>
+void VectorSSE2(VectorValue* pDest, const VectorValue* pA, const VectorValue* pB, int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(pDest + i, Op::SSE2(_mm_loadu_pd(pA + i), _mm_loadu_pd(pB + i)));
+  for (; i < n; i++)
+    pDest[i] = Op::Scalar(pA[i], pB[i]);
+}
+#endif
+
+#ifdef IPLUG_SIMD_AVX
+template <typename Op>
+IPLUG_SIMD_TARGET_AVX void VectorAVX(VectorValue* pDest, const VectorValue* pA, const VectorValue* pB, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(pDest + i, Op::AVX(_mm256_loadu_pd(pA + i), _mm256_loadu_pd(pB + i)));
+  for (; i < n; i++)
+    pDest[i] = Op::Scalar(pA[i], pB[i]);
+}
+#endif
+
+#ifdef IPLUG_SIMD_NEON
+template <typename Op>
+void VectorNEON(VectorValue* pDest, const VectorValue* pA, const VectorValue* pB, int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vst1q_f64(pDest + i, Op::NEON(vld1q_f64(pA + i), vld1q_f64(pB + i)));
+  for (; i < n; i++)
+    pDest[i] = Op::Scalar(pA[i], pB[i]);
+}
+#endif
+#endif
+
+/** @return The best kernel of an operation for the running CPU */
+template <typename Op>
+VectorKernel SelectVectorKernel()
+{
+  simd::SIMDVariants<VectorKernel> variants;
+  variants.scalar = VectorScalar<Op>;
+
+#if EEL_F_SIZE == 8
+  if constexpr (Op::kSIMD)
+  {
+  #ifdef IPLUG_SIMD_SSE2
+    variants.sse2 = VectorSSE2<Op>;
+  #endif
+  #ifdef IPLUG_SIMD_AVX
+    variants.avx = VectorAVX<Op>;
+  #endif
+  #ifdef IPLUG_SIMD_NEON
+    variants.neon = VectorNEON<Op>;
+  #endif
+  }
+#endif
+
+  return simd::SelectVariant(variants);
+}
+
+/** The functions a vectorized \@sample section can call, with their number of arguments */
+struct VectorFunction
+{
+  const char* mName;
+  int mNArgs;
+  VectorKernel (*mSelect)();
+};
+
+static const VectorFunction sVectorFunctions[] = {
+  { "sin", 1, SelectVectorKernel<SinOp> },
+  { "cos", 1, SelectVectorKernel<CosOp> },
+  { "tan", 1, SelectVectorKernel<TanOp> },
+  { "asin", 1, SelectVectorKernel<AsinOp> },
+  { "acos", 1, SelectVectorKernel<AcosOp> },
+  { "atan", 1, SelectVectorKernel<AtanOp> },
+  { "atan2", 2, SelectVectorKernel<Atan2Op> },
+  { "sqrt", 1, SelectVectorKernel<SqrtOp> },
+  { "sqr", 1, SelectVectorKernel<SqrOp> },
+  { "pow", 2, SelectVectorKernel<PowOp> },
+  { "exp", 1, SelectVectorKernel<ExpOp> },
+  { "log", 1, SelectVectorKernel<LogOp> },
+  { "log10", 1, SelectVectorKernel<Log10Op> },
+  { "abs", 1, SelectVectorKernel<AbsOp> },
+  { "min", 2, SelectVectorKernel<MinOp> },
+  { "max", 2, SelectVectorKernel<MaxOp> },
+  { "sign", 1, SelectVectorKernel<SignOp> },
+  { "floor", 1, SelectVectorKernel<FloorOp> },
+  { "ceil", 1, SelectVectorKernel<CeilOp> },
+};
+
+} // namespace
+
+/** An \@sample section compiled for blocks of frames. Each operation of the section is applied to kFrames frames at a time, in registers of kFrames values:
+ * the constants, the variables the section reads but doesn't assign (uniforms, broadcast at the start of each block), the channels' input samples,
+ * and the results of the operations */
+struct EEL2DSP::VectorProgram
+{
+  static constexpr int kFrames = 64;
+
+  struct Instruction
+  {
+    VectorKernel mKernel;
+    int mDest;
+    int mA;
+    int mB;
+  };
+
+  /** A register that is set from, or written back to, one of the VM's variables */
+  struct Binding
+  {
+    int mReg;
+    EEL_F* mVar;
+  };
+
+  VectorValue* Reg(int reg) { return mRegisters.data() + static_cast<size_t>(reg) * kFrames; }
+
+  void ProcessBlock(sample** inputs, sample** outputs, int nChans, int nFrames, EEL_F* const* spl);
+
+  std::vector<Instruction> mCode;
+  std::vector<VectorValue> mRegisters;
+  std::vector<Binding> mUniforms;
+  std::vector<Binding> mResults; // the variables the section assigns, which are set to their value for the last frame
+  int mInputs[kMaxChannels]; // the register each channel's input is loaded into, or -1 if the section doesn't read it
+  int mOutputs[kMaxChannels]; // the register each channel's output is stored from, or -1 if the section doesn't assign it
+};
+
+void EEL2DSP::VectorProgram::ProcessBlock(sample** inputs, sample** outputs, int nChans, int nFrames, EEL_F* const* spl)
+{
+  for (const Binding& uniform : mUniforms)
+    std::fill_n(Reg(uniform.mReg), kFrames, *uniform.mVar);
+
+  int n = 0;
+
+  for (int start = 0; start < nFrames; start += n)
+  {
+    n = std::min(kFrames, nFrames - start);
+
+    for (int c = 0; c < nChans; c++)
+    {
+      if (mInputs[c] >= 0)
+        std::copy_n(inputs[c] + start, n, Reg(mInputs[c]));
+    }
+
+    for (const Instruction& instruction : mCode)
+      instruction.mKernel(Reg(instruction.mDest), Reg(instruction.mA), Reg(instruction.mB), n);
+
+    for (int c = 0; c < nChans; c++)
+    {
+      if (mOutputs[c] >= 0)
+      {
+        const VectorValue* pOutput = Reg(mOutputs[c]);
+
+        for (int s = 0; s < n; s++)
+          outputs[c][start + s] = static_cast<sample>(pOutput[s]);
+      }
+      else if (outputs[c] != inputs[c])
+        memcpy(outputs[c] + start, inputs[c] + start, n * sizeof(sample));
+    }
+  }
+
+  // leave the variables as the per frame code would, with their values for the last frame
+  if (nFrames > 0)
+  {
+    for (const Binding& result : mResults)
+      *result.mVar = Reg(result.mReg)[n - 1];
+
+    for (int c = 0; c < nChans; c++)
+      *spl[c] = mOutputs[c] >= 0 ? Reg(mOutputs[c])[n - 1] : inputs[c][nFrames - 1];
+  }
+}
+
+/** Compiles an \@sample section for EEL2DSP::VectorProgram, if it is straight-line arithmetic with no variable carried between frames.
+ * The parser follows EEL2's grammar (eel2.y) for the operators it accepts, including its precedence of / over *, and - over +, so that the results are the same.
+ * The section is first compiled to virtual registers, one for each result, then the operations that don't affect an output are dropped,
+ * and the registers are shared out so that the results are in as few registers as possible */
+class EEL2DSP::VectorCompiler
+{
+public:
+  VectorCompiler(const char* code, int nChans)
+  : mCode(code)
+  , mNumChans(nChans)
+  {
+  }
+
+  /** @return The program, or nullptr if the section can't be vectorized */
+  VectorProgram* Compile(NSEEL_VMCTX vm);
+
+private:
+  enum class ERegType { kConstant, kUniform, kInput, kTemp };
+
+  struct VReg
+  {
+    ERegType mType = ERegType::kTemp;
+    VectorValue mConstant = 0.;
+    std::string mVar; // kUniform
+    int mChannel = -1; // kInput
+  };
+
+  struct VInstruction
+  {
+    VectorKernel mKernel;
+    int mDest;
+    int mA;
+    int mB;
+  };
+
+  static constexpr int kMaxInstructions = 4096;
+
+  // tokens
+  void SkipSpace();
+  bool Accept(const char* op);
+  bool PeekAssignment(std::string& name, std::string& op);
+  bool ReadIdentifier(std::string& name);
+  bool ReadNumber(VectorValue& value);
+
+  // grammar, each returns a virtual register, or -1 if the code can't be vectorized
+  int Sequence();
+  int Add();
+  int Sub();
+  int Mul();
+  int Div();
+  int Pow();
+  int Unary();
+  int Primary();
+
+  int Constant(VectorValue value);
+  int Emit(VectorKernel kernel, int a, int b);
+  int ReadVar(const std::string& name);
+  bool WriteVar(const std::string& name, int reg);
+  int ChannelOf(const std::string& name) const;
+
+  const char* mCode;
+  const char* mPos = nullptr;
+  const int mNumChans;
+  bool mFailed = false;
+
+  std::vector<VReg> mVRegs;
+  std::vector<VInstruction> mInstructions;
+  std::map<VectorValue, int> mConstants;
+  std::map<std::string, int> mVars; // the register holding each variable's current value
+  std::map<std::string, bool> mAssigned; // name, and true if the variable was read before it was assigned, so it would be carried between frames
+};
+
+void EEL2DSP::VectorCompiler::SkipSpace()
+{
+  while (true)
+  {
+    while (isspace(static_cast<unsigned char>(*mPos)))
+      mPos++;
+
+    if (mPos[0] == '/' && mPos[1] == '/')
+    {
+      while (*mPos && *mPos != '\n')
+        mPos++;
+    }
+    else if (mPos[0] == '/' && mPos[1] == '*')
+    {
+      const char* end = strstr(mPos + 2, "*/");
+      mPos = end ? end + 2 : mPos + strlen(mPos);
+    }
+    else
+      return;
+  }
+}
+
+bool EEL2DSP::VectorCompiler::Accept(const char* op)
+{
+  SkipSpace();
+  const size_t len = strlen(op);
+
+  if (strncmp(mPos, op, len))
+    return false;
+
+  // an operator that is the start of a longer one is not accepted, e.g. the / of /=, or the = of ==
+  if (len == 1 && strchr("+-*/^=", op[0]) && mPos[1] == '=')
+    return false;
+
+  mPos += len;
+  return true;
+}
+
+bool EEL2DSP::VectorCompiler::ReadIdentifier(std::string& name)
+{
+  SkipSpace();
+
+  if (!isalpha(static_cast<unsigned char>(*mPos)) && *mPos != '_')
+    return false;
+
+  name.clear();
+
+  while (isalnum(static_cast<unsigned char>(*mPos)) || *mPos == '_' || *mPos == '.')
+    name += static_cast<char>(tolower(static_cast<unsigned char>(*mPos++))); // EEL2's names are case insensitive
+
+  return true;
+}
+
+bool EEL2DSP::VectorCompiler::PeekAssignment(std::string& name, std::string& op)
+{
+  const char* start = mPos;
+
+  if (ReadIdentifier(name))
+  {
+    SkipSpace();
+
+    for (const char* assignOp : { "+=", "-=", "*=", "/=", "^=" })
+    {
+      if (!strncmp(mPos, assignOp, 2))
+      {
+        op = assignOp;
+        mPos += 2;
+        return true;
+      }
+    }
+
+    if (mPos[0] == '=' && mPos[1] != '=')
+    {
+      op = "=";
+      mPos++;
+      return true;
+    }
+  }
+
+  mPos = start;
+  return false;
+}
+
+bool EEL2DSP::VectorCompiler::ReadNumber(VectorValue& value)
+{
+  SkipSpace();
+
+  if (*mPos == '$')
+  {
+    std::string name;
+    const char* start = mPos++;
+
+    if (ReadIdentifier(name) && (name == "pi" || name == "e" || name == "phi"))
+    {
+      value = name == "pi" ? 3.141592653589793 : name == "e" ? 2.718281828459045 : 1.6180339887498948;
+      return true;
+    }
+
+    mPos = start;
+    return false;
+  }
+
+  // decimal numbers only, as EEL2's [0-9]+\.?[0-9]* and \.[0-9]+
+  if (!isdigit(static_cast<unsigned char>(*mPos)) && !(*mPos == '.' && isdigit(static_cast<unsigned char>(mPos[1]))))
+    return false;
+
+  const char* start = mPos;
+
+  while (isdigit(static_cast<unsigned char>(*mPos)))
+    mPos++;
+
+  if (*mPos == '.')
+  {
+    mPos++;
+
+    while (isdigit(static_cast<unsigned char>(*mPos)))
+      mPos++;
+  }
+
+  // 0x1f, or a number run into a name
+  if (isalpha(static_cast<unsigned char>(*mPos)) || *mPos == '_' || *mPos == '.')
+  {
+    mFailed = true;
+    return false;
+  }
+
+  value = static_cast<VectorValue>(atof(std::string(start, mPos).c_str()));
+  return true;
+}
+
+int EEL2DSP::VectorCompiler::Constant(VectorValue value)
+{
+  auto it = mConstants.find(value);
+
+  if (it != mConstants.end())
+    return it->second;
+
+  VReg reg;
+  reg.mType = ERegType::kConstant;
+  reg.mConstant = value;
+  mVRegs.push_back(reg);
+
+  return mConstants[value] = static_cast<int>(mVRegs.size()) - 1;
+}
+
+int EEL2DSP::VectorCompiler::Emit(VectorKernel kernel, int a, int b)
+{
+  if (a < 0 || b < 0 || mInstructions.size() >= kMaxInstructions)
+  {
+    mFailed = true;
+    return -1;
+  }
+
+  mVRegs.push_back(VReg());
+  const int dest = static_cast<int>(mVRegs.size()) - 1;
+  mInstructions.push_back({ kernel, dest, a, b });
+  return dest;
+}
+
+int EEL2DSP::VectorCompiler::ChannelOf(const std::string& name) const
+{
+  if (name.size() < 4 || name.compare(0, 3, "spl") || !isdigit(static_cast<unsigned char>(name[3])) || (name[3] == '0' && name.size() > 4))
+    return -1;
+
+  for (size_t i = 3; i < name.size(); i++)
+  {
+    if (!isdigit(static_cast<unsigned char>(name[i])))
+      return -1;
+  }
+
+  const int channel = atoi(name.c_str() + 3);
+  return channel < mNumChans ? channel : -1;
+}
+
+int EEL2DSP::VectorCompiler::ReadVar(const std::string& name)
+{
+  auto it = mVars.find(name);
+
+  if (it != mVars.end())
+    return it->second;
+
+  VReg reg;
+  reg.mType = ERegType::kUniform;
+  reg.mChannel = ChannelOf(name);
+
+  if (reg.mChannel >= 0)
+    reg.mType = ERegType::kInput;
+  else
+  {
+    reg.mVar = name;
+    mAssigned[name] = true; // read first
+  }
+
+  mVRegs.push_back(reg);
+  return mVars[name] = static_cast<int>(mVRegs.size()) - 1;
+}
+
+bool EEL2DSP::VectorCompiler::WriteVar(const std::string& name, int reg)
+{
+  auto it = mAssigned.find(name);
+
+  // a variable that a frame reads before it assigns is carried from the frame before
+  if (it != mAssigned.end() && it->second && mVRegs[mVars[name]].mType == ERegType::kUniform)
+    return false;
+
+  if (ChannelOf(name) < 0)
+    mAssigned[name] = false;
+
+  mVars[name] = reg;
+  return true;
+}
+
+int EEL2DSP::VectorCompiler::Sequence()
+{
+  int result = -1;
+
+  while (!mFailed)
+  {
+    SkipSpace();
+
+    if (!*mPos || *mPos == ')')
+      break;
+
+    if (Accept(";"))
+      continue;
+
+    result = Add();
+
+    SkipSpace();
+
+    if (*mPos && *mPos != ')' && !Accept(";"))
+      mFailed = true;
+  }
+
+  return mFailed ? -1 : result;
+}
+
+int EEL2DSP::VectorCompiler::Add()
+{
+  int a = Sub();
+
+  while (a >= 0 && Accept("+"))
+    a = Emit(SelectVectorKernel<AddOp>(), a, Sub());
+
+  return a;
+}
+
+int EEL2DSP::VectorCompiler::Sub()
+{
+  int a = Mul();
+
+  while (a >= 0 && Accept("-"))
+    a = Emit(SelectVectorKernel<SubOp>(), a, Mul());
+
+  return a;
+}
+
+int EEL2DSP::VectorCompiler::Mul()
+{
+  int a = Div();
+
+  while (a >= 0 && Accept("*"))
+    a = Emit(SelectVectorKernel<MulOp>(), a, Div());
+
+  return a;
+}
+
+int EEL2DSP::VectorCompiler::Div()
+{
+  int a = Pow();
+
+  while (a >= 0 && Accept("/"))
+    a = Emit(SelectVectorKernel<DivOp>(), a, Pow());
+
+  SkipSpace();
+
+  // %, <<, >> and the comparisons are not vectorized
+  if (*mPos == '%' || *mPos == '<' || *mPos == '>')
+    mFailed = true;
+
+  return mFailed ? -1 : a;
+}
+
+int EEL2DSP::VectorCompiler::Pow()
+{
+  int a = Unary();
+
+  while (a >= 0 && Accept("^"))
+    a = Emit(SelectVectorKernel<PowOp>(), a, Unary());
+
+  return a;
+}
+
+int EEL2DSP::VectorCompiler::Unary()
+{
+  if (Accept("-"))
+  {
+    const int a = Unary();
+    return Emit(SelectVectorKernel<NegOp>(), a, a);
+  }
+
+  if (Accept("+"))
+    return Unary();
+
+  std::string name, op;
+
+  // an assignment's value is the whole expression to its right, as in EEL2
+  if (PeekAssignment(name, op))
+  {
+    int value = Add();
+
+    if (value < 0)
+      return -1;
+
+    if (op != "=")
+    {
+      const int var = ReadVar(name);
+      VectorKernel kernel = op == "+=" ? SelectVectorKernel<AddOp>() : op == "-=" ? SelectVectorKernel<SubOp>() :
+                            op == "*=" ? SelectVectorKernel<MulOp>() : op == "/=" ? SelectVectorKernel<DivOp>() : SelectVectorKernel<PowOp>();
+      value = Emit(kernel, var, value);
+    }
+
+    if (value < 0 || !WriteVar(name, value))
+    {
+      mFailed = true;
+      return -1;
+    }
+
+    return value;
+  }
+
+  return Primary();
+}
+
+int EEL2DSP::VectorCompiler::Primary()
+{
+  VectorValue value;
+
+  if (ReadNumber(value))
+    return Constant(value);
+
+  if (mFailed)
+    return -1;
+
+  if (Accept("("))
+  {
+    const int result = Sequence();
+
+    if (result < 0 || !Accept(")"))
+    {
+      mFailed = true;
+      return -1;
+    }
+
+    return result;
+  }
+
+  std::string name;
+
+  if (!ReadIdentifier(name))
+  {
+    mFailed = true;
+    return -1;
+  }
+
+  if (!Accept("("))
+    return ReadVar(name);
+
+  // functions defined by the script, and the memory, string and other functions that have side effects, are not vectorized
+  for (const VectorFunction& function : sVectorFunctions)
+  {
+    if (name != function.mName)
+      continue;
+
+    int args[2] = { -1, -1 };
+
+    for (int i = 0; i < function.mNArgs; i++)
+    {
+      if (i && !Accept(","))
+        break;
+
+      args[i] = Add();
+    }
+
+    if (args[function.mNArgs - 1] < 0 || !Accept(")"))
+      break;
+
+    return Emit(function.mSelect(), args[0], function.mNArgs > 1 ? args[1] : args[0]);
+  }
+
+  mFailed = true;
+  return -1;
+}
+
+EEL2DSP::VectorProgram* EEL2DSP::VectorCompiler::Compile(NSEEL_VMCTX vm)
+{
+  mPos = mCode;
+  Sequence();
+  SkipSpace();
+
+  if (mFailed || *mPos)
+    return nullptr;
+
+  const int nVRegs = static_cast<int>(mVRegs.size());
+  constexpr int kLive = INT_MAX; // used after the last instruction
+  std::vector<int> lastUse(nVRegs, -1);
+  std::vector<int> channelOutputs(mNumChans, -1);
+  std::vector<std::pair<std::string, int>> results;
+
+  for (int c = 0; c < mNumChans; c++)
+  {
+    auto it = mVars.find("spl" + std::to_string(c));
+
+    if (it != mVars.end() && mVRegs[it->second].mChannel != c)
+    {
+      channelOutputs[c] = it->second;
+      lastUse[it->second] = kLive;
+    }
+  }
+
+  for (const auto& var : mAssigned)
+  {
+    if (!var.second)
+    {
+      results.emplace_back(var.first, mVars[var.first]);
+      lastUse[mVars[var.first]] = kLive;
+    }
+  }
+
+  // drop the operations whose results aren't used, working back from the outputs
+  std::vector<VInstruction> code;
+
+  for (int i = static_cast<int>(mInstructions.size()) - 1; i >= 0; i--)
+  {
+    const VInstruction& instruction = mInstructions[i];
+
+    if (lastUse[instruction.mDest] < 0)
+      continue;
+
+    const int idx = static_cast<int>(code.size());
+
+    for (int src : { instruction.mA, instruction.mB })
+    {
+      if (lastUse[src] < 0)
+        lastUse[src] = idx;
+    }
+
+    code.push_back(instruction);
+  }
+
+  std::reverse(code.begin(), code.end());
+
+  // lastUse was counted from the end, turn it the right way round
+  const int nInstructions = static_cast<int>(code.size());
+
+  for (int& use : lastUse)
+  {
+    if (use >= 0 && use != kLive)
+      use = nInstructions - 1 - use;
+  }
+
+  // constants and uniforms keep their registers for the whole block, the others are reused once their value is no longer needed
+  std::unique_ptr<VectorProgram> pProgram(new VectorProgram);
+  std::vector<int> physical(nVRegs, -1);
+  std::vector<int> freeRegs;
+  int nRegs = 0;
+
+  auto allocate = [&]() {
+    if (freeRegs.empty())
+      return nRegs++;
+
+    const int reg = freeRegs.back();
+    freeRegs.pop_back();
+    return reg;
+  };
+
+  std::vector<std::pair<int, VectorValue>> constants;
+
+  for (int v = 0; v < nVRegs; v++)
+  {
+    const VReg& vreg = mVRegs[v];
+
+    if (lastUse[v] < 0 || vreg.mType == ERegType::kTemp)
+      continue;
+
+    physical[v] = allocate();
+
+    if (vreg.mType == ERegType::kConstant)
+      constants.emplace_back(physical[v], vreg.mConstant);
+    else if (vreg.mType == ERegType::kUniform)
+      pProgram->mUniforms.push_back({ physical[v], NSEEL_VM_regvar(vm, vreg.mVar.c_str()) });
+  }
+
+  for (int c = 0; c < kMaxChannels; c++)
+  {
+    pProgram->mInputs[c] = -1;
+    pProgram->mOutputs[c] = -1;
+  }
+
+  for (int v = 0; v < nVRegs; v++)
+  {
+    if (physical[v] >= 0 && mVRegs[v].mType == ERegType::kInput)
+      pProgram->mInputs[mVRegs[v].mChannel] = physical[v];
+  }
+
+  for (int i = 0; i < nInstructions; i++)
+  {
+    const VInstruction& instruction = code[i];
+
+    for (int src : { instruction.mA, instruction.mB })
+    {
+      const ERegType type = mVRegs[src].mType;
+
+      if (lastUse[src] == i && (type == ERegType::kTemp || type == ERegType::kInput) && physical[src] >= 0)
+      {
+        freeRegs.push_back(physical[src]);
+        lastUse[src] = -1; // freed once, if it is both operands
+      }
+    }
+
+    physical[instruction.mDest] = allocate();
+    pProgram->mCode.push_back({ instruction.mKernel, physical[instruction.mDest], physical[instruction.mA], physical[instruction.mB] });
+  }
+
+  for (int c = 0; c < mNumChans; c++)
+  {
+    if (channelOutputs[c] >= 0)
+      pProgram->mOutputs[c] = physical[channelOutputs[c]];
+  }
+
+  for (const auto& result : results)
+  {
+    EEL_F* pVar = NSEEL_VM_regvar(vm, result.first.c_str());
+
+    if (!pVar)
+      return nullptr;
+
+    pProgram->mResults.push_back({ physical[result.second], pVar });
+  }
+
+  for (const auto& uniform : pProgram->mUniforms)
+  {
+    if (!uniform.mVar)
+      return nullptr;
+  }
+
+  pProgram->mRegisters.assign(static_cast<size_t>(std::max(nRegs, 1)) * VectorProgram::kFrames, 0.);
+
+  for (const auto& constant : constants)
+    std::fill_n(pProgram->Reg(constant.first), VectorProgram::kFrames, constant.second);
+
+  return pProgram.release();
+}
+
+#pragma mark - EEL2DSP
+
+EEL2DSP::Program::~Program()
+{
+  delete mVector;
+
+  // functions defined in @init are shared with the other sections, so it is freed last
+  if (mSample)
+    NSEEL_code_free(mSample);
+  if (mBlock)
+    NSEEL_code_free(mBlock);
+  if (mInit)
+    NSEEL_code_free(mInit);
+  if (mVM)
+    NSEEL_VM_free(mVM);
+}
+
+EEL2DSP::EEL2DSP(int nChans)
+: mNumChans(nChans)
+{
+  assert(nChans > 0 && nChans <= kMaxChannels);
+
+  for (auto& value : mParamValues)
+    value.store(0., std::memory_order_relaxed);
+}
+
+EEL2DSP::~EEL2DSP()
+{
+  if (mThread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+
+    mCondition.notify_one();
+    mThread.join();
+  }
+
+  delete mPending.exchange(nullptr);
+  delete mRetired.exchange(nullptr);
+  delete mCurrent;
+  NSEEL_VM_FreeGRAM(&mGRAM);
+}
+
+int EEL2DSP::AddParam(const char* varName, double initialValue)
+{
+  assert(!mThread.joinable() && "add parameters before the first call to SetScript()");
+  assert(mNumParams < kMaxParams);
+
+  if (mThread.joinable() || mNumParams >= kMaxParams)
+    return -1;
+
+  mParamNames[mNumParams] = varName;
+  mParamValues[mNumParams].store(initialValue, std::memory_order_relaxed);
+
+  return mNumParams++;
+}
+
+void EEL2DSP::SetScript(const char* script)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScript = script;
+    mScriptChanged = true;
+    mCompiling.store(true, std::memory_order_release);
+
+    if (!mThread.joinable())
+      mThread = std::thread(&EEL2DSP::CompilerThread, this);
+  }
+
+  mCondition.notify_one();
+}
+
+void EEL2DSP::SetSampleRate(double sampleRate)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (sampleRate == mSampleRate)
+      return;
+
+    mSampleRate = sampleRate;
+
+    if (!mThread.joinable())
+      return;
+
+    mScriptChanged = true;
+    mCompiling.store(true, std::memory_order_release);
+  }
+
+  mCondition.notify_one();
+}
+
+bool EEL2DSP::GetCompileError(WDL_String& error) const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  error.Set(mError.Get());
+  return mError.GetLength() > 0;
+}
+
+bool EEL2DSP::IsVectorized() const
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mVectorized;
+}
+
+void EEL2DSP::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+{
+  // only start a new program once the compiler thread has freed the last one this replaced, so that nothing is freed here
+  if (!mRetired.load(std::memory_order_acquire))
+  {
+    if (Program* pNew = mPending.exchange(nullptr, std::memory_order_acq_rel))
+    {
+      mRetired.store(mCurrent, std::memory_order_release);
+      mCurrent = pNew;
+    }
+  }
+
+  Program* pProgram = mCurrent;
+
+  if (!pProgram)
+  {
+    for (int c = 0; c < mNumChans; c++)
+    {
+      if (outputs[c] != inputs[c])
+        memcpy(outputs[c], inputs[c], nFrames * sizeof(sample));
+    }
+
+    return;
+  }
+
+  for (int p = 0; p < mNumParams; p++)
+  {
+    if (pProgram->mParams[p])
+      *pProgram->mParams[p] = mParamValues[p].load(std::memory_order_relaxed);
+  }
+
+  *pProgram->mSamplesBlock = nFrames;
+
+  // @block and @sample are compiled to skip EEL2's own switch to flush-to-zero mode, which takes four control register writes for every call,
+  // on x86 that is for every sample. The mode is set once here instead
+  IDenormalScope denormalScope;
+
+  if (pProgram->mBlock)
+    NSEEL_code_execute(pProgram->mBlock);
+
+  if (!pProgram->mSample)
+  {
+    for (int c = 0; c < mNumChans; c++)
+    {
+      if (outputs[c] != inputs[c])
+        memcpy(outputs[c], inputs[c], nFrames * sizeof(sample));
+    }
+
+    return;
+  }
+
+  EEL_F** spl = pProgram->mSpl;
+
+  if (pProgram->mVector)
+  {
+    pProgram->mVector->ProcessBlock(inputs, outputs, mNumChans, nFrames, spl);
+    return;
+  }
+
+  for (int s = 0; s < nFrames; s++)
+  {
+    for (int c = 0; c < mNumChans; c++)
+      *spl[c] = inputs[c][s];
+
+    NSEEL_code_execute(pProgram->mSample);
+
+    for (int c = 0; c < mNumChans; c++)
+      outputs[c][s] = static_cast<sample>(*spl[c]);
+  }
+}
+
+/** @return \c true if there is nothing but whitespace in a section, which EEL2's compiler would return no code for */
+static bool IsBlank(const std::string& code)
+{
+  for (char c : code)
+  {
+    if (!isspace(static_cast<unsigned char>(c)))
+      return false;
+  }
+
+  return true;
+}
+
+EEL2DSP::Program* EEL2DSP::Compile(const std::string& script, double sampleRate, WDL_String& error)
+{
+  enum ESection { kInit, kBlock, kSample, kNumSections };
+  static const char* sectionNames[kNumSections] = { "init", "block", "sample" };
+
+  std::string code[kNumSections];
+  int lineOffsets[kNumSections] = {};
+  int section = kInit;
+  int line = 0;
+
+  // split the script into its sections, a line starting with @ starts a new section, and each section keeps its line numbers for the compiler's messages
+  for (size_t pos = 0; pos < script.size(); line++)
+  {
+    size_t end = script.find('\n', pos);
+
+    if (end == std::string::npos)
+      end = script.size();
+
+    const std::string text = script.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (text.size() && text[0] == '@')
+    {
+      const size_t nameEnd = text.find_first_of(" \t\r", 1);
+      const std::string name = text.substr(1, nameEnd == std::string::npos ? std::string::npos : nameEnd - 1);
+
+      section = -1;
+
+      for (int s = 0; s < kNumSections; s++)
+      {
+        if (name == sectionNames[s])
+          section = s;
+      }
+
+      if (section < 0)
+      {
+        error.SetFormatted(256, "line %d: unknown section @%s", line + 1, name.c_str());
+        return nullptr;
+      }
+
+      code[section].clear();
+      lineOffsets[section] = line + 1;
+      continue;
+    }
+
+    code[section] += text;
+    code[section] += '\n';
+  }
+
+  Program* pProgram = new Program;
+  pProgram->mVM = NSEEL_VM_alloc();
+
+  if (!pProgram->mVM)
+  {
+    error.Set("could not allocate an EEL2 VM");
+    delete pProgram;
+    return nullptr;
+  }
+
+  NSEEL_VM_SetGRAM(pProgram->mVM, &mGRAM);
+
+  for (int c = 0; c < mNumChans; c++)
+  {
+    char name[16];
+    snprintf(name, sizeof(name), "spl%d", c);
+    pProgram->mSpl[c] = NSEEL_VM_regvar(pProgram->mVM, name);
+  }
+
+  pProgram->mSampleRate = NSEEL_VM_regvar(pProgram->mVM, "srate");
+  pProgram->mSamplesBlock = NSEEL_VM_regvar(pProgram->mVM, "samplesblock");
+  pProgram->mNumChans = NSEEL_VM_regvar(pProgram->mVM, "num_ch");
+
+  for (int p = 0; p < mNumParams; p++)
+  {
+    pProgram->mParams[p] = NSEEL_VM_regvar(pProgram->mVM, mParamNames[p].c_str());
+
+    if (pProgram->mParams[p])
+      *pProgram->mParams[p] = mParamValues[p].load(std::memory_order_relaxed);
+  }
+
+  *pProgram->mSampleRate = sampleRate;
+  *pProgram->mNumChans = mNumChans;
+
+  NSEEL_CODEHANDLE* handles[kNumSections] = { &pProgram->mInit, &pProgram->mBlock, &pProgram->mSample };
+
+  for (int s = 0; s < kNumSections; s++)
+  {
+    if (IsBlank(code[s]))
+      continue;
+
+    // functions defined in one section can be called from the sections after it. @init runs on this thread, with EEL2 setting up the floating point mode itself
+    const int flags = NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS | (s == kInit ? 0 : NSEEL_CODE_COMPILE_FLAG_NOFPSTATE);
+    *handles[s] = NSEEL_code_compile_ex(pProgram->mVM, code[s].c_str(), lineOffsets[s], flags);
+
+    if (!*handles[s])
+    {
+      const char* msg = NSEEL_code_getcodeerror(pProgram->mVM);
+      error.SetFormatted(1024, "@%s: %s", sectionNames[s], msg ? msg : "compile error");
+      delete pProgram;
+      return nullptr;
+    }
+  }
+
+  // the per frame code is still compiled first, for its error messages, and it is where the script's variables are registered
+  if (pProgram->mSample)
+    pProgram->mVector = VectorCompiler(code[kSample].c_str(), mNumChans).Compile(pProgram->mVM);
+
+  if (pProgram->mInit)
+    NSEEL_code_execute(pProgram->mInit);
+
+  return pProgram;
+}
+
+void EEL2DSP::FreeRetired()
+{
+  delete mRetired.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+void EEL2DSP::CompilerThread()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  while (!mStop)
+  {
+    if (!mScriptChanged)
+    {
+      const auto wake = [this]() { return mStop || mScriptChanged; };
+
+      // the audio thread can't wake this thread when it retires a program, so poll while one might be retired
+      if (mPending.load(std::memory_order_acquire) || mRetired.load(std::memory_order_acquire))
+        mCondition.wait_for(lock, std::chrono::milliseconds(100), wake);
+      else
+        mCondition.wait(lock, wake);
+
+      FreeRetired();
+      continue;
+    }
+
+    const std::string script = mScript;
+    const double sampleRate = mSampleRate;
+    mScriptChanged = false;
+
+    lock.unlock();
+
+    WDL_String error;
+    Program* pProgram = Compile(script, sampleRate, error);
+
+    FreeRetired();
+
+    // a program that was compiled but never started is replaced, the audio thread has never seen it
+    if (pProgram)
+      delete mPending.exchange(pProgram, std::memory_order_acq_rel);
+
+    lock.lock();
+    mError.Set(error.Get());
+
+    if (pProgram)
+      mVectorized = pProgram->mVector != nullptr;
+
+    if (!mScriptChanged)
+      mCompiling.store(false, std::memory_order_release);
+  }
+}
@@ -0,0 +1,160 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc EEL2DSP
+ */
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+
+#include "eel2/ns-eel.h"
+#include "wdlstring.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Runs DSP written as an EEL2 script, which is compiled to native code by WDL's EEL2 JIT on a background thread, so that a script can be edited and reloaded
+ * while the plug-in is running. A script has up to three sections, in the style of a JSFX:
+ * - \@init runs once, when the script is compiled, with srate set. Code before the first section is part of \@init
+ * - \@block runs at the start of every block, with samplesblock set to the number of frames
+ * - \@sample runs for every frame, with spl0, spl1... holding each channel's input sample, which it replaces with the output
+ *
+ * num_ch is the number of channels, and each parameter added with AddParam() is a variable that is updated at the start of every block.
+ * A newly compiled script replaces the running one at the start of a block, so it never sees a block that is half processed by the old script, and with nothing
+ * on the audio thread that locks, allocates or frees, except EEL2 memory (mem[] and gmem[]) that a script touches for the first time in \@block or \@sample.
+ * Touch it in \@init, e.g. with memset(), to allocate it on the compiler thread.
+ *
+ * A \@sample section that is straight-line arithmetic, with no variable carried from one frame to the next, is also compiled for blocks of frames, and runs with
+ * SSE2, AVX or NEON on several frames at a time, see IsVectorized(). It may use + - * / ^, the assignment operators, parentheses and the math functions, on spl0...,
+ * numbers, and variables it doesn't assign, or assigns before it reads them. Any other \@sample section runs once per frame.
+ *
+ * The script's variables start again from zero each time it is compiled, and a script that doesn't compile leaves the last one that did running.
+ * Link with WDL/eel2's nseel-caltab.c, nseel-cfunc.c, nseel-compiler.c, nseel-eval.c, nseel-lextab.c, nseel-ram.c and nseel-yylex.c, and the asm-nseel-x64-sse
+ * object for x86_64 (or define EEL_TARGET_PORTABLE), and compile IPlugEEL2.cpp */
+class EEL2DSP
+{
+public:
+  static constexpr int kMaxChannels = 64;
+  static constexpr int kMaxParams = 64;
+
+  /** @param nChans The number of channels processed, each of which is a variable spl0, spl1... up to kMaxChannels */
+  EEL2DSP(int nChans = 2);
+  ~EEL2DSP();
+
+  EEL2DSP(const EEL2DSP&) = delete;
+  EEL2DSP& operator=(const EEL2DSP&) = delete;
+
+  /** Add a parameter, which the script sees as a variable. Call this before the first SetScript(), e.g. in the plug-in's constructor
+   * @param varName The name of the variable, which must be a valid EEL2 identifier
+   * @param initialValue The value of the variable until the first SetParamValue()
+   * @return The parameter's index, for SetParamValue() */
+  int AddParam(const char* varName, double initialValue = 0.);
+
+  /** Set a parameter's value, which the script sees from the start of the next block. Can be called from any thread, e.g. from OnParamChange()
+   * @param paramIdx The index returned by AddParam()
+   * @param value The value the variable will have */
+  void SetParamValue(int paramIdx, double value)
+  {
+    assert(paramIdx >= 0 && paramIdx < mNumParams);
+    mParamValues[paramIdx].store(value, std::memory_order_relaxed);
+  }
+
+  /** Compile a script on the background thread. It replaces the running script at the start of the next block after it compiles. If another script is
+   * waiting to be compiled it is replaced by this one, only the latest script is compiled
+   * @param script The script's source */
+  void SetScript(const char* script);
+
+  /** Set the sample rate, which recompiles the script if it has changed, so that \@init runs with the new rate. Call this from OnReset()
+   * @param sampleRate The sample rate */
+  void SetSampleRate(double sampleRate);
+
+  /** @return \c true if a script is waiting to be compiled, or has been compiled but has not started running yet */
+  bool IsCompiling() const { return mCompiling.load(std::memory_order_acquire) || mPending.load(std::memory_order_acquire); }
+
+  /** Get the error from the last script that was compiled
+   * @param error Set to the EEL2 compiler's message, with the section and line, or an empty string if the script compiled
+   * @return \c true if the last script failed to compile */
+  bool GetCompileError(WDL_String& error) const;
+
+  /** @return \c true if the last script that compiled runs its \@sample section on blocks of frames, rather than once per frame */
+  bool IsVectorized() const;
+
+  /** Run the script on a block of audio. Inputs and outputs can be the same buffers. Called on the audio thread, from ProcessBlock()
+   * @param inputs The input channels, nChans of them
+   * @param outputs The output channels, nChans of them
+   * @param nFrames The number of frames */
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames);
+
+private:
+  struct VectorProgram;
+  class VectorCompiler;
+
+  /** A compiled script, with its own VM, so that its variables are separate from those of the script it replaces */
+  struct Program
+  {
+    ~Program();
+
+    NSEEL_VMCTX mVM = nullptr;
+    NSEEL_CODEHANDLE mInit = nullptr;
+    NSEEL_CODEHANDLE mBlock = nullptr;
+    NSEEL_CODEHANDLE mSample = nullptr;
+    EEL_F* mSpl[kMaxChannels] = {};
+    EEL_F* mSampleRate = nullptr;
+    EEL_F* mSamplesBlock = nullptr;
+    EEL_F* mNumChans = nullptr;
+    EEL_F* mParams[kMaxParams] = {};
+    VectorProgram* mVector = nullptr; // \@sample for blocks of frames, or nullptr if it has to run per frame
+  };
+
+  /** Compile a script, and run its \@init section, on the compiler thread
+   * @param error Set to the compiler's message if it fails
+   * @return The program, or nullptr if it failed to compile */
+  Program* Compile(const std::string& script, double sampleRate, WDL_String& error);
+
+  /** Compile the latest script each time there is one, and free programs the audio thread has replaced */
+  void CompilerThread();
+
+  /** Free the program the audio thread has replaced, if there is one, on the compiler thread */
+  void FreeRetired();
+
+  const int mNumChans;
+  int mNumParams = 0;
+  std::string mParamNames[kMaxParams];
+  std::atomic<double> mParamValues[kMaxParams];
+  void* mGRAM = nullptr; // gmem[], shared by the programs of each instance
+
+  Program* mCurrent = nullptr; // only touched by the audio thread, once the compiler thread has been started
+  std::atomic<Program*> mPending {nullptr}; // compiled, waiting for the audio thread to start it
+  std::atomic<Program*> mRetired {nullptr}; // replaced by the audio thread, waiting for the compiler thread to free it
+  std::atomic<bool> mCompiling {false};
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::thread mThread;
+  std::string mScript;
+  bool mScriptChanged = false;
+  bool mStop = false;
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  WDL_String mError;
+  bool mVectorized = false;
+};
+
+END_IPLUG_NAMESPACE
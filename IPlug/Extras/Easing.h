@@ -20,6 +20,7 @@
 #define _USE_MATH_DEFINES
 #endif
 #include <math.h>
+#include <algorithm>
 #include "IPlugPlatform.h"
 
 BEGIN_IPLUG_NAMESPACE
@@ -350,4 +351,44 @@ T EaseBounceInOut(T x)
   }
 }
 
+/** A timing curve tabulated once, so that animating with it is a table lookup and a linear interpolation rather than a call to the easing function.
+ * Worth it for the curves that use std::pow, std::sin etc. (sine, exponential, elastic, back, power), the polynomial ones are cheaper to evaluate directly.
+ * CachedEase() shares one table per curve between all the animations that use it
+ * @tparam N The number of points in the table */
+template<int N = 256>
+class EasingCurveCache
+{
+public:
+  /** @param func The easing function to tabulate, called N times with x from 0 to 1 */
+  template<class F>
+  explicit EasingCurveCache(F func)
+  {
+    for (int i = 0; i < N; i++)
+      mTable[i] = static_cast<float>(func(static_cast<float>(i) / (N - 1)));
+  }
+
+  /** @param x The position along the curve, clamped to the range 0-1 */
+  float operator()(float x) const
+  {
+    const float pos = (x < 0.f ? 0.f : x > 1.f ? 1.f : x) * (N - 1);
+    const int i = std::min(static_cast<int>(pos), N - 2);
+    const float frac = pos - i;
+    return mTable[i] + (mTable[i + 1] - mTable[i]) * frac;
+  }
+
+private:
+  float mTable[N];
+};
+
+/** Evaluate an easing function through a table that is built the first time it is used, and shared by every call with the same function, e.g.
+ * CachedEase<EaseElasticOut<float>>(static_cast<float>(pCaller->GetAnimationProgress()))
+ * @tparam Func The easing function
+ * @param x The position along the curve, clamped to the range 0-1 */
+template<float (*Func)(float), int N = 256>
+float CachedEase(float x)
+{
+  static const EasingCurveCache<N> sCache(Func);
+  return sCache(x);
+}
+
 END_IPLUG_NAMESPACE
@@ -0,0 +1,491 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A feedback delay network reverb with a Hadamard mixing matrix, any number of inputs and up to NLINES decorrelated outputs
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+#include "IPlugUtilities.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A feedback delay network reverb. NLINES delay lines of mutually prime lengths are damped by a one-pole lowpass, mixed by a Hadamard matrix and fed back,
+ * so every line feeds every other one without changing the energy in the loop, and the decay time is set by the gain of each line alone.
+ * Each output channel taps the lines with the signs of a different row of the Hadamard matrix, so the outputs are decorrelated and the reverb can feed
+ * surround and immersive layouts with up to NLINES channels. The output is the reverb only, mix it with the dry signal as needed.
+ *
+ * The network runs in float, four lines to a vector (SSE2, NEON or WASM SIMD128, scalar otherwise). The shortest delay bounds how far back the lines are read,
+ * so a block of up to that many samples is read out of the lines at once, transposed four lines by four samples at a time so that each sample's NLINES values
+ * are contiguous, processed a sample at a time with vector operations, and transposed back in.
+ * @tparam T The sample type of the inputs and outputs
+ * @tparam NLINES The number of delay lines, a power of two from 4 to 64 */
+template<typename T = double, int NLINES = 16>
+class FDNReverb
+{
+  static_assert(NLINES >= 4 && NLINES <= 64 && (NLINES & (NLINES - 1)) == 0, "NLINES must be a power of two from 4 to 64");
+
+public:
+  /** @param nInputChans The number of input channels, at most 64, which are spread over all the lines
+   * @param nOutputChans The number of output channels, at most NLINES */
+  FDNReverb(int nInputChans = 2, int nOutputChans = 2)
+  : mNInChans(Clip(nInputChans, 1, kMaxInputs))
+  , mNOutChans(Clip(nOutputChans, 1, NLINES))
+  {
+    assert(nInputChans <= kMaxInputs && nOutputChans <= NLINES);
+    SetSampleRate(44100.);
+  }
+
+  /** Reallocate and clear the delay lines for a sample rate, do this outside of the audio callback */
+  void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+
+    // the lines are sized for the largest room, so that SetSize() doesn't allocate
+    const int maxDelay = static_cast<int>(std::ceil(kMaxDelayMs * 0.001 * kMaxSizeScale * mSampleRate)) + 1;
+
+    mLineSize = 1;
+
+    while (mLineSize < maxDelay)
+      mLineSize <<= 1;
+
+    mLines.Resize(NLINES * LineStride());
+    Reset();
+    UpdateCoefficients();
+  }
+
+  /** @param size The room size, 0 to 1, which scales the delay lengths from 0.25x to 2x */
+  void SetSize(double size)
+  {
+    mSize = Clip(size, 0., 1.);
+    UpdateCoefficients();
+  }
+
+  /** @param seconds The time for the reverb to decay by 60dB at low frequencies */
+  void SetDecayTime(double seconds)
+  {
+    mDecayTime = std::max(seconds, 0.01);
+    UpdateCoefficients();
+  }
+
+  /** @param freqCPS The cutoff of the lowpass in the feedback loop, lower values make high frequencies decay sooner */
+  void SetDampingFreq(double freqCPS)
+  {
+    mDampingFreq = std::max(freqCPS, 10.);
+    UpdateCoefficients();
+  }
+
+  /** Clear the delay lines and the damping filters */
+  void Reset()
+  {
+    memset(mLines.Get(), 0, mLines.GetSize() * sizeof(float));
+    memset(mLowpass, 0, sizeof(mLowpass));
+    mWritePos = 0;
+  }
+
+  int NInChans() const { return mNInChans; }
+
+  int NOutChans() const { return mNOutChans; }
+
+  /** @return The delay of line idx in samples, for the current size and sample rate */
+  int GetDelay(int idx) const { return mDelays[idx]; }
+
+  /** Process a block. The outputs can be the same buffers as the inputs
+   * @param inputs NInChans() input channels
+   * @param outputs NOutChans() output channels, which receive the reverb only
+   * @param nFrames The number of samples in each channel */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames)
+  {
+    const int mask = mLineSize - 1;
+
+    for (int s0 = 0; s0 < nFrames;)
+    {
+      const int n = std::min({nFrames - s0, mMinDelay, kBlockSize});
+
+      // transpose the delayed samples the block reads, four lines and four samples at a time
+      for (int i = 0; i < NLINES; i += 4)
+      {
+        const float* pLines[4];
+
+        for (int j = 0; j < 4; j++)
+          pLines[j] = GetLine(i + j) + ((mWritePos - mDelays[i + j]) & mask);
+
+        int s = 0;
+
+        for (; s + 4 <= n; s += 4)
+        {
+          V a = Load(pLines[0] + s), b = Load(pLines[1] + s), c = Load(pLines[2] + s), d = Load(pLines[3] + s);
+          Transpose4(a, b, c, d);
+          Store(&mBlock[s][i], a);
+          Store(&mBlock[s + 1][i], b);
+          Store(&mBlock[s + 2][i], c);
+          Store(&mBlock[s + 3][i], d);
+        }
+
+        for (; s < n; s++)
+        {
+          for (int j = 0; j < 4; j++)
+            mBlock[s][i + j] = pLines[j][s];
+        }
+      }
+
+      // the inputs are copied first, as they may be overwritten by the outputs
+      for (int c = 0; c < mNInChans; c++)
+      {
+        for (int s = 0; s < n; s++)
+          mInputs[c][s] = static_cast<float>(inputs[c][s0 + s]);
+      }
+
+      ProcessTransposed(n);
+
+      for (int i = 0; i < NLINES; i += 4)
+      {
+        float* pLines[4];
+
+        for (int j = 0; j < 4; j++)
+          pLines[j] = GetLine(i + j) + mWritePos;
+
+        int s = 0;
+
+        for (; s + 4 <= n; s += 4)
+        {
+          V a = Load(&mBlock[s][i]), b = Load(&mBlock[s + 1][i]), c = Load(&mBlock[s + 2][i]), d = Load(&mBlock[s + 3][i]);
+          Transpose4(a, b, c, d);
+          Store(pLines[0] + s, a);
+          Store(pLines[1] + s, b);
+          Store(pLines[2] + s, c);
+          Store(pLines[3] + s, d);
+        }
+
+        for (; s < n; s++)
+        {
+          for (int j = 0; j < 4; j++)
+            pLines[j][s] = mBlock[s][i + j];
+        }
+      }
+
+      // the block was written contiguously from mWritePos, into the guard if it went past the end of the rings. Keep the guard a copy of the start
+      const int nWrapped = mWritePos + n - mLineSize;
+      const int nGuarded = std::min(n, kBlockSize - mWritePos);
+
+      for (int i = 0; i < NLINES; i++)
+      {
+        float* pLine = GetLine(i);
+
+        if (nWrapped > 0)
+          memcpy(pLine, pLine + mLineSize, nWrapped * sizeof(float));
+
+        if (nGuarded > 0)
+          memcpy(pLine + mLineSize + mWritePos, pLine + mWritePos, nGuarded * sizeof(float));
+      }
+
+      for (int c = 0; c < mNOutChans; c++)
+      {
+        for (int s = 0; s < n; s++)
+          outputs[c][s0 + s] = static_cast<T>(mOutputs[c][s]);
+      }
+
+      mWritePos = (mWritePos + n) & mask;
+      s0 += n;
+    }
+
+    // the loop decays exponentially towards denormals, which are slow on some CPUs
+    for (int i = 0; i < NLINES; i++)
+    {
+      if (std::fabs(mLowpass[i]) < 1e-20f)
+        mLowpass[i] = 0.f;
+    }
+  }
+
+private:
+#pragma mark - Vectors of four lines
+
+#if defined IPLUG_SIMD_SSE2
+  using V = __m128;
+  static inline V Load(const float* p) { return _mm_loadu_ps(p); }
+  static inline void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+  static inline V Splat(float f) { return _mm_set1_ps(f); }
+  static inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+  static inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static inline float Sum(V v)
+  {
+    const V h = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 1, 1, 1))));
+  }
+  /** The two butterfly stages of a Hadamard transform within a vector */
+  static inline void Transpose4(V& a, V& b, V& c, V& d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+  static inline V Hadamard4(V v)
+  {
+    v = _mm_add_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)), _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)), _mm_setr_ps(1.f, -1.f, 1.f, -1.f)));
+    return _mm_add_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 1, 0)), _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 2, 3, 2)), _mm_setr_ps(1.f, 1.f, -1.f, -1.f)));
+  }
+#elif defined IPLUG_SIMD_NEON
+  using V = float32x4_t;
+  static inline V Load(const float* p) { return vld1q_f32(p); }
+  static inline void Store(float* p, V v) { vst1q_f32(p, v); }
+  static inline V Splat(float f) { return vdupq_n_f32(f); }
+  static inline V Add(V a, V b) { return vaddq_f32(a, b); }
+  static inline V Sub(V a, V b) { return vsubq_f32(a, b); }
+  static inline V Mul(V a, V b) { return vmulq_f32(a, b); }
+  static inline float Sum(V v) { return vaddvq_f32(v); }
+  static inline void Transpose4(V& a, V& b, V& c, V& d)
+  {
+    const float64x2_t t0 = vreinterpretq_f64_f32(vtrn1q_f32(a, b)), t1 = vreinterpretq_f64_f32(vtrn2q_f32(a, b));
+    const float64x2_t t2 = vreinterpretq_f64_f32(vtrn1q_f32(c, d)), t3 = vreinterpretq_f64_f32(vtrn2q_f32(c, d));
+    a = vreinterpretq_f32_f64(vtrn1q_f64(t0, t2));
+    b = vreinterpretq_f32_f64(vtrn1q_f64(t1, t3));
+    c = vreinterpretq_f32_f64(vtrn2q_f64(t0, t2));
+    d = vreinterpretq_f32_f64(vtrn2q_f64(t1, t3));
+  }
+  static inline V Hadamard4(V v)
+  {
+    static const float kSigns1[4] = {1.f, -1.f, 1.f, -1.f};
+    static const float kSigns2[4] = {1.f, 1.f, -1.f, -1.f};
+    v = vaddq_f32(vtrn1q_f32(v, v), vmulq_f32(vtrn2q_f32(v, v), vld1q_f32(kSigns1)));
+    return vaddq_f32(vcombine_f32(vget_low_f32(v), vget_low_f32(v)), vmulq_f32(vcombine_f32(vget_high_f32(v), vget_high_f32(v)), vld1q_f32(kSigns2)));
+  }
+#elif defined IPLUG_SIMD_WASM
+  using V = v128_t;
+  static inline V Load(const float* p) { return wasm_v128_load(p); }
+  static inline void Store(float* p, V v) { wasm_v128_store(p, v); }
+  static inline V Splat(float f) { return wasm_f32x4_splat(f); }
+  static inline V Add(V a, V b) { return wasm_f32x4_add(a, b); }
+  static inline V Sub(V a, V b) { return wasm_f32x4_sub(a, b); }
+  static inline V Mul(V a, V b) { return wasm_f32x4_mul(a, b); }
+  static inline float Sum(V v)
+  {
+    return (wasm_f32x4_extract_lane(v, 0) + wasm_f32x4_extract_lane(v, 1)) + (wasm_f32x4_extract_lane(v, 2) + wasm_f32x4_extract_lane(v, 3));
+  }
+  static inline void Transpose4(V& a, V& b, V& c, V& d)
+  {
+    const V t0 = wasm_i32x4_shuffle(a, b, 0, 4, 1, 5), t1 = wasm_i32x4_shuffle(a, b, 2, 6, 3, 7);
+    const V t2 = wasm_i32x4_shuffle(c, d, 0, 4, 1, 5), t3 = wasm_i32x4_shuffle(c, d, 2, 6, 3, 7);
+    a = wasm_i32x4_shuffle(t0, t2, 0, 1, 4, 5);
+    b = wasm_i32x4_shuffle(t0, t2, 2, 3, 6, 7);
+    c = wasm_i32x4_shuffle(t1, t3, 0, 1, 4, 5);
+    d = wasm_i32x4_shuffle(t1, t3, 2, 3, 6, 7);
+  }
+  static inline V Hadamard4(V v)
+  {
+    v = wasm_f32x4_add(wasm_i32x4_shuffle(v, v, 0, 0, 2, 2), wasm_f32x4_mul(wasm_i32x4_shuffle(v, v, 1, 1, 3, 3), wasm_f32x4_make(1.f, -1.f, 1.f, -1.f)));
+    return wasm_f32x4_add(wasm_i32x4_shuffle(v, v, 0, 1, 0, 1), wasm_f32x4_mul(wasm_i32x4_shuffle(v, v, 2, 3, 2, 3), wasm_f32x4_make(1.f, 1.f, -1.f, -1.f)));
+  }
+#else
+  struct V { float v[4]; };
+  static inline V Load(const float* p) { V r; memcpy(r.v, p, sizeof(r.v)); return r; }
+  static inline void Store(float* p, V v) { memcpy(p, v.v, sizeof(v.v)); }
+  static inline V Splat(float f) { return {{f, f, f, f}}; }
+  static inline V Add(V a, V b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+  static inline V Sub(V a, V b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+  static inline V Mul(V a, V b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+  static inline float Sum(V v) { return (v.v[0] + v.v[1]) + (v.v[2] + v.v[3]); }
+  static inline void Transpose4(V& a, V& b, V& c, V& d)
+  {
+    V* rows[4] = {&a, &b, &c, &d};
+
+    for (int r = 0; r < 4; r++)
+    {
+      for (int col = r + 1; col < 4; col++)
+        std::swap(rows[r]->v[col], rows[col]->v[r]);
+    }
+  }
+  static inline V Hadamard4(V v)
+  {
+    const float a = v.v[0] + v.v[1], b = v.v[0] - v.v[1], c = v.v[2] + v.v[3], d = v.v[2] - v.v[3];
+    return {{a + c, b + d, a - c, b - d}};
+  }
+#endif
+
+  static constexpr int kNVecs = NLINES / 4;
+
+  /** Run the network over n samples of mBlock, in place, reading mInputs and writing mOutputs */
+  void ProcessTransposed(int n)
+  {
+    V lowpass[kNVecs], gain[kNVecs];
+    const V damp = Splat(mDampCoeff), undamp = Splat(1.f - mDampCoeff);
+
+    for (int v = 0; v < kNVecs; v++)
+    {
+      lowpass[v] = Load(mLowpass + v * 4);
+      gain[v] = Load(mGains + v * 4);
+    }
+
+    for (int s = 0; s < n; s++)
+    {
+      V x[kNVecs];
+
+      for (int v = 0; v < kNVecs; v++)
+      {
+        lowpass[v] = Add(Mul(Load(&mBlock[s][v * 4]), undamp), Mul(lowpass[v], damp));
+        x[v] = Mul(lowpass[v], gain[v]);
+      }
+
+      for (int c = 0; c < mNOutChans; c++)
+      {
+        V sum = Mul(x[0], Load(&mOutGains[c][0]));
+
+        for (int v = 1; v < kNVecs; v++)
+          sum = Add(sum, Mul(x[v], Load(&mOutGains[c][v * 4])));
+
+        mOutputs[c][s] = Sum(sum);
+      }
+
+      // the butterflies between vectors, then the two within each vector
+      for (int h = kNVecs / 2; h >= 1; h /= 2)
+      {
+        for (int v = 0; v < kNVecs; v += h * 2)
+        {
+          for (int j = v; j < v + h; j++)
+          {
+            const V a = x[j], b = x[j + h];
+            x[j] = Add(a, b);
+            x[j + h] = Sub(a, b);
+          }
+        }
+      }
+
+      for (int v = 0; v < kNVecs; v++)
+        x[v] = Hadamard4(x[v]);
+
+      for (int c = 0; c < mNInChans; c++)
+      {
+        const V in = Splat(mInputs[c][s]);
+
+        for (int v = 0; v < kNVecs; v++)
+          x[v] = Add(x[v], Mul(in, Load(&mInGains[c][v * 4])));
+      }
+
+      for (int v = 0; v < kNVecs; v++)
+        Store(&mBlock[s][v * 4], x[v]);
+    }
+
+    for (int v = 0; v < kNVecs; v++)
+      Store(mLowpass + v * 4, lowpass[v]);
+  }
+
+  /** The sign of element (row, col) of the NLINES x NLINES Sylvester Hadamard matrix */
+  static float HadamardSign(int row, int col)
+  {
+    int bits = row & col;
+    int parity = 0;
+
+    while (bits)
+    {
+      parity ^= 1;
+      bits &= bits - 1;
+    }
+
+    return parity ? -1.f : 1.f;
+  }
+
+  static bool IsPrime(int n)
+  {
+    if (n < 2)
+      return false;
+
+    for (int d = 2; d * d <= n; d++)
+    {
+      if (n % d == 0)
+        return false;
+    }
+
+    return true;
+  }
+
+  void UpdateCoefficients()
+  {
+    // delays spread exponentially between kMinDelayMs and kMaxDelayMs, each moved up to a prime that isn't used yet, so that the echoes don't coincide
+    const double sizeScale = 0.25 + mSize * (kMaxSizeScale - 0.25);
+    const int maxDelay = mLineSize - 1;
+
+    for (int i = 0; i < NLINES; i++)
+    {
+      const double ms = kMinDelayMs * std::pow(kMaxDelayMs / kMinDelayMs, static_cast<double>(i) / (NLINES - 1));
+      int delay = std::max(static_cast<int>(ms * 0.001 * sizeScale * mSampleRate), 2);
+
+      while (delay < maxDelay && (!IsPrime(delay) || std::find(mDelays, mDelays + i, delay) != mDelays + i))
+        delay++;
+
+      mDelays[i] = std::min(delay, maxDelay);
+    }
+
+    mMinDelay = *std::min_element(mDelays, mDelays + NLINES);
+
+    // the Hadamard matrix is scaled by 1/sqrt(NLINES) to be orthogonal, which is folded into the gains of the lines
+    const double norm = 1. / std::sqrt(static_cast<double>(NLINES));
+
+    for (int i = 0; i < NLINES; i++)
+      mGains[i] = static_cast<float>(std::pow(10., -3. * mDelays[i] / (mDecayTime * mSampleRate)) * norm);
+
+    mDampCoeff = static_cast<float>(std::exp(-2. * PI * std::min(mDampingFreq, 0.49 * mSampleRate) / mSampleRate));
+
+    // the outputs use rows 1, 2, 3... mixing the lines with a different pattern of signs each, the inputs use rows from the other end
+    for (int c = 0; c < mNOutChans; c++)
+    {
+      for (int i = 0; i < NLINES; i++)
+        mOutGains[c][i] = HadamardSign((c + 1) % NLINES, i);
+    }
+
+    const float inNorm = static_cast<float>(1. / std::sqrt(static_cast<double>(mNInChans)));
+
+    for (int c = 0; c < mNInChans; c++)
+    {
+      for (int i = 0; i < NLINES; i++)
+        mInGains[c][i] = HadamardSign(NLINES - 1 - (c % NLINES), i) * inNorm;
+    }
+  }
+
+  // each ring is followed by a copy of its first kBlockSize samples, so that a block is always contiguous. The rings are a power of two long, so they are
+  // spaced a cache line further apart each as well, or the writes at the same position in every ring would all map to the same cache set
+  int LineStride() const { return mLineSize + kBlockSize + 16; }
+
+  float* GetLine(int idx) { return mLines.Get() + idx * LineStride(); }
+
+  static constexpr int kBlockSize = 64;
+  static constexpr int kMaxInputs = 64;
+  static constexpr double kMinDelayMs = 20.;
+  static constexpr double kMaxDelayMs = 90.;
+  static constexpr double kMaxSizeScale = 2.;
+
+  int mNInChans, mNOutChans;
+  double mSampleRate = 44100.;
+  double mSize = 0.5;
+  double mDecayTime = 2.;
+  double mDampingFreq = 8000.;
+
+  WDL_TypedBuf<float> mLines; // NLINES power of two rings of mLineSize samples and their guards, LineStride() apart
+  int mLineSize = 1;
+  int mWritePos = 0;
+  int mDelays[NLINES] = {};
+  int mMinDelay = 1;
+
+  alignas(16) float mLowpass[NLINES] = {};
+  alignas(16) float mGains[NLINES] = {};
+  float mDampCoeff = 0.f;
+  alignas(16) float mOutGains[NLINES][NLINES] = {};
+  alignas(16) float mInGains[kMaxInputs][NLINES] = {};
+
+  alignas(16) float mBlock[kBlockSize][NLINES];
+  float mInputs[kMaxInputs][kBlockSize];
+  float mOutputs[NLINES][kBlockSize];
+};
+
+END_IPLUG_NAMESPACE
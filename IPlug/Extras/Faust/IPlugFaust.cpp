@@ -47,10 +47,10 @@ void IPlugFaust::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
       mOverSampler->ProcessBlock(inputs, outputs, nFrames, 2, 2 /* TODO: flexible channel count */,
         [&](sample** inputs, sample** outputs, int nFrames) //TODO:: badness capture = allocated
         {
-          mDSP->compute(nFrames, inputs, outputs);
+          Compute(inputs, outputs, nFrames);
         });
     else
-      mDSP->compute(nFrames, inputs, outputs);
+      Compute(inputs, outputs, nFrames);
   }
   //    else silence?
 }
@@ -74,6 +74,16 @@ public:
   static bool CompileCPP() { return true; }
 
   static void SetAutoRecompile(bool enable) {}
+
+  /** In FaustGen this enables Faust's vector mode (-vec -lv 1), which compiles loops over blocks of samples that the C++ compiler can auto-vectorize.
+   * There is a NO-OP implementation here, the compiled C++ code uses the mode it was generated with by CompileCPP()
+   * @param enable \c true to compile in vector mode */
+  virtual void SetVectorMode(bool enable) {}
+
+  /** In FaustGen this sets the vector size (-vs) to the largest power of two that fits in the host's block size, call it from OnReset() before SetSampleRate().
+   * There is a NO-OP implementation here so that when not using the JIT compiler, the same class can be used interchangeably
+   * @param blockSize The maximum number of frames the host will process in one block */
+  virtual void SetBlockSize(int blockSize) {}
   
   void FreeDSP()
   {
@@ -170,6 +180,12 @@ public:
   void addSoundfile(const char *label, const char *filename, Soundfile **sf_zone) override {}
 
 protected:
+  /** Called by ProcessBlock() to run the DSP, at the oversampled rate when oversampling. FaustGen overrides it to crossfade to a recompiled DSP */
+  virtual void Compute(sample** inputs, sample** outputs, int nFrames)
+  {
+    mDSP->compute(nFrames, inputs, outputs);
+  }
+
   void AddOrUpdateParam(IParam::EParamType type, const char* label, FAUSTFLOAT* zone, FAUSTFLOAT init = 0., FAUSTFLOAT min = 0., FAUSTFLOAT max = 0., FAUSTFLOAT step = 1.);
   
   void BuildParameterMap();
@@ -17,12 +17,16 @@
 #define LLVM_DSP
 
 #include "fileread.h"
+#include "filewrite.h"
+
+#include <algorithm>
 
 using namespace iplug;
 
 int FaustGen::sFaustGenCounter = 0;
 int FaustGen::Factory::sFactoryCounter = 0;
 bool FaustGen::sAutoRecompile = false;
+int FaustGen::sMsSinceFileCheck = 0;
 std::map<std::string, FaustGen::Factory *> FaustGen::Factory::sFactoryMap;
 Timer* FaustGen::sTimer = nullptr;
 
@@ -41,9 +45,15 @@ FaustGen::Factory::Factory(const char* name, const char* libraryPath, const char
 
 FaustGen::Factory::~Factory()
 {
+  if (mCompileThread.joinable())
+    mCompileThread.join();
+
+  if (mCompiledFactory)
+    deleteDSPFactory(mCompiledFactory);
+
   FreeDSPFactory();
   mSourceCodeStr.Set("");
-  mBitCodeStr.Set("");
+  mBitCodeStr.clear();
 }
 
 void FaustGen::Factory::FreeDSPFactory()
@@ -60,6 +70,12 @@ void FaustGen::Factory::FreeDSPFactory()
     deleteDSPFactory(mLLVMFactory); // this is commented in faustgen~
     mLLVMFactory = nullptr;
   }
+
+  if(mRetiredFactory)
+  {
+    deleteDSPFactory(mRetiredFactory);
+    mRetiredFactory = nullptr;
+  }
 }
 
 llvm_dsp_factory* FaustGen::Factory::CreateFactoryFromBitCode()
@@ -68,9 +84,11 @@ llvm_dsp_factory* FaustGen::Factory::CreateFactoryFromBitCode()
   std::string err;
   
   // Alternate model using machine code
-  llvm_dsp_factory* pFactory = readDSPFactoryFromMachine(mBitCodeStr.Get(), GetLLVMArchStr(), err);
+  llvm_dsp_factory* pFactory = readDSPFactoryFromMachine(mBitCodeStr, GetLLVMArchStr(), err);
   
-  // TODO: Print error
+  if (!pFactory)
+    DBGMSG("FaustGen-%s: Invalid machine code : %s\n", mName.Get(), err.c_str());
+
   return pFactory;
   
   /*
@@ -87,28 +105,8 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
   SetDefaultCompileOptions();
   PrintCompileOptions();
 
-  // Prepare compile options
   std::string error;
-  const char* argv[64];
-
-  const int N = (int) mCompileOptions.size();
-
-  assert(N < 64);
-
-  for (auto i = 0; i< N; i++)
-  {
-    argv[i] = mCompileOptions[i].c_str();
-  }
-
-  // Generate SVG file // this shouldn't get called if we not making SVGs
-//  if (!generateAuxFilesFromString(name.Get(), mSourceCodeStr.Get(), N, argv, error))
-//  {
-//    DBGMSG("FaustGen-%s: Generate SVG error : %s\n", error.c_str());
-//  }
-
-  argv[N] = 0; // NULL terminated argv
-
-  llvm_dsp_factory* pFactory = createDSPFactoryFromString(name.Get(), mSourceCodeStr.Get(), N, argv, GetLLVMArchStr(), error, mOptimizationLevel);
+  llvm_dsp_factory* pFactory = CompileSourceCode(name.Get(), mSourceCodeStr.Get(), mCompileOptions, mOptimizationLevel, error);
 
   if(error.length())
     DBGMSG("%s\n", error.c_str());
@@ -122,6 +120,12 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
     {
       inst->SetErrored(false);
     }
+
+    WDL_String cachePath;
+    uint64_t cacheKey;
+
+    if (GetCachePath(cachePath, cacheKey))
+      WriteCache(pFactory, cachePath.Get(), cacheKey);
     
     return pFactory;
   }
@@ -143,6 +147,216 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
   }
 }
 
+//static
+llvm_dsp_factory* FaustGen::Factory::CompileSourceCode(const std::string& name, const std::string& sourceCode, const std::vector<std::string>& options, int optimizationLevel, std::string& error)
+{
+  // Prepare compile options
+  const char* argv[64];
+
+  const int N = (int) options.size();
+
+  assert(N < 64);
+
+  for (auto i = 0; i< N; i++)
+  {
+    argv[i] = options[i].c_str();
+  }
+
+  // Generate SVG file // this shouldn't get called if we not making SVGs
+//  if (!generateAuxFilesFromString(name, sourceCode, N, argv, error))
+//  {
+//    DBGMSG("FaustGen-%s: Generate SVG error : %s\n", error.c_str());
+//  }
+
+  argv[N] = 0; // NULL terminated argv
+
+  return createDSPFactoryFromString(name, sourceCode, N, argv, GetLLVMArchStr(), error, optimizationLevel);
+}
+
+void FaustGen::Factory::CompileAsync()
+{
+  if (IsCompiling())
+  {
+    mRecompilePending = true;
+    return;
+  }
+
+  WDL_String name;
+  name.SetFormatted(64, "FaustGen-%d", mInstanceIdx);
+
+  SetDefaultCompileOptions();
+  PrintCompileOptions();
+
+  WDL_String cachePath;
+  uint64_t cacheKey = 0;
+
+  if (!GetCachePath(cachePath, cacheKey))
+    cachePath.Set("");
+
+  mCompileDone = false;
+  mCompiledFactory = nullptr;
+  mCompileError.clear();
+
+  // the thread works on copies, so the source can be edited again while it compiles
+  mCompileThread = std::thread([this, name = std::string(name.Get()), sourceCode = std::string(mSourceCodeStr.Get()), options = mCompileOptions,
+                                optimizationLevel = mOptimizationLevel, cachePath = std::string(cachePath.Get()), cacheKey]() {
+    mCompiledFactory = CompileSourceCode(name, sourceCode, options, optimizationLevel, mCompileError);
+
+    if (mCompiledFactory && cachePath.length())
+      WriteCache(mCompiledFactory, cachePath.c_str(), cacheKey);
+
+    mCompileDone = true;
+  });
+}
+
+bool FaustGen::Factory::PollCompile()
+{
+  bool fading = false;
+
+  for (auto inst : mInstances)
+  {
+    if (inst->ReleaseFadedDSP())
+      fading = true;
+  }
+
+  if (!fading && mRetiredFactory)
+  {
+    deleteDSPFactory(mRetiredFactory);
+    mRetiredFactory = nullptr;
+  }
+
+  // a swap waits for the previous one to finish fading
+  if (!IsCompiling() || !mCompileDone || fading)
+    return false;
+
+  mCompileThread.join();
+
+  llvm_dsp_factory* pFactory = mCompiledFactory;
+  mCompiledFactory = nullptr;
+
+  if (mRecompilePending)
+  {
+    // the source changed while it was compiling, so the result is stale
+    mRecompilePending = false;
+
+    if (pFactory)
+      deleteDSPFactory(pFactory);
+
+    CompileAsync();
+    return false;
+  }
+
+  if (!pFactory)
+  {
+    DBGMSG("FaustGen-%s: Invalid Faust code or compile options, keeping the previous DSP : %s\n", mName.Get(), mCompileError.c_str());
+    return false;
+  }
+
+  DBGMSG("FaustGen-%s: Background compilation succeeded\n", mName.Get());
+
+  {
+    WDL_MutexLock lock(&mDSPMutex);
+    mRetiredFactory = mLLVMFactory;
+    mLLVMFactory = pFactory;
+    mBitCodeStr.clear();
+  }
+
+  for (auto inst : mInstances)
+  {
+    inst->SwapDSP();
+  }
+
+  return true;
+}
+
+bool FaustGen::Factory::GetCachePath(WDL_String& path, uint64_t& key)
+{
+  // the SVG is generated by the compiler, so it mustn't be bypassed
+  if (mDrawPath.GetLength())
+    return false;
+
+#ifdef FAUSTGEN_CACHE_PATH
+  path.Set(FAUSTGEN_CACHE_PATH);
+#else
+  if (!mInputDSPFile.GetLength())
+    return false;
+
+  path.Set(mInputDSPFile.Get());
+  path.remove_filepart(true);
+#endif
+
+  path.AppendFormatted(MAX_WIN32_PATH_LEN, "%s.fgcache", mName.Get());
+
+  SetDefaultCompileOptions();
+
+  // FNV-1a over everything that changes the machine code. Imported libraries are not included, so delete the cache after editing them
+  key = 14695981039346656037ull;
+
+  auto hashStr = [&key](const char* str) {
+    do
+    {
+      key = (key ^ static_cast<uint8_t>(*str)) * 1099511628211ull;
+    } while (*str++);
+  };
+
+  hashStr(mSourceCodeStr.Get());
+
+  for (auto& c : mCompileOptions)
+  {
+    hashStr(c.c_str());
+  }
+
+  hashStr(GetLLVMArchStr().c_str());
+  hashStr(getCLibFaustVersion());
+  hashStr(FAUSTGEN_VERSION);
+  key = (key ^ static_cast<uint32_t>(mOptimizationLevel)) * 1099511628211ull;
+
+  return true;
+}
+
+bool FaustGen::Factory::ReadCache()
+{
+  WDL_String path;
+  uint64_t key;
+
+  if (!GetCachePath(path, key))
+    return false;
+
+  WDL_FileRead file(path.Get());
+
+  if (!file.IsOpen() || file.GetSize() <= static_cast<WDL_FILEREAD_POSTYPE>(sizeof(key)))
+    return false;
+
+  // the file starts with the key it was compiled for, anything else is stale
+  uint64_t fileKey = 0;
+  file.Read(&fileKey, sizeof(fileKey));
+
+  if (fileKey != key)
+    return false;
+
+  mBitCodeStr.resize(static_cast<size_t>(file.GetSize()) - sizeof(key));
+  file.Read(&mBitCodeStr[0], static_cast<int>(mBitCodeStr.size()));
+
+  return true;
+}
+
+//static
+void FaustGen::Factory::WriteCache(llvm_dsp_factory* pFactory, const char* path, uint64_t key)
+{
+  const std::string machineCode = writeDSPFactoryToMachine(pFactory, GetLLVMArchStr());
+
+  if (machineCode.empty())
+    return;
+
+  WDL_FileWrite file(path);
+
+  if (file.IsOpen())
+  {
+    file.Write(&key, sizeof(key));
+    file.Write(machineCode.data(), static_cast<int>(machineCode.size()));
+  }
+}
+
 ::dsp *FaustGen::Factory::CreateDSPInstance(const MidiHandlerPtr& handler, int nVoices)
 {
   ::dsp* pMonoDSP = mLLVMFactory->createDSPInstance();
@@ -177,8 +391,14 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
     goto end;
   }
 
+  // Tries the machine code cached by a previous compile of the same source
+  if (!mBitCodeStr.length() && ReadCache())
+  {
+    DBGMSG("FaustGen-%s: Found cached machine code\n", mName.Get());
+  }
+
   // Tries to create from bitcode
-  if (mBitCodeStr.GetLength())
+  if (mBitCodeStr.length())
   {
     mLLVMFactory = CreateFactoryFromBitCode();
     if (mLLVMFactory)
@@ -276,29 +496,64 @@ void FaustGen::Factory::SetDefaultCompileOptions()
   }
 
   // All options set in the 'compileoptions' message
-  for (auto c : mOptions)
+  for (auto i = 0; i < mOptions.size(); i++)
   {
     // '-opt v' : parsed for LLVM optimization level
-    if (c == "-opt")
+    if (mOptions[i] == "-opt")
     {
-      mOptimizationLevel = atoi(c.c_str());
+      if (i + 1 < mOptions.size())
+        mOptimizationLevel = atoi(mOptions[++i].c_str());
     }
     else
     {
-      AddCompileOption(c.c_str());
+      AddCompileOption(mOptions[i].c_str());
     }
   }
 
-  // Vector mode by default
-  /*
-  AddCompileOption("-vec");
-  AddCompileOption("-lv");
-  AddCompileOption("1");
-  */
-  /*
-  Seems not necessary...
-  AddCompileOption("-vs", TOSTRING(GetBlockSize()));
-  */
+  // Vector mode, loop variant 1 (simple loops that can be auto-vectorized)
+  if (mVectorMode)
+  {
+    WDL_String vectorSize;
+    vectorSize.SetFormatted(16, "%i", mVectorSize);
+
+    AddCompileOption("-vec");
+    AddCompileOption("-lv", "1");
+    AddCompileOption("-vs", vectorSize.Get());
+  }
+}
+
+void FaustGen::Factory::GetCommandLineOptions(WDL_String& str)
+{
+  str.Set("");
+
+  if (sizeof(sample) == 8)
+    str.Append("-double ");
+
+  for (auto i = 0; i < mOptions.size(); i++)
+  {
+    // the LLVM optimization level doesn't apply to the C++ backend
+    if (mOptions[i] == "-opt")
+      i++;
+    else
+      str.AppendFormatted(1024, "%s ", mOptions[i].c_str());
+  }
+
+  if (mVectorMode)
+    str.AppendFormatted(64, "-vec -lv 1 -vs %i ", mVectorSize);
+}
+
+void FaustGen::Factory::SetVectorMode(bool enable, int vectorSize)
+{
+  if (enable == mVectorMode && vectorSize == mVectorSize)
+    return;
+
+  mVectorMode = enable;
+  mVectorSize = vectorSize;
+
+  DBGMSG("FaustGen-%s: Vector mode %s, vector size %i\n", mName.Get(), enable ? "on" : "off", vectorSize);
+
+  if (mLLVMFactory)
+    Recompile();
 }
 
 void FaustGen::Factory::UpdateSourceCode(const char* str)
@@ -313,19 +568,9 @@ void FaustGen::Factory::UpdateSourceCode(const char* str)
     //      inst->hilight_off();
     //    }
 
-    // Delete the existing Faust module
-    FreeDSPFactory();
-
     mSourceCodeStr.Set(str);
 
-    // Free the memory allocated for fBitCode
-    mBitCodeStr.Set("");
-
-    // Update all instances
-    for (auto inst : mInstances)
-    {
-      inst->Init();
-    }
+    Recompile();
   }
   else
   {
@@ -333,6 +578,28 @@ void FaustGen::Factory::UpdateSourceCode(const char* str)
   }
 }
 
+void FaustGen::Factory::Recompile()
+{
+  // Free the memory allocated for fBitCode
+  mBitCodeStr.clear();
+
+  // With the timer running to install it, compile in the background and swap the new DSP in
+  if (sTimer && mLLVMFactory)
+  {
+    CompileAsync();
+    return;
+  }
+
+  // Delete the existing Faust module
+  FreeDSPFactory();
+
+  // Update all instances
+  for (auto inst : mInstances)
+  {
+    inst->Init();
+  }
+}
+
 void FaustGen::Factory::RemoveInstance(FaustGen* pDSP)
 {
   mInstances.erase(pDSP);
@@ -349,9 +616,25 @@ bool FaustGen::Factory::LoadFile(const char* file)
 {
   // Delete the existing Faust module
   //FreeDSPFactory();
-  WDL_String fileStr(file);
+  if (ReadSourceFile(file))
+  {
+    // Update all instances
+    for (auto inst : mInstances)
+    {
+      inst->Init();
+    }
+    
+    return true;
+  }
+  
+  assert(0 && "If you hit this assert it means the faust DSP file specificed in FAUST_BLOCK file was not found. This may be due to an invalid path or the macOS app sandbox.");
+  
+  return false;
+}
 
-  mBitCodeStr.Set("");
+bool FaustGen::Factory::ReadSourceFile(const char* file)
+{
+  WDL_String fileStr(file);
 
   WDL_FileRead infile(file);
 
@@ -372,18 +655,12 @@ bool FaustGen::Factory::LoadFile(const char* file)
     AddLibraryPath(fileStr.Get());
     
     mInputDSPFile.Set(file);
-    
-    // Update all instances
-    for (auto inst : mInstances)
-    {
-      inst->Init();
-    }
+
+    mBitCodeStr.clear();
     
     return true;
   }
   
-  assert(0 && "If you hit this assert it means the faust DSP file specificed in FAUST_BLOCK file was not found. This may be due to an invalid path or the macOS app sandbox.");
-  
   return false;
 }
 
@@ -399,9 +676,11 @@ void FaustGen::Factory::SetCompileOptions(std::initializer_list<const char*> opt
   if (options.size() == 0)
     DBGMSG("FaustGen-%s: No argument entered, no additional compilation option will be used", mName.Get());
 
-  //TODO
-//  mOptions = options;
-//
+  mOptions.assign(options.begin(), options.end());
+
+  if (mLLVMFactory)
+    Recompile();
+
 //  /*
 //  if (optimize) {
 //
@@ -416,16 +695,6 @@ void FaustGen::Factory::SetCompileOptions(std::initializer_list<const char*> opt
 //    DBGMSG("FaustGen-%s: Optimal compilation options found\n");
 //  }
 //  */
-//
-//  // Delete the existing Faust module
-//  FreeDSPFactory();
-//  mBitCodeStr.Set("");
-//
-//  // Update all instances
-//  for (auto i : fInstances) {
-//    i->UpdateSourceCode();
-//  }
-
 }
 
 #pragma mark -
@@ -501,6 +770,171 @@ void FaustGen::Init()
     mMidiHandler->startMidi();
 }
 
+void FaustGen::FreeDSP()
+{
+  mFadeRemaining = 0;
+  mFadingMidiUI = nullptr;
+  mFadingDSP = nullptr;
+  mFadingMidiHandler = nullptr;
+
+  IPlugFaust::FreeDSP();
+}
+
+void FaustGen::SwapDSP()
+{
+  auto pMidiHandler = std::make_unique<iplug2_midi_handler>();
+  auto pMidiUI = std::make_unique<MidiUI>(pMidiHandler.get());
+  std::unique_ptr<::dsp> pDSP(mFactory->CreateDSPInstance(pMidiHandler));
+  assert(pDSP);
+
+  const int sampleRate = mDSP ? mDSP->getSampleRate() : DEFAULT_SAMPLE_RATE;
+
+  pDSP->buildUserInterface(pMidiUI.get());
+  pDSP->init(sampleRate);
+
+  assert((pDSP->getNumInputs() <= mMaxNInputs) && (pDSP->getNumOutputs() <= mMaxNOutputs)); // don't have enough buffers to process the DSP
+
+  // the crossfade's scratch buffers are allocated here rather than on the audio thread
+  const int nOldOutputs = mDSP ? mDSP->getNumOutputs() : 0;
+  mFadeBuffer.resize(kFadeChunkSize * nOldOutputs);
+  mFadeOldOutputs.resize(nOldOutputs);
+  mFadeInputs.resize(std::max(mMaxNInputs, 0));
+  mFadeOutputs.resize(std::max(mMaxNOutputs, 0));
+
+  {
+    // the audio thread only waits for the parameter map to be rebuilt, not for the compile
+    WDL_MutexLock lock(&mMutex);
+
+    mZones.Empty(); // remove existing pointers to zones
+    pDSP->buildUserInterface(this);
+    BuildParameterMap(); // build a new map based on updated code
+
+    mFadingMidiUI = std::move(mMidiUI);
+    mFadingDSP = std::move(mDSP);
+    mFadingMidiHandler = std::move(mMidiHandler);
+    mMidiUI = std::move(pMidiUI);
+    mDSP = std::move(pDSP);
+    mMidiHandler = std::move(pMidiHandler);
+
+    // an errored DSP was silent, so there is nothing to fade from
+    mFadeLength = (mFadingDSP && !mErrored) ? std::max(1, sampleRate * FAUSTGEN_CROSSFADE_TIME / 1000) : 0;
+    mFadeRemaining = mFadeLength;
+    mErrored = false;
+    mInitialized = true;
+  }
+
+  if (mFadingMidiHandler)
+    mFadingMidiHandler->stopMidi();
+
+  if(mPlug)
+    mPlug->OnParamReset(EParamSource::kRecompile);
+  
+  if(mOnCompileFunc)
+    mOnCompileFunc();
+
+  mMidiHandler->startMidi();
+}
+
+bool FaustGen::ReleaseFadedDSP()
+{
+  // destroyed at the end of the function, outside the lock, in the same order as FreeDSP()
+  MidiHandlerPtr pMidiHandler;
+  std::unique_ptr<::dsp> pDSP;
+  std::unique_ptr<MidiUI> pMidiUI;
+
+  WDL_MutexLock lock(&mMutex);
+
+  if (!mFadingDSP)
+    return false;
+
+  if (mFadeRemaining > 0)
+    return true;
+
+  pMidiUI = std::move(mFadingMidiUI);
+  pDSP = std::move(mFadingDSP);
+  pMidiHandler = std::move(mFadingMidiHandler);
+
+  return false;
+}
+
+void FaustGen::Compute(sample** inputs, sample** outputs, int nFrames)
+{
+  if (mFadeRemaining <= 0)
+  {
+    mDSP->compute(nFrames, inputs, outputs);
+    return;
+  }
+
+  const int nInputs = std::max(mDSP->getNumInputs(), mFadingDSP->getNumInputs());
+  const int nOutputs = mDSP->getNumOutputs();
+  const int nOldOutputs = mFadingDSP->getNumOutputs();
+  const int nMixed = std::min(nOutputs, nOldOutputs);
+
+  auto setBuffers = [&](int offset) {
+    for (auto c = 0; c < nInputs; c++)
+      mFadeInputs[c] = inputs[c] + offset;
+
+    for (auto c = 0; c < nOutputs; c++)
+      mFadeOutputs[c] = outputs[c] + offset;
+  };
+
+  int offset = 0;
+
+  // in chunks that fit the scratch buffer. The old DSP runs first, as the new one may be processing in place
+  while (offset < nFrames && mFadeRemaining > 0)
+  {
+    const int n = std::min({kFadeChunkSize, nFrames - offset, mFadeRemaining});
+
+    setBuffers(offset);
+
+    for (auto c = 0; c < nOldOutputs; c++)
+      mFadeOldOutputs[c] = mFadeBuffer.data() + c * kFadeChunkSize;
+
+    mFadingDSP->compute(n, mFadeInputs.data(), mFadeOldOutputs.data());
+    mDSP->compute(n, mFadeInputs.data(), mFadeOutputs.data());
+
+    for (auto c = 0; c < nMixed; c++)
+    {
+      sample* pNew = mFadeOutputs[c];
+      const sample* pOld = mFadeOldOutputs[c];
+
+      for (auto i = 0; i < n; i++)
+      {
+        const sample oldGain = static_cast<sample>(mFadeRemaining - i) / static_cast<sample>(mFadeLength);
+        pNew[i] += oldGain * (pOld[i] - pNew[i]);
+      }
+    }
+
+    mFadeRemaining -= n;
+    offset += n;
+  }
+
+  if (offset < nFrames)
+  {
+    setBuffers(offset);
+    mDSP->compute(nFrames - offset, mFadeInputs.data(), mFadeOutputs.data());
+  }
+}
+
+void FaustGen::SetVectorMode(bool enable)
+{
+  mFactory->SetVectorMode(enable, mFactory->mVectorSize);
+}
+
+void FaustGen::SetBlockSize(int blockSize)
+{
+  int vectorSize = FAUSTGEN_MIN_VECTOR_SIZE;
+
+  while (vectorSize * 2 <= std::min(blockSize, FAUSTGEN_MAX_VECTOR_SIZE))
+    vectorSize *= 2;
+
+  // only the vector mode depends on it, so a scalar DSP isn't recompiled
+  if (mFactory->mVectorMode)
+    mFactory->SetVectorMode(true, vectorSize);
+  else
+    mFactory->mVectorSize = vectorSize;
+}
+
 void FaustGen::GetDrawPath(WDL_String& path)
 {
   assert(!CStringHasContents(mFactory->mDrawPath.Get()));
@@ -519,6 +953,7 @@ bool FaustGen::CompileCPP()
   WDL_String command;
   WDL_String inputFile;
   WDL_String outputFile;
+  WDL_String options;
 
   for (auto f : Factory::sFactoryMap)
   {
@@ -526,8 +961,8 @@ bool FaustGen::CompileCPP()
     outputFile = inputFile;
     outputFile.remove_fileext();
     outputFile.AppendFormatted(1024, ".tmp");
-    //-double
-    command.SetFormatted(1024, "%s -cn %s -i -a %s -o %s %s", FAUST_EXE, f.second->mName.Get(), archFile.Get(), outputFile.Get(), inputFile.Get());
+    f.second->GetCommandLineOptions(options);
+    command.SetFormatted(2048, "%s %s-cn %s -i -a %s -o %s %s", FAUST_EXE, options.Get(), f.second->mName.Get(), archFile.Get(), outputFile.Get(), inputFile.Get());
 
     DBGMSG("exec: %s\n", command.Get());
 
@@ -582,33 +1017,43 @@ bool FaustGen::CompileCPP()
 void FaustGen::OnTimer(Timer& timer)
 {
   WDL_String* pInputFile;
-  bool recompile = false;
+  bool recompiled = false;
 
-  for (auto f : Factory::sFactoryMap)
+  sMsSinceFileCheck += FAUSTGEN_COMPILE_POLL_INTERVAL;
+
+  if (sMsSinceFileCheck >= FAUST_RECOMPILE_INTERVAL)
   {
-    pInputFile = &f.second->mInputDSPFile;
-    StatType buf;
-    GetStat(pInputFile->Get(), &buf);
-    StatTime oldTime = f.second->mPreviousTime;
-    StatTime newTime = GetModifiedTime(buf);
+    sMsSinceFileCheck = 0;
 
-    if(!Equal(newTime, oldTime))
+    for (auto f : Factory::sFactoryMap)
     {
-      WDL_MutexLock lock(&mMutex);
-
-      recompile = true;
-      f.second->FreeDSPFactory();
-      DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", mName.Get());
-      DBGMSG("FaustGen-%s: JIT compiling %s\n", mName.Get(), pInputFile->Get());
-      f.second->LoadFile(pInputFile->Get());
+      pInputFile = &f.second->mInputDSPFile;
+      StatType buf;
+      GetStat(pInputFile->Get(), &buf);
+      StatTime oldTime = f.second->mPreviousTime;
+      StatTime newTime = GetModifiedTime(buf);
+
+      if(!Equal(newTime, oldTime))
+      {
+        DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", mName.Get());
+        DBGMSG("FaustGen-%s: JIT compiling %s in the background\n", mName.Get(), pInputFile->Get());
+
+        if (f.second->ReadSourceFile(pInputFile->Get()))
+          f.second->CompileAsync();
+      }
+
+      f.second->mPreviousTime = newTime;
     }
-      
-    f.second->mPreviousTime = newTime;
   }
 
-  if(recompile)
+  for (auto f : Factory::sFactoryMap)
+  {
+    if (f.second->PollCompile())
+      recompiled = true;
+  }
+
+  if(recompiled)
   {
-    // TODO: should check for successfull JIT
     DBGMSG("FaustGen-%s: Statically compiling all FAUST blocks\n", mName.Get());
     CompileCPP();
     //WDL_String objFile;
@@ -631,7 +1076,7 @@ void FaustGen::SetAutoRecompile(bool enable)
   if(enable)
   {
     if(sTimer == nullptr)
-      sTimer = Timer::Create(std::bind(&FaustGen::OnTimer, this, std::placeholders::_1), FAUST_RECOMPILE_INTERVAL);
+      sTimer = Timer::Create(std::bind(&FaustGen::OnTimer, this, std::placeholders::_1), FAUSTGEN_COMPILE_POLL_INTERVAL);
   }
   else
   {
@@ -21,9 +21,11 @@ using FaustGen = iplug::IPlugFaust; // not used, except for CompileCPP();
 
 #ifndef FAUST_COMPILED
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <set>
+#include <thread>
 #include <vector>
 #include <map>
 
@@ -81,7 +83,14 @@ static inline StatTime TimeZero() { return (StatTime) 0; }
 #define LLVM_OPTIMIZATION -1  // means 'maximum'
 
 #define FAUST_CLASS_PREFIX "F"
+#define FAUSTGEN_MIN_VECTOR_SIZE 4
+#define FAUSTGEN_MAX_VECTOR_SIZE 512
 #define FAUST_RECOMPILE_INTERVAL 5000 //ms
+#define FAUSTGEN_COMPILE_POLL_INTERVAL 100 //ms, how often a background compile is checked for completion
+#define FAUSTGEN_CROSSFADE_TIME 20 //ms, the crossfade from the old DSP to a recompiled one
+
+// Compiled factories are cached as machine code in this folder, keyed by the source and compile options. If it isn't defined, they are cached next to the .dsp file
+//#define FAUSTGEN_CACHE_PATH "/tmp/"
 
 #ifndef FAUST_EXE
   #if defined OS_MAC || defined OS_LINUX
@@ -138,6 +147,19 @@ class FaustGen : public IPlugFaust
       
     llvm_dsp_factory* CreateFactoryFromBitCode();
     llvm_dsp_factory* CreateFactoryFromSourceCode();
+
+    /** Recompile the current source code and update all the instances, in the background if the recompile timer is running */
+    void Recompile();
+
+    /** Start compiling the current source code on a background thread. PollCompile() swaps the result into the instances when it is done.
+     * If a compile is already running, another one is started when it finishes */
+    void CompileAsync();
+
+    /** Call this on the main thread to install a finished background compile, and to free DSPs that have finished fading out
+     * @return \c true if a new DSP was swapped in */
+    bool PollCompile();
+
+    bool IsCompiling() const { return mCompileThread.joinable(); }
     
     /** If DSP already exists will return it, otherwise create it
      * @return pointer to the DSP instance */
@@ -158,12 +180,27 @@ class FaustGen : public IPlugFaust
     void RemoveInstance(FaustGen* pDSP);
 
     bool LoadFile(const char* file);
+    bool ReadSourceFile(const char* file);
     bool WriteToFile(const char* file);
     void SetCompileOptions(std::initializer_list<const char*> options);
 
+    /** The vector mode is a property of the compiled factory, so it is shared by all the instances of the DSP */
+    void SetVectorMode(bool enable, int vectorSize);
+
+    /** Get the options that are passed to the command line compiler by CompileCPP(), matching those used by the JIT compiler */
+    void GetCommandLineOptions(WDL_String& str);
+
   private:
     void AddLibraryPath(const char* libraryPath);
     void AddCompileOption(const char* key, const char* value = "");
+
+    static llvm_dsp_factory* CompileSourceCode(const std::string& name, const std::string& sourceCode, const std::vector<std::string>& options, int optimizationLevel, std::string& error);
+
+    /** Get the path of the machine code cache, and the key of the current source code and compile options that is stored in it
+     * @return \c false if there is nowhere to cache it */
+    bool GetCachePath(WDL_String& path, uint64_t& key);
+    bool ReadCache();
+    static void WriteCache(llvm_dsp_factory* pFactory, const char* path, uint64_t key);
   private:
     struct FMeta : public Meta
     {
@@ -192,8 +229,9 @@ class FaustGen : public IPlugFaust
     std::set<FaustGen*> mInstances;
 
     llvm_dsp_factory* mLLVMFactory = nullptr;
+    llvm_dsp_factory* mRetiredFactory = nullptr; // the factory of the DSPs that are still fading out after a hot swap
     WDL_FastString mSourceCodeStr;
-    WDL_FastString mBitCodeStr;
+    std::string mBitCodeStr;
     WDL_String mDrawPath;
     WDL_String mName;
 
@@ -204,10 +242,18 @@ class FaustGen : public IPlugFaust
     int mNInputs = 0;
     int mNOutputs = 0;
     int mOptimizationLevel = LLVM_OPTIMIZATION;
+    bool mVectorMode = false;
+    int mVectorSize = 32; // Faust's default
     static int sFactoryCounter;
     static std::map<std::string, Factory*> sFactoryMap;
     WDL_String mInputDSPFile;
     StatTime mPreviousTime;
+
+    std::thread mCompileThread;
+    std::atomic<bool> mCompileDone {false};
+    bool mRecompilePending = false;
+    llvm_dsp_factory* mCompiledFactory = nullptr; // written by the compile thread before mCompileDone is set
+    std::string mCompileError;
   };
 public:
 
@@ -241,6 +287,14 @@ public:
   //bool CompileObjectFile(const char* fileName);
 
   void SetAutoRecompile(bool enable);
+
+  /** Set extra options for the compiler, e.g. {"-ftz", "2"}. "-opt N" sets the LLVM optimization level. This recompiles the DSP if it has already been compiled
+   * @param options The compiler options, which are shared by all the instances of the DSP */
+  void SetCompileOptions(std::initializer_list<const char*> options) { mFactory->SetCompileOptions(options); }
+
+  void SetVectorMode(bool enable) override;
+
+  void SetBlockSize(int blockSize) override;
   
   void SetCompileFunc(std::function<void()> func) { mOnCompileFunc = func; }
   
@@ -249,16 +303,43 @@ public:
   void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override;
   
   void SetErrored(bool errored) { mErrored = errored; }
-  
+
+  /** Free the DSP, including one that is fading out after a hot swap */
+  void FreeDSP();
+
+protected:
+  void Compute(sample** inputs, sample** outputs, int nFrames) override;
+
 private:
+  /** Replace the DSP with a new instance from the factory's current LLVM factory, crossfading from the old one over FAUSTGEN_CROSSFADE_TIME. Called on the main thread */
+  void SwapDSP();
+
+  /** Free the old DSP once the crossfade has finished
+   * @return \c true if a DSP is still fading out */
+  bool ReleaseFadedDSP();
+  
+
   Factory* mFactory = nullptr;
   static Timer* sTimer;
   static int sFaustGenCounter;
   static bool sAutoRecompile;
+  static int sMsSinceFileCheck;
   int mMaxNInputs = -1;
   int mMaxNOutputs = -1;
   bool mErrored = false;
   std::function<void()> mOnCompileFunc = nullptr;
+
+  // the DSP replaced by SwapDSP(), which ProcessBlock() fades out, and its scratch buffers
+  std::unique_ptr<::dsp> mFadingDSP;
+  MidiHandlerPtr mFadingMidiHandler;
+  std::unique_ptr<MidiUI> mFadingMidiUI;
+  std::vector<sample> mFadeBuffer;
+  std::vector<sample*> mFadeInputs;
+  std::vector<sample*> mFadeOutputs;
+  std::vector<sample*> mFadeOldOutputs;
+  int mFadeLength = 0;
+  int mFadeRemaining = 0;
+  static constexpr int kFadeChunkSize = 64;
   
   WDL_Mutex mMutex;
 };
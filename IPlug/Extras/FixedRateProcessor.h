@@ -0,0 +1,279 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Runs a block processor at a fixed sample rate whatever the host's rate, converting its inputs and outputs with WDL_Resampler
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "resample.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Runs a block processor at its own sample rate, for DSP that is only designed or tuned at certain rates, or to cap the CPU an algorithm uses at high session rates.
+ * Each host block's inputs are converted to the processing rate with a windowed sinc WDL_Resampler, the function is called once with however many frames
+ * that gives (which varies from block to block by a frame or so), and its outputs are converted back and queued. The queue is primed with enough silence
+ * to cover the resamplers' filters and the rounding of the frame counts, so each block of the host's outputs is always complete. GetLatency() adds the
+ * delay of the filters to that, as measured on an impulse by Reset().
+ * When the rates are the same the function is called with the host's buffers.
+ * Reset() allocates, ProcessBlock() doesn't
+ * @tparam T The sample type */
+template <typename T = sample>
+class FixedRateProcessor
+{
+public:
+  static constexpr int kSincSize = 64; // the taps of each resampler's filter
+  static constexpr int kSincInterpSize = 32;
+
+  /** @param nInChans The most input channels ProcessBlock() will be given
+   * @param nOutChans The most output channels ProcessBlock() will be given */
+  FixedRateProcessor(int nInChans = 2, int nOutChans = 2)
+  : mNInChans(std::max(nInChans, 0))
+  , mNOutChans(std::max(nOutChans, 0))
+  {
+  }
+
+  /** Set the rates and allocate the buffers, clearing the state. Call this outside of the audio callback, e.g. in OnReset()
+   * @param hostRate The rate the host calls ProcessBlock() at
+   * @param processingRate The rate the function runs at
+   * @param maxHostFrames The most frames the host calls ProcessBlock() with */
+  void Reset(double hostRate, double processingRate, int maxHostFrames)
+  {
+    mHostRate = hostRate;
+    mProcessingRate = processingRate;
+    mMaxHostFrames = std::max(maxHostFrames, 1);
+
+    if (!IsConverting())
+    {
+      mMaxProcessingFrames = mMaxHostFrames;
+      mLatency = 0;
+      return;
+    }
+
+    const double ratio = processingRate / hostRate;
+
+    // feeding the resamplers a block gives a frame or two either side of its length at the other rate
+    mMaxProcessingFrames = static_cast<int>(std::ceil(mMaxHostFrames * ratio)) + 4;
+    mMaxConvertedFrames = static_cast<int>(std::ceil(mMaxProcessingFrames / ratio)) + 4;
+
+    for (int dir = 0; dir < 2; dir++)
+    {
+      WDL_Resampler& resampler = mResamplers[dir];
+      resampler.SetMode(false, 0, true, kSincSize, kSincInterpSize);
+      resampler.SetFeedMode(true);
+      dir == kUp ? resampler.SetRates(hostRate, processingRate) : resampler.SetRates(processingRate, hostRate);
+    }
+
+    const int nIn = NResampledChans(kUp);
+    const int nOut = NResampledChans(kDown);
+    mResampled.Resize(std::max(nIn * mMaxProcessingFrames, nOut * mMaxConvertedFrames));
+    mProcessing[kUp].Resize(nIn * mMaxProcessingFrames);
+    mProcessing[kDown].Resize(nOut * mMaxProcessingFrames);
+    mResampledPtrs.Resize(std::max(nIn, nOut));
+    mResamplerPtrs.Resize(std::max(nIn, nOut));
+    mProcessingPtrs[kUp].Resize(nIn);
+    mProcessingPtrs[kDown].Resize(nOut);
+
+    for (int c = 0; c < nIn; c++)
+      mProcessingPtrs[kUp].Get()[c] = mProcessing[kUp].Get() + c * mMaxProcessingFrames;
+
+    for (int c = 0; c < nOut; c++)
+      mProcessingPtrs[kDown].Get()[c] = mProcessing[kDown].Get() + c * mMaxProcessingFrames;
+
+    // run a block of silence through the resamplers, so that their buffers and filters are allocated now rather than on the audio thread
+    memset(mProcessing[kDown].Get(), 0, mProcessing[kDown].GetSize() * sizeof(T));
+    Resample(kUp, nullptr, nIn, mMaxHostFrames, mMaxProcessingFrames);
+    Resample(kDown, mProcessingPtrs[kDown].Get(), nOut, mMaxProcessingFrames, mMaxConvertedFrames);
+    mResamplers[kUp].Reset();
+    mResamplers[kDown].Reset();
+
+    // the queue starts with enough silence that the resamplers, which hold back about half their filters, never fall behind the host,
+    // and a frame more either way for the rounding of the counts with other block sizes
+    int maxDeficit = 0;
+    const double delay = MeasureDelay(maxDeficit);
+    mResamplers[kUp].Reset();
+    mResamplers[kDown].Reset();
+    mPrimingFrames = maxDeficit + 2;
+    mLatency = mPrimingFrames + static_cast<int>(std::lround(delay));
+
+    mQueueSize = mPrimingFrames + mMaxConvertedFrames;
+    mQueue.Resize(nOut * mQueueSize);
+    memset(mQueue.Get(), 0, mQueue.GetSize() * sizeof(T));
+    mQueuedFrames = mPrimingFrames;
+  }
+
+  /** @return \c true if the host's rate differs from the processing rate */
+  bool IsConverting() const { return mHostRate != mProcessingRate && mHostRate > 0. && mProcessingRate > 0.; }
+
+  /** @return The rate the function runs at */
+  double GetProcessingRate() const { return mProcessingRate; }
+
+  /** @return The most frames the function is called with */
+  int GetMaxProcessingFrames() const { return mMaxProcessingFrames; }
+
+  /** @return The latency of the conversion, in frames at the host's rate */
+  int GetLatency() const { return mLatency; }
+
+  /** Process a block at the processing rate
+   * @param inputs The host's inputs
+   * @param outputs The host's outputs, which can't be the inputs
+   * @param nFrames The number of frames, at most the maxHostFrames given to Reset()
+   * @param nInChans The number of inputs, at most the nInChans given to the constructor
+   * @param nOutChans The number of outputs, at most the nOutChans given to the constructor
+   * @param func A function taking (T** inputs, T** outputs, int nFrames) that processes the frames at the processing rate. It isn't wrapped in a std::function, so a lambda with captures doesn't allocate */
+  template <typename Func>
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nInChans, int nOutChans, Func&& func)
+  {
+    assert(nInChans <= mNInChans);
+    assert(nOutChans <= mNOutChans);
+    assert(nFrames <= mMaxHostFrames);
+
+    if (!IsConverting())
+    {
+      func(inputs, outputs, nFrames);
+      return;
+    }
+
+    // an instrument without inputs still converts a channel of silence, which sets how many frames each block gets
+    const int nProcessing = Resample(kUp, nInChans ? inputs : nullptr, std::max(nInChans, 1), nFrames, mMaxProcessingFrames);
+
+    for (int c = 0; c < nInChans; c++)
+      Convert(mResampledPtrs.Get()[c], mProcessingPtrs[kUp].Get()[c], nProcessing);
+
+    for (int c = nInChans; c < NResampledChans(kUp); c++)
+      memset(mProcessingPtrs[kUp].Get()[c], 0, nProcessing * sizeof(T));
+
+    for (int c = 0; c < nOutChans; c++)
+      memset(mProcessingPtrs[kDown].Get()[c], 0, nProcessing * sizeof(T));
+
+    if (nProcessing > 0)
+      func(mProcessingPtrs[kUp].Get(), mProcessingPtrs[kDown].Get(), nProcessing);
+
+    const int nConverted = nOutChans && nProcessing > 0 ? Resample(kDown, mProcessingPtrs[kDown].Get(), nOutChans, nProcessing, mMaxConvertedFrames) : 0;
+    const int nQueued = std::min(nConverted, mQueueSize - mQueuedFrames);
+    const int nAvailable = std::min(mQueuedFrames + nQueued, nFrames);
+
+    for (int c = 0; c < nOutChans; c++)
+    {
+      T* pQueue = mQueue.Get() + c * mQueueSize;
+      Convert(mResampledPtrs.Get()[c], pQueue + mQueuedFrames, nQueued);
+      memcpy(outputs[c], pQueue, nAvailable * sizeof(T));
+      memset(outputs[c] + nAvailable, 0, (nFrames - nAvailable) * sizeof(T));
+      memmove(pQueue, pQueue + nAvailable, (mQueuedFrames + nQueued - nAvailable) * sizeof(T));
+    }
+
+    mQueuedFrames += nQueued - nAvailable;
+  }
+
+private:
+  enum EDirection { kUp = 0, kDown };
+
+  /** @return The number of channels a resampler converts, at least one */
+  int NResampledChans(int dir) const { return std::max(dir == kUp ? mNInChans : mNOutChans, 1); }
+
+  /** Feed a resampler nFrames of each channel, or silence if inputs is nullptr, its output frames are in mResampledPtrs
+   * @return The number of output frames */
+  int Resample(int dir, T** inputs, int nChans, int nFrames, int maxOutFrames)
+  {
+    WDL_Resampler& resampler = mResamplers[dir];
+    WDL_ResampleSample** ppIn = mResamplerPtrs.Get();
+    const int nIn = resampler.ResamplePreparePlanar(nFrames, nChans, ppIn);
+
+    for (int c = 0; c < nChans; c++)
+    {
+      if (inputs)
+        Convert(inputs[c], ppIn[c], nIn);
+      else
+        memset(ppIn[c], 0, nIn * sizeof(WDL_ResampleSample));
+
+      mResampledPtrs.Get()[c] = mResampled.Get() + c * maxOutFrames;
+    }
+
+    return resampler.ResampleOutPlanar(mResampledPtrs.Get(), nIn, maxOutFrames, nChans);
+  }
+
+  /** Run an impulse through both resamplers in blocks of the most host frames, one channel each way, once their first frames have settled
+   * @param maxDeficit Set to the most frames the output fell behind the input by at the end of a block
+   * @return The delay of the frames they output after one another, from the energy centroid of the response, in frames at the host's rate, which depends on the rates */
+  double MeasureDelay(int& maxDeficit)
+  {
+    const int impulsePos = 4 * static_cast<int>(std::ceil(kSincSize * std::max(1., mHostRate / mProcessingRate)));
+    const int nFrames = 3 * impulsePos;
+    std::vector<T> block(mMaxHostFrames);
+    T* pIn = block.data();
+    double sum = 0., weighted = 0.;
+    int nOut = 0;
+    maxDeficit = 0;
+
+    for (int pos = 0; pos < nFrames; pos += mMaxHostFrames)
+    {
+      for (int s = 0; s < mMaxHostFrames; s++)
+        block[s] = pos + s == impulsePos ? 1. : 0.;
+
+      const int nProcessing = Resample(kUp, &pIn, 1, mMaxHostFrames, mMaxProcessingFrames);
+      Convert(mResampledPtrs.Get()[0], mProcessingPtrs[kDown].Get()[0], nProcessing);
+      const int nConverted = Resample(kDown, mProcessingPtrs[kDown].Get(), 1, nProcessing, mMaxConvertedFrames);
+
+      for (int s = 0; s < nConverted; s++, nOut++)
+      {
+        const double e = mResampledPtrs.Get()[0][s] * mResampledPtrs.Get()[0][s];
+        sum += e;
+        weighted += e * nOut;
+      }
+
+      maxDeficit = std::max(maxDeficit, pos + mMaxHostFrames - nOut);
+    }
+
+    return sum > 0. ? weighted / sum - impulsePos : 0.;
+  }
+
+  template <typename From, typename To>
+  static void Convert(const From* pSrc, To* pDest, int nFrames)
+  {
+    for (int s = 0; s < nFrames; s++)
+      pDest[s] = static_cast<To>(pSrc[s]);
+  }
+
+  int mNInChans;
+  int mNOutChans;
+  double mHostRate = 0.;
+  double mProcessingRate = 0.;
+  int mMaxHostFrames = 0;
+  int mMaxProcessingFrames = 0;
+  int mMaxConvertedFrames = 0;
+  int mLatency = 0;
+  /** The silence the queue starts with, which the resamplers' output never falls behind */
+  int mPrimingFrames = 0;
+  WDL_Resampler mResamplers[2];
+  /** A resampler's output, each channel's frames contiguous */
+  WDL_TypedBuf<WDL_ResampleSample> mResampled;
+  WDL_TypedBuf<WDL_ResampleSample*> mResampledPtrs;
+  WDL_TypedBuf<WDL_ResampleSample*> mResamplerPtrs;
+  /** The function's inputs and outputs */
+  WDL_TypedBuf<T> mProcessing[2];
+  WDL_TypedBuf<T*> mProcessingPtrs[2];
+  /** The converted outputs not yet returned to the host, each channel's frames contiguous from the start of its mQueueSize frames */
+  WDL_TypedBuf<T> mQueue;
+  int mQueueSize = 0;
+  int mQueuedFrames = 0;
+};
+
+END_IPLUG_NAMESPACE
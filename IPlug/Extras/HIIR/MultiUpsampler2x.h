@@ -0,0 +1,145 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Upsamples any number of channels by a factor 2, using the same all-pass structure as Upsampler2xFPU.
+ * The filter state for all channels is stored contiguously and channel pairs are processed together in one SIMD register
+ */
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+
+#include "StereoStageProc.h"
+
+namespace hiir
+{
+
+template <int NC, typename T>
+class Upsampler2xMulti
+{
+public:
+  enum { NBR_COEFS = NC };
+
+  Upsampler2xMulti ()
+  {
+    for (int i = 0; i < NBR_COEFS; ++i)
+    {
+      _coef [i] = StereoPair<T>::zero();
+    }
+  }
+
+  /*
+  Name: set_num_channels
+  Description:
+    Allocates the filter memory for nbr_chn channels and clears it. Allocates,
+    so don't call it from the audio thread.
+  */
+  void set_num_channels (int nbr_chn)
+  {
+    _nbr_chn = nbr_chn;
+    _x.assign (((nbr_chn + 1) / 2) * NBR_COEFS, StereoPair<T>::zero());
+    _y.assign (((nbr_chn + 1) / 2) * NBR_COEFS, StereoPair<T>::zero());
+  }
+
+  /*
+  Name: set_coefs
+  Description:
+    Sets filter coefficients, as for Upsampler2xFPU::set_coefs().
+  */
+  void set_coefs (const double coef_arr [NBR_COEFS])
+  {
+    assert (coef_arr != 0);
+
+    for (int i = 0; i < NBR_COEFS; ++i)
+    {
+      _coef [i] = StereoPair<T>::set1(static_cast <T> (coef_arr [i]));
+    }
+  }
+
+  /*
+  Name: process_block
+  Description:
+    Upsamples (x2) the input sample blocks of nbr_chn channels.
+  Input parameters:
+    - in_ptr_arr: Input arrays, containing nbr_spl samples.
+    - nbr_chn: Number of channels to process, no more than set_num_channels()
+    - nbr_spl: Number of input samples to process, > 0
+  Output parameters:
+    - out_ptr_arr: Output sample arrays, capacity: nbr_spl * 2 samples.
+  */
+  void process_block (T* const out_ptr_arr [], const T* const in_ptr_arr [], int nbr_chn, long nbr_spl)
+  {
+    assert (nbr_chn <= _nbr_chn);
+    assert (nbr_spl > 0);
+
+    for (int chn = 0; chn < nbr_chn; chn += 2)
+    {
+      StereoPair<T>* x = &_x [(chn / 2) * NBR_COEFS];
+      StereoPair<T>* y = &_y [(chn / 2) * NBR_COEFS];
+      const T* in_l_ptr = in_ptr_arr [chn];
+      T* out_l_ptr = out_ptr_arr [chn];
+
+      if (chn + 1 < nbr_chn)
+      {
+        const T* in_r_ptr = in_ptr_arr [chn + 1];
+        T* out_r_ptr = out_ptr_arr [chn + 1];
+
+        for (long pos = 0; pos < nbr_spl; ++pos)
+        {
+          StereoPair<T> even = StereoPair<T>::load(in_l_ptr [pos], in_r_ptr [pos]);
+          StereoPair<T> odd = even;
+
+          stereo_process_sample_pos<NBR_COEFS, T> (even, odd, &_coef [0], x, y);
+
+          even.store(out_l_ptr [pos * 2], out_r_ptr [pos * 2]);
+          odd.store(out_l_ptr [pos * 2 + 1], out_r_ptr [pos * 2 + 1]);
+        }
+      }
+      else // odd channel out, the right lane is unused
+      {
+        for (long pos = 0; pos < nbr_spl; ++pos)
+        {
+          StereoPair<T> even = StereoPair<T>::set1(in_l_ptr [pos]);
+          StereoPair<T> odd = even;
+
+          stereo_process_sample_pos<NBR_COEFS, T> (even, odd, &_coef [0], x, y);
+
+          even.storel(out_l_ptr [pos * 2]);
+          odd.storel(out_l_ptr [pos * 2 + 1]);
+        }
+      }
+    }
+  }
+
+  /*
+  Name: clear_buffers
+  Description:
+    Clears filter memory, as if it processed silence since an infinite amount
+    of time.
+  */
+  void clear_buffers ()
+  {
+    std::fill (_x.begin (), _x.end (), StereoPair<T>::zero());
+    std::fill (_y.begin (), _y.end (), StereoPair<T>::zero());
+  }
+
+private:
+  std::array<StereoPair<T>, NBR_COEFS> _coef;
+  std::vector<StereoPair<T>> _x; // [pair * NBR_COEFS + coef]
+  std::vector<StereoPair<T>> _y;
+  int _nbr_chn = 0;
+};  // class Upsampler2xMulti
+
+} // namespace hiir
@@ -0,0 +1,124 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Stereo versions of the HIIR all-pass stages, processing a left/right pair in one SIMD register (SSE2/NEON/WASM SIMD128 for double, scalar otherwise)
+ */
+
+#include "IPlugSIMD.h"
+
+namespace hiir
+{
+
+/** A left/right pair of samples. The generic version is plain scalar code */
+template <typename T>
+struct StereoPair
+{
+  T l, r;
+
+  static inline StereoPair load(T l, T r) { return { l, r }; }
+  static inline StereoPair set1(T v) { return { v, v }; }
+  static inline StereoPair zero() { return { 0, 0 }; }
+
+  inline void store(T& outL, T& outR) const { outL = l; outR = r; }
+  inline void storel(T& outL) const { outL = l; }
+
+  friend inline StereoPair operator+(const StereoPair& a, const StereoPair& b) { return { a.l + b.l, a.r + b.r }; }
+  friend inline StereoPair operator-(const StereoPair& a, const StereoPair& b) { return { a.l - b.l, a.r - b.r }; }
+  friend inline StereoPair operator*(const StereoPair& a, const StereoPair& b) { return { a.l * b.l, a.r * b.r }; }
+};
+
+#if defined IPLUG_SIMD_SSE2
+template <>
+struct StereoPair<double>
+{
+  __m128d v;
+
+  static inline StereoPair load(double l, double r) { return { _mm_set_pd(r, l) }; }
+  static inline StereoPair set1(double x) { return { _mm_set1_pd(x) }; }
+  static inline StereoPair zero() { return { _mm_setzero_pd() }; }
+
+  inline void store(double& outL, double& outR) const { _mm_storel_pd(&outL, v); _mm_storeh_pd(&outR, v); }
+  inline void storel(double& outL) const { _mm_storel_pd(&outL, v); }
+
+  friend inline StereoPair operator+(const StereoPair& a, const StereoPair& b) { return { _mm_add_pd(a.v, b.v) }; }
+  friend inline StereoPair operator-(const StereoPair& a, const StereoPair& b) { return { _mm_sub_pd(a.v, b.v) }; }
+  friend inline StereoPair operator*(const StereoPair& a, const StereoPair& b) { return { _mm_mul_pd(a.v, b.v) }; }
+};
+#elif defined IPLUG_SIMD_NEON
+template <>
+struct StereoPair<double>
+{
+  float64x2_t v;
+
+  static inline StereoPair load(double l, double r) { const double d[2] = { l, r }; return { vld1q_f64(d) }; }
+  static inline StereoPair set1(double x) { return { vdupq_n_f64(x) }; }
+  static inline StereoPair zero() { return { vdupq_n_f64(0.) }; }
+
+  inline void store(double& outL, double& outR) const { outL = vgetq_lane_f64(v, 0); outR = vgetq_lane_f64(v, 1); }
+  inline void storel(double& outL) const { outL = vgetq_lane_f64(v, 0); }
+
+  friend inline StereoPair operator+(const StereoPair& a, const StereoPair& b) { return { vaddq_f64(a.v, b.v) }; }
+  friend inline StereoPair operator-(const StereoPair& a, const StereoPair& b) { return { vsubq_f64(a.v, b.v) }; }
+  friend inline StereoPair operator*(const StereoPair& a, const StereoPair& b) { return { vmulq_f64(a.v, b.v) }; }
+};
+#elif defined IPLUG_SIMD_WASM
+template <>
+struct StereoPair<double>
+{
+  v128_t v;
+
+  static inline StereoPair load(double l, double r) { return { wasm_f64x2_make(l, r) }; }
+  static inline StereoPair set1(double x) { return { wasm_f64x2_splat(x) }; }
+  static inline StereoPair zero() { return { wasm_f64x2_splat(0.) }; }
+
+  inline void store(double& outL, double& outR) const { outL = wasm_f64x2_extract_lane(v, 0); outR = wasm_f64x2_extract_lane(v, 1); }
+  inline void storel(double& outL) const { outL = wasm_f64x2_extract_lane(v, 0); }
+
+  friend inline StereoPair operator+(const StereoPair& a, const StereoPair& b) { return { wasm_f64x2_add(a.v, b.v) }; }
+  friend inline StereoPair operator-(const StereoPair& a, const StereoPair& b) { return { wasm_f64x2_sub(a.v, b.v) }; }
+  friend inline StereoPair operator*(const StereoPair& a, const StereoPair& b) { return { wasm_f64x2_mul(a.v, b.v) }; }
+};
+#endif
+
+/** Stereo equivalent of StageProcFPU::process_sample_pos(). Even coefficients filter spl_0 and odd coefficients filter spl_1 */
+template <int NC, typename T>
+inline void stereo_process_sample_pos (StereoPair<T> &spl_0, StereoPair<T> &spl_1, const StereoPair<T> coef [], StereoPair<T> x [], StereoPair<T> y [])
+{
+  int i = 0;
+
+  for (; i + 1 < NC; i += 2)
+  {
+    const StereoPair<T> temp_0 = (spl_0 - y [i + 0]) * coef [i + 0] + x [i + 0];
+    const StereoPair<T> temp_1 = (spl_1 - y [i + 1]) * coef [i + 1] + x [i + 1];
+
+    x [i + 0] = spl_0;
+    x [i + 1] = spl_1;
+
+    y [i + 0] = temp_0;
+    y [i + 1] = temp_1;
+
+    spl_0 = temp_0;
+    spl_1 = temp_1;
+  }
+
+  if (i < NC)
+  {
+    const StereoPair<T> temp = (spl_0 - y [i]) * coef [i] + x [i];
+    x [i] = spl_0;
+    y [i] = temp;
+    spl_0 = temp;
+  }
+}
+
+} // namespace hiir
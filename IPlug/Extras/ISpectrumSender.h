@@ -0,0 +1,472 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ISpectrumSender
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "fft.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+#include "ISender.h"
+#include "SharedTable.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The bins of one channel of an ISpectrumSender frame, in dB, from the lowest frequency up */
+template <int MAXBINS = 512>
+struct ISpectrumBins
+{
+  /** The number of valid bins, see ISpectrumSender::SetNumBins() */
+  int nBins;
+  /** The magnitude of each bin, with the release ballistics applied */
+  std::array<float, MAXBINS> mags;
+  /** The held peak of each bin */
+  std::array<float, MAXBINS> peaks;
+};
+
+/** ISpectrumSender is a spectrum analyzer that sends ready to draw bins to a control.
+ * The audio thread only copies samples into a lock-free circular buffer in ProcessBlock(). A worker thread started by the constructor windows overlapping frames,
+ * transforms them with WDL_real_fft(), reduces the FFT bins to SetNumBins() log-spaced bins and applies release and peak hold ballistics.
+ * When the worker falls behind, it only analyzes the newest frame that is due, so the analysis rate is decimated to what the worker keeps up with.
+ * Frames are published through an ISnapshotSender, so TransmitData() on the main thread only hands the latest one to the control, as an ISenderData<MAXNC, ISpectrumBins<MAXBINS>>.
+ * Add WDL/fft.c to the project to use it
+ * @tparam MAXNC The maximum number of channels
+ * @tparam MAXBINS The maximum number of bins sent to the control
+ * @tparam MAXFFTSIZE The maximum FFT size, a power of two */
+template <int MAXNC = 1, int MAXBINS = 512, int MAXFFTSIZE = 8192>
+class ISpectrumSender
+{
+public:
+  using Data = ISenderData<MAXNC, ISpectrumBins<MAXBINS>>;
+
+  static constexpr int kUpdateMessage = ISender<>::kUpdateMessage;
+
+  /** The size of the circular buffer per channel, in samples. The worker reads the newest MAXFFTSIZE samples, so the audio thread has to write the rest before it catches up */
+  static constexpr int kRingSize = MAXFFTSIZE * 4;
+
+  /** How often the worker checks for a new frame, which bounds the analysis rate */
+  static constexpr int kWorkerIntervalMs = 5;
+
+  /** The level that silence and unset bins are reported at */
+  static constexpr float kMinDB = -120.f;
+
+  static_assert((MAXFFTSIZE & (MAXFFTSIZE - 1)) == 0, "MAXFFTSIZE must be a power of two");
+
+  enum class EWindow
+  {
+    kRectangular,
+    kHann,
+    kBlackmanHarris
+  };
+
+  /** ISpectrumSender constructor, which starts the worker thread
+   * @param fftSize The FFT size, a power of two no larger than MAXFFTSIZE
+   * @param overlap The number of frames that overlap each sample, so the hop size is fftSize / overlap
+   * @param window The window applied to each frame
+   * @param nBins The number of bins sent to the control, see SetNumBins() */
+  ISpectrumSender(int fftSize = 2048, int overlap = 4, EWindow window = EWindow::kHann, int nBins = 256)
+  {
+    WDL_fft_init();
+
+    for (auto& ring : mRing)
+      ring.assign(kRingSize, 0.f);
+
+    SetFFTSize(fftSize, overlap);
+    SetWindow(window);
+    SetNumBins(nBins);
+
+    mThread = std::thread(&ISpectrumSender::WorkerLoop, this);
+  }
+
+  ~ISpectrumSender()
+  {
+    mQuit.store(true, std::memory_order_release);
+
+    if (mThread.joinable())
+      mThread.join();
+  }
+
+  ISpectrumSender(const ISpectrumSender&) = delete;
+  ISpectrumSender& operator=(const ISpectrumSender&) = delete;
+
+  /** Set the FFT size and overlap. Call on the main thread
+   * @param fftSize The FFT size, a power of two no larger than MAXFFTSIZE
+   * @param overlap The number of frames that overlap each sample */
+  void SetFFTSize(int fftSize, int overlap)
+  {
+    assert(fftSize >= 16 && fftSize <= MAXFFTSIZE && (fftSize & (fftSize - 1)) == 0);
+    assert(overlap >= 1 && overlap <= fftSize);
+
+    UpdateConfig([&](Config& config) {
+      config.fftSize = fftSize;
+      config.overlap = overlap;
+    });
+  }
+
+  /** Set the window applied to each frame. Call on the main thread */
+  void SetWindow(EWindow window)
+  {
+    UpdateConfig([&](Config& config) { config.window = window; });
+  }
+
+  /** Set the number of bins sent to the control, typically its width in pixels, from its OnResize(). Call on the main thread
+   * @param nBins The number of bins, no more than MAXBINS */
+  void SetNumBins(int nBins)
+  {
+    assert(nBins > 0 && nBins <= MAXBINS);
+
+    UpdateConfig([&](Config& config) { config.nBins = nBins; });
+  }
+
+  /** Set the frequency range the bins are spread over logarithmically. Call on the main thread
+   * @param minFreq The lower edge of the first bin in Hz
+   * @param maxFreq The upper edge of the last bin in Hz, which is clipped to the Nyquist frequency */
+  void SetFrequencyRange(float minFreq, float maxFreq)
+  {
+    assert(minFreq > 0.f && maxFreq > minFreq);
+
+    UpdateConfig([&](Config& config) {
+      config.minFreq = minFreq;
+      config.maxFreq = maxFreq;
+    });
+  }
+
+  /** Set the meter ballistics of the bins. Call on the main thread
+   * @param releaseDBPerSec How fast the magnitudes fall
+   * @param peakHoldMs How long peaks are held
+   * @param peakReleaseDBPerSec How fast peaks fall after they have been held */
+  void SetBallistics(float releaseDBPerSec, float peakHoldMs, float peakReleaseDBPerSec)
+  {
+    UpdateConfig([&](Config& config) {
+      config.releaseDBPerSec = releaseDBPerSec;
+      config.peakHoldMs = peakHoldMs;
+      config.peakReleaseDBPerSec = peakReleaseDBPerSec;
+    });
+  }
+
+  /** Set the sample rate the bin frequencies are calculated for. This can be called on the realtime audio thread, typically from OnReset() */
+  void Reset(double sampleRate)
+  {
+    mSampleRate.store(sampleRate, std::memory_order_release);
+  }
+
+  /** Copy sample buffers into the analyzer. This can be called on the realtime audio thread, it doesn't block or allocate
+   @param inputs the sample buffers to analyze
+   @param nFrames the number of sample frames in the input buffers
+   @param ctrlTag a control tag to indicate which control to send the bins to. Note: if you don't supply the control tag here, you must use TransmitDataToControlsWithTags() and specify one or more tags there
+   @param nChans the number of channels to analyze
+   @param chanOffset the starting channel */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    assert(chanOffset + nChans <= MAXNC);
+
+    mCtrlTag.store(ctrlTag, std::memory_order_relaxed);
+    mNChans.store(nChans, std::memory_order_relaxed);
+    mChanOffset.store(chanOffset, std::memory_order_relaxed);
+
+    const int skip = std::max(nFrames - kRingSize, 0); // only the newest kRingSize samples can be kept
+    const uint64_t writePos = mWritePos.load(std::memory_order_relaxed) + skip;
+    const int n = nFrames - skip;
+    const int start = static_cast<int>(writePos & (kRingSize - 1));
+    const int first = std::min(n, kRingSize - start);
+
+    for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+    {
+      float* pRing = mRing[c].data();
+      const sample* pIn = inputs[c] + skip;
+
+      for (auto s = 0; s < first; s++)
+        pRing[start + s] = static_cast<float>(pIn[s]);
+
+      for (auto s = first; s < n; s++)
+        pRing[s - first] = static_cast<float>(pIn[s]);
+    }
+
+    mWritePos.store(writePos + n, std::memory_order_release);
+  }
+
+  /** Sends the latest analyzed frame to its control, if there is a new one.
+   *  This must be called on the main thread - typically in MyPlugin::OnIdle() */
+  void TransmitData(IEditorDelegate& dlg)
+  {
+    mSnapshots.TransmitData(dlg);
+  }
+
+  /** This variation can be used if you need to supply multiple controls with the same frame, overriding the tag in the data packet
+   @param dlg The editor delegate
+   @param ctrlTags A list of control tags that should receive the updates from this sender */
+  void TransmitDataToControlsWithTags(IEditorDelegate& dlg, const std::initializer_list<int>& ctrlTags)
+  {
+    mSnapshots.TransmitDataToControlsWithTags(dlg, ctrlTags);
+  }
+
+private:
+  struct Config
+  {
+    int fftSize = 2048;
+    int overlap = 4;
+    EWindow window = EWindow::kHann;
+    int nBins = 256;
+    float minFreq = 20.f;
+    float maxFreq = 20000.f;
+    float releaseDBPerSec = 60.f;
+    float peakHoldMs = 1000.f;
+    float peakReleaseDBPerSec = 20.f;
+  };
+
+  /** The FFT bins that make up a bin sent to the control: the maximum of [lo, hi) if hi > lo, otherwise an interpolation between lo and lo + 1 */
+  struct BinRange
+  {
+    int lo;
+    int hi;
+    float frac;
+  };
+
+  template <typename F>
+  void UpdateConfig(F&& func)
+  {
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    func(mConfig);
+    mConfigVersion.fetch_add(1, std::memory_order_release);
+  }
+
+  /** Rebuild the worker's tables for a new configuration, on the worker thread */
+  void Prepare(const Config& config, double sampleRate)
+  {
+    const int n = config.fftSize;
+    const int nHalf = n / 2;
+
+    mFFTBuf.resize(n);
+    mPower.resize(nHalf);
+    mPermute.resize(nHalf);
+
+    const EWindow windowType = config.window;
+    mWindow = SharedTable<std::vector<WDL_FFT_REAL>, std::tuple<int, int>>::Get(std::make_tuple(static_cast<int>(windowType), n), [windowType, n]() {
+      std::vector<WDL_FFT_REAL> window(n);
+
+      for (int i = 0; i < n; i++)
+      {
+        const double phase = 2. * PI * i / n;
+        double w = 1.;
+
+        if (windowType == EWindow::kHann)
+          w = 0.5 - 0.5 * std::cos(phase);
+        else if (windowType == EWindow::kBlackmanHarris)
+          w = 0.35875 - 0.48829 * std::cos(phase) + 0.14128 * std::cos(2. * phase) - 0.01168 * std::cos(3. * phase);
+
+        window[i] = static_cast<WDL_FFT_REAL>(w);
+      }
+
+      return window;
+    });
+
+    double windowSum = 0.;
+
+    for (int i = 0; i < n; i++)
+      windowSum += (*mWindow)[i];
+
+    // a full scale sine reads 0 dB, WDL_real_fft() returns twice the amplitude of the positive frequency bins
+    mPowerScale = static_cast<float>(1. / (windowSum * windowSum));
+
+    for (int k = 0; k < nHalf; k++)
+      mPermute[k] = WDL_fft_permute(nHalf, k);
+
+    const double binsPerHz = n / sampleRate;
+    const double maxFreq = std::min(static_cast<double>(config.maxFreq), sampleRate * 0.5);
+    const double ratio = maxFreq / config.minFreq;
+
+    mBinRanges.resize(config.nBins);
+
+    for (int b = 0; b < config.nBins; b++)
+    {
+      const double loFreq = config.minFreq * std::pow(ratio, static_cast<double>(b) / config.nBins);
+      const double hiFreq = config.minFreq * std::pow(ratio, static_cast<double>(b + 1) / config.nBins);
+      const int lo = Clip(static_cast<int>(std::ceil(loFreq * binsPerHz)), 1, nHalf - 1);
+      const int hi = Clip(static_cast<int>(std::ceil(hiFreq * binsPerHz)), 1, nHalf);
+
+      if (hi > lo)
+        mBinRanges[b] = { lo, hi, 0.f };
+      else
+      {
+        const double k = Clip(std::sqrt(loFreq * hiFreq) * binsPerHz, 1., nHalf - 2.);
+        mBinRanges[b] = { static_cast<int>(k), static_cast<int>(k), static_cast<float>(k - std::floor(k)) };
+      }
+    }
+
+    for (int c = 0; c < MAXNC; c++)
+    {
+      mMags[c].assign(config.nBins, kMinDB);
+      mPeaks[c].assign(config.nBins, kMinDB);
+      mHoldTimes[c].assign(config.nBins, 0.f);
+    }
+  }
+
+  /** Analyze the frame that ends at frameEnd and publish the bins */
+  void AnalyzeFrame(const Config& config, uint64_t frameEnd, float dt)
+  {
+    const int n = config.fftSize;
+    const int nChans = mNChans.load(std::memory_order_relaxed);
+    const int chanOffset = mChanOffset.load(std::memory_order_relaxed);
+    const float releaseDB = config.releaseDBPerSec * dt;
+    const float peakReleaseDB = config.peakReleaseDBPerSec * dt;
+    const float peakHoldTime = config.peakHoldMs * 0.001f;
+    const WDL_FFT_REAL* pWindow = mWindow->data();
+
+    Data& d = mSnapshots.GetWriteData();
+    d.ctrlTag = mCtrlTag.load(std::memory_order_relaxed);
+    d.nChans = nChans;
+    d.chanOffset = chanOffset;
+
+    for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+    {
+      const float* pRing = mRing[c].data();
+      const uint64_t start = frameEnd - n;
+
+      for (int i = 0; i < n; i++)
+        mFFTBuf[i] = pRing[(start + i) & (kRingSize - 1)] * pWindow[i];
+
+      WDL_real_fft(mFFTBuf.data(), n, 0);
+
+      const WDL_FFT_COMPLEX* pBins = reinterpret_cast<const WDL_FFT_COMPLEX*>(mFFTBuf.data());
+
+      for (int k = 1; k < n / 2; k++)
+      {
+        const WDL_FFT_COMPLEX& bin = pBins[mPermute[k]];
+        mPower[k] = static_cast<float>(bin.re * bin.re + bin.im * bin.im);
+      }
+
+      ISpectrumBins<MAXBINS>& bins = d.vals[c];
+      bins.nBins = config.nBins;
+
+      for (int b = 0; b < config.nBins; b++)
+      {
+        const BinRange& range = mBinRanges[b];
+        float power;
+
+        if (range.hi > range.lo)
+          power = *std::max_element(mPower.begin() + range.lo, mPower.begin() + range.hi);
+        else
+          power = mPower[range.lo] + (mPower[range.lo + 1] - mPower[range.lo]) * range.frac;
+
+        const float db = std::max(10.f * std::log10(power * mPowerScale + 1e-30f), kMinDB);
+
+        float& mag = mMags[c][b];
+        mag = std::max(db, mag - releaseDB);
+
+        float& peak = mPeaks[c][b];
+        float& holdTime = mHoldTimes[c][b];
+
+        if (db >= peak)
+        {
+          peak = db;
+          holdTime = peakHoldTime;
+        }
+        else if ((holdTime -= dt) <= 0.f)
+          peak = std::max(mag, peak - peakReleaseDB);
+
+        bins.mags[b] = mag;
+        bins.peaks[b] = peak;
+      }
+    }
+
+    mSnapshots.PublishData();
+  }
+
+  void WorkerLoop()
+  {
+    Config config;
+    int configVersion = -1;
+    double sampleRate = 0.;
+    uint64_t nextFrameEnd = 0;
+    uint64_t lastFrameEnd = 0;
+    bool realign = true;
+
+    while (!mQuit.load(std::memory_order_acquire))
+    {
+      if (mConfigVersion.load(std::memory_order_acquire) != configVersion || mSampleRate.load(std::memory_order_acquire) != sampleRate)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mConfigMutex);
+          config = mConfig;
+          configVersion = mConfigVersion.load(std::memory_order_relaxed);
+        }
+
+        sampleRate = mSampleRate.load(std::memory_order_acquire);
+        Prepare(config, sampleRate);
+        realign = true;
+      }
+
+      const uint64_t writePos = mWritePos.load(std::memory_order_acquire);
+      const int hop = std::max(config.fftSize / config.overlap, 1);
+
+      if (realign)
+      {
+        nextFrameEnd = lastFrameEnd = std::max(writePos, static_cast<uint64_t>(config.fftSize));
+        realign = false;
+      }
+
+      if (writePos >= nextFrameEnd)
+      {
+        // analyze the newest frame that is due, skipping any the worker fell behind on
+        const uint64_t frameEnd = nextFrameEnd + ((writePos - nextFrameEnd) / hop) * hop;
+        AnalyzeFrame(config, frameEnd, static_cast<float>((frameEnd - lastFrameEnd) / sampleRate));
+        lastFrameEnd = frameEnd;
+        nextFrameEnd = frameEnd + hop;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(kWorkerIntervalMs));
+    }
+  }
+
+  // audio thread
+  std::array<std::vector<float>, MAXNC> mRing;
+  std::atomic<uint64_t> mWritePos {0};
+  std::atomic<int> mCtrlTag {kNoTag};
+  std::atomic<int> mNChans {MAXNC};
+  std::atomic<int> mChanOffset {0};
+  std::atomic<double> mSampleRate {DEFAULT_SAMPLE_RATE};
+
+  // main thread
+  std::mutex mConfigMutex;
+  Config mConfig;
+  std::atomic<int> mConfigVersion {0};
+  ISnapshotSender<MAXNC, ISpectrumBins<MAXBINS>> mSnapshots;
+
+  // worker thread
+  std::thread mThread;
+  std::atomic<bool> mQuit {false};
+  std::vector<WDL_FFT_REAL> mFFTBuf;
+  std::shared_ptr<const std::vector<WDL_FFT_REAL>> mWindow; // shared with other senders with the same window and FFT size, see SharedTable
+  std::vector<float> mPower;
+  std::vector<int> mPermute;
+  std::vector<BinRange> mBinRanges;
+  float mPowerScale = 1.f;
+  std::array<std::vector<float>, MAXNC> mMags;
+  std::array<std::vector<float>, MAXNC> mPeaks;
+  std::array<std::vector<float>, MAXNC> mHoldTimes;
+};
+
+END_IPLUG_NAMESPACE
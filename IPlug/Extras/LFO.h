@@ -122,6 +122,20 @@ public:
     
     T phaseIncr = IOscillator<T>::mPhaseIncr;
 
+    if(mRateMode == ERateMode::kHz || !transportIsRunning)
+    {
+      // the increment is constant, so pick the shape once for the block
+      if(mRateMode == ERateMode::kBPM)
+        phaseIncr *= mQNScalar;
+
+      if(mPolarity == EPolarity::kUnipolar)
+        IOscillator<T>::mPhase = FillBlockForShape<true>(pOutput, nFrames, phase, phaseIncr);
+      else
+        IOscillator<T>::mPhase = FillBlockForShape<false>(pOutput, nFrames, phase, phaseIncr);
+
+      return;
+    }
+
     for (int s=0; s<nFrames; s++)
     {
       double sampleAccurateQnPos = qnPos + ((double) s / samplesPerBeat);
@@ -187,7 +201,8 @@ private:
     return x;
   };
   
-  inline T DoProcess(T phase)
+  /** Evaluate a shape. The block loops call this with constant arguments, so the switches fold away */
+  static inline T ShapeValue(EShape shape, bool unipolar, T phase)
   {
     auto triangle         = [](T x){ return (2. * (1. - std::abs((WrapPhase(x + 0.25) * 2.) -1.))) - 1.; };
     auto triangleUnipolar = [](T x){ return 1. - std::abs((x * 2.) - 1. ); };
@@ -197,12 +212,12 @@ private:
     auto rampupUnipolar   = [](T x){ return x; };
     auto rampdown         = [](T x){ return ((1. - x) * 2.) - 1.; };
     auto rampdownUnipolar = [](T x){ return 1. - x; };
-    
+
     T output = 0.;
     
-    if(mPolarity == EPolarity::kUnipolar)
+    if(unipolar)
     {
-      switch (mShape) {
+      switch (shape) {
         case kTriangle: output = triangleUnipolar(phase); break;
         case kSquare:   output = squareUnipolar(phase); break;
         case kRampUp:   output = rampupUnipolar(phase); break;
@@ -213,7 +228,7 @@ private:
     }
     else
     {
-      switch (mShape) {
+      switch (shape) {
         case kTriangle: output = triangle(phase); break;
         case kSquare:   output = square(phase); break;
         case kRampUp:   output = rampup(phase); break;
@@ -223,11 +238,48 @@ private:
       }
     }
     
-    mLastOutput = output * mLevelScalar;
+    return output;
+  }
+
+  inline T DoProcess(T phase)
+  {
+    mLastOutput = ShapeValue(mShape, mPolarity == EPolarity::kUnipolar, phase) * mLevelScalar;
     
     return mLastOutput;
   }
 
+  /** Free running block loop for one shape, with the phase advancing by a constant increment */
+  template <EShape SHAPE, bool UNIPOLAR>
+  T FillBlock(T* pOutput, int nFrames, T phase, T phaseIncr)
+  {
+    const T levelScalar = mLevelScalar;
+
+    for (int s=0; s<nFrames; s++)
+    {
+      phase = WrapPhase(phase + phaseIncr);
+      pOutput[s] = ShapeValue(SHAPE, UNIPOLAR, phase) * levelScalar;
+    }
+
+    if (nFrames > 0)
+      mLastOutput = pOutput[nFrames - 1];
+
+    return phase;
+  }
+
+  template <bool UNIPOLAR>
+  T FillBlockForShape(T* pOutput, int nFrames, T phase, T phaseIncr)
+  {
+    switch (mShape)
+    {
+      case kTriangle: return FillBlock<kTriangle, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+      case kSquare:   return FillBlock<kSquare, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+      case kRampUp:   return FillBlock<kRampUp, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+      case kRampDown: return FillBlock<kRampDown, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+      case kSine:     return FillBlock<kSine, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+      default:        return FillBlock<kNumShapes, UNIPOLAR>(pOutput, nFrames, phase, phaseIncr);
+    }
+  }
+
 private:
   T mLastOutput = 0.;
   T mLevelScalar = 1.; // Non clipped, or smoothed scalar value
@@ -0,0 +1,188 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc LatencyCompensator
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "IPlugPlatform.h"
+#include "IPlugUtilities.h"
+#include "NChanDelay.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Delays the dry signal of a plug-in that reports latency, so that dry/wet mixes and a soft bypass stay time aligned with the processed signal.
+ * Everything is allocated up front for the largest latency, so that SetLatency() can be called on the audio thread. A change takes effect at the start of the next
+ * block, which crossfades from the dry signal at the old latency to the new one, rather than jumping.
+ * Report the same latency to the host with IPlugProcessor::RequestLatency(), which batches the host notifications.
+ * @code
+ * void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override
+ * {
+ *   mCompensator.ProcessDry(inputs, nFrames); // before the inputs are overwritten
+ *   mLookaheadLimiter.ProcessBlock(inputs, outputs, nFrames);
+ *   mCompensator.Mix(outputs, outputs, nFrames, GetParam(kMix)->Value() / 100.);
+ * }
+ * @endcode */
+template<typename T = sample>
+class LatencyCompensator
+{
+public:
+  /** @param nChans The number of channels
+   * @param maxLatency The largest latency SetLatency() will be given, in samples
+   * @param maxBlockSize The most samples ProcessDry() will be given at once, e.g. IPlugProcessor::GetBlockSize() */
+  LatencyCompensator(int nChans = 2, int maxLatency = 4096, int maxBlockSize = DEFAULT_BLOCK_SIZE)
+  {
+    Resize(nChans, maxLatency, maxBlockSize);
+  }
+
+  /** Reallocate and clear the buffers, do this outside of the audio callback, e.g. in OnReset(). See the constructor for the arguments */
+  void Resize(int nChans, int maxLatency, int maxBlockSize)
+  {
+    mNChans = std::max(nChans, 1);
+    mMaxLatency = std::max(maxLatency, 1);
+    mMaxBlockSize = std::max(maxBlockSize, 1);
+    mDelay.Resize(mNChans, mMaxLatency, mMaxBlockSize);
+    mBuffer.Resize(2 * mNChans * mMaxBlockSize);
+    mDryPtrs.Resize(mNChans);
+    mFadePtrs.Resize(mNChans);
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      mDryPtrs.Get()[c] = mBuffer.Get() + c * mMaxBlockSize;
+      mFadePtrs.Get()[c] = mBuffer.Get() + (mNChans + c) * mMaxBlockSize;
+    }
+
+    Reset();
+  }
+
+  /** Clear the delayed signal, and apply the latency and mix without fading */
+  void Reset()
+  {
+    mDelay.Reset();
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(T));
+    mLatency = mTargetLatency;
+    mPrevWet = -1.;
+  }
+
+  /** Set the latency of the wet signal, which the dry signal is delayed by. Safe to call on the audio thread, it takes effect at the next ProcessDry()
+   * @param samples The latency, clamped between 0 and the maximum latency */
+  void SetLatency(int samples) { mTargetLatency = Clip(samples, 0, mMaxLatency); }
+
+  /** @return The latency the dry signal is delayed by, which lags SetLatency() by up to a block */
+  int GetLatency() const { return mLatency; }
+
+  int GetMaxLatency() const { return mMaxLatency; }
+
+  int GetMaxBlockSize() const { return mMaxBlockSize; }
+
+  /** Delay a block of the dry signal, call this before the inputs are overwritten
+   * @param inputs mNChans input channels
+   * @param nFrames The number of samples in each channel, no more than the maximum block size */
+  void ProcessDry(T** inputs, int nFrames)
+  {
+    assert(nFrames <= mMaxBlockSize);
+
+    mDelay.Write(inputs, nFrames);
+    ReadDry(inputs, mDryPtrs.Get(), nFrames, mLatency);
+
+    if (mTargetLatency != mLatency)
+    {
+      ReadDry(inputs, mFadePtrs.Get(), nFrames, mTargetLatency);
+
+      const T step = T(1) / static_cast<T>(std::max(nFrames, 1));
+
+      for (auto c = 0; c < mNChans; c++)
+      {
+        T* pDry = mDryPtrs.Get()[c];
+        const T* pNew = mFadePtrs.Get()[c];
+
+        for (auto s = 0; s < nFrames; s++)
+        {
+          const T fade = static_cast<T>(s + 1) * step;
+          pDry[s] += (pNew[s] - pDry[s]) * fade;
+        }
+      }
+
+      mLatency = mTargetLatency;
+    }
+  }
+
+  /** @return mNChans buffers of the dry signal delayed by the latency, as of the last ProcessDry() */
+  T** GetDry() { return mDryPtrs.Get(); }
+
+  /** Mix the delayed dry signal with the wet signal. The mix is ramped over the block from the previous call's value
+   * @param wet mNChans channels of the processed signal
+   * @param outputs mNChans output channels, can be the same as wet
+   * @param nFrames The number of samples in each channel, as passed to the last ProcessDry()
+   * @param wetAmount 0 for the dry signal alone, which is a latency matched bypass, to 1 for the wet signal alone */
+  void Mix(T** wet, T** outputs, int nFrames, double wetAmount)
+  {
+    const T target = static_cast<T>(Clip(wetAmount, 0., 1.));
+    const T start = mPrevWet < 0. ? target : static_cast<T>(mPrevWet);
+    const T step = (target - start) / static_cast<T>(std::max(nFrames, 1));
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      const T* pDry = mDryPtrs.Get()[c];
+      const T* pWet = wet[c];
+      T* pOut = outputs[c];
+
+      if (start == target)
+      {
+        for (auto s = 0; s < nFrames; s++)
+          pOut[s] = pDry[s] + (pWet[s] - pDry[s]) * target;
+      }
+      else
+      {
+        for (auto s = 0; s < nFrames; s++)
+        {
+          const T mix = start + step * static_cast<T>(s + 1);
+          pOut[s] = pDry[s] + (pWet[s] - pDry[s]) * mix;
+        }
+      }
+    }
+
+    mPrevWet = target;
+  }
+
+private:
+  void ReadDry(T** inputs, T** outputs, int nFrames, int latency)
+  {
+    // NChanModDelayLine's shortest delay is one sample
+    if (latency == 0)
+    {
+      for (auto c = 0; c < mNChans; c++)
+        memcpy(outputs[c], inputs[c], nFrames * sizeof(T));
+    }
+    else
+      mDelay.Read(outputs, nFrames, static_cast<double>(latency));
+  }
+
+  NChanModDelayLine<T> mDelay {1, 1, 1};
+  WDL_TypedBuf<T> mBuffer;
+  WDL_TypedBuf<T*> mDryPtrs;
+  WDL_TypedBuf<T*> mFadePtrs;
+  int mNChans = 0;
+  int mMaxLatency = 0;
+  int mMaxBlockSize = 0;
+  int mLatency = 0;
+  int mTargetLatency = 0;
+  double mPrevWet = -1.;
+};
+
+END_IPLUG_NAMESPACE
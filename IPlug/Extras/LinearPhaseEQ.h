@@ -0,0 +1,586 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc LinearPhaseEQ
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "convoengine.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A linear-phase or hybrid-phase equalizer, which runs its bands as one FIR through WDL_ConvolutionEngine_Div, with its late partitions on a worker thread and its
+ * spectral multiply-accumulates in SIMD, so that a full-range kernel is affordable at small block sizes.
+ * - The kernel is designed from the bands' magnitude responses on a background thread: the magnitudes of RBJ biquad prototypes are multiplied on a fine frequency grid,
+ *   given a phase, transformed to an impulse and windowed
+ * - SetPhaseBlend() moves the phase from linear, 0, to minimum phase, 1, found through the cepstrum, delayed by half the kernel either way, so the latency doesn't change.
+ *   In between, pre-ringing is traded for the phase shift of an analog style EQ
+ * - A new kernel goes to a spare engine, which the background thread primes with the last kernel's worth of input, so that the audio thread only crossfades to it,
+ *   rather than blocking in SetImpulse() or clicking
+ *
+ * Band changes can be made on any thread, e.g. from OnParamChange(). While a crossfade is running, further changes are designed once it finishes.
+ * Report GetLatency() with IPlugProcessor::SetLatency(). Add WDL/convoengine.cpp and WDL/fft.c to the project to use it
+ * @tparam MAXBANDS The maximum number of bands */
+template <int MAXBANDS = 8>
+class LinearPhaseEQ final
+{
+public:
+  enum class EBandType
+  {
+    kBell,
+    kLowShelf,
+    kHighShelf,
+    kLowPass,
+    kHighPass,
+    kNotch
+  };
+
+  struct Band
+  {
+    EBandType type = EBandType::kBell;
+    double freqCPS = 1000.;
+    double gainDB = 0.;
+    double Q = 0.7071;
+    bool enabled = false;
+  };
+
+  /** How often the background thread checks for band changes and finished crossfades */
+  static constexpr int kWorkerIntervalMs = 5;
+  /** The background thread hands a primed engine over once it is within this many blocks of the audio thread, which feeds it the rest */
+  static constexpr int kHandoverBlocks = 2;
+
+  /** @param nChans The number of channels, which all use the same kernel
+   * @param kernelSize The FIR length, a power of two. Longer kernels resolve lower frequencies, e.g. 8192 at 48kHz for bands down to 20Hz */
+  LinearPhaseEQ(int nChans = 2, int kernelSize = 8192)
+  : mNChans(nChans)
+  , mKernelSize(kernelSize)
+  {
+    assert((kernelSize & (kernelSize - 1)) == 0 && kernelSize * 4 <= WDL_FFT_MAX_SIZE);
+
+    WDL_fft_init();
+
+    for (auto& engine : mEngines)
+      engine.EnableWorkerThread(true);
+
+    mImpulse.SetNumChannels(1);
+    mThread = std::thread(&LinearPhaseEQ::WorkerLoop, this);
+  }
+
+  ~LinearPhaseEQ()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+
+    mWake.notify_one();
+
+    if (mThread.joinable())
+      mThread.join();
+  }
+
+  LinearPhaseEQ(const LinearPhaseEQ&) = delete;
+  LinearPhaseEQ& operator=(const LinearPhaseEQ&) = delete;
+
+  /** Set a band, on any thread. Doesn't block or allocate
+   * @param idx The band, less than MAXBANDS
+   * @param band The band's settings */
+  void SetBand(int idx, const Band& band)
+  {
+    assert(idx >= 0 && idx < MAXBANDS);
+
+    BandState& state = mBands[idx];
+    state.type.store(static_cast<int>(band.type), std::memory_order_relaxed);
+    state.freqCPS.store(band.freqCPS, std::memory_order_relaxed);
+    state.gainDB.store(band.gainDB, std::memory_order_relaxed);
+    state.Q.store(band.Q, std::memory_order_relaxed);
+    state.enabled.store(band.enabled, std::memory_order_relaxed);
+    mVersion.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @return A band's settings */
+  Band GetBand(int idx) const
+  {
+    const BandState& state = mBands[idx];
+    Band band;
+    band.type = static_cast<EBandType>(state.type.load(std::memory_order_relaxed));
+    band.freqCPS = state.freqCPS.load(std::memory_order_relaxed);
+    band.gainDB = state.gainDB.load(std::memory_order_relaxed);
+    band.Q = state.Q.load(std::memory_order_relaxed);
+    band.enabled = state.enabled.load(std::memory_order_relaxed);
+    return band;
+  }
+
+  /** Set the phase, on any thread
+   * @param blend 0 for linear phase, 1 for minimum phase, or in between for a hybrid */
+  void SetPhaseBlend(double blend)
+  {
+    mPhaseBlend.store(Clip(blend, 0., 1.), std::memory_order_relaxed);
+    mVersion.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @param seconds How long a crossfade to a new kernel takes, from the next Reset() */
+  void SetCrossfadeTime(double seconds) { mCrossfadeTime = std::max(seconds, 0.001); }
+
+  /** Design the kernel for the current bands, and clear. Allocates and blocks, so call from OnReset(), while the audio isn't processing
+   * @param sampleRate The sample rate
+   * @param blockSize The largest block ProcessBlock() will be called with */
+  void Reset(double sampleRate, int blockSize)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mSampleRate = sampleRate;
+    mBlockSize = std::max(blockSize, 1);
+    mCrossfadeLength = std::max(static_cast<int>(mCrossfadeTime * sampleRate), 1);
+
+    int ringSize = 1;
+
+    while (ringSize < 4 * (mKernelSize + kHandoverBlocks * mBlockSize))
+      ringSize <<= 1;
+
+    mRingMask = ringSize - 1;
+    mRings.assign(mNChans, std::vector<WDL_FFT_REAL>(ringSize, 0.));
+    mScratch.assign(mNChans * 2, std::vector<WDL_FFT_REAL>(std::max(mBlockSize, ringSize / 4), 0.));
+    mInPtrs.assign(mNChans, nullptr);
+    mWritePos.store(0, std::memory_order_relaxed);
+
+    mDesignedVersion = mVersion.load(std::memory_order_acquire);
+    DesignKernel();
+
+    mActive.store(0, std::memory_order_relaxed);
+    LoadKernel(mEngines[0]);
+    mEngines[1].Reset();
+    mFadePos = -1;
+    mSpareState.store(kSpareFree, std::memory_order_release);
+    mReady = mSampleRate > 0.;
+  }
+
+  /** Process a block, on the audio thread. The inputs and outputs can be the same buffers
+   * @param inputs nChans buffers of nFrames
+   * @param outputs nChans buffers of nFrames, delayed by GetLatency()
+   * @param nFrames The number of frames */
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+  {
+    if (!mReady)
+    {
+      for (auto c = 0; c < mNChans; c++)
+        memset(outputs[c], 0, nFrames * sizeof(sample));
+
+      return;
+    }
+
+    for (int pos = 0; pos < nFrames; pos += mBlockSize)
+    {
+      const int n = std::min(mBlockSize, nFrames - pos);
+      ProcessChunk(inputs, outputs, pos, n);
+    }
+  }
+
+  /** @return The latency in samples, half the kernel, for IPlugProcessor::SetLatency() */
+  int GetLatency() const { return mKernelSize / 2; }
+
+  /** @return \c true while crossfading to a new kernel. Only meaningful on the audio thread */
+  bool IsCrossfading() const { return mFadePos >= 0; }
+
+  /** The magnitude response of a band at a frequency, e.g. to draw the curve
+   * @return The linear gain */
+  static double BandMagnitude(const Band& band, double freqCPS, double sampleRate)
+  {
+    if (!band.enabled)
+      return 1.;
+
+    double b[3], a[3];
+    BandCoefficients(band, sampleRate, b, a);
+
+    const std::complex<double> z1 = std::polar(1., -2. * PI * freqCPS / sampleRate);
+    const std::complex<double> z2 = z1 * z1;
+    return std::abs((b[0] + b[1] * z1 + b[2] * z2) / (a[0] + a[1] * z1 + a[2] * z2));
+  }
+
+private:
+  enum ESpareState
+  {
+    kSpareFree,  // the background thread may design into the spare engine
+    kSpareReady, // primed, for the audio thread to crossfade to
+    kSpareFading // the audio thread is crossfading to it
+  };
+
+  struct BandState
+  {
+    std::atomic<int> type {0};
+    std::atomic<double> freqCPS {1000.};
+    std::atomic<double> gainDB {0.};
+    std::atomic<double> Q {0.7071};
+    std::atomic<bool> enabled {false};
+  };
+
+  /** RBJ cookbook biquad coefficients */
+  static void BandCoefficients(const Band& band, double sampleRate, double* b, double* a)
+  {
+    const double w0 = 2. * PI * Clip(band.freqCPS, 1., sampleRate * 0.499) / sampleRate;
+    const double c = std::cos(w0);
+    const double alpha = std::sin(w0) / (2. * std::max(band.Q, 0.01));
+    const double A = std::pow(10., band.gainDB / 40.);
+    const double sq = 2. * std::sqrt(A) * alpha;
+
+    a[0] = 1. + alpha; a[1] = -2. * c; a[2] = 1. - alpha;
+
+    switch (band.type)
+    {
+      case EBandType::kBell:
+        b[0] = 1. + alpha * A; b[1] = -2. * c; b[2] = 1. - alpha * A;
+        a[0] = 1. + alpha / A; a[2] = 1. - alpha / A;
+        break;
+      case EBandType::kLowShelf:
+        b[0] = A * ((A + 1.) - (A - 1.) * c + sq); b[1] = 2. * A * ((A - 1.) - (A + 1.) * c); b[2] = A * ((A + 1.) - (A - 1.) * c - sq);
+        a[0] = (A + 1.) + (A - 1.) * c + sq; a[1] = -2. * ((A - 1.) + (A + 1.) * c); a[2] = (A + 1.) + (A - 1.) * c - sq;
+        break;
+      case EBandType::kHighShelf:
+        b[0] = A * ((A + 1.) + (A - 1.) * c + sq); b[1] = -2. * A * ((A - 1.) + (A + 1.) * c); b[2] = A * ((A + 1.) + (A - 1.) * c - sq);
+        a[0] = (A + 1.) - (A - 1.) * c + sq; a[1] = 2. * ((A - 1.) - (A + 1.) * c); a[2] = (A + 1.) - (A - 1.) * c - sq;
+        break;
+      case EBandType::kLowPass:
+        b[0] = (1. - c) / 2.; b[1] = 1. - c; b[2] = (1. - c) / 2.;
+        break;
+      case EBandType::kHighPass:
+        b[0] = (1. + c) / 2.; b[1] = -(1. + c); b[2] = (1. + c) / 2.;
+        break;
+      case EBandType::kNotch:
+        b[0] = 1.; b[1] = -2. * c; b[2] = 1.;
+        break;
+    }
+  }
+
+  /** Design mKernel from the bands, on a grid four times the kernel size so the cepstrum doesn't alias. Called with mMutex held */
+  void DesignKernel()
+  {
+    const int n = mKernelSize;
+    const int m = n * 4;
+    const int mHalf = m / 2;
+    const double blend = mPhaseBlend.load(std::memory_order_relaxed);
+
+    Band bands[MAXBANDS];
+
+    for (auto i = 0; i < MAXBANDS; i++)
+      bands[i] = GetBand(i);
+
+    mMagnitudes.resize(mHalf + 1);
+    mPhases.assign(mHalf + 1, 0.);
+    mDesignBuf.resize(m);
+
+    for (auto k = 0; k <= mHalf; k++)
+    {
+      const double freq = k * mSampleRate / m;
+      double mag = 1.;
+
+      for (const auto& band : bands)
+        mag *= BandMagnitude(band, freq, mSampleRate);
+
+      mMagnitudes[k] = std::max(mag, 1e-6);
+    }
+
+    WDL_FFT_COMPLEX* pPacked = reinterpret_cast<WDL_FFT_COMPLEX*>(mDesignBuf.data());
+
+    if (blend > 0.)
+    {
+      // the real cepstrum of the log magnitude, folded onto positive quefrencies, transforms to the log of the minimum phase spectrum, whose imaginary part is its phase
+      PackSpectrum([&](int k) { return std::complex<double>(std::log(mMagnitudes[k]), 0.); });
+      WDL_real_fft(mDesignBuf.data(), m, 1);
+
+      for (auto i = 0; i < m; i++)
+      {
+        const double fold = (i == 0 || i == mHalf) ? 1. : (i < mHalf ? 2. : 0.);
+        mDesignBuf[i] = static_cast<WDL_FFT_REAL>(mDesignBuf[i] * fold / m);
+      }
+
+      WDL_real_fft(mDesignBuf.data(), m, 0);
+
+      for (auto k = 1; k < mHalf; k++)
+        mPhases[k] = blend * pPacked[WDL_fft_permute(mHalf, k)].im * 0.5;
+    }
+
+    // delay by half the kernel, then back to an impulse
+    PackSpectrum([&](int k) { return std::polar(mMagnitudes[k], mPhases[k] - PI * k * n / m); });
+    WDL_real_fft(mDesignBuf.data(), m, 1);
+
+    mKernel.resize(n);
+
+    for (auto i = 0; i < n; i++)
+    {
+      const double phase = 2. * PI * i / n;
+      const double blackman = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2. * phase);
+      mKernel[i] = static_cast<WDL_FFT_REAL>(mDesignBuf[i] / m * blackman);
+    }
+  }
+
+  /** Fill mDesignBuf with a spectrum in WDL_real_fft()'s packed order */
+  template <typename F>
+  void PackSpectrum(F&& bin)
+  {
+    const int mHalf = static_cast<int>(mDesignBuf.size()) / 2;
+    WDL_FFT_COMPLEX* pPacked = reinterpret_cast<WDL_FFT_COMPLEX*>(mDesignBuf.data());
+
+    mDesignBuf[0] = static_cast<WDL_FFT_REAL>(bin(0).real());
+    mDesignBuf[1] = static_cast<WDL_FFT_REAL>(bin(mHalf).real());
+
+    for (auto k = 1; k < mHalf; k++)
+    {
+      const std::complex<double> value = bin(k);
+      WDL_FFT_COMPLEX& packed = pPacked[WDL_fft_permute(mHalf, k)];
+      packed.re = static_cast<WDL_FFT_REAL>(value.real());
+      packed.im = static_cast<WDL_FFT_REAL>(value.imag());
+    }
+  }
+
+  void LoadKernel(WDL_ConvolutionEngine_Div& engine)
+  {
+    mImpulse.samplerate = mSampleRate;
+    mImpulse.SetLength(mKernelSize);
+    memcpy(mImpulse.impulses[0].Get(), mKernel.data(), mKernelSize * sizeof(WDL_FFT_REAL));
+    engine.SetImpulse(&mImpulse, 0, mBlockSize);
+    engine.Reset();
+  }
+
+  /** Feed an engine input from the rings, discarding its output. Returns false if the audio thread has overwritten the input meanwhile */
+  bool FeedFromRings(WDL_ConvolutionEngine_Div& engine, uint64_t start, uint64_t end, std::vector<WDL_FFT_REAL*>& ptrs, int scratchOffset)
+  {
+    const int chunk = static_cast<int>(mScratch[0].size());
+    const int ringSize = mRingMask + 1;
+
+    while (start < end)
+    {
+      const int n = static_cast<int>(std::min<uint64_t>(end - start, chunk));
+
+      for (auto c = 0; c < mNChans; c++)
+      {
+        WDL_FFT_REAL* pDst = mScratch[scratchOffset + c].data();
+        const WDL_FFT_REAL* pRing = mRings[c].data();
+
+        for (auto i = 0; i < n; i++)
+          pDst[i] = pRing[(start + i) & mRingMask];
+
+        ptrs[c] = pDst;
+      }
+
+      if (mWritePos.load(std::memory_order_acquire) - start > static_cast<uint64_t>(ringSize - mBlockSize))
+        return false;
+
+      engine.Add(ptrs.data(), n, mNChans);
+      engine.Advance(engine.Avail(n));
+      start += n;
+    }
+
+    return true;
+  }
+
+  void WorkerLoop()
+  {
+    std::vector<WDL_FFT_REAL*> ptrs(mNChans);
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mQuit)
+    {
+      mWake.wait_for(lock, std::chrono::milliseconds(kWorkerIntervalMs));
+
+      const int version = mVersion.load(std::memory_order_acquire);
+
+      if (mQuit || !mReady || version == mDesignedVersion || mSpareState.load(std::memory_order_acquire) != kSpareFree)
+        continue;
+
+      mDesignedVersion = version;
+      DesignKernel();
+
+      WDL_ConvolutionEngine_Div& spare = mEngines[1 - mActive.load(std::memory_order_acquire)];
+      LoadKernel(spare);
+
+      // prime the spare with the last kernel's worth of input, then catch up until the audio thread can feed it the rest
+      uint64_t fed = mWritePos.load(std::memory_order_acquire);
+      const uint64_t start = fed - std::min<uint64_t>(fed, mKernelSize);
+      bool primed = FeedFromRings(spare, start, fed, ptrs, mNChans);
+
+      for (auto i = 0; primed && i < 8; i++)
+      {
+        const uint64_t writePos = mWritePos.load(std::memory_order_acquire);
+
+        if (writePos - fed <= static_cast<uint64_t>(kHandoverBlocks * mBlockSize))
+          break;
+
+        primed = FeedFromRings(spare, fed, writePos, ptrs, mNChans);
+        fed = writePos;
+      }
+
+      if (!primed || mWritePos.load(std::memory_order_acquire) - fed > static_cast<uint64_t>(kHandoverBlocks * mBlockSize * 2))
+      {
+        // fell behind, try again next time
+        mDesignedVersion = -1;
+        continue;
+      }
+
+      mHandoverPos = fed;
+      mSpareState.store(kSpareReady, std::memory_order_release);
+    }
+  }
+
+  void ProcessChunk(sample** inputs, sample** outputs, int offset, int nFrames)
+  {
+    const int active = mActive.load(std::memory_order_relaxed);
+    WDL_ConvolutionEngine_Div& engine = mEngines[active];
+    WDL_ConvolutionEngine_Div& spare = mEngines[1 - active];
+    const uint64_t writePos = mWritePos.load(std::memory_order_relaxed);
+
+    if (mFadePos < 0 && mSpareState.load(std::memory_order_acquire) == kSpareReady)
+    {
+      // the input since the background thread stopped feeding the spare is still in the rings
+      for (uint64_t pos = mHandoverPos; pos < writePos;)
+      {
+        const int n = static_cast<int>(std::min<uint64_t>(writePos - pos, mBlockSize));
+
+        for (auto c = 0; c < mNChans; c++)
+        {
+          for (auto i = 0; i < n; i++)
+            mScratch[c][i] = mRings[c][(pos + i) & mRingMask];
+
+          mInPtrs[c] = mScratch[c].data();
+        }
+
+        spare.Add(mInPtrs.data(), n, mNChans);
+        spare.Advance(spare.Avail(n));
+        pos += n;
+      }
+
+      mSpareState.store(kSpareFading, std::memory_order_relaxed);
+      mFadePos = 0;
+    }
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      WDL_FFT_REAL* pRing = mRings[c].data();
+      WDL_FFT_REAL* pIn = mScratch[c].data();
+
+      for (auto i = 0; i < nFrames; i++)
+        pRing[(writePos + i) & mRingMask] = pIn[i] = static_cast<WDL_FFT_REAL>(inputs[c][offset + i]);
+
+      mInPtrs[c] = pIn;
+    }
+
+    mWritePos.store(writePos + nFrames, std::memory_order_release);
+
+    engine.Add(mInPtrs.data(), nFrames, mNChans);
+
+    if (mFadePos >= 0)
+      spare.Add(mInPtrs.data(), nFrames, mNChans);
+
+    const int avail = std::min(engine.Avail(nFrames), nFrames);
+    WDL_FFT_REAL** pWet = engine.Get();
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      sample* pOut = outputs[c] + offset;
+
+      for (auto i = 0; i < nFrames - avail; i++)
+        pOut[i] = 0.;
+
+      for (auto i = 0; i < avail; i++)
+        pOut[nFrames - avail + i] = pWet[c][i];
+    }
+
+    engine.Advance(avail);
+
+    if (mFadePos < 0)
+      return;
+
+    const int spareAvail = std::min(spare.Avail(nFrames), nFrames);
+    WDL_FFT_REAL** pSpareWet = spare.Get();
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      sample* pOut = outputs[c] + offset;
+
+      for (auto i = 0; i < nFrames; i++)
+      {
+        const double gain = std::min(static_cast<double>(mFadePos + i) / mCrossfadeLength, 1.);
+        const int j = i - (nFrames - spareAvail);
+        const sample wet = j >= 0 ? pSpareWet[c][j] : 0.;
+        pOut[i] += (wet - pOut[i]) * gain;
+      }
+    }
+
+    spare.Advance(spareAvail);
+    mFadePos += nFrames;
+
+    if (mFadePos >= mCrossfadeLength)
+    {
+      mFadePos = -1;
+      mActive.store(1 - active, std::memory_order_relaxed);
+      mSpareState.store(kSpareFree, std::memory_order_release);
+    }
+  }
+
+  const int mNChans;
+  const int mKernelSize;
+  double mCrossfadeTime = 0.05;
+
+  BandState mBands[MAXBANDS];
+  std::atomic<double> mPhaseBlend {0.};
+  std::atomic<int> mVersion {0};
+
+  // background thread, and Reset()
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::thread mThread;
+  bool mQuit = false;
+  int mDesignedVersion = -1;
+  std::vector<double> mMagnitudes;
+  std::vector<double> mPhases;
+  std::vector<WDL_FFT_REAL> mDesignBuf;
+  std::vector<WDL_FFT_REAL> mKernel;
+  WDL_ImpulseBuffer mImpulse;
+  /** Where the background thread stopped feeding the spare engine */
+  uint64_t mHandoverPos = 0;
+
+  // shared through mSpareState
+  WDL_ConvolutionEngine_Div mEngines[2];
+  std::atomic<int> mActive {0};
+  std::atomic<int> mSpareState {kSpareFree};
+  std::vector<std::vector<WDL_FFT_REAL>> mRings;
+  std::atomic<uint64_t> mWritePos {0};
+  int mRingMask = 0;
+
+  // audio thread
+  double mSampleRate = 0.;
+  int mBlockSize = DEFAULT_BLOCK_SIZE;
+  int mCrossfadeLength = 1;
+  int mFadePos = -1;
+  bool mReady = false;
+  /** The first mNChans for the audio thread, the rest for the background thread */
+  std::vector<std::vector<WDL_FFT_REAL>> mScratch;
+  std::vector<WDL_FFT_REAL*> mInPtrs;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,206 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief O(1) lookups of UI strings in a WDL/localize language pack, through a hashed table built when the language pack is loaded
+ */
+
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+
+#include "assocarray.h"
+
+#include "IPlugPlatform.h"
+
+// from WDL/localize/localize.h, which can't be included without the windows or SWELL types. Link WDL/localize/localize.cpp to use the table
+WDL_AssocArray<WDL_UINT64, char*>* WDL_LoadLanguagePack(const char* buf, const char* onlySec_name);
+WDL_AssocArray<WDL_UINT64, char*>* WDL_LoadLanguagePackInternal(const char* buf, WDL_StringKeyedArray<WDL_AssocArray<WDL_UINT64, char*>*>* dest, const char* onlySec_name,
+                                                               bool include_commented_lines, bool no_escape_strings, WDL_StringKeyedArray<char*>* extra_metadata);
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The 64 bit FNV-1 hash of a string and its terminating null, the id WDL/localize gives a string in a language pack. constexpr, so that it is computed at compile time for literals
+ * @param str The string
+ * @param hash The hash to continue from
+ * @return The hash */
+constexpr uint64_t LocalizeHash(const char* str, uint64_t hash = 0xCBF29CE484222325ULL)
+{
+  while (true)
+  {
+    hash = (hash * 0x100000001B3ULL) ^ static_cast<unsigned char>(*str);
+
+    if (!*str++)
+      return hash;
+  }
+}
+
+/** A process-wide table of the translations in a WDL/localize language pack, keyed by the hashes of a string and of its context (the langpack [section]), built once by Load().
+ * Looking a string up is a hash table probe, then another in the [common] section if the string's context hasn't got it, rather than __localizeFunc()'s binary search of each section.
+ * Use IPLUG_LOCALIZE() or ILocalizedString, whose hashes are computed at compile time. Format string verification and double null terminated strings are not supported.
+ * The translations are never freed, so the pointers it returns stay valid when another language pack is loaded. Use it from the main thread */
+class ILocalizeTable
+{
+public:
+  /** @return The table every plug-in instance in the process shares */
+  static ILocalizeTable& Get()
+  {
+    static ILocalizeTable sTable;
+    return sTable;
+  }
+
+  /** Load a language pack, replacing the current translations
+   * @param path The path of the language pack file
+   * @param loadGlobal \c true to also load it into WDL/localize, so that __LOCALIZE() and the menu and dialog localization use it, which parses the file a second time
+   * @return \c true if the file was read */
+  bool Load(const char* path, bool loadGlobal = true)
+  {
+    WDL_StringKeyedArray<WDL_AssocArray<WDL_UINT64, char*>*> sections(true, [](WDL_AssocArray<WDL_UINT64, char*>* pSection) { delete pSection; });
+
+    WDL_LoadLanguagePackInternal(path, &sections, nullptr, false, false, nullptr);
+
+    if (!sections.GetSize())
+      return false;
+
+    if (loadGlobal)
+      WDL_LoadLanguagePack(path, nullptr);
+
+    int nTranslations = 0;
+
+    for (int i = 0; i < sections.GetSize(); i++)
+      nTranslations += sections.Enumerate(i)->GetSize();
+
+    mTranslations.clear();
+    mTranslations.reserve(nTranslations);
+
+    for (int i = 0; i < sections.GetSize(); i++)
+    {
+      const char* sectionName = nullptr;
+      const WDL_AssocArray<WDL_UINT64, char*>* pSection = sections.Enumerate(i, &sectionName);
+      const uint64_t ctxHash = LocalizeHash(sectionName);
+
+      for (int j = 0; j < pSection->GetSize(); j++)
+      {
+        WDL_UINT64 strHash = 0;
+        const char* translation = pSection->Enumerate(j, &strHash);
+        mTranslations[Key(ctxHash, strHash)] = translation; // allocated by the language pack loader, which doesn't free them
+      }
+    }
+
+    mGeneration++;
+    return true;
+  }
+
+  /** Go back to the untranslated strings. A language pack loaded into WDL/localize by Load() stays loaded there */
+  void Clear()
+  {
+    mTranslations.clear();
+    mGeneration++;
+  }
+
+  /** Look a string up
+   * @param ctxHash LocalizeHash() of the context
+   * @param strHash LocalizeHash() of the string
+   * @param str The string, which is returned if there is no translation
+   * @return The translation, or str */
+  const char* Lookup(uint64_t ctxHash, uint64_t strHash, const char* str) const
+  {
+    if (mTranslations.empty())
+      return str;
+
+    auto it = mTranslations.find(Key(ctxHash, strHash));
+
+    if (it == mTranslations.end())
+      it = mTranslations.find(Key(kCommonHash, strHash));
+
+    return it != mTranslations.end() ? it->second : str;
+  }
+
+  /** @return Incremented each time the translations change, so that cached lookups can tell when they are out of date */
+  int GetGeneration() const { return mGeneration; }
+
+  /** @return The number of translations in the table */
+  int NTranslations() const { return static_cast<int>(mTranslations.size()); }
+
+private:
+  ILocalizeTable() = default;
+  ILocalizeTable(const ILocalizeTable&) = delete;
+  ILocalizeTable& operator=(const ILocalizeTable&) = delete;
+
+  static constexpr uint64_t Key(uint64_t ctxHash, uint64_t strHash)
+  {
+    return (ctxHash * 0x9E3779B97F4A7C15ULL) ^ strHash;
+  }
+
+  /** The hashes are already well mixed, so they are used as they are */
+  struct KeyHash
+  {
+    size_t operator()(uint64_t key) const { return static_cast<size_t>(key ^ (key >> 32)); }
+  };
+
+  static constexpr uint64_t kCommonHash = LocalizeHash("common");
+
+  std::unordered_map<uint64_t, const char*, KeyHash> mTranslations;
+  int mGeneration = 0;
+};
+
+/** A UI string, such as a control's label or a menu item, and its translation, which is looked up in ILocalizeTable the first time it is needed after the translations change.
+ * Keep one alongside the control or menu that shows it: Get() costs an integer comparison, rather than a lookup, on each redraw or menu build */
+class ILocalizedString
+{
+public:
+  /** @param str The string, which must outlive this, e.g. a literal
+   * @param ctx The context, the langpack [section] the string's translation is in */
+  constexpr ILocalizedString(const char* str, const char* ctx)
+  : mStr(str)
+  , mStrHash(LocalizeHash(str))
+  , mCtxHash(LocalizeHash(ctx))
+  {
+  }
+
+  /** @return The translation, or the string if it hasn't got one */
+  const char* Get() const
+  {
+    const ILocalizeTable& table = ILocalizeTable::Get();
+
+    if (mGeneration != table.GetGeneration())
+    {
+      mTranslation = table.Lookup(mCtxHash, mStrHash, mStr);
+      mGeneration = table.GetGeneration();
+    }
+
+    return mTranslation;
+  }
+
+  operator const char*() const { return Get(); }
+
+  /** @return \c true if the translation has changed since the last Get(), e.g. so that a control can update its label when another language pack has been loaded */
+  bool IsOutOfDate() const { return mGeneration != ILocalizeTable::Get().GetGeneration(); }
+
+  /** @return The untranslated string */
+  const char* GetSource() const { return mStr; }
+
+private:
+  const char* mStr;
+  uint64_t mStrHash;
+  uint64_t mCtxHash;
+  mutable const char* mTranslation = nullptr;
+  mutable int mGeneration = -1;
+};
+
+END_IPLUG_NAMESPACE
+
+/** Look up a string literal's translation in ILocalizeTable, with its hashes computed at compile time. The counterpart of WDL/localize's __LOCALIZE()
+ * @param str The string literal
+ * @param ctx The context literal, the langpack [section] */
+#define IPLUG_LOCALIZE(str, ctx) iplug::ILocalizeTable::Get().Lookup(std::integral_constant<uint64_t, iplug::LocalizeHash("" ctx "")>::value, std::integral_constant<uint64_t, iplug::LocalizeHash("" str "")>::value, "" str "")
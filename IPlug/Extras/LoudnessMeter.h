@@ -0,0 +1,457 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Loudness measurement to ITU-R BS.1770-4 and EBU R128: momentary, short-term and integrated loudness and true-peak level, and a sender for IVMeterControl
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+#include "IPlugUtilities.h"
+#include "ISender.h"
+#include "Oversampler.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Measures loudness to ITU-R BS.1770-4, with the momentary (400 ms), short-term (3 s) and gated integrated loudness of EBU R128, and the true-peak level.
+ * Each channel is K-weighted by the two biquads of BS.1770, two channels to a SIMD vector, and its mean square is summed over 100 ms steps. Everything else
+ * is done once per step: the momentary and short-term loudness from the last 4 and 30 steps, and the integrated loudness from a histogram of the loudness of
+ * every 400 ms block, in 0.1 LU bins that hold the number of blocks and their summed power, rather than from a list of every block since the last reset.
+ * So the integrated loudness costs the same after an hour as after a second, and is exact except for the blocks that share a bin with the relative gate,
+ * which are all kept, an error well under the 0.1 LU that EBU Tech 3341 allows.
+ *
+ * The true-peak level is the largest absolute value of each channel up-sampled 4x by OverSampler, with its linear phase FIR filters.
+ * Loudness is in LUFS and levels in dBTP, and either is -infinity before there is anything to measure.
+ * @tparam MAXNC The maximum number of channels */
+template <int MAXNC = 8>
+class LoudnessMeter
+{
+public:
+  /** The BS.1770 weights of each kind of channel, see SetChannelWeight() */
+  static constexpr double kWeightFront = 1.;
+  static constexpr double kWeightSurround = 1.41;
+  static constexpr double kWeightLFE = 0.;
+
+  static constexpr double kAbsoluteGateLUFS = -70.;
+  static constexpr double kRelativeGateLU = -10.;
+
+  /** @param nChans The number of channels measured, up to MAXNC. Each starts with kWeightFront
+   * @param measureTruePeak Set \c false to skip the 4x up-sampling, if the true-peak level isn't needed */
+  LoudnessMeter(int nChans = 2, bool measureTruePeak = true)
+  : mNChans(nChans)
+  , mMeasureTruePeak(measureTruePeak)
+  , mOverSampler(k4x, true, nChans, 1, EOverSamplingEngine::kFIR, EFIRQuality::kLow, k4x)
+  {
+    assert(nChans > 0 && nChans <= MAXNC);
+    std::fill(mWeights, mWeights + MAXNC, kWeightFront);
+    Reset(DEFAULT_SAMPLE_RATE);
+  }
+
+  LoudnessMeter(const LoudnessMeter&) = delete;
+  LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+
+  /** Set the weight of a channel, e.g. kWeightSurround for the surround channels and kWeightLFE for the LFE of a 5.1 layout */
+  void SetChannelWeight(int chan, double weight)
+  {
+    assert(chan >= 0 && chan < mNChans);
+    mWeights[chan] = weight;
+  }
+
+  /** Set up the filters for a sample rate, and clear everything that has been measured. Call this from OnReset(), it allocates the up-sampling buffers
+   * @param sampleRate The sample rate
+   * @param blockSize The largest block that ProcessBlock() will be called with, larger blocks are measured in pieces of this size */
+  void Reset(double sampleRate, int blockSize = DEFAULT_BLOCK_SIZE)
+  {
+    SetKWeighting(sampleRate);
+
+    mStepLength = std::max(1, static_cast<int>(std::round(sampleRate * 0.1)));
+    mMaxBlockSize = std::max(1, blockSize);
+
+    if (mMeasureTruePeak)
+      mOverSampler.Reset(mMaxBlockSize);
+
+    memset(mZ, 0, sizeof(mZ));
+    std::fill(mChanEnergy, mChanEnergy + MAXNC, 0.);
+    std::fill(mSteps, mSteps + kShortTermSteps, 0.);
+    mStepPos = 0;
+    mStepIdx = 0;
+    mMomentaryLUFS = mShortTermLUFS = -std::numeric_limits<double>::infinity();
+    ClearIntegrated();
+    mResetIntegrated.store(false, std::memory_order_relaxed);
+  }
+
+  /** Start the integrated loudness and maximum true-peak level again, from the next ProcessBlock(). This can be called from any thread, e.g. from a reset button */
+  void ResetIntegrated()
+  {
+    mResetIntegrated.store(true, std::memory_order_release);
+  }
+
+  /** Measure a block. This can be called on the realtime audio thread
+   * @param inputs The channels, nChans of them
+   * @param nFrames The number of frames */
+  void ProcessBlock(sample** inputs, int nFrames)
+  {
+    if (mResetIntegrated.exchange(false, std::memory_order_acq_rel))
+      ClearIntegrated();
+
+    for (int s = 0; s < nFrames;)
+    {
+      const int n = std::min(nFrames - s, mStepLength - mStepPos);
+      KWeightAndSum(inputs, s, n);
+      s += n;
+      mStepPos += n;
+
+      if (mStepPos == mStepLength)
+        EndStep();
+    }
+
+    if (mMeasureTruePeak)
+    {
+      for (int s = 0; s < nFrames; s += mMaxBlockSize)
+        MeasureTruePeak(inputs, s, std::min(nFrames - s, mMaxBlockSize));
+    }
+  }
+
+  /** @return The loudness of the last 400 ms, updated every 100 ms, in LUFS */
+  double GetMomentaryLUFS() const { return mMomentaryLUFS; }
+
+  /** @return The loudness of the last 3 s, updated every 100 ms, in LUFS */
+  double GetShortTermLUFS() const { return mShortTermLUFS; }
+
+  /** @return The gated loudness since the last reset, updated every 100 ms, in LUFS */
+  double GetIntegratedLUFS() const { return mIntegratedLUFS; }
+
+  /** @return The largest true-peak level since the last reset, in dBTP */
+  double GetTruePeakDB() const { return mTruePeak > 0. ? AmpToDB(mTruePeak) : -std::numeric_limits<double>::infinity(); }
+
+  /** @return The number of 100 ms steps measured since Reset(), which changes each time the loudness is updated */
+  uint64_t GetNumSteps() const { return mNumSteps; }
+
+private:
+  static constexpr int kMomentarySteps = 4;
+  static constexpr int kShortTermSteps = 30;
+  static constexpr int kBinsPerLU = 10;
+  static constexpr int kNumBins = 100 * kBinsPerLU; // -70 to +30 LUFS
+  static constexpr int kMaxPairs = (MAXNC + 1) / 2;
+
+  static double PowerToLUFS(double power)
+  {
+    return power > 0. ? -0.691 + 10. * std::log10(power) : -std::numeric_limits<double>::infinity();
+  }
+
+  /** The K-weighting filters of BS.1770, a high shelf for the acoustic effect of the head and the RLB high-pass, from the analog prototypes so that any sample rate
+   * gets the response that the coefficients given for 48 kHz have */
+  void SetKWeighting(double sampleRate)
+  {
+    const double pi = 3.14159265358979323846;
+
+    double K = std::tan(pi * 1681.974450955533 / sampleRate);
+    double Q = 0.7071752369554196;
+    const double Vh = std::pow(10., 3.999843853973347 / 20.);
+    const double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1. + K / Q + K * K;
+    mShelf[0] = (Vh + Vb * K / Q + K * K) / a0;
+    mShelf[1] = 2. * (K * K - Vh) / a0;
+    mShelf[2] = (Vh - Vb * K / Q + K * K) / a0;
+    mShelf[3] = 2. * (K * K - 1.) / a0;
+    mShelf[4] = (1. - K / Q + K * K) / a0;
+
+    K = std::tan(pi * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1. + K / Q + K * K;
+    mHighPass[0] = 1.;
+    mHighPass[1] = -2.;
+    mHighPass[2] = 1.;
+    mHighPass[3] = 2. * (K * K - 1.) / a0;
+    mHighPass[4] = (1. - K / Q + K * K) / a0;
+  }
+
+  /** K-weight n frames of each channel from offset, and add their squares to the channel's energy for this step */
+  void KWeightAndSum(sample** inputs, int offset, int n)
+  {
+    const V sb0 = Splat(mShelf[0]), sb1 = Splat(mShelf[1]), sb2 = Splat(mShelf[2]), sa1 = Splat(mShelf[3]), sa2 = Splat(mShelf[4]);
+    const V hb0 = Splat(mHighPass[0]), hb1 = Splat(mHighPass[1]), hb2 = Splat(mHighPass[2]), ha1 = Splat(mHighPass[3]), ha2 = Splat(mHighPass[4]);
+
+    for (int c = 0; c < mNChans; c += 2)
+    {
+      // an odd last channel is filtered in both lanes, and the second lane is ignored
+      const bool pair = c + 1 < mNChans;
+      const sample* pA = inputs[c] + offset;
+      const sample* pB = pair ? inputs[c + 1] + offset : pA;
+
+      V z1 = Load(mZ[0] + c), z2 = Load(mZ[1] + c), w1 = Load(mZ[2] + c), w2 = Load(mZ[3] + c);
+      V sum = Splat(0.);
+
+      for (int i = 0; i < n; i++)
+      {
+        const V x = Set(static_cast<double>(pA[i]), static_cast<double>(pB[i]));
+
+        // transposed direct form II
+        const V y = Add(Mul(sb0, x), z1);
+        z1 = Sub(Add(Mul(sb1, x), z2), Mul(sa1, y));
+        z2 = Sub(Mul(sb2, x), Mul(sa2, y));
+
+        const V k = Add(Mul(hb0, y), w1);
+        w1 = Sub(Add(Mul(hb1, y), w2), Mul(ha1, k));
+        w2 = Sub(Mul(hb2, y), Mul(ha2, k));
+
+        sum = Add(sum, Mul(k, k));
+      }
+
+      Store(mZ[0] + c, z1);
+      Store(mZ[1] + c, z2);
+      Store(mZ[2] + c, w1);
+      Store(mZ[3] + c, w2);
+
+      double sums[2];
+      Store(sums, sum);
+      mChanEnergy[c] += sums[0];
+
+      if (pair)
+        mChanEnergy[c + 1] += sums[1];
+    }
+  }
+
+  /** Update the loudness at the end of a 100 ms step */
+  void EndStep()
+  {
+    double energy = 0.;
+
+    for (int c = 0; c < mNChans; c++)
+    {
+      energy += mWeights[c] * mChanEnergy[c];
+      mChanEnergy[c] = 0.;
+    }
+
+    mSteps[mStepIdx] = energy;
+    mStepIdx = (mStepIdx + 1) % kShortTermSteps;
+    mStepPos = 0;
+    mNumSteps++;
+
+    double momentary = 0., shortTerm = 0.;
+
+    for (int i = 0; i < kShortTermSteps; i++)
+    {
+      const double step = mSteps[(mStepIdx + kShortTermSteps - 1 - i) % kShortTermSteps];
+      shortTerm += step;
+
+      if (i < kMomentarySteps)
+        momentary += step;
+    }
+
+    const double momentaryPower = momentary / (kMomentarySteps * static_cast<double>(mStepLength));
+    mMomentaryLUFS = PowerToLUFS(momentaryPower);
+    mShortTermLUFS = PowerToLUFS(shortTerm / (kShortTermSteps * static_cast<double>(mStepLength)));
+
+    // the gating blocks are the momentary windows, 400 ms overlapping by 75%, from the first one that is all signal
+    if (++mNumBlockSteps >= kMomentarySteps && mMomentaryLUFS >= kAbsoluteGateLUFS)
+    {
+      const int bin = std::min(kNumBins - 1, static_cast<int>((mMomentaryLUFS - kAbsoluteGateLUFS) * kBinsPerLU));
+      mBinCounts[bin]++;
+      mBinPowers[bin] += momentaryPower;
+      mIntegratedLUFS = ComputeIntegrated();
+    }
+
+    // the filters decay towards denormals in silence, which are slow on some CPUs
+    for (int i = 0; i < 4; i++)
+    {
+      for (int c = 0; c < mNChans; c++)
+      {
+        if (std::fabs(mZ[i][c]) < 1e-30)
+          mZ[i][c] = 0.;
+      }
+    }
+  }
+
+  /** @return The integrated loudness, the mean power of the blocks over the absolute gate that are also over the relative gate */
+  double ComputeIntegrated() const
+  {
+    uint64_t count = 0;
+    double power = 0.;
+
+    for (int b = 0; b < kNumBins; b++)
+    {
+      count += mBinCounts[b];
+      power += mBinPowers[b];
+    }
+
+    if (!count)
+      return -std::numeric_limits<double>::infinity();
+
+    const double relativeGate = PowerToLUFS(power / static_cast<double>(count)) + kRelativeGateLU;
+    const int gateBin = Clip(static_cast<int>(std::floor((relativeGate - kAbsoluteGateLUFS) * kBinsPerLU)), 0, kNumBins - 1);
+
+    count = 0;
+    power = 0.;
+
+    for (int b = gateBin; b < kNumBins; b++)
+    {
+      count += mBinCounts[b];
+      power += mBinPowers[b];
+    }
+
+    return count ? PowerToLUFS(power / static_cast<double>(count)) : -std::numeric_limits<double>::infinity();
+  }
+
+  void ClearIntegrated()
+  {
+    std::fill(mBinCounts, mBinCounts + kNumBins, 0u);
+    std::fill(mBinPowers, mBinPowers + kNumBins, 0.);
+    mNumBlockSteps = 0;
+    mIntegratedLUFS = -std::numeric_limits<double>::infinity();
+    mTruePeak = 0.;
+  }
+
+  /** Up-sample n frames of each channel from offset and raise the true-peak level to their peak */
+  void MeasureTruePeak(sample** inputs, int offset, int n)
+  {
+    sample* ptrs[MAXNC];
+
+    for (int c = 0; c < mNChans; c++)
+      ptrs[c] = inputs[c] + offset;
+
+    // there are no output channels, so nothing is down-sampled
+    mOverSampler.ProcessBlockContiguous(ptrs, nullptr, n, mNChans, 0, [this](sample** up, sample**, int nUp) {
+      for (int c = 0; c < mNChans; c++)
+        mTruePeak = std::max(mTruePeak, static_cast<double>(VectorPeak(up[c], nUp)));
+    });
+  }
+
+#pragma mark - Vectors of two channels
+
+#if defined IPLUG_SIMD_SSE2
+  using V = __m128d;
+  static inline V Load(const double* p) { return _mm_loadu_pd(p); }
+  static inline void Store(double* p, V v) { _mm_storeu_pd(p, v); }
+  static inline V Set(double a, double b) { return _mm_setr_pd(a, b); }
+  static inline V Splat(double d) { return _mm_set1_pd(d); }
+  static inline V Add(V a, V b) { return _mm_add_pd(a, b); }
+  static inline V Sub(V a, V b) { return _mm_sub_pd(a, b); }
+  static inline V Mul(V a, V b) { return _mm_mul_pd(a, b); }
+#elif defined IPLUG_SIMD_NEON
+  using V = float64x2_t;
+  static inline V Load(const double* p) { return vld1q_f64(p); }
+  static inline void Store(double* p, V v) { vst1q_f64(p, v); }
+  static inline V Set(double a, double b) { return vcombine_f64(vdup_n_f64(a), vdup_n_f64(b)); }
+  static inline V Splat(double d) { return vdupq_n_f64(d); }
+  static inline V Add(V a, V b) { return vaddq_f64(a, b); }
+  static inline V Sub(V a, V b) { return vsubq_f64(a, b); }
+  static inline V Mul(V a, V b) { return vmulq_f64(a, b); }
+#elif defined IPLUG_SIMD_WASM
+  using V = v128_t;
+  static inline V Load(const double* p) { return wasm_v128_load(p); }
+  static inline void Store(double* p, V v) { wasm_v128_store(p, v); }
+  static inline V Set(double a, double b) { return wasm_f64x2_make(a, b); }
+  static inline V Splat(double d) { return wasm_f64x2_splat(d); }
+  static inline V Add(V a, V b) { return wasm_f64x2_add(a, b); }
+  static inline V Sub(V a, V b) { return wasm_f64x2_sub(a, b); }
+  static inline V Mul(V a, V b) { return wasm_f64x2_mul(a, b); }
+#else
+  struct V { double v[2]; };
+  static inline V Load(const double* p) { return {{p[0], p[1]}}; }
+  static inline void Store(double* p, V v) { p[0] = v.v[0]; p[1] = v.v[1]; }
+  static inline V Set(double a, double b) { return {{a, b}}; }
+  static inline V Splat(double d) { return {{d, d}}; }
+  static inline V Add(V a, V b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1]}}; }
+  static inline V Sub(V a, V b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1]}}; }
+  static inline V Mul(V a, V b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1]}}; }
+#endif
+
+  const int mNChans;
+  const bool mMeasureTruePeak;
+  double mWeights[MAXNC];
+  double mShelf[5] = {}; // b0, b1, b2, a1, a2
+  double mHighPass[5] = {};
+  double mZ[4][kMaxPairs * 2] = {}; // the state of both filters of each channel, with the channels of a vector next to each other
+  double mChanEnergy[MAXNC] = {}; // the sum of the squares of each channel's K-weighted samples in this step
+  double mSteps[kShortTermSteps] = {}; // the weighted energy of the last 30 steps, a ring buffer
+  int mStepLength = 4800;
+  int mStepPos = 0;
+  int mStepIdx = 0;
+  uint64_t mNumSteps = 0;
+  int mNumBlockSteps = 0; // steps since the integrated loudness was reset, the first gating block is complete after 4
+  double mMomentaryLUFS = 0.;
+  double mShortTermLUFS = 0.;
+  double mIntegratedLUFS = 0.;
+  uint32_t mBinCounts[kNumBins] = {};
+  double mBinPowers[kNumBins] = {};
+  std::atomic<bool> mResetIntegrated {false};
+  int mMaxBlockSize = DEFAULT_BLOCK_SIZE;
+  double mTruePeak = 0.;
+  OverSampler<sample> mOverSampler;
+};
+
+/** ILoudnessSender measures loudness with a LoudnessMeter and sends it to an IVMeterControl<4>, with EResponse::Log, as four tracks: momentary, short-term and
+ * integrated loudness and the maximum true-peak level, each as the amplitude of its LUFS or dBTP value, so that the meter's dB scale reads LUFS.
+ * It is an ISnapshotSender, the control gets the latest values, published every 100 ms, without a queue or a lock
+ * @tparam MAXNC The maximum number of channels measured */
+template <int MAXNC = 8>
+class ILoudnessSender : public ISnapshotSender<4, float>
+{
+public:
+  enum EValue { kMomentary = 0, kShortTerm, kIntegrated, kTruePeak, kNumValues };
+
+  /** @param nChans The number of channels measured
+   * @param measureTruePeak Set \c false to skip the true-peak level, which is then sent as silence */
+  ILoudnessSender(int nChans = 2, bool measureTruePeak = true)
+  : mMeter(nChans, measureTruePeak)
+  {
+  }
+
+  /** See LoudnessMeter::Reset(). Call this from OnReset() */
+  void Reset(double sampleRate, int blockSize = DEFAULT_BLOCK_SIZE)
+  {
+    mMeter.Reset(sampleRate, blockSize);
+    mLastStep = 0;
+  }
+
+  /** Measure a block and publish the loudness if it has been updated. This can be called on the realtime audio thread
+   @param inputs the sample buffers to analyze
+   @param nFrames the number of sample frames in the input buffers
+   @param ctrlTag a control tag to indicate which control to send the data to. Note: if you don't supply the control tag here, you must use TransmitDataToControlsWithTags() and specify one or more tags there */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag)
+  {
+    mMeter.ProcessBlock(inputs, nFrames);
+
+    if (mMeter.GetNumSteps() == mLastStep)
+      return;
+
+    mLastStep = mMeter.GetNumSteps();
+
+    ISenderData<4, float>& d = GetWriteData();
+    d.ctrlTag = ctrlTag;
+    d.nChans = kNumValues;
+    d.chanOffset = 0;
+    d.vals[kMomentary] = static_cast<float>(DBToAmp(mMeter.GetMomentaryLUFS()));
+    d.vals[kShortTerm] = static_cast<float>(DBToAmp(mMeter.GetShortTermLUFS()));
+    d.vals[kIntegrated] = static_cast<float>(DBToAmp(mMeter.GetIntegratedLUFS()));
+    d.vals[kTruePeak] = static_cast<float>(DBToAmp(mMeter.GetTruePeakDB()));
+    PublishData();
+  }
+
+  /** @return The meter, e.g. to set the channel weights, to reset the integrated loudness, or to read the values in LUFS */
+  LoudnessMeter<MAXNC>& GetMeter() { return mMeter; }
+
+private:
+  LoudnessMeter<MAXNC> mMeter;
+  uint64_t mLastStep = 0;
+};
+
+END_IPLUG_NAMESPACE
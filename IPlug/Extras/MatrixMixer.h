@@ -0,0 +1,264 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc MatrixMixer
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+#include "heapbuf.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Mixes N input channels to M output channels through a matrix of gains, for downmixes, upmixes, panning laws or ambisonic rotations, e.g. 9.1.6 to 5.1
+ * or between 16 channel 3rd order ambisonic signals. Every output channel is the sum of the inputs, each scaled by its gain in the matrix.
+ * - Zero gains are skipped, so a sparse matrix, such as a downmix, costs only its non-zero entries
+ * - Where the gains are constant over a block, unity gains are copies or adds, and the others a SIMD multiply-add per entry
+ * - A gain change is ramped per sample over the ramp length, rather than stepping, which zips. Only the entries that change are ramped
+ *
+ * The gains can be set on the audio thread, they take effect at the next Process(). The inputs and outputs may be the same buffers.
+ * @code
+ * // 5.1 in the SMPTE order L R C LFE Ls Rs, to stereo as ITU-R BS.775 has it, without the LFE
+ * MatrixMixer<> mDownmix {6, 2};
+ * const double g = 0.7071;
+ * const double gains[] = { 1., 0., g, 0., g, 0.,
+ *                          0., 1., g, 0., 0., g };
+ * mDownmix.SetMatrix(gains);
+ * @endcode */
+template<typename T = sample>
+class MatrixMixer
+{
+public:
+  /** @param nInputs The number of input channels
+   * @param nOutputs The number of output channels
+   * @param maxBlockSize The most samples Process() will be given at once, e.g. IPlugProcessor::GetBlockSize()
+   * @param rampLength How many samples a change of gain is ramped over, 0 to step */
+  MatrixMixer(int nInputs = 2, int nOutputs = 2, int maxBlockSize = DEFAULT_BLOCK_SIZE, int rampLength = 64)
+  {
+    Resize(nInputs, nOutputs, maxBlockSize, rampLength);
+  }
+
+  /** Reallocate, set the identity matrix and end any ramp. Do this outside of the audio callback, e.g. in OnReset(). See the constructor for the arguments */
+  void Resize(int nInputs, int nOutputs, int maxBlockSize, int rampLength)
+  {
+    mNInputs = std::max(nInputs, 1);
+    mNOutputs = std::max(nOutputs, 1);
+    mMaxBlockSize = std::max(maxBlockSize, 1);
+    mRampLength = std::max(rampLength, 0);
+
+    const int nGains = mNInputs * mNOutputs;
+    mTarget.Resize(nGains);
+    mCurrent.Resize(nGains);
+    mStep.Resize(nGains);
+    mScratch.Resize(mNInputs * mMaxBlockSize);
+    mInputPtrs.Resize(mNInputs);
+
+    SetIdentity();
+    Reset();
+  }
+
+  /** Jump to the target gains, ending any ramp */
+  void Reset()
+  {
+    memcpy(mCurrent.Get(), mTarget.Get(), mTarget.GetSize() * sizeof(T));
+    memset(mStep.Get(), 0, mStep.GetSize() * sizeof(T));
+    mRampRemaining = 0;
+    mChanged = false;
+  }
+
+  /** Set the gain from one input to one output */
+  void SetGain(int outputIdx, int inputIdx, double gain)
+  {
+    assert(outputIdx >= 0 && outputIdx < mNOutputs && inputIdx >= 0 && inputIdx < mNInputs);
+
+    mTarget.Get()[outputIdx * mNInputs + inputIdx] = static_cast<T>(gain);
+    mChanged = true;
+  }
+
+  /** @return The target gain from one input to one output, which the gain in use may still be ramping to */
+  double GetGain(int outputIdx, int inputIdx) const { return mTarget.Get()[outputIdx * mNInputs + inputIdx]; }
+
+  /** Set every gain
+   * @param gains mNOutputs rows of mNInputs gains, the first row being the gains of the inputs to the first output */
+  void SetMatrix(const double* gains)
+  {
+    for (auto i = 0; i < mTarget.GetSize(); i++)
+      mTarget.Get()[i] = static_cast<T>(gains[i]);
+
+    mChanged = true;
+  }
+
+  /** Route each input to the output with the same index at unity gain. Outputs beyond the number of inputs are silent */
+  void SetIdentity()
+  {
+    for (auto o = 0; o < mNOutputs; o++)
+    {
+      for (auto i = 0; i < mNInputs; i++)
+        mTarget.Get()[o * mNInputs + i] = o == i ? T(1) : T(0);
+    }
+
+    mChanged = true;
+  }
+
+  int NInputs() const { return mNInputs; }
+
+  int NOutputs() const { return mNOutputs; }
+
+  int GetMaxBlockSize() const { return mMaxBlockSize; }
+
+  /** Mix a block
+   * @param inputs mNInputs input channels
+   * @param outputs mNOutputs output channels, which may be input channels
+   * @param nFrames The number of samples in each channel, no more than the maximum block size */
+  void Process(T** inputs, T** outputs, int nFrames)
+  {
+    assert(nFrames <= mMaxBlockSize);
+
+    if (mChanged)
+      StartRamp();
+
+    T** pInputs = GetInputs(inputs, outputs, nFrames);
+    int offset = 0;
+
+    if (mRampRemaining > 0)
+    {
+      const int rampFrames = std::min(nFrames, mRampRemaining);
+      Mix(pInputs, outputs, 0, rampFrames, true);
+      mRampRemaining -= rampFrames;
+      offset = rampFrames;
+
+      if (mRampRemaining == 0)
+        Reset();
+      else
+      {
+        T* pCurrent = mCurrent.Get();
+        const T* pStep = mStep.Get();
+
+        for (auto i = 0; i < mCurrent.GetSize(); i++)
+          pCurrent[i] += pStep[i] * static_cast<T>(rampFrames);
+      }
+    }
+
+    if (offset < nFrames)
+      Mix(pInputs, outputs, offset, nFrames - offset, false);
+  }
+
+private:
+  void StartRamp()
+  {
+    mChanged = false;
+
+    if (mRampLength == 0)
+    {
+      Reset();
+      return;
+    }
+
+    const T* pTarget = mTarget.Get();
+    const T* pCurrent = mCurrent.Get();
+    T* pStep = mStep.Get();
+
+    // a ramp that is under way restarts from where it has got to
+    for (auto i = 0; i < mTarget.GetSize(); i++)
+      pStep[i] = (pTarget[i] - pCurrent[i]) / static_cast<T>(mRampLength);
+
+    mRampRemaining = mRampLength;
+  }
+
+  /** @return The inputs, copied to scratch buffers if any of them are also outputs, which are written before all the inputs have been read */
+  T** GetInputs(T** inputs, T** outputs, int nFrames)
+  {
+    bool aliased = false;
+
+    for (auto o = 0; o < mNOutputs && !aliased; o++)
+    {
+      for (auto i = 0; i < mNInputs && !aliased; i++)
+        aliased = outputs[o] == inputs[i];
+    }
+
+    if (!aliased)
+      return inputs;
+
+    for (auto i = 0; i < mNInputs; i++)
+    {
+      mInputPtrs.Get()[i] = mScratch.Get() + i * mMaxBlockSize;
+      VectorCopy(mInputPtrs.Get()[i], inputs[i], nFrames);
+    }
+
+    return mInputPtrs.Get();
+  }
+
+  void Mix(T** inputs, T** outputs, int offset, int nFrames, bool ramping)
+  {
+    const T* pCurrent = mCurrent.Get();
+    const T* pStep = mStep.Get();
+
+    for (auto o = 0; o < mNOutputs; o++)
+    {
+      T* pOut = outputs[o] + offset;
+      const T* pGains = pCurrent + o * mNInputs;
+      const T* pSteps = pStep + o * mNInputs;
+      bool written = false;
+
+      for (auto i = 0; i < mNInputs; i++)
+      {
+        const T gain = pGains[i];
+        const T step = ramping ? pSteps[i] : T(0);
+
+        if (gain == T(0) && step == T(0))
+          continue;
+
+        const T* pIn = inputs[i] + offset;
+
+        if (step == T(0) && gain == T(1))
+        {
+          if (written)
+            VectorAccumulate(pOut, pIn, nFrames);
+          else
+            VectorCopy(pOut, pIn, nFrames);
+        }
+        else
+        {
+          if (!written)
+            VectorZero(pOut, nFrames);
+
+          VectorMultiplyAccumulate(pOut, pIn, nFrames, gain, step);
+        }
+
+        written = true;
+      }
+
+      if (!written)
+        VectorZero(pOut, nFrames);
+    }
+  }
+
+  WDL_TypedBuf<T> mTarget;
+  WDL_TypedBuf<T> mCurrent;
+  WDL_TypedBuf<T> mStep; // per sample, while ramping
+  WDL_TypedBuf<T> mScratch;
+  WDL_TypedBuf<T*> mInputPtrs;
+  int mNInputs = 0;
+  int mNOutputs = 0;
+  int mMaxBlockSize = 0;
+  int mRampLength = 0;
+  int mRampRemaining = 0;
+  bool mChanged = false;
+};
+
+END_IPLUG_NAMESPACE
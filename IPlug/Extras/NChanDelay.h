@@ -1,15 +1,29 @@
 /*
  ==============================================================================
- 
- This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers. 
- 
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
  See LICENSE.txt for  more info.
- 
+
  ==============================================================================
 */
 
 #pragma once
+
+/**
+ * @file
+ * @brief Multi-channel delay lines: NChanDelayLine for latency compensation and NChanModDelayLine for fractional, modulated delays
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
 #include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
+#include "IPlugUtilities.h"
+#include "heapbuf.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -23,49 +37,495 @@ public:
   , mNOutChans(nOutputChans)
   {}
 
+  /** Set the delay and clear the buffer. A shorter delay than before doesn't reallocate */
   void SetDelayTime(int delayTimeSamples)
   {
     mDTSamples = delayTimeSamples;
-    mBuffer.Resize(mNInChans * delayTimeSamples);
+    mBuffer.Resize(mNInChans * delayTimeSamples, false);
     mWriteAddress = 0;
     ClearBuffer();
   }
 
+  int GetDelayTime() const { return static_cast<int>(mDTSamples); }
+
   void ClearBuffer()
   {
-    memset(mBuffer.Get(), 0, mNInChans * mDTSamples * sizeof(T));
+    if (mDTSamples)
+      memset(mBuffer.Get(), 0, mNInChans * mDTSamples * sizeof(T));
   }
 
   void ProcessBlock(T** inputs, T** outputs, int nFrames)
   {
     T* buffer = mBuffer.Get();
+    const int nChans = std::min(mNInChans, mNOutChans);
+
+    if (!mDTSamples)
+    {
+      for (auto c = 0; c < nChans; c++)
+      {
+        if (outputs[c] != inputs[c])
+          memcpy(outputs[c], inputs[c], nFrames * sizeof(T));
+      }
+
+      return;
+    }
 
-    for (auto s = 0 ; s < nFrames; ++s)
+    // each channel's ring holds the last mDTSamples inputs, oldest at mWriteAddress, so a run of samples up to the end of the ring is swapped with the buffers in one go
+    for (auto c = 0; c < nChans; c++)
     {
-      int32_t readAddress = mWriteAddress - mDTSamples;
-      readAddress %= mDTSamples;
+      T* pRing = buffer + c * mDTSamples;
+      const T* pIn = inputs[c];
+      T* pOut = outputs[c];
+      uint32_t writeAddress = mWriteAddress;
 
-      for (auto c = 0; c < mNInChans; c++)
+      for (auto s = 0; s < nFrames;)
       {
-        if (c < mNOutChans)
+        const int n = std::min(nFrames - s, static_cast<int>(mDTSamples - writeAddress));
+
+        if (pIn == pOut)
+          std::swap_ranges(pOut + s, pOut + s + n, pRing + writeAddress);
+        else
         {
-          T input = inputs[c][s];
-          const int offset = c * mDTSamples;
-          outputs[c][s] = buffer[offset + readAddress];
-          buffer[offset + mWriteAddress] = input;
+          memcpy(pOut + s, pRing + writeAddress, n * sizeof(T));
+          memcpy(pRing + writeAddress, pIn + s, n * sizeof(T));
         }
-      }
 
-      mWriteAddress++;
-      mWriteAddress %= mDTSamples;
+        s += n;
+        writeAddress = (writeAddress + n) % mDTSamples;
+      }
     }
+
+    mWriteAddress = static_cast<uint32_t>((mWriteAddress + static_cast<uint64_t>(nFrames)) % mDTSamples);
   }
 
 private:
   WDL_TypedBuf<T> mBuffer;
-  uint32_t mNInChans, mNOutChans;
+  int mNInChans, mNOutChans;
   uint32_t mWriteAddress = 0;
   uint32_t mDTSamples = 0;
 } WDL_FIXALIGN;
 
+/** A multi-channel delay line with fractional delay times that can be modulated per sample, for chorus, flanger and vibrato effects and lookahead processors.
+ * All channels share one allocation, each channel is a power of two ring followed by copies of its first few samples, so that the taps an interpolator needs are always contiguous.
+ * Blocks are written with at most two copies per channel, and read back with Read() at one or more delays. With a fixed delay the interpolation is a short FIR, which is vectorized
+ * @see NChanDelayLine for integer latency compensation */
+template<typename T>
+class NChanModDelayLine
+{
+public:
+  enum EInterpolation
+  {
+    kLinear = 0,
+    kLagrange, // third order, four taps
+    kAllpass, // first order, flat magnitude response but only suitable for slowly modulated delays
+    kNumInterpolations
+  };
+
+  /** @param nChans The number of channels
+   * @param maxDelaySamples The longest delay Read() will be asked for, in samples
+   * @param maxBlockSize The most samples Write() will be given at once, ProcessBlock() splits longer blocks */
+  NChanModDelayLine(int nChans = 2, int maxDelaySamples = 4096, int maxBlockSize = 512)
+  {
+    Resize(nChans, maxDelaySamples, maxBlockSize);
+  }
+
+  /** Reallocate and clear the buffer, do this outside of the audio callback. See the constructor for the arguments */
+  void Resize(int nChans, int maxDelaySamples, int maxBlockSize)
+  {
+    mNChans = std::max(nChans, 1);
+    mMaxDelay = std::max(maxDelaySamples, 1);
+    mMaxBlockSize = std::max(maxBlockSize, 1);
+
+    mSize = 1;
+
+    while (mSize < mMaxDelay + mMaxBlockSize + kGuard)
+      mSize <<= 1;
+
+    mBuffer.Resize(mNChans * Stride());
+    mAllpassState.Resize(mNChans);
+    Reset();
+  }
+
+  /** Clear the delayed signal and the interpolator's state */
+  void Reset()
+  {
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(T));
+    memset(mAllpassState.Get(), 0, mAllpassState.GetSize() * sizeof(double));
+    mWritePos = 0;
+  }
+
+  void SetInterpolation(EInterpolation interpolation) { mInterpolation = interpolation; }
+
+  EInterpolation GetInterpolation() const { return mInterpolation; }
+
+  int GetMaxDelay() const { return mMaxDelay; }
+
+  int GetMaxBlockSize() const { return mMaxBlockSize; }
+
+  /** Append a block to the delay line
+   * @param inputs mNChans input channels
+   * @param nFrames The number of samples in each channel, no more than the maximum block size */
+  void Write(T** inputs, int nFrames)
+  {
+    assert(nFrames <= mMaxBlockSize);
+
+    const int n1 = std::min(nFrames, mSize - mWritePos);
+
+    for (auto c = 0; c < mNChans; c++)
+    {
+      T* pRing = GetChannel(c);
+      memcpy(pRing + mWritePos, inputs[c], n1 * sizeof(T));
+      memcpy(pRing, inputs[c] + n1, (nFrames - n1) * sizeof(T));
+      memcpy(pRing + mSize, pRing, kGuard * sizeof(T));
+    }
+
+    mWritePos = (mWritePos + nFrames) & (mSize - 1);
+  }
+
+  /** Read the block that was just written at a fixed delay
+   * @param outputs mNChans output channels, these can be the same as the inputs that were written
+   * @param nFrames The number of samples in each channel, as passed to the last Write()
+   * @param delaySamples The delay in samples, clamped between 1 and the maximum delay */
+  void Read(T** outputs, int nFrames, double delaySamples)
+  {
+    const double delay = Clip(delaySamples, 1., static_cast<double>(mMaxDelay));
+    const int base = mWritePos - nFrames + mSize;
+
+    if (mInterpolation == kAllpass)
+    {
+      // delay = i + frac with frac in [0.5, 1.5), which keeps the allpass pole away from -1
+      const int i = static_cast<int>(delay - 0.5);
+      const double frac = delay - i;
+      const double a = (1. - frac) / (1. + frac);
+
+      ForEachSegment(outputs, (base - i - 1) & (mSize - 1), nFrames, [&](int c, const T* pTaps, T* pOut, int n) {
+        double y1 = mAllpassState.Get()[c];
+
+        for (auto s = 0; s < n; s++)
+        {
+          y1 = a * (pTaps[s + 1] - y1) + pTaps[s];
+          pOut[s] = static_cast<T>(y1);
+        }
+
+        mAllpassState.Get()[c] = y1;
+      });
+
+      return;
+    }
+
+    // the position of the first output behind the newest sample is tap + frac, with frac in [0, 1)
+    const int whole = static_cast<int>(std::ceil(delay));
+    const T frac = static_cast<T>(whole - delay);
+    const int tap = base - whole;
+
+    if (mInterpolation == kLagrange)
+    {
+      T coeffs[4];
+      LagrangeCoeffs(frac, coeffs);
+
+      ForEachSegment(outputs, (tap - 1) & (mSize - 1), nFrames, [&](int, const T* pTaps, T* pOut, int n) {
+        FIR4(pTaps, pOut, n, coeffs);
+      });
+    }
+    else
+    {
+      ForEachSegment(outputs, tap & (mSize - 1), nFrames, [&](int, const T* pTaps, T* pOut, int n) {
+        FIR2(pTaps, pOut, n, T(1) - frac, frac);
+      });
+    }
+  }
+
+  /** Read the block that was just written with a delay that changes every sample
+   * @param outputs mNChans output channels, these can be the same as the inputs that were written
+   * @param nFrames The number of samples in each channel, as passed to the last Write()
+   * @param pDelaySamples nFrames delays in samples, shared by all channels and clamped between 1 and the maximum delay */
+  void Read(T** outputs, int nFrames, const T* pDelaySamples)
+  {
+    const int mask = mSize - 1;
+    const double base = static_cast<double>(mWritePos - nFrames + 2 * mSize);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const double delay = Clip(static_cast<double>(pDelaySamples[s]), 1., static_cast<double>(mMaxDelay));
+
+      if (mInterpolation == kAllpass)
+      {
+        const int i = static_cast<int>(delay - 0.5);
+        const double frac = delay - i;
+        const double a = (1. - frac) / (1. + frac);
+        const int tap = (static_cast<int>(base) + s - i - 1) & mask;
+
+        for (auto c = 0; c < mNChans; c++)
+        {
+          const T* pTaps = GetChannel(c) + tap;
+          double& y1 = mAllpassState.Get()[c];
+          y1 = a * (pTaps[1] - y1) + pTaps[0];
+          outputs[c][s] = static_cast<T>(y1);
+        }
+
+        continue;
+      }
+
+      const double pos = base + s - delay;
+      const int whole = static_cast<int>(pos);
+      const T frac = static_cast<T>(pos - whole);
+
+      if (mInterpolation == kLagrange)
+      {
+        T coeffs[4];
+        LagrangeCoeffs(frac, coeffs);
+        const int tap = (whole - 1) & mask;
+
+        for (auto c = 0; c < mNChans; c++)
+        {
+          const T* pTaps = GetChannel(c) + tap;
+          outputs[c][s] = coeffs[0] * pTaps[0] + coeffs[1] * pTaps[1] + coeffs[2] * pTaps[2] + coeffs[3] * pTaps[3];
+        }
+      }
+      else
+      {
+        const int tap = whole & mask;
+
+        for (auto c = 0; c < mNChans; c++)
+        {
+          const T* pTaps = GetChannel(c) + tap;
+          outputs[c][s] = pTaps[0] + frac * (pTaps[1] - pTaps[0]);
+        }
+      }
+    }
+  }
+
+  /** Delay a block of any size by a fixed amount
+   * @param inputs mNChans input channels
+   * @param outputs mNChans output channels, can be the same as the inputs
+   * @param nFrames The number of samples in each channel
+   * @param delaySamples The delay in samples, see Read() */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, double delaySamples)
+  {
+    ProcessChunks(inputs, outputs, nFrames, [this, delaySamples](T** pOutputs, int n, int) { Read(pOutputs, n, delaySamples); });
+  }
+
+  /** Delay a block of any size by an amount that changes every sample
+   * @param inputs mNChans input channels
+   * @param outputs mNChans output channels, can be the same as the inputs
+   * @param nFrames The number of samples in each channel
+   * @param pDelaySamples nFrames delays in samples, see Read() */
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, const T* pDelaySamples)
+  {
+    ProcessChunks(inputs, outputs, nFrames, [this, pDelaySamples](T** pOutputs, int n, int offset) { Read(pOutputs, n, pDelaySamples + offset); });
+  }
+
+private:
+  static constexpr int kGuard = 3; // samples copied past the end of each ring, enough for the four Lagrange taps
+
+  int Stride() const { return mSize + kGuard; }
+
+  T* GetChannel(int c) { return mBuffer.Get() + c * Stride(); }
+
+  static void LagrangeCoeffs(T frac, T* pCoeffs)
+  {
+    const T fp1 = frac + T(1), fm1 = frac - T(1), fm2 = frac - T(2);
+    pCoeffs[0] = -frac * fm1 * fm2 / T(6);
+    pCoeffs[1] = fp1 * fm1 * fm2 / T(2);
+    pCoeffs[2] = -fp1 * frac * fm2 / T(2);
+    pCoeffs[3] = fp1 * frac * fm1 / T(6);
+  }
+
+  /** Call func(channel, pTaps, pOutput, n) for the runs of a block that don't cross the end of the rings, pTaps[s] being the first tap for output s */
+  template <typename F>
+  void ForEachSegment(T** outputs, int tap, int nFrames, F&& func)
+  {
+    for (auto s = 0; s < nFrames;)
+    {
+      const int n = std::min(nFrames - s, mSize - tap);
+
+      for (auto c = 0; c < mNChans; c++)
+        func(c, GetChannel(c) + tap, outputs[c] + s, n);
+
+      s += n;
+      tap = 0;
+    }
+  }
+
+  template <typename F>
+  void ProcessChunks(T** inputs, T** outputs, int nFrames, F&& read)
+  {
+    T* pIn[kMaxChunkChans];
+    T* pOut[kMaxChunkChans];
+    const int nChans = std::min(mNChans, static_cast<int>(kMaxChunkChans));
+    assert(mNChans <= kMaxChunkChans);
+
+    for (auto offset = 0; offset < nFrames; offset += mMaxBlockSize)
+    {
+      const int n = std::min(mMaxBlockSize, nFrames - offset);
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        pIn[c] = inputs[c] + offset;
+        pOut[c] = outputs[c] + offset;
+      }
+
+      Write(pIn, n);
+      read(pOut, n, offset);
+    }
+  }
+
+  static constexpr int kMaxChunkChans = 64;
+
+  template <typename U>
+  static void FIR2(const U* pTaps, U* pOut, int n, U c0, U c1)
+  {
+    for (auto s = 0; s < n; s++)
+      pOut[s] = c0 * pTaps[s] + c1 * pTaps[s + 1];
+  }
+
+  template <typename U>
+  static void FIR4(const U* pTaps, U* pOut, int n, const U* pCoeffs)
+  {
+    for (auto s = 0; s < n; s++)
+      pOut[s] = pCoeffs[0] * pTaps[s] + pCoeffs[1] * pTaps[s + 1] + pCoeffs[2] * pTaps[s + 2] + pCoeffs[3] * pTaps[s + 3];
+  }
+
+#if defined IPLUG_SIMD_SSE2
+  static void FIR2(const float* pTaps, float* pOut, int n, float c0, float c1)
+  {
+    const __m128 v0 = _mm_set1_ps(c0), v1 = _mm_set1_ps(c1);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+      _mm_storeu_ps(pOut + s, _mm_add_ps(_mm_mul_ps(v0, _mm_loadu_ps(pTaps + s)), _mm_mul_ps(v1, _mm_loadu_ps(pTaps + s + 1))));
+
+    FIR2<float>(pTaps + s, pOut + s, n - s, c0, c1);
+  }
+
+  static void FIR4(const float* pTaps, float* pOut, int n, const float* pCoeffs)
+  {
+    const __m128 v0 = _mm_set1_ps(pCoeffs[0]), v1 = _mm_set1_ps(pCoeffs[1]), v2 = _mm_set1_ps(pCoeffs[2]), v3 = _mm_set1_ps(pCoeffs[3]);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+    {
+      const __m128 a = _mm_add_ps(_mm_mul_ps(v0, _mm_loadu_ps(pTaps + s)), _mm_mul_ps(v1, _mm_loadu_ps(pTaps + s + 1)));
+      const __m128 b = _mm_add_ps(_mm_mul_ps(v2, _mm_loadu_ps(pTaps + s + 2)), _mm_mul_ps(v3, _mm_loadu_ps(pTaps + s + 3)));
+      _mm_storeu_ps(pOut + s, _mm_add_ps(a, b));
+    }
+
+    FIR4<float>(pTaps + s, pOut + s, n - s, pCoeffs);
+  }
+
+  static void FIR2(const double* pTaps, double* pOut, int n, double c0, double c1)
+  {
+    const __m128d v0 = _mm_set1_pd(c0), v1 = _mm_set1_pd(c1);
+    int s = 0;
+
+    for (; s + 2 <= n; s += 2)
+      _mm_storeu_pd(pOut + s, _mm_add_pd(_mm_mul_pd(v0, _mm_loadu_pd(pTaps + s)), _mm_mul_pd(v1, _mm_loadu_pd(pTaps + s + 1))));
+
+    FIR2<double>(pTaps + s, pOut + s, n - s, c0, c1);
+  }
+
+  static void FIR4(const double* pTaps, double* pOut, int n, const double* pCoeffs)
+  {
+    const __m128d v0 = _mm_set1_pd(pCoeffs[0]), v1 = _mm_set1_pd(pCoeffs[1]), v2 = _mm_set1_pd(pCoeffs[2]), v3 = _mm_set1_pd(pCoeffs[3]);
+    int s = 0;
+
+    for (; s + 2 <= n; s += 2)
+    {
+      const __m128d a = _mm_add_pd(_mm_mul_pd(v0, _mm_loadu_pd(pTaps + s)), _mm_mul_pd(v1, _mm_loadu_pd(pTaps + s + 1)));
+      const __m128d b = _mm_add_pd(_mm_mul_pd(v2, _mm_loadu_pd(pTaps + s + 2)), _mm_mul_pd(v3, _mm_loadu_pd(pTaps + s + 3)));
+      _mm_storeu_pd(pOut + s, _mm_add_pd(a, b));
+    }
+
+    FIR4<double>(pTaps + s, pOut + s, n - s, pCoeffs);
+  }
+#elif defined IPLUG_SIMD_NEON
+  static void FIR2(const float* pTaps, float* pOut, int n, float c0, float c1)
+  {
+    const float32x4_t v0 = vdupq_n_f32(c0), v1 = vdupq_n_f32(c1);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+      vst1q_f32(pOut + s, vmlaq_f32(vmulq_f32(v0, vld1q_f32(pTaps + s)), v1, vld1q_f32(pTaps + s + 1)));
+
+    FIR2<float>(pTaps + s, pOut + s, n - s, c0, c1);
+  }
+
+  static void FIR4(const float* pTaps, float* pOut, int n, const float* pCoeffs)
+  {
+    const float32x4_t v0 = vdupq_n_f32(pCoeffs[0]), v1 = vdupq_n_f32(pCoeffs[1]), v2 = vdupq_n_f32(pCoeffs[2]), v3 = vdupq_n_f32(pCoeffs[3]);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+    {
+      const float32x4_t a = vmlaq_f32(vmulq_f32(v0, vld1q_f32(pTaps + s)), v1, vld1q_f32(pTaps + s + 1));
+      const float32x4_t b = vmlaq_f32(vmulq_f32(v2, vld1q_f32(pTaps + s + 2)), v3, vld1q_f32(pTaps + s + 3));
+      vst1q_f32(pOut + s, vaddq_f32(a, b));
+    }
+
+    FIR4<float>(pTaps + s, pOut + s, n - s, pCoeffs);
+  }
+#elif defined IPLUG_SIMD_WASM
+  static void FIR2(const float* pTaps, float* pOut, int n, float c0, float c1)
+  {
+    const v128_t v0 = wasm_f32x4_splat(c0), v1 = wasm_f32x4_splat(c1);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+      wasm_v128_store(pOut + s, wasm_f32x4_add(wasm_f32x4_mul(v0, wasm_v128_load(pTaps + s)), wasm_f32x4_mul(v1, wasm_v128_load(pTaps + s + 1))));
+
+    FIR2<float>(pTaps + s, pOut + s, n - s, c0, c1);
+  }
+
+  static void FIR4(const float* pTaps, float* pOut, int n, const float* pCoeffs)
+  {
+    const v128_t v0 = wasm_f32x4_splat(pCoeffs[0]), v1 = wasm_f32x4_splat(pCoeffs[1]), v2 = wasm_f32x4_splat(pCoeffs[2]), v3 = wasm_f32x4_splat(pCoeffs[3]);
+    int s = 0;
+
+    for (; s + 4 <= n; s += 4)
+    {
+      const v128_t a = wasm_f32x4_add(wasm_f32x4_mul(v0, wasm_v128_load(pTaps + s)), wasm_f32x4_mul(v1, wasm_v128_load(pTaps + s + 1)));
+      const v128_t b = wasm_f32x4_add(wasm_f32x4_mul(v2, wasm_v128_load(pTaps + s + 2)), wasm_f32x4_mul(v3, wasm_v128_load(pTaps + s + 3)));
+      wasm_v128_store(pOut + s, wasm_f32x4_add(a, b));
+    }
+
+    FIR4<float>(pTaps + s, pOut + s, n - s, pCoeffs);
+  }
+
+  static void FIR2(const double* pTaps, double* pOut, int n, double c0, double c1)
+  {
+    const v128_t v0 = wasm_f64x2_splat(c0), v1 = wasm_f64x2_splat(c1);
+    int s = 0;
+
+    for (; s + 2 <= n; s += 2)
+      wasm_v128_store(pOut + s, wasm_f64x2_add(wasm_f64x2_mul(v0, wasm_v128_load(pTaps + s)), wasm_f64x2_mul(v1, wasm_v128_load(pTaps + s + 1))));
+
+    FIR2<double>(pTaps + s, pOut + s, n - s, c0, c1);
+  }
+
+  static void FIR4(const double* pTaps, double* pOut, int n, const double* pCoeffs)
+  {
+    const v128_t v0 = wasm_f64x2_splat(pCoeffs[0]), v1 = wasm_f64x2_splat(pCoeffs[1]), v2 = wasm_f64x2_splat(pCoeffs[2]), v3 = wasm_f64x2_splat(pCoeffs[3]);
+    int s = 0;
+
+    for (; s + 2 <= n; s += 2)
+    {
+      const v128_t a = wasm_f64x2_add(wasm_f64x2_mul(v0, wasm_v128_load(pTaps + s)), wasm_f64x2_mul(v1, wasm_v128_load(pTaps + s + 1)));
+      const v128_t b = wasm_f64x2_add(wasm_f64x2_mul(v2, wasm_v128_load(pTaps + s + 2)), wasm_f64x2_mul(v3, wasm_v128_load(pTaps + s + 3)));
+      wasm_v128_store(pOut + s, wasm_f64x2_add(a, b));
+    }
+
+    FIR4<double>(pTaps + s, pOut + s, n - s, pCoeffs);
+  }
+#endif
+
+  WDL_TypedBuf<T> mBuffer; // mNChans rings of mSize samples, each followed by kGuard copies of its first samples
+  WDL_TypedBuf<double> mAllpassState;
+  int mNChans = 0;
+  int mMaxDelay = 0;
+  int mMaxBlockSize = 0;
+  int mSize = 0;
+  int mWritePos = 0;
+  EInterpolation mInterpolation = kLinear;
+} WDL_FIXALIGN;
+
 END_IPLUG_NAMESPACE
@@ -1,10 +1,15 @@
 #include "IPlugOSC.h"
 
+#include <algorithm>
+
 using namespace iplug;
 
 std::unique_ptr<Timer> OSCInterface::mTimer;
 int OSCInterface::sInstances = 0;
+std::thread OSCInterface::sNetworkThread;
+std::atomic<bool> OSCInterface::sNetworkThreadRunning {false};
 WDL_PtrList<OSCDevice> gDevices;
+WDL_Mutex gDevicesMutex; // the network thread uses gDevices
 
 #ifdef OS_WIN
 #define XSleep Sleep
@@ -18,8 +23,8 @@ OSCDevice::OSCDevice(const char* dest, int maxpacket, int sendsleep, sockaddr_in
   mHasInput = listen_addr != nullptr;
 
   memset(&mSendAddress, 0, sizeof(mSendAddress));
-  mMaxMacketSize = maxpacket > 0 ? maxpacket : 1024;
-  mSendSleep = sendsleep >= 0 ? sendsleep : 10;
+  mMaxMacketSize = maxpacket > 0 ? maxpacket : OSC_MAX_PACKET_SIZE;
+  mSendSleep = sendsleep >= 0 ? sendsleep : 0; // the network thread would stall, and the packets are already bundled
   mSendSocket = socket(AF_INET, SOCK_DGRAM, 0);
 
   if (mSendSocket == INVALID_SOCKET)
@@ -82,6 +87,51 @@ void OSCDevice::RunInput()
 
   struct sockaddr* p = mDestination.GetLength() ? nullptr : (struct sockaddr*) & mSendAddress;
 
+#if defined OS_LINUX
+  // read up to kBatchSize datagrams per system call
+  static constexpr int kBatchSize = 8;
+  static constexpr int kBufferSize = 16384;
+  mReceiveBuffer.Resize(kBatchSize * kBufferSize);
+
+  for (;;)
+  {
+    struct mmsghdr msgs[kBatchSize];
+    struct iovec iovs[kBatchSize];
+    struct sockaddr_in addrs[kBatchSize];
+    memset(msgs, 0, sizeof(msgs));
+
+    for (int i = 0; i < kBatchSize; i++)
+    {
+      iovs[i].iov_base = mReceiveBuffer.Get() + i * kBufferSize;
+      iovs[i].iov_len = kBufferSize;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+
+      if (p)
+      {
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      }
+    }
+
+    const int n = recvmmsg(mSendSocket, msgs, kBatchSize, MSG_DONTWAIT, nullptr);
+
+    if (n < 1)
+      break;
+
+    for (int i = 0; i < n; i++)
+    {
+      if (p && msgs[i].msg_hdr.msg_namelen == sizeof(mSendAddress))
+        mSendAddress = addrs[i];
+
+      if (msgs[i].msg_len > 0)
+        OnMessage(1, (const unsigned char*) iovs[i].iov_base, (int) msgs[i].msg_len);
+    }
+
+    if (n < kBatchSize)
+      break;
+  }
+#else
   for (;;)
   {
     char buf[16384];
@@ -94,79 +144,119 @@ void OSCDevice::RunInput()
 
     OnMessage(1, (const unsigned char*)buf, len);
   }
+#endif
 }
 
 void OSCDevice::RunOutput()
 {
-  static char hdr[16] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 1, 0, 0, 0 };
+  static const char hdr[16] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1 }; // timetag 1 means immediately
 
-  // send mSendQueue as UDP blocks
-  if (mSendQueue.Available() <= 16)
   {
-    if (mSendQueue.Available() > 0) mSendQueue.Clear();
-    return;
+    WDL_MutexLock lock(&mSendMutex);
+
+    if (!mSendQueue.Available())
+      return;
+
+    mOutgoingQueue.Add(mSendQueue.Get(), mSendQueue.Available());
+    mSendQueue.Clear();
   }
-  // mSendQueue should begin with a 16 byte pad, then messages in OSC
 
-  char* packetstart = (char*)mSendQueue.Get();
-  int packetlen = 16;
-  bool hasbundle = false;
-  mSendQueue.Advance(16); // skip bundle for now, but keep it around
+  // mOutgoingQueue holds messages with big endian size prefixes, the same layout as the elements of a bundle
+  const char* pData = (const char*) mOutgoingQueue.Get();
+  const int available = mOutgoingQueue.Available();
+  int pos = 0;
+  int packetStart = 0;
+  int nInPacket = 0;
 
-  SET_SOCK_BLOCK(mSendSocket, true);
+  mPacketBuffer.Resize(0, false);
+  mPackets.Resize(0, false);
+
+  auto finishPacket = [&]() {
+    if (nInPacket == 1)
+    {
+      // a lone message is sent without the bundle header and size
+      char* pPacket = mPacketBuffer.Get() + packetStart;
+      const int size = mPacketBuffer.GetSize() - packetStart - 20;
+      memmove(pPacket, pPacket + 20, size);
+      mPacketBuffer.Resize(packetStart + size, false);
+    }
+
+    if (nInPacket > 0)
+    {
+      const int packet[2] = { packetStart, mPacketBuffer.GetSize() - packetStart };
+      mPackets.Add(packet, 2);
+    }
 
-  while (mSendQueue.Available() >= sizeof(int))
+    nInPacket = 0;
+  };
+
+  while (pos + (int) sizeof(int) <= available)
   {
-    int len = *(int*)mSendQueue.Get(); // not advancing
+    int len;
+    memcpy(&len, pData + pos, sizeof(int));
     OSC_MAKEINTMEM4BE((char*)&len);
 
-    if (len < 1 || len > MAX_OSC_MSG_LEN || len > mSendQueue.Available()) break;
-
-    if (packetlen > 16 && packetlen + sizeof(int) + len > mMaxMacketSize)
-    {
-      // packet is full
-      if (!hasbundle)
-      {
-        packetstart += 20;
-        packetlen -= 20;
-      }
-      else
-      {
-        memcpy(packetstart, hdr, 16);
-      }
+    if (len < 1 || len > MAX_OSC_MSG_LEN || pos + (int) sizeof(int) + len > available) break;
 
-      sendto(mSendSocket, packetstart, packetlen, 0, (struct sockaddr*) & mSendAddress, sizeof(mSendAddress));
-      if (mSendSleep > 0)
-        XSleep(mSendSleep);
+    if (nInPacket > 0 && mPacketBuffer.GetSize() - packetStart + (int) sizeof(int) + len > mMaxMacketSize)
+      finishPacket(); // packet is full
 
-      packetstart = (char*)mSendQueue.Get() - 16; // safe since we padded the queue start
-      packetlen = 16;
-      hasbundle = false;
+    if (nInPacket == 0)
+    {
+      packetStart = mPacketBuffer.GetSize();
+      mPacketBuffer.Add(hdr, sizeof(hdr));
     }
 
-    if (packetlen > 16) hasbundle = true;
-    mSendQueue.Advance(sizeof(int) + len);
-    packetlen += sizeof(int) + len;
+    mPacketBuffer.Add(pData + pos, sizeof(int) + len);
+    nInPacket++;
+    pos += sizeof(int) + len;
   }
 
-  if (packetlen > 16)
+  finishPacket();
+  mOutgoingQueue.Clear();
+
+  const int nPackets = mPackets.GetSize() / 2;
+
+  if (!nPackets)
+    return;
+
+  SET_SOCK_BLOCK(mSendSocket, true);
+
+#if defined OS_LINUX
+  static constexpr int kBatchSize = 32;
+
+  for (int first = 0; first < nPackets; first += kBatchSize)
   {
-    if (!hasbundle)
-    {
-      packetstart += 20;
-      packetlen -= 20;
-    }
-    else
+    struct mmsghdr msgs[kBatchSize];
+    struct iovec iovs[kBatchSize];
+    const int n = std::min(kBatchSize, nPackets - first);
+    memset(msgs, 0, sizeof(msgs));
+
+    for (int i = 0; i < n; i++)
     {
-      memcpy(packetstart, hdr, 16);
+      iovs[i].iov_base = mPacketBuffer.Get() + mPackets.Get()[(first + i) * 2];
+      iovs[i].iov_len = mPackets.Get()[(first + i) * 2 + 1];
+      msgs[i].msg_hdr.msg_name = &mSendAddress;
+      msgs[i].msg_hdr.msg_namelen = sizeof(mSendAddress);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
     }
-    sendto(mSendSocket, packetstart, packetlen, 0, (struct sockaddr*) & mSendAddress, sizeof(mSendAddress));
+
+    sendmmsg(mSendSocket, msgs, n, 0);
+
     if (mSendSleep > 0)
       XSleep(mSendSleep);
   }
-  SET_SOCK_BLOCK(mSendSocket, false);
+#else
+  for (int i = 0; i < nPackets; i++)
+  {
+    sendto(mSendSocket, mPacketBuffer.Get() + mPackets.Get()[i * 2], mPackets.Get()[i * 2 + 1], 0, (struct sockaddr*) & mSendAddress, sizeof(mSendAddress));
+    if (mSendSleep > 0)
+      XSleep(mSendSleep);
+  }
+#endif
 
-  mSendQueue.Clear();
+  SET_SOCK_BLOCK(mSendSocket, false);
 }
 
 void OSCDevice::AddInstance(void(*callback)(void* d1, int dev_idx, int msglen, void* msg), void* d1, int dev_idx)
@@ -175,6 +265,15 @@ void OSCDevice::AddInstance(void(*callback)(void* d1, int dev_idx, int msglen, v
   mInstances.Add(r);
 }
 
+void OSCDevice::RemoveInstance(void* d1)
+{
+  for (int x = mInstances.GetSize() - 1; x >= 0; x--)
+  {
+    if (mInstances.Get()[x].data1 == d1)
+      mInstances.Delete(x);
+  }
+}
+
 void OSCDevice::OnMessage(char type, const unsigned char* msg, int len)
 {
   const int n = mInstances.GetSize();
@@ -185,8 +284,7 @@ void OSCDevice::OnMessage(char type, const unsigned char* msg, int len)
 
 void OSCDevice::SendOSC(const char* src, int len)
 {
-  if (!mSendQueue.GetSize())
-    mSendQueue.Add(nullptr, 16);
+  WDL_MutexLock lock(&mSendMutex);
 
   int tlen = len;
   OSC_MAKEINTMEM4BE(&tlen);
@@ -201,6 +299,9 @@ void OSCInterface::MessageCallback(void* d1, int dev_idx, int len, void* msg)
 
   if (_this && msg)
   {
+    if (_this->OnOSCPacket((const char*) msg, len, GetTime()))
+      return;
+
     if (_this->mIncomingEvents.GetSize() < 65536 * 8)
     {
       const int this_sz = ((sizeof(incomingEvent) + (len - 3)) + 7) & ~7;
@@ -221,17 +322,73 @@ void OSCInterface::MessageCallback(void* d1, int dev_idx, int len, void* msg)
   }
 }
 
-void OSCInterface::OnTimer(Timer& timer)
+//static
+void OSCInterface::NetworkThreadProc()
+{
+  while (sNetworkThreadRunning)
+  {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    int maxSocket = -1;
+
+    {
+      WDL_MutexLock lock(&gDevicesMutex);
+
+      for (auto i = 0; i < gDevices.GetSize(); i++)
+      {
+        auto* pDev = gDevices.Get(i);
+        if (pDev->mHasInput && pDev->mSendSocket != INVALID_SOCKET)
+        {
+          FD_SET(pDev->mSendSocket, &readSet);
+          maxSocket = std::max(maxSocket, (int) pDev->mSendSocket);
+        }
+      }
+    }
+
+    // waits without the lock, a socket that is closed meanwhile just makes select() return early.
+    // The timeout is how long an outgoing message can wait to be sent
+    if (maxSocket < 0)
+    {
+      XSleep(OSC_SEND_INTERVAL);
+    }
+    else
+    {
+      struct timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = OSC_SEND_INTERVAL * 1000;
+      select(maxSocket + 1, &readSet, nullptr, nullptr, &tv);
+    }
+
+    WDL_MutexLock lock(&gDevicesMutex);
+
+    for (auto i = 0; i < gDevices.GetSize(); i++)
+    {
+      auto* pDev = gDevices.Get(i);
+
+      if (pDev->mHasInput)
+        pDev->RunInput();
+
+      if (pDev->mHasOutput)
+        pDev->RunOutput();
+    }
+  }
+}
+
+void OSCInterface::DetachDevices()
 {
-  const int nDevices = gDevices.GetSize();
+  WDL_MutexLock lock(&gDevicesMutex);
 
-  for (auto i = 0; i < nDevices; i++)
+  for (auto i = 0; i < mDevices.GetSize(); i++)
   {
-    auto* pDev = gDevices.Get(i);
-    if (pDev->mHasInput)
-      pDev->RunInput();
+    if (gDevices.Find(mDevices.Get(i)) >= 0)
+      mDevices.Get(i)->RemoveInstance(this);
   }
 
+  mDevices.Empty();
+}
+
+void OSCInterface::OnTimer(Timer& timer)
+{
   if (mIncomingEvents.GetSize())
   {
     static WDL_HeapBuf tmp;
@@ -264,11 +421,16 @@ void OSCInterface::OnTimer(Timer& timer)
 
       while (rd_pos + rd_sz <= evt->sz && rd_sz >= 0)
       {
-        OscMessageRead rmsg((char*)evt->msg + rd_pos, rd_sz);
+        const OscMessageView view((char*)evt->msg + rd_pos, rd_sz);
+
+        if (!DispatchOSCMessage(view, 0))
+        {
+          OscMessageRead rmsg((char*)evt->msg + rd_pos, rd_sz);
 
-        const char* mstr = rmsg.GetMessage();
-        if (mstr && *mstr)
-          OnOSCMessage(rmsg);
+          const char* mstr = rmsg.GetMessage();
+          if (mstr && *mstr)
+            OnOSCMessage(rmsg);
+        }
 
         rd_pos += rd_sz + 4;
         if (rd_pos >= evt->sz) break;
@@ -278,13 +440,6 @@ void OSCInterface::OnTimer(Timer& timer)
       }
     }
   }
-
-  for (auto i = 0; i < nDevices; i++)
-  {
-    auto* pDev = gDevices.Get(i);
-    if (pDev->mHasOutput)
-      pDev->RunOutput();  // send queued messages
-  }
 }
 
 OSCInterface::OSCInterface(OSCLogFunc logFunc)
@@ -295,19 +450,37 @@ OSCInterface::OSCInterface(OSCLogFunc logFunc)
   if (!mTimer)
     mTimer = std::unique_ptr<Timer>(Timer::Create(std::bind(&OSCInterface::OnTimer, this, std::placeholders::_1), OSC_TIMER_RATE));
 
+  if (!sNetworkThreadRunning)
+  {
+    sNetworkThreadRunning = true;
+    sNetworkThread = std::thread(NetworkThreadProc);
+  }
+
   sInstances++;
 }
 
 OSCInterface::~OSCInterface()
 {
+  DetachDevices();
+
   if (--sInstances == 0) {
     mTimer = nullptr;
+
+    if (sNetworkThreadRunning)
+    {
+      sNetworkThreadRunning = false;
+      sNetworkThread.join();
+    }
+
+    WDL_MutexLock lock(&gDevicesMutex);
     gDevices.Empty(true);
   }
 }
 
 OSCDevice* OSCInterface::CreateReceiver(WDL_String& log, int port)
 {
+  WDL_MutexLock lock(&gDevicesMutex);
+
   const char buf[] = "127.0.0.1";
 
   struct sockaddr_in addr;
@@ -366,6 +539,8 @@ OSCDevice* OSCInterface::CreateReceiver(WDL_String& log, int port)
 
 OSCDevice* OSCInterface::CreateSender(WDL_String& log, const char* ip, int port)
 {
+  WDL_MutexLock lock(&gDevicesMutex);
+
   WDL_String destStr;
   destStr.SetFormatted(256, "%s:%i", ip, port);
   OSCDevice* r = nullptr;
@@ -428,6 +603,7 @@ void OSCSender::SetDestination(const char* ip, int port)
     
     if (mDevice != nullptr)
     {
+      WDL_MutexLock lock(&gDevicesMutex);
       gDevices.DeletePtr(mDevice, true);
     }
 
@@ -458,6 +634,7 @@ void OSCReceiver::SetReceivePort(int port)
   {
     if (mDevice != nullptr)
     {
+      WDL_MutexLock lock(&gDevicesMutex);
       gDevices.DeletePtr(mDevice, true);
     }
 
@@ -469,3 +646,134 @@ void OSCReceiver::SetReceivePort(int port)
       mLogFunc(log);
   }
 }
+
+OSCReceiver::~OSCReceiver()
+{
+  // OnOSCPacket() uses the queue, which is destroyed before the base class detaches
+  DetachDevices();
+}
+
+void OSCReceiver::SetAudioThreadDelivery(bool enable)
+{
+  if (enable && !mAudioQueue)
+  {
+    mAudioQueue = std::make_unique<IPlugQueue<OSCTimedMessage>>(OSC_AUDIO_QUEUE_SIZE);
+    mPendingMessages.reserve(OSC_AUDIO_QUEUE_SIZE);
+  }
+
+  mAudioThreadDelivery = enable;
+}
+
+bool OSCReceiver::OnOSCPacket(const char* packet, int len, double arrivalTime)
+{
+  if (!mAudioThreadDelivery)
+    return false;
+
+  QueuePacket(packet, len, kOSCTimeTagImmediate, arrivalTime, GetNTPTime(), 0);
+  return true;
+}
+
+void OSCReceiver::QueuePacket(const char* packet, int len, uint64_t timeTag, double arrivalTime, double ntpTime, int depth)
+{
+  if (len >= 16 && !strcmp(packet, "#bundle"))
+  {
+    if (depth > 8)
+      return;
+
+    uint32_t tag[2];
+    memcpy(tag, packet + 8, sizeof(tag));
+    OSC_MAKEINTMEM4BE(&tag[0]);
+    OSC_MAKEINTMEM4BE(&tag[1]);
+    const uint64_t bundleTimeTag = (static_cast<uint64_t>(tag[0]) << 32) | tag[1];
+
+    int pos = 16;
+
+    while (pos + 4 <= len)
+    {
+      int size;
+      memcpy(&size, packet + pos, sizeof(size));
+      OSC_MAKEINTMEM4BE(&size);
+      pos += 4;
+
+      if (size < 0 || pos + size > len)
+        break;
+
+      QueuePacket(packet + pos, size, bundleTimeTag, arrivalTime, ntpTime, depth + 1);
+      pos += size;
+    }
+  }
+  else if (len > 0 && len <= MAX_OSC_MSG_LEN)
+  {
+    OSCTimedMessage msg;
+    msg.mArrivalTime = arrivalTime;
+    msg.mTimeTag = timeTag;
+    msg.mDueTime = arrivalTime;
+
+    // a timetag in the past takes effect on arrival
+    if (timeTag != kOSCTimeTagImmediate)
+      msg.mDueTime += std::max(TimeTagToSeconds(timeTag) - ntpTime, 0.);
+
+    msg.mSequence = mSequence++;
+    msg.mSize = len;
+    memcpy(msg.mData, packet, len);
+
+    mAudioQueue->Push(msg); // dropped if the audio thread isn't keeping up
+  }
+}
+
+void OSCReceiver::ProcessOSCQueue(int nFrames, double sampleRate)
+{
+  if (!mAudioQueue || nFrames < 1 || sampleRate <= 0.)
+    return;
+
+  const double now = GetTime();
+  const double blockDuration = nFrames / sampleRate;
+
+  // the block plays back the time since the previous block, restarting after a gap (e.g. when the transport was stopped)
+  double blockStart = mLastProcessTime;
+
+  if (blockStart <= 0. || now - blockStart > 4. * blockDuration)
+    blockStart = now - blockDuration;
+
+  mLastProcessTime = now;
+
+  // mPendingMessages has room for a full queue, so this doesn't allocate
+  while (mPendingMessages.size() < mPendingMessages.capacity())
+  {
+    mPendingMessages.emplace_back();
+
+    if (!mAudioQueue->Pop(mPendingMessages.back()))
+    {
+      mPendingMessages.pop_back();
+      break;
+    }
+  }
+
+  if (mPendingMessages.empty())
+    return;
+
+  std::sort(mPendingMessages.begin(), mPendingMessages.end(), [](const OSCTimedMessage& a, const OSCTimedMessage& b) {
+    return a.mDueTime < b.mDueTime || (a.mDueTime == b.mDueTime && a.mSequence < b.mSequence);
+  });
+
+  size_t nDue = 0;
+
+  for (; nDue < mPendingMessages.size() && mPendingMessages[nDue].mDueTime < now; nDue++)
+  {
+    OSCTimedMessage& timedMsg = mPendingMessages[nDue];
+    const int offset = Clip(static_cast<int>((timedMsg.mDueTime - blockStart) * sampleRate), 0, nFrames - 1);
+
+    const OscMessageView view(timedMsg.mData, timedMsg.mSize);
+
+    if (DispatchOSCMessage(view, offset))
+      continue;
+
+    OscMessageRead msg(timedMsg.mData, timedMsg.mSize);
+    const char* mstr = msg.GetMessage();
+
+    if (mstr && *mstr)
+      ProcessOSCMessage(msg, offset, timedMsg);
+  }
+
+  mPendingMessages.erase(mPendingMessages.begin(), mPendingMessages.begin() + nDue);
+}
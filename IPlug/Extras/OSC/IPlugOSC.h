@@ -17,16 +17,22 @@
  *
  */
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
 #include <functional>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "jnetlib/jnetlib.h"
 
 #include "IPlugPlatform.h"
 #include "IPlugLogger.h"
 #include "IPlugOSC_msg.h"
+#include "IPlugQueue.h"
 #include "IPlugTimer.h"
 
 
@@ -36,8 +42,36 @@ BEGIN_IPLUG_NAMESPACE
 static constexpr int OSC_TIMER_RATE = 100;
 #endif
 
+/** How often the network thread sends queued messages, in milliseconds */
+#ifndef OSC_SEND_INTERVAL
+static constexpr int OSC_SEND_INTERVAL = 5;
+#endif
+
+/** The largest UDP packet that is sent, outgoing messages are packed into bundles of up to this size. The default is the IPv4 UDP payload of a 1500 byte Ethernet MTU */
+#ifndef OSC_MAX_PACKET_SIZE
+static constexpr int OSC_MAX_PACKET_SIZE = 1472;
+#endif
+
+#ifndef OSC_AUDIO_QUEUE_SIZE
+static constexpr int OSC_AUDIO_QUEUE_SIZE = 256;
+#endif
+
+/** The OSC timetag that means "immediately" */
+static constexpr uint64_t kOSCTimeTagImmediate = 1;
+
 using OSCLogFunc = std::function<void(WDL_String& log)>;
 
+/** An incoming OSC message with its timing, as OSCReceiver queues it for the audio thread */
+struct OSCTimedMessage
+{
+  double mArrivalTime = 0.; // when the packet was received, in seconds on the OSCInterface::GetTime() clock
+  double mDueTime = 0.; // when it should take effect on the same clock, the arrival time or the bundle's timetag
+  uint64_t mTimeTag = kOSCTimeTagImmediate; // the NTP timetag of the enclosing bundle
+  uint32_t mSequence = 0; // the order of arrival, which keeps the messages of a bundle in order
+  int mSize = 0;
+  char mData[MAX_OSC_MSG_LEN];
+};
+
 /** \todo */
 class OSCDevice
 {
@@ -51,22 +85,26 @@ public:
   
   virtual ~OSCDevice();
   
-  /** \todo */
+  /** Receive the pending packets. Called on the network thread. On Linux, these are read in batches with recvmmsg() */
   void RunInput();
   
-  /** \todo */
+  /** Pack the queued messages into bundles of up to the maximum packet size and send them. Called on the network thread. On Linux, the packets are sent with a single sendmmsg() */
   void RunOutput();
   
   /** \todo */
   void AddInstance(void (*callback)(void* d1, int dev_idx, int msglen, void* msg), void* d1, int dev_idx);
 
+  /** Stop calling back an instance that is going away
+   * @param d1 The data pointer it was added with */
+  void RemoveInstance(void* d1);
+
   /** \todo
    * @param type 
    * @param msg 
    * @param len */
   void OnMessage(char type, const unsigned char* msg, int len);
   
-  /** \todo
+  /** Queue a message to be sent by the network thread. This can be called on any thread
    * @param src 
    * @param len */
   void SendOSC(const char* src, int len);
@@ -91,9 +129,16 @@ public:
   
   struct sockaddr_in mSendAddress, mReceiveAddress;
   WDL_Queue mSendQueue, mReceiveQueue;
+
+private:
+  WDL_Mutex mSendMutex; // SendOSC() and RunOutput() are called on different threads
+  WDL_Queue mOutgoingQueue; // the messages that RunOutput() took from mSendQueue
+  WDL_TypedBuf<char> mPacketBuffer;
+  WDL_TypedBuf<int> mPackets; // offset and size pairs in mPacketBuffer
+  WDL_TypedBuf<char> mReceiveBuffer;
 };
 
-/** \todo */
+/** The base of OSCSender and OSCReceiver. All the sockets are read and written on a network thread that is shared by all the instances, incoming messages are delivered to OnOSCMessage() on a timer */
 class OSCInterface
 {
   struct incomingEvent
@@ -133,10 +178,47 @@ public:
   /** Set the Log Func object
    * @param logFunc */
   void SetLogFunc(OSCLogFunc logFunc) { mLogFunc = logFunc; }
-  
+
+  /** @return The time in seconds on the steady clock that message arrival and due times are measured with */
+  static double GetTime()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /** @return The current time in seconds since the NTP epoch (1900), which OSC timetags count from */
+  static double GetNTPTime()
+  {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count() + 2208988800.;
+  }
+
+  /** @return A timetag in seconds since the NTP epoch */
+  static double TimeTagToSeconds(uint64_t timeTag)
+  {
+    return static_cast<double>(timeTag >> 32) + static_cast<double>(timeTag & 0xFFFFFFFF) / 4294967296.;
+  }
+
+protected:
+  /** Called for each incoming packet on the thread that receives it, before it is queued for OnOSCMessage()
+   * @param packet The packet, a message or a bundle
+   * @param len The size of the packet in bytes
+   * @param arrivalTime When it was received, see GetTime()
+   * @return \c true if the packet was consumed and shouldn't go to OnOSCMessage() */
+  virtual bool OnOSCPacket(const char* packet, int len, double arrivalTime) { return false; }
+
+  /** Called for each incoming message before it is delivered to OnOSCMessage() or ProcessOSCMessage(), see OSCReceiver::AddOSCHandler()
+   * @param msg The message, a view of the received data that hasn't been byte swapped yet
+   * @param offset The sample offset in the block when it is delivered on the audio thread, otherwise 0
+   * @return \c true if the message was handled and shouldn't go to OnOSCMessage() */
+  virtual bool DispatchOSCMessage(const OscMessageView& msg, int offset) { return false; }
+
+  /** Stop receiving for this object, call it from the destructor of a subclass whose OnOSCPacket() uses its members */
+  void DetachDevices();
+
 private:
   static void MessageCallback(void *d1, int dev_idx, int msglen, void *msg);
 
+  static void NetworkThreadProc();
+
   void OnTimer(Timer& timer);
   
   // these are non-owned refs
@@ -146,6 +228,8 @@ protected:
   OSCLogFunc mLogFunc;
   static std::unique_ptr<Timer> mTimer;
   static int sInstances;
+  static std::thread sNetworkThread;
+  static std::atomic<bool> sNetworkThreadRunning;
   WDL_HeapBuf mIncomingEvents;  // incomingEvent list, each is 8-byte aligned
   WDL_Mutex mIncomingEvents_mutex;
 };
@@ -181,6 +265,8 @@ public:
    * @param port 
    * @param logFunc */
   OSCReceiver(int port = 8000, OSCLogFunc logFunc = nullptr);
+
+  ~OSCReceiver();
   
   /** Set the Receive Port object
    * @param port */
@@ -188,11 +274,52 @@ public:
   
   /** \todo */
   virtual void OnOSCMessage(OscMessageRead& msg) = 0;
-  
+
+  /** Deliver incoming messages to ProcessOSCMessage() on the audio thread, instead of to OnOSCMessage() on the timer.
+   * Packets are timestamped on arrival on the network thread, and messages in bundles take effect at their timetags.
+   * Call it on the main thread before processing starts, e.g. in the plug-in's constructor
+   * @param enable \c true to deliver to the audio thread */
+  void SetAudioThreadDelivery(bool enable);
+
+  /** Call this at the start of ProcessBlock() to deliver the messages that are due in this block to ProcessOSCMessage(), in order.
+   * Like MIDI, messages are delivered one block after they arrive, at the sample offset where they arrived (or are due) within the previous block's duration,
+   * so the timing between them is kept to the sample. Messages due later are held until their block
+   * @param nFrames The number of frames in the block
+   * @param sampleRate The sample rate */
+  void ProcessOSCQueue(int nFrames, double sampleRate);
+
+  /** Override this to handle messages on the audio thread, see SetAudioThreadDelivery()
+   * @param msg The message
+   * @param offset The sample offset in the block where it takes effect
+   * @param timing The arrival time and timetag of the message */
+  virtual void ProcessOSCMessage(OscMessageRead& msg, int offset, const OSCTimedMessage& timing) {}
+
+  /** Add a handler for the messages whose address matches a pattern, see OSCDispatcher. This is faster than comparing addresses in OnOSCMessage(), and the arguments are read without copying the message.
+   * The handlers are called wherever the messages are delivered, on the timer or on the audio thread (see SetAudioThreadDelivery()), and the messages they handle don't go to OnOSCMessage() or ProcessOSCMessage().
+   * Add them on the main thread before messages arrive, e.g. in the plug-in's constructor
+   * @param pattern The address pattern, e.g. "/gain" or "/mixer/ch/[1-8]/fader"
+   * @param handler Called for each message that matches
+   * @return \c false if the pattern doesn't start with / */
+  bool AddOSCHandler(const char* pattern, OSCDispatcher::Handler handler) { return mDispatcher.Add(pattern, std::move(handler)); }
+
+protected:
+  bool OnOSCPacket(const char* packet, int len, double arrivalTime) override;
+  bool DispatchOSCMessage(const OscMessageView& msg, int offset) override { return mDispatcher.Dispatch(msg, offset) > 0; }
+
 private:
+  /** Queue the messages in a packet, recursing into nested bundles. Called on the network thread */
+  void QueuePacket(const char* packet, int len, uint64_t timeTag, double arrivalTime, double ntpTime, int depth);
+
   OSCDevice* mDevice = nullptr;
   int mPort = 0;
+  OSCDispatcher mDispatcher;
   char mReadBuf[MAX_OSC_MSG_LEN] = {};
+
+  std::atomic<bool> mAudioThreadDelivery {false};
+  std::unique_ptr<IPlugQueue<OSCTimedMessage>> mAudioQueue;
+  std::vector<OSCTimedMessage> mPendingMessages; // audio thread only, holds messages that aren't due yet
+  double mLastProcessTime = 0.;
+  uint32_t mSequence = 0;
 };
 
 
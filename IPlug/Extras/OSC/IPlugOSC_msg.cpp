@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "IPlugOSC_msg.h"
 
 using namespace iplug;
@@ -385,3 +386,312 @@ void OscMessageWrite::DebugDump(const char* label, char* dump, int dumplen)
     rmsg.DebugDump(label, dump, dumplen);    
   }
 }
+
+static unsigned int ReadBE32(const char* p)
+{
+  const unsigned char* u=(const unsigned char*)p;
+  return ((unsigned int)u[0]<<24)|((unsigned int)u[1]<<16)|((unsigned int)u[2]<<8)|(unsigned int)u[3];
+}
+
+OscMessageView::OscMessageView(const char* buf, int len)
+{
+  if (!buf || len <= 0) return;
+
+  const int addrlen=_strlen(buf, len);
+  if (addrlen == len || buf[0] != '/') return;
+
+  mAddress=buf;
+  mValid=true;
+
+  int pos=pad4(addrlen);
+  if (pos >= len || buf[pos] != ',') return; // no type tag, no arguments
+
+  const char* types=buf+pos+1;
+  const int typelen=_strlen(types, len-pos-1);
+  if (pos+1+typelen == len)
+  {
+    mAddress="";
+    mValid=false;
+    return;
+  }
+
+  mTypes=types;
+  pos += pad4(typelen+1);
+
+  for (int i=0; i < typelen && mNArgs < kMaxArgs; i++)
+  {
+    int size;
+    switch (types[i])
+    {
+      case 'i': case 'f': size=4; break;
+      case 'T': case 'F': case 'N': case 'I': size=0; break;
+      case 's':
+      {
+        if (pos >= len) return;
+        const int slen=_strlen(buf+pos, len-pos);
+        if (pos+slen == len) return; // unterminated
+        size=pad4(slen);
+        break;
+      }
+      default: return; // the arguments after an unsupported type can't be located
+    }
+
+    if (pos+size > len) return;
+
+    mArgs[mNArgs++]=buf+pos;
+    pos += size;
+  }
+}
+
+bool OscMessageView::GetIntArg(int idx, int& value) const
+{
+  if (GetArgType(idx) != 'i') return false;
+  value=(int) ReadBE32(mArgs[idx]);
+  return true;
+}
+
+bool OscMessageView::GetFloatArg(int idx, float& value) const
+{
+  if (GetArgType(idx) != 'f') return false;
+  const unsigned int bits=ReadBE32(mArgs[idx]);
+  memcpy(&value, &bits, sizeof(float));
+  return true;
+}
+
+bool OscMessageView::GetNumberArg(int idx, double& value) const
+{
+  int i;
+  float f;
+
+  switch (GetArgType(idx))
+  {
+    case 'i': GetIntArg(idx, i); value=(double) i; return true;
+    case 'f': GetFloatArg(idx, f); value=(double) f; return true;
+    case 'T': value=1.0; return true;
+    case 'F': value=0.0; return true;
+    default: return false;
+  }
+}
+
+const char* OscMessageView::GetStringArg(int idx) const
+{
+  return GetArgType(idx) == 's' ? mArgs[idx] : NULL;
+}
+
+
+
+void OSCDispatcher::Clear()
+{
+  mNodes.clear();
+  mNodes.push_back(std::make_unique<Node>());
+  mHandlers.clear();
+}
+
+int OSCDispatcher::AddChild(int parent, const char* part, int len)
+{
+  Node* pParent=mNodes[parent].get();
+  const std::string_view key(part, len);
+  const bool isPattern=key.find_first_of("*?[{") != std::string_view::npos;
+
+  if (isPattern)
+  {
+    for (int child : pParent->mPatternChildren)
+    {
+      if (mNodes[child]->mPart == key) return child;
+    }
+  }
+  else
+  {
+    auto it=pParent->mLiteralChildren.find(key);
+    if (it != pParent->mLiteralChildren.end()) return it->second;
+  }
+
+  const int child=(int) mNodes.size();
+  mNodes.push_back(std::make_unique<Node>());
+  Node* pChild=mNodes.back().get();
+  pChild->mPart.assign(part, len);
+
+  if (isPattern)
+    pParent->mPatternChildren.push_back(child);
+  else
+    pParent->mLiteralChildren[std::string_view(pChild->mPart)]=child;
+
+  return child;
+}
+
+bool OSCDispatcher::Add(const char* pattern, Handler handler)
+{
+  if (!pattern || pattern[0] != '/') return false;
+
+  int node=0;
+  const char* p=pattern+1;
+  for (;;)
+  {
+    const char* end=strchr(p, '/');
+    if (!end) end=p+strlen(p);
+
+    node=AddChild(node, p, (int) (end-p));
+
+    if (!*end) break;
+    p=end+1;
+  }
+
+  mNodes[node]->mHandlers.push_back((int) mHandlers.size());
+  mHandlers.push_back(std::move(handler));
+  return true;
+}
+
+int OSCDispatcher::Dispatch(const OscMessageView& msg, int offset) const
+{
+  const char* address=msg.GetAddress();
+  if (mHandlers.empty() || !msg.IsValid() || address[0] != '/') return 0;
+
+  // the nodes that match the address so far, a literal address follows a single path
+  int active[kMaxMatches], next[kMaxMatches];
+  int nActive=1;
+  active[0]=0;
+
+  const char* p=address+1;
+  for (;;)
+  {
+    const char* end=strchr(p, '/');
+    if (!end) end=p+strlen(p);
+
+    const std::string_view part(p, end-p);
+    int nNext=0;
+
+    for (int i=0; i < nActive; i++)
+    {
+      const Node* pNode=mNodes[active[i]].get();
+
+      if (!pNode->mLiteralChildren.empty() && nNext < kMaxMatches)
+      {
+        auto it=pNode->mLiteralChildren.find(part);
+        if (it != pNode->mLiteralChildren.end()) next[nNext++]=it->second;
+      }
+
+      for (int child : pNode->mPatternChildren)
+      {
+        if (nNext < kMaxMatches && MatchPart(mNodes[child]->mPart.c_str(), (int) mNodes[child]->mPart.size(), p, (int) (end-p)))
+          next[nNext++]=child;
+      }
+    }
+
+    if (!nNext) return 0;
+
+    memcpy(active, next, nNext*sizeof(int));
+    nActive=nNext;
+
+    if (!*end) break;
+    p=end+1;
+  }
+
+  // call the handlers in the order they were added
+  int matched[kMaxMatches];
+  int nMatched=0;
+
+  for (int i=0; i < nActive; i++)
+  {
+    for (int h : mNodes[active[i]]->mHandlers)
+    {
+      if (nMatched < kMaxMatches) matched[nMatched++]=h;
+    }
+  }
+
+  if (nActive > 1) std::sort(matched, matched+nMatched);
+
+  for (int i=0; i < nMatched; i++)
+    mHandlers[matched[i]](msg, offset);
+
+  return nMatched;
+}
+
+bool OSCDispatcher::MatchPart(const char* pattern, int patternLen, const char* str, int strLen)
+{
+  const char* pe=pattern+patternLen;
+  const char* se=str+strLen;
+
+  while (pattern < pe)
+  {
+    const char c=*pattern;
+
+    if (c == '*')
+    {
+      while (pattern < pe && *pattern == '*') ++pattern;
+      if (pattern == pe) return true;
+
+      for (const char* s=str; s <= se; ++s)
+      {
+        if (MatchPart(pattern, (int) (pe-pattern), s, (int) (se-s))) return true;
+      }
+      return false;
+    }
+
+    if (c == '{')
+    {
+      const char* close=(const char*) memchr(pattern, '}', pe-pattern);
+      if (close)
+      {
+        const char* alt=pattern+1;
+        while (alt <= close)
+        {
+          const char* altend=alt;
+          while (altend < close && *altend != ',') ++altend;
+
+          const int altlen=(int) (altend-alt);
+          if (altlen <= se-str && !memcmp(alt, str, altlen) &&
+              MatchPart(close+1, (int) (pe-close-1), str+altlen, (int) (se-str-altlen))) return true;
+
+          alt=altend+1;
+        }
+        return false;
+      }
+    }
+
+    if (str == se) return false;
+
+    if (c == '?')
+    {
+      ++pattern;
+      ++str;
+      continue;
+    }
+
+    if (c == '[')
+    {
+      const char* close=(const char*) memchr(pattern+1, ']', pe-pattern-1);
+      if (close)
+      {
+        const char* q=pattern+1;
+        const bool negate=q < close && *q == '!';
+        if (negate) ++q;
+
+        bool found=false;
+        while (q < close)
+        {
+          if (q+2 < close && q[1] == '-')
+          {
+            if (*str >= q[0] && *str <= q[2]) found=true;
+            q += 3;
+          }
+          else
+          {
+            if (*str == *q) found=true;
+            ++q;
+          }
+        }
+
+        if (found == negate) return false;
+        pattern=close+1;
+        ++str;
+        continue;
+      }
+    }
+
+    if (c != *str) return false;
+    ++pattern;
+    ++str;
+  }
+
+  return str == se;
+}
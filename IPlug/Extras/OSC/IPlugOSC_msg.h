@@ -17,6 +17,13 @@
  *
  */
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include "IPlugPlatform.h"
 
 BEGIN_IPLUG_NAMESPACE
@@ -81,4 +88,121 @@ private:
   bool m_msgok;
 };
 
+/** A read-only view of an incoming OSC message. Unlike OscMessageRead it doesn't write over the buffer: the constructor validates the message in one pass
+ * and records where each argument starts, and the arguments are decoded from the big-endian data when they are read, in any order.
+ * The buffer must outlive the view. Supports the i, f, s, T, F, N and I argument types */
+class OscMessageView
+{
+public:
+  /** The most arguments that are indexed, any more are ignored */
+  static constexpr int kMaxArgs = 64;
+
+  /** @param buf The message, not modified
+   * @param len The size of the message in bytes */
+  OscMessageView(const char* buf, int len);
+  OscMessageView(const OscMessageView&) = delete;
+  OscMessageView& operator=(const OscMessageView&) = delete;
+
+  /** @return \c true if the message has a valid address and type tag */
+  bool IsValid() const { return mValid; }
+
+  /** @return The address of the message, e.g. "/mixer/ch/1/fader", empty if it is invalid */
+  const char* GetAddress() const { return mAddress; }
+
+  /** @return The number of arguments, not counting any that are truncated or follow an unsupported type */
+  int GetNumArgs() const { return mNArgs; }
+
+  /** @param idx The argument index
+   * @return The argument's OSC type tag character, or 0 if there is no such argument */
+  char GetArgType(int idx) const { return (idx >= 0 && idx < mNArgs) ? mTypes[idx] : 0; }
+
+  /** @param idx The argument index
+   * @param value Receives the value of an int argument
+   * @return \c true if the argument is an int */
+  bool GetIntArg(int idx, int& value) const;
+
+  /** @param idx The argument index
+   * @param value Receives the value of a float argument
+   * @return \c true if the argument is a float */
+  bool GetFloatArg(int idx, float& value) const;
+
+  /** Read a numeric argument whatever its type, since senders differ in whether they send ints, floats or booleans
+   * @param idx The argument index
+   * @param value Receives the value of an i, f, T or F argument
+   * @return \c true if the argument is one of those types */
+  bool GetNumberArg(int idx, double& value) const;
+
+  /** @param idx The argument index
+   * @return The string, pointing into the message buffer, or nullptr if the argument isn't a string */
+  const char* GetStringArg(int idx) const;
+
+private:
+  const char* mAddress = "";
+  const char* mTypes = "";
+  const char* mArgs[kMaxArgs];
+  int mNArgs = 0;
+  bool mValid = false;
+};
+
+/** Dispatches incoming OSC messages to handlers by address. The address patterns that handlers are added for are compiled into a trie with a node per
+ * part of the address, so a message is matched in a single pass over its address, rather than comparing it with every pattern.
+ * A part of a pattern can use the OSC wildcards: ? matches any character, * any sequence of characters, [abc] [a-z] and [!a-z] match one character of a set and {foo,bar} one of a list of strings.
+ * Literal parts are looked up in a hash table, so a plug-in with hundreds of fixed addresses costs about the same per message as one with a few.
+ * Add the handlers before messages arrive, e.g. in the constructor, Dispatch() doesn't lock and can be called from several threads at once */
+class OSCDispatcher
+{
+public:
+  /** Called for a message whose address matches the handler's pattern
+   * @param msg The message
+   * @param offset The sample offset in the block when it is delivered on the audio thread, otherwise 0 */
+  using Handler = std::function<void(const OscMessageView& msg, int offset)>;
+
+  /** The most trie nodes that are followed at once and the most handlers called per message, any more are dropped. Only reached with overlapping wildcard patterns */
+  static constexpr int kMaxMatches = 64;
+
+  OSCDispatcher() { Clear(); }
+  OSCDispatcher(const OSCDispatcher&) = delete;
+  OSCDispatcher& operator=(const OSCDispatcher&) = delete;
+
+  /** Add a handler
+   * @param pattern The address pattern, starting with /, e.g. "/gain" or "/mixer/ch/[1-8]/{fader,pan}"
+   * @param handler Called for each message that matches, after the handlers added before it
+   * @return \c false if the pattern doesn't start with / */
+  bool Add(const char* pattern, Handler handler);
+
+  /** Remove all the handlers */
+  void Clear();
+
+  /** @return \c true if no handlers have been added */
+  bool IsEmpty() const { return mHandlers.empty(); }
+
+  /** Call the handlers whose patterns match a message's address
+   * @param msg The message
+   * @param offset Passed to the handlers
+   * @return The number of handlers called */
+  int Dispatch(const OscMessageView& msg, int offset = 0) const;
+
+  /** Match one part of an address with one part of a pattern
+   * @param pattern The pattern part, without slashes
+   * @param patternLen Its length
+   * @param str The address part, without slashes
+   * @param strLen Its length
+   * @return \c true if they match */
+  static bool MatchPart(const char* pattern, int patternLen, const char* str, int strLen);
+
+private:
+  struct Node
+  {
+    std::string mPart; // the literal children's keys point to this, so nodes are never moved
+    std::unordered_map<std::string_view, int> mLiteralChildren;
+    std::vector<int> mPatternChildren;
+    std::vector<int> mHandlers;
+  };
+
+  int AddChild(int parent, const char* part, int len);
+
+  std::vector<std::unique_ptr<Node>> mNodes; // mNodes[0] is the root
+  std::vector<Handler> mHandlers;
+};
+
 END_IPLUG_NAMESPACE
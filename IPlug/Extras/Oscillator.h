@@ -205,6 +205,8 @@ public:
 
   T mLastOutput = 0.;
 private:
+  template <typename, int> friend class FastSinOscillatorLanes;
+
   static const int tableSize = 512; // 2^9
   static const int tableSizeM1 = 511; // 2^9 -1
   static const T mLUT[513];
@@ -212,4 +214,99 @@ private:
 
 #include "Oscillator_table.h"
 
+#pragma mark - Lane-parallel versions
+
+/** N independent SinOscillators with their state stored in lanes, so that one sample of every lane can be computed in a single vectorizable loop.
+ * Outputs are interleaved by lane: pOutput[s * N + lane] */
+template <typename T, int N>
+class SinOscillatorLanes
+{
+public:
+  static constexpr int kNumLanes = N;
+
+  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+
+  void SetFreqCPS(int lane, double freqHz) { mPhaseIncr[lane] = (1./mSampleRate) * freqHz; }
+
+  void SetPhase(int lane, double phase) { mPhase[lane] = phase; }
+
+  void Reset(int lane, double startPhase = 0.) { mPhase[lane] = startPhase; }
+
+  /** Compute one sample for every lane
+   * @param pOutput Receives N samples */
+  inline void Process(T* pOutput)
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      double phase = mPhase[l] + mPhaseIncr[l];
+      phase -= (phase >= 1.) ? 1. : 0.;
+      mPhase[l] = phase;
+      pOutput[l] = T(std::sin(phase * PI * 2.));
+    }
+  }
+
+  /** @param pOutput Receives nFrames * N samples, interleaved by lane */
+  void ProcessBlock(T* pOutput, int nFrames)
+  {
+    for (auto s = 0; s < nFrames; s++)
+      Process(pOutput + s * N);
+  }
+
+private:
+  double mPhase[N] = {};
+  double mPhaseIncr[N] = {};
+  double mSampleRate = 44100.;
+} ALIGNED(16);
+
+/** N independent FastSinOscillators with their state stored in lanes, using the same 512 point table as FastSinOscillator.
+ * The phase/fraction split is done with arithmetic rather than the union trick, so that the lane loop can be vectorized.
+ * Outputs are interleaved by lane: pOutput[s * N + lane] */
+template <typename T, int N>
+class FastSinOscillatorLanes
+{
+public:
+  static constexpr int kNumLanes = N;
+
+  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+
+  void SetFreqCPS(int lane, double freqHz) { mPhaseIncr[lane] = (1./mSampleRate) * freqHz; }
+
+  void SetPhase(int lane, double phase) { mPhase[lane] = phase; }
+
+  void Reset(int lane, double startPhase = 0.) { mPhase[lane] = startPhase; }
+
+  /** Compute one sample for every lane
+   * @param pOutput Receives N samples */
+  inline void Process(T* pOutput)
+  {
+    const T* pLUT = FastSinOscillator<T>::mLUT;
+
+    for (auto l = 0; l < N; l++)
+    {
+      const double tablePos = mPhase[l] * FastSinOscillator<T>::tableSize;
+      const int idx = static_cast<int>(tablePos);
+      const double frac = tablePos - idx;
+      const T f1 = pLUT[idx & FastSinOscillator<T>::tableSizeM1];
+      const T f2 = pLUT[(idx & FastSinOscillator<T>::tableSizeM1) + 1];
+      pOutput[l] = T(f1 + frac * (f2 - f1));
+
+      double phase = mPhase[l] + mPhaseIncr[l];
+      phase -= (phase >= 1.) ? 1. : 0.;
+      mPhase[l] = phase;
+    }
+  }
+
+  /** @param pOutput Receives nFrames * N samples, interleaved by lane */
+  void ProcessBlock(T* pOutput, int nFrames)
+  {
+    for (auto s = 0; s < nFrames; s++)
+      Process(pOutput + s * N);
+  }
+
+private:
+  double mPhase[N] = {}; // 0. to 1.
+  double mPhaseIncr[N] = {};
+  double mSampleRate = 44100.;
+} ALIGNED(16);
+
 END_IPLUG_NAMESPACE
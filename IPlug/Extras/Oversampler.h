@@ -12,11 +12,18 @@
 
 #define OVERSAMPLING_FACTORS_VA_LIST "None", "2x", "4x", "8x", "16x"
 
+#include <algorithm>
 #include <functional>
 #include <cmath>
+#include <memory>
+#include <tuple>
+#include <vector>
 
-#include "HIIR/FPUUpsampler2x.h"
-#include "HIIR/FPUDownsampler2x.h"
+#include "HIIR/MultiUpsampler2x.h"
+#include "HIIR/MultiDownsampler2x.h"
+#include "HIIR/PolyphaseIIR2Designer.h"
+#include "PolyphaseFIR.h"
+#include "SharedTable.h"
 
 #include "heapbuf.h"
 #include "ptrlist.h"
@@ -37,98 +44,97 @@ enum EFactor
   kNumFactors
 };
 
+/** The filters used by OverSampler */
+enum class EOverSamplingEngine
+{
+  kIIR = 0, // minimum-phase polyphase IIR (HIIR), no latency but non-linear phase
+  kFIR      // linear-phase polyphase half-band FIR, adds latency: see OverSampler::GetLatency()
+};
+
+/** A set of coefficients for one of OverSampler's IIR stages, designed at runtime by hiir::PolyphaseIIR2Designer. See OverSampler::GetIIRDesign() */
+struct OverSamplerIIRDesign
+{
+  int mNumCoefs = 0;
+  double mTransition = 0.; // normalized transition bandwidth, at the stage's output rate
+  double mAttenuation = 0.; // stop-band attenuation, dB
+  std::vector<double> mCoefs;
+};
+
 template<typename T = double>
 class OverSampler
 {
 public:
   using BlockProcessFunc = std::function<void(T**, T**, int)>;
   
-  OverSampler(EFactor factor = kNone, bool blockProcessing = true, int nInChannels = 1, int nOutChannels = 1)
+  /** OverSampler constructor
+   * @param factor The initial oversampling factor
+   * @param blockProcessing \c true if ProcessBlock() will be used, \c false for the per-sample Process() and ProcessGen()
+   * @param nInChannels The maximum number of input channels
+   * @param nOutChannels The maximum number of output channels
+   * @param engine The filters to use, see EOverSamplingEngine
+   * @param firQuality The quality of the filters if engine is EOverSamplingEngine::kFIR
+   * @param maxFactor The highest factor that SetOverSampling() will be called with. Filter state and buffers are only allocated for the stages up to this factor */
+  OverSampler(EFactor factor = kNone, bool blockProcessing = true, int nInChannels = 1, int nOutChannels = 1,
+              EOverSamplingEngine engine = EOverSamplingEngine::kIIR, EFIRQuality firQuality = EFIRQuality::kMedium, EFactor maxFactor = k16x)
   : mBlockProcessing(blockProcessing)
   , mNInChannels(nInChannels)
   , mNOutChannels(nOutChannels)
+  , mMaxFactor(std::max(maxFactor, factor))
+  , mEngine(engine)
+  , mFIRQuality(firQuality)
   {
     
-    static constexpr double coeffs2x[12] = { 0.036681502163648017, 0.13654762463195794, 0.27463175937945444, 0.42313861743656711, 0.56109869787919531, 0.67754004997416184, 0.76974183386322703, 0.83988962484963892, 0.89226081800387902, 0.9315419599631839, 0.96209454837808417, 0.98781637073289585 };
-    static constexpr double coeffs4x[4] = {0.041893991997656171, 0.16890348243995201, 0.39056077292116603, 0.74389574826847926 };
-    static constexpr double coeffs8x[3] = {0.055748680811302048, 0.24305119574153072, 0.64669913119268196 };
-    static constexpr double coeffs16x[2] = {0.10717745346023573, 0.53091435354504557 };
+    ResetIIRDesigns();
 
     for (auto c = 0; c < mNInChannels; c++)
     {
-      mUpsampler2x.Add(new Upsampler2xFPU<12, T>());
-      mUpsampler4x.Add(new Upsampler2xFPU<4, T>());
-      mUpsampler8x.Add(new Upsampler2xFPU<3, T>());
-      mUpsampler16x.Add(new Upsampler2xFPU<2, T>());
-      
-      mUpsampler2x.Get(c)->set_coefs(coeffs2x);
-      mUpsampler4x.Get(c)->set_coefs(coeffs4x);
-      mUpsampler8x.Get(c)->set_coefs(coeffs8x);
-      mUpsampler16x.Get(c)->set_coefs(coeffs16x);
-      
       // ptr location doesn't matter at this stage
       mNextInputPtrs.Add(mUp2x.Get());
     }
     
     for (auto c = 0; c < mNOutChannels; c++)
     {
-      mDownsampler2x.Add(new Downsampler2xFPU<12, T>());
-      mDownsampler4x.Add(new Downsampler2xFPU<4, T>());
-      mDownsampler8x.Add(new Downsampler2xFPU<3, T>());
-      mDownsampler16x.Add(new Downsampler2xFPU<2, T>());
-      
-      mDownsampler2x.Get(c)->set_coefs(coeffs2x);
-      mDownsampler4x.Get(c)->set_coefs(coeffs4x);
-      mDownsampler8x.Get(c)->set_coefs(coeffs8x);
-      mDownsampler16x.Get(c)->set_coefs(coeffs16x);
-      
       // ptr location doesn't matter at this stage
       mNextOutputPtrs.Add(mDown2x.Get());
     }
-        
-    SetOverSampling(factor);
-    
+
+    CreateFIRStages();
+
     Reset();
+
+    SetOverSampling(factor);
   }
   
   ~OverSampler()
   {
-    mUpsampler2x.Empty(true);
-    mDownsampler2x.Empty(true);
-    mUpsampler4x.Empty(true);
-    mDownsampler4x.Empty(true);
-    mUpsampler8x.Empty(true);
-    mDownsampler8x.Empty(true);
-    mUpsampler16x.Empty(true);
-    mDownsampler16x.Empty(true);
+    DeleteFIRStages();
   }
 
   OverSampler(const OverSampler&) = delete;
   OverSampler& operator=(const OverSampler&) = delete;
-    
+  
+  /** Allocate the buffers and filter state for a block size, for every factor up to the maximum factor, and clear them. Changing the factor with SetOverSampling() afterwards doesn't allocate
+   * @param blockSize The maximum number of frames that will be passed to ProcessBlock() */
   void Reset(int blockSize = DEFAULT_BLOCK_SIZE)
   {
-    int numBufSamples = 1;
-    
-    if(mBlockProcessing)
-      numBufSamples = blockSize;
-    else
-    {
-      numBufSamples = 1;
+    if (!mBlockProcessing)
       blockSize = 1;
-    }
-    
-    numBufSamples *= mNInChannels;
-    
-    mUp2x.Resize(2 * numBufSamples);
-    mUp4x.Resize(4 * numBufSamples);
-    mUp8x.Resize(8 * numBufSamples);
-    mUp16x.Resize(16 * numBufSamples);
+
+    mBlockSize = blockSize;
+
+    auto bufferSize = [&](EFactor factor, int nChans) {
+      return mMaxFactor >= factor ? (1 << factor) * blockSize * nChans : 0;
+    };
+
+    mUp2x.Resize(bufferSize(k2x, mNInChannels));
+    mUp4x.Resize(bufferSize(k4x, mNInChannels));
+    mUp8x.Resize(bufferSize(k8x, mNInChannels));
+    mUp16x.Resize(bufferSize(k16x, mNInChannels));
     
-    mDown2x.Resize(2 * numBufSamples);
-    mDown4x.Resize(4 * numBufSamples);
-    mDown8x.Resize(8 * numBufSamples);
-    mDown16x.Resize(16 * numBufSamples);
+    mDown2x.Resize(bufferSize(k2x, mNOutChannels));
+    mDown4x.Resize(bufferSize(k4x, mNOutChannels));
+    mDown8x.Resize(bufferSize(k8x, mNOutChannels));
+    mDown16x.Resize(bufferSize(k16x, mNOutChannels));
     
     mUp16BufferPtrs.Empty();
     mUp8BufferPtrs.Empty();
@@ -142,29 +148,35 @@ public:
     
     for (auto c = 0; c < mNInChannels; c++)
     {
-      mUpsampler2x.Get(c)->clear_buffers();
-      mUpsampler4x.Get(c)->clear_buffers();
-      mUpsampler8x.Get(c)->clear_buffers();
-      mUpsampler16x.Get(c)->clear_buffers();
-      
-      mUp2BufferPtrs.Add(mUp2x.Get() + c * 2 * blockSize);
-      mUp4BufferPtrs.Add(mUp4x.Get() + (c * 4 * blockSize));
-      mUp8BufferPtrs.Add(mUp8x.Get() + (c * 8 * blockSize));
-      mUp16BufferPtrs.Add(mUp16x.Get() + (c * 16 * blockSize));
+      mUp2BufferPtrs.Add(mUp2x.Get() ? mUp2x.Get() + c * 2 * blockSize : nullptr);
+      mUp4BufferPtrs.Add(mUp4x.Get() ? mUp4x.Get() + (c * 4 * blockSize) : nullptr);
+      mUp8BufferPtrs.Add(mUp8x.Get() ? mUp8x.Get() + (c * 8 * blockSize) : nullptr);
+      mUp16BufferPtrs.Add(mUp16x.Get() ? mUp16x.Get() + (c * 16 * blockSize) : nullptr);
     }
     
     for (auto c = 0; c < mNOutChannels; c++)
     {
-      mDownsampler2x.Get(c)->clear_buffers();
-      mDownsampler4x.Get(c)->clear_buffers();
-      mDownsampler8x.Get(c)->clear_buffers();
-      mDownsampler16x.Get(c)->clear_buffers();
-      
-      mDown2BufferPtrs.Add(mDown2x.Get() + c * 2 * blockSize);
-      mDown4BufferPtrs.Add(mDown4x.Get() + (c * 4 * blockSize));
-      mDown8BufferPtrs.Add(mDown8x.Get() + (c * 8 * blockSize));
-      mDown16BufferPtrs.Add(mDown16x.Get() + (c * 16 * blockSize));
+      mDown2BufferPtrs.Add(mDown2x.Get() ? mDown2x.Get() + c * 2 * blockSize : nullptr);
+      mDown4BufferPtrs.Add(mDown4x.Get() ? mDown4x.Get() + (c * 4 * blockSize) : nullptr);
+      mDown8BufferPtrs.Add(mDown8x.Get() ? mDown8x.Get() + (c * 8 * blockSize) : nullptr);
+      mDown16BufferPtrs.Add(mDown16x.Get() ? mDown16x.Get() + (c * 16 * blockSize) : nullptr);
     }
+
+    // only the IIR stages up to the maximum factor get any filter state
+    const bool iir = mEngine == EOverSamplingEngine::kIIR;
+    mUpsampler2x.set_num_channels(iir && mMaxFactor >= k2x ? mNInChannels : 0);
+    mUpsampler4x.set_num_channels(iir && mMaxFactor >= k4x ? mNInChannels : 0);
+    mUpsampler8x.set_num_channels(iir && mMaxFactor >= k8x ? mNInChannels : 0);
+    mUpsampler16x.set_num_channels(iir && mMaxFactor >= k16x ? mNInChannels : 0);
+
+    mDownsampler2x.set_num_channels(iir && mMaxFactor >= k2x ? mNOutChannels : 0);
+    mDownsampler4x.set_num_channels(iir && mMaxFactor >= k4x ? mNOutChannels : 0);
+    mDownsampler8x.set_num_channels(iir && mMaxFactor >= k8x ? mNOutChannels : 0);
+    mDownsampler16x.set_num_channels(iir && mMaxFactor >= k16x ? mNOutChannels : 0);
+
+    ResetFIRStages(blockSize);
+
+    ClearBuffers();
   }
 
   /** Over sample an input block with a per-block function (up sample input -> process with function -> down sample)
@@ -178,267 +190,465 @@ public:
   {
     assert(nInChans <= mNInChannels);
     assert(nOutChans <= mNOutChannels);
-    
-    if(mRate != mPrevRate)
+    assert(nFrames <= mBlockSize);
+
+    if (mRate == 1)
     {
-      switch (mRate) {
-        case 2:
-          mInPtrLoopSrc = &mUp2BufferPtrs;
-          mOutPtrLoopSrc = &mDown2BufferPtrs;
-          break;
-        case 4:
-          mInPtrLoopSrc = &mUp4BufferPtrs;
-          mOutPtrLoopSrc = &mDown4BufferPtrs;
-          break;
-        case 8:
-          mInPtrLoopSrc = &mUp8BufferPtrs;
-          mOutPtrLoopSrc = &mDown8BufferPtrs;
-          break;
-        case 16:
-          mInPtrLoopSrc = &mUp16BufferPtrs;
-          mOutPtrLoopSrc = &mDown16BufferPtrs;
-          break;
-        default:
-          break;
-      }
-      
-      mPrevRate = mRate;
+      func(inputs, outputs, nFrames);
+      return;
     }
 
-    for(auto c = 0; c < nInChans; c++) {
-      if (mRate >= 2) {
-        mUpsampler2x.Get(c)->process_block(mUp2BufferPtrs.Get(c), inputs[c], nFrames);
-      }
-      if (mRate >= 4) {
-        mUpsampler4x.Get(c)->process_block(mUp4BufferPtrs.Get(c), mUp2BufferPtrs.Get(c), nFrames * 2);
-      }
-      if (mRate >= 8) {
-        mUpsampler8x.Get(c)->process_block(mUp8BufferPtrs.Get(c), mUp4BufferPtrs.Get(c), nFrames * 4);
-      }
-      if (mRate == 16) {
-        mUpsampler16x.Get(c)->process_block(mUp16BufferPtrs.Get(c), mUp8BufferPtrs.Get(c), nFrames * 8);
-      }
+    Upsample(inputs, nInChans, nFrames);
+
+    WDL_PtrList<T>* pInPtrs = UpBufferPtrs(mRate);
+    WDL_PtrList<T>* pOutPtrs = DownBufferPtrs(mRate);
+
+    for (auto i = 0; i < mRate; i++)
+    {
+      for (auto c = 0; c < nInChans; c++)
+        mNextInputPtrs.Set(c, pInPtrs->Get(c) + (i * nFrames));
+
+      for (auto c = 0; c < nOutChans; c++)
+        mNextOutputPtrs.Set(c, pOutPtrs->Get(c) + (i * nFrames));
+
+      func(mNextInputPtrs.GetList(), mNextOutputPtrs.GetList(), nFrames);
     }
-    
-    if (mRate == 1) {
+
+    Downsample(outputs, nOutChans, nFrames);
+  }
+
+  /** Over sample an input block with a function that processes the whole up-sampled block in one call, of nFrames * GetRate() frames,
+   * rather than GetRate() calls of nFrames frames as ProcessBlock() makes. The function isn't wrapped in a std::function, so a lambda with captures doesn't allocate.
+   * See ProcessBlock() for the arguments */
+  template <typename Func>
+  void ProcessBlockContiguous(T** inputs, T** outputs, int nFrames, int nInChans, int nOutChans, Func&& func)
+  {
+    assert(nInChans <= mNInChannels);
+    assert(nOutChans <= mNOutChannels);
+    assert(nFrames <= mBlockSize);
+
+    if (mRate == 1)
+    {
       func(inputs, outputs, nFrames);
-    } else {
-      for (auto i = 0; i < mRate; i++) {
-        for(auto c = 0; c < nInChans; c++) {
-          mNextInputPtrs.Set(c, mInPtrLoopSrc->Get(c) + (i * nFrames));
-          mNextOutputPtrs.Set(c, mOutPtrLoopSrc->Get(c) + (i * nFrames));
-        }
-        func(mNextInputPtrs.GetList(), mNextOutputPtrs.GetList(), nFrames);
-      }
-    }
-    
-    for(auto c = 0; c < nOutChans; c++) {
-      if (mRate == 16) {
-        mDownsampler16x.Get(c)->process_block(mDown8BufferPtrs.Get(c), mDown16BufferPtrs.Get(c), nFrames * 8);
-      }
-      if (mRate >= 8) {
-        mDownsampler8x.Get(c)->process_block(mDown4BufferPtrs.Get(c), mDown8BufferPtrs.Get(c), nFrames * 4);
-      }
-      if (mRate >= 4) {
-        mDownsampler4x.Get(c)->process_block(mDown2BufferPtrs.Get(c), mDown4BufferPtrs.Get(c), nFrames * 2);
-      }
-      if (mRate >= 2) {
-        mDownsampler2x.Get(c)->process_block(outputs[c], mDown2BufferPtrs.Get(c), nFrames);
-      }
+      return;
     }
+
+    Upsample(inputs, nInChans, nFrames);
+
+    // each channel's up-sampled frames are contiguous
+    func(UpBufferPtrs(mRate)->GetList(), DownBufferPtrs(mRate)->GetList(), nFrames * mRate);
+
+    Downsample(outputs, nOutChans, nFrames);
   }
-  
+
   /** Over sample an input sample with a per-sample function (up-sample input -> process with function -> down-sample)
    * @param input The audio sample to input
    * @param std::function<double(double)> The function that processes the audio sample at the higher sampling rate. NOTE: std::function can call malloc if you pass in captures
    * @return The audio sample output */
   T Process(T input, std::function<T(T)> func)
   {
+    if (mRate == 1)
+      return func(input);
+
     T output;
+    T* pUp = UpBufferPtrs(mRate)->Get(0);
+    T* pDown = DownBufferPtrs(mRate)->Get(0);
+    const T* pInput = &input;
+    T* pOutput = &output;
+
+    Upsample(&pInput, 1, 1);
 
-    if(mRate == 16)
+    for (auto i = 0; i < mRate; i++)
     {
-      mUpsampler2x.Get(0)->process_sample(mUp2x.Get()[0], mUp2x.Get()[1], input);
-      mUpsampler4x.Get(0)->process_block(mUp4x.Get(), mUp2x.Get(), 2);
-      mUpsampler8x.Get(0)->process_block(mUp8x.Get(), mUp4x.Get(), 4);
-      mUpsampler16x.Get(0)->process_block(mUp16x.Get(), mUp8x.Get(), 8);
+      pDown[i] = func(pUp[i]);
+    }
 
-      for (auto i = 0; i < 16; i++)
-      {
-        mDown16x.Get()[i] = func(mUp16x.Get()[i]);
-      }
+    Downsample(&pOutput, 1, 1);
 
-      mDownsampler16x.Get(0)->process_block(mDown8x.Get(), mDown16x.Get(), 8);
-      mDownsampler8x.Get(0)->process_block(mDown4x.Get(), mDown8x.Get(), 4);
-      mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-      output = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
-    }
-    else if (mRate == 8)
+    return output;
+  }
+
+  /** Over-sample an per-sample synthesis function
+   * @param genFunc The function that generates the audio sample
+   * @return The audio sample output */
+  T ProcessGen(std::function<T()> genFunc)
+  {
+    T output;
+
+    if (mRate == 1)
+      return genFunc();
+
+    T* pDown = DownBufferPtrs(mRate)->Get(0);
+    T* pOutput = &mDownSamplerOutput;
+
+    for (int j = 0; j < mRate; j++)
     {
-      mUpsampler2x.Get(0)->process_sample(mUp2x.Get()[0], mUp2x.Get()[1], input);
-      mUpsampler4x.Get(0)->process_block(mUp4x.Get(), mUp2x.Get(), 2);
-      mUpsampler8x.Get(0)->process_block(mUp8x.Get(), mUp4x.Get(), 4);
+      pDown[mWritePos] = genFunc();
 
-      for (auto i = 0; i < 8; i++)
-      {
-        mDown8x.Get()[i] = func(mUp8x.Get()[i]);
-      }
+      mWritePos++;
+      mWritePos &= (mRate - 1);
 
-      mDownsampler8x.Get(0)->process_block(mDown4x.Get(), mDown8x.Get(), 4);
-      mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-      output = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
+      if (mWritePos == 0)
+        Downsample(&pOutput, 1, 1);
     }
-    else if (mRate == 4)
-    {
-      mUpsampler2x.Get(0)->process_sample(mUp2x.Get()[0], mUp2x.Get()[1], input);
-      mUpsampler4x.Get(0)->process_block(mUp4x.Get(), mUp2x.Get(), 2);
 
-      for (auto i = 0; i < 4; i++)
-      {
-        mDown4x.Get()[i] = func(mUp4x.Get()[i]);
-      }
+    output = mDownSamplerOutput;
+
+    return output;
+  }
+
+  /** Change the oversampling factor. This clears the filter state but doesn't allocate, so it can be called on the audio thread
+   * @param factor The new factor, which must not be higher than the maxFactor passed to the constructor */
+  void SetOverSampling(EFactor factor)
+  {
+    assert(factor <= mMaxFactor);
+    factor = std::min(factor, mMaxFactor);
 
-      mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-      output = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
+    if(factor != mFactor)
+    {
+      mFactor = factor;
+      mRate = 1 << factor;
+      
+      UpdateFIRLatency();
+      ClearBuffers();
     }
-    else if (mRate == 2)
+  }
+  
+  static EFactor RateToFactor(int rate)
+  {
+    switch (rate)
     {
-      mUpsampler2x.Get(0)->process_sample(mUp2x.Get()[0], mUp2x.Get()[1], input);
-
-      mDown2x.Get()[0] = func(mUp2x.Get()[0]);
-      mDown2x.Get()[1] = func(mUp2x.Get()[1]);
-      output = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
+      case 1: return EFactor::kNone;
+      case 2: return EFactor::k2x;
+      case 4: return EFactor::k4x;
+      case 8: return EFactor::k8x;
+      case 16: return EFactor::k16x;
+      default: assert(0); return EFactor::kNone;
     }
-    else
+  }
+  
+  int GetRate()
+  {
+    return mRate;
+  }
+
+  /** Change the filters. This allocates, so don't call it on the audio thread
+   * @param engine The filters to use, see EOverSamplingEngine
+   * @param firQuality The quality of the filters if engine is EOverSamplingEngine::kFIR */
+  void SetEngine(EOverSamplingEngine engine, EFIRQuality firQuality = EFIRQuality::kMedium)
+  {
+    if (engine != mEngine || firQuality != mFIRQuality)
     {
-      output = func(input);
+      mEngine = engine;
+      mFIRQuality = firQuality;
+
+      DeleteFIRStages();
+      CreateFIRStages();
+      Reset(mBlockSize);
     }
+  }
 
-    return output;
+  EOverSamplingEngine GetEngine() const { return mEngine; }
+
+  /** @param stage The stage, from k2x, which goes from 1x to 2x, to k16x, which goes from 8x to 16x
+   * @return The number of coefficients of the stage's IIR filters, which is fixed at compile time */
+  static constexpr int GetIIRStageNumCoefs(EFactor stage)
+  {
+    return stage == k2x ? 12 : stage == k4x ? 4 : stage == k8x ? 3 : 2;
   }
 
-  /** Over-sample an per-sample synthesis function
-   * @param genFunc The function that generates the audio sample
-   * @return The audio sample output */
-  T ProcessGen(std::function<T()> genFunc)
+  /** @param stage The stage, from k2x to k16x
+   * @return The transition bandwidth the stage's default coefficients were designed with */
+  static constexpr double GetIIRStageDefaultTransition(EFactor stage)
   {
-    auto ProcessDown16x = [&](T input)
-    {
-      mDown16x.Get()[mWritePos] = (T) input;
+    return stage == k2x ? 0.01 : stage == k4x ? 0.255 : stage == k8x ? 0.3775 : 0.43865;
+  }
 
-      mWritePos++;
-      mWritePos &= 15;
+  /** Get coefficients for an IIR stage with a different transition bandwidth, e.g. a wider one, which rolls off more of the top of the
+   * audio band but rejects more of the images and aliases, or a narrower one for a flatter top end with less rejection. Each design is computed once per process and shared by every OverSampler that asks for it while anything holds it.
+   * This takes a lock and may design the filter, so call it on the main thread, e.g. in the plug-in constructor, and keep the designs to switch between with SetIIRDesign().
+   * Requires HIIR/PolyphaseIIR2Designer.cpp to be compiled into the project
+   * @param stage The stage, from k2x to k16x, which sets the number of coefficients
+   * @param transition The normalized transition bandwidth at the stage's output rate, between 0 and 0.5. The stop band starts at 0.25 + transition
+   * @return The design, with the stop-band attenuation that the stage's number of coefficients reaches for that transition bandwidth */
+  static std::shared_ptr<const OverSamplerIIRDesign> GetIIRDesign(EFactor stage, double transition)
+  {
+    assert(stage >= k2x && stage <= k16x);
+    const int nCoefs = GetIIRStageNumCoefs(stage);
+    transition = std::min(std::max(transition, 0.0001), 0.4999);
+
+    return SharedTable<OverSamplerIIRDesign, std::tuple<int, double>>::Get(std::make_tuple(nCoefs, transition), [nCoefs, transition]() {
+      OverSamplerIIRDesign design;
+      design.mNumCoefs = nCoefs;
+      design.mTransition = transition;
+      design.mAttenuation = PolyphaseIIR2Designer::compute_atten_from_order_tbw(nCoefs, transition);
+      design.mCoefs.resize(nCoefs);
+      PolyphaseIIR2Designer::compute_coefs_spec_order_tbw(design.mCoefs.data(), nCoefs, transition);
+      return design;
+    });
+  }
 
-      if(mWritePos == 0)
-      {
-        mDownsampler16x.Get(0)->process_block(mDown8x.Get(), mDown16x.Get(), 8);
-        mDownsampler8x.Get(0)->process_block(mDown4x.Get(), mDown8x.Get(), 4);
-        mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-        mDownSamplerOutput = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
-      }
-    };
+  /** Use a design from GetIIRDesign() for an IIR stage's upsampler and downsampler. This only copies the coefficients, and keeps the filter state,
+   * so it can be called on the audio thread to change the quality between blocks, e.g. in IPlugProcessor::OnQualityChange(). The design isn't held
+   * @param stage The stage, from k2x to k16x
+   * @param design The coefficients, which must have been designed for this stage
+   * @return \c false if the design has a different number of coefficients to the stage, and wasn't used */
+  bool SetIIRDesign(EFactor stage, const OverSamplerIIRDesign& design)
+  {
+    if (stage < k2x || stage > k16x || design.mNumCoefs != GetIIRStageNumCoefs(stage) || static_cast<int>(design.mCoefs.size()) != design.mNumCoefs)
+      return false;
+
+    SetIIRCoefs(stage, design.mCoefs.data());
+    return true;
+  }
+
+  /** Go back to the default coefficients for every IIR stage. Like SetIIRDesign(), this can be called on the audio thread */
+  void ResetIIRDesigns()
+  {
+    // these are the designs for GetIIRStageDefaultTransition(), precomputed so that the designer is only needed for other designs
+    static constexpr double coeffs2x[12] = { 0.036681502163648017, 0.13654762463195794, 0.27463175937945444, 0.42313861743656711, 0.56109869787919531, 0.67754004997416184, 0.76974183386322703, 0.83988962484963892, 0.89226081800387902, 0.9315419599631839, 0.96209454837808417, 0.98781637073289585 };
+    static constexpr double coeffs4x[4] = {0.041893991997656171, 0.16890348243995201, 0.39056077292116603, 0.74389574826847926 };
+    static constexpr double coeffs8x[3] = {0.055748680811302048, 0.24305119574153072, 0.64669913119268196 };
+    static constexpr double coeffs16x[2] = {0.10717745346023573, 0.53091435354504557 };
 
-    auto ProcessDown8x = [&](T input)
+    SetIIRCoefs(k2x, coeffs2x);
+    SetIIRCoefs(k4x, coeffs4x);
+    SetIIRCoefs(k8x, coeffs8x);
+    SetIIRCoefs(k16x, coeffs16x);
+  }
+
+  /** @return The latency in samples at the base rate for the current factor and engine, which should be reported with IPlugProcessor::SetLatency().
+   * The IIR engine is minimum-phase, so it has no latency to compensate (its group delay varies with frequency). The FIR engine's latency is padded to a whole number of samples */
+  int GetLatency() const
+  {
+    return mEngine == EOverSamplingEngine::kFIR ? mFIRLatency : 0;
+  }
+
+private:
+  void SetIIRCoefs(EFactor stage, const double* pCoefs)
+  {
+    switch (stage)
     {
-      mDown8x.Get()[mWritePos] = (T) input;
+      case k2x: mUpsampler2x.set_coefs(pCoefs); mDownsampler2x.set_coefs(pCoefs); break;
+      case k4x: mUpsampler4x.set_coefs(pCoefs); mDownsampler4x.set_coefs(pCoefs); break;
+      case k8x: mUpsampler8x.set_coefs(pCoefs); mDownsampler8x.set_coefs(pCoefs); break;
+      case k16x: mUpsampler16x.set_coefs(pCoefs); mDownsampler16x.set_coefs(pCoefs); break;
+      default: break;
+    }
+  }
 
-      mWritePos++;
-      mWritePos &= 7;
+  WDL_PtrList<T>* UpBufferPtrs(int rate)
+  {
+    switch (rate)
+    {
+      case 2: return &mUp2BufferPtrs;
+      case 4: return &mUp4BufferPtrs;
+      case 8: return &mUp8BufferPtrs;
+      case 16: return &mUp16BufferPtrs;
+      default: return nullptr;
+    }
+  }
 
-      if(mWritePos == 0)
-      {
-        mDownsampler8x.Get(0)->process_block(mDown4x.Get(), mDown8x.Get(), 4);
-        mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-        mDownSamplerOutput = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
-      }
-    };
+  WDL_PtrList<T>* DownBufferPtrs(int rate)
+  {
+    switch (rate)
+    {
+      case 2: return &mDown2BufferPtrs;
+      case 4: return &mDown4BufferPtrs;
+      case 8: return &mDown8BufferPtrs;
+      case 16: return &mDown16BufferPtrs;
+      default: return nullptr;
+    }
+  }
+
+  /** Clear the filter memory of every stage, without allocating */
+  void ClearBuffers()
+  {
+    mUpsampler2x.clear_buffers();
+    mUpsampler4x.clear_buffers();
+    mUpsampler8x.clear_buffers();
+    mUpsampler16x.clear_buffers();
+
+    mDownsampler2x.clear_buffers();
+    mDownsampler4x.clear_buffers();
+    mDownsampler8x.clear_buffers();
+    mDownsampler16x.clear_buffers();
 
-    auto ProcessDown4x = [&](T input)
+    for (auto stage = 0; stage < kNumFIRStages; stage++)
     {
-      mDown4x.Get()[mWritePos] = (T) input;
+      for (auto i = 0; i < mFIRUpsamplers[stage].GetSize(); i++)
+        mFIRUpsamplers[stage].Get(i)->Reset();
 
-      mWritePos++;
-      mWritePos &= 3;
+      for (auto i = 0; i < mFIRDownsamplers[stage].GetSize(); i++)
+        mFIRDownsamplers[stage].Get(i)->Reset();
+    }
 
-      if(mWritePos == 0)
-      {
-        mDownsampler4x.Get(0)->process_block(mDown2x.Get(), mDown4x.Get(), 2);
-        mDownSamplerOutput = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
-      }
-    };
+    for (auto i = 0; i < mFIRDelays.GetSize(); i++)
+      mFIRDelays.Get(i)->Reset();
 
-    auto ProcessDown2x = [&](T input)
+    mWritePos = 0;
+    mDownSamplerOutput = 0.;
+  }
+
+  /** Up-sample nChans channels into the mUpNBufferPtrs for the current rate */
+  void Upsample(const T* const* inputs, int nChans, int nFrames)
+  {
+    if (mEngine == EOverSamplingEngine::kFIR)
     {
-      mDown2x.Get()[mWritePos] = (T) input;
+      for (auto c = 0; c < nChans; c++)
+      {
+        const T* pStageInput = inputs[c];
 
-      mWritePos = !mWritePos;
+        for (auto stage = 0; stage < mFactor; stage++)
+        {
+          T* pStageOutput = UpBufferPtrs(2 << stage)->Get(c);
+          mFIRUpsamplers[stage].Get(c)->ProcessBlock(pStageOutput, pStageInput, nFrames << stage);
+          pStageInput = pStageOutput;
+        }
+      }
+      return;
+    }
+
+    if (mRate >= 2) {
+      mUpsampler2x.process_block(mUp2BufferPtrs.GetList(), inputs, nChans, nFrames);
+    }
+    if (mRate >= 4) {
+      mUpsampler4x.process_block(mUp4BufferPtrs.GetList(), mUp2BufferPtrs.GetList(), nChans, nFrames * 2);
+    }
+    if (mRate >= 8) {
+      mUpsampler8x.process_block(mUp8BufferPtrs.GetList(), mUp4BufferPtrs.GetList(), nChans, nFrames * 4);
+    }
+    if (mRate == 16) {
+      mUpsampler16x.process_block(mUp16BufferPtrs.GetList(), mUp8BufferPtrs.GetList(), nChans, nFrames * 8);
+    }
+  }
 
-      if(mWritePos == 0)
+  /** Down-sample nChans channels from the mDownNBufferPtrs for the current rate */
+  void Downsample(T* const* outputs, int nChans, int nFrames)
+  {
+    if (mEngine == EOverSamplingEngine::kFIR)
+    {
+      for (auto c = 0; c < nChans; c++)
       {
-        mDownSamplerOutput = mDownsampler2x.Get(0)->process_sample(mDown2x.Get());
+        mFIRDelays.Get(c)->ProcessBlock(DownBufferPtrs(mRate)->Get(c), nFrames * mRate);
+
+        for (auto stage = mFactor - 1; stage >= 0; stage--)
+        {
+          T* pStageOutput = stage > 0 ? DownBufferPtrs(1 << stage)->Get(c) : outputs[c];
+          mFIRDownsamplers[stage].Get(c)->ProcessBlock(pStageOutput, DownBufferPtrs(2 << stage)->Get(c), nFrames << stage);
+        }
       }
-    };
+      return;
+    }
 
-    T output;
+    if (mRate == 16) {
+      mDownsampler16x.process_block(mDown8BufferPtrs.GetList(), mDown16BufferPtrs.GetList(), nChans, nFrames * 8);
+    }
+    if (mRate >= 8) {
+      mDownsampler8x.process_block(mDown4BufferPtrs.GetList(), mDown8BufferPtrs.GetList(), nChans, nFrames * 4);
+    }
+    if (mRate >= 4) {
+      mDownsampler4x.process_block(mDown2BufferPtrs.GetList(), mDown4BufferPtrs.GetList(), nChans, nFrames * 2);
+    }
+    if (mRate >= 2) {
+      mDownsampler2x.process_block(outputs, mDown2BufferPtrs.GetList(), nChans, nFrames);
+    }
+  }
 
-    for (int j = 0; j < mRate; j++)
+  void CreateFIRStages()
+  {
+    if (mEngine != EOverSamplingEngine::kFIR)
+      return;
+
+    const double beta = GetFIRKaiserBeta(mFIRQuality);
+
+    for (auto stage = 0; stage < mMaxFactor; stage++)
     {
-      output = genFunc();
+      const int halfLength = GetFIRHalfLength(mFIRQuality, stage);
 
-      switch(mRate)
+      for (auto c = 0; c < mNInChannels; c++)
       {
-        case 2: ProcessDown2x(output); break;
-        case 4: ProcessDown4x(output); break;
-        case 8: ProcessDown8x(output); break;
-        case 16: ProcessDown16x(output); break;
-        default: break;
+        mFIRUpsamplers[stage].Add(new FIRUpsampler2x<T>());
+        mFIRUpsamplers[stage].Get(c)->Design(halfLength, beta);
       }
-    }
 
-    if(mRate > 1)
-      output = mDownSamplerOutput;
+      for (auto c = 0; c < mNOutChannels; c++)
+      {
+        mFIRDownsamplers[stage].Add(new FIRDownsampler2x<T>());
+        mFIRDownsamplers[stage].Get(c)->Design(halfLength, beta);
+      }
+    }
 
-    return output;
+    for (auto c = 0; c < mNOutChannels; c++)
+      mFIRDelays.Add(new FIRDelay<T>());
   }
 
-  void SetOverSampling(EFactor factor)
+  void DeleteFIRStages()
   {
-    if(factor != mFactor)
+    for (auto stage = 0; stage < kNumFIRStages; stage++)
     {
-      mFactor = factor;
-      mRate = std::pow(2, (int) factor);
-      
-      Reset();
+      mFIRUpsamplers[stage].Empty(true);
+      mFIRDownsamplers[stage].Empty(true);
     }
+
+    mFIRDelays.Empty(true);
   }
-  
-  static EFactor RateToFactor(int rate)
+
+  /** Size the FIR histories for the block size and every factor up to the maximum */
+  void ResetFIRStages(int blockSize)
   {
-    switch (rate)
+    for (auto stage = 0; stage < kNumFIRStages; stage++)
     {
-      case 1: return EFactor::kNone;
-      case 2: return EFactor::k2x;
-      case 4: return EFactor::k4x;
-      case 8: return EFactor::k8x;
-      case 16: return EFactor::k16x;
-      default: assert(0); return EFactor::kNone;
+      for (auto i = 0; i < mFIRUpsamplers[stage].GetSize(); i++)
+        mFIRUpsamplers[stage].Get(i)->Resize(blockSize << stage);
+
+      for (auto i = 0; i < mFIRDownsamplers[stage].GetSize(); i++)
+        mFIRDownsamplers[stage].Get(i)->Resize(blockSize << stage);
     }
+
+    const int maxRate = 1 << mMaxFactor;
+
+    for (auto i = 0; i < mFIRDelays.GetSize(); i++)
+      mFIRDelays.Get(i)->Resize(maxRate - 1, blockSize * maxRate);
+
+    UpdateFIRLatency();
   }
-  
-  int GetRate()
+
+  /** Pad the latency of the FIR stages in use to a whole number of base rate samples. Doesn't allocate */
+  void UpdateFIRLatency()
   {
-    return mRate;
+    mFIRLatency = 0;
+
+    if (mEngine != EOverSamplingEngine::kFIR)
+      return;
+
+    // round-trip latency of each stage, in samples at the highest rate
+    int latency = 0;
+
+    for (auto stage = 0; stage < mFactor; stage++)
+      latency += 2 * mFIRUpsamplers[stage].Get(0)->GetLatency() * (mRate >> (stage + 1));
+
+    const int padding = (mRate - (latency % mRate)) % mRate;
+    mFIRLatency = (latency + padding) / mRate;
+
+    for (auto i = 0; i < mFIRDelays.GetSize(); i++)
+      mFIRDelays.Get(i)->SetDelay(padding);
   }
 
-private:
+  static constexpr int kNumFIRStages = kNumFactors - 1;
+
   EFactor mFactor = kNone;
-  int mPrevRate = 0;
   int mRate = 1;
   int mWritePos = 0;
   T mDownSamplerOutput = 0.;
   bool mBlockProcessing; // false
   int mNInChannels; // 1
   int mNOutChannels;
+  EFactor mMaxFactor;
+  int mBlockSize = DEFAULT_BLOCK_SIZE;
+  EOverSamplingEngine mEngine;
+  EFIRQuality mFIRQuality;
+  int mFIRLatency = 0;
   
   // the actual data
   WDL_TypedBuf<T> mUp16x;
@@ -464,21 +674,22 @@ private:
 
   WDL_PtrList<T> mNextInputPtrs;
   WDL_PtrList<T> mNextOutputPtrs;
-
-  //Ptrs to the buffer data ptrs, changed depending on rate (block processing only)
-  WDL_PtrList<T>* mInPtrLoopSrc = nullptr;
-  WDL_PtrList<T>* mOutPtrLoopSrc = nullptr;
   
-  //Ptrs to oversamplers for each channel
-  WDL_PtrList<Upsampler2xFPU<12, T>> mUpsampler2x; // for 1x to 2x SR
-  WDL_PtrList<Upsampler2xFPU<4, T>> mUpsampler4x;  // for 2x to 4x SR
-  WDL_PtrList<Upsampler2xFPU<3, T>> mUpsampler8x;  // for 4x to 8x SR
-  WDL_PtrList<Upsampler2xFPU<2, T>> mUpsampler16x; // for 8x to 16x SR
-
-  WDL_PtrList<Downsampler2xFPU<12, T>> mDownsampler2x; // decimator for 2x to 1x SR
-  WDL_PtrList<Downsampler2xFPU<4, T>> mDownsampler4x;  // decimator for 4x to 2x SR
-  WDL_PtrList<Downsampler2xFPU<3, T>> mDownsampler8x;  // decimator for 8x to 4x SR
-  WDL_PtrList<Downsampler2xFPU<2, T>> mDownsampler16x; // decimator for 16x to 8x SR
+  //Oversamplers for all channels, with the state of every channel stored contiguously and channel pairs processed together
+  Upsampler2xMulti<12, T> mUpsampler2x; // for 1x to 2x SR
+  Upsampler2xMulti<4, T> mUpsampler4x;  // for 2x to 4x SR
+  Upsampler2xMulti<3, T> mUpsampler8x;  // for 4x to 8x SR
+  Upsampler2xMulti<2, T> mUpsampler16x; // for 8x to 16x SR
+
+  Downsampler2xMulti<12, T> mDownsampler2x; // decimator for 2x to 1x SR
+  Downsampler2xMulti<4, T> mDownsampler4x;  // decimator for 4x to 2x SR
+  Downsampler2xMulti<3, T> mDownsampler8x;  // decimator for 8x to 4x SR
+  Downsampler2xMulti<2, T> mDownsampler16x; // decimator for 16x to 8x SR
+
+  //Linear-phase FIR stages for each channel, indexed by stage (0 is 1x to 2x SR). Only allocated for EOverSamplingEngine::kFIR
+  WDL_PtrList<FIRUpsampler2x<T>> mFIRUpsamplers[kNumFIRStages];
+  WDL_PtrList<FIRDownsampler2x<T>> mFIRDownsamplers[kNumFIRStages];
+  WDL_PtrList<FIRDelay<T>> mFIRDelays; // pads the FIR latency to whole samples at the base rate
 };
 
 END_IPLUG_NAMESPACE
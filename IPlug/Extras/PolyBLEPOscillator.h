@@ -0,0 +1,366 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Band-limited saw, square, pulse and triangle oscillators with hard sync, using polynomial corrections (PolyBLEP and PolyBLAMP) at each discontinuity
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "IPlugPlatform.h"
+#include "IPlugUtilities.h"
+#include "Oscillator.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The waveforms PolyBLEPOscillator can generate */
+enum class EPolyBLEPShape
+{
+  kSaw = 0,
+  kSquare,
+  kPulse, // width set with SetPulseWidth()
+  kTriangle, // peak position set with SetPulseWidth(), 0.5 is symmetrical
+  kNumShapes
+};
+
+/** The per-sample step shared by PolyBLEPOscillator and PolyBLEPOscillatorLanes.
+ * The naive waveform is corrected around each jump with a two sample polynomial step residual (BLEP), and around each change of slope (the corners of the triangle, and sync resets) with its integral (BLAMP).
+ * Since a hard sync reset can't be seen coming, the residual for the sample before a discontinuity is added to a pending sample, so the output is delayed by one sample.
+ * The step is written without branches, so that a loop calling it across lanes can be vectorized
+ * @tparam U The type the phase and corrections are computed in */
+template <typename U>
+class PolyBLEP
+{
+public:
+  /** The narrowest pulse width, and the closest a triangle's peak can be to either end of the cycle */
+  static constexpr double kMinWidth = 0.001;
+
+  /** @return The naive waveform at a phase */
+  template <EPolyBLEPShape S>
+  static inline U Value(U phase, U width)
+  {
+    if constexpr (S == EPolyBLEPShape::kSaw)
+      return U(2) * phase - U(1);
+    else if constexpr (S == EPolyBLEPShape::kTriangle)
+    {
+      const U rise = U(2) * phase / width - U(1);
+      const U fall = U(1) - U(2) * (phase - width) / (U(1) - width);
+      return phase < width ? rise : fall;
+    }
+    else
+      return phase < width ? U(1) : U(-1);
+  }
+
+  /** @return The slope of the naive waveform at a phase, per cycle */
+  template <EPolyBLEPShape S>
+  static inline U Slope(U phase, U width)
+  {
+    if constexpr (S == EPolyBLEPShape::kSaw)
+      return U(2);
+    else if constexpr (S == EPolyBLEPShape::kTriangle)
+    {
+      const U rise = U(2) / width;
+      const U fall = U(-2) / (U(1) - width);
+      return phase < width ? rise : fall;
+    }
+    else
+      return U(0);
+  }
+
+  /** Advance one sample
+   * @param phase The phase, 0. to 1.
+   * @param pending The sample that is output next, which corrections for discontinuities in the coming sample are added to
+   * @param dt The phase increment, the frequency divided by the sample rate, from 0. to 0.5
+   * @param width The pulse width or triangle peak position, from kMinWidth to 1. - kMinWidth. 0.5 for kSquare
+   * @param sync How many samples (0. to 1.) before this sample a hard sync reset happened, or negative for none
+   * @param syncOut Receives how many samples before this sample the phase wrapped or was reset, or -1.
+   * @return The output sample */
+  template <EPolyBLEPShape S>
+  static inline U Step(U& phase, U& pending, U dt, U width, U sync, U& syncOut)
+  {
+    dt = std::min(std::max(dt, U(0)), U(0.5));
+    const U invDt = U(1) / std::max(dt, std::numeric_limits<U>::min()); // nothing is crossed when dt is 0.
+    const bool reset = sync >= U(0);
+    const U clampedSync = std::min(sync, U(1));
+    const U syncPos = reset ? clampedSync : U(0);
+    const U a = phase;
+    const U b = a + dt * (U(1) - syncPos); // the phase reached before a reset, unwrapped
+
+    U before = U(0);
+    U after = U(0);
+
+    // a jump h and a change of slope m per sample, f samples before this sample
+    auto correct = [&](bool happened, U f, U h, U m) {
+      // both sides are computed, so that the selects don't stop the lane loop being vectorized
+      const U g = U(1) - f;
+      const U b = h * U(0.5) * f * f + m * (U(1) / U(6)) * f * f * f;
+      const U c = m * (U(1) / U(6)) * g * g * g - h * U(0.5) * g * g;
+      before += happened ? b : U(0);
+      after += happened ? c : U(0);
+    };
+
+    const U corner = S == EPolyBLEPShape::kTriangle ? U(2) / (width * (U(1) - width)) * dt : U(0);
+    const U steps = S == EPolyBLEPShape::kSaw ? U(-2) : S == EPolyBLEPShape::kTriangle ? U(0) : U(2);
+
+    // the wrap at the end of the cycle
+    const bool wrapped = b >= U(1);
+    const U wrapPos = U(1) - (U(1) - a) * invDt;
+    correct(wrapped, wrapPos, steps, corner);
+
+    // the pulse's falling edge, or the triangle's peak
+    if constexpr (S != EPolyBLEPShape::kSaw)
+    {
+      const U edge = width + (width > a ? U(0) : U(1));
+      correct(edge <= b, U(1) - (edge - a) * invDt, -steps, -corner);
+    }
+
+    const U resetPhase = b - (wrapped ? U(1) : U(0));
+
+    // the sync reset jumps to the start of the cycle, and the pulse can fall again before this sample
+    const U start = syncPos * dt;
+    const U resetValue = Value<S>(resetPhase, width);
+    correct(reset, syncPos, Value<S>(U(0), width) - resetValue, (Slope<S>(U(0), width) - Slope<S>(resetPhase, width)) * dt);
+
+    if constexpr (S != EPolyBLEPShape::kSaw)
+      correct(reset & (width <= start), syncPos - width * invDt, -steps, -corner);
+
+    phase = reset ? start : resetPhase;
+    syncOut = reset ? syncPos : wrapped ? wrapPos : U(-1);
+
+    const U output = pending + before;
+    pending = (reset ? Value<S>(start, width) : resetValue) + after;
+    return output;
+  }
+};
+
+/** A band-limited saw, square, pulse or triangle oscillator with hard sync, see PolyBLEP.
+ * The output is delayed by one sample. ProcessBlock() takes an optional buffer of frequencies, for per-sample pitch modulation without a virtual call per sample,
+ * and optional sync buffers: pass one oscillator's pSyncOut as another's pSyncIn to hard sync the second to the first */
+template <typename T>
+class PolyBLEPOscillator : public IOscillator<T>
+{
+public:
+  PolyBLEPOscillator(EPolyBLEPShape shape = EPolyBLEPShape::kSaw, double startPhase = 0., double startFreq = 1.)
+  : IOscillator<T>(startPhase, startFreq)
+  , mShape(shape)
+  {
+    Reset();
+  }
+
+  void SetShape(EPolyBLEPShape shape) { mShape = shape; }
+
+  EPolyBLEPShape GetShape() const { return mShape; }
+
+  /** @param width The fraction of the cycle the pulse is high for, or where the triangle peaks, 0. to 1. Ignored by kSaw and kSquare */
+  void SetPulseWidth(double width) { mWidth = Clip(width, PolyBLEP<double>::kMinWidth, 1. - PolyBLEP<double>::kMinWidth); }
+
+  /** Go back to the start phase */
+  void Reset()
+  {
+    IOscillator<T>::Reset();
+    mReset = true;
+  }
+
+  inline T Process(double freqHz) override
+  {
+    IOscillator<T>::SetFreqCPS(freqHz);
+
+    T output = 0.;
+    ProcessBlock(&output, 1);
+
+    return output;
+  }
+
+  /** Fill a buffer at the current frequency, see IOscillator::SetFreqCPS()
+   * @param pOutput Receives nFrames samples
+   * @param nFrames The number of samples to output
+   * @param pSyncIn nFrames values from another oscillator's pSyncOut to hard sync to, or nullptr
+   * @param pSyncOut Receives, for each sample, how many samples before it the phase wrapped, or -1., or nullptr */
+  void ProcessBlock(T* pOutput, int nFrames, const T* pSyncIn = nullptr, T* pSyncOut = nullptr)
+  {
+    Dispatch(pOutput, nullptr, nFrames, pSyncIn, pSyncOut);
+  }
+
+  /** Fill a buffer with a frequency per sample
+   * @param pOutput Receives nFrames samples
+   * @param pFreqHz The frequency for each sample, in Hz. The last one is kept as the current frequency
+   * @param nFrames The number of samples to output
+   * @param pSyncIn nFrames values from another oscillator's pSyncOut to hard sync to, or nullptr
+   * @param pSyncOut Receives, for each sample, how many samples before it the phase wrapped, or -1., or nullptr */
+  void ProcessBlock(T* pOutput, const T* pFreqHz, int nFrames, const T* pSyncIn = nullptr, T* pSyncOut = nullptr)
+  {
+    Dispatch(pOutput, pFreqHz, nFrames, pSyncIn, pSyncOut);
+  }
+
+private:
+  void Dispatch(T* pOutput, const T* pFreqHz, int nFrames, const T* pSyncIn, T* pSyncOut)
+  {
+    switch (mShape)
+    {
+      case EPolyBLEPShape::kSaw: Render<EPolyBLEPShape::kSaw>(pOutput, pFreqHz, nFrames, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kSquare: Render<EPolyBLEPShape::kSquare>(pOutput, pFreqHz, nFrames, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kPulse: Render<EPolyBLEPShape::kPulse>(pOutput, pFreqHz, nFrames, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kTriangle: Render<EPolyBLEPShape::kTriangle>(pOutput, pFreqHz, nFrames, pSyncIn, pSyncOut); break;
+      default: break;
+    }
+  }
+
+  template <EPolyBLEPShape S>
+  void Render(T* pOutput, const T* pFreqHz, int nFrames, const T* pSyncIn, T* pSyncOut)
+  {
+    const double width = S == EPolyBLEPShape::kSquare ? 0.5 : mWidth;
+    const double invSampleRate = 1. / IOscillator<T>::mSampleRate;
+    double phase = IOscillator<T>::mPhase - std::floor(IOscillator<T>::mPhase);
+    double pending = mPending;
+    double dt = IOscillator<T>::mPhaseIncr;
+
+    // after a reset the pending sample is the naive waveform at the start phase
+    if (mReset)
+    {
+      pending = PolyBLEP<double>::template Value<S>(phase, width);
+      mReset = false;
+    }
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      if (pFreqHz)
+        dt = pFreqHz[s] * invSampleRate;
+
+      double syncOut;
+      pOutput[s] = static_cast<T>(PolyBLEP<double>::template Step<S>(phase, pending, dt, width, pSyncIn ? static_cast<double>(pSyncIn[s]) : -1., syncOut));
+
+      if (pSyncOut)
+        pSyncOut[s] = static_cast<T>(syncOut);
+    }
+
+    IOscillator<T>::mPhase = phase;
+    IOscillator<T>::mPhaseIncr = dt;
+    mPending = pending;
+  }
+
+  EPolyBLEPShape mShape;
+  double mWidth = 0.5;
+  double mPending = 0.;
+  bool mReset = true;
+};
+
+/** N independent PolyBLEPOscillators of the same shape with their state stored in lanes, so that one sample of every lane can be computed in a single vectorizable loop,
+ * e.g. for the unison voices of a SynthVoiceGroup. The phase is computed in T, so float lanes vectorize twice as wide as double ones.
+ * The lane loop is vectorized by compilers that don't assume floating point operations can trap, which is clang's default, or GCC with -fno-trapping-math
+ * Inputs and outputs are interleaved by lane: pOutput[s * N + lane] */
+template <typename T, int N>
+class PolyBLEPOscillatorLanes
+{
+public:
+  static constexpr int kNumLanes = N;
+
+  PolyBLEPOscillatorLanes(EPolyBLEPShape shape = EPolyBLEPShape::kSaw)
+  : mShape(shape)
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      mWidth[l] = T(0.5);
+      Reset(l);
+    }
+  }
+
+  void SetShape(EPolyBLEPShape shape) { mShape = shape; }
+
+  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+
+  void SetFreqCPS(int lane, double freqHz) { mPhaseIncr[lane] = static_cast<T>((1./mSampleRate) * freqHz); }
+
+  /** @param width The fraction of the cycle the pulse is high for, or where the triangle peaks, see PolyBLEPOscillator::SetPulseWidth() */
+  void SetPulseWidth(int lane, double width) { mWidth[lane] = static_cast<T>(Clip(width, PolyBLEP<double>::kMinWidth, 1. - PolyBLEP<double>::kMinWidth)); }
+
+  void Reset(int lane, double startPhase = 0.)
+  {
+    mPhase[lane] = static_cast<T>(startPhase - std::floor(startPhase));
+    mPending[lane] = T(0);
+    mReset[lane] = true;
+  }
+
+  /** @param pOutput Receives nFrames * N samples, interleaved by lane
+   * @param nFrames The number of samples to output for each lane
+   * @param pFreqHz nFrames * N frequencies in Hz, interleaved by lane, or nullptr for each lane's current frequency
+   * @param pSyncIn nFrames * N sync values, interleaved by lane, e.g. from another PolyBLEPOscillatorLanes' pSyncOut, or nullptr
+   * @param pSyncOut Receives nFrames * N sync values, interleaved by lane, see PolyBLEPOscillator::ProcessBlock(), or nullptr */
+  void ProcessBlock(T* pOutput, int nFrames, const T* pFreqHz = nullptr, const T* pSyncIn = nullptr, T* pSyncOut = nullptr)
+  {
+    switch (mShape)
+    {
+      case EPolyBLEPShape::kSaw: Render<EPolyBLEPShape::kSaw>(pOutput, nFrames, pFreqHz, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kSquare: Render<EPolyBLEPShape::kSquare>(pOutput, nFrames, pFreqHz, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kPulse: Render<EPolyBLEPShape::kPulse>(pOutput, nFrames, pFreqHz, pSyncIn, pSyncOut); break;
+      case EPolyBLEPShape::kTriangle: Render<EPolyBLEPShape::kTriangle>(pOutput, nFrames, pFreqHz, pSyncIn, pSyncOut); break;
+      default: break;
+    }
+  }
+
+private:
+  template <EPolyBLEPShape S>
+  void Render(T* pOutput, int nFrames, const T* pFreqHz, const T* pSyncIn, T* pSyncOut)
+  {
+    const T invSampleRate = static_cast<T>(1. / mSampleRate);
+    T width[N];
+    T syncOut[N];
+
+    for (auto l = 0; l < N; l++)
+    {
+      width[l] = S == EPolyBLEPShape::kSquare ? T(0.5) : mWidth[l];
+
+      if (mReset[l])
+      {
+        mPending[l] = PolyBLEP<T>::template Value<S>(mPhase[l], width[l]);
+        mReset[l] = false;
+      }
+    }
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      if (pFreqHz)
+      {
+        for (auto l = 0; l < N; l++)
+          mPhaseIncr[l] = pFreqHz[s * N + l] * invSampleRate;
+      }
+
+      if (pSyncIn)
+        StepLanes<S, true>(pOutput + s * N, width, pSyncIn + s * N, syncOut);
+      else
+        StepLanes<S, false>(pOutput + s * N, width, nullptr, syncOut);
+
+      if (pSyncOut)
+        std::copy(syncOut, syncOut + N, pSyncOut + s * N);
+    }
+  }
+
+  /** One sample for every lane, kept out of Render() so that each version is inlined and vectorized on its own */
+  template <EPolyBLEPShape S, bool SYNC>
+  inline void StepLanes(T* pOutput, const T* pWidth, const T* pSync, T* pSyncOut)
+  {
+    for (auto l = 0; l < N; l++)
+      pOutput[l] = PolyBLEP<T>::template Step<S>(mPhase[l], mPending[l], mPhaseIncr[l], pWidth[l], SYNC ? pSync[l] : T(-1), pSyncOut[l]);
+  }
+
+  EPolyBLEPShape mShape;
+  T mPhase[N] = {}; // 0. to 1.
+  T mPhaseIncr[N] = {};
+  T mWidth[N] = {};
+  T mPending[N] = {};
+  bool mReset[N] = {};
+  double mSampleRate = 44100.;
+} ALIGNED(16);
+
+END_IPLUG_NAMESPACE
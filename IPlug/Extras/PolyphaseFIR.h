@@ -0,0 +1,303 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Linear-phase polyphase half-band FIR stages for 2x up and down sampling, used by OverSampler
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "SharedTable.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Quality of the linear-phase FIR over-sampling filters. Higher qualities have steeper filters, more stop-band rejection, and more latency */
+enum class EFIRQuality
+{
+  kLow = 0,   // 31 taps for the first 2x stage, ~70dB rejection
+  kMedium,    // 63 taps, ~100dB
+  kHigh,      // 127 taps, ~120dB
+  kNumFIRQualities
+};
+
+/** Designs the non-trivial polyphase branch of a Kaiser-windowed half-band low pass FIR with 4 * halfLength - 1 taps.
+ * Every other tap of a half-band filter is zero apart from the centre tap (0.5), so the filter is fully described by the 2 * halfLength taps of one branch.
+ * Because the filter is symmetric, only the first halfLength taps of that branch are returned
+ * @param halfLength Half the number of taps in the non-trivial branch
+ * @param beta The Kaiser window beta. Higher values trade transition width for stop-band rejection
+ * @param coeffs Filled with halfLength coefficients */
+static inline void DesignHalfBandFIR(int halfLength, double beta, std::vector<double>& coeffs)
+{
+  auto besselI0 = [](double x) {
+    double sum = 1.;
+    double term = 1.;
+
+    for (int k = 1; k < 50; k++)
+    {
+      term *= (x / (2. * k)) * (x / (2. * k));
+      sum += term;
+
+      if (term < sum * 1e-17)
+        break;
+    }
+
+    return sum;
+  };
+
+  const int nTaps = 4 * halfLength - 1;
+  const int centre = nTaps / 2;
+  const double i0Beta = besselI0(beta);
+
+  coeffs.resize(halfLength);
+
+  double sum = 0.;
+
+  for (int k = 0; k < halfLength; k++)
+  {
+    const int tap = 2 * k; // even taps are the non-trivial branch, since the centre tap is odd
+    const double offset = (tap - centre) * 0.5;
+    const double sinc = std::sin(PI * offset) / (PI * offset);
+    const double r = (2. * tap) / (nTaps - 1) - 1.;
+    const double window = besselI0(beta * std::sqrt(std::max(0., 1. - r * r))) / i0Beta;
+    coeffs[k] = 0.5 * sinc * window;
+    sum += coeffs[k];
+  }
+
+  // normalise for unity gain at DC: the branch (both symmetric halves) must sum to 0.5, the centre tap provides the other 0.5
+  for (auto& c : coeffs)
+    c *= 0.25 / sum;
+}
+
+/** @return The half length for the FIR stage at a given oversampling stage (0 is 1x -> 2x). Later stages have more transition band to work with, so they are shorter */
+static inline int GetFIRHalfLength(EFIRQuality quality, int stage)
+{
+  static constexpr int kFirstStage[] = { 8, 16, 32 };
+  return std::max(kFirstStage[static_cast<int>(quality)] >> stage, 4);
+}
+
+/** @return The Kaiser beta to use with a given quality */
+static inline double GetFIRKaiserBeta(EFIRQuality quality)
+{
+  static constexpr double kBeta[] = { 6.5, 9., 11. };
+  return kBeta[static_cast<int>(quality)];
+}
+
+/** Base class for the FIR stages, holding the folded coefficients */
+template <typename T>
+class FIRStage2x
+{
+public:
+  /** Design the filter for this stage, or share the coefficients of a stage that has already designed it, see SharedTable
+   * @param halfLength See DesignHalfBandFIR()
+   * @param beta See DesignHalfBandFIR() */
+  void Design(int halfLength, double beta)
+  {
+    mCoeffs = SharedTable<std::vector<T>, std::tuple<int, double>>::Get(std::make_tuple(halfLength, beta), [halfLength, beta]() {
+      std::vector<double> coeffs;
+      DesignHalfBandFIR(halfLength, beta, coeffs);
+      return std::vector<T>(coeffs.begin(), coeffs.end());
+    });
+    mHalfLength = halfLength;
+  }
+
+  /** @return The latency of the stage in samples at the higher rate */
+  int GetLatency() const { return 2 * mHalfLength - 1; }
+
+protected:
+  // out[n] += coeff[k] * (x[n + H - k] + x[n + k]) for each folded tap. The inner loop runs over the block with no loop-carried dependency, so it vectorizes
+  void ConvolveFolded(T* pOut, const T* pHistory, int nFrames) const
+  {
+    const int historyLength = 2 * mHalfLength - 1;
+    const T* pCoeffs = mCoeffs->data();
+
+    std::fill_n(pOut, nFrames, T(0));
+
+    for (int k = 0; k < mHalfLength; k++)
+    {
+      const T coeff = pCoeffs[k];
+      const T* pA = pHistory + historyLength - k;
+      const T* pB = pHistory + k;
+
+      for (int s = 0; s < nFrames; s++)
+        pOut[s] += coeff * (pA[s] + pB[s]);
+    }
+  }
+
+  std::shared_ptr<const std::vector<T>> mCoeffs;
+  int mHalfLength = 0;
+};
+
+/** Linear-phase polyphase half-band FIR 2x up-sampler. Only the non-trivial branch is convolved, the other branch is a pure delay */
+template <typename T>
+class FIRUpsampler2x : public FIRStage2x<T>
+{
+public:
+  /** Allocate the history for blocks of up to maxFrames input samples and clear it */
+  void Resize(int maxFrames)
+  {
+    mMaxFrames = maxFrames;
+    mHistory.assign(HistoryLength() + maxFrames, T(0));
+    mAcc.assign(maxFrames, T(0));
+  }
+
+  /** Clear the filter memory */
+  void Reset()
+  {
+    std::fill(mHistory.begin(), mHistory.end(), T(0));
+  }
+
+  /** Up-sample a block. pOutput may be the same array as pInput
+   * @param pOutput Output array with capacity for nFrames * 2 samples
+   * @param pInput Input array of nFrames samples
+   * @param nFrames Number of input samples, no more than the size passed to Resize() */
+  void ProcessBlock(T* pOutput, const T* pInput, int nFrames)
+  {
+    assert(nFrames <= mMaxFrames);
+
+    const int historyLength = HistoryLength();
+    T* pHistory = mHistory.data();
+
+    std::copy_n(pInput, nFrames, pHistory + historyLength);
+
+    this->ConvolveFolded(mAcc.data(), pHistory, nFrames);
+
+    const T* pDelayed = pHistory + historyLength - (this->mHalfLength - 1);
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      pOutput[2 * s] = T(2) * mAcc[s];
+      pOutput[2 * s + 1] = pDelayed[s];
+    }
+
+    std::memmove(pHistory, pHistory + nFrames, historyLength * sizeof(T));
+  }
+
+private:
+  int HistoryLength() const { return 2 * this->mHalfLength - 1; }
+
+  std::vector<T> mHistory;
+  std::vector<T> mAcc;
+  int mMaxFrames = 0;
+};
+
+/** Linear-phase polyphase half-band FIR 2x down-sampler. The input is split into its even and odd phases, the even phase is convolved and the odd phase is delayed */
+template <typename T>
+class FIRDownsampler2x : public FIRStage2x<T>
+{
+public:
+  /** Allocate the history for blocks of up to maxFrames output samples and clear it */
+  void Resize(int maxFrames)
+  {
+    mMaxFrames = maxFrames;
+    mEven.assign(2 * this->mHalfLength - 1 + maxFrames, T(0));
+    mOdd.assign(this->mHalfLength + maxFrames, T(0));
+  }
+
+  /** Clear the filter memory */
+  void Reset()
+  {
+    std::fill(mEven.begin(), mEven.end(), T(0));
+    std::fill(mOdd.begin(), mOdd.end(), T(0));
+  }
+
+  /** Down-sample a block. pOutput may be the same array as pInput
+   * @param pOutput Output array with capacity for nFrames samples
+   * @param pInput Input array of nFrames * 2 samples
+   * @param nFrames Number of output samples, no more than the size passed to Resize() */
+  void ProcessBlock(T* pOutput, const T* pInput, int nFrames)
+  {
+    assert(nFrames <= mMaxFrames);
+
+    const int evenHistory = 2 * this->mHalfLength - 1;
+    const int oddHistory = this->mHalfLength;
+    T* pEven = mEven.data();
+    T* pOdd = mOdd.data();
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      pEven[evenHistory + s] = pInput[2 * s];
+      pOdd[oddHistory + s] = pInput[2 * s + 1];
+    }
+
+    this->ConvolveFolded(pOutput, pEven, nFrames);
+
+    for (int s = 0; s < nFrames; s++)
+      pOutput[s] += T(0.5) * pOdd[s];
+
+    std::memmove(pEven, pEven + nFrames, evenHistory * sizeof(T));
+    std::memmove(pOdd, pOdd + nFrames, oddHistory * sizeof(T));
+  }
+
+private:
+  std::vector<T> mEven;
+  std::vector<T> mOdd;
+  int mMaxFrames = 0;
+};
+
+/** A whole-sample delay, used to round the latency of a cascade of FIR stages up to a whole number of samples at the base rate */
+template <typename T>
+class FIRDelay
+{
+public:
+  /** Allocate for delays of up to maxDelay samples and blocks of up to maxFrames */
+  void Resize(int maxDelay, int maxFrames)
+  {
+    mMaxDelay = maxDelay;
+    mMaxFrames = maxFrames;
+    mBuffer.assign(maxDelay + maxFrames, T(0));
+    mDelay = std::min(mDelay, maxDelay);
+  }
+
+  /** Set the delay and clear the buffer. Doesn't allocate */
+  void SetDelay(int delay)
+  {
+    assert(delay <= mMaxDelay);
+    mDelay = delay;
+    Reset();
+  }
+
+  void Reset()
+  {
+    std::fill(mBuffer.begin(), mBuffer.end(), T(0));
+  }
+
+  /** Delay a block in place */
+  void ProcessBlock(T* pData, int nFrames)
+  {
+    assert(nFrames <= mMaxFrames);
+
+    if (mDelay == 0)
+      return;
+
+    T* pBuffer = mBuffer.data();
+    std::copy_n(pData, nFrames, pBuffer + mDelay);
+    std::copy_n(pBuffer, nFrames, pData);
+    std::memmove(pBuffer, pBuffer + nFrames, mDelay * sizeof(T));
+  }
+
+private:
+  std::vector<T> mBuffer;
+  int mDelay = 0;
+  int mMaxDelay = 0;
+  int mMaxFrames = 0;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,410 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc STFTProcessor
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "fft.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugThreadPool.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A short-time Fourier transform engine for spectral effects, such as denoisers, spectral gates and vocoders, which windows overlapping frames of every channel,
+ * transforms them with WDL_real_fft(), passes the spectra to a function to modify, and overlap-adds the resynthesized frames into the output.
+ * The spectra have fftSize / 2 + 1 bins in frequency order, from DC to Nyquist. The imaginary parts of the DC and Nyquist bins are ignored.
+ *
+ * A frame's input is complete once every hop. How its work runs is chosen with SetScheduling():
+ * - EScheduling::kImmediate processes the frame in the block its input completes in, for the lowest latency, but a frame that is large compared to the block
+ *   lands in one callback
+ * - EScheduling::kSpread gives each frame a hop to finish in, and does its forward transforms, spectral function and inverse transforms a piece at a time
+ *   across the blocks in that hop, at the cost of a hop more latency
+ * - EScheduling::kBackground runs each frame on IPlugThreadPool during the hop, and only waits for it if it isn't done when its output is needed, for very large frames.
+ *   Frames run in spread mode if there is no pool, or its queues are full
+ *
+ * Report GetLatency() with IPlugProcessor::SetLatency(). Settings take effect at the next Reset(), which allocates, so call it from OnReset().
+ * Add WDL/fft.c to the project to use it
+ * @code
+ * // a spectral gate
+ * mSTFT = std::make_unique<STFTProcessor>(2, [&](WDL_FFT_COMPLEX** spectra, int nChans, int nBins) {
+ *   for (auto c = 0; c < nChans; c++)
+ *     for (auto k = 0; k < nBins; k++)
+ *       if (spectra[c][k].re * spectra[c][k].re + spectra[c][k].im * spectra[c][k].im < mThresholdPower)
+ *         spectra[c][k].re = spectra[c][k].im = 0.;
+ * });
+ * mSTFT->SetFFTSize(4096, 1024);
+ * @endcode */
+class STFTProcessor final
+{
+public:
+  /** Modifies the spectra of one frame in place, on the audio thread or, with EScheduling::kBackground, a worker
+   * @param spectra nChans arrays of nBins bins, from DC to Nyquist
+   * @param nChans The number of channels
+   * @param nBins The number of bins, fftSize / 2 + 1 */
+  using SpectrumFunc = std::function<void(WDL_FFT_COMPLEX** spectra, int nChans, int nBins)>;
+
+  enum class EWindow
+  {
+    kRectangular,
+    kHann,
+    kSqrtHann
+  };
+
+  enum class EScheduling
+  {
+    kImmediate,
+    kSpread,
+    kBackground
+  };
+
+  /** @param nChans The number of channels processed
+   * @param func The function that modifies each frame's spectra */
+  STFTProcessor(int nChans, SpectrumFunc func)
+  : mNChans(nChans)
+  , mFunc(std::move(func))
+  , mSpectrumPtrs(nChans)
+  {
+    WDL_fft_init();
+    mTask.Set(RunFrameTask, this);
+  }
+
+  ~STFTProcessor()
+  {
+    FinishFrame();
+  }
+
+  STFTProcessor(const STFTProcessor&) = delete;
+  STFTProcessor& operator=(const STFTProcessor&) = delete;
+
+  /** @param fftSize The frame size, a power of two from 16 to WDL_FFT_MAX_SIZE
+   * @param hopSize The number of samples between frames, which divides fftSize, e.g. fftSize / 4 */
+  void SetFFTSize(int fftSize, int hopSize)
+  {
+    assert(fftSize >= 16 && fftSize <= WDL_FFT_MAX_SIZE && (fftSize & (fftSize - 1)) == 0);
+    assert(hopSize >= 1 && hopSize <= fftSize && fftSize % hopSize == 0);
+
+    mNextFFTSize = fftSize;
+    mNextHopSize = hopSize;
+  }
+
+  /** Set the windows. The synthesis window is divided by the overlap-add of the windows' product at each position in the hop, so unmodified spectra are reconstructed exactly
+   * with any pair, except where that sum is zero: Hann with a hop of fftSize. For smooth overlaps of modified spectra pick a pair whose product already overlap-adds to a constant,
+   * such as sqrt Hann with sqrt Hann, or Hann with rectangular, at a hop of fftSize / 2 or less, or Hann with Hann at fftSize / 3 or less, e.g. fftSize / 4
+   * @param analysis Applied to each frame before the forward transform
+   * @param synthesis Applied to each frame after the inverse transform, for smooth overlaps when the spectra are modified */
+  void SetWindows(EWindow analysis, EWindow synthesis)
+  {
+    mNextAnalysisWindow = analysis;
+    mNextSynthesisWindow = synthesis;
+  }
+
+  /** @param scheduling How frames are scheduled, see EScheduling
+   * @param pPool The pool used by EScheduling::kBackground, e.g. IPlugThreadPool::Get() */
+  void SetScheduling(EScheduling scheduling, std::shared_ptr<IPlugThreadPool> pPool = nullptr)
+  {
+    mNextScheduling = scheduling;
+    mpNextPool = std::move(pPool);
+  }
+
+  /** Apply the settings, allocate and clear. Call from OnReset(), while the audio isn't processing */
+  void Reset(double sampleRate)
+  {
+    FinishFrame();
+
+    mSampleRate = sampleRate;
+    mFFTSize = mNextFFTSize;
+    mHopSize = mNextHopSize;
+    mScheduling = mNextScheduling;
+    mpPool = mNextScheduling == EScheduling::kBackground ? mpNextPool : nullptr;
+
+    // a frame is read while the next hop is written, and written while the output of previous frames is read
+    int ringSize = 1;
+
+    while (ringSize < 2 * (mFFTSize + mHopSize))
+      ringSize <<= 1;
+
+    mRingMask = ringSize - 1;
+
+    mInputRings.assign(mNChans, std::vector<sample>(ringSize, 0.));
+    mOutputRings.assign(mNChans, std::vector<sample>(ringSize, 0.));
+    mFFTBufs.assign(mNChans, std::vector<WDL_FFT_REAL>(mFFTSize, 0.));
+    mSpectra.assign(mNChans, std::vector<WDL_FFT_COMPLEX>(GetNumBins()));
+
+    for (auto c = 0; c < mNChans; c++)
+      mSpectrumPtrs[c] = mSpectra[c].data();
+
+    mPermute.resize(mFFTSize / 2);
+
+    for (auto k = 0; k < mFFTSize / 2; k++)
+      mPermute[k] = WDL_fft_permute(mFFTSize / 2, k);
+
+    mAnalysisWindow = MakeWindow(mNextAnalysisWindow, mFFTSize);
+    mSynthesisWindow = MakeWindow(mNextSynthesisWindow, mFFTSize);
+
+    // the windows' product summed over the frames that overlap a sample, which repeats every hop as the hop divides fftSize, and WDL_real_fft()'s round trip gain of 2 * fftSize
+    std::vector<double> overlapSums(mHopSize, 0.);
+
+    for (auto i = 0; i < mFFTSize; i++)
+      overlapSums[i % mHopSize] += mAnalysisWindow[i] * mSynthesisWindow[i];
+
+    for (auto i = 0; i < mFFTSize; i++)
+    {
+      const double overlapSum = overlapSums[i % mHopSize];
+      mSynthesisWindow[i] = overlapSum > 1e-9 ? mSynthesisWindow[i] / (overlapSum * 2. * mFFTSize) : 0.;
+    }
+
+    // the rings start as if fftSize samples of silence had been processed
+    mTime = mFFTSize;
+    mNextFrameEnd = mHopSize + mFFTSize - 1;
+    mFramePending = false;
+  }
+
+  /** Process a block through the STFT. The inputs and outputs can be the same buffers. Call on the audio thread
+   * @param inputs nChans buffers of nFrames
+   * @param outputs nChans buffers of nFrames, delayed by GetLatency()
+   * @param nFrames The number of frames */
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames)
+  {
+    const int latency = GetLatency();
+    int pos = 0;
+
+    while (pos < nFrames)
+    {
+      const bool event = mNextFrameEnd - mTime < static_cast<uint64_t>(nFrames - pos);
+      const int n = event ? static_cast<int>(mNextFrameEnd - mTime) + 1 : nFrames - pos;
+
+      for (auto c = 0; c < mNChans; c++)
+        CopyToRing(mInputRings[c].data(), mTime, inputs[c] + pos, n);
+
+      // the pending frame's output is due at the sample that completes the next frame
+      if (event)
+      {
+        FinishFrame();
+        StartFrame(mNextFrameEnd + 1 - mFFTSize);
+        mNextFrameEnd += mHopSize;
+      }
+
+      for (auto c = 0; c < mNChans; c++)
+        EmitFromRing(mOutputRings[c].data(), mTime - latency, outputs[c] + pos, n);
+
+      mTime += n;
+      pos += n;
+    }
+
+    if (mFramePending && !mFrameSubmitted)
+    {
+      // the share of the frame's steps due by now, so that it is done by the end of its hop
+      const uint64_t elapsed = mTime - (mFrameStart + mFFTSize);
+      const int due = static_cast<int>(std::min<uint64_t>((elapsed * NSteps() + mHopSize - 1) / mHopSize, NSteps()));
+
+      while (mNextStep < due)
+        RunStep(mNextStep++);
+    }
+  }
+
+  /** @return The delay from input to output in samples, for IPlugProcessor::SetLatency(). A hop more with EScheduling::kSpread or kBackground */
+  int GetLatency() const { return mFFTSize - 1 + (mScheduling == EScheduling::kImmediate ? 0 : mHopSize); }
+
+  int GetFFTSize() const { return mFFTSize; }
+
+  int GetHopSize() const { return mHopSize; }
+
+  /** @return The number of bins passed to the spectral function */
+  int GetNumBins() const { return mFFTSize / 2 + 1; }
+
+  /** @return The frequency of a bin in Hz */
+  double GetBinFrequency(int bin) const { return bin * mSampleRate / mFFTSize; }
+
+private:
+  static std::vector<double> MakeWindow(EWindow type, int size)
+  {
+    std::vector<double> window(size, 1.);
+
+    // periodic windows, which overlap-add exactly
+    for (auto i = 0; i < size; i++)
+    {
+      const double hann = 0.5 - 0.5 * std::cos(2. * PI * i / size);
+
+      if (type == EWindow::kHann)
+        window[i] = hann;
+      else if (type == EWindow::kSqrtHann)
+        window[i] = std::sqrt(hann);
+    }
+
+    return window;
+  }
+
+  void CopyToRing(sample* pRing, uint64_t time, const sample* pSrc, int n) const
+  {
+    const int start = static_cast<int>(time & mRingMask);
+    const int first = std::min(n, mRingMask + 1 - start);
+
+    memcpy(pRing + start, pSrc, first * sizeof(sample));
+    memcpy(pRing, pSrc + first, (n - first) * sizeof(sample));
+  }
+
+  /** Read the finished output, and clear it for the frames that will be added there a ring later */
+  void EmitFromRing(sample* pRing, uint64_t time, sample* pDst, int n) const
+  {
+    const int start = static_cast<int>(time & mRingMask);
+    const int first = std::min(n, mRingMask + 1 - start);
+
+    memcpy(pDst, pRing + start, first * sizeof(sample));
+    memcpy(pDst + first, pRing, (n - first) * sizeof(sample));
+    memset(pRing + start, 0, first * sizeof(sample));
+    memset(pRing, 0, (n - first) * sizeof(sample));
+  }
+
+  /** A forward transform per channel, the spectral function, and an inverse transform per channel */
+  int NSteps() const { return 2 * mNChans + 1; }
+
+  void StartFrame(uint64_t frameStart)
+  {
+    mFrameStart = frameStart;
+    mNextStep = 0;
+    mFramePending = true;
+    mFrameSubmitted = false;
+
+    if (mScheduling == EScheduling::kImmediate)
+      FinishFrame();
+    else if (mpPool)
+      mFrameSubmitted = mpPool->Submit(mTask, mGroup, IPlugThreadPool::DeadlineIn(mHopSize / mSampleRate));
+  }
+
+  void FinishFrame()
+  {
+    if (!mFramePending)
+      return;
+
+    if (mFrameSubmitted)
+      mpPool->Wait(mGroup);
+    else
+    {
+      while (mNextStep < NSteps())
+        RunStep(mNextStep++);
+    }
+
+    mFramePending = false;
+  }
+
+  static void RunFrameTask(void* pContext)
+  {
+    STFTProcessor* pSTFT = static_cast<STFTProcessor*>(pContext);
+
+    for (auto step = 0; step < pSTFT->NSteps(); step++)
+      pSTFT->RunStep(step);
+  }
+
+  void RunStep(int step)
+  {
+    const int n = mFFTSize;
+    const int nHalf = n / 2;
+
+    if (step < mNChans)
+    {
+      const sample* pRing = mInputRings[step].data();
+      WDL_FFT_REAL* pBuf = mFFTBufs[step].data();
+
+      for (auto i = 0; i < n; i++)
+        pBuf[i] = static_cast<WDL_FFT_REAL>(pRing[(mFrameStart + i) & mRingMask] * mAnalysisWindow[i]);
+
+      WDL_real_fft(pBuf, n, 0);
+
+      const WDL_FFT_COMPLEX* pPacked = reinterpret_cast<const WDL_FFT_COMPLEX*>(pBuf);
+      WDL_FFT_COMPLEX* pSpectrum = mSpectra[step].data();
+
+      pSpectrum[0].re = pBuf[0];
+      pSpectrum[0].im = 0.;
+      pSpectrum[nHalf].re = pBuf[1];
+      pSpectrum[nHalf].im = 0.;
+
+      for (auto k = 1; k < nHalf; k++)
+        pSpectrum[k] = pPacked[mPermute[k]];
+    }
+    else if (step == mNChans)
+    {
+      mFunc(mSpectrumPtrs.data(), mNChans, GetNumBins());
+    }
+    else
+    {
+      const int c = step - mNChans - 1;
+      WDL_FFT_REAL* pBuf = mFFTBufs[c].data();
+      WDL_FFT_COMPLEX* pPacked = reinterpret_cast<WDL_FFT_COMPLEX*>(pBuf);
+      const WDL_FFT_COMPLEX* pSpectrum = mSpectra[c].data();
+
+      for (auto k = 1; k < nHalf; k++)
+        pPacked[mPermute[k]] = pSpectrum[k];
+
+      pBuf[0] = pSpectrum[0].re;
+      pBuf[1] = pSpectrum[nHalf].re;
+
+      WDL_real_fft(pBuf, n, 1);
+
+      sample* pRing = mOutputRings[c].data();
+
+      for (auto i = 0; i < n; i++)
+        pRing[(mFrameStart + i) & mRingMask] += pBuf[i] * mSynthesisWindow[i];
+    }
+  }
+
+  const int mNChans;
+  SpectrumFunc mFunc;
+
+  int mNextFFTSize = 2048;
+  int mNextHopSize = 512;
+  EWindow mNextAnalysisWindow = EWindow::kSqrtHann;
+  EWindow mNextSynthesisWindow = EWindow::kSqrtHann;
+  EScheduling mNextScheduling = EScheduling::kSpread;
+  std::shared_ptr<IPlugThreadPool> mpNextPool;
+
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  int mFFTSize = 2048;
+  int mHopSize = 512;
+  EScheduling mScheduling = EScheduling::kSpread;
+  std::shared_ptr<IPlugThreadPool> mpPool;
+
+  int mRingMask = 0;
+  std::vector<std::vector<sample>> mInputRings;
+  std::vector<std::vector<sample>> mOutputRings;
+  std::vector<std::vector<WDL_FFT_REAL>> mFFTBufs;
+  std::vector<std::vector<WDL_FFT_COMPLEX>> mSpectra;
+  std::vector<WDL_FFT_COMPLEX*> mSpectrumPtrs;
+  std::vector<int> mPermute;
+  std::vector<double> mAnalysisWindow;
+  std::vector<double> mSynthesisWindow;
+
+  /** The number of samples processed, plus the fftSize of silence the rings start with */
+  uint64_t mTime = 0;
+  /** The time of the sample that completes the next frame */
+  uint64_t mNextFrameEnd = 0;
+
+  uint64_t mFrameStart = 0;
+  int mNextStep = 0;
+  bool mFramePending = false;
+  bool mFrameSubmitted = false;
+  IThreadPoolTask mTask;
+  IThreadPoolGroup mGroup;
+};
+
+END_IPLUG_NAMESPACE
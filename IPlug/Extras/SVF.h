@@ -19,6 +19,7 @@
 #include <complex>
 
 #include "IPlugPlatform.h"
+#include "IPlugSIMD.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -102,19 +103,77 @@ public:
     if(mState != mNewState)
       UpdateCoefficients();
 
-    for (auto c = 0; c < nChans; c++)
+    auto c = 0;
+
+#if defined IPLUG_SIMD_SSE2 || defined IPLUG_SIMD_NEON || defined IPLUG_SIMD_WASM
+    // pairs of channels in the two lanes of a double vector
+    for (; c + 1 < nChans; c += 2)
+      ProcessPair(inputs[c], inputs[c + 1], outputs[c], outputs[c + 1], c, nFrames);
+#endif
+
+    for (; c < nChans; c++)
     {
+      const double a1 = m_a1, a2 = m_a2, a3 = m_a3;
+      const double m0 = (T) m_m0, m1 = m_m1, m2 = m_m2;
+      double ic1eq = mIc1eq[c];
+      double ic2eq = mIc2eq[c];
+      const T* pIn = inputs[c];
+      T* pOut = outputs[c];
+
       for (auto s = 0; s < nFrames; s++)
       {
-        const double v0 = (double) inputs[c][s];
+        const double v0 = (double) pIn[s];
+        const double v3 = v0 - ic2eq;
+        const double v1 = a1 * ic1eq + a2 * v3;
+        const double v2 = ic2eq + a2 * ic1eq + a3 * v3;
+        ic1eq = 2. * v1 - ic1eq;
+        ic2eq = 2. * v2 - ic2eq;
+
+        pOut[s] = m0 * v0 + m1 * v1 + m2 * v2;
+      }
+
+      mIc1eq[c] = ic1eq;
+      mIc2eq[c] = ic2eq;
+    }
+  }
+
+  /** Process a block with the cutoff modulated at audio rate, e.g. by an envelope or LFO. The Q, gain and mode set with the other setters are used,
+   * and the cutoff set with SetFreqCPS() is ignored. Only the coefficients that depend on the cutoff are updated per sample, using FastTan()
+   * @param inputs The input channels
+   * @param outputs The output channels
+   * @param nChans The number of channels
+   * @param nFrames The number of samples in each channel
+   * @param pFreqCPS nFrames cutoff frequencies in Hz, shared by all channels */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames, const T* pFreqCPS)
+  {
+    assert(nChans <= NC);
+
+    if(mState != mNewState)
+      UpdateCoefficients();
+
+    const double k = 1. / mState.Q;
+    const double m0 = (T) m_m0, m1 = m_m1, m2 = m_m2;
+    const double gScale = CalcGScale(mState.mode, mState.gain);
+    const double wScale = PI / mState.sampleRate;
+    const double maxW = 0.499 * PI;
 
-        mV3[c] = v0 - mIc2eq[c];
-        mV1[c] = m_a1 * mIc1eq[c] + m_a2*mV3[c];
-        mV2[c] = mIc2eq[c] + m_a2 * mIc1eq[c] + m_a3 * mV3[c];
-        mIc1eq[c] = 2. * mV1[c] - mIc1eq[c];
-        mIc2eq[c] = 2. * mV2[c] - mIc2eq[c];
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const double g = FastTan(std::min(wScale * Clip((double) pFreqCPS[s], 10.0, 20000.), maxW)) * gScale;
+      const double a1 = 1. / (1. + g * (g + k));
+      const double a2 = g * a1;
+      const double a3 = g * a2;
 
-        outputs[c][s] = (T) m_m0 * v0 + m_m1 * mV1[c] + m_m2 * mV2[c];
+      for (auto c = 0; c < nChans; c++)
+      {
+        const double v0 = (double) inputs[c][s];
+        const double v3 = v0 - mIc2eq[c];
+        const double v1 = a1 * mIc1eq[c] + a2 * v3;
+        const double v2 = mIc2eq[c] + a2 * mIc1eq[c] + a3 * v3;
+        mIc1eq[c] = 2. * v1 - mIc1eq[c];
+        mIc2eq[c] = 2. * v2 - mIc2eq[c];
+
+        outputs[c][s] = (T) (m0 * v0 + m1 * v1 + m2 * v2);
       }
     }
   }
@@ -123,27 +182,139 @@ public:
   {
     for (auto c = 0; c < NC; c++)
     {
-      mV1[c] = 0.;
-      mV2[c] = 0.;
-      mV3[c] = 0.;
       mIc1eq[c] = 0.;
       mIc2eq[c] = 0.;
     }
   }
 
 private:
+#if defined IPLUG_SIMD_SSE2
+  void ProcessPair(const T* pInL, const T* pInR, T* pOutL, T* pOutR, int c, int nFrames)
+  {
+    const __m128d a1 = _mm_set1_pd(m_a1), a2 = _mm_set1_pd(m_a2), a3 = _mm_set1_pd(m_a3);
+    const __m128d m0 = _mm_set1_pd((T) m_m0), m1 = _mm_set1_pd(m_m1), m2 = _mm_set1_pd(m_m2);
+    const __m128d two = _mm_set1_pd(2.);
+    __m128d ic1eq = _mm_setr_pd(mIc1eq[c], mIc1eq[c + 1]);
+    __m128d ic2eq = _mm_setr_pd(mIc2eq[c], mIc2eq[c + 1]);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const __m128d v0 = _mm_setr_pd((double) pInL[s], (double) pInR[s]);
+      const __m128d v3 = _mm_sub_pd(v0, ic2eq);
+      const __m128d v1 = _mm_add_pd(_mm_mul_pd(a1, ic1eq), _mm_mul_pd(a2, v3));
+      const __m128d v2 = _mm_add_pd(_mm_add_pd(ic2eq, _mm_mul_pd(a2, ic1eq)), _mm_mul_pd(a3, v3));
+      ic1eq = _mm_sub_pd(_mm_mul_pd(two, v1), ic1eq);
+      ic2eq = _mm_sub_pd(_mm_mul_pd(two, v2), ic2eq);
+
+      alignas(16) double out[2];
+      _mm_store_pd(out, _mm_add_pd(_mm_add_pd(_mm_mul_pd(m0, v0), _mm_mul_pd(m1, v1)), _mm_mul_pd(m2, v2)));
+      pOutL[s] = (T) out[0];
+      pOutR[s] = (T) out[1];
+    }
+
+    alignas(16) double state[2];
+    _mm_store_pd(state, ic1eq);
+    mIc1eq[c] = state[0]; mIc1eq[c + 1] = state[1];
+    _mm_store_pd(state, ic2eq);
+    mIc2eq[c] = state[0]; mIc2eq[c + 1] = state[1];
+  }
+#elif defined IPLUG_SIMD_NEON
+  void ProcessPair(const T* pInL, const T* pInR, T* pOutL, T* pOutR, int c, int nFrames)
+  {
+    const float64x2_t a1 = vdupq_n_f64(m_a1), a2 = vdupq_n_f64(m_a2), a3 = vdupq_n_f64(m_a3);
+    const float64x2_t m0 = vdupq_n_f64((T) m_m0), m1 = vdupq_n_f64(m_m1), m2 = vdupq_n_f64(m_m2);
+    const float64x2_t two = vdupq_n_f64(2.);
+    const double ic1[2] = { mIc1eq[c], mIc1eq[c + 1] };
+    const double ic2[2] = { mIc2eq[c], mIc2eq[c + 1] };
+    float64x2_t ic1eq = vld1q_f64(ic1);
+    float64x2_t ic2eq = vld1q_f64(ic2);
+
+    // vmulq/vaddq rather than the fused vfmaq, so that the result matches the scalar loop
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const double in[2] = { (double) pInL[s], (double) pInR[s] };
+      const float64x2_t v0 = vld1q_f64(in);
+      const float64x2_t v3 = vsubq_f64(v0, ic2eq);
+      const float64x2_t v1 = vaddq_f64(vmulq_f64(a1, ic1eq), vmulq_f64(a2, v3));
+      const float64x2_t v2 = vaddq_f64(vaddq_f64(ic2eq, vmulq_f64(a2, ic1eq)), vmulq_f64(a3, v3));
+      ic1eq = vsubq_f64(vmulq_f64(two, v1), ic1eq);
+      ic2eq = vsubq_f64(vmulq_f64(two, v2), ic2eq);
+
+      const float64x2_t out = vaddq_f64(vaddq_f64(vmulq_f64(m0, v0), vmulq_f64(m1, v1)), vmulq_f64(m2, v2));
+      pOutL[s] = (T) vgetq_lane_f64(out, 0);
+      pOutR[s] = (T) vgetq_lane_f64(out, 1);
+    }
+
+    mIc1eq[c] = vgetq_lane_f64(ic1eq, 0); mIc1eq[c + 1] = vgetq_lane_f64(ic1eq, 1);
+    mIc2eq[c] = vgetq_lane_f64(ic2eq, 0); mIc2eq[c + 1] = vgetq_lane_f64(ic2eq, 1);
+  }
+#elif defined IPLUG_SIMD_WASM
+  void ProcessPair(const T* pInL, const T* pInR, T* pOutL, T* pOutR, int c, int nFrames)
+  {
+    const v128_t a1 = wasm_f64x2_splat(m_a1), a2 = wasm_f64x2_splat(m_a2), a3 = wasm_f64x2_splat(m_a3);
+    const v128_t m0 = wasm_f64x2_splat((T) m_m0), m1 = wasm_f64x2_splat(m_m1), m2 = wasm_f64x2_splat(m_m2);
+    const v128_t two = wasm_f64x2_splat(2.);
+    v128_t ic1eq = wasm_f64x2_make(mIc1eq[c], mIc1eq[c + 1]);
+    v128_t ic2eq = wasm_f64x2_make(mIc2eq[c], mIc2eq[c + 1]);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const v128_t v0 = wasm_f64x2_make((double) pInL[s], (double) pInR[s]);
+      const v128_t v3 = wasm_f64x2_sub(v0, ic2eq);
+      const v128_t v1 = wasm_f64x2_add(wasm_f64x2_mul(a1, ic1eq), wasm_f64x2_mul(a2, v3));
+      const v128_t v2 = wasm_f64x2_add(wasm_f64x2_add(ic2eq, wasm_f64x2_mul(a2, ic1eq)), wasm_f64x2_mul(a3, v3));
+      ic1eq = wasm_f64x2_sub(wasm_f64x2_mul(two, v1), ic1eq);
+      ic2eq = wasm_f64x2_sub(wasm_f64x2_mul(two, v2), ic2eq);
+
+      const v128_t out = wasm_f64x2_add(wasm_f64x2_add(wasm_f64x2_mul(m0, v0), wasm_f64x2_mul(m1, v1)), wasm_f64x2_mul(m2, v2));
+      pOutL[s] = (T) wasm_f64x2_extract_lane(out, 0);
+      pOutR[s] = (T) wasm_f64x2_extract_lane(out, 1);
+    }
+
+    mIc1eq[c] = wasm_f64x2_extract_lane(ic1eq, 0); mIc1eq[c + 1] = wasm_f64x2_extract_lane(ic1eq, 1);
+    mIc2eq[c] = wasm_f64x2_extract_lane(ic2eq, 0); mIc2eq[c + 1] = wasm_f64x2_extract_lane(ic2eq, 1);
+  }
+#endif
+
   void UpdateCoefficients()
   {
     mState = mNewState;
+    CalcCoefficients(mState.mode, mState.freq, mState.Q, mState.gain, mState.sampleRate, m_a1, m_a2, m_a3, m_m0, m_m1, m_m2);
+  }
+
+public:
+  /** Approximate std::tan(x) for 0 < x < PI/2 with a [5/4] Padé approximant, folded about PI/4 so that it stays accurate towards PI/2. The relative error is below 2e-8 */
+  static inline double FastTan(double x)
+  {
+    const bool fold = x > PI * 0.25;
+    const double y = fold ? PI * 0.5 - x : x;
+    const double y2 = y * y;
+    const double num = y * (945. + y2 * (-105. + y2));
+    const double den = 945. + y2 * (-420. + y2 * 15.);
+    return fold ? den / num : num / den;
+  }
 
-    const double w = std::tan(PI * mState.freq/mState.sampleRate);
+  /** @return The factor the shelving modes scale the warped cutoff by, 1 for the others. The m_m0, m_m1 and m_m2 coefficients don't depend on the cutoff, so this is all that is needed to update a filter when only its cutoff changes */
+  static double CalcGScale(EMode mode, double gain)
+  {
+    if (mode == kLowPassShelf || mode == kHighPassShelf)
+      return 1. / std::sqrt(std::pow(10., gain/40.));
 
-    switch(mState.mode)
+    return 1.;
+  }
+
+  /** Calculate the coefficients for a filter setting, shared with SVFLanes */
+  static void CalcCoefficients(EMode mode, double freq, double Q, double gain, double sampleRate,
+                               double& m_a1, double& m_a2, double& m_a3, double& m_m0, double& m_m1, double& m_m2)
+  {
+    const double w = std::tan(PI * freq/sampleRate);
+
+    switch(mode)
     {
       case kLowPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -155,7 +326,7 @@ private:
       case kHighPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -167,7 +338,7 @@ private:
       case kBandPass:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -179,7 +350,7 @@ private:
       case kNotch:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -191,7 +362,7 @@ private:
       case kPeak:
       {
         const double g = w;
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -202,9 +373,9 @@ private:
       }
       case kBell:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gain/40.);
         const double g = w;
-        const double k = 1 / mState.Q;
+        const double k = 1 / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -215,9 +386,9 @@ private:
       }
       case kLowPassShelf:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gain/40.);
         const double g = w / std::sqrt(A);
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -228,9 +399,9 @@ private:
       }
       case kHighPassShelf:
       {
-        const double A = std::pow(10., mState.gain/40.);
+        const double A = std::pow(10., gain/40.);
         const double g = w / std::sqrt(A);
-        const double k = 1. / mState.Q;
+        const double k = 1. / Q;
         m_a1 = 1./(1. + g * (g + k));
         m_a2 = g * m_a1;
         m_a3 = g * m_a2;
@@ -245,9 +416,6 @@ private:
   }
 
 private:
-  double mV1[NC] = {};
-  double mV2[NC] = {};
-  double mV3[NC] = {};
   double mIc1eq[NC] = {};
   double mIc2eq[NC] = {};
   double m_a1 = 0.;
@@ -274,4 +442,170 @@ private:
   Settings mState, mNewState;
 };
 
+/** N independent SVFs with their own settings and state stored in lanes, for processing one filter per voice across a group of voices.
+ * Coefficients are recalculated lazily for lanes whose settings changed, so modulating every lane once per block costs one tan() per lane.
+ * For smoother modulation, SetCutoffInterpolation() ramps the cutoff across each block, or a per sample cutoff can be passed to ProcessBlock().
+ * Inputs and outputs are interleaved by lane: pInput[s * N + lane] */
+template<typename T, int N>
+class SVFLanes
+{
+public:
+  using EMode = typename SVF<T>::EMode;
+  static constexpr int kNumLanes = N;
+
+  SVFLanes(EMode mode = SVF<T>::kLowPass, double freqCPS = 1000.)
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      mMode[l] = mode;
+      mFreq[l] = freqCPS;
+      mQ[l] = 0.1; // same defaults as SVF
+      mGain[l] = 1.;
+      mDirty[l] = true;
+    }
+  }
+
+  void SetFreqCPS(int lane, double freqCPS) { mFreq[lane] = Clip(freqCPS, 10.0, 20000.); mDirty[lane] = true; }
+
+  void SetQ(int lane, double Q) { mQ[lane] = Clip(Q, 0.1, 100.0); mDirty[lane] = true; }
+
+  void SetGain(int lane, double gainDB) { mGain[lane] = Clip(gainDB, -36.0, 36.0); mDirty[lane] = true; }
+
+  void SetMode(int lane, EMode mode) { mMode[lane] = mode; mDirty[lane] = true; }
+
+  void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+
+    for (auto l = 0; l < N; l++)
+      mDirty[l] = true;
+  }
+
+  /** When enabled, a lane whose settings change between blocks ramps its cutoff across the next block rather than jumping to it,
+   * which smooths envelopes and LFOs applied once per block
+   * @param interpolate \c true to ramp the cutoff, which costs a division per sample in the lanes that are ramping */
+  void SetCutoffInterpolation(bool interpolate) { mInterpolate = interpolate; }
+
+  /** Clear a lane's state, e.g. when a voice starts. The lane doesn't ramp from its previous cutoff */
+  void Reset(int lane)
+  {
+    mIc1eq[lane] = 0.;
+    mIc2eq[lane] = 0.;
+    mG[lane] = 0.;
+  }
+
+  /** @param pInput nFrames * N samples, interleaved by lane
+   * @param pOutput Receives nFrames * N samples, interleaved by lane. Can be the same as pInput */
+  void ProcessBlock(const T* pInput, T* pOutput, int nFrames)
+  {
+    double gStart[N];
+    double gStep[N];
+
+    for (auto l = 0; l < N; l++)
+    {
+      gStep[l] = 0.;
+
+      if (mDirty[l])
+      {
+        gStart[l] = mG[l];
+        UpdateLane(l);
+
+        if (mInterpolate && gStart[l] > 0. && nFrames > 0)
+          gStep[l] = (mG[l] - gStart[l]) / nFrames;
+      }
+    }
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const T* pIn = pInput + s * N;
+      T* pOut = pOutput + s * N;
+
+      for (auto l = 0; l < N; l++)
+      {
+        if (gStep[l] != 0. && s < nFrames - 1) // the last sample uses the new coefficients
+        {
+          const double g = gStart[l] + gStep[l] * (s + 1);
+          const double a1 = 1. / (1. + g * (g + mK[l]));
+          pOut[l] = Tick(l, pIn[l], a1, g * a1, g * g * a1);
+        }
+        else
+          pOut[l] = Tick(l, pIn[l], m_a1[l], m_a2[l], m_a3[l]);
+      }
+    }
+  }
+
+  /** Process a block with each lane's cutoff modulated at audio rate, e.g. by a per voice filter envelope. The Q, gain and mode set with the other setters are used,
+   * and the cutoff set with SetFreqCPS() is ignored. Only the coefficients that depend on the cutoff are updated per sample, using SVF::FastTan()
+   * @param pInput nFrames * N samples, interleaved by lane
+   * @param pOutput Receives nFrames * N samples, interleaved by lane. Can be the same as pInput
+   * @param pFreqCPS nFrames * N cutoff frequencies in Hz, interleaved by lane */
+  void ProcessBlock(const T* pInput, T* pOutput, int nFrames, const T* pFreqCPS)
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      if (mDirty[l])
+        UpdateLane(l);
+    }
+
+    const double wScale = PI / mSampleRate;
+    const double maxW = 0.499 * PI;
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const T* pIn = pInput + s * N;
+      const T* pFreq = pFreqCPS + s * N;
+      T* pOut = pOutput + s * N;
+
+      for (auto l = 0; l < N; l++)
+      {
+        const double g = SVF<T>::FastTan(std::min(wScale * Clip((double) pFreq[l], 10.0, 20000.), maxW)) * mGScale[l];
+        const double a1 = 1. / (1. + g * (g + mK[l]));
+        pOut[l] = Tick(l, pIn[l], a1, g * a1, g * g * a1);
+      }
+    }
+  }
+
+private:
+  void UpdateLane(int l)
+  {
+    SVF<T>::CalcCoefficients(mMode[l], mFreq[l], mQ[l], mGain[l], mSampleRate, m_a1[l], m_a2[l], m_a3[l], m_m0[l], m_m1[l], m_m2[l]);
+    mK[l] = 1. / mQ[l];
+    mGScale[l] = SVF<T>::CalcGScale(mMode[l], mGain[l]);
+    mG[l] = m_a2[l] / m_a1[l];
+    mDirty[l] = false;
+  }
+
+  inline T Tick(int l, T input, double a1, double a2, double a3)
+  {
+    const double v0 = (double) input;
+    const double v3 = v0 - mIc2eq[l];
+    const double v1 = a1 * mIc1eq[l] + a2 * v3;
+    const double v2 = mIc2eq[l] + a2 * mIc1eq[l] + a3 * v3;
+    mIc1eq[l] = 2. * v1 - mIc1eq[l];
+    mIc2eq[l] = 2. * v2 - mIc2eq[l];
+
+    return (T) (m_m0[l] * v0 + m_m1[l] * v1 + m_m2[l] * v2);
+  }
+
+  double mIc1eq[N] = {};
+  double mIc2eq[N] = {};
+  double m_a1[N] = {};
+  double m_a2[N] = {};
+  double m_a3[N] = {};
+  double m_m0[N] = {};
+  double m_m1[N] = {};
+  double m_m2[N] = {};
+  double mK[N] = {};
+  double mGScale[N] = {};
+  double mG[N] = {}; // the warped cutoff the coefficients were calculated for, 0 if the lane shouldn't ramp from it
+
+  EMode mMode[N];
+  double mFreq[N];
+  double mQ[N];
+  double mGain[N];
+  bool mDirty[N];
+  double mSampleRate = 44100.;
+  bool mInterpolate = false;
+};
+
 END_IPLUG_NAMESPACE
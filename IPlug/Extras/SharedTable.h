@@ -0,0 +1,165 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A process-wide registry of immutable DSP tables, built once per key and shared by every object and plug-in instance that asks for them
+ */
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A registry of immutable tables of type T (wavetables, window functions, filter coefficients, lookup tables...), keyed by the parameters they are built from.
+ * The first object to ask for a key builds the table, every other object in the process that asks for the same key, while anything still holds it, gets the
+ * same copy. Asking takes a lock, so do it when an object is set up, on the main thread, rather than on the audio thread. The table itself is never modified
+ * once it is built, so it can be read from any thread without locking. A table is freed when the last pointer to it is released, except that the registry
+ * also holds one built by Request() until the next call for its key finds it ready.
+ *
+ * Each T has its own registry, so the key only needs to tell two tables of the same type apart, e.g. std::make_tuple(size, beta). It must be copyable and
+ * ordered by operator<, as enums, numbers and std::tuples of them are.
+ * @tparam T The table type, built by the builder function and then only read
+ * @tparam Key The type of the parameters the table is built from */
+template <typename T, typename Key>
+class SharedTable
+{
+public:
+  using TablePtr = std::shared_ptr<const T>;
+
+  /** Get the table for a key, building it on this thread if nobody has it, or waiting if another thread is building it
+   * @param key The parameters the table is built from
+   * @param build A function that returns the table for key, by value. It is only called if the table has to be built
+   * @return The table */
+  template <typename Builder>
+  static TablePtr Get(const Key& key, Builder&& build)
+  {
+    std::promise<TablePtr> promise;
+    std::shared_future<TablePtr> future;
+
+    {
+      std::lock_guard<std::mutex> lock(GetMutex());
+      Entry& entry = GetEntries()[key];
+
+      if (TablePtr pTable = Collect(entry))
+        return pTable;
+
+      if (entry.mPending.valid())
+        future = entry.mPending;
+      else
+        entry.mPending = promise.get_future().share();
+    }
+
+    if (future.valid())
+      return future.get();
+
+    TablePtr pTable = std::make_shared<const T>(build());
+
+    {
+      std::lock_guard<std::mutex> lock(GetMutex());
+      Entry& entry = GetEntries()[key];
+      entry.mTable = pTable;
+      entry.mPending = std::shared_future<TablePtr>();
+      Prune();
+    }
+
+    promise.set_value(pTable);
+    return pTable;
+  }
+
+  /** Start building the table for a key on a background thread, if nobody has it yet, e.g. for a table that takes long enough to slow down the plug-in's constructor
+   * @param key The parameters the table is built from
+   * @param build A function that returns the table for key, by value. It is copied to the background thread
+   * @return A future that becomes ready when the table is built */
+  template <typename Builder>
+  static std::shared_future<TablePtr> Request(const Key& key, Builder build)
+  {
+    std::lock_guard<std::mutex> lock(GetMutex());
+    Entry& entry = GetEntries()[key];
+
+    if (TablePtr pTable = Collect(entry))
+    {
+      std::promise<TablePtr> ready;
+      ready.set_value(std::move(pTable));
+      return ready.get_future().share();
+    }
+
+    // the builder thread doesn't touch the registry, its table is collected by the next call that finds it ready,
+    // and the registry's statics wait for it if the process exits or the plug-in is unloaded while it is running
+    if (!entry.mPending.valid())
+      entry.mPending = std::async(std::launch::async, [build]() mutable { return TablePtr(std::make_shared<const T>(build())); }).share();
+
+    return entry.mPending;
+  }
+
+  /** @return The table for a key if something holds it, without building it or waiting for it, otherwise nullptr */
+  static TablePtr Find(const Key& key)
+  {
+    std::lock_guard<std::mutex> lock(GetMutex());
+    auto it = GetEntries().find(key);
+    return it != GetEntries().end() ? Collect(it->second) : nullptr;
+  }
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<const T> mTable;
+    std::shared_future<TablePtr> mPending; // while the table is being built, or until a table built by Request() is collected
+  };
+
+  /** @return The entry's table if something holds it, moving a table that Request() has finished building from its future to the entry */
+  static TablePtr Collect(Entry& entry)
+  {
+    if (!entry.mTable.expired() || !entry.mPending.valid() || entry.mPending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return entry.mTable.lock();
+
+    TablePtr pTable = entry.mPending.get();
+    entry.mTable = pTable;
+    entry.mPending = std::shared_future<TablePtr>();
+    return pTable;
+  }
+
+  /** Forget the tables nothing holds any more */
+  static void Prune()
+  {
+    auto& entries = GetEntries();
+
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+      if (it->second.mTable.expired() && !it->second.mPending.valid())
+        it = entries.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  static std::mutex& GetMutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static std::map<Key, Entry>& GetEntries()
+  {
+    static std::map<Key, Entry> sEntries;
+    return sEntries;
+  }
+};
+
+END_IPLUG_NAMESPACE
@@ -9,6 +9,9 @@
 */
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+
 #include "denormal.h"
 #include "IPlugConstants.h"
 
@@ -18,6 +21,8 @@ template<typename T, int NC = 1>
 class LogParamSmooth
 {
 private:
+  static constexpr double kConvergedRatio = 1e-6;
+
   double mA, mB;
   T mOutM1[NC];
 
@@ -66,25 +71,72 @@ public:
     mB = 1.0 - mA;
   }
 
+  /** @return \c true if a channel is close enough to a target (-120dB relative) that the rest of the smoothing can be skipped */
+  inline bool IsConverged(T target, int channel = 0) const
+  {
+    const T diff = mOutM1[channel] - target;
+    const T scale = std::max(std::abs(target), T(1));
+    return std::abs(diff) <= T(kConvergedRatio) * scale;
+  }
+
+  /** Smooth a block towards per-channel targets. Channels that have converged snap to their target, and the rest of the block is filled with it */
   void ProcessBlock(T inputs[NC], T** outputs, int nFrames, int channelOffset = 0)
   {
     const T b = mB;
     const T a = mA;
 
-    for (auto s = 0; s < nFrames; ++s)
+    for (auto c = 0; c < NC; c++)
     {
-      for (auto c = 0; c < NC; c++)
+      const T input = inputs[channelOffset + c];
+      T* pOutput = outputs[channelOffset + c];
+      auto s = 0;
+
+      for (; s < nFrames && !IsConverged(input, c); ++s)
       {
-        T output = (inputs[channelOffset + c] * b) + (mOutM1[c] * a);
+        T output = (input * b) + (mOutM1[c] * a);
 #ifndef OS_IOS
         denormal_fix(&output);
 #endif
         mOutM1[c] = output;
-        outputs[channelOffset + c][s] = output;
+        pOutput[s] = output;
+      }
+
+      if (s < nFrames)
+      {
+        mOutM1[c] = input;
+        std::fill_n(pOutput + s, nFrames - s, input);
       }
     }
   }
 
+  /** Smooth one sample of every channel, treating the channels as lanes for voice groups. Each lane can have a different target
+   * @param inputs NC target values
+   * @param outputs Receives NC smoothed values */
+  inline void ProcessLanes(const T* inputs, T* outputs)
+  {
+    const T b = mB;
+    const T a = mA;
+
+    for (auto c = 0; c < NC; c++)
+    {
+      T output = (inputs[c] * b) + (mOutM1[c] * a);
+#ifndef OS_IOS
+      denormal_fix(&output);
+#endif
+      mOutM1[c] = output;
+      outputs[c] = output;
+    }
+  }
+
+  /** Smooth a block towards per-lane targets
+   * @param inputs NC target values
+   * @param pOutput Receives nFrames * NC values, interleaved by lane: pOutput[s * NC + lane] */
+  void ProcessBlockLanes(const T* inputs, T* pOutput, int nFrames)
+  {
+    for (auto s = 0; s < nFrames; ++s)
+      ProcessLanes(inputs, pOutput + s * NC);
+  }
+
 } WDL_FIXALIGN;
 
 template<typename T>
@@ -93,7 +145,9 @@ class SmoothedGain
 public:
   void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames, double gainValue)
   {
-    for (auto s = 0; s < nFrames; ++s)
+    auto s = 0;
+
+    for (; s < nFrames && !mSmoother.IsConverged(gainValue); ++s)
     {
       const double smoothedGain = mSmoother.Process(gainValue);
       
@@ -102,6 +156,18 @@ public:
         outputs[c][s] = inputs[c][s] * smoothedGain;
       }
     }
+
+    if (s < nFrames)
+    {
+      // constant gain for the rest of the block
+      mSmoother.SetValue(gainValue);
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        for (auto i = s; i < nFrames; ++i)
+          outputs[c][i] = inputs[c][i] * gainValue;
+      }
+    }
   }
   
 private:
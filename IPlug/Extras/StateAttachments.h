@@ -0,0 +1,413 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Keeps the large binary data of a plug-in's state, such as user samples and impulse responses, out of the chunk the host stores, by its content hash
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_WIN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "sha.h"
+#include "wdlstring.h"
+
+#include "IPlugStructs.h"
+#include "IPlugPaths.h"
+#include "SharedTable.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A large blob of a plug-in's state, e.g. a sample or an impulse response the user has loaded, identified by the SHA-1 hash of its content.
+ * The data is immutable and shared: every attachment in the process with the same content holds the same copy, through SharedTable, so copying an attachment,
+ * restoring an undo snapshot or opening a second instance with the same sample costs a pointer. Set it on the main thread, hashing takes a few ms per MB.
+ * DSP code can keep the pointer from GetDataPtr() for as long as it reads the data. See StateAttachmentStore for putting it in the plug-in's state */
+class StateAttachment
+{
+public:
+  using Data = std::vector<uint8_t>;
+  using DataPtr = std::shared_ptr<const Data>;
+
+  /** The number of hex digits in a hash */
+  static constexpr int kHashLength = WDL_SHA1SIZE * 2;
+
+  StateAttachment() { mHash[0] = '\0'; }
+
+  /** Set the data, hashing it, and sharing it with any attachment in the process that has the same content
+   * @param data The data, moved into the attachment */
+  void Set(Data data)
+  {
+    char hash[kHashLength + 1];
+    Hash(data.data(), data.size(), hash);
+    Set(hash, SharedTable<Data, std::string>::Get(hash, [&data]() { return std::move(data); }));
+  }
+
+  /** Set the data from a copy of a buffer
+   * @param pData The data
+   * @param size The size of the data in bytes */
+  void Set(const void* pData, int size)
+  {
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+    Set(Data(pBytes, pBytes + std::max(size, 0)));
+  }
+
+  /** Remove the data and the hash */
+  void Clear()
+  {
+    mData = nullptr;
+    mHash[0] = '\0';
+    mSize = 0;
+  }
+
+  /** @return The data, or nullptr if there isn't any */
+  const uint8_t* GetData() const { return mData ? mData->data() : nullptr; }
+
+  /** @return The size of the data in bytes */
+  int Size() const { return mData ? static_cast<int>(mData->size()) : 0; }
+
+  /** @return A pointer to the data that keeps it alive, or nullptr if there isn't any */
+  DataPtr GetDataPtr() const { return mData; }
+
+  /** @return \c true if the attachment has data */
+  bool HasData() const { return mData != nullptr; }
+
+  /** @return The SHA-1 hash of the data as 40 lower case hex digits, or an empty string if the attachment has never been set */
+  const char* GetHash() const { return mHash; }
+
+  /** @return \c true if the attachment was unserialized from a state whose data wasn't embedded and couldn't be found in the store, e.g. a project copied from another computer.
+   * The hash is kept, so the plug-in can tell the user which file is missing, and serializing the attachment again keeps referring to it */
+  bool IsMissing() const { return mHash[0] && !mData; }
+
+  /** Hash a buffer as StateAttachment does
+   * @param pData The data
+   * @param size The size of the data in bytes
+   * @param hash Receives kHashLength hex digits and a terminating zero */
+  static void Hash(const void* pData, size_t size, char* hash)
+  {
+    static constexpr size_t kMaxAdd = 1 << 30; // WDL_SHA1::add() takes an int
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+    WDL_SHA1 sha;
+
+    for (size_t pos = 0; pos < size; pos += kMaxAdd)
+      sha.add(pBytes + pos, static_cast<int>(std::min(size - pos, kMaxAdd)));
+
+    unsigned char digest[WDL_SHA1SIZE];
+    sha.result(digest);
+
+    for (int i = 0; i < WDL_SHA1SIZE; i++)
+      snprintf(hash + i * 2, 3, "%02x", digest[i]);
+  }
+
+private:
+  friend class StateAttachmentStore;
+
+  void Set(const char* hash, DataPtr pData, int size = -1)
+  {
+    mData = std::move(pData);
+    mSize = mData ? static_cast<int>(mData->size()) : size;
+    strncpy(mHash, hash, kHashLength);
+    mHash[kHashLength] = '\0';
+  }
+
+  DataPtr mData;
+  int mSize = 0; // also the size of missing data, so that it can be referred to again
+  char mHash[kHashLength + 1];
+};
+
+/** Puts StateAttachments in and out of a plug-in's state, in SerializeState() and UnserializeState(), so that the chunk the host saves with the project, keeps for undo and compares
+ * only records an attachment's hash, while the data is written once, to a file named by the hash in the store's directory. Saving a project whose samples haven't changed doesn't copy them,
+ * and an attachment used by several instances or projects is stored once.
+ *
+ * The embed policy decides which attachments also go into the chunk, so that a project can be opened on another computer: all of them, those up to a size, or none.
+ * An attachment that can't be written to the directory is always embedded. When an attachment is read, embedded data is used as it is, otherwise the data is found in memory, if
+ * another attachment in the process holds it, or read from the directory and checked against the hash. If it can't be found the attachment IsMissing().
+ * Hosts don't tell plug-ins where a project is, so the directory is one for the plug-in, see DefaultDirectory(), or wherever the plug-in lets the user choose.
+ * The methods read and write files, so call them off the audio thread. Files are written under a temporary name and renamed, so a crash never leaves a corrupt attachment */
+class StateAttachmentStore
+{
+public:
+  /** Which attachments are embedded in the chunk as well as stored */
+  enum EEmbed
+  {
+    kEmbedNever = 0,
+    kEmbedSmall, // those up to the embed size
+    kEmbedAlways
+  };
+
+  static constexpr int kDefaultEmbedSize = 1 << 20;
+
+  /** @param directory The directory to store the attachments in, created when the first one is written. An empty string stores nothing and embeds every attachment
+   * @param embed The EEmbed policy
+   * @param embedSize The largest attachment kEmbedSmall embeds, in bytes */
+  StateAttachmentStore(const char* directory = "", EEmbed embed = kEmbedSmall, int embedSize = kDefaultEmbedSize)
+  : mDirectory(directory)
+  , mEmbed(embed)
+  , mEmbedSize(embedSize)
+  {
+  }
+
+  /** @param directory The directory to store the attachments in, see StateAttachmentStore() */
+  void SetDirectory(const char* directory) { mDirectory.Set(directory); }
+
+  /** @return The directory the attachments are stored in */
+  const char* GetDirectory() const { return mDirectory.Get(); }
+
+  /** @param embed The EEmbed policy
+   * @param embedSize The largest attachment kEmbedSmall embeds, in bytes */
+  void SetEmbedPolicy(EEmbed embed, int embedSize = kDefaultEmbedSize)
+  {
+    mEmbed = embed;
+    mEmbedSize = embedSize;
+  }
+
+  /** Get a directory in the user's application support folder for a plug-in's attachments, shared by all of its instances and projects
+   * @param path Receives the path
+   * @param mfrName The manufacturer's name, e.g. PLUG_MFR
+   * @param pluginName The plug-in's name, e.g. PLUG_NAME */
+  static void DefaultDirectory(WDL_String& path, const char* mfrName, const char* pluginName)
+  {
+    AppSupportPath(path);
+    path.AppendFormatted(1024, "%c%s%c%s%cAttachments", WDL_DIRCHAR, mfrName, WDL_DIRCHAR, pluginName, WDL_DIRCHAR);
+  }
+
+  /** Write an attachment to a chunk, in SerializeState(), storing its data if it isn't stored already
+   * @param attachment The attachment, which may be empty or missing
+   * @param chunk The chunk to append to
+   * @return \c true on success */
+  bool SerializeAttachment(const StateAttachment& attachment, IByteChunk& chunk) const
+  {
+    int size = attachment.mSize;
+    int flags = 0;
+
+    // a missing attachment carries on referring to its data, in case the data turns up again
+    if (attachment.HasData())
+    {
+      const bool embed = mEmbed == kEmbedAlways || (mEmbed == kEmbedSmall && size <= mEmbedSize);
+
+      if (embed || !Store(attachment))
+        flags |= kFlagEmbedded;
+    }
+
+    char hash[StateAttachment::kHashLength] = {};
+    memcpy(hash, attachment.GetHash(), strlen(attachment.GetHash()));
+
+    chunk.Put(&kMagic);
+    chunk.Put(&kFormatVersion);
+    chunk.Put(&flags);
+    chunk.Put(&size);
+    chunk.PutBytes(hash, StateAttachment::kHashLength);
+
+    if (flags & kFlagEmbedded)
+      chunk.PutBytes(attachment.GetData(), size);
+
+    return true;
+  }
+
+  /** Read an attachment from a chunk, in UnserializeState()
+   * @param attachment The attachment to set, which is missing if the data was neither embedded nor found
+   * @param chunk The chunk to read from
+   * @param startPos The position of the attachment in the chunk, in bytes
+   * @return The position after the attachment, or -1 if the chunk doesn't hold one there */
+  int UnserializeAttachment(StateAttachment& attachment, const IByteChunk& chunk, int startPos) const
+  {
+    int magic = 0, version = 0, flags = 0, size = 0;
+    char hash[StateAttachment::kHashLength + 1] = {};
+    int pos = chunk.Get(&magic, startPos);
+
+    if (pos < 0 || magic != kMagic)
+      return -1;
+
+    pos = chunk.Get(&version, pos);
+    pos = pos < 0 ? pos : chunk.Get(&flags, pos);
+    pos = pos < 0 ? pos : chunk.Get(&size, pos);
+    pos = pos < 0 ? pos : chunk.GetBytes(hash, StateAttachment::kHashLength, pos);
+
+    if (pos < 0 || version > kFormatVersion || size < 0)
+      return -1;
+
+    attachment.Clear();
+
+    if (flags & kFlagEmbedded)
+    {
+      if (size > chunk.Size() - pos)
+        return -1;
+
+      const uint8_t* pBytes = chunk.GetData() + pos;
+      attachment.Set(hash, SharedTable<StateAttachment::Data, std::string>::Get(hash, [pBytes, size]() { return StateAttachment::Data(pBytes, pBytes + size); }));
+      return pos + size;
+    }
+
+    if (!hash[0])
+      return pos;
+
+    StateAttachment::DataPtr pData = SharedTable<StateAttachment::Data, std::string>::Find(hash);
+
+    if (!pData)
+    {
+      StateAttachment::Data data;
+
+      if (Load(hash, size, data))
+        pData = SharedTable<StateAttachment::Data, std::string>::Get(hash, [&data]() { return std::move(data); });
+    }
+
+    attachment.Set(hash, std::move(pData), size);
+    return pos;
+  }
+
+  /** Write an attachment's data to the directory, unless a file of the right size is there already. SerializeAttachment() calls this, call it earlier, e.g. when the user loads a sample, so that saving the project doesn't wait for the write
+   * @param attachment The attachment
+   * @return \c true if the data is stored */
+  bool Store(const StateAttachment& attachment) const
+  {
+    if (!attachment.HasData() || !mDirectory.GetLength())
+      return false;
+
+    WDL_String path;
+    GetPath(attachment.GetHash(), path);
+
+    if (FileSize(path.Get()) == attachment.Size())
+      return true;
+
+    CreateDirectories(mDirectory.Get());
+
+    // another instance can be storing the same attachment, so the temporary name is this store's
+    WDL_String tempPath(path);
+    tempPath.AppendFormatted(64, ".%p.tmp", static_cast<const void*>(this));
+
+    FILE* fp = fopen(tempPath.Get(), "wb");
+
+    if (!fp)
+      return false;
+
+    const size_t size = static_cast<size_t>(attachment.Size());
+    bool ok = fwrite(attachment.GetData(), 1, size, fp) == size;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok && rename(tempPath.Get(), path.Get()) != 0)
+      ok = false;
+
+    if (!ok)
+    {
+      remove(tempPath.Get());
+      // another instance may have renamed its copy first
+      return FileSize(path.Get()) == attachment.Size();
+    }
+
+    return true;
+  }
+
+  /** Read an attachment's data from the directory
+   * @param hash The hash of the data
+   * @param size The size of the data in bytes
+   * @param data Receives the data
+   * @return \c true if the file was found, was the right size and had the right hash */
+  bool Load(const char* hash, int size, StateAttachment::Data& data) const
+  {
+    if (!mDirectory.GetLength())
+      return false;
+
+    WDL_String path;
+    GetPath(hash, path);
+
+    if (FileSize(path.Get()) != size)
+      return false;
+
+    FILE* fp = fopen(path.Get(), "rb");
+
+    if (!fp)
+      return false;
+
+    data.resize(static_cast<size_t>(size));
+    bool ok = fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+
+    char fileHash[StateAttachment::kHashLength + 1];
+    StateAttachment::Hash(data.data(), data.size(), fileHash);
+
+    if (!ok || strcmp(fileHash, hash))
+    {
+      data.clear();
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  static constexpr int kMagic = 'IPSA';
+  static constexpr int kFormatVersion = 1;
+  static constexpr int kFlagEmbedded = 1;
+
+  void GetPath(const char* hash, WDL_String& path) const
+  {
+    path.Set(mDirectory.Get());
+
+    if (path.GetLength() && path.Get()[path.GetLength() - 1] != WDL_DIRCHAR)
+      path.Append(WDL_DIRCHAR_STR);
+
+    path.AppendFormatted(64, "%s.bin", hash);
+  }
+
+  /** @return The size of a file, or -1 if it can't be opened */
+  static long FileSize(const char* path)
+  {
+    FILE* fp = fopen(path, "rb");
+
+    if (!fp)
+      return -1;
+
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fclose(fp);
+    return size;
+  }
+
+  /** Create a directory and any of its parents that don't exist */
+  static void CreateDirectories(const char* directory)
+  {
+    WDL_String path(directory);
+    char* pPath = path.Get();
+
+    for (int i = 1; i <= path.GetLength(); i++)
+    {
+      if (pPath[i] != WDL_DIRCHAR && pPath[i] != '/' && pPath[i] != '\0')
+        continue;
+
+      const char c = pPath[i];
+      pPath[i] = '\0';
+#if defined OS_WIN
+      CreateDirectoryA(pPath, NULL);
+#else
+      mkdir(pPath, 0755);
+#endif
+      pPath[i] = c;
+    }
+  }
+
+  WDL_String mDirectory;
+  EEmbed mEmbed;
+  int mEmbedSize;
+};
+
+END_IPLUG_NAMESPACE
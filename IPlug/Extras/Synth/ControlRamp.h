@@ -47,6 +47,19 @@ struct ControlRamp
     return (startValue != 0.) || (endValue != 0.);
   }
 
+  /** @param idx A sample index within the block, which can be past the end of the block
+   * @return The value Write() would write at that index */
+  double GetValueAt(int idx) const
+  {
+    if (idx < transitionStart)
+      return startValue;
+
+    if (idx >= transitionEnd)
+      return endValue;
+
+    return startValue + (endValue - startValue) * (idx - transitionStart + 1) / (transitionEnd - transitionStart);
+  }
+
   /** Writes the ramp signal to an output buffer.
    * @param buffer Pointer to the start of an output buffer.
    * @param startIdx Sample index of the start of the desired write within the buffer.
@@ -102,7 +115,7 @@ public:
       if(mSamplesRemaining == mGlideSamples)
       {
         // start glide
-        if(mSamplesRemaining > blockSize)
+        if(mStartOffset + mSamplesRemaining > blockSize)
         {
           // start with ramp to block end
           int glideStartSamples = blockSize - mStartOffset;
@@ -150,6 +163,9 @@ public:
     mStartOffset = startOffset;
   }
     
+  // the value the glide in progress is heading for, or has reached
+  double GetTargetValue() const { return mTargetValue; }
+
   // create an array of processors for an array of ramps
   template<size_t N>
   static ProcessorArray<N>* Create(RampArray<N>& inputs)
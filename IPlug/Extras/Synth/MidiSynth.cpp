@@ -8,7 +8,10 @@
  ==============================================================================
  */
 
+#include <cmath>
+
 #include "MidiSynth.h"
+#include "scalafile.h"
 
 using namespace iplug;
 
@@ -306,6 +309,42 @@ void MidiSynth::SetMPEZones(int channel, int nChans)
   std::cout << "MPE channels: \n    lo: " << mMPELowerZoneChannels << " hi " << mMPEUpperZoneChannels << "\n";
 }
 
+bool MidiSynth::LoadScalaScale(const char* path, int referenceKey, double referenceFreqHz)
+{
+  ScalaScaleFile scl;
+
+  if (!scl.Open(path) || !scl.SkipDescr() || referenceFreqHz <= 0.)
+    return false;
+
+  const int nNotes = scl.ReadNum();
+
+  if (nNotes < 1 || nNotes > 1024)
+    return false;
+
+  // degree 0 is the implicit 1/1 and the last degree is the period, usually 2/1
+  std::vector<float> degrees(nNotes + 1, 0.f);
+
+  for (int i = 1; i <= nNotes; i++)
+  {
+    const double ratio = scl.ReadPitch();
+
+    if (ratio <= 0.)
+      return false;
+
+    degrees[i] = static_cast<float>(std::log2(ratio));
+  }
+
+  const float referencePitch = static_cast<float>(std::log2(referenceFreqHz / 440.));
+
+  SetKeyToPitchFn([degrees, nNotes, referenceKey, referencePitch](int key) {
+    const int steps = key - referenceKey;
+    const int periods = static_cast<int>(std::floor(static_cast<double>(steps) / nNotes));
+    return referencePitch + periods * degrees[nNotes] + degrees[steps - periods * nNotes];
+  });
+
+  return true;
+}
+
 void MidiSynth::SetChannelPitchBendRange(int channelParam, int rangeParam)
 {
   int channelLo, channelHi;
@@ -433,6 +472,12 @@ bool MidiSynth::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int
       mVoiceAllocator.ProcessEvents(blockSize, mSampleTime);
       mVoiceAllocator.ProcessVoices(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
 
+      for (auto pGroup : mVoiceGroups)
+      {
+        if (pGroup->GetAnyBusy())
+          pGroup->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+      }
+
       samplesRemaining -= blockSize;
       startIndex += blockSize;
       mSampleTime += blockSize;
@@ -474,11 +519,20 @@ void MidiSynth::SetSampleRateAndBlockSize(double sampleRate, int blockSize)
   Reset();
 
   mSampleRate = sampleRate;
+  mHostBlockSize = blockSize;
   mMidiQueue.Resize(blockSize);
+
+  if (mRenderPool)
+    mRenderPool->Resize(mRenderPool->MaxOutputChans(), blockSize);
   mVoiceAllocator.SetSampleRateAndBlockSize(sampleRate, blockSize);
 
   for(int v = 0; v < NVoices(); v++)
   {
     GetVoice(v)->SetSampleRateAndBlockSize(sampleRate, blockSize);
   }
+
+  for (auto pGroup : mVoiceGroups)
+  {
+    pGroup->SetSampleRateAndBlockSize(sampleRate, blockSize);
+  }
 }
@@ -27,19 +27,21 @@
 
 #include "SynthVoice.h"
 #include "VoiceAllocator.h"
+#include "SynthVoiceGroup.h"
 
 #define DEBUG_VOICE_COUNT 0
 
 BEGIN_IPLUG_NAMESPACE
 
 /** A monophonic/polyphonic synthesiser base class which can be supplied with a custom voice.
- *  Supports different kinds of after touch, pitch bend, velocity and after touch curves, unison (currently monophonic mode only) */
+ *  Supports different kinds of after touch, pitch bend, velocity and after touch curves, unison */
 class MidiSynth
 {
 public:
   /** This defines the size in samples of a single block of processing that will be done by the synth. */
   static constexpr int kDefaultBlockSize = 32;
   static constexpr int kDefaultPitchBendRange = 12;
+  static constexpr int kDefaultMinVoicesForThreading = 8;
 
 #pragma mark - MidiSynth class
 
@@ -95,14 +97,39 @@ public:
   }
 
   /** Set this function to something other than the default
-   * if you need to implement a tuning table for microtonal support
-   * @param fn A function taking an integer key value and returning a double-precision
-   *  pitch value, where 0.5 = 220Hz, 1.0 = 440 Hz, 2.0 = 880 Hz ("1v / octave"). */
+   * if you need to implement a tuning table for microtonal support.
+   * It is called for all 128 keys here and whenever the note offset changes, to fill the table that note on looks up, so it can be as slow as it needs to be
+   * @param fn A function taking an integer key value and returning a
+   *  pitch value in octaves relative to 440Hz, where -1 = 220Hz, 0 = 440 Hz, 1 = 880 Hz ("1v / octave"). */
   void SetKeyToPitchFn(const std::function<float(int)>& fn)
   {
     mVoiceAllocator.SetKeyToPitchFunction(fn);
   }
 
+  /** Give one MIDI channel its own tuning, e.g. for multi-channel tunings from an MTS-ESP client, which can be polled on the main thread and passed in here when it changes
+   * @param channel The MIDI channel, 0 to 15
+   * @param pitches The pitches of keys 0 to 127, in octaves relative to 440Hz, or nullptr to go back to the key to pitch function */
+  void SetChannelTuning(int channel, const float* pitches)
+  {
+    mVoiceAllocator.SetChannelPitchTable(channel, pitches);
+  }
+
+  /** Tune every channel to a Scala scale (.scl) file, mapped linearly from a reference key as Scala does when there is no keyboard mapping (.kbm) file
+   * @param path The path of the .scl file
+   * @param referenceKey The key that plays the scale's first degree (1/1)
+   * @param referenceFreqHz The frequency of the reference key, by default middle C in 12-TET
+   * @return \c true if the file was read, otherwise the tuning is unchanged */
+  bool LoadScalaScale(const char* path, int referenceKey = 60, double referenceFreqHz = 261.6255653005986);
+
+  /** Stack several voices per note, see VoiceAllocator::SetUnison(). Add nVoices times as many voices as the polyphony you want
+   * @param nVoices The number of voices per note, 1 for no unison
+   * @param detuneCents The pitch difference between the outermost voices of a note, in cents
+   * @param spread The stereo width of a note's voices, from 0 to 1 */
+  void SetUnison(int nVoices, float detuneCents = 10.f, float spread = 1.f)
+  {
+    mVoiceAllocator.SetUnison(nVoices, detuneCents, spread);
+  }
+
   void SetNoteOffset(double offset)
   {
     mVoiceAllocator.SetPitchOffset(static_cast<float>(offset));
@@ -134,18 +161,72 @@ public:
     return mVoiceAllocator.GetNVoices();
   }
 
+  /** Limit the number of voices new notes are allocated to, e.g. from IPlugProcessor::OnQualityChange(). Voices beyond the limit that are already sounding are left to finish.
+   * Call this on the audio thread
+   * @param maxVoices The number of voices to use, or 0 for all of them */
+  void SetMaxVoices(int maxVoices)
+  {
+    mVoiceAllocator.SetMaxVoices(maxVoices);
+  }
+
   /** adds a SynthVoice to this MidiSynth, taking ownership of the object. */
   void AddVoice(SynthVoice* pVoice, uint8_t zone)
   {
     mVoiceAllocator.AddVoice(pVoice, zone);
   }
 
+  /** adds a group of voices that are rendered together to this MidiSynth. Each lane of the group is allocated like a SynthVoice. We do not take ownership of the group. */
+  void AddVoiceGroup(SynthVoiceGroupBase* pGroup, uint8_t zone)
+  {
+    for (auto l = 0; l < pGroup->NLanes(); l++)
+      mVoiceAllocator.AddVoice(pGroup->GetLane(l), zone);
+
+    mVoiceGroups.push_back(pGroup);
+  }
+
   void AddMidiMsgToQueue(const IMidiMsg& msg)
   {
     mMidiQueue.Add(msg);
   }
 
-  /** Processes a block of audio samples
+  /** Spread voice rendering across a pool of worker threads. Call this when audio is not running, e.g. in the plug-in constructor.
+   * Voices must be safe to render concurrently with each other, see VoiceRenderPool
+   * @param nThreads The total number of threads to render on including the audio thread. Pass 1 or less to go back to rendering on the audio thread only
+   * @param maxOutputChans The maximum number of output channels ProcessBlock() will be called with
+   * @param minVoices Below this number of busy voices, rendering stays on the audio thread */
+  void SetMultiThreadedRendering(int nThreads, int maxOutputChans, int minVoices = kDefaultMinVoicesForThreading)
+  {
+    mVoiceAllocator.SetRenderPool(nullptr, 0);
+    mRenderPool.reset();
+
+    if (nThreads > 1)
+    {
+      mRenderPool.reset(new VoiceRenderPool(nThreads, maxOutputChans, mHostBlockSize));
+      mRenderPool->SetAudioWorkgroup(mpAudioWorkgroup);
+      mVoiceAllocator.SetRenderPool(mRenderPool.get(), minVoices);
+    }
+  }
+
+  /** Have the render pool's workers join the host's audio workgroup, see VoiceRenderPool::SetAudioWorkgroup(). Call it when IPlugProcessor::GetAudioWorkgroup() changes
+   * @param pWorkgroup An os_workgroup_t, or nullptr */
+  void SetAudioWorkgroup(void* pWorkgroup)
+  {
+    mpAudioWorkgroup = pWorkgroup;
+
+    if (mRenderPool)
+      mRenderPool->SetAudioWorkgroup(pWorkgroup);
+  }
+
+  /** Set whether an output channel is connected, so that voices routed only to disconnected channels (see SynthVoice::SetOutputChannels()) don't write to them.
+   * Call it for each output at the start of a block, e.g. with IPlugProcessor::IsChannelConnected()
+   * @param chIdx The output channel
+   * @param connected \c false if the host isn't using the channel */
+  void SetOutputChannelConnected(int chIdx, bool connected)
+  {
+    mVoiceAllocator.SetOutputChannelConnected(chIdx, connected);
+  }
+
+  /** Processes a block of audio samples. Each voice accumulates into the output channels it is routed to, see SynthVoice::SetOutputChannels(), so a multi-bus instrument can pass the host's outputs for all its buses
    * @param inputs Pointer to input Arrays
    * @param outputs Pointer to output Arrays
    * @param nInputs The number of input channels that contain valid data
@@ -193,13 +274,16 @@ private:
   void HandleRPN(IMidiMsg msg);
 
   // basic MIDI data
+  std::unique_ptr<VoiceRenderPool> mRenderPool; // declared before mVoiceAllocator, which refers to it
+  void* mpAudioWorkgroup = nullptr;
   VoiceAllocator mVoiceAllocator;
-  uint16_t mUnisonVoices{1};
+  std::vector<SynthVoiceGroupBase*> mVoiceGroups;
   IMidiQueue mMidiQueue;
   float mVelocityLUT[128];
   float mAfterTouchLUT[128];
   ChannelState mChannelStates[16]{};
   int mBlockSize;
+  int mHostBlockSize = DEFAULT_BLOCK_SIZE;
   int64_t mSampleTime{0};
   double mSampleRate = DEFAULT_SAMPLE_RATE;
   bool mVoicesAreActive = false;
@@ -0,0 +1,173 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ModMatrix
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include "IPlugPlatform.h"
+#include "ControlRamp.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Evaluates modulation sources at a control rate, routes them to destinations through a matrix of amounts, and writes each destination as a linearly interpolated buffer.
+ * Sources are evaluated once every GetControlInterval() samples, so envelopes and LFOs used as sources should be run at GetControlRate() rather than at the audio sample rate.
+ * Because the matrix is linear, it is applied to the control values rather than to the buffers: the result is the same as routing interpolated sources, at the cost of one multiply-add per route per control period.
+ * Interpolation delays the modulation by one control period.
+ * Use one ModMatrix per voice, with sources such as envelopes and the voice's VoiceInputs ramps, or one for the whole synth for global sources, whose buffers can be passed to MidiSynth::ProcessBlock() as the voices' inputs
+ * @tparam T The sample type
+ * @tparam NSources The number of sources
+ * @tparam NDestinations The number of destinations */
+template<typename T, int NSources, int NDestinations>
+class ModMatrix
+{
+public:
+  /** A source is called once per control period with the index, within the current block, of the last sample of the period (which can be past the end of the block), and returns its value there */
+  using SourceFunc = std::function<T(int)>;
+
+  static constexpr int kDefaultControlInterval = 16;
+
+  ModMatrix()
+  {
+    ClearRoutes();
+  }
+
+  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+
+  /** @param nSamples The number of samples between evaluations of the sources, e.g. 16 or 32 */
+  void SetControlInterval(int nSamples)
+  {
+    mInterval = std::max(nSamples, 1);
+    mCountdown = std::min(mCountdown, mInterval);
+  }
+
+  int GetControlInterval() const { return mInterval; }
+
+  /** @return The rate at which the sources are evaluated, in Hz */
+  double GetControlRate() const { return mSampleRate / mInterval; }
+
+  /** Set a source. This may allocate, so call it outside the audio callback */
+  void SetSource(int src, SourceFunc func) { mSources[src] = std::move(func); }
+
+  /** Use a ControlRamp, such as one of a SynthVoice's VoiceInputs, as a source. The ramp must outlive the matrix */
+  void SetSource(int src, const ControlRamp& ramp)
+  {
+    mSources[src] = [&ramp](int idx) { return static_cast<T>(ramp.GetValueAt(idx)); };
+  }
+
+  /** @param src The source
+   * @param dest The destination
+   * @param amount The amount of the source added to the destination, 0 to remove the route */
+  void SetRoute(int src, int dest, T amount) { mAmounts[src][dest] = amount; }
+
+  T GetRoute(int src, int dest) const { return mAmounts[src][dest]; }
+
+  /** Remove all routes and destination offsets */
+  void ClearRoutes()
+  {
+    for (auto src = 0; src < NSources; src++)
+      std::fill_n(mAmounts[src], NDestinations, T(0));
+
+    std::fill_n(mOffsets, NDestinations, T(0));
+  }
+
+  /** @param dest The destination
+   * @param offset A constant added to the destination, e.g. the value of the parameter it modulates */
+  void SetDestinationOffset(int dest, T offset) { mOffsets[dest] = offset; }
+
+  /** Jump to the sources' values the next time the matrix is processed, rather than ramping to them, e.g. when a voice is triggered */
+  void Reset()
+  {
+    mCountdown = 0;
+    mPrimed = false;
+  }
+
+  /** @param outputs NDestinations buffers that receive nFrames interpolated samples of each destination, or nullptr to only update GetValue()
+   * @param nFrames The number of samples to process */
+  void ProcessBlock(T** outputs, int nFrames)
+  {
+    for (auto s = 0; s < nFrames;)
+    {
+      if (mCountdown == 0)
+      {
+        Tick(s + mInterval - 1);
+        mCountdown = mInterval;
+      }
+
+      const int n = std::min(mCountdown, nFrames - s);
+
+      for (auto d = 0; d < NDestinations; d++)
+      {
+        const T value = mValue[d];
+        const T incr = mIncr[d];
+
+        // no loop carried dependency, so this vectorizes
+        if (outputs)
+        {
+          T* pOut = outputs[d] + s;
+
+          for (auto i = 0; i < n; i++)
+            pOut[i] = value + incr * static_cast<T>(i + 1);
+        }
+
+        mValue[d] = value + incr * static_cast<T>(n);
+      }
+
+      mCountdown -= n;
+      s += n;
+    }
+  }
+
+  /** @return A destination's value at the end of the last block processed */
+  T GetValue(int dest) const { return mValue[dest]; }
+
+private:
+  void Tick(int endIdx)
+  {
+    T sources[NSources];
+
+    for (auto src = 0; src < NSources; src++)
+      sources[src] = mSources[src] ? mSources[src](endIdx) : T(0);
+
+    for (auto d = 0; d < NDestinations; d++)
+    {
+      T target = mOffsets[d];
+
+      for (auto src = 0; src < NSources; src++)
+        target += mAmounts[src][d] * sources[src];
+
+      // start from the last target rather than the ramp's end, so that rounding doesn't accumulate
+      mValue[d] = mPrimed ? mTarget[d] : target;
+      mTarget[d] = target;
+      mIncr[d] = (target - mValue[d]) / static_cast<T>(mInterval);
+    }
+
+    mPrimed = true;
+  }
+
+  SourceFunc mSources[NSources];
+  T mAmounts[NSources][NDestinations];
+  T mOffsets[NDestinations];
+  T mValue[NDestinations] = {};
+  T mTarget[NDestinations] = {};
+  T mIncr[NDestinations] = {};
+  double mSampleRate = 44100.;
+  int mInterval = kDefaultControlInterval;
+  int mCountdown = 0;
+  bool mPrimed = false;
+};
+
+END_IPLUG_NAMESPACE
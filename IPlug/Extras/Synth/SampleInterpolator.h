@@ -0,0 +1,444 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Variable-ratio playback of samples in memory for sampler voices, reading straight from the sample with linear, Hermite or windowed sinc
+ * interpolation. Each voice only keeps a SamplePlayhead, the sinc tables are shared by every voice and plug-in instance
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugSIMD.h"
+#include "SharedTable.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A voice's position in a sample and its playback ratio, as 32.32 fixed point source frames, which is all the state a voice needs for SampleInterpolator.
+ * Fixed point keeps the position exact however long a note is held, and the fraction is the low 32 bits */
+struct SamplePlayhead
+{
+  static constexpr int kFracBits = 32;
+  static constexpr double kOne = 4294967296.;
+
+  int64_t mPos = 0; // the source frame
+  int64_t mInc = -1; // source frames per output frame, < 0 until the first block after Start()
+
+  /** @param startFrame The source frame to start from, which can be fractional, e.g. to start a sample at the position an earlier voice had reached */
+  void Start(double startFrame = 0.)
+  {
+    mPos = ToFixed(std::max(startFrame, 0.));
+    mInc = -1;
+  }
+
+  /** @return The source frame the next output frame will be read from */
+  double GetPosition() const { return mPos / kOne; }
+
+  static int64_t ToFixed(double frames) { return static_cast<int64_t>(std::llround(frames * kOne)); }
+};
+
+/** A sample to play: interleaved float frames in memory, such as a StreamedSample's preload or a file read with WAVReader, with an optional loop */
+struct SampleSourceView
+{
+  const float* pFrames = nullptr;
+  int nChans = 0;
+  int64_t nFrames = 0;
+  int64_t loopStart = 0;
+  int64_t loopEnd = 0; // exclusive, the sample loops if loopEnd > loopStart
+
+  bool Loops() const { return loopEnd > loopStart; }
+};
+
+/** Windowed sinc interpolation tables for SampleInterpolator. Each bank is a set of fractional delays of a Kaiser windowed sinc low pass, one bank per half
+ * octave of upwards transposition, with its cut off lowered to the source rate divided by the ratio, so that playing a sample faster doesn't alias.
+ * A bank is kNTaps * (kNPhases + 1) floats (16.5 KB), and a voice uses one at a time */
+struct SampleInterpolatorSincTable
+{
+  static constexpr int kNTaps = 32;
+  static constexpr int kNPhases = 128; // the coefficients are linearly interpolated between phases
+  static constexpr int kNBanks = 5; // for ratios up to 1, 1.41, 2, 2.83 and 4, higher ratios use the last bank and alias
+  static constexpr double kPassband = 0.9; // the cut off, as a fraction of the Nyquist frequency of the source, or of the output when transposing up
+
+  std::vector<float> mCoefs; // [bank][phase][tap], phase kNPhases is phase 0 of the next frame, so that every phase has a neighbour
+
+  explicit SampleInterpolatorSincTable(double beta)
+  : mCoefs(static_cast<size_t>(kNBanks) * (kNPhases + 1) * kNTaps)
+  {
+    const double i0Beta = BesselI0(beta);
+
+    for (int bank = 0; bank < kNBanks; bank++)
+    {
+      const double cutoff = 0.5 * kPassband / std::pow(2., bank * 0.5); // cycles per source frame
+
+      for (int phase = 0; phase <= kNPhases; phase++)
+      {
+        float* pCoefs = GetCoefs(bank, phase);
+        double taps[kNTaps];
+        double sum = 0.;
+
+        for (int k = 0; k < kNTaps; k++)
+        {
+          // tap k is source frame (k - kNTaps / 2 + 1) relative to the integer position, the read position is phase / kNPhases past it
+          const double x = (k - kNTaps / 2 + 1) - static_cast<double>(phase) / kNPhases;
+          const double r = x / (kNTaps / 2);
+          const double window = BesselI0(beta * std::sqrt(std::max(0., 1. - r * r))) / i0Beta;
+          const double arg = 2. * cutoff * x;
+          taps[k] = (arg == 0. ? 1. : std::sin(PI * arg) / (PI * arg)) * window;
+          sum += taps[k];
+        }
+
+        for (int k = 0; k < kNTaps; k++)
+          pCoefs[k] = static_cast<float>(taps[k] / sum); // unity gain at DC for every phase
+      }
+    }
+  }
+
+  /** @return The bank to use for a playback ratio */
+  static int GetBank(double ratio)
+  {
+    return ratio <= 1. ? 0 : std::min(static_cast<int>(std::ceil(2. * std::log2(ratio) - 1e-9)), kNBanks - 1);
+  }
+
+  const float* GetCoefs(int bank, int phase) const { return mCoefs.data() + (static_cast<size_t>(bank) * (kNPhases + 1) + phase) * kNTaps; }
+
+private:
+  float* GetCoefs(int bank, int phase) { return mCoefs.data() + (static_cast<size_t>(bank) * (kNPhases + 1) + phase) * kNTaps; }
+
+  static double BesselI0(double x)
+  {
+    double sum = 1.;
+    double term = 1.;
+
+    for (int k = 1; k < 50; k++)
+    {
+      term *= (x / (2. * k)) * (x / (2. * k));
+      sum += term;
+
+      if (term < sum * 1e-17)
+        break;
+    }
+
+    return sum;
+  }
+};
+
+/** Renders voices from samples in memory at continuously variable playback ratios, reading directly from the sample's frames.
+ * One SampleInterpolator is shared by all the voices of a synth, and holds the interpolation mode, the shared sinc table and a little scratch space.
+ * Each voice only keeps a SamplePlayhead (16 bytes), so hundreds of voices cost nothing beyond the samples they read.
+ * Frames are read straight from the sample while every tap of the block is inside it, only blocks that reach the start, the end or a loop point
+ * gather their taps frame by frame. Render() is for the audio thread, the constructor and SetInterpolation() may build the sinc table
+ * @tparam T The output sample type */
+template <typename T = sample>
+class SampleInterpolator
+{
+public:
+  enum EInterpolation
+  {
+    kLinear = 0, // two taps
+    kHermite, // third order, four taps
+    kSinc, // SampleInterpolatorSincTable::kNTaps taps, band limited to the output rate when transposing up
+    kNumInterpolations
+  };
+
+  static constexpr int kMaxChans = 8; // further source channels are ignored
+  static constexpr double kSincBeta = 8.6; // about 90 dB of stop band rejection
+
+  SampleInterpolator(EInterpolation interpolation = kHermite)
+  {
+    SetInterpolation(interpolation);
+  }
+
+  /** Set the interpolation for every voice. Choosing kSinc gets the shared sinc table, which takes a lock and may build it, so do it on the main thread */
+  void SetInterpolation(EInterpolation interpolation)
+  {
+    if (interpolation == kSinc && !mSinc)
+    {
+      mSinc = SharedTable<SampleInterpolatorSincTable, int>::Get(SampleInterpolatorSincTable::kNTaps, []() {
+        return SampleInterpolatorSincTable(kSincBeta);
+      });
+    }
+
+    mInterpolation = interpolation;
+  }
+
+  EInterpolation GetInterpolation() const { return mInterpolation; }
+
+  /** Render the next frames of a voice, adding them to its outputs. The playback ratio glides from the one the previous block ended with to ratio over the block.
+   * A looping sample wraps at its loop end, otherwise the voice ends at the end of the sample. Taps before the start or after the end are silent.
+   * Like SampleStream::ReadAccumulating(), the last channel of the sample is added to any further outputs, so a mono sample is added to all of them
+   * @param head The voice's playhead, see SamplePlayhead::Start()
+   * @param source The sample, which must stay valid for the duration of the call
+   * @param ratio Source frames per output frame, e.g. 2^(semitones / 12) * sourceRate / outputRate, greater than 0
+   * @param outputs The voice's outputs
+   * @param nOutputs The number of outputs
+   * @param startIdx The first frame of the outputs to add to
+   * @param nFrames The number of frames
+   * @param gain The gain the frames are added with
+   * @return The number of frames rendered, less than nFrames if the sample has ended */
+  int Render(SamplePlayhead& head, const SampleSourceView& source, double ratio, T** outputs, int nOutputs, int startIdx, int nFrames, double gain = 1.)
+  {
+    if (!source.pFrames || source.nChans < 1 || nFrames < 1 || ratio <= 0.)
+      return 0;
+
+    const int64_t target = SamplePlayhead::ToFixed(std::min(ratio, 1e6));
+
+    if (head.mInc < 0)
+      head.mInc = target;
+
+    switch (mInterpolation)
+    {
+      case kLinear: return RenderWith<Linear>(head, source, target, outputs, nOutputs, startIdx, nFrames, gain);
+      case kSinc: return RenderWith<Sinc>(head, source, target, outputs, nOutputs, startIdx, nFrames, gain);
+      default: return RenderWith<Hermite>(head, source, target, outputs, nOutputs, startIdx, nFrames, gain);
+    }
+  }
+
+private:
+#pragma mark - Kernels
+
+  // A kernel reads the taps from kBefore frames before the integer position to kAfter frames after it, pFrame points at the first tap.
+  // Interpolate() writes one value per source channel to pOut
+
+  struct Linear
+  {
+    static constexpr int kBefore = 0;
+    static constexpr int kAfter = 1;
+
+    static void Interpolate(const SampleInterpolator&, const float* pFrame, int stride, int nChans, uint32_t frac, float* pOut)
+    {
+      const float f = static_cast<float>(frac * (1. / SamplePlayhead::kOne));
+
+      for (int c = 0; c < nChans; c++)
+        pOut[c] = pFrame[c] + f * (pFrame[stride + c] - pFrame[c]);
+    }
+  };
+
+  struct Hermite
+  {
+    static constexpr int kBefore = 1;
+    static constexpr int kAfter = 2;
+
+    static void Interpolate(const SampleInterpolator&, const float* pFrame, int stride, int nChans, uint32_t frac, float* pOut)
+    {
+      const float f = static_cast<float>(frac * (1. / SamplePlayhead::kOne));
+
+      for (int c = 0; c < nChans; c++)
+      {
+        const float xm1 = pFrame[c];
+        const float x0 = pFrame[stride + c];
+        const float x1 = pFrame[2 * stride + c];
+        const float x2 = pFrame[3 * stride + c];
+        const float c1 = 0.5f * (x1 - xm1);
+        const float c2 = xm1 - 2.5f * x0 + 2.f * x1 - 0.5f * x2;
+        const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        pOut[c] = ((c3 * f + c2) * f + c1) * f + x0;
+      }
+    }
+  };
+
+  struct Sinc
+  {
+    static constexpr int kNTaps = SampleInterpolatorSincTable::kNTaps;
+    static constexpr int kBefore = kNTaps / 2 - 1;
+    static constexpr int kAfter = kNTaps / 2;
+
+    static void Interpolate(const SampleInterpolator& interp, const float* pFrame, int stride, int nChans, uint32_t frac, float* pOut)
+    {
+      static constexpr int kPhaseShift = SamplePlayhead::kFracBits - 7; // kNPhases is 2^7
+      static_assert(SampleInterpolatorSincTable::kNPhases == 1 << 7, "kPhaseShift assumes 128 phases");
+
+      const int phase = static_cast<int>(frac >> kPhaseShift);
+      const V t = Splat(static_cast<float>((frac & ((1u << kPhaseShift) - 1)) * (1. / (1u << kPhaseShift))));
+      const float* pC0 = interp.mSinc->GetCoefs(interp.mBank, phase);
+      const float* pC1 = pC0 + kNTaps;
+      alignas(16) float coefs[kNTaps];
+
+      for (int k = 0; k < kNTaps; k += 4)
+      {
+        const V c0 = Load(pC0 + k);
+        Store(coefs + k, Add(c0, Mul(t, Sub(Load(pC1 + k), c0))));
+      }
+
+      if (stride == 1)
+      {
+        V acc0 = Mul(Load(coefs), Load(pFrame));
+        V acc1 = Mul(Load(coefs + 4), Load(pFrame + 4));
+
+        for (int k = 8; k < kNTaps; k += 8)
+        {
+          acc0 = Add(acc0, Mul(Load(coefs + k), Load(pFrame + k)));
+          acc1 = Add(acc1, Mul(Load(coefs + k + 4), Load(pFrame + k + 4)));
+        }
+
+        alignas(16) float sum[4];
+        Store(sum, Add(acc0, acc1));
+        pOut[0] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+        return;
+      }
+
+      if (nChans == 2)
+      {
+        float l0 = 0.f, r0 = 0.f, l1 = 0.f, r1 = 0.f;
+
+        for (int k = 0; k < kNTaps; k += 2, pFrame += 2 * stride)
+        {
+          l0 += coefs[k] * pFrame[0];
+          r0 += coefs[k] * pFrame[1];
+          l1 += coefs[k + 1] * pFrame[stride];
+          r1 += coefs[k + 1] * pFrame[stride + 1];
+        }
+
+        pOut[0] = l0 + l1;
+        pOut[1] = r0 + r1;
+        return;
+      }
+
+      float acc[kMaxChans] = {};
+
+      for (int k = 0; k < kNTaps; k++, pFrame += stride)
+      {
+        for (int c = 0; c < nChans; c++)
+          acc[c] += coefs[k] * pFrame[c];
+      }
+
+      memcpy(pOut, acc, nChans * sizeof(float));
+    }
+  };
+
+  template <typename Kernel>
+  int RenderWith(SamplePlayhead& head, const SampleSourceView& source, int64_t target, T** outputs, int nOutputs, int startIdx, int nFrames, double gain)
+  {
+    constexpr int kNTaps = Kernel::kBefore + Kernel::kAfter + 1;
+    const int stride = source.nChans;
+    const int nChans = std::min(source.nChans, kMaxChans);
+    const bool loops = source.Loops();
+    const int64_t end = loops ? source.loopEnd : source.nFrames;
+
+    int64_t pos = head.mPos;
+    int64_t inc = head.mInc;
+    const int64_t dInc = (target - inc) / nFrames;
+
+    if (std::is_same<Kernel, Sinc>::value)
+      mBank = SampleInterpolatorSincTable::GetBank(std::max(inc, target) / SamplePlayhead::kOne);
+
+    // where the last frame of the block is read from, if it doesn't reach the end of the sample or a loop point
+    const int64_t lastPos = pos + inc * (nFrames - 1) + dInc * ((static_cast<int64_t>(nFrames) - 1) * (nFrames - 2) / 2);
+    const bool direct = (pos >> SamplePlayhead::kFracBits) - Kernel::kBefore >= 0
+                     && (lastPos >> SamplePlayhead::kFracBits) + Kernel::kAfter < std::min(end, source.nFrames);
+
+    float frame[kMaxChans];
+    int s = 0;
+
+    for (; s < nFrames; s++)
+    {
+      const int64_t i0 = pos >> SamplePlayhead::kFracBits;
+
+      if (!loops && i0 >= end)
+        break;
+
+      const uint32_t frac = static_cast<uint32_t>(pos);
+
+      if (direct)
+        Kernel::Interpolate(*this, source.pFrames + (i0 - Kernel::kBefore) * stride, stride, nChans, frac, frame);
+      else
+      {
+        GatherTaps(source, i0 - Kernel::kBefore, kNTaps, nChans);
+        Kernel::Interpolate(*this, mTaps, nChans, nChans, frac, frame);
+      }
+
+      for (int c = 0; c < nOutputs; c++)
+        outputs[c][startIdx + s] += static_cast<T>(frame[std::min(c, nChans - 1)] * gain);
+
+      pos += inc;
+      inc += dInc;
+
+      if (loops && pos >= (source.loopEnd << SamplePlayhead::kFracBits))
+        pos -= (source.loopEnd - source.loopStart) << SamplePlayhead::kFracBits;
+    }
+
+    head.mPos = pos;
+    head.mInc = target;
+    return s;
+  }
+
+  /** Copy nTaps frames from first into mTaps, wrapping frames past a loop end back into the loop, and with silence outside the sample */
+  void GatherTaps(const SampleSourceView& source, int64_t first, int nTaps, int nChans)
+  {
+    const int64_t loopLength = source.loopEnd - source.loopStart;
+
+    for (int k = 0; k < nTaps; k++)
+    {
+      int64_t i = first + k;
+
+      if (loopLength > 0 && i >= source.loopEnd)
+        i = source.loopStart + (i - source.loopEnd) % loopLength;
+
+      float* pDest = mTaps + k * nChans;
+
+      if (i >= 0 && i < source.nFrames)
+        memcpy(pDest, source.pFrames + i * source.nChans, nChans * sizeof(float));
+      else
+        memset(pDest, 0, nChans * sizeof(float));
+    }
+  }
+
+#pragma mark - Vectors of four floats
+
+#if defined IPLUG_SIMD_SSE2
+  using V = __m128;
+  static inline V Load(const float* p) { return _mm_loadu_ps(p); }
+  static inline void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+  static inline V Splat(float f) { return _mm_set1_ps(f); }
+  static inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+  static inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+#elif defined IPLUG_SIMD_NEON
+  using V = float32x4_t;
+  static inline V Load(const float* p) { return vld1q_f32(p); }
+  static inline void Store(float* p, V v) { vst1q_f32(p, v); }
+  static inline V Splat(float f) { return vdupq_n_f32(f); }
+  static inline V Add(V a, V b) { return vaddq_f32(a, b); }
+  static inline V Sub(V a, V b) { return vsubq_f32(a, b); }
+  static inline V Mul(V a, V b) { return vmulq_f32(a, b); }
+#elif defined IPLUG_SIMD_WASM
+  using V = v128_t;
+  static inline V Load(const float* p) { return wasm_v128_load(p); }
+  static inline void Store(float* p, V v) { wasm_v128_store(p, v); }
+  static inline V Splat(float f) { return wasm_f32x4_splat(f); }
+  static inline V Add(V a, V b) { return wasm_f32x4_add(a, b); }
+  static inline V Sub(V a, V b) { return wasm_f32x4_sub(a, b); }
+  static inline V Mul(V a, V b) { return wasm_f32x4_mul(a, b); }
+#else
+  struct V { float v[4]; };
+  static inline V Load(const float* p) { V r; memcpy(r.v, p, sizeof(r.v)); return r; }
+  static inline void Store(float* p, V v) { memcpy(p, v.v, sizeof(v.v)); }
+  static inline V Splat(float f) { return {{f, f, f, f}}; }
+  static inline V Add(V a, V b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+  static inline V Sub(V a, V b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+  static inline V Mul(V a, V b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+#endif
+
+  EInterpolation mInterpolation = kHermite;
+  std::shared_ptr<const SampleInterpolatorSincTable> mSinc;
+  int mBank = 0; // the sinc bank for the block being rendered
+  float mTaps[SampleInterpolatorSincTable::kNTaps * kMaxChans]; // the taps of a frame near the start, the end or a loop point
+};
+
+END_IPLUG_NAMESPACE
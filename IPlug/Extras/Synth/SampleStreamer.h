@@ -0,0 +1,574 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Disk streaming of WAV samples for sampler voices: the attack of each sample is preloaded, and the rest is read ahead of the voices on an I/O thread
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "fileread.h"
+#include "WAVReader.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** How StreamedSample reads its file */
+enum class EStreamReadMode
+{
+  kMapped,    // memory map the file, so reads are page faults on the I/O thread that the OS can read ahead
+  kUnbuffered // read it into our own buffers, bypassing the OS file cache (FILE_FLAG_NO_BUFFERING on Windows, F_NOCACHE on macOS), so a large library doesn't evict everything else
+};
+
+/** A WAV file (16, 24 or 32 bit integer, or 32 or 64 bit float PCM) whose first frames are kept in memory as float, and whose remainder is streamed from disk.
+ * Samples are created by SampleStreamer::LoadSample(), which owns them.
+ * Frames are interleaved, in memory and in a SampleStream. The file is only open while it is being streamed, see SampleStreamer */
+class StreamedSample final
+{
+public:
+  StreamedSample(const char* path, int preloadFrames, EStreamReadMode mode)
+  : mPath(path)
+  , mMode(mode)
+  {
+    if (!Open() || !mReader.ReadHeader(*mFile))
+    {
+      Close();
+      return;
+    }
+
+    const int nPreloadFrames = static_cast<int>(std::min<int64_t>(std::max(preloadFrames, 0), NFrames()));
+    mPreload.resize(static_cast<size_t>(nPreloadFrames) * NChans());
+    mNPreloadFrames = ReadFrames(0, nPreloadFrames, mPreload.data());
+    mIsValid = mNPreloadFrames == nPreloadFrames; // or the file is truncated
+    Close(); // until a voice streams it
+  }
+
+  StreamedSample(const StreamedSample&) = delete;
+  StreamedSample& operator=(const StreamedSample&) = delete;
+
+  /** @return \c true if the file was read */
+  bool IsValid() const { return mIsValid; }
+
+  /** @return The path of the file */
+  const char* GetPath() const { return mPath.c_str(); }
+
+  int NChans() const { return mReader.NChans(); }
+
+  int64_t NFrames() const { return mReader.NFrames(); }
+
+  double GetSampleRate() const { return mReader.GetSampleRate(); }
+
+  /** @return The number of frames at the start that are in memory. If this is NFrames() the sample is never streamed */
+  int NPreloadFrames() const { return mNPreloadFrames; }
+
+  /** @return The preloaded frames, interleaved */
+  const float* GetPreload() const { return mPreload.data(); }
+
+private:
+  friend class SampleStreamer;
+
+  bool Open()
+  {
+    // WDL_FileRead can only map files below 4GB, which is as large as a RIFF file can be
+    if (mMode == EStreamReadMode::kMapped && sizeof(void*) == 8)
+      mFile = std::make_unique<WDL_FileRead>(mPath.c_str(), 0, 0, 0, 0, 0xFFFFFFFF);
+    else
+      mFile = std::make_unique<WDL_FileRead>(mPath.c_str(), -1, kUnbufferedBufSize, 2);
+
+    if (!mFile->IsOpen())
+    {
+      mFile = nullptr;
+      return false;
+    }
+
+    return true;
+  }
+
+  void Close() { mFile = nullptr; }
+
+  /** Read frames from the file, which must be open. Only the thread that opened it can call this */
+  int ReadFrames(int64_t startFrame, int nFrames, float* pDest) { return mReader.ReadFrames(*mFile, startFrame, nFrames, pDest); }
+
+  static constexpr int kUnbufferedBufSize = 65536;
+
+  std::string mPath;
+  EStreamReadMode mMode;
+  bool mIsValid = false;
+  int mNPreloadFrames = 0;
+  std::vector<float> mPreload;
+
+  // used by the I/O thread
+  std::unique_ptr<WDL_FileRead> mFile;
+  WAVReader mReader;
+  uint64_t mLastUsed = 0;
+};
+
+/** One voice's playback of a StreamedSample. Playback starts from the preloaded frames, while the SampleStreamer's I/O thread reads the following frames into
+ * a ring of chunks ahead of the voice. The ring is lock-free: each chunk is tagged with the playback and the position it holds, so the voice can restart
+ * on another sample at any time without waiting for the I/O thread. Start(), Stop() and Read() are for the audio thread */
+class SampleStream final
+{
+public:
+  /** Start playing a sample, stopping whatever was playing
+   * @param pSample A sample from the SampleStreamer that owns this stream, with no more channels than it was made for
+   * @param startFrame The frame to start from. Starting after the preloaded frames plays silence until the I/O thread has read them, which is counted as an underrun
+   * @return \c true if the sample can be played */
+  bool Start(StreamedSample* pSample, int64_t startFrame = 0)
+  {
+    if (!pSample || !pSample->IsValid() || pSample->NChans() > mMaxChans)
+    {
+      Stop();
+      return false;
+    }
+
+    mSample = pSample;
+    mPos = std::max<int64_t>(startFrame, 0);
+    mStreamStart = std::max<int64_t>(mPos, pSample->NPreloadFrames());
+    mReadChunk = -1;
+    Request(pSample, mStreamStart);
+    return true;
+  }
+
+  /** Stop playing, the I/O thread stops reading for this stream */
+  void Stop()
+  {
+    if (mSample)
+    {
+      mSample = nullptr;
+      Request(nullptr, 0);
+    }
+  }
+
+  /** @return \c true while a sample is playing, until its last frame has been read */
+  bool IsPlaying() const { return mSample && mPos < mSample->NFrames(); }
+
+  /** @return The sample that is playing, or \c nullptr */
+  StreamedSample* GetSample() const { return mSample; }
+
+  /** @return The number of channels of the playing sample, which is the layout of the frames Read() outputs */
+  int NChans() const { return mSample ? mSample->NChans() : 0; }
+
+  /** @return The position of the next frame */
+  int64_t GetPosition() const { return mPos; }
+
+  /** Read the next frames, the chunks this gets to are released to the I/O thread. Frames past the end of the sample, or that the I/O thread hasn't read yet, are silent
+   * @param pDest Receives nFrames interleaved frames of NChans() channels
+   * @return The number of frames that were in time, less than nFrames if the sample has ended or on an underrun */
+  int Read(float* pDest, int nFrames)
+  {
+    const int nChans = NChans();
+    int nRead = 0;
+
+    while (nFrames > 0 && IsPlaying())
+    {
+      int n;
+
+      if (mPos < mStreamStart)
+      {
+        n = static_cast<int>(std::min<int64_t>(nFrames, mStreamStart - mPos));
+        std::copy_n(mSample->GetPreload() + mPos * nChans, n * nChans, pDest);
+        nRead += n;
+      }
+      else
+      {
+        const int64_t chunk = (mPos - mStreamStart) / mChunkFrames;
+        const int offset = static_cast<int>((mPos - mStreamStart) % mChunkFrames);
+        n = static_cast<int>(std::min<int64_t>({nFrames, mChunkFrames - offset, mSample->NFrames() - mPos}));
+
+        if (chunk != mReadChunk)
+        {
+          mReadChunk = chunk;
+          mReadPos.store(MakeTag(mGeneration, chunk)); // the chunks before this one can be refilled
+        }
+
+        Chunk& slot = mChunks[chunk % mChunks.size()];
+
+        if (slot.mTag.load(std::memory_order_acquire) == MakeTag(mGeneration, chunk))
+        {
+          std::copy_n(slot.mData.data() + offset * nChans, n * nChans, pDest);
+          nRead += n;
+        }
+        else
+        {
+          std::fill_n(pDest, n * nChans, 0.f); // keep time, so the voice's envelope isn't held up by the disk
+          mNUnderruns.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+
+      mPos += n;
+      pDest += n * nChans;
+      nFrames -= n;
+    }
+
+    std::fill_n(pDest, nFrames * nChans, 0.f);
+    return nRead;
+  }
+
+  /** Read the next frames and add them to a voice's outputs, see Read(). The last channel of the sample is added to any further outputs, so a mono sample is added to all of them */
+  void ReadAccumulating(sample** outputs, int nOutputs, int startIdx, int nFrames, double gain = 1.)
+  {
+    const int nChans = NChans();
+
+    if (!nChans)
+      return;
+
+    while (nFrames > 0)
+    {
+      const int n = std::min(nFrames, kScratchFrames);
+      Read(mScratch.data(), n);
+
+      for (int c = 0; c < nOutputs; c++)
+      {
+        const float* pSrc = mScratch.data() + std::min(c, nChans - 1);
+
+        for (int s = 0; s < n; s++, pSrc += nChans)
+          outputs[c][startIdx + s] += static_cast<sample>(*pSrc * gain);
+      }
+
+      startIdx += n;
+      nFrames -= n;
+    }
+  }
+
+  /** @return The number of underruns since the stream was created */
+  int GetNUnderruns() const { return mNUnderruns.load(std::memory_order_relaxed); }
+
+private:
+  friend class SampleStreamer;
+
+  static constexpr int kScratchFrames = 256;
+
+  struct Chunk
+  {
+    std::vector<float> mData;
+    std::atomic<uint64_t> mTag{0}; // the generation and chunk index it holds
+  };
+
+  SampleStream(int maxChans, int chunkFrames, int nChunks)
+  : mMaxChans(maxChans)
+  , mChunkFrames(chunkFrames)
+  , mChunks(nChunks)
+  , mScratch(kScratchFrames * maxChans)
+  {
+    for (auto& chunk : mChunks)
+      chunk.mData.resize(static_cast<size_t>(chunkFrames) * maxChans);
+  }
+
+  static uint64_t MakeTag(uint32_t generation, int64_t chunk) { return static_cast<uint64_t>(generation) << 32 | static_cast<uint32_t>(chunk); }
+
+  // a sequence lock, the generation is odd while the request is being written
+  void Request(StreamedSample* pSample, int64_t streamStart)
+  {
+    mRequestGeneration.store(mGeneration + 1);
+    mGeneration += 2;
+    mRequestSample.store(pSample);
+    mRequestStart.store(streamStart);
+    mReadPos.store(MakeTag(mGeneration, 0));
+    mRequestGeneration.store(mGeneration);
+  }
+
+  const int mMaxChans;
+  const int mChunkFrames;
+  std::vector<Chunk> mChunks;
+  std::vector<float> mScratch;
+  std::atomic<int> mNUnderruns{0};
+
+  // written by the audio thread
+  StreamedSample* mSample = nullptr;
+  int64_t mPos = 0;
+  int64_t mStreamStart = 0;
+  int64_t mReadChunk = -1;
+  uint32_t mGeneration = 0;
+  std::atomic<uint32_t> mRequestGeneration{0};
+  std::atomic<StreamedSample*> mRequestSample{nullptr};
+  std::atomic<int64_t> mRequestStart{0};
+  std::atomic<uint64_t> mReadPos{0}; // the generation and the chunk the voice is reading
+
+  // used by the I/O thread
+  uint32_t mFillGeneration = 0;
+  StreamedSample* mFillSample = nullptr;
+  int64_t mFillStart = 0;
+  int64_t mFillChunk = 0;
+};
+
+/** Owns the samples and the voices' streams, and runs the I/O thread that keeps the streams ahead of the voices.
+ * Each pass of the I/O thread reads one chunk for the stream with the fewest chunks buffered ahead of its voice, so the voice closest to an underrun is always served first,
+ * and a voice that has just started (and is playing its preloaded frames) gets its first chunks before the others are topped up.
+ * Samples only keep their files open while they are streamed, up to a limit, so a library of thousands of samples doesn't run out of file handles.
+ *
+ * The preloaded frames must cover the time it takes to read the first chunk, so for a library on a hard disk, increase them rather than the chunk size.
+ * Load samples and add streams on the main thread, e.g. one stream per voice in the plug-in constructor. The samples and streams are destroyed with the streamer */
+class SampleStreamer final
+{
+public:
+  static constexpr int kDefaultPreloadFrames = 16384;
+  static constexpr int kDefaultChunkFrames = 8192;
+  static constexpr int kDefaultNChunks = 6;
+  static constexpr int kDefaultMaxOpenFiles = 128;
+
+  /** @param maxChans The most channels of the samples, which sizes each stream's buffers
+   * @param preloadFrames The number of frames of each sample that are kept in memory
+   * @param chunkFrames The size of each read
+   * @param nChunks The number of chunks each stream reads ahead
+   * @param mode How the files are read */
+  SampleStreamer(int maxChans = 2, int preloadFrames = kDefaultPreloadFrames, int chunkFrames = kDefaultChunkFrames, int nChunks = kDefaultNChunks,
+                 EStreamReadMode mode = EStreamReadMode::kMapped, int maxOpenFiles = kDefaultMaxOpenFiles)
+  : mMaxChans(maxChans)
+  , mPreloadFrames(preloadFrames)
+  , mChunkFrames(chunkFrames)
+  , mNChunks(std::max(nChunks, 2))
+  , mMode(mode)
+  , mMaxOpenFiles(std::max(maxOpenFiles, 1))
+  {
+  }
+
+  ~SampleStreamer()
+  {
+    mRunning = false;
+
+    if (mThread.joinable())
+      mThread.join();
+  }
+
+  SampleStreamer(const SampleStreamer&) = delete;
+  SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+  /** Read a WAV file's header and preloaded frames. Call it from the main thread or a loading thread, not the audio thread
+   * @return The sample, owned by the streamer, or \c nullptr if the file can't be read */
+  StreamedSample* LoadSample(const char* path)
+  {
+    auto pSample = std::make_unique<StreamedSample>(path, mPreloadFrames, mMode);
+
+    if (!pSample->IsValid())
+      return nullptr;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSamples.push_back(std::move(pSample));
+    return mSamples.back().get();
+  }
+
+  /** Delete a sample. No stream may be playing it, so stop the voices that could be (e.g. while processing is suspended) first */
+  void UnloadSample(StreamedSample* pSample)
+  {
+    std::lock_guard<std::mutex> lock(mMutex); // waits for the I/O thread to finish a read from it
+
+    for (auto& pStream : mStreams)
+    {
+      if (pStream->mFillSample == pSample)
+        pStream->mFillSample = nullptr;
+    }
+
+    auto it = std::find_if(mSamples.begin(), mSamples.end(), [pSample](const std::unique_ptr<StreamedSample>& p) { return p.get() == pSample; });
+
+    if (it != mSamples.end())
+    {
+      if ((*it)->mFile)
+        mNOpenFiles--;
+
+      mSamples.erase(it);
+    }
+  }
+
+  /** Add a stream, typically one for each voice. This starts the I/O thread
+   * @return The stream, owned by the streamer */
+  SampleStream* AddStream()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStreams.push_back(std::unique_ptr<SampleStream>(new SampleStream(mMaxChans, mChunkFrames, mNChunks)));
+
+    if (!mThread.joinable())
+    {
+      mRunning = true;
+      mThread = std::thread([this]() { ThreadProc(); });
+    }
+
+    return mStreams.back().get();
+  }
+
+  /** @return The total number of underruns of the streams, which means the preload is too short for the disk, or the chunks too few */
+  int GetNUnderruns() const
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int n = 0;
+
+    for (auto& pStream : mStreams)
+      n += pStream->GetNUnderruns();
+
+    return n;
+  }
+
+private:
+  static constexpr int kIdleSleepMs = 2;
+  static constexpr int kChunksPerLock = 16; // how many chunks are read before the lock is released, so LoadSample() isn't held up by a busy disk
+
+  void ThreadProc()
+  {
+    while (mRunning)
+    {
+      bool busy = false;
+
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        for (int i = 0; i < kChunksPerLock; i++)
+        {
+          SampleStream* pStream = FindMostUrgent();
+
+          if (!pStream)
+            break;
+
+          FillChunk(*pStream);
+          busy = true;
+        }
+      }
+
+      if (!busy)
+        std::this_thread::sleep_for(std::chrono::milliseconds(kIdleSleepMs));
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto& pSample : mSamples)
+      pSample->Close();
+
+    mNOpenFiles = 0;
+  }
+
+  /** Pick up each stream's latest request, and find the one with the fewest chunks ahead of its voice */
+  SampleStream* FindMostUrgent()
+  {
+    SampleStream* pMostUrgent = nullptr;
+    int64_t leastAhead = mNChunks;
+
+    for (auto& pStream : mStreams)
+    {
+      SampleStream& stream = *pStream;
+      const uint32_t generation = stream.mRequestGeneration.load();
+
+      if (generation & 1)
+        continue; // being written, it'll be there next pass
+
+      if (generation != stream.mFillGeneration)
+      {
+        StreamedSample* pSample = stream.mRequestSample.load();
+        const int64_t start = stream.mRequestStart.load();
+
+        if (stream.mRequestGeneration.load() != generation)
+          continue;
+
+        stream.mFillGeneration = generation;
+        stream.mFillSample = pSample;
+        stream.mFillStart = start;
+        stream.mFillChunk = 0;
+      }
+
+      if (!stream.mFillSample || stream.mFillStart + stream.mFillChunk * mChunkFrames >= stream.mFillSample->NFrames())
+        continue;
+
+      const uint64_t readPos = stream.mReadPos.load();
+
+      if (static_cast<uint32_t>(readPos >> 32) != generation)
+        continue;
+
+      const int64_t ahead = stream.mFillChunk - static_cast<uint32_t>(readPos);
+
+      if (ahead < leastAhead)
+      {
+        leastAhead = ahead;
+        pMostUrgent = &stream;
+      }
+    }
+
+    return pMostUrgent;
+  }
+
+  void FillChunk(SampleStream& stream)
+  {
+    StreamedSample& sample = *stream.mFillSample;
+    const int64_t chunk = stream.mFillChunk++;
+
+    if (!OpenFile(sample))
+      return; // the voice will underrun
+
+    SampleStream::Chunk& slot = stream.mChunks[chunk % stream.mChunks.size()];
+    const int64_t startFrame = stream.mFillStart + chunk * mChunkFrames;
+    const int nFrames = static_cast<int>(std::min<int64_t>(mChunkFrames, sample.NFrames() - startFrame));
+
+    // the voice has moved past the chunk that was in this slot, and won't read it before the new tag is stored
+    slot.mTag.store(0, std::memory_order_relaxed);
+    const int nRead = sample.ReadFrames(startFrame, nFrames, slot.mData.data());
+    std::fill(slot.mData.begin() + static_cast<size_t>(nRead) * sample.NChans(), slot.mData.begin() + static_cast<size_t>(nFrames) * sample.NChans(), 0.f);
+    slot.mTag.store(SampleStream::MakeTag(stream.mFillGeneration, chunk), std::memory_order_release);
+  }
+
+  /** Make sure a sample's file is open, closing the least recently used one if too many are */
+  bool OpenFile(StreamedSample& sample)
+  {
+    sample.mLastUsed = ++mUseCounter;
+
+    if (sample.mFile)
+      return true;
+
+    if (mNOpenFiles >= mMaxOpenFiles)
+    {
+      StreamedSample* pOldest = nullptr;
+
+      for (auto& pSample : mSamples)
+      {
+        if (pSample->mFile && (!pOldest || pSample->mLastUsed < pOldest->mLastUsed))
+          pOldest = pSample.get();
+      }
+
+      if (pOldest)
+      {
+        pOldest->Close();
+        mNOpenFiles--;
+      }
+    }
+
+    if (!sample.Open())
+      return false;
+
+    mNOpenFiles++;
+    return true;
+  }
+
+  const int mMaxChans;
+  const int mPreloadFrames;
+  const int mChunkFrames;
+  const int mNChunks;
+  const EStreamReadMode mMode;
+  const int mMaxOpenFiles;
+
+  mutable std::mutex mMutex;
+  std::vector<std::unique_ptr<StreamedSample>> mSamples;
+  std::vector<std::unique_ptr<SampleStream>> mStreams;
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+
+  // used by the I/O thread
+  int mNOpenFiles = 0;
+  uint64_t mUseCounter = 0;
+};
+
+END_IPLUG_NAMESPACE
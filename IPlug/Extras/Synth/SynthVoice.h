@@ -15,6 +15,7 @@
  * @copydoc SynthVoice
  */
 
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <stdint.h>
@@ -101,6 +102,41 @@ public:
    */
   virtual void SetControl(int controlNumber, float value) {};
 
+  /** Route the voice to a range of the output channels, e.g. the bus of a drum pad, so it renders straight into them rather than into all the outputs.
+   * The outputs ProcessSamplesAccumulating() is called with start at startChan, and nOutputs is the size of the range, clipped to the channels the host provides.
+   * If every channel in the range is disconnected (see VoiceAllocator::SetOutputChannelConnected()), it is called with nOutputs 0, so the voice can still advance its envelopes and become free without writing anything.
+   * Call it when the voice isn't being processed, e.g. in Trigger()
+   * @param startChan The first output channel
+   * @param nChans The number of channels, or -1 for all the channels from startChan */
+  void SetOutputChannels(int startChan, int nChans = -1) { mOutputChanStart = std::max(startChan, 0); mNOutputChans = nChans; }
+
+  /** @return The first output channel the voice renders into, see SetOutputChannels() */
+  int GetOutputChanStart() const { return mOutputChanStart; }
+
+  /** @return The number of output channels the voice renders into, or -1 for all the channels from GetOutputChanStart() */
+  int GetNOutputChans() const { return mNOutputChans; }
+
+  /** Call ProcessSamplesAccumulating() with the outputs offset and sized to the voice's output channels, see SetOutputChannels(). Used by VoiceAllocator and VoiceRenderPool
+   * @param disconnectedOutputs Bit c is set if output channel c is disconnected */
+  void ProcessSamplesRouted(sample** inputs, sample** outputs, int nInputs, int nOutputs, uint64_t disconnectedOutputs, int startIdx, int nFrames)
+  {
+    const int start = std::min(mOutputChanStart, nOutputs);
+    int nChans = nOutputs - start;
+
+    if (mNOutputChans >= 0 && mNOutputChans < nChans)
+      nChans = mNOutputChans;
+
+    if (disconnectedOutputs && nChans > 0 && start + nChans <= 64)
+    {
+      const uint64_t range = (nChans == 64 ? ~0ull : ((1ull << nChans) - 1)) << start;
+
+      if ((disconnectedOutputs & range) == range)
+        nChans = 0;
+    }
+
+    ProcessSamplesAccumulating(inputs, outputs + start, nInputs, nChans, startIdx, nFrames);
+  }
+
 protected:
   VoiceInputs mInputs;
   int64_t mLastTriggeredTime{-1};
@@ -110,6 +146,10 @@ protected:
   uint8_t mKey{0};
   double mBasePitch{0.};
   double mGain{0.}; // used by voice allocator to hard-kill voices.
+  uint8_t mUnisonIndex{0}; // this voice's place in its unison group, see VoiceAllocator::SetUnison()
+  float mUnisonPan{0.f}; // the stereo position for this voice's place in the unison group, from -1 to 1. Its detune is already in the pitch input
+  int mOutputChanStart{0}; // see SetOutputChannels()
+  int mNOutputChans{-1};
 
   friend class MidiSynth;
   friend class VoiceAllocator;
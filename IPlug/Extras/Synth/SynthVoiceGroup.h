@@ -0,0 +1,129 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc SynthVoiceGroup
+ */
+
+#include <array>
+
+#include "SynthVoice.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Non-templated interface to a SynthVoiceGroup, used by MidiSynth */
+class SynthVoiceGroupBase
+{
+public:
+  virtual ~SynthVoiceGroupBase() {}
+
+  /** @return The number of voices (lanes) in the group */
+  virtual int NLanes() const = 0;
+
+  /** @return The SynthVoice that the VoiceAllocator uses to control a lane */
+  virtual SynthVoice* GetLane(int lane) = 0;
+
+  /** @return \c true if any lane is generating audio */
+  virtual bool GetAnyBusy() const = 0;
+
+  /** Process a block of audio for all lanes together, accumulating into the outputs. Arguments are as for SynthVoice::ProcessSamplesAccumulating() */
+  virtual void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) = 0;
+
+  /** Implement this if you need to do work when the sample rate or block size changes */
+  virtual void SetSampleRateAndBlockSize(double sampleRate, int blockSize) {}
+};
+
+/** A group of N voices of the same type that are rendered together, with their DSP state stored in lanes so that one loop over the lanes can be vectorized.
+ * Use the *Lanes versions of the Extras DSP classes (SinOscillatorLanes, FastSinOscillatorLanes, ADSREnvelopeLanes, SVFLanes, LogParamSmooth::ProcessLanes()) for the state.
+ * The VoiceAllocator sees each lane as an ordinary SynthVoice (see GetLane()), so allocation, stealing and control ramps work as usual,
+ * but the lanes don't render anything themselves: MidiSynth calls ProcessSamplesAccumulating() once for the whole group instead.
+ * Add the group to a MidiSynth with MidiSynth::AddVoiceGroup() */
+template <int N>
+class SynthVoiceGroup : public SynthVoiceGroupBase
+{
+public:
+  static constexpr int kNumLanes = N;
+
+  /** The SynthVoice for one lane, which forwards to the group */
+  class Lane final : public SynthVoice
+  {
+  public:
+    bool GetBusy() const override { return mGroup->GetLaneBusy(mLane); }
+    void Trigger(double level, bool isRetrigger) override { mGroup->TriggerLane(mLane, level, isRetrigger); }
+    void Release() override { mGroup->ReleaseLane(mLane); }
+    void SetProgramNumber(int pgm) override { mGroup->SetLaneProgramNumber(mLane, pgm); }
+    void SetControl(int controlNumber, float value) override { mGroup->SetLaneControl(mLane, controlNumber, value); }
+
+    // rendered by the group
+    void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nFrames) override {}
+
+    /** @return The control ramps the VoiceAllocator writes for this lane */
+    const VoiceInputs& GetInputs() const { return mInputs; }
+
+  private:
+    SynthVoiceGroup* mGroup = nullptr;
+    int mLane = 0;
+
+    friend class SynthVoiceGroup;
+  };
+
+  SynthVoiceGroup()
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      mLanes[l].mGroup = this;
+      mLanes[l].mLane = l;
+    }
+  }
+
+  SynthVoiceGroup(const SynthVoiceGroup&) = delete;
+  SynthVoiceGroup& operator=(const SynthVoiceGroup&) = delete;
+
+  int NLanes() const override { return N; }
+
+  SynthVoice* GetLane(int lane) override { return &mLanes[lane]; }
+
+  bool GetAnyBusy() const override
+  {
+    for (auto l = 0; l < N; l++)
+    {
+      if (GetLaneBusy(l))
+        return true;
+    }
+    return false;
+  }
+
+  /** @return \c true if the lane is generating any audio */
+  virtual bool GetLaneBusy(int lane) const = 0;
+
+  /** Called when the VoiceAllocator starts a lane, see SynthVoice::Trigger() */
+  virtual void TriggerLane(int lane, double level, bool isRetrigger) {}
+
+  /** Called when the VoiceAllocator releases a lane, see SynthVoice::Release() */
+  virtual void ReleaseLane(int lane) {}
+
+  /** See SynthVoice::SetProgramNumber() */
+  virtual void SetLaneProgramNumber(int lane, int pgm) {}
+
+  /** See SynthVoice::SetControl() */
+  virtual void SetLaneControl(int lane, int controlNumber, float value) {}
+
+protected:
+  /** @return The control ramps (gate, pitch, pitch bend...) for a lane, written by the VoiceAllocator */
+  const VoiceInputs& LaneInputs(int lane) const { return mLanes[lane].GetInputs(); }
+
+private:
+  std::array<Lane, N> mLanes;
+};
+
+END_IPLUG_NAMESPACE
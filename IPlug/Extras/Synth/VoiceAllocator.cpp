@@ -27,18 +27,55 @@ VoiceAllocator::VoiceAllocator()
 {
   // setup default key->pitch fn
   mKeyToPitchFn = [](int k){return (k - 69.f)/12.f;};
+  UpdatePitchTables();
 
-  mSustainedNotes.reserve(128);
-  mHeldKeys.reserve(128);
+  // keys are unique in both lists, so they can never grow beyond this and won't allocate on the audio thread
+  mSustainedNotes.reserve(UCHAR_MAX + 1);
+  mHeldKeys.reserve(UCHAR_MAX + 1);
 }
 
 VoiceAllocator::~VoiceAllocator()
 {
 }
 
+void VoiceAllocator::SetChannelPitchTable(int channel, const float* pitches)
+{
+  if (channel < 0 || channel >= kNumPitchTableChannels)
+    return;
+
+  if (pitches)
+    std::copy(pitches, pitches + kNumPitchTableKeys, mChannelPitchTables[channel].begin());
+
+  mHasChannelPitchTable[channel] = pitches != nullptr;
+  UpdatePitchTables();
+}
+
+void VoiceAllocator::UpdatePitchTables()
+{
+  const int offset = static_cast<int>(mPitchOffset);
+  PitchTable fromFn;
+
+  for (int k = 0; k < kNumPitchTableKeys; k++)
+    fromFn[k] = mKeyToPitchFn ? mKeyToPitchFn(k + offset) : (k + offset - 69.f) / 12.f;
+
+  for (int c = 0; c < kNumPitchTableChannels; c++)
+  {
+    if (!mHasChannelPitchTable[c])
+    {
+      mPitchTables[c] = fromFn;
+      continue;
+    }
+
+    // a table only covers the MIDI keys, so keys shifted past either end take its first or last pitch
+    for (int k = 0; k < kNumPitchTableKeys; k++)
+      mPitchTables[c][k] = mChannelPitchTables[c][std::min(std::max(k + offset, 0), kNumPitchTableKeys - 1)];
+  }
+}
+
 void VoiceAllocator::Clear()
 {
   mHeldKeys.clear();
+  mHeldKeyBits.reset();
   mSustainedNotes.clear();
   HardKillAllVoices();
 }
@@ -55,11 +92,21 @@ void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
 {
   if(mVoicePtrs.size() + 1 < UCHAR_MAX)
   {
+    const int voiceIdx = static_cast<int>(mVoicePtrs.size());
     mVoicePtrs.push_back(pVoice);
+    mBusyVoicePtrs.reserve(mVoicePtrs.size());
     ClearVoiceInputs(pVoice);
     pVoice->mKey = -1;
     pVoice->mZone = zone;
 
+    mVoiceZones.push_back(zone);
+    mVoiceChannels.push_back(pVoice->mChannel);
+    mVoiceKeys.push_back(kAllKeys);
+    mVoiceTriggerTimes.push_back(pVoice->mLastTriggeredTime);
+    mAllVoices[voiceIdx] = true;
+    mVoicesByZone[zone][voiceIdx] = true;
+    mVoicesByChannel[pVoice->mChannel][voiceIdx] = true;
+
     // make a glides structures for the control ramps of the new voice
     mVoiceGlides.emplace_back(ControlRampProcessor::Create(pVoice->mInputs));
   }
@@ -72,24 +119,11 @@ void VoiceAllocator::AddVoice(SynthVoice* pVoice, uint8_t zone)
 VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddress addr)
 {
   const int n = static_cast<int>(mVoicePtrs.size());
-  VoiceBitsArray v;
-
-  // set all bits to true
-  for(int i=0; i<n; ++i)
-  {
-    v[i] = true;
-  }
 
   // for each criterion present in address, clear any voice bits not matching
 
   // zone
-  if(addr.mZone != kAllZones)
-  {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mZone == addr.mZone);
-    }
-  }
+  VoiceBitsArray v = (addr.mZone != kAllZones) ? mVoicesByZone[addr.mZone] : mAllVoices;
 
   // setting the flag kVoicesAll returns all voices matching the zone of the address.
   if(addr.mFlags & kVoicesAll) return v;
@@ -97,27 +131,26 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
   // channel
   if(addr.mChannel != kAllChannels)
   {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mChannel == addr.mChannel);
-    }
+    v &= mVoicesByChannel[addr.mChannel];
   }
 
   // Key
   if(addr.mKey != kAllKeys)
   {
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = v[i] & (mVoicePtrs[i]->mKey == addr.mKey);
-    }
+    v &= mVoicesByKey[addr.mKey];
   }
 
+  if(v.none()) return v;
+
   // busy flag
   if(addr.mFlags & kVoicesBusy)
   {
     for(int i=0; i<n; ++i)
     {
-      v[i] = v[i] & mVoicePtrs[i]->GetBusy();
+      if(v[i])
+      {
+        v[i] = mVoicePtrs[i]->GetBusy();
+      }
     }
   }
 
@@ -130,7 +163,7 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
     {
       if(v[i])
       {
-        int64_t vt = mVoicePtrs[i]->mLastTriggeredTime;
+        int64_t vt = mVoiceTriggerTimes[i];
         if(vt > maxT)
         {
           maxT = vt;
@@ -139,12 +172,7 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
       }
     }
 
-    // set all bits to false
-    //v.reset();
-    for(int i=0; i<n; ++i)
-    {
-      v[i] = 0;
-    }
+    v.reset();
 
     if(maxIdx >= 0)
     {
@@ -154,6 +182,28 @@ VoiceAllocator::VoiceBitsArray VoiceAllocator::VoicesMatchingAddress(VoiceAddres
   return v;
 }
 
+void VoiceAllocator::SetVoiceChannel(int voiceIdx, uint8_t channel)
+{
+  mVoicesByChannel[mVoiceChannels[voiceIdx]][voiceIdx] = false;
+  mVoicesByChannel[channel][voiceIdx] = true;
+  mVoiceChannels[voiceIdx] = channel;
+  mVoicePtrs[voiceIdx]->mChannel = channel;
+}
+
+void VoiceAllocator::SetVoiceKey(int voiceIdx, uint8_t key)
+{
+  mVoicesByKey[mVoiceKeys[voiceIdx]][voiceIdx] = false;
+
+  // an unassigned voice has key kAllKeys, which is never looked up
+  if(key != kAllKeys)
+  {
+    mVoicesByKey[key][voiceIdx] = true;
+  }
+
+  mVoiceKeys[voiceIdx] = key;
+  mVoicePtrs[voiceIdx]->mKey = key;
+}
+
 void VoiceAllocator::SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples)
 {
   // send control change to all matched voices through glide generators
@@ -178,6 +228,61 @@ void VoiceAllocator::SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, flo
   }
 }
 
+void VoiceAllocator::AddExpression(const VoiceInputEvent& e, int ctlIdx)
+{
+  for(int i=0; i<mNumPendingExpressions; ++i)
+  {
+    PendingExpression& pe = mPendingExpressions[i];
+    const VoiceAddress& a = pe.mAddress;
+
+    if(pe.mCtlIdx == ctlIdx && a.mZone == e.mAddress.mZone && a.mChannel == e.mAddress.mChannel && a.mKey == e.mAddress.mKey && a.mFlags == e.mAddress.mFlags)
+    {
+      pe.mValue = e.mValue;
+      pe.mLastOffset = std::max(pe.mLastOffset, e.mSampleOffset);
+      return;
+    }
+  }
+
+  // more addresses than fit: send the ones so far, later values for the same addresses restart their ramps
+  if(mNumPendingExpressions == kMaxPendingExpressions)
+  {
+    SendExpressionsToVoiceInputs();
+  }
+
+  mPendingExpressions[mNumPendingExpressions++] = {e.mAddress, ctlIdx, e.mValue, e.mSampleOffset, e.mSampleOffset};
+}
+
+void VoiceAllocator::SendExpressionsToVoiceInputs()
+{
+  for(int i=0; i<mNumPendingExpressions; ++i)
+  {
+    const PendingExpression& pe = mPendingExpressions[i];
+    const VoiceBitsArray v = VoicesMatchingAddress(pe.mAddress);
+
+    if(v.none())
+      continue;
+
+    // ramp from the first event in the block towards the last value, over at least the control glide time
+    const int glideSamples = std::max(mControlGlideSamples, pe.mLastOffset - pe.mFirstOffset);
+
+    for(int j=0; j<mVoicePtrs.size(); ++j)
+    {
+      if(v[j])
+      {
+        ControlRampProcessor& glide = mVoiceGlides[j]->at(pe.mCtlIdx);
+
+        // a value the voice is already at or heading for would only restart its glide
+        if(glide.GetTargetValue() != pe.mValue)
+        {
+          glide.SetTarget(pe.mValue, pe.mFirstOffset, glideSamples, mBlockSize);
+        }
+      }
+    }
+  }
+
+  mNumPendingExpressions = 0;
+}
+
 void VoiceAllocator::SendProgramChangeToVoices(VoiceBitsArray v, int pgm)
 {
   for(int i=0; i<mVoicePtrs.size(); ++i)
@@ -195,7 +300,13 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
   {
     VoiceInputEvent event;
     mInputQueue.Pop(event);
-    VoiceAllocator::VoiceBitsArray voices = VoicesMatchingAddress(event.mAddress);
+
+    // note on/off and sustain do their own matching, expressions are matched once per block
+    VoiceAllocator::VoiceBitsArray voices;
+    if(event.mAction == kControllerAction || event.mAction == kProgramChangeAction)
+    {
+      voices = VoicesMatchingAddress(event.mAddress);
+    }
 
     switch(event.mAction)
     {
@@ -218,17 +329,17 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
       }
       case kPitchBendAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlPitchBend, event.mValue, mControlGlideSamples);
+        AddExpression(event, kVoiceControlPitchBend);
         break;
       }
       case kPressureAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlPressure, event.mValue, mControlGlideSamples);
+        AddExpression(event, kVoiceControlPressure);
         break;
       }
       case kTimbreAction:
       {
-        SendControlToVoiceInputs(voices, kVoiceControlTimbre, event.mValue, mControlGlideSamples);
+        AddExpression(event, kVoiceControlTimbre);
         break;
       }
       case kSustainAction:
@@ -236,21 +347,24 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
         mSustainPedalDown = (bool) (event.mValue >= 0.5);
         if (!mSustainPedalDown) // sustain pedal released
         {
-          // if notes are sustaining, check that they're not still held and if not then stop voice
+          // if notes are sustaining, check that they're not still held and if not then stop voice.
+          // held notes are compacted in place, rather than erased one by one
           if (!mSustainedNotes.empty())
           {
-            for (auto susNotesItr = mSustainedNotes.begin(); susNotesItr != mSustainedNotes.end();)
+            size_t nKept = 0;
+            for (size_t i = 0; i < mSustainedNotes.size(); i++)
             {
-              uint8_t key = *susNotesItr;
-              bool held = std::find(mHeldKeys.begin(), mHeldKeys.end(), key) != mHeldKeys.end();
-              if (!held)
+              uint8_t key = mSustainedNotes[i];
+              if (!mHeldKeyBits[key])
               {
                 StopVoices(VoicesMatchingAddress({event.mAddress.mZone, kAllChannels, key, 0}), event.mSampleOffset);
-                susNotesItr = mSustainedNotes.erase(susNotesItr);
               }
               else
-                susNotesItr++;
+              {
+                mSustainedNotes[nKept++] = key;
+              }
             }
+            mSustainedNotes.resize(nKept);
           }
         }
         break;
@@ -274,6 +388,10 @@ void VoiceAllocator::ProcessEvents(int blockSize, int64_t sampleTime)
     }
   }
 
+  // dense MPE streams are coalesced to one value per address and control, matched to voices once per block rather than once per event.
+  // sent after the block's note ons, so that a note picks up the expression sent on its channel just before it
+  SendExpressionsToVoiceInputs();
+
   // update any glides in progress, writing voice control outputs
   for(auto& glides : mVoiceGlides)
   {
@@ -292,14 +410,20 @@ void VoiceAllocator::CalcGlideTimesInSamples()
 
 int VoiceAllocator::FindFreeVoiceIndex(int startIndex) const
 {
-  size_t voices = mVoicePtrs.size();
-  for(int i=0; i<voices; ++i)
+  const int groupSize = mUnisonVoices;
+  const int groups = GetNAllocatableVoices() / groupSize;
+  const int startGroup = groups > 0 ? (startIndex / groupSize) % groups : 0;
+  for(int i=0; i<groups; ++i)
   {
-    int j = (startIndex + i)%voices;
-    SynthVoice* pv = mVoicePtrs[j];
-    if(!pv->GetBusy())
+    const int first = ((startGroup + i)%groups) * groupSize;
+    bool free = true;
+    for(int u=0; u<groupSize && free; ++u)
+    {
+      free = !mVoicePtrs[first + u]->GetBusy();
+    }
+    if(free)
     {
-      return j;
+      return first;
     }
   }
   return -1;
@@ -307,21 +431,44 @@ int VoiceAllocator::FindFreeVoiceIndex(int startIndex) const
 
 int VoiceAllocator::FindVoiceIndexToSteal(int64_t sampleTime) const
 {
-  size_t voices = mVoicePtrs.size();
+  // a group's voices are all triggered together, so the first voice's trigger time is the group's
+  const int groupSize = mUnisonVoices;
+  const int groups = GetNAllocatableVoices() / groupSize;
+  if(groups < 1)
+  {
+    return -1;
+  }
   int64_t earliestTime = sampleTime;
   int longestPlayingVoiceIdx = 0;
-  for(int i=0; i<voices; ++i)
+  for(int i=0; i<groups * groupSize; i += groupSize)
   {
-    SynthVoice* pv = mVoicePtrs[i];
-    if(pv->mLastTriggeredTime < earliestTime)
+    if(mVoiceTriggerTimes[i] < earliestTime)
     {
-      earliestTime = pv->mLastTriggeredTime;
+      earliestTime = mVoiceTriggerTimes[i];
       longestPlayingVoiceIdx = i;
     }
   }
   return longestPlayingVoiceIdx;
 }
 
+void VoiceAllocator::SetUnison(int nVoices, float detuneCents, float spread)
+{
+  mUnisonVoices = std::min(std::max(nVoices, 1), kMaxUnisonVoices);
+  mUnisonDetunes.fill(0.f);
+  mUnisonPans.fill(0.f);
+
+  if(mUnisonVoices > 1)
+  {
+    // spaced evenly and symmetrically about the note, so the outermost places are +/- half the detune and the full spread
+    for(int u=0; u<mUnisonVoices; ++u)
+    {
+      const float pos = 2.f * u / (mUnisonVoices - 1) - 1.f;
+      mUnisonDetunes[u] = pos * detuneCents / 2400.f;
+      mUnisonPans[u] = pos * std::min(std::max(spread, 0.f), 1.f);
+    }
+  }
+}
+
 // start a single voice and set its current channel and key.
 void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig)
 {
@@ -331,14 +478,20 @@ void VoiceAllocator::StartVoice(int voiceIdx, int channel, int key, float pitch,
     mVoiceGlides[voiceIdx]->at(kVoiceControlGate).SetTarget(velocity, sampleOffset, 1, mBlockSize);
   }
 
+  // groups start at multiples of the group size, so a voice's place in its group is its index modulo the size
+  const int unisonIndex = voiceIdx % mUnisonVoices;
+
   // add glide for pitch
-  mVoiceGlides[voiceIdx]->at(kVoiceControlPitch).SetTarget(pitch, sampleOffset, mNoteGlideSamples, mBlockSize);
+  mVoiceGlides[voiceIdx]->at(kVoiceControlPitch).SetTarget(pitch + mUnisonDetunes[unisonIndex], sampleOffset, mNoteGlideSamples, mBlockSize);
 
   // set things directly in voice
   SynthVoice* pVoice = mVoicePtrs[voiceIdx];
+  pVoice->mUnisonIndex = static_cast<uint8_t>(unisonIndex);
+  pVoice->mUnisonPan = mUnisonPans[unisonIndex];
   pVoice->mLastTriggeredTime = sampleTime;
-  pVoice->mChannel = channel;
-  pVoice->mKey = key;
+  mVoiceTriggerTimes[voiceIdx] = sampleTime;
+  SetVoiceChannel(voiceIdx, channel);
+  SetVoiceKey(voiceIdx, key);
   pVoice->mGain = 1.;
 
   // call voice's Trigger method
@@ -360,7 +513,7 @@ void VoiceAllocator::StartVoices(VoiceBitsArray vbits, int channel, int key, flo
 void VoiceAllocator::StopVoice(int voiceIdx, int sampleOffset)
 {
   mVoiceGlides[voiceIdx]->at(kVoiceControlGate).SetTarget(0.0, sampleOffset, 1, mBlockSize);
-  mVoicePtrs[voiceIdx]->mKey = -1;
+  SetVoiceKey(voiceIdx, kAllKeys);
   mVoicePtrs[voiceIdx]->Release();
 }
 
@@ -379,6 +532,7 @@ void VoiceAllocator::StopVoices(VoiceBitsArray vbits, int sampleOffset)
 void VoiceAllocator::SoftKillAllVoices()
 {
   mHeldKeys.clear();
+  mHeldKeyBits.reset();
   mSustainedNotes.clear();
   mSustainPedalDown = false;
 
@@ -404,7 +558,7 @@ void VoiceAllocator::NoteOn(VoiceInputEvent e, int64_t sampleTime)
   int key = e.mAddress.mKey;
   int offset = e.mSampleOffset;
   float velocity = e.mValue;
-  float pitch = mKeyToPitchFn(key + static_cast<int>(mPitchOffset));
+  float pitch = GetPitch(channel, key);
 
   switch(mPolyMode)
   {
@@ -429,12 +583,16 @@ void VoiceAllocator::NoteOn(VoiceInputEvent e, int64_t sampleTime)
       }
       if(mRotateVoices)
       {
-        mVoiceRotateIndex = i + 1;
+        mVoiceRotateIndex = i + mUnisonVoices;
       }
       if(i >= 0)
       {
+        // the whole unison group starts together
         bool retrig = false;
-        StartVoice(i, channel, key, pitch, velocity, offset, sampleTime, retrig);
+        for(int u=0; u<mUnisonVoices; ++u)
+        {
+          StartVoice(i + u, channel, key, pitch, velocity, offset, sampleTime, retrig);
+        }
       }
       break;
     }
@@ -444,8 +602,9 @@ void VoiceAllocator::NoteOn(VoiceInputEvent e, int64_t sampleTime)
   }
 
   // add to held keys
-  if(std::find(mHeldKeys.begin(), mHeldKeys.end(), key) == mHeldKeys.end())
+  if(!mHeldKeyBits[key])
   {
+    mHeldKeyBits[key] = true;
     mHeldKeys.push_back(key);
     mMinHeldVelocity = std::min(velocity, mMinHeldVelocity);
   }
@@ -464,7 +623,11 @@ void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
   int offset = e.mSampleOffset;
 
   // remove from held keys
-  mHeldKeys.erase(std::remove(mHeldKeys.begin(), mHeldKeys.end(), key), mHeldKeys.end());
+  if(mHeldKeyBits[key])
+  {
+    mHeldKeyBits[key] = false;
+    mHeldKeys.erase(std::find(mHeldKeys.begin(), mHeldKeys.end(), key));
+  }
   if(mHeldKeys.empty())
   {
     mMinHeldVelocity = 1.0f;
@@ -511,7 +674,7 @@ void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
     {
       // trigger the queued key for all voices in the zone at the minimum held velocity.
       // alternatively the release velocity of the note off could be used here.
-      float pitch = mKeyToPitchFn(queuedKey + static_cast<int>(mPitchOffset));
+      float pitch = GetPitch(channel, queuedKey);
       bool retrig = false;
 
       StartVoices(VoicesMatchingAddress({e.mAddress.mZone, kAllChannels, kAllKeys, 0}), channel, queuedKey, pitch, mMinHeldVelocity, offset, sampleTime, retrig);
@@ -529,12 +692,38 @@ void VoiceAllocator::NoteOff(VoiceInputEvent e, int64_t sampleTime)
 
 void VoiceAllocator::ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize)
 {
+  if(mRenderPool)
+  {
+    mBusyVoicePtrs.clear();
+
+    for(auto pVoice : mVoicePtrs)
+    {
+      if(pVoice->GetBusy())
+      {
+        mBusyVoicePtrs.push_back(pVoice);
+      }
+    }
+
+    const int nBusy = static_cast<int>(mBusyVoicePtrs.size());
+
+    if(nBusy >= mMinVoicesForRenderPool && mRenderPool->Process(mBusyVoicePtrs.data(), nBusy, inputs, outputs, nInputs, nOutputs, mDisconnectedOutputs, startIndex, blockSize))
+    {
+      return;
+    }
+
+    for(auto pVoice : mBusyVoicePtrs)
+    {
+      pVoice->ProcessSamplesRouted(inputs, outputs, nInputs, nOutputs, mDisconnectedOutputs, startIndex, blockSize);
+    }
+
+    return;
+  }
+
   for(auto pVoice : mVoicePtrs)
   {
-    // TODO distribute voices across cores
     if(pVoice->GetBusy())
     {
-      pVoice->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, startIndex, blockSize);
+      pVoice->ProcessSamplesRouted(inputs, outputs, nInputs, nOutputs, mDisconnectedOutputs, startIndex, blockSize);
     }
   }
 }
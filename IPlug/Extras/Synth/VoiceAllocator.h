@@ -15,6 +15,7 @@
  * @copydoc VoiceAllocator
  */
 
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <stdint.h>
@@ -26,6 +27,7 @@
 #include "IPlugQueue.h"
 
 #include "SynthVoice.h"
+#include "VoiceRenderPool.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -97,6 +99,7 @@ public:
   };
 
   static constexpr int kVoiceMostRecent = 1 << 7;
+  static constexpr int kMaxUnisonVoices = 16;
 
   // one voice worth of ramp generators
   using VoiceControlRamps = ControlRampProcessor::ProcessorArray<kNumVoiceControlRamps>;
@@ -130,16 +133,61 @@ public:
   /** Stop all voices from making sound immdiately. */
   void HardKillAllVoices();
 
-  void SetKeyToPitchFunction(const std::function<float(int)>& fn) {mKeyToPitchFn = fn;}
+  /** Set the tuning of every channel that doesn't have its own pitch table. The function is called for every key here and when the pitch offset changes, not on note on
+   @param fn A function taking a key, shifted by the pitch offset, and returning its pitch in octaves relative to 440Hz */
+  void SetKeyToPitchFunction(const std::function<float(int)>& fn) { mKeyToPitchFn = fn; UpdatePitchTables(); }
+
+  /** Give a channel its own tuning, e.g. from a per-channel (MTS-ESP or MIDI tuning standard) tuning source
+   @param channel The MIDI channel, 0 to 15
+   @param pitches The pitches of keys 0 to 127 in octaves relative to 440Hz, which are copied, or nullptr to go back to the key to pitch function */
+  void SetChannelPitchTable(int channel, const float* pitches);
+
+  /** @return The pitch a note on for this channel and key starts a voice at, in octaves relative to 440Hz */
+  float GetPitch(int channel, int key) const { return mPitchTables[channel & (kNumPitchTableChannels - 1)][key & (kNumPitchTableKeys - 1)]; }
 
   /** Send the event to the voices matching its address.*/
   void SendEventToVoices(VoiceInputEvent event);
 
+  /** Render the busy voices, each into its own output channels, see SynthVoice::SetOutputChannels() */
   void ProcessVoices(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIndex, int blockSize);
 
+  /** Set whether an output channel is connected, e.g. from IPlugProcessor::IsChannelConnected() at the start of each block. Voices routed only to disconnected channels are called with no outputs
+   @param chIdx The output channel, channels from 64 on are always treated as connected
+   @param connected \c false if the host isn't using the channel */
+  void SetOutputChannelConnected(int chIdx, bool connected)
+  {
+    if (chIdx >= 0 && chIdx < 64)
+      mDisconnectedOutputs = connected ? (mDisconnectedOutputs & ~(1ull << chIdx)) : (mDisconnectedOutputs | (1ull << chIdx));
+  }
+
+  /** Render busy voices on a VoiceRenderPool when there are at least minVoices of them. We do not take ownership of the pool.
+   @param pPool The pool to render on, or nullptr to always render on the calling thread
+   @param minVoices Below this number of busy voices, rendering stays on the calling thread since the synchronisation would cost more than it saves */
+  void SetRenderPool(VoiceRenderPool* pPool, int minVoices) { mRenderPool = pPool; mMinVoicesForRenderPool = minVoices; }
+
   size_t GetNVoices() const {return mVoicePtrs.size();}
+  /** Limit the voices that new notes in poly mode are allocated to, to the first maxVoices. Voices beyond the limit that are already sounding are left to finish.
+   @param maxVoices The number of voices to use, or 0 for all of them */
+  void SetMaxVoices(int maxVoices) { mMaxVoices = std::max(maxVoices, 0); }
+  /** @return The number of voices new notes can be allocated to */
+  int GetNAllocatableVoices() const { const int n = static_cast<int>(mVoicePtrs.size()); return (mMaxVoices > 0 && mMaxVoices < n) ? mMaxVoices : n; }
+  /** Stack voices for each note in poly mode. A note on allocates a group of nVoices contiguous voices in one go, starting at a multiple of nVoices,
+   and the group is stolen and released as a unit. Each voice's pitch input includes its detune, and SynthVoice::mUnisonPan gives its stereo position.
+   In mono mode every voice in the zone already plays the note, and voices are detuned and spread by their index in the same way.
+   This doesn't allocate, but new groupings only apply to new notes, so it is best changed while notes aren't sounding
+   @param nVoices The number of voices per note, from 1, for no unison, to kMaxUnisonVoices
+   @param detuneCents The pitch difference between the outermost voices of a group, in cents
+   @param spread The stereo width of a group, from 0 for all voices in the centre to 1 for the outermost voices hard left and right */
+  void SetUnison(int nVoices, float detuneCents, float spread);
+  /** @return The number of voices per note */
+  int GetNUnisonVoices() const { return mUnisonVoices; }
+  /** @return The detune of each place in a unison group, in octaves, GetNUnisonVoices() of them, for voices that compute their group's detune and spread together */
+  const float* GetUnisonDetunes() const { return mUnisonDetunes.data(); }
+  /** @return The stereo position of each place in a unison group, from -1 to 1, GetNUnisonVoices() of them */
+  const float* GetUnisonPans() const { return mUnisonPans.data(); }
   SynthVoice* GetVoice(int voiceIndex) const {return mVoicePtrs[voiceIndex];}
-  void SetPitchOffset(float offset) { mPitchOffset = offset; }
+  /** Shift the keys that are looked up in the tuning by a whole number of keys */
+  void SetPitchOffset(float offset) { mPitchOffset = offset; UpdatePitchTables(); }
 
 private:
   using VoiceBitsArray = std::bitset<UCHAR_MAX>;
@@ -148,6 +196,12 @@ private:
 
   void SendControlToVoiceInputs(VoiceBitsArray v, int ctlIdx, float val, int glideSamples);
   void SendControlToVoicesDirect(VoiceBitsArray v, int ctlIdx, float val);
+
+  /** Add a pitch bend, pressure or timbre event to the expressions for this block, replacing any earlier value for the same address and control */
+  void AddExpression(const VoiceInputEvent& e, int ctlIdx);
+
+  /** Send the block's expressions to the voices matching their addresses, each as one ramp from the first event's offset */
+  void SendExpressionsToVoiceInputs();
   void SendProgramChangeToVoices(VoiceBitsArray v, int pgm);
 
   void StartVoice(int voiceIdx, int channel, int key, float pitch, float velocity, int sampleOffset, int64_t sampleTime, bool retrig);
@@ -156,23 +210,70 @@ private:
   void StopVoice(int voiceIdx, int sampleOffset);
   void StopVoices(VoiceBitsArray voices, int sampleOffset);
 
+  /** Rebuild the pitch tables that note on looks up, from the key to pitch function or the channel pitch tables, shifted by the pitch offset */
+  void UpdatePitchTables();
+
   void CalcGlideTimesInSamples();
   void ClearVoiceInputs(SynthVoice* pVoice);
+  /** @return The first voice of a unison group whose voices are all free, searching from the group containing startIndex, or -1 if there isn't one */
   int FindFreeVoiceIndex(int startIndex) const;
+  /** @return The first voice of the unison group that was triggered longest ago, or -1 if there are fewer allocatable voices than one group */
   int FindVoiceIndexToSteal(int64_t sampleTime) const;
 
   void NoteOn(VoiceInputEvent e, int64_t sampleTime);
   void NoteOff(VoiceInputEvent e, int64_t sampleTime);
 
+  void SetVoiceChannel(int voiceIdx, uint8_t channel);
+  void SetVoiceKey(int voiceIdx, uint8_t key);
+
   IPlugQueue<VoiceInputEvent> mInputQueue{1024};
 
+  /** The pitch bend, pressure and timbre events for one address and control in the current block, coalesced into the last value */
+  struct PendingExpression
+  {
+    VoiceAddress mAddress;
+    int mCtlIdx;
+    float mValue;
+    int mFirstOffset;
+    int mLastOffset;
+  };
+
+  // MPE controllers send a stream per channel, so this only fills if there are more than 16 channels' worth of addresses in a block
+  static constexpr int kMaxPendingExpressions = 48;
+  std::array<PendingExpression, kMaxPendingExpressions> mPendingExpressions;
+  int mNumPendingExpressions = 0;
+
   std::vector<SynthVoice*> mVoicePtrs;
+  std::vector<SynthVoice*> mBusyVoicePtrs; // scratch list for ProcessVoices(), reserved for all voices
+  VoiceRenderPool* mRenderPool = nullptr;
+  int mMinVoicesForRenderPool = 0;
+  uint64_t mDisconnectedOutputs = 0; // bit c is set if output channel c is disconnected
   std::vector<std::unique_ptr<VoiceControlRamps>> mVoiceGlides;
-  std::vector<int> mHeldKeys; // The currently physically held keys on the keyboard
+  std::vector<int> mHeldKeys; // The currently physically held keys on the keyboard, in the order they were pressed
   std::vector<int> mSustainedNotes; // Any notes that are sustained, including those that are physically held
+  std::bitset<UCHAR_MAX + 1> mHeldKeyBits; // mHeldKeys as a set, for O(1) lookup
+
+  // Voice state mirrored in structure-of-arrays form, indexed by voice, so that address matching doesn't chase mVoicePtrs
+  std::vector<uint8_t> mVoiceZones;
+  std::vector<uint8_t> mVoiceChannels;
+  std::vector<uint8_t> mVoiceKeys; // kAllKeys when the voice is not assigned to a key
+  std::vector<int64_t> mVoiceTriggerTimes;
+
+  // Masks of the voices in each zone, on each channel and playing each key, so that VoicesMatchingAddress() is O(1) in the number of voices
+  VoiceBitsArray mAllVoices;
+  std::array<VoiceBitsArray, UCHAR_MAX + 1> mVoicesByZone;
+  std::array<VoiceBitsArray, UCHAR_MAX + 1> mVoicesByChannel;
+  std::array<VoiceBitsArray, UCHAR_MAX + 1> mVoicesByKey;
+
+  static constexpr int kNumPitchTableChannels = 16;
+  static constexpr int kNumPitchTableKeys = 128;
+  using PitchTable = std::array<float, kNumPitchTableKeys>;
 
   std::function<float(int)> mKeyToPitchFn;
   double mPitchOffset{0.};
+  std::array<PitchTable, kNumPitchTableChannels> mPitchTables; // what note on looks up, by channel and key
+  std::array<PitchTable, kNumPitchTableChannels> mChannelPitchTables; // set by SetChannelPitchTable(), before the pitch offset
+  std::bitset<kNumPitchTableChannels> mHasChannelPitchTable;
 
   double mNoteGlideTime{0.};
   double mControlGlideTime{0.01};
@@ -181,6 +282,10 @@ private:
   double mSampleRate;
   int mBlockSize;
 
+  int mMaxVoices{0}; // 0 for no limit, see SetMaxVoices()
+  int mUnisonVoices{1};
+  std::array<float, kMaxUnisonVoices> mUnisonDetunes{}; // by place in the group, in octaves
+  std::array<float, kMaxUnisonVoices> mUnisonPans{};
   bool mRotateVoices{true};
   int mVoiceRotateIndex{0};
   bool mSustainPedalDown{false};
@@ -0,0 +1,286 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc VoiceRenderPool
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IPlugRealtimeThread.h"
+#include "SynthVoice.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A pool of pre-spawned realtime worker threads that renders synth voices in parallel with the audio thread.
+ * The voices are split into NThreads() shares. The audio thread renders the first directly into the outputs, and the others are claimed by whichever thread
+ * gets to them first, a worker or the audio thread once it has finished its own, and rendered into that share's accumulation buffers, which are summed into the
+ * outputs once all shares are done. So the audio thread only ever waits for shares that are already being rendered, never for a worker to wake up.
+ * Nothing is allocated or locked on the audio thread. Voices must not write to state shared with other voices in ProcessSamplesAccumulating() */
+class VoiceRenderPool final
+{
+public:
+  /** How many times a worker polls for new work before yielding, and then how many times it yields before parking */
+  static constexpr int kSpinCount = 2000;
+  static constexpr int kYieldCount = 200;
+
+  /** VoiceRenderPool constructor
+   * @param nThreads The total number of threads to render on, including the audio thread, so nThreads - 1 workers are started
+   * @param maxOutputChans The maximum number of output channels that will be rendered
+   * @param maxBlockSize The maximum number of sample frames per ProcessBlock() call */
+  VoiceRenderPool(int nThreads, int maxOutputChans, int maxBlockSize)
+  {
+    const int nWorkers = std::max(nThreads - 1, 0);
+    mWorkers.reserve(nWorkers);
+    mShares.reserve(nWorkers);
+
+    for (int i = 0; i < nWorkers; i++)
+    {
+      mWorkers.emplace_back(new Worker);
+      mShares.emplace_back(new Share);
+    }
+
+    Resize(maxOutputChans, maxBlockSize);
+
+    for (int i = 0; i < nWorkers; i++)
+      mWorkers[i]->mThread = std::thread(&VoiceRenderPool::WorkerLoop, this);
+  }
+
+  ~VoiceRenderPool()
+  {
+    mQuit.store(true, std::memory_order_release);
+    mCV.notify_all();
+
+    for (auto& pWorker : mWorkers)
+    {
+      if (pWorker->mThread.joinable())
+        pWorker->mThread.join();
+    }
+  }
+
+  VoiceRenderPool(const VoiceRenderPool&) = delete;
+  VoiceRenderPool& operator=(const VoiceRenderPool&) = delete;
+
+  /** Reallocate the worker accumulation buffers. Must not be called while Process() is running
+   * @param maxOutputChans The maximum number of output channels that will be rendered
+   * @param maxBlockSize The maximum number of sample frames per ProcessBlock() call */
+  void Resize(int maxOutputChans, int maxBlockSize)
+  {
+    mMaxOutputChans = maxOutputChans;
+    mMaxBlockSize = maxBlockSize;
+
+    for (auto& pShare : mShares)
+    {
+      pShare->mBuffers.assign(maxOutputChans, std::vector<sample>(maxBlockSize, 0.));
+      pShare->mBufferPtrs.resize(maxOutputChans);
+
+      for (int c = 0; c < maxOutputChans; c++)
+        pShare->mBufferPtrs[c] = pShare->mBuffers[c].data();
+    }
+  }
+
+  /** Have the workers join an audio workgroup, so that the OS schedules them with the host's audio threads, see IPlugThreadPool::SetAudioWorkgroup()
+   * @param pWorkgroup An os_workgroup_t, e.g. from IPlugProcessor::GetAudioWorkgroup(), or nullptr to leave the current one */
+  void SetAudioWorkgroup(void* pWorkgroup)
+  {
+    mpWorkgroup.store(pWorkgroup, std::memory_order_release);
+  }
+
+  /** @return The maximum number of output channels the worker buffers were allocated for */
+  int MaxOutputChans() const { return mMaxOutputChans; }
+
+  /** @return The total number of threads voices are rendered on, including the audio thread */
+  int NThreads() const { return static_cast<int>(mWorkers.size()) + 1; }
+
+  /** Render voices across the pool, accumulating into outputs, each voice into its own output channels (see SynthVoice::SetOutputChannels()). Called on the audio thread
+   * @param ppVoices The voices to render
+   * @param nVoices The number of voices in ppVoices
+   * @param disconnectedOutputs Bit c is set if output channel c is disconnected, the worker buffers of those channels aren't summed into the outputs
+   * @param startIdx The start index of the block of samples to process
+   * @param nFrames The number of samples to process
+   * @return \c false if the block doesn't fit the buffers allocated in Resize(), in which case nothing was rendered */
+  bool Process(SynthVoice* const* ppVoices, int nVoices, sample** inputs, sample** outputs, int nInputs, int nOutputs, uint64_t disconnectedOutputs, int startIdx, int nFrames)
+  {
+    if (nOutputs > mMaxOutputChans || startIdx + nFrames > mMaxBlockSize)
+      return false;
+
+    mpVoices = ppVoices;
+    mNVoices = nVoices;
+    mInputs = inputs;
+    mNInputs = nInputs;
+    mNOutputs = nOutputs;
+    mDisconnectedOutputs = disconnectedOutputs;
+    mStartIdx = startIdx;
+    mNFrames = nFrames;
+
+    const int nShares = static_cast<int>(mShares.size());
+    mPending.store(nShares, std::memory_order_relaxed);
+    mJob.store((static_cast<uint64_t>(++mGeneration) << 32) | 1, std::memory_order_release);
+
+    if (mNParked.load(std::memory_order_acquire) > 0)
+      mCV.notify_all();
+
+    RenderShare(0, outputs);
+
+    // render the shares no worker has started, e.g. because they are still waking up
+    while (RenderNextShare())
+    {
+    }
+
+    // the shares left are being rendered, so this waits no longer than the slowest of them takes
+    for (int polls = 0; mPending.load(std::memory_order_acquire) > 0; polls++)
+    {
+      if (polls >= kSpinCount)
+        std::this_thread::yield();
+    }
+
+    // reduce the share buffers into the outputs
+    for (auto& pShare : mShares)
+    {
+      for (int c = 0; c < nOutputs; c++)
+      {
+        if (c < 64 && (disconnectedOutputs >> c) & 1)
+          continue;
+
+        const sample* pSrc = pShare->mBufferPtrs[c] + startIdx;
+        sample* pDst = outputs[c] + startIdx;
+
+        for (int s = 0; s < nFrames; s++)
+          pDst[s] += pSrc[s];
+      }
+    }
+
+    return true;
+  }
+
+private:
+  struct Worker
+  {
+    std::thread mThread;
+  };
+
+  /** The accumulation buffers of one of the shares after the first */
+  struct Share
+  {
+    std::vector<std::vector<sample>> mBuffers;
+    std::vector<sample*> mBufferPtrs;
+  };
+
+  /** Render every NThreads()th voice, starting at share, into ppOutputs */
+  void RenderShare(int share, sample** ppOutputs)
+  {
+    const int stride = NThreads();
+
+    for (int v = share; v < mNVoices; v += stride)
+      mpVoices[v]->ProcessSamplesRouted(mInputs, ppOutputs, mNInputs, mNOutputs, mDisconnectedOutputs, mStartIdx, mNFrames);
+  }
+
+  /** Claim the next share of the current block that nobody has started, and render it into its buffers. Called on the workers and the audio thread
+   * @return \c false if there were none left */
+  bool RenderNextShare()
+  {
+    // the claim carries the generation, so a worker that wakes late claims a share of the block that is running, or one past the last
+    const uint64_t job = mJob.fetch_add(1, std::memory_order_acq_rel);
+    const int shareIdx = static_cast<int>(job & 0xFFFFFFFF);
+
+    if (shareIdx > static_cast<int>(mShares.size()))
+      return false;
+
+    Share& share = *mShares[shareIdx - 1];
+
+    for (int c = 0; c < mNOutputs; c++)
+      std::fill_n(share.mBufferPtrs[c] + mStartIdx, mNFrames, 0.);
+
+    RenderShare(shareIdx, share.mBufferPtrs.data());
+
+    mPending.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  void WorkerLoop()
+  {
+    IRealtimeThreadScope realtimeScope(mpWorkgroup.load(std::memory_order_acquire));
+    uint32_t lastGeneration = 0;
+
+    while (true)
+    {
+      uint32_t generation;
+      int polls = 0;
+
+      // spin, then yield, then park until there is a new block to render
+      while ((generation = static_cast<uint32_t>(mJob.load(std::memory_order_acquire) >> 32)) == lastGeneration && !mQuit.load(std::memory_order_acquire))
+      {
+        if (++polls < kSpinCount)
+          continue;
+        else if (polls < kSpinCount + kYieldCount)
+          std::this_thread::yield();
+        else
+        {
+          std::unique_lock<std::mutex> lock(mMutex);
+          mNParked.fetch_add(1, std::memory_order_acq_rel);
+          // the audio thread doesn't take the mutex, so a notify can come between the check and the wait. The timeout bounds how long the worker misses out for,
+          // and the audio thread renders the shares it misses
+          mCV.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+            return static_cast<uint32_t>(mJob.load(std::memory_order_acquire) >> 32) != lastGeneration || mQuit.load(std::memory_order_acquire);
+          });
+          mNParked.fetch_sub(1, std::memory_order_acq_rel);
+        }
+      }
+
+      if (mQuit.load(std::memory_order_acquire))
+        return;
+
+      lastGeneration = generation;
+      realtimeScope.SetWorkgroup(mpWorkgroup.load(std::memory_order_acquire));
+
+      while (RenderNextShare())
+      {
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  std::vector<std::unique_ptr<Share>> mShares;
+  int mMaxOutputChans = 0;
+  int mMaxBlockSize = 0;
+
+  // the current job, written by the audio thread before mJob is stored
+  SynthVoice* const* mpVoices = nullptr;
+  int mNVoices = 0;
+  sample** mInputs = nullptr;
+  int mNInputs = 0;
+  int mNOutputs = 0;
+  uint64_t mDisconnectedOutputs = 0;
+  int mStartIdx = 0;
+  int mNFrames = 0;
+
+  /** The block's generation in the high 32 bits, and the index of the next share to claim in the low 32 */
+  std::atomic<uint64_t> mJob{0};
+  /** Written by the audio thread only */
+  uint32_t mGeneration = 0;
+  std::atomic<void*> mpWorkgroup{nullptr};
+  std::atomic<int> mPending{0};
+  std::atomic<int> mNParked{0};
+  std::atomic<bool> mQuit{false};
+  std::mutex mMutex;
+  std::condition_variable mCV;
+};
+
+END_IPLUG_NAMESPACE
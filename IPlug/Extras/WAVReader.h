@@ -0,0 +1,182 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc WAVReader
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "fileread.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Reads the frames of a WAV file (16, 24 or 32 bit integer, or 32 or 64 bit float PCM, including WAVE_FORMAT_EXTENSIBLE) from a WDL_FileRead, converted to interleaved float.
+ * It doesn't own the file, so that the file can be closed and reopened between reads */
+class WAVReader
+{
+public:
+  /** Read the header, leaving the file at the first frame
+   * @return \c true if the file is a WAV file in one of the supported formats */
+  bool ReadHeader(WDL_FileRead& file)
+  {
+    uint8_t riff[12];
+
+    mNChans = 0;
+
+    if (file.Read(riff, 12) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+      return false;
+
+    bool hasFormat = false;
+    uint8_t header[8];
+
+    while (file.Read(header, 8) == 8)
+    {
+      const uint32_t size = ReadLE32(header + 4);
+      const WDL_FILEREAD_POSTYPE next = file.GetPosition() + size + (size & 1);
+
+      if (!memcmp(header, "fmt ", 4) && size >= 16)
+      {
+        uint8_t fmt[40] = {};
+
+        if (file.Read(fmt, std::min<int>(size, sizeof(fmt))) < 16)
+          return false;
+
+        uint16_t tag = ReadLE16(fmt);
+
+        if (tag == kWaveFormatExtensible && size >= 26)
+          tag = ReadLE16(fmt + 24); // the first two bytes of the subformat GUID
+
+        const int nChans = ReadLE16(fmt + 2);
+        mSampleRate = ReadLE32(fmt + 4);
+        mBlockAlign = ReadLE16(fmt + 12);
+        mBitsPerSample = ReadLE16(fmt + 14);
+        mIsFloat = tag == kWaveFormatFloat;
+
+        const bool supported = (tag == kWaveFormatPCM && (mBitsPerSample == 16 || mBitsPerSample == 24 || mBitsPerSample == 32))
+                            || (mIsFloat && (mBitsPerSample == 32 || mBitsPerSample == 64));
+
+        if (!supported || !nChans || mBlockAlign != nChans * (mBitsPerSample / 8))
+          return false;
+
+        mNChans = nChans;
+        hasFormat = true;
+      }
+      else if (!memcmp(header, "data", 4) && hasFormat)
+      {
+        mDataOffset = file.GetPosition();
+        mNFrames = std::min<int64_t>(size, file.GetSize() - mDataOffset) / mBlockAlign;
+        return true;
+      }
+
+      if (file.SetPosition(next))
+        break;
+    }
+
+    mNChans = 0;
+    return false;
+  }
+
+  /** @return The number of channels, or 0 if the header wasn't read */
+  int NChans() const { return mNChans; }
+
+  int64_t NFrames() const { return mNFrames; }
+
+  double GetSampleRate() const { return mSampleRate; }
+
+  /** Read and convert frames. A memory mapped file is converted straight from its view
+   * @param file The file the header was read from, or the same file reopened
+   * @param pDest Receives nFrames interleaved frames
+   * @return The number of frames read, fewer than nFrames at the end of the data */
+  int ReadFrames(WDL_FileRead& file, int64_t startFrame, int nFrames, float* pDest)
+  {
+    nFrames = static_cast<int>(std::max<int64_t>(std::min<int64_t>(nFrames, mNFrames - startFrame), 0));
+
+    const WDL_FILEREAD_POSTYPE offset = mDataOffset + startFrame * mBlockAlign;
+    int nBytes = nFrames * mBlockAlign;
+
+    if (!nBytes)
+      return 0;
+
+    if (offset + nBytes <= 0x7FFFFFFF)
+    {
+      if (const void* pMapped = file.GetMappedView(static_cast<int>(offset), &nBytes))
+      {
+        Convert(static_cast<const uint8_t*>(pMapped), (nBytes / mBlockAlign) * mNChans, pDest);
+        return nBytes / mBlockAlign;
+      }
+    }
+
+    mReadBuf.resize(nBytes);
+
+    if (file.SetPosition(offset))
+      return 0;
+
+    const int nRead = std::max(file.Read(mReadBuf.data(), nBytes), 0) / mBlockAlign;
+    Convert(mReadBuf.data(), nRead * mNChans, pDest);
+    return nRead;
+  }
+
+private:
+  void Convert(const uint8_t* pSrc, int nSamples, float* pDest) const
+  {
+    if (mIsFloat && mBitsPerSample == 32)
+      memcpy(pDest, pSrc, nSamples * sizeof(float));
+    else if (mIsFloat)
+    {
+      for (int i = 0; i < nSamples; i++, pSrc += 8)
+      {
+        double d;
+        memcpy(&d, pSrc, 8);
+        pDest[i] = static_cast<float>(d);
+      }
+    }
+    else if (mBitsPerSample == 16)
+    {
+      for (int i = 0; i < nSamples; i++, pSrc += 2)
+        pDest[i] = static_cast<int16_t>(ReadLE16(pSrc)) * (1.f / 32768.f);
+    }
+    else if (mBitsPerSample == 24)
+    {
+      for (int i = 0; i < nSamples; i++, pSrc += 3)
+        pDest[i] = (static_cast<int32_t>(pSrc[0] << 8 | pSrc[1] << 16 | static_cast<uint32_t>(pSrc[2]) << 24) >> 8) * (1.f / 8388608.f);
+    }
+    else
+    {
+      for (int i = 0; i < nSamples; i++, pSrc += 4)
+        pDest[i] = static_cast<float>(static_cast<int32_t>(ReadLE32(pSrc)) * (1. / 2147483648.));
+    }
+  }
+
+  static uint16_t ReadLE16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+  static uint32_t ReadLE32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24; }
+
+  static constexpr uint16_t kWaveFormatPCM = 1;
+  static constexpr uint16_t kWaveFormatFloat = 3;
+  static constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+
+  int mNChans = 0;
+  int64_t mNFrames = 0;
+  double mSampleRate = 0.;
+  int mBlockAlign = 0;
+  int mBitsPerSample = 0;
+  bool mIsFloat = false;
+  WDL_FILEREAD_POSTYPE mDataOffset = 0;
+  std::vector<uint8_t> mReadBuf;
+};
+
+END_IPLUG_NAMESPACE
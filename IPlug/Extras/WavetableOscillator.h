@@ -0,0 +1,320 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Band-limited wavetable oscillator, using per-octave mip-mapped tables that are built in the background and shared between voices
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugSIMD.h"
+#include "Oscillator.h"
+#include "SharedTable.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The waveforms WavetableBank can build */
+enum class EWavetableShape
+{
+  kSine = 0,
+  kSaw,
+  kSquare,
+  kTriangle,
+  kNumShapes
+};
+
+/** Per-octave mip-mapped band-limited tables for one waveform.
+ * Level 0 holds kMaxHarmonics harmonics, and each level above it holds half as many as the one below, down to a sine at the last level.
+ * A fundamental with normalized frequency f (cycles per sample) is played from the first level whose highest harmonic is below Nyquist, so the tables don't depend on the sample rate */
+template <typename T>
+class Wavetable
+{
+public:
+  static constexpr int kTableBits = 11;
+  static constexpr int kTableSize = 1 << kTableBits;
+  static constexpr int kMaxHarmonics = kTableSize / 2;
+  static constexpr int kNumLevels = kTableBits;
+
+  /** Build the tables for one of the standard shapes. This takes a few milliseconds, see WavetableBank to build them in the background */
+  explicit Wavetable(EWavetableShape shape)
+  {
+    std::vector<double> amps(kMaxHarmonics + 1, 0.);
+
+    for (int h = 1; h <= kMaxHarmonics; h++)
+    {
+      switch (shape)
+      {
+        case EWavetableShape::kSine: amps[h] = h == 1 ? 1. : 0.; break;
+        case EWavetableShape::kSaw: amps[h] = -2. / (PI * h); break; // rises from -1 to 1
+        case EWavetableShape::kSquare: amps[h] = (h & 1) ? 4. / (PI * h) : 0.; break;
+        case EWavetableShape::kTriangle: amps[h] = (h & 1) ? ((h & 2) ? -8. : 8.) / (PI * PI * h * h) : 0.; break;
+        default: break;
+      }
+    }
+
+    Build(amps);
+  }
+
+  /** Build the tables for a custom waveform
+   * @param amps The amplitude of each sine harmonic, amps[0] (DC) is ignored. Harmonics above kMaxHarmonics are dropped */
+  explicit Wavetable(const std::vector<double>& amps)
+  {
+    std::vector<double> padded(kMaxHarmonics + 1, 0.);
+
+    for (int h = 1; h < static_cast<int>(amps.size()) && h <= kMaxHarmonics; h++)
+      padded[h] = amps[h];
+
+    Build(padded);
+  }
+
+  /** @return kTableSize + 1 samples for a level, the last one repeats the first so that interpolation doesn't need to wrap */
+  const T* GetLevel(int level) const { return mData.data() + level * (kTableSize + 1); }
+
+  /** @param phaseIncr The fundamental in cycles per sample
+   * @return The level to play it from */
+  static int GetLevelForIncrement(double phaseIncr)
+  {
+    int level = 0;
+
+    while (level < kNumLevels - 1 && (kMaxHarmonics >> level) * phaseIncr > 0.5)
+      level++;
+
+    return level;
+  }
+
+private:
+  void Build(const std::vector<double>& amps)
+  {
+    std::vector<double> sinTable(kTableSize);
+    std::vector<double> acc(kTableSize, 0.);
+
+    for (int i = 0; i < kTableSize; i++)
+      sinTable[i] = std::sin(2. * PI * i / kTableSize);
+
+    mData.resize(kNumLevels * (kTableSize + 1));
+
+    // every level is a superset of the one above it, so build from the top down adding the harmonics each level gains
+    int nHarmonics = 0;
+
+    for (int level = kNumLevels - 1; level >= 0; level--)
+    {
+      const int levelHarmonics = kMaxHarmonics >> level;
+
+      for (int h = nHarmonics + 1; h <= levelHarmonics; h++)
+      {
+        if (amps[h] == 0.)
+          continue;
+
+        for (int i = 0; i < kTableSize; i++)
+          acc[i] += amps[h] * sinTable[(h * i) & (kTableSize - 1)];
+      }
+
+      nHarmonics = levelHarmonics;
+
+      T* pLevel = mData.data() + level * (kTableSize + 1);
+
+      for (int i = 0; i < kTableSize; i++)
+        pLevel[i] = T(acc[i]);
+
+      pLevel[kTableSize] = pLevel[0];
+    }
+  }
+
+  std::vector<T> mData;
+};
+
+/** Builds the standard Wavetable shapes on demand on a background thread, and hands the same tables to every oscillator (and plug-in instance) that asks for them, see SharedTable */
+template <typename T>
+class WavetableBank
+{
+public:
+  using TablePtr = typename SharedTable<Wavetable<T>, EWavetableShape>::TablePtr;
+
+  /** Start building a shape's tables if nobody has them yet. Takes a lock and may start a thread, so call it from the main thread (e.g. in the plug-in constructor) rather than the audio thread
+   * @return A future that becomes ready when the tables are built */
+  static std::shared_future<TablePtr> Request(EWavetableShape shape)
+  {
+    return SharedTable<Wavetable<T>, EWavetableShape>::Request(shape, [shape]() { return Wavetable<T>(shape); });
+  }
+};
+
+/** A band-limited wavetable oscillator. Each block is played from the mip-map level that suits the current frequency, with linear interpolation computed four samples at a time.
+ * The oscillator outputs silence until its tables have been built, so request the shapes a plug-in uses early with WavetableBank::Request()
+ * @see Wavetable WavetableBank */
+template <typename T>
+class WavetableOscillator : public IOscillator<T>
+{
+public:
+  using TablePtr = typename WavetableBank<T>::TablePtr;
+
+  WavetableOscillator(EWavetableShape shape = EWavetableShape::kSaw, double startPhase = 0., double startFreq = 1.)
+  : IOscillator<T>(startPhase, startFreq)
+  {
+    SetShape(shape);
+  }
+
+  /** Switch to one of the standard shapes. This doesn't wait for the tables to be built, but see WavetableBank::Request() for which thread to call it on */
+  void SetShape(EWavetableShape shape)
+  {
+    mPending = WavetableBank<T>::Request(shape);
+    CheckPending();
+  }
+
+  /** Switch to custom tables, which can be shared between oscillators */
+  void SetWavetable(TablePtr pTable)
+  {
+    mPending = std::shared_future<TablePtr>();
+    mTable = std::move(pTable);
+  }
+
+  /** @return \c true if the tables are built, and the oscillator isn't outputting silence */
+  bool IsReady()
+  {
+    CheckPending();
+    return mTable != nullptr;
+  }
+
+  inline T Process(double freqHz) override
+  {
+    IOscillator<T>::SetFreqCPS(freqHz);
+
+    T output = 0.;
+    ProcessBlock(&output, 1);
+
+    return output;
+  }
+
+  /** Fill a buffer at the current frequency, see IOscillator::SetFreqCPS()
+   * @param pOutput Receives nFrames samples
+   * @param nFrames The number of samples to output */
+  void ProcessBlock(T* pOutput, int nFrames)
+  {
+    const double phaseIncr = IOscillator<T>::mPhaseIncr;
+    const double wrapped = IOscillator<T>::mPhase - std::floor(IOscillator<T>::mPhase);
+    uint32_t phase = static_cast<uint32_t>(wrapped * kPhaseScale);
+    const uint32_t incr = static_cast<uint32_t>(static_cast<int64_t>(std::floor(phaseIncr * kPhaseScale))); // negative frequencies wrap round
+
+    CheckPending();
+
+    if (mTable)
+      RenderTable(pOutput, mTable->GetLevel(Wavetable<T>::GetLevelForIncrement(std::fabs(phaseIncr))), nFrames, phase, incr);
+    else
+    {
+      std::fill_n(pOutput, nFrames, T(0));
+      phase += incr * static_cast<uint32_t>(nFrames);
+    }
+
+    IOscillator<T>::mPhase = phase / kPhaseScale;
+  }
+
+private:
+  static constexpr double kPhaseScale = 4294967296.; // 2^32, the phase is a 32 bit fixed point fraction of a cycle
+  static constexpr int kFracBits = 32 - Wavetable<T>::kTableBits;
+  static constexpr uint32_t kFracMask = (1u << kFracBits) - 1;
+
+  void CheckPending()
+  {
+    if (mPending.valid() && mPending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+      mTable = mPending.get();
+      mPending = std::shared_future<TablePtr>();
+    }
+  }
+
+  template <typename U>
+  static void RenderTable(U* pOutput, const U* pTable, int nFrames, uint32_t& phase, uint32_t incr)
+  {
+    const U fracScale = U(1) / U(kFracMask + 1);
+
+    for (int s = 0; s < nFrames; s++, phase += incr)
+    {
+      const uint32_t idx = phase >> kFracBits;
+      const U frac = static_cast<U>(phase & kFracMask) * fracScale;
+      pOutput[s] = pTable[idx] + frac * (pTable[idx + 1] - pTable[idx]);
+    }
+  }
+
+  static void RenderTable(float* pOutput, const float* pTable, int nFrames, uint32_t& phase, uint32_t incr)
+  {
+    int s = 0;
+
+#if defined IPLUG_SIMD_SSE2
+    const __m128i incr4 = _mm_set1_epi32(static_cast<int>(incr * 4u));
+    const __m128i fracMask = _mm_set1_epi32(static_cast<int>(kFracMask));
+    const __m128 fracScale = _mm_set1_ps(1.f / (kFracMask + 1));
+    __m128i phases = _mm_setr_epi32(static_cast<int>(phase), static_cast<int>(phase + incr), static_cast<int>(phase + 2u * incr), static_cast<int>(phase + 3u * incr));
+    alignas(16) int32_t idx[4];
+
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      _mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_srli_epi32(phases, kFracBits));
+      const __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(phases, fracMask)), fracScale);
+      const __m128 a = _mm_setr_ps(pTable[idx[0]], pTable[idx[1]], pTable[idx[2]], pTable[idx[3]]);
+      const __m128 b = _mm_setr_ps(pTable[idx[0] + 1], pTable[idx[1] + 1], pTable[idx[2] + 1], pTable[idx[3] + 1]);
+      _mm_storeu_ps(pOutput + s, _mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a))));
+      phases = _mm_add_epi32(phases, incr4);
+    }
+#elif defined IPLUG_SIMD_NEON
+    const uint32x4_t incr4 = vdupq_n_u32(incr * 4u);
+    const uint32x4_t fracMask = vdupq_n_u32(kFracMask);
+    const float32x4_t fracScale = vdupq_n_f32(1.f / (kFracMask + 1));
+    const uint32_t start[4] = { phase, phase + incr, phase + 2u * incr, phase + 3u * incr };
+    uint32x4_t phases = vld1q_u32(start);
+    uint32_t idx[4];
+
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      vst1q_u32(idx, vshrq_n_u32(phases, kFracBits));
+      const float32x4_t frac = vmulq_f32(vcvtq_f32_u32(vandq_u32(phases, fracMask)), fracScale);
+      const float aVals[4] = { pTable[idx[0]], pTable[idx[1]], pTable[idx[2]], pTable[idx[3]] };
+      const float bVals[4] = { pTable[idx[0] + 1], pTable[idx[1] + 1], pTable[idx[2] + 1], pTable[idx[3] + 1] };
+      const float32x4_t a = vld1q_f32(aVals);
+      vst1q_f32(pOutput + s, vmlaq_f32(a, frac, vsubq_f32(vld1q_f32(bVals), a)));
+      phases = vaddq_u32(phases, incr4);
+    }
+#elif defined IPLUG_SIMD_WASM
+    const v128_t incr4 = wasm_i32x4_splat(static_cast<int32_t>(incr * 4u));
+    const v128_t fracMask = wasm_i32x4_splat(static_cast<int32_t>(kFracMask));
+    const v128_t fracScale = wasm_f32x4_splat(1.f / (kFracMask + 1));
+    v128_t phases = wasm_u32x4_make(phase, phase + incr, phase + 2u * incr, phase + 3u * incr);
+
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      const v128_t idx = wasm_u32x4_shr(phases, kFracBits);
+      const uint32_t i0 = wasm_u32x4_extract_lane(idx, 0), i1 = wasm_u32x4_extract_lane(idx, 1), i2 = wasm_u32x4_extract_lane(idx, 2), i3 = wasm_u32x4_extract_lane(idx, 3);
+      const v128_t frac = wasm_f32x4_mul(wasm_f32x4_convert_i32x4(wasm_v128_and(phases, fracMask)), fracScale);
+      const v128_t a = wasm_f32x4_make(pTable[i0], pTable[i1], pTable[i2], pTable[i3]);
+      const v128_t b = wasm_f32x4_make(pTable[i0 + 1], pTable[i1 + 1], pTable[i2 + 1], pTable[i3 + 1]);
+      wasm_v128_store(pOutput + s, wasm_f32x4_add(a, wasm_f32x4_mul(frac, wasm_f32x4_sub(b, a))));
+      phases = wasm_i32x4_add(phases, incr4);
+    }
+#endif
+
+    phase += incr * static_cast<uint32_t>(s);
+    RenderTable<float>(pOutput + s, pTable, nFrames - s, phase, incr);
+  }
+
+  TablePtr mTable;
+  std::shared_future<TablePtr> mPending;
+};
+
+END_IPLUG_NAMESPACE
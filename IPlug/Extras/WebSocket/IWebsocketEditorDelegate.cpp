@@ -65,7 +65,8 @@ bool IWebsocketEditorDelegate::OnWebsocketData(int connIdx, void* pData, size_t
 void IWebsocketEditorDelegate::SendMidiMsgFromUI(const IMidiMsg& msg)
 {
   IByteChunk data;
-  data.PutStr("SMMFD");
+  const uint8_t type = kSMMFD;
+  data.Put(&type);
   data.Put(&msg.mStatus);
   data.Put(&msg.mData1);
   data.Put(&msg.mData2);
@@ -79,9 +80,10 @@ void IWebsocketEditorDelegate::SendMidiMsgFromUI(const IMidiMsg& msg)
 void IWebsocketEditorDelegate::SendSysexMsgFromUI(const ISysEx& msg)
 {
   IByteChunk data;
-  data.PutStr("SSMFD");
+  const uint8_t type = kSSMFD;
+  data.Put(&type);
   data.Put(&msg.mSize);
-  data.PutBytes(&msg.mData, msg.mSize);
+  data.PutBytes(msg.mData, msg.mSize);
   
   // Server side UI edit, send to clients
   SendDataToConnection(-1, data.GetData(), data.Size());
@@ -92,9 +94,9 @@ void IWebsocketEditorDelegate::SendSysexMsgFromUI(const ISysEx& msg)
 void IWebsocketEditorDelegate::SendArbitraryMsgFromUI(int msgTag, int ctrlTag, int dataSize, const void* pData)
 {
   IByteChunk data;
-  data.PutStr("SSMFD");
+  const uint8_t type = kSAMFD;
+  data.Put(&type);
   data.Put(&msgTag);
-  data.Put(&ctrlTag);
   data.Put(&dataSize);
   data.PutBytes(pData, dataSize);
   
@@ -123,11 +125,12 @@ void IWebsocketEditorDelegate::SendParameterValueFromUI(int paramIdx, double val
 void IWebsocketEditorDelegate::SendControlValueFromDelegate(int ctrlTag, double normalizedValue)
 {
   IByteChunk data;
-  data.PutStr("SCVFD");
+  const uint8_t type = kSCVFD;
+  data.Put(&type);
   data.Put(&ctrlTag);
   data.Put(&normalizedValue);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  SendDataToConnection(-1, data.GetData(), data.Size(), -1, ESendPolicy::kCoalesce, MakeCoalesceKey(kSCVFD, ctrlTag));
   
   IGEditorDelegate::SendControlValueFromDelegate(ctrlTag, normalizedValue);
 }
@@ -135,13 +138,14 @@ void IWebsocketEditorDelegate::SendControlValueFromDelegate(int ctrlTag, double
 void IWebsocketEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
 {
   IByteChunk data;
-  data.PutStr("SCMFD");
+  const uint8_t type = kSCMFD;
+  data.Put(&type);
   data.Put(&ctrlTag);
   data.Put(&msgTag);
   data.Put(&dataSize);
   data.PutBytes(pData, dataSize);
   
-  SendDataToConnection(-1, data.GetData(), data.Size());
+  SendDataToConnection(-1, data.GetData(), data.Size(), -1, mControlMsgPolicy, MakeCoalesceKey(kSCMFD, ctrlTag, msgTag));
   
   IGEditorDelegate::SendControlMsgFromDelegate(ctrlTag, msgTag, dataSize, pData);
 }
@@ -149,7 +153,8 @@ void IWebsocketEditorDelegate::SendControlMsgFromDelegate(int ctrlTag, int msgTa
 void IWebsocketEditorDelegate::SendArbitraryMsgFromDelegate(int msgTag, int dataSize, const void* pData)
 {
   IByteChunk data;
-  data.PutStr("SAMFD");
+  const uint8_t type = kSAMFD;
+  data.Put(&type);
   data.Put(&msgTag);
   data.Put(&dataSize);
   data.PutBytes(pData, dataSize);
@@ -162,7 +167,8 @@ void IWebsocketEditorDelegate::SendArbitraryMsgFromDelegate(int msgTag, int data
 void IWebsocketEditorDelegate::SendMidiMsgFromDelegate(const IMidiMsg& msg)
 {
   IByteChunk data;
-  data.PutStr("SMMFD");
+  const uint8_t type = kSMMFD;
+  data.Put(&type);
   data.Put(&msg.mStatus);
   data.Put(&msg.mData1);
   data.Put(&msg.mData2);
@@ -175,7 +181,8 @@ void IWebsocketEditorDelegate::SendMidiMsgFromDelegate(const IMidiMsg& msg)
 void IWebsocketEditorDelegate::SendSysexMsgFromDelegate(const ISysEx& msg)
 {
   IByteChunk data;
-  data.PutStr("SSMFD");
+  const uint8_t type = kSSMFD;
+  data.Put(&type);
   data.Put(&msg.mSize);
   data.PutBytes(msg.mData, msg.mSize);
   
@@ -217,8 +224,9 @@ void IWebsocketEditorDelegate::ProcessWebsocketQueue()
 void IWebsocketEditorDelegate::DoSPVFDToClients(int paramIdx, double value, int excludeIdx)
 {
   IByteChunk data;
-  data.PutStr("SPVFD");
+  const uint8_t type = kSPVFD;
+  data.Put(&type);
   data.Put(&paramIdx);
   data.Put(&value);
-  SendDataToConnection(-1, data.GetData(), data.Size(), excludeIdx);
+  SendDataToConnection(-1, data.GetData(), data.Size(), excludeIdx, ESendPolicy::kCoalesce, MakeCoalesceKey(kSPVFD, paramIdx));
 }
@@ -12,11 +12,28 @@
 
 BEGIN_IPLUG_NAMESPACE
 
-/** An IEditorDelegate base class that embeds a websocket server ... */
+/** An IEditorDelegate base class that embeds a websocket server ...
+ * Messages to the clients are binary frames starting with a one byte EWebsocketMsgType, followed by the message's fields in little endian order:
+ * - kSPVFD: int32 paramIdx, float64 value
+ * - kSCVFD: int32 ctrlTag, float64 value
+ * - kSCMFD: int32 ctrlTag, int32 msgTag, int32 dataSize, data
+ * - kSAMFD: int32 msgTag, int32 dataSize, data
+ * - kSMMFD: uint8 status, uint8 data1, uint8 data2
+ * - kSSMFD: int32 dataSize, data */
 class IWebsocketEditorDelegate : public IGEditorDelegate, public IWebsocketServer
 {
 public:
   static constexpr int MAX_NUM_CLIENTS = 4;
+
+  enum EWebsocketMsgType : uint8_t
+  {
+    kSPVFD = 0,
+    kSCVFD,
+    kSCMFD,
+    kSAMFD,
+    kSMMFD,
+    kSSMFD
+  };
   
   IWebsocketEditorDelegate(int nParams);
   virtual ~IWebsocketEditorDelegate();
@@ -44,9 +61,20 @@ public:
   
   // Call this repeatedly in order to handle incoming data
   void ProcessWebsocketQueue();
+
+  /** Set how control messages are queued for the clients. The default, ESendPolicy::kCoalesce, replaces a queued message with the same control and message tags, which suits meter data.
+   * ESendPolicy::kQueue sends every message, unless the client falls too far behind */
+  void SetControlMsgSendPolicy(ESendPolicy policy) { mControlMsgPolicy = policy; }
   
 private:
   void DoSPVFDToClients(int paramIdx, double value, int excludeIdx);
+
+  static uint64_t MakeCoalesceKey(EWebsocketMsgType type, int tag, int msgTag = 0)
+  {
+    return (static_cast<uint64_t>(type) << 56) | (static_cast<uint64_t>(tag & 0xFFFFFFF) << 28) | static_cast<uint64_t>(msgTag & 0xFFFFFFF);
+  }
+
+  ESendPolicy mControlMsgPolicy = ESendPolicy::kCoalesce;
   
   struct ParamTupleCX
   {
@@ -19,6 +19,9 @@ IWebsocketServer::IWebsocketServer()
 IWebsocketServer::~IWebsocketServer()
 {
   DestroyServer();
+
+  WDL_MutexLock lock(&mMutex);
+  mConnections.Empty(true);
 }
 
 bool IWebsocketServer::CreateServer(const char* DOCUMENT_ROOT, const char* PORT)
@@ -78,14 +81,23 @@ int IWebsocketServer::NClients()
   return mConnections.GetSize();
 }
 
-bool IWebsocketServer::SendTextToConnection(int idx, const char* str, int exclude)
+int IWebsocketServer::NDroppedMessages(int idx)
+{
+  WDL_MutexLock lock(&mMutex);
+
+  Connection* pConnection = mConnections.Get(idx);
+
+  return pConnection ? pConnection->NDroppedMessages() : 0;
+}
+
+bool IWebsocketServer::SendTextToConnection(int idx, const char* str, int exclude, ESendPolicy policy, uint64_t coalesceKey)
 {
-  return DoSendToConnection(idx, MG_WEBSOCKET_OPCODE_TEXT, str, strlen(str), exclude);
+  return DoSendToConnection(idx, MG_WEBSOCKET_OPCODE_TEXT, str, strlen(str), exclude, policy, coalesceKey);
 }
 
-bool IWebsocketServer::SendDataToConnection(int idx, void* pData, size_t sizeInBytes, int exclude)
+bool IWebsocketServer::SendDataToConnection(int idx, const void* pData, size_t sizeInBytes, int exclude, ESendPolicy policy, uint64_t coalesceKey)
 {
-  return DoSendToConnection(idx, MG_WEBSOCKET_OPCODE_BINARY, (const char*) pData, sizeInBytes, exclude);
+  return DoSendToConnection(idx, MG_WEBSOCKET_OPCODE_BINARY, (const char*) pData, sizeInBytes, exclude, policy, coalesceKey);
 }
 
 void IWebsocketServer::OnWebsocketReady(int idx)
@@ -102,39 +114,39 @@ bool IWebsocketServer::OnWebsocketData(int idx, void* pData, size_t dataSize)
   return true; // return true to keep the connection open
 }
 
-bool IWebsocketServer::DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude)
+bool IWebsocketServer::DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude, ESendPolicy policy, uint64_t coalesceKey)
 {
-  int nclients = NClients();
-  
-  std::function<bool(int)> sendFunc = [&](int connIdx) {
-    WDL_MutexLock lock(&mMutex);
-    mg_connection* pConn = mConnections.Get(connIdx);
-    
-    if(pConn) {
-      if(mg_websocket_write(pConn, opcode, pData, sizeInBytes))
-        return true;
-    }
-    
-    return false;
-  };
-  
-  bool success = false;
-  
-  if(idx == -1)
+  // only the queues are touched here, the writes happen on the connections' sender threads
+  WDL_MutexLock lock(&mMutex);
+
+  if (idx != -1)
   {
-    for(int i=0;i<nclients;i++) // TODO: sending to self?
-    {
-      if(i != exclude)
-        success &= sendFunc(i);
-    }
+    Connection* pConnection = mConnections.Get(idx);
+    return pConnection && pConnection->Enqueue(opcode, pData, sizeInBytes, policy, coalesceKey);
   }
-  else {
-    sendFunc(idx);
+
+  bool success = true;
+
+  for (int i = 0; i < mConnections.GetSize(); i++)
+  {
+    if (i != exclude)
+      success &= mConnections.Get(i)->Enqueue(opcode, pData, sizeInBytes, policy, coalesceKey);
   }
-  
+
   return success;
 }
 
+int IWebsocketServer::FindConnection(const mg_connection* pConn)
+{
+  for (int i = 0; i < mConnections.GetSize(); i++)
+  {
+    if (mConnections.Get(i)->GetConnection() == pConn)
+      return i;
+  }
+
+  return -1;
+}
+
 // CivetWebSocketHandler
 // These methods are called on the server thread
 bool IWebsocketServer::handleConnection(CivetServer* pServer, const struct mg_connection* pConn)
@@ -149,7 +161,7 @@ void IWebsocketServer::handleReadyState(CivetServer* pServer, struct mg_connecti
 {
   WDL_MutexLock lock(&mMutex);
   
-  mConnections.Add(pConn);
+  mConnections.Add(new Connection(pConn, mMaxQueuedMessages));
   
   DBGMSG("WS ready NClients %i\n", NClients());
   
@@ -164,11 +176,11 @@ bool IWebsocketServer::handleData(CivetServer* pServer, struct mg_connection* pC
   
   if(*firstByte == 129) // TODO: check that
   {
-    return OnWebsocketText(mConnections.Find(pConn), pData, dataSize);
+    return OnWebsocketText(FindConnection(pConn), pData, dataSize);
   }
   else if(*firstByte == 130) // TODO: check that
   {
-    return OnWebsocketData(mConnections.Find(pConn), (void*) pData, dataSize);
+    return OnWebsocketData(FindConnection(pConn), (void*) pData, dataSize);
   }
   
   return true;
@@ -176,11 +188,93 @@ bool IWebsocketServer::handleData(CivetServer* pServer, struct mg_connection* pC
 
 void IWebsocketServer::handleClose(CivetServer* pServer, const struct mg_connection* pConn)
 {
-  WDL_MutexLock lock(&mMutex);
+  Connection* pConnection = nullptr;
 
-  mConnections.DeletePtr(pConn);
-  
-  DBGMSG("WS closed NClients %i\n", NClients());
+  {
+    WDL_MutexLock lock(&mMutex);
+
+    const int idx = FindConnection(pConn);
+    pConnection = mConnections.Get(idx);
+    mConnections.Delete(idx);
+
+    DBGMSG("WS closed NClients %i\n", mConnections.GetSize());
+  }
+
+  // joins the sender thread, which may be finishing a write, so don't hold the lock
+  delete pConnection;
+}
+
+IWebsocketServer::Connection::Connection(mg_connection* pConn, int maxQueuedMessages)
+: mConn(pConn)
+, mMaxQueuedMessages(maxQueuedMessages)
+{
+  mThread = std::thread(&Connection::SenderLoop, this);
+}
+
+IWebsocketServer::Connection::~Connection()
+{
+  {
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    mClosing = true;
+  }
+
+  mQueueCV.notify_one();
+  mThread.join();
+}
+
+bool IWebsocketServer::Connection::Enqueue(int opcode, const char* pData, size_t sizeInBytes, ESendPolicy policy, uint64_t coalesceKey)
+{
+  std::unique_lock<std::mutex> lock(mQueueMutex);
+
+  if (policy == ESendPolicy::kCoalesce)
+  {
+    for (auto& msg : mQueue)
+    {
+      if (msg.mCoalesce && msg.mKey == coalesceKey && msg.mOpcode == opcode)
+      {
+        msg.mData.assign(pData, pData + sizeInBytes);
+        return true;
+      }
+    }
+  }
+  else if (policy == ESendPolicy::kDropIfBusy && !mQueue.empty())
+  {
+    mNDropped++;
+    return false;
+  }
+
+  if (static_cast<int>(mQueue.size()) >= mMaxQueuedMessages)
+  {
+    mNDropped++;
+    return false;
+  }
+
+  mQueue.push_back({opcode, coalesceKey, policy == ESendPolicy::kCoalesce, std::vector<char>(pData, pData + sizeInBytes)});
+  lock.unlock();
+  mQueueCV.notify_one();
+
+  return true;
+}
+
+void IWebsocketServer::Connection::SenderLoop()
+{
+  std::unique_lock<std::mutex> lock(mQueueMutex);
+
+  while (true)
+  {
+    mQueueCV.wait(lock, [this]() { return mClosing || !mQueue.empty(); });
+
+    if (mClosing)
+      break;
+
+    QueuedMessage msg = std::move(mQueue.front());
+    mQueue.pop_front();
+
+    // a slow client blocks here, while messages for it keep being queued or coalesced
+    lock.unlock();
+    mg_websocket_write(mConn, msg.mOpcode, msg.mData.data(), msg.mData.size());
+    lock.lock();
+  }
 }
 
 std::unique_ptr<CivetServer> IWebsocketServer::sServer;
@@ -8,9 +8,17 @@
  ==============================================================================
 */
 
+#pragma once
+
 #include "CivetServer.h"
+#include <condition_variable>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "ptrlist.h"
 #include "IPlugLogger.h"
@@ -24,9 +32,21 @@
 
 BEGIN_IPLUG_NAMESPACE
 
+/** A websocket server shared between plug-in instances. Each client connection has its own bounded send queue, emptied by a sender thread for that connection,
+ * so sending never blocks the calling thread and a slow client only delays its own messages */
 class IWebsocketServer : public CivetWebSocketHandler
 {
 public:
+  static constexpr int kDefaultMaxQueuedMessages = 256;
+
+  /** What to do with a message that is sent to a client */
+  enum class ESendPolicy
+  {
+    kQueue,      // queue it, dropping it if the client's queue is full
+    kDropIfBusy, // only queue it if the client's queue is empty, for high rate data where only the latest value matters
+    kCoalesce    // replace the queued message with the same key if there is one, otherwise queue it
+  };
+
   IWebsocketServer();
   virtual ~IWebsocketServer();
     
@@ -40,10 +60,21 @@ public:
   void GetURL(WDL_String& url);
 
   int NClients();
+
+  /** Set the size of each client's send queue. Applies to clients that connect afterwards */
+  void SetMaxQueuedMessages(int maxMessages) { mMaxQueuedMessages = maxMessages; }
+
+  /** @return The number of messages that have been dropped for a client, because its queue was full */
+  int NDroppedMessages(int idx);
+
+  /** Queue text for a client, or all clients if idx is -1. The text is sent on the client's sender thread
+   * @return \c true if the text was queued for all the clients */
+  bool SendTextToConnection(int idx, const char* str, int exclude = -1, ESendPolicy policy = ESendPolicy::kQueue, uint64_t coalesceKey = 0);
   
-  bool SendTextToConnection(int idx, const char* str, int exclude = -1);
-  
-  bool SendDataToConnection(int idx, void* pData, size_t sizeInBytes, int exclude = -1);
+  /** Queue binary data for a client, or all clients if idx is -1. The data is copied and sent on the client's sender thread
+   * @param coalesceKey Identifies the messages that replace each other with ESendPolicy::kCoalesce
+   * @return \c true if the data was queued for all the clients */
+  bool SendDataToConnection(int idx, const void* pData, size_t sizeInBytes, int exclude = -1, ESendPolicy policy = ESendPolicy::kQueue, uint64_t coalesceKey = 0);
   
   virtual void OnWebsocketReady(int idx);
   
@@ -52,7 +83,44 @@ public:
   virtual bool OnWebsocketData(int idx, void* pData, size_t dataSize);
   
 private:
-  bool DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude);
+  struct QueuedMessage
+  {
+    int mOpcode;
+    uint64_t mKey;
+    bool mCoalesce;
+    std::vector<char> mData;
+  };
+
+  class Connection
+  {
+  public:
+    Connection(mg_connection* pConn, int maxQueuedMessages);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool Enqueue(int opcode, const char* pData, size_t sizeInBytes, ESendPolicy policy, uint64_t coalesceKey);
+
+    mg_connection* GetConnection() const { return mConn; }
+    int NDroppedMessages() const { return mNDropped; }
+
+  private:
+    void SenderLoop();
+
+    mg_connection* mConn;
+    const int mMaxQueuedMessages;
+    int mNDropped = 0;
+    bool mClosing = false;
+    std::deque<QueuedMessage> mQueue;
+    std::mutex mQueueMutex;
+    std::condition_variable mQueueCV;
+    std::thread mThread;
+  };
+
+  bool DoSendToConnection(int idx, int opcode, const char* pData, size_t sizeInBytes, int exclude, ESendPolicy policy, uint64_t coalesceKey);
+
+  int FindConnection(const mg_connection* pConn);
   
   // CivetWebSocketHandler
   bool handleConnection(CivetServer* pServer, const struct mg_connection* pConn) override;
@@ -63,7 +131,8 @@ private:
   
   void handleClose(CivetServer* pServer, const struct mg_connection* pConn) override;
   
-  WDL_PtrList<mg_connection> mConnections;
+  WDL_PtrList<Connection> mConnections;
+  int mMaxQueuedMessages = kDefaultMaxQueuedMessages;
   static std::unique_ptr<CivetServer> sServer;
   static int sInstances;
 
@@ -12,6 +12,7 @@ See LICENSE.txt for  more info.
 #include "IPlugPaths.h"
 #include <string>
 #include <windows.h>
+#include <Shlwapi.h>
 #include <cassert>
 
 using namespace iplug;
@@ -19,11 +20,43 @@ using namespace Microsoft::WRL;
 
 IWebView::IWebView(bool opaque)
 {
+  GetNumInstances()++;
 }
 
 IWebView::~IWebView()
 {
   CloseWebView();
+
+  if (--GetNumInstances() == 0)
+    ClearPool();
+}
+
+// UTF8ToUTF16() is limited to IPLUG_WIN_MAX_WIDE_PATH, which scripts and batches of messages can exceed
+static std::wstring UTF8ToWideString(const char* utf8Str)
+{
+  const int requiredSize = MultiByteToWideChar(CP_UTF8, 0, utf8Str, -1, NULL, 0);
+
+  if (requiredSize <= 0)
+    return std::wstring();
+
+  std::wstring wideStr(requiredSize, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, utf8Str, -1, &wideStr[0], requiredSize);
+  wideStr.resize(requiredSize - 1);
+  return wideStr;
+}
+
+// The host that resource pack requests are sent to, see SetResourcePack()
+static const char* kResourcePackURL = "https://iplug.localhost/";
+
+// A hidden window that parked web views are moved to, since a WebView2 controller always needs a parent
+static HWND GetParkingWindow()
+{
+  static HWND sParkingWindow = nullptr;
+
+  if (!sParkingWindow || !IsWindow(sParkingWindow))
+    sParkingWindow = CreateWindowExW(0, L"STATIC", L"", WS_POPUP, 0, 0, 0, 0, NULL, NULL, NULL, NULL);
+
+  return sParkingWindow;
 }
 
 typedef HRESULT(*TCCWebView2EnvWithOptions)(
@@ -34,6 +67,9 @@ typedef HRESULT(*TCCWebView2EnvWithOptions)(
 
 void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, float scale)
 {
+  if (AdoptWebView(pParent, x, y, w, h, scale))
+    return nullptr;
+
   HWND hWnd = (HWND) pParent;
 
   x *= scale;
@@ -56,6 +92,7 @@ void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, f
 
       Callback<ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler>(
         [&, hWnd, x, y, w, h](HRESULT result, ICoreWebView2Environment* env) -> HRESULT {
+          mWebViewEnv = env;
           env->CreateCoreWebView2Controller(hWnd,
             Callback<ICoreWebView2CreateCoreWebView2ControllerCompletedHandler>(
               [&, hWnd, x, y, w, h](HRESULT result, ICoreWebView2Controller* controller) -> HRESULT {
@@ -71,36 +108,19 @@ void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, f
                 Settings->put_IsWebMessageEnabled(TRUE);
 
                 // this script adds a function IPlugSendMsg that is used to call the platform webview messaging function in JS
-                mWebViewWnd->AddScriptToExecuteOnDocumentCreated(L"function IPlugSendMsg(m) {window.chrome.webview.postMessage(m)};",
+                // and a handler for the buffers sent by PostSharedBuffer()
+                mWebViewWnd->AddScriptToExecuteOnDocumentCreated(L"function IPlugSendMsg(m) {window.chrome.webview.postMessage(m)};"
+                  L"window.chrome.webview.addEventListener('sharedbufferreceived', function(e) { var b = e.getBuffer(); var m = e.additionalData;"
+                  L"for (var i = 0; i < m.length; i++) { var v = new Uint8Array(b, m[i][3], m[i][4]); if (m[i][0] == 0) SCMFD(m[i][1], m[i][2], m[i][4], v); else SAMFD(m[i][1], m[i][4], v); } });",
                   Callback<ICoreWebView2AddScriptToExecuteOnDocumentCreatedCompletedHandler>(
                     [this](HRESULT error, PCWSTR id) -> HRESULT {
                       return S_OK;
                     }).Get());
 
-                mWebViewWnd->add_WebMessageReceived(
-                  Callback<ICoreWebView2WebMessageReceivedEventHandler>(
-                    [this](ICoreWebView2* sender, ICoreWebView2WebMessageReceivedEventArgs* args) {
-                      wil::unique_cotaskmem_string jsonString;
-                      args->get_WebMessageAsJson(&jsonString);
-                      std::wstring jsonWString = jsonString.get();
-                      WDL_String cStr;
-                      UTF16ToUTF8(cStr, jsonWString.c_str());
-                      OnMessageFromWebView(cStr.Get());
-                      return S_OK;
-                    }).Get(), &mWebMessageReceivedToken);
-
-                mWebViewWnd->add_NavigationCompleted(
-                  Callback<ICoreWebView2NavigationCompletedEventHandler>(
-                    [this](ICoreWebView2* sender, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT {
-                      BOOL success;
-                      args->get_IsSuccess(&success);
-                      if (success)
-                      {
-                        OnWebContentLoaded();
-                      }
-                      return S_OK;
-                    })
-                  .Get(), &mNavigationCompletedToken);
+                if (mResourcePack)
+                  mWebViewWnd->AddWebResourceRequestedFilter(UTF8ToWideString(kResourcePackURL).append(L"*").c_str(), COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+
+                AddWebViewEventHandlers();
 
                 mWebViewCtrlr->put_Bounds({ (LONG)x, (LONG)y, (LONG)(x + w), (LONG)(y + h) });
                 OnWebViewReady();
@@ -113,25 +133,150 @@ void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, f
   return nullptr;
 }
 
-void IWebView::CloseWebView()
+void IWebView::AddWebViewEventHandlers()
 {
-  if (mWebViewCtrlr.get() != nullptr)
+  mWebViewWnd->add_WebMessageReceived(
+    Callback<ICoreWebView2WebMessageReceivedEventHandler>(
+      [this](ICoreWebView2* sender, ICoreWebView2WebMessageReceivedEventArgs* args) {
+        wil::unique_cotaskmem_string jsonString;
+        args->get_WebMessageAsJson(&jsonString);
+        std::wstring jsonWString = jsonString.get();
+        WDL_String cStr;
+        UTF16ToUTF8(cStr, jsonWString.c_str());
+        OnMessageFromWebView(cStr.Get());
+        return S_OK;
+      }).Get(), &mWebMessageReceivedToken);
+
+  mWebViewWnd->add_NavigationCompleted(
+    Callback<ICoreWebView2NavigationCompletedEventHandler>(
+      [this](ICoreWebView2* sender, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT {
+        BOOL success;
+        args->get_IsSuccess(&success);
+        if (success)
+        {
+          OnWebContentLoaded();
+        }
+        return S_OK;
+      })
+    .Get(), &mNavigationCompletedToken);
+
+  if (mResourcePack)
   {
-    mWebViewCtrlr->Close();
-    mWebViewCtrlr = nullptr;
-    mWebViewWnd = nullptr;
+    mWebViewWnd->add_WebResourceRequested(
+      Callback<ICoreWebView2WebResourceRequestedEventHandler>(
+        [this](ICoreWebView2* sender, ICoreWebView2WebResourceRequestedEventArgs* args) -> HRESULT {
+          return OnResourcePackRequest(args);
+        }).Get(), &mWebResourceRequestedToken);
   }
+}
+
+void IWebView::RemoveWebViewEventHandlers()
+{
+  mWebViewWnd->remove_WebMessageReceived(mWebMessageReceivedToken);
+  mWebViewWnd->remove_NavigationCompleted(mNavigationCompletedToken);
+
+  if (mResourcePack)
+    mWebViewWnd->remove_WebResourceRequested(mWebResourceRequestedToken);
+}
+
+void IWebView::CloseWebView()
+{
+  if (!ParkWebView() && mWebViewCtrlr.get() != nullptr)
+    mWebViewCtrlr->Close();
+
+  mWebViewCtrlr = nullptr;
+  mWebViewWnd = nullptr;
+  mWebViewEnv = nullptr;
 
   if (mDLLHandle)
   {
     FreeLibrary(mDLLHandle);
     mDLLHandle = nullptr;
   }
+
+  mLoadedKey.clear();
+  mReused = false;
+  mUnparked = false;
+}
+
+bool IWebView::ParkWebView()
+{
+  if (!mWebViewCtrlr || !mWebViewWnd || mLoadedKey.empty() || GetPoolSize() == 0)
+    return false;
+
+  TrimPool(GetPoolSize() - 1);
+  EvaluateJavaScript("if (window.IPlugOnPark) IPlugOnPark();");
+  RemoveWebViewEventHandlers();
+
+  mWebViewCtrlr->put_IsVisible(FALSE);
+  mWebViewCtrlr->put_ParentWindow(GetParkingWindow());
+
+  ParkedWebView parked;
+  parked.mPoolKey = GetPoolKey();
+  parked.mLoadedKey = mLoadedKey;
+  parked.mWebViewEnv = std::move(mWebViewEnv);
+  parked.mWebViewCtrlr = std::move(mWebViewCtrlr);
+  parked.mWebViewWnd = std::move(mWebViewWnd);
+  // the loader stays loaded while the web view it created is open
+  parked.mDLLHandle = mDLLHandle;
+  mDLLHandle = nullptr;
+
+  GetPool().push_back(std::move(parked));
+  return true;
+}
+
+void* IWebView::AdoptWebView(void* pParent, float x, float y, float w, float h, float scale)
+{
+  const int idx = FindParkedWebView();
+
+  if (idx < 0)
+    return nullptr;
+
+  auto& pool = GetPool();
+  ParkedWebView parked = std::move(pool[idx]);
+  pool.erase(pool.begin() + idx);
+
+  mWebViewEnv = std::move(parked.mWebViewEnv);
+  mWebViewCtrlr = std::move(parked.mWebViewCtrlr);
+  mWebViewWnd = std::move(parked.mWebViewWnd);
+  mDLLHandle = parked.mDLLHandle;
+  mLoadedKey = parked.mLoadedKey;
+  mReused = true;
+  mUnparked = false;
+
+  x *= scale;
+  y *= scale;
+  w *= scale;
+  h *= scale;
+
+  mWebViewCtrlr->put_ParentWindow((HWND) pParent);
+  mWebViewCtrlr->put_Bounds({ (LONG)x, (LONG)y, (LONG)(x + w), (LONG)(y + h) });
+  mWebViewCtrlr->put_IsVisible(TRUE);
+  AddWebViewEventHandlers();
+  OnWebViewReady();
+
+  return pParent;
+}
+
+void IWebView::DestroyParkedWebView(ParkedWebView& parked)
+{
+  if (parked.mWebViewCtrlr)
+    parked.mWebViewCtrlr->Close();
+
+  parked.mWebViewCtrlr = nullptr;
+  parked.mWebViewWnd = nullptr;
+  parked.mWebViewEnv = nullptr;
+
+  if (parked.mDLLHandle)
+  {
+    FreeLibrary(parked.mDLLHandle);
+    parked.mDLLHandle = nullptr;
+  }
 }
 
 void IWebView::LoadHTML(const char* html)
 {
-  if (mWebViewWnd)
+  if (mWebViewWnd && !ReusePage("html:" + std::to_string(std::hash<std::string>()(html))))
   {
     WCHAR htmlWide[IPLUG_WIN_MAX_WIDE_PATH]; // TODO: error check/size
     UTF8ToUTF16(htmlWide, html, IPLUG_WIN_MAX_WIDE_PATH); // TODO: error check/size
@@ -142,7 +287,7 @@ void IWebView::LoadHTML(const char* html)
 void IWebView::LoadURL(const char* url)
 {
   //TODO: error check url?
-  if (mWebViewWnd)
+  if (mWebViewWnd && !ReusePage(std::string("url:") + url))
   {
     WCHAR urlWide[IPLUG_WIN_MAX_WIDE_PATH]; // TODO: error check/size
     UTF8ToUTF16(urlWide, url, IPLUG_WIN_MAX_WIDE_PATH); // TODO: error check/size
@@ -152,7 +297,7 @@ void IWebView::LoadURL(const char* url)
 
 void IWebView::LoadFile(const char* fileName, const char* bundleID)
 {
-  if (mWebViewWnd)
+  if (mWebViewWnd && !ReusePage(std::string("file:") + fileName))
   {
     WDL_String fullStr;
     fullStr.SetFormatted(MAX_WIN32_PATH_LEN, "file://%s", fileName);
@@ -162,14 +307,65 @@ void IWebView::LoadFile(const char* fileName, const char* bundleID)
   }
 }
 
+void IWebView::LoadFromResourcePack(const char* fileName)
+{
+  WDL_String url(kResourcePackURL);
+  url.Append(fileName);
+  LoadURL(url.Get());
+}
+
+HRESULT IWebView::OnResourcePackRequest(ICoreWebView2WebResourceRequestedEventArgs* args)
+{
+  wil::com_ptr<ICoreWebView2WebResourceRequest> request;
+  wil::unique_cotaskmem_string uri;
+  args->get_Request(&request);
+  request->get_Uri(&uri);
+
+  WDL_String url;
+  UTF16ToUTF8(url, uri.get());
+
+  int size = 0;
+  WDL_String mimeType, eTag;
+  const uint8_t* pData = nullptr;
+
+  if (!strncmp(url.Get(), kResourcePackURL, strlen(kResourcePackURL)))
+    pData = GetPackedResource(url.Get() + strlen(kResourcePackURL), size, mimeType, eTag);
+
+  wil::com_ptr<ICoreWebView2WebResourceResponse> response;
+
+  if (!pData)
+  {
+    mWebViewEnv->CreateWebResourceResponse(nullptr, 404, L"Not Found", L"", &response);
+    return args->put_Response(response.get());
+  }
+
+  const std::wstring eTagWide = UTF8ToWideString(eTag.Get());
+
+  // a page the web view has cached is revalidated with the tag rather than served again
+  wil::com_ptr<ICoreWebView2HttpRequestHeaders> requestHeaders;
+  wil::unique_cotaskmem_string ifNoneMatch;
+
+  if (SUCCEEDED(request->get_Headers(&requestHeaders)) && SUCCEEDED(requestHeaders->GetHeader(L"If-None-Match", &ifNoneMatch)) && ifNoneMatch && eTagWide == ifNoneMatch.get())
+  {
+    mWebViewEnv->CreateWebResourceResponse(nullptr, 304, L"Not Modified", (L"ETag: " + eTagWide).c_str(), &response);
+    return args->put_Response(response.get());
+  }
+
+  wil::com_ptr<IStream> stream;
+  stream.attach(SHCreateMemStream(pData, static_cast<UINT>(size)));
+
+  const std::wstring headers = L"Content-Type: " + UTF8ToWideString(mimeType.Get()) + L"\r\nCache-Control: no-cache\r\nETag: " + eTagWide + L"\r\nAccess-Control-Allow-Origin: *";
+  mWebViewEnv->CreateWebResourceResponse(stream.get(), 200, L"OK", headers.c_str(), &response);
+  return args->put_Response(response.get());
+}
+
 void IWebView::EvaluateJavaScript(const char* scriptStr, completionHandlerFunc func)
 {
   if (mWebViewWnd)
   {
-    WCHAR scriptWide[IPLUG_WIN_MAX_WIDE_PATH]; // TODO: error check/size
-    UTF8ToUTF16(scriptWide, scriptStr, IPLUG_WIN_MAX_WIDE_PATH); // TODO: error check/size
+    const std::wstring scriptWide = UTF8ToWideString(scriptStr);
 
-    mWebViewWnd->ExecuteScript(scriptWide, Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
+    mWebViewWnd->ExecuteScript(scriptWide.c_str(), Callback<ICoreWebView2ExecuteScriptCompletedHandler>(
       [func](HRESULT errorCode, LPCWSTR resultObjectAsJson) -> HRESULT {
         if (func && resultObjectAsJson) {
           WDL_String str;
@@ -181,6 +377,34 @@ void IWebView::EvaluateJavaScript(const char* scriptStr, completionHandlerFunc f
   }
 }
 
+bool IWebView::PostSharedBuffer(const void* pData, int size, const char* descriptorsJson)
+{
+#ifdef __ICoreWebView2_17_INTERFACE_DEFINED__
+  if (!mWebViewWnd || !mWebViewEnv || size <= 0)
+    return false;
+
+  // shared buffers need a WebView2 runtime that is newer than the SDK requires, so check for the interfaces at runtime
+  auto env12 = mWebViewEnv.try_query<ICoreWebView2Environment12>();
+  auto webView17 = mWebViewWnd.try_query<ICoreWebView2_17>();
+
+  if (!env12 || !webView17)
+    return false;
+
+  wil::com_ptr<ICoreWebView2SharedBuffer> buffer;
+  BYTE* pBuffer = nullptr;
+
+  if (FAILED(env12->CreateSharedBuffer(static_cast<UINT64>(size), &buffer)) || FAILED(buffer->get_Buffer(&pBuffer)))
+    return false;
+
+  memcpy(pBuffer, pData, size);
+
+  // the memory is released when both this reference and the page's ArrayBuffer have gone
+  return SUCCEEDED(webView17->PostSharedBufferToScript(buffer.get(), COREWEBVIEW2_SHARED_BUFFER_ACCESS_READ_ONLY, UTF8ToWideString(descriptorsJson).c_str()));
+#else
+  return false;
+#endif
+}
+
 void IWebView::EnableScroll(bool enable)
 {
   // TODO?
@@ -11,8 +11,14 @@
 #pragma once
 
 #include "IPlugPlatform.h"
+#include "IPlugResourcePack.h"
 #include "wdlstring.h"
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #if defined OS_MAC
   #define PLATFORM_VIEW NSView
@@ -52,12 +58,83 @@ public:
    * @param fileName On windows this should be an absolute path to the file you want to load. On macOS/iOS it can just be the file name if the file is packaged into a subfolder "web" of the bundle resources
    * @param bundleID The NSBundleID of the macOS/iOS bundle, not required on Windows */
   void LoadFile(const char* fileName, const char* bundleID = "");
+
+  /** Serve the web view's pages from a resource pack in memory, rather than have the web view read each file of the UI from disk.
+   * Make the pack from the UI's build folder with Scripts/bin2c.py --pack name --pack-paths --dir folder, so that entries are named by their paths.
+   * The pack is served at a URL of its own (iplug://localhost/ on macOS/iOS, https://iplug.localhost/ on Windows), so relative URLs in the pages work.
+   * Call before OpenWebView(). The pack must stay open while the web view is open
+   * @param pPack The pack, or nullptr to stop serving one */
+  void SetResourcePack(IResourcePack* pPack) { mResourcePack = pPack; mETags.clear(); }
+
+  /** Load a page from the resource pack set with SetResourcePack()
+   * @param fileName The page's path in the pack */
+  void LoadFromResourcePack(const char* fileName = "index.html");
+
+  /** Get the response to a request to the resource pack's URL. Called by the platform's scheme handler
+   * @param path The path of the URL, without the scheme and host
+   * @param size Set to the size of the data
+   * @param mimeType Set to the data's MIME type
+   * @param eTag Set to a tag that changes when the data does, so the web view's cache can keep the data and revalidate it
+   * @return The data, which stays valid while the pack is open, or nullptr if the pack doesn't have it */
+  const uint8_t* GetPackedResource(const char* path, int& size, WDL_String& mimeType, WDL_String& eTag)
+  {
+    size = 0;
+
+    if (!mResourcePack)
+      return nullptr;
+
+    WDL_String file(path);
+
+    // the query and fragment don't name the resource
+    for (int i = 0; i < file.GetLength(); i++)
+    {
+      if (file.Get()[i] == '?' || file.Get()[i] == '#')
+      {
+        file.SetLen(i);
+        break;
+      }
+    }
+
+    if (!file.GetLength() || file.Get()[file.GetLength() - 1] == '/')
+      file.Append("index.html");
+
+    const uint8_t* pData = mResourcePack->Get(file.Get(), size);
+
+    if (!pData)
+      return nullptr;
+
+    mimeType.Set(GetMimeType(file.get_fileext()));
+
+    // the web view caches responses across sessions, so tag them by their content, which changes when the plug-in is updated
+    auto itr = mETags.find(pData);
+
+    if (itr == mETags.end())
+    {
+      uint32_t hash = 2166136261u;
+
+      for (int i = 0; i < size; i++)
+        hash = (hash ^ pData[i]) * 16777619u;
+
+      itr = mETags.emplace(pData, hash).first;
+    }
+
+    eTag.SetFormatted(32, "\"%08x-%x\"", itr->second, size);
+    return pData;
+  }
   
   /** Runs some JavaScript in the webview
    * @param scriptStr UTF8 encoded JavaScript code to run
    * @param func A function conforming to completionHandlerFunc that should be called on successful execution of the script */
   void EvaluateJavaScript(const char* scriptStr, completionHandlerFunc func = nullptr);
   
+  /** Send a block of binary data to the page without encoding it, where the platform web view supports it (currently WebView2 runtimes with shared buffers).
+   * The page receives it in a "sharedbufferreceived" event, which IWebView handles by passing views of the buffer to SCMFD() and SAMFD()
+   * @param pData The data
+   * @param size The size of the data in bytes
+   * @param descriptorsJson A JSON array of [type (0 for SCMFD, 1 for SAMFD), tag, msgTag, offset, size] arrays describing the messages in the data
+   * @return \c true if the data was sent, \c false if it needs to be sent by EvaluateJavaScript() instead */
+  bool PostSharedBuffer(const void* pData, int size, const char* descriptorsJson);
+
   /** Enable scrolling on the webview. NOTE: currently only implemented for iOS */
   void EnableScroll(bool enable);
   
@@ -73,6 +150,27 @@ public:
   /** When a script in the web view posts a message, it will arrive as a UTF8 json string here */
   virtual void OnMessageFromWebView(const char* json) {}
 
+  /** Keep up to size web views open when their editors close, so that an editor that opens later reuses one with its page loaded, rather than creating a web view and loading the page again.
+   * A parked web view is detached from its window and calls the page's window.IPlugOnPark(), if it has one, so that the page can reset its state.
+   * An IWebView that opens adopts a parked web view made with the same settings. If it then loads the page the parked view shows, with the same LoadURL(), LoadFile(), LoadHTML()
+   * or LoadFromResourcePack() call, the page isn't loaded again; window.IPlugOnUnpark() is called and then OnWebContentLoaded(), as if it had been.
+   * The pool is shared by all of the IWebViews in the process, and emptied when the last one is destroyed. Call on the main thread
+   * @param size The most web views to park, 0 (the default) to close web views rather than park them */
+  static void SetPoolSize(int size)
+  {
+    GetPoolSizeRef() = std::max(size, 0);
+    TrimPool(GetPoolSizeRef());
+  }
+
+  /** @return The most web views that are parked, see SetPoolSize() */
+  static int GetPoolSize() { return GetPoolSizeRef(); }
+
+  /** @return The number of web views that are parked */
+  static int GetNumParkedWebViews() { return static_cast<int>(GetPool().size()); }
+
+  /** Close all the parked web views, e.g. to free their memory. Call on the main thread */
+  static void ClearPool() { TrimPool(0); }
+
 #if defined OS_WIN
   /** Set the paths required for the Windows ICoreWebView2 component
    * @param dllPath (Windows only) an absolute path to the WebView2Loader.dll that is required to use the WebView2 on windows
@@ -81,16 +179,161 @@ public:
 #endif
   
 private:
+  /** An open platform web view that is parked in the pool */
+  struct ParkedWebView
+  {
+    std::string mPoolKey; // the settings it was made with, see GetPoolKey()
+    std::string mLoadedKey; // the page it shows, see ReusePage()
+#if defined OS_MAC || defined OS_IOS
+    void* mWKWebView = nullptr; // retained while parked
+    void* mScriptHandler = nullptr;
+    void* mSchemeHandler = nullptr;
+#elif defined OS_WIN
+    wil::com_ptr<ICoreWebView2Environment> mWebViewEnv;
+    wil::com_ptr<ICoreWebView2Controller> mWebViewCtrlr;
+    wil::com_ptr<ICoreWebView2> mWebViewWnd;
+    HMODULE mDLLHandle = nullptr;
+#endif
+  };
+
+  /** Park the open web view, if the pool has room. Implemented per platform
+   * @return \c true if the web view was parked, \c false if it should be closed */
+  bool ParkWebView();
+
+  /** Adopt a parked web view made with the same settings, attaching it to pParent. Implemented per platform
+   * @return The platform view on macOS/iOS, pParent on Windows, or nullptr if the pool has none to adopt */
+  void* AdoptWebView(void* pParent, float x, float y, float w, float h, float scale);
+
+  /** Close a parked web view. Implemented per platform */
+  static void DestroyParkedWebView(ParkedWebView& parked);
+
+  /** @return A key for the settings that a web view is made with, which a parked web view must match to be adopted */
+  std::string GetPoolKey() const
+  {
+    std::string key(mOpaque ? "opaque" : "transparent");
+
+    if (mResourcePack)
+      key += "/pack";
+
+#if defined OS_WIN
+    key += "/";
+    key += mTmpPath.Get();
+#endif
+
+    return key;
+  }
+
+  /** Called by the Load methods before they navigate
+   * @param loadedKey Identifies the page that is about to be loaded
+   * @return \c true if the web view was adopted and already shows the page, in which case the page is unparked rather than loaded */
+  bool ReusePage(const std::string& loadedKey)
+  {
+    if (mReused && loadedKey == mLoadedKey)
+    {
+      if (!mUnparked)
+      {
+        mUnparked = true;
+        // evaluates to a string, which every platform passes to the completion handler
+        EvaluateJavaScript("if (window.IPlugOnUnpark) IPlugOnUnpark(); 'unparked'", [this](const char*) { OnWebContentLoaded(); });
+      }
+
+      return true;
+    }
+
+    mReused = false;
+    mLoadedKey = loadedKey;
+    return false;
+  }
+
+  /** Find a parked web view for this IWebView to adopt
+   * @return The index in the pool, or -1 if there isn't one */
+  int FindParkedWebView() const
+  {
+    const std::string poolKey = GetPoolKey();
+    const auto& pool = GetPool();
+
+    // the most recently parked first, since its page is the most likely to be loaded again
+    for (int i = static_cast<int>(pool.size()) - 1; i >= 0; i--)
+    {
+      if (pool[i].mPoolKey == poolKey)
+        return i;
+    }
+
+    return -1;
+  }
+
+  static void TrimPool(int size)
+  {
+    auto& pool = GetPool();
+
+    while (static_cast<int>(pool.size()) > size)
+    {
+      DestroyParkedWebView(pool.front());
+      pool.erase(pool.begin());
+    }
+  }
+
+  static std::vector<ParkedWebView>& GetPool()
+  {
+    static std::vector<ParkedWebView> sPool;
+    return sPool;
+  }
+
+  static int& GetPoolSizeRef()
+  {
+    static int sPoolSize = 0;
+    return sPoolSize;
+  }
+
+  /** The number of IWebViews, so the pool can be emptied when the last is destroyed */
+  static int& GetNumInstances()
+  {
+    static int sNumInstances = 0;
+    return sNumInstances;
+  }
+
+  static const char* GetMimeType(const char* ext)
+  {
+    static const char* mimeTypes[][2] = {
+      { ".html", "text/html" }, { ".htm", "text/html" }, { ".js", "text/javascript" }, { ".mjs", "text/javascript" },
+      { ".css", "text/css" }, { ".json", "application/json" }, { ".map", "application/json" }, { ".wasm", "application/wasm" },
+      { ".svg", "image/svg+xml" }, { ".png", "image/png" }, { ".jpg", "image/jpeg" }, { ".jpeg", "image/jpeg" },
+      { ".gif", "image/gif" }, { ".webp", "image/webp" }, { ".ico", "image/x-icon" }, { ".woff", "font/woff" },
+      { ".woff2", "font/woff2" }, { ".ttf", "font/ttf" }, { ".otf", "font/otf" }, { ".txt", "text/plain" }
+    };
+
+    for (auto& mimeType : mimeTypes)
+    {
+      if (!stricmp(ext, mimeType[0]))
+        return mimeType[1];
+    }
+
+    return "application/octet-stream";
+  }
+
   bool mOpaque = true;
+  IResourcePack* mResourcePack = nullptr;
+  std::unordered_map<const void*, uint32_t> mETags;
+  std::string mLoadedKey;
+  bool mReused = false; // the web view was adopted from the pool
+  bool mUnparked = false; // ReusePage() has unparked the page
+#if defined OS_WIN
+  HRESULT OnResourcePackRequest(ICoreWebView2WebResourceRequestedEventArgs* args);
+  void AddWebViewEventHandlers();
+  void RemoveWebViewEventHandlers();
+#endif
 #if defined OS_MAC || defined OS_IOS
   void* mWKWebView = nullptr;
   void* mWebConfig = nullptr;
   void* mScriptHandler = nullptr;
+  void* mSchemeHandler = nullptr;
 #elif defined OS_WIN
+  wil::com_ptr<ICoreWebView2Environment> mWebViewEnv;
   wil::com_ptr<ICoreWebView2Controller> mWebViewCtrlr;
   wil::com_ptr<ICoreWebView2> mWebViewWnd;
   EventRegistrationToken mWebMessageReceivedToken;
   EventRegistrationToken mNavigationCompletedToken;
+  EventRegistrationToken mWebResourceRequestedToken;
   WDL_String mDLLPath;
   WDL_String mTmpPath;
   HMODULE mDLLHandle = nullptr;
@@ -41,9 +41,15 @@ using namespace iplug;
   return self;
 }
 
+// nullptr while the web view is parked
+-(void) setIWebView:(IWebView*) webView
+{
+  mWebView = webView;
+}
+
 - (void) userContentController:(nonnull WKUserContentController*) userContentController didReceiveScriptMessage:(nonnull WKScriptMessage*) message
 {
-  if ([[message name] isEqualToString:@"callback"])
+  if (mWebView && [[message name] isEqualToString:@"callback"])
   {
     NSDictionary* dict = (NSDictionary*) message.body;
     NSData* data = [NSJSONSerialization dataWithJSONObject:dict options:NSJSONWritingPrettyPrinted error:nil];
@@ -54,7 +60,76 @@ using namespace iplug;
 
 - (void) webView:(WKWebView*) webView didFinishNavigation:(WKNavigation*) navigation
 {
-  mWebView->OnWebContentLoaded();
+  if (mWebView)
+    mWebView->OnWebContentLoaded();
+}
+
+@end
+
+// Serves requests to the scheme that the resource pack is served at, see IWebView::SetResourcePack()
+API_AVAILABLE(macos(10.13), ios(11.0))
+@interface ResourcePackSchemeHandler : NSObject <WKURLSchemeHandler>
+{
+  IWebView* mWebView;
+}
+@end
+
+@implementation ResourcePackSchemeHandler
+
+-(id) initWithIWebView:(IWebView*) webView
+{
+  self = [super init];
+  
+  if (self)
+    mWebView = webView;
+  
+  return self;
+}
+
+// nullptr while the web view is parked
+-(void) setIWebView:(IWebView*) webView
+{
+  mWebView = webView;
+}
+
+- (void) webView:(WKWebView*) webView startURLSchemeTask:(id<WKURLSchemeTask>) urlSchemeTask
+{
+  if (!mWebView)
+  {
+    [urlSchemeTask didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    return;
+  }
+  
+  NSURL* url = urlSchemeTask.request.URL;
+  int size = 0;
+  WDL_String mimeType, eTag;
+  const uint8_t* pData = mWebView->GetPackedResource([[url path] UTF8String], size, mimeType, eTag);
+  
+  if (!pData)
+  {
+    NSHTTPURLResponse* response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:404 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+    [urlSchemeTask didReceiveResponse:response];
+    [urlSchemeTask didFinish];
+    return;
+  }
+  
+  NSDictionary* headers = @{
+    @"Content-Type" : [NSString stringWithUTF8String:mimeType.Get()],
+    @"Content-Length" : [NSString stringWithFormat:@"%d", size],
+    @"Cache-Control" : @"no-cache",
+    @"ETag" : [NSString stringWithUTF8String:eTag.Get()],
+    @"Access-Control-Allow-Origin" : @"*"
+  };
+  
+  NSHTTPURLResponse* response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:headers];
+  [urlSchemeTask didReceiveResponse:response];
+  // the pack outlives the task, so its data is passed without copying
+  [urlSchemeTask didReceiveData:[NSData dataWithBytesNoCopy:(void*) pData length:size freeWhenDone:NO]];
+  [urlSchemeTask didFinish];
+}
+
+- (void) webView:(WKWebView*) webView stopURLSchemeTask:(id<WKURLSchemeTask>) urlSchemeTask
+{
 }
 
 @end
@@ -62,15 +137,22 @@ using namespace iplug;
 IWebView::IWebView(bool opaque)
 : mOpaque(opaque)
 {
+  GetNumInstances()++;
 }
 
 IWebView::~IWebView()
 {
   CloseWebView();
+
+  if (--GetNumInstances() == 0)
+    ClearPool();
 }
 
 void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, float scale)
 {  
+  if (void* pWebView = AdoptWebView(pParent, x, y, w, h, scale))
+    return pWebView;
+  
   WKWebViewConfiguration* webConfig = [[WKWebViewConfiguration alloc] init];
   WKPreferences* preferences = [[WKPreferences alloc] init];
   
@@ -91,6 +173,15 @@ void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, f
                                                  injectionTime:WKUserScriptInjectionTimeAtDocumentEnd forMainFrameOnly:YES];
   [controller addUserScript:script2];
   
+  if (mResourcePack)
+  {
+    if (@available(macOS 10.13, iOS 11.0, *))
+    {
+      ResourcePackSchemeHandler* schemeHandler = [[ResourcePackSchemeHandler alloc] initWithIWebView: this];
+      [webConfig setURLSchemeHandler:schemeHandler forURLScheme:@"iplug"];
+      mSchemeHandler = (__bridge void*) schemeHandler;
+    }
+  }
   
   WKWebView* webView = [[WKWebView alloc] initWithFrame: MAKERECT(x, y, w, h) configuration:webConfig];
   
@@ -132,22 +223,105 @@ void* IWebView::OpenWebView(void* pParent, float x, float y, float w, float h, f
 
 void IWebView::CloseWebView()
 {
-  WKWebView* webView = (__bridge WKWebView*) mWKWebView;
-  [webView removeFromSuperview];
+  if (!ParkWebView())
+  {
+    WKWebView* webView = (__bridge WKWebView*) mWKWebView;
+    [webView removeFromSuperview];
+  }
   
   mWebConfig = nullptr;
   mWKWebView = nullptr;
   mScriptHandler = nullptr;
+  mSchemeHandler = nullptr;
+  mLoadedKey.clear();
+  mReused = false;
+  mUnparked = false;
+}
+
+bool IWebView::ParkWebView()
+{
+  if (!mWKWebView || mLoadedKey.empty() || GetPoolSize() == 0)
+    return false;
+  
+  TrimPool(GetPoolSize() - 1);
+  EvaluateJavaScript("if (window.IPlugOnPark) IPlugOnPark();");
+  
+  ParkedWebView parked;
+  parked.mPoolKey = GetPoolKey();
+  parked.mLoadedKey = mLoadedKey;
+  parked.mScriptHandler = mScriptHandler;
+  parked.mSchemeHandler = mSchemeHandler;
+  
+  // the superview owns the web view, so retain it before removing it
+  WKWebView* webView = (__bridge WKWebView*) mWKWebView;
+  parked.mWKWebView = (__bridge_retained void*) webView;
+  [webView removeFromSuperview];
+  
+  [(__bridge ScriptHandler*) mScriptHandler setIWebView: nullptr];
+  
+  if (@available(macOS 10.13, iOS 11.0, *))
+    [(__bridge ResourcePackSchemeHandler*) mSchemeHandler setIWebView: nullptr];
+  
+  GetPool().push_back(std::move(parked));
+  return true;
+}
+
+void* IWebView::AdoptWebView(void* pParent, float x, float y, float w, float h, float scale)
+{
+  const int idx = FindParkedWebView();
+  
+  if (idx < 0)
+    return nullptr;
+  
+  auto& pool = GetPool();
+  ParkedWebView parked = std::move(pool[idx]);
+  pool.erase(pool.begin() + idx);
+  
+  // the parent takes over ownership from the pool
+  WKWebView* webView = (__bridge_transfer WKWebView*) parked.mWKWebView;
+  [webView setFrame: MAKERECT(x, y, w, h)];
+  
+  if (pParent)
+    [(__bridge PLATFORM_VIEW*) pParent addSubview: webView];
+  
+  [(__bridge ScriptHandler*) parked.mScriptHandler setIWebView: this];
+  
+  if (@available(macOS 10.13, iOS 11.0, *))
+    [(__bridge ResourcePackSchemeHandler*) parked.mSchemeHandler setIWebView: this];
+  
+  mWKWebView = (__bridge void*) webView;
+  mScriptHandler = parked.mScriptHandler;
+  mSchemeHandler = parked.mSchemeHandler;
+  mLoadedKey = parked.mLoadedKey;
+  mReused = true;
+  mUnparked = false;
+  
+  OnWebViewReady();
+  
+  return mWKWebView;
+}
+
+void IWebView::DestroyParkedWebView(ParkedWebView& parked)
+{
+  WKWebView* webView = (__bridge_transfer WKWebView*) parked.mWKWebView;
+  [webView stopLoading];
+  parked.mWKWebView = nullptr;
 }
 
 void IWebView::LoadHTML(const char* html)
 {
+  if (ReusePage("html:" + std::to_string(std::hash<std::string>()(html))))
+    return;
+  
   WKWebView* webView = (__bridge WKWebView*) mWKWebView;
   [webView loadHTMLString:[NSString stringWithUTF8String:html] baseURL:nil];
 }
 
 void IWebView::LoadURL(const char* url)
 {
+  if (ReusePage(std::string("url:") + url))
+    return;
+  
   WKWebView* webView = (__bridge WKWebView*) mWKWebView;
   
   NSURL* nsurl = [NSURL URLWithString:[NSString stringWithUTF8String:url] relativeToURL:nil];
@@ -157,6 +331,9 @@ void IWebView::LoadURL(const char* url)
 
 void IWebView::LoadFile(const char* fileName, const char* bundleID)
 {
+  if (ReusePage(std::string("file:") + bundleID + "/" + fileName))
+    return;
+  
   WKWebView* webView = (__bridge WKWebView*) mWKWebView;
 
   WDL_String fullPath;
@@ -175,6 +352,13 @@ void IWebView::LoadFile(const char* fileName, const char* bundleID)
   [webView loadFileURL:pageUrl allowingReadAccessToURL:rootUrl];
 }
 
+void IWebView::LoadFromResourcePack(const char* fileName)
+{
+  WDL_String url("iplug://localhost/");
+  url.Append(fileName);
+  LoadURL(url.Get());
+}
+
 void IWebView::EvaluateJavaScript(const char* scriptStr, completionHandlerFunc func)
 {
   WKWebView* webView = (__bridge WKWebView*) mWKWebView;
@@ -192,6 +376,11 @@ void IWebView::EvaluateJavaScript(const char* scriptStr, completionHandlerFunc f
   }
 }
 
+bool IWebView::PostSharedBuffer(const void* pData, int size, const char* descriptorsJson)
+{
+  return false; // WKWebView can only pass strings and JSON types to scripts
+}
+
 void IWebView::EnableScroll(bool enable)
 {
 #ifdef OS_IOS
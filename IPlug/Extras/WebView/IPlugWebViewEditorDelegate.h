@@ -12,17 +12,25 @@
 
 #include "IPlugEditorDelegate.h"
 #include "IPlugWebView.h"
+#include "IPlugTimer.h"
 #include "wdl_base64.h"
 #include "json.hpp"
 #include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 
 BEGIN_IPLUG_NAMESPACE
 
-/** This Editor Delegate allows using a platform native web view as the UI for an iPlug plugin */
+/** This Editor Delegate allows using a platform native web view as the UI for an iPlug plugin.
+ * Messages to the web view are queued and sent together in one script every kFlushIntervalMs, with only the latest value sent for each control and parameter.
+ * With SetBinaryMessages(true), the payloads of control and arbitrary messages are sent as one buffer per batch and reach SCMFD()/SAMFD() as Uint8Arrays rather than base64 strings,
+ * using a WebView2 shared buffer where the runtime supports it */
 class WebViewEditorDelegate : public IEditorDelegate
                             , public IWebView
 {
   static constexpr int kDefaultMaxJSStringLength = 1024;
+  static constexpr int kFlushIntervalMs = 16;
   
 public:
   WebViewEditorDelegate(int nParams);
@@ -33,48 +41,125 @@ public:
   
   void CloseWindow() override
   {
+    mFlushTimer = nullptr;
+    mContentLoaded = false;
+    ClearPendingMessages();
     CloseWebView();
   }
 
   void SendControlValueFromDelegate(int ctrlTag, double normalizedValue) override
   {
-    WDL_String str;
-    str.SetFormatted(mMaxJSStringLength, "SCVFD(%i, %f)", ctrlTag, normalizedValue);
-    EvaluateJavaScript(str.Get());
+    if (mContentLoaded)
+    {
+      GetControlCoalescer().AddValue(ctrlTag, normalizedValue);
+      StartFlushTimer();
+    }
   }
 
   void SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData) override
   {
-    WDL_String str;
-    std::vector<char> base64;
-    base64.resize(GetBase64Length(dataSize));
-    wdl_base64encode(reinterpret_cast<const unsigned char*>(pData), base64.data(), dataSize);
-    str.SetFormatted(mMaxJSStringLength, "SCMFD(%i, %i, %i, '%s')", ctrlTag, msgTag, dataSize, base64.data());
-    EvaluateJavaScript(str.Get());
+    if (!mContentLoaded)
+      return;
+
+    if (GetControlCoalescer().GetMsgCoalescing(ctrlTag))
+      GetControlCoalescer().AddMsg(ctrlTag, msgTag, dataSize, pData);
+    else if (mBinaryMessages)
+      AddPendingData(kControlMsg, ctrlTag, msgTag, dataSize, pData);
+    else
+    {
+      mPendingScript.AppendFormatted(mMaxJSStringLength, "SCMFD(%i, %i, %i, '", ctrlTag, msgTag, dataSize);
+      AppendBase64(mPendingScript, dataSize, pData);
+      mPendingScript.Append("');");
+    }
+
+    StartFlushTimer();
   }
 
   void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override
   {
-    WDL_String str;
-    str.SetFormatted(mMaxJSStringLength, "SPVFD(%i, %f)", paramIdx, value);
-    EvaluateJavaScript(str.Get());
+    if (mContentLoaded)
+      SetPendingValue(mPendingParamValues, paramIdx, value);
   }
 
   void SendArbitraryMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
   {
-    WDL_String str;
-    std::vector<char> base64;
-    base64.resize(GetBase64Length(dataSize));
-    wdl_base64encode(reinterpret_cast<const unsigned char*>(pData), base64.data(), dataSize);
-    str.SetFormatted(mMaxJSStringLength, "SAMFD(%i, %i, %s)", msgTag, dataSize, base64.data());
-    EvaluateJavaScript(str.Get());
+    if (!mContentLoaded)
+      return;
+
+    if (mBinaryMessages)
+      AddPendingData(kArbitraryMsg, msgTag, kNoTag, dataSize, pData);
+    else
+    {
+      mPendingScript.AppendFormatted(mMaxJSStringLength, "SAMFD(%i, %i, '", msgTag, dataSize);
+      AppendBase64(mPendingScript, dataSize, pData);
+      mPendingScript.Append("');");
+    }
+
+    StartFlushTimer();
   }
   
   void SendMidiMsgFromDelegate(const IMidiMsg& msg) override
   {
-    WDL_String str;
-    str.SetFormatted(mMaxJSStringLength, "SMMFD(%i, %i, %i)", msg.mStatus, msg.mData1, msg.mData2);
-    EvaluateJavaScript(str.Get());
+    if (!mContentLoaded)
+      return;
+
+    mPendingScript.AppendFormatted(mMaxJSStringLength, "SMMFD(%i, %i, %i);", msg.mStatus, msg.mData1, msg.mData2);
+    StartFlushTimer();
+  }
+
+  /** Send the queued messages to the web view now, rather than waiting for the next flush. Called on the main thread
+   * Control values are coalesced to the newest one for each control, sent as SCVFD(ctrlTag, value, minValue, maxValue) with the range of the values since the last flush */
+  void FlushMessagesToWebView()
+  {
+    WDL_String script;
+
+    for (const auto& param : mPendingParamValues)
+      script.AppendFormatted(mMaxJSStringLength, "SPVFD(%i, %f);", param.first, param.second);
+
+    // the coalesced messages follow the ones that aren't coalesced, which were sent before
+    GetControlCoalescer().Flush([&](const IControlCoalescer::ValueSlot& slot) {
+      script.AppendFormatted(mMaxJSStringLength, "SCVFD(%i, %f, %f, %f);", slot.mCtrlTag, slot.mValue, slot.mMin, slot.mMax);
+    },
+    [&](int ctrlTag, int msgTag, int dataSize, const void* pData) {
+      if (mBinaryMessages)
+        AddPendingData(kControlMsg, ctrlTag, msgTag, dataSize, pData);
+      else
+      {
+        mPendingScript.AppendFormatted(mMaxJSStringLength, "SCMFD(%i, %i, %i, '", ctrlTag, msgTag, dataSize);
+        AppendBase64(mPendingScript, dataSize, pData);
+        mPendingScript.Append("');");
+      }
+    });
+
+    script.Append(mPendingScript.Get());
+
+    if (mPendingDataMsgs.size())
+    {
+      WDL_String descriptors("[");
+
+      for (auto i = 0; i < static_cast<int>(mPendingDataMsgs.size()); i++)
+      {
+        const PendingDataMsg& msg = mPendingDataMsgs[i];
+        descriptors.AppendFormatted(mMaxJSStringLength, "%s[%i, %i, %i, %i, %i]", i ? ", " : "", msg.mType, msg.mTag, msg.mMsgTag, msg.mOffset, msg.mSize);
+      }
+
+      descriptors.Append("]");
+
+      if (!PostSharedBuffer(mPendingData.data(), static_cast<int>(mPendingData.size()), descriptors.Get()))
+      {
+        // one base64 string for the whole batch, decoded once, with each message getting a view of its part
+        script.Append("(function(){var d=Uint8Array.from(atob('");
+        AppendBase64(script, static_cast<int>(mPendingData.size()), mPendingData.data());
+        script.Append("'),function(c){return c.charCodeAt(0);});var m=");
+        script.Append(descriptors.Get());
+        script.Append(";for(var i=0;i<m.length;i++){var v=d.subarray(m[i][3],m[i][3]+m[i][4]);if(m[i][0]==0)SCMFD(m[i][1],m[i][2],m[i][4],v);else SAMFD(m[i][1],m[i][4],v);}})();");
+      }
+    }
+
+    ClearPendingMessages();
+
+    if (script.GetLength())
+      EvaluateJavaScript(script.Get());
   }
 
   void OnMessageFromWebView(const char* jsonStr) override
@@ -136,13 +221,22 @@ public:
   
   void OnWebContentLoaded() override
   {
+    mContentLoaded = true;
     OnUIOpen();
   }
   
+  /** Set the maximum length of the scalar parts of the messages sent to the web view. Message payloads and batches aren't limited by this */
   void SetMaxJSStringLength(int length)
   {
     mMaxJSStringLength = length;
   }
+
+  /** @param binary \c true to send message payloads to SCMFD()/SAMFD() as Uint8Arrays, \c false to send them as base64 strings */
+  void SetBinaryMessages(bool binary)
+  {
+    FlushMessagesToWebView();
+    mBinaryMessages = binary;
+  }
   
 protected:
   int GetBase64Length(int dataSize)
@@ -153,6 +247,79 @@ protected:
   int mMaxJSStringLength = kDefaultMaxJSStringLength;
   std::function<void()> mEditorInitFunc = nullptr;
   void* mHelperView = nullptr;
+
+private:
+  enum EDataMsgType
+  {
+    kControlMsg = 0,
+    kArbitraryMsg
+  };
+
+  struct PendingDataMsg
+  {
+    EDataMsgType mType;
+    int mTag;
+    int mMsgTag;
+    int mOffset;
+    int mSize;
+  };
+
+  void StartFlushTimer()
+  {
+    if (!mFlushTimer)
+      mFlushTimer = std::unique_ptr<Timer>(Timer::Create([this](Timer& t) { FlushMessagesToWebView(); }, kFlushIntervalMs));
+  }
+
+  void SetPendingValue(std::vector<std::pair<int, double>>& values, int idx, double value)
+  {
+    for (auto& pending : values)
+    {
+      if (pending.first == idx)
+      {
+        pending.second = value;
+        return;
+      }
+    }
+
+    values.emplace_back(idx, value);
+    StartFlushTimer();
+  }
+
+  void AddPendingData(EDataMsgType type, int tag, int msgTag, int dataSize, const void* pData)
+  {
+    const int offset = static_cast<int>(mPendingData.size());
+    mPendingDataMsgs.push_back({ type, tag, msgTag, offset, dataSize });
+    mPendingData.resize(offset + dataSize);
+
+    if (dataSize)
+      memcpy(mPendingData.data() + offset, pData, dataSize);
+  }
+
+  void AppendBase64(WDL_String& str, int dataSize, const void* pData)
+  {
+    const int start = str.GetLength();
+    const int base64Length = GetBase64Length(dataSize);
+
+    if (base64Length && str.SetLen(start + base64Length))
+      wdl_base64encode(reinterpret_cast<const unsigned char*>(pData), str.Get() + start, dataSize); // writes the terminating null at the end of the string
+  }
+
+  void ClearPendingMessages()
+  {
+    mPendingParamValues.clear();
+    GetControlCoalescer().Clear();
+    mPendingScript.Set("");
+    mPendingDataMsgs.clear();
+    mPendingData.clear();
+  }
+
+  std::unique_ptr<Timer> mFlushTimer;
+  std::vector<std::pair<int, double>> mPendingParamValues;
+  WDL_String mPendingScript; // messages that aren't coalesced, in the order they were sent
+  std::vector<PendingDataMsg> mPendingDataMsgs;
+  std::vector<unsigned char> mPendingData;
+  bool mBinaryMessages = false;
+  bool mContentLoaded = false;
 };
 
 END_IPLUG_NAMESPACE
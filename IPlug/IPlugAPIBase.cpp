@@ -13,12 +13,15 @@
  * @brief IPlugAPIBase implementation
  */
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <cstdio>
 #include <ctime>
 #include <cassert>
 
 #include "IPlugAPIBase.h"
+#include "IPlugProcessor.h"
 
 using namespace iplug;
 
@@ -42,6 +45,9 @@ IPlugAPIBase::IPlugAPIBase(Config c, EAPI plugAPI)
   Trace(TRACELOC, "%s:%s", c.pluginName, CurrentTime());
   
   mParamDisplayStr.Set("", MAX_PARAM_DISPLAY_LEN);
+  mParamChangeFromProcessor.Resize(c.nParams);
+  mParamValuesFromUI.ForEachBuffer([&](ParamValuesSnapshot& snapshot) { snapshot.mValues.Resize(c.nParams); });
+  mCrossfadeStartValues.Resize(c.nParams);
 }
 
 IPlugAPIBase::~IPlugAPIBase()
@@ -63,17 +69,41 @@ void IPlugAPIBase::OnHostRequestingImportantParameters(int count, WDL_TypedBuf<i
   }
 }
 
-void IPlugAPIBase::CreateTimer()
+void IPlugAPIBase::CreateTimer(bool reportsEditor)
 {
-  mTimer = std::unique_ptr<Timer>(Timer::Create(std::bind(&IPlugAPIBase::OnTimer, this, std::placeholders::_1), IDLE_TIMER_RATE));
+  mReportsEditor = reportsEditor;
+  mTimer = nullptr;
+  UpdateTimerRate();
+}
+
+void IPlugAPIBase::UpdateTimerRate()
+{
+  const uint32_t rate = (GetEditorOpen() || mIdleRequired || mTimerWorkPending) ? IDLE_TIMER_RATE : IDLE_TIMER_RATE_BACKGROUND;
+
+  if (mTimer && rate == mTimerRate)
+    return;
+
+  // the TimerService moves a callback out of its timer while it runs, so this can replace the timer from within OnTimer()
+  if (mTimer)
+    mTimer->Stop();
+
+  mTimer = std::unique_ptr<Timer>(Timer::Create(std::bind(&IPlugAPIBase::OnTimer, this, std::placeholders::_1), rate));
+  mTimerRate = rate;
 }
 
 bool IPlugAPIBase::CompareState(const uint8_t* pIncomingState, int startPos) const
 {
+  const double* pStart = (const double*) pIncomingState + startPos;
+  const double* data = pStart;
+  const int size = NParams() * static_cast<int>(sizeof(double));
+  const uint32_t version = GetStateVersion();
+
+  // Pro Tools compares the same chunk over and over, if neither it nor the parameters have changed the answer hasn't either
+  if (size && version == mComparedStateVersion && mComparedState.GetSize() == size && !memcmp(mComparedState.Get(), pStart, size))
+    return mComparedStateEqual;
+
   bool isEqual = true;
   
-  const double* data = (const double*) pIncomingState + startPos;
-  
   // dirty hack here because protools treats param values as 32 bit int and in IPlug they are 64bit float
   // if we memcmp() the incoming state with the current they may have tiny differences due to the quantization
   for (int i = 0; i < NParams(); i++)
@@ -83,10 +113,30 @@ bool IPlugAPIBase::CompareState(const uint8_t* pIncomingState, int startPos) con
     
     isEqual &= (std::fabs(v - vi) < 0.00001);
   }
+
+  mComparedState.Resize(size, false);
+
+  if (mComparedState.GetSize() == size)
+  {
+    memcpy(mComparedState.Get(), pStart, size);
+    mComparedStateVersion = version;
+    mComparedStateEqual = isEqual;
+  }
   
   return isEqual;
 }
 
+uint32_t IPlugAPIBase::GetStateVersion() const
+{
+  const IParamChangeFlags* pFlags = NParams() ? GetParam(0)->GetChangeFlags() : nullptr;
+
+  // the parameters all share the processor's change flags, whose version counts every value that is set
+  if (!pFlags)
+    return mStateVersion.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+  return mStateVersion.load(std::memory_order_acquire) + pFlags->GetVersion();
+}
+
 bool IPlugAPIBase::EditorResizeFromUI(int viewWidth, int viewHeight, bool needsPlatformResize)
 {  
   if (needsPlatformResize)
@@ -134,12 +184,127 @@ void IPlugAPIBase::SendParameterValueFromAPI(int paramIdx, double value, bool no
   if (normalized)
     value = GetParam(paramIdx)->FromNormalized(value);
   
-  mParamChangeFromProcessor.Push(ParamTuple { paramIdx, value } );
+  mParamChangeFromProcessor.Push(paramIdx, value);
+}
+
+void IPlugAPIBase::SendParamValuesToProcessor(const double* pValues, int crossfadeSamples)
+{
+  ParamValuesSnapshot& snapshot = mParamValuesFromUI.GetWriteBuffer();
+  memcpy(snapshot.mValues.Get(), pValues, NParams() * sizeof(double));
+  snapshot.mCrossfadeSamples = std::max(crossfadeSamples, 0);
+  mParamValuesFromUI.Publish();
+}
+
+bool IPlugAPIBase::RestorePresetWithoutBlocking(int idx, int crossfadeSamples)
+{
+  IByteChunk chunk;
+
+  if (!GetPresetChunk(idx, chunk))
+    return false;
+
+  ParamValuesSnapshot& snapshot = mParamValuesFromUI.GetWriteBuffer();
+
+  if (GetParamValuesFromChunk(chunk, 0, snapshot.mValues.Get()) < 0)
+    return false;
+
+  snapshot.mCrossfadeSamples = std::max(crossfadeSamples, 0);
+  mParamValuesFromUI.Publish();
+
+  SetCurrentPresetIdx(idx);
+  OnPresetsModified();
+  return true;
+}
+
+void IPlugAPIBase::ProcessParamValuesFromUI(int nFrames)
+{
+  const int n = NParams();
+
+  if (mParamValuesFromUI.Update())
+  {
+    for (int i = 0; i < n; i++)
+      mCrossfadeStartValues.Get()[i] = GetParam(i)->Value();
+
+    mCrossfadePos = 0;
+    mApplyingParamValues = true;
+  }
+
+  if (!mApplyingParamValues)
+    return;
+
+  const ParamValuesSnapshot& snapshot = mParamValuesFromUI.GetReadBuffer();
+  const double* pTargets = snapshot.mValues.Get();
+  const double* pStarts = mCrossfadeStartValues.Get();
+
+  mCrossfadePos += nFrames;
+  const double t = snapshot.mCrossfadeSamples > 0 ? std::min(static_cast<double>(mCrossfadePos) / snapshot.mCrossfadeSamples, 1.) : 1.;
+
+  for (int i = 0; i < n; i++)
+  {
+    IParam* pParam = GetParam(i);
+    double value = pTargets[i];
+
+    if (t < 1.)
+    {
+      const bool continuous = pParam->Type() == IParam::kTypeDouble && !pParam->GetStepped();
+
+      if (continuous)
+        value = pStarts[i] + (pTargets[i] - pStarts[i]) * t;
+      else if (t < 0.5)
+        value = pStarts[i];
+    }
+
+    const double before = pParam->Value();
+    pParam->Set(value);
+
+    if (pParam->Value() != before)
+      OnParamChange(i, kPresetRecall);
+  }
+
+  if (t >= 1.)
+  {
+    mApplyingParamValues = false;
+    mParamValuesApplied.store(true, std::memory_order_release);
+  }
 }
 
 void IPlugAPIBase::OnTimer(Timer& t)
 {
-  if(HasUI())
+  if (mParamValuesApplied.exchange(false, std::memory_order_acquire))
+  {
+    OnRestoreState(); // updates the UI
+    DirtyParametersFromUI(); // informs the host
+  }
+
+  const bool editorOpen = HasUI() && GetEditorOpen();
+  bool workPending = false;
+
+  // the API classes derive from IPlugProcessor too, apart from the controller of a distributed VST3 plug-in
+  if (IPlugProcessor* pProcessor = dynamic_cast<IPlugProcessor*>(this))
+  {
+    workPending = pProcessor->ApplyRequestedLatency();
+
+    IPlugProfiler& profiler = pProcessor->GetProfiler();
+
+    if (profiler.GetEnabled())
+    {
+      // its queue is sized for draining at the full rate
+      workPending = true;
+      profiler.Drain();
+
+      if (editorOpen && profiler.GetDisplayControlTag() != kNoTag)
+        SendControlMsgFromDelegate(profiler.GetDisplayControlTag(), IPlugProfiler::kUpdateMessage, sizeof(IProfileStats), &profiler.GetStats());
+    }
+  }
+
+#if defined VST3C_API || defined VST3_API
+  // parameter changes from setParamNormalized(), coalesced to the last value of each parameter since the last tick
+  mParamChangeFromProcessor.Drain([&](int paramIdx, double value) {
+    OnParamChangeUI(paramIdx, kHost);
+    SendParameterValueFromDelegate(paramIdx, value, false);
+  });
+#endif
+
+  if(editorOpen)
   {
 // VST3 ********************************************************************************
 #if defined VST3P_API || defined VST3_API
@@ -154,24 +319,23 @@ void IPlugAPIBase::OnTimer(Timer& t)
 #endif
     }
 
-    while (mSysExDataFromProcessor.ElementsAvailable())
+    SysExData sysEx;
+
+    while (mSysExDataFromProcessor.Pop(sysEx))
     {
-      SysExData msg;
-      mSysExDataFromProcessor.Pop(msg);
 #ifdef VST3P_API // distributed
-      TransmitSysExDataFromProcessor(msg);
+      TransmitSysExDataFromProcessor(sysEx);
 #else
-      SendSysexMsgFromDelegate({msg.mOffset, msg.mData, msg.mSize});
+      SendSysexMsgFromDelegate({sysEx.mOffset, sysEx.mData, sysEx.mSize});
 #endif
     }
+
+    mSysExDataFromProcessor.Release();
 // !VST3 ******************************************************************************
 #else
-    while(mParamChangeFromProcessor.ElementsAvailable())
-    {
-      ParamTuple p;
-      mParamChangeFromProcessor.Pop(p);
-      SendParameterValueFromDelegate(p.idx, p.value, false);
-    }
+    mParamChangeFromProcessor.Drain([&](int paramIdx, double value) {
+      SendParameterValueFromDelegate(paramIdx, value, false);
+    });
     
     while (mMidiMsgsFromProcessor.ElementsAvailable())
     {
@@ -180,16 +344,36 @@ void IPlugAPIBase::OnTimer(Timer& t)
       SendMidiMsgFromDelegate(msg);
     }
     
-    while (mSysExDataFromProcessor.ElementsAvailable())
-    {
-      SysExData msg;
-      mSysExDataFromProcessor.Pop(msg);
-      SendSysexMsgFromDelegate({msg.mOffset, msg.mData, msg.mSize});
-    }
+    SysExData sysEx;
+
+    while (mSysExDataFromProcessor.Pop(sysEx))
+      SendSysexMsgFromDelegate({sysEx.mOffset, sysEx.mData, sysEx.mSize});
+
+    mSysExDataFromProcessor.Release();
+#endif
+  }
+  else if(HasUI())
+  {
+    // nothing is showing them, and they would be stale by the time the editor opens, which sends the current parameter values anyway
+#if !defined VST3P_API && !defined VST3_API
+    mParamChangeFromProcessor.Drain([](int paramIdx, double value) {});
 #endif
+    IMidiMsg msg;
+
+    while (mMidiMsgsFromProcessor.Pop(msg)) {}
+
+    SysExData sysEx;
+
+    while (mSysExDataFromProcessor.Pop(sysEx)) {}
+
+    mSysExDataFromProcessor.Release();
   }
   
   OnIdle();
+  TransmitMsgBatch();
+
+  mTimerWorkPending = workPending;
+  UpdateTimerRate();
 }
 
 void IPlugAPIBase::SendMidiMsgFromUI(const IMidiMsg& msg)
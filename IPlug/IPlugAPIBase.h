@@ -53,6 +53,7 @@ public:
 
   /** Override this method to implement a custom comparison of incoming state data with your plug-ins state data, in order
    * to support the ProTools compare light when using custom state chunks. The default implementation will compare the serialized parameters.
+   * While GetStateVersion() stays the same, comparing the same data again returns the last answer straight away, so an override can do the same with its own cache
    * @param pIncomingState The incoming state data
    * @param startPos The position to start in the incoming data in bytes
    * @return \c true in order to indicate that the states are equal. */
@@ -107,7 +108,8 @@ public:
 #endif
   }
 
-  /** Override this method to get an "idle"" call on the main thread */
+  /** Override this method to get an "idle"" call on the main thread. It is called every IDLE_TIMER_RATE ms while the editor is open, and only every
+   * IDLE_TIMER_RATE_BACKGROUND ms while it is closed, unless SetIdleRequired() asks for the full rate */
   virtual void OnIdle() {}
     
 #pragma mark - Methods you can call - some of which have custom implementations in the API classes, some implemented in IPlugAPIBase.cpp
@@ -136,8 +138,33 @@ public:
    * you can call this to update the parameters on the DSP side */
   virtual void DirtyParametersFromUI() override;
 
+  /** Send a complete set of parameter values to the audio thread without taking the parameters mutex. The audio thread applies them at the start of its next block,
+   * calling OnParamChange() with kPresetRecall (on the audio thread) for the parameters that change, and the UI and host are updated afterwards on the main thread.
+   * If several sets are sent before the audio thread picks one up, only the latest is applied. Call from one thread only, usually the main thread
+   * @param pValues NParams() non-normalised values
+   * @param crossfadeSamples Move to the new values over this many samples, a block at a time. Continuous parameters are interpolated, while stepped, boolean, integer and enumerated parameters switch half way through. 0 applies them all at once */
+  void SendParamValuesToProcessor(const double* pValues, int crossfadeSamples = 0);
+
+  /** Restore a preset's parameter values with SendParamValuesToProcessor(), so that the audio thread is never blocked. Only the parameters are restored,
+   * so this suits plug-ins whose presets are made by SerializeParams() or SerializeParamsCompact(), i.e. that don't override SerializeState() to store other data in front of the parameters. Call from the main thread
+   * @param idx The index of the preset to restore
+   * @param crossfadeSamples See SendParamValuesToProcessor()
+   * @return \c true if the preset's values were sent */
+  bool RestorePresetWithoutBlocking(int idx, int crossfadeSamples = 0);
+
+  /** Call this when state that SerializeState() writes, other than the parameter values, changes, e.g. custom chunk data, so that GetStateVersion() changes too */
+  void DirtyState() { mStateVersion.fetch_add(1, std::memory_order_release); }
+
+  /** @return A number that changes whenever a parameter's value is set, on any thread, or DirtyState() is called, so that CompareState() and serialization can tell that nothing has changed since they last ran.
+   * The parameter values are tracked through the change flags the API classes attach in their constructors, without them every call returns a new number */
+  uint32_t GetStateVersion() const;
+
 #pragma mark - Methods called by the API class - you do not call these methods in your plug-in class
 
+  /** Called by the API classes on the audio thread at the start of each block, to apply or continue applying values sent by SendParamValuesToProcessor()
+   * @param nFrames The number of frames in the block */
+  void ProcessParamValuesFromUI(int nFrames);
+
   /** This is called from the plug-in API class in order to update UI controls linked to plug-in parameters, prior to calling OnParamChange()
    * NOTE: It may be called on the high priority audio thread. Its purpose is to place parameter changes in a queue to defer to main thread for the UI
    * @param paramIdx The index of the parameter that changed
@@ -178,12 +205,36 @@ public:
   
   void DeferSysexMsg(const ISysEx& msg) override
   {
-    SysExData data(msg.mOffset, msg.mSize, msg.mData); // copies data
-    mSysExDataFromEditor.Push(data);
+    mSysExDataFromEditor.Push(msg); // copies data
   }
 
-  /** Called by the API class to create the timer that pumps the parameter/message queues */
-  void CreateTimer();
+  /** Call this if OnIdle() needs to run at IDLE_TIMER_RATE even while the editor is closed, e.g. to poll a device or a file. Otherwise, in plug-in
+   * formats that report the editor opening and closing, the timer slows to IDLE_TIMER_RATE_BACKGROUND while it is closed, so that a session
+   * with hundreds of instances doesn't wake the main thread for each of them every few milliseconds
+   * @param required \c true to keep the full rate */
+  void SetIdleRequired(bool required)
+  {
+    mIdleRequired = required;
+
+    if (mTimer)
+      UpdateTimerRate();
+  }
+
+  /** @return \c false if the API class has reported that the editor is closed */
+  bool GetEditorOpen() const { return mEditorOpen || !mReportsEditor; }
+
+  /** Called by the API class to create the timer that pumps the parameter/message queues
+   * @param reportsEditor \c true if the API class calls SetEditorOpen() when the host opens and closes the editor. Otherwise the editor is always treated as open */
+  void CreateTimer(bool reportsEditor = false);
+
+  /** Called by the API class when the host opens or closes the editor, if it passed reportsEditor to CreateTimer() */
+  void SetEditorOpen(bool open)
+  {
+    mEditorOpen = open;
+
+    if (mTimer)
+      UpdateTimerRate();
+  }
   
 private:
   /** Implementations call into the APIs resize hooks
@@ -210,8 +261,14 @@ private:
   /** \todo */
   virtual void TransmitSysExDataFromProcessor(const SysExData& data) {}
 
+  /** Called at the end of each timer tick, after OnIdle(), to send the messages queued for the other half of the plug-in during the tick together */
+  virtual void TransmitMsgBatch() {}
+
   void OnTimer(Timer& t);
 
+  /** Create the timer, or recreate it at IDLE_TIMER_RATE or IDLE_TIMER_RATE_BACKGROUND if it should run at the other rate. Safe to call from the timer's own callback */
+  void UpdateTimerRate();
+
   friend class IPlugAPP;
   friend class IPlugAAX;
   friend class IPlugVST2;
@@ -222,17 +279,40 @@ private:
   friend class IPlugAUv3;
   friend class IPlugWEB;
   friend class IPlugWAM;
+  friend class IPlugCLAP;
 
 private:
+  struct ParamValuesSnapshot
+  {
+    WDL_TypedBuf<double> mValues;
+    int mCrossfadeSamples = 0;
+  };
+
   WDL_String mParamDisplayStr;
   std::unique_ptr<Timer> mTimer;
+  uint32_t mTimerRate = 0; // ms
+  bool mReportsEditor = false; // see CreateTimer()
+  bool mEditorOpen = false; // as reported by SetEditorOpen()
+  bool mIdleRequired = false;
+  bool mTimerWorkPending = false; // set by OnTimer() while something, e.g. the profiler or a settling latency, needs the full rate
+
+  IPlugTripleBuffer<ParamValuesSnapshot> mParamValuesFromUI; // complete sets of parameter values sent to the audio thread by SendParamValuesToProcessor()
+  WDL_TypedBuf<double> mCrossfadeStartValues; // audio thread, the values when the current set of values started to be applied
+  int mCrossfadePos = 0;
+  bool mApplyingParamValues = false;
+  std::atomic<bool> mParamValuesApplied {false}; // set by the audio thread when a set of values has been applied, so the main thread can update the UI and host
   
-  IPlugQueue<ParamTuple> mParamChangeFromProcessor {PARAM_TRANSFER_SIZE};
-  IPlugQueue<IMidiMsg> mMidiMsgsFromEditor {MIDI_TRANSFER_SIZE}; // a queue of midi messages generated in the editor by clicking keyboard UI etc
+  mutable std::atomic<uint32_t> mStateVersion {0}; // see DirtyState(), GetStateVersion() adds the parameter change flags' version
+  mutable WDL_TypedBuf<uint8_t> mComparedState; // main thread, the parameter data CompareState() last compared
+  mutable uint32_t mComparedStateVersion = 0;
+  mutable bool mComparedStateEqual = false;
+
+  IPlugCoalescingQueue<double> mParamChangeFromProcessor; // latest non-normalized value of each parameter changed by the host, sized to NParams()
+  IPlugMPMCQueue<IMidiMsg> mMidiMsgsFromEditor {MIDI_TRANSFER_SIZE}; // a queue of midi messages generated in the editor by clicking keyboard UI etc, can be pushed from several threads (UI, OSC, websocket)
   IPlugQueue<IMidiMsg> mMidiMsgsFromProcessor {MIDI_TRANSFER_SIZE}; // a queue of MIDI messages received (potentially on the high priority thread), by the processor to send to the editor
-  IPlugQueue<SysExData> mSysExDataFromEditor {SYSEX_TRANSFER_SIZE}; // a queue of SYSEX data to send to the processor
-  IPlugQueue<SysExData> mSysExDataFromProcessor {SYSEX_TRANSFER_SIZE}; // a queue of SYSEX data to send to the editor
-  SysExData mSysexBuf;
+  IPlugSysExQueue mSysExDataFromEditor {SYSEX_TRANSFER_BYTES}; // a queue of SYSEX data to send to the processor, can be pushed from several threads
+  IPlugSysExQueue mSysExDataFromProcessor {SYSEX_TRANSFER_BYTES}; // a queue of SYSEX data to send to the editor
+  SysExData mSysexBuf; // points into mSysExDataFromEditor's arena
 };
 
 END_IPLUG_NAMESPACE
@@ -37,9 +37,7 @@ using PLUG_SAMPLE_SRC = double;
 
 using sample = PLUG_SAMPLE_DST;
 
-#define LOGFILE "IPlugLog.txt"
-#define MAX_PROCESS_TRACE_COUNT 100
-#define MAX_IDLE_TRACE_COUNT 15
+#define LOGFILE "IPlugLog.json"
 
 enum EIPlugPluginType
 {
@@ -111,19 +109,33 @@ static const int MAX_PARAM_DISPLAY_PRECISION = 6;
 #define IDLE_TIMER_RATE 20 // this controls the frequency of data going from processor to editor (and OnIdle calls)
 #endif
 
-#ifndef MAX_SYSEX_SIZE
-#define MAX_SYSEX_SIZE 512
+#ifndef IDLE_TIMER_RATE_BACKGROUND
+#define IDLE_TIMER_RATE_BACKGROUND 250 // the slower rate the timer drops to while the editor is closed, see IPlugAPIBase::SetIdleRequired()
+#endif
+
+#ifndef LATENCY_SETTLE_TICKS
+#define LATENCY_SETTLE_TICKS 10 // the number of idle timer ticks a latency from IPlugProcessor::RequestLatency() must stay the same for before the host is told
 #endif
 
 #define PARAM_TRANSFER_SIZE 512
+
+#ifndef PARAM_AUTOMATION_LIST_SIZE
+#define PARAM_AUTOMATION_LIST_SIZE 1024 // maximum number of automation points per block, when sample accurate automation is enabled
+#endif
 #define MIDI_TRANSFER_SIZE 32
-#define SYSEX_TRANSFER_SIZE 4
+#ifndef SYSEX_TRANSFER_BYTES
+#define SYSEX_TRANSFER_BYTES 2048 // the size of the arena of each SysEx queue, which is shared by the messages in it. The largest message is a little under half this
+#endif
 
 // All version ints are stored as 0xVVVVRRMM: V = version, R = revision, M = minor revision.
 #define IPLUG_VERSION 0x010000
 #define IPLUG_VERSION_MAGIC 'pfft'
+#define IPLUG_COMPACT_PARAMS_MAGIC 'pcmp' // see IPluginBase::SerializeParamsCompact()
+#define IPLUG_COMPACT_PARAMS_VERSION 1
 
 static const int DEFAULT_BLOCK_SIZE = 1024;
+static const int DEFAULT_MIN_SLICE_SIZE = 16;
+static const double SILENCE_THRESHOLD = 1e-9; // about -180dB, samples below this count as silence for silence skipping
 static const double DEFAULT_TEMPO = 120.0;
 static const int kNoParameter = -1;
 static const int kNoValIdx = -1;
@@ -183,7 +195,9 @@ enum EAPI
   kAPIAAX = 4,
   kAPIAPP = 5,
   kAPIWAM = 6,
-  kAPIWEB = 7
+  kAPIWEB = 7,
+  kAPIBENCH = 8,
+  kAPICLAP = 9
 };
 
 /** @enum EHost
@@ -250,7 +264,8 @@ enum EResourceLocation
   kNotFound = 0,
   kAbsolutePath,
   kWinBinary,
-  kPreloadedTexture
+  kPreloadedTexture,
+  kResourcePack
 };
 
 // These constants come from vstpreset.cpp, allowing saving of VST3 format presets without including the VST3 SDK
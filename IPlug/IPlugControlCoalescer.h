@@ -0,0 +1,183 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IControlCoalescer
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Latest-value slots per control tag, which the editor delegates use to deliver what the DSP sends with SendControlValueFromDelegate() and SendControlMsgFromDelegate()
+ * once per frame, rather than as it is sent. For each control tag there is one value slot, holding the newest value and the lowest and highest values since the last Flush().
+ * Messages are only coalesced for the control tags SetMsgCoalescing() was called for, with one slot for each message tag holding a copy of the newest message's data.
+ * Not thread safe, it is used on the main thread */
+class IControlCoalescer
+{
+public:
+  /** The values sent to one control since the last Flush() */
+  struct ValueSlot
+  {
+    int mCtrlTag;
+    double mValue; // the newest
+    double mMin;
+    double mMax;
+    int mCount; // the number of values sent
+  };
+
+  /** Put a value in its control's slot
+   * @param ctrlTag The control's tag
+   * @param value The normalized value */
+  void AddValue(int ctrlTag, double value)
+  {
+    for (auto& slot : mValues)
+    {
+      if (slot.mCtrlTag == ctrlTag)
+      {
+        slot.mValue = value;
+        slot.mMin = std::min(slot.mMin, value);
+        slot.mMax = std::max(slot.mMax, value);
+        slot.mCount++;
+        return;
+      }
+    }
+
+    mValues.push_back({ctrlTag, value, value, value, 1});
+  }
+
+  /** @param ctrlTag The control's tag
+   * @param coalesce \c true to keep only the newest message of each message tag sent to the control, \c false to deliver every message */
+  void SetMsgCoalescing(int ctrlTag, bool coalesce)
+  {
+    auto it = std::find(mCoalescedCtrlTags.begin(), mCoalescedCtrlTags.end(), ctrlTag);
+
+    if (coalesce && it == mCoalescedCtrlTags.end())
+      mCoalescedCtrlTags.push_back(ctrlTag);
+    else if (!coalesce && it != mCoalescedCtrlTags.end())
+      mCoalescedCtrlTags.erase(it);
+  }
+
+  /** @return \c true if SetMsgCoalescing() was called for the control tag, in which case its messages should be given to AddMsg() */
+  bool GetMsgCoalescing(int ctrlTag) const
+  {
+    return !mCoalescedCtrlTags.empty() && std::find(mCoalescedCtrlTags.begin(), mCoalescedCtrlTags.end(), ctrlTag) != mCoalescedCtrlTags.end();
+  }
+
+  /** Copy a message into its slot, replacing the message with the same control and message tags that is already there
+   * @param ctrlTag The control's tag
+   * @param msgTag The message's tag
+   * @param dataSize The size of the data in bytes
+   * @param pData The data, which is copied */
+  void AddMsg(int ctrlTag, int msgTag, int dataSize, const void* pData)
+  {
+    MsgSlot* pSlot = nullptr;
+
+    for (auto& slot : mMsgs)
+    {
+      if (slot.mCtrlTag == ctrlTag && slot.mMsgTag == msgTag)
+      {
+        pSlot = &slot;
+        break;
+      }
+    }
+
+    if (!pSlot)
+    {
+      mMsgs.push_back({ctrlTag, msgTag, 0, 0});
+      pSlot = &mMsgs.back();
+    }
+    else if (dataSize <= pSlot->mSize)
+    {
+      pSlot->mSize = dataSize;
+
+      if (dataSize)
+        memcpy(mMsgData.data() + pSlot->mOffset, pData, dataSize);
+
+      return;
+    }
+
+    // a new slot, or a larger message than the slot's, is appended, and the old data is dropped at the next Flush()
+    const int offset = static_cast<int>((mMsgData.size() + kDataAlignment - 1) & ~(kDataAlignment - 1));
+    mMsgData.resize(offset + dataSize);
+
+    if (dataSize)
+      memcpy(mMsgData.data() + offset, pData, dataSize);
+
+    pSlot->mOffset = offset;
+    pSlot->mSize = dataSize;
+  }
+
+  /** @return \c true if there is nothing to flush */
+  bool Empty() const { return mValues.empty() && mMsgs.empty(); }
+
+  /** Deliver the values, then the messages, and empty the slots. Values and messages sent while it is delivering are kept for the next Flush()
+   * @param valueFunc Called with a const ValueSlot& for each control that was sent a value, in the order they were first sent
+   * @param msgFunc Called with (int ctrlTag, int msgTag, int dataSize, const void* pData) for each message slot. pData is nullptr if dataSize is 0, otherwise aligned to kDataAlignment */
+  template <class VF, class MF>
+  void Flush(VF&& valueFunc, MF&& msgFunc)
+  {
+    if (Empty())
+      return;
+
+    // swapped out, keeping the capacity of both sets for the next frames
+    std::swap(mValues, mFlushValues);
+    std::swap(mMsgs, mFlushMsgs);
+    std::swap(mMsgData, mFlushMsgData);
+
+    for (const auto& slot : mFlushValues)
+      valueFunc(slot);
+
+    for (const auto& slot : mFlushMsgs)
+      msgFunc(slot.mCtrlTag, slot.mMsgTag, slot.mSize, slot.mSize ? static_cast<const void*>(mFlushMsgData.data() + slot.mOffset) : nullptr);
+
+    mFlushValues.clear();
+    mFlushMsgs.clear();
+    mFlushMsgData.clear();
+  }
+
+  /** Empty the slots without delivering them, e.g. when the editor closes. Which control tags have their messages coalesced is kept */
+  void Clear()
+  {
+    mValues.clear();
+    mMsgs.clear();
+    mMsgData.clear();
+  }
+
+  /** The alignment of the message data passed to Flush()'s msgFunc, so that receivers can cast it to a struct */
+  static constexpr int kDataAlignment = alignof(std::max_align_t);
+
+private:
+  struct MsgSlot
+  {
+    int mCtrlTag;
+    int mMsgTag;
+    int mOffset; // into mMsgData
+    int mSize;
+  };
+
+  std::vector<ValueSlot> mValues;
+  std::vector<MsgSlot> mMsgs;
+  std::vector<unsigned char> mMsgData; // allocated with new, so at least as aligned as kDataAlignment
+  std::vector<ValueSlot> mFlushValues;
+  std::vector<MsgSlot> mFlushMsgs;
+  std::vector<unsigned char> mFlushMsgData;
+  std::vector<int> mCoalescedCtrlTags;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,150 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IDenormalScope
+ */
+
+#include <atomic>
+#include <cstdint>
+
+#include "IPlugPlatform.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+  #define IPLUG_DENORMAL_MXCSR
+  #include <xmmintrin.h>
+#elif defined(_M_ARM64)
+  #define IPLUG_DENORMAL_FPCR
+  #include <intrin.h>
+#elif defined(__aarch64__)
+  #define IPLUG_DENORMAL_FPCR
+#elif defined(__arm__) && defined(__ARM_FP)
+  #define IPLUG_DENORMAL_FPSCR
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Flushes denormals to zero on the current thread for the lifetime of the object, and restores the previous floating point mode afterwards.
+ * Decaying filter and reverb states reach the denormal range, where arithmetic is many times slower on most CPUs, and hosts don't all set the mode themselves.
+ * The API classes put one around each of their audio callbacks, unless the plug-in has opted out with IPlugProcessor::SetFlushDenormals().
+ * - x86: sets FTZ (results) and DAZ (inputs) in MXCSR
+ * - ARM64: sets FZ in FPCR, which flushes both results and inputs
+ * - 32 bit ARM with a VFP: sets FZ in FPSCR
+ * - WebAssembly and other targets have no such mode, and the scope does nothing
+ *
+ * If a counter is given, the scope clears the sticky underflow flag at the start and adds one to the counter at the end if the flag was set, that is if the
+ * code inside produced a result that would have been a denormal. IPlugProcessor does this in debug builds, see IPlugProcessor::GetNDenormalBlocks() */
+class IDenormalScope final
+{
+public:
+  /** @param flush \c false to leave the mode alone, so that an opt out doesn't need a second code path
+   * @param pUnderflowCount If not nullptr, incremented at the end of the scope if an underflow happened inside it */
+  IDenormalScope(bool flush = true, std::atomic<int>* pUnderflowCount = nullptr)
+  : mFlush(flush)
+  , mpUnderflowCount(pUnderflowCount)
+  {
+    if (!mFlush && !mpUnderflowCount)
+      return;
+
+#if defined IPLUG_DENORMAL_MXCSR
+    mSaved = _mm_getcsr();
+    _mm_setcsr((mSaved | (mFlush ? kFTZ | kDAZ : 0)) & ~kUnderflow);
+#elif defined IPLUG_DENORMAL_FPCR
+    mSaved = ReadFPCR();
+
+    if (mFlush)
+      WriteFPCR(mSaved | kFZ);
+
+    if (mpUnderflowCount)
+    {
+      mSavedStatus = ReadFPSR();
+      WriteFPSR(mSavedStatus & ~kUnderflow);
+    }
+#elif defined IPLUG_DENORMAL_FPSCR
+    mSaved = ReadFPSCR();
+    WriteFPSCR((mSaved | (mFlush ? kFZ : 0)) & ~kUnderflow);
+#endif
+  }
+
+  ~IDenormalScope()
+  {
+    if (!mFlush && !mpUnderflowCount)
+      return;
+
+#if defined IPLUG_DENORMAL_MXCSR
+    const uint32_t current = _mm_getcsr();
+
+    if (mpUnderflowCount && (current & kUnderflow))
+      (*mpUnderflowCount)++;
+
+    // keep the host's sticky exception flags as they were
+    _mm_setcsr(mSaved);
+#elif defined IPLUG_DENORMAL_FPCR
+    if (mpUnderflowCount)
+    {
+      if (ReadFPSR() & kUnderflow)
+        (*mpUnderflowCount)++;
+
+      WriteFPSR(mSavedStatus);
+    }
+
+    if (mFlush)
+      WriteFPCR(mSaved);
+#elif defined IPLUG_DENORMAL_FPSCR
+    if (mpUnderflowCount && (ReadFPSCR() & kUnderflow))
+      (*mpUnderflowCount)++;
+
+    WriteFPSCR(mSaved);
+#endif
+  }
+
+  IDenormalScope(const IDenormalScope&) = delete;
+  IDenormalScope& operator=(const IDenormalScope&) = delete;
+
+private:
+#if defined IPLUG_DENORMAL_MXCSR
+  static constexpr uint32_t kFTZ = 0x8000;
+  static constexpr uint32_t kDAZ = 0x0040;
+  static constexpr uint32_t kUnderflow = 0x0010;
+  uint32_t mSaved = 0;
+#elif defined IPLUG_DENORMAL_FPCR
+  static constexpr uint64_t kFZ = 1ull << 24;
+  static constexpr uint64_t kUnderflow = 1ull << 3; // FPSR.UFC
+  uint64_t mSaved = 0;
+  uint64_t mSavedStatus = 0;
+
+  #if defined(_M_ARM64)
+  static uint64_t ReadFPCR() { return _ReadStatusReg(0x5A20); } // ARM64_SYSREG(3, 3, 4, 4, 0)
+  static void WriteFPCR(uint64_t value) { _WriteStatusReg(0x5A20, value); }
+  static uint64_t ReadFPSR() { return _ReadStatusReg(0x5A21); } // ARM64_SYSREG(3, 3, 4, 4, 1)
+  static void WriteFPSR(uint64_t value) { _WriteStatusReg(0x5A21, value); }
+  #else
+  static uint64_t ReadFPCR() { uint64_t value; __asm__ __volatile__("mrs %0, fpcr" : "=r"(value)); return value; }
+  static void WriteFPCR(uint64_t value) { __asm__ __volatile__("msr fpcr, %0" : : "r"(value)); }
+  static uint64_t ReadFPSR() { uint64_t value; __asm__ __volatile__("mrs %0, fpsr" : "=r"(value)); return value; }
+  static void WriteFPSR(uint64_t value) { __asm__ __volatile__("msr fpsr, %0" : : "r"(value)); }
+  #endif
+#elif defined IPLUG_DENORMAL_FPSCR
+  static constexpr uint32_t kFZ = 1u << 24;
+  static constexpr uint32_t kUnderflow = 1u << 3; // FPSCR.UFC
+  uint32_t mSaved = 0;
+
+  static uint32_t ReadFPSCR() { uint32_t value; __asm__ __volatile__("vmrs %0, fpscr" : "=r"(value)); return value; }
+  static void WriteFPSCR(uint32_t value) { __asm__ __volatile__("vmsr fpscr, %0" : : "r"(value)); }
+#endif
+
+  bool mFlush;
+  std::atomic<int>* mpUnderflowCount;
+};
+
+END_IPLUG_NAMESPACE
@@ -16,6 +16,7 @@
  */
 
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <stdint.h>
 
@@ -24,9 +25,17 @@
 #include "IPlugParameter.h"
 #include "IPlugMidi.h"
 #include "IPlugStructs.h"
+#include "IPlugMemoryReport.h"
+#include "IPlugControlCoalescer.h"
+
+#if defined OS_LINUX
+  #include "IPlugTimer.h"
+#endif
 
 BEGIN_IPLUG_NAMESPACE
 
+class IRunLoop;
+
 /** This pure virtual interface delegates communication in both directions between a UI editor and something else (which is usually a plug-in)
  *  It is also the class that owns parameter objects (for historical reasons) - although it's not necessary to allocate them
  *
@@ -55,6 +64,7 @@ public:
   
   virtual ~IEditorDelegate()
   {
+    SetHostRunLoop(nullptr);
     mParams.Empty(true);
   }
   
@@ -83,6 +93,19 @@ public:
 
   /** @return Returns the number of parameters that belong to the plug-in. */
   int NParams() const { return mParams.GetSize(); }
+
+  /** Add an estimate of the memory this delegate uses to a report. The base implementation counts the parameters, IPluginBase adds presets, state and heap buffers, and IGraphics adds its own, see IGraphics::GetMemoryReport().
+   * Override it to add big allocations of your own, e.g. sample data with kMemoryOther, calling the base implementation. Call from the main thread
+   * @param report The report to add to */
+  virtual void GetMemoryReport(IMemoryReport& report) const
+  {
+    size_t bytes = mParams.GetSize() * sizeof(IParam*);
+
+    for (int i = 0; i < NParams(); i++)
+      bytes += GetParam(i)->GetMemorySize();
+
+    report.Add(kMemoryParameters, bytes);
+  }
   
   /** If you are not using IGraphics, you can implement this method to attach to the native parent view e.g. NSView, UIView, HWND.
    *  Defer calling OnUIOpen() if necessary. */
@@ -93,6 +116,27 @@ public:
 
   /** Called by app wrappers when the OS window scaling buttons/resizers are used */
   virtual void OnParentWindowResize(int width, int height) { /* NO-OP*/ }
+
+  /** Called by API classes on Linux, before OpenWindow(), with the host's event loop, which the UI registers its events and display timer with, see IRunLoop.
+   * The process's timers run from it too, see TimerService::AddRunLoop(), so set it back to nullptr before the loop is destroyed
+   * @param pRunLoop The host's loop, or nullptr after CloseWindow(), or if the host doesn't have one */
+  void SetHostRunLoop(IRunLoop* pRunLoop)
+  {
+#if defined OS_LINUX
+    if (pRunLoop == mHostRunLoop)
+      return;
+
+    if (mHostRunLoop)
+      TimerService::Get().RemoveRunLoop(mHostRunLoop);
+
+    if (pRunLoop)
+      TimerService::Get().AddRunLoop(pRunLoop);
+#endif
+    mHostRunLoop = pRunLoop;
+  }
+
+  /** @return The host's event loop, or nullptr */
+  IRunLoop* GetHostRunLoop() const { return mHostRunLoop; }
   
 #pragma mark - Methods you may want to override...
   /** Override this method to do something before the UI is opened. You must call the base implementation to make sure controls linked to parameters get updated correctly. */
@@ -176,6 +220,7 @@ public:
    * In IGraphics plug-ins, this method is used to update controls in the user interface from a class implementing IEditorDelegate, when the control is not linked to a parameter.
    * A typical use case would be a meter control.
    * In OnIdle() your plug-in would call this method to update the IControl's value.
+   * The IGraphics, WebView and distributed VST3 delegates coalesce the values sent to each control, and deliver only the newest one once per frame, see IControl::SetCoalescedValuesFromDelegate()
    * @param ctrlTag A tag for the control
    * @param normalizedValue The normalised value to set the control to. This will modify IControl::mValue; */
   virtual void SendControlValueFromDelegate(int ctrlTag, double normalizedValue) {};
@@ -184,11 +229,18 @@ public:
    * WARNING: should not be called on the realtime audio thread.
    * This method can be used to send opaque data from a class implementing IEditorDelegate to a specific control in the user interface.
    * The message can be handled in the destination control via IControl::OnMsgFromDelegate
+   * If SetControlMsgCoalescing() was called for the control, only the newest message of each msgTag is delivered, once per frame
    * @param ctrlTag A unique tag to identify the control that is the destination of the message
    * @param msgTag A unique tag to identify the message
    * @param dataSize The size in bytes of the data payload pointed to by pData. Note: if this is nonzero, pData must be valid.
    * @param pData Ptr to the opaque data payload for the message */
   virtual void SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize = 0, const void* pData = nullptr) { OnMessage(msgTag, ctrlTag, dataSize, pData); }
+
+  /** Have the editor receive only the newest message of each msgTag sent to a control with SendControlMsgFromDelegate(), once per frame, e.g. for a display that the DSP
+   * updates more often than it is drawn. The messages are copied until they are delivered. Don't use it for controls that need every message, such as the ones an ISender feeds
+   * @param ctrlTag The tag of the control
+   * @param coalesce \c true to coalesce its messages, \c false to deliver each of them */
+  void SetControlMsgCoalescing(int ctrlTag, bool coalesce = true) { mControlCoalescer.SetMsgCoalescing(ctrlTag, coalesce); }
   
   /** SendArbitraryMsgFromDelegate (Abbreviation: SAMFD)
    * WARNING: should not be called on the realtime audio thread.
@@ -347,6 +399,10 @@ public:
    * @param scale The new screen scale*/
   virtual void SetScreenScale(float scale) {}
 
+protected:
+  /** @return The slots the editor delegate keeps the values and messages sent to controls in until the next frame, see SendControlValueFromDelegate() */
+  IControlCoalescer& GetControlCoalescer() { return mControlCoalescer; }
+
   friend class IPlugAPP;
   friend class IPlugAAX;
   friend class IPlugVST2;
@@ -370,6 +426,10 @@ private:
   int mEditorHeight = 0;
   /** Editor sizing constraints */
   int mMinWidth = 10, mMaxWidth = 100000, mMinHeight = 10, mMaxHeight = 100000;
+  /** The host's event loop on Linux, not owned */
+  IRunLoop* mHostRunLoop = nullptr;
+  /** Values and messages for controls, waiting for the next frame */
+  IControlCoalescer mControlCoalescer;
 };
 
 END_IPLUG_NAMESPACE
@@ -16,7 +16,9 @@
  *
  * To trace some arbitrary data:                 Trace(TRACELOC, "%s:%d", myStr, myInt);
  * To simply create a trace entry in the log:    TRACE
+ * To trace the duration of a block:             TRACE_SCOPE("Reverb");
  * No need to wrap tracer calls in #ifdef TRACER_BUILD because Trace is a no-op unless TRACER_BUILD is defined.
+ * In a TRACER_BUILD events are recorded by IPlugTracer, which is cheap enough to use on the audio thread, and written to LOGFILE as a Chrome trace.
  */
 
 #include <cstdio>
@@ -33,6 +35,10 @@
 #include "IPlugConstants.h"
 #include "IPlugUtilities.h"
 
+#if defined TRACER_BUILD
+  #include "IPlugTracer.h"
+#endif
+
 BEGIN_IPLUG_NAMESPACE
 
 #ifdef NDEBUG
@@ -72,56 +78,18 @@ BEGIN_IPLUG_NAMESPACE
 
 #if defined TRACER_BUILD
   #define TRACE Trace(TRACELOC, "");
-
-  #if defined OS_WIN
-    #define SYS_THREAD_ID (intptr_t) GetCurrentThreadId()
-  #elif defined(OS_MAC) || defined(OS_LINUX) || defined(OS_WEB)
-    #define SYS_THREAD_ID (intptr_t) pthread_self()
-  #endif
-
-  #else
-    #define TRACE
-  #endif
+  #define TRACE_SCOPE(name) iplug::IPlugTracer::Scope TRACER_CONCAT(traceScope, __LINE__)(name);
+  #define TRACER_CONCAT_(a, b) a##b
+  #define TRACER_CONCAT(a, b) TRACER_CONCAT_(a, b)
+#else
+  #define TRACE
+  #define TRACE_SCOPE(name)
+#endif
 
   #define TRACELOC __FUNCTION__,__LINE__
-  static void Trace(const char* funcName, int line, const char* fmtStr, ...);
 
   #define APPEND_TIMESTAMP(str) AppendTimestamp(__DATE__, __TIME__, str)
 
-  struct LogFile
-  {
-    FILE* mFP;
-    
-    LogFile()
-    {
-  #ifdef OS_WIN
-      char logFilePath[MAX_WIN32_PATH_LEN];
-      snprintf(logFilePath, MAX_WIN32_PATH_LEN,"%s/%s", "C:\\", LOGFILE);
-  #else
-      char logFilePath[MAX_MACOS_PATH_LEN];
-      snprintf(logFilePath, MAX_MACOS_PATH_LEN, "%s/%s", getenv("HOME"), LOGFILE);
-  #endif
-      mFP = fopen(logFilePath, "w");
-      assert(mFP);
-      
-      DBGMSG("Logging to %s\n", logFilePath);
-    }
-    
-    ~LogFile()
-    {
-      fclose(mFP);
-      mFP = nullptr;
-    }
-    
-    LogFile(const LogFile&) = delete;
-    LogFile& operator=(const LogFile&) = delete;
-  };
-
-  static bool IsWhitespace(char c)
-  {
-    return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
-  }
-
   static const char* CurrentTime()
   {
     //    TODO: replace with std::chrono based version
@@ -147,14 +115,14 @@ BEGIN_IPLUG_NAMESPACE
     if (tz < 0) tz = -tz;
     snprintf(&cStr[i], 32, "%02d%02d", tz / 60, tz % 60);
     
-    static char sTimeStr[32];
+    thread_local char sTimeStr[32];
     strcpy(sTimeStr, cStr);
     return sTimeStr;
   }
 
   static const char* AppendTimestamp(const char* Mmm_dd_yyyy, const char* hh_mm_ss, const char* cStr)
   {
-    static WDL_String str;
+    thread_local WDL_String str;
     str.Set(cStr);
     str.Append(" ");
     WDL_String tStr;
@@ -172,107 +140,15 @@ BEGIN_IPLUG_NAMESPACE
 
   #if defined TRACER_BUILD
 
-  const int TXTLEN = 1024;
-
-  // _vsnsprintf
-
-  #define VARARGS_TO_STR(str) { \
-  try { \
-  va_list argList;  \
-  va_start(argList, format);  \
-  int i = vsnprintf(str, TXTLEN-2, format, argList); \
-  if (i < 0 || i > TXTLEN-2) {  \
-  str[TXTLEN-1] = '\0';  \
-  } \
-  va_end(argList);  \
-  } \
-  catch(...) {  \
-  strcpy(str, "parse error"); \
-  } \
-  strcat(str, "\r\n"); \
-  }
-
-  static intptr_t GetOrdinalThreadID(intptr_t sysThreadID)
+  /** Record a trace event, see IPlugTracer. It doesn't format, lock or allocate, so it can be called on the audio thread
+   * @param funcName The function name, use TRACELOC for this and line
+   * @param line The line number
+   * @param format A printf format string, which must be a string literal because it is formatted later, on the tracer's thread
+   * @param args The arguments, which can be integers, enums, floating point numbers, strings and pointers */
+  template <typename... Args>
+  void Trace(const char* funcName, int line, const char* format, const Args&... args)
   {
-    static WDL_TypedBuf<intptr_t> sThreadIDs;
-    int i, n = sThreadIDs.GetSize();
-    intptr_t* pThreadID = sThreadIDs.Get();
-    for (i = 0; i < n; ++i, ++pThreadID)
-    {
-      if (sysThreadID == *pThreadID)
-      {
-        return i;
-      }
-    }
-    sThreadIDs.Resize(n + 1);
-    *(sThreadIDs.Get() + n) = sysThreadID;
-    return n;
-  }
-
-  #define MAX_LOG_LINES 16384
-  void Trace(const char* funcName, int line, const char* format, ...)
-  {
-    static int sTrace = 0;
-    static int32_t sProcessCount = 0;
-    static int32_t sIdleCount = 0;
-
-    if (sTrace++ < MAX_LOG_LINES)
-    {
-  #ifndef TRACETOSTDOUT
-      static LogFile sLogFile;
-      assert(sLogFile.mFP);
-  #endif
-      static WDL_Mutex sLogMutex;
-      char str[TXTLEN];
-      VARARGS_TO_STR(str);
-      
-  #ifdef TRACETOSTDOUT
-      DBGMSG("[%ld:%s:%d]%s", GetOrdinalThreadID(SYS_THREAD_ID), funcName, line, str);
-  #else
-      WDL_MutexLock lock(&sLogMutex);
-      intptr_t threadID = GetOrdinalThreadID(SYS_THREAD_ID);
-      
-      if(strstr(funcName, "rocess") || strstr(funcName, "ender")) // These are not typos! by excluding the first character, we can use TRACE in methods called ProcessXXX or process etc.
-      {
-        if(++sProcessCount > MAX_PROCESS_TRACE_COUNT)
-        {
-          fflush(sLogFile.mFP);
-          return;
-        }
-        else if (sProcessCount == MAX_PROCESS_TRACE_COUNT)
-        {
-          fprintf(sLogFile.mFP, "**************** DISABLING PROCESS TRACING AFTER %d HITS ****************\n\n", sProcessCount);
-          fflush(sLogFile.mFP);
-          return;
-        }
-      }
-      
-#ifdef VST2_API
-      if(strstr(str, "effGetProgram") || strstr(str, "effEditGetRect") || strstr(funcName, "MouseOver"))
-#else
-      if(strstr(funcName, "MouseOver") || strstr(funcName, "idle"))
-#endif
-      {
-        if(++sIdleCount > MAX_IDLE_TRACE_COUNT)
-        {
-          fflush(sLogFile.mFP);
-          return;
-        }
-        else if (sIdleCount == MAX_IDLE_TRACE_COUNT)
-        {
-          fprintf(sLogFile.mFP, "**************** DISABLING IDLE/MOUSEOVER TRACING AFTER %d HITS ****************\n", sIdleCount);
-          fflush(sLogFile.mFP);
-          return;
-        }
-      }
-      
-      if (threadID > 0)
-        fprintf(sLogFile.mFP, "*** -");
-      
-      fprintf(sLogFile.mFP, "[%ld:%s:%d]%s", threadID, funcName, line, str);
-      fflush(sLogFile.mFP);
-  #endif
-    }
+    IPlugTracer::Get().Add('i', funcName, line, format, args...);
   }
 
   #ifdef VST2_API
@@ -641,7 +517,8 @@ BEGIN_IPLUG_NAMESPACE
   #endif // AU_API
 
 #else // TRACER_BUILD
-  static void Trace(const char* funcName, int line, const char* format, ...) {}
+  template <typename... Args>
+  void Trace(const char* funcName, int line, const char* format, const Args&... args) {}
 static const char* VSTOpcodeStr(int opCode) { return ""; }
   static const char* AUSelectStr(int select) { return ""; }
   static const char* AUPropertyStr(int propID) { return ""; }
@@ -0,0 +1,167 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IMemoryReport
+ */
+
+#include <cstddef>
+#include <cstring>
+
+#include "heapbuf.h"
+#include "wdlstring.h"
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The categories of memory that an IMemoryReport breaks its totals into */
+enum EMemoryCategory
+{
+  kMemoryParameters = 0,
+  kMemoryPresets,
+  kMemoryState,
+  kMemoryBitmaps,
+  kMemoryLayers,
+  kMemoryFonts,
+  kMemoryHeapBuffers,
+  kMemoryOther,
+  kNumMemoryCategories
+};
+
+/** An estimate of the memory that a plug-in instance uses, by category, as filled in by IPluginBase::GetMemoryReport() and IGraphics::GetMemoryReport().
+ * Each category has a per-instance total, which grows with every instance the host creates, and a shared total for the assets the instances in a process share, such as a preset bank, cached bitmaps and font data.
+ * The sizes are the bytes the data structures are known to hold, not those the allocator or the GPU driver actually reserves, so they are best used to compare categories and builds with each other.
+ *
+ * kMemoryHeapBuffers is only filled in when the project is built with WDL_HEAPBUF_ACCOUNTING, and then counts every WDL_HeapBuf (and WDL_TypedBuf, WDL_PtrList etc) that the plug-in class created, see IMemoryAccountScope.
+ * That includes DSP buffers but also the buffers behind some of the other categories, so it isn't added to the totals */
+class IMemoryReport
+{
+public:
+  IMemoryReport() { Clear(); }
+
+  /** Reset every category to 0 */
+  void Clear()
+  {
+    memset(mInstanceBytes, 0, sizeof(mInstanceBytes));
+    memset(mSharedBytes, 0, sizeof(mSharedBytes));
+  }
+
+  /** Add to a category
+   * @param category The category the memory belongs to
+   * @param bytes The number of bytes
+   * @param shared \c true if the memory is shared by the instances in the process, \c false if each instance has its own */
+  void Add(EMemoryCategory category, size_t bytes, bool shared = false)
+  {
+    (shared ? mSharedBytes : mInstanceBytes)[category] += bytes;
+  }
+
+  /** @param category The category
+   * @return The per-instance bytes in the category */
+  size_t GetInstanceBytes(EMemoryCategory category) const { return mInstanceBytes[category]; }
+
+  /** @param category The category
+   * @return The shared bytes in the category */
+  size_t GetSharedBytes(EMemoryCategory category) const { return mSharedBytes[category]; }
+
+  /** @return The per-instance bytes in every category except kMemoryHeapBuffers, which overlaps the others */
+  size_t GetInstanceTotal() const { return Total(mInstanceBytes); }
+
+  /** @return The shared bytes in every category except kMemoryHeapBuffers, which overlaps the others */
+  size_t GetSharedTotal() const { return Total(mSharedBytes); }
+
+  /** @return The category with the most per-instance bytes, not counting kMemoryHeapBuffers */
+  EMemoryCategory GetLargestInstanceCategory() const
+  {
+    int largest = 0;
+
+    for (int i = 1; i < kNumMemoryCategories; i++)
+    {
+      if (i != kMemoryHeapBuffers && mInstanceBytes[i] > mInstanceBytes[largest])
+        largest = i;
+    }
+
+    return static_cast<EMemoryCategory>(largest);
+  }
+
+  /** @param category The category
+   * @return A short name for the category, for display */
+  static const char* GetCategoryName(EMemoryCategory category)
+  {
+    static const char* names[kNumMemoryCategories] = { "parameters", "presets", "state", "bitmaps", "layers", "fonts", "heap buffers", "other" };
+    return names[category];
+  }
+
+  /** @param str Receives a line per non-empty category and the totals, e.g. for DBGMSG() */
+  void GetText(WDL_String& str) const
+  {
+    str.Set("");
+
+    for (int i = 0; i < kNumMemoryCategories; i++)
+    {
+      if (mInstanceBytes[i] || mSharedBytes[i])
+        str.AppendFormatted(128, "%-12s %10.1f KB per instance, %10.1f KB shared\n", GetCategoryName(static_cast<EMemoryCategory>(i)), mInstanceBytes[i] / 1024., mSharedBytes[i] / 1024.);
+    }
+
+    str.AppendFormatted(128, "%-12s %10.1f KB per instance, %10.1f KB shared\n", "total", GetInstanceTotal() / 1024., GetSharedTotal() / 1024.);
+  }
+
+private:
+  static size_t Total(const size_t* pBytes)
+  {
+    size_t total = 0;
+
+    for (int i = 0; i < kNumMemoryCategories; i++)
+    {
+      if (i != kMemoryHeapBuffers)
+        total += pBytes[i];
+    }
+
+    return total;
+  }
+
+  size_t mInstanceBytes[kNumMemoryCategories];
+  size_t mSharedBytes[kNumMemoryCategories];
+};
+
+/** While one of these exists, the WDL heap buffers created on its thread are charged to a new account, which the IPluginBase constructed in its lifetime adopts for its kMemoryHeapBuffers category.
+ * The functions in IPlug_include_in_plug_src.h that construct the plug-in class make one, so that buffers created by the plug-in's constructor and its members are counted, wherever they are resized later.
+ * Does nothing unless the project is built with WDL_HEAPBUF_ACCOUNTING */
+class IMemoryAccountScope
+{
+public:
+#ifdef WDL_HEAPBUF_ACCOUNTING
+  IMemoryAccountScope()
+  : mAccount(new WDL_HeapBuf_Account)
+  , mScope(mAccount)
+  {}
+
+  ~IMemoryAccountScope()
+  {
+    mAccount->Release();
+  }
+#else
+  IMemoryAccountScope() {}
+#endif
+
+  IMemoryAccountScope(const IMemoryAccountScope&) = delete;
+  IMemoryAccountScope& operator=(const IMemoryAccountScope&) = delete;
+
+#ifdef WDL_HEAPBUF_ACCOUNTING
+private:
+  WDL_HeapBuf_Account* mAccount;
+  WDL_HeapBuf_Account::Scope mScope;
+#endif
+};
+
+END_IPLUG_NAMESPACE
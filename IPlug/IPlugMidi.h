@@ -672,120 +672,228 @@ void MyPlug::ProcessBlock(double** inputs, double** outputs, int nFrames)
   #define DEFAULT_BLOCK_SIZE 512
 #endif
 
-/** A class to help with queuing timestamped MIDI messages
+/** A class to help with queuing timestamped MIDI messages.
+ * The queue has a fixed capacity, allocated by the constructor and Resize(), so Add() never allocates on the audio thread. If the queue is full the
+ * message is dropped and counted, see GetNumOverflows(). Messages are kept in buckets of kBucketFrames samples, so a message arriving in order is
+ * appended to its bucket's tail and one arriving out of order is only sorted among the few messages sharing its bucket.
+ * Define DONT_SORT_IMIDIQUEUE to keep the messages in the order they are added instead.
   * @ingroup IPlugUtilities */
 class IMidiQueue
 {
 public:
+  /** The number of samples of offsets sharing each bucket, e.g. a MidiSynth sub-block */
+  static constexpr int kBucketFrames = 32;
+
   IMidiQueue(int size = DEFAULT_BLOCK_SIZE)
-  : mBuf(NULL), mSize(0), mGrow(Granulize(size)), mFront(0), mBack(0)
   {
-    Expand();
+    Resize(size);
   }
   
   ~IMidiQueue()
   {
     free(mBuf);
+    free(mNext);
+    free(mHead);
+    free(mTail);
   }
 
-  // Adds a MIDI message at the back of the queue. If the queue is full,
-  // it will automatically expand itself.
+  IMidiQueue(const IMidiQueue&) = delete;
+  IMidiQueue& operator=(const IMidiQueue&) = delete;
+
+  // Adds a MIDI message to the queue, after any messages with the same or
+  // earlier offsets. If the queue is full, the message is dropped.
   void Add(const IMidiMsg& msg)
   {
-    if (mBack >= mSize)
+    if (mFree < 0)
     {
-      if (mFront > 0)
-        Compact();
-      else if (!Expand()) return;
+      ++mNumOverflows;
+      return;
     }
 
-#ifndef DONT_SORT_IMIDIQUEUE
-    // Insert the MIDI message at the right offset.
-    if (mBack > mFront && msg.mOffset < mBuf[mBack - 1].mOffset)
-    {
-      int i = mBack - 2;
-      while (i >= mFront && msg.mOffset < mBuf[i].mOffset) --i;
-      i++;
-      memmove(&mBuf[i + 1], &mBuf[i], (mBack - i) * sizeof(IMidiMsg));
-      mBuf[i] = msg;
-    }
-    else
-#endif
-      mBuf[mBack] = msg;
-    ++mBack;
+    int i = mFree;
+    mFree = mNext[i];
+    mBuf[i] = msg;
+    Link(i);
+    ++mCount;
   }
 
-  // Removes a MIDI message from the front of the queue (but does *not*
-  // free up its space until Compact() is called).
-  inline void Remove() { ++mFront; }
+  // Removes a MIDI message from the front of the queue.
+  inline void Remove()
+  {
+    int i = mHead[mFrontBucket];
+    mHead[mFrontBucket] = mNext[i];
+    if (mHead[mFrontBucket] < 0) mTail[mFrontBucket] = -1;
+    mNext[i] = mFree;
+    mFree = i;
+
+    if (--mCount == 0) mFrontBucket = mNumBuckets;
+    else while (mHead[mFrontBucket] < 0) ++mFrontBucket;
+  }
 
   // Returns true if the queue is empty.
-  inline bool Empty() const { return mFront == mBack; }
+  inline bool Empty() const { return mCount == 0; }
 
   // Returns the number of MIDI messages in the queue.
-  inline int ToDo() const { return mBack - mFront; }
+  inline int ToDo() const { return mCount; }
 
-  // Returns the number of MIDI messages for which memory has already been
-  // allocated.
+  // Returns the number of MIDI messages the queue can hold.
   inline int GetSize() const { return mSize; }
 
+  // Returns the number of MIDI messages dropped because the queue was full,
+  // since it was constructed.
+  inline int GetNumOverflows() const { return mNumOverflows; }
+
   // Returns the "next" MIDI message (all the way in the front of the
   // queue), but does *not* remove it from the queue.
-  inline IMidiMsg& Peek() const { return mBuf[mFront]; }
+  inline IMidiMsg& Peek() const { return mBuf[mHead[mFrontBucket]]; }
 
-  // Moves back MIDI messages all the way to the front of the queue, thus
-  // freeing up space at the back, and updates the sample offset of the
-  // remaining MIDI messages by substracting nFrames.
+  // Updates the sample offset of the remaining MIDI messages by substracting
+  // nFrames, moving them to the buckets for their new offsets.
   inline void Flush(int nFrames)
   {
-    // Move everything all the way to the front.
-    if (mFront > 0) Compact();
+    if (mNumOverflows != mNumReportedOverflows)
+    {
+      Trace(TRACELOC, "IMidiQueue full, %d messages dropped (%d in total)", mNumOverflows - mNumReportedOverflows, mNumOverflows);
+      mNumReportedOverflows = mNumOverflows;
+    }
+
+    if (!mCount) return;
 
-    // Update the sample offset.
-    for (int i = 0; i < mBack; ++i) mBuf[i].mOffset -= nFrames;
+    // the remaining messages in order, to be linked to their new buckets
+    int first = Unlink();
+    while (first >= 0)
+    {
+      int i = first;
+      first = mNext[i];
+      mBuf[i].mOffset -= nFrames;
+      Link(i);
+    }
   }
 
   // Clears the queue.
-  inline void Clear() { mFront = mBack = 0; }
+  inline void Clear()
+  {
+    int first = Unlink();
+    while (first >= 0)
+    {
+      int i = first;
+      first = mNext[i];
+      mNext[i] = mFree;
+      mFree = i;
+    }
+    mCount = 0;
+  }
 
-  // Resizes (grows or shrinks) the queue, returns the new size.
+  /** Resizes (grows or shrinks) the queue, keeping any queued messages. This allocates, so call it when the block size is set, not on the audio thread.
+   * @param size The number of messages the queue can hold, usually the block size, which is also the span of offsets given a bucket each kBucketFrames, later offsets share the last bucket
+   * @return The new size */
   int Resize(int size)
   {
-    if (mFront > 0) Compact();
-    mGrow = size = Granulize(size);
+    int span = std::max(size, 1);
+    size = Granulize(size);
     // Don't shrink below the number of currently queued MIDI messages.
-    if (size < mBack) size = Granulize(mBack);
-    if (size == mSize) return mSize;
+    if (size < mCount) size = Granulize(mCount);
+    int nBuckets = (span + kBucketFrames - 1) / kBucketFrames + 1;
+
+    IMidiMsg* buf = (IMidiMsg*)malloc(size * sizeof(IMidiMsg));
+    int* next = (int*)malloc(size * sizeof(int));
+    int* head = (int*)malloc(nBuckets * sizeof(int));
+    int* tail = (int*)malloc(nBuckets * sizeof(int));
+
+    if (!buf || !next || !head || !tail)
+    {
+      free(buf); free(next); free(head); free(tail);
+      return mSize;
+    }
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
-    if (!buf) return mSize;
+    // copy the queued messages in order to the front of the new pool
+    int n = 0;
+    for (int first = Unlink(); first >= 0; first = mNext[first])
+      buf[n++] = mBuf[first];
 
-    mBuf = (IMidiMsg*)buf;
+    free(mBuf); free(mNext); free(mHead); free(mTail);
+    mBuf = buf;
+    mNext = next;
+    mHead = head;
+    mTail = tail;
     mSize = size;
+    mNumBuckets = nBuckets;
+
+    for (int b = 0; b < mNumBuckets; ++b) mHead[b] = mTail[b] = -1;
+    for (int i = n; i < mSize; ++i) mNext[i] = i + 1 < mSize ? i + 1 : -1;
+    mFree = n < mSize ? n : -1;
+    mFrontBucket = mNumBuckets;
+
+    for (int i = 0; i < n; ++i) Link(i);
+    mCount = n;
+
     return size;
   }
 
 protected:
-  // Automatically expands the queue.
-  bool Expand()
+  inline int BucketFor(int offset) const
   {
-    if (!mGrow) return false;
-    int size = (mSize / mGrow + 1) * mGrow;
+#ifndef DONT_SORT_IMIDIQUEUE
+    if (offset <= 0) return 0;
+    return std::min(offset / kBucketFrames, mNumBuckets - 1);
+#else
+    return 0;
+#endif
+  }
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
-    if (!buf) return false;
+  // Links message i into the bucket for its offset, after any messages with the same or earlier offsets.
+  inline void Link(int i)
+  {
+    const int offset = mBuf[i].mOffset;
+    const int b = BucketFor(offset);
+    int prev = mTail[b];
 
-    mBuf = (IMidiMsg*)buf;
-    mSize = size;
-    return true;
+#ifndef DONT_SORT_IMIDIQUEUE
+    // in order: the usual case, appended
+    if (prev >= 0 && offset < mBuf[prev].mOffset)
+    {
+      // out of order: walk this bucket from its head
+      prev = -1;
+      for (int j = mHead[b]; j >= 0 && mBuf[j].mOffset <= offset; j = mNext[j]) prev = j;
+    }
+#endif
+
+    if (prev < 0)
+    {
+      mNext[i] = mHead[b];
+      mHead[b] = i;
+    }
+    else
+    {
+      mNext[i] = mNext[prev];
+      mNext[prev] = i;
+    }
+
+    if (mNext[i] < 0) mTail[b] = i;
+
+    if (b < mFrontBucket) mFrontBucket = b;
   }
 
-  // Moves everything all the way to the front.
-  inline void Compact()
+  // Empties the buckets, leaving mCount to the caller.
+  // Returns the first of the messages that were in them, in order, chained by mNext.
+  inline int Unlink()
   {
-    mBack -= mFront;
-    if (mBack > 0) memmove(&mBuf[0], &mBuf[mFront], mBack * sizeof(IMidiMsg));
-    mFront = 0;
+    int first = -1, last = -1;
+
+    if (mCount)
+    {
+      for (int b = mFrontBucket; b < mNumBuckets; ++b)
+      {
+        if (mHead[b] < 0) continue;
+        if (last < 0) first = mHead[b];
+        else mNext[last] = mHead[b];
+        last = mTail[b];
+        mHead[b] = mTail[b] = -1;
+      }
+    }
+
+    mFrontBucket = mNumBuckets;
+    return first;
   }
 
   // Rounds the MIDI queue size up to the next 4 kB memory page size.
@@ -797,10 +905,14 @@ protected:
     return size;
   }
 
-  IMidiMsg* mBuf;
+  IMidiMsg* mBuf = nullptr; // mSize messages
+  int* mNext = nullptr; // for each message, the next in its bucket, or the next free one, -1 at the end
+  int* mHead = nullptr; // for each bucket, its first message, -1 if empty
+  int* mTail = nullptr; // for each bucket, its last message
 
-  int mSize, mGrow;
-  int mFront, mBack;
+  int mSize = 0, mNumBuckets = 0;
+  int mCount = 0, mFree = -1, mFrontBucket = 0; // mFrontBucket is the first bucket with messages, mNumBuckets if none
+  int mNumOverflows = 0, mNumReportedOverflows = 0;
 };
 
 END_IPLUG_NAMESPACE
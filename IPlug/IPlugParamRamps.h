@@ -0,0 +1,356 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IParamRamps
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "IPlugPlatform.h"
+#include "IPlugStructs.h"
+#include "IPlugParameter.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Smooths the parameters that have a smoothing time (see IParam::SetSmoothing()) by rendering each one's value, per frame, into a contiguous buffer before ProcessBlock() is called, so that DSP code reads a ramp rather than running a smoother per sample.
+ * A ramp heads for the value its parameter had at the start of the block. With sample accurate automation it heads for each of the parameter's automation points in turn, from the point's offset on.
+ * Ramps are rendered a segment at a time, without a branch per frame. Once a ramp has converged its buffer holds a constant, which is only written again when the value or the block length changes, and IsConstant() tells DSP code it can take a scalar path.
+ * IPlugProcessor owns one of these. Reset() and Add() allocate, the other methods don't
+ * @tparam T The sample type of the buffers */
+template <typename T = PLUG_SAMPLE_DST>
+class IParamRamps final
+{
+public:
+  /** How close to its target (relative to the target, or absolute below 1.) a kSmoothLog ramp snaps to it, the same as LogParamSmooth */
+  static constexpr double kConvergedRatio = 1e-6;
+
+  IParamRamps() = default;
+
+  IParamRamps(const IParamRamps&) = delete;
+  IParamRamps& operator=(const IParamRamps&) = delete;
+
+  /** Remove every ramp and set the buffer length, not realtime safe
+   * @param nParams The number of parameters of the plug-in
+   * @param maxFrames The most frames Render() will be called with */
+  void Reset(int nParams, int maxFrames)
+  {
+    mRampIdx.Resize(std::max(nParams, 0));
+    std::fill_n(mRampIdx.Get(), mRampIdx.GetSize(), -1);
+    mRamps.Resize(0);
+    mBuffers.Resize(0);
+    mMaxFrames = std::max(maxFrames, 1);
+    mSampleRate = 0.;
+  }
+
+  /** Add a ramp for a parameter, which starts converged at its current value, not realtime safe
+   * @param paramIdx The index of the parameter
+   * @param curve The IParam::ESmoothing curve, other than kSmoothNone
+   * @param timeMs The smoothing time in milliseconds \see IParam::SetSmoothing()
+   * @param value The parameter's current real value */
+  void Add(int paramIdx, IParam::ESmoothing curve, double timeMs, double value)
+  {
+    if (paramIdx < 0 || paramIdx >= mRampIdx.GetSize() || curve == IParam::kSmoothNone || mRampIdx.Get()[paramIdx] >= 0)
+      return;
+
+    Ramp ramp;
+    ramp.mCurve = curve;
+    ramp.mTime = timeMs;
+    ramp.mValue = ramp.mTarget = ramp.mFinal = value;
+
+    mRampIdx.Get()[paramIdx] = mRamps.GetSize();
+    mRamps.Add(ramp);
+    mBuffers.Resize(mRamps.GetSize() * mMaxFrames);
+    // the coefficients are worked out for the new ramp at the next BeginBlock()
+    mSampleRate = 0.;
+  }
+
+  /** @return The number of smoothed parameters */
+  int NRamps() const { return mRamps.GetSize(); }
+
+  /** @return \c true if the parameter has a ramp */
+  bool HasRamp(int paramIdx) const { return paramIdx >= 0 && paramIdx < mRampIdx.GetSize() && mRampIdx.Get()[paramIdx] >= 0; }
+
+  /** Start a block. Ramps head for their parameter's value at the start of the block, except for parameters with automation points in the block, whose ramps head for the points as Render() reaches them, or SetTarget() is called for them
+   * @param pValues The values of all of the parameters at the start of the block, the last value of any that are automated in the block
+   * @param changes The automation points of the block, only their parameter indices are used here
+   * @param sampleRate The rate the block's frames are rendered at */
+  void BeginBlock(const double* pValues, const IParamChangeList& changes, double sampleRate)
+  {
+    const int nRamps = mRamps.GetSize();
+
+    if (!nRamps)
+      return;
+
+    if (sampleRate != mSampleRate)
+      SetSampleRate(sampleRate);
+
+    Ramp* pRamps = mRamps.Get();
+    const int* pRampIdx = mRampIdx.Get();
+    const int nParams = mRampIdx.GetSize();
+
+    for (int i = 0; i < changes.NChanges(); i++)
+    {
+      const int paramIdx = changes.Get(i).mIdx;
+
+      if (paramIdx >= 0 && paramIdx < nParams && pRampIdx[paramIdx] >= 0)
+        pRamps[pRampIdx[paramIdx]].mHasChanges = true;
+    }
+
+    for (int paramIdx = 0; paramIdx < nParams; paramIdx++)
+    {
+      if (pRampIdx[paramIdx] < 0)
+        continue;
+
+      Ramp& ramp = pRamps[pRampIdx[paramIdx]];
+      ramp.mFinal = pValues[paramIdx];
+
+      if (!ramp.mHasChanges)
+        Retarget(ramp, ramp.mFinal);
+
+      ramp.mHasChanges = false;
+    }
+  }
+
+  /** Have a ramp head for a new value from the start of the next Render(), for automation points delivered at the start of a slice. Parameters without a ramp are ignored
+   * @param paramIdx The index of the parameter
+   * @param value The real value */
+  void SetTarget(int paramIdx, double value)
+  {
+    if (HasRamp(paramIdx))
+      Retarget(mRamps.Get()[mRampIdx.Get()[paramIdx]], value);
+  }
+
+  /** Render the next nFrames of every ramp into its buffer
+   * @param nFrames The number of frames, at most the maxFrames given to Reset()
+   * @param pChanges The automation points falling in these frames, whose offsets are relative to the first frame, or nullptr if SetTarget() delivers them */
+  void Render(int nFrames, const IParamChangeList* pChanges = nullptr)
+  {
+    const int nRamps = mRamps.GetSize();
+
+    if (!nRamps)
+      return;
+
+    assert(nFrames <= mMaxFrames);
+    nFrames = std::min(nFrames, mMaxFrames);
+
+    Ramp* pRamps = mRamps.Get();
+
+    for (int r = 0; r < nRamps; r++)
+    {
+      pRamps[r].mPos = 0;
+      pRamps[r].mConstant = pRamps[r].mRemaining == 0;
+    }
+
+    // split the ramps at their parameters' automation points, which are in time order
+    if (pChanges)
+    {
+      const int* pRampIdx = mRampIdx.Get();
+      const int nParams = mRampIdx.GetSize();
+
+      for (int i = 0; i < pChanges->NChanges(); i++)
+      {
+        const IParamChange& change = pChanges->Get(i);
+
+        if (change.mIdx < 0 || change.mIdx >= nParams || pRampIdx[change.mIdx] < 0)
+          continue;
+
+        const int r = pRampIdx[change.mIdx];
+        RenderSegment(pRamps[r], GetBuffer(r), Clip(change.mOffset, 0, nFrames));
+        Retarget(pRamps[r], change.mValue);
+      }
+    }
+
+    for (int r = 0; r < nRamps; r++)
+    {
+      Ramp& ramp = pRamps[r];
+      T* pBuffer = GetBuffer(r);
+      RenderSegment(ramp, pBuffer, nFrames);
+
+      // the constant of a converged ramp is only written when it changes
+      if (ramp.mConstant && (ramp.mFilledValue != ramp.mValue || ramp.mFilledFrames < nFrames))
+      {
+        std::fill_n(pBuffer, nFrames, static_cast<T>(ramp.mValue));
+        ramp.mFilledValue = ramp.mValue;
+        ramp.mFilledFrames = nFrames;
+      }
+    }
+  }
+
+  /** Jump every ramp to the value its parameter had at the start of the block, for blocks that aren't processed, e.g. when silence is skipped */
+  void Skip()
+  {
+    for (int r = 0; r < mRamps.GetSize(); r++)
+    {
+      Ramp& ramp = mRamps.Get()[r];
+      ramp.mValue = ramp.mTarget = ramp.mFinal;
+      ramp.mRemaining = 0;
+    }
+  }
+
+  /** @return The buffer of a smoothed parameter's values for the frames of the last Render()
+   * @param paramIdx The index of a parameter with a ramp */
+  const T* Get(int paramIdx) const
+  {
+    assert(HasRamp(paramIdx));
+    return mBuffers.Get() + mRampIdx.Get()[paramIdx] * mMaxFrames;
+  }
+
+  /** @return \c true if every frame of the last Render() of a parameter's ramp has the same value, which it will have converged to
+   * @param paramIdx The index of a parameter with a ramp */
+  bool IsConstant(int paramIdx) const
+  {
+    assert(HasRamp(paramIdx));
+    return mRamps.Get()[mRampIdx.Get()[paramIdx]].mConstant;
+  }
+
+private:
+  struct Ramp
+  {
+    IParam::ESmoothing mCurve = IParam::kSmoothLinear;
+    double mTime = 0.; // ms
+    double mCoeff = 0.; // kSmoothLinear: the frames a ramp takes, kSmoothLog: the one-pole coefficient
+    double mValue = 0.; // the value at the last frame rendered
+    double mTarget = 0.;
+    double mFinal = 0.; // the parameter's value at the start of the block
+    double mInc = 0.; // kSmoothLinear: the increment per frame
+    int mRemaining = 0; // the frames until the ramp converges, 0 once it has
+    int mPos = 0; // the next frame of the current Render()
+    bool mHasChanges = false;
+    bool mConstant = true; // every frame of the current Render() so far is mValue, and hasn't been written
+    double mFilledValue = 0.; // the constant the buffer holds, if mFilledFrames > 0
+    int mFilledFrames = 0;
+  };
+
+  T* GetBuffer(int rampIdx) { return mBuffers.Get() + rampIdx * mMaxFrames; }
+
+  void SetSampleRate(double sampleRate)
+  {
+    static constexpr double TWO_PI = 6.283185307179586476925286766559;
+
+    mSampleRate = sampleRate;
+
+    for (int r = 0; r < mRamps.GetSize(); r++)
+    {
+      Ramp& ramp = mRamps.Get()[r];
+      const double frames = std::max(ramp.mTime * 0.001 * sampleRate, 1.);
+      ramp.mCoeff = ramp.mCurve == IParam::kSmoothLog ? std::exp(-TWO_PI / frames) : frames;
+    }
+  }
+
+  /** Start a ramp from the current value to a new one */
+  void Retarget(Ramp& ramp, double target)
+  {
+    if (target == ramp.mTarget)
+      return;
+
+    ramp.mTarget = target;
+
+    if (ramp.mCurve == IParam::kSmoothLog)
+    {
+      const double dist = std::abs(ramp.mValue - target);
+      const double tolerance = kConvergedRatio * std::max(std::abs(target), 1.);
+
+      // the one-pole decays the distance by mCoeff per frame, so the frames it takes to come within tolerance are known now
+      if (dist <= tolerance || ramp.mCoeff <= 0.)
+      {
+        ramp.mValue = target;
+        ramp.mRemaining = 0;
+      }
+      else
+        ramp.mRemaining = std::max(static_cast<int>(std::ceil(std::log(tolerance / dist) / std::log(ramp.mCoeff))), 1);
+    }
+    else
+    {
+      ramp.mRemaining = std::max(static_cast<int>(std::lround(ramp.mCoeff)), 1);
+      ramp.mInc = (target - ramp.mValue) / ramp.mRemaining;
+    }
+  }
+
+  /** Render a ramp from its current position to frame end */
+  void RenderSegment(Ramp& ramp, T* pBuffer, int end)
+  {
+    int pos = ramp.mPos;
+
+    if (pos >= end)
+      return;
+
+    ramp.mPos = end;
+
+    if (!ramp.mRemaining)
+    {
+      if (!ramp.mConstant)
+        std::fill(pBuffer + pos, pBuffer + end, static_cast<T>(ramp.mValue));
+
+      return;
+    }
+
+    // the frames so far were left unwritten while the ramp was constant
+    if (ramp.mConstant)
+    {
+      std::fill_n(pBuffer, pos, static_cast<T>(ramp.mValue));
+      ramp.mConstant = false;
+      ramp.mFilledFrames = 0;
+    }
+
+    const int n = std::min(ramp.mRemaining, end - pos);
+    T* pDst = pBuffer + pos;
+
+    if (ramp.mCurve == IParam::kSmoothLog)
+    {
+      const double a = ramp.mCoeff;
+      const double target = ramp.mTarget;
+      double dist = ramp.mValue - target;
+
+      for (int i = 0; i < n; i++)
+      {
+        dist *= a;
+        pDst[i] = static_cast<T>(target + dist);
+      }
+
+      ramp.mValue = target + dist;
+    }
+    else
+    {
+      const double start = ramp.mValue;
+      const double inc = ramp.mInc;
+
+      for (int i = 0; i < n; i++)
+        pDst[i] = static_cast<T>(start + inc * (i + 1));
+
+      ramp.mValue = start + inc * n;
+    }
+
+    ramp.mRemaining -= n;
+    pos += n;
+
+    if (!ramp.mRemaining)
+    {
+      ramp.mValue = ramp.mTarget;
+
+      // the last frame of the ramp lands on the target exactly
+      pDst[n - 1] = static_cast<T>(ramp.mValue);
+      std::fill(pBuffer + pos, pBuffer + end, static_cast<T>(ramp.mValue));
+    }
+  }
+
+  WDL_TypedBuf<Ramp> mRamps;
+  WDL_TypedBuf<int> mRampIdx; // the index of each parameter's ramp, -1 if it has none
+  WDL_TypedBuf<T> mBuffers; // mMaxFrames per ramp
+  int mMaxFrames = 1;
+  double mSampleRate = 0.;
+};
+
+END_IPLUG_NAMESPACE
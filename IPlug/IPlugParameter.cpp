@@ -15,9 +15,14 @@
 
 #include <cstdio>
 #include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 
 #include "IPlugParameter.h"
 #include "IPlugLogger.h"
+#include "IPlugSIMD.h"
 
 using namespace iplug;
 
@@ -33,6 +38,19 @@ double IParam::ShapeLinear::ValueToNormalized(double value, const IParam& param)
   return (value - param.mMin) / (param.mMax - param.mMin);
 }
 
+void IParam::ShapeLinear::NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  VectorMultiplyAddClip(pValues, pNormalized, n, param.mMax - param.mMin, param.mMin, -inf, inf);
+}
+
+void IParam::ShapeLinear::ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  const double range = param.mMax - param.mMin;
+  VectorMultiplyAddClip(pNormalized, pValues, n, 1. / range, -param.mMin / range, -inf, inf);
+}
+
 IParam::ShapePowCurve::ShapePowCurve(double shape)
 : mShape(shape)
 {
@@ -58,6 +76,25 @@ double IParam::ShapePowCurve::ValueToNormalized(double value, const IParam& para
   return std::pow((value - param.GetMin()) / (param.GetMax() - param.GetMin()), 1.0 / mShape);
 }
 
+void IParam::ShapePowCurve::NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const
+{
+  const double min = param.GetMin();
+  const double range = param.GetMax() - min;
+
+  for (int i = 0; i < n; i++)
+    pValues[i] = min + std::pow(pNormalized[i], mShape) * range;
+}
+
+void IParam::ShapePowCurve::ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const
+{
+  const double min = param.GetMin();
+  const double invRange = 1.0 / (param.GetMax() - min);
+  const double invShape = 1.0 / mShape;
+
+  for (int i = 0; i < n; i++)
+    pNormalized[i] = std::pow((pValues[i] - min) * invRange, invShape);
+}
+
 void IParam::ShapeExp::Init(const IParam& param)
 {
   double min = param.GetMin();
@@ -79,14 +116,40 @@ double IParam::ShapeExp::ValueToNormalized(double value, const IParam& param) co
   return (std::log(value) - mAdd) / mMul;
 }
 
+void IParam::ShapeExp::NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const
+{
+  for (int i = 0; i < n; i++)
+    pValues[i] = std::exp(mAdd + pNormalized[i] * mMul);
+}
+
+void IParam::ShapeExp::ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const
+{
+  const double invMul = 1.0 / mMul;
+
+  for (int i = 0; i < n; i++)
+    pNormalized[i] = (std::log(pValues[i]) - mAdd) * invMul;
+}
+
 #pragma mark -
 
+std::atomic<uint32_t> IParam::sNamesVersion{0};
+
+const char* IParam::InternString(const char* str)
+{
+  if (!str || !*str)
+    return "";
+
+  // the nodes of an unordered_set don't move when it rehashes, so the pointers stay valid
+  static std::mutex sMutex;
+  static std::unordered_set<std::string> sStrings;
+
+  std::lock_guard<std::mutex> lock(sMutex);
+  return sStrings.emplace(str).first->c_str();
+}
+
 IParam::IParam()
 {
   mShape = std::make_unique<ShapeLinear>();
-  memset(mName, 0, MAX_PARAM_NAME_LEN * sizeof(char));
-  memset(mLabel, 0, MAX_PARAM_LABEL_LEN * sizeof(char));
-  memset(mParamGroup, 0, MAX_PARAM_LABEL_LEN * sizeof(char));
 };
 
 void IParam::InitBool(const char* name, bool defaultVal, const char* label, int flags, const char* group, const char* offText, const char* onText)
@@ -144,9 +207,10 @@ void IParam::InitDouble(const char* name, double defaultVal, double minVal, doub
 //  assert(CStringHasContents(mName) && "Parameter already initialised!");
 //  assert(CStringHasContents(name) && "Parameter must be given a name!");
 
-  strcpy(mName, name);
-  strcpy(mLabel, label);
-  strcpy(mParamGroup, group);
+  mName = InternString(name);
+  mLabel = InternString(label);
+  mParamGroup = InternString(group);
+  sNamesVersion.fetch_add(1, std::memory_order_release);
   
   // N.B. apply stepping and constraints to the default value (and store the result)
   mMin = minVal;
@@ -156,6 +220,7 @@ void IParam::InitDouble(const char* name, double defaultVal, double minVal, doub
   mUnit = unit;
   mFlags = flags;
   mDisplayFunction = displayFunc;
+  InvalidateDisplayCache();
 
   Set(defaultVal);
   
@@ -168,6 +233,9 @@ void IParam::InitDouble(const char* name, double defaultVal, double minVal, doub
     
   mShape = std::unique_ptr<Shape>(shape.Clone());
   mShape->Init(*this);
+
+  if (mNormalizationTable.GetSize())
+    BuildNormalizationTable(mNormalizationTable.GetSize() - 1);
 }
 
 void IParam::InitFrequency(const char *name, double defaultVal, double minVal, double maxVal, double step, int flags, const char *group)
@@ -236,6 +304,7 @@ void IParam::Init(const IParam& p, const char* searchStr, const char* replaceStr
   }
   
   InitDouble(str.Get(), p.mDefault, p.mMin, p.mMax, p.mStep, p.mLabel, p.mFlags, group.Get(), *p.mShape, p.mUnit, p.mDisplayFunction);
+  SetSmoothing(p.mSmoothingTime, p.mSmoothing);
   
   for (auto i=0; i<p.NDisplayTexts(); i++)
   {
@@ -251,18 +320,65 @@ void IParam::SetDisplayText(double value, const char* str)
   mDisplayTexts.Resize(n + 1);
   DisplayText* pDT = mDisplayTexts.Get() + n;
   pDT->mValue = value;
-  strcpy(pDT->mText, str);
+  pDT->mText = InternString(str);
+  InvalidateDisplayCache();
 }
 
 void IParam::SetDisplayPrecision(int precision)
 {
   mDisplayPrecision = precision;
+  InvalidateDisplayCache();
+}
+
+void IParam::InvalidateDisplayCache()
+{
+  std::lock_guard<std::mutex> lock(mDisplayCacheMutex);
+
+  for (auto& entry : mDisplayCache)
+    entry.mValid = false;
 }
 
 void IParam::GetDisplay(double value, bool normalized, WDL_String& str, bool withDisplayText) const
 {
   if (normalized) value = FromNormalized(value);
 
+  if (!mDisplayCacheEnabled)
+  {
+    FormatDisplay(value, str, withDisplayText);
+    return;
+  }
+
+  DisplayCacheEntry& entry = mDisplayCache[DisplayCacheSlot(value, withDisplayText)];
+
+  {
+    std::unique_lock<std::mutex> lock(mDisplayCacheMutex, std::try_to_lock);
+
+    if (lock.owns_lock() && entry.mValid && entry.mValue == value && entry.mWithDisplayText == withDisplayText)
+    {
+      str.Set(entry.mText);
+      return;
+    }
+  }
+
+  FormatDisplay(value, str, withDisplayText);
+
+  // a string that doesn't fit isn't cached, so that it is returned whole
+  if (str.GetLength() < MAX_PARAM_DISPLAY_LEN)
+  {
+    std::unique_lock<std::mutex> lock(mDisplayCacheMutex, std::try_to_lock);
+
+    if (lock.owns_lock())
+    {
+      entry.mValue = value;
+      entry.mWithDisplayText = withDisplayText;
+      entry.mValid = true;
+      memcpy(entry.mText, str.Get(), str.GetLength() + 1);
+    }
+  }
+}
+
+void IParam::FormatDisplay(double value, WDL_String& str, bool withDisplayText) const
+{
   if (mDisplayFunction != nullptr)
   {
     mDisplayFunction(value, str);
@@ -355,6 +471,57 @@ bool IParam::MapDisplayText(const char* str, double* pValue) const
   return false;
 }
 
+void IParam::ToNormalized(const double* pValues, double* pNormalized, int n) const
+{
+  ConstrainValues(pValues, pNormalized, n);
+  mShape->ValuesToNormalized(pNormalized, pNormalized, n, *this);
+
+  VectorMultiplyAddClip(pNormalized, pNormalized, n, 1., 0., 0., 1.);
+}
+
+void IParam::FromNormalized(const double* pNormalized, double* pValues, int n) const
+{
+  if (mNormalizationTable.GetSize())
+  {
+    for (int i = 0; i < n; i++)
+      pValues[i] = TableNormalizedToValue(pNormalized[i]);
+  }
+  else
+    mShape->NormalizedToValues(pNormalized, pValues, n, *this);
+
+  ConstrainValues(pValues, pValues, n);
+}
+
+void IParam::ConstrainValues(const double* pValues, double* pDest, int n) const
+{
+  if (mFlags & kFlagStepped)
+  {
+    for (int i = 0; i < n; i++)
+      pDest[i] = Constrain(pValues[i]);
+  }
+  else
+    VectorMultiplyAddClip(pDest, pValues, n, 1., 0., mMin, mMax);
+}
+
+void IParam::SetNormalizationTableSize(int size)
+{
+  if (size > 0)
+    BuildNormalizationTable(size);
+  else
+    mNormalizationTable.Resize(0);
+}
+
+void IParam::BuildNormalizationTable(int size)
+{
+  double* pTable = mNormalizationTable.ResizeOK(size + 1, false);
+
+  if (!pTable)
+    return;
+
+  for (int i = 0; i <= size; i++)
+    pTable[i] = mShape->NormalizedToValue(static_cast<double>(i) / size, *this);
+}
+
 double IParam::StringToValue(const char* str) const
 {
   double v = 0.;
@@ -15,10 +15,13 @@
  * @copydoc IParam
  */
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
 
 #include "wdlstring.h"
 
@@ -26,6 +29,63 @@
 
 BEGIN_IPLUG_NAMESPACE
 
+/** One bit per parameter, set by IParam when its value changes and cleared by the audio thread when it reads the changes, so that IPlugProcessor can refresh its
+ * parameter snapshot without loading every value in every block. Setting a bit is wait-free, and a block in which nothing changed costs a single load.
+ * A version that counts every change, unlike the bits, is never cleared, so that other threads can tell whether any value has been set since they last looked */
+class IParamChangeFlags
+{
+public:
+  /** Clear the flags and make room for nParams parameters, not thread safe */
+  void Resize(int nParams)
+  {
+    mNWords = (std::max(nParams, 0) + 63) / 64;
+    mWords = std::make_unique<std::atomic<uint64_t>[]>(mNWords);
+
+    for (int i = 0; i < mNWords; i++)
+      mWords[i].store(0, std::memory_order_relaxed);
+
+    mAnyChanged.store(false, std::memory_order_relaxed);
+    mVersion.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /** Flag a parameter as changed, called by IParam after it has stored the new value */
+  void SetChanged(int paramIdx)
+  {
+    mWords[paramIdx >> 6].fetch_or(static_cast<uint64_t>(1) << (paramIdx & 63), std::memory_order_release);
+    mAnyChanged.store(true, std::memory_order_release);
+    mVersion.fetch_add(1, std::memory_order_release);
+  }
+
+  /** @return A number that changes whenever SetChanged() is called, from any thread */
+  uint32_t GetVersion() const { return mVersion.load(std::memory_order_acquire); }
+
+  /** Call func(paramIdx) for each parameter that has changed since the last call, and clear its flag. A change that lands during the call is seen now or next time
+   * @param func Called with the index of each changed parameter */
+  template <typename F>
+  void ForEachChanged(F&& func)
+  {
+    if (!mAnyChanged.exchange(false, std::memory_order_acquire))
+      return;
+
+    for (int w = 0; w < mNWords; w++)
+    {
+      uint64_t bits = mWords[w].exchange(0, std::memory_order_acquire);
+
+      for (int b = 0; bits; b++, bits >>= 1)
+      {
+        if (bits & 1)
+          func(w * 64 + b);
+      }
+    }
+  }
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> mWords;
+  int mNWords = 0;
+  std::atomic<bool> mAnyChanged{false};
+  std::atomic<uint32_t> mVersion{0};
+};
+
 /** IPlug's parameter class */
 class IParam
 {
@@ -40,6 +100,9 @@ public:
   /** Used by AudioUnit plugins to determine the mapping of parameters */
   enum EDisplayType { kDisplayLinear, kDisplayLog, kDisplayExp, kDisplaySquared, kDisplaySquareRoot, kDisplayCubed, kDisplayCubeRoot };
 
+  /** The curves IPlugProcessor can smooth a parameter's real value with, see SetSmoothing(). kSmoothLinear reaches a new value in the smoothing time, kSmoothLog approaches it exponentially like LogParamSmooth */
+  enum ESmoothing { kSmoothNone, kSmoothLinear, kSmoothLog };
+
   /** Flags to determine characteristics of the parameter */
   enum EFlags
   {
@@ -88,6 +151,28 @@ public:
      * @param param The IParam to do the calculation against
      * @return double The normalized value */
     virtual double ValueToNormalized(double value, const IParam& param) const = 0;
+
+    /** Convert a block of normalized values to real values. The default calls NormalizedToValue() for each one; shapes override it to avoid a virtual call per value
+     * @param pNormalized The normalized values
+     * @param pValues Receives the real values, may be the same buffer as pNormalized
+     * @param n The number of values
+     * @param param The IParam to do the calculation against */
+    virtual void NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const
+    {
+      for (int i = 0; i < n; i++)
+        pValues[i] = NormalizedToValue(pNormalized[i], param);
+    }
+
+    /** Convert a block of real values to normalized values. The default calls ValueToNormalized() for each one; shapes override it to avoid a virtual call per value
+     * @param pValues The real values
+     * @param pNormalized Receives the normalized values, may be the same buffer as pValues
+     * @param n The number of values
+     * @param param The IParam to do the calculation against */
+    virtual void ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const
+    {
+      for (int i = 0; i < n; i++)
+        pNormalized[i] = ValueToNormalized(pValues[i], param);
+    }
   };
 
   /** Linear parameter shaping */
@@ -97,6 +182,8 @@ public:
     IParam::EDisplayType GetDisplayType() const override { return kDisplayLinear; }
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
+    void NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const override;
+    void ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const override;
   
     double mShape;
   };
@@ -109,6 +196,8 @@ public:
     IParam::EDisplayType GetDisplayType() const override;
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
+    void NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const override;
+    void ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const override;
     
     double mShape;
   };
@@ -121,6 +210,8 @@ public:
     IParam::EDisplayType GetDisplayType() const override { return kDisplayLog; }
     double NormalizedToValue(double value, const IParam& param) const override;
     double ValueToNormalized(double value, const IParam& param) const override;
+    void NormalizedToValues(const double* pNormalized, double* pValues, int n, const IParam& param) const override;
+    void ValuesToNormalized(const double* pValues, double* pNormalized, int n, const IParam& param) const override;
     
     double mMul = 1.0;
     double mAdd = 1.0;
@@ -277,7 +368,7 @@ public:
    * @return double The resulting constrained value */
   inline double ConstrainNormalized(double normalizedValue) const
   {
-    return ToNormalized(mShape->NormalizedToValue(normalizedValue, *this));
+    return ToNormalized(ShapeNormalizedToValue(normalizedValue));
   }
   
   /** Convert a real value to normalized value for this parameter
@@ -293,12 +384,54 @@ public:
    * @return The corresponding real value, for this parameter */
   inline double FromNormalized(double normalizedValue) const
   {
-    return Constrain(mShape->NormalizedToValue(normalizedValue, *this));
+    return Constrain(ShapeNormalizedToValue(normalizedValue));
   }
 
+  /** Convert a block of real values to normalized values, with the same result as calling ToNormalized() for each of them, to within rounding. Use this when handling many values of one parameter at once, e.g. a block of automation points
+   * @param pValues The real input values
+   * @param pNormalized Receives the normalized values, may be the same buffer as pValues
+   * @param n The number of values */
+  void ToNormalized(const double* pValues, double* pNormalized, int n) const;
+
+  /** Convert a block of normalized values to real values, with the same result as calling FromNormalized() for each of them, to within rounding. Use this when handling many values of one parameter at once, e.g. a block of automation points
+   * @param pNormalized The normalized input values
+   * @param pValues Receives the real values, may be the same buffer as pNormalized
+   * @param n The number of values */
+  void FromNormalized(const double* pNormalized, double* pValues, int n) const;
+
+  /** Replace the pow()/exp() calls that a non-linear shape makes in FromNormalized() with a linearly interpolated table of the shape's curve, which makes the parameter cheaper to automate.
+   * With the default size the real values of ShapeExp and ShapePowCurve(3.) are within a few parts per million of the exact ones, but curves that are very steep at an end (e.g. ShapePowCurve(0.5) near 0.) are less accurate there.
+   * ToNormalized() still calls the shape, because searching the table is no faster than a log(). So ToNormalized(FromNormalized(x)) can come back slightly away from x, most where the curve is flat (about 0.0004 for ShapePowCurve(3.) near 0.).
+   * Call it after the parameter is initialized, the table is rebuilt if the parameter is initialized again
+   * @param size The number of segments in the table, or 0 to go back to calling the shape */
+  void SetNormalizationTableSize(int size = kDefaultNormalizationTableSize);
+
+  /** Have IPlugProcessor smooth the parameter for ProcessBlock(), which reads a buffer of the smoothed value per sample with IPlugProcessor::GetSmoothedParam(), rather than running a smoother itself.
+   * Call it after the parameter is initialized, in the plug-in constructor, the processor picks the smoothed parameters up when it is reset
+   * @param timeMs For kSmoothLinear the time a ramp to a new value takes, for kSmoothLog the time constant, as for LogParamSmooth. 0. to stop smoothing
+   * @param curve The ESmoothing curve */
+  void SetSmoothing(double timeMs, ESmoothing curve = kSmoothLinear) { mSmoothingTime = std::max(timeMs, 0.); mSmoothing = mSmoothingTime > 0. ? curve : kSmoothNone; }
+
+  /** @return The ESmoothing curve IPlugProcessor smooths the parameter with, kSmoothNone unless SetSmoothing() has been called */
+  ESmoothing GetSmoothing() const { return mSmoothing; }
+
+  /** @return The smoothing time in milliseconds \see SetSmoothing() */
+  double GetSmoothingTime() const { return mSmoothingTime; }
+
+  /** Have the parameter flag itself in a set of change flags whenever its value is set, IPlugProcessor uses this for its parameter snapshot
+   * @param pFlags The flags to set, or nullptr to stop
+   * @param paramIdx The parameter's index in the flags */
+  void SetChangeFlags(IParamChangeFlags* pFlags, int paramIdx) { mpChangeFlags = pFlags; mChangeFlagIdx = paramIdx; }
+
+  /** @return The change flags the parameter sets, or nullptr if SetChangeFlags() hasn't been called */
+  const IParamChangeFlags* GetChangeFlags() const { return mpChangeFlags; }
+
+  /** @return The number of segments in the normalization table, or 0 if the shape is called directly \see SetNormalizationTableSize() */
+  int GetNormalizationTableSize() const { return std::max(mNormalizationTable.GetSize() - 1, 0); }
+
   /** Sets the parameter value
    * @param value Value to be set. Will be stepped and clamped between \c mMin and \c mMax */
-  void Set(double value) { mValue.store(Constrain(value)); }
+  void Set(double value) { mValue.store(Constrain(value)); NotifyChanged(); }
 
   /** Sets the parameter value from a normalized range (usually coming from the linked IControl)
    * @param normalizedValue The expected normalized value between 0. and 1. */
@@ -306,10 +439,10 @@ public:
 
   /** Set the parameter value using a textual representation
    * @param str The textual representations as a CString */
-  void SetString(const char* str) { mValue.store(StringToValue(str)); }
+  void SetString(const char* str) { mValue.store(StringToValue(str)); NotifyChanged(); }
 
   /** Replaces the parameter's current value with the default one  */
-  void SetToDefault() { mValue.store(mDefault); }
+  void SetToDefault() { mValue.store(mDefault); NotifyChanged(); }
 
   /** Set the parameter's default value, and set the parameter to that default
    * @param value The new default value */
@@ -326,11 +459,19 @@ public:
 
   /** Set the parameters label after creation. WARNING: if this is called after the host has queried plugin parameters, the host may display the label as it was previously
    * @param label CString for the label */
-  void SetLabel(const char* label) { strcpy(mLabel, label); }
+  void SetLabel(const char* label) { mLabel = InternString(label); }
   
-  /** Set the function to translate display values
+  /** Set the function to translate display values. Its results are cached, see InvalidateDisplayCache()
    * @param func A function conforming to DisplayFunc */
-  void SetDisplayFunc(DisplayFunc func) { mDisplayFunction = func; }
+  void SetDisplayFunc(DisplayFunc func) { mDisplayFunction = func; InvalidateDisplayCache(); }
+
+  /** Forget the display strings GetDisplay() has cached. They are forgotten automatically when the display texts, precision or function change,
+   * call this when something else that a DisplayFunc reads changes, e.g. another parameter that selects the units it displays */
+  void InvalidateDisplayCache();
+
+  /** Enable/disable the cache of display strings, which hosts can ask for thousands of times per second, e.g. when drawing automation lanes
+   * @param enable Set \c false for a DisplayFunc whose result can change for the same value at any time */
+  void SetDisplayCacheEnabled(bool enable) { mDisplayCacheEnabled = enable; InvalidateDisplayCache(); }
 
   /** Gets a readable value of the parameter
    * @return double Current value of the parameter */
@@ -359,7 +500,7 @@ public:
    * @param withDisplayText Should the output include display texts */
   void GetDisplay(WDL_String& display, bool withDisplayText = true) const { GetDisplay(mValue.load(), false, display, withDisplayText); }
 
-  /** Get the current textual display for a specified parameter value
+  /** Get the current textual display for a specified parameter value. The last few strings are cached, so a host asking for the same values again doesn't format them again
    * @param value The value to get the display for
    * @param normalized Is value normalized or real
    * @param display \c WDL_String to fill with the results
@@ -416,6 +557,9 @@ public:
    * @param pValue The value linked to the display text will be put here
    * @return \c true if str matched a display text */
   bool MapDisplayText(const char* str, double* pValue) const;
+
+  /** @return The bytes this parameter holds, including its display texts and normalization table, but not the interned strings, which are shared */
+  size_t GetMemorySize() const { return sizeof(IParam) + mDisplayTexts.GetSizeBytes() + mNormalizationTable.GetSizeBytes(); }
   
   /** Get the parameter's type
    * @return EParamType Type of the parameter, @e kTypeNone if not initialized
@@ -488,32 +632,100 @@ public:
 
   /** Helper to print the parameter details to debug console in debug builds */
   void PrintDetails() const;
+
+  /** Get a copy of a string that lives as long as the process and is shared with every other caller asking for the same text.
+   * IParam stores its name, label, group and display texts this way, so plug-ins with thousands of parameters that share labels, groups and display texts only store each of them once,
+   * and two interned strings are equal if their pointers are. Thread safe
+   * @param str The string to intern
+   * @return The interned copy of str */
+  static const char* InternString(const char* str);
+
+  /** @return A number that changes whenever any parameter's name or group is set, so that lookups built from them know when they need rebuilding */
+  static uint32_t GetNamesVersion() { return sNamesVersion.load(std::memory_order_acquire); }
+
+  /** The number of segments SetNormalizationTableSize() uses by default */
+  static constexpr int kDefaultNormalizationTableSize = 1024;
+
 private:
+  inline double ShapeNormalizedToValue(double normalizedValue) const
+  {
+    return mNormalizationTable.GetSize() ? TableNormalizedToValue(normalizedValue) : mShape->NormalizedToValue(normalizedValue, *this);
+  }
+
+  inline double TableNormalizedToValue(double normalizedValue) const
+  {
+    const int size = mNormalizationTable.GetSize() - 1;
+    const double* pTable = mNormalizationTable.Get();
+    const double pos = Clip(normalizedValue, 0., 1.) * size;
+    const int i = std::min(static_cast<int>(pos), size - 1);
+    return pTable[i] + (pos - i) * (pTable[i + 1] - pTable[i]);
+  }
+
+  void NotifyChanged() { if (mpChangeFlags) mpChangeFlags->SetChanged(mChangeFlagIdx); }
+  void BuildNormalizationTable(int size);
+  void ConstrainValues(const double* pValues, double* pDest, int n) const;
+
   /** A DisplayText is used to link a certain real value of the parameter with a CString. For example -70 on a decibel gain parameter could instead read "-inf" */
   struct DisplayText
   {
     double mValue;
-    char mText[MAX_PARAM_DISPLAY_LEN];
+    const char* mText; // interned
   };
 
-  EParamType mType = kTypeNone;
-  EParamUnit mUnit = kUnitCustom;
+  /** A display string GetDisplay() has returned, for a real value */
+  struct DisplayCacheEntry
+  {
+    double mValue = 0.0;
+    bool mWithDisplayText = false;
+    bool mValid = false;
+    char mText[MAX_PARAM_DISPLAY_LEN] = {};
+  };
+
+  static constexpr int kDisplayCacheSize = 8;
+
+  /** Format a real value for display, without the cache */
+  void FormatDisplay(double value, WDL_String& display, bool withDisplayText) const;
+
+  /** @return The slot of the display cache that a value is stored in */
+  static int DisplayCacheSlot(double value, bool withDisplayText)
+  {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits ^= bits >> 29;
+    bits *= 0x9E3779B97F4A7C15ull;
+    return static_cast<int>((bits >> 61) ^ (withDisplayText ? 1 : 0)) & (kDisplayCacheSize - 1);
+  }
+
+  // the fields used to convert and constrain values come first, so that they share a cache line, and the UI metadata follows
   std::atomic<double> mValue{0.0};
   double mMin = 0.0;
   double mMax = 1.0;
   double mStep = 1.0;
   double mDefault = 0.0;
-  int mDisplayPrecision = 0;
+  std::unique_ptr<Shape> mShape;
+  EParamType mType = kTypeNone;
   int mFlags = 0;
+  IParamChangeFlags* mpChangeFlags = nullptr;
+  int mChangeFlagIdx = 0;
+  ESmoothing mSmoothing = kSmoothNone;
+  double mSmoothingTime = 0.0;
 
-  char mName[MAX_PARAM_NAME_LEN];
-  char mLabel[MAX_PARAM_LABEL_LEN];
-  char mParamGroup[MAX_PARAM_GROUP_LEN];
-  
-  std::unique_ptr<Shape> mShape;
+  EParamUnit mUnit = kUnitCustom;
+  int mDisplayPrecision = 0;
+  const char* mName = ""; // interned
+  const char* mLabel = ""; // interned
+  const char* mParamGroup = ""; // interned
   DisplayFunc mDisplayFunction = nullptr;
 
   WDL_TypedBuf<DisplayText> mDisplayTexts;
+  WDL_TypedBuf<double> mNormalizationTable; // real values at size + 1 evenly spaced normalized values, empty if the shape is called directly
+
+  // GetDisplay() can be called by the host and the UI on different threads, a thread that finds the cache locked formats the string itself
+  bool mDisplayCacheEnabled = true;
+  mutable std::mutex mDisplayCacheMutex;
+  mutable DisplayCacheEntry mDisplayCache[kDisplayCacheSize];
+
+  static std::atomic<uint32_t> sNamesVersion;
 } WDL_FIXALIGN;
 
 END_IPLUG_NAMESPACE
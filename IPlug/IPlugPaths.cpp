@@ -16,6 +16,7 @@
 #include "IPlugPlatform.h"
 #include "IPlugConstants.h"
 #include "IPlugPaths.h"
+#include "IPlugResourcePathCache.h"
 
 #if defined OS_WEB
 #include <emscripten/val.h>
@@ -23,6 +24,12 @@
 #include <windows.h>
 #include <Shlobj.h>
 #include <Shlwapi.h>
+#elif defined OS_LINUX
+#include <dlfcn.h>
+#include <limits.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #endif
 
 BEGIN_IPLUG_NAMESPACE
@@ -147,18 +154,16 @@ static BOOL EnumResNameProc(HANDLE module, LPCTSTR type, LPTSTR name, LONG_PTR p
 {
   if (IS_INTRESOURCE(name)) return true; // integer resources not wanted
   else {
-    WDL_String* search = (WDL_String*)param;
-    if (search != 0 && name != 0)
+    auto* pEntries = (ResourcePathCache::Entries*)param;
+    if (pEntries != 0 && name != 0)
     {
       //strip off extra quotes
       WDL_String strippedName(strlwr(name + 1));
       strippedName.SetLen(strippedName.GetLength() - 1);
 
-      if (strcmp(strlwr(search->Get()), strippedName.Get()) == 0) // if we are looking for a resource with this name
-      {
-        search->SetFormatted(strippedName.GetLength() + 7, "found: %s", strippedName.Get());
-        return false;
-      }
+      WDL_String resID;
+      resID.SetFormatted(MAX_PATH, "\"%s\"", strippedName.Get());
+      pEntries->emplace(strippedName.Get(), resID.Get());
     }
   }
 
@@ -169,18 +174,21 @@ EResourceLocation LocateResource(const char* name, const char* type, WDL_String&
 {
   if (CStringHasContents(name))
   {
-    WDL_String search(name);
     WDL_String typeUpper(type);
+    _strupr(typeUpper.Get());
 
     HMODULE hInstance = static_cast<HMODULE>(pHInstance);
 
-    EnumResourceNames(hInstance, _strupr(typeUpper.Get()), (ENUMRESNAMEPROC)EnumResNameProc, (LONG_PTR)&search);
+    // enumerate each type of resource in the binary once, rather than for every lookup
+    char key[64];
+    snprintf(key, sizeof(key), "%p/%s", pHInstance, typeUpper.Get());
 
-    if (strstr(search.Get(), "found: ") != 0)
-    {
-      result.SetFormatted(MAX_PATH, "\"%s\"", search.Get() + 7, search.GetLength() - 7); // 7 = strlen("found: ")
+    auto enumResources = [hInstance, &typeUpper](ResourcePathCache::Entries& entries) {
+      EnumResourceNames(hInstance, typeUpper.Get(), (ENUMRESNAMEPROC)EnumResNameProc, (LONG_PTR)&entries);
+    };
+
+    if (ResourcePathCache::Find(key, enumResources, ResourcePathCache::FoldName(name, true), result))
       return EResourceLocation::kWinBinary;
-    }
     else
     {
       if (PathFileExists(name))
@@ -243,6 +251,13 @@ void VST3PresetsPath(WDL_String& path, const char* mfrName, const char* pluginNa
   path.Set("Presets");
 }
 
+/** @return \c true if path is listed in the manifest of resources that are fetched when they're loaded, written by Scripts/make_web_manifest.py */
+static bool IsInResourceManifest(const char* path)
+{
+  emscripten::val manifest = emscripten::val::global("iplugResources");
+  return !manifest.isUndefined() && manifest.call<bool>("hasOwnProperty", std::string(path));
+}
+
 EResourceLocation LocateResource(const char* name, const char* type, WDL_String& result, const char*, void*, const char*)
 {
   if (CStringHasContents(name))
@@ -257,7 +272,7 @@ EResourceLocation LocateResource(const char* name, const char* type, WDL_String&
     
     if(strcmp(type, "png") == 0) { //TODO: lowercase/uppercase png
       plusSlash.SetFormatted(strlen("/resources/img/") + strlen(file) + 1, "/resources/img/%s", file);
-      foundResource = emscripten::val::global("preloadedImages").call<bool>("hasOwnProperty", std::string(plusSlash.Get()));
+      foundResource = IsInResourceManifest(plusSlash.Get()) || emscripten::val::global("preloadedImages").call<bool>("hasOwnProperty", std::string(plusSlash.Get()));
     }
     else if(strcmp(type, "ttf") == 0) { //TODO: lowercase/uppercase ttf
       plusSlash.SetFormatted(strlen("/resources/fonts/") + strlen(file) + 1, "/resources/fonts/%s", file);
@@ -277,6 +292,145 @@ EResourceLocation LocateResource(const char* name, const char* type, WDL_String&
   return EResourceLocation::kNotFound;
 }
 
+#elif defined OS_LINUX
+#pragma mark - OS_LINUX
+
+static bool PathExists(const char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+// The directory of the shared object, or executable, containing pAddr, with a trailing slash
+static void GetModulePath(const void* pAddr, WDL_String& path)
+{
+  path.Set("");
+  Dl_info info;
+
+  if (dladdr(pAddr, &info) && info.dli_fname)
+  {
+    char fullPath[PATH_MAX];
+
+    if (realpath(info.dli_fname, fullPath))
+    {
+      path.Set(fullPath);
+      path.remove_filepart(true);
+    }
+  }
+}
+
+void HostPath(WDL_String& path, const char* bundleID)
+{
+  char exePath[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", exePath, PATH_MAX - 1);
+  path.Set(exePath, len > 0 ? static_cast<int>(len) : 0);
+  path.remove_filepart(true);
+}
+
+void PluginPath(WDL_String& path, void* pExtra)
+{
+  GetModulePath(pExtra ? pExtra : reinterpret_cast<const void*>(&GetModulePath), path);
+}
+
+void BundleResourcePath(WDL_String& path, void* pExtra)
+{
+  // Plugin.vst3/Contents/x86_64-linux/Plugin.so has its resources in Plugin.vst3/Contents/Resources
+  PluginPath(path, pExtra);
+  path.SetLen(path.GetLength() - 1);
+  path.remove_filepart(true);
+  path.Append("Resources/");
+}
+
+void UserHomePath(WDL_String& path)
+{
+  const char* pHome = getenv("HOME");
+
+  if (!CStringHasContents(pHome))
+  {
+    const passwd* pPasswd = getpwuid(getuid());
+    pHome = pPasswd ? pPasswd->pw_dir : "";
+  }
+
+  path.Set(pHome);
+}
+
+void DesktopPath(WDL_String& path)
+{
+  UserHomePath(path);
+  path.Append("/Desktop");
+}
+
+void AppSupportPath(WDL_String& path, bool isSystem)
+{
+  const char* pConfig = getenv("XDG_CONFIG_HOME");
+
+  if (isSystem)
+    path.Set("/etc/xdg");
+  else if (CStringHasContents(pConfig))
+    path.Set(pConfig);
+  else
+  {
+    UserHomePath(path);
+    path.Append("/.config");
+  }
+}
+
+void VST3PresetsPath(WDL_String& path, const char* mfrName, const char* pluginName, bool isSystem)
+{
+  if (isSystem)
+    path.Set("/usr/share/vst3/presets");
+  else
+  {
+    UserHomePath(path);
+    path.Append("/.vst3/presets");
+  }
+
+  path.AppendFormatted(PATH_MAX, "/%s/%s", mfrName, pluginName);
+}
+
+void INIPath(WDL_String& path, const char* pluginName)
+{
+  AppSupportPath(path);
+  path.AppendFormatted(PATH_MAX, "/%s", pluginName);
+}
+
+EResourceLocation LocateResource(const char* name, const char* type, WDL_String& result, const char*, void* pExtra, const char*)
+{
+  if (CStringHasContents(name))
+  {
+    // first check the bundle's resources, and the resources folder of an app, where the build puts them in img/ and fonts/
+    WDL_String file(name);
+    const char* subFolder = strcmp(type, "ttf") == 0 ? "fonts/" : "img/";
+    char key[64];
+    snprintf(key, sizeof(key), "%p/%s", pExtra, subFolder);
+
+    auto scanFolders = [pExtra, subFolder](ResourcePathCache::Entries& entries) {
+      WDL_String paths[4];
+      BundleResourcePath(paths[0], pExtra);
+      paths[1].Set(paths[0].Get());
+      paths[1].Append(subFolder);
+      PluginPath(paths[2], pExtra);
+      paths[2].Append("resources/");
+      paths[3].Set(paths[2].Get());
+      paths[3].Append(subFolder);
+
+      for (auto& path : paths)
+        ResourcePathCache::ScanDirectory(path.Get(), entries, false);
+    };
+
+    if (ResourcePathCache::Find(key, scanFolders, file.get_filepart(), result))
+      return EResourceLocation::kAbsolutePath;
+
+    // finally check name, which might be a full path - if the plug-in is trying to load a resource at runtime (e.g. skin-able UI)
+    if (PathExists(name))
+    {
+      result.Set(name);
+      return EResourceLocation::kAbsolutePath;
+    }
+  }
+  return EResourceLocation::kNotFound;
+}
+
 #endif
 
 END_IPLUG_NAMESPACE
@@ -79,6 +79,7 @@ extern void INIPath(WDL_String& path, const char* pluginName);
  * The .rc file must include these ids, otherwise you may hit a runtime assertion when you come to load the file.
  * In some cases you may want to provide an absolute path to a file in a shared resources folder
  * here (for example if you want to reduce the disk footprint of multiple bundles, such as when you have multiple plug-in formats installed).
+ * The bundle's resources are found once and cached for the process, see ResourcePathCache, so repeated lookups don't touch the file system.
  *
  * @param fileNameOrResID The filename or resourceID including extension. If no resource is found this argument is tested as an absolute path.
  * @param type The resource type (file extension) in lower or upper case, e.g. ttf or TTF for a truetype font
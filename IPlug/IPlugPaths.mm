@@ -15,6 +15,7 @@
 
 
 #include "IPlugPaths.h"
+#include "IPlugResourcePathCache.h"
 #include <string>
 #include <map>
 
@@ -147,29 +148,32 @@ bool GetResourcePathFromBundle(const char* fileName, const char* searchExt, WDL_
     
     bool isCorrectType = !strcasecmp(ext, searchExt);
     
-    bool isAppExtension = IsOOPAuv3AppExtension();
-    
-    NSBundle* pBundle = [NSBundle bundleWithIdentifier:[NSString stringWithCString:bundleID encoding:NSUTF8StringEncoding]];
-    
-    NSString* pFile = [[NSString stringWithCString:fileName encoding:NSUTF8StringEncoding] stringByDeletingPathExtension];
-    NSString* pExt = [NSString stringWithCString:searchExt encoding:NSUTF8StringEncoding];
-    
-    if (isCorrectType && pBundle && pFile)
+    if (isCorrectType && CStringHasContents(bundleID))
     {
-      NSString* pBasePath;
-      
-      if(isAppExtension)
-        pBasePath = [[[[pBundle bundlePath] stringByDeletingLastPathComponent] stringByDeletingLastPathComponent] stringByAppendingString:@"/Resources/"];
-      else
-        pBasePath = [[pBundle resourcePath] stringByAppendingString:@"/"];
+      // the bundle's resources folder is scanned once, case-insensitively like the default file system, rather than checked for every lookup
+      auto scanBundle = [bundleID](ResourcePathCache::Entries& entries) {
+        NSBundle* pBundle = [NSBundle bundleWithIdentifier:[NSString stringWithCString:bundleID encoding:NSUTF8StringEncoding]];
+        
+        if (!pBundle)
+          return;
+        
+        NSString* pBasePath;
+        
+        if(IsOOPAuv3AppExtension())
+          pBasePath = [[[[pBundle bundlePath] stringByDeletingLastPathComponent] stringByDeletingLastPathComponent] stringByAppendingString:@"/Resources/"];
+        else
+          pBasePath = [[pBundle resourcePath] stringByAppendingString:@"/"];
+        
+        ResourcePathCache::ScanDirectory([pBasePath UTF8String], entries, true, 1);
+      };
       
-      NSString* pPath = [[[pBasePath stringByAppendingString:pFile] stringByAppendingString: @"."] stringByAppendingString:pExt];
+      WDL_String file(fileName);
+      file.remove_fileext();
+      file.Append(".");
+      file.Append(searchExt);
       
-      if (pPath && [[NSFileManager defaultManager] fileExistsAtPath : pPath] == YES)
-      {
-        fullPath.Set([pPath cStringUsingEncoding:NSUTF8StringEncoding]);
+      if (ResourcePathCache::Find(bundleID, scanBundle, ResourcePathCache::FoldName(file.Get(), true), fullPath))
         return true;
-      }
     }
     
     fullPath.Set("");
@@ -17,6 +17,12 @@
 #include "wdlendian.h"
 #include "wdl_base64.h"
 
+#ifdef IPLUG_ZLIB_STATE
+#include "zlib/zlib.h"
+#endif
+
+#include <vector>
+
 using namespace iplug;
 
 IPluginBase::IPluginBase(int nParams, int nPresets)
@@ -24,11 +30,39 @@ IPluginBase::IPluginBase(int nParams, int nPresets)
 {  
   for (int i = 0; i < nPresets; ++i)
     mPresets.Add(new IPreset());
+
+#ifdef WDL_HEAPBUF_ACCOUNTING
+  if ((mHeapBufAccount = WDL_HeapBuf_Account::Current()))
+    mHeapBufAccount->AddRef();
+#endif
 }
 
 IPluginBase::~IPluginBase()
 {
   mPresets.Empty(true);
+
+#ifdef WDL_HEAPBUF_ACCOUNTING
+  if (mHeapBufAccount)
+    mHeapBufAccount->Release();
+#endif
+}
+
+void IPluginBase::InitDeferred()
+{
+  if (mDeferredInitDone)
+    return;
+
+  mDeferredInitDone = true; // first, so that the function can restore presets etc.
+
+  if (mDeferredInitFunc)
+  {
+    TRACE_SCOPE("InitDeferred");
+    using ms = std::chrono::duration<double, std::milli>;
+    const auto start = std::chrono::steady_clock::now();
+    mDeferredInitFunc();
+    mDeferredInitFunc = nullptr;
+    Trace(TRACELOC, "%.2fms, %.2fms after construction", ms(std::chrono::steady_clock::now() - start).count(), ms(start - mConstructionTime).count());
+  }
 }
 
 int IPluginBase::GetPluginVersion(bool decimal) const
@@ -75,6 +109,8 @@ const char* IPluginBase::GetAPIStr() const
     case kAPIAPP: return "APP";
     case kAPIWAM: return "WAM";
     case kAPIWEB: return "WEB";
+    case kAPIBENCH: return "BENCH";
+    case kAPICLAP: return "CLAP";
     default: return "";
   }
 }
@@ -106,6 +142,7 @@ bool IPluginBase::SerializeParams(IByteChunk& chunk) const
   TRACE
   bool savedOK = true;
   int i, n = mParams.GetSize();
+  chunk.Reserve(chunk.Size() + n * static_cast<int>(sizeof(double)));
   for (i = 0; i < n && savedOK; ++i)
   {
     IParam* pParam = mParams.Get(i);
@@ -136,6 +173,225 @@ int IPluginBase::UnserializeParams(const IByteChunk& chunk, int startPos)
   return pos;
 }
 
+// The compact format is a header - magic, version, flags, number of parameters, number of values, payload size and stored size - followed by the payload, which may be compressed.
+// The payload holds one entry per value that differs from the parameter's default: the gap from the previous entry's index as a variable length integer, then the value as a double
+enum ECompactParamsFlags
+{
+  kCompactParamsZlib = 1
+};
+
+static void PutVarUInt(IByteChunk& chunk, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    uint8_t byte = static_cast<uint8_t>(value | 0x80);
+    chunk.Put(&byte);
+    value >>= 7;
+  }
+
+  uint8_t byte = static_cast<uint8_t>(value);
+  chunk.Put(&byte);
+}
+
+static int GetVarUInt(const uint8_t* pData, int size, uint32_t& value, int pos)
+{
+  value = 0;
+
+  for (int shift = 0; shift < 35 && pos >= 0 && pos < size; shift += 7)
+  {
+    uint8_t byte = pData[pos++];
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+      return pos;
+  }
+
+  return -1;
+}
+
+bool IPluginBase::SerializeParamsCompact(IByteChunk& chunk, bool compress) const
+{
+  TRACE
+  const int n = mParams.GetSize();
+  IByteChunk payload;
+  payload.Reserve(n * (static_cast<int>(sizeof(double)) + 1));
+
+  int nValues = 0, lastIdx = -1;
+
+  for (int i = 0; i < n; ++i)
+  {
+    const IParam* pParam = mParams.Get(i);
+    double v = pParam->Value();
+
+    if (v != pParam->GetDefault())
+    {
+      PutVarUInt(payload, static_cast<uint32_t>(i - lastIdx - 1));
+      payload.Put(&v);
+      lastIdx = i;
+      nValues++;
+    }
+  }
+
+  int magic = IPLUG_COMPACT_PARAMS_MAGIC;
+  uint8_t version = IPLUG_COMPACT_PARAMS_VERSION;
+  uint8_t flags = 0;
+  int payloadSize = payload.Size();
+  const uint8_t* pStored = payload.GetData();
+  int storedSize = payloadSize;
+
+#ifdef IPLUG_ZLIB_STATE
+  IByteChunk compressed;
+
+  if (compress && payloadSize)
+  {
+    uLongf compressedSize = compressBound(static_cast<uLong>(payloadSize));
+    compressed.Resize(static_cast<int>(compressedSize));
+
+    if (compress2(compressed.GetData(), &compressedSize, payload.GetData(), static_cast<uLong>(payloadSize), Z_BEST_SPEED) == Z_OK && static_cast<int>(compressedSize) < payloadSize)
+    {
+      flags |= kCompactParamsZlib;
+      pStored = compressed.GetData();
+      storedSize = static_cast<int>(compressedSize);
+    }
+  }
+#endif
+
+  chunk.Reserve(chunk.Size() + 6 * static_cast<int>(sizeof(int)) + storedSize);
+  chunk.Put(&magic);
+  chunk.Put(&version);
+  chunk.Put(&flags);
+  chunk.Put(&n);
+  chunk.Put(&nValues);
+  chunk.Put(&payloadSize);
+  chunk.Put(&storedSize);
+
+  return storedSize == 0 || chunk.PutBytes(pStored, storedSize) > 0;
+}
+
+int IPluginBase::UnserializeParamsCompact(const IByteChunk& chunk, int startPos)
+{
+  TRACE
+  int magic = 0;
+
+  if (chunk.Get(&magic, startPos) < 0 || magic != IPLUG_COMPACT_PARAMS_MAGIC)
+    return UnserializeParams(chunk, startPos);
+
+  const int n = mParams.GetSize();
+  std::vector<double> values(n);
+  const int endPos = GetParamValuesFromChunk(chunk, startPos, values.data());
+
+  if (endPos < 0)
+    return -1;
+
+  std::vector<int> changed;
+
+  ENTER_PARAMS_MUTEX
+  for (int i = 0; i < n; ++i)
+  {
+    IParam* pParam = mParams.Get(i);
+    const double before = pParam->Value();
+    pParam->Set(values[i]);
+
+    if (pParam->Value() != before)
+      changed.push_back(i);
+  }
+
+  for (int paramIdx : changed)
+  {
+    OnParamChange(paramIdx, kPresetRecall);
+    OnParamChangeUI(paramIdx, kPresetRecall);
+  }
+  LEAVE_PARAMS_MUTEX
+
+  return endPos;
+}
+
+int IPluginBase::GetParamValuesFromChunk(const IByteChunk& chunk, int startPos, double* pValues) const
+{
+  const int n = mParams.GetSize();
+  int magic = 0;
+
+  if (chunk.Get(&magic, startPos) < 0 || magic != IPLUG_COMPACT_PARAMS_MAGIC)
+  {
+    // SerializeParams() format, parameters missing from the end of the chunk keep their current values
+    int pos = startPos;
+
+    for (int i = 0; i < n; ++i)
+    {
+      pValues[i] = mParams.Get(i)->Value();
+
+      if (pos >= 0)
+        pos = chunk.Get(&pValues[i], pos);
+    }
+
+    return pos;
+  }
+
+  uint8_t version = 0, flags = 0;
+  int nStoredParams = 0, nValues = 0, payloadSize = 0, storedSize = 0;
+  int pos = startPos + static_cast<int>(sizeof(int));
+  pos = chunk.Get(&version, pos);
+  pos = chunk.Get(&flags, pos);
+  pos = chunk.Get(&nStoredParams, pos);
+  pos = chunk.Get(&nValues, pos);
+  pos = chunk.Get(&payloadSize, pos);
+  pos = chunk.Get(&storedSize, pos);
+
+  if (pos < 0 || version > IPLUG_COMPACT_PARAMS_VERSION || payloadSize < 0 || storedSize < 0 || pos + storedSize > chunk.Size())
+    return -1;
+
+  const uint8_t* pPayload = chunk.GetData() + pos;
+  const int endPos = pos + storedSize;
+
+#ifdef IPLUG_ZLIB_STATE
+  IByteChunk uncompressed;
+
+  if (flags & kCompactParamsZlib)
+  {
+    uLongf uncompressedSize = static_cast<uLongf>(payloadSize);
+    uncompressed.Resize(payloadSize);
+
+    if (uncompress(uncompressed.GetData(), &uncompressedSize, pPayload, static_cast<uLong>(storedSize)) != Z_OK || static_cast<int>(uncompressedSize) != payloadSize)
+      return -1;
+
+    pPayload = uncompressed.GetData();
+  }
+#else
+  if (flags & kCompactParamsZlib)
+  {
+    DBGMSG("compressed parameter state needs IPLUG_ZLIB_STATE\n");
+    return -1;
+  }
+#endif
+
+  if (!(flags & kCompactParamsZlib) && payloadSize != storedSize)
+    return -1;
+
+  for (int i = 0; i < n; ++i)
+    pValues[i] = mParams.Get(i)->GetDefault();
+
+  int payloadPos = 0, idx = -1;
+
+  for (int v = 0; v < nValues; v++)
+  {
+    uint32_t gap = 0;
+    payloadPos = GetVarUInt(pPayload, payloadSize, gap, payloadPos);
+
+    if (payloadPos < 0 || payloadPos + static_cast<int>(sizeof(double)) > payloadSize)
+      return -1;
+
+    idx += static_cast<int>(gap) + 1;
+
+    if (idx >= n) // from a version of the plug-in with more parameters
+      break;
+
+    memcpy(&pValues[idx], pPayload + payloadPos, sizeof(double));
+    payloadPos += static_cast<int>(sizeof(double));
+  }
+
+  return endPos;
+}
+
 void IPluginBase::InitParamRange(int startIdx, int endIdx, int countStart, const char* nameFmtStr, double defaultVal, double minVal, double maxVal, double step, const char *label, int flags, const char *group, const IParam::Shape& shape, IParam::EParamUnit unit, IParam::DisplayFunc displayFunc)
 {
   WDL_String nameStr;
@@ -204,14 +460,54 @@ void IPluginBase::ForParamInRange(int startIdx, int endIdx, std::function<void(i
 
 void IPluginBase::ForParamInGroup(const char* paramGroup, std::function<void (int paramIdx, IParam&)> func)
 {
+  UpdateParamIndices();
+
+  auto it = mParamGroupIndex.find(paramGroup);
+
+  if (it == mParamGroupIndex.end())
+    return;
+
+  for (int p : it->second)
+  {
+    func(p, * GetParam(p));
+  }
+}
+
+int IPluginBase::FindParamIdx(const char* name) const
+{
+  UpdateParamIndices();
+
+  auto it = mParamNameIndex.find(name);
+  return it != mParamNameIndex.end() ? it->second : kNoParameter;
+}
+
+int IPluginBase::NParamsInGroup(const char* paramGroup) const
+{
+  UpdateParamIndices();
+
+  auto it = mParamGroupIndex.find(paramGroup);
+  return it != mParamGroupIndex.end() ? static_cast<int>(it->second.size()) : 0;
+}
+
+void IPluginBase::UpdateParamIndices() const
+{
+  const uint32_t version = IParam::GetNamesVersion();
+
+  if (version == mParamIndicesVersion && NParams() == mParamIndicesSize)
+    return;
+
+  mParamNameIndex.clear();
+  mParamGroupIndex.clear();
+
   for (auto p = 0; p < NParams(); p++)
   {
-    IParam* pParam = GetParam(p);
-    if(strcmp(pParam->GetGroup(), paramGroup) == 0)
-    {
-      func(p, *pParam);
-    }
+    const IParam* pParam = GetParam(p);
+    mParamNameIndex.emplace(pParam->GetName(), p); // keeps the first parameter with a name
+    mParamGroupIndex[pParam->GetGroup()].push_back(p);
   }
+
+  mParamIndicesVersion = version;
+  mParamIndicesSize = NParams();
 }
 
 void IPluginBase::DefaultParamValues()
@@ -390,6 +686,88 @@ void IPluginBase::EnsureDefaultPreset()
   MakeDefaultPreset("Empty", mPresets.GetSize());
 }
 
+bool IPluginBase::MakePresetsFromBank(const char* path)
+{
+  auto bank = IPresetBank::Open(path);
+
+  if (!bank)
+    return false;
+
+  SetPresetBank(bank);
+  return true;
+}
+
+void IPluginBase::SetPresetBank(std::shared_ptr<const IPresetBank> bank)
+{
+  mPresetBank = std::move(bank);
+  mBankPresetCopies.clear();
+}
+
+bool IPluginBase::WritePresetBank(const char* path, std::function<const char*(int presetIdx)> categoryFunc) const
+{
+  IPresetBankWriter writer;
+  IByteChunk chunk;
+  int n = NPresets();
+  for (int i = 0; i < n; ++i)
+  {
+    if (GetPresetChunk(i, chunk))
+    {
+      const char* category = categoryFunc ? categoryFunc(i) : GetPresetCategory(i);
+      writer.Add(GetPresetName(i), category, chunk);
+    }
+  }
+  return writer.Write(path);
+}
+
+const IPreset* IPluginBase::FindPreset(int idx) const
+{
+  if (idx >= 0 && idx < mPresets.GetSize())
+  {
+    return mPresets.Get(idx);
+  }
+  auto it = mBankPresetCopies.find(idx - mPresets.GetSize());
+  return it != mBankPresetCopies.end() ? it->second.get() : nullptr;
+}
+
+IPreset* IPluginBase::GetPreset(int idx)
+{
+  if (IPreset* pPreset = const_cast<IPreset*>(FindPreset(idx)))
+  {
+    return pPreset;
+  }
+  
+  int bankIdx = idx - mPresets.GetSize();
+  if (bankIdx < 0 || bankIdx >= NBankPresets())
+  {
+    return nullptr;
+  }
+  // the first time a bank preset is needed as an IPreset, copy it out of the bank
+  auto pPreset = std::make_unique<IPreset>();
+  pPreset->mInitialized = true;
+  snprintf(pPreset->mName, MAX_PRESET_NAME_LEN, "%s", mPresetBank->GetName(bankIdx));
+  mPresetBank->GetChunk(bankIdx, pPreset->mChunk);
+  return (mBankPresetCopies[bankIdx] = std::move(pPreset)).get();
+}
+
+bool IPluginBase::GetPresetChunk(int idx, IByteChunk& chunk) const
+{
+  chunk.Clear();
+  if (const IPreset* pPreset = FindPreset(idx))
+  {
+    return pPreset->mInitialized && chunk.PutChunk(&pPreset->mChunk) >= 0;
+  }
+  return mPresetBank && mPresetBank->GetChunk(idx - mPresets.GetSize(), chunk);
+}
+
+const char* IPluginBase::GetPresetCategory(int idx) const
+{
+  if (!mPresetBank || idx < mPresets.GetSize())
+  {
+    return "";
+  }
+  return mPresetBank->GetCategoryName(mPresetBank->GetCategory(idx - mPresets.GetSize()));
+}
+
 void IPluginBase::PruneUninitializedPresets()
 {
   TRACE
@@ -411,11 +789,11 @@ void IPluginBase::PruneUninitializedPresets()
 bool IPluginBase::RestorePreset(int idx)
 {
   TRACE
+  InitDeferred();
   bool restoredOK = false;
-  if (idx >= 0 && idx < mPresets.GetSize())
+  IPreset* pPreset = const_cast<IPreset*>(FindPreset(idx));
+  if (pPreset)
   {
-    IPreset* pPreset = mPresets.Get(idx);
-    
     if (!(pPreset->mInitialized))
     {
       pPreset->mInitialized = true;
@@ -426,19 +804,26 @@ bool IPluginBase::RestorePreset(int idx)
     {
       restoredOK = (UnserializeState(pPreset->mChunk, 0) > 0);
     }
-    
-    if (restoredOK)
-    {
-      mCurrentPresetIdx = idx;
-      OnPresetsModified();
-      OnRestoreState();
-    }
+  }
+  else if (mPresetBank)
+  {
+    // a bank preset this instance hasn't modified is read from the bank, without keeping a copy
+    IByteChunk chunk;
+    restoredOK = mPresetBank->GetChunk(idx - mPresets.GetSize(), chunk) && (UnserializeState(chunk, 0) > 0);
+  }
+  
+  if (restoredOK)
+  {
+    mCurrentPresetIdx = idx;
+    OnPresetsModified();
+    OnRestoreState();
   }
   return restoredOK;
 }
 
 bool IPluginBase::RestorePreset(const char* name)
 {
+  InitDeferred();
   if (CStringHasContents(name))
   {
     int n = mPresets.GetSize();
@@ -450,24 +835,41 @@ bool IPluginBase::RestorePreset(const char* name)
         return RestorePreset(i);
       }
     }
+    
+    for (const auto& [bankIdx, pPreset] : mBankPresetCopies)
+    {
+      if (!strcmp(pPreset->mName, name))
+      {
+        return RestorePreset(mPresets.GetSize() + bankIdx);
+      }
+    }
+    
+    if (mPresetBank)
+    {
+      int bankIdx = mPresetBank->Find(name);
+      // a copy may have been renamed
+      if (bankIdx >= 0 && !mBankPresetCopies.count(bankIdx))
+      {
+        return RestorePreset(mPresets.GetSize() + bankIdx);
+      }
+    }
   }
   return false;
 }
 
 const char* IPluginBase::GetPresetName(int idx) const
 {
-  if (idx >= 0 && idx < mPresets.GetSize())
+  if (const IPreset* pPreset = FindPreset(idx))
   {
-    return mPresets.Get(idx)->mName;
+    return pPreset->mName;
   }
-  return "";
+  return mPresetBank ? mPresetBank->GetName(idx - mPresets.GetSize()) : "";
 }
 
 void IPluginBase::ModifyCurrentPreset(const char* name)
 {
-  if (mCurrentPresetIdx >= 0 && mCurrentPresetIdx < mPresets.GetSize())
+  if (IPreset* pPreset = GetPreset(mCurrentPresetIdx))
   {
-    IPreset* pPreset = mPresets.Get(mCurrentPresetIdx);
     pPreset->mChunk.Clear();
     
     Trace(TRACELOC, "%d %s", mCurrentPresetIdx, pPreset->mName);
@@ -485,18 +887,30 @@ bool IPluginBase::SerializePresets(IByteChunk& chunk) const
 {
   TRACE
   bool savedOK = true;
-  int n = mPresets.GetSize();
+  int n = NPresets();
   for (int i = 0; i < n && savedOK; ++i)
   {
-    IPreset* pPreset = mPresets.Get(i);
-    chunk.PutStr(pPreset->mName);
+    const IPreset* pPreset = FindPreset(i);
+    chunk.PutStr(GetPresetName(i));
     
-    Trace(TRACELOC, "%d %s", i, pPreset->mName);
+    Trace(TRACELOC, "%d %s", i, GetPresetName(i));
     
-    chunk.Put(&pPreset->mInitialized);
-    if (pPreset->mInitialized)
+    if (pPreset)
     {
-      savedOK &= (chunk.PutChunk(&(pPreset->mChunk)) > 0);
+      chunk.Put(&pPreset->mInitialized);
+      if (pPreset->mInitialized)
+      {
+        savedOK &= (chunk.PutChunk(&(pPreset->mChunk)) > 0);
+      }
+    }
+    else
+    {
+      // the bank preset's state, straight from the mapping
+      bool initialized = true;
+      int size;
+      const uint8_t* pData = mPresetBank->GetData(i - mPresets.GetSize(), size);
+      chunk.Put(&initialized);
+      savedOK &= (chunk.PutBytes(pData, size) > 0);
     }
   }
   return savedOK;
@@ -505,11 +919,12 @@ bool IPluginBase::SerializePresets(IByteChunk& chunk) const
 int IPluginBase::UnserializePresets(const IByteChunk& chunk, int startPos)
 {
   TRACE
+  InitDeferred();
   WDL_String name;
-  int n = mPresets.GetSize(), pos = startPos;
+  int n = NPresets(), pos = startPos;
   for (int i = 0; i < n && pos >= 0; ++i)
   {
-    IPreset* pPreset = mPresets.Get(i);
+    IPreset* pPreset = GetPreset(i);
     pos = chunk.GetStr(name, pos);
     strcpy(pPreset->mName, name.Get());
     
@@ -628,12 +1043,13 @@ void IPluginBase::DumpPresetBlob(const char* filename) const
   
   char buf[MAX_BLOB_LENGTH];
   
-  IByteChunk* pPresetChunk = &mPresets.Get(mCurrentPresetIdx)->mChunk;
-  uint8_t* byteStart = pPresetChunk->GetData();
+  IByteChunk presetChunk;
+  GetPresetChunk(mCurrentPresetIdx, presetChunk);
+  uint8_t* byteStart = presetChunk.GetData();
   
-  wdl_base64encode(byteStart, buf, pPresetChunk->Size());
+  wdl_base64encode(byteStart, buf, presetChunk.Size());
   
-  fprintf(fp, "%s\", %i);\n", buf, pPresetChunk->Size());
+  fprintf(fp, "%s\", %i);\n", buf, presetChunk.Size());
   fclose(fp);
 }
 
@@ -779,11 +1195,12 @@ bool IPluginBase::SaveBankAsFXB(const char* file) const
       
       for (int p = 0; p < NPresets(); p++)
       {
-        IPreset* pPreset = mPresets.Get(p);
+        IByteChunk presetChunk;
+        GetPresetChunk(p, presetChunk);
         
         char prgName[28];
         memset(prgName, 0, 28);
-        strcpy(prgName, pPreset->mName);
+        strcpy(prgName, GetPresetName(p));
         
         bnk.Put(&chunkMagic);
         //byteSize = WDL_bswap32(20 + 28 + (NParams() * 4) );
@@ -800,7 +1217,7 @@ bool IPluginBase::SaveBankAsFXB(const char* file) const
         for (int i = 0; i< NParams(); i++)
         {
           double v = 0.0;
-          pos = pPreset->mChunk.Get(&v, pos);
+          pos = presetChunk.Get(&v, pos);
           
           WDL_EndianFloat v32;
           v32.f = (float) GetParam(i)->ToNormalized(v);
@@ -1045,3 +1462,33 @@ bool IPluginBase::LoadBankFromFXB(const char* file)
   
   return false;
 }
+
+void IPluginBase::GetMemoryReport(IMemoryReport& report) const
+{
+  EDITOR_DELEGATE_CLASS::GetMemoryReport(report);
+
+  auto presetBytes = [](const IPreset* pPreset) { return sizeof(IPreset) + pPreset->mChunk.Size(); };
+
+  size_t bytes = 0;
+
+  for (int i = 0; i < mPresets.GetSize(); i++)
+    bytes += presetBytes(mPresets.Get(i));
+
+  for (const auto& copy : mBankPresetCopies)
+    bytes += presetBytes(copy.second.get());
+
+  report.Add(kMemoryPresets, bytes);
+
+  if (mPresetBank)
+    report.Add(kMemoryPresets, mPresetBank->GetSize(), true);
+
+  IByteChunk state;
+
+  if (SerializeState(state))
+    report.Add(kMemoryState, state.Size());
+
+#ifdef WDL_HEAPBUF_ACCOUNTING
+  if (mHeapBufAccount)
+    report.Add(kMemoryHeapBuffers, static_cast<size_t>(mHeapBufAccount->GetBytes()));
+#endif
+}
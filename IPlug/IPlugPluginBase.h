@@ -19,6 +19,14 @@
 #include "IPlugParameter.h"
 #include "IPlugStructs.h"
 #include "IPlugLogger.h"
+#include "IPlugPresetBank.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -132,6 +140,26 @@ public:
    * @param startPos The start position in the chunk where parameter values are stored
    * @return The new chunk position (endPos) */
   int UnserializeParams(const IByteChunk& chunk, int startPos);
+
+  /** Serializes the parameters whose values differ from their defaults, in a compact, versioned format. For plug-ins with many parameters, most of them at their defaults, this is much smaller and faster than SerializeParams()
+   * @param chunk The output chunk to serialize to. Will append data if the chunk has already been started.
+   * @param compress \c true to compress the values with zlib. This needs iPlug to be built with IPLUG_ZLIB_STATE defined and WDL/zlib linked, otherwise it is ignored
+   * @return \c true if the serialization was successful */
+  bool SerializeParamsCompact(IByteChunk& chunk, bool compress = false) const;
+
+  /** Unserializes values written by SerializeParamsCompact(), or by SerializeParams() if the chunk doesn't start with the compact format's header.
+   * Parameters missing from the chunk are set to their defaults. Unlike UnserializeParams(), only the parameters whose values change are notified, via OnParamChange() and OnParamChangeUI(), rather than calling OnParamReset()
+   * @param chunk The incoming chunk where parameter values are stored to unserialize
+   * @param startPos The start position in the chunk where parameter values are stored
+   * @return The new chunk position (endPos), or -1 if the data is invalid */
+  int UnserializeParamsCompact(const IByteChunk& chunk, int startPos);
+
+  /** Reads the parameter values stored by SerializeParamsCompact() or SerializeParams() without setting any parameters
+   * @param chunk The incoming chunk where parameter values are stored
+   * @param startPos The start position in the chunk where parameter values are stored
+   * @param pValues Receives NParams() non-normalised values. Parameters missing from a compact chunk get their defaults, and those missing from the end of a SerializeParams() chunk get their current values
+   * @return The new chunk position (endPos), or -1 if the data is invalid */
+  int GetParamValuesFromChunk(const IByteChunk& chunk, int startPos, double* pValues) const;
     
   /** Override this method to serialize custom state data, if your plugin does state chunks.
    * @param chunk The output bytechunk where data can be serialized
@@ -166,11 +194,29 @@ public:
   /** Implemented by the API class, called by the UI (etc) when the plug-in initiates a program/preset change (not applicable to all APIs) */
   virtual void InformHostOfPresetChange() {};
 
+#pragma mark - Deferred initialization
+
+  /** Set a function to do the plug-in's expensive initialization later than its constructor, e.g. computing DSP tables, loading convolution IRs or making
+   * presets, so that a host that constructs plug-ins to scan or validate them, or that constructs every instance when it loads a project, doesn't wait for it.
+   * It is called once, on the main thread, by InitDeferred(). The constructor must still initialize all the parameters, and the function mustn't change
+   * their values, since the host may have restored state by the time it runs. Call it in the plug-in's constructor
+   * @param func The function to call, which is released once it has run */
+  void SetDeferredInitFunc(std::function<void()> func) { mDeferredInitFunc = std::move(func); }
+
+  /** Call the function set with SetDeferredInitFunc(), if it hasn't been called. The API classes call this before the plug-in is first reset or activated,
+   * and RestorePreset() and UnserializePresets() call it, so that presets it makes are there. Call it yourself before using anything it creates elsewhere,
+   * e.g. in UnserializeState() or the UI. Its duration, and the time since construction, are traced */
+  void InitDeferred();
+
+  /** @return \c true once InitDeferred() has been called */
+  bool IsInitDeferredDone() const { return mDeferredInitDone; }
+
 #pragma mark - Preset Manipulation
   
-  /** Get a ptr to a factory preset
-   * @ param idx The index number of the preset you are referring to */
-  IPreset* GetPreset(int idx) { return mPresets.Get(idx); }
+  /** Get a ptr to a factory preset. A preset from the factory bank is copied out of it the first time, and from then on is this copy, which can be modified
+   * @ param idx The index number of the preset you are referring to
+   * @return The preset, or nullptr if idx is out of range */
+  IPreset* GetPreset(int idx);
   
   /** This method should update the current preset with current values
    * NOTE: This is only relevant for VST2 plug-ins, which is the only format to have the notion of banks?
@@ -179,7 +225,7 @@ public:
 
   /** Gets the number of factory presets. NOTE: some hosts don't like 0 presets, so even if you don't support factory presets, this method should return 1
    * @return The number of factory presets */
-  int NPresets() const { return mPresets.GetSize(); }
+  int NPresets() const { return mPresets.GetSize() + NBankPresets(); }
 
   /** Restore a preset by index. This should also update mCurrentPresetIdx
    * @param idx The index of the preset to restore
@@ -195,13 +241,24 @@ public:
    * @param idx The index of the preset whose name to get
    * @return CString preset name */
   const char* GetPresetName(int idx) const;
+
+  /** Get the category of a preset from the factory bank
+   * @param idx The index of the preset
+   * @return CString category name, "" if the preset has none or isn't from the bank */
+  const char* GetPresetCategory(int idx) const;
+
+  /** Copy a preset's state into a chunk, without copying a preset from the factory bank into this instance, see GetPreset()
+   * @param idx The index of the preset
+   * @param chunk IByteChunk to fill, replacing its contents
+   * @return \c true if the preset exists and has been initialized */
+  bool GetPresetChunk(int idx, IByteChunk& chunk) const;
   
   /** Copy source preset to preset at index
   * @param pSrc source preset
   * @param destIdx index of internal destination preset */
   void CopyPreset(IPreset* pSrc, int destIdx, bool copyname = false)
   {
-    IPreset* pDst = mPresets.Get(destIdx);
+    IPreset* pDst = GetPreset(destIdx);
 
     pDst->mChunk.Clear();
     pDst->mChunk.PutChunk(&pSrc->mChunk);
@@ -246,6 +303,28 @@ public:
    * @param sizeOfChunk The binary string size */
   void MakePresetFromBlob(const char* name, const char* blob, int sizeOfChunk);
   
+  /** Append the presets of a factory bank file to this instance's presets, following those created with MakePreset() etc. The file is memory-mapped once
+   * per process and shared read-only by every instance, and a preset's state is only read when it is recalled. Call it in the plug-in's constructor
+   * @param path The full path of a bank written by IPresetBankWriter or WritePresetBank(), UTF-8
+   * @return \c true if the bank was opened */
+  bool MakePresetsFromBank(const char* path);
+
+  /** Append the presets of a factory bank that is already open, e.g. one from IPresetBank::FromMemory() on a resource embedded in the binary
+   * @param bank The bank, or nullptr to remove the factory bank */
+  void SetPresetBank(std::shared_ptr<const IPresetBank> bank);
+
+  /** @return The factory bank, or nullptr. Its preset i is preset GetPresetBankStartIdx() + i of this instance */
+  const IPresetBank* GetPresetBank() const { return mPresetBank.get(); }
+
+  /** @return The index of the first preset from the factory bank */
+  int GetPresetBankStartIdx() const { return mPresets.GetSize(); }
+
+  /** Write all the initialized presets to a bank file, e.g. to convert baked-in factory presets, in a tool build of the plug-in
+   * @param path The full path of the file to write or overwrite
+   * @param categoryFunc Returns the category of the preset at an index, or nullptr for none. If it is empty, presets from a factory bank keep their category
+   * @return \c true on success */
+  bool WritePresetBank(const char* path, std::function<const char*(int presetIdx)> categoryFunc = nullptr) const;
+
   /** [AUV2 only] Removes any presets that weren't initialized */
   void PruneUninitializedPresets();
   
@@ -299,7 +378,13 @@ public:
    * @return /c true on success */
   bool LoadBankFromFXB(const char* file);
 
-  
+#pragma mark - Memory accounting
+
+  /** Adds the presets this instance holds, the size of its state as SerializeState() writes it (a copy the host keeps for every instance) and the shared factory bank, to the parameters IEditorDelegate counts.
+   * If the project is built with WDL_HEAPBUF_ACCOUNTING it also adds the heap buffers created while the plug-in was constructed, see IMemoryAccountScope
+   * @param report The report to add to */
+  void GetMemoryReport(IMemoryReport& report) const override;
+
 #pragma mark - Parameter manipulation
     
   /** Initialise a range of parameters simultaneously. This mirrors the arguments available in IParam::InitDouble, for maximum flexibility
@@ -338,6 +423,15 @@ public:
    * @param paramGroup The name of the group to modify
    * @param func A lambda function to modify the parameter. Ideas: you could randomise the parameter value or reset to default*/
   void ForParamInGroup(const char* paramGroup, std::function<void(int paramIdx, IParam& param)> func);
+
+  /** Find a parameter by name. Uses a hashed index of the parameter names, which is rebuilt when a name or group changes. Call from the main thread
+   * @param name The name of the parameter
+   * @return The index of the first parameter with that name, or kNoParameter if there isn't one */
+  int FindParamIdx(const char* name) const;
+
+  /** @param paramGroup The name of the group
+   * @return The number of parameters in a group, from the same index as FindParamIdx() */
+  int NParamsInGroup(const char* paramGroup) const;
   
   /** Copy a range of parameter values
    * @param startIdx The index of the first parameter value to copy
@@ -421,6 +515,33 @@ private:
   WDL_PtrList<const char> mParamGroups;
   /** "Baked in" Factory presets */
   WDL_PtrList<IPreset> mPresets;
+  /** Factory presets that follow mPresets, shared by every instance */
+  std::shared_ptr<const IPresetBank> mPresetBank;
+  /** Copies of the presets from mPresetBank that have been needed as an IPreset, by their index in the bank, so that pruning mPresets doesn't move them */
+  std::unordered_map<int, std::unique_ptr<IPreset>> mBankPresetCopies;
+
+  int NBankPresets() const { return mPresetBank ? mPresetBank->NPresets() : 0; }
+
+  std::function<void()> mDeferredInitFunc;
+  bool mDeferredInitDone = false;
+  std::chrono::steady_clock::time_point mConstructionTime = std::chrono::steady_clock::now();
+
+  /** @return The preset at idx if this instance has it, or nullptr for a preset that is only in the factory bank, or if idx is out of range */
+  const IPreset* FindPreset(int idx) const;
+
+private:
+  /** Rebuild the parameter name and group indices if a name or group has changed since they were built */
+  void UpdateParamIndices() const;
+
+  // the keys view the parameters' interned strings, so they stay valid
+  mutable std::unordered_map<std::string_view, int> mParamNameIndex;
+  mutable std::unordered_map<std::string_view, std::vector<int>> mParamGroupIndex;
+  mutable uint32_t mParamIndicesVersion = 0;
+  mutable int mParamIndicesSize = -1;
+
+#ifdef WDL_HEAPBUF_ACCOUNTING
+  WDL_HeapBuf_Account* mHeapBufAccount = nullptr; // adopted from the IMemoryAccountScope the instance is constructed in
+#endif
 
 #ifdef PARAMS_MUTEX
   friend class IPlugVST3ProcessorBase;
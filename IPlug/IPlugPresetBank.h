@@ -0,0 +1,446 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPresetBank
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugStructs.h"
+
+#include "wdlendian.h"
+#include "fileread.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A read-only bank of factory presets, memory-mapped from a file (or viewing memory embedded in the binary) and shared by every instance in the process.
+ * Nothing is decoded when the bank is opened: names and categories are read straight from the mapping, and a preset's state is only copied out when it is
+ * recalled, so a bank of thousands of presets costs each instance nothing but a pointer, and pages of the file that are never recalled are never read.
+ *
+ * The file is little-endian, every field a uint32, offsets from the start of the file:
+ * - header: 'IPBK', version, nPresets, nCategories, presets offset, name index offset, categories offset, strings offset, strings size
+ * - presets: {name, category, data offset, data size} each, grouped by category. name is an offset into the strings, category is kNoCategory or an index
+ * - name index: the preset indices sorted by name (strcmp), for Find()
+ * - categories: {name, first preset, number of presets} each
+ * - strings: NUL-terminated UTF-8
+ * - data: each preset's state, as written by IPluginBase::SerializeState()
+ *
+ * Write banks with IPresetBankWriter, e.g. from a tool build of the plug-in with IPluginBase::WritePresetBank() */
+class IPresetBank
+{
+public:
+  static constexpr uint32_t kNoCategory = 0xFFFFFFFF;
+  static constexpr uint32_t kVersion = 1;
+
+  IPresetBank(const IPresetBank&) = delete;
+  IPresetBank& operator=(const IPresetBank&) = delete;
+
+  /** Map a bank file, or share the mapping another instance already has open
+   * @param path The full path of the bank file, UTF-8
+   * @return The bank, or nullptr if the file doesn't exist or isn't a valid bank */
+  static std::shared_ptr<const IPresetBank> Open(const char* path)
+  {
+    std::lock_guard<std::mutex> lock(GetCacheMutex());
+    auto& cache = GetCache();
+    auto& entry = cache[path];
+
+    if (auto bank = entry.lock())
+      return bank;
+
+    auto pFile = std::make_unique<WDL_FileRead>(path, 0, 8192, 4, 0, 0x7FFFFFFF); // map the whole file, whatever its size
+    int size = pFile->IsOpen() ? static_cast<int>(std::min<WDL_FILEREAD_POSTYPE>(pFile->GetSize(), 0x7FFFFFFF)) : 0;
+    const void* pData = size ? pFile->GetMappedView(0, &size) : nullptr;
+
+    std::shared_ptr<IPresetBank> bank(new IPresetBank(static_cast<const uint8_t*>(pData), size));
+    bank->mFile = std::move(pFile);
+
+    if (!bank->IsValid())
+    {
+      cache.erase(path);
+      return nullptr;
+    }
+
+    entry = bank;
+    return bank;
+  }
+
+  /** View a bank in memory without copying it, e.g. one embedded in the binary as a resource
+   * @param pData The bank, which must outlive the IPresetBank
+   * @param size The size of the bank in bytes
+   * @return The bank, or nullptr if it isn't valid */
+  static std::shared_ptr<const IPresetBank> FromMemory(const void* pData, int size)
+  {
+    std::shared_ptr<IPresetBank> bank(new IPresetBank(static_cast<const uint8_t*>(pData), size));
+    return bank->IsValid() ? bank : nullptr;
+  }
+
+  int NPresets() const { return mNPresets; }
+
+  /** @return The name of the preset at idx, or "" if idx is out of range */
+  const char* GetName(int idx) const
+  {
+    return (idx >= 0 && idx < mNPresets) ? GetString(PresetField(idx, kName)) : "";
+  }
+
+  /** @return The index of the category of the preset at idx, or -1 if it has none */
+  int GetCategory(int idx) const
+  {
+    uint32_t category = (idx >= 0 && idx < mNPresets) ? PresetField(idx, kCategory) : kNoCategory;
+    return category == kNoCategory ? -1 : static_cast<int>(category);
+  }
+
+  int NCategories() const { return mNCategories; }
+
+  /** @return The size of the bank data in bytes */
+  int GetSize() const { return mSize; }
+
+  /** @return The name of the category at categoryIdx, or "" if it is out of range */
+  const char* GetCategoryName(int categoryIdx) const
+  {
+    return (categoryIdx >= 0 && categoryIdx < mNCategories) ? GetString(Get32(mCategoriesOffset + categoryIdx * kCategorySize)) : "";
+  }
+
+  /** Get the presets in a category, which are consecutive
+   * @param categoryIdx The index of the category
+   * @param firstIdx Set to the index of its first preset
+   * @param nPresets Set to the number of presets in it, 0 if categoryIdx is out of range */
+  void GetCategoryPresets(int categoryIdx, int& firstIdx, int& nPresets) const
+  {
+    firstIdx = nPresets = 0;
+
+    if (categoryIdx >= 0 && categoryIdx < mNCategories)
+    {
+      firstIdx = static_cast<int>(Get32(mCategoriesOffset + categoryIdx * kCategorySize + 4));
+      nPresets = static_cast<int>(Get32(mCategoriesOffset + categoryIdx * kCategorySize + 8));
+    }
+  }
+
+  /** @return The index of the category called name, or -1 */
+  int FindCategory(const char* name) const
+  {
+    for (int i = 0; i < mNCategories; i++)
+    {
+      if (!strcmp(GetCategoryName(i), name))
+        return i;
+    }
+    return -1;
+  }
+
+  /** Find a preset by name, with a binary search of the name index
+   * @return The index of the first preset called name, or -1 */
+  int Find(const char* name) const
+  {
+    int lo = 0, hi = mNPresets;
+
+    while (lo < hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+
+      if (strcmp(GetName(NameIndex(mid)), name) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    return (lo < mNPresets && !strcmp(GetName(NameIndex(lo)), name)) ? NameIndex(lo) : -1;
+  }
+
+  /** Get a preset's state where it is mapped, without copying it
+   * @param idx The index of the preset
+   * @param size Set to the size of the state in bytes
+   * @return A pointer to the state, or nullptr if idx is out of range */
+  const uint8_t* GetData(int idx, int& size) const
+  {
+    if (idx < 0 || idx >= mNPresets)
+    {
+      size = 0;
+      return nullptr;
+    }
+
+    size = static_cast<int>(PresetField(idx, kDataSize));
+    return mData + PresetField(idx, kDataOffset);
+  }
+
+  /** Copy a preset's state into a chunk, replacing its contents
+   * @return \c true if idx is in range */
+  bool GetChunk(int idx, IByteChunk& chunk) const
+  {
+    int size;
+    const uint8_t* pData = GetData(idx, size);
+    chunk.Clear();
+
+    if (!pData)
+      return false;
+
+    chunk.PutBytes(pData, size);
+    return true;
+  }
+
+private:
+  enum EPresetField { kName = 0, kCategory, kDataOffset, kDataSize, kNumPresetFields };
+
+  static constexpr int kHeaderSize = 9 * 4;
+  static constexpr int kPresetSize = kNumPresetFields * 4;
+  static constexpr int kCategorySize = 3 * 4;
+
+  IPresetBank(const uint8_t* pData, int size)
+  : mData(pData)
+  , mSize(pData ? size : 0)
+  {
+  }
+
+  uint32_t Get32(uint32_t offset) const
+  {
+    uint32_t v;
+    memcpy(&v, mData + offset, 4);
+    return WDL_bswap32_if_be(v);
+  }
+
+  uint32_t PresetField(int idx, EPresetField field) const { return Get32(mPresetsOffset + idx * kPresetSize + field * 4); }
+  int NameIndex(int i) const { return static_cast<int>(Get32(mNameIndexOffset + i * 4)); }
+  const char* GetString(uint32_t offset) const { return reinterpret_cast<const char*>(mData + mStringsOffset + offset); }
+
+  /** @return \c true if the table [offset, offset + count * entrySize) lies within the bank */
+  bool TableFits(uint32_t offset, uint32_t count, uint32_t entrySize) const
+  {
+    return offset <= static_cast<uint32_t>(mSize) && count <= (static_cast<uint32_t>(mSize) - offset) / entrySize;
+  }
+
+  /** Read the header and check every offset in the bank once, so that the accessors can trust them */
+  bool IsValid()
+  {
+    if (mSize < kHeaderSize || memcmp(mData, "IPBK", 4) || Get32(4) != kVersion)
+      return false;
+
+    uint32_t nPresets = Get32(8), nCategories = Get32(12), stringsSize = Get32(32);
+    mPresetsOffset = Get32(16);
+    mNameIndexOffset = Get32(20);
+    mCategoriesOffset = Get32(24);
+    mStringsOffset = Get32(28);
+
+    if (nPresets > 0x7FFFFFFF || nCategories > 0x7FFFFFFF
+        || !TableFits(mPresetsOffset, nPresets, kPresetSize) || !TableFits(mNameIndexOffset, nPresets, 4)
+        || !TableFits(mCategoriesOffset, nCategories, kCategorySize) || !TableFits(mStringsOffset, stringsSize, 1)
+        || !stringsSize || mData[mStringsOffset + stringsSize - 1] != 0)
+      return false;
+
+    mNPresets = static_cast<int>(nPresets);
+    mNCategories = static_cast<int>(nCategories);
+
+    for (int i = 0; i < mNPresets; i++)
+    {
+      uint32_t category = PresetField(i, kCategory);
+
+      if (PresetField(i, kName) >= stringsSize || (category != kNoCategory && category >= nCategories)
+          || !TableFits(PresetField(i, kDataOffset), PresetField(i, kDataSize), 1) || static_cast<uint32_t>(NameIndex(i)) >= nPresets)
+        return false;
+    }
+
+    for (int i = 0; i < mNCategories; i++)
+    {
+      uint32_t first = Get32(mCategoriesOffset + i * kCategorySize + 4), n = Get32(mCategoriesOffset + i * kCategorySize + 8);
+
+      if (Get32(mCategoriesOffset + i * kCategorySize) >= stringsSize || first > nPresets || n > nPresets - first)
+        return false;
+    }
+
+    return true;
+  }
+
+  static std::mutex& GetCacheMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::unordered_map<std::string, std::weak_ptr<const IPresetBank>>& GetCache()
+  {
+    static std::unordered_map<std::string, std::weak_ptr<const IPresetBank>> cache;
+    return cache;
+  }
+
+  const uint8_t* mData;
+  int mSize;
+  std::unique_ptr<WDL_FileRead> mFile; // owns the mapping, if the bank was opened from a file
+  int mNPresets = 0;
+  int mNCategories = 0;
+  uint32_t mPresetsOffset = 0;
+  uint32_t mNameIndexOffset = 0;
+  uint32_t mCategoriesOffset = 0;
+  uint32_t mStringsOffset = 0;
+};
+
+/** Builds an IPresetBank file. Presets are grouped by category in the order their categories were first added, and keep the order they were added in within it */
+class IPresetBankWriter
+{
+public:
+  /** Add a preset
+   * @param name The preset's name, which Find() looks up
+   * @param category The preset's category, or nullptr or "" for none
+   * @param chunk The preset's state, as written by IPluginBase::SerializeState() */
+  void Add(const char* name, const char* category, const IByteChunk& chunk)
+  {
+    int categoryIdx = -1;
+
+    if (category && *category)
+    {
+      auto it = std::find(mCategories.begin(), mCategories.end(), category);
+      categoryIdx = static_cast<int>(it - mCategories.begin());
+
+      if (it == mCategories.end())
+        mCategories.push_back(category);
+    }
+
+    mPresets.push_back({name, categoryIdx, std::vector<uint8_t>(chunk.GetData(), chunk.GetData() + chunk.Size())});
+  }
+
+  int NPresets() const { return static_cast<int>(mPresets.size()); }
+
+  /** Write the bank to a file, replacing it
+   * @return \c true on success */
+  bool Write(const char* path) const
+  {
+    std::vector<uint8_t> bank;
+    Build(bank);
+
+    FILE* fp = fopen(path, "wb");
+
+    if (!fp)
+      return false;
+
+    bool ok = fwrite(bank.data(), 1, bank.size(), fp) == bank.size();
+    return (fclose(fp) == 0) && ok;
+  }
+
+  /** Build the bank in memory, e.g. for IPresetBank::FromMemory() */
+  void Build(std::vector<uint8_t>& bank) const
+  {
+    // uncategorised presets go last
+    std::vector<int> order(mPresets.size());
+    for (int i = 0; i < NPresets(); i++)
+      order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+      return static_cast<unsigned>(mPresets[a].mCategory) < static_cast<unsigned>(mPresets[b].mCategory);
+    });
+
+    std::vector<char> strings;
+    auto addString = [&strings](const std::string& str) {
+      uint32_t offset = static_cast<uint32_t>(strings.size());
+      strings.insert(strings.end(), str.c_str(), str.c_str() + str.size() + 1);
+      return offset;
+    };
+
+    const uint32_t nPresets = static_cast<uint32_t>(mPresets.size()), nCategories = static_cast<uint32_t>(mCategories.size());
+    const uint32_t presetsOffset = 9 * 4;
+    const uint32_t nameIndexOffset = presetsOffset + nPresets * 16;
+    const uint32_t categoriesOffset = nameIndexOffset + nPresets * 4;
+    const uint32_t stringsOffset = categoriesOffset + nCategories * 12;
+
+    std::vector<uint32_t> presetNames(nPresets), categoryNames(nCategories), categoryFirst(nCategories, 0), categoryCount(nCategories, 0);
+
+    for (uint32_t i = 0; i < nPresets; i++)
+    {
+      const Preset& preset = mPresets[order[i]];
+      presetNames[i] = addString(preset.mName);
+
+      if (preset.mCategory >= 0 && !categoryCount[preset.mCategory]++)
+        categoryFirst[preset.mCategory] = i;
+    }
+
+    for (uint32_t i = 0; i < nCategories; i++)
+      categoryNames[i] = addString(mCategories[i]);
+
+    if (strings.empty())
+      strings.push_back(0);
+
+    const uint32_t dataOffset = (stringsOffset + static_cast<uint32_t>(strings.size()) + 15) & ~15u;
+
+    bank.clear();
+    bank.reserve(dataOffset);
+    auto put32 = [&bank](uint32_t v) {
+      v = WDL_bswap32_if_be(v);
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+      bank.insert(bank.end(), p, p + 4);
+    };
+
+    bank.insert(bank.end(), {'I', 'P', 'B', 'K'});
+    put32(IPresetBank::kVersion);
+    put32(nPresets);
+    put32(nCategories);
+    put32(presetsOffset);
+    put32(nameIndexOffset);
+    put32(categoriesOffset);
+    put32(stringsOffset);
+    put32(static_cast<uint32_t>(strings.size()));
+
+    uint32_t offset = dataOffset;
+    for (uint32_t i = 0; i < nPresets; i++)
+    {
+      const Preset& preset = mPresets[order[i]];
+      put32(presetNames[i]);
+      put32(preset.mCategory < 0 ? IPresetBank::kNoCategory : static_cast<uint32_t>(preset.mCategory));
+      put32(offset);
+      put32(static_cast<uint32_t>(preset.mData.size()));
+      offset += static_cast<uint32_t>(preset.mData.size());
+    }
+
+    std::vector<uint32_t> nameIndex(nPresets);
+    for (uint32_t i = 0; i < nPresets; i++)
+      nameIndex[i] = i;
+
+    std::stable_sort(nameIndex.begin(), nameIndex.end(), [&](uint32_t a, uint32_t b) {
+      return strcmp(mPresets[order[a]].mName.c_str(), mPresets[order[b]].mName.c_str()) < 0;
+    });
+
+    for (uint32_t i : nameIndex)
+      put32(i);
+
+    for (uint32_t i = 0; i < nCategories; i++)
+    {
+      put32(categoryNames[i]);
+      put32(categoryFirst[i]);
+      put32(categoryCount[i]);
+    }
+
+    bank.insert(bank.end(), strings.begin(), strings.end());
+    bank.resize(dataOffset, 0);
+
+    for (uint32_t i = 0; i < nPresets; i++)
+    {
+      const std::vector<uint8_t>& data = mPresets[order[i]].mData;
+      bank.insert(bank.end(), data.begin(), data.end());
+    }
+  }
+
+private:
+  struct Preset
+  {
+    std::string mName;
+    int mCategory;
+    std::vector<uint8_t> mData;
+  };
+
+  std::vector<std::string> mCategories;
+  std::vector<Preset> mPresets;
+};
+
+END_IPLUG_NAMESPACE
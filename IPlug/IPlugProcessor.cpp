@@ -14,6 +14,10 @@
  */
 
 #include "IPlugProcessor.h"
+#include "IPlugEditorDelegate.h"
+#include "IPlugSIMD.h"
+#include "Oversampler.h"
+#include "FixedRateProcessor.h"
 
 #ifdef OS_WIN
 #define strtok_r strtok_s
@@ -35,6 +39,8 @@ IPlugProcessor::IPlugProcessor(const Config& config, EAPI plugAPI)
 
   mScratchData[ERoute::kInput].Resize(totalNInChans);
   mScratchData[ERoute::kOutput].Resize(totalNOutChans);
+  mSliceData[ERoute::kInput].Resize(totalNInChans);
+  mSliceData[ERoute::kOutput].Resize(totalNOutChans);
 
   sample** ppInData = mScratchData[ERoute::kInput].Get();
 
@@ -56,6 +62,32 @@ IPlugProcessor::IPlugProcessor(const Config& config, EAPI plugAPI)
     pOutChannel->mIncomingData = nullptr;
     mChannelData[ERoute::kOutput].Add(pOutChannel);
   }
+
+  for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+  {
+    const int nChans = MaxNChannels(direction);
+    const int nBuses = MaxNBuses(direction);
+
+    mConnectedChannelIdx[direction].Resize(nChans);
+    mConnectedChannelData[direction].Resize(nChans);
+
+    // the API classes lay out each bus's channels after the largest the previous buses can be, a wildcard bus takes the remaining channels
+    int start = 0;
+
+    for (int bus = 0; bus < nBuses; bus++)
+    {
+      mBusChannelStart[direction].push_back(start);
+      const int nBusChans = MaxNChannelsForBus(direction, bus);
+      start = nBusChans < 0 ? nChans : std::min(start + nBusChans, nChans);
+    }
+
+    mBusChannelStart[direction].push_back(start);
+  }
+
+  // resolve the buffer kernels for this CPU here, rather than on the first audio callback
+  simd::Kernels::Get();
+
+  mSilenceSkippingByDefault = mPlugType == EIPlugPluginType::kEffect && totalNInChans > 0;
 }
 
 IPlugProcessor::~IPlugProcessor()
@@ -65,6 +97,9 @@ IPlugProcessor::~IPlugProcessor()
   mChannelData[ERoute::kInput].Empty(true);
   mChannelData[ERoute::kOutput].Empty(true);
   mIOConfigs.Empty(true);
+
+  delete mPendingLatencyDelay.exchange(nullptr);
+  delete mRetiredLatencyDelay.exchange(nullptr);
 }
 
 void IPlugProcessor::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
@@ -227,6 +262,22 @@ int IPlugProcessor::MaxNChannelsForBus(ERoute direction, int busIdx) const
   return maxChansOnBuses.size() > 0 ? maxChansOnBuses[busIdx] : 0;
 }
 
+bool IPlugProcessor::IsBusConnected(ERoute direction, int busIdx) const
+{
+  const std::vector<int>& busStart = mBusChannelStart[direction];
+
+  if (busIdx < 0 || busIdx + 1 >= static_cast<int>(busStart.size()))
+    return false;
+
+  for (int i = busStart[busIdx]; i < busStart[busIdx + 1]; i++)
+  {
+    if (IsChannelConnected(direction, i))
+      return true;
+  }
+
+  return false;
+}
+
 int IPlugProcessor::NChannelsConnected(ERoute direction) const
 {
   const WDL_PtrList<IChannelData<>>& channelData = mChannelData[direction];
@@ -269,12 +320,259 @@ void IPlugProcessor::SetChannelLabel(ERoute direction, int idx, const char* form
     mChannelData[direction].Get(idx)->mLabel.SetFormatted(MAX_CHAN_NAME_LEN, formatStr, idx+(!zeroBased));
 }
 
+void IPlugProcessor::SetSampleAccurateAutomation(bool enable, int maxChangesPerBlock)
+{
+  mParamChanges.Clear();
+  mParamChanges.Resize(enable ? maxChangesPerBlock : 0);
+  mSampleAccurateAutomation = enable;
+}
+
+void IPlugProcessor::SetBlockSlicing(bool enable, int minSliceSize)
+{
+  mSliceMidiQueue.Clear();
+  mSliceMidiQueue.Resize(std::max(mBlockSize, DEFAULT_BLOCK_SIZE));
+  mMinSliceSize = std::max(minSliceSize, 1);
+  mBlockSlicing = enable;
+}
+
+void IPlugProcessor::EnableHostPrecisionProcessing(bool enable)
+{
+  mHostPrecisionProcessing = enable;
+
+  for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+    mHostPrecisionData[direction].Resize(enable ? MaxNChannels(direction) : 0);
+
+  ResizeHostPrecisionScratch();
+}
+
+void IPlugProcessor::ResizeHostPrecisionScratch()
+{
+  for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+  {
+    WDL_TypedBuf<PLUG_SAMPLE_SRC>& scratch = mHostPrecisionScratch[direction];
+    scratch.Resize(mHostPrecisionProcessing ? MaxNChannels(direction) * mBlockSize : 0);
+    VectorZero(scratch.Get(), scratch.GetSize());
+  }
+}
+
+void IPlugProcessor::EnableOverSampling(int factor, int maxFactor, bool linearPhase)
+{
+  // at least one channel each way, since the FIR engine measures its latency on the first channel, even for an instrument without inputs
+  const int nIn = std::max(MaxNChannels(ERoute::kInput), 1);
+  const int nOut = std::max(MaxNChannels(ERoute::kOutput), 1);
+  const EOverSamplingEngine engine = linearPhase ? EOverSamplingEngine::kFIR : EOverSamplingEngine::kIIR;
+
+  mMaxOverSamplingFactor = Clip(maxFactor, (int) kNone, (int) k16x);
+  factor = Clip(factor, (int) kNone, mMaxOverSamplingFactor);
+  mOverSampler = std::make_unique<OverSampler<sample>>((EFactor) factor, true, nIn, nOut, engine, EFIRQuality::kMedium, (EFactor) mMaxOverSamplingFactor);
+  mOverSampler->Reset(std::max(mProcessingBlockSize, 1));
+  ResetParamRamps();
+  mRequestedOverSamplingFactor.store(-1, std::memory_order_relaxed);
+  mOverSamplingRate.store(mOverSampler->GetRate(), std::memory_order_relaxed);
+  // the idle timer reports the filters' latency
+  mOverSamplingLatency.store(mOverSampler->GetLatency(), std::memory_order_relaxed);
+}
+
+void IPlugProcessor::ApplyRequestedOverSampling()
+{
+  const int factor = mRequestedOverSamplingFactor.exchange(-1, std::memory_order_acq_rel);
+
+  if (factor < 0 || !mOverSampler)
+    return;
+
+  mOverSampler->SetOverSampling((EFactor) Clip(factor, (int) kNone, mMaxOverSamplingFactor));
+
+  if (mOverSampler->GetRate() != GetOverSamplingRate())
+  {
+    mOverSamplingRate.store(mOverSampler->GetRate(), std::memory_order_relaxed);
+    mOverSamplingLatency.store(mOverSampler->GetLatency(), std::memory_order_relaxed);
+    OnOverSamplingChange();
+  }
+}
+
+void IPlugProcessor::EnableFixedSampleRate(double sampleRate, bool onlyAbove)
+{
+  mFixedRateProcessor = std::make_unique<FixedRateProcessor<sample>>(MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput));
+  mFixedSampleRate = sampleRate;
+  mFixedRateOnlyAbove = onlyAbove;
+  ResetProcessingRate();
+}
+
+void IPlugProcessor::ResetProcessingRate()
+{
+  mProcessingRate = mSampleRate;
+  mProcessingBlockSize = mBlockSize;
+
+  if (mFixedRateProcessor)
+  {
+    if (mFixedSampleRate > 0. && !(mFixedRateOnlyAbove && mSampleRate <= mFixedSampleRate))
+      mProcessingRate = mFixedSampleRate;
+
+    mFixedRateProcessor->Reset(mSampleRate, mProcessingRate, std::max(mBlockSize, 1));
+    mProcessingBlockSize = mFixedRateProcessor->GetMaxProcessingFrames();
+    // the idle timer reports the conversion's latency
+    mFixedRateLatency.store(mFixedRateProcessor->GetLatency(), std::memory_order_relaxed);
+  }
+
+  if (mOverSampler)
+    mOverSampler->Reset(std::max(mProcessingBlockSize, 1));
+
+  ResetParamRamps();
+}
+
+void IPlugProcessor::ResetParamRamps()
+{
+  if (!mpSnapshotDelegate)
+    return;
+
+  const int nParams = mpSnapshotDelegate->NParams();
+  // the oversampling factor can change up to the highest one without a reset, and ProcessBlockHostPrecision() gets the host's blocks
+  const int maxFrames = std::max(mProcessingBlockSize << (mOverSampler ? mMaxOverSamplingFactor : 0), mBlockSize);
+
+  mParamRamps.Reset(nParams, maxFrames);
+
+  for (int i = 0; i < nParams; i++)
+  {
+    const IParam* pParam = mpSnapshotDelegate->GetParam(i);
+
+    if (pParam->GetSmoothing() != IParam::kSmoothNone)
+      mParamRamps.Add(i, pParam->GetSmoothing(), pParam->GetSmoothingTime(), pParam->Value());
+  }
+}
+
+int IPlugProcessor::GetFrameworkLatency() const
+{
+  const int overSamplingLatency = mOverSamplingLatency.load(std::memory_order_relaxed);
+  const int fixedRateLatency = mFixedRateLatency.load(std::memory_order_relaxed);
+
+  // the oversampler runs at the processing rate
+  if (!IsConvertingSampleRate())
+    return overSamplingLatency + fixedRateLatency;
+
+  return static_cast<int>(std::lround(overSamplingLatency * mSampleRate / mProcessingRate)) + fixedRateLatency;
+}
+
+void IPlugProcessor::ProcessSlice(sample** inputs, sample** outputs, int nFrames)
+{
+  if (IsConvertingSampleRate())
+  {
+    const int nIn = MaxNChannels(ERoute::kInput);
+    const int nOut = MaxNChannels(ERoute::kOutput);
+
+    mFixedRateProcessor->ProcessBlock(inputs, outputs, nFrames, nIn, nOut, [this](sample** fixedInputs, sample** fixedOutputs, int nFixedFrames) {
+      ProcessAtProcessingRate(fixedInputs, fixedOutputs, nFixedFrames);
+    });
+    return;
+  }
+
+  ProcessAtProcessingRate(inputs, outputs, nFrames);
+}
+
+void IPlugProcessor::ProcessAtProcessingRate(sample** inputs, sample** outputs, int nFrames)
+{
+  if (GetOverSamplingRate() == 1)
+  {
+    CompactConnectedChannels(inputs, outputs);
+    RenderParamRamps(nFrames);
+    ProcessBlock(inputs, outputs, nFrames);
+    return;
+  }
+
+  const int nIn = MaxNChannels(ERoute::kInput);
+  const int nOut = MaxNChannels(ERoute::kOutput);
+
+  mOverSampler->ProcessBlockContiguous(inputs, outputs, nFrames, nIn, nOut, [this](sample** upInputs, sample** upOutputs, int nUpFrames) {
+    CompactConnectedChannels(upInputs, upOutputs);
+    RenderParamRamps(nUpFrames);
+    ProcessBlock(upInputs, upOutputs, nUpFrames);
+  });
+}
+
 void IPlugProcessor::SetLatency(int samples)
 {
-  mLatency = samples;
+  // a longer bypass delay line is allocated here and published before the latency, so the audio thread only ever switches lines and clears them
+  if (mLatencyDelayCapacity >= 0 && samples > mLatencyDelayCapacity)
+  {
+    delete mRetiredLatencyDelay.exchange(nullptr, std::memory_order_acquire);
+    delete mPendingLatencyDelay.exchange(NewLatencyDelay(samples), std::memory_order_acq_rel); // one the audio thread never took
+  }
 
-  if (mLatencyDelay)
-    mLatencyDelay->SetDelayTime(mLatency);
+  mLatency.store(samples, std::memory_order_release);
+}
+
+void IPlugProcessor::CreateLatencyDelay()
+{
+  mLatencyDelay.reset(NewLatencyDelay(GetLatency()));
+}
+
+NChanDelayLine<sample>* IPlugProcessor::NewLatencyDelay(int latency)
+{
+  auto* pDelay = new NChanDelayLine<sample>(MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput));
+  pDelay->SetDelayTime(latency);
+  mLatencyDelayCapacity = latency;
+  return pDelay;
+}
+
+void IPlugProcessor::AttachParamSnapshot(IEditorDelegate& delegate)
+{
+  const int nParams = delegate.NParams();
+
+  mpSnapshotDelegate = &delegate;
+  mParamChangeFlags.Resize(nParams);
+  mParamSnapshot.Resize(nParams);
+
+  for (int i = 0; i < nParams; i++)
+  {
+    IParam* pParam = delegate.GetParam(i);
+    pParam->SetChangeFlags(&mParamChangeFlags, i);
+    mParamSnapshot.Get()[i] = pParam->Value();
+  }
+}
+
+void IPlugProcessor::UpdateParamSnapshot()
+{
+  if (!mpSnapshotDelegate)
+    return;
+
+  double* pValues = mParamSnapshot.Get();
+
+  mParamChangeFlags.ForEachChanged([&](int paramIdx) {
+    pValues[paramIdx] = mpSnapshotDelegate->GetParam(paramIdx)->Value();
+  });
+}
+
+bool IPlugProcessor::ApplyRequestedLatency()
+{
+  const int requested = mRequestedLatency.load(std::memory_order_relaxed);
+  const int frameworkLatency = GetFrameworkLatency();
+
+  if (requested < 0 && frameworkLatency == mReportedFrameworkLatency)
+    return false;
+
+  // the plug-in's own latency, plus the fixed rate conversion's and the oversampling filters'
+  const int latency = (requested >= 0 ? requested : GetLatency() - mReportedFrameworkLatency) + frameworkLatency;
+
+  if (latency != mSettlingLatency)
+  {
+    mSettlingLatency = latency;
+    mLatencySettleTicks = 0;
+  }
+  else if (++mLatencySettleTicks >= LATENCY_SETTLE_TICKS)
+  {
+    int expected = requested;
+
+    // a newer request restarts the wait on the next tick
+    if (requested < 0 || mRequestedLatency.compare_exchange_strong(expected, -1))
+    {
+      mSettlingLatency = -1;
+      mReportedFrameworkLatency = frameworkLatency;
+
+      if (latency != GetLatency())
+        SetLatency(latency);
+    }
+  }
+
+  return mSettlingLatency >= 0;
 }
 
 //static
@@ -432,6 +730,16 @@ void IPlugProcessor::SetChannelConnections(ERoute direction, int idx, int n, boo
   for (auto i = idx; i < endIdx; ++i)
   {
     IChannelData<>* pChannel = channelData.Get(i);
+
+    // an input's scratch buffer may hold converted host samples, clear them so that a disconnected input (e.g. a side-chain) is silent
+    if (!connected && pChannel->mConnected && direction == ERoute::kInput)
+    {
+      VectorZero(pChannel->mScratchBuf.Get(), pChannel->mScratchBuf.GetSize());
+
+      if (mHostPrecisionScratch[direction].GetSize())
+        VectorZero(mHostPrecisionScratch[direction].Get() + i * mBlockSize, mBlockSize);
+    }
+
     pChannel->mConnected = connected;
 
     if (!connected)
@@ -466,32 +774,75 @@ void IPlugProcessor::AttachBuffers(ERoute direction, int idx, int n, PLUG_SAMPLE
 
     if (pChannel->mConnected)
     {
-      if (direction == ERoute::kInput)
-      {
-        PLUG_SAMPLE_DST* pScratch = pChannel->mScratchBuf.Get();
-        CastCopy(pScratch, *(ppData++), nFrames);
-        *(pChannel->mData) = pScratch;
-      }
-      else // output
-      {
-        *(pChannel->mData) = pChannel->mScratchBuf.Get();
-        pChannel->mIncomingData = *(ppData++);
-      }
+      // inputs are converted once the block is known to go through ProcessBlock(), see ConvertIncomingInputs()
+      *(pChannel->mData) = pChannel->mScratchBuf.Get();
+      pChannel->mIncomingData = *(ppData++);
     }
   }
 }
 
+void IPlugProcessor::ConvertIncomingInputs(int nFrames)
+{
+  const int nIn = MaxNChannels(ERoute::kInput);
+
+  for (int c = 0; c < nIn; c++)
+  {
+    IChannelData<>* pInChannel = mChannelData[ERoute::kInput].Get(c);
+
+    // cleared, so that a channel that isn't attached next block isn't read from a stale host buffer
+    if (pInChannel->mConnected && pInChannel->mIncomingData)
+      VectorCopy(*(pInChannel->mData), pInChannel->mIncomingData, nFrames);
+
+    pInChannel->mIncomingData = nullptr;
+  }
+}
+
 void IPlugProcessor::PassThroughBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
-  if (mLatency && mLatencyDelay)
+  const int latency = mLatency.load(std::memory_order_acquire);
+
+  if (mLatencyDelay)
+  {
+    // SetLatency() publishes a longer line before the latency that needs it, and takes the old one back
+    if (mPendingLatencyDelay.load(std::memory_order_relaxed))
+    {
+      if (NChanDelayLine<sample>* pDelay = mPendingLatencyDelay.exchange(nullptr, std::memory_order_acquire))
+      {
+        NChanDelayLine<sample>* pRetired = mRetiredLatencyDelay.exchange(mLatencyDelay.release(), std::memory_order_release);
+        assert(!pRetired && "SetLatency() deletes the retired line before it publishes another");
+        mLatencyDelay.reset(pDelay);
+      }
+    }
+
+    // no longer than the line was allocated for, so this only clears it
+    if (mLatencyDelay->GetDelayTime() != latency)
+      mLatencyDelay->SetDelayTime(latency);
+  }
+
+  if (latency && mLatencyDelay)
     mLatencyDelay->ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
   else
     IPlugProcessor::ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+
+  if (mBlockSlicing)
+  {
+    // when bypassed, MIDI is still delivered - but not sliced
+    while (!mSliceMidiQueue.Empty())
+    {
+      ProcessMidiMsg(mSliceMidiQueue.Peek());
+      mSliceMidiQueue.Remove();
+    }
+
+    mSliceMidiQueue.Flush(nFrames);
+  }
+
+  mParamChanges.Clear();
 }
 
 void IPlugProcessor::PassThroughBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 {
   // for PLUG_SAMPLE_SRC bit buffers, first run the delay (if mLatency) on the PLUG_SAMPLE_DST IPlug buffers
+  ConvertIncomingInputs(nFrames);
   PassThroughBuffers(PLUG_SAMPLE_DST(0.), nFrames);
 
   int i, n = MaxNChannels(ERoute::kOutput);
@@ -502,18 +853,263 @@ void IPlugProcessor::PassThroughBuffers(PLUG_SAMPLE_SRC type, int nFrames)
     IChannelData<>* pOutChannel = *ppOutChannel;
     if (pOutChannel->mConnected)
     {
-      CastCopy(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
+      VectorCopy(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
     }
   }
 }
 
 void IPlugProcessor::ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames)
 {
-  ProcessBlock(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+  ProcessBuffersInPrecision(mScratchData[ERoute::kInput].Get(), mScratchData[ERoute::kOutput].Get(), nFrames);
+}
+
+template <typename T>
+void IPlugProcessor::ProcessBuffersInPrecision(T** inputs, T** outputs, int nFrames)
+{
+  IRealtimeChecker::RealtimeScope realtimeScope;
+
+  const bool profile = mProfiler.GetEnabled();
+  const bool govern = mQualityGovernor.GetEnabled();
+  const double startTime = (profile || govern) ? mProfiler.GetTime() : 0.;
+
+  UpdateParamSnapshot();
+  mParamRamps.BeginBlock(mParamSnapshot.Get(), mParamChanges, GetSampleRate());
+  UpdateConnectedChannels();
+
+  // silence skipping: the tail is counted from the end of the last block with input, and once it has ended blocks are only skipped after a processed block turned out silent
+  bool tailEnded = false;
+
+  if (mSilenceSkipping)
+  {
+    const bool woken = mWakeFromSilence.exchange(false) || mMidiSinceLastBlock;
+
+    if (!woken && InputsAreSilent(inputs, nFrames))
+    {
+      const int64_t prevSilentFrames = mSilentInputFrames;
+      mSilentInputFrames += nFrames;
+      tailEnded = mTailSize >= 0 && mSilentInputFrames >= mTailSize;
+
+      if (mOutputSilent && mTailSize >= 0 && prevSilentFrames >= mTailSize)
+      {
+        const int nOut = MaxNChannels(ERoute::kOutput);
+
+        for (int c = 0; c < nOut; c++)
+        {
+          if (mChannelData[ERoute::kOutput].Get(c)->mConnected)
+            VectorZero(outputs[c], nFrames);
+        }
+
+        if (mBlockSlicing)
+          mSliceMidiQueue.Flush(nFrames);
+
+        mParamChanges.Clear();
+        mParamRamps.Skip();
+        mMidiSinceLastBlock = false;
+        mInputSilentFromHost = false;
+        ApplyRequestedOverSampling();
+        return;
+      }
+    }
+    else
+      mSilentInputFrames = 0;
+  }
+
+  mMidiSinceLastBlock = false;
+  mInputSilentFromHost = false;
+
+  ProcessBlockInPrecision(inputs, outputs, nFrames);
+
+  mParamChanges.Clear();
+  ApplyRequestedOverSampling();
+
+  // only check the output once the tail has ended, so that skipping starts after the first silent block
+  mOutputSilent = tailEnded && OutputsAreSilent(outputs, nFrames);
+
+  if (profile)
+    mProfiler.AddBlock(startTime, nFrames, mSampleRate);
+
+  if (govern)
+    mQualityGovernor.AddBlock(mProfiler.GetTime() - startTime, nFrames / mSampleRate, mRenderingOffline);
+
+  // also catches the level going back up when the governor is disabled
+  const int qualityLevel = mQualityGovernor.GetLevel();
+
+  if (qualityLevel != mQualityLevel)
+  {
+    if (mQualityLevel >= 0)
+      OnQualityChange(qualityLevel);
+
+    mQualityLevel = qualityLevel;
+  }
+}
+
+void IPlugProcessor::UpdateConnectedChannels()
+{
+  for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+  {
+    const int nChans = MaxNChannels(direction);
+    int* pIdx = mConnectedChannelIdx[direction].Get();
+    int nConnected = 0;
+    uint64_t mask = 0;
+
+    for (int c = 0; c < nChans; c++)
+    {
+      if (mChannelData[direction].Get(c)->mConnected)
+      {
+        pIdx[nConnected++] = c;
+
+        if (c < 64)
+          mask |= static_cast<uint64_t>(1) << c;
+      }
+    }
+
+    mNConnectedChannels[direction] = nConnected;
+    mConnectedChannelMask[direction] = mask;
+  }
+}
+
+void IPlugProcessor::CompactConnectedChannels(sample** inputs, sample** outputs)
+{
+  sample** channels[2] = {inputs, outputs};
+
+  for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+  {
+    const int* pIdx = mConnectedChannelIdx[direction].Get();
+    sample** ppData = mConnectedChannelData[direction].Get();
+
+    for (int i = 0; i < mNConnectedChannels[direction]; i++)
+      ppData[i] = channels[direction][pIdx[i]];
+  }
+}
+
+void IPlugProcessor::ProcessBlockInPrecision(sample** inputs, sample** outputs, int nFrames)
+{
+  if (mBlockSlicing)
+    ProcessBlockSliced(nFrames);
+  else
+    ProcessSlice(inputs, outputs, nFrames);
+}
+
+template <typename T>
+bool IPlugProcessor::InputsAreSilent(T** inputs, int nFrames) const
+{
+  if (mInputSilentFromHost)
+    return true;
+
+  const int nIn = MaxNChannels(ERoute::kInput);
+
+  for (int c = 0; c < nIn; c++)
+  {
+    if (mChannelData[ERoute::kInput].Get(c)->mConnected && VectorPeak(inputs[c], nFrames) > SILENCE_THRESHOLD)
+      return false;
+  }
+
+  return true;
+}
+
+template <typename T>
+bool IPlugProcessor::OutputsAreSilent(T** outputs, int nFrames) const
+{
+  const int nOut = MaxNChannels(ERoute::kOutput);
+
+  for (int c = 0; c < nOut; c++)
+  {
+    if (mChannelData[ERoute::kOutput].Get(c)->mConnected && VectorPeak(outputs[c], nFrames) > SILENCE_THRESHOLD)
+      return false;
+  }
+
+  return true;
+}
+
+void IPlugProcessor::ProcessBlockSliced(int nFrames)
+{
+  const int nIn = MaxNChannels(ERoute::kInput);
+  const int nOut = MaxNChannels(ERoute::kOutput);
+  sample** ppIn = mScratchData[ERoute::kInput].Get();
+  sample** ppOut = mScratchData[ERoute::kOutput].Get();
+  sample** ppSliceIn = mSliceData[ERoute::kInput].Get();
+  sample** ppSliceOut = mSliceData[ERoute::kOutput].Get();
+  const int nParamChanges = mParamChanges.NChanges();
+  int paramChangeIdx = 0;
+  int pos = 0;
+
+  // deliver all events before endOffset, relative to the start of the slice at pos
+  auto deliverEvents = [&](int endOffset) {
+    while (!mSliceMidiQueue.Empty() && mSliceMidiQueue.Peek().mOffset < endOffset)
+    {
+      IMidiMsg msg = mSliceMidiQueue.Peek();
+      msg.mOffset = std::max(msg.mOffset - pos, 0);
+      ProcessMidiMsg(ScaleOffset(msg));
+      mSliceMidiQueue.Remove();
+    }
+
+    while (paramChangeIdx < nParamChanges && mParamChanges.Get(paramChangeIdx).mOffset < endOffset)
+    {
+      IParamChange change = mParamChanges.Get(paramChangeIdx++);
+      change.mOffset = std::max(change.mOffset - pos, 0);
+      mParamRamps.SetTarget(change.mIdx, change.mValue);
+      ProcessParamChange(ScaleOffset(change));
+    }
+  };
+
+  while (pos < nFrames)
+  {
+    deliverEvents(pos + 1);
+
+    int end = nFrames;
+
+    if (!mSliceMidiQueue.Empty())
+      end = std::min(end, mSliceMidiQueue.Peek().mOffset);
+
+    if (paramChangeIdx < nParamChanges)
+      end = std::min(end, mParamChanges.Get(paramChangeIdx).mOffset);
+
+    end = Clip(end, std::min(pos + mMinSliceSize, nFrames), nFrames);
+
+    // events that fall inside the minimum slice size are delivered at the start of the slice
+    deliverEvents(end);
+
+    for (int c = 0; c < nIn; c++)
+      ppSliceIn[c] = ppIn[c] + pos;
+
+    for (int c = 0; c < nOut; c++)
+      ppSliceOut[c] = ppOut[c] + pos;
+
+    ProcessSlice(ppSliceIn, ppSliceOut, end - pos);
+
+    pos = end;
+  }
+
+  // messages beyond the end of this block remain queued for the next one
+  mSliceMidiQueue.Flush(nFrames);
 }
 
 void IPlugProcessor::ProcessBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 {
+  // oversampling, fixed rate conversion and block slicing work on sample buffers
+  if (mHostPrecisionProcessing && !mBlockSlicing && GetOverSamplingRate() == 1 && !IsConvertingSampleRate() && nFrames <= mBlockSize)
+  {
+    for (ERoute direction : {ERoute::kInput, ERoute::kOutput})
+    {
+      const int nChans = MaxNChannels(direction);
+      PLUG_SAMPLE_SRC** ppData = mHostPrecisionData[direction].Get();
+      PLUG_SAMPLE_SRC* pScratch = mHostPrecisionScratch[direction].Get();
+
+      for (int c = 0; c < nChans; c++)
+      {
+        IChannelData<>* pChannel = mChannelData[direction].Get(c);
+        ppData[c] = (pChannel->mConnected && pChannel->mIncomingData) ? pChannel->mIncomingData : pScratch + c * mBlockSize;
+
+        if (direction == ERoute::kInput)
+          pChannel->mIncomingData = nullptr;
+      }
+    }
+
+    ProcessBuffersInPrecision(mHostPrecisionData[ERoute::kInput].Get(), mHostPrecisionData[ERoute::kOutput].Get(), nFrames);
+    return;
+  }
+
+  ConvertIncomingInputs(nFrames);
   ProcessBuffers((PLUG_SAMPLE_DST) 0, nFrames);
   int i, n = MaxNChannels(ERoute::kOutput);
   IChannelData<>** ppOutChannel = mChannelData[ERoute::kOutput].GetList();
@@ -524,13 +1120,14 @@ void IPlugProcessor::ProcessBuffers(PLUG_SAMPLE_SRC type, int nFrames)
 
     if (pOutChannel->mConnected)
     {
-      CastCopy(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
+      VectorCopy(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
     }
   }
 }
 
 void IPlugProcessor::ProcessBuffersAccumulating(int nFrames)
 {
+  ConvertIncomingInputs(nFrames);
   ProcessBuffers((PLUG_SAMPLE_DST) 0, nFrames);
   int i, n = MaxNChannels(ERoute::kOutput);
   IChannelData<>** ppOutChannel = mChannelData[ERoute::kOutput].GetList();
@@ -540,12 +1137,7 @@ void IPlugProcessor::ProcessBuffersAccumulating(int nFrames)
     IChannelData<>* pOutChannel = *ppOutChannel;
     if (pOutChannel->mConnected)
     {
-      PLUG_SAMPLE_SRC* pDest = pOutChannel->mIncomingData;
-      PLUG_SAMPLE_DST* pSrc = *(pOutChannel->mData); // TODO : check this: PLUG_SAMPLE_DST will allways be float, because this is only for VST2 accumulating
-      for (int j = 0; j < nFrames; ++j, ++pDest, ++pSrc)
-      {
-        *pDest += (PLUG_SAMPLE_SRC) *pSrc;
-      }
+      VectorAccumulate(pOutChannel->mIncomingData, *(pOutChannel->mData), nFrames);
     }
   }
 }
@@ -557,13 +1149,25 @@ void IPlugProcessor::ZeroScratchBuffers()
   for (i = 0; i < nIn; ++i)
   {
     IChannelData<>* pInChannel = mChannelData[ERoute::kInput].Get(i);
-    memset(pInChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(PLUG_SAMPLE_DST));
+
+    // connected inputs either point at host buffers or have their scratch buffer overwritten by AttachBuffers()
+    if (!pInChannel->mConnected)
+      VectorZero(pInChannel->mScratchBuf.Get(), mBlockSize);
   }
 
   for (i = 0; i < nOut; ++i)
   {
     IChannelData<>* pOutChannel = mChannelData[ERoute::kOutput].Get(i);
-    memset(pOutChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(PLUG_SAMPLE_DST));
+    VectorZero(pOutChannel->mScratchBuf.Get(), mBlockSize);
+  }
+}
+
+void IPlugProcessor::SetSampleRate(double sampleRate)
+{
+  if (sampleRate != mSampleRate)
+  {
+    mSampleRate = sampleRate;
+    ResetProcessingRate();
   }
 }
 
@@ -588,5 +1192,10 @@ void IPlugProcessor::SetBlockSize(int blockSize)
     }
 
     mBlockSize = blockSize;
+    ResizeHostPrecisionScratch();
+    ResetProcessingRate();
+
+    if (mBlockSlicing && mSliceMidiQueue.GetSize() < blockSize)
+      mSliceMidiQueue.Resize(blockSize);
   }
 }
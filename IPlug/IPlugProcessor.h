@@ -18,6 +18,7 @@
 #include <cassert>
 #include <memory>
 #include <vector>
+#include <atomic>
 
 #include "ptrlist.h"
 
@@ -25,6 +26,12 @@
 #include "IPlugConstants.h"
 #include "IPlugStructs.h"
 #include "IPlugUtilities.h"
+#include "IPlugParameter.h"
+#include "IPlugParamRamps.h"
+#include "IPlugProfiler.h"
+#include "IPlugQualityGovernor.h"
+#include "IPlugRealtimeChecker.h"
+#include "IPlugDenormal.h"
 #include "NChanDelay.h"
 
 /**
@@ -35,8 +42,11 @@
 BEGIN_IPLUG_NAMESPACE
 
 struct Config;
+class IEditorDelegate;
+template <typename T> class OverSampler;
+template <typename T> class FixedRateProcessor;
 
-/** The base class for IPlug Audio Processing. It knows nothing about presets or parameters or user interface.  */
+/** The base class for IPlug Audio Processing. It knows nothing about presets or user interface, and of the parameters only keeps a per-block snapshot of their values.  */
 class IPlugProcessor
 {
 public:
@@ -58,9 +68,23 @@ public:
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
    * @param inputs Two-dimensional array containing the non-interleaved input buffers of audio samples for all channels
    * @param outputs Two-dimensional array for audio output (non-interleaved).
-   * @param nFrames The block size for this block: number of samples per channel.*/
+   * @param nFrames The block size for this block: number of samples per channel.
+   * @see GetConnectedChannels() in order to only process the channels the host has connected */
   virtual void ProcessBlock(sample** inputs, sample** outputs, int nFrames);
 
+  /** Override this as well as ProcessBlock(), and call EnableHostPrecisionProcessing(), in order to process the host's buffers directly when they are PLUG_SAMPLE_SRC,
+   * i.e. float buffers in a build with \c sample as double (the default) or double buffers in one with SAMPLE_TYPE_FLOAT, instead of having them converted to and from \c sample every block.
+   * Write the DSP as a template over the sample type and call it from both:
+   * \code
+   * template <typename T> void ProcessBlockT(T** inputs, T** outputs, int nFrames);
+   * void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override { ProcessBlockT(inputs, outputs, nFrames); }
+   * void ProcessBlockHostPrecision(PLUG_SAMPLE_SRC** inputs, PLUG_SAMPLE_SRC** outputs, int nFrames) override { ProcessBlockT(inputs, outputs, nFrames); }
+   * \endcode
+   * Which one is called depends on the buffers each host block arrives with, e.g. the VST3 symbolic sample size the host chose, or float for AU, AAX and the VST2 processReplacing() call.
+   * Blocks that are oversampled or sliced (see EnableOverSampling() and SetBlockSlicing()) still go through ProcessBlock(), since the framework does that on \c sample buffers.
+   * GetConnectedChannels() isn't valid in this method, use IsChannelConnected() */
+  virtual void ProcessBlockHostPrecision(PLUG_SAMPLE_SRC** inputs, PLUG_SAMPLE_SRC** outputs, int nFrames) {}
+
   /** Override this method to handle incoming MIDI messages. The method is called prior to ProcessBlock().
    * You can use IMidiQueue in combination with this method in order to queue the message and process at the appropriate time in ProcessBlock()
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
@@ -71,6 +95,12 @@ public:
    * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts */
   virtual void ProcessSysEx(ISysEx& msg) {}
 
+  /** Override this method to handle parameter automation points when block slicing (see SetBlockSlicing()) and sample accurate automation are both enabled.
+   * The method is called prior to ProcessBlock() for the slice that the automation point falls in, with the offset relative to the start of that slice.
+   * THIS METHOD IS CALLED BY THE HIGH PRIORITY AUDIO THREAD - You should be careful not to do any unbounded, blocking operations such as file I/O which could cause audio dropouts
+   * @param change The automation point */
+  virtual void ProcessParamChange(const IParamChange& change) {}
+
   /** Override this method in your plug-in class to do something prior to playback etc. (e.g.clear buffers, update internal DSP with the latest sample rate) */
   virtual void OnReset() { TRACE }
 
@@ -97,14 +127,20 @@ public:
    * @return \c true if successful */
   virtual bool SendSysEx(const ISysEx& msg) { return false; }
 
-  /** @return Sample rate (in Hz) */
-  double GetSampleRate() const { return mSampleRate; }
+  /** @return The sample rate (in Hz) ProcessBlock() runs at, which is the host's, or the one given to EnableFixedSampleRate(), multiplied by the oversampling rate, see EnableOverSampling() */
+  double GetSampleRate() const { return mProcessingRate * GetOverSamplingRate(); }
+
+  /** @return Maximum block size in samples that ProcessBlock() is called with, at the rate of GetSampleRate(), actual blocksize may vary each ProcessBlock() */
+  int GetBlockSize() const { return mProcessingBlockSize * GetOverSamplingRate(); }
+
+  /** @return The host's sample rate (in Hz), which is GetSampleRate() unless the framework oversamples ProcessBlock() or runs it at a fixed rate */
+  double GetHostSampleRate() const { return mSampleRate; }
 
-  /** @return Maximum block size in samples, actual blocksize may vary each ProcessBlock() */
-  int GetBlockSize() const { return mBlockSize; }
+  /** @return The host's maximum block size in samples, which is GetBlockSize() unless the framework oversamples ProcessBlock() or runs it at a fixed rate */
+  int GetHostBlockSize() const { return mBlockSize; }
 
   /** @return Plugin latency (in samples) */
-  int GetLatency() const { return mLatency; }
+  int GetLatency() const { return mLatency.load(std::memory_order_relaxed); }
 
   /** @return The tail size in samples (useful for reverberation plug-ins, that may need to decay after the transport stops or an audio item ends) */
   int GetTailSize() { return mTailSize; }
@@ -115,6 +151,145 @@ public:
   /** @return \c true if the plugin is currently rendering off-line */
   bool GetRenderingOffline() const { return mRenderingOffline; };
 
+  /** Enable sample accurate automation. When enabled the API classes will add every automation point the host provides for a block
+   * to a time-ordered list that can be read in ProcessBlock() via GetParamChanges(), in addition to setting the parameter to the last value of the block
+   * as usual. Call this from your plug-in's constructor, since it allocates memory.
+   * @param enable \c true in order to enable sample accurate automation
+   * @param maxChangesPerBlock The maximum number of automation points that can be stored for a single block */
+  void SetSampleAccurateAutomation(bool enable, int maxChangesPerBlock = PARAM_AUTOMATION_LIST_SIZE);
+
+  /** @return \c true if sample accurate automation has been enabled */
+  bool GetSampleAccurateAutomation() const { return mSampleAccurateAutomation; }
+
+  /** @return The profiler that times every host block, which can also time named scopes in DSP code with IPLUG_PROFILE_SCOPE(). Enable it with IPlugProfiler::SetEnabled(), its statistics are updated on the main thread by IPlugAPIBase::OnTimer() */
+  IPlugProfiler& GetProfiler() { return mProfiler; }
+
+  /** @return The governor that lowers the quality level when this instance's blocks come close to their deadline, and raises it again once there is headroom.
+   * Enable it with IPlugQualityGovernor::SetEnabled(), e.g. in the plug-in constructor. Blocks are timed with the profiler's clock whether or not the profiler is enabled */
+  IPlugQualityGovernor& GetQualityGovernor() { return mQualityGovernor; }
+
+  /** @return The quality level DSP code should run at, from 0, the lowest, to IPlugQualityGovernor::GetNumLevels() - 1, which it always is while the governor is disabled or the host renders offline */
+  int GetQualityLevel() const { return mQualityGovernor.GetLevel(); }
+
+  /** Override this method to follow the quality level, e.g. with SetOverSampling() or by limiting a synth's voices, see GetQualityGovernor().
+   * It is called on the audio thread between blocks, so it mustn't allocate
+   * @param level The new level, see GetQualityLevel() */
+  virtual void OnQualityChange(int level) {}
+
+  /** @return The time-ordered list of parameter automation points for the current block. Only valid inside ProcessBlock(), and empty unless sample accurate automation is enabled */
+  const IParamChangeList& GetParamChanges() const { return mParamChanges; }
+
+  /** @return The value of a parameter as of the start of the current block, from a plain array that the processor refreshes before each block with only the parameters
+   * that have changed. Unlike GetParam(paramIdx)->Value() it isn't an atomic load, and it stays the same for the whole block, even if the UI sets the parameter meanwhile.
+   * Only valid on the audio thread, in ProcessBlock() and the methods it calls. Use GetParamChanges() for automation points within the block
+   * @param paramIdx The index of the parameter */
+  double GetParamValue(int paramIdx) const { assert(paramIdx >= 0 && paramIdx < mParamSnapshot.GetSize()); return mParamSnapshot.Get()[paramIdx]; }
+
+  /** @return NParams() values as of the start of the current block \see GetParamValue() */
+  const double* GetParamValues() const { return mParamSnapshot.Get(); }
+
+  /** @return The smoothed real values of a parameter that IParam::SetSmoothing() was called for, one per frame of the current ProcessBlock() call, at GetSampleRate().
+   * The ramp heads for the value the parameter has at the start of each block, or with sample accurate automation for each automation point from its offset on, and carries on across slices and blocks.
+   * Once it has converged every frame holds the parameter's value, see IsSmoothedParamConstant(). Only valid in ProcessBlock() and ProcessBlockHostPrecision()
+   * @param paramIdx The index of a smoothed parameter */
+  const sample* GetSmoothedParam(int paramIdx) const { return mParamRamps.Get(paramIdx); }
+
+  /** @return \c true if a smoothed parameter has converged, so that GetSmoothedParam() is the same value for every frame of the current ProcessBlock() call and DSP code can use its first frame as a constant
+   * @param paramIdx The index of a smoothed parameter */
+  bool IsSmoothedParamConstant(int paramIdx) const { return mParamRamps.IsConstant(paramIdx); }
+
+  /** @return The audio workgroup of the device the host renders this instance on, an os_workgroup_t on macOS 11 and iOS 14 or later, otherwise nullptr.
+   * Pass it to an IRealtimeThreadScope in threads the plug-in spawns for DSP, or to IPlugThreadPool::SetAudioWorkgroup(), and look again from time to time,
+   * since the host can move the plug-in to another device. The AUv2 and AUv3 APIs get it from the host's render context observer, and the standalone app from its device */
+  void* GetAudioWorkgroup() const { return mpAudioWorkgroup.load(std::memory_order_acquire); }
+
+  /** Have the framework run ProcessBlock() at a multiple of the host's sample rate, for plug-ins with non-linearities that alias, rather than wrapping it in an OverSampler by hand.
+   * The inputs are up-sampled, ProcessBlock() is called once with the whole up-sampled block, and the outputs are down-sampled. While oversampling:
+   * - GetSampleRate() and GetBlockSize() are multiplied by the rate, so coefficients and smoothers set up with them run at the right rate
+   * - MIDI and automation offsets passed to ProcessMidiMsg() and ProcessParamChange(), and in GetParamChanges(), are at the up-sampled rate
+   * - The latency of the filters, which only the linear phase ones have, is added to the latency given to RequestLatency() and reported on the main thread.
+   *   Use RequestLatency() for the plug-in's own latency, rather than SetLatency(), which sets the total
+   *
+   * Call this from your plug-in's constructor, since it allocates the filters for every factor up to maxFactor. Bypass isn't oversampled.
+   * @param factor The EFactor to start with, e.g. k2x
+   * @param maxFactor The highest EFactor SetOverSampling() will be called with
+   * @param linearPhase \c true for linear phase FIR filters, which add latency, rather than the default minimum phase IIR ones, which don't */
+  void EnableOverSampling(int factor, int maxFactor, bool linearPhase = false);
+
+  /** Change the oversampling factor, from any thread, e.g. in OnParamChange(). It takes effect between blocks, without allocating, and OnOverSamplingChange() is called
+   * @param factor An EFactor from kNone, which stops oversampling, to the maxFactor given to EnableOverSampling() */
+  void SetOverSampling(int factor) { mRequestedOverSamplingFactor.store(factor, std::memory_order_release); }
+
+  /** @return The rate ProcessBlock() is oversampled by, 1 when it isn't */
+  int GetOverSamplingRate() const { return mOverSamplingRate.load(std::memory_order_relaxed); }
+
+  /** Override this method to recalculate whatever depends on the sample rate, such as filter coefficients, when the oversampling factor changes.
+   * It is called on the audio thread between blocks, so it mustn't allocate, and OnReset() isn't called */
+  virtual void OnOverSamplingChange() {}
+
+  /** Have the framework run ProcessBlock() at a fixed sample rate whatever the host's, for DSP that is only designed or tuned at certain rates, or to cap the CPU it uses in high rate sessions.
+   * The inputs are converted to the fixed rate with a windowed sinc resampler, ProcessBlock() is called once per block with however many frames that gives, and the outputs are converted back. While converting:
+   * - GetSampleRate() is the fixed rate, and GetBlockSize() the most frames ProcessBlock() is called with, which varies from block to block by a frame or so
+   * - MIDI and automation offsets passed to ProcessMidiMsg() and ProcessParamChange(), and in GetParamChanges(), are at the fixed rate
+   * - The latency of the conversion, about one resampler filter length, is added to the latency given to RequestLatency() and reported on the main thread.
+   *   Use RequestLatency() for the plug-in's own latency, rather than SetLatency(), which sets the total
+   *
+   * Oversampling, see EnableOverSampling(), is applied at the fixed rate. Call this from your plug-in's constructor. The conversion is set up again, which allocates, whenever the host's rate or block size changes. Bypass isn't converted.
+   * @param sampleRate The rate ProcessBlock() runs at, e.g. 48000. or 96000.
+   * @param onlyAbove \c true to only convert when the host's rate is higher, e.g. to process a 192 kHz session at 96 kHz but run natively at 44.1 or 48 kHz */
+  void EnableFixedSampleRate(double sampleRate, bool onlyAbove = false);
+
+  /** @return \c true if ProcessBlock() runs at a different rate to the host's, see EnableFixedSampleRate() */
+  bool IsConvertingSampleRate() const { return mProcessingRate != mSampleRate; }
+
+  /** Enable block slicing. When enabled, the host's block is split at the sample offsets of incoming MIDI messages (and automation points,
+   * if sample accurate automation is enabled) and ProcessBlock() is called once per slice. ProcessMidiMsg() and ProcessParamChange() are called
+   * immediately before the slice an event falls in, with the event's offset relative to the start of the slice.
+   * Slices are never shorter than minSliceSize samples (apart from at the end of the host's block), events that fall inside a slice are delivered at its start.
+   * Call this from your plug-in's constructor or OnReset(), since it allocates memory.
+   * @param enable \c true in order to enable block slicing
+   * @param minSliceSize The minimum size of a slice in samples */
+  void SetBlockSlicing(bool enable, int minSliceSize = DEFAULT_MIN_SLICE_SIZE);
+
+  /** @return \c true if block slicing has been enabled */
+  bool GetBlockSlicing() const { return mBlockSlicing; }
+
+  /** Have host blocks of PLUG_SAMPLE_SRC buffers processed by ProcessBlockHostPrecision() rather than converted for ProcessBlock(). Call this from your plug-in's constructor, since it allocates memory
+   * @param enable \c true if the plug-in implements ProcessBlockHostPrecision() */
+  void EnableHostPrecisionProcessing(bool enable);
+
+  /** @return \c true if EnableHostPrecisionProcessing() has been called */
+  bool GetHostPrecisionProcessing() const { return mHostPrecisionProcessing; }
+
+  /** Enable silence skipping. When enabled, once the inputs have been silent for longer than the tail size (see SetTailSize()) and the last block of output
+   * was silent, ProcessBlock() is no longer called and the outputs are zeroed, until the inputs or MIDI wake the plug-in again. The API classes also tell hosts
+   * that support it that the outputs are silent. An infinite (negative) tail size never skips.
+   * Effects that have inputs enable it when they call SetTailSize(), since until then their tail is unknown. Disable it from your constructor if your plug-in
+   * makes sound without input, for instance a tone generator or something driven by the transport, or call WakeFromSilence() when it starts to.
+   * Once this has been called, SetTailSize() no longer changes it.
+   * @param enable \c true in order to skip processing silence */
+  void SetSilenceSkipping(bool enable) { mSilenceSkipping = enable; mSilenceSkippingByDefault = false; mSilentInputFrames = 0; mOutputSilent = false; }
+
+  /** @return \c true if silence skipping is enabled */
+  bool GetSilenceSkipping() const { return mSilenceSkipping; }
+
+  /** Make the next block be processed even if its input is silent, and restart the tail countdown. Call this from any thread, when something other than
+   * the input or MIDI is about to make the plug-in produce output, e.g. in OnParamChange() */
+  void WakeFromSilence() { mWakeFromSilence = true; }
+
+  /** Flush denormals to zero while the API classes process audio, which is on by default. See IDenormalScope
+   * @param flush \c false to leave the floating point mode as the host set it */
+  void SetFlushDenormals(bool flush) { mFlushDenormals = flush; }
+
+  /** @return \c true if denormals are flushed to zero while processing */
+  bool GetFlushDenormals() const { return mFlushDenormals; }
+
+  /** @return In debug builds, the number of audio callbacks in which a calculation underflowed, that is produced a denormal or would have without flushing. Always 0 in release builds */
+  int GetNDenormalBlocks() const { return mNDenormalBlocks.load(std::memory_order_relaxed); }
+
+  /** @return \c true if the last block's outputs were silent, either because it was skipped or because it was processed after the tail had ended and was silent */
+  bool GetOutputSilent() const { return mOutputSilent; }
+
 #pragma mark -
   /** @return The number of samples elapsed since start of project timeline. */
   double GetSamplePos() const { return mTimeInfo.mSamplePos; }
@@ -200,6 +375,33 @@ public:
   /** @return \c true if this plug-in has a side-chain input, which may not necessarily be active in the current I/O config */
   bool HasSidechainInput() const { return MaxNBuses(ERoute::kInput) > 1; }
 
+  /** @param direction Whether you want to test inputs or outputs
+   * @param busIdx The index of the bus
+   * @return \c true if the host has connected any of the bus's channels. The channels of an input bus that isn't connected are silent */
+  bool IsBusConnected(ERoute direction, int busIdx) const;
+
+  /** @return \c true if the side-chain input is connected for the current block. When it isn't, its channels are silent */
+  bool IsSidechainConnected() const { return HasSidechainInput() && IsBusConnected(ERoute::kInput, 1); }
+
+  /** @param direction Whether you want inputs or outputs
+   * @return A mask of the channels connected for the current block, with bit i set if channel i is connected. Channels from 64 up are left out, GetConnectedChannels() has all of them */
+  uint64_t GetConnectedChannelMask(ERoute direction) const { return mConnectedChannelMask[direction]; }
+
+  /** Get the connected channels of the current block, compacted so that multichannel DSP loops can skip the ones the host hasn't connected. Only valid inside ProcessBlock()
+   * @param direction Whether you want inputs or outputs
+   * @param ppData Receives the buffers of the connected channels, the same pointers ProcessBlock() receives for them
+   * @param pChanIdx If not nullptr, receives the channel index of each buffer in ppData
+   * @return The number of connected channels */
+  int GetConnectedChannels(ERoute direction, sample**& ppData, const int** pChanIdx = nullptr) const
+  {
+    ppData = mConnectedChannelData[direction].Get();
+
+    if (pChanIdx)
+      *pChanIdx = mConnectedChannelIdx[direction].Get();
+
+    return mNConnectedChannels[direction];
+  }
+
   /** This is called by IPlugVST in order to limit a plug-in to stereo I/O for certain picky hosts \todo may no longer be relevant*/
   void LimitToStereoIO();//TODO: this should be updated
 
@@ -234,11 +436,27 @@ public:
    @param latency Latency in samples */
   virtual void SetLatency(int latency);
 
+  /** Ask for the latency to change, from any thread, for instance when a lookahead parameter changes. Unlike SetLatency() the host isn't told straight away:
+   * the main thread applies the latest request once it has stayed the same for LATENCY_SETTLE_TICKS ticks of the idle timer, so dragging a control makes the host
+   * redo its delay compensation once, rather than for every value. LatencyCompensator can delay your dry signal to match
+   * @param latency Latency in samples */
+  void RequestLatency(int latency) { mRequestedLatency.store(latency, std::memory_order_relaxed); }
+
   /** Call this method if you need to update the tail size at runtime, for example if the decay time of your reverb effect changes
    * Some apis have special interpretations of certain numbers. For VST3 set to 0xffffffff for infinite tail, or 0 for none (default)
    * For VST2 setting to 1 means no tail
+   * The first call enables silence skipping for effects that have inputs, unless SetSilenceSkipping() has been called
    * @param tailSize the new tailsize in samples*/
-  void SetTailSize(int tailSize) { mTailSize = tailSize; }
+  void SetTailSize(int tailSize)
+  {
+    mTailSize = tailSize;
+
+    if (mSilenceSkippingByDefault)
+    {
+      mSilenceSkipping = true;
+      mSilenceSkippingByDefault = false;
+    }
+  }
 
   /** A static method to parse the config.h channel I/O string.
    * @param IOStr Space separated cstring list of I/O configurations for this plug-in in the format ninchans-noutchans.
@@ -267,14 +485,115 @@ protected:
   void ProcessBuffers(PLUG_SAMPLE_DST type, int nFrames);
   void ProcessBuffersAccumulating(int nFrames); // only for VST2 deprecated method single precision
   void ZeroScratchBuffers();
-  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+  void SetSampleRate(double sampleRate);
   void SetBlockSize(int blockSize);
   void SetBypassed(bool bypassed) { mBypassed = bypassed; }
   void SetTimeInfo(const ITimeInfo& timeInfo) { mTimeInfo = timeInfo; }
   void SetRenderingOffline(bool renderingOffline) { mRenderingOffline = renderingOffline; }
+  /** Called by the API classes to add a single automation point for the forthcoming block, when sample accurate automation is enabled
+   * @param paramIdx The index of the parameter
+   * @param value The non-normalized value
+   * @param offset The sample offset in the forthcoming block */
+  void AddParamChange(int paramIdx, double value, int offset) { if (mSampleAccurateAutomation) mParamChanges.Add(paramIdx, mBlockSlicing ? offset : ScaleFrames(offset), value); }
+  /** Called by the API classes on the audio thread for incoming MIDI messages, instead of calling ProcessMidiMsg() directly.
+   * When block slicing is enabled the message is queued, in order to be delivered prior to the slice it falls in */
+  void ProcessMidiMsgFromAPI(const IMidiMsg& msg) { mMidiSinceLastBlock = true; if (mBlockSlicing) mSliceMidiQueue.Add(msg); else ProcessMidiMsg(ScaleOffset(msg)); }
+  /** Called by the API classes at the start of each audio callback, before any MIDI or parameter processing. The denormal mode applies until the returned scope is destroyed */
+  IDenormalScope MakeDenormalScope()
+  {
+#if defined _DEBUG
+    return IDenormalScope(mFlushDenormals, &mNDenormalBlocks);
+#else
+    return IDenormalScope(mFlushDenormals);
+#endif
+  }
+  /** Called by the API classes from their constructors, once the parameters exist. Sizes the parameter snapshot and has every parameter flag its changes for it
+   * @param delegate The plug-in, which owns the parameters. The number of parameters mustn't change afterwards */
+  void AttachParamSnapshot(IEditorDelegate& delegate);
+  /** Called by the API classes when they learn the host's audio workgroup. They keep it retained for as long as it is current
+   * @param pWorkgroup An os_workgroup_t, or nullptr */
+  void SetAudioWorkgroup(void* pWorkgroup) { mpAudioWorkgroup.store(pWorkgroup, std::memory_order_release); }
+  /** Called by the API classes before ProcessBuffers(), when the host has flagged all of the connected inputs as silent, which saves scanning them. It applies to the next block only */
+  void SetInputSilentFromHost(bool silent) { mInputSilentFromHost = silent; }
+  /** Called by the API classes that delay the signal by the latency while bypassed, from their constructors. Creates mLatencyDelay */
+  void CreateLatencyDelay();
   const WDL_String& GetChannelLabel(ERoute direction, int idx) { return mChannelData[direction].Get(idx)->mLabel; }
 
 private:
+  friend class IPlugAPIBase;
+
+  /** Allocate a bypass delay line long enough for the latency. The main thread hands it to the audio thread through mPendingLatencyDelay
+   * @return The new delay line, which the caller owns */
+  NChanDelayLine<sample>* NewLatencyDelay(int latency);
+
+  /** Called by IPlugAPIBase::OnTimer() on the main thread, applies a latency from RequestLatency() once it has settled
+   * @return \c true while a latency is settling, so that the timer counts the ticks at its full rate */
+  bool ApplyRequestedLatency();
+
+  /** Copies the parameters that have changed since the last block into mParamSnapshot, at the start of ProcessBuffers() */
+  void UpdateParamSnapshot();
+
+  /** Calls ProcessBlock() once per slice of the current block, delivering queued MIDI messages and automation points before each slice */
+  void ProcessBlockSliced(int nFrames);
+
+  /** Calls ProcessBlock() for a block or slice, through the fixed rate conversion and the oversampler if they are enabled */
+  void ProcessSlice(sample** inputs, sample** outputs, int nFrames);
+
+  /** Calls ProcessBlock() for a block at the processing rate, through the oversampler if it is oversampling */
+  void ProcessAtProcessingRate(sample** inputs, sample** outputs, int nFrames);
+
+  /** Sets up the conversion for EnableFixedSampleRate() at the host's rate and block size, and the oversampler for the block size at the processing rate */
+  void ResetProcessingRate();
+
+  /** @return The latency of the fixed rate conversion and the oversampling filters, at the host's rate */
+  int GetFrameworkLatency() const;
+
+  /** Processes a block for ProcessBuffers(), in either the \c sample scratch buffers or the host's PLUG_SAMPLE_SRC buffers, see EnableHostPrecisionProcessing() */
+  template <typename T>
+  void ProcessBuffersInPrecision(T** inputs, T** outputs, int nFrames);
+
+  /** Calls ProcessBlock(), sliced or through ProcessSlice() */
+  void ProcessBlockInPrecision(sample** inputs, sample** outputs, int nFrames);
+
+  /** Calls ProcessBlockHostPrecision() */
+  void ProcessBlockInPrecision(PLUG_SAMPLE_SRC** inputs, PLUG_SAMPLE_SRC** outputs, int nFrames) { RenderParamRamps(nFrames); ProcessBlockHostPrecision(inputs, outputs, nFrames); }
+
+  /** Finds the parameters IParam::SetSmoothing() was called for and sizes their ramps for the most frames ProcessBlock() can be called with, when the rate or block size changes */
+  void ResetParamRamps();
+
+  /** Renders the smoothed parameters for a ProcessBlock() call, through the automation points of the block unless block slicing delivers them */
+  void RenderParamRamps(int nFrames) { mParamRamps.Render(nFrames, mBlockSlicing ? nullptr : &mParamChanges); }
+
+  /** Converts the PLUG_SAMPLE_SRC inputs that AttachBuffers() was given into the scratch buffers, for blocks that go through ProcessBlock() */
+  void ConvertIncomingInputs(int nFrames);
+
+  /** Sizes the buffers disconnected channels use in ProcessBlockHostPrecision() */
+  void ResizeHostPrecisionScratch();
+
+  /** Applies a factor from SetOverSampling(), at the end of ProcessBuffers(), so that the events the API classes deliver before the next block are scaled by the new rate */
+  void ApplyRequestedOverSampling();
+
+  /** @return A number of frames at the host's rate scaled to the fixed and oversampled rate ProcessBlock() runs at */
+  int ScaleFrames(int frames) const { return (IsConvertingSampleRate() ? static_cast<int>(frames * (mProcessingRate / mSampleRate)) : frames) * GetOverSamplingRate(); }
+
+  /** @return An event with its offset scaled to the rate ProcessBlock() runs at */
+  template <typename T>
+  T ScaleOffset(T event) const { event.mOffset = ScaleFrames(event.mOffset); return event; }
+
+  /** Finds the connected channels for the current block, see GetConnectedChannels() */
+  void UpdateConnectedChannels();
+
+  /** Points the compacted channel lists at the buffers ProcessBlock() is about to be called with */
+  void CompactConnectedChannels(sample** inputs, sample** outputs);
+
+  /** @return \c true if the inputs of the current block are all below SILENCE_THRESHOLD, or the host said they are */
+  template <typename T>
+  bool InputsAreSilent(T** inputs, int nFrames) const;
+
+  /** @return \c true if the outputs of the current block are all below SILENCE_THRESHOLD */
+  template <typename T>
+  bool OutputsAreSilent(T** outputs, int nFrames) const;
+
   /** See EIPlugPluginTypes */
   EIPlugPluginType mPlugType;
   /** \c true if the plug-in accepts MIDI input */
@@ -283,10 +602,13 @@ private:
   bool mDoesMIDIOut;
   /** \c true if the plug-in supports MIDI Polyphonic Expression */
   bool mDoesMPE;
-  /** Plug-in latency (in samples) */
-  int mLatency;
+  /** Plug-in latency (in samples), written on the main thread and read by the audio thread */
+  std::atomic<int> mLatency;
   /** Current sample rate (in Hz) */
   double mSampleRate = DEFAULT_SAMPLE_RATE;
+  /** The rate ProcessBlock() runs at before oversampling, the host's unless EnableFixedSampleRate() converts it, and the most frames it is called with at that rate */
+  double mProcessingRate = DEFAULT_SAMPLE_RATE;
+  int mProcessingBlockSize = 0;
   /** Current block size (in samples) */
   int mBlockSize = 0;
   /** Current tail size (in samples) */
@@ -295,6 +617,97 @@ private:
   bool mBypassed = false;
   /** \c true if the plug-in is rendering off-line*/
   bool mRenderingOffline = false;
+  /** \c true if the API classes should provide every automation point via mParamChanges */
+  bool mSampleAccurateAutomation = false;
+  /** The automation points for the current block */
+  IParamChangeList mParamChanges;
+  /** The plug-in whose parameters are snapshotted, or nullptr until AttachParamSnapshot() */
+  IEditorDelegate* mpSnapshotDelegate = nullptr;
+  /** Which parameters have been set since the last block */
+  IParamChangeFlags mParamChangeFlags;
+  /** Each parameter's value as of the start of the current block */
+  WDL_TypedBuf<double> mParamSnapshot;
+  /** The smoothed parameters, see GetSmoothedParam() */
+  IParamRamps<sample> mParamRamps;
+  /** \c true if ProcessBlock() should be called per slice of the host's block */
+  bool mBlockSlicing = false;
+  /** The minimum size of a slice in samples */
+  int mMinSliceSize = DEFAULT_MIN_SLICE_SIZE;
+  /** MIDI messages from the API class, waiting to be delivered to the slice they fall in */
+  IMidiQueue mSliceMidiQueue;
+  /** \c true if ProcessBlock() should be skipped for silent input once the tail has ended, see SetSilenceSkipping() */
+  bool mSilenceSkipping = false;
+  /** \c true for effects with inputs, until SetTailSize() enables silence skipping or SetSilenceSkipping() is called */
+  bool mSilenceSkippingByDefault = false;
+  /** Set by WakeFromSilence(), possibly from another thread */
+  std::atomic<bool> mWakeFromSilence{false};
+  /** \c true if MIDI has arrived since the last block */
+  bool mMidiSinceLastBlock = false;
+  /** \c true if the host flagged the inputs of the forthcoming block as silent */
+  bool mInputSilentFromHost = false;
+  /** The number of samples since the last block with non silent input */
+  int64_t mSilentInputFrames = 0;
+  /** \c true if the outputs of the last block were silent */
+  bool mOutputSilent = false;
+  /** Times the host blocks, see GetProfiler() */
+  IPlugProfiler mProfiler;
+  /** Lowers the quality level under load, see GetQualityGovernor() */
+  IPlugQualityGovernor mQualityGovernor;
+  /** The level OnQualityChange() was last called for */
+  int mQualityLevel = -1;
+  /** Pointers into the scratch data, offset to the start of the current slice */
+  WDL_TypedBuf<sample*> mSliceData[2];
+  /** \c true if PLUG_SAMPLE_SRC host buffers go to ProcessBlockHostPrecision(), see EnableHostPrecisionProcessing() */
+  bool mHostPrecisionProcessing = false;
+  /** The channel pointers ProcessBlockHostPrecision() is called with, the host's buffers for connected channels */
+  WDL_TypedBuf<PLUG_SAMPLE_SRC*> mHostPrecisionData[2];
+  /** A block for each channel, used by the disconnected ones in ProcessBlockHostPrecision(). The inputs are kept silent */
+  WDL_TypedBuf<PLUG_SAMPLE_SRC> mHostPrecisionScratch[2];
+  /** Oversamples ProcessBlock(), or nullptr unless EnableOverSampling() was called */
+  std::unique_ptr<OverSampler<sample>> mOverSampler;
+  /** The highest factor the oversampler was allocated for */
+  int mMaxOverSamplingFactor = 0;
+  /** The latest factor from SetOverSampling(), or -1 */
+  std::atomic<int> mRequestedOverSamplingFactor{-1};
+  /** The rate ProcessBlock() is oversampled by */
+  std::atomic<int> mOverSamplingRate{1};
+  /** The latency of the oversampling filters at the processing rate */
+  std::atomic<int> mOverSamplingLatency{0};
+  /** Converts the host's rate to the one from EnableFixedSampleRate() and back, or nullptr */
+  std::unique_ptr<FixedRateProcessor<sample>> mFixedRateProcessor;
+  /** The rate from EnableFixedSampleRate(), and whether to only convert higher rates to it */
+  double mFixedSampleRate = 0.;
+  bool mFixedRateOnlyAbove = false;
+  /** The latency of the fixed rate conversion at the host rate */
+  std::atomic<int> mFixedRateLatency{0};
+  /** How much of the framework's latency the reported latency includes */
+  int mReportedFrameworkLatency = 0;
+  /** The host's audio workgroup, see GetAudioWorkgroup() */
+  std::atomic<void*> mpAudioWorkgroup{nullptr};
+  /** The latest latency from RequestLatency(), or -1 */
+  std::atomic<int> mRequestedLatency{-1};
+  /** The request the idle timer last saw, and for how many ticks it has been unchanged */
+  int mSettlingLatency = -1;
+  int mLatencySettleTicks = 0;
+  /** A longer bypass delay line than mLatencyDelay, allocated by SetLatency() for the audio thread to switch to, and the one it replaced, which the main thread deletes */
+  std::atomic<NChanDelayLine<sample>*> mPendingLatencyDelay{nullptr};
+  std::atomic<NChanDelayLine<sample>*> mRetiredLatencyDelay{nullptr};
+  /** The longest latency the newest bypass delay line can delay by without allocating, or -1 if there is no delay line. Main thread only */
+  int mLatencyDelayCapacity = -1;
+  /** \c true if the API classes should flush denormals to zero while processing */
+  bool mFlushDenormals = true;
+  /** The number of audio callbacks that underflowed, counted in debug builds */
+  std::atomic<int> mNDenormalBlocks{0};
+  /** The indices of the connected channels for the current block */
+  WDL_TypedBuf<int> mConnectedChannelIdx[2];
+  /** The buffers of the connected channels for the current ProcessBlock() call */
+  WDL_TypedBuf<sample*> mConnectedChannelData[2];
+  /** The number of connected channels for the current block */
+  int mNConnectedChannels[2] = {};
+  /** The connected channels for the current block, for the first 64 channels */
+  uint64_t mConnectedChannelMask[2] = {};
+  /** The index of the first channel of each bus, followed by the total, for the bus layout with the most channels on each bus */
+  std::vector<int> mBusChannelStart[2];
   /** A list of IOConfig structures populated by ParseChannelIOStr in the IPlugProcessor constructor */
   WDL_PtrList<IOConfig> mIOConfigs;
   /* Manages pointers to the actual data for each channel */
@@ -302,7 +715,7 @@ private:
   /* A list of IChannelData structures corresponding to every input/output channel */
   WDL_PtrList<IChannelData<>> mChannelData[2];
 protected: // these members are protected because they need to be access by the API classes, and don't want a setter/getter
-  /** A multi-channel delay line used to delay the bypassed signal when a plug-in with latency is bypassed. */
+  /** A multi-channel delay line used to delay the bypassed signal when a plug-in with latency is bypassed. Owned by the audio thread once processing starts, see CreateLatencyDelay() */
   std::unique_ptr<NChanDelayLine<sample>> mLatencyDelay = nullptr;
   /** Contains detailed information about the transport state */
   ITimeInfo mTimeInfo;
@@ -0,0 +1,324 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugProfiler
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#include "heapbuf.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugQueue.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** One timed interval measured by IPlugProfiler, either a whole host block or a named scope inside DSP code */
+struct IProfileRecord
+{
+  /** The scope's name, or nullptr for a host block */
+  const char* mName = nullptr;
+  /** When the interval started, in seconds since the profiler was created */
+  double mStartTime = 0.;
+  /** How long the interval took, in seconds */
+  float mDuration = 0.f;
+  /** How long the host block lasts in real time (nFrames / sample rate), in seconds. 0. for a scope */
+  float mDeadline = 0.f;
+  /** A small number identifying the thread the interval was measured on */
+  int mThread = 0;
+};
+
+/** Statistics of the host blocks that IPlugProfiler has measured, this is what IPlugProfiler sends to a display control.
+ * Loads are the time spent processing a block divided by the time the block lasts, so 1. means the deadline was only just met */
+struct IProfileStats
+{
+  /** The number of blocks the load statistics are taken over */
+  int mNBlocks = 0;
+  /** The number of blocks whose processing took longer than the block lasts, since the last Reset() */
+  int mNOverruns = 0;
+  /** The number of records that were lost because IPlugProfiler wasn't drained in time, since the last Reset() */
+  int mNDropped = 0;
+  /** The highest load of the blocks measured since the previous Drain() that had any */
+  float mRecentMaxLoad = 0.f;
+  /** The load statistics over the last mNBlocks blocks */
+  float mMeanLoad = 0.f;
+  float mMedianLoad = 0.f;
+  float mP95Load = 0.f;
+  float mP99Load = 0.f;
+  float mMaxLoad = 0.f;
+};
+
+/** A low-overhead profiler for the audio thread. IPlugProcessor times every host block with it, and DSP code can time named scopes with IPLUG_PROFILE_SCOPE().
+ * Records are pushed to a lock-free queue; IPlugAPIBase::OnTimer() drains them on the main thread into the statistics, a history for WriteTrace(), and optionally a display control (IProfilerDisplayControl).
+ * The profiler does nothing until it is enabled, apart from checking an atomic flag once per block and scope */
+class IPlugProfiler final
+{
+public:
+  /** The message tag used to send IProfileStats to the display control */
+  static constexpr int kUpdateMessage = 0;
+
+  /** RAII helper that records the time between its construction and destruction as a named scope, see IPLUG_PROFILE_SCOPE() */
+  class Scope
+  {
+  public:
+    /** @param profiler The profiler to add the scope to
+     * @param name The scope's name. It is stored as a pointer so it must outlive the profiler, normally a string literal */
+    Scope(IPlugProfiler& profiler, const char* name)
+    : mProfiler(profiler)
+    , mName(name)
+    , mStartTime(profiler.GetEnabled() ? profiler.GetTime() : -1.)
+    {
+    }
+
+    ~Scope()
+    {
+      if (mStartTime >= 0.)
+        mProfiler.AddScope(mName, mStartTime);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    IPlugProfiler& mProfiler;
+    const char* mName;
+    double mStartTime;
+  };
+
+  /** @param queueSize The number of records that can be waiting to be drained. IPlugAPIBase::OnTimer() drains them every IDLE_TIMER_RATE ms, so allow for a few hundred blocks and their scopes
+   * @param historySize The number of records kept for WriteTrace()
+   * @param windowSize The number of blocks the load statistics are taken over */
+  IPlugProfiler(int queueSize = 4096, int historySize = 16384, int windowSize = 1024)
+  : mQueue(2)
+  , mQueueSize(queueSize)
+  , mHistorySize(historySize)
+  , mWindowSize(windowSize)
+  , mStartTime(std::chrono::steady_clock::now())
+  {
+  }
+
+  IPlugProfiler(const IPlugProfiler&) = delete;
+  IPlugProfiler& operator=(const IPlugProfiler&) = delete;
+
+  /** Start or stop profiling. The buffers are allocated the first time the profiler is enabled, so call this on the main thread, e.g. in the plug-in constructor */
+  void SetEnabled(bool enabled)
+  {
+    if (enabled && !mAllocated)
+    {
+      mQueue.Resize(mQueueSize);
+      mHistory.Resize(mHistorySize);
+      mLoads.Resize(mWindowSize);
+      mSortedLoads.Resize(mWindowSize);
+      mAllocated = true;
+    }
+
+    mEnabled.store(enabled, std::memory_order_release);
+  }
+
+  /** @return \c true if the profiler is recording */
+  bool GetEnabled() const { return mEnabled.load(std::memory_order_acquire); }
+
+  /** @return The time in seconds since the profiler was created */
+  double GetTime() const
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+  }
+
+  /** Record a host block that started at startTime and has just finished. Called by IPlugProcessor
+   * @param startTime The value GetTime() returned before the block was processed
+   * @param nFrames The number of frames in the block
+   * @param sampleRate The sample rate */
+  void AddBlock(double startTime, int nFrames, double sampleRate)
+  {
+    IProfileRecord record;
+    record.mStartTime = startTime;
+    record.mDuration = static_cast<float>(GetTime() - startTime);
+    record.mDeadline = static_cast<float>(nFrames / sampleRate);
+    record.mThread = GetThreadNumber();
+    Push(record);
+  }
+
+  /** Record a named scope that started at startTime and has just finished. Can be called from any thread, but see Scope for a simpler way to use it
+   * @param name The scope's name, which must outlive the profiler
+   * @param startTime The value GetTime() returned when the scope started */
+  void AddScope(const char* name, double startTime)
+  {
+    IProfileRecord record;
+    record.mName = name;
+    record.mStartTime = startTime;
+    record.mDuration = static_cast<float>(GetTime() - startTime);
+    record.mThread = GetThreadNumber();
+    Push(record);
+  }
+
+  /** Move the waiting records into the history and update the statistics. Call this on the main thread, IPlugAPIBase::OnTimer() does so while the profiler is enabled */
+  void Drain()
+  {
+    if (!mAllocated)
+      return;
+
+    IProfileRecord record;
+    bool newBlocks = false;
+    float recentMax = 0.f;
+
+    while (mQueue.Pop(record))
+    {
+      mHistory.Get()[mHistoryPos] = record;
+      mHistoryPos = (mHistoryPos + 1) % mHistorySize;
+      mHistoryCount = std::min(mHistoryCount + 1, mHistorySize);
+
+      if (!record.mName && record.mDeadline > 0.f)
+      {
+        const float load = record.mDuration / record.mDeadline;
+        mLoads.Get()[mLoadsPos] = load;
+        mLoadsPos = (mLoadsPos + 1) % mWindowSize;
+        mLoadsCount = std::min(mLoadsCount + 1, mWindowSize);
+        recentMax = std::max(recentMax, load);
+        newBlocks = true;
+
+        if (load > 1.f)
+          mStats.mNOverruns++;
+      }
+    }
+
+    mStats.mNDropped = mNDropped.load(std::memory_order_relaxed);
+
+    if (!newBlocks)
+      return;
+
+    mStats.mRecentMaxLoad = recentMax;
+    mStats.mNBlocks = mLoadsCount;
+
+    float* pSorted = mSortedLoads.Get();
+    std::copy(mLoads.Get(), mLoads.Get() + mLoadsCount, pSorted);
+    std::sort(pSorted, pSorted + mLoadsCount);
+
+    float sum = 0.f;
+    for (int i = 0; i < mLoadsCount; i++)
+      sum += pSorted[i];
+
+    auto percentile = [&](float p) { return pSorted[std::min(static_cast<int>(p * mLoadsCount), mLoadsCount - 1)]; };
+
+    mStats.mMeanLoad = sum / mLoadsCount;
+    mStats.mMedianLoad = percentile(0.5f);
+    mStats.mP95Load = percentile(0.95f);
+    mStats.mP99Load = percentile(0.99f);
+    mStats.mMaxLoad = pSorted[mLoadsCount - 1];
+  }
+
+  /** @return The statistics as of the last Drain() */
+  const IProfileStats& GetStats() const { return mStats; }
+
+  /** Clear the statistics and the history. Call this on the main thread */
+  void Reset()
+  {
+    mStats = IProfileStats();
+    mNDropped.store(0, std::memory_order_relaxed);
+    mHistoryPos = mHistoryCount = 0;
+    mLoadsPos = mLoadsCount = 0;
+  }
+
+  /** Call a function for each record in the history, oldest first. Call this on the main thread
+   * @param func A function taking a const IProfileRecord& */
+  template <typename F>
+  void ForEachRecord(F func) const
+  {
+    const int first = (mHistoryPos - mHistoryCount + mHistorySize) % mHistorySize;
+
+    for (int i = 0; i < mHistoryCount; i++)
+      func(mHistory.Get()[(first + i) % mHistorySize]);
+  }
+
+  /** Write the history as a Chrome trace event file, which can be opened in chrome://tracing or https://ui.perfetto.dev. Call this on the main thread
+   * @param path The file to write
+   * @return \c true on success */
+  bool WriteTrace(const char* path) const
+  {
+    FILE* fp = fopen(path, "w");
+
+    if (!fp)
+      return false;
+
+    bool first = true;
+    fprintf(fp, "{\"traceEvents\":[");
+
+    ForEachRecord([&](const IProfileRecord& record) {
+      fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",", record.mName ? record.mName : "ProcessBlock",
+              record.mThread, record.mStartTime * 1e6, record.mDuration * 1e6);
+
+      if (!record.mName && record.mDeadline > 0.f)
+        fprintf(fp, ",\"args\":{\"load\":%.4f}", record.mDuration / record.mDeadline);
+
+      fprintf(fp, "}");
+      first = false;
+    });
+
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+  }
+
+  /** Set a control to send the statistics to after each Drain(), e.g. an IProfilerDisplayControl
+   * @param ctrlTag The control's tag, or kNoTag to stop sending them */
+  void SetDisplayControlTag(int ctrlTag) { mDisplayControlTag = ctrlTag; }
+
+  /** @return The tag of the control the statistics are sent to, or kNoTag */
+  int GetDisplayControlTag() const { return mDisplayControlTag; }
+
+private:
+  void Push(const IProfileRecord& record)
+  {
+    if (!mQueue.Push(record))
+      mNDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static int GetThreadNumber()
+  {
+    static std::atomic<int> sNextThread{0};
+    thread_local const int threadNumber = sNextThread.fetch_add(1, std::memory_order_relaxed);
+    return threadNumber;
+  }
+
+  IPlugMPMCQueue<IProfileRecord> mQueue; // scopes can be timed on worker threads as well as the audio thread
+  std::atomic<bool> mEnabled{false};
+  std::atomic<int> mNDropped{0};
+  bool mAllocated = false;
+  int mQueueSize;
+  int mHistorySize;
+  int mWindowSize;
+  std::chrono::steady_clock::time_point mStartTime;
+
+  WDL_TypedBuf<IProfileRecord> mHistory;
+  int mHistoryPos = 0;
+  int mHistoryCount = 0;
+  WDL_TypedBuf<float> mLoads;
+  WDL_TypedBuf<float> mSortedLoads;
+  int mLoadsPos = 0;
+  int mLoadsCount = 0;
+  IProfileStats mStats;
+  int mDisplayControlTag = kNoTag;
+};
+
+END_IPLUG_NAMESPACE
+
+#define IPLUG_PROFILE_CONCAT_(a, b) a##b
+#define IPLUG_PROFILE_CONCAT(a, b) IPLUG_PROFILE_CONCAT_(a, b)
+
+/** Time the rest of the enclosing block as a named scope, e.g. IPLUG_PROFILE_SCOPE(GetProfiler(), "Reverb") at the top of a function called from ProcessBlock()
+ * @param profiler An IPlugProfiler
+ * @param name A string literal naming the scope */
+#define IPLUG_PROFILE_SCOPE(profiler, name) iplug::IPlugProfiler::Scope IPLUG_PROFILE_CONCAT(profileScope, __LINE__)((profiler), (name))
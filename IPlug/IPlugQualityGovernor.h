@@ -0,0 +1,182 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugQualityGovernor
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Lowers the quality DSP code runs at when an instance's blocks take too long, and raises it again once there is headroom, so that an overloaded session degrades rather than drops out.
+ * IPlugProcessor times every host block against its deadline (nFrames / sample rate) with the profiler's clock and passes the load to AddBlock() on the audio thread.
+ * The load is smoothed, and when it crosses the down threshold the quality drops a level at a time, with a hold in between so the lower level's load can be seen.
+ * It only rises again once the smoothed load has stayed under the lower up threshold for the recovery time. Offline rendering always runs at the highest level.
+ *
+ * DSP code reads GetLevel(), or Map() to turn it into a setting such as an oversampling factor, a voice count, a convolution tail length or an analyzer rate.
+ * The level can be read on any thread. IPlugProcessor::OnQualityChange() is called on the audio thread, between blocks, when it changes */
+class IPlugQualityGovernor final
+{
+public:
+  IPlugQualityGovernor() = default;
+
+  IPlugQualityGovernor(const IPlugQualityGovernor&) = delete;
+  IPlugQualityGovernor& operator=(const IPlugQualityGovernor&) = delete;
+
+  /** Start or stop governing. While stopped the level is the highest. Set the levels and thresholds first, on the main thread, e.g. in the plug-in constructor */
+  void SetEnabled(bool enabled)
+  {
+    mLevel.store(mNumLevels - 1, std::memory_order_relaxed);
+    mResetRequested.store(true, std::memory_order_release);
+    mEnabled.store(enabled, std::memory_order_release);
+  }
+
+  /** @return \c true if the governor is measuring the blocks */
+  bool GetEnabled() const { return mEnabled.load(std::memory_order_acquire); }
+
+  /** @param nLevels The number of quality levels, at least 2. Level nLevels - 1 is the highest, 0 the lowest */
+  void SetNumLevels(int nLevels)
+  {
+    mNumLevels = std::max(nLevels, 2);
+    mLevel.store(mNumLevels - 1, std::memory_order_relaxed);
+    mResetRequested.store(true, std::memory_order_release);
+  }
+
+  /** @return The number of quality levels */
+  int GetNumLevels() const { return mNumLevels; }
+
+  /** @param down The smoothed load above which the quality drops, e.g. 0.8 for 80% of the deadline
+   * @param up The smoothed load below which the quality may rise again, less than down */
+  void SetThresholds(float down, float up)
+  {
+    mDownThreshold = down;
+    mUpThreshold = std::min(up, down);
+  }
+
+  /** @param smoothingSeconds The time constant of the load smoothing
+   * @param holdSeconds How long to wait after a drop before the quality can drop again
+   * @param recoverySeconds How long the smoothed load must stay under the up threshold before the quality rises a level */
+  void SetTimes(float smoothingSeconds, float holdSeconds, float recoverySeconds)
+  {
+    mSmoothingTime = std::max(smoothingSeconds, 0.001f);
+    mHoldTime = std::max(holdSeconds, 0.f);
+    mRecoveryTime = std::max(recoverySeconds, 0.f);
+  }
+
+  /** @return The current quality level, from 0, the lowest, to GetNumLevels() - 1, the highest. Can be called on any thread */
+  int GetLevel() const { return mLevel.load(std::memory_order_relaxed); }
+
+  /** @return \c true if the quality is at its highest level */
+  bool IsMaxLevel() const { return GetLevel() == mNumLevels - 1; }
+
+  /** Map the current level linearly onto a range of settings, e.g. Map(8, 32) for a voice count, or Map((int) kNone, (int) k4x) for an oversampling factor
+   * @param lowest The setting for level 0
+   * @param highest The setting for the highest level
+   * @return The setting for the current level, rounded to the nearest value */
+  template <typename T>
+  T Map(T lowest, T highest) const
+  {
+    const double frac = static_cast<double>(GetLevel()) / (mNumLevels - 1);
+    return static_cast<T>(std::round(lowest + (highest - lowest) * frac));
+  }
+
+  /** @return The smoothed load over the last few blocks, where 1. means the blocks took as long as they last. Only meaningful on the audio thread, or as a rough display value */
+  float GetSmoothedLoad() const { return mSmoothedLoad.load(std::memory_order_relaxed); }
+
+  /** Add a block that has been processed. Called by IPlugProcessor on the audio thread
+   * @param duration How long the block took to process, in seconds
+   * @param deadline How long the block lasts in real time, in seconds
+   * @param offline \c true if the host is rendering offline, which resets the governor to the highest level
+   * @return \c true if the level changed */
+  bool AddBlock(double duration, double deadline, bool offline)
+  {
+    const int prevLevel = mLevel.load(std::memory_order_relaxed);
+
+    if (mResetRequested.exchange(false, std::memory_order_acq_rel) || offline)
+    {
+      Reset();
+      return mLevel.load(std::memory_order_relaxed) != prevLevel;
+    }
+
+    if (deadline <= 0.)
+      return false;
+
+    const float load = static_cast<float>(duration / deadline);
+    const float coeff = 1.f - std::exp(static_cast<float>(-deadline) / mSmoothingTime);
+    const float prevSmoothed = mSmoothedLoad.load(std::memory_order_relaxed);
+    const float smoothed = prevSmoothed + coeff * (load - prevSmoothed);
+    mSmoothedLoad.store(smoothed, std::memory_order_relaxed);
+
+    mHoldRemaining -= deadline;
+
+    int level = prevLevel;
+
+    // an overrun has already dropped out, so it doesn't wait for the smoothing to catch up
+    if ((smoothed > mDownThreshold || load > 1.f) && mHoldRemaining <= 0. && level > 0)
+    {
+      level--;
+      mHoldRemaining = mHoldTime;
+      mRecoveryElapsed = 0.;
+    }
+    else if (smoothed < mUpThreshold && load <= 1.f)
+    {
+      mRecoveryElapsed += deadline;
+
+      if (mRecoveryElapsed >= mRecoveryTime && level < mNumLevels - 1)
+      {
+        level++;
+        mHoldRemaining = mHoldTime;
+        mRecoveryElapsed = 0.;
+      }
+    }
+    else
+      mRecoveryElapsed = 0.;
+
+    if (level == prevLevel)
+      return false;
+
+    mLevel.store(level, std::memory_order_relaxed);
+    return true;
+  }
+
+private:
+  void Reset()
+  {
+    mLevel.store(mNumLevels - 1, std::memory_order_relaxed);
+    mSmoothedLoad.store(0.f, std::memory_order_relaxed);
+    mHoldRemaining = 0.;
+    mRecoveryElapsed = 0.;
+  }
+
+  std::atomic<bool> mEnabled{false};
+  std::atomic<bool> mResetRequested{false};
+  std::atomic<int> mLevel{3};
+  std::atomic<float> mSmoothedLoad{0.f};
+  int mNumLevels = 4;
+  float mDownThreshold = 0.8f;
+  float mUpThreshold = 0.5f;
+  float mSmoothingTime = 0.1f;
+  float mHoldTime = 0.5f;
+  float mRecoveryTime = 3.f;
+  /** Seconds of audio until the quality can drop again */
+  double mHoldRemaining = 0.;
+  /** Seconds of audio the smoothed load has been under the up threshold */
+  double mRecoveryElapsed = 0.;
+};
+
+END_IPLUG_NAMESPACE
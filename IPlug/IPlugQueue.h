@@ -17,6 +17,9 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 
 #include "heapbuf.h"
 
@@ -134,4 +137,474 @@ private:
   std::atomic<size_t> mReadIndex{0};
 };
 
+/** A bounded lock-free MPMC queue with the same interface as IPlugQueue, for when several threads push to (or pop from) the same queue,
+ * e.g. the editor, OSC and websocket threads all sending MIDI to the processor.
+ * based on the bounded MPMC queue by Dmitry Vyukov http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ * Push() and Pop() cost a compare-and-swap each, so prefer IPlugQueue when there is only one producer and one consumer */
+template<typename T>
+class IPlugMPMCQueue final
+{
+public:
+  /** IPlugMPMCQueue constructor
+   * @param size The minimum number of elements the queue can hold. This is rounded up to a power of two */
+  IPlugMPMCQueue(int size)
+  {
+    Resize(size);
+  }
+
+  ~IPlugMPMCQueue(){}
+
+  IPlugMPMCQueue(const IPlugMPMCQueue&) = delete;
+  IPlugMPMCQueue& operator=(const IPlugMPMCQueue&) = delete;
+
+  /** Resize the queue, discarding any elements in it. Not thread safe
+   * @param size The minimum number of elements the queue can hold. This is rounded up to a power of two */
+  void Resize(int size)
+  {
+    size_t capacity = 2;
+    while (capacity < (size_t) size)
+      capacity <<= 1;
+
+    mCells.reset(new Cell[capacity]);
+    mMask = capacity - 1;
+
+    for (size_t i = 0; i < capacity; i++)
+      mCells[i].mSequence.store(i, std::memory_order_relaxed);
+
+    mWriteIndex.store(0, std::memory_order_relaxed);
+    mReadIndex.store(0, std::memory_order_relaxed);
+  }
+
+  /** Push an element, can be called from any number of threads
+   * @param item The element to copy into the queue
+   * @return \c true on success, \c false if the queue was full */
+  bool Push(const T& item)
+  {
+    Cell* pCell;
+    auto pos = mWriteIndex.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      pCell = &mCells[pos & mMask];
+      const auto seq = pCell->mSequence.load(std::memory_order_acquire);
+      const auto diff = (intptr_t) seq - (intptr_t) pos;
+
+      if (diff == 0)
+      {
+        if (mWriteIndex.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false; // full
+      else
+        pos = mWriteIndex.load(std::memory_order_relaxed);
+    }
+
+    pCell->mData = item;
+    pCell->mSequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Pop an element, can be called from any number of threads
+   * @param item Receives the element
+   * @return \c true on success, \c false if the queue was empty */
+  bool Pop(T& item)
+  {
+    Cell* pCell;
+    auto pos = mReadIndex.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      pCell = &mCells[pos & mMask];
+      const auto seq = pCell->mSequence.load(std::memory_order_acquire);
+      const auto diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+      if (diff == 0)
+      {
+        if (mReadIndex.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false; // empty
+      else
+        pos = mReadIndex.load(std::memory_order_relaxed);
+    }
+
+    item = pCell->mData;
+    pCell->mSequence.store(pos + mMask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @return The number of elements in the queue at the time of the call. This is only a snapshot when other threads are pushing or popping */
+  size_t ElementsAvailable() const
+  {
+    const auto write = mWriteIndex.load(std::memory_order_acquire);
+    const auto read = mReadIndex.load(std::memory_order_acquire);
+
+    return write > read ? write - read : 0;
+  }
+
+  /** Peek at the next element without removing it. Only valid with a single consumer, and when ElementsAvailable() is non-zero
+   * @return const T& The element at the front of the queue */
+  const T& Peek()
+  {
+    const auto pos = mReadIndex.load(std::memory_order_relaxed);
+    return mCells[pos & mMask].mData;
+  }
+
+  /** @return \c true if the queue was empty at the time of the call */
+  bool WasEmpty() const
+  {
+    return ElementsAvailable() == 0;
+  }
+
+  /** @return \c true if the queue was full at the time of the call */
+  bool WasFull() const
+  {
+    return ElementsAvailable() > mMask;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> mSequence{0};
+    T mData;
+  };
+
+  std::unique_ptr<Cell[]> mCells;
+  size_t mMask = 0;
+  // padding keeps the producer and consumer indices on separate cache lines, without requiring an over-aligned owner
+  char mPad0[64];
+  std::atomic<size_t> mWriteIndex{0};
+  char mPad1[64];
+  std::atomic<size_t> mReadIndex{0};
+};
+
+/** A lock-free queue of variable size messages, such as SysEx, that are copied into one arena instead of each taking a fixed size slot.
+ * Each message takes a slice of the arena just big enough for it (16 byte aligned), starting where the previous one ended, so the order of the arena is the order
+ * of the queue: a few hundred short messages or one dump of nearly the whole arena fit in the same memory. Any number of threads can Push(), a single thread Pop()s.
+ * The data that Pop() returns points into the arena, and stays valid until Release() (so several messages can be handed to a host in the same block), which
+ * gives the slices of all the messages popped so far back to the producers. Push() is a compare-and-swap to reserve the slice and a copy, and never allocates.
+ * Push() and Pop() work with any struct that has mOffset, mSize and mData members, e.g. SysExData or ISysEx */
+class IPlugSysExQueue final
+{
+public:
+  /** IPlugSysExQueue constructor
+   * @param nBytes The minimum size of the arena. This is rounded up to a power of two */
+  IPlugSysExQueue(int nBytes)
+  {
+    Resize(nBytes);
+  }
+
+  IPlugSysExQueue(const IPlugSysExQueue&) = delete;
+  IPlugSysExQueue& operator=(const IPlugSysExQueue&) = delete;
+
+  /** Resize the arena, discarding any messages in it. Not thread safe
+   * @param nBytes The minimum size of the arena. This is rounded up to a power of two, up to 512 KB */
+  void Resize(int nBytes)
+  {
+    size_t nUnits = 2;
+    while (nUnits * sizeof(Unit) < (size_t) nBytes && nUnits < kMaxUnits)
+      nUnits <<= 1;
+
+    mUnits.reset(new Unit[nUnits]);
+    mCommitted.reset(new std::atomic<uint16_t>[nUnits]);
+    mMask = nUnits - 1;
+
+    for (size_t i = 0; i < nUnits; i++)
+      mCommitted[i].store(0, std::memory_order_relaxed);
+
+    mWritePos.store(0, std::memory_order_relaxed);
+    mReleasePos.store(0, std::memory_order_relaxed);
+    mNPushed.store(0, std::memory_order_relaxed);
+    mReadPos = 0;
+    mNPopped = 0;
+  }
+
+  /** @return The largest message, in bytes, that can be pushed. It is a little under half the arena, so that it fits wherever the free space starts once the queue is empty */
+  int MaxMessageSize() const
+  {
+    return static_cast<int>(((mMask + 1) / 2 - 1) * sizeof(Unit));
+  }
+
+  /** Copy a message into the arena, can be called from any number of threads
+   * @return \c true on success, \c false if there wasn't room for it, or it is bigger than MaxMessageSize() */
+  bool Push(int offset, int size, const void* pData)
+  {
+    if (size < 0 || size > MaxMessageSize())
+      return false;
+
+    // one unit for the header, then the data
+    const size_t nUnits = 1 + (size + sizeof(Unit) - 1) / sizeof(Unit);
+    const size_t capacity = mMask + 1;
+    auto pos = mWritePos.load(std::memory_order_relaxed);
+    size_t nPadding;
+
+    while (true)
+    {
+      // a message that would wrap around the end of the arena starts again at the beginning, so that its data is contiguous
+      const size_t untilEnd = capacity - (pos & mMask);
+      nPadding = nUnits > untilEnd ? untilEnd : 0;
+
+      if (pos + nPadding + nUnits - mReleasePos.load(std::memory_order_acquire) > capacity)
+        return false; // full
+
+      if (mWritePos.compare_exchange_weak(pos, pos + nPadding + nUnits, std::memory_order_relaxed))
+        break;
+    }
+
+    if (nPadding)
+    {
+      mCommitted[pos & mMask].store(kPadding, std::memory_order_release);
+      pos += nPadding;
+    }
+
+    Unit* pUnit = &mUnits[pos & mMask];
+    pUnit->mHeader[0] = offset;
+    pUnit->mHeader[1] = size;
+
+    if (size)
+      memcpy(pUnit + 1, pData, size);
+
+    // counted before the commit, so that a consumer that has popped the message also sees it counted and ElementsAvailable() can't wrap
+    mNPushed.fetch_add(1, std::memory_order_relaxed);
+    mCommitted[pos & mMask].store(static_cast<uint16_t>(nUnits), std::memory_order_release);
+    return true;
+  }
+
+  /** Copy a message into the arena, can be called from any number of threads
+   * @param msg The message, e.g. a SysExData or ISysEx
+   * @return \c true on success, \c false if there wasn't room for it */
+  template <class T>
+  bool Push(const T& msg)
+  {
+    return Push(msg.mOffset, msg.mSize, msg.mData);
+  }
+
+  /** Pop a message. Call from the consumer thread only. Messages are popped in the order their Push() calls reserved their slices, so one that is still
+   * being copied holds up the ones behind it until it is complete
+   * @param offset Receives the message's offset
+   * @param size Receives the message's size in bytes
+   * @param pData Receives the message's data, which is valid until Release()
+   * @return \c true on success, \c false if there was no complete message */
+  bool Pop(int& offset, int& size, const uint8_t*& pData)
+  {
+    auto committed = mCommitted[mReadPos & mMask].load(std::memory_order_acquire);
+
+    if (committed == kPadding)
+    {
+      mCommitted[mReadPos & mMask].store(0, std::memory_order_relaxed);
+      mReadPos += (mMask + 1) - (mReadPos & mMask);
+      committed = mCommitted[mReadPos & mMask].load(std::memory_order_acquire);
+    }
+
+    if (!committed)
+      return false;
+
+    const Unit* pUnit = &mUnits[mReadPos & mMask];
+    offset = pUnit->mHeader[0];
+    size = pUnit->mHeader[1];
+    pData = reinterpret_cast<const uint8_t*>(pUnit + 1);
+
+    // unused units are always zero, the slice isn't written again until it is released
+    mCommitted[mReadPos & mMask].store(0, std::memory_order_relaxed);
+    mReadPos += committed;
+    mNPopped++;
+    return true;
+  }
+
+  /** Pop a message. Call from the consumer thread only
+   * @param msg Receives the message, e.g. a SysExData. Its data is valid until Release()
+   * @return \c true on success, \c false if there was no complete message */
+  template <class T>
+  bool Pop(T& msg)
+  {
+    const uint8_t* pData;
+
+    if (!Pop(msg.mOffset, msg.mSize, pData))
+      return false;
+
+    msg.mData = pData;
+    return true;
+  }
+
+  /** Give the slices of the messages popped so far back to the producers. Call from the consumer thread once it has finished with their data */
+  void Release()
+  {
+    mReleasePos.store(mReadPos, std::memory_order_release);
+  }
+
+  /** @return The number of messages in the queue at the time of the call, including ones that are still being copied, so a Pop() can fail even if this is non-zero */
+  size_t ElementsAvailable() const
+  {
+    return mNPushed.load(std::memory_order_acquire) - mNPopped;
+  }
+
+private:
+  struct alignas(16) Unit
+  {
+    int32_t mHeader[4];
+  };
+
+  static constexpr uint16_t kPadding = 0xFFFF;
+  static constexpr size_t kMaxUnits = 0x8000;
+
+  std::unique_ptr<Unit[]> mUnits;
+  std::unique_ptr<std::atomic<uint16_t>[]> mCommitted; // per unit, the length in units of the message that starts there, kPadding, or 0
+  size_t mMask = 0;
+  char mPad0[64];
+  std::atomic<size_t> mWritePos{0};
+  std::atomic<size_t> mNPushed{0};
+  char mPad1[64];
+  std::atomic<size_t> mReleasePos{0};
+  size_t mReadPos = 0; // consumer only
+  size_t mNPopped = 0; // consumer only
+};
+
+/** A lock-free SPSC transfer that coalesces values by index instead of queueing every change: a dirty bitset plus the latest value per slot.
+ * Pushing is O(1) and never fails for a valid index, and the consumer handles each changed slot once per Drain() with its most recent value.
+ * The order of changes between different slots is not preserved.
+ * Used to send parameter changes from the processor to the UI, where only the latest value matters */
+template<typename T>
+class IPlugCoalescingQueue final
+{
+public:
+  /** IPlugCoalescingQueue constructor
+   * @param size The number of slots (e.g. the number of parameters) */
+  IPlugCoalescingQueue(int size = 0)
+  {
+    Resize(size);
+  }
+
+  IPlugCoalescingQueue(const IPlugCoalescingQueue&) = delete;
+  IPlugCoalescingQueue& operator=(const IPlugCoalescingQueue&) = delete;
+
+  /** Resize the queue, discarding any pending changes. Not thread safe
+   * @param size The number of slots */
+  void Resize(int size)
+  {
+    mSize = size > 0 ? size : 0;
+    mNumWords = (mSize + 31) / 32;
+    mValues.reset(mSize ? new std::atomic<T>[mSize] : nullptr);
+    mDirty.reset(mNumWords ? new std::atomic<uint32_t>[mNumWords] : nullptr);
+
+    for (int i = 0; i < mNumWords; i++)
+      mDirty[i].store(0, std::memory_order_relaxed);
+
+    mPending.store(false, std::memory_order_relaxed);
+  }
+
+  /** Set the latest value for a slot and mark it as changed. Call from the producer thread
+   * @param idx The slot index
+   * @param value The new value, which replaces any value for this slot that has not been drained yet
+   * @return \c true on success, \c false if idx is out of range */
+  bool Push(int idx, T value)
+  {
+    if (idx < 0 || idx >= mSize)
+      return false;
+
+    mValues[idx].store(value, std::memory_order_relaxed);
+    mDirty[idx >> 5].fetch_or(1u << (idx & 31), std::memory_order_release);
+    mPending.store(true, std::memory_order_release);
+    return true;
+  }
+
+  /** Call func(idx, value) once for each slot that changed since the last call. Call from the consumer thread
+   * @param func A callable taking (int idx, T value)
+   * @return The number of slots that were handled */
+  template <typename F>
+  int Drain(F&& func)
+  {
+    if (!mPending.exchange(false, std::memory_order_acquire))
+      return 0;
+
+    int count = 0;
+
+    for (int w = 0; w < mNumWords; w++)
+    {
+      uint32_t bits = mDirty[w].exchange(0, std::memory_order_acquire);
+
+      while (bits)
+      {
+        int bit = 0;
+        while (!(bits & (1u << bit)))
+          bit++;
+
+        bits &= ~(1u << bit);
+        const int idx = (w << 5) + bit;
+        func(idx, mValues[idx].load(std::memory_order_relaxed));
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  /** @return \c true if there were no undrained changes at the time of the call */
+  bool WasEmpty() const
+  {
+    return !mPending.load(std::memory_order_acquire);
+  }
+
+private:
+  std::unique_ptr<std::atomic<T>[]> mValues;
+  std::unique_ptr<std::atomic<uint32_t>[]> mDirty;
+  std::atomic<bool> mPending{false};
+  int mSize = 0;
+  int mNumWords = 0;
+};
+
+/** A wait-free exchange of the latest value of T between one writer and one reader thread, using three buffers.
+ * The writer fills GetWriteBuffer() and calls Publish(), the reader calls Update() and reads GetReadBuffer(). Neither thread ever waits for the other,
+ * values published while the reader is busy replace each other, and the read buffer stays valid until the next Update().
+ * Used to send complete sets of parameter values to the audio thread */
+template<typename T>
+class IPlugTripleBuffer final
+{
+public:
+  IPlugTripleBuffer() = default;
+  IPlugTripleBuffer(const IPlugTripleBuffer&) = delete;
+  IPlugTripleBuffer& operator=(const IPlugTripleBuffer&) = delete;
+
+  /** @return The buffer to fill before calling Publish(). Call from the writer thread */
+  T& GetWriteBuffer() { return mBuffers[mWriteIdx]; }
+
+  /** Make the write buffer the latest value, and swap in a free buffer to write to next. Call from the writer thread */
+  void Publish()
+  {
+    mWriteIdx = mLatest.exchange(mWriteIdx | kNewBit, std::memory_order_acq_rel) & kIdxMask;
+  }
+
+  /** Swap in the latest value if one has been published since the last call. Call from the reader thread
+   * @return \c true if GetReadBuffer() now holds a new value */
+  bool Update()
+  {
+    if (!(mLatest.load(std::memory_order_relaxed) & kNewBit))
+      return false;
+
+    mReadIdx = mLatest.exchange(mReadIdx, std::memory_order_acq_rel) & kIdxMask;
+    return true;
+  }
+
+  /** @return The value swapped in by the last successful Update(). Call from the reader thread */
+  T& GetReadBuffer() { return mBuffers[mReadIdx]; }
+
+  /** Call func(buffer) for each of the three buffers, e.g. to allocate them. Not thread safe */
+  template <typename F>
+  void ForEachBuffer(F&& func)
+  {
+    for (auto& buffer : mBuffers)
+      func(buffer);
+  }
+
+private:
+  static constexpr int kIdxMask = 3;
+  static constexpr int kNewBit = 4;
+
+  T mBuffers[3];
+  int mWriteIdx = 0;
+  int mReadIdx = 1;
+  std::atomic<int> mLatest{2};
+};
+
 END_IPLUG_NAMESPACE
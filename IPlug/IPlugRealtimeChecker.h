@@ -0,0 +1,262 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IRealtimeChecker
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "IPlugPlatform.h"
+
+#if defined IPLUG_RTSAFE_CHECKS
+  #include <cstdio>
+  #include <cstdlib>
+  #include <cstring>
+  #if defined OS_WIN
+    #include <windows.h>
+  #else
+    #include <execinfo.h>
+    #include <pthread.h>
+    #include <unistd.h>
+  #endif
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Debug instrumentation that reports operations that can block on the audio thread: heap allocation and deallocation, locking a mutex and sleeping.
+ * IPlugProcessor marks the audio thread with a RealtimeScope while it processes a block, and the interceptors report any of these operations made inside one,
+ * with a stack trace on stderr (OutputDebugString on Windows). Each call site is reported once, up to kMaxReportedCallSites.
+ *
+ * Define IPLUG_RTSAFE_CHECKS project-wide in a debug build to enable it (see DEBUG_DEFS in common-mac.xcconfig). IPlug_include_in_plug_src.h then compiles the interceptors in IPlugRealtimeChecker_include_in_plug_src.h into the plug-in:
+ * - new and delete, on all platforms
+ * - malloc(), calloc(), realloc() and free(), on macOS and on Linux with glibc (so WDL_TypedBuf, WDL_HeapBuf and WDL_String growth is caught too)
+ * - pthread_mutex_lock(), pthread_rwlock_rdlock() and pthread_rwlock_wrlock(), pthread_cond_wait(), sleep(), usleep() and nanosleep() on macOS and Linux, which covers WDL_Mutex
+ *
+ * The interceptors only see calls made from the plug-in binary itself, which is where the DSP code is. A Linux plug-in must be linked with -Wl,-Bsymbolic-functions for its own definitions to take precedence over the host's.
+ * Without IPLUG_RTSAFE_CHECKS the scopes are empty and nothing is intercepted */
+class IRealtimeChecker final
+{
+public:
+  /** The kinds of operation that are reported */
+  enum class EViolation
+  {
+    kAllocation,
+    kDeallocation,
+    kLock,
+    kSleep
+  };
+
+  /** The number of distinct call sites that are reported, further violations are only counted */
+  static constexpr int kMaxReportedCallSites = 64;
+
+#if defined IPLUG_RTSAFE_CHECKS
+  /** Marks the current thread as realtime for the lifetime of the object. Scopes can be nested */
+  class RealtimeScope
+  {
+  public:
+    RealtimeScope() { if (CreateKey()) SetState(GetState() + kDepthUnit); }
+    ~RealtimeScope() { if (GetState() & kDepthMask) SetState(GetState() - kDepthUnit); }
+
+    RealtimeScope(const RealtimeScope&) = delete;
+    RealtimeScope& operator=(const RealtimeScope&) = delete;
+  };
+
+  /** Suspends checking on the current thread for the lifetime of the object, around code that is known to be safe or that deliberately accepts the cost */
+  class AllowScope
+  {
+  public:
+    AllowScope() { if (GetState() & kDepthMask) { SetState(GetState() + kAllowUnit); mActive = true; } }
+    ~AllowScope() { if (mActive) SetState(GetState() - kAllowUnit); }
+
+    AllowScope(const AllowScope&) = delete;
+    AllowScope& operator=(const AllowScope&) = delete;
+
+  private:
+    bool mActive = false;
+  };
+
+  /** @return \c true if the current thread is inside a RealtimeScope and checking isn't suspended */
+  static bool IsRealtime()
+  {
+    const uintptr_t state = GetState();
+    return (state & kDepthMask) && !(state & (kAllowMask | kReportingBit));
+  }
+
+  /** Report an operation if the current thread is realtime. The interceptors call this, and it can be called directly from code that is about to block
+   * @param type The kind of operation */
+  static void Check(EViolation type)
+  {
+    if (IsRealtime())
+      Report(type);
+  }
+
+  /** @return The number of violations since the program started, including those at call sites that were already reported */
+  static int GetNViolations() { return sNViolations.load(std::memory_order_relaxed); }
+
+  /** Call abort() after reporting a violation, to stop in the debugger at the first one
+   * @param abortOnViolation \c true to abort */
+  static void SetAbortOnViolation(bool abortOnViolation) { sAbortOnViolation.store(abortOnViolation, std::memory_order_relaxed); }
+
+private:
+  // the per-thread state is packed into one word, so that it can live in a pthread key without allocating (thread_local allocates on first use on macOS, which would recurse into malloc)
+  static constexpr uintptr_t kDepthUnit = 1;
+  static constexpr uintptr_t kDepthMask = 0xFFFF;
+  static constexpr uintptr_t kAllowUnit = 0x10000;
+  static constexpr uintptr_t kAllowMask = 0x7FFF0000;
+  static constexpr uintptr_t kReportingBit = 0x80000000;
+  static constexpr int kMaxFrames = 32;
+  static constexpr int kNCallSiteFrames = 4; // the frames nearest the violation that identify its call site
+
+#if defined OS_WIN
+  static bool CreateKey() { return true; }
+  static uintptr_t GetState() { return sState; }
+  static void SetState(uintptr_t state) { sState = state; }
+
+  static inline thread_local uintptr_t sState = 0;
+#else
+  static bool CreateKey()
+  {
+    int keyState = sKeyState.load(std::memory_order_acquire);
+
+    if (keyState == 0 && sKeyState.compare_exchange_strong(keyState, 1, std::memory_order_acq_rel))
+    {
+      pthread_key_create(&sKey, nullptr);
+      sKeyState.store(2, std::memory_order_release);
+      return true;
+    }
+
+    return keyState == 2;
+  }
+
+  static uintptr_t GetState()
+  {
+    return sKeyState.load(std::memory_order_acquire) == 2 ? reinterpret_cast<uintptr_t>(pthread_getspecific(sKey)) : 0;
+  }
+
+  static void SetState(uintptr_t state)
+  {
+    pthread_setspecific(sKey, reinterpret_cast<void*>(state));
+  }
+
+  static inline pthread_key_t sKey;
+  static inline std::atomic<int> sKeyState{0}; // 0: not created, 1: being created, 2: created
+#endif
+
+  static const char* GetViolationStr(EViolation type)
+  {
+    switch (type)
+    {
+      case EViolation::kAllocation: return "allocation";
+      case EViolation::kDeallocation: return "deallocation";
+      case EViolation::kLock: return "lock";
+      case EViolation::kSleep: return "sleep";
+      default: return "";
+    }
+  }
+
+  /** @return \c true if the call site wasn't reported before and there is room to remember it */
+  static bool IsNewCallSite(void* const* frames, int nFrames)
+  {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int i = 0; i < std::min(nFrames, kNCallSiteFrames); i++)
+      hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+
+    hash |= 1; // 0 marks an empty slot
+
+    const int nReported = std::min(sNReportedCallSites.load(std::memory_order_acquire), kMaxReportedCallSites);
+
+    for (int i = 0; i < nReported; i++)
+    {
+      if (sReportedCallSites[i].load(std::memory_order_relaxed) == hash)
+        return false;
+    }
+
+    const int slot = sNReportedCallSites.fetch_add(1, std::memory_order_acq_rel);
+
+    if (slot >= kMaxReportedCallSites)
+      return false;
+
+    sReportedCallSites[slot].store(hash, std::memory_order_relaxed);
+    return true;
+  }
+
+  static void Report(EViolation type)
+  {
+    const uintptr_t state = GetState();
+    SetState(state | kReportingBit); // anything reporting does isn't checked
+
+    sNViolations.fetch_add(1, std::memory_order_relaxed);
+
+    void* frames[kMaxFrames];
+    char line[128];
+
+#if defined OS_WIN
+    const int nFrames = CaptureStackBackTrace(2, kMaxFrames, frames, nullptr);
+
+    if (IsNewCallSite(frames, nFrames))
+    {
+      snprintf(line, sizeof(line), "IPlug realtime violation: %s on the audio thread\n", GetViolationStr(type));
+      OutputDebugStringA(line);
+
+      for (int i = 0; i < nFrames; i++)
+      {
+        snprintf(line, sizeof(line), "  %p\n", frames[i]);
+        OutputDebugStringA(line);
+      }
+#else
+    const int nFrames = backtrace(frames, kMaxFrames);
+
+    if (IsNewCallSite(frames + 1, nFrames - 1)) // skip this function
+    {
+      snprintf(line, sizeof(line), "IPlug realtime violation: %s on the audio thread\n", GetViolationStr(type));
+      const ssize_t written = write(STDERR_FILENO, line, strlen(line));
+      (void) written;
+      backtrace_symbols_fd(frames + 1, nFrames - 1, STDERR_FILENO);
+#endif
+
+      if (sAbortOnViolation.load(std::memory_order_relaxed))
+        abort();
+    }
+
+    SetState(state);
+  }
+
+  static inline std::atomic<int> sNViolations{0};
+  static inline std::atomic<bool> sAbortOnViolation{false};
+  static inline std::atomic<int> sNReportedCallSites{0};
+  static inline std::atomic<uint64_t> sReportedCallSites[kMaxReportedCallSites] = {};
+#else
+  class RealtimeScope
+  {
+  public:
+    RealtimeScope() {}
+  };
+
+  class AllowScope
+  {
+  public:
+    AllowScope() {}
+  };
+
+  static bool IsRealtime() { return false; }
+  static void Check(EViolation type) {}
+  static int GetNViolations() { return 0; }
+  static void SetAbortOnViolation(bool abortOnViolation) {}
+#endif
+};
+
+END_IPLUG_NAMESPACE
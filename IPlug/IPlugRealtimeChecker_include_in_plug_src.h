@@ -0,0 +1,266 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief The interceptors for IRealtimeChecker: replacements for new and delete, and on macOS and Linux for the malloc family, pthread locks and sleeps.
+ * IPlug_include_in_plug_src.h includes this when IPLUG_RTSAFE_CHECKS is defined, so that they are compiled into exactly one translation unit of each plug-in binary
+ */
+
+#include <cerrno>
+#include <new>
+
+#include "IPlugRealtimeChecker.h"
+
+#if defined OS_MAC || defined OS_IOS
+  #include <dlfcn.h>
+  #include <malloc/malloc.h>
+  #define IPLUG_RTSAFE_INTERCEPT_MALLOC
+  #define IPLUG_RTSAFE_INTERCEPT_PTHREAD
+#elif defined OS_LINUX && defined __GLIBC__
+  #include <dlfcn.h>
+  #include <time.h>
+  #define IPLUG_RTSAFE_INTERCEPT_MALLOC
+  #define IPLUG_RTSAFE_INTERCEPT_PTHREAD
+
+  extern "C" void* __libc_malloc(size_t size);
+  extern "C" void* __libc_calloc(size_t n, size_t size);
+  extern "C" void* __libc_realloc(void* ptr, size_t size);
+  extern "C" void* __libc_memalign(size_t alignment, size_t size);
+  extern "C" void __libc_free(void* ptr);
+#endif
+
+namespace iplug_rtsafe
+{
+  using iplug::IRealtimeChecker;
+  using EViolation = IRealtimeChecker::EViolation;
+
+#if defined OS_MAC || defined OS_IOS
+  static void* RawMalloc(size_t size) { return malloc_zone_malloc(malloc_default_zone(), size); }
+  static void* RawCalloc(size_t n, size_t size) { return malloc_zone_calloc(malloc_default_zone(), n, size); }
+  static void* RawAlignedAlloc(size_t alignment, size_t size) { return malloc_zone_memalign(malloc_default_zone(), alignment, size); }
+
+  static void* RawRealloc(void* ptr, size_t size)
+  {
+    malloc_zone_t* pZone = ptr ? malloc_zone_from_ptr(ptr) : nullptr;
+    return malloc_zone_realloc(pZone ? pZone : malloc_default_zone(), ptr, size);
+  }
+
+  static void RawFree(void* ptr)
+  {
+    if (malloc_zone_t* pZone = malloc_zone_from_ptr(ptr))
+      malloc_zone_free(pZone, ptr);
+  }
+
+  static void RawAlignedFree(void* ptr) { RawFree(ptr); }
+#elif defined IPLUG_RTSAFE_INTERCEPT_MALLOC
+  static void* RawMalloc(size_t size) { return __libc_malloc(size); }
+  static void* RawCalloc(size_t n, size_t size) { return __libc_calloc(n, size); }
+  static void* RawRealloc(void* ptr, size_t size) { return __libc_realloc(ptr, size); }
+  static void* RawAlignedAlloc(size_t alignment, size_t size) { return __libc_memalign(alignment, size); }
+  static void RawFree(void* ptr) { __libc_free(ptr); }
+  static void RawAlignedFree(void* ptr) { __libc_free(ptr); }
+#elif defined OS_WIN
+  static void* RawMalloc(size_t size) { return malloc(size); }
+  static void* RawAlignedAlloc(size_t alignment, size_t size) { return _aligned_malloc(size, alignment); }
+  static void RawFree(void* ptr) { free(ptr); }
+  static void RawAlignedFree(void* ptr) { _aligned_free(ptr); }
+#else
+  static void* RawMalloc(size_t size) { return malloc(size); }
+  static void* RawAlignedAlloc(size_t alignment, size_t size) { void* ptr = nullptr; return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr; }
+  static void RawFree(void* ptr) { free(ptr); }
+  static void RawAlignedFree(void* ptr) { free(ptr); }
+#endif
+
+  static void* NewImpl(size_t size)
+  {
+    IRealtimeChecker::Check(EViolation::kAllocation);
+
+    if (void* ptr = RawMalloc(size ? size : 1))
+      return ptr;
+
+    throw std::bad_alloc();
+  }
+
+  static void* AlignedNewImpl(size_t size, std::align_val_t alignment)
+  {
+    IRealtimeChecker::Check(EViolation::kAllocation);
+
+    size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+
+    if (void* ptr = RawAlignedAlloc(align, size ? size : 1))
+      return ptr;
+
+    throw std::bad_alloc();
+  }
+
+  static void DeleteImpl(void* ptr)
+  {
+    if (!ptr)
+      return;
+
+    IRealtimeChecker::Check(EViolation::kDeallocation);
+    RawFree(ptr);
+  }
+
+  static void AlignedDeleteImpl(void* ptr)
+  {
+    if (!ptr)
+      return;
+
+    IRealtimeChecker::Check(EViolation::kDeallocation);
+    RawAlignedFree(ptr);
+  }
+
+#if defined IPLUG_RTSAFE_INTERCEPT_PTHREAD
+  /** Look up the next definition of an intercepted function, i.e. the system's */
+  template <typename F>
+  static F GetNext(std::atomic<void*>& cache, const char* name)
+  {
+    void* pFunc = cache.load(std::memory_order_acquire);
+
+    if (!pFunc)
+    {
+      pFunc = dlsym(RTLD_NEXT, name);
+      cache.store(pFunc, std::memory_order_release);
+    }
+
+    return reinterpret_cast<F>(pFunc);
+  }
+
+  #define IPLUG_RTSAFE_NEXT(func) iplug_rtsafe::GetNext<decltype(&::func)>(iplug_rtsafe::s_##func, #func)
+  static std::atomic<void*> s_pthread_mutex_lock{nullptr};
+  static std::atomic<void*> s_pthread_rwlock_rdlock{nullptr};
+  static std::atomic<void*> s_pthread_rwlock_wrlock{nullptr};
+  static std::atomic<void*> s_pthread_cond_wait{nullptr};
+  static std::atomic<void*> s_sleep{nullptr};
+  static std::atomic<void*> s_usleep{nullptr};
+  static std::atomic<void*> s_nanosleep{nullptr};
+
+  // resolve the system's functions up front, since dlsym() can allocate and lock
+  static struct Resolver
+  {
+    Resolver()
+    {
+      IPLUG_RTSAFE_NEXT(pthread_mutex_lock);
+      IPLUG_RTSAFE_NEXT(pthread_rwlock_rdlock);
+      IPLUG_RTSAFE_NEXT(pthread_rwlock_wrlock);
+      IPLUG_RTSAFE_NEXT(pthread_cond_wait);
+      IPLUG_RTSAFE_NEXT(sleep);
+      IPLUG_RTSAFE_NEXT(usleep);
+      IPLUG_RTSAFE_NEXT(nanosleep);
+    }
+  } sResolver;
+#endif
+} // namespace iplug_rtsafe
+
+void* operator new(size_t size) { return iplug_rtsafe::NewImpl(size); }
+void* operator new[](size_t size) { return iplug_rtsafe::NewImpl(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { try { return iplug_rtsafe::NewImpl(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return iplug_rtsafe::NewImpl(size); } catch (...) { return nullptr; } }
+void* operator new(size_t size, std::align_val_t alignment) { return iplug_rtsafe::AlignedNewImpl(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return iplug_rtsafe::AlignedNewImpl(size, alignment); }
+void operator delete(void* ptr) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete[](void* ptr) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete(void* ptr, size_t) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { iplug_rtsafe::DeleteImpl(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { iplug_rtsafe::AlignedDeleteImpl(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { iplug_rtsafe::AlignedDeleteImpl(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { iplug_rtsafe::AlignedDeleteImpl(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { iplug_rtsafe::AlignedDeleteImpl(ptr); }
+
+extern "C"
+{
+#if defined IPLUG_RTSAFE_INTERCEPT_MALLOC
+  void* malloc(size_t size)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kAllocation);
+    return iplug_rtsafe::RawMalloc(size);
+  }
+
+  void* calloc(size_t n, size_t size)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kAllocation);
+    return iplug_rtsafe::RawCalloc(n, size);
+  }
+
+  void* realloc(void* ptr, size_t size)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kAllocation);
+    return iplug_rtsafe::RawRealloc(ptr, size);
+  }
+
+  int posix_memalign(void** pPtr, size_t alignment, size_t size)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kAllocation);
+    *pPtr = iplug_rtsafe::RawAlignedAlloc(alignment, size);
+    return *pPtr ? 0 : ENOMEM;
+  }
+
+  void free(void* ptr)
+  {
+    if (!ptr)
+      return;
+
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kDeallocation);
+    iplug_rtsafe::RawFree(ptr);
+  }
+#endif
+
+#if defined IPLUG_RTSAFE_INTERCEPT_PTHREAD
+  int pthread_mutex_lock(pthread_mutex_t* pMutex)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kLock);
+    return IPLUG_RTSAFE_NEXT(pthread_mutex_lock)(pMutex);
+  }
+
+  int pthread_rwlock_rdlock(pthread_rwlock_t* pLock)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kLock);
+    return IPLUG_RTSAFE_NEXT(pthread_rwlock_rdlock)(pLock);
+  }
+
+  int pthread_rwlock_wrlock(pthread_rwlock_t* pLock)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kLock);
+    return IPLUG_RTSAFE_NEXT(pthread_rwlock_wrlock)(pLock);
+  }
+
+  int pthread_cond_wait(pthread_cond_t* pCond, pthread_mutex_t* pMutex)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kLock);
+    return IPLUG_RTSAFE_NEXT(pthread_cond_wait)(pCond, pMutex);
+  }
+
+  unsigned int sleep(unsigned int seconds)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kSleep);
+    return IPLUG_RTSAFE_NEXT(sleep)(seconds);
+  }
+
+  int usleep(useconds_t usec)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kSleep);
+    return IPLUG_RTSAFE_NEXT(usleep)(usec);
+  }
+
+  int nanosleep(const struct timespec* pRequest, struct timespec* pRemaining)
+  {
+    iplug::IRealtimeChecker::Check(iplug_rtsafe::EViolation::kSleep);
+    return IPLUG_RTSAFE_NEXT(nanosleep)(pRequest, pRemaining);
+  }
+#endif
+}
+
+#undef IPLUG_RTSAFE_NEXT
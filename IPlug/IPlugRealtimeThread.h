@@ -0,0 +1,166 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IRealtimeThreadScope
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_WIN
+  #include <windows.h>
+#elif defined OS_MAC || defined OS_IOS
+  #include <mach/mach.h>
+  #include <mach/mach_time.h>
+  #include <mach/thread_policy.h>
+  #include <pthread.h>
+  #if __has_include(<os/workgroup.h>)
+    #include <os/workgroup.h>
+    #define IPLUG_AUDIO_WORKGROUPS
+    #if defined __OBJC__ && __has_feature(objc_arc)
+      #define IPLUG_WORKGROUP(ptr) ((__bridge os_workgroup_t) (ptr))
+    #else
+      #define IPLUG_WORKGROUP(ptr) (static_cast<os_workgroup_t>(ptr))
+    #endif
+  #endif
+#elif !defined OS_WEB || defined __EMSCRIPTEN_PTHREADS__
+  #include <pthread.h>
+  #include <sched.h>
+  #define IPLUG_REALTIME_PTHREADS
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Gives the thread it is created on realtime scheduling, and membership of the host's audio workgroup, until it is destroyed. Create one at the top of any thread
+ * a plug-in spawns for DSP, otherwise the thread runs at normal priority, and on Apple silicon it may be put on an efficiency core and miss the audio deadline.
+ * - macOS and iOS: a time constraint policy like Core Audio's own I/O threads, and on macOS 11 and iOS 14 or later os_workgroup_join(), which tells the scheduler
+ *   that the thread works to the same deadline as the host's audio threads
+ * - Windows: registers the thread with MMCSS as "Pro Audio", and reverts it afterwards
+ * - Linux: SCHED_FIFO, where the process has the rights to it
+ *
+ * The workgroup comes from IPlugProcessor::GetAudioWorkgroup(), and can change when the host moves the plug-in to another device, so a long running thread
+ * should pass the latest one to SetWorkgroup() from time to time, e.g. when it wakes for a block */
+class IRealtimeThreadScope final
+{
+public:
+  /** @param pWorkgroup An os_workgroup_t to join, or nullptr
+   * @param periodSeconds How often the thread has work to do, e.g. the block size over the sample rate, which macOS uses for its scheduling constraints */
+  IRealtimeThreadScope(void* pWorkgroup = nullptr, double periodSeconds = 128. / 44100.)
+  {
+#if defined OS_WIN
+    // avrt.dll is loaded on demand, as IPlugAPPHost does, so that plug-ins don't need to link it
+    mAvrt = LoadLibraryA("avrt.dll");
+
+    if (mAvrt)
+    {
+      auto avSetMmThreadCharacteristics = (AvSetMmThreadCharacteristicsFunc) GetProcAddress(mAvrt, "AvSetMmThreadCharacteristicsA");
+      DWORD taskIndex = 0;
+
+      if (avSetMmThreadCharacteristics)
+        mMMCSSHandle = avSetMmThreadCharacteristics("Pro Audio", &taskIndex);
+    }
+#elif defined OS_MAC || defined OS_IOS
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    const double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+    const double period = std::max(periodSeconds, 0.0005);
+
+    thread_time_constraint_policy_data_t policy;
+    policy.period = static_cast<uint32_t>(period * ticksPerSecond);
+    policy.computation = static_cast<uint32_t>(0.5 * period * ticksPerSecond);
+    policy.constraint = static_cast<uint32_t>(period * ticksPerSecond);
+    policy.preemptible = 1;
+    thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, reinterpret_cast<thread_policy_t>(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#elif defined IPLUG_REALTIME_PTHREADS
+    if (pthread_getschedparam(pthread_self(), &mSavedPolicy, &mSavedParam) == 0)
+    {
+      sched_param param {};
+      param.sched_priority = std::max(sched_get_priority_max(SCHED_FIFO) - 10, sched_get_priority_min(SCHED_FIFO));
+      mPromoted = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+#endif
+
+    SetWorkgroup(pWorkgroup);
+  }
+
+  ~IRealtimeThreadScope()
+  {
+    SetWorkgroup(nullptr);
+
+#if defined OS_WIN
+    if (mAvrt)
+    {
+      auto avRevertMmThreadCharacteristics = (AvRevertMmThreadCharacteristicsFunc) GetProcAddress(mAvrt, "AvRevertMmThreadCharacteristics");
+
+      if (mMMCSSHandle && avRevertMmThreadCharacteristics)
+        avRevertMmThreadCharacteristics(mMMCSSHandle);
+
+      FreeLibrary(mAvrt);
+    }
+#elif defined IPLUG_REALTIME_PTHREADS
+    if (mPromoted)
+      pthread_setschedparam(pthread_self(), mSavedPolicy, &mSavedParam);
+#endif
+  }
+
+  IRealtimeThreadScope(const IRealtimeThreadScope&) = delete;
+  IRealtimeThreadScope& operator=(const IRealtimeThreadScope&) = delete;
+
+  /** Leave the current workgroup, if any, and join another. Call it on the thread the scope was created on, which os_workgroup_join() requires.
+   * Does nothing if the workgroup is the current one, or where workgroups aren't available
+   * @param pWorkgroup An os_workgroup_t, or nullptr to just leave. It isn't retained, the API classes keep the current workgroup alive, so a thread should move on soon after it changes */
+  void SetWorkgroup(void* pWorkgroup)
+  {
+#ifdef IPLUG_AUDIO_WORKGROUPS
+    if (pWorkgroup == mpWorkgroup)
+      return;
+
+    if (__builtin_available(macOS 11.0, iOS 14.0, *))
+    {
+      if (mpWorkgroup)
+      {
+        os_workgroup_leave(IPLUG_WORKGROUP(mpWorkgroup), &mJoinToken);
+        mpWorkgroup = nullptr;
+      }
+
+      // a workgroup that has been cancelled, because its device went away, fails to join
+      if (pWorkgroup && os_workgroup_join(IPLUG_WORKGROUP(pWorkgroup), &mJoinToken) == 0)
+        mpWorkgroup = pWorkgroup;
+    }
+#endif
+  }
+
+  /** @return The workgroup the thread has joined, or nullptr */
+  void* GetWorkgroup() const { return mpWorkgroup; }
+
+private:
+  void* mpWorkgroup = nullptr;
+#if defined OS_WIN
+  typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsFunc)(LPCSTR taskName, LPDWORD taskIndex);
+  typedef BOOL (WINAPI *AvRevertMmThreadCharacteristicsFunc)(HANDLE avrtHandle);
+
+  HMODULE mAvrt = nullptr;
+  HANDLE mMMCSSHandle = nullptr;
+#elif defined IPLUG_AUDIO_WORKGROUPS
+  os_workgroup_join_token_s mJoinToken;
+#elif defined IPLUG_REALTIME_PTHREADS
+  int mSavedPolicy = 0;
+  sched_param mSavedParam {};
+  bool mPromoted = false;
+#endif
+};
+
+END_IPLUG_NAMESPACE
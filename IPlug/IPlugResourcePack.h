@@ -0,0 +1,457 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IResourcePack
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugLogger.h"
+#include "wdlendian.h"
+#include "ptrlist.h"
+
+#ifdef IPLUG_ZLIB_RESOURCES
+#include "zlib/zlib.h"
+#endif
+
+#ifdef OS_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A single blob holding many resources (bitmaps, SVGs, fonts...), with a hashed name table, so that a UI with hundreds of images finds each one
+ * with a lookup in memory rather than a search of the bundle or the binary's resources and a file open.
+ * A pack is made by Scripts/bin2c.py --pack, either as a C array that is compiled into the binary or as a file that is memory mapped.
+ * Entries that are stored uncompressed are returned as pointers into the pack, without copying. Entries compressed with zlib are inflated the first
+ * time they are asked for and kept until the pack is closed, which needs iPlug to be built with IPLUG_ZLIB_RESOURCES defined and WDL/zlib linked.
+ *
+ * Register() a pack, for instance in the plug-in constructor, and IGraphics::LoadBitmap(), LoadSVG(), LoadFont() and LoadResource() look for
+ * resources in it by their file name, case-insensitively, before they use LocateResource(). A registered pack must stay open while any IGraphics can load from it.
+ *
+ * The layout, all little-endian uint32s: a header of magic, version, number of entries, then the entries sorted by name hash, each a name hash,
+ * name offset, name length, data offset, stored size, size and compression, then the names and the 16-byte aligned data. Offsets are from the start of the pack */
+class IResourcePack final
+{
+public:
+  enum ECompression
+  {
+    kNoCompression = 0,
+    kZlibCompression
+  };
+
+  static constexpr uint32_t kMagic = 0x4B505249; // "IRPK"
+  static constexpr uint32_t kVersion = 1;
+
+  IResourcePack() = default;
+  ~IResourcePack() { Close(); }
+
+  IResourcePack(const IResourcePack&) = delete;
+  IResourcePack& operator=(const IResourcePack&) = delete;
+
+  /** Open a pack in memory, e.g. the array that bin2c.py generates. The data isn't copied, so it must outlive the pack
+   * @return \c true if the data is a valid pack */
+  bool Open(const void* pData, int size)
+  {
+    Close();
+
+    if (!Validate(static_cast<const uint8_t*>(pData), size))
+      return false;
+
+    mData = static_cast<const uint8_t*>(pData);
+    mSize = size;
+    mInflated.resize(NEntries());
+    return true;
+  }
+
+  /** Memory map a pack file, which is paged in as entries are read rather than read at once
+   * @return \c true if the file could be mapped and is a valid pack */
+  bool OpenFile(const char* path)
+  {
+    Close();
+
+    const void* pMapped = nullptr;
+    int size = 0;
+
+#ifdef OS_WIN
+    wchar_t pathWide[MAX_PATH * 4];
+
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, pathWide, MAX_PATH * 4))
+      return false;
+
+    HANDLE hFile = CreateFileW(pathWide, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+      return false;
+
+    LARGE_INTEGER fileSize;
+
+    if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0 && fileSize.QuadPart < INT32_MAX)
+    {
+      if (HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr))
+      {
+        pMapped = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMapping); // the view keeps the mapping
+        size = static_cast<int>(fileSize.QuadPart);
+      }
+    }
+
+    CloseHandle(hFile);
+#else
+    const int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size < INT32_MAX)
+    {
+      void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (p != MAP_FAILED)
+      {
+        pMapped = p;
+        size = static_cast<int>(st.st_size);
+      }
+    }
+
+    close(fd); // the mapping keeps the file
+#endif
+
+    if (!pMapped)
+      return false;
+
+    if (!Open(pMapped, size))
+    {
+      UnmapView(pMapped, size);
+      return false;
+    }
+
+    mMapped = pMapped;
+    mMappedSize = size;
+    return true;
+  }
+
+  /** Close the pack, freeing any inflated entries and unmapping a file. Unregister() it first if it is registered */
+  void Close()
+  {
+    mData = nullptr;
+    mSize = 0;
+    mInflated.clear();
+    Unmap();
+  }
+
+  /** @return \c true if the pack is open */
+  bool IsOpen() const { return mData != nullptr; }
+
+  /** @return The number of entries */
+  int NEntries() const { return mData ? static_cast<int>(ReadU32(mData + 8)) : 0; }
+
+  /** @return The name of an entry, which is not null-terminated, see GetNameLength() */
+  const char* GetName(int idx) const { return reinterpret_cast<const char*>(mData + EntryField(idx, kNameOffset)); }
+
+  /** @return The length of an entry's name */
+  int GetNameLength(int idx) const { return static_cast<int>(EntryField(idx, kNameLength)); }
+
+  /** @param name A file name, or a path, looked up case-insensitively. A path is looked up whole first, for packs made with bin2c.py --pack-paths, then by its file name
+   * @return The index of the entry, or -1 if the pack doesn't have it */
+  int Find(const char* name) const
+  {
+    if (!mData || !name)
+      return -1;
+
+    while (*name == '/')
+      name++;
+
+    const char* fileName = FilePart(name);
+
+    if (fileName != name)
+    {
+      const int idx = FindName(name);
+
+      if (idx >= 0)
+        return idx;
+    }
+
+    return FindName(fileName);
+  }
+
+  /** @return \c true if the pack has an entry for name */
+  bool Contains(const char* name) const { return Find(name) >= 0; }
+
+  /** Get an entry's data. Can be called on any thread
+   * @param name A file name or a path, see Find()
+   * @param size Set to the size of the data
+   * @return The data, which stays valid until the pack is closed, or nullptr if the pack doesn't have the entry or can't inflate it */
+  const uint8_t* Get(const char* name, int& size)
+  {
+    size = 0;
+    const int idx = Find(name);
+
+    if (idx < 0)
+      return nullptr;
+
+    const uint8_t* pStored = mData + EntryField(idx, kDataOffset);
+    const uint32_t dataSize = EntryField(idx, kSize);
+
+    if (EntryField(idx, kCompression) == kNoCompression)
+    {
+      size = static_cast<int>(dataSize);
+      return pStored;
+    }
+
+#ifdef IPLUG_ZLIB_RESOURCES
+    const uint32_t storedSize = EntryField(idx, kStoredSize);
+    std::lock_guard<std::mutex> lock(mInflateMutex);
+    std::unique_ptr<uint8_t[]>& pInflated = mInflated[idx];
+
+    if (!pInflated)
+    {
+      std::unique_ptr<uint8_t[]> pData(new uint8_t[dataSize]);
+      uLongf inflatedSize = static_cast<uLongf>(dataSize);
+
+      if (EntryField(idx, kCompression) != kZlibCompression
+          || uncompress(pData.get(), &inflatedSize, pStored, static_cast<uLong>(storedSize)) != Z_OK || inflatedSize != dataSize)
+        return nullptr;
+
+      pInflated = std::move(pData);
+    }
+
+    size = static_cast<int>(dataSize);
+    return pInflated.get();
+#else
+    DBGMSG("compressed resource packs need IPLUG_ZLIB_RESOURCES\n");
+    return nullptr;
+#endif
+  }
+
+#pragma mark - The registered packs
+
+  /** Register a pack for IGraphics to load resources from. Packs are searched in the order they were registered */
+  static void Register(IResourcePack* pPack)
+  {
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+
+    if (GetRegistry().Find(pPack) < 0)
+      GetRegistry().Add(pPack);
+  }
+
+  /** Stop IGraphics loading resources from a pack */
+  static void Unregister(IResourcePack* pPack)
+  {
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+    GetRegistry().DeletePtr(pPack);
+  }
+
+  /** @return \c true if a registered pack has an entry for name */
+  static bool ContainsRegistered(const char* name)
+  {
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+
+    for (auto i = 0; i < GetRegistry().GetSize(); i++)
+    {
+      if (GetRegistry().Get(i)->Contains(name))
+        return true;
+    }
+
+    return false;
+  }
+
+  /** Get an entry's data from the first registered pack that has it, see Get() */
+  static const uint8_t* GetRegistered(const char* name, int& size)
+  {
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+    size = 0;
+
+    for (auto i = 0; i < GetRegistry().GetSize(); i++)
+    {
+      if (GetRegistry().Get(i)->Contains(name))
+        return GetRegistry().Get(i)->Get(name, size);
+    }
+
+    return nullptr;
+  }
+
+  /** The hash of the name table, FNV-1a of the lower case name. Scripts/bin2c.py must hash names the same way */
+  static uint32_t Hash(const char* name)
+  {
+    uint32_t hash = 2166136261u;
+
+    for (const char* p = name; *p; p++)
+    {
+      hash ^= static_cast<uint8_t>(ToLower(*p));
+      hash *= 16777619u;
+    }
+
+    return hash;
+  }
+
+private:
+  enum EEntryField
+  {
+    kHash = 0,
+    kNameOffset,
+    kNameLength,
+    kDataOffset,
+    kStoredSize,
+    kSize,
+    kCompression,
+    kNumEntryFields
+  };
+
+  static constexpr int kHeaderSize = 12;
+  static constexpr int kEntrySize = kNumEntryFields * 4;
+
+  static uint32_t ReadU32(const uint8_t* p)
+  {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return WDL_bswap32_if_be(v);
+  }
+
+  uint32_t EntryField(int idx, EEntryField field) const
+  {
+    return ReadU32(mData + kHeaderSize + idx * kEntrySize + field * 4);
+  }
+
+  static char ToLower(char c) { return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c; }
+
+  static bool NamesMatch(const char* a, const char* b, int len)
+  {
+    for (int i = 0; i < len; i++)
+    {
+      if (ToLower(a[i]) != ToLower(b[i]))
+        return false;
+    }
+
+    return true;
+  }
+
+  int FindName(const char* name) const
+  {
+    const uint32_t hash = Hash(name);
+    const int len = static_cast<int>(strlen(name));
+
+    // the entries are sorted by hash, find the first with this hash, then compare the names of the (almost always one) entries that have it
+    int lo = 0, hi = NEntries();
+
+    while (lo < hi)
+    {
+      const int mid = (lo + hi) / 2;
+
+      if (EntryField(mid, kHash) < hash)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    for (int i = lo; i < NEntries() && EntryField(i, kHash) == hash; i++)
+    {
+      if (GetNameLength(i) == len && NamesMatch(GetName(i), name, len))
+        return i;
+    }
+
+    return -1;
+  }
+
+  static const char* FilePart(const char* path)
+  {
+    const char* p = path + strlen(path);
+
+    while (p > path && p[-1] != '/' && p[-1] != '\\')
+      p--;
+
+    return p;
+  }
+
+  /** Check the header and that every entry lies inside the data, so Get() doesn't need to */
+  static bool Validate(const uint8_t* pData, int size)
+  {
+    if (!pData || size < kHeaderSize || ReadU32(pData) != kMagic || ReadU32(pData + 4) != kVersion)
+      return false;
+
+    const uint32_t nEntries = ReadU32(pData + 8);
+
+    if (nEntries > static_cast<uint32_t>((size - kHeaderSize) / kEntrySize))
+      return false;
+
+    for (uint32_t i = 0; i < nEntries; i++)
+    {
+      const uint8_t* pEntry = pData + kHeaderSize + i * kEntrySize;
+      const uint64_t nameEnd = static_cast<uint64_t>(ReadU32(pEntry + kNameOffset * 4)) + ReadU32(pEntry + kNameLength * 4);
+      const uint64_t dataEnd = static_cast<uint64_t>(ReadU32(pEntry + kDataOffset * 4)) + ReadU32(pEntry + kStoredSize * 4);
+
+      if (nameEnd > static_cast<uint64_t>(size) || dataEnd > static_cast<uint64_t>(size))
+        return false;
+
+      if (ReadU32(pEntry + kCompression * 4) == kNoCompression && ReadU32(pEntry + kStoredSize * 4) != ReadU32(pEntry + kSize * 4))
+        return false;
+
+      if (i > 0 && ReadU32(pEntry) < ReadU32(pEntry - kEntrySize))
+        return false;
+    }
+
+    return true;
+  }
+
+  static void UnmapView(const void* pMapped, int size)
+  {
+#ifdef OS_WIN
+    UnmapViewOfFile(pMapped);
+#else
+    munmap(const_cast<void*>(pMapped), static_cast<size_t>(size));
+#endif
+  }
+
+  void Unmap()
+  {
+    if (mMapped)
+      UnmapView(mMapped, mMappedSize);
+
+    mMapped = nullptr;
+    mMappedSize = 0;
+  }
+
+  static std::mutex& GetRegistryMutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static WDL_PtrList<IResourcePack>& GetRegistry()
+  {
+    static WDL_PtrList<IResourcePack> sPacks;
+    return sPacks;
+  }
+
+  const uint8_t* mData = nullptr;
+  int mSize = 0;
+  const void* mMapped = nullptr; // set if OpenFile() mapped the data
+  int mMappedSize = 0;
+  std::vector<std::unique_ptr<uint8_t[]>> mInflated; // by entry, the compressed entries that have been asked for
+  std::mutex mInflateMutex;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,144 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ResourcePathCache
+ */
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "IPlugPlatform.h"
+#include "dirscan.h"
+#include "wdlstring.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A process-wide cache of the resources LocateResource() can find in a bundle, so that looking one up is a hash map hit rather than building paths and checking the file system for each candidate.
+ * Each set of resources is identified by a key, e.g. a bundle ID and sub folder, and filled the first time that key is looked up, typically by scanning the bundle's resource folders once with ScanDirectory().
+ * A bundle's contents don't change while it is loaded. Call Clear() if a plug-in writes resources where LocateResource() looks for them */
+class ResourcePathCache final
+{
+public:
+  /** Maps a resource name to the result LocateResource() returns for it */
+  using Entries = std::unordered_map<std::string, std::string>;
+
+  /** Look up a resource, filling the key's entries on first use. Can be called on any thread
+   * @param key Identifies the set of resources, e.g. the bundle ID and sub folder
+   * @param fill Called once, on first use of key, to add all of the resources in the set
+   * @param name The name to look up, which must be folded the same way fill() folds names
+   * @param result Set to the entry's value if found
+   * @return \c true if the set has the name */
+  static bool Find(const std::string& key, const std::function<void(Entries&)>& fill, const std::string& name, WDL_String& result)
+  {
+    std::lock_guard<std::mutex> lock(GetMutex());
+    auto& sets = GetSets();
+    auto itr = sets.find(key);
+
+    if (itr == sets.end())
+    {
+      itr = sets.emplace(key, Entries()).first;
+      fill(itr->second);
+    }
+
+    auto entry = itr->second.find(name);
+
+    if (entry == itr->second.end())
+      return false;
+
+    result.Set(entry->second.c_str());
+    return true;
+  }
+
+  /** Add the files in a directory to a set of entries, with their paths relative to dir as names and their full paths as values. Files already in the set are kept, so scan directories in priority order
+   * @param dir The directory, with or without a trailing slash
+   * @param entries The set to add files to
+   * @param foldCase Lower case the names, for a case-insensitive file system
+   * @param maxDepth How many levels of sub folders to scan */
+  static void ScanDirectory(const char* dir, Entries& entries, bool foldCase, int maxDepth = 0)
+  {
+    std::string dirStr(dir);
+
+    if (!dirStr.empty() && dirStr.back() != '/' && dirStr.back() != '\\')
+      dirStr += '/';
+
+    ScanDirectory(dirStr, std::string(), entries, foldCase, maxDepth);
+  }
+
+  /** Fold a name as ScanDirectory() does */
+  static std::string FoldName(const char* name, bool foldCase)
+  {
+    std::string folded(name);
+
+    for (auto& c : folded)
+    {
+      if (c == '\\')
+        c = '/';
+      else if (foldCase && c >= 'A' && c <= 'Z')
+        c = c - 'A' + 'a';
+    }
+
+    return folded;
+  }
+
+  /** Forget every set, so that each is filled again when it is next looked up */
+  static void Clear()
+  {
+    std::lock_guard<std::mutex> lock(GetMutex());
+    GetSets().clear();
+  }
+
+private:
+  static void ScanDirectory(const std::string& dir, const std::string& prefix, Entries& entries, bool foldCase, int depth)
+  {
+    WDL_DirScan scan;
+
+    if (scan.First((dir + prefix).c_str()))
+      return;
+
+    do
+    {
+      const char* fileName = scan.GetCurrentFN();
+
+      if (fileName[0] == '.')
+        continue;
+
+      const std::string relPath = prefix + fileName;
+
+      if (scan.GetCurrentIsDirectory())
+      {
+        if (depth > 0)
+          ScanDirectory(dir, relPath + "/", entries, foldCase, depth - 1);
+      }
+      else
+        entries.emplace(FoldName(relPath.c_str(), foldCase), dir + relPath);
+    }
+    while (!scan.Next());
+  }
+
+  static std::mutex& GetMutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static std::unordered_map<std::string, Entries>& GetSets()
+  {
+    static std::unordered_map<std::string, Entries> sSets;
+    return sSets;
+  }
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,209 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IRunLoop
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+#if defined OS_LINUX
+  #include <poll.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The UI thread's event loop, for platforms where the UI doesn't get one from the OS, i.e. Linux, where each plug-in window has its own X connection.
+ * The UI registers the connection's file descriptor and its display timer, and is called back when there are events or the timer is due, so it doesn't
+ * need to poll. A host that has a loop of its own, e.g. a VST3 host's Steinberg::Linux::IRunLoop, gives the plug-in an adapter to it via
+ * IEditorDelegate::SetHostRunLoop(), otherwise IPollRunLoop can be run by an app */
+class IRunLoop
+{
+public:
+  using Callback = void(*)(void* pContext);
+
+  virtual ~IRunLoop() {}
+
+  /** Call func on the loop's thread whenever fd is readable. An fd can only be registered once
+   * @return \c true if the loop accepted it */
+  virtual bool AddFD(int fd, Callback func, void* pContext) = 0;
+
+  virtual void RemoveFD(int fd) = 0;
+
+  /** Call func on the loop's thread every intervalMS, until RemoveTimer()
+   * @return An id for RemoveTimer(), or 0 if the loop refused it */
+  virtual int AddTimer(int intervalMS, Callback func, void* pContext) = 0;
+
+  virtual void RemoveTimer(int timerID) = 0;
+};
+
+#if defined OS_LINUX
+
+/** An IRunLoop the app runs itself, blocking in poll() until the next file descriptor is readable or the next timer is due, so an idle loop doesn't wake */
+class IPollRunLoop final : public IRunLoop
+{
+public:
+  /** @return The loop for windows and timers whose host doesn't have one, e.g. an app's, which it runs with Run() until the last window is closed */
+  static IPollRunLoop& GetDefault()
+  {
+    static IPollRunLoop sRunLoop;
+    return sRunLoop;
+  }
+
+  bool AddFD(int fd, Callback func, void* pContext) override
+  {
+    return AddFD(fd, func, pContext, false);
+  }
+
+  /** Add a file descriptor that doesn't keep Run() running, e.g. the timerfd a Timer falls back to
+   * @return \c true if the loop accepted it */
+  bool AddBackgroundFD(int fd, Callback func, void* pContext)
+  {
+    return AddFD(fd, func, pContext, true);
+  }
+
+  void RemoveFD(int fd) override
+  {
+    mFDs.erase(std::remove_if(mFDs.begin(), mFDs.end(), [fd](const FD& f) { return f.mFD == fd; }), mFDs.end());
+  }
+
+  int AddTimer(int intervalMS, Callback func, void* pContext) override
+  {
+    const auto interval = std::chrono::milliseconds(std::max(intervalMS, 1));
+    mTimers.push_back({++mLastTimerID, interval, Clock::now() + interval, func, pContext});
+    return mLastTimerID;
+  }
+
+  void RemoveTimer(int timerID) override
+  {
+    mTimers.erase(std::remove_if(mTimers.begin(), mTimers.end(), [timerID](const TimerEntry& t) { return t.mID == timerID; }), mTimers.end());
+  }
+
+  /** Wait for, then dispatch, the file descriptors that are readable and the timers that are due
+   * @param maxWaitMS The longest to wait if nothing is due, or -1 to wait for as long as it takes */
+  void Dispatch(int maxWaitMS = -1)
+  {
+    int timeout = maxWaitMS;
+    const auto now = Clock::now();
+
+    for (auto& t : mTimers)
+    {
+      const int due = static_cast<int>(std::max<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(t.mNext - now).count(), 0));
+      timeout = timeout < 0 ? due : std::min(timeout, due);
+    }
+
+    mPollFDs.resize(mFDs.size());
+
+    for (size_t i = 0; i < mFDs.size(); i++)
+      mPollFDs[i] = { mFDs[i].mFD, POLLIN, 0 };
+
+    if (poll(mPollFDs.data(), static_cast<nfds_t>(mPollFDs.size()), timeout) > 0)
+    {
+      for (auto& p : mPollFDs)
+      {
+        if (p.revents)
+          DispatchFD(p.fd);
+      }
+    }
+
+    DispatchTimers();
+  }
+
+  /** Dispatch until Stop(), or until only background file descriptors are left */
+  void Run()
+  {
+    mRunning = true;
+
+    while (mRunning && (mTimers.size() || std::any_of(mFDs.begin(), mFDs.end(), [](const FD& f) { return !f.mBackground; })))
+      Dispatch();
+  }
+
+  void Stop() { mRunning = false; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct FD
+  {
+    int mFD;
+    Callback mFunc;
+    void* mContext;
+    bool mBackground;
+  };
+
+  bool AddFD(int fd, Callback func, void* pContext, bool background)
+  {
+    if (std::any_of(mFDs.begin(), mFDs.end(), [fd](const FD& f) { return f.mFD == fd; }))
+      return false;
+
+    mFDs.push_back({fd, func, pContext, background});
+    return true;
+  }
+
+  struct TimerEntry
+  {
+    int mID;
+    Clock::duration mInterval;
+    Clock::time_point mNext;
+    Callback mFunc;
+    void* mContext;
+  };
+
+  // the callbacks may add or remove entries, so these look them up again rather than iterating
+  void DispatchFD(int fd)
+  {
+    auto it = std::find_if(mFDs.begin(), mFDs.end(), [fd](const FD& f) { return f.mFD == fd; });
+
+    if (it != mFDs.end())
+      it->mFunc(it->mContext);
+  }
+
+  void DispatchTimers()
+  {
+    const auto now = Clock::now();
+    mDueTimers.clear();
+
+    for (auto& t : mTimers)
+    {
+      if (t.mNext <= now)
+      {
+        // scheduled from when it was due, so it doesn't drift, but without a burst to catch up after a stall
+        t.mNext = std::max(t.mNext + t.mInterval, now);
+        mDueTimers.push_back(t.mID);
+      }
+    }
+
+    for (auto id : mDueTimers)
+    {
+      auto it = std::find_if(mTimers.begin(), mTimers.end(), [id](const TimerEntry& t) { return t.mID == id; });
+
+      if (it != mTimers.end())
+        it->mFunc(it->mContext);
+    }
+  }
+
+  std::vector<FD> mFDs;
+  std::vector<TimerEntry> mTimers;
+  std::vector<pollfd> mPollFDs;
+  std::vector<int> mDueTimers;
+  int mLastTimerID = 0;
+  bool mRunning = false;
+};
+
+#endif
+
+END_IPLUG_NAMESPACE
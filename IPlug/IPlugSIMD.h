@@ -0,0 +1,1186 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Vectorized buffer kernels (copy/convert, accumulate, zero) used by IPlugProcessor to move audio between host and plug-in buffers, a min/max reduction used by IGraphics to decimate plotted data, a peak reduction used by IPlugProcessor to detect silence, peak and sum reductions used by the meter senders, and a multiply-add-clip used by IParam to convert blocks of values.
+ * The SSE2/AVX/NEON variant is chosen once at runtime by CPU feature detection. GetCPUFeatures() and SIMDDispatch let DSP code register its own per instruction set kernels the same way. WebAssembly builds use the SIMD128 variant when compiled with -msimd128 (see common-web.mk).
+ */
+
+#include <cstring>
+
+#include "IPlugPlatform.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+  #define IPLUG_SIMD_SSE2
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #define IPLUG_SIMD_AVX
+    #define IPLUG_SIMD_TARGET_AVX
+    #define IPLUG_SIMD_TARGET_AVX2
+    #define IPLUG_SIMD_TARGET_AVX512
+  #elif defined(__GNUC__) || defined(__clang__)
+    #include <cpuid.h>
+    #define IPLUG_SIMD_AVX
+    #define IPLUG_SIMD_TARGET_AVX __attribute__((target("avx")))
+    #define IPLUG_SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #define IPLUG_SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+  #endif
+#elif defined(__ARM_NEON) && defined(__aarch64__) || defined(_M_ARM64)
+  #define IPLUG_SIMD_NEON
+  #include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+  #define IPLUG_SIMD_WASM
+  #include <wasm_simd128.h>
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Instruction set used by the IPlugSIMD kernels */
+enum class ESIMDLevel
+{
+  kScalar = 0,
+  kSSE2,
+  kAVX,
+  kNEON,
+  kWASM
+};
+
+namespace simd {
+
+#pragma mark - Scalar kernels
+
+template <typename DEST, typename SRC>
+void ConvertScalar(DEST* pDest, const SRC* pSrc, int n)
+{
+  for (int i = 0; i < n; i++)
+    pDest[i] = (DEST) pSrc[i];
+}
+
+template <typename DEST, typename SRC>
+void AccumulateScalar(DEST* pDest, const SRC* pSrc, int n)
+{
+  for (int i = 0; i < n; i++)
+    pDest[i] += (DEST) pSrc[i];
+}
+
+inline void MinMaxScalar(const float* pSrc, int n, float* pMin, float* pMax)
+{
+  float min = *pMin;
+  float max = *pMax;
+
+  for (int i = 0; i < n; i++)
+  {
+    min = pSrc[i] < min ? pSrc[i] : min;
+    max = pSrc[i] > max ? pSrc[i] : max;
+  }
+
+  *pMin = min;
+  *pMax = max;
+}
+
+inline void MultiplyAddClipScalar(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi)
+{
+  for (int i = 0; i < n; i++)
+  {
+    const double v = pSrc[i] * mul + add;
+    pDest[i] = v < lo ? lo : (v > hi ? hi : v);
+  }
+}
+
+template <typename T>
+T PeakScalar(const T* pSrc, int n, T peak)
+{
+  for (int i = 0; i < n; i++)
+  {
+    const T v = pSrc[i] < 0 ? -pSrc[i] : pSrc[i];
+    peak = v > peak ? v : peak;
+  }
+
+  return peak;
+}
+
+template <typename T>
+inline void MultiplyAccumulateScalar(T* pDest, const T* pSrc, int n, T gain, T step)
+{
+  for (int i = 0; i < n; i++)
+    pDest[i] += pSrc[i] * (gain + step * static_cast<T>(i));
+}
+
+template <typename T, bool SQUARES>
+inline void PeakSumScalar(const T* pSrc, int n, T* pPeak, T* pSum)
+{
+  T peak = *pPeak;
+  T sum = *pSum;
+
+  for (int i = 0; i < n; i++)
+  {
+    const T v = pSrc[i] < 0 ? -pSrc[i] : pSrc[i];
+    peak = v > peak ? v : peak;
+    sum += SQUARES ? v * v : v;
+  }
+
+  *pPeak = peak;
+  *pSum = sum;
+}
+
+#pragma mark - SSE2 kernels
+
+#ifdef IPLUG_SIMD_SSE2
+inline void ConvertSSE2(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 v = _mm_loadu_ps(pSrc + i);
+    _mm_storeu_pd(pDest + i, _mm_cvtps_pd(v));
+    _mm_storeu_pd(pDest + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void ConvertSSE2(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i));
+    const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i + 2));
+    _mm_storeu_ps(pDest + i, _mm_movelh_ps(lo, hi));
+  }
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateSSE2(float* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_loadu_ps(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateSSE2(double* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(pDest + i, _mm_add_pd(_mm_loadu_pd(pDest + i), _mm_loadu_pd(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateSSE2(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 v = _mm_loadu_ps(pSrc + i);
+    _mm_storeu_pd(pDest + i, _mm_add_pd(_mm_loadu_pd(pDest + i), _mm_cvtps_pd(v)));
+    _mm_storeu_pd(pDest + i + 2, _mm_add_pd(_mm_loadu_pd(pDest + i + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v))));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateSSE2(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i));
+    const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(pSrc + i + 2));
+    _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_movelh_ps(lo, hi)));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void MinMaxSSE2(const float* pSrc, int n, float* pMin, float* pMax)
+{
+  int i = 0;
+  if (n >= 4)
+  {
+    __m128 vMin = _mm_loadu_ps(pSrc);
+    __m128 vMax = vMin;
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+      const __m128 v = _mm_loadu_ps(pSrc + i);
+      vMin = _mm_min_ps(vMin, v);
+      vMax = _mm_max_ps(vMax, v);
+    }
+    float lanes[8];
+    _mm_storeu_ps(lanes, vMin);
+    _mm_storeu_ps(lanes + 4, vMax);
+    MinMaxScalar(lanes, 8, pMin, pMax);
+  }
+  MinMaxScalar(pSrc + i, n - i, pMin, pMax);
+}
+
+inline void MultiplyAddClipSSE2(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi)
+{
+  const __m128d vMul = _mm_set1_pd(mul), vAdd = _mm_set1_pd(add), vLo = _mm_set1_pd(lo), vHi = _mm_set1_pd(hi);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_pd(pDest + i, _mm_min_pd(_mm_max_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(pSrc + i), vMul), vAdd), vLo), vHi));
+  MultiplyAddClipScalar(pDest + i, pSrc + i, n - i, mul, add, lo, hi);
+}
+
+inline float PeakSSE2(const float* pSrc, int n)
+{
+  const __m128 vAbs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 vPeak = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vPeak = _mm_max_ps(vPeak, _mm_and_ps(_mm_loadu_ps(pSrc + i), vAbs));
+  vPeak = _mm_max_ps(vPeak, _mm_movehl_ps(vPeak, vPeak));
+  vPeak = _mm_max_ss(vPeak, _mm_shuffle_ps(vPeak, vPeak, 1));
+  return PeakScalar(pSrc + i, n - i, _mm_cvtss_f32(vPeak));
+}
+
+inline double PeakSSE2(const double* pSrc, int n)
+{
+  const __m128d vAbs = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+  __m128d vPeak = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vPeak = _mm_max_pd(vPeak, _mm_and_pd(_mm_loadu_pd(pSrc + i), vAbs));
+  vPeak = _mm_max_sd(vPeak, _mm_unpackhi_pd(vPeak, vPeak));
+  return PeakScalar(pSrc + i, n - i, _mm_cvtsd_f64(vPeak));
+}
+
+template <bool SQUARES>
+inline void PeakSumSSE2(const float* pSrc, int n, float* pPeak, float* pSum)
+{
+  const __m128 vAbs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 vPeak = _mm_setzero_ps();
+  __m128 vSum = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 v = _mm_and_ps(_mm_loadu_ps(pSrc + i), vAbs);
+    vPeak = _mm_max_ps(vPeak, v);
+    vSum = _mm_add_ps(vSum, SQUARES ? _mm_mul_ps(v, v) : v);
+  }
+  float lanes[8];
+  _mm_storeu_ps(lanes, vPeak);
+  _mm_storeu_ps(lanes + 4, vSum);
+  *pPeak = PeakScalar(lanes, 4, *pPeak);
+  *pSum += (lanes[4] + lanes[5]) + (lanes[6] + lanes[7]);
+  PeakSumScalar<float, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+template <bool SQUARES>
+inline void PeakSumSSE2(const double* pSrc, int n, double* pPeak, double* pSum)
+{
+  const __m128d vAbs = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+  __m128d vPeak = _mm_setzero_pd();
+  __m128d vSum = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const __m128d v = _mm_and_pd(_mm_loadu_pd(pSrc + i), vAbs);
+    vPeak = _mm_max_pd(vPeak, v);
+    vSum = _mm_add_pd(vSum, SQUARES ? _mm_mul_pd(v, v) : v);
+  }
+  double lanes[4];
+  _mm_storeu_pd(lanes, vPeak);
+  _mm_storeu_pd(lanes + 2, vSum);
+  *pPeak = PeakScalar(lanes, 2, *pPeak);
+  *pSum += lanes[2] + lanes[3];
+  PeakSumScalar<double, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+// the gain of each vector is recomputed from its index rather than accumulated, so that long ramps don't drift
+inline void MultiplyAccumulateSSE2(float* pDest, const float* pSrc, int n, float gain, float step)
+{
+  const __m128 vLanes = _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0.f, 1.f, 2.f, 3.f));
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 vGain = _mm_add_ps(_mm_set1_ps(gain + step * i), vLanes);
+    _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_mul_ps(_mm_loadu_ps(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+
+inline void MultiplyAccumulateSSE2(double* pDest, const double* pSrc, int n, double gain, double step)
+{
+  const __m128d vLanes = _mm_setr_pd(0., step);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const __m128d vGain = _mm_add_pd(_mm_set1_pd(gain + step * i), vLanes);
+    _mm_storeu_pd(pDest + i, _mm_add_pd(_mm_loadu_pd(pDest + i), _mm_mul_pd(_mm_loadu_pd(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+#endif
+
+#pragma mark - AVX kernels
+
+#ifdef IPLUG_SIMD_AVX
+IPLUG_SIMD_TARGET_AVX inline void ConvertAVX(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(pDest + i, _mm256_cvtps_pd(_mm_loadu_ps(pSrc + i)));
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void ConvertAVX(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(pDest + i, _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i)));
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void AccumulateAVX(float* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(pDest + i, _mm256_add_ps(_mm256_loadu_ps(pDest + i), _mm256_loadu_ps(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void AccumulateAVX(double* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(pDest + i, _mm256_add_pd(_mm256_loadu_pd(pDest + i), _mm256_loadu_pd(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void AccumulateAVX(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(pDest + i, _mm256_add_pd(_mm256_loadu_pd(pDest + i), _mm256_cvtps_pd(_mm_loadu_ps(pSrc + i))));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void AccumulateAVX(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm256_cvtpd_ps(_mm256_loadu_pd(pSrc + i))));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void MinMaxAVX(const float* pSrc, int n, float* pMin, float* pMax)
+{
+  int i = 0;
+  if (n >= 8)
+  {
+    __m256 vMin = _mm256_loadu_ps(pSrc);
+    __m256 vMax = vMin;
+    for (i = 8; i + 8 <= n; i += 8)
+    {
+      const __m256 v = _mm256_loadu_ps(pSrc + i);
+      vMin = _mm256_min_ps(vMin, v);
+      vMax = _mm256_max_ps(vMax, v);
+    }
+    float lanes[16];
+    _mm256_storeu_ps(lanes, vMin);
+    _mm256_storeu_ps(lanes + 8, vMax);
+    MinMaxScalar(lanes, 16, pMin, pMax);
+  }
+  MinMaxScalar(pSrc + i, n - i, pMin, pMax);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void MultiplyAddClipAVX(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi)
+{
+  const __m256d vMul = _mm256_set1_pd(mul), vAdd = _mm256_set1_pd(add), vLo = _mm256_set1_pd(lo), vHi = _mm256_set1_pd(hi);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(pDest + i, _mm256_min_pd(_mm256_max_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(pSrc + i), vMul), vAdd), vLo), vHi));
+  MultiplyAddClipScalar(pDest + i, pSrc + i, n - i, mul, add, lo, hi);
+}
+
+IPLUG_SIMD_TARGET_AVX inline float PeakAVX(const float* pSrc, int n)
+{
+  const __m256 vAbs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 vPeak = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    vPeak = _mm256_max_ps(vPeak, _mm256_and_ps(_mm256_loadu_ps(pSrc + i), vAbs));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, vPeak);
+  return PeakScalar(pSrc + i, n - i, PeakScalar(lanes, 8, 0.f));
+}
+
+IPLUG_SIMD_TARGET_AVX inline double PeakAVX(const double* pSrc, int n)
+{
+  const __m256d vAbs = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+  __m256d vPeak = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vPeak = _mm256_max_pd(vPeak, _mm256_and_pd(_mm256_loadu_pd(pSrc + i), vAbs));
+  double lanes[4];
+  _mm256_storeu_pd(lanes, vPeak);
+  return PeakScalar(pSrc + i, n - i, PeakScalar(lanes, 4, 0.));
+}
+
+template <bool SQUARES>
+IPLUG_SIMD_TARGET_AVX inline void PeakSumAVX(const float* pSrc, int n, float* pPeak, float* pSum)
+{
+  const __m256 vAbs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 vPeak = _mm256_setzero_ps();
+  __m256 vSum = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m256 v = _mm256_and_ps(_mm256_loadu_ps(pSrc + i), vAbs);
+    vPeak = _mm256_max_ps(vPeak, v);
+    vSum = _mm256_add_ps(vSum, SQUARES ? _mm256_mul_ps(v, v) : v);
+  }
+  float lanes[16];
+  _mm256_storeu_ps(lanes, vPeak);
+  _mm256_storeu_ps(lanes + 8, vSum);
+  *pPeak = PeakScalar(lanes, 8, *pPeak);
+  *pSum += ((lanes[8] + lanes[9]) + (lanes[10] + lanes[11])) + ((lanes[12] + lanes[13]) + (lanes[14] + lanes[15]));
+  PeakSumScalar<float, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+template <bool SQUARES>
+IPLUG_SIMD_TARGET_AVX inline void PeakSumAVX(const double* pSrc, int n, double* pPeak, double* pSum)
+{
+  const __m256d vAbs = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+  __m256d vPeak = _mm256_setzero_pd();
+  __m256d vSum = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d v = _mm256_and_pd(_mm256_loadu_pd(pSrc + i), vAbs);
+    vPeak = _mm256_max_pd(vPeak, v);
+    vSum = _mm256_add_pd(vSum, SQUARES ? _mm256_mul_pd(v, v) : v);
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, vPeak);
+  _mm256_storeu_pd(lanes + 4, vSum);
+  *pPeak = PeakScalar(lanes, 4, *pPeak);
+  *pSum += (lanes[4] + lanes[5]) + (lanes[6] + lanes[7]);
+  PeakSumScalar<double, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void MultiplyAccumulateAVX(float* pDest, const float* pSrc, int n, float gain, float step)
+{
+  const __m256 vLanes = _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f));
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m256 vGain = _mm256_add_ps(_mm256_set1_ps(gain + step * i), vLanes);
+    _mm256_storeu_ps(pDest + i, _mm256_add_ps(_mm256_loadu_ps(pDest + i), _mm256_mul_ps(_mm256_loadu_ps(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+
+IPLUG_SIMD_TARGET_AVX inline void MultiplyAccumulateAVX(double* pDest, const double* pSrc, int n, double gain, double step)
+{
+  const __m256d vLanes = _mm256_mul_pd(_mm256_set1_pd(step), _mm256_setr_pd(0., 1., 2., 3.));
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d vGain = _mm256_add_pd(_mm256_set1_pd(gain + step * i), vLanes);
+    _mm256_storeu_pd(pDest + i, _mm256_add_pd(_mm256_loadu_pd(pDest + i), _mm256_mul_pd(_mm256_loadu_pd(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+#endif
+
+#pragma mark - NEON kernels
+
+#ifdef IPLUG_SIMD_NEON
+inline void ConvertNEON(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const float32x4_t v = vld1q_f32(pSrc + i);
+    vst1q_f64(pDest + i, vcvt_f64_f32(vget_low_f32(v)));
+    vst1q_f64(pDest + i + 2, vcvt_high_f64_f32(v));
+  }
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void ConvertNEON(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(pDest + i, vcvt_high_f32_f64(vcvt_f32_f64(vld1q_f64(pSrc + i)), vld1q_f64(pSrc + i + 2)));
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateNEON(float* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(pDest + i, vaddq_f32(vld1q_f32(pDest + i), vld1q_f32(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateNEON(double* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vst1q_f64(pDest + i, vaddq_f64(vld1q_f64(pDest + i), vld1q_f64(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateNEON(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const float32x4_t v = vld1q_f32(pSrc + i);
+    vst1q_f64(pDest + i, vaddq_f64(vld1q_f64(pDest + i), vcvt_f64_f32(vget_low_f32(v))));
+    vst1q_f64(pDest + i + 2, vaddq_f64(vld1q_f64(pDest + i + 2), vcvt_high_f64_f32(v)));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateNEON(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const float32x4_t v = vcvt_high_f32_f64(vcvt_f32_f64(vld1q_f64(pSrc + i)), vld1q_f64(pSrc + i + 2));
+    vst1q_f32(pDest + i, vaddq_f32(vld1q_f32(pDest + i), v));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void MinMaxNEON(const float* pSrc, int n, float* pMin, float* pMax)
+{
+  int i = 0;
+  if (n >= 4)
+  {
+    float32x4_t vMin = vld1q_f32(pSrc);
+    float32x4_t vMax = vMin;
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+      const float32x4_t v = vld1q_f32(pSrc + i);
+      vMin = vminq_f32(vMin, v);
+      vMax = vmaxq_f32(vMax, v);
+    }
+    const float lanes[2] = { vminvq_f32(vMin), vmaxvq_f32(vMax) };
+    MinMaxScalar(lanes, 2, pMin, pMax);
+  }
+  MinMaxScalar(pSrc + i, n - i, pMin, pMax);
+}
+
+inline void MultiplyAddClipNEON(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi)
+{
+  const float64x2_t vMul = vdupq_n_f64(mul), vAdd = vdupq_n_f64(add), vLo = vdupq_n_f64(lo), vHi = vdupq_n_f64(hi);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vst1q_f64(pDest + i, vminq_f64(vmaxq_f64(vaddq_f64(vmulq_f64(vld1q_f64(pSrc + i), vMul), vAdd), vLo), vHi));
+  MultiplyAddClipScalar(pDest + i, pSrc + i, n - i, mul, add, lo, hi);
+}
+
+inline float PeakNEON(const float* pSrc, int n)
+{
+  float32x4_t vPeak = vdupq_n_f32(0.f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vPeak = vmaxq_f32(vPeak, vabsq_f32(vld1q_f32(pSrc + i)));
+  return PeakScalar(pSrc + i, n - i, vmaxvq_f32(vPeak));
+}
+
+inline double PeakNEON(const double* pSrc, int n)
+{
+  float64x2_t vPeak = vdupq_n_f64(0.);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vPeak = vmaxq_f64(vPeak, vabsq_f64(vld1q_f64(pSrc + i)));
+  return PeakScalar(pSrc + i, n - i, vmaxvq_f64(vPeak));
+}
+
+template <bool SQUARES>
+inline void PeakSumNEON(const float* pSrc, int n, float* pPeak, float* pSum)
+{
+  float32x4_t vPeak = vdupq_n_f32(0.f);
+  float32x4_t vSum = vdupq_n_f32(0.f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const float32x4_t v = vabsq_f32(vld1q_f32(pSrc + i));
+    vPeak = vmaxq_f32(vPeak, v);
+    vSum = SQUARES ? vfmaq_f32(vSum, v, v) : vaddq_f32(vSum, v);
+  }
+  const float peak = vmaxvq_f32(vPeak);
+  *pPeak = peak > *pPeak ? peak : *pPeak;
+  *pSum += vaddvq_f32(vSum);
+  PeakSumScalar<float, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+template <bool SQUARES>
+inline void PeakSumNEON(const double* pSrc, int n, double* pPeak, double* pSum)
+{
+  float64x2_t vPeak = vdupq_n_f64(0.);
+  float64x2_t vSum = vdupq_n_f64(0.);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const float64x2_t v = vabsq_f64(vld1q_f64(pSrc + i));
+    vPeak = vmaxq_f64(vPeak, v);
+    vSum = SQUARES ? vfmaq_f64(vSum, v, v) : vaddq_f64(vSum, v);
+  }
+  const double peak = vmaxvq_f64(vPeak);
+  *pPeak = peak > *pPeak ? peak : *pPeak;
+  *pSum += vaddvq_f64(vSum);
+  PeakSumScalar<double, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+inline void MultiplyAccumulateNEON(float* pDest, const float* pSrc, int n, float gain, float step)
+{
+  const float lanes[4] = { 0.f, step, 2.f * step, 3.f * step };
+  const float32x4_t vLanes = vld1q_f32(lanes);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const float32x4_t vGain = vaddq_f32(vdupq_n_f32(gain + step * i), vLanes);
+    vst1q_f32(pDest + i, vaddq_f32(vld1q_f32(pDest + i), vmulq_f32(vld1q_f32(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+
+inline void MultiplyAccumulateNEON(double* pDest, const double* pSrc, int n, double gain, double step)
+{
+  const double lanes[2] = { 0., step };
+  const float64x2_t vLanes = vld1q_f64(lanes);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const float64x2_t vGain = vaddq_f64(vdupq_n_f64(gain + step * i), vLanes);
+    vst1q_f64(pDest + i, vaddq_f64(vld1q_f64(pDest + i), vmulq_f64(vld1q_f64(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+#endif
+
+#pragma mark - WebAssembly SIMD128 kernels
+
+#ifdef IPLUG_SIMD_WASM
+inline void ConvertWASM(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t v = wasm_v128_load(pSrc + i);
+    wasm_v128_store(pDest + i, wasm_f64x2_promote_low_f32x4(v));
+    wasm_v128_store(pDest + i + 2, wasm_f64x2_promote_low_f32x4(wasm_i64x2_shuffle(v, v, 1, 0)));
+  }
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void ConvertWASM(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t lo = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i));
+    const v128_t hi = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i + 2));
+    wasm_v128_store(pDest + i, wasm_i64x2_shuffle(lo, hi, 0, 2));
+  }
+  ConvertScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateWASM(float* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    wasm_v128_store(pDest + i, wasm_f32x4_add(wasm_v128_load(pDest + i), wasm_v128_load(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateWASM(double* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    wasm_v128_store(pDest + i, wasm_f64x2_add(wasm_v128_load(pDest + i), wasm_v128_load(pSrc + i)));
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateWASM(double* pDest, const float* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t v = wasm_v128_load(pSrc + i);
+    wasm_v128_store(pDest + i, wasm_f64x2_add(wasm_v128_load(pDest + i), wasm_f64x2_promote_low_f32x4(v)));
+    wasm_v128_store(pDest + i + 2, wasm_f64x2_add(wasm_v128_load(pDest + i + 2), wasm_f64x2_promote_low_f32x4(wasm_i64x2_shuffle(v, v, 1, 0))));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void AccumulateWASM(float* pDest, const double* pSrc, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t lo = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i));
+    const v128_t hi = wasm_f32x4_demote_f64x2_zero(wasm_v128_load(pSrc + i + 2));
+    wasm_v128_store(pDest + i, wasm_f32x4_add(wasm_v128_load(pDest + i), wasm_i64x2_shuffle(lo, hi, 0, 2)));
+  }
+  AccumulateScalar(pDest + i, pSrc + i, n - i);
+}
+
+inline void MinMaxWASM(const float* pSrc, int n, float* pMin, float* pMax)
+{
+  int i = 0;
+  if (n >= 4)
+  {
+    v128_t vMin = wasm_v128_load(pSrc);
+    v128_t vMax = vMin;
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+      const v128_t v = wasm_v128_load(pSrc + i);
+      vMin = wasm_f32x4_min(vMin, v);
+      vMax = wasm_f32x4_max(vMax, v);
+    }
+    const float lanes[8] = { wasm_f32x4_extract_lane(vMin, 0), wasm_f32x4_extract_lane(vMin, 1), wasm_f32x4_extract_lane(vMin, 2), wasm_f32x4_extract_lane(vMin, 3),
+                             wasm_f32x4_extract_lane(vMax, 0), wasm_f32x4_extract_lane(vMax, 1), wasm_f32x4_extract_lane(vMax, 2), wasm_f32x4_extract_lane(vMax, 3) };
+    MinMaxScalar(lanes, 8, pMin, pMax);
+  }
+  MinMaxScalar(pSrc + i, n - i, pMin, pMax);
+}
+
+inline void MultiplyAddClipWASM(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi)
+{
+  const v128_t vMul = wasm_f64x2_splat(mul), vAdd = wasm_f64x2_splat(add), vLo = wasm_f64x2_splat(lo), vHi = wasm_f64x2_splat(hi);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    wasm_v128_store(pDest + i, wasm_f64x2_min(wasm_f64x2_max(wasm_f64x2_add(wasm_f64x2_mul(wasm_v128_load(pSrc + i), vMul), vAdd), vLo), vHi));
+  MultiplyAddClipScalar(pDest + i, pSrc + i, n - i, mul, add, lo, hi);
+}
+
+inline float PeakWASM(const float* pSrc, int n)
+{
+  v128_t vPeak = wasm_f32x4_splat(0.f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vPeak = wasm_f32x4_max(vPeak, wasm_f32x4_abs(wasm_v128_load(pSrc + i)));
+  const float lanes[4] = { wasm_f32x4_extract_lane(vPeak, 0), wasm_f32x4_extract_lane(vPeak, 1), wasm_f32x4_extract_lane(vPeak, 2), wasm_f32x4_extract_lane(vPeak, 3) };
+  return PeakScalar(pSrc + i, n - i, PeakScalar(lanes, 4, 0.f));
+}
+
+inline double PeakWASM(const double* pSrc, int n)
+{
+  v128_t vPeak = wasm_f64x2_splat(0.);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+    vPeak = wasm_f64x2_max(vPeak, wasm_f64x2_abs(wasm_v128_load(pSrc + i)));
+  const double lanes[2] = { wasm_f64x2_extract_lane(vPeak, 0), wasm_f64x2_extract_lane(vPeak, 1) };
+  return PeakScalar(pSrc + i, n - i, PeakScalar(lanes, 2, 0.));
+}
+
+template <bool SQUARES>
+inline void PeakSumWASM(const float* pSrc, int n, float* pPeak, float* pSum)
+{
+  v128_t vPeak = wasm_f32x4_splat(0.f);
+  v128_t vSum = wasm_f32x4_splat(0.f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t v = wasm_f32x4_abs(wasm_v128_load(pSrc + i));
+    vPeak = wasm_f32x4_max(vPeak, v);
+    vSum = wasm_f32x4_add(vSum, SQUARES ? wasm_f32x4_mul(v, v) : v);
+  }
+  const float lanes[4] = { wasm_f32x4_extract_lane(vPeak, 0), wasm_f32x4_extract_lane(vPeak, 1), wasm_f32x4_extract_lane(vPeak, 2), wasm_f32x4_extract_lane(vPeak, 3) };
+  *pPeak = PeakScalar(lanes, 4, *pPeak);
+  *pSum += (wasm_f32x4_extract_lane(vSum, 0) + wasm_f32x4_extract_lane(vSum, 1)) + (wasm_f32x4_extract_lane(vSum, 2) + wasm_f32x4_extract_lane(vSum, 3));
+  PeakSumScalar<float, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+template <bool SQUARES>
+inline void PeakSumWASM(const double* pSrc, int n, double* pPeak, double* pSum)
+{
+  v128_t vPeak = wasm_f64x2_splat(0.);
+  v128_t vSum = wasm_f64x2_splat(0.);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const v128_t v = wasm_f64x2_abs(wasm_v128_load(pSrc + i));
+    vPeak = wasm_f64x2_max(vPeak, v);
+    vSum = wasm_f64x2_add(vSum, SQUARES ? wasm_f64x2_mul(v, v) : v);
+  }
+  const double lanes[2] = { wasm_f64x2_extract_lane(vPeak, 0), wasm_f64x2_extract_lane(vPeak, 1) };
+  *pPeak = PeakScalar(lanes, 2, *pPeak);
+  *pSum += wasm_f64x2_extract_lane(vSum, 0) + wasm_f64x2_extract_lane(vSum, 1);
+  PeakSumScalar<double, SQUARES>(pSrc + i, n - i, pPeak, pSum);
+}
+
+inline void MultiplyAccumulateWASM(float* pDest, const float* pSrc, int n, float gain, float step)
+{
+  const v128_t vLanes = wasm_f32x4_make(0.f, step, 2.f * step, 3.f * step);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const v128_t vGain = wasm_f32x4_add(wasm_f32x4_splat(gain + step * i), vLanes);
+    wasm_v128_store(pDest + i, wasm_f32x4_add(wasm_v128_load(pDest + i), wasm_f32x4_mul(wasm_v128_load(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+
+inline void MultiplyAccumulateWASM(double* pDest, const double* pSrc, int n, double gain, double step)
+{
+  const v128_t vLanes = wasm_f64x2_make(0., step);
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    const v128_t vGain = wasm_f64x2_add(wasm_f64x2_splat(gain + step * i), vLanes);
+    wasm_v128_store(pDest + i, wasm_f64x2_add(wasm_v128_load(pDest + i), wasm_f64x2_mul(wasm_v128_load(pSrc + i), vGain)));
+  }
+  MultiplyAccumulateScalar(pDest + i, pSrc + i, n - i, gain + step * i, step);
+}
+#endif
+
+#pragma mark - Dispatch
+
+/** The instruction set extensions of the CPU the code is running on, as far as this build can use them. See GetCPUFeatures() */
+struct CPUFeatures
+{
+  bool sse2 = false;
+  bool sse41 = false;
+  bool avx = false;
+  bool avx2 = false;
+  bool fma = false;
+  bool avx512f = false;
+  bool neon = false;
+  bool wasmSIMD = false;
+};
+
+/** @return The features of the running CPU, detected on the first call */
+inline const CPUFeatures& GetCPUFeatures()
+{
+  static const CPUFeatures sFeatures = []() {
+    CPUFeatures features;
+#if defined IPLUG_SIMD_AVX
+    features.sse2 = true;
+
+    #if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const unsigned int ecx = (unsigned int) info[2];
+    unsigned int ebx7 = 0;
+    if (maxLeaf >= 7)
+    {
+      __cpuidex(info, 7, 0);
+      ebx7 = (unsigned int) info[1];
+    }
+    #else
+    unsigned int eax, ebx, ecx = 0, edx, ebx7 = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return features;
+    if (__get_cpuid_max(0, nullptr) >= 7)
+    {
+      unsigned int eax7, ecx7, edx7;
+      __cpuid_count(7, 0, eax7, ebx7, ecx7, edx7);
+    }
+    #endif
+
+    features.sse41 = (ecx & (1u << 19)) != 0;
+
+    // AVX also needs the OS to save the YMM registers on context switch, and AVX-512 the ZMM and mask registers
+    if ((ecx & (1u << 27)) && (ecx & (1u << 28)))
+    {
+      #if defined(_MSC_VER)
+      const unsigned long long xcr0 = _xgetbv(0);
+      #else
+      unsigned int xcr0lo, xcr0hi;
+      __asm__ volatile("xgetbv" : "=a"(xcr0lo), "=d"(xcr0hi) : "c"(0));
+      const unsigned long long xcr0 = ((unsigned long long) xcr0hi << 32) | xcr0lo;
+      #endif
+
+      if ((xcr0 & 0x6) == 0x6)
+      {
+        features.avx = true;
+        features.fma = (ecx & (1u << 12)) != 0;
+        features.avx2 = (ebx7 & (1u << 5)) != 0;
+        features.avx512f = (ebx7 & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+      }
+    }
+#elif defined IPLUG_SIMD_SSE2
+    features.sse2 = true;
+#elif defined IPLUG_SIMD_NEON
+    features.neon = true;
+#elif defined IPLUG_SIMD_WASM
+    features.wasmSIMD = true; // a module built with -msimd128 doesn't load in an engine without SIMD, so there is nothing to detect
+#endif
+    return features;
+  }();
+
+  return sFeatures;
+}
+
+/** @return The best instruction set of ESIMDLevel supported by the CPU the code is running on */
+static inline ESIMDLevel DetectSIMDLevel()
+{
+  const CPUFeatures& features = GetCPUFeatures();
+
+  if (features.avx)
+    return ESIMDLevel::kAVX;
+  else if (features.sse2)
+    return ESIMDLevel::kSSE2;
+  else if (features.neon)
+    return ESIMDLevel::kNEON;
+  else if (features.wasmSIMD)
+    return ESIMDLevel::kWASM;
+
+  return ESIMDLevel::kScalar;
+}
+
+/** The per instruction set implementations of a kernel, SelectVariant() picks the best one the CPU supports. Only scalar is required, leave the others nullptr.
+ * Implementations for an instruction set the build doesn't target by default are compiled with IPLUG_SIMD_TARGET_AVX, IPLUG_SIMD_TARGET_AVX2 or IPLUG_SIMD_TARGET_AVX512,
+ * inside the matching #ifdef IPLUG_SIMD_AVX etc. */
+template <typename Fn>
+struct SIMDVariants
+{
+  Fn scalar = nullptr;
+  Fn sse2 = nullptr;
+  Fn avx = nullptr;
+  Fn avx2 = nullptr; // also requires FMA, which every AVX2 CPU has
+  Fn avx512 = nullptr;
+  Fn neon = nullptr;
+  Fn wasm = nullptr;
+};
+
+/** @return The best of the variants for a CPU */
+template <typename Fn>
+Fn SelectVariant(const SIMDVariants<Fn>& variants, const CPUFeatures& features = GetCPUFeatures())
+{
+  if (features.avx512f && variants.avx512)
+    return variants.avx512;
+  if (features.avx2 && features.fma && variants.avx2)
+    return variants.avx2;
+  if (features.avx && variants.avx)
+    return variants.avx;
+  if (features.sse2 && variants.sse2)
+    return variants.sse2;
+  if (features.neon && variants.neon)
+    return variants.neon;
+  if (features.wasmSIMD && variants.wasm)
+    return variants.wasm;
+
+  return variants.scalar;
+}
+
+/** A kernel that is resolved once for the running CPU, so that one build uses the best code on both old and new machines. The key is a type that names the kernel,
+ * with the function pointer type and a static method that returns its variants:
+ * @code
+ * struct ProcessGainKernel
+ * {
+ *   using Fn = void (*)(float*, int, float);
+ *   static SIMDVariants<Fn> Variants()
+ *   {
+ *     SIMDVariants<Fn> variants;
+ *     variants.scalar = ProcessGainScalar;
+ *   #ifdef IPLUG_SIMD_AVX
+ *     variants.avx2 = ProcessGainAVX2; // defined with IPLUG_SIMD_TARGET_AVX2
+ *   #endif
+ *     return variants;
+ *   }
+ * };
+ *
+ * SIMDDispatch<ProcessGainKernel>::Get()(pBuffer, nFrames, gain);
+ * @endcode
+ * The first Get() detects the CPU and selects the variant. Call it once outside the audio thread, e.g. in the constructor of the DSP class that uses it.
+ * Later calls return the cached pointer. */
+template <typename Key>
+struct SIMDDispatch
+{
+  using Fn = typename Key::Fn;
+
+  static Fn Get()
+  {
+    static const Fn sFn = SelectVariant(Key::Variants());
+    return sFn;
+  }
+};
+
+/** Table of kernel function pointers, resolved once for the running CPU */
+struct Kernels
+{
+  void (*convertFloatToDouble)(double*, const float*, int) = ConvertScalar<double, float>;
+  void (*convertDoubleToFloat)(float*, const double*, int) = ConvertScalar<float, double>;
+  void (*accumulateFloat)(float*, const float*, int) = AccumulateScalar<float, float>;
+  void (*accumulateDouble)(double*, const double*, int) = AccumulateScalar<double, double>;
+  void (*accumulateFloatToDouble)(double*, const float*, int) = AccumulateScalar<double, float>;
+  void (*accumulateDoubleToFloat)(float*, const double*, int) = AccumulateScalar<float, double>;
+  void (*minMaxFloat)(const float*, int, float*, float*) = MinMaxScalar;
+  void (*multiplyAddClipDouble)(double*, const double*, int, double, double, double, double) = MultiplyAddClipScalar;
+  float (*peakFloat)(const float*, int) = [](const float* pSrc, int n) { return PeakScalar(pSrc, n, 0.f); };
+  double (*peakDouble)(const double*, int) = [](const double* pSrc, int n) { return PeakScalar(pSrc, n, 0.); };
+  void (*peakSumAbsFloat)(const float*, int, float*, float*) = PeakSumScalar<float, false>;
+  void (*peakSumAbsDouble)(const double*, int, double*, double*) = PeakSumScalar<double, false>;
+  void (*peakSumSquaresFloat)(const float*, int, float*, float*) = PeakSumScalar<float, true>;
+  void (*peakSumSquaresDouble)(const double*, int, double*, double*) = PeakSumScalar<double, true>;
+  void (*multiplyAccumulateFloat)(float*, const float*, int, float, float) = MultiplyAccumulateScalar<float>;
+  void (*multiplyAccumulateDouble)(double*, const double*, int, double, double) = MultiplyAccumulateScalar<double>;
+  ESIMDLevel level = ESIMDLevel::kScalar;
+
+  Kernels() : Kernels(DetectSIMDLevel()) {}
+
+  /** A table for a particular instruction set rather than the best one, e.g. to compare them in IPlugDSPBench_main.cpp. The CPU must support it
+   * @param simdLevel The instruction set. If this build has no kernels for it, the table is scalar */
+  explicit Kernels(ESIMDLevel simdLevel)
+  {
+    level = simdLevel;
+
+    switch (level)
+    {
+#ifdef IPLUG_SIMD_AVX
+      case ESIMDLevel::kAVX:
+        convertFloatToDouble = ConvertAVX;
+        convertDoubleToFloat = ConvertAVX;
+        accumulateFloat = AccumulateAVX;
+        accumulateDouble = AccumulateAVX;
+        accumulateFloatToDouble = AccumulateAVX;
+        accumulateDoubleToFloat = AccumulateAVX;
+        minMaxFloat = MinMaxAVX;
+        multiplyAddClipDouble = MultiplyAddClipAVX;
+        peakFloat = PeakAVX;
+        peakDouble = PeakAVX;
+        peakSumAbsFloat = PeakSumAVX<false>;
+        peakSumAbsDouble = PeakSumAVX<false>;
+        peakSumSquaresFloat = PeakSumAVX<true>;
+        peakSumSquaresDouble = PeakSumAVX<true>;
+        multiplyAccumulateFloat = MultiplyAccumulateAVX;
+        multiplyAccumulateDouble = MultiplyAccumulateAVX;
+        break;
+#endif
+#ifdef IPLUG_SIMD_SSE2
+      case ESIMDLevel::kSSE2:
+        convertFloatToDouble = ConvertSSE2;
+        convertDoubleToFloat = ConvertSSE2;
+        accumulateFloat = AccumulateSSE2;
+        accumulateDouble = AccumulateSSE2;
+        accumulateFloatToDouble = AccumulateSSE2;
+        accumulateDoubleToFloat = AccumulateSSE2;
+        minMaxFloat = MinMaxSSE2;
+        multiplyAddClipDouble = MultiplyAddClipSSE2;
+        peakFloat = PeakSSE2;
+        peakDouble = PeakSSE2;
+        peakSumAbsFloat = PeakSumSSE2<false>;
+        peakSumAbsDouble = PeakSumSSE2<false>;
+        peakSumSquaresFloat = PeakSumSSE2<true>;
+        peakSumSquaresDouble = PeakSumSSE2<true>;
+        multiplyAccumulateFloat = MultiplyAccumulateSSE2;
+        multiplyAccumulateDouble = MultiplyAccumulateSSE2;
+        break;
+#endif
+#ifdef IPLUG_SIMD_NEON
+      case ESIMDLevel::kNEON:
+        convertFloatToDouble = ConvertNEON;
+        convertDoubleToFloat = ConvertNEON;
+        accumulateFloat = AccumulateNEON;
+        accumulateDouble = AccumulateNEON;
+        accumulateFloatToDouble = AccumulateNEON;
+        accumulateDoubleToFloat = AccumulateNEON;
+        minMaxFloat = MinMaxNEON;
+        multiplyAddClipDouble = MultiplyAddClipNEON;
+        peakFloat = PeakNEON;
+        peakDouble = PeakNEON;
+        peakSumAbsFloat = PeakSumNEON<false>;
+        peakSumAbsDouble = PeakSumNEON<false>;
+        peakSumSquaresFloat = PeakSumNEON<true>;
+        peakSumSquaresDouble = PeakSumNEON<true>;
+        multiplyAccumulateFloat = MultiplyAccumulateNEON;
+        multiplyAccumulateDouble = MultiplyAccumulateNEON;
+        break;
+#endif
+#ifdef IPLUG_SIMD_WASM
+      case ESIMDLevel::kWASM:
+        convertFloatToDouble = ConvertWASM;
+        convertDoubleToFloat = ConvertWASM;
+        accumulateFloat = AccumulateWASM;
+        accumulateDouble = AccumulateWASM;
+        accumulateFloatToDouble = AccumulateWASM;
+        accumulateDoubleToFloat = AccumulateWASM;
+        minMaxFloat = MinMaxWASM;
+        multiplyAddClipDouble = MultiplyAddClipWASM;
+        peakFloat = PeakWASM;
+        peakDouble = PeakWASM;
+        peakSumAbsFloat = PeakSumWASM<false>;
+        peakSumAbsDouble = PeakSumWASM<false>;
+        peakSumSquaresFloat = PeakSumWASM<true>;
+        peakSumSquaresDouble = PeakSumWASM<true>;
+        multiplyAccumulateFloat = MultiplyAccumulateWASM;
+        multiplyAccumulateDouble = MultiplyAccumulateWASM;
+        break;
+#endif
+      default:
+        level = ESIMDLevel::kScalar;
+        break;
+    }
+  }
+
+  /** @return The process-wide kernel table. The first call does the CPU detection, so call it once outside the audio thread (IPlugProcessor does this in its constructor) */
+  static const Kernels& Get()
+  {
+    static const Kernels sKernels;
+    return sKernels;
+  }
+};
+
+} // namespace simd
+
+#pragma mark - Buffer operations
+
+/** Copy n samples from pSrc to pDest, converting the sample format if needed */
+inline void VectorCopy(float* pDest, const float* pSrc, int n) { memcpy(pDest, pSrc, n * sizeof(float)); }
+inline void VectorCopy(double* pDest, const double* pSrc, int n) { memcpy(pDest, pSrc, n * sizeof(double)); }
+inline void VectorCopy(double* pDest, const float* pSrc, int n) { simd::Kernels::Get().convertFloatToDouble(pDest, pSrc, n); }
+inline void VectorCopy(float* pDest, const double* pSrc, int n) { simd::Kernels::Get().convertDoubleToFloat(pDest, pSrc, n); }
+
+/** Add n samples from pSrc to pDest, converting the sample format if needed */
+inline void VectorAccumulate(float* pDest, const float* pSrc, int n) { simd::Kernels::Get().accumulateFloat(pDest, pSrc, n); }
+inline void VectorAccumulate(double* pDest, const double* pSrc, int n) { simd::Kernels::Get().accumulateDouble(pDest, pSrc, n); }
+inline void VectorAccumulate(double* pDest, const float* pSrc, int n) { simd::Kernels::Get().accumulateFloatToDouble(pDest, pSrc, n); }
+inline void VectorAccumulate(float* pDest, const double* pSrc, int n) { simd::Kernels::Get().accumulateDoubleToFloat(pDest, pSrc, n); }
+
+/** Widen a range to include n values from pSrc. Initialise the range to the first value, or to +/- infinity
+ * @param pSrc The values
+ * @param n The number of values
+ * @param min Lowered to the smallest value
+ * @param max Raised to the largest value */
+inline void VectorMinMax(const float* pSrc, int n, float& min, float& max) { simd::Kernels::Get().minMaxFloat(pSrc, n, &min, &max); }
+
+/** Scale, offset and clamp n values, pDest[i] = Clip(pSrc[i] * mul + add, lo, hi). pDest may be pSrc. Used by IParam's batch conversions */
+inline void VectorMultiplyAddClip(double* pDest, const double* pSrc, int n, double mul, double add, double lo, double hi) { simd::Kernels::Get().multiplyAddClipDouble(pDest, pSrc, n, mul, add, lo, hi); }
+
+/** @return The largest absolute value of n samples, or 0 if n is 0. Used by IPlugProcessor to detect silent blocks */
+inline float VectorPeak(const float* pSrc, int n) { return simd::Kernels::Get().peakFloat(pSrc, n); }
+inline double VectorPeak(const double* pSrc, int n) { return simd::Kernels::Get().peakDouble(pSrc, n); }
+
+/** Raise a peak to the largest absolute value of n samples, and add their absolute values to a sum, in one pass. Used by IPeakSender and IPeakAvgSender
+ * @param peak Raised to the largest absolute value, initialise it to 0
+ * @param sum The absolute values are added to this */
+inline void VectorPeakSumAbs(const float* pSrc, int n, float& peak, float& sum) { simd::Kernels::Get().peakSumAbsFloat(pSrc, n, &peak, &sum); }
+inline void VectorPeakSumAbs(const double* pSrc, int n, double& peak, double& sum) { simd::Kernels::Get().peakSumAbsDouble(pSrc, n, &peak, &sum); }
+
+/** Raise a peak to the largest absolute value of n samples, and add their squares to a sum, in one pass, for an RMS. Used by IPeakAvgSender
+ * @param peak Raised to the largest absolute value, initialise it to 0
+ * @param sum The squares are added to this */
+inline void VectorPeakSumSquares(const float* pSrc, int n, float& peak, float& sum) { simd::Kernels::Get().peakSumSquaresFloat(pSrc, n, &peak, &sum); }
+inline void VectorPeakSumSquares(const double* pSrc, int n, double& peak, double& sum) { simd::Kernels::Get().peakSumSquaresDouble(pSrc, n, &peak, &sum); }
+
+/** Add n samples, scaled by a gain that ramps linearly, to pDest: pDest[i] += pSrc[i] * (gain + step * i). Used by MatrixMixer
+ * @param step The gain increment per sample, 0 for a constant gain */
+inline void VectorMultiplyAccumulate(float* pDest, const float* pSrc, int n, float gain, float step = 0.f) { simd::Kernels::Get().multiplyAccumulateFloat(pDest, pSrc, n, gain, step); }
+inline void VectorMultiplyAccumulate(double* pDest, const double* pSrc, int n, double gain, double step = 0.) { simd::Kernels::Get().multiplyAccumulateDouble(pDest, pSrc, n, gain, step); }
+
+/** Zero n samples at pDest. The C library memset is already vectorized on every platform we target, so it is used directly */
+template <typename T>
+inline void VectorZero(T* pDest, int n) { memset(pDest, 0, n * sizeof(T)); }
+
+END_IPLUG_NAMESPACE
@@ -40,24 +40,146 @@ struct ParamTuple
   {}
 };
 
-/** This structure is used when queueing Sysex messages. You may need to set MAX_SYSEX_SIZE to reflect the max sysex payload in bytes */
+/** A single, timestamped point of host parameter automation within a processing block */
+struct IParamChange
+{
+  int mIdx;
+  int mOffset;
+  double mValue; // non-normalized
+
+  IParamChange(int idx = kNoParameter, int offset = 0, double value = 0.)
+  : mIdx(idx)
+  , mOffset(offset)
+  , mValue(value)
+  {}
+};
+
+/** A fixed capacity, time-ordered list of the parameter automation points received for the current processing block.
+ * The list is filled by the API classes on the audio thread when sample accurate automation is enabled (see IPlugProcessor::SetSampleAccurateAutomation())
+ * and is valid for the duration of ProcessBlock(). Consecutive points for a parameter describe a piecewise-linear automation curve,
+ * which is the interpretation of VST3 IParamValueQueues and AudioUnit ramped parameter events. Memory is only allocated in Resize() */
+class IParamChangeList
+{
+public:
+  IParamChangeList(int size = 0)
+  {
+    Resize(size);
+  }
+
+  /** Allocate storage for a number of points. Not realtime safe.
+   * @param size The maximum number of points that can be stored per block */
+  void Resize(int size)
+  {
+    mChanges.Resize(size);
+    mSize = std::min(mSize, size);
+  }
+
+  /** Insert a point, keeping the list ordered by sample offset. Points with the same offset stay in the order they were added.
+   * @param idx The parameter index
+   * @param offset The sample offset within the block
+   * @param value The non-normalized parameter value
+   * @return \c false if the list is full and the point was dropped */
+  bool Add(int idx, int offset, double value)
+  {
+    if (mSize >= mChanges.GetSize())
+    {
+      mNumDropped++;
+      return false;
+    }
+
+    IParamChange* pChanges = mChanges.Get();
+    int i = mSize;
+
+    while (i > 0 && pChanges[i - 1].mOffset > offset)
+    {
+      pChanges[i] = pChanges[i - 1];
+      i--;
+    }
+
+    pChanges[i] = IParamChange(idx, offset, value);
+    mSize++;
+    return true;
+  }
+
+  /** Remove all points, keeping the storage */
+  void Clear() { mSize = 0; }
+
+  /** @return The number of points in the list */
+  int NChanges() const { return mSize; }
+
+  /** @return \c true if there are no points in the list */
+  bool Empty() const { return mSize == 0; }
+
+  /** @return The point at idx, in time order */
+  const IParamChange& Get(int idx) const { assert(idx >= 0 && idx < mSize); return mChanges.Get()[idx]; }
+
+  /** @return The number of points that have been dropped because the list was full, since the last call to ResetNumDropped() */
+  int NumDropped() const { return mNumDropped; }
+
+  void ResetNumDropped() { mNumDropped = 0; }
+
+  /** Render the automation curve of one parameter into a buffer, interpolating linearly between consecutive points.
+   * The curve starts at startValue at offset 0 and ramps to the first point, as host automation segments do, and after the last point it holds the value of the last point
+   * @param paramIdx The parameter to render
+   * @param startValue The value of the parameter at the start of the block
+   * @param pDst Buffer of at least nFrames values
+   * @param nFrames The number of samples to render
+   * @return The value at the end of the block */
+  template <typename T>
+  double FillRamp(int paramIdx, double startValue, T* pDst, int nFrames) const
+  {
+    int pos = 0;
+    double prevValue = startValue;
+    int prevOffset = 0;
+
+    for (int i = 0; i < mSize && pos < nFrames; i++)
+    {
+      const IParamChange& change = mChanges.Get()[i];
+
+      if (change.mIdx != paramIdx)
+        continue;
+
+      const int end = Clip(change.mOffset, 0, nFrames);
+
+      if (end > pos)
+      {
+        const double inc = (change.mValue - prevValue) / (double) (end - prevOffset);
+        double v = prevValue + inc * (double) (pos - prevOffset);
+
+        for (; pos < end; pos++, v += inc)
+          pDst[pos] = (T) v;
+      }
+
+      prevValue = change.mValue;
+      prevOffset = end;
+    }
+
+    for (; pos < nFrames; pos++)
+      pDst[pos] = (T) prevValue;
+
+    return prevValue;
+  }
+
+private:
+  WDL_TypedBuf<IParamChange> mChanges;
+  int mSize = 0;
+  int mNumDropped = 0;
+};
+
+/** This structure is used when queueing Sysex messages. It doesn't own its data: IPlugSysExQueue::Push() copies the data into the queue's arena,
+ * and Pop() points mData at the copy in the arena, which is valid until the queue's Release(). Set SYSEX_TRANSFER_BYTES for the size of the arenas */
 struct SysExData
 {
-  SysExData(int offset = 0, int size = 0, const void* pData = 0)
+  SysExData(int offset = 0, int size = 0, const void* pData = nullptr)
   : mOffset(offset)
   , mSize(size)
+  , mData(static_cast<const uint8_t*>(pData))
   {
-    assert(size < MAX_SYSEX_SIZE);
-    
-    if (pData)
-      memcpy(mData, pData, size);
-    else
-      memset(mData, 0, MAX_SYSEX_SIZE);
   }
   
   int mOffset;
   int mSize;
-  uint8_t mData[MAX_SYSEX_SIZE];
+  const uint8_t* mData;
 };
 
 /** A helper class for IByteChunk and IByteStream that avoids code duplication */
@@ -223,6 +345,18 @@ public:
     return mBytes.GetSize();
   }
   
+  /** Allocates memory for the chunk to grow to a size without reallocating, e.g. before a sequence of Put() calls. The size of the chunk doesn't change
+   * @param nBytes The size (in bytes) to allocate for */
+  inline void Reserve(int nBytes)
+  {
+    int n = mBytes.GetSize();
+    if (nBytes > n)
+    {
+      mBytes.Resize(nBytes, false);
+      mBytes.Resize(n, false);
+    }
+  }
+  
   /** Resizes the chunk
    * @param newSize Desired size (in bytes)
    * @return Old size (in bytes) */
@@ -0,0 +1,345 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugThreadPool
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugQueue.h"
+#include "IPlugRealtimeThread.h"
+#include "IPlugUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+class IPlugThreadPool;
+
+/** A unit of work for IPlugThreadPool. The caller owns it, so submitting it allocates nothing, and it must stay alive until its group is done */
+class IThreadPoolTask
+{
+public:
+  using Func = void (*)(void* pContext);
+
+  IThreadPoolTask(Func func = nullptr, void* pContext = nullptr)
+  : mFunc(func)
+  , mpContext(pContext)
+  {}
+
+  /** Set what the task does. Not while it's queued */
+  void Set(Func func, void* pContext) { mFunc = func; mpContext = pContext; }
+
+private:
+  friend class IPlugThreadPool;
+
+  Func mFunc;
+  void* mpContext;
+  std::chrono::steady_clock::time_point mDeadline;
+  class IThreadPoolGroup* mpGroup = nullptr;
+};
+
+/** Counts the unfinished tasks that were submitted with it, so that a thread can wait for a batch of them, e.g. the ones it needs by the end of its block */
+class IThreadPoolGroup
+{
+public:
+  /** @return \c true once every task submitted with the group has finished */
+  bool IsDone() const { return mPending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class IPlugThreadPool;
+
+  std::atomic<int> mPending{0};
+};
+
+/** Lends a host's own worker threads to IPlugThreadPool, for plug-in APIs where the host shares its thread pool, such as CLAP's thread-pool extension.
+ * The API wrapper installs it on the audio thread with IPlugThreadPool::SetHostExecutor(), and when Wait() has tasks left it asks the host to call
+ * IPlugThreadPool::RunHostTask() on its threads, so the host can schedule them alongside the rest of the session instead of competing with the pool's workers */
+class IThreadPoolHostExecutor
+{
+public:
+  virtual ~IThreadPoolHostExecutor() {}
+
+  /** Ask the host to run tasks from the pool on its threads, blocking until it has, on the audio thread that called Wait()
+   * @param pool The pool to call RunHostTask() on
+   * @param nTasks The number of times to call it
+   * @return \c false if the host didn't run them, in which case Wait() runs the tasks as usual */
+  virtual bool RequestExec(IPlugThreadPool& pool, int nTasks) = 0;
+};
+
+/** One pool of realtime priority worker threads for every instance in the process, sized to the number of cores, for DSP that can run in parallel, such as voices,
+ * convolution partitions or analyser FFTs. Instances each spawning their own workers would oversubscribe the machine as soon as a session has a few dozen of them.
+ * - Instances hold the pool with Get(), the pool starts with the first and stops when the last lets go, so its threads never outlive the plug-in binary
+ * - Submit() is lock-free and allocates nothing, so it can be called on audio threads, and from tasks themselves
+ * - Each worker has its own queues, tasks go to them in turn, and a worker with nothing to do takes tasks from the others
+ * - Tasks are tagged with a deadline. Those due within kUrgentWindow go to urgent queues, which every thread empties before starting on background work,
+ *   and a task that finishes after its deadline is counted by GetNMissedDeadlines()
+ * - Wait() runs urgent tasks on the waiting thread until its group is done, rather than leaving an audio thread idle
+ * - Where the host shares its own threads, Wait() hands the tasks to them first, see IThreadPoolHostExecutor
+ * - On macOS 11 and iOS 14 or later the workers can join the host's audio workgroup, see SetAudioWorkgroup()
+ *
+ * The pool is shared by the instances of one plug-in binary, since each binary has its own copy of this class. On the web without pthreads it has no workers
+ * and Wait() runs everything */
+class IPlugThreadPool final
+{
+public:
+  /** Tasks due within this much time of being submitted go to the urgent queues */
+  static constexpr std::chrono::microseconds kUrgentWindow{20000};
+  /** The number of tasks each of a worker's queues can hold */
+  static constexpr int kQueueSize = 1024;
+  /** How many times an idle worker looks for a task before parking */
+  static constexpr int kSpinCount = 2000;
+
+  using Clock = std::chrono::steady_clock;
+
+  /** Get the pool, starting it if no other instance holds it. Call this from the main thread, e.g. in a plug-in's constructor, and keep the pointer for the
+   * lifetime of the instance
+   * @param nWorkers The number of workers to start with if the pool isn't running yet, or 0 for one fewer than the number of cores
+   * @return The shared pool */
+  static std::shared_ptr<IPlugThreadPool> Get(int nWorkers = 0)
+  {
+    static std::mutex sMutex;
+    static std::weak_ptr<IPlugThreadPool> sPool;
+
+    std::lock_guard<std::mutex> lock(sMutex);
+    std::shared_ptr<IPlugThreadPool> pPool = sPool.lock();
+
+    if (!pPool)
+    {
+      pPool.reset(new IPlugThreadPool(nWorkers > 0 ? nWorkers : DefaultNWorkers()));
+      sPool = pPool;
+    }
+
+    return pPool;
+  }
+
+  ~IPlugThreadPool()
+  {
+    mQuit.store(true, std::memory_order_release);
+    mCV.notify_all();
+
+    for (auto& pWorker : mWorkers)
+    {
+      if (pWorker->mThread.joinable())
+        pWorker->mThread.join();
+    }
+  }
+
+  IPlugThreadPool(const IPlugThreadPool&) = delete;
+  IPlugThreadPool& operator=(const IPlugThreadPool&) = delete;
+
+  /** @return The number of worker threads */
+  int NWorkers() const { return static_cast<int>(mWorkers.size()); }
+
+  /** @return A deadline the given number of seconds from now, e.g. nFrames / GetSampleRate() for the end of the current block */
+  static Clock::time_point DeadlineIn(double seconds)
+  {
+    return Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  }
+
+  /** Queue a task, from any thread. A task submitted by a worker goes to that worker's queues
+   * @param task The task, which must stay alive until the group is done
+   * @param group The group to count the task in
+   * @param deadline When the result is needed
+   * @return \c false if the task's queues are full, in which case it wasn't queued and the caller should run the work itself */
+  bool Submit(IThreadPoolTask& task, IThreadPoolGroup& group, Clock::time_point deadline)
+  {
+    const bool urgent = deadline - Clock::now() < kUrgentWindow;
+    const int nQueues = static_cast<int>(mQueues.size()) / 2;
+    const int first = sWorkerIdx >= 0 && sWorkerPool == this ? sWorkerIdx : static_cast<int>(mNextQueue.fetch_add(1, std::memory_order_relaxed) % nQueues);
+
+    task.mDeadline = deadline;
+    task.mpGroup = &group;
+    group.mPending.fetch_add(1, std::memory_order_acq_rel);
+
+    for (int i = 0; i < nQueues; i++)
+    {
+      if (GetQueue((first + i) % nQueues, urgent).Push(&task))
+      {
+        if (mNParked.load(std::memory_order_acquire) > 0)
+          mCV.notify_one();
+
+        return true;
+      }
+    }
+
+    group.mPending.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+  }
+
+  /** Wait for a group's tasks to finish, running urgent tasks on the calling thread meanwhile. Safe on an audio thread, it doesn't lock, but it does spin
+   * @param group The group to wait for */
+  void Wait(IThreadPoolGroup& group)
+  {
+    IThreadPoolHostExecutor* pExecutor = sHostExecutor;
+
+    // a worker waiting on tasks it submitted keeps them to itself, the host's threads are for the audio thread's batches
+    if (pExecutor && sWorkerPool != this)
+    {
+      const int nPending = group.mPending.load(std::memory_order_acquire);
+
+      if (nPending > 1)
+        pExecutor->RequestExec(*this, nPending);
+    }
+
+    while (!group.IsDone())
+    {
+      if (!RunOne(-1, NWorkers() == 0))
+        std::this_thread::yield();
+    }
+  }
+
+  /** Have the workers join an audio workgroup, so that the OS schedules them with the host's audio threads, and knows they share its deadline.
+   * The workers join it the next time they wake, and leave their previous one. Does nothing where workgroups aren't available
+   * @param pWorkgroup An os_workgroup_t, e.g. from IPlugProcessor::GetAudioWorkgroup(), or nullptr to leave the current one */
+  void SetAudioWorkgroup(void* pWorkgroup)
+  {
+    mpWorkgroup.store(pWorkgroup, std::memory_order_release);
+    mCV.notify_all();
+  }
+
+  /** Set the host executor for Wait() calls on the calling thread, called by API wrappers on the audio thread around processing
+   * @param pExecutor The executor, or nullptr when the host doesn't share its threads */
+  static void SetHostExecutor(IThreadPoolHostExecutor* pExecutor) { sHostExecutor = pExecutor; }
+
+  /** Run one queued task, urgent ones first, called by the host's threads on behalf of an IThreadPoolHostExecutor. Does nothing if the queues are empty */
+  void RunHostTask() { RunOne(-1, true); }
+
+  /** @return The number of tasks that finished after their deadline since the pool started */
+  int GetNMissedDeadlines() const { return mNMissedDeadlines.load(std::memory_order_relaxed); }
+
+private:
+  struct Worker
+  {
+    std::thread mThread;
+  };
+
+  explicit IPlugThreadPool(int nWorkers)
+  {
+#if defined OS_WEB && !defined __EMSCRIPTEN_PTHREADS__
+    nWorkers = 0;
+#endif
+    // a queue pair for each worker, and one for submissions when there are no workers
+    const int nQueues = std::max(nWorkers, 1);
+
+    for (int i = 0; i < nQueues * 2; i++)
+      mQueues.emplace_back(new IPlugMPMCQueue<IThreadPoolTask*>(kQueueSize));
+
+    for (int i = 0; i < nWorkers; i++)
+      mWorkers.emplace_back(new Worker);
+
+    for (int i = 0; i < nWorkers; i++)
+      mWorkers[i]->mThread = std::thread(&IPlugThreadPool::WorkerLoop, this, i);
+  }
+
+  static int DefaultNWorkers()
+  {
+    const int nCores = static_cast<int>(std::thread::hardware_concurrency());
+    // the threads that submit also run tasks in Wait()
+    return Clip(nCores - 1, 1, 64);
+  }
+
+  IPlugMPMCQueue<IThreadPoolTask*>& GetQueue(int idx, bool urgent) { return *mQueues[idx * 2 + (urgent ? 0 : 1)]; }
+
+  /** Run one task, looking at the given worker's queues first and then the others', urgent ones before background ones
+   * @param workerIdx The worker to start with, or -1 from a thread that isn't a worker
+   * @param background \c true to run background tasks as well as urgent ones
+   * @return \c true if a task was run */
+  bool RunOne(int workerIdx, bool background)
+  {
+    const int nQueues = static_cast<int>(mQueues.size()) / 2;
+    const int first = std::max(workerIdx, 0);
+    IThreadPoolTask* pTask = nullptr;
+
+    for (int pass = 0; pass < (background ? 2 : 1) && !pTask; pass++)
+    {
+      for (int i = 0; i < nQueues; i++)
+      {
+        if (GetQueue((first + i) % nQueues, pass == 0).Pop(pTask))
+          break;
+      }
+    }
+
+    if (!pTask)
+      return false;
+
+    IThreadPoolGroup* pGroup = pTask->mpGroup;
+    const Clock::time_point deadline = pTask->mDeadline;
+
+    pTask->mFunc(pTask->mpContext);
+
+    if (Clock::now() > deadline)
+      mNMissedDeadlines.fetch_add(1, std::memory_order_relaxed);
+
+    // the task may be destroyed as soon as its group is done
+    pGroup->mPending.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+  }
+
+  void WorkerLoop(int workerIdx)
+  {
+    IRealtimeThreadScope realtimeScope(mpWorkgroup.load(std::memory_order_acquire));
+    sWorkerIdx = workerIdx;
+    sWorkerPool = this;
+
+    while (!mQuit.load(std::memory_order_acquire))
+    {
+      // join the latest workgroup from SetAudioWorkgroup(), on the worker's own thread as os_workgroup_join() requires
+      realtimeScope.SetWorkgroup(mpWorkgroup.load(std::memory_order_acquire));
+
+      bool found = false;
+
+      for (int i = 0; i < kSpinCount && !found; i++)
+      {
+        found = RunOne(workerIdx, true);
+
+        if (!found && i > kSpinCount / 2)
+          std::this_thread::yield();
+      }
+
+      if (!found && !mQuit.load(std::memory_order_acquire))
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNParked.fetch_add(1, std::memory_order_acq_rel);
+        // the timeout covers a notify that happens between the check and the wait, since submitters don't take the mutex
+        mCV.wait_for(lock, std::chrono::milliseconds(1));
+        mNParked.fetch_sub(1, std::memory_order_acq_rel);
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<IPlugMPMCQueue<IThreadPoolTask*>>> mQueues; // urgent and background for each worker
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  std::atomic<uint32_t> mNextQueue{0};
+  std::atomic<int> mNParked{0};
+  std::atomic<int> mNMissedDeadlines{0};
+  std::atomic<void*> mpWorkgroup{nullptr};
+  std::atomic<bool> mQuit{false};
+  std::mutex mMutex;
+  std::condition_variable mCV;
+
+  // which worker of which pool the current thread is, so that tasks submitted from tasks stay on their worker
+  static inline thread_local int sWorkerIdx = -1;
+  static inline thread_local IPlugThreadPool* sWorkerPool = nullptr;
+  // the executor installed by the API wrapper on the current audio thread
+  static inline thread_local IThreadPoolHostExecutor* sHostExecutor = nullptr;
+};
+
+END_IPLUG_NAMESPACE
@@ -15,15 +15,18 @@
 
 #include "IPlugTimer.h"
 
+#include <algorithm>
+
+#if defined OS_LINUX
+  #include <sys/timerfd.h>
+  #include <unistd.h>
+  #include "IPlugRunLoop.h"
+#endif
+
 using namespace iplug;
 
 #if defined OS_MAC || defined OS_IOS
 
-Timer* Timer::Create(ITimerFunction func, uint32_t intervalMs)
-{
-  return new Timer_impl(func, intervalMs);
-}
-
 Timer_impl::Timer_impl(ITimerFunction func, uint32_t intervalMs)
 : mTimerFunc(func)
 , mIntervalMs(intervalMs)
@@ -63,11 +66,6 @@ void Timer_impl::TimerProc(CFRunLoopTimerRef timer, void *info)
 
 #elif defined OS_WIN
 
-Timer* Timer::Create(ITimerFunction func, uint32_t intervalMs)
-{
-  return new Timer_impl(func, intervalMs);
-}
-
 WDL_Mutex Timer_impl::sMutex;
 WDL_PtrList<Timer_impl> Timer_impl::sTimers;
 
@@ -117,11 +115,6 @@ void CALLBACK Timer_impl::TimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWOR
   }
 }
 #elif defined OS_WEB
-Timer* Timer::Create(ITimerFunction func, uint32_t intervalMs)
-{
-  return new Timer_impl(func, intervalMs);
-}
-
 Timer_impl::Timer_impl(ITimerFunction func, uint32_t intervalMs)
 : mTimerFunc(func)
 {
@@ -143,4 +136,289 @@ void Timer_impl::TimerProc(void* userData)
   Timer_impl* itimer = (Timer_impl*) userData;
   itimer->mTimerFunc(*itimer);
 }
+#elif defined OS_LINUX
+Timer_impl::Timer_impl(ITimerFunction func, uint32_t intervalMs, IRunLoop* pRunLoop)
+: mTimerFunc(func)
+{
+  if (pRunLoop)
+  {
+    mTimerID = pRunLoop->AddTimer(static_cast<int>(intervalMs), TimerProc, this);
+
+    if (mTimerID)
+    {
+      mRunLoop = pRunLoop;
+      return;
+    }
+  }
+
+  mFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (mFD < 0)
+    return;
+
+  itimerspec spec = {};
+  spec.it_interval.tv_sec = intervalMs / 1000;
+  spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+  spec.it_value = spec.it_interval;
+  timerfd_settime(mFD, 0, &spec, nullptr);
+
+  // the default loop isn't kept running by the timer, only by windows
+  const bool added = pRunLoop ? pRunLoop->AddFD(mFD, TimerFDProc, this) : IPollRunLoop::GetDefault().AddBackgroundFD(mFD, TimerFDProc, this);
+
+  if (added)
+    mRunLoop = pRunLoop ? pRunLoop : &IPollRunLoop::GetDefault();
+  else
+  {
+    close(mFD);
+    mFD = -1;
+  }
+}
+
+Timer_impl::~Timer_impl()
+{
+  Stop();
+}
+
+void Timer_impl::Stop()
+{
+  if (mRunLoop)
+  {
+    if (mTimerID)
+      mRunLoop->RemoveTimer(mTimerID);
+    else
+      mRunLoop->RemoveFD(mFD);
+
+    mRunLoop = nullptr;
+    mTimerID = 0;
+  }
+
+  if (mFD >= 0)
+  {
+    close(mFD);
+    mFD = -1;
+  }
+}
+
+void Timer_impl::TimerProc(void* pContext)
+{
+  Timer_impl* itimer = (Timer_impl*) pContext;
+  itimer->mTimerFunc(*itimer);
+}
+
+void Timer_impl::TimerFDProc(void* pContext)
+{
+  Timer_impl* itimer = (Timer_impl*) pContext;
+  uint64_t nExpirations = 0;
+
+  // ticks that were missed while the loop was busy are run once, TimerService skips them anyway
+  if (read(itimer->mFD, &nExpirations, sizeof(nExpirations)) == sizeof(nExpirations))
+    itimer->mTimerFunc(*itimer);
+}
+#endif
+
+#pragma mark - TimerService
+
+Timer* Timer::Create(ITimerFunction func, uint32_t intervalMs)
+{
+  return new SharedTimer(func, intervalMs);
+}
+
+SharedTimer::SharedTimer(ITimerFunction func, uint32_t intervalMs)
+: mTimerFunc(func)
+, mInterval(std::max(intervalMs, 1u) / 1000.0)
+{
+  TimerService::Get().Add(this);
+}
+
+SharedTimer::~SharedTimer()
+{
+  Stop();
+}
+
+void SharedTimer::Stop()
+{
+  if (mRunning)
+    TimerService::Get().Remove(this);
+}
+
+//static
+TimerService& TimerService::Get()
+{
+  static TimerService* sService = new TimerService;
+  return *sService;
+}
+
+void TimerService::Add(SharedTimer* pTimer)
+{
+  WDL_MutexLock lock(&mMutex);
+
+  if (!mTickDepth)
+    mRetiredOSTimer = nullptr;
+
+  pTimer->mNextTime = GetTime() + pTimer->mInterval;
+  pTimer->mRunning = true;
+  mTimers.Add(pTimer);
+  UpdateOSTimer();
+}
+
+void TimerService::Remove(SharedTimer* pTimer)
+{
+  WDL_MutexLock lock(&mMutex);
+
+  pTimer->mRunning = false;
+
+  if (pTimer == mCurrentTimer)
+    mCurrentTimer = nullptr;
+
+  const int idx = mTimers.Find(pTimer);
+
+  if (idx < 0)
+    return;
+
+  if (mTickDepth)
+    mTimers.Set(idx, nullptr); // the tick is iterating, it compacts the list when it has finished
+  else
+    mTimers.Delete(idx);
+
+  UpdateOSTimer();
+}
+
+void TimerService::Tick()
+{
+  WDL_MutexLock lock(&mMutex);
+
+  // the retired OS timer isn't the one that is running this
+  if (!mTickDepth)
+    mRetiredOSTimer = nullptr;
+
+  mTickDepth++; // a callback can run a modal loop, which ticks again
+
+  const double now = GetTime();
+  const double tolerance = 0.5 * mTickMs / 1000.0;
+
+  // timers that are added by a callback are appended, and run when they are due
+  for (auto i = 0; i < mTimers.GetSize(); i++)
+  {
+    SharedTimer* pTimer = mTimers.Get(i);
+
+    // a timer without its function is running further up the stack, in a modal loop
+    if (!pTimer || !pTimer->mTimerFunc || pTimer->mNextTime > now + tolerance)
+      continue;
+
+    pTimer->mScheduledTime = pTimer->mNextTime;
+    pTimer->mFireTime = now;
+
+    // drift-free: the next time is a whole number of intervals on, skipping the ticks that were missed rather than running them in a burst
+    pTimer->mNextTime += pTimer->mInterval * std::max(1., std::ceil((now - pTimer->mNextTime) / pTimer->mInterval));
+
+    // the callback can stop or delete any timer, including this one, so it runs from here and is only given back if its timer is still running
+    Timer::ITimerFunction func = std::move(pTimer->mTimerFunc);
+    SharedTimer* pPrevTimer = mCurrentTimer;
+    mCurrentTimer = pTimer;
+    func(*pTimer);
+
+    if (mCurrentTimer == pTimer)
+      pTimer->mTimerFunc = std::move(func);
+
+    mCurrentTimer = pPrevTimer;
+  }
+
+  if (--mTickDepth == 0)
+  {
+    for (auto i = mTimers.GetSize() - 1; i >= 0; i--)
+    {
+      if (!mTimers.Get(i))
+        mTimers.Delete(i);
+    }
+
+    if (mTickChanged)
+    {
+      mTickChanged = false;
+      UpdateOSTimer();
+    }
+  }
+}
+
+void TimerService::UpdateOSTimer()
+{
+  uint32_t tickMs = 0;
+
+  for (auto i = 0; i < mTimers.GetSize(); i++)
+  {
+    if (SharedTimer* pTimer = mTimers.Get(i))
+    {
+      const uint32_t intervalMs = std::max(kMinTickMs, static_cast<uint32_t>(pTimer->mInterval * 1000.0 + 0.5));
+      tickMs = tickMs ? std::min(tickMs, intervalMs) : intervalMs;
+    }
+  }
+
+#if defined OS_LINUX
+  IRunLoop* pRunLoop = mRunLoops.GetSize() ? mRunLoops.Get(mRunLoops.GetSize() - 1) : nullptr;
+
+  if (tickMs == mTickMs && (!tickMs || pRunLoop == mOSTimerRunLoop))
+    return;
+#else
+  if (tickMs == mTickMs)
+    return;
+#endif
+
+  // a tick can change the timers several times, so the new OS timer is made once it has finished
+  if (mTickDepth && tickMs)
+  {
+    mTickChanged = true;
+    return;
+  }
+
+  // this can be running in the OS timer's callback, so it is only stopped here
+  if (mOSTimer)
+  {
+    mOSTimer->Stop();
+    mRetiredOSTimer = std::move(mOSTimer);
+  }
+
+  mTickMs = tickMs;
+
+#if defined OS_LINUX
+  mOSTimerRunLoop = tickMs ? pRunLoop : nullptr;
+
+  if (tickMs)
+    mOSTimer = std::make_unique<Timer_impl>([this](Timer& t) { Tick(); }, tickMs, pRunLoop);
+#else
+  if (tickMs)
+    mOSTimer = std::make_unique<Timer_impl>([this](Timer& t) { Tick(); }, tickMs);
+#endif
+}
+
+#if defined OS_LINUX
+void TimerService::AddRunLoop(IRunLoop* pRunLoop)
+{
+  WDL_MutexLock lock(&mMutex);
+
+  if (!pRunLoop || mRunLoops.Find(pRunLoop) >= 0)
+    return;
+
+  mRunLoops.Add(pRunLoop);
+  UpdateOSTimer();
+}
+
+void TimerService::RemoveRunLoop(IRunLoop* pRunLoop)
+{
+  WDL_MutexLock lock(&mMutex);
+
+  if (mRunLoops.Find(pRunLoop) < 0)
+    return;
+
+  mRunLoops.DeletePtr(pRunLoop);
+
+  // the loop is going away, so the OS timer comes off it now, even from inside a tick
+  if (mOSTimer && mOSTimerRunLoop == pRunLoop)
+  {
+    mOSTimer->Stop();
+    mRetiredOSTimer = std::move(mOSTimer);
+    mOSTimerRunLoop = nullptr;
+    mTickMs = 0;
+  }
+
+  UpdateOSTimer();
+}
 #endif
@@ -20,8 +20,10 @@
 #include <cstring>
 #include <stdint.h>
 #include <cstring>
+#include <chrono>
 #include <cmath>
 #include <functional>
+#include <memory>
 #include "ptrlist.h"
 #include "mutex.h"
 
@@ -44,9 +46,20 @@ struct Timer
   
   using ITimerFunction = std::function<void(Timer& t)>;
 
+  /** Create a timer on the process-wide TimerService, which runs all the timers from one OS timer on the main thread */
   static Timer* Create(ITimerFunction func, uint32_t intervalMs);
   virtual ~Timer() {};
   virtual void Stop() = 0;
+
+  /** @return The time the current callback was due, in seconds on the TimerService::GetTime() clock. Callbacks are scheduled from this rather than from when they ran, so they don't drift */
+  double GetScheduledTime() const { return mScheduledTime; }
+
+  /** @return The time the current callback actually ran, on the same clock */
+  double GetFireTime() const { return mFireTime; }
+
+protected:
+  double mScheduledTime = 0.;
+  double mFireTime = 0.;
 };
 
 #if defined OS_MAC || defined OS_IOS
@@ -95,8 +108,105 @@ private:
   long ID = 0;
   ITimerFunction mTimerFunc;
 };
+#elif defined OS_LINUX
+class IRunLoop;
+
+/** On Linux there is no main thread loop to attach a timer to, so it runs from the host's IRunLoop when TimerService has one, see TimerService::AddRunLoop().
+ * If there is none, or the loop refuses the timer, a timerfd is registered with the loop's file descriptors instead, or with IPollRunLoop::GetDefault()'s when there is no loop */
+class Timer_impl : public Timer
+{
+public:
+  Timer_impl(ITimerFunction func, uint32_t intervalMs, IRunLoop* pRunLoop);
+  ~Timer_impl();
+  void Stop() override;
+  static void TimerProc(void* pContext);
+  static void TimerFDProc(void* pContext);
+
+private:
+  ITimerFunction mTimerFunc;
+  IRunLoop* mRunLoop = nullptr; // the loop it is registered with
+  int mTimerID = 0; // the loop's timer, or 0 if it runs from mFD
+  int mFD = -1;
+};
 #else
   #error NOT IMPLEMENTED
 #endif
 
+/** A timer on the TimerService, what Timer::Create() returns */
+class SharedTimer final : public Timer
+{
+public:
+  SharedTimer(ITimerFunction func, uint32_t intervalMs);
+  ~SharedTimer();
+  void Stop() override;
+
+private:
+  friend class TimerService;
+  ITimerFunction mTimerFunc;
+  double mInterval;
+  double mNextTime = 0.;
+  bool mRunning = false;
+};
+
+/** The process-wide service that runs every Timer::Create() timer from a single OS timer on the main thread, rather than one OS timer each (per plug-in instance, OSC interface and so on).
+ * The OS timer ticks at the shortest registered interval, and each tick runs all the timers that are due within half a tick, so timers with similar intervals
+ * fire together instead of waking the process at slightly different moments. With the handful to few hundred timers of a process, a scan of the list per tick is cheaper than
+ * the buckets of a hashed timer wheel. The OS timer only exists while there are timers, so a plug-in binary can be unloaded once they are destroyed */
+class TimerService final
+{
+public:
+  /** The shortest tick, shorter intervals run at this rate */
+  static constexpr uint32_t kMinTickMs = 4;
+
+  /** @return The service, which is never destroyed in case timers outlive static destruction */
+  static TimerService& Get();
+
+  /** @return The time in seconds on the steady clock that timers are scheduled with */
+  static double GetTime()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /** @return The number of running timers */
+  int NTimers() const { return mTimers.GetSize(); }
+
+  /** @return The interval of the OS timer in milliseconds, or 0 if there are no timers */
+  uint32_t GetTickMs() const { return mTickMs; }
+
+#if defined OS_LINUX
+  /** Run the OS timer from a host's event loop, rather than from a timerfd on IPollRunLoop::GetDefault(), which nothing runs inside a host. The most recently added loop is used.
+   * IEditorDelegate::SetHostRunLoop() calls this
+   * @param pRunLoop The host's loop, which must be removed before it is destroyed */
+  void AddRunLoop(IRunLoop* pRunLoop);
+
+  /** Stop using a host's event loop. If the OS timer was running from it, it moves to the previous loop, or to the fallback timerfd */
+  void RemoveRunLoop(IRunLoop* pRunLoop);
+#endif
+
+private:
+  friend class SharedTimer;
+
+  TimerService() = default;
+
+  void Add(SharedTimer* pTimer);
+  void Remove(SharedTimer* pTimer);
+  void Tick();
+
+  /** Recreate the OS timer if the shortest interval changed. The old one is only stopped, and deleted later, as this can be called from its callback */
+  void UpdateOSTimer();
+
+  WDL_Mutex mMutex;
+  WDL_PtrList<SharedTimer> mTimers; // removed timers are set to nullptr during a tick
+  std::unique_ptr<Timer> mOSTimer;
+  std::unique_ptr<Timer> mRetiredOSTimer;
+  SharedTimer* mCurrentTimer = nullptr; // the timer whose callback is running
+  uint32_t mTickMs = 0;
+  int mTickDepth = 0;
+  bool mTickChanged = false;
+#if defined OS_LINUX
+  WDL_PtrList<IRunLoop> mRunLoops;
+  IRunLoop* mOSTimerRunLoop = nullptr; // the loop mOSTimer was created with
+#endif
+};
+
 END_IPLUG_NAMESPACE
@@ -0,0 +1,585 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc IPlugTracer
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugQueue.h"
+
+#ifndef TRACER_MAX_THREADS
+  /** The number of threads that can have trace buffers at the same time. A thread's buffer is given back when the thread exits */
+  #define TRACER_MAX_THREADS 16
+#endif
+
+#ifndef TRACER_EVENTS_PER_THREAD
+  /** The number of events each thread's buffer holds (each is 256 bytes). The flusher empties the buffers every TRACER_FLUSH_INTERVAL_MS */
+  #define TRACER_EVENTS_PER_THREAD 1024
+#endif
+
+#ifndef TRACER_FLUSH_INTERVAL_MS
+  #define TRACER_FLUSH_INTERVAL_MS 50
+#endif
+
+BEGIN_IPLUG_NAMESPACE
+
+/** The binary event tracer behind Trace(), TRACE and TRACE_SCOPE() in a TRACER_BUILD.
+ * Recording an event doesn't format, lock or allocate, so it can be done on the audio thread: it reads the clock, copies the call site (the function name,
+ * line and format string are stored as pointers to their string literals, so they are identified at compile time) and the binary arguments into an event,
+ * and pushes the event to the calling thread's own lock-free buffer. Strings passed as arguments are copied, up to the space left in the event.
+ * A background thread empties the buffers every TRACER_FLUSH_INTERVAL_MS, formats the events and writes them to LOGFILE as a Chrome trace event file,
+ * which can be opened in chrome://tracing or https://ui.perfetto.dev, or as text to the console if TRACETOSTDOUT is defined.
+ * All the buffers are allocated when the tracer is created, on the first call to Get(). If a buffer is full, or more than TRACER_MAX_THREADS threads trace
+ * at the same time, events are dropped and the count is written to the trace */
+class IPlugTracer final
+{
+public:
+  /** The most arguments an event records, further ones are left out of its message */
+  static constexpr int kMaxArgs = 12;
+
+  /** RAII helper that records a duration event from its construction to its destruction, see TRACE_SCOPE() */
+  class Scope
+  {
+  public:
+    /** @param name The scope's name. It is stored as a pointer so it must outlive the tracer, normally a string literal */
+    Scope(const char* name)
+    : mName(name)
+    {
+      IPlugTracer::Get().Add('B', mName, 0, nullptr);
+    }
+
+    ~Scope()
+    {
+      IPlugTracer::Get().Add('E', mName, 0, nullptr);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* mName;
+  };
+
+  /** @return The tracer, which is created the first time this is called. Call it on the main thread first, e.g. IPlugAPIBase's constructor traces */
+  static IPlugTracer& Get()
+  {
+    static IPlugTracer sTracer;
+    return sTracer;
+  }
+
+  /** Record an event, can be called from any thread
+   * @param phase The Chrome trace event phase, 'i' for an instant event, 'B' or 'E' for the beginning and end of a duration
+   * @param funcName The event's name, normally __FUNCTION__. It is stored as a pointer so it must outlive the tracer
+   * @param line The line number
+   * @param format A printf format string for the arguments, or nullptr. It is stored as a pointer so it must outlive the tracer
+   * @param args The arguments, which can be integers, enums, floating point numbers, strings and pointers */
+  template <typename... Args>
+  void Add(char phase, const char* funcName, int line, const char* format, const Args&... args)
+  {
+    if (!sAlive.load(std::memory_order_acquire))
+      return;
+
+    const int64_t time = GetTime();
+    Slot* pSlot = GetThreadSlot();
+
+    if (!pSlot)
+    {
+      mNDroppedNoSlot.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Event event;
+    event.mTime = time;
+    event.mFuncName = funcName;
+    event.mFormat = format;
+    event.mLine = line;
+    event.mPhase = phase;
+    event.mStrings[kStringsSize - 1] = '\0';
+    (AddArg(event, args), ...);
+
+    if (!pSlot->mQueue.Push(event))
+      pSlot->mNDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /** @return The time in nanoseconds since the tracer was created */
+  int64_t GetTime() const
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStartTime).count();
+  }
+
+  IPlugTracer(const IPlugTracer&) = delete;
+  IPlugTracer& operator=(const IPlugTracer&) = delete;
+
+private:
+  enum EArgType : uint8_t
+  {
+    kArgInt,
+    kArgUInt,
+    kArgDouble,
+    kArgString,
+    kArgPointer
+  };
+
+  static constexpr int kStringsSize = 112;
+
+  /** One recorded event, 256 bytes. Its arguments are stored in binary and only formatted by the flusher */
+  struct Event
+  {
+    int64_t mTime;
+    const char* mFuncName;
+    const char* mFormat;
+    int32_t mLine;
+    char mPhase;
+    uint8_t mNArgs = 0;
+    uint8_t mStringsUsed = 0;
+    uint8_t mArgTypes[kMaxArgs];
+
+    union Arg
+    {
+      int64_t mInt;
+      uint64_t mUInt;
+      double mDouble;
+      const void* mPointer;
+    } mArgs[kMaxArgs];
+
+    char mStrings[kStringsSize]; // string arguments, mUInt is the offset of each one. The last byte is always 0, for strings that didn't fit
+  };
+
+  enum ESlotState : int
+  {
+    kSlotFree,
+    kSlotClaiming,
+    kSlotActive,
+    kSlotRetired // its thread has exited, the flusher frees it once it is empty
+  };
+
+  /** A thread's buffer. Its thread is the only producer and the flusher the only consumer */
+  struct Slot
+  {
+    Slot() : mQueue(TRACER_EVENTS_PER_THREAD) {}
+
+    IPlugQueue<Event> mQueue;
+    std::atomic<int> mState{kSlotFree};
+    std::atomic<int> mNDropped{0};
+    int mThreadID = 0;
+    // flusher only
+    int mNamedThreadID = -1;
+    int mNReportedDropped = 0;
+  };
+
+  /** Gives the thread's slot back when the thread exits */
+  struct ThreadSlot
+  {
+    ~ThreadSlot()
+    {
+      if (mSlot && sAlive.load(std::memory_order_acquire))
+        mSlot->mState.store(kSlotRetired, std::memory_order_release);
+    }
+
+    Slot* mSlot = nullptr;
+  };
+
+  IPlugTracer()
+  : mStartTime(std::chrono::steady_clock::now())
+  {
+#ifndef TRACETOSTDOUT
+  #ifdef OS_WIN
+    char logFilePath[MAX_WIN32_PATH_LEN];
+    snprintf(logFilePath, MAX_WIN32_PATH_LEN, "%s/%s", "C:\\", LOGFILE);
+  #else
+    char logFilePath[MAX_MACOS_PATH_LEN];
+    snprintf(logFilePath, MAX_MACOS_PATH_LEN, "%s/%s", getenv("HOME"), LOGFILE);
+  #endif
+    mFP = fopen(logFilePath, "w");
+
+    if (mFP)
+      fprintf(mFP, "[\n"); // the JSON array form of the trace event format, which can be read without the closing bracket if the process doesn't exit cleanly
+#endif
+
+    sAlive.store(true, std::memory_order_release);
+    mFlusher = std::thread([this]() { RunFlusher(); });
+  }
+
+  ~IPlugTracer()
+  {
+    sAlive.store(false, std::memory_order_release);
+
+    {
+      std::lock_guard<std::mutex> lock(mFlusherMutex);
+      mStopFlusher = true;
+    }
+
+    mFlusherCV.notify_one();
+    mFlusher.join();
+    Flush();
+
+    if (mFP)
+    {
+      fprintf(mFP, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"iPlug2\"}}\n]\n");
+      fclose(mFP);
+    }
+  }
+
+  Slot* GetThreadSlot()
+  {
+    thread_local ThreadSlot tThreadSlot;
+
+    if (!tThreadSlot.mSlot)
+    {
+      for (auto& slot : mSlots)
+      {
+        int expected = kSlotFree;
+
+        if (slot.mState.compare_exchange_strong(expected, kSlotClaiming, std::memory_order_acquire))
+        {
+          slot.mThreadID = mNextThreadID.fetch_add(1, std::memory_order_relaxed);
+          slot.mNDropped.store(0, std::memory_order_relaxed);
+          slot.mState.store(kSlotActive, std::memory_order_release);
+          tThreadSlot.mSlot = &slot;
+          break;
+        }
+      }
+    }
+
+    return tThreadSlot.mSlot;
+  }
+
+  template <typename T>
+  static void AddArg(Event& event, const T& arg)
+  {
+    if (event.mNArgs == kMaxArgs)
+      return;
+
+    auto& value = event.mArgs[event.mNArgs];
+    auto& type = event.mArgTypes[event.mNArgs];
+    using U = std::decay_t<T>;
+
+    if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>)
+    {
+      const char* src = arg;
+
+      if (!src)
+        src = "(null)";
+
+      int pos = event.mStringsUsed;
+      value.mUInt = static_cast<uint64_t>(pos);
+
+      while (pos < kStringsSize - 1 && *src)
+        event.mStrings[pos++] = *src++;
+
+      if (pos < kStringsSize - 1)
+        event.mStrings[pos++] = '\0';
+
+      event.mStringsUsed = static_cast<uint8_t>(pos);
+      type = kArgString;
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+      value.mDouble = static_cast<double>(arg);
+      type = kArgDouble;
+    }
+    else if constexpr (std::is_enum_v<U>)
+    {
+      value.mInt = static_cast<int64_t>(arg);
+      type = kArgInt;
+    }
+    else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+    {
+      value.mInt = static_cast<int64_t>(arg);
+      type = kArgInt;
+    }
+    else if constexpr (std::is_integral_v<U>)
+    {
+      value.mUInt = static_cast<uint64_t>(arg);
+      type = kArgUInt;
+    }
+    else
+    {
+      static_assert(std::is_pointer_v<U>, "Trace() arguments must be integers, enums, floating point numbers, strings or pointers");
+      value.mPointer = static_cast<const void*>(arg);
+      type = kArgPointer;
+    }
+
+    event.mNArgs++;
+  }
+
+  /** Format an event's arguments with its printf format string, the flusher does this rather than the thread that recorded it */
+  static void FormatMessage(const Event& event, char* buf, int bufSize)
+  {
+    const char* fmt = event.mFormat;
+    int pos = 0;
+    int argIdx = 0;
+
+    auto append = [&](int n) { pos = std::min(pos + std::max(n, 0), bufSize - 1); };
+
+    auto nextArg = [&](const Event::Arg*& pArg, EArgType& type) {
+      if (argIdx >= event.mNArgs)
+        return false;
+
+      pArg = &event.mArgs[argIdx];
+      type = static_cast<EArgType>(event.mArgTypes[argIdx++]);
+      return true;
+    };
+
+    auto intValue = [&](const Event::Arg& arg, EArgType type) -> int64_t {
+      return type == kArgDouble ? static_cast<int64_t>(arg.mDouble) : arg.mInt;
+    };
+
+    buf[0] = '\0';
+
+    while (fmt && *fmt && pos < bufSize - 1)
+    {
+      if (*fmt != '%')
+      {
+        buf[pos++] = *fmt++;
+        continue;
+      }
+
+      if (fmt[1] == '%')
+      {
+        buf[pos++] = '%';
+        fmt += 2;
+        continue;
+      }
+
+      // rebuild the conversion specification with the length of the stored argument, e.g. %d for an int becomes %lld
+      char spec[32];
+      int specLen = 0;
+      spec[specLen++] = *fmt++;
+
+      while (*fmt && strchr("-+ #0", *fmt) && specLen < 8)
+        spec[specLen++] = *fmt++;
+
+      for (int i = 0; i < 2; i++) // width, then precision
+      {
+        if (i == 1)
+        {
+          if (*fmt != '.')
+            break;
+
+          spec[specLen++] = *fmt++;
+        }
+
+        if (*fmt == '*')
+        {
+          const Event::Arg* pArg;
+          EArgType type;
+          fmt++;
+          const int value = nextArg(pArg, type) ? static_cast<int>(intValue(*pArg, type)) : 0;
+          specLen += snprintf(spec + specLen, 5, "%d", std::max(std::min(value, 999), -999));
+        }
+        else
+        {
+          while (*fmt >= '0' && *fmt <= '9' && specLen < 12 * (i + 1))
+            spec[specLen++] = *fmt++;
+        }
+      }
+
+      while (*fmt && strchr("hlLqjzt", *fmt))
+        fmt++;
+
+      const char conversion = *fmt;
+
+      if (!conversion)
+        break;
+
+      fmt++;
+
+      const Event::Arg* pArg;
+      EArgType type;
+
+      if (conversion == 'n' || !nextArg(pArg, type))
+        continue;
+
+      char* pDst = buf + pos;
+      const int dstSize = bufSize - pos;
+
+      switch (conversion)
+      {
+        case 'd': case 'i':
+          strcpy(spec + specLen, "lld");
+          append(snprintf(pDst, dstSize, spec, static_cast<long long>(intValue(*pArg, type))));
+          break;
+        case 'u': case 'x': case 'X': case 'o':
+          spec[specLen++] = 'l';
+          spec[specLen++] = 'l';
+          spec[specLen++] = conversion;
+          spec[specLen] = '\0';
+          append(snprintf(pDst, dstSize, spec, static_cast<unsigned long long>(intValue(*pArg, type))));
+          break;
+        case 'c':
+          strcpy(spec + specLen, "c");
+          append(snprintf(pDst, dstSize, spec, static_cast<int>(intValue(*pArg, type))));
+          break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+          spec[specLen++] = conversion;
+          spec[specLen] = '\0';
+          append(snprintf(pDst, dstSize, spec, type == kArgDouble ? pArg->mDouble : type == kArgUInt ? static_cast<double>(pArg->mUInt) : static_cast<double>(pArg->mInt)));
+          break;
+        case 's':
+          strcpy(spec + specLen, "s");
+          append(snprintf(pDst, dstSize, spec, type == kArgString ? event.mStrings + pArg->mUInt : "?"));
+          break;
+        case 'p':
+          strcpy(spec + specLen, "p");
+          append(snprintf(pDst, dstSize, spec, pArg->mPointer));
+          break;
+        default:
+          break;
+      }
+    }
+
+    buf[pos] = '\0';
+  }
+
+  /** Write str as the contents of a JSON string */
+  void WriteJSONString(const char* str)
+  {
+    for (; *str; str++)
+    {
+      const unsigned char c = static_cast<unsigned char>(*str);
+
+      if (c == '"' || c == '\\')
+        fprintf(mFP, "\\%c", c);
+      else if (c < 0x20)
+        fprintf(mFP, "\\u%04x", c);
+      else
+        fputc(c, mFP);
+    }
+  }
+
+  void WriteEvent(const Slot& slot, const Event& event)
+  {
+    char msg[1024];
+    FormatMessage(event, msg, sizeof(msg));
+
+#ifdef TRACETOSTDOUT
+    if (event.mPhase == 'i')
+      printf("[%d:%s:%d]%s\n", slot.mThreadID, event.mFuncName, event.mLine, msg);
+#else
+    if (!mFP)
+      return;
+
+    fprintf(mFP, "{\"name\":\"");
+    WriteJSONString(event.mFuncName ? event.mFuncName : "");
+    fprintf(mFP, "\",\"ph\":\"%c\",%s\"pid\":0,\"tid\":%d,\"ts\":%.3f", event.mPhase, event.mPhase == 'i' ? "\"s\":\"t\"," : "", slot.mThreadID, event.mTime * 1e-3);
+
+    if (event.mFormat)
+    {
+      fprintf(mFP, ",\"args\":{\"line\":%d,\"msg\":\"", event.mLine);
+      WriteJSONString(msg);
+      fprintf(mFP, "\"}");
+    }
+
+    fprintf(mFP, "},\n");
+#endif
+  }
+
+  void WriteDropped(int threadID, int nDropped)
+  {
+#ifdef TRACETOSTDOUT
+    printf("[%d:IPlugTracer]dropped %d events\n", threadID, nDropped);
+#else
+    if (mFP)
+      fprintf(mFP, "{\"name\":\"IPlugTracer dropped events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"count\":%d}},\n", threadID, GetTime() * 1e-3, nDropped);
+#endif
+  }
+
+  /** Empty every thread's buffer into the file. Called on the flusher thread, and once more by the destructor after it has stopped */
+  void Flush()
+  {
+    Event event;
+
+    for (auto& slot : mSlots)
+    {
+      const int state = slot.mState.load(std::memory_order_acquire);
+
+      if (state != kSlotActive && state != kSlotRetired)
+        continue;
+
+      if (slot.mNamedThreadID != slot.mThreadID)
+      {
+        slot.mNamedThreadID = slot.mThreadID;
+        slot.mNReportedDropped = 0;
+#ifndef TRACETOSTDOUT
+        if (mFP)
+          fprintf(mFP, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}},\n", slot.mThreadID, slot.mThreadID);
+#endif
+      }
+
+      while (slot.mQueue.Pop(event))
+        WriteEvent(slot, event);
+
+      const int nDropped = slot.mNDropped.load(std::memory_order_relaxed);
+
+      if (nDropped != slot.mNReportedDropped)
+      {
+        WriteDropped(slot.mThreadID, nDropped - slot.mNReportedDropped);
+        slot.mNReportedDropped = nDropped;
+      }
+
+      // a retired slot's thread is gone and the loads above have seen everything it pushed
+      if (state == kSlotRetired)
+        slot.mState.store(kSlotFree, std::memory_order_release);
+    }
+
+    const int nDroppedNoSlot = mNDroppedNoSlot.exchange(0, std::memory_order_relaxed);
+
+    if (nDroppedNoSlot)
+      WriteDropped(-1, nDroppedNoSlot);
+
+    if (mFP)
+      fflush(mFP);
+  }
+
+  void RunFlusher()
+  {
+    std::unique_lock<std::mutex> lock(mFlusherMutex);
+
+    while (!mStopFlusher)
+    {
+      mFlusherCV.wait_for(lock, std::chrono::milliseconds(TRACER_FLUSH_INTERVAL_MS), [this]() { return mStopFlusher; });
+      lock.unlock();
+      Flush();
+      lock.lock();
+    }
+  }
+
+  static inline std::atomic<bool> sAlive{false}; // false once static destruction has reached the tracer, for threads that trace or exit after it
+
+  const std::chrono::steady_clock::time_point mStartTime;
+  Slot mSlots[TRACER_MAX_THREADS];
+  std::atomic<int> mNextThreadID{0};
+  std::atomic<int> mNDroppedNoSlot{0};
+  FILE* mFP = nullptr;
+  std::thread mFlusher;
+  std::mutex mFlusherMutex;
+  std::condition_variable mFlusherCV;
+  bool mStopFlusher = false;
+};
+
+END_IPLUG_NAMESPACE
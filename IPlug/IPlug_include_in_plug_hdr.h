@@ -69,6 +69,14 @@
 #elif defined WEB_API
   #include "IPlugWeb.h"
   #define PLUGIN_API_BASE IPlugWeb
+#elif defined BENCH_API
+  #include "IPlugBench.h"
+  #define PLUGIN_API_BASE IPlugBench
+  #define API_EXT "bench"
+#elif defined CLAP_API
+  #include "IPlugCLAP.h"
+  #define PLUGIN_API_BASE IPlugCLAP
+  #define API_EXT "clap"
 #elif defined VST3_API
   #define IPLUG_VST3
   #include "IPlugVST3.h"
@@ -105,6 +113,7 @@ END_IPLUG_NAMESPACE
   #define EXPORT __attribute__ ((visibility("default")))
 #elif defined OS_LINUX
   //TODO:
+  #define BUNDLE_ID ""
 #elif defined OS_WEB
   #define BUNDLE_ID ""
 #else
@@ -266,6 +275,31 @@ END_IPLUG_NAMESPACE
   #endif
 #endif
 
+#ifdef CLAP_API
+  #ifndef PLUG_VERSION_STR
+    #error You need to define PLUG_VERSION_STR in config.h - A string to identify the version number
+  #endif
+
+  #ifndef PLUG_URL_STR
+    #pragma message WARN("PLUG_URL_STR not defined, setting to empty string")
+    #define PLUG_URL_STR ""
+  #endif
+
+  #ifndef CLAP_PLUGIN_ID
+    #define CLAP_PLUGIN_ID BUNDLE_DOMAIN "." BUNDLE_MFR "." BUNDLE_NAME
+  #endif
+
+  #ifndef CLAP_FEATURES
+    #if PLUG_TYPE == 1
+      #define CLAP_FEATURES CLAP_PLUGIN_FEATURE_INSTRUMENT
+    #elif PLUG_TYPE == 2
+      #define CLAP_FEATURES CLAP_PLUGIN_FEATURE_NOTE_EFFECT
+    #else
+      #define CLAP_FEATURES CLAP_PLUGIN_FEATURE_AUDIO_EFFECT
+    #endif
+  #endif
+#endif
+
 #ifdef AU_API
   #ifndef AUV2_ENTRY
     #error AUV2_ENTRY not defined - the name of the entry point for a component manager AUv2 plug-in, without quotes
@@ -18,13 +18,17 @@
  * Depending on the API macro defined, a different entry point and helper methods are activated
 */
 
+#if defined IPLUG_RTSAFE_CHECKS
+  #include "IPlugRealtimeChecker_include_in_plug_src.h"
+#endif
+
 #pragma mark - OS_WIN
 
 // clang-format off
 
 #if defined OS_WIN && !defined VST3C_API
   HINSTANCE gHINSTANCE = 0;
-  #if defined(VST2_API) || defined(AAX_API)
+  #if defined(VST2_API) || defined(AAX_API) || defined(CLAP_API)
   #ifdef __MINGW32__
   extern "C"
   #endif
@@ -271,7 +275,70 @@
     
     return 0;
   }
-#elif defined AUv3_API || defined AAX_API || defined APP_API
+#pragma mark - CLAP
+#elif defined CLAP_API
+  static const char* const sCLAPFeatures[] = { CLAP_FEATURES, nullptr };
+
+  static const clap_plugin_descriptor_t sCLAPDescriptor = {
+    CLAP_VERSION_INIT,
+    CLAP_PLUGIN_ID,
+    PLUG_NAME,
+    PLUG_MFR,
+    PLUG_URL_STR,
+    "",                                   // manual url
+    "",                                   // support url
+    PLUG_VERSION_STR,
+    "",                                   // description
+    sCLAPFeatures
+  };
+
+  static uint32_t CLAPGetPluginCount(const clap_plugin_factory_t* pFactory)
+  {
+    return 1;
+  }
+
+  static const clap_plugin_descriptor_t* CLAPGetPluginDescriptor(const clap_plugin_factory_t* pFactory, uint32_t index)
+  {
+    return index == 0 ? &sCLAPDescriptor : nullptr;
+  }
+
+  static const clap_plugin_t* CLAPCreatePlugin(const clap_plugin_factory_t* pFactory, const clap_host_t* pHost, const char* pluginID)
+  {
+    if (!clap_version_is_compatible(pHost->clap_version) || strcmp(pluginID, sCLAPDescriptor.id))
+      return nullptr;
+
+    iplug::IPlugCLAP* pPlug = iplug::MakePlug(iplug::InstanceInfo{pHost, &sCLAPDescriptor});
+    return pPlug ? pPlug->GetCLAPPlugin() : nullptr;
+  }
+
+  static const clap_plugin_factory_t sCLAPFactory = {
+    CLAPGetPluginCount,
+    CLAPGetPluginDescriptor,
+    CLAPCreatePlugin
+  };
+
+  static bool CLAPEntryInit(const char* pluginPath)
+  {
+    return true;
+  }
+
+  static void CLAPEntryDeinit()
+  {
+  }
+
+  static const void* CLAPGetFactory(const char* factoryID)
+  {
+    return strcmp(factoryID, CLAP_PLUGIN_FACTORY_ID) ? nullptr : &sCLAPFactory;
+  }
+
+  // not in an extern "C" block, where the const would give it internal linkage
+  extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+    CLAP_VERSION_INIT,
+    CLAPEntryInit,
+    CLAPEntryDeinit,
+    CLAPGetFactory
+  };
+#elif defined AUv3_API || defined AAX_API || defined APP_API || defined BENCH_API
 // Nothing to do here
 #else
   #error "No API defined!"
@@ -282,15 +349,17 @@
 BEGIN_IPLUG_NAMESPACE
 
 #pragma mark -
-#pragma mark VST2, VST3, AAX, AUv3, APP, WAM, WEB
+#pragma mark VST2, VST3, AAX, AUv3, APP, WAM, WEB, BENCH, CLAP
 
-#if defined VST2_API || defined VST3_API || defined AAX_API || defined AUv3_API || defined APP_API  || defined WAM_API || defined WEB_API
+#if defined VST2_API || defined VST3_API || defined AAX_API || defined AUv3_API || defined APP_API  || defined WAM_API || defined WEB_API || defined BENCH_API || defined CLAP_API
 
 Plugin* MakePlug(const iplug::InstanceInfo& info)
 {
   // From VST3 - is this necessary?
   static WDL_Mutex sMutex;
   WDL_MutexLock lock(&sMutex);
+  TRACE_SCOPE("MakePlug");
+  IMemoryAccountScope memoryAccount; // see IPluginBase::GetMemoryReport()
   
   return new PLUG_CLASS_NAME(info);
 }
@@ -300,6 +369,8 @@ Plugin* MakePlug(const iplug::InstanceInfo& info)
 
 Plugin* MakePlug(void* pMemory)
 {
+  TRACE_SCOPE("MakePlug");
+  IMemoryAccountScope memoryAccount; // see IPluginBase::GetMemoryReport()
   iplug::InstanceInfo info;
   info.mCocoaViewFactoryClassName.Set(AUV2_VIEW_CLASS_STR);
     
@@ -316,6 +387,8 @@ Steinberg::FUnknown* MakeController()
 {
   static WDL_Mutex sMutex;
   WDL_MutexLock lock(&sMutex);
+  TRACE_SCOPE("MakeController");
+  IMemoryAccountScope memoryAccount; // see IPluginBase::GetMemoryReport()
   IPlugVST3Controller::iplug::InstanceInfo info;
   info.mOtherGUID = Steinberg::FUID(VST3_PROCESSOR_UID);
   // If you are trying to build a distributed VST3 plug-in and you hit an error here like "no matching constructor..." or 
@@ -331,6 +404,8 @@ Steinberg::FUnknown* MakeProcessor()
 {
   static WDL_Mutex sMutex;
   WDL_MutexLock lock(&sMutex);
+  TRACE_SCOPE("MakeProcessor");
+  IMemoryAccountScope memoryAccount; // see IPluginBase::GetMemoryReport()
   IPlugVST3Processor::iplug::InstanceInfo info;
   info.mOtherGUID = Steinberg::FUID(VST3_CONTROLLER_UID);
   return static_cast<Steinberg::Vst::IAudioProcessor*>(new PLUG_CLASS_NAME(info));
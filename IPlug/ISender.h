@@ -20,11 +20,11 @@
 
 #include "IPlugPlatform.h"
 #include "IPlugQueue.h"
+#include "IPlugSIMD.h"
+#include <algorithm>
 #include <array>
-
-#if defined OS_IOS || defined OS_MAC
-#include <Accelerate/Accelerate.h>
-#endif
+#include <atomic>
+#include <cmath>
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -107,6 +107,80 @@ private:
   IPlugQueue<ISenderData<MAXNC, T>> mQueue {QUEUE_SIZE};
 };
 
+/** ISnapshotSender is an alternative to ISender for data where only the latest frame matters, such as a scope or spectrum frame.
+ * Rather than queuing copies it keeps three ISenderData buffers: the audio thread fills one in place and publishes it with an atomic exchange, and TransmitData() hands the newest published one to the controls without copying it.
+ * Frames published between two calls to TransmitData() are skipped rather than queued */
+template <int MAXNC = 1, typename T = float>
+class ISnapshotSender
+{
+public:
+  static constexpr int kUpdateMessage = ISender<MAXNC, 1, T>::kUpdateMessage;
+
+  /** @return The buffer to fill on the realtime audio thread. It belongs to the audio thread until PublishData(), after which this returns a different buffer, holding an older frame */
+  ISenderData<MAXNC, T>& GetWriteData() { return mBuffers[mWriteIdx]; }
+
+  /** Make the write buffer the latest snapshot. This can be called on the realtime audio thread, it doesn't block or copy */
+  void PublishData()
+  {
+    mWriteIdx = mLatest.exchange(mWriteIdx | kFreshBit, std::memory_order_acq_rel) & kIdxMask;
+  }
+
+  /** Copies a data element into the write buffer and publishes it. This can be called on the realtime audio thread. */
+  void PushData(const ISenderData<MAXNC, T>& d)
+  {
+    GetWriteData() = d;
+    PublishData();
+  }
+
+  /** Sends the latest snapshot to its control, if one was published since the last call.
+   *  This must be called on the main thread - typically in MyPlugin::OnIdle() */
+  void TransmitData(IEditorDelegate& dlg)
+  {
+    if (AcquireLatest())
+    {
+      const ISenderData<MAXNC, T>& d = mBuffers[mReadIdx];
+      assert(d.ctrlTag != kNoTag && "You must supply a control tag");
+      dlg.SendControlMsgFromDelegate(d.ctrlTag, kUpdateMessage, sizeof(ISenderData<MAXNC, T>), (void*) &d);
+    }
+  }
+
+  /** This variation can be used if you need to supply multiple controls with the same snapshot, overriding the tag in the data packet
+   @param dlg The editor delegate
+   @param ctrlTags A list of control tags that should receive the updates from this sender */
+  void TransmitDataToControlsWithTags(IEditorDelegate& dlg, const std::initializer_list<int>& ctrlTags)
+  {
+    if (AcquireLatest())
+    {
+      ISenderData<MAXNC, T>& d = mBuffers[mReadIdx];
+
+      for (auto tag : ctrlTags)
+      {
+        d.ctrlTag = tag;
+        dlg.SendControlMsgFromDelegate(tag, kUpdateMessage, sizeof(ISenderData<MAXNC, T>), (void*) &d);
+      }
+    }
+  }
+
+private:
+  /** Swap the read buffer for the latest snapshot, if it is newer */
+  bool AcquireLatest()
+  {
+    if (!(mLatest.load(std::memory_order_relaxed) & kFreshBit))
+      return false;
+
+    mReadIdx = mLatest.exchange(mReadIdx, std::memory_order_acq_rel) & kIdxMask;
+    return true;
+  }
+
+  static constexpr int kIdxMask = 3;
+  static constexpr int kFreshBit = 4;
+
+  std::array<ISenderData<MAXNC, T>, 3> mBuffers;
+  int mWriteIdx = 0; // audio thread
+  int mReadIdx = 1; // main thread
+  std::atomic<int> mLatest {2}; // the buffer in between, with kFreshBit set when it hasn't been read
+};
+
 /** IPeakSender is a utility class which can be used to defer peak data from sample buffers for sending to the GUI
  * It sends the average peak value over a certain time window.
  */
@@ -130,7 +204,8 @@ public:
   void SetWindowSizeMs(double timeMs, double sampleRate)
   {
     mWindowSizeMs = static_cast<float>(timeMs);
-    mWindowSize = static_cast<int>(timeMs * 0.001 * sampleRate);
+    mWindowSize = std::max(1, static_cast<int>(timeMs * 0.001 * sampleRate));
+    mCount = 0;
   }
   
   /** Queue peaks from sample buffers into the sender This can be called on the realtime audio thread.
@@ -141,7 +216,8 @@ public:
    @param chanOffset the starting channel */
   void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
   {
-    for (auto s = 0; s < nFrames; s++)
+    // each channel is summed a run of frames at a time, up to the end of the block or of the window, with the vectorized kernels
+    for (auto s = 0; s < nFrames;)
     {
       if (mCount == 0)
       {
@@ -162,13 +238,17 @@ public:
         mPreviousSum = sum;
       }
       
+      const int n = std::min(nFrames - s, mWindowSize - mCount);
+
       for (auto c = chanOffset; c < (chanOffset + nChans); c++)
       {
-        mPeaks[c] += std::fabs(static_cast<float>(inputs[c][s]));
+        sample peak = 0., sum = 0.;
+        VectorPeakSumAbs(inputs[c] + s, n, peak, sum);
+        mPeaks[c] += static_cast<float>(sum);
       }
       
-      mCount++;
-      mCount %= mWindowSize;
+      s += n;
+      mCount = (mCount + n) % mWindowSize;
     }
   }
 private:
@@ -219,6 +299,26 @@ public:
       return mPreviousOutput;
     }
 
+    /** Update the follower once, with coefficients from GetCoefficient(), e.g. once per metering window
+     * @param input The new value to follow
+     * @param attackCoeff The coefficient while the input is rising
+     * @param decayCoeff The coefficient while the input is falling
+     * @return The smoothed value */
+    inline float ProcessWindow(float input, float attackCoeff, float decayCoeff)
+    {
+      mPreviousOutput += (input - mPreviousOutput) * (input > mPreviousOutput ? attackCoeff : decayCoeff);
+      denormal_fix(&mPreviousOutput);
+      return mPreviousOutput;
+    }
+
+    /** @param time The time constant, in updates, i.e. in windows for a follower updated once per window
+     * @return The exact one-pole coefficient for that time constant, 1 - e^(-1/time). For long times it is the 1/time that Process() steps by, and unlike that
+     * it is still correct for times of a few windows or less, so the ballistics don't depend on the window size */
+    static float GetCoefficient(double time)
+    {
+      return time > 0. ? static_cast<float>(1. - std::exp(-1. / time)) : 1.f;
+    }
+
   private:
     float mPreviousOutput = 0.0f;
   };
@@ -238,8 +338,6 @@ public:
   void Reset(double sampleRate)
   {
     SetWindowSizeMs(mWindowSizeMs, sampleRate);
-    SetAttackTimeMs(mAttackTimeMs, sampleRate);
-    SetDecayTimeMs(mDecayTimeMs, sampleRate);
     SetPeakHoldTimeMs(mPeakHoldTimeMs, sampleRate);
     std::fill(mHeldPeaks.begin(), mHeldPeaks.end(), 0.0f);
   }
@@ -247,25 +345,25 @@ public:
   void SetAttackTimeMs(double timeMs, double sampleRate)
   {
     mAttackTimeMs = static_cast<float>(timeMs);
-    mAttackTimeSamples = static_cast<float>(timeMs * 0.001 * (sampleRate / double(mWindowSize)));
+    mAttackCoeff = EnvelopeFollower::GetCoefficient(timeMs * 0.001 * (sampleRate / double(mWindowSize)));
   }
   
   void SetDecayTimeMs(double timeMs, double sampleRate)
   {
     mDecayTimeMs = static_cast<float>(timeMs);
-    mDecayTimeSamples = static_cast<float>(timeMs * 0.001 * (sampleRate / mWindowSize));
+    mDecayCoeff = EnvelopeFollower::GetCoefficient(timeMs * 0.001 * (sampleRate / double(mWindowSize)));
   }
   
+  /** Set the window that the peak and average are measured over, which is also how often they are sent. The attack and decay times are kept */
   void SetWindowSizeMs(double timeMs, double sampleRate)
   {
     mWindowSizeMs = static_cast<float>(timeMs);
-    mWindowSize = static_cast<int>(timeMs * 0.001 * sampleRate);
-
-    for (auto i=0; i<MAXNC; i++)
-    {
-      mBuffers[i].resize(mWindowSize);
-      std::fill(mBuffers[i].begin(), mBuffers[i].end(), 0.0f);
-    }
+    mWindowSize = std::max(1, static_cast<int>(timeMs * 0.001 * sampleRate));
+    mCount = 0;
+    std::fill(mWindowPeaks.begin(), mWindowPeaks.end(), 0.0f);
+    std::fill(mWindowSums.begin(), mWindowSums.end(), 0.0f);
+    SetAttackTimeMs(mAttackTimeMs, sampleRate);
+    SetDecayTimeMs(mDecayTimeMs, sampleRate);
   }
   
   void SetPeakHoldTimeMs(double timeMs, double sampleRate)
@@ -283,15 +381,10 @@ public:
    @param chanOffset the starting channel */
   void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
   {
-    for (auto s = 0; s < nFrames; s++)
+    // the peak and the sum of each window are accumulated a run of frames at a time, up to the end of the block or of the window, with the vectorized kernels,
+    // and the envelope followers and peak holds are updated once per window
+    for (auto s = 0; s < nFrames;)
     {
-      int windowPos = s % mWindowSize;
-      
-      for (auto c = chanOffset; c < (chanOffset + nChans); c++)
-      {
-        mBuffers[c][windowPos] = static_cast<float>(inputs[c][s]);
-      }
-      
       if (mCount == 0)
       {
         ISenderData<MAXNC, std::pair<float, float>> d {ctrlTag, nChans, chanOffset};
@@ -300,45 +393,16 @@ public:
         
         for (auto c = chanOffset; c < (chanOffset + nChans); c++)
         {
-          auto peakVal = 0.0f;
-          auto avgVal = 0.0f;
-#if defined OS_IOS || defined OS_MAC
-          vDSP_vabs(mBuffers[c].data(), 1, mBuffers[c].data(), 1, mWindowSize);
-          vDSP_maxv(mBuffers[c].data(), 1, &peakVal, mWindowSize);
-          
-          if (mRMSMode)
-          {
-            vDSP_rmsqv(mBuffers[c].data(), 1, &avgVal, mWindowSize);
-          }
-          else
-          {
-            vDSP_meanv(mBuffers[c].data(), 1, &avgVal, mWindowSize);
-          }
-#else
-          for (auto i=0; i<mWindowSize; i++)
-          {
-            auto absVal = std::fabs(mBuffers[c][i]);
-            
-            if (absVal > peakVal)
-            {
-              peakVal = absVal;
-            }
-            
-            if (mRMSMode)
-            {
-              absVal = absVal * absVal;
-            }
-            
-            avgVal += absVal;
-          }
-          
-          avgVal /= static_cast<float>(mWindowSize);
+          const auto peakVal = mWindowPeaks[c];
+          auto avgVal = mWindowSums[c] / static_cast<float>(mWindowSize);
           
           if (mRMSMode)
           {
             avgVal = std::sqrt(avgVal);
           }
-#endif
+          
+          mWindowPeaks[c] = 0.0f;
+          mWindowSums[c] = 0.0f;
       
           // set peak-hold value
           if (mPeakHoldCounters[c] <= 0)
@@ -362,7 +426,7 @@ public:
           std::get<0>(d.vals[c]) = mHeldPeaks[c];
           
           // set avg value
-          auto smoothedAvg = mEnvFollowers[c].Process(avgVal, mAttackTimeSamples, mDecayTimeSamples);
+          auto smoothedAvg = mEnvFollowers[c].ProcessWindow(avgVal, mAttackCoeff, mDecayCoeff);
           std::get<1>(d.vals[c]) = smoothedAvg;
           
           avgSum += smoothedAvg;
@@ -394,8 +458,23 @@ public:
         mPreviousSum = avgSum;
       }
       
-      mCount++;
-      mCount %= mWindowSize;
+      const int n = std::min(nFrames - s, mWindowSize - mCount);
+      
+      for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+      {
+        sample peak = 0., sum = 0.;
+        
+        if (mRMSMode)
+          VectorPeakSumSquares(inputs[c] + s, n, peak, sum);
+        else
+          VectorPeakSumAbs(inputs[c] + s, n, peak, sum);
+        
+        mWindowPeaks[c] = std::max(mWindowPeaks[c], static_cast<float>(peak));
+        mWindowSums[c] += static_cast<float>(sum);
+      }
+      
+      s += n;
+      mCount = (mCount + n) % mWindowSize;
     }
   }
 private:
@@ -409,10 +488,11 @@ private:
   float mAttackTimeMs = 1.f;
   float mDecayTimeMs = 100.f;
   float mPeakHoldTimeMs = 100.f;
-  float mAttackTimeSamples = 1.0f;
-  float mDecayTimeSamples = DEFAULT_SAMPLE_RATE/10.0f;
+  float mAttackCoeff = 1.0f;
+  float mDecayCoeff = 0.01f;
   std::array<float, MAXNC> mHeldPeaks = {0};
-  std::array<std::vector<float>, MAXNC> mBuffers;
+  std::array<float, MAXNC> mWindowPeaks = {0}; // the peak of the window so far
+  std::array<float, MAXNC> mWindowSums = {0}; // the sum of the absolute values, or of the squares in RMS mode, of the window so far
   std::array<int, MAXNC> mPeakHoldCounters;
   std::array<EnvelopeFollower, MAXNC> mEnvFollowers;
 };
@@ -491,4 +571,82 @@ private:
   float mThreshold = 0.01f;
 };
 
+/** IBufferSnapshotSender sends the same buffers as IBufferSender, but through an ISnapshotSender: samples are written straight into the snapshot being filled, and the UI only receives the latest complete buffer.
+ * Use it for controls that draw the latest buffer, such as IVScopeControl, and IBufferSender for those that need every buffer, such as IVDisplayControl */
+template <int MAXNC = 1, int MAXBUF = 128>
+class IBufferSnapshotSender : public ISnapshotSender<MAXNC, std::array<float, MAXBUF>>
+{
+public:
+  using Base = ISnapshotSender<MAXNC, std::array<float, MAXBUF>>;
+
+  IBufferSnapshotSender(double minThresholdDb = -90., int bufferSize = MAXBUF)
+  : mThreshold(static_cast<float>(DBToAmp(minThresholdDb)))
+  {
+    SetBufferSize(bufferSize);
+  }
+
+  /** Write sample buffers into the sender, publishing each complete buffer that is over the required threshold. This can be called on the realtime audio thread.
+   @param inputs the sample buffers
+   @param nFrames the number of sample frames in the input buffers
+   @param ctrlTag a control tag to indicate which control to send the buffers to. Note: if you don't supply the control tag here, you must use TransmitDataToControlsWithTags() and specify one or more tags there
+   @param nChans the number of channels of data that should be sent
+   @param chanOffset the starting channel */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    for (auto s = 0; s < nFrames; s++)
+    {
+      if (mBufCount == mBufferSize)
+      {
+        float sum = 0.0f;
+        for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+        {
+          sum += mRunningSum[c];
+          mRunningSum[c] = 0.0f;
+        }
+
+        if (sum > mThreshold || mPreviousSum > mThreshold)
+        {
+          ISenderData<MAXNC, std::array<float, MAXBUF>>& d = Base::GetWriteData();
+          d.ctrlTag = ctrlTag;
+          d.nChans = nChans;
+          d.chanOffset = chanOffset;
+          Base::PublishData();
+        }
+
+        mPreviousSum = sum;
+        mBufCount = 0;
+      }
+
+      ISenderData<MAXNC, std::array<float, MAXBUF>>& d = Base::GetWriteData();
+
+      for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+      {
+        const float inputSample = static_cast<float>(inputs[c][s]);
+        d.vals[c][mBufCount] = inputSample;
+        mRunningSum[c] += std::fabs(inputSample);
+      }
+
+      mBufCount++;
+    }
+  }
+
+  void SetBufferSize(int bufferSize)
+  {
+    assert(bufferSize > 0);
+    assert(bufferSize <= MAXBUF);
+
+    mBufferSize = bufferSize;
+    mBufCount = 0;
+  }
+
+  int GetBufferSize() const { return mBufferSize; }
+
+private:
+  int mBufCount = 0;
+  int mBufferSize = MAXBUF;
+  std::array<float, MAXNC> mRunningSum {0.};
+  float mPreviousSum = 1.f;
+  float mThreshold = 0.01f;
+};
+
 END_IPLUG_NAMESPACE
@@ -2,19 +2,146 @@ ReaperExtBase::ReaperExtBase(reaper_plugin_info_t* pRec)
 : EDITOR_DELEGATE_CLASS(0) // zero params
 , mRec(pRec)
 {
+  mAudioHook.OnAudioBuffer = AudioHookCallback;
+  mAudioHook.userdata1 = this;
+  mAudioHookPtrs.Resize(2 * kMaxAudioHookChannels);
+  mAudioHookMsgScratch.Resize(mAudioHookMsgs.MaxMessageSize());
+
   mTimer = std::unique_ptr<Timer>(Timer::Create(std::bind(&ReaperExtBase::OnTimer, this, std::placeholders::_1), IDLE_TIMER_RATE));
 }
 
 ReaperExtBase::~ReaperExtBase()
 {
+  SetAudioHookEnabled(false);
   mTimer->Stop();
 }
 
 void ReaperExtBase::OnTimer(Timer& t)
 {
+  DrainAudioHookQueues();
   OnIdle();
 }
 
+bool ReaperExtBase::SetAudioHookEnabled(bool enable, int maxBlockSize)
+{
+  if (enable == mAudioHookEnabled)
+  {
+    // the block size is read on the audio thread, so it is only changed while the hook is unregistered
+    if (!enable || maxBlockSize == mAudioHookMaxBlockSize)
+      return true;
+
+    SetAudioHookEnabled(false);
+  }
+
+  // this can be called from the constructor, before the entry point imports the API functions
+  if (!Audio_RegHardwareHook)
+    *((void**) &Audio_RegHardwareHook) = mRec->GetFunc("Audio_RegHardwareHook");
+
+  if (!Audio_RegHardwareHook)
+    return false;
+
+  if (enable)
+  {
+    mAudioHookMaxBlockSize = std::max(maxBlockSize, 0);
+    mAudioHookSampleRate = 0.;
+    mAudioHookBlockSize = 0;
+
+    if (Audio_RegHardwareHook(true, &mAudioHook) <= 0)
+      return false;
+  }
+  else
+  {
+    // returns once the audio thread is no longer in the hook
+    Audio_RegHardwareHook(false, &mAudioHook);
+  }
+
+  mAudioHookEnabled = enable;
+  return true;
+}
+
+//static
+void ReaperExtBase::AudioHookCallback(bool isPost, int len, double srate, audio_hook_register_t* pReg)
+{
+  ReaperExtBase* pExt = static_cast<ReaperExtBase*>(pReg->userdata1);
+
+  if (len <= 0 || !pReg->GetBuffer)
+    return;
+
+  const int maxBlockSize = pExt->mAudioHookMaxBlockSize;
+  const int blockSize = maxBlockSize > 0 ? std::min(len, maxBlockSize) : len;
+
+  if (srate != pExt->mAudioHookSampleRate || blockSize > pExt->mAudioHookBlockSize)
+  {
+    pExt->mAudioHookSampleRate = srate;
+    pExt->mAudioHookBlockSize = blockSize;
+    pExt->OnAudioHookReset(srate, blockSize);
+  }
+
+  const int nInputs = std::min(pReg->input_nch, kMaxAudioHookChannels);
+  const int nOutputs = std::min(pReg->output_nch, kMaxAudioHookChannels);
+  ReaSample** ppBuffers = pExt->mAudioHookPtrs.Get();
+  ReaSample** inputs = ppBuffers;
+  ReaSample** outputs = ppBuffers + kMaxAudioHookChannels;
+
+  for (int offset = 0; offset < len; offset += blockSize)
+  {
+    // GetBuffer() may only be called from the hook, so the pointers are fetched for each buffer
+    for (int ch = 0; ch < nInputs; ch++)
+    {
+      ReaSample* pBuffer = pReg->GetBuffer(false, ch);
+      inputs[ch] = pBuffer ? pBuffer + offset : nullptr;
+    }
+
+    for (int ch = 0; ch < nOutputs; ch++)
+    {
+      ReaSample* pBuffer = pReg->GetBuffer(true, ch);
+      outputs[ch] = pBuffer ? pBuffer + offset : nullptr;
+    }
+
+    pExt->OnAudioHookBlock(isPost, inputs, nInputs, outputs, nOutputs, std::min(blockSize, len - offset), srate);
+  }
+}
+
+bool ReaperExtBase::SendControlValueFromAudioHook(int ctrlTag, double normalizedValue)
+{
+  return mAudioHookValues.Push({ctrlTag, normalizedValue});
+}
+
+bool ReaperExtBase::SendControlMsgFromAudioHook(int ctrlTag, int msgTag, int dataSize, const void* pData)
+{
+  if (dataSize < 0 || kAudioHookMsgHeaderSize + dataSize > mAudioHookMsgScratch.GetSize())
+    return false;
+
+  uint8_t* pScratch = mAudioHookMsgScratch.Get();
+  memcpy(pScratch, &msgTag, sizeof(int));
+
+  if (dataSize)
+    memcpy(pScratch + kAudioHookMsgHeaderSize, pData, dataSize);
+
+  return mAudioHookMsgs.Push(ctrlTag, kAudioHookMsgHeaderSize + dataSize, pScratch);
+}
+
+void ReaperExtBase::DrainAudioHookQueues()
+{
+  AudioHookValue value;
+
+  while (mAudioHookValues.Pop(value))
+    SendControlValueFromDelegate(value.mCtrlTag, value.mValue);
+
+  int ctrlTag, size;
+  const uint8_t* pMsg;
+
+  while (mAudioHookMsgs.Pop(ctrlTag, size, pMsg))
+  {
+    int msgTag;
+    memcpy(&msgTag, pMsg, sizeof(int));
+    const int dataSize = size - kAudioHookMsgHeaderSize;
+    SendControlMsgFromDelegate(ctrlTag, msgTag, dataSize, dataSize ? pMsg + kAudioHookMsgHeaderSize : nullptr);
+  }
+
+  mAudioHookMsgs.Release();
+}
+
 auto ClientResize = [](HWND hWnd, int nWidth, int nHeight) {
   RECT rcClient, rcWindow;
   POINT ptDiff;
@@ -17,9 +17,20 @@
 */
 
 #include "IPlugTimer.h"
+#include "IPlugQueue.h"
 #include "IPlugDelegate_select.h"
 
-struct reaper_plugin_info_t;
+#include "reaper_plugin.h"
+
+/** The size in bytes of the arena that carries messages from the audio hook to the UI, see ReaperExtBase::SendControlMsgFromAudioHook() */
+#ifndef REAPEREXT_AUDIO_HOOK_MSG_BYTES
+  #define REAPEREXT_AUDIO_HOOK_MSG_BYTES 65536
+#endif
+
+/** The number of control values that can be waiting to go from the audio hook to the UI, see ReaperExtBase::SendControlValueFromAudioHook() */
+#ifndef REAPEREXT_AUDIO_HOOK_VALUE_QUEUE_SIZE
+  #define REAPEREXT_AUDIO_HOOK_VALUE_QUEUE_SIZE 1024
+#endif
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -51,6 +62,46 @@ public:
   
   void ToggleDocking();
 
+  /** Register (or unregister) a callback on REAPER's audio thread, before and after REAPER processes each hardware buffer, see audio_hook_register_t. Each buffer is passed to OnAudioHookBlock().
+   * Unregister it in the destructor of the derived class, since the hook can be called until then
+   * @param enable \c true to register the hook, \c false to unregister it
+   * @param maxBlockSize If greater than 0, buffers longer than this are split into blocks of at most this many frames, so that analysis can run at a fixed cadence
+   * @return \c true on success */
+  bool SetAudioHookEnabled(bool enable, int maxBlockSize = 0);
+
+  /** @return \c true if the audio hook is registered, see SetAudioHookEnabled() */
+  bool GetAudioHookEnabled() const { return mAudioHookEnabled; }
+
+  /** Called on the audio thread before the first block, and whenever the sample rate or the largest block size changes
+   * @param sampleRate The sample rate of REAPER's audio device
+   * @param blockSize The largest number of frames OnAudioHookBlock() will be called with, until the next reset */
+  virtual void OnAudioHookReset(double sampleRate, int blockSize) {}
+
+  /** Called on the audio thread for each hardware buffer, or each block of it, see SetAudioHookEnabled(). It must not block or allocate.
+   * Use SendControlValueFromAudioHook() and SendControlMsgFromAudioHook() to send results to the UI
+   * @param isPost \c false before REAPER processes the buffer, \c true after
+   * @param inputs The hardware input channels. A channel may be nullptr
+   * @param nInputs The number of input channels
+   * @param outputs The hardware output channels, which can be modified. A channel may be nullptr
+   * @param nOutputs The number of output channels
+   * @param nFrames The number of frames in the block
+   * @param sampleRate The sample rate */
+  virtual void OnAudioHookBlock(bool isPost, ReaSample** inputs, int nInputs, ReaSample** outputs, int nOutputs, int nFrames, double sampleRate) {}
+
+  /** Queue a value for a control, from the audio hook. It is sent to the UI with SendControlValueFromDelegate() on the next timer tick. Lock-free, call from OnAudioHookBlock()
+   * @param ctrlTag The control's tag
+   * @param normalizedValue The normalized value
+   * @return \c false if the queue was full */
+  bool SendControlValueFromAudioHook(int ctrlTag, double normalizedValue);
+
+  /** Queue a message for a control, from the audio hook. It is sent to the UI with SendControlMsgFromDelegate() on the next timer tick. Lock-free, call from OnAudioHookBlock()
+   * @param ctrlTag The control's tag
+   * @param msgTag The message's tag
+   * @param dataSize The size of the data in bytes, which is copied
+   * @param pData The data
+   * @return \c false if the arena was full, or the message is bigger than REAPEREXT_AUDIO_HOOK_MSG_BYTES allows */
+  bool SendControlMsgFromAudioHook(int ctrlTag, int msgTag, int dataSize, const void* pData);
+
 public:
   // Reaper calls back to this when it wants to execute an action registered by the extension plugin
   static bool HookCommandProc(int command, int flag);
@@ -63,9 +114,35 @@ private:
   
   void OnTimer(Timer& t);
 
+  /** The audio_hook_register_t callback, which calls OnAudioHookBlock() */
+  static void AudioHookCallback(bool isPost, int len, double srate, audio_hook_register_t* pReg);
+
+  /** Send what the audio hook queued to the UI, on the main thread */
+  void DrainAudioHookQueues();
+
+  struct AudioHookValue
+  {
+    int mCtrlTag;
+    double mValue;
+  };
+
+  // a message's data starts after the message tag, at this offset so that receivers can cast it to a struct
+  static constexpr int kAudioHookMsgHeaderSize = 16;
+  // more hardware channels than this are not passed to OnAudioHookBlock()
+  static constexpr int kMaxAudioHookChannels = 256;
+
   reaper_plugin_info_t* mRec = nullptr;
   std::unique_ptr<Timer> mTimer;
   bool mDocked = false;
+  audio_hook_register_t mAudioHook {};
+  bool mAudioHookEnabled = false;
+  int mAudioHookMaxBlockSize = 0;
+  double mAudioHookSampleRate = 0.; // audio thread, the values OnAudioHookReset() was last called with
+  int mAudioHookBlockSize = 0;
+  WDL_TypedBuf<ReaSample*> mAudioHookPtrs; // audio thread, the inputs then the outputs of the current block
+  WDL_TypedBuf<uint8_t> mAudioHookMsgScratch; // audio thread, a message with its header, before it is pushed
+  IPlugQueue<AudioHookValue> mAudioHookValues {REAPEREXT_AUDIO_HOOK_VALUE_QUEUE_SIZE};
+  IPlugSysExQueue mAudioHookMsgs {REAPEREXT_AUDIO_HOOK_MSG_BYTES};
 };
 
 END_IPLUG_NAMESPACE
@@ -126,6 +126,8 @@ IPlugVST2::IPlugVST2(const InstanceInfo& info, const Config& config)
 {
   Trace(TRACELOC, "%s", config.pluginName);
 
+  AttachParamSnapshot(*this);
+
   mHasVSTExtensions = VSTEXT_NONE;
 
   int nInputs = MaxNChannels(ERoute::kInput), nOutputs = MaxNChannels(ERoute::kOutput);
@@ -167,13 +169,27 @@ IPlugVST2::IPlugVST2(const InstanceInfo& info, const Config& config)
 
   SetBlockSize(DEFAULT_BLOCK_SIZE);
 
+  // VstEvents declares room for two event pointers, the rest follow it
+  mOutputEventsBuf.Resize(sizeof(VstEvents) + (MIDI_TRANSFER_SIZE - 2) * sizeof(VstEvent*));
+  memset(mOutputEventsBuf.Get(), 0, mOutputEventsBuf.GetSize());
+  memset(mOutputMidiEvents, 0, sizeof(mOutputMidiEvents));
+
+  VstEvents* pOutputEvents = reinterpret_cast<VstEvents*>(mOutputEventsBuf.Get());
+
+  for (int i = 0; i < MIDI_TRANSFER_SIZE; i++)
+  {
+    mOutputMidiEvents[i].type = kVstMidiType;
+    mOutputMidiEvents[i].byteSize = sizeof(VstMidiEvent);
+    pOutputEvents->events[i] = reinterpret_cast<VstEvent*>(&mOutputMidiEvents[i]);
+  }
+
   if (config.plugHasUI)
   {
     mAEffect.flags |= effFlagsHasEditor;
     UpdateEditRect();
   }
   
-  CreateTimer();
+  CreateTimer(true);
 }
 
 void IPlugVST2::BeginInformHostOfParamChange(int idx)
@@ -230,9 +246,6 @@ void IPlugVST2::SetLatency(int samples)
 
 bool IPlugVST2::SendVSTEvent(VstEvent& event)
 {
-  // It would be more efficient to bundle these and send at the end of a processed block,
-  // but that would require writing OnBlockEnd and making sure it always gets called,
-  // and who cares anyway, midi events aren't that dense.
   VstEvents events;
   memset(&events, 0, sizeof(VstEvents));
   events.numEvents = 1;
@@ -240,8 +253,32 @@ bool IPlugVST2::SendVSTEvent(VstEvent& event)
   return (mHostCallback(&mAEffect, audioMasterProcessEvents, 0, 0, &events, 0.0f) == 1);
 }
 
+void IPlugVST2::FlushOutputEvents()
+{
+  if (!mNOutputEvents)
+    return;
+
+  VstEvents* pOutputEvents = reinterpret_cast<VstEvents*>(mOutputEventsBuf.Get());
+  pOutputEvents->numEvents = mNOutputEvents;
+  mHostCallback(&mAEffect, audioMasterProcessEvents, 0, 0, pOutputEvents, 0.0f);
+  mNOutputEvents = 0;
+}
+
 bool IPlugVST2::SendMidiMsg(const IMidiMsg& msg)
 {
+  if (mInProcess)
+  {
+    if (mNOutputEvents == MIDI_TRANSFER_SIZE)
+      FlushOutputEvents();
+
+    VstMidiEvent& midiEvent = mOutputMidiEvents[mNOutputEvents++];
+    midiEvent.deltaFrames = msg.mOffset;
+    midiEvent.midiData[0] = msg.mStatus;
+    midiEvent.midiData[1] = msg.mData1;
+    midiEvent.midiData[2] = msg.mData2;
+    return true;
+  }
+
   VstMidiEvent midiEvent;
   memset(&midiEvent, 0, sizeof(VstMidiEvent));
 
@@ -266,6 +303,8 @@ bool IPlugVST2::SendSysEx(const ISysEx& msg)
   sysexEvent.dumpBytes = msg.mSize;
   sysexEvent.sysexDump = (char*) msg.mData;
 
+  FlushOutputEvents(); // keep the order of the MIDI sent before it
+
   return SendVSTEvent((VstEvent&) sysexEvent);
 }
 
@@ -346,8 +385,9 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       if (idx >= 0 && idx < _this->NParams())
       {
         ENTER_PARAMS_MUTEX_STATIC
-        strcpy((char*) ptr, _this->GetParam(idx)->GetLabel());
+        strncpy((char*) ptr, _this->GetParam(idx)->GetLabel(), MAX_PARAM_LABEL_LEN - 1);
         LEAVE_PARAMS_MUTEX_STATIC
+        ((char*) ptr)[MAX_PARAM_LABEL_LEN - 1] = '\0';
       }
       return 0;
     }
@@ -358,7 +398,8 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
         ENTER_PARAMS_MUTEX_STATIC
         _this->GetParam(idx)->GetDisplay(_this->mParamDisplayStr);
         LEAVE_PARAMS_MUTEX_STATIC
-        strcpy((char*) ptr, _this->mParamDisplayStr.Get());
+        strncpy((char*) ptr, _this->mParamDisplayStr.Get(), MAX_PARAM_DISPLAY_LEN - 1);
+        ((char*) ptr)[MAX_PARAM_DISPLAY_LEN - 1] = '\0';
       }
       return 0;
     }
@@ -367,8 +408,9 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       if (idx >= 0 && idx < _this->NParams())
       {
         ENTER_PARAMS_MUTEX_STATIC
-        strcpy((char*) ptr, _this->GetParam(idx)->GetName());
+        strncpy((char*) ptr, _this->GetParam(idx)->GetName(), MAX_PARAM_NAME_LEN - 1);
         LEAVE_PARAMS_MUTEX_STATIC
+        ((char*) ptr)[MAX_PARAM_NAME_LEN - 1] = '\0';
       }
       return 0;
     }
@@ -399,7 +441,8 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
             break;
         }
 
-        strcpy(props->label, pParam->GetLabel());
+        strncpy(props->label, pParam->GetLabel(), sizeof(props->label) - 1);
+        props->label[sizeof(props->label) - 1] = '\0';
         LEAVE_PARAMS_MUTEX_STATIC
 
         return 1;
@@ -427,17 +470,21 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
     case effSetSampleRate:
     {
       _this->SetSampleRate(opt);
+      _this->InitDeferred();
       _this->OnReset();
       return 0;
     }
     case effSetBlockSize:
     {
       _this->SetBlockSize((int) value);
+      _this->InitDeferred();
       _this->OnReset();
       return 0;
     }
     case effMainsChanged:
     {
+      _this->InitDeferred();
+
       if (!value)
       {
         _this->OnActivate(false);
@@ -445,6 +492,9 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       }
       else
       {
+        if (_this->DoesMIDIIn())
+          _this->mHostCallback(pEffect, __audioMasterWantMidiDeprecated, 0, 0, 0, 0.0f); // old hosts only send MIDI to plug-ins that ask on resume
+
         _this->OnActivate(true);
       }
       return 0;
@@ -462,6 +512,7 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
     }
     case effEditOpen:
     {
+      _this->SetEditorOpen(true);
 #if defined OS_WIN || defined ARCH_64BIT
       if (_this->OpenWindow(ptr))
       {
@@ -481,6 +532,7 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
       if (_this->HasUI())
       {
         _this->CloseWindow();
+        _this->SetEditorOpen(false);
         return 1;
       }
       return 0;
@@ -561,7 +613,7 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
             {
               VstMidiEvent* pME = (VstMidiEvent*) pEvent;
               IMidiMsg msg(pME->deltaFrames, pME->midiData[0], pME->midiData[1], pME->midiData[2]);
-              _this->ProcessMidiMsg(msg);
+              _this->ProcessMidiMsgFromAPI(msg);
               _this->mMidiMsgsFromProcessor.Push(msg);
 
               //#ifdef TRACER_BUILD
@@ -789,7 +841,8 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
             if (value >= 0 && value < _this->NParams())
             {
               _this->GetParam((int) value)->GetDisplay((double) opt, true, _this->mParamDisplayStr);
-              strcpy((char*) ptr, _this->mParamDisplayStr.Get());
+              strncpy((char*) ptr, _this->mParamDisplayStr.Get(), MAX_PARAM_DISPLAY_LEN - 1);
+              ((char*) ptr)[MAX_PARAM_DISPLAY_LEN - 1] = '\0';
             }
             return 0xbeef;
           }
@@ -929,9 +982,6 @@ VstIntPtr VSTCALLBACK IPlugVST2::VSTDispatcher(AEffect *pEffect, VstInt32 opCode
 template <class SAMPLETYPE>
 void IPlugVST2::VSTPreProcess(SAMPLETYPE** inputs, SAMPLETYPE** outputs, VstInt32 nFrames)
 {
-  if (DoesMIDIIn())
-    mHostCallback(&mAEffect, __audioMasterWantMidiDeprecated, 0, 0, 0, 0.0f);
-
   AttachBuffers(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), inputs, nFrames);
   AttachBuffers(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), outputs, nFrames);
 
@@ -969,7 +1019,7 @@ void IPlugVST2::VSTPreProcess(SAMPLETYPE** inputs, SAMPLETYPE** outputs, VstInt3
 
   while (mMidiMsgsFromEditor.Pop(msg))
   {
-    ProcessMidiMsg(msg);
+    ProcessMidiMsgFromAPI(msg);
   }
 }
 
@@ -978,10 +1028,15 @@ void VSTCALLBACK IPlugVST2::VSTProcess(AEffect* pEffect, float** inputs, float**
 {
   TRACE
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
+  auto denormalScope = _this->MakeDenormalScope();
+  _this->mInProcess = true;
   _this->VSTPreProcess(inputs, outputs, nFrames);
   ENTER_PARAMS_MUTEX_STATIC
+  _this->ProcessParamValuesFromUI(nFrames);
   _this->ProcessBuffersAccumulating(nFrames);
   LEAVE_PARAMS_MUTEX_STATIC
+  _this->FlushOutputEvents();
+  _this->mInProcess = false;
   _this->OutputSysexFromEditor();
 }
 
@@ -989,10 +1044,15 @@ void VSTCALLBACK IPlugVST2::VSTProcessReplacing(AEffect* pEffect, float** inputs
 {
   TRACE
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
+  auto denormalScope = _this->MakeDenormalScope();
+  _this->mInProcess = true;
   _this->VSTPreProcess(inputs, outputs, nFrames);
   ENTER_PARAMS_MUTEX_STATIC
+  _this->ProcessParamValuesFromUI(nFrames);
   _this->ProcessBuffers((float) 0.0f, nFrames);
   LEAVE_PARAMS_MUTEX_STATIC
+  _this->FlushOutputEvents();
+  _this->mInProcess = false;
   _this->OutputSysexFromEditor();
 }
 
@@ -1000,10 +1060,15 @@ void VSTCALLBACK IPlugVST2::VSTProcessDoubleReplacing(AEffect* pEffect, double**
 {
   TRACE
   IPlugVST2* _this = (IPlugVST2*) pEffect->object;
+  auto denormalScope = _this->MakeDenormalScope();
+  _this->mInProcess = true;
   _this->VSTPreProcess(inputs, outputs, nFrames);
   ENTER_PARAMS_MUTEX_STATIC
+  _this->ProcessParamValuesFromUI(nFrames);
   _this->ProcessBuffers((double) 0.0, nFrames);
   LEAVE_PARAMS_MUTEX_STATIC
+  _this->FlushOutputEvents();
+  _this->mInProcess = false;
   _this->OutputSysexFromEditor();
 }
 
@@ -1046,5 +1111,7 @@ void IPlugVST2::OutputSysexFromEditor()
       ISysEx smsg {mSysexBuf.mOffset, mSysexBuf.mData, mSysexBuf.mSize};
       SendSysEx(smsg);
     }
+
+    mSysExDataFromEditor.Release();
   }
 }
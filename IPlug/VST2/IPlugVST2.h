@@ -77,7 +77,9 @@ private:
   static void VSTCALLBACK VSTSetParameter(AEffect *pEffect, VstInt32 idx, float value);
   
   bool SendVSTEvent(VstEvent& event);
-  bool SendVSTEvents(WDL_TypedBuf<VstEvent>* pEvents);
+
+  /** Send the MIDI collected by SendMidiMsg() during a process call to the host, in one audioMasterProcessEvents call */
+  void FlushOutputEvents();
   
   void UpdateEditRect();
     
@@ -87,6 +89,11 @@ private:
   enum { VSTEXT_NONE=0, VSTEXT_COCKOS, VSTEXT_COCOA }; // list of VST extensions supported by host
   int mHasVSTExtensions;
 
+  WDL_TypedBuf<uint8_t> mOutputEventsBuf; // a VstEvents with room for MIDI_TRANSFER_SIZE event pointers, set up once
+  VstMidiEvent mOutputMidiEvents[MIDI_TRANSFER_SIZE]; // the pool the pointers point into
+  int mNOutputEvents = 0;
+  bool mInProcess = false; // SendMidiMsg() batches events while this is set, and sends them straight away otherwise
+
   IByteChunk mState;     // Persistent storage if the host asks for plugin state.
   IByteChunk mBankState; // Persistent storage if the host asks for bank state.
 protected:
@@ -32,7 +32,7 @@ IPlugVST3::IPlugVST3(const InstanceInfo& info, const Config& config)
 , IPlugVST3ControllerBase(parameters)
 , mView(nullptr)
 {
-  CreateTimer();
+  CreateTimer(true);
 }
 
 IPlugVST3::~IPlugVST3() {}
@@ -76,6 +76,7 @@ tresult PLUGIN_API IPlugVST3::setActive(TBool state)
 {
   TRACE
 
+  InitDeferred();
   OnActivate((bool) state);
   return SingleComponentEffect::setActive(state);
 }
@@ -84,6 +85,7 @@ tresult PLUGIN_API IPlugVST3::setupProcessing(ProcessSetup& newSetup)
 {
   TRACE
 
+  InitDeferred();
   return SetupProcessing(newSetup, processSetup) ? kResultOk : kResultFalse;
 }
 
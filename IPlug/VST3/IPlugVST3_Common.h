@@ -10,11 +10,21 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifndef OS_WIN
+  #include <unistd.h>
+#endif
+
 #include "pluginterfaces/base/ibstream.h"
-#
+#include "public.sdk/source/vst/vstcomponentbase.h"
+
 #include "IPlugAPIBase.h"
 #include "IPlugVST3_Parameter.h"
 #include "IPlugVST3_ControllerBase.h"
+#include "IPlugQueue.h"
 
 BEGIN_IPLUG_NAMESPACE
 
@@ -86,6 +96,308 @@ struct IPlugVST3State
   }
 };
 
+/** The messages sent between the processor and controller of a distributed VST3 plug-in during one timer tick, coalesced into one binary IMessage
+ * rather than allocating and sending an IMessage per message. The IMessage's "D" attribute holds a sequence of records, each a one byte EMsgType
+ * followed by its fields, in native byte order since both ends are the same binary. Data is padded to start at a multiple of kDataAlignment bytes into the batch,
+ * so that receivers that cast it to a struct get it as aligned as a separate IMessage's would be:
+ * - kSCVFD: int32 ctrlTag, float64 value
+ * - kSCMFD: int32 ctrlTag, int32 msgTag, int32 dataSize, data
+ * - kSAMFD, kSAMFUI: int32 msgTag, int32 ctrlTag, int32 dataSize, data
+ * - kSMMFD, kSMMFUI: int32 offset, uint8 status, uint8 data1, uint8 data2
+ * - kSSMFD, kSSMFUI: int32 offset, int32 dataSize, data */
+class IPlugVST3MsgBatch
+{
+public:
+  enum EMsgType : uint8_t
+  {
+    kSCVFD = 0,
+    kSCMFD,
+    kSAMFD,
+    kSMMFD,
+    kSSMFD,
+    kSAMFUI,
+    kSMMFUI,
+    kSSMFUI
+  };
+
+  static constexpr int kDataAlignment = 8;
+
+  /** One decoded record, only the fields for its type are set. mData points into the IMessage, and is nullptr if mDataSize is 0 */
+  struct Msg
+  {
+    EMsgType mType;
+    int mCtrlTag = kNoTag;
+    int mMsgTag = kNoTag;
+    double mValue = 0.;
+    IMidiMsg mMidiMsg;
+    int mOffset = 0;
+    int mDataSize = 0;
+    const void* mData = nullptr;
+  };
+
+  /** @param fromUI \c true for the controller's batch, of messages from the UI, \c false for the processor's, of messages from the delegate */
+  IPlugVST3MsgBatch(bool fromUI)
+  : mMsgID(fromUI ? "SBFUI" : "SBFD")
+  , mPeerMsgID(fromUI ? "SBFD" : "SBFUI")
+  {}
+
+  void AddControlValue(int ctrlTag, double value)
+  {
+    PutType(kSCVFD);
+    mData.Put(&ctrlTag);
+    mData.Put(&value);
+  }
+
+  void AddControlMsg(int ctrlTag, int msgTag, int dataSize, const void* pData)
+  {
+    PutType(kSCMFD);
+    mData.Put(&ctrlTag);
+    mData.Put(&msgTag);
+    PutData(dataSize, pData);
+  }
+
+  void AddArbitraryMsg(EMsgType type, int msgTag, int ctrlTag, int dataSize, const void* pData)
+  {
+    PutType(type);
+    mData.Put(&msgTag);
+    mData.Put(&ctrlTag);
+    PutData(dataSize, pData);
+  }
+
+  void AddMidiMsg(EMsgType type, const IMidiMsg& msg)
+  {
+    PutType(type);
+    mData.Put(&msg.mOffset);
+    mData.Put(&msg.mStatus);
+    mData.Put(&msg.mData1);
+    mData.Put(&msg.mData2);
+  }
+
+  void AddSysEx(EMsgType type, int offset, int dataSize, const void* pData)
+  {
+    PutType(type);
+    mData.Put(&offset);
+    PutData(dataSize, pData);
+  }
+
+  /** Send everything added since the last call in one IMessage, if anything was added
+   * @param component The processor or controller, whose peer receives the message */
+  void Send(const Steinberg::Vst::ComponentBase& component)
+  {
+    if (!mData.Size())
+      return;
+
+    Steinberg::OPtr<Steinberg::Vst::IMessage> message = component.allocateMessage();
+
+    if (message)
+    {
+      message->setMessageID(mMsgID);
+      message->getAttributes()->setBinary("D", mData.GetData(), mData.Size());
+      component.sendMessage(message);
+    }
+
+    mData.Clear();
+  }
+
+  /** @return The encoded batch, everything added since the last Send() or Clear() */
+  const uint8_t* GetData() const { return mData.GetData(); }
+
+  /** @return The size of the encoded batch in bytes, 0 if nothing has been added */
+  int Size() const { return mData.Size(); }
+
+  /** Forget everything added, e.g. once GetData() has been sent some other way than Send() */
+  void Clear() { mData.Clear(); }
+
+  /** @return \c true if the message is a batch sent by the peer's IPlugVST3MsgBatch */
+  bool IsPeerBatch(Steinberg::Vst::IMessage* message) const { return !strcmp(message->getMessageID(), mPeerMsgID); }
+
+  /** Decode a batch sent by the peer in one pass, calling func with each message in the order they were added
+   * @param message A message for which IsPeerBatch() returned \c true
+   * @param func Called with a const Msg& for each record
+   * @return \c false if the batch was truncated, in which case func has been called for the records before the truncation */
+  template <class F>
+  static bool Decode(Steinberg::Vst::IMessage* message, F&& func)
+  {
+    const void* pBatch = nullptr;
+    Steinberg::uint32 size = 0;
+
+    if (message->getAttributes()->getBinary("D", pBatch, size) != Steinberg::kResultOk)
+      return false;
+
+    return Decode(pBatch, static_cast<int>(size), func);
+  }
+
+  /** Decode a batch from GetData() and Size() of the peer's batch, that came some other way than an IMessage
+   * @param pBatch The batch's data, which must stay valid while func is called, since mData points into it
+   * @param size The size of the batch in bytes
+   * @param func Called with a const Msg& for each record
+   * @return \c false if the batch was truncated, in which case func has been called for the records before the truncation */
+  template <class F>
+  static bool Decode(const void* pBatch, int size, F&& func)
+  {
+    const uint8_t* pSrc = static_cast<const uint8_t*>(pBatch);
+    const int srcSize = size;
+    int pos = 0;
+
+    while (pos < srcSize)
+    {
+      Msg msg;
+      pos = IByteGetter::GetBytes(pSrc, srcSize, &msg.mType, sizeof(msg.mType), pos);
+
+      switch (msg.mType)
+      {
+        case kSCVFD:
+          pos = Get(pSrc, srcSize, msg.mCtrlTag, pos);
+          pos = Get(pSrc, srcSize, msg.mValue, pos);
+          break;
+        case kSCMFD:
+          pos = Get(pSrc, srcSize, msg.mCtrlTag, pos);
+          pos = Get(pSrc, srcSize, msg.mMsgTag, pos);
+          pos = GetData(pSrc, srcSize, msg, pos);
+          break;
+        case kSAMFD:
+        case kSAMFUI:
+          pos = Get(pSrc, srcSize, msg.mMsgTag, pos);
+          pos = Get(pSrc, srcSize, msg.mCtrlTag, pos);
+          pos = GetData(pSrc, srcSize, msg, pos);
+          break;
+        case kSMMFD:
+        case kSMMFUI:
+          pos = Get(pSrc, srcSize, msg.mMidiMsg.mOffset, pos);
+          pos = Get(pSrc, srcSize, msg.mMidiMsg.mStatus, pos);
+          pos = Get(pSrc, srcSize, msg.mMidiMsg.mData1, pos);
+          pos = Get(pSrc, srcSize, msg.mMidiMsg.mData2, pos);
+          break;
+        case kSSMFD:
+        case kSSMFUI:
+          pos = Get(pSrc, srcSize, msg.mOffset, pos);
+          pos = GetData(pSrc, srcSize, msg, pos);
+          break;
+        default:
+          return false;
+      }
+
+      if (pos < 0)
+        return false;
+
+      func(msg);
+    }
+
+    return true;
+  }
+
+private:
+  void PutType(EMsgType type) { mData.Put(&type); }
+
+  void PutData(int dataSize, const void* pData)
+  {
+    mData.Put(&dataSize);
+    if (dataSize > 0)
+    {
+      mData.Resize(AlignDataPos(mData.Size()));
+      mData.PutBytes(pData, dataSize);
+    }
+  }
+
+  // IByteGetter::GetBytes() returns -1 if it would read past the end, or if startPos is already -1
+  template <class T>
+  static int Get(const uint8_t* pSrc, int srcSize, T& val, int pos)
+  {
+    return IByteGetter::GetBytes(pSrc, srcSize, &val, sizeof(T), pos);
+  }
+
+  static int GetData(const uint8_t* pSrc, int srcSize, Msg& msg, int pos)
+  {
+    pos = Get(pSrc, srcSize, msg.mDataSize, pos);
+
+    if (pos < 0 || msg.mDataSize < 0)
+      return -1;
+
+    if (!msg.mDataSize)
+      return pos;
+
+    pos = AlignDataPos(pos);
+
+    if (msg.mDataSize > srcSize - pos)
+      return -1;
+
+    msg.mData = pSrc + pos;
+    return pos + msg.mDataSize;
+  }
+
+  static int AlignDataPos(int pos) { return (pos + kDataAlignment - 1) & ~(kDataAlignment - 1); }
+
+  const char* mMsgID;
+  const char* mPeerMsgID;
+  IByteChunk mData;
+};
+
+/** A channel for the processor's message batches to the controller when both are in the same process, as they nearly always are, so that they skip
+ * the copies and the host's message queue. The processor creates a channel and offers its ID and process ID to the controller in an IMessage when they
+ * are connected. The controller looks them up, which only succeeds in the same process, and replies to accept it, after which the processor pushes its
+ * batches into mQueue and the controller pops them on its timer. If the host runs them in separate processes, the batches keep going by IMessage.
+ * The processor only offers a channel if VST3_SHARED_MEMORY_CHANNEL is defined. */
+class IPlugVST3SharedChannel
+{
+public:
+  /** The size of the queue. A batch bigger than half of it goes by IMessage */
+  static constexpr int kQueueBytes = 256 * 1024;
+
+  /** Create a channel and register it, so that the controller can find it
+   * @param id Set to the ID to offer to the controller
+   * @return The channel, which the registry forgets when nothing holds it */
+  static std::shared_ptr<IPlugVST3SharedChannel> Create(Steinberg::int64& id)
+  {
+    std::lock_guard<std::mutex> lock(GetMutex());
+    auto& channels = GetChannels();
+
+    for (auto it = channels.begin(); it != channels.end();)
+      it = it->second.expired() ? channels.erase(it) : std::next(it);
+
+    static Steinberg::int64 sLastID = 0;
+    id = ++sLastID;
+
+    auto pChannel = std::make_shared<IPlugVST3SharedChannel>();
+    channels[id] = pChannel;
+    return pChannel;
+  }
+
+  /** @return The channel the processor offered, if it is in this process, otherwise nullptr */
+  static std::shared_ptr<IPlugVST3SharedChannel> Find(Steinberg::int64 processID, Steinberg::int64 id)
+  {
+    if (processID != GetProcessID())
+      return nullptr;
+
+    std::lock_guard<std::mutex> lock(GetMutex());
+    auto it = GetChannels().find(id);
+    return it != GetChannels().end() ? it->second.lock() : nullptr;
+  }
+
+  static Steinberg::int64 GetProcessID()
+  {
+#ifdef OS_WIN
+    return static_cast<Steinberg::int64>(GetCurrentProcessId());
+#else
+    return static_cast<Steinberg::int64>(getpid());
+#endif
+  }
+
+  IPlugSysExQueue mQueue {kQueueBytes}; // batches, pushed by the processor and popped by the controller
+
+private:
+  static std::mutex& GetMutex()
+  {
+    static std::mutex sMutex;
+    return sMutex;
+  }
+
+  static std::map<Steinberg::int64, std::weak_ptr<IPlugVST3SharedChannel>>& GetChannels()
+  {
+    static std::map<Steinberg::int64, std::weak_ptr<IPlugVST3SharedChannel>> sChannels;
+    return sChannels;
+  }
+};
+
 // Host
 static void IPlugVST3GetHost(IPlugAPIBase* pPlug, Steinberg::FUnknown* context)
 {
@@ -28,7 +28,7 @@ IPlugVST3Controller::IPlugVST3Controller(const InstanceInfo& info, const Config&
 , mProcessorGUID(info.mOtherGUID)
 , IPlugVST3ControllerBase(parameters)
 {
-  CreateTimer();
+  CreateTimer(true);
 }
 
 IPlugVST3Controller::~IPlugVST3Controller()
@@ -162,118 +162,96 @@ tresult PLUGIN_API IPlugVST3Controller::notify(IMessage* message)
   if (!message)
     return kInvalidArgument;
   
-  if (!strcmp(message->getMessageID(), "SCVFD"))
+  if (mMsgBatch.IsPeerBatch(message)) // messages from the processor
   {
-    Steinberg::int64 ctrlTag = kNoTag;
-    double normalizedValue = 0.;
-    
-    if(message->getAttributes()->getInt("CT", ctrlTag) == kResultFalse)
-      return kResultFalse;
-    
-    if(message->getAttributes()->getFloat("NV", normalizedValue) == kResultFalse)
-      return kResultFalse;
-    
-    SendControlValueFromDelegate((int) ctrlTag, normalizedValue);
-
+    bool handled = IPlugVST3MsgBatch::Decode(message, [this](const IPlugVST3MsgBatch::Msg& msg) { OnMsgFromProcessor(msg); });
+    return handled ? kResultOk : kResultFalse;
   }
-  else if (!strcmp(message->getMessageID(), "SCMFD"))
+  else if (!strcmp(message->getMessageID(), "SHMO")) // the processor offers a shared channel, which we can only use if it is in this process
   {
-    const void* data;
-    Steinberg::int64 ctrlTag = kNoTag;
-    Steinberg::int64 msgTag = kNoTag;
-
-    if(message->getAttributes()->getInt("CT", ctrlTag) == kResultFalse)
-      return kResultFalse;
+    int64 processID;
+    int64 id;
     
-    if(message->getAttributes()->getInt("MT", msgTag) == kResultFalse)
+    if (message->getAttributes()->getInt("PID", processID) != kResultOk || message->getAttributes()->getInt("ID", id) != kResultOk)
       return kResultFalse;
-
-    Steinberg::uint32 size;
     
-    if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
-    {
-      SendControlMsgFromDelegate((int) ctrlTag, (int) msgTag, size, data);
-      return kResultOk;
-    }
-  }
-  else if (!strcmp(message->getMessageID(), "SMMFD"))
-  {
-    const void* data = nullptr;
-    uint32 size;
+    mSharedChannel = IPlugVST3SharedChannel::Find(processID, id);
     
-    if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
-    {
-      if (size == sizeof(IMidiMsg))
-      {
-        IMidiMsg msg;
-        memcpy(&msg, data, size);
-        SendMidiMsgFromDelegate(msg);
-      }
-    }
-  }
-  else if (!strcmp(message->getMessageID(), "SSMFD"))
-  {
-    const void* data = nullptr;
-    uint32 size;
-    int64 offset;
+    if (!mSharedChannel)
+      return kResultOk; // in another process, keep using IMessages
+    
+    OPtr<IMessage> reply = allocateMessage();
     
-    if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
+    if (!reply)
     {
-      if (message->getAttributes()->getInt("O", offset) == kResultOk)
-      {
-        ISysEx msg {static_cast<int>(offset), static_cast<const uint8_t*>(data), static_cast<int>(size)};
-        SendSysexMsgFromDelegate(msg);
-      }
+      mSharedChannel = nullptr;
+      return kResultFalse;
     }
+    
+    reply->setMessageID("SHMA");
+    reply->getAttributes()->setInt("ID", id);
+    sendMessage(reply);
+    return kResultOk;
   }
   
   return ComponentBase::notify(message);
 }
 
+void IPlugVST3Controller::OnMsgFromProcessor(const IPlugVST3MsgBatch::Msg& msg)
+{
+  switch (msg.mType)
+  {
+    case IPlugVST3MsgBatch::kSCVFD:
+      SendControlValueFromDelegate(msg.mCtrlTag, msg.mValue);
+      break;
+    case IPlugVST3MsgBatch::kSCMFD:
+      SendControlMsgFromDelegate(msg.mCtrlTag, msg.mMsgTag, msg.mDataSize, msg.mData);
+      break;
+    case IPlugVST3MsgBatch::kSAMFD:
+      SendArbitraryMsgFromDelegate(msg.mMsgTag, msg.mDataSize, msg.mData);
+      break;
+    case IPlugVST3MsgBatch::kSMMFD:
+      SendMidiMsgFromDelegate(msg.mMidiMsg);
+      break;
+    case IPlugVST3MsgBatch::kSSMFD:
+      SendSysexMsgFromDelegate({msg.mOffset, static_cast<const uint8_t*>(msg.mData), msg.mDataSize});
+      break;
+    default:
+      break;
+  }
+}
+
 void IPlugVST3Controller::SendMidiMsgFromUI(const IMidiMsg& msg)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SMMFUI");
-  message->getAttributes()->setBinary("D", (void*) &msg, sizeof(IMidiMsg));
-  sendMessage(message);
+  mMsgBatch.AddMidiMsg(IPlugVST3MsgBatch::kSMMFUI, msg);
 }
 
 void IPlugVST3Controller::SendSysexMsgFromUI(const ISysEx& msg)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SSMFUI");
-  message->getAttributes()->setInt("O", (int64) msg.mOffset);
-  message->getAttributes()->setBinary("D", msg.mData, msg.mSize);
-  sendMessage(message);
+  mMsgBatch.AddSysEx(IPlugVST3MsgBatch::kSSMFUI, msg.mOffset, msg.mSize, msg.mData);
 }
 
 void IPlugVST3Controller::SendArbitraryMsgFromUI(int msgTag, int ctrlTag, int dataSize, const void* pData)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  if (dataSize == 0) // allow sending messages with no data
+  mMsgBatch.AddArbitraryMsg(IPlugVST3MsgBatch::kSAMFUI, msgTag, ctrlTag, dataSize, pData);
+}
+
+void IPlugVST3Controller::TransmitMsgBatch()
+{
+  // once per timer tick, handle the batches the processor has pushed into the shared channel since the last one
+  if (mSharedChannel)
   {
-    dataSize = 1;
-    uint8_t dummy = 0;
-    pData = &dummy;
+    IPlugSysExQueue& queue = mSharedChannel->mQueue;
+    int offset, size;
+    const uint8_t* pData;
+    
+    while (queue.Pop(offset, size, pData))
+      IPlugVST3MsgBatch::Decode(pData, size, [this](const IPlugVST3MsgBatch::Msg& msg) { OnMsgFromProcessor(msg); });
+    
+    queue.Release();
   }
   
-  message->setMessageID("SAMFUI");
-  message->getAttributes()->setInt("MT", msgTag);
-  message->getAttributes()->setInt("CT", ctrlTag);
-  message->getAttributes()->setBinary("D", pData, dataSize);
-  sendMessage(message);
+  mMsgBatch.Send(*this);
 }
 
 void IPlugVST3Controller::SendParameterValueFromUI(int paramIdx, double normalisedValue)
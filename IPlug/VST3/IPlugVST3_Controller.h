@@ -123,10 +123,15 @@ public:
   ViewType* GetView() const { return mView; }
 
 private:
+  void TransmitMsgBatch() override;
+  void OnMsgFromProcessor(const IPlugVST3MsgBatch::Msg& msg);
+
   ViewType* mView = nullptr;
   bool mPlugIsInstrument;
   bool mDoesMidiIn;
   Steinberg::FUID mProcessorGUID;
+  IPlugVST3MsgBatch mMsgBatch {true}; // messages for the processor, sent once per timer tick
+  std::shared_ptr<IPlugVST3SharedChannel> mSharedChannel; // the processor's batches, if it is in this process and offered it
 };
 
 END_IPLUG_NAMESPACE
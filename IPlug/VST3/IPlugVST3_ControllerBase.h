@@ -222,8 +222,8 @@ public:
       if (pParam)
       {
         pParam->SetNormalized(value);
-        pPlug->OnParamChangeUI(tag, kHost);
-        pPlug->SendParameterValueFromDelegate(tag, value, true);
+        // the editor is told on the next timer tick, with the latest value, rather than for each of the host's calls during automation
+        pPlug->SendParameterValueFromAPI(tag, value, true);
       }
     }
     
@@ -61,6 +61,7 @@ tresult PLUGIN_API IPlugVST3Processor::setActive(TBool state)
 {
   TRACE
   
+  InitDeferred();
   OnActivate((bool) state);
   return AudioEffect::setActive(state);
 }
@@ -69,6 +70,7 @@ tresult PLUGIN_API IPlugVST3Processor::setupProcessing(ProcessSetup& newSetup)
 {
   TRACE
   
+  InitDeferred();
   return SetupProcessing(newSetup, processSetup) ? kResultOk : kResultFalse;
 }
 
@@ -110,95 +112,98 @@ tresult PLUGIN_API IPlugVST3Processor::getState(IBStream* pState)
 
 void IPlugVST3Processor::SendControlValueFromDelegate(int ctrlTag, double normalizedValue)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SCVFD");
-  message->getAttributes()->setInt("CT", ctrlTag);
-  message->getAttributes()->setFloat("NV", normalizedValue);
-  
-  sendMessage(message);
+  // added to the batch in TransmitMsgBatch()
+  GetControlCoalescer().AddValue(ctrlTag, normalizedValue);
 }
 
 void IPlugVST3Processor::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SCMFD");
-  message->getAttributes()->setInt("CT", ctrlTag);
-  message->getAttributes()->setInt("MT", msgTag);
-  message->getAttributes()->setBinary("D", pData, dataSize);
-  
-  sendMessage(message);
+  if (GetControlCoalescer().GetMsgCoalescing(ctrlTag))
+    GetControlCoalescer().AddMsg(ctrlTag, msgTag, dataSize, pData);
+  else
+    mMsgBatch.AddControlMsg(ctrlTag, msgTag, dataSize, pData);
 }
 
 void IPlugVST3Processor::SendArbitraryMsgFromDelegate(int msgTag, int dataSize, const void* pData)
+{
+  mMsgBatch.AddArbitraryMsg(IPlugVST3MsgBatch::kSAMFD, msgTag, kNoTag, dataSize, pData);
+}
+
+#pragma mark IConnectionPoint override
+
+tresult PLUGIN_API IPlugVST3Processor::connect(IConnectionPoint* pOther)
+{
+  tresult result = AudioEffect::connect(pOther);
+
+#ifdef VST3_SHARED_MEMORY_CHANNEL
+  if (result == kResultOk)
+    OfferSharedChannel();
+#endif
+
+  return result;
+}
+
+tresult PLUGIN_API IPlugVST3Processor::disconnect(IConnectionPoint* pOther)
+{
+  mSharedChannel = nullptr;
+  mSharedChannelAccepted = false;
+  return AudioEffect::disconnect(pOther);
+}
+
+void IPlugVST3Processor::OfferSharedChannel()
 {
   OPtr<IMessage> message = allocateMessage();
   
   if (!message)
     return;
   
-  if (dataSize == 0) // allow sending messages with no data
-  {
-    dataSize = 1;
-    uint8_t dummy = 0;
-    pData = &dummy;
-  }
+  mSharedChannel = IPlugVST3SharedChannel::Create(mSharedChannelID);
+  mSharedChannelAccepted = false;
   
-  message->setMessageID("SAMFD");
-  message->getAttributes()->setInt("MT", msgTag);
-  message->getAttributes()->setBinary("D", pData, dataSize);
+  message->setMessageID("SHMO");
+  message->getAttributes()->setInt("PID", IPlugVST3SharedChannel::GetProcessID());
+  message->getAttributes()->setInt("ID", mSharedChannelID);
   sendMessage(message);
 }
 
-#pragma mark IConnectionPoint override
-
 tresult PLUGIN_API IPlugVST3Processor::notify(IMessage* message)
 {
   if (!message)
     return kInvalidArgument;
   
-  const void* data = nullptr;
-  uint32 size;
-  
-  if (!strcmp(message->getMessageID(), "SMMFUI")) // midi message from UI
+  if (!strcmp(message->getMessageID(), "SHMA")) // the controller is in this process and has accepted the shared channel
   {
-    if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
+    int64 id;
+    
+    if (mSharedChannel && message->getAttributes()->getInt("ID", id) == kResultOk && id == mSharedChannelID)
     {
-      if (size == sizeof(IMidiMsg))
-      {
-        IMidiMsg msg;
-        memcpy(&msg, data, size);
-        mMidiMsgsFromEditor.Push(msg);
-        return kResultOk;
-      }
-      
-      return kResultFalse;
+      mSharedChannelAccepted = true;
+      return kResultOk;
     }
+    
+    return kResultFalse;
   }
-  else if (!strcmp(message->getMessageID(), "SAMFUI")) // message from UI
+  
+  if (mMsgBatch.IsPeerBatch(message)) // messages from UI
   {
-    int64 msgTag;
-    int64 ctrlTag;
-
-    if (message->getAttributes()->getInt("MT", msgTag) == kResultOk && message->getAttributes()->getInt("CT", ctrlTag) == kResultOk)
-    {
-      if (message->getAttributes()->getBinary("D", data, size) == kResultOk)
+    bool handled = IPlugVST3MsgBatch::Decode(message, [&](const IPlugVST3MsgBatch::Msg& msg) {
+      switch (msg.mType)
       {
-        if(OnMessage((int) msgTag, (int) ctrlTag, size, data))
-        {
-          return kResultOk;
-        }
+        case IPlugVST3MsgBatch::kSMMFUI:
+          mMidiMsgsFromEditor.Push(msg.mMidiMsg);
+          break;
+        case IPlugVST3MsgBatch::kSSMFUI:
+          DeferSysexMsg({msg.mOffset, static_cast<const uint8_t*>(msg.mData), msg.mDataSize});
+          break;
+        case IPlugVST3MsgBatch::kSAMFUI:
+          OnMessage(msg.mMsgTag, msg.mCtrlTag, msg.mDataSize, msg.mData);
+          break;
+        default:
+          break;
       }
-      
-      return kResultFalse;
-    }
+    });
+    
+    return handled ? kResultOk : kResultFalse;
   }
   
   return AudioEffect::notify(message);
@@ -208,25 +213,44 @@ tresult PLUGIN_API IPlugVST3Processor::notify(IMessage* message)
 
 void IPlugVST3Processor::TransmitMidiMsgFromProcessor(const IMidiMsg& msg)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
-  
-  message->setMessageID("SMMFD");
-  message->getAttributes()->setBinary("D", (void*) &msg, sizeof(IMidiMsg));
-  sendMessage(message);
+  mMsgBatch.AddMidiMsg(IPlugVST3MsgBatch::kSMMFD, msg);
 }
 
 void IPlugVST3Processor::TransmitSysExDataFromProcessor(const SysExData& data)
 {
-  OPtr<IMessage> message = allocateMessage();
-  
-  if (!message)
-    return;
+  mMsgBatch.AddSysEx(IPlugVST3MsgBatch::kSSMFD, data.mOffset, data.mSize, data.mData);
+}
+
+void IPlugVST3Processor::TransmitMsgBatch()
+{
+  // the lowest and highest values go before the newest, so that the controller's coalescer sees the same range
+  GetControlCoalescer().Flush([&](const IControlCoalescer::ValueSlot& slot) {
+    if (slot.mMin != slot.mValue)
+      mMsgBatch.AddControlValue(slot.mCtrlTag, slot.mMin);
+
+    if (slot.mMax != slot.mValue)
+      mMsgBatch.AddControlValue(slot.mCtrlTag, slot.mMax);
+
+    mMsgBatch.AddControlValue(slot.mCtrlTag, slot.mValue);
+  },
+  [&](int ctrlTag, int msgTag, int dataSize, const void* pData) {
+    mMsgBatch.AddControlMsg(ctrlTag, msgTag, dataSize, pData);
+  });
+
+  if (mSharedChannelAccepted && mMsgBatch.Size())
+  {
+    IPlugSysExQueue& queue = mSharedChannel->mQueue;
+    
+    if (queue.Push(0, mMsgBatch.Size(), mMsgBatch.GetData()))
+    {
+      mMsgBatch.Clear();
+      return;
+    }
+    
+    // the controller hasn't caught up: keep adding to the batch, and try again next tick, so that the order is kept, unless it is too big to ever fit
+    if (mMsgBatch.Size() <= queue.MaxMessageSize())
+      return;
+  }
   
-  message->setMessageID("SSMFD");
-  message->getAttributes()->setBinary("D", (void*) data.mData, data.mSize);
-  message->getAttributes()->setInt("O", data.mOffset);
-  sendMessage(message);
+  mMsgBatch.Send(*this);
 }
@@ -77,12 +77,22 @@ public:
 private:
   void TransmitMidiMsgFromProcessor(const IMidiMsg& msg) override;
   void TransmitSysExDataFromProcessor(const SysExData& data) override;
+  void TransmitMsgBatch() override;
 
   // IConnectionPoint
+  Steinberg::tresult PLUGIN_API connect(Steinberg::Vst::IConnectionPoint* pOther) override;
+  Steinberg::tresult PLUGIN_API disconnect(Steinberg::Vst::IConnectionPoint* pOther) override;
   Steinberg::tresult PLUGIN_API notify(Steinberg::Vst::IMessage* message) override;
+
+  /** Offer the controller an IPlugVST3SharedChannel for our message batches, which it accepts if it is in the same process */
+  void OfferSharedChannel();
   
 //  Steinberg::Vst::ParameterChanges mOutputParamChanges;
   IMidiQueue mMidiOutputQueue;
+  IPlugVST3MsgBatch mMsgBatch {false}; // messages for the controller, sent once per timer tick
+  std::shared_ptr<IPlugVST3SharedChannel> mSharedChannel; // offered to the controller, used once it has accepted
+  Steinberg::int64 mSharedChannelID = 0;
+  bool mSharedChannelAccepted = false;
 };
 
 Steinberg::FUnknown* MakeProcessor();
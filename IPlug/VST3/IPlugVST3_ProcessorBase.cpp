@@ -52,22 +52,21 @@ IPlugVST3ProcessorBase::IPlugVST3ProcessorBase(Config c, IPlugAPIBase& plug)
 : IPlugProcessor(c, kAPIVST3)
 , mPlug(plug)
 {
+  AttachParamSnapshot(plug);
+
   SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), true);
   SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true);
   
   mMaxNChansForMainInputBus = MaxNChannelsForBus(ERoute::kInput, 0);
 
   if (MaxNChannels(ERoute::kInput))
-  {
-    mLatencyDelay = std::unique_ptr<NChanDelayLine<PLUG_SAMPLE_DST>>(new NChanDelayLine<PLUG_SAMPLE_DST>(MaxNChannels(ERoute::kInput), MaxNChannels(ERoute::kOutput)));
-    mLatencyDelay->SetDelayTime(GetLatency());
-  }
+    CreateLatencyDelay();
   
   // Make sure the process context is predictably initialised in case it is used before process is called
   memset(&mProcessContext, 0, sizeof(ProcessContext));
 }
 
-void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* pEventList, IPlugQueue<IMidiMsg>& editorQueue, IPlugQueue<IMidiMsg>& processorQueue)
+void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* pEventList, IPlugMPMCQueue<IMidiMsg>& editorQueue, IPlugQueue<IMidiMsg>& processorQueue)
 {
   IMidiMsg msg;
     
@@ -84,7 +83,7 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* pEventList, IPlugQueue<IM
           case Event::kNoteOnEvent:
           {
             msg.MakeNoteOnMsg(event.noteOn.pitch, event.noteOn.velocity * 127, event.sampleOffset, event.noteOn.channel);
-            ProcessMidiMsg(msg);
+            ProcessMidiMsgFromAPI(msg);
             processorQueue.Push(msg);
             break;
           }
@@ -92,14 +91,14 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* pEventList, IPlugQueue<IM
           case Event::kNoteOffEvent:
           {
             msg.MakeNoteOffMsg(event.noteOff.pitch, event.sampleOffset, event.noteOff.channel);
-            ProcessMidiMsg(msg);
+            ProcessMidiMsgFromAPI(msg);
             processorQueue.Push(msg);
             break;
           }
           case Event::kPolyPressureEvent:
           {
             msg.MakePolyATMsg(event.polyPressure.pitch, event.polyPressure.pressure * 127., event.sampleOffset, event.polyPressure.channel);
-            ProcessMidiMsg(msg);
+            ProcessMidiMsgFromAPI(msg);
             processorQueue.Push(msg);
             break;
           }
@@ -116,11 +115,11 @@ void IPlugVST3ProcessorBase::ProcessMidiIn(IEventList* pEventList, IPlugQueue<IM
   
   while (editorQueue.Pop(msg))
   {
-    ProcessMidiMsg(msg);
+    ProcessMidiMsgFromAPI(msg);
   }
 }
 
-void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugQueue<SysExData>& sysExQueue, SysExData& sysExBuf, IEventList* pOutputEvents, int32 numSamples)
+void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugSysExQueue& sysExQueue, SysExData& sysExBuf, IEventList* pOutputEvents, int32 numSamples)
 {
   if (!mMidiOutputQueue.Empty() && pOutputEvents)
   {
@@ -193,6 +192,9 @@ void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugQueue<SysExData>& sysExQueue, S
   mMidiOutputQueue.Flush(numSamples);
   
   // Output SYSEX from the editor, which has bypassed the processors' ProcessSysEx()
+  // the events point into the queue's arena, so the messages from the last block are only released now that the host has taken them
+  sysExQueue.Release();
+
   if (sysExQueue.ElementsAvailable())
   {
     Event toAdd = {0};
@@ -203,7 +205,7 @@ void IPlugVST3ProcessorBase::ProcessMidiOut(IPlugQueue<SysExData>& sysExQueue, S
       toAdd.sampleOffset = sysExBuf.mOffset;
       toAdd.data.type = DataEvent::kMidiSysEx;
       toAdd.data.size = sysExBuf.mSize;
-      toAdd.data.bytes = (uint8*) sysExBuf.mData; // TODO!  this is a problem if more than one message in this block!
+      toAdd.data.bytes = (uint8*) sysExBuf.mData;
       pOutputEvents->addEvent(toAdd);
     }
   }
@@ -312,7 +314,34 @@ void IPlugVST3ProcessorBase::ProcessParameterChanges(ProcessData& data, IPlugQue
 #ifdef PARAMS_MUTEX
                 mPlug.mParams_mutex.Enter();
 #endif
-                mPlug.GetParam(idx)->SetNormalized(value);
+                IParam* pParam = mPlug.GetParam(idx);
+
+                if (GetSampleAccurateAutomation())
+                {
+                  // convert the points in blocks, so that shaped parameters do one batch conversion rather than a virtual call per point
+                  constexpr int32 kPointBlockSize = 64;
+                  int32 pointOffsets[kPointBlockSize];
+                  double pointValues[kPointBlockSize];
+
+                  for (int32 blockStart = 0; blockStart < numPoints; blockStart += kPointBlockSize)
+                  {
+                    const int32 blockEnd = std::min(blockStart + kPointBlockSize, numPoints);
+                    int32 nBlockPoints = 0;
+
+                    for (int32 pointIdx = blockStart; pointIdx < blockEnd; pointIdx++)
+                    {
+                      if (paramQueue->getPoint(pointIdx, pointOffsets[nBlockPoints], pointValues[nBlockPoints]) == kResultTrue)
+                        nBlockPoints++;
+                    }
+
+                    pParam->FromNormalized(pointValues, pointValues, nBlockPoints);
+
+                    for (int32 p = 0; p < nBlockPoints; p++)
+                      AddParamChange(idx, pointValues[p], pointOffsets[p]);
+                  }
+                }
+
+                pParam->SetNormalized(value);
               
                 // In VST3 non distributed the same parameter value is also set via IPlugVST3Controller::setParamNormalized(ParamID tag, ParamValue value)
                 mPlug.OnParamChange(idx, kHost, offsetSamples);
@@ -326,17 +355,26 @@ void IPlugVST3ProcessorBase::ProcessParameterChanges(ProcessData& data, IPlugQue
                 int channel = index / kCountCtrlNumber;
                 int ctrlr = index % kCountCtrlNumber;
 
-                IMidiMsg msg;
+                // with sample accurate automation, every point is sent as a MIDI message, otherwise just the last one
+                const int32 firstPointIdx = GetSampleAccurateAutomation() ? 0 : numPoints - 1;
 
-                if (ctrlr == kAfterTouch)
-                  msg.MakeChannelATMsg((int) (value * 127.), offsetSamples, channel);
-                else if (ctrlr == kPitchBend)
-                  msg.MakePitchWheelMsg((value * 2.)-1., channel, offsetSamples);
-                else
-                  msg.MakeControlChangeMsg((IMidiMsg::EControlChangeMsg) ctrlr, value, channel, offsetSamples);
+                for (int32 pointIdx = firstPointIdx; pointIdx < numPoints; pointIdx++)
+                {
+                  if (paramQueue->getPoint(pointIdx, offsetSamples, value) != kResultTrue)
+                    continue;
 
-                fromProcessor.Push(msg);
-                ProcessMidiMsg(msg);
+                  IMidiMsg msg;
+
+                  if (ctrlr == kAfterTouch)
+                    msg.MakeChannelATMsg((int) (value * 127.), offsetSamples, channel);
+                  else if (ctrlr == kPitchBend)
+                    msg.MakePitchWheelMsg((value * 2.)-1., channel, offsetSamples);
+                  else
+                    msg.MakeControlChangeMsg((IMidiMsg::EControlChangeMsg) ctrlr, value, channel, offsetSamples);
+
+                  fromProcessor.Push(msg);
+                  ProcessMidiMsgFromAPI(msg);
+                }
               }
             }
               break;
@@ -410,6 +448,20 @@ void IPlugVST3ProcessorBase::ProcessAudio(ProcessData& data, ProcessSetup& setup
 #ifdef PARAMS_MUTEX
       mPlug.mParams_mutex.Enter();
 #endif
+      mPlug.ProcessParamValuesFromUI(data.numSamples);
+
+      // the host's silence flags save scanning the inputs, and tell it when the outputs can be skipped
+      auto allChannels = [](int32 nChans) { return nChans >= 64 ? ~static_cast<uint64>(0) : (static_cast<uint64>(1) << nChans) - 1; };
+      bool inputsSilent = data.numInputs > 0;
+
+      for (int32 inBus = 0; inBus < data.numInputs && inBus < (mSidechainActive ? 2 : 1); inBus++)
+      {
+        const uint64 mask = allChannels(data.inputs[inBus].numChannels);
+        inputsSilent = inputsSilent && (data.inputs[inBus].silenceFlags & mask) == mask;
+      }
+
+      SetInputSilentFromHost(inputsSilent);
+
       if (sampleSize == kSample32)
         ProcessBuffers(0.f, data.numSamples); // single precision
       else
@@ -417,12 +469,16 @@ void IPlugVST3ProcessorBase::ProcessAudio(ProcessData& data, ProcessSetup& setup
 #ifdef PARAMS_MUTEX
       mPlug.mParams_mutex.Leave();
 #endif
+
+      for (int32 outBus = 0; outBus < data.numOutputs; outBus++)
+        data.outputs[outBus].silenceFlags = GetOutputSilent() ? allChannels(data.outputs[outBus].numChannels) : 0;
     }
   }
 }
 
-void IPlugVST3ProcessorBase::Process(ProcessData& data, ProcessSetup& setup, const BusList& ins, const BusList& outs, IPlugQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugQueue<SysExData>& sysExFromEditor, SysExData& sysExBuf)
+void IPlugVST3ProcessorBase::Process(ProcessData& data, ProcessSetup& setup, const BusList& ins, const BusList& outs, IPlugMPMCQueue<IMidiMsg>& fromEditor, IPlugQueue<IMidiMsg>& fromProcessor, IPlugSysExQueue& sysExFromEditor, SysExData& sysExBuf)
 {
+  auto denormalScope = MakeDenormalScope();
   PrepareProcessContext(data, setup);
   ProcessParameterChanges(data, fromProcessor);
   
@@ -14,6 +14,161 @@
 
 #include "IPlugStructs.h"
 
+#ifdef OS_LINUX
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "pluginterfaces/gui/iplugview.h"
+
+#include "IPlugRunLoop.h"
+
+/** Adapts the host's Steinberg::Linux::IRunLoop to an iplug::IRunLoop, so that the UI is called back by the host when it has X events or its display timer is due */
+class IPlugVST3RunLoop final : public iplug::IRunLoop
+{
+public:
+  IPlugVST3RunLoop(Steinberg::Linux::IRunLoop* pHostRunLoop)
+  : mHostRunLoop(pHostRunLoop)
+  {
+    mHostRunLoop->addRef();
+  }
+
+  ~IPlugVST3RunLoop()
+  {
+    for (auto* pHandler : mEventHandlers)
+    {
+      mHostRunLoop->unregisterEventHandler(pHandler);
+      pHandler->release();
+    }
+
+    for (auto* pHandler : mTimerHandlers)
+    {
+      mHostRunLoop->unregisterTimer(pHandler);
+      pHandler->release();
+    }
+
+    mHostRunLoop->release();
+  }
+
+  IPlugVST3RunLoop(const IPlugVST3RunLoop&) = delete;
+  IPlugVST3RunLoop& operator=(const IPlugVST3RunLoop&) = delete;
+
+  bool AddFD(int fd, Callback func, void* pContext) override
+  {
+    auto* pHandler = new EventHandler(fd, func, pContext);
+
+    if (mHostRunLoop->registerEventHandler(pHandler, fd) != Steinberg::kResultOk)
+    {
+      pHandler->release();
+      return false;
+    }
+
+    mEventHandlers.push_back(pHandler);
+    return true;
+  }
+
+  void RemoveFD(int fd) override
+  {
+    for (auto it = mEventHandlers.begin(); it != mEventHandlers.end(); it++)
+    {
+      if ((*it)->mFD == fd)
+      {
+        mHostRunLoop->unregisterEventHandler(*it);
+        (*it)->release();
+        mEventHandlers.erase(it);
+        return;
+      }
+    }
+  }
+
+  int AddTimer(int intervalMS, Callback func, void* pContext) override
+  {
+    auto* pHandler = new TimerHandler(++mLastTimerID, func, pContext);
+
+    if (mHostRunLoop->registerTimer(pHandler, static_cast<Steinberg::Linux::TimerInterval>(intervalMS)) != Steinberg::kResultOk)
+    {
+      pHandler->release();
+      return 0;
+    }
+
+    mTimerHandlers.push_back(pHandler);
+    return mLastTimerID;
+  }
+
+  void RemoveTimer(int timerID) override
+  {
+    for (auto it = mTimerHandlers.begin(); it != mTimerHandlers.end(); it++)
+    {
+      if ((*it)->mID == timerID)
+      {
+        mHostRunLoop->unregisterTimer(*it);
+        (*it)->release();
+        mTimerHandlers.erase(it);
+        return;
+      }
+    }
+  }
+
+private:
+  /** FUnknown reference counting for the handlers, which the host may hold on to */
+  template <class I>
+  class Handler : public I
+  {
+  public:
+    Handler(Callback func, void* pContext) : mFunc(func), mContext(pContext) {}
+    virtual ~Handler() {}
+
+    Steinberg::tresult PLUGIN_API queryInterface(const Steinberg::TUID _iid, void** obj) override
+    {
+      QUERY_INTERFACE(_iid, obj, Steinberg::FUnknown::iid, I)
+      QUERY_INTERFACE(_iid, obj, I::iid, I)
+      *obj = nullptr;
+      return Steinberg::kNoInterface;
+    }
+
+    Steinberg::uint32 PLUGIN_API addRef() override { return ++mRefCount; }
+
+    Steinberg::uint32 PLUGIN_API release() override
+    {
+      const Steinberg::uint32 refCount = --mRefCount;
+
+      if (refCount == 0)
+        delete this;
+
+      return refCount;
+    }
+
+  protected:
+    Callback mFunc;
+    void* mContext;
+
+  private:
+    std::atomic<Steinberg::uint32> mRefCount {1};
+  };
+
+  class EventHandler final : public Handler<Steinberg::Linux::IEventHandler>
+  {
+  public:
+    EventHandler(int fd, Callback func, void* pContext) : Handler(func, pContext), mFD(fd) {}
+    void PLUGIN_API onFDIsSet(Steinberg::Linux::FileDescriptor) override { mFunc(mContext); }
+    const int mFD;
+  };
+
+  class TimerHandler final : public Handler<Steinberg::Linux::ITimerHandler>
+  {
+  public:
+    TimerHandler(int timerID, Callback func, void* pContext) : Handler(func, pContext), mID(timerID) {}
+    void PLUGIN_API onTimer() override { mFunc(mContext); }
+    const int mID;
+  };
+
+  Steinberg::Linux::IRunLoop* mHostRunLoop;
+  std::vector<EventHandler*> mEventHandlers;
+  std::vector<TimerHandler*> mTimerHandlers;
+  int mLastTimerID = 0;
+};
+#endif
+
 /** IPlug VST3 View  */
 template <class T>
 class IPlugVST3View : public Steinberg::CPluginView
@@ -45,6 +200,9 @@ public:
 #elif defined OS_MAC
       if (strcmp (type, Steinberg::kPlatformTypeNSView) == 0)
         return Steinberg::kResultTrue;
+#elif defined OS_LINUX
+      if (strcmp(type, Steinberg::kPlatformTypeX11EmbedWindowID) == 0)
+        return Steinberg::kResultTrue;
 #endif
     }
     
@@ -109,6 +267,7 @@ public:
     if (mOwner.HasUI())
     {
       void* pView = nullptr;
+      mOwner.SetEditorOpen(true);
 #ifdef OS_WIN
       if (strcmp(type, Steinberg::kPlatformTypeHWND) == 0)
         pView = mOwner.OpenWindow(pParent);
@@ -117,6 +276,23 @@ public:
         pView = mOwner.OpenWindow(pParent);
       else // Carbon
         return Steinberg::kResultFalse;
+#elif defined OS_LINUX
+      if (strcmp(type, Steinberg::kPlatformTypeX11EmbedWindowID) == 0)
+      {
+        // the host's loop calls the UI back for its X events and display timer, a UI without one has nothing to drive it
+        Steinberg::Linux::IRunLoop* pHostRunLoop = nullptr;
+
+        if (plugFrame && plugFrame->queryInterface(Steinberg::Linux::IRunLoop::iid, (void**) &pHostRunLoop) == Steinberg::kResultOk && pHostRunLoop)
+        {
+          mRunLoop = std::make_unique<IPlugVST3RunLoop>(pHostRunLoop);
+          pHostRunLoop->release(); // the adapter has its own reference
+        }
+
+        mOwner.SetHostRunLoop(mRunLoop.get());
+        pView = mOwner.OpenWindow(pParent);
+      }
+      else
+        return Steinberg::kResultFalse;
 #endif
       return Steinberg::kResultTrue;
     }
@@ -127,7 +303,15 @@ public:
   Steinberg::tresult PLUGIN_API removed() override
   {
     if (mOwner.HasUI())
+    {
       mOwner.CloseWindow();
+      mOwner.SetEditorOpen(false);
+    }
+
+#ifdef OS_LINUX
+    mOwner.SetHostRunLoop(nullptr);
+    mRunLoop = nullptr;
+#endif
     
     return CPluginView::removed();
   }
@@ -296,4 +480,7 @@ public:
   }
 
   T& mOwner;
+#ifdef OS_LINUX
+  std::unique_ptr<IPlugVST3RunLoop> mRunLoop;
+#endif
 };
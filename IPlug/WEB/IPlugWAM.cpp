@@ -10,16 +10,22 @@
 
 #include "IPlugWAM.h"
 
+#include <emscripten.h>
+
 using namespace iplug;
 
 IPlugWAM::IPlugWAM(const InstanceInfo& info, const Config& config)
 : IPlugAPIBase(config, kAPIWAM)
 , IPlugProcessor(config, kAPIWAM)
 {
+  AttachParamSnapshot(*this);
+
   int nInputs = MaxNChannels(ERoute::kInput), nOutputs = MaxNChannels(ERoute::kOutput);
 
   SetChannelConnections(ERoute::kInput, 0, nInputs, true);
   SetChannelConnections(ERoute::kOutput, 0, nOutputs, true);
+
+  mMessagesToUI.Resize(kMessagesToUISize);
 }
 
 const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
@@ -28,6 +34,15 @@ const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
 
   SetSampleRate(sr);
   SetBlockSize(bufsize);
+  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), !IsInstrument());
+  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true);
+
+  // bind this instance to the AudioWorkletProcessor being constructed, which calls init() from its constructor, see IPlugWAM-awp.js
+  EM_ASM({
+    Module.iplugLinks = Module.iplugLinks || {};
+    Module.iplugLinks[$0] = Module.iplugPendingLink;
+    Module.iplugPendingLink = undefined;
+  }, (int) this);
 
   DBGMSG("%i %i\n", sr, bufsize);
 
@@ -50,6 +65,7 @@ const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
   json.Append("]\n}");
 
   //TODO: correct place? - do we need a WAM reset message?
+  InitDeferred();
   OnParamReset(kReset);
   OnReset();
   postMessage("StartIdleTimer", nullptr, nullptr);
@@ -59,26 +75,26 @@ const char* IPlugWAM::init(uint32_t bufsize, uint32_t sr, void* pDesc)
 
 void IPlugWAM::onProcess(WAM::AudioBus* pAudio, void* pData)
 {
-  const int blockSize = GetBlockSize();
+  auto denormalScope = MakeDenormalScope(); // WebAssembly has no flush to zero mode, so this only keeps the callbacks alike
+  const int blockSize = GetHostBlockSize();
   
-  SetChannelConnections(ERoute::kInput, 0, MaxNChannels(ERoute::kInput), !IsInstrument()); //TODO: go elsewhere
-  SetChannelConnections(ERoute::kOutput, 0, MaxNChannels(ERoute::kOutput), true); //TODO: go elsewhere
   AttachBuffers(ERoute::kInput, 0, NChannelsConnected(ERoute::kInput), pAudio->inputs, blockSize);
   AttachBuffers(ERoute::kOutput, 0, NChannelsConnected(ERoute::kOutput), pAudio->outputs, blockSize);
   
   ENTER_PARAMS_MUTEX
+  ProcessParamValuesFromUI(blockSize);
   ProcessBuffers((float) 0.0f, blockSize);
   LEAVE_PARAMS_MUTEX
+
+  if (mMessagesToUISize)
+    FlushMessagesToUI();
 }
 
 void IPlugWAM::OnEditorIdleTick()
 {
-  while(mParamChangeFromProcessor.ElementsAvailable())
-  {
-    ParamTuple p;
-    mParamChangeFromProcessor.Pop(p);
-    SendParameterValueFromDelegate(p.idx, p.value, false);
-  }
+  mParamChangeFromProcessor.Drain([&](int paramIdx, double value) {
+    SendParameterValueFromDelegate(paramIdx, value, false);
+  });
 
   while (mMidiMsgsFromProcessor.ElementsAvailable())
   {
@@ -88,6 +104,40 @@ void IPlugWAM::OnEditorIdleTick()
   }
 
   OnIdle();
+  FlushMessagesToUI();
+}
+
+void IPlugWAM::AddMessageToUI(EWAMMessageToUI verb, int a, int b, double value, int dataSize, const void* pData)
+{
+  const int size = WAMMessageToUISize(dataSize);
+
+  if (mMessagesToUISize + size > kMessagesToUISize)
+  {
+    FlushMessagesToUI();
+
+    if (size > kMessagesToUISize)
+    {
+      DBGMSG("IPlugWAM: message to UI of %i bytes dropped\n", dataSize);
+      return;
+    }
+  }
+
+  WriteWAMMessageToUI(mMessagesToUI.Get() + mMessagesToUISize, verb, a, b, value, dataSize, pData);
+  mMessagesToUISize += size;
+}
+
+void IPlugWAM::FlushMessagesToUI()
+{
+  if (!mMessagesToUISize)
+    return;
+
+  EM_ASM({
+    var link = Module.iplugLinks && Module.iplugLinks[$0];
+    if (link && link.send)
+      link.send(HEAPU8.subarray($1, $1 + $2));
+  }, (int) this, (int) mMessagesToUI.Get(), mMessagesToUISize);
+
+  mMessagesToUISize = 0;
 }
 
 //WAM onMessageN
@@ -161,13 +211,10 @@ void IPlugWAM::onMidi(byte status, byte data1, byte data2)
   IMidiMsg msg = {0, status, data1, data2};
   ProcessMidiMsg(msg); // onMidi is not called on HPT. We could queue things up, but just process the message straightaway for now
   //mMidiMsgsFromProcessor.Push(msg);
-  
-  WDL_String dataStr;
-  dataStr.SetFormatted(16, "%i:%i:%i", msg.mStatus, msg.mData1, msg.mData2);
-  
-  // TODO: in the future this will be done via shared array buffer
+
   // if onMidi ever gets called on HPT, should defer via queue
-  postMessage("SMMFD", dataStr.Get(), "");
+  SendMidiMsgFromDelegate(msg);
+  FlushMessagesToUI();
 }
 
 void IPlugWAM::onParam(uint32_t idparam, double value)
@@ -180,53 +227,38 @@ void IPlugWAM::onSysex(byte* pData, uint32_t size)
 {
   ISysEx sysex = {0 /* no offset */, pData, (int) size };
   ProcessSysEx(sysex);
-  
-  WDL_String dataStr;
-  dataStr.SetFormatted(16, "%i", size);
-  
-  // TODO: in the future this will be done via shared array buffer
+
   // if onSysex ever gets called on HPT, should defer via queue
-  postMessage("SSMFD", dataStr.Get(), "");
+  SendSysexMsgFromDelegate(sysex);
+  FlushMessagesToUI();
 }
 
 void IPlugWAM::SendControlValueFromDelegate(int ctrlTag, double normalizedValue)
 {
-  WDL_String propStr;
-  WDL_String dataStr;
-
-  propStr.SetFormatted(16, "%i", ctrlTag);
-  dataStr.SetFormatted(16, "%f", normalizedValue);
-
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SCVFD", propStr.Get(), dataStr.Get());
+  AddMessageToUI(kWAMSCVFD, ctrlTag, 0, normalizedValue);
 }
 
 void IPlugWAM::SendControlMsgFromDelegate(int ctrlTag, int msgTag, int dataSize, const void* pData)
 {
-  WDL_String propStr;
-  propStr.SetFormatted(16, "%i:%i", ctrlTag, msgTag);
-  
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SCMFD", propStr.Get(), pData, (uint32_t) dataSize);
+  AddMessageToUI(kWAMSCMFD, ctrlTag, msgTag, 0., dataSize, pData);
 }
 
 void IPlugWAM::SendParameterValueFromDelegate(int paramIdx, double value, bool normalized)
 {
-  WDL_String propStr;
-  WDL_String dataStr;
-  propStr.SetFormatted(16, "%i", paramIdx);
-  dataStr.SetFormatted(16, "%f", value);
-
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SPVFD", propStr.Get(), dataStr.Get());
+  AddMessageToUI(kWAMSPVFD, paramIdx, 0, value);
 }
 
 void IPlugWAM::SendArbitraryMsgFromDelegate(int msgTag, int dataSize, const void* pData)
 {
-  WDL_String propStr;
-  propStr.SetFormatted(16, "%i", msgTag);
-  
-  // TODO: in the future this will be done via shared array buffer
-  postMessage("SAMFD", propStr.Get(), pData, (uint32_t) dataSize);
+  AddMessageToUI(kWAMSAMFD, msgTag, 0, 0., dataSize, pData);
 }
 
+void IPlugWAM::SendMidiMsgFromDelegate(const IMidiMsg& msg)
+{
+  AddMessageToUI(kWAMSMMFD, msg.mStatus, msg.mData1, msg.mData2);
+}
+
+void IPlugWAM::SendSysexMsgFromDelegate(const ISysEx& msg)
+{
+  AddMessageToUI(kWAMSSMFD, 0, 0, 0., msg.mSize, msg.mData);
+}
@@ -13,6 +13,7 @@
 
 #include "IPlugAPIBase.h"
 #include "IPlugProcessor.h"
+#include "IPlugWAMMessages.h"
 #include "processor.h"
 
 using namespace WAM;
@@ -56,9 +57,24 @@ public:
   void SendParameterValueFromDelegate(int paramIdx, double value, bool normalized) override;
   void SendArbitraryMsgFromDelegate(int msgTag, int dataSize = 0, const void* pData = nullptr) override;
   
+  void SendMidiMsgFromDelegate(const IMidiMsg& msg) override;
+  void SendSysexMsgFromDelegate(const ISysEx& msg) override;
+
 private:
+  /** The byte size of mMessagesToUI. It is allocated once, messages that don't fit in an empty batch are dropped */
+  static constexpr int kMessagesToUISize = 65536;
+
   /** Called repeatedly to emulate IPlugAPIBase::OnTimer() */
   void OnEditorIdleTick();
+
+  /** Append a message for the UI to the current batch, flushing first if it doesn't fit */
+  void AddMessageToUI(EWAMMessageToUI verb, int a, int b, double value, int dataSize = 0, const void* pData = nullptr);
+
+  /** Hand the batch to the AudioWorkletProcessor in one call, which copies it into the SharedArrayBuffer ring (or posts it, if there is no ring) */
+  void FlushMessagesToUI();
+
+  WDL_TypedBuf<uint8_t> mMessagesToUI;
+  int mMessagesToUISize = 0;
 };
 
 IPlugWAM* MakePlug(const InstanceInfo& info);
@@ -0,0 +1,81 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief The binary records that IPlugWAM batches up for the UI, and that IPlugWeb decodes. Shared so that the two WASM modules agree on the layout
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Verbs of the records sent from the WAM processor to the UI */
+enum EWAMMessageToUI
+{
+  kWAMSPVFD = 0,
+  kWAMSCVFD,
+  kWAMSCMFD,
+  kWAMSAMFD,
+  kWAMSMMFD,
+  kWAMSSMFD
+};
+
+/** The byte size of a record header: verb, two tags and the payload size as int32, then a double value. Payloads follow, padded to 8 bytes */
+static constexpr int kWAMMessageToUIHeaderSize = 24;
+
+/** @return The byte size of a record with a payload of dataSize bytes */
+static inline int WAMMessageToUISize(int dataSize)
+{
+  return kWAMMessageToUIHeaderSize + ((dataSize + 7) & ~7);
+}
+
+/** Write a record
+ * @param pDest Room for WAMMessageToUISize(dataSize) bytes */
+static inline void WriteWAMMessageToUI(uint8_t* pDest, EWAMMessageToUI verb, int a, int b, double value, int dataSize, const void* pData)
+{
+  const int32_t header[4] = { verb, a, b, dataSize };
+  memcpy(pDest, header, sizeof(header));
+  memcpy(pDest + sizeof(header), &value, sizeof(double));
+
+  if (dataSize)
+    memcpy(pDest + kWAMMessageToUIHeaderSize, pData, dataSize);
+}
+
+/** Decode a batch of records in one pass
+ * @param func Called as func(verb, a, b, value, dataSize, pData) for each record */
+template <typename F>
+static inline void ForEachWAMMessageToUI(const uint8_t* pData, int size, F&& func)
+{
+  int pos = 0;
+
+  while (pos + kWAMMessageToUIHeaderSize <= size)
+  {
+    int32_t header[4];
+    double value;
+    memcpy(header, pData + pos, sizeof(header));
+    memcpy(&value, pData + pos + sizeof(header), sizeof(double));
+
+    const int dataSize = header[3];
+
+    if (dataSize < 0 || pos + kWAMMessageToUIHeaderSize + dataSize > size)
+      break;
+
+    func(static_cast<EWAMMessageToUI>(header[0]), header[1], header[2], value, dataSize, pData + pos + kWAMMessageToUIHeaderSize);
+    pos += WAMMessageToUISize(dataSize);
+  }
+}
+
+END_IPLUG_NAMESPACE
@@ -9,6 +9,7 @@
 */
 
 #include "IPlugWeb.h"
+#include "IPlugWAMMessages.h"
 
 #include <memory>
 
@@ -179,6 +180,33 @@ static void _SendSysexMsgFromDelegate(int dataSize, uintptr_t pData)
   gPlug->SendSysexMsgFromDelegate(msg);
 }
 
+// a batch of records from IPlugWAM::FlushMessagesToUI(), decoded here so that a tick's updates cost one call from JS
+static void _ReceiveMessagesFromDSP(int size, uintptr_t pData)
+{
+  ForEachWAMMessageToUI(reinterpret_cast<const uint8_t*>(pData), size, [](EWAMMessageToUI verb, int a, int b, double value, int dataSize, const uint8_t* pMsgData) {
+    switch (verb)
+    {
+      case kWAMSPVFD: gPlug->SendParameterValueFromDelegate(a, value, true); break;
+      case kWAMSCVFD: gPlug->SendControlValueFromDelegate(a, value); break;
+      case kWAMSCMFD: gPlug->SendControlMsgFromDelegate(a, b, dataSize, pMsgData); break;
+      case kWAMSAMFD: gPlug->SendArbitraryMsgFromDelegate(a, dataSize, pMsgData); break;
+      case kWAMSMMFD:
+      {
+        IMidiMsg msg {0, (uint8_t) a, (uint8_t) b, (uint8_t) value};
+        gPlug->SendMidiMsgFromDelegate(msg);
+        break;
+      }
+      case kWAMSSMFD:
+      {
+        ISysEx msg(0, pMsgData, dataSize);
+        gPlug->SendSysexMsgFromDelegate(msg);
+        break;
+      }
+      default: break;
+    }
+  });
+}
+
 static void _StartIdleTimer()
 {
   gPlug->CreateTimer();
@@ -191,5 +219,6 @@ EMSCRIPTEN_BINDINGS(IPlugWeb) {
   function("SCVFD", &_SendControlValueFromDelegate);
   function("SMMFD", &_SendMidiMsgFromDelegate);
   function("SSMFD", &_SendSysexMsgFromDelegate);
+  function("DSPMSGS", &_ReceiveMessagesFromDSP);
   function("StartIdleTimer", &_StartIdleTimer);
 }
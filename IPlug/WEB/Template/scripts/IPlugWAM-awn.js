@@ -9,65 +9,91 @@ class NAME_PLACEHOLDERController extends WAMController
     if (options.outputChannelCount === undefined)   options.outputChannelCount = [2];
     if (options.processorOptions.inputChannelCount === undefined) options.processorOptions = {inputChannelCount:[]};
 
+    // messages from the DSP come through a SharedArrayBuffer ring when the page is cross-origin isolated, otherwise they are posted in batches
+    var ring = null;
+    if (typeof SharedArrayBuffer !== "undefined" && self.crossOriginIsolated) {
+      ring = new SharedArrayBuffer(8 + 65536 * 4); // read and write indices, then the bytes
+      options.processorOptions.dspToUIRing = ring;
+    }
+
+    // the DSP module compiled by importScripts(), which the processor instantiates, see IPlugWAM-awp.js
+    options.processorOptions.wasmModule = NAME_PLACEHOLDERController.wasmModule;
+
     options.buflenSPN = 1024;
     super(actx, "NAME_PLACEHOLDER", options);
+
+    this.dspMsgBuffer = 0;
+    this.dspMsgBufferSize = 0;
+
+    if (ring) {
+      this.ringIndices = new Int32Array(ring, 0, 2);
+      this.ringBytes = new Uint8Array(ring, 8);
+      this.ringScratch = new Uint8Array(this.ringBytes.length);
+      this.pollDSPToUIRing = this.pollDSPToUIRing.bind(this);
+      requestAnimationFrame(this.pollDSPToUIRing);
+    }
   }
 
+  // index.html calls this before constructing the controller, to load the worklet scripts and the DSP module
   static importScripts (actx) {
     var origin = "ORIGIN_PLACEHOLDER";
 
-    return new Promise( (resolve) => {
+    // The AudioWorklet can't fetch or compile WebAssembly asynchronously, so the DSP module is compiled here while it streams,
+    // or index.html already started it. WebAssembly.Module can be passed to the processor in the AudioWorkletNodeOptions
+    var wasm = (typeof NAME_PLACEHOLDER_WAM_WASM !== "undefined") ? NAME_PLACEHOLDER_WAM_WASM
+                                                                 : WebAssembly.compileStreaming(fetch(origin + "scripts/NAME_PLACEHOLDER-wam.wasm"));
+
+    return new Promise( (resolve, reject) => {
+      wasm.then((module) => {
+        NAME_PLACEHOLDERController.wasmModule = module;
       actx.audioWorklet.addModule(origin + "scripts/NAME_PLACEHOLDER-wam.js").then(() => {
       actx.audioWorklet.addModule(origin + "scripts/wam-processor.js").then(() => {
       actx.audioWorklet.addModule(origin + "scripts/NAME_PLACEHOLDER-awp.js").then(() => {
         resolve();
-      }) }) });
+      }) }) }) }, reject);
     })
   }
 
+  pollDSPToUIRing() {
+    const capacity = this.ringBytes.length;
+    const read = Atomics.load(this.ringIndices, 0);
+    const write = Atomics.load(this.ringIndices, 1);
+    const size = (write - read + capacity) % capacity;
+
+    if (size > 0) {
+      const first = Math.min(size, capacity - read);
+      this.ringScratch.set(this.ringBytes.subarray(read, read + first), 0);
+      this.ringScratch.set(this.ringBytes.subarray(0, size - first), first);
+      Atomics.store(this.ringIndices, 0, write);
+      this.dispatchDSPMessages(this.ringScratch.subarray(0, size));
+    }
+
+    requestAnimationFrame(this.pollDSPToUIRing);
+  }
+
+  // hand a batch of records from IPlugWAM::FlushMessagesToUI() to the web module, which decodes them in one call
+  dispatchDSPMessages(bytes) {
+    if (bytes.length > this.dspMsgBufferSize) {
+      if (this.dspMsgBuffer)
+        Module._free(this.dspMsgBuffer);
+
+      this.dspMsgBufferSize = Math.max(bytes.length, 65536);
+      this.dspMsgBuffer = Module._malloc(this.dspMsgBufferSize);
+    }
+
+    Module.HEAPU8.set(bytes, this.dspMsgBuffer);
+    Module.DSPMSGS(bytes.length, this.dspMsgBuffer);
+  }
+
   onmessage(msg) {
     //Received the WAM descriptor from the processor - could create an HTML UI here, based on descriptor
     if(msg.type == "descriptor") {
       console.log("got WAM descriptor...");
     }
 
-    //Send Parameter Value From Delegate
-    if(msg.verb == "SPVFD") {
-      Module.SPVFD(parseInt(msg.prop), parseFloat(msg.data));
-    }
-    //Set Control Value From Delegate
-    else if(msg.verb == "SCVFD") {
-      Module.SCVFD(parseInt(msg.prop), parseFloat(msg.data));
-    }
-    //Send Control Message From Delegate
-    else if(msg.verb == "SCMFD") {
-      var res = msg.prop.split(":");
-      var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SCMFD(parseInt(res[0]), parseInt(res[1]), data.length, buffer);
-      Module._free(buffer);
-    }
-    //Send Arbitrary Message From Delegate
-    else if(msg.verb == "SAMFD") {
-      var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SAMFD(parseInt(msg.prop), data.length, buffer);
-      Module._free(buffer);
-    }
-    //Send MIDI Message From Delegate
-    else if(msg.verb == "SMMFD") {
-      var res = msg.prop.split(":");
-      Module.SMMFD(parseInt(res[0]), parseInt(res[1]), parseInt(res[2]));
-    }
-    //Send Sysex Message From Delegate
-    else if(msg.verb == "SSMFD") {
-      var data = new Uint8Array(msg.data);
-      const buffer = Module._malloc(data.length);
-      Module.HEAPU8.set(data, buffer);
-      Module.SSMFD(parseInt(msg.prop), data.length, buffer);
-      Module._free(buffer);
+    //Batch of messages from the DSP, when there is no SharedArrayBuffer ring
+    if(msg.verb == "DSPMSGS") {
+      this.dispatchDSPMessages(new Uint8Array(msg.data));
     }
     else if(msg.verb == "StartIdleTimer") {
       Module.StartIdleTimer();
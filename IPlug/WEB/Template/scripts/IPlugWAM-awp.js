@@ -5,7 +5,43 @@ class NAME_PLACEHOLDER_AWP extends AudioWorkletGlobalScope.WAMProcessor
   constructor(options) {
     options = options || {}
     options.mod = AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER;
+
+    // the first processor instantiates the DSP module that the controller compiled on the main thread, see IPlugWAM-module.js
+    if (options.mod.instantiate && options.processorOptions && options.processorOptions.wasmModule)
+      options.mod.instantiate(options.processorOptions.wasmModule);
+
+    // IPlugWAM::init() is called from the WAMProcessor constructor, and binds the C++ instance to this link
+    const link = {};
+    options.mod.iplugPendingLink = link;
     super(options);
+
+    const ring = options.processorOptions && options.processorOptions.dspToUIRing;
+
+    if (ring) {
+      // single producer, single consumer byte ring shared with the controller on the main thread, see IPlugWAM-awn.js
+      const indices = new Int32Array(ring, 0, 2); // read, write
+      const bytes = new Uint8Array(ring, 8);
+      const capacity = bytes.length;
+
+      link.send = (batch) => {
+        const read = Atomics.load(indices, 0);
+        const write = Atomics.load(indices, 1);
+        const free = (read - write - 1 + capacity) % capacity;
+
+        if (batch.length > free)
+          return; // the UI isn't keeping up, drop the batch rather than block the audio thread
+
+        const first = Math.min(batch.length, capacity - write);
+        bytes.set(batch.subarray(0, first), write);
+        bytes.set(batch.subarray(first), 0);
+        Atomics.store(indices, 1, (write + batch.length) % capacity);
+      };
+    }
+    else {
+      link.send = (batch) => {
+        this.port.postMessage({ verb: "DSPMSGS", prop: "", data: batch.slice().buffer });
+      };
+    }
   }
 }
 
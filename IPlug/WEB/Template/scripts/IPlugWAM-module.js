@@ -0,0 +1,17 @@
+/* Prefixed to NAME_PLACEHOLDER-wam.js by makedist-web.sh, declares the emscripten Module of the NAME_PLACEHOLDER DSP in the AudioWorklet scope */
+
+AudioWorkletGlobalScope.WAM = AudioWorkletGlobalScope.WAM || {};
+AudioWorkletGlobalScope.WAM.NAME_PLACEHOLDER = {
+  ENVIRONMENT: 'WEB',
+
+  // The AudioWorklet can't fetch the .wasm, or compile it asynchronously, so emscripten waits here until the first
+  // NAME_PLACEHOLDER_AWP calls instantiate() with the module that was compiled on the main thread, see IPlugWAM-awn.js.
+  // Instantiating a compiled module is synchronous, so the runtime is ready by the time the processor's constructor continues
+  instantiateWasm: function(imports, receiveInstance) {
+    this.instantiate = function(module) {
+      this.instantiate = null;
+      receiveInstance(new WebAssembly.Instance(module, imports), module);
+    };
+    return {};
+  }
+};
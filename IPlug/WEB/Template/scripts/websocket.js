@@ -18,23 +18,22 @@ function setupWebSocket(onCompleted) {
         var buf = new Uint8Array(msg).buffer;
         var dv = new DataView(buf);
         var pos = 0;
-        var strlen = dv.getInt32(pos, true); pos += 4;
-        var prefix = new TextDecoder("utf-8").decode(new Uint8Array(buf, pos, strlen)); pos += strlen;
+        var type = dv.getUint8(pos); pos++; // see IWebsocketEditorDelegate::EWebsocketMsgType
 
         //Send Parameter Value From Delegate
-        if(prefix == "SPVFD") {
+        if(type == 0) {
           var paramIdx = dv.getInt32(pos, true); pos += 4;
           var value = dv.getFloat64(pos, true); pos += 8;
           Module.SPVFD(paramIdx, value);
         }
-        //Send Control Message From Delegate
-        else if(prefix == "SCVDD") {
+        //Send Control Value From Delegate
+        else if(type == 1) {
           var ctrlTag = dv.getInt32(pos, true); pos += 4;
           var value = dv.getFloat64(pos, true); pos += 8;
           Module.SCVFD(ctrlTag, value);
         }
         //Send Control Message From Delegate
-        else if(prefix == "SCMFD") {
+        else if(type == 2) {
           var ctrlTag = dv.getInt32(pos, true); pos += 4;
           var msgTag = dv.getInt32(pos, true); pos += 4;
           var dataSize = dv.getInt32(pos, true); pos += 4;
@@ -46,7 +45,7 @@ function setupWebSocket(onCompleted) {
           Module._free(esbuf);
         }
         //Send Arbitrary Message From Delegate
-        else if(prefix == "SAMFD") {
+        else if(type == 3) {
           var msgTag = dv.getInt32(pos, true); pos += 4;
           var dataSize = dv.getInt32(pos, true); pos += 4;
           var data = new Uint8Array(buf, pos, dataSize);
@@ -57,21 +56,20 @@ function setupWebSocket(onCompleted) {
           Module._free(esbuf);
         }
         //Send MIDI Message From Delegate
-        else if(prefix == "SMMFD") {
-          var status = dv.getUint8(pos, true); pos ++;
-          var data1 = dv.getUint8(pos, true); pos ++;
-          var data2 = dv.getUint8(pos, true); pos ++;
+        else if(type == 4) {
+          var status = dv.getUint8(pos); pos ++;
+          var data1 = dv.getUint8(pos); pos ++;
+          var data2 = dv.getUint8(pos); pos ++;
           Module.SMMFD(status, data1, data2);
         }
         //Send Sysex Message From Delegate
-        else if(prefix == "SSMFD") {
-          var msgTag = dv.getInt32(pos, true); pos += 4;
+        else if(type == 5) {
           var dataSize = dv.getInt32(pos, true); pos += 4;
           var data = new Uint8Array(buf, pos, dataSize);
 
           const esbuf = Module._malloc(data.length);
           Module.HEAPU8.set(data, esbuf);
-          Module.SSMFD(msgTag, data.length, esbuf);
+          Module.SSMFD(data.length, esbuf);
           Module._free(esbuf);
         }
     }
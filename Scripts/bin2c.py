@@ -3,6 +3,7 @@ import collections
 import os
 import os.path
 import re
+import struct
 import sys
 
 INDENT = 2
@@ -169,6 +170,10 @@ def compress(method, data_in):
     data = c.compress(data_in)
     data += c.flush()
     
+  elif method == 'zlib':
+    import zlib
+    data = zlib.compress(data_in, 9)
+    
   elif method == 'none':
     data = data_in
     
@@ -178,6 +183,58 @@ def compress(method, data_in):
   return data
 # END compress
 
+PACK_MAGIC = 0x4B505249 # "IRPK", see IPlug/IPlugResourcePack.h
+PACK_VERSION = 1
+PACK_ALIGN = 16
+
+def pack_hash(name):
+  '''
+  FNV-1a of the lower case name, as IResourcePack::Hash().
+  '''
+  h = 2166136261
+  for c in name.lower().encode('utf-8'):
+    h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+  return h
+# END pack_hash
+
+def make_pack(files, method):
+  '''
+  Build an IResourcePack from a list of (name, data) pairs. Entries are compressed with zlib if method is 'zlib' and it makes them smaller,
+  so already compressed formats such as PNG stay uncompressed and can be used in place.
+  '''
+  entries = []
+  for name, data in files:
+    stored, compression = data, 0
+    if method == 'zlib':
+      z = compress('zlib', data)
+      if len(z) < len(data):
+        stored, compression = z, 1
+    elif method != 'none':
+      raise Exception('Resource packs can only be compressed with zlib')
+    entries.append((pack_hash(name), name.encode('utf-8'), stored, len(data), compression))
+  entries.sort(key=lambda e: (e[0], e[1]))
+  
+  header_size = 12
+  entry_size = 7 * 4
+  names_offset = header_size + entry_size * len(entries)
+  names = b''.join(e[1] for e in entries)
+  pos = names_offset + len(names)
+  
+  table = []
+  data = b''
+  name_pos = names_offset
+  for h, name, stored, size, compression in entries:
+    pad = (-pos) % PACK_ALIGN
+    data += b'\0' * pad
+    pos += pad
+    table.append(struct.pack('<7I', h, name_pos, len(name), pos, len(stored), size, compression))
+    data += stored
+    pos += len(stored)
+    name_pos += len(name)
+  
+  return struct.pack('<3I', PACK_MAGIC, PACK_VERSION, len(entries)) + b''.join(table) + names + data
+# END make_pack
+
 def main(argv):
   parser = argparse.ArgumentParser()
   # parser.add_argument('-g', '--header', type=str, default=None,
@@ -185,8 +242,16 @@ def main(argv):
   parser.add_argument('--cd', type=str, default='.',
     help='CD to the given directory before listing files.')
   parser.add_argument('-c', '--compress', default='none',
-    choices=['gzip', 'bz2', 'xz', 'none'],
-    help='Compress the data before exporting it')
+    choices=['gzip', 'bz2', 'xz', 'zlib', 'none'],
+    help='Compress the data before exporting it. With --pack, each entry is compressed on its own, and only zlib is supported')
+  parser.add_argument('-p', '--pack', type=str, default=None, metavar='name',
+    help='Put all the inputs into a single IResourcePack array with this name, looked up by file name, instead of one array each')
+  parser.add_argument('--pack-file', type=str, default=None, metavar='path',
+    help='With --pack, also write the pack to this file, for IResourcePack::OpenFile()')
+  parser.add_argument('--pack-paths', action='store_true',
+    help='With --pack, name entries by their paths, relative to --cd or to their --dir, rather than their file names, e.g. for the assets of a web UI')
+  parser.add_argument('-d', '--dir', type=str, action='append', metavar='path', default=[],
+    help='With --pack, add every file in this folder and its sub folders, e.g. a web UI build folder')
   parser.add_argument('-a', '--array', type=str, default=None, metavar='name',
     help='If set this will generate an array of included resources and their names')
   parser.add_argument('-s', '--scaled', type=str, action='append', metavar='path', default=[],
@@ -208,13 +273,17 @@ def main(argv):
     raise Exception('Invalid number of input arguments, must be multiple of 2')
     
   entries = []
+  pack_names = []
   
-  def add_entry(path, name):
+  def add_entry(path, name, pack_path=None):
     pt = os.path.relpath(path).replace('\\', '/')
     with open(pt, 'rb') as fd:
       data_in = fd.read()
-    data = compress(args.compress, data_in)
+    # packed entries are compressed one by one, when the pack is made
+    data = data_in if args.pack else compress(args.compress, data_in)
     entries.append(Entry(pt, data, make_cname(name)))
+    pack_path = (pack_path or pt).replace('\\', '/')
+    pack_names.append(pack_path if args.pack_paths else os.path.basename(pack_path))
   
   # Process our normal args
   for i in range(0, len(inputs), 2):
@@ -235,6 +304,23 @@ def main(argv):
           add_entry(fn, fn)
   # end process scaled arguments
   
+  for dir in args.dir:
+    if not args.pack:
+      raise Exception('--dir can only be used with --pack')
+    for root, dirs, files in os.walk(dir):
+      dirs.sort()
+      for fn in sorted(files):
+        path = os.path.join(root, fn)
+        rel = os.path.relpath(path, dir)
+        add_entry(path, rel, rel)
+  
+  if args.pack:
+    pack = make_pack([(name, en.data) for name, en in zip(pack_names, entries)], args.compress)
+    if args.pack_file:
+      with open(args.pack_file, 'wb') as fd:
+        fd.write(pack)
+    entries = [Entry(args.pack, pack, make_cname(args.pack))]
+  
   process(entries, args.output_file, args.output_header, args.array)
 
 if __name__ == '__main__':
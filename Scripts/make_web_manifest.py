@@ -0,0 +1,49 @@
+#!/usr/bin/python3
+
+# make_web_manifest.py writes the manifest of the resources a web build fetches when they are first loaded, rather than preloading them with file_packager.py
+# IGraphicsWeb creates each bitmap at the size listed here and draws the image into it once it arrives, see IGraphicsWeb::LoadAPIBitmap()
+# arguments:
+# 1st argument : the project's resources folder, with the images in img/ and the fonts in fonts/
+# 2nd argument : the .js file to write, which defines the iplugResources global
+
+import sys, os, struct, json
+
+def png_size(path):
+  with open(path, 'rb') as f:
+    header = f.read(24)
+
+  if len(header) < 24 or header[:8] != b'\x89PNG\r\n\x1a\n' or header[12:16] != b'IHDR':
+    return None
+
+  return struct.unpack('>II', header[16:24])
+
+def main():
+  resources = sys.argv[1]
+  output = sys.argv[2]
+
+  manifest = {}
+
+  imgdir = os.path.join(resources, 'img')
+  if os.path.isdir(imgdir):
+    for name in sorted(os.listdir(imgdir)):
+      if name.lower().endswith('.png'):
+        size = png_size(os.path.join(imgdir, name))
+        if size is None:
+          print('make_web_manifest.py: ' + name + ' is not a valid PNG, skipping', file=sys.stderr)
+          continue
+        manifest['/resources/img/' + name] = { 'w': size[0], 'h': size[1] }
+
+  fontdir = os.path.join(resources, 'fonts')
+  if os.path.isdir(fontdir):
+    for name in sorted(os.listdir(fontdir)):
+      if name.lower().endswith(('.ttf', '.otf')):
+        manifest['/resources/fonts/' + name] = { 'size': os.path.getsize(os.path.join(fontdir, name)) }
+
+  with open(output, 'w') as f:
+    f.write('var iplugResources = ' + json.dumps(manifest, indent=1) + ';\n')
+
+  # the number of resources, for makedist-web.sh
+  print(len(manifest))
+
+if __name__ == '__main__':
+  main()
@@ -62,13 +62,18 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     GetUI()->SetAllControlsDirty();
   };
   
-  pGraphics->SetKeyHandlerFunc([DoFunc](const IKeyPress& key, bool isUp)
+  pGraphics->SetKeyHandlerFunc([this, DoFunc](const IKeyPress& key, bool isUp)
   {
     if(!isUp) {
       switch (key.VK) {
         case kVK_UP: DoFunc(EFunc::More); return true;
         case kVK_DOWN: DoFunc(EFunc::Less); return true;
         case kVK_TAB: key.S ? DoFunc(EFunc::Prev) : DoFunc(EFunc::Next); return true;
+        case kVK_B:
+          GetUI()->StartDrawBenchmark(300, [this](const IDrawBenchmarkResult& result) {
+            GetUI()->GetControlWithTag(kCtrlTagTestNum)->As<ITextControl>()->SetStrFmt(128, "%s: %.2f ms/frame", result.mDrawingAPI, result.mMeanFrameTime * 1000.);
+          });
+          return true;
         default: return false;
       }
     }
@@ -88,6 +93,7 @@ void IGraphicsStressTest::LayoutUI(IGraphics* pGraphics)
     {
       g.DrawText(IText(30), "Press tab to go to next test", r);
       g.DrawText(IText(30), "up/down to change the # of things", r.GetVShifted(40.f));
+      g.DrawText(IText(30), "B to benchmark 300 frames", r.GetVShifted(80.f));
     }
     else
     //      if (!g.CheckLayer(pCaller->mLayer))
@@ -28,7 +28,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "convoengine.h"
+#include "mutex.h"
 
 #include "denormal.h"
 
@@ -38,59 +42,332 @@
 #define CONVOENGINE_SILENCE_THRESH 1.0e-12 // -240dB
 #define CONVOENGINE_IMPULSE_SILENCE_THRESH 1.0e-15 // -300dB
 
-static void WDL_CONVO_CplxMul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFCPLXf *b, int n)
+// impulse spectra are stored split, with the fft_size real parts of a block followed by its fft_size
+// imaginary parts, so the multiply only has to deinterleave the input spectrum
+#if !defined(WDL_CONVO_NO_SIMD) && !defined(WDL_CONVO_USE_AVX) && !defined(WDL_CONVO_USE_SSE) && !defined(WDL_CONVO_USE_NEON)
+  #if defined(__AVX__)
+    #define WDL_CONVO_USE_AVX
+  #elif defined(__SSE2__) || _M_IX86_FP >= 2 || defined(_M_X64) || defined(_M_AMD64)
+    #define WDL_CONVO_USE_SSE
+  #elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && (WDL_FFT_REALSIZE == 4 || defined(__aarch64__))
+    #define WDL_CONVO_USE_NEON
+  #endif
+#endif
+
+#if defined(WDL_CONVO_WANT_FULLPRECISION_IMPULSE_STORAGE) && WDL_FFT_REALSIZE != 4
+  // double spectra with double impulses, scalar only
+  #undef WDL_CONVO_USE_AVX
+  #undef WDL_CONVO_USE_SSE
+  #undef WDL_CONVO_USE_NEON
+#endif
+
+#if defined(WDL_CONVO_USE_AVX)
+  #include <immintrin.h>
+#elif defined(WDL_CONVO_USE_SSE)
+  #include <emmintrin.h>
+#elif defined(WDL_CONVO_USE_NEON)
+  #include <arm_neon.h>
+#endif
+
+// c = a*b (or c += a*b if add), for n complex values
+template<bool add> static void WDL_CONVO_CplxMulSplit(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a,
+                                                      const WDL_CONVO_IMPULSEBUFf *bre, const WDL_CONVO_IMPULSEBUFf *bim, int n)
+{
+  WDL_FFT_REAL *cp = (WDL_FFT_REAL *)c;
+  const WDL_FFT_REAL *ap = (const WDL_FFT_REAL *)a;
+  int i=0;
+
+#if WDL_FFT_REALSIZE == 4
+
+#if defined(WDL_CONVO_USE_AVX)
+  for (; i+8 <= n; i += 8)
+  {
+    const __m256 a0 = _mm256_loadu_ps(ap+i*2), a1 = _mm256_loadu_ps(ap+i*2+8);
+    const __m256 x = _mm256_permute2f128_ps(a0,a1,0x20), y = _mm256_permute2f128_ps(a0,a1,0x31);
+    const __m256 ar = _mm256_shuffle_ps(x,y,_MM_SHUFFLE(2,0,2,0)), ai = _mm256_shuffle_ps(x,y,_MM_SHUFFLE(3,1,3,1));
+    const __m256 br = _mm256_loadu_ps(bre+i), bi = _mm256_loadu_ps(bim+i);
+    const __m256 cr = _mm256_sub_ps(_mm256_mul_ps(ar,br),_mm256_mul_ps(ai,bi));
+    const __m256 ci = _mm256_add_ps(_mm256_mul_ps(ar,bi),_mm256_mul_ps(ai,br));
+    const __m256 lo = _mm256_unpacklo_ps(cr,ci), hi = _mm256_unpackhi_ps(cr,ci);
+    __m256 c0 = _mm256_permute2f128_ps(lo,hi,0x20), c1 = _mm256_permute2f128_ps(lo,hi,0x31);
+    if (add)
+    {
+      c0 = _mm256_add_ps(c0,_mm256_loadu_ps(cp+i*2));
+      c1 = _mm256_add_ps(c1,_mm256_loadu_ps(cp+i*2+8));
+    }
+    _mm256_storeu_ps(cp+i*2,c0);
+    _mm256_storeu_ps(cp+i*2+8,c1);
+  }
+#endif
+#if defined(WDL_CONVO_USE_AVX) || defined(WDL_CONVO_USE_SSE)
+  for (; i+4 <= n; i += 4)
+  {
+    const __m128 a0 = _mm_loadu_ps(ap+i*2), a1 = _mm_loadu_ps(ap+i*2+4);
+    const __m128 ar = _mm_shuffle_ps(a0,a1,_MM_SHUFFLE(2,0,2,0)), ai = _mm_shuffle_ps(a0,a1,_MM_SHUFFLE(3,1,3,1));
+    const __m128 br = _mm_loadu_ps(bre+i), bi = _mm_loadu_ps(bim+i);
+    const __m128 cr = _mm_sub_ps(_mm_mul_ps(ar,br),_mm_mul_ps(ai,bi));
+    const __m128 ci = _mm_add_ps(_mm_mul_ps(ar,bi),_mm_mul_ps(ai,br));
+    __m128 c0 = _mm_unpacklo_ps(cr,ci), c1 = _mm_unpackhi_ps(cr,ci);
+    if (add)
+    {
+      c0 = _mm_add_ps(c0,_mm_loadu_ps(cp+i*2));
+      c1 = _mm_add_ps(c1,_mm_loadu_ps(cp+i*2+4));
+    }
+    _mm_storeu_ps(cp+i*2,c0);
+    _mm_storeu_ps(cp+i*2+4,c1);
+  }
+#elif defined(WDL_CONVO_USE_NEON)
+  for (; i+4 <= n; i += 4)
+  {
+    const float32x4x2_t av = vld2q_f32(ap+i*2);
+    const float32x4_t br = vld1q_f32(bre+i), bi = vld1q_f32(bim+i);
+    float32x4x2_t cv;
+    cv.val[0] = vmlsq_f32(vmulq_f32(av.val[0],br),av.val[1],bi);
+    cv.val[1] = vmlaq_f32(vmulq_f32(av.val[0],bi),av.val[1],br);
+    if (add)
+    {
+      const float32x4x2_t old = vld2q_f32(cp+i*2);
+      cv.val[0] = vaddq_f32(cv.val[0],old.val[0]);
+      cv.val[1] = vaddq_f32(cv.val[1],old.val[1]);
+    }
+    vst2q_f32(cp+i*2,cv);
+  }
+#endif
+
+#else // double spectra, float impulses
+
+#if defined(WDL_CONVO_USE_AVX)
+  for (; i+4 <= n; i += 4)
+  {
+    const __m256d a0 = _mm256_loadu_pd(ap+i*2), a1 = _mm256_loadu_pd(ap+i*2+4);
+    const __m256d x = _mm256_permute2f128_pd(a0,a1,0x20), y = _mm256_permute2f128_pd(a0,a1,0x31);
+    const __m256d ar = _mm256_unpacklo_pd(x,y), ai = _mm256_unpackhi_pd(x,y);
+    const __m256d br = _mm256_cvtps_pd(_mm_loadu_ps(bre+i)), bi = _mm256_cvtps_pd(_mm_loadu_ps(bim+i));
+    const __m256d cr = _mm256_sub_pd(_mm256_mul_pd(ar,br),_mm256_mul_pd(ai,bi));
+    const __m256d ci = _mm256_add_pd(_mm256_mul_pd(ar,bi),_mm256_mul_pd(ai,br));
+    const __m256d lo = _mm256_unpacklo_pd(cr,ci), hi = _mm256_unpackhi_pd(cr,ci);
+    __m256d c0 = _mm256_permute2f128_pd(lo,hi,0x20), c1 = _mm256_permute2f128_pd(lo,hi,0x31);
+    if (add)
+    {
+      c0 = _mm256_add_pd(c0,_mm256_loadu_pd(cp+i*2));
+      c1 = _mm256_add_pd(c1,_mm256_loadu_pd(cp+i*2+4));
+    }
+    _mm256_storeu_pd(cp+i*2,c0);
+    _mm256_storeu_pd(cp+i*2+4,c1);
+  }
+#endif
+#if defined(WDL_CONVO_USE_AVX) || defined(WDL_CONVO_USE_SSE)
+  for (; i+2 <= n; i += 2)
+  {
+    const __m128d a0 = _mm_loadu_pd(ap+i*2), a1 = _mm_loadu_pd(ap+i*2+2);
+    const __m128d ar = _mm_unpacklo_pd(a0,a1), ai = _mm_unpackhi_pd(a0,a1);
+    const __m128d br = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(bre+i)));
+    const __m128d bi = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(bim+i)));
+    const __m128d cr = _mm_sub_pd(_mm_mul_pd(ar,br),_mm_mul_pd(ai,bi));
+    const __m128d ci = _mm_add_pd(_mm_mul_pd(ar,bi),_mm_mul_pd(ai,br));
+    __m128d c0 = _mm_unpacklo_pd(cr,ci), c1 = _mm_unpackhi_pd(cr,ci);
+    if (add)
+    {
+      c0 = _mm_add_pd(c0,_mm_loadu_pd(cp+i*2));
+      c1 = _mm_add_pd(c1,_mm_loadu_pd(cp+i*2+2));
+    }
+    _mm_storeu_pd(cp+i*2,c0);
+    _mm_storeu_pd(cp+i*2+2,c1);
+  }
+#elif defined(WDL_CONVO_USE_NEON)
+  for (; i+2 <= n; i += 2)
+  {
+    const float64x2x2_t av = vld2q_f64(ap+i*2);
+    const float64x2_t br = vcvt_f64_f32(vld1_f32(bre+i)), bi = vcvt_f64_f32(vld1_f32(bim+i));
+    float64x2x2_t cv;
+    cv.val[0] = vsubq_f64(vmulq_f64(av.val[0],br),vmulq_f64(av.val[1],bi));
+    cv.val[1] = vaddq_f64(vmulq_f64(av.val[0],bi),vmulq_f64(av.val[1],br));
+    if (add)
+    {
+      const float64x2x2_t old = vld2q_f64(cp+i*2);
+      cv.val[0] = vaddq_f64(cv.val[0],old.val[0]);
+      cv.val[1] = vaddq_f64(cv.val[1],old.val[1]);
+    }
+    vst2q_f64(cp+i*2,cv);
+  }
+#endif
+
+#endif
+
+  for (; i < n; i ++)
+  {
+    const WDL_FFT_REAL ar = ap[i*2], ai = ap[i*2+1];
+    const WDL_FFT_REAL br = (WDL_FFT_REAL)bre[i], bi = (WDL_FFT_REAL)bim[i];
+    const WDL_FFT_REAL cr = ar*br - ai*bi, ci = ar*bi + ai*br;
+    if (add)
+    {
+      cp[i*2] += cr;
+      cp[i*2+1] += ci;
+    }
+    else
+    {
+      cp[i*2] = cr;
+      cp[i*2+1] = ci;
+    }
+  }
+}
+
+static void WDL_CONVO_CplxMul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFf *b, int n)
 {
-  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
-  if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re = t1;
-    c[1].re = t5;
-    c[0].im = t3;
-    c[1].im = t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
+  WDL_CONVO_CplxMulSplit<false>(c,a,b,b+n,n);
 }
-static void WDL_CONVO_CplxMul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFCPLXf *b, int n)
+static void WDL_CONVO_CplxMul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFf *b, int n)
 {
-  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
-  if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re += t1;
-    c[1].re += t5;
-    c[0].im += t3;
-    c[1].im += t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
+  WDL_CONVO_CplxMulSplit<true>(c,a,b,b+n,n);
+}
+
+// the time-domain FIR of the brute force mode: out[x] = sum of imp[i]*src[x-imp_len+1+i], with the impulse stored
+// reversed and src pointing at the block, after imp_len-1 samples of history. the SIMD loops compute two vectors of
+// outputs at a time, each impulse sample broadcast against unaligned runs of input
+static void WDL_CONVO_BruteFIR(WDL_FFT_REAL *pout, const WDL_FFT_REAL *psrc, const WDL_CONVO_IMPULSEBUFf *imp, int imp_len, int len)
+{
+  const WDL_FFT_REAL *src=psrc-imp_len+1;
+  int done=0;
+
+#if WDL_FFT_REALSIZE == 4
+
+#if defined(WDL_CONVO_USE_AVX)
+  for (; done+16 <= len; done += 16)
+  {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      const __m256 a = _mm256_broadcast_ss(imp+i);
+      s0 = _mm256_add_ps(s0,_mm256_mul_ps(a,_mm256_loadu_ps(sp+i)));
+      s1 = _mm256_add_ps(s1,_mm256_mul_ps(a,_mm256_loadu_ps(sp+i+8)));
+    }
+    _mm256_storeu_ps(pout+done,s0);
+    _mm256_storeu_ps(pout+done+8,s1);
+  }
+#elif defined(WDL_CONVO_USE_SSE)
+  for (; done+8 <= len; done += 8)
+  {
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      const __m128 a = _mm_set1_ps(imp[i]);
+      s0 = _mm_add_ps(s0,_mm_mul_ps(a,_mm_loadu_ps(sp+i)));
+      s1 = _mm_add_ps(s1,_mm_mul_ps(a,_mm_loadu_ps(sp+i+4)));
+    }
+    _mm_storeu_ps(pout+done,s0);
+    _mm_storeu_ps(pout+done+4,s1);
+  }
+#elif defined(WDL_CONVO_USE_NEON)
+  for (; done+8 <= len; done += 8)
+  {
+    float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      s0 = vmlaq_n_f32(s0,vld1q_f32(sp+i),imp[i]);
+      s1 = vmlaq_n_f32(s1,vld1q_f32(sp+i+4),imp[i]);
+    }
+    vst1q_f32(pout+done,s0);
+    vst1q_f32(pout+done+4,s1);
+  }
+#endif
+
+#else // double samples, float impulses
+
+#if defined(WDL_CONVO_USE_AVX)
+  for (; done+8 <= len; done += 8)
+  {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      const __m256d a = _mm256_set1_pd(imp[i]);
+      s0 = _mm256_add_pd(s0,_mm256_mul_pd(a,_mm256_loadu_pd(sp+i)));
+      s1 = _mm256_add_pd(s1,_mm256_mul_pd(a,_mm256_loadu_pd(sp+i+4)));
+    }
+    _mm256_storeu_pd(pout+done,s0);
+    _mm256_storeu_pd(pout+done+4,s1);
+  }
+#elif defined(WDL_CONVO_USE_SSE)
+  for (; done+4 <= len; done += 4)
+  {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      const __m128d a = _mm_set1_pd(imp[i]);
+      s0 = _mm_add_pd(s0,_mm_mul_pd(a,_mm_loadu_pd(sp+i)));
+      s1 = _mm_add_pd(s1,_mm_mul_pd(a,_mm_loadu_pd(sp+i+2)));
+    }
+    _mm_storeu_pd(pout+done,s0);
+    _mm_storeu_pd(pout+done+2,s1);
+  }
+#elif defined(WDL_CONVO_USE_NEON)
+  for (; done+4 <= len; done += 4)
+  {
+    float64x2_t s0 = vdupq_n_f64(0.0), s1 = vdupq_n_f64(0.0);
+    const WDL_FFT_REAL *sp=src+done;
+    for (int i = 0; i < imp_len; i ++)
+    {
+      s0 = vaddq_f64(s0,vmulq_n_f64(vld1q_f64(sp+i),imp[i]));
+      s1 = vaddq_f64(s1,vmulq_n_f64(vld1q_f64(sp+i+2),imp[i]));
+    }
+    vst1q_f64(pout+done,s0);
+    vst1q_f64(pout+done+2,s1);
+  }
+#endif
+
+#endif
+
+  // the rest, or all of it without SIMD
+  int x=done;
+  int len1 = len&~1;
+  for (; x < len1 ; x += 2)
+  {
+    int i=imp_len;
+    double sum=0.0,sum2=0.0;
+    const WDL_FFT_REAL *sp=psrc+x-imp_len + 1;
+    const WDL_CONVO_IMPULSEBUFf *ip=imp;
+    int j=i/4; i&=3;
+    while (j--) // produce 2 samples, 4 impulse samples at a time
+    {
+      double a = ip[0],b=ip[1],aa=ip[2],bb=ip[3];
+      double c = sp[1],d=sp[2],cc=sp[3];
+      sum+=a * sp[0] + b * c + aa * d + bb * cc;
+      sum2+=a * c + b * d + aa * cc + bb * sp[4];
+      ip+=4;
+      sp+=4;
+    }
+
+    while (i--)
+    {
+      double a = *ip++;
+      sum+=a * sp[0];
+      sum2+=a * sp[1];
+      sp++;
+    }
+    pout[x]=(WDL_FFT_REAL) sum;
+    pout[x+1]=(WDL_FFT_REAL) sum2;
+  }
+  for(;x<len;x++) // any odd samples left
+  {
+    int i=imp_len;
+    double sum=0.0;
+    const WDL_FFT_REAL *sp=psrc+x-imp_len + 1;
+    const WDL_CONVO_IMPULSEBUFf *ip=imp;
+    int j=i/4; i&=3;
+    while (j--)
+    {
+      sum+=ip[0] * sp[0] + ip[1] * sp[1] + ip[2] * sp[2] + ip[3] * sp[3];
+      ip+=4;
+      sp+=4;
+    }
+
+    while (i--) sum+=*ip++ * *sp++;
+    pout[x]=(WDL_FFT_REAL) sum;
+  }
 }
 
 static bool CompareQueueToBuf(WDL_FastQueue *q, const void *data, int len)
@@ -121,22 +398,94 @@ static bool CompareQueueToBuf(WDL_FastQueue *q, const void *data, int len)
 }
 
 
-WDL_ConvolutionEngine::WDL_ConvolutionEngine()
+struct WDL_ConvolutionEngine::ImpulseData
+{
+  ImpulseData() : refcnt(1), hash(0), fft_size(0), impulse_len(0), shared(false) { }
+  ~ImpulseData() { chans.Empty(true); }
+
+  WDL_PtrList<ImpChannelInfo> chans; // not modified once shared
+
+  int refcnt; // guarded by s_mutex once shared
+  WDL_UINT64 hash;
+  int fft_size, impulse_len;
+  bool shared; // in s_cache
+
+  static WDL_Mutex s_mutex;
+  static WDL_PtrList<ImpulseData> s_cache;
+};
+
+WDL_Mutex WDL_ConvolutionEngine::ImpulseData::s_mutex;
+WDL_PtrList<WDL_ConvolutionEngine::ImpulseData> WDL_ConvolutionEngine::ImpulseData::s_cache;
+
+// returns the cached spectra for this impulse with a reference added, or NULL
+WDL_ConvolutionEngine::ImpulseData *WDL_ConvolutionEngine::AcquireImpulseData(WDL_UINT64 hash, int fft_size, int impulse_len, int nch)
+{
+  WDL_MutexLock lock(&ImpulseData::s_mutex);
+  for (int x = 0; x < ImpulseData::s_cache.GetSize(); x ++)
+  {
+    ImpulseData *d = ImpulseData::s_cache.Get(x);
+    if (d->hash == hash && d->fft_size == fft_size && d->impulse_len == impulse_len && d->chans.GetSize() == nch)
+    {
+      d->refcnt++;
+      return d;
+    }
+  }
+  return NULL;
+}
+
+void WDL_ConvolutionEngine::ReleaseImpulseData(ImpulseData *data)
+{
+  if (!data) return;
+  if (data->shared)
+  {
+    WDL_MutexLock lock(&ImpulseData::s_mutex);
+    if (--data->refcnt > 0) return;
+    ImpulseData::s_cache.DeletePtr(data);
+  }
+  delete data;
+}
+
+static WDL_UINT64 WDL_CONVO_HashImpulse(WDL_UINT64 h, const void *data, int len)
+{
+  // FNV-1a over 32-bit words
+  const unsigned char *p = (const unsigned char *)data;
+  while (len >= 4)
+  {
+    unsigned int w;
+    memcpy(&w,p,4);
+    h = (h ^ w) * (WDL_UINT64)0x100000001b3ULL;
+    p += 4;
+    len -= 4;
+  }
+  while (len-- > 0) h = (h ^ *p++) * (WDL_UINT64)0x100000001b3ULL;
+  return h;
+}
+
+
+WDL_ConvolutionEngine::WDL_ConvolutionEngine() : m_pending_imp(NULL), m_pending_xfade(0), m_retired_imp(NULL)
 {
   WDL_fft_init();
   m_fft_size=0;
-  m_impdata.Add(new ImpChannelInfo);
+  m_impdata=new ImpulseData;
+  m_impdata->chans.Add(new ImpChannelInfo);
   m_impulse_len=0;
+  m_max_impulse_len=0;
+  m_hist_blocks=0;
+  m_queue_nch=0;
+  m_xfade_impdata=NULL;
+  m_xfade_len=0;
   m_proc_nch=0;
 }
 
 WDL_ConvolutionEngine::~WDL_ConvolutionEngine()
 {
-  m_impdata.Empty(true);
+  ReleaseQueuedImpulses();
+  ReleaseImpulseData(m_impdata);
   m_proc.Empty(true);
 }
 
-int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size, bool forceBrute)
+// returns the length of the impulse used, and in nch its channel count with identical channels merged
+static int WDL_CONVO_GetImpulseLength(WDL_ImpulseBuffer *impulse, int impulse_sample_offset, int max_imp_size, int *nch_out)
 {
   int impulse_len=0;
   int x;
@@ -159,27 +508,52 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
     }
     if (x >= nch) nch=1;
   }
+  *nch_out=nch;
+  return impulse_len;
+}
+
+static int WDL_CONVO_ChooseFFTSize(int fft_size, int impulse_len)
+{
+  if (fft_size<=0)
+  {
+    int msz=fft_size<=-16? -fft_size*2 : 32768;
+
+    fft_size=32;
+    while (fft_size < impulse_len*2 && fft_size < msz) fft_size*=2;
+  }
+  return fft_size;
+}
+
+int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size, bool forceBrute)
+{
+  int nch;
+  const int impulse_len=WDL_CONVO_GetImpulseLength(impulse,impulse_sample_offset,max_imp_size,&nch);
+  int x;
 
   m_impulse_len=impulse_len;
   m_proc_nch=-1;
 
-  while (m_impdata.GetSize() > nch)
-    m_impdata.Delete(m_impdata.GetSize()-1,true);
-  while (m_impdata.GetSize() < nch)
-    m_impdata.Add(new ImpChannelInfo);
+  ReleaseQueuedImpulses();
+  ReleaseImpulseData(m_impdata);
+  m_queue_nch=0;
+  m_hist_blocks=0;
 
   if (forceBrute)
   {
+    m_impdata=new ImpulseData;
+    for (x = 0; x < nch; x ++)
+      m_impdata->chans.Add(new ImpChannelInfo);
+
     m_fft_size=0;
 
     // save impulse
-    for (x = 0; x < m_impdata.GetSize(); x ++)
+    for (x = 0; x < m_impdata->chans.GetSize(); x ++)
     {
       WDL_FFT_REAL *imp=impulse->impulses[x].Get()+impulse_sample_offset;
       int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
       if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
 
-      WDL_CONVO_IMPULSEBUFf *impout=m_impdata.Get(x)->imp.Resize(lenout)+lenout;
+      WDL_CONVO_IMPULSEBUFf *impout=m_impdata->chans.Get(x)->imp.Resize(lenout)+lenout;
       while (lenout-->0) *--impout = (WDL_CONVO_IMPULSEBUFf) *imp++;
     }
 
@@ -194,32 +568,59 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
     return 0;
   }
 
- 
-  if (fft_size<=0)
-  {
-    int msz=fft_size<=-16? -fft_size*2 : 32768;
+  m_fft_size=WDL_CONVO_ChooseFFTSize(fft_size,impulse_len);
+  m_impdata=BuildImpulseData(impulse,m_fft_size,impulse_sample_offset,max_imp_size);
 
-    fft_size=32;
-    while (fft_size < impulse_len*2 && fft_size < msz) fft_size*=2;
+  const int chunksize=m_fft_size/2;
+  m_hist_blocks=wdl_max(impulse_len,m_max_impulse_len);
+  m_hist_blocks=(m_hist_blocks+chunksize-1)/chunksize;
+  if (impulse_len>0) m_queue_nch=nch;
+
+  return m_fft_size/2;
+}
+
+// returns the spectra for this impulse and FFT size with a reference added, from the cache if another engine computed them
+WDL_ConvolutionEngine::ImpulseData *WDL_ConvolutionEngine::BuildImpulseData(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size)
+{
+  int nch;
+  const int impulse_len=WDL_CONVO_GetImpulseLength(impulse,impulse_sample_offset,max_imp_size,&nch);
+  int x;
+
+  // the spectra only depend on the impulse samples used, the FFT size and the partitioning (which follows from them)
+  WDL_UINT64 hash=0xcbf29ce484222325ULL;
+  const int hashparms[4] = { nch, fft_size, impulse_len, (int) (sizeof(WDL_CONVO_IMPULSEBUFf) * 16 + sizeof(WDL_FFT_REAL)) };
+  hash=WDL_CONVO_HashImpulse(hash,hashparms,sizeof(hashparms));
+  for (x = 0; x < nch; x ++)
+  {
+    int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;
+    if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
+    hash=WDL_CONVO_HashImpulse(hash,&lenout,sizeof(lenout));
+    if (lenout>0) hash=WDL_CONVO_HashImpulse(hash,impulse->impulses[x].Get()+impulse_sample_offset,lenout*sizeof(WDL_FFT_REAL));
   }
 
-  m_fft_size=fft_size;
+  ImpulseData *cached=AcquireImpulseData(hash,fft_size,impulse_len,nch);
+  if (cached) return cached;
+
+  ImpulseData *impdata=new ImpulseData;
+  for (x = 0; x < nch; x ++)
+    impdata->chans.Add(new ImpChannelInfo);
 
   int impchunksize=fft_size/2;
   int nblocks=(impulse_len+impchunksize-1)/impchunksize;
   //wdl_log("il=%d, ffts=%d, cs=%d, nb=%d\n",impulse_len,fft_size,impchunksize,nblocks);
 
-  const bool smallerSizeMode=sizeof(WDL_CONVO_IMPULSEBUFf)!=sizeof(WDL_FFT_REAL);
+  WDL_TypedBuf<WDL_FFT_REAL> imptmpbuf;
+  WDL_FFT_REAL *imptmp=imptmpbuf.Resize(fft_size*2,false);
  
   WDL_FFT_REAL scale=(WDL_FFT_REAL) (1.0/fft_size);
-  for (x = 0; x < m_impdata.GetSize(); x ++)
+  for (x = 0; x < impdata->chans.GetSize(); x ++)
   {
     WDL_FFT_REAL *imp=impulse->impulses[x].Get()+impulse_sample_offset;
 
-    WDL_FFT_REAL *imp2=x < m_impdata.GetSize()-1 ? impulse->impulses[x+1].Get()+impulse_sample_offset : NULL;
+    WDL_FFT_REAL *imp2=x < impdata->chans.GetSize()-1 ? impulse->impulses[x+1].Get()+impulse_sample_offset : NULL;
 
-    WDL_CONVO_IMPULSEBUFf *impout=m_impdata.Get(x)->imp.Resize((nblocks+!!smallerSizeMode)*fft_size*2);
-    char *zbuf=m_impdata.Get(x)->zflag.Resize(nblocks);
+    WDL_CONVO_IMPULSEBUFf *impout=impdata->chans.Get(x)->imp.Resize(nblocks*fft_size*2);
+    char *zbuf=impdata->chans.Get(x)->zflag.Resize(nblocks);
     int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
     if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
       
@@ -234,7 +635,6 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
       int i=0;    
       WDL_FFT_REAL mv=0.0;
       WDL_FFT_REAL mv2=0.0;
-      WDL_FFT_REAL *imptmp = (WDL_FFT_REAL *)impout; //-V615
 
       for (; i < thissz; i ++)
       {
@@ -261,12 +661,13 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
       if (mv>CONVOENGINE_IMPULSE_SILENCE_THRESH||mv2>CONVOENGINE_IMPULSE_SILENCE_THRESH)
       {
         *zbuf++=mv>CONVOENGINE_IMPULSE_SILENCE_THRESH ? 2 : 1; // 1 means only second channel has content
-        WDL_fft((WDL_FFT_COMPLEX*)impout,fft_size,0);
+        WDL_fft((WDL_FFT_COMPLEX*)imptmp,fft_size,0);
 
-        if (smallerSizeMode)
+        // store split, see WDL_CONVO_CplxMulSplit()
+        for (i = 0; i < fft_size; i ++)
         {
-          int x,n=fft_size*2;
-          for(x=0;x<n;x++) impout[x]=(WDL_CONVO_IMPULSEBUFf)imptmp[x];
+          impout[i]=(WDL_CONVO_IMPULSEBUFf)imptmp[i*2];
+          impout[fft_size+i]=(WDL_CONVO_IMPULSEBUFf)imptmp[i*2+1];
         }
       }
       else *zbuf++=0;
@@ -274,7 +675,96 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
       impout+=fft_size*2;
     }
   }
-  return m_fft_size/2;
+
+  // share the new spectra, unless another engine computed the same ones in the meantime
+  cached=AcquireImpulseData(hash,fft_size,impulse_len,nch);
+  if (cached)
+  {
+    ReleaseImpulseData(impdata);
+    return cached;
+  }
+
+  WDL_MutexLock lock(&ImpulseData::s_mutex);
+  impdata->hash=hash;
+  impdata->fft_size=fft_size;
+  impdata->impulse_len=impulse_len;
+  impdata->shared=true;
+  ImpulseData::s_cache.Add(impdata);
+  return impdata;
+}
+
+WDL_ConvolutionEngine::PreparedImpulse *WDL_ConvolutionEngine::PrepareImpulse(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size)
+{
+  int nch;
+  const int impulse_len=WDL_CONVO_GetImpulseLength(impulse,impulse_sample_offset,max_imp_size,&nch);
+  if (impulse_len<1) return NULL;
+
+  WDL_fft_init();
+  return BuildImpulseData(impulse,WDL_CONVO_ChooseFFTSize(fft_size,impulse_len),impulse_sample_offset,max_imp_size);
+}
+
+void WDL_ConvolutionEngine::ReleasePreparedImpulse(PreparedImpulse *imp)
+{
+  ReleaseImpulseData(imp);
+}
+
+bool WDL_ConvolutionEngine::QueuePreparedImpulse(PreparedImpulse *imp, int crossfade_blocks)
+{
+  CollectRetiredImpulses();
+
+  if (!imp || !m_queue_nch || imp->fft_size != m_fft_size || imp->chans.GetSize() != m_queue_nch) return false;
+
+  const int chunksize=m_fft_size/2;
+  if ((imp->impulse_len+chunksize-1)/chunksize > m_hist_blocks) return false;
+
+  m_pending_xfade.store(wdl_max(crossfade_blocks,0));
+  ReleaseImpulseData(m_pending_imp.exchange(imp)); // one that Avail() has not taken yet is replaced
+  return true;
+}
+
+void WDL_ConvolutionEngine::CollectRetiredImpulses()
+{
+  ReleaseImpulseData(m_retired_imp.exchange(NULL));
+}
+
+// only when the audio thread is not in Avail()
+void WDL_ConvolutionEngine::ReleaseQueuedImpulses()
+{
+  ReleaseImpulseData(m_pending_imp.exchange(NULL));
+  CollectRetiredImpulses();
+  ReleaseImpulseData(m_xfade_impdata);
+  m_xfade_impdata=NULL;
+}
+
+void WDL_ConvolutionEngine::TakePendingImpulse()
+{
+  // one crossfade at a time, and the impulse it ends with needs somewhere to go
+  if (m_xfade_impdata || m_retired_imp.load() || !m_pending_imp.load(std::memory_order_relaxed)) return;
+
+  ImpulseData *imp=m_pending_imp.exchange(NULL);
+  if (!imp) return;
+
+  const int xfade_blocks=m_pending_xfade.load();
+  ImpulseData *old=m_impdata;
+  m_impdata=imp;
+  m_impulse_len=imp->impulse_len;
+
+  if (xfade_blocks<1 || m_proc_nch<1)
+  {
+    m_retired_imp.store(old);
+    return;
+  }
+
+  // both impulses use the same input history, the new one starts with the old one's overlap
+  m_xfade_impdata=old;
+  m_xfade_len=xfade_blocks*(m_fft_size/2);
+  for (int ch = 0; ch < m_proc_nch; ch ++)
+  {
+    ProcChannelInfo *pinf = m_proc.Get(ch);
+    pinf->xfade_pos=0;
+    if (pinf->xfade_overlaphist.GetSize()==pinf->overlaphist.GetSize())
+      memcpy(pinf->xfade_overlaphist.Get(),pinf->overlaphist.Get(),pinf->overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
+  }
 }
 
 
@@ -290,6 +780,7 @@ void WDL_ConvolutionEngine::Reset() // clears out any latent samples
     memset(inf->samplehist_zflag.Get(),0,inf->samplehist_zflag.GetSize());
     memset(inf->samplehist.Get(),0,inf->samplehist.GetSize()*sizeof(WDL_FFT_REAL));
     memset(inf->overlaphist.Get(),0,inf->overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
+    memset(inf->xfade_overlaphist.Get(),0,inf->xfade_overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
   }
 }
 
@@ -304,9 +795,9 @@ void WDL_ConvolutionEngine::Add(WDL_FFT_REAL **bufs, int len, int nch)
 
     for (int ch = 0; ch < nch; ch ++)
     {
-      int wch = ch % m_impdata.GetSize();
-      WDL_CONVO_IMPULSEBUFf *imp=m_impdata.Get(wch)->imp.Get();
-      int imp_len = m_impdata.Get(wch)->imp.GetSize();
+      int wch = ch % m_impdata->chans.GetSize();
+      WDL_CONVO_IMPULSEBUFf *imp=m_impdata->chans.Get(wch)->imp.Get();
+      int imp_len = m_impdata->chans.Get(wch)->imp.GetSize();
       ProcChannelInfo *pinf = m_proc.Get(ch);
 
       if (imp_len>0) 
@@ -327,52 +818,7 @@ void WDL_ConvolutionEngine::Add(WDL_FFT_REAL **bufs, int len, int nch)
         }
 
         WDL_FFT_REAL *pout=(WDL_FFT_REAL*)pinf->samplesout.Add(NULL,len*sizeof(WDL_FFT_REAL));
-        int x;
-        int len1 = len&~1;
-        for (x=0; x < len1 ; x += 2)
-        {
-          int i=imp_len;
-          double sum=0.0,sum2=0.0;
-          WDL_FFT_REAL *sp=psrc+x-imp_len + 1;
-          WDL_CONVO_IMPULSEBUFf *ip=imp;
-          int j=i/4; i&=3;
-          while (j--) // produce 2 samples, 4 impulse samples at a time
-          {
-            double a = ip[0],b=ip[1],aa=ip[2],bb=ip[3];
-            double c = sp[1],d=sp[2],cc=sp[3];
-            sum+=a * sp[0] + b * c + aa * d + bb * cc;
-            sum2+=a * c + b * d + aa * cc + bb * sp[4];
-            ip+=4;
-            sp+=4;
-          }
-
-          while (i--)
-          {
-            double a = *ip++;
-            sum+=a * sp[0];
-            sum2+=a * sp[1];
-            sp++;
-          }
-          pout[x]=(WDL_FFT_REAL) sum;
-          pout[x+1]=(WDL_FFT_REAL) sum2;
-        }
-        for(;x<len;x++) // any odd samples left
-        {
-          int i=imp_len;
-          double sum=0.0;
-          WDL_FFT_REAL *sp=psrc+x-imp_len + 1;
-          WDL_CONVO_IMPULSEBUFf *ip=imp;
-          int j=i/4; i&=3;
-          while (j--)
-          {
-            sum+=ip[0] * sp[0] + ip[1] * sp[1] + ip[2] * sp[2] + ip[3] * sp[3];
-            ip+=4;
-            sp+=4;
-          }
-
-          while (i--) sum+=*ip++ * *sp++;
-          pout[x]=(WDL_FFT_REAL) sum;
-        }
+        WDL_CONVO_BruteFIR(pout,psrc,imp,imp_len,len);
         pinf->samplesin2.Advance(len*sizeof(WDL_FFT_REAL));
         pinf->samplesin2.Compact();
       }
@@ -402,6 +848,7 @@ void WDL_ConvolutionEngine::Add(WDL_FFT_REAL **bufs, int len, int nch)
     {
       ProcChannelInfo *pinf = m_proc.Get(ch);
       pinf->hist_pos = 0;
+      pinf->xfade_pos = 0;
       int so=pinf->samplesin.Available() + pinf->samplesout.Available();
       if (so>mso) mso=so;
 
@@ -421,13 +868,15 @@ void WDL_ConvolutionEngine::Add(WDL_FFT_REAL **bufs, int len, int nch)
         memset(pinf->samplesout.Add(NULL,mso-so),0,mso-so);
       }
       
-      const int sz=nblocks*m_fft_size;
+      const int sz=m_hist_blocks*m_fft_size;
 
-      memset(pinf->samplehist_zflag.Resize(nblocks),0,nblocks);
+      memset(pinf->samplehist_zflag.Resize(m_hist_blocks),0,m_hist_blocks);
       pinf->samplehist.Resize(sz*2);
       pinf->overlaphist.Resize(m_fft_size/2);
+      pinf->xfade_overlaphist.Resize(m_fft_size/2);
       memset(pinf->samplehist.Get(),0,pinf->samplehist.GetSize()*sizeof(WDL_FFT_REAL));
       memset(pinf->overlaphist.Get(),0,pinf->overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
+      memset(pinf->xfade_overlaphist.Get(),0,pinf->xfade_overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
     }
   }
 
@@ -462,6 +911,85 @@ void WDL_ConvolutionEngine::AddSilenceToOutput(int len)
   }
 }
 
+// multiplies the input history ending at histpos by an impulse's spectra and inverse transforms the sum to workbuf
+int WDL_ConvolutionEngine::ConvolveHistory(WDL_FFT_REAL *workbuf, ImpChannelInfo *imp, int nblocks, ProcChannelInfo *pinf, int histpos, int mzfl)
+{
+  const char *useSilentList=pinf->samplehist_zflag.GetSize()==m_hist_blocks ? pinf->samplehist_zflag.Get() : NULL;
+  const char *useImpSilentList=imp->zflag.GetSize() == nblocks ? imp->zflag.Get() : NULL;
+
+  int applycnt=0;
+  WDL_CONVO_IMPULSEBUFf *impulseptr=imp->imp.Get();
+  for (int i = 0; i < nblocks; i ++, impulseptr+=m_fft_size*2)
+  {
+    int srchistpos = histpos-i;
+    if (srchistpos < 0) srchistpos += m_hist_blocks;
+
+    if (useImpSilentList && useImpSilentList[i]<mzfl) continue;
+    if (useSilentList && !useSilentList[srchistpos]) continue; // silent block
+
+    WDL_FFT_REAL *samplehist=pinf->samplehist.Get() + m_fft_size*srchistpos*2;
+
+    if (applycnt++) // add to output
+      WDL_CONVO_CplxMul3((WDL_FFT_COMPLEX*)workbuf,(WDL_FFT_COMPLEX*)samplehist,impulseptr,m_fft_size);   
+    else // replace output
+      WDL_CONVO_CplxMul2((WDL_FFT_COMPLEX*)workbuf,(WDL_FFT_COMPLEX*)samplehist,impulseptr,m_fft_size);  
+
+  }
+  if (!applycnt)
+    memset(workbuf,0,m_fft_size*2*sizeof(WDL_FFT_REAL));
+  else
+    WDL_fft((WDL_FFT_COMPLEX*)workbuf,m_fft_size,1);
+  return applycnt;
+}
+
+// adds the overlap from the last block to the first half of the block in workbuf, in place, and keeps its second half.
+// with olhist2, workbuf holds two signals (real and imaginary parts), the second is output to out2
+static void WDL_CONVO_OverlapAdd(WDL_FFT_REAL *workbuf, int fft_size, WDL_FFT_REAL *olhist, WDL_FFT_REAL *olhist2, WDL_FFT_REAL *out2)
+{
+  WDL_FFT_REAL *p1=workbuf,*p3=workbuf+fft_size,*p1o=workbuf;
+  int s=fft_size/4;
+
+  if (olhist2)
+  {
+    WDL_FFT_REAL *p2o=out2;
+    while (s--)
+    {
+      p2o[0] = p1[1]+olhist2[0];
+      p2o[1] = p1[3]+olhist2[1];
+      p1o[0] = p1[0]+olhist[0];
+      p1o[1] = p1[2]+olhist[1];
+      p1o+=2;
+      p2o+=2;
+      p1+=4;
+
+      olhist[0]=p3[0];
+      olhist[1]=p3[2];
+      olhist2[0]=p3[1];
+      olhist2[1]=p3[3];
+      p3+=4;
+
+      olhist+=2;
+      olhist2+=2;
+    }
+  }
+  else
+  {
+    while (s--)
+    {
+      p1o[0] = p1[0]+olhist[0];
+      p1o[1] = p1[2]+olhist[1];
+      p1o+=2;
+      p1+=4;
+
+      olhist[0]=p3[0];
+      olhist[1]=p3[2];
+      p3+=4;
+
+      olhist+=2;
+    }
+  }
+}
+
 int WDL_ConvolutionEngine::Avail(int want)
 {
   if (m_fft_size<1)
@@ -470,11 +998,14 @@ int WDL_ConvolutionEngine::Avail(int want)
     return pinf ? pinf->samplesout.Available()/sizeof(WDL_FFT_REAL) : 0;
   }
 
+  TakePendingImpulse();
+
   const int sz=m_fft_size/2;
   const int chunksize=m_fft_size/2;
   const int nblocks=(m_impulse_len+chunksize-1)/chunksize;
+  const int xfade_nblocks=m_xfade_impdata ? (m_xfade_impdata->impulse_len+chunksize-1)/chunksize : 0;
   // clear combining buffer
-  WDL_FFT_REAL *workbuf2 = m_combinebuf.Resize(m_fft_size*4); // temp space
+  WDL_FFT_REAL *workbuf2 = m_combinebuf.Resize(m_fft_size*8); // temp space, the second half for the impulse being crossfaded from
 
   int ch;
 
@@ -484,12 +1015,12 @@ int WDL_ConvolutionEngine::Avail(int want)
     ProcChannelInfo *pinf2 = ch+1 < m_proc_nch ? m_proc.Get(ch+1) : NULL;
 
     if (!pinf->samplehist.GetSize()||!pinf->overlaphist.GetSize()) continue;
-    int srcc=ch % m_impdata.GetSize();
+    int srcc=ch % m_impdata->chans.GetSize();
 
     bool allow_mono_input_mode=true;
     bool mono_impulse_mode=false;
 
-    if (m_impdata.GetSize()==1 && pinf2 &&
+    if (m_impdata->chans.GetSize()==1 && pinf2 &&
         pinf2->samplehist.GetSize()&&pinf2->overlaphist.GetSize() &&
         pinf->samplesin.Available()==pinf2->samplesin.Available() &&
         pinf->samplesout.Available()==pinf2->samplesout.Available()
@@ -503,12 +1034,12 @@ int WDL_ConvolutionEngine::Avail(int want)
     const int in_needed=sz;
 
     // useSilentList[x] = 1 for mono signal, 2 for stereo, 0 for silent
-    char *useSilentList=pinf->samplehist_zflag.GetSize()==nblocks ? pinf->samplehist_zflag.Get() : NULL;
+    char *useSilentList=pinf->samplehist_zflag.GetSize()==m_hist_blocks ? pinf->samplehist_zflag.Get() : NULL;
     while (pinf->samplesin.Available()/(int)sizeof(WDL_FFT_REAL) >= sz &&
            pinf->samplesout.Available() < want*(int)sizeof(WDL_FFT_REAL))
     {
       int histpos;
-      if ((histpos=++pinf->hist_pos) >= nblocks) histpos=pinf->hist_pos=0;
+      if ((histpos=++pinf->hist_pos) >= m_hist_blocks) histpos=pinf->hist_pos=0;
 
       // get samples from input, to history
       WDL_FFT_REAL *optr = pinf->samplehist.Get()+histpos*m_fft_size*2;
@@ -522,7 +1053,7 @@ int WDL_ConvolutionEngine::Avail(int want)
       bool nonzflag=false;
       if (mono_impulse_mode)
       {
-        if (++pinf2->hist_pos >= nblocks) pinf2->hist_pos=0;
+        if (++pinf2->hist_pos >= m_hist_blocks) pinf2->hist_pos=0;
         pinf2->samplesin.GetToBuf(0,workbuf2,sz*sizeof(WDL_FFT_REAL));
         pinf2->samplesin.Advance(sz*sizeof(WDL_FFT_REAL));
         int i;
@@ -538,7 +1069,7 @@ int WDL_ConvolutionEngine::Avail(int want)
       {
         if (allow_mono_input_mode && 
           pinf2 &&
-          srcc<m_impdata.GetSize()-1 &&
+          srcc<m_impdata->chans.GetSize()-1 &&
           !CompareQueueToBuf(&pinf2->samplesin,optr+sz,sz*sizeof(WDL_FFT_REAL))
           )
         {
@@ -559,10 +1090,10 @@ int WDL_ConvolutionEngine::Avail(int want)
       }
 
       int i;
-      for (i = 1; mono_input_mode && i < nblocks; i ++) // start @ 1, since hist[histpos] is no longer used for here
+      for (i = 1; mono_input_mode && i < m_hist_blocks; i ++) // start @ 1, since hist[histpos] is no longer used for here
       {
         int srchistpos = histpos-i;
-        if (srchistpos < 0) srchistpos += nblocks;
+        if (srchistpos < 0) srchistpos += m_hist_blocks;
         if (!useSilentList || useSilentList[srchistpos]==2) mono_input_mode=false;
       }
 
@@ -585,94 +1116,63 @@ int WDL_ConvolutionEngine::Avail(int want)
         pinf2->samplesin.Advance(sz*sizeof(WDL_FFT_REAL));
 
         // save a valid copy in sample hist incase we switch from mono to stereo
-        if (++pinf2->hist_pos >= nblocks) pinf2->hist_pos=0;
-        if (pinf2->samplehist_zflag.GetSize()==nblocks)
+        if (++pinf2->hist_pos >= m_hist_blocks) pinf2->hist_pos=0;
+        if (pinf2->samplehist_zflag.GetSize()==m_hist_blocks)
           pinf2->samplehist_zflag.Get()[pinf2->hist_pos] = nonzflag ? 1 : 0;
 
         WDL_FFT_REAL *optr2 = pinf2->samplehist.Get()+pinf2->hist_pos*m_fft_size*2;
         memcpy(optr2,optr,m_fft_size*2*sizeof(WDL_FFT_REAL));
       }
 
-      int applycnt=0;
-      char *useImpSilentList=m_impdata.Get(srcc)->zflag.GetSize() == nblocks ? m_impdata.Get(srcc)->zflag.Get() : NULL;
+      const bool dual=mono_impulse_mode||mono_input_mode;
+      WDL_FFT_REAL *out2=workbuf2+m_fft_size*2;
 
-      WDL_CONVO_IMPULSEBUFf *impulseptr=m_impdata.Get(srcc)->imp.Get();
-      for (i = 0; i < nblocks; i ++, impulseptr+=m_fft_size*2)
-      {
-        int srchistpos = histpos-i;
-        if (srchistpos < 0) srchistpos += nblocks;
-
-        if (useImpSilentList && useImpSilentList[i]<mzfl) continue;
-        if (useSilentList && !useSilentList[srchistpos]) continue; // silent block
-
-        WDL_FFT_REAL *samplehist=pinf->samplehist.Get() + m_fft_size*srchistpos*2;
-
-        if (applycnt++) // add to output
-          WDL_CONVO_CplxMul3((WDL_FFT_COMPLEX*)workbuf2,(WDL_FFT_COMPLEX*)samplehist,(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr,m_fft_size);   
-        else // replace output
-          WDL_CONVO_CplxMul2((WDL_FFT_COMPLEX*)workbuf2,(WDL_FFT_COMPLEX*)samplehist,(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr,m_fft_size);  
+      ConvolveHistory(workbuf2,m_impdata->chans.Get(srcc),nblocks,pinf,histpos,mzfl);
+      WDL_CONVO_OverlapAdd(workbuf2,m_fft_size,pinf->overlaphist.Get(),dual ? pinf2->overlaphist.Get() : NULL,out2);
 
-      }
-      if (!applycnt)
-        memset(workbuf2,0,m_fft_size*2*sizeof(WDL_FFT_REAL));
-      else
-        WDL_fft((WDL_FFT_COMPLEX*)workbuf2,m_fft_size,1);
+      if (m_xfade_impdata && pinf->xfade_pos < m_xfade_len)
+      {
+        WDL_FFT_REAL *fadebuf=workbuf2+m_fft_size*4;
+        WDL_FFT_REAL *fadeout2=fadebuf+m_fft_size*2;
 
-      WDL_FFT_REAL *olhist=pinf->overlaphist.Get(); // errors from last time
-      WDL_FFT_REAL *p1=workbuf2,*p3=workbuf2+m_fft_size,*p1o=workbuf2;
+        ConvolveHistory(fadebuf,m_xfade_impdata->chans.Get(srcc),xfade_nblocks,pinf,histpos,mzfl);
+        WDL_CONVO_OverlapAdd(fadebuf,m_fft_size,pinf->xfade_overlaphist.Get(),dual ? pinf2->xfade_overlaphist.Get() : NULL,fadeout2);
 
-      if (mono_impulse_mode||mono_input_mode)
-      {
-        WDL_FFT_REAL *p2o=workbuf2+m_fft_size*2;
-        WDL_FFT_REAL *olhist2=pinf2->overlaphist.Get(); // errors from last time
-        int s=sz/2;
-        while (s--)
+        // equal power
+        const double dpos=1.5707963267948966/m_xfade_len; // pi/2 over the crossfade
+        for (i = 0; i < sz; i ++)
         {
-          p2o[0] = p1[1]+olhist2[0];
-          p2o[1] = p1[3]+olhist2[1];
-          p1o[0] = p1[0]+olhist[0];
-          p1o[1] = p1[2]+olhist[1];
-          p1o+=2;
-          p2o+=2;
-          p1+=4;
-
-          olhist[0]=p3[0];
-          olhist[1]=p3[2];
-          olhist2[0]=p3[1];
-          olhist2[1]=p3[3];
-          p3+=4;
-
-          olhist+=2;
-          olhist2+=2;
+          const double pos=wdl_min(pinf->xfade_pos+i,m_xfade_len)*dpos;
+          const WDL_FFT_REAL gnew=(WDL_FFT_REAL)sin(pos), gold=(WDL_FFT_REAL)cos(pos);
+          workbuf2[i]=workbuf2[i]*gnew + fadebuf[i]*gold;
+          if (dual) out2[i]=out2[i]*gnew + fadeout2[i]*gold;
         }
-        // add samples to output
-        pinf->samplesout.Add(workbuf2,sz*sizeof(WDL_FFT_REAL));
-        pinf2->samplesout.Add(workbuf2+m_fft_size*2,sz*sizeof(WDL_FFT_REAL));
+        pinf->xfade_pos+=sz;
+        if (dual) pinf2->xfade_pos=pinf->xfade_pos;
       }
-      else
-      {
-        int s=sz/2;
-        while (s--)
-        {
-          p1o[0] = p1[0]+olhist[0];
-          p1o[1] = p1[2]+olhist[1];
-          p1o+=2;
-          p1+=4;
-
-          olhist[0]=p3[0];
-          olhist[1]=p3[2];
-          p3+=4;
 
-          olhist+=2;
-        }
-        // add samples to output
-        pinf->samplesout.Add(workbuf2,sz*sizeof(WDL_FFT_REAL));
-      }
+      // add samples to output
+      pinf->samplesout.Add(workbuf2,sz*sizeof(WDL_FFT_REAL));
+      if (dual) pinf2->samplesout.Add(out2,sz*sizeof(WDL_FFT_REAL));
     } // while available
 
     if (mono_impulse_mode) ch++;
   }
 
+  if (m_xfade_impdata)
+  {
+    for (ch = 0; ch < m_proc_nch; ch ++)
+    {
+      const ProcChannelInfo *pinf = m_proc.Get(ch);
+      if (pinf->samplehist.GetSize() && pinf->xfade_pos < m_xfade_len) break;
+    }
+    if (ch >= m_proc_nch) // hand it back, TakePendingImpulse() made sure m_retired_imp is empty
+    {
+      m_retired_imp.store(m_xfade_impdata);
+      m_xfade_impdata=NULL;
+    }
+  }
+
   int mv = want;
   for (ch=0;ch<m_proc_nch;ch++)
   {
@@ -707,11 +1207,139 @@ void WDL_ConvolutionEngine::Advance(int len)
 **  low latency version
 */
 
+// runs the late partitions of a WDL_ConvolutionEngine_Div. the audio thread queues input in Add(), the
+// worker feeds it to the engines and queues their summed output as soon as it can be computed, which
+// (because of how those partitions are scheduled) is at least WORKER_MIN_SLACK samples before Avail() needs it.
+struct WDL_ConvolutionEngine_Div::WorkerState
+{
+  WorkerState() : nch(0), in_len(0), out_len(0), busy(false), stop(false), need_feedsilence(true) { }
+  ~WorkerState()
+  {
+    Stop();
+    engines.Empty(true);
+    in.Empty(true);
+    out.Empty(true);
+  }
+
+  void Start() { thread = std::thread([this]() { Run(); }); }
+  void Stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop=true;
+    }
+    wake.notify_one();
+    if (thread.joinable()) thread.join();
+  }
+
+  // waits for the worker to finish what is queued, so that the engines and queues can be modified
+  void WaitIdle(std::unique_lock<std::mutex> &lock) { done.wait(lock, [this]() { return !busy && !in_len; }); }
+
+  void SetNumChannels(int n) // called with the lock held and the worker idle
+  {
+    while (in.GetSize() < n) in.Add(new WDL_Queue);
+    while (in.GetSize() > n) in.Delete(in.GetSize()-1,true);
+    while (out.GetSize() < n)
+    {
+      WDL_Queue *q = new WDL_Queue;
+      void *add = q->Add(NULL,out_len*sizeof(WDL_FFT_REAL));
+      if (add) memset(add,0,out_len*sizeof(WDL_FFT_REAL));
+      out.Add(q);
+    }
+    while (out.GetSize() > n) out.Delete(out.GetSize()-1,true);
+    nch=n;
+  }
+
+  void Run();
+
+  WDL_PtrList<WDL_ConvolutionEngine> engines; // only used by the worker thread while it is running
+
+  std::mutex mutex; // guards everything below
+  std::condition_variable wake, done;
+  WDL_PtrList<WDL_Queue> in, out; // per channel
+  int nch, in_len, out_len; // in_len/out_len are in samples
+  bool busy, stop, need_feedsilence;
+
+  std::thread thread;
+
+  // worker thread only
+  WDL_TypedBuf<WDL_FFT_REAL> inbuf, outbuf;
+  WDL_TypedBuf<WDL_FFT_REAL *> inptrs;
+};
+
+void WDL_ConvolutionEngine_Div::WorkerState::Run()
+{
+  const int compute_all = 0x7fffffff / (int)sizeof(WDL_FFT_REAL);
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    wake.wait(lock, [this]() { return stop || in_len > 0; });
+    if (stop) return;
+
+    const int len = in_len, n = nch;
+    const bool ns = need_feedsilence;
+    need_feedsilence=false;
+
+    WDL_FFT_REAL *ibuf = inbuf.Resize(len*n,false);
+    WDL_FFT_REAL **iptrs = inptrs.Resize(n,false);
+    int ch;
+    for (ch = 0; ch < n; ch ++)
+    {
+      iptrs[ch] = ibuf + ch*len;
+      memcpy(iptrs[ch],in.Get(ch)->Get(),len*sizeof(WDL_FFT_REAL));
+      in.Get(ch)->Clear();
+    }
+    in_len=0;
+    busy=true;
+    lock.unlock();
+
+    // compute every complete block, and hand over as much output as all of the engines have
+    int produce=-1;
+    int x;
+    for (x = 0; x < engines.GetSize(); x ++)
+    {
+      WDL_ConvolutionEngine *eng=engines.Get(x);
+      eng->Add(iptrs,len,n);
+      if (ns) eng->AddSilenceToOutput(eng->m_zl_delaypos);
+      const int a = eng->Avail(compute_all);
+      if (produce<0 || a<produce) produce=a;
+    }
+    if (produce<0) produce=0;
+
+    WDL_FFT_REAL *obuf = outbuf.Resize(produce*n,false);
+    memset(obuf,0,produce*n*sizeof(WDL_FFT_REAL));
+    for (x = 0; x < engines.GetSize() && produce>0; x ++)
+    {
+      WDL_ConvolutionEngine *eng=engines.Get(x);
+      WDL_FFT_REAL **p=eng->Get();
+      if (p) for (ch = 0; ch < n; ch ++)
+      {
+        WDL_FFT_REAL *o=obuf + ch*produce;
+        const WDL_FFT_REAL *i=p[ch];
+        int j=produce;
+        while (j-->0) *o++ += *i++;
+      }
+      eng->Advance(produce);
+    }
+
+    lock.lock();
+    if (n == nch) // channel count can only change while idle, but be safe
+    {
+      for (ch = 0; ch < n; ch ++) out.Get(ch)->Add(obuf + ch*produce,produce*sizeof(WDL_FFT_REAL));
+      out_len += produce;
+    }
+    busy=false;
+    done.notify_all();
+  }
+}
+
 WDL_ConvolutionEngine_Div::WDL_ConvolutionEngine_Div()
 {
   timingInit();
   for (int x = 0; x < 2; x ++) m_sout.Add(new WDL_Queue);
   m_need_feedsilence=true;
+  m_worker=NULL;
+  m_want_worker=false;
 }
 
 int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
@@ -719,6 +1347,8 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
   m_need_feedsilence=true;
 
   m_engines.Empty(true);
+  delete m_worker;
+  m_worker=NULL;
   if (maxfft_size<0)maxfft_size=-maxfft_size;
   maxfft_size*=2;
   if (!maxfft_size || maxfft_size>32768) maxfft_size=32768;
@@ -757,7 +1387,16 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
     eng->SetImpulse(impulse,fftsize,offs+impulse_offset,impulsechunksize, wantBrute);
     eng->m_zl_delaypos = offs;
     eng->m_zl_dumpage=0;
-    m_engines.Add(eng);
+
+    // output of a partition is computed when a whole fftsize/2 block of input has been added, and is
+    // needed offs samples after its input, so the difference is how long a worker has to compute it
+    if (m_want_worker && !wantBrute && offs - fftsize/2 >= WORKER_MIN_SLACK)
+    {
+      if (!m_worker) m_worker = new WorkerState;
+      m_worker->engines.Add(eng);
+    }
+    else
+      m_engines.Add(eng);
 
 #ifdef WDLCONVO_ZL_ACCOUNTING
     wdl_log("ce%d: offs=%d, len=%d, fftsize=%d\n",m_engines.GetSize(),offs,impulsechunksize,fftsize);
@@ -769,6 +1408,8 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
 #if 1 // this seems about 10% faster (maybe due to better cache use from less sized ffts used?)
     impulsechunksize=offs*3;
     fftsize=offs*2;
+    if (m_want_worker && offs >= WORKER_MIN_SLACK*2)
+      fftsize=offs; // half the FFT size, to leave offs/2 samples for the worker
 #else
     impulsechunksize=fftsize;
 
@@ -776,6 +1417,8 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
 #endif
   }
   while (samplesleft > 0);
+
+  if (m_worker) m_worker->Start();
   
   return GetLatency();
 }
@@ -799,12 +1442,23 @@ void WDL_ConvolutionEngine_Div::Reset()
     m_sout.Get(x)->Clear();
   }
 
+  if (m_worker)
+  {
+    std::unique_lock<std::mutex> lock(m_worker->mutex);
+    m_worker->WaitIdle(lock);
+    for (x = 0; x < m_worker->engines.GetSize(); x ++) m_worker->engines.Get(x)->Reset();
+    for (x = 0; x < m_worker->out.GetSize(); x ++) m_worker->out.Get(x)->Clear();
+    m_worker->out_len=0;
+    m_worker->need_feedsilence=true;
+  }
+
   m_need_feedsilence=true;
 }
 
 WDL_ConvolutionEngine_Div::~WDL_ConvolutionEngine_Div()
 {
   timingPrint();
+  delete m_worker;
   m_engines.Empty(true);
   m_sout.Empty(true);
 }
@@ -836,6 +1490,31 @@ void WDL_ConvolutionEngine_Div::Add(WDL_FFT_REAL **bufs, int len, int nch)
     if (ns) eng->AddSilenceToOutput(eng->m_zl_delaypos); // add silence to output (to delay output to its correct time)
 
   }
+
+  if (m_worker && len>0)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_worker->mutex);
+      if (m_worker->nch != nch)
+      {
+        m_worker->WaitIdle(lock);
+        m_worker->SetNumChannels(nch);
+      }
+      const int add_sz = len*sizeof(WDL_FFT_REAL);
+      for (x = 0; x < nch; x ++)
+      {
+        WDL_Queue *q = m_worker->in.Get(x);
+        if (bufs && bufs[x]) q->Add(bufs[x],add_sz);
+        else
+        {
+          void *add = q->Add(NULL,add_sz);
+          if (WDL_NORMALLY(add != NULL)) memset(add,0,add_sz);
+        }
+      }
+      m_worker->in_len += len;
+    }
+    m_worker->wake.notify_one();
+  }
 }
 WDL_FFT_REAL **WDL_ConvolutionEngine_Div::Get() 
 {
@@ -889,6 +1568,16 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
     if (a < wantSamples) wantSamples=a;
   }
 
+  std::unique_lock<std::mutex> worker_lock;
+  if (m_worker && wantSamples>0)
+  {
+    // the worker is normally well ahead, this only blocks if it has missed its deadline
+    worker_lock = std::unique_lock<std::mutex>(m_worker->mutex);
+    const int ws = wantSamples;
+    m_worker->done.wait(worker_lock, [this, ws]() { return m_worker->out_len >= ws || (!m_worker->busy && !m_worker->in_len); });
+    if (m_worker->out_len < wantSamples) wantSamples=m_worker->out_len;
+  }
+
 #ifdef WDLCONVO_ZL_ACCOUNTING
   static DWORD lastt=0;
   if (cnt>maxcnt)maxcnt=cnt;
@@ -932,6 +1621,25 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
       }
       eng->Advance(wantSamples);
     }
+
+    if (worker_lock.owns_lock())
+    {
+      for (x = 0; x < m_sout.GetSize() && x < m_worker->out.GetSize(); x ++)
+      {
+        WDL_Queue *q = m_sout.Get(x);
+        const int qsz = q->Available();
+        if (WDL_NORMALLY(qsz >= add_sz))
+        {
+          WDL_FFT_REAL *o=(WDL_FFT_REAL *)((char *)q->Get() + qsz - add_sz);
+          const WDL_FFT_REAL *in=(const WDL_FFT_REAL *)m_worker->out.Get(x)->Get();
+          int j=wantSamples;
+          while (j-->0) *o++ += *in++;
+        }
+        m_worker->out.Get(x)->Advance(add_sz);
+        m_worker->out.Get(x)->Compact();
+      }
+      m_worker->out_len -= wantSamples;
+    }
   }
   timingLeave(1);
 
@@ -30,6 +30,8 @@
 #ifndef _WDL_CONVOENGINE_H_
 #define _WDL_CONVOENGINE_H_
 
+#include <atomic>
+
 #include "queue.h"
 #include "fastqueue.h"
 #include "fft.h"
@@ -89,6 +91,28 @@ public:
   ~WDL_ConvolutionEngine();
 
   int SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size=-1, int impulse_sample_offset=0, int max_imp_size=0, bool forceBrute=false);
+
+  // an impulse's spectra for one FFT size, immutable once prepared, so that PrepareImpulse() can run on any thread
+  // and the result can be queued to any number of engines
+  struct ImpulseData;
+  typedef ImpulseData PreparedImpulse;
+
+  // does the FFT work of SetImpulse() without touching an engine. fft_size is as for SetImpulse(), pass GetFFTSize()
+  // of the engine it is for. returns NULL for an empty impulse. release it with ReleasePreparedImpulse() unless it is queued
+  static PreparedImpulse *PrepareImpulse(WDL_ImpulseBuffer *impulse, int fft_size=-1, int impulse_sample_offset=0, int max_imp_size=0);
+  static void ReleasePreparedImpulse(PreparedImpulse *imp);
+
+  // swaps a prepared impulse in at the start of the next FFT block processed by Avail(), equal-power crossfading from the
+  // current impulse over crossfade_blocks blocks of GetFFTSize()/2 samples. nothing is allocated or freed on the audio
+  // thread: the engine takes over the reference to imp, and impulses it has finished with are released by the next call
+  // to this, CollectRetiredImpulses(), SetImpulse() or the destructor. call from one non-audio thread. returns false,
+  // leaving imp the caller's, if imp's FFT size or channel count (after identical channels are merged) differ from the
+  // current impulse's, or it is longer than the input history, see SetMaxImpulseLength()
+  bool QueuePreparedImpulse(PreparedImpulse *imp, int crossfade_blocks=0);
+  void CollectRetiredImpulses();
+
+  // call before SetImpulse() to size the input history for prepared impulses up to len samples, if longer than its impulse
+  void SetMaxImpulseLength(int len) { m_max_impulse_len=len; }
  
   int GetFFTSize() { return m_fft_size; }
   int GetLatency() { return m_fft_size/2; }
@@ -116,15 +140,39 @@ private:
     WDL_TypedBuf<WDL_FFT_REAL> samplehist; // FFT'd sample blocks per channel
     WDL_TypedBuf<char> samplehist_zflag;
     WDL_TypedBuf<WDL_FFT_REAL> overlaphist;
+    WDL_TypedBuf<WDL_FFT_REAL> xfade_overlaphist; // the overlap of the impulse being crossfaded from
 
     int hist_pos;
+    int xfade_pos; // samples of the crossfade output so far
+
   };
 
 
-  WDL_PtrList<ImpChannelInfo> m_impdata;
+  // impulse spectra are shared (read-only) between all engines in the process that were given the
+  // same impulse data and FFT size, see AcquireImpulseData()
+  ImpulseData *m_impdata;
+  static ImpulseData *AcquireImpulseData(WDL_UINT64 hash, int fft_size, int impulse_len, int nch);
+  static void ReleaseImpulseData(ImpulseData *data);
+
+  static ImpulseData *BuildImpulseData(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size);
+  void ReleaseQueuedImpulses();
+  void TakePendingImpulse(); // audio thread, at a block boundary
+  int ConvolveHistory(WDL_FFT_REAL *workbuf, ImpChannelInfo *imp, int nblocks, ProcChannelInfo *pinf, int histpos, int mzfl);
 
   int m_impulse_len;
   int m_fft_size;
+  int m_max_impulse_len;
+  int m_hist_blocks; // blocks of input history, at least as many as the impulse has
+  int m_queue_nch; // impulse channels a prepared impulse must have, 0 if none can be queued
+
+  // queued by QueuePreparedImpulse(), taken by Avail()
+  std::atomic<ImpulseData *> m_pending_imp;
+  std::atomic<int> m_pending_xfade;
+  // handed back by Avail() once it no longer uses it
+  std::atomic<ImpulseData *> m_retired_imp;
+  // the impulse being crossfaded from, and the crossfade length in samples
+  ImpulseData *m_xfade_impdata;
+  int m_xfade_len;
 
   int m_proc_nch;
   WDL_PtrList<ProcChannelInfo> m_proc;
@@ -154,6 +202,13 @@ public:
   WDL_ConvolutionEngine_Div();
   ~WDL_ConvolutionEngine_Div();
 
+  // call before SetImpulse(). when enabled, the late partitions are scheduled with at least
+  // WORKER_MIN_SLACK samples between their input being complete and their output being needed,
+  // and are processed on a worker thread. only the head partitions run in Add()/Avail(), which
+  // wait for the worker only if it misses that deadline.
+  void EnableWorkerThread(bool enable) { m_want_worker=enable; }
+  enum { WORKER_MIN_SLACK=2048 };
+
   int SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size=0, int known_blocksize=0, int max_imp_size=0, int impulse_offset=0, int latency_allowed=0);
 
   int GetLatency();
@@ -173,6 +228,10 @@ private:
 
   bool m_need_feedsilence;
 
+  struct WorkerState;
+  WorkerState *m_worker; // owns the engines that run on the worker thread, if any
+  bool m_want_worker;
+
 } WDL_FIXALIGN;
 
 
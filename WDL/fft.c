@@ -35,7 +35,26 @@
 #include "fft.h"
 
 
-#define FFT_MAXBITLEN 15
+#define FFT_MAXBITLEN 17 /* WDL_FFT_MAX_SIZE */
+
+#if !defined(WDL_FFT_NO_SIMD) && WDL_FFT_REALSIZE == 4
+  #if defined(__SSE__) || _M_IX86_FP >= 1 || defined(_M_X64) || defined(_M_AMD64)
+    #define WDL_FFT_USE_SSE
+    #include <xmmintrin.h>
+  #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define WDL_FFT_USE_NEON
+    #include <arm_neon.h>
+  #endif
+#endif
+
+#ifdef WDL_FFT_USE_VDSP
+  #ifdef WDL_FFT_NO_PERMUTE
+    #error WDL_FFT_USE_VDSP requires the permutation tables
+  #endif
+  #include <stdlib.h>
+  #include <string.h>
+  #include <Accelerate/Accelerate.h>
+#endif
 
 #ifdef _MSC_VER
 #define inline __inline
@@ -55,6 +74,8 @@ static WDL_FFT_COMPLEX d4096[511];
 static WDL_FFT_COMPLEX d8192[1023];
 static WDL_FFT_COMPLEX d16384[2047];
 static WDL_FFT_COMPLEX d32768[4095];
+static WDL_FFT_COMPLEX d65536[8191];
+static WDL_FFT_COMPLEX d131072[16383];
 
 
 #define sqrthalf (d16[1].re)
@@ -267,6 +288,85 @@ static WDL_FFT_COMPLEX d32768[4095];
   a1.im = t4; \
   }
 
+#if defined(WDL_FFT_USE_SSE) || defined(WDL_FFT_USE_NEON)
+
+/* TRANSFORM/UNTRANSFORM on two consecutive complex values at once. w points to the two
+(re,im) twiddles, or if rev is set to the twiddles for the second and first value, to be
+used with re and im swapped (as the second half of cpassbig/upassbig does) */
+
+#ifdef WDL_FFT_USE_SSE
+typedef __m128 wdl_fft_v4;
+#define V4_LOAD(p) _mm_loadu_ps((const float *)(p))
+#define V4_STORE(p,v) _mm_storeu_ps((float *)(p),v)
+#define V4_ADD(a,b) _mm_add_ps(a,b)
+#define V4_SUB(a,b) _mm_sub_ps(a,b)
+#define V4_MUL(a,b) _mm_mul_ps(a,b)
+#define V4_SWAP(a) _mm_shuffle_ps(a,a,_MM_SHUFFLE(2,3,0,1)) /* (re,im) -> (im,re) */
+#define V4_DUPRE(a) _mm_shuffle_ps(a,a,_MM_SHUFFLE(2,2,0,0))
+#define V4_DUPIM(a) _mm_shuffle_ps(a,a,_MM_SHUFFLE(3,3,1,1))
+#define V4_REV(a) _mm_shuffle_ps(a,a,_MM_SHUFFLE(0,1,2,3))
+#define V4_NEGRE(a) _mm_xor_ps(a,_mm_set_ps(0.0f,-0.0f,0.0f,-0.0f))
+#define V4_NEGIM(a) _mm_xor_ps(a,_mm_set_ps(-0.0f,0.0f,-0.0f,0.0f))
+#else
+typedef float32x4_t wdl_fft_v4;
+#define V4_LOAD(p) vld1q_f32((const float *)(p))
+#define V4_STORE(p,v) vst1q_f32((float *)(p),v)
+#define V4_ADD(a,b) vaddq_f32(a,b)
+#define V4_SUB(a,b) vsubq_f32(a,b)
+#define V4_MUL(a,b) vmulq_f32(a,b)
+#define V4_SWAP(a) vrev64q_f32(a)
+#define V4_DUPRE(a) (vtrnq_f32(a,a).val[0])
+#define V4_DUPIM(a) (vtrnq_f32(a,a).val[1])
+#define V4_REV(a) vcombine_f32(vget_high_f32(vrev64q_f32(a)),vget_low_f32(vrev64q_f32(a)))
+static const float wdl_fft_negre[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+static const float wdl_fft_negim[4] = { 1.0f, -1.0f, 1.0f, -1.0f };
+#define V4_NEGRE(a) vmulq_f32(a,vld1q_f32(wdl_fft_negre))
+#define V4_NEGIM(a) vmulq_f32(a,vld1q_f32(wdl_fft_negim))
+#endif
+
+static inline wdl_fft_v4 v4_loadw(const WDL_FFT_COMPLEX *w, int rev)
+{
+  return rev ? V4_REV(V4_LOAD(w)) : V4_LOAD(w);
+}
+
+/* x*w and x*conj(w) */
+static inline wdl_fft_v4 v4_cmul(wdl_fft_v4 x, wdl_fft_v4 w)
+{
+  return V4_ADD(V4_MUL(x,V4_DUPRE(w)),V4_NEGRE(V4_MUL(V4_SWAP(x),V4_DUPIM(w))));
+}
+static inline wdl_fft_v4 v4_cmulconj(wdl_fft_v4 x, wdl_fft_v4 w)
+{
+  return V4_ADD(V4_MUL(x,V4_DUPRE(w)),V4_NEGIM(V4_MUL(V4_SWAP(x),V4_DUPIM(w))));
+}
+
+static inline void transform2(WDL_FFT_COMPLEX *a0, WDL_FFT_COMPLEX *a1, WDL_FFT_COMPLEX *a2, WDL_FFT_COMPLEX *a3, const WDL_FFT_COMPLEX *w, int rev)
+{
+  const wdl_fft_v4 x0 = V4_LOAD(a0), x1 = V4_LOAD(a1), x2 = V4_LOAD(a2), x3 = V4_LOAD(a3);
+  const wdl_fft_v4 d02 = V4_SUB(x0,x2), d13 = V4_SUB(x1,x3);
+  const wdl_fft_v4 id13 = V4_NEGRE(V4_SWAP(d13)); /* i*(a1-a3) */
+  const wdl_fft_v4 ww = v4_loadw(w,rev);
+  V4_STORE(a0,V4_ADD(x0,x2));
+  V4_STORE(a1,V4_ADD(x1,x3));
+  V4_STORE(a2,v4_cmul(V4_ADD(d02,id13),ww));
+  V4_STORE(a3,v4_cmulconj(V4_SUB(d02,id13),ww));
+}
+
+static inline void untransform2(WDL_FFT_COMPLEX *a0, WDL_FFT_COMPLEX *a1, WDL_FFT_COMPLEX *a2, WDL_FFT_COMPLEX *a3, const WDL_FFT_COMPLEX *w, int rev)
+{
+  const wdl_fft_v4 x0 = V4_LOAD(a0), x1 = V4_LOAD(a1);
+  const wdl_fft_v4 ww = v4_loadw(w,rev);
+  const wdl_fft_v4 p = v4_cmulconj(V4_LOAD(a2),ww), q = v4_cmul(V4_LOAD(a3),ww);
+  const wdl_fft_v4 sum = V4_ADD(p,q);
+  const wdl_fft_v4 s = V4_NEGIM(V4_SWAP(V4_SUB(p,q))); /* -i*(p-q) */
+  V4_STORE(a0,V4_ADD(x0,sum));
+  V4_STORE(a2,V4_SUB(x0,sum));
+  V4_STORE(a1,V4_ADD(x1,s));
+  V4_STORE(a3,V4_SUB(x1,s));
+}
+
+#define WDL_FFT_SIMD_PASSES
+#endif
+
 static void c2(register WDL_FFT_COMPLEX *a)
 {
   register WDL_FFT_REAL t1;
@@ -425,8 +525,12 @@ static void cpass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   TRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
 
   for (;;) {
+#ifdef WDL_FFT_SIMD_PASSES
+    transform2(a+2,a1+2,a2+2,a3+2,w+1,0);
+#else
     TRANSFORM(a[2],a1[2],a2[2],a3[2],w[1].re,w[1].im);
     TRANSFORM(a[3],a1[3],a2[3],a3[3],w[2].re,w[2].im);
+#endif
     if (!--n) break;
     a += 2;
     a1 += 2;
@@ -498,8 +602,12 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 += 2;
 
   do {
+#ifdef WDL_FFT_SIMD_PASSES
+    transform2(a,a1,a2,a3,w+1,0);
+#else
     TRANSFORM(a[0],a1[0],a2[0],a3[0],w[1].re,w[1].im);
     TRANSFORM(a[1],a1[1],a2[1],a3[1],w[2].re,w[2].im);
+#endif
     a += 2;
     a1 += 2;
     a2 += 2;
@@ -516,8 +624,12 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
 
   k = n - 2;
   do {
+#ifdef WDL_FFT_SIMD_PASSES
+    transform2(a,a1,a2,a3,w-2,1);
+#else
     TRANSFORM(a[0],a1[0],a2[0],a3[0],w[-1].im,w[-1].re);
     TRANSFORM(a[1],a1[1],a2[1],a3[1],w[-2].im,w[-2].re);
+#endif
     a += 2;
     a1 += 2;
     a2 += 2;
@@ -575,6 +687,22 @@ static void c32768(register WDL_FFT_COMPLEX *a)
   c16384(a);
 }
 
+static void c65536(register WDL_FFT_COMPLEX *a)
+{
+  cpassbig(a,d65536,8192);
+  c16384(a + 32768 + 16384);
+  c16384(a + 32768);
+  c32768(a);
+}
+
+static void c131072(register WDL_FFT_COMPLEX *a)
+{
+  cpassbig(a,d131072,16384);
+  c32768(a + 65536 + 32768);
+  c32768(a + 65536);
+  c65536(a);
+}
+
 
 /* n even, n > 0 */
 void WDL_fft_complexmul(WDL_FFT_COMPLEX *a,WDL_FFT_COMPLEX *b,int n)
@@ -809,8 +937,12 @@ static void upass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
 
   for (;;) {
+#ifdef WDL_FFT_SIMD_PASSES
+    untransform2(a+2,a1+2,a2+2,a3+2,w+1,0);
+#else
     UNTRANSFORM(a[2],a1[2],a2[2],a3[2],w[1].re,w[1].im);
     UNTRANSFORM(a[3],a1[3],a2[3],a3[3],w[2].re,w[2].im);
+#endif
     if (!--n) break;
     a += 2;
     a1 += 2;
@@ -883,8 +1015,12 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 += 2;
 
   do {
+#ifdef WDL_FFT_SIMD_PASSES
+    untransform2(a,a1,a2,a3,w+1,0);
+#else
     UNTRANSFORM(a[0],a1[0],a2[0],a3[0],w[1].re,w[1].im);
     UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[2].re,w[2].im);
+#endif
     a += 2;
     a1 += 2;
     a2 += 2;
@@ -901,8 +1037,12 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
 
   k = n - 2;
   do {
+#ifdef WDL_FFT_SIMD_PASSES
+    untransform2(a,a1,a2,a3,w-2,1);
+#else
     UNTRANSFORM(a[0],a1[0],a2[0],a3[0],w[-1].im,w[-1].re);
     UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[-2].im,w[-2].re);
+#endif
     a += 2;
     a1 += 2;
     a2 += 2;
@@ -962,6 +1102,22 @@ static void u32768(register WDL_FFT_COMPLEX *a)
   upassbig(a,d32768,4096);
 }
 
+static void u65536(register WDL_FFT_COMPLEX *a)
+{
+  u32768(a);
+  u16384(a + 32768);
+  u16384(a + 32768 + 16384);
+  upassbig(a,d65536,8192);
+}
+
+static void u131072(register WDL_FFT_COMPLEX *a)
+{
+  u65536(a);
+  u32768(a + 65536);
+  u32768(a + 65536 + 32768);
+  upassbig(a,d131072,16384);
+}
+
 
 static void __fft_gen(WDL_FFT_COMPLEX *buf, const WDL_FFT_COMPLEX *buf2, int sz, int isfull)
 {
@@ -1025,6 +1181,169 @@ int *WDL_fft_permute_tab(int fftsize)
 }
 
 
+#endif
+
+static const WDL_fft_backend *s_backend;
+
+void WDL_fft_set_backend(const WDL_fft_backend *backend)
+{
+  s_backend = backend;
+}
+
+const WDL_fft_backend *WDL_fft_get_backend()
+{
+  return s_backend;
+}
+
+#ifdef WDL_FFT_USE_VDSP
+
+/* vDSP uses the same signs and scaling (including the packing of the real transform, with
+the Nyquist bin in the imaginary part of the DC bin), but natural order, so the results are
+permuted in place to match WDL_fft_permute() */
+
+#if WDL_FFT_REALSIZE == 4
+static FFTSetup s_vdsp_setup;
+#define WDL_VDSP_FFT_ZIP vDSP_fft_zip
+#define WDL_VDSP_FFT_ZRIP vDSP_fft_zrip
+typedef DSPSplitComplex wdl_vdsp_split;
+#else
+static FFTSetupD s_vdsp_setup;
+#define WDL_VDSP_FFT_ZIP vDSP_fft_zipD
+#define WDL_VDSP_FFT_ZRIP vDSP_fft_zripD
+typedef DSPDoubleSplitComplex wdl_vdsp_split;
+#endif
+
+static int *s_vdsp_cycles[FFT_MAXBITLEN+1]; /* per log2(size), the first index of each cycle of the permutation, terminated by -1 */
+
+static void vdsp_permute(WDL_FFT_COMPLEX *buf, int bits, int toWDL)
+{
+  const int *perm = WDL_fft_permute_tab(1 << bits);
+  const int *cyc = s_vdsp_cycles[bits];
+  int start;
+  while ((start = *cyc++) >= 0)
+  {
+    WDL_FFT_COMPLEX v = buf[start];
+    int j = start;
+    if (toWDL) /* buf[perm[k]] = natural[k] */
+    {
+      do {
+        const int d = perm[j];
+        const WDL_FFT_COMPLEX t = buf[d];
+        buf[d] = v;
+        v = t;
+        j = d;
+      } while (j != start);
+    }
+    else /* natural[k] = buf[perm[k]] */
+    {
+      for (;;)
+      {
+        const int src = perm[j];
+        if (src == start) { buf[j] = v; break; }
+        buf[j] = buf[src];
+        j = src;
+      }
+    }
+  }
+}
+
+static int vdsp_bits(int len)
+{
+  int bits = 0;
+  if (len < 2 || (len & (len-1))) return -1;
+  while ((1 << bits) < len) bits++;
+  return bits;
+}
+
+static int vdsp_fft(WDL_FFT_COMPLEX *buf, int len, int isInverse)
+{
+  const int bits = vdsp_bits(len);
+  wdl_vdsp_split split;
+  if (bits < 1 || bits > FFT_MAXBITLEN || !s_vdsp_setup || !s_vdsp_cycles[bits]) return 0;
+
+  split.realp = &buf[0].re;
+  split.imagp = &buf[0].im;
+
+  if (!isInverse)
+  {
+    WDL_VDSP_FFT_ZIP(s_vdsp_setup,&split,2,bits,kFFTDirection_Forward);
+    vdsp_permute(buf,bits,1);
+  }
+  else
+  {
+    vdsp_permute(buf,bits,0);
+    WDL_VDSP_FFT_ZIP(s_vdsp_setup,&split,2,bits,kFFTDirection_Inverse);
+  }
+  return 1;
+}
+
+static int vdsp_real_fft(WDL_FFT_REAL *buf, int len, int isInverse)
+{
+  const int bits = vdsp_bits(len);
+  wdl_vdsp_split split;
+  if (bits < 2 || bits > FFT_MAXBITLEN || !s_vdsp_setup || !s_vdsp_cycles[bits-1]) return 0;
+
+  split.realp = buf;
+  split.imagp = buf + 1;
+
+  if (!isInverse)
+  {
+    WDL_VDSP_FFT_ZRIP(s_vdsp_setup,&split,2,bits,kFFTDirection_Forward);
+    vdsp_permute((WDL_FFT_COMPLEX *)buf,bits-1,1);
+  }
+  else
+  {
+    vdsp_permute((WDL_FFT_COMPLEX *)buf,bits-1,0);
+    WDL_VDSP_FFT_ZRIP(s_vdsp_setup,&split,2,bits,kFFTDirection_Inverse);
+  }
+  return 1;
+}
+
+static const WDL_fft_backend s_vdsp_backend = { vdsp_fft, vdsp_real_fft };
+
+static void vdsp_init()
+{
+  int bits;
+  char *visited = (char *)malloc(WDL_FFT_MAX_SIZE);
+  if (!visited) return;
+
+  for (bits = 1; bits <= FFT_MAXBITLEN; bits ++)
+  {
+    const int n = 1 << bits;
+    const int *perm = WDL_fft_permute_tab(n);
+    int i, ncyc = 0;
+    int *cyc;
+
+    memset(visited,0,n);
+    for (i = 0; i < n; i ++) if (!visited[i])
+    {
+      int j = i;
+      do { visited[j] = 1; j = perm[j]; } while (j != i);
+      if (perm[i] != i) ncyc++;
+    }
+
+    cyc = s_vdsp_cycles[bits] = (int *)malloc((ncyc+1) * sizeof(int));
+    if (!cyc) continue;
+
+    memset(visited,0,n);
+    for (i = 0; i < n; i ++) if (!visited[i])
+    {
+      int j = i;
+      do { visited[j] = 1; j = perm[j]; } while (j != i);
+      if (perm[i] != i) *cyc++ = i;
+    }
+    *cyc = -1;
+  }
+  free(visited);
+
+#if WDL_FFT_REALSIZE == 4
+  s_vdsp_setup = vDSP_create_fftsetup(FFT_MAXBITLEN,kFFTRadix2);
+#else
+  s_vdsp_setup = vDSP_create_fftsetupD(FFT_MAXBITLEN,kFFTRadix2);
+#endif
+  if (s_vdsp_setup && !s_backend) s_backend = &s_vdsp_backend;
+}
+
 #endif
 
 void WDL_fft_init()
@@ -1048,22 +1367,30 @@ void WDL_fft_init()
     fft_gen(d8192,d4096,0);
     fft_gen(d16384,d8192,0);
     fft_gen(d32768,d16384,0);
+    fft_gen(d65536,d32768,0);
+    fft_gen(d131072,d65536,0);
 #undef fft_gen
 
 #ifndef WDL_FFT_NO_PERMUTE
 	  offs = 0;
-	  for (i = 2; i <= 32768; i *= 2) 
+	  for (i = 2; i <= WDL_FFT_MAX_SIZE; i *= 2) 
     {
 		  idx_perm_calc(offs, i);
 		  offs += i;
 	  }
 #endif
 
+#ifdef WDL_FFT_USE_VDSP
+    vdsp_init();
+#endif
+
   }
 }
 
 void WDL_fft(WDL_FFT_COMPLEX *buf, int len, int isInverse)
 {
+  if (s_backend && s_backend->fft && s_backend->fft(buf,len,isInverse)) return;
+
   switch (len)
   {
     case 2: c2(buf); break;
@@ -1082,6 +1409,8 @@ void WDL_fft(WDL_FFT_COMPLEX *buf, int len, int isInverse)
     TMP(8192)
     TMP(16384)
     TMP(32768)
+    TMP(65536)
+    TMP(131072)
 #undef TMP
   }
 }
@@ -1177,6 +1506,8 @@ static void two_for_one(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, in
 
 void WDL_real_fft(WDL_FFT_REAL* buf, int len, int isInverse)
 {
+  if (s_backend && s_backend->real_fft && s_backend->real_fft(buf,len,isInverse)) return;
+
   switch (len)
   {
     case 2: if (!isInverse) r2(buf); else v2(buf); break;
@@ -1194,6 +1525,8 @@ void WDL_real_fft(WDL_FFT_REAL* buf, int len, int isInverse)
     TMP(8192)
     TMP(16384)
     TMP(32768)
+    TMP(65536)
+    TMP(131072)
 #undef TMP
   }
 }
@@ -51,6 +51,8 @@ typedef struct {
   WDL_FFT_REAL im;
 } WDL_FFT_COMPLEX;
 
+#define WDL_FFT_MAX_SIZE 131072 /* largest len for WDL_fft() and WDL_real_fft() */
+
 extern void WDL_fft_init();
 
 extern void WDL_fft_complexmul(WDL_FFT_COMPLEX *dest, WDL_FFT_COMPLEX *src, int len);
@@ -70,6 +72,23 @@ extern void WDL_real_fft(WDL_FFT_REAL *, int len, int isInverse);
 extern int WDL_fft_permute(int fftsize, int idx);
 extern int *WDL_fft_permute_tab(int fftsize);
 
+/* An alternative implementation of WDL_fft() and WDL_real_fft(). Each function returns
+nonzero if it did the transform, or 0 to have the built-in implementation do it (e.g. for
+sizes it doesn't support). A backend must use the same scaling and WDL_fft_permute() order
+as the built-in implementation, so that callers can't tell the difference.
+
+If built with WDL_FFT_USE_VDSP (Apple only) the default backend uses vDSP, otherwise the
+built-in implementation is used (which has SSE and NEON paths, see WDL_FFT_NO_SIMD). */
+typedef struct {
+  int (*fft)(WDL_FFT_COMPLEX *, int len, int isInverse);
+  int (*real_fft)(WDL_FFT_REAL *, int len, int isInverse);
+} WDL_fft_backend;
+
+/* Pass NULL for the built-in implementation. Call after WDL_fft_init(), and not while
+transforms are running on other threads. */
+extern void WDL_fft_set_backend(const WDL_fft_backend *backend);
+extern const WDL_fft_backend *WDL_fft_get_backend();
+
 #ifdef __cplusplus
 };
 #endif
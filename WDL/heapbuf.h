@@ -44,6 +44,63 @@
 
 #include "wdltypes.h"
 
+#ifdef WDL_HEAPBUF_ACCOUNTING
+// define WDL_HEAPBUF_ACCOUNTING for every file in a project (it changes the layout of WDL_HeapBuf) to count the
+// bytes that WDL_HeapBufs and so WDL_TypedBufs, WDL_PtrLists etc have allocated. each buffer charges the account
+// that was current on its thread when the buffer was created (see WDL_HeapBuf_Account::Scope), or nothing if none was.
+// an account is reference counted by its buffers, so it may be released while buffers that charge it still exist
+#include <atomic>
+
+class WDL_HeapBuf_Account
+{
+  public:
+    WDL_HeapBuf_Account() : m_refcnt(1), m_bufs(0), m_bytes(0), m_peak(0) { }
+
+    void AddRef() { m_refcnt.fetch_add(1,std::memory_order_relaxed); }
+    void Release() { if (m_refcnt.fetch_sub(1,std::memory_order_acq_rel)==1) delete this; }
+
+    WDL_INT64 GetBytes() const { return m_bytes.load(std::memory_order_relaxed); } // bytes allocated now
+    WDL_INT64 GetPeakBytes() const { return m_peak.load(std::memory_order_relaxed); }
+    int GetNumBuffers() const { return m_bufs.load(std::memory_order_relaxed); }
+    void ResetPeak() { m_peak.store(GetBytes(),std::memory_order_relaxed); }
+
+    void Charge(int delta)
+    {
+      const WDL_INT64 b = m_bytes.fetch_add(delta,std::memory_order_relaxed)+delta;
+      WDL_INT64 pk = m_peak.load(std::memory_order_relaxed);
+      while (b > pk && !m_peak.compare_exchange_weak(pk,b,std::memory_order_relaxed));
+    }
+
+    static WDL_HeapBuf_Account *&Current() { static thread_local WDL_HeapBuf_Account *cur; return cur; }
+
+    // makes an account current on this thread for its lifetime
+    class Scope
+    {
+      public:
+        explicit Scope(WDL_HeapBuf_Account *a) : m_prev(Current()) { Current()=a; }
+        ~Scope() { Current()=m_prev; }
+
+      private:
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+        WDL_HeapBuf_Account *m_prev;
+    };
+
+  private:
+    friend class WDL_HeapBuf;
+    ~WDL_HeapBuf_Account() { }
+    WDL_HeapBuf_Account(const WDL_HeapBuf_Account &);
+    WDL_HeapBuf_Account &operator=(const WDL_HeapBuf_Account &);
+
+    std::atomic<int> m_refcnt, m_bufs;
+    std::atomic<WDL_INT64> m_bytes, m_peak;
+};
+
+#define WDL_HEAPBUF_CHARGE(delta) { if (m_account) m_account->Charge(delta); }
+#else
+#define WDL_HEAPBUF_CHARGE(delta)
+#endif
+
 class WDL_HeapBuf
 {
   public:
@@ -65,6 +122,10 @@ class WDL_HeapBuf
     WDL_HeapBuf(const WDL_HeapBuf &cp)
     {
       m_buf=0;
+    #ifdef WDL_HEAPBUF_ACCOUNTING
+      m_alloc=0;
+      OpenAccount();
+    #endif
       CopyFrom(&cp,true);
     }
     WDL_HeapBuf &operator=(const WDL_HeapBuf &cp)
@@ -78,10 +139,16 @@ class WDL_HeapBuf
   #ifndef WDL_HEAPBUF_TRACE
     explicit WDL_HeapBuf(int granul=4096) : m_buf(NULL), m_alloc(0), m_size(0), m_granul(granul)
     {
+    #ifdef WDL_HEAPBUF_ACCOUNTING
+      OpenAccount();
+    #endif
     }
     ~WDL_HeapBuf()
     {
       free(m_buf);
+    #ifdef WDL_HEAPBUF_ACCOUNTING
+      CloseAccount();
+    #endif
     }
   #else
     explicit WDL_HeapBuf(int granul=4096, const char *tracetype="WDL_HeapBuf"
@@ -89,14 +156,24 @@ class WDL_HeapBuf
     {
       m_tracetype = tracetype;
       wdl_log("WDL_HeapBuf: created type: %s granul=%d\n",tracetype,granul);
+    #ifdef WDL_HEAPBUF_ACCOUNTING
+      OpenAccount();
+    #endif
     }
     ~WDL_HeapBuf()
     {
       wdl_log("WDL_HeapBuf: destroying type: %s (alloc=%d, size=%d)\n",m_tracetype,m_alloc,m_size);
       free(m_buf);
+    #ifdef WDL_HEAPBUF_ACCOUNTING
+      CloseAccount();
+    #endif
     }
   #endif
 
+  #ifdef WDL_HEAPBUF_ACCOUNTING
+    WDL_HeapBuf_Account *GetAccount() const { return m_account; }
+  #endif
+
 #endif // !WDL_HEAPBUF_IMPL_ONLY
 
     // implementation bits
@@ -122,6 +199,7 @@ class WDL_HeapBuf
             return m_buf;
           }
           if (newbuf&&m_buf) memcpy(newbuf,m_buf,a);
+          WDL_HEAPBUF_CHARGE(newsize-m_alloc)
           m_size=m_alloc=newsize;
           free(m_buf);
           return m_buf=newbuf;
@@ -162,6 +240,7 @@ class WDL_HeapBuf
                 #endif
                 if (newalloc <= 0)
                 {
+                  WDL_HEAPBUF_CHARGE(-m_alloc)
                   free(m_buf);
                   m_buf=0;
                   m_alloc=0;
@@ -187,6 +266,7 @@ class WDL_HeapBuf
                   }
                 }
   
+                WDL_HEAPBUF_CHARGE(newalloc-m_alloc)
                 m_buf=nbuf;
                 m_alloc=newalloc;
               } // alloc size change
@@ -204,6 +284,7 @@ class WDL_HeapBuf
       {
         if (exactCopyOfConfig) // copy all settings
         {
+          WDL_HEAPBUF_CHARGE(-m_alloc)
           free(m_buf);
 
           #ifdef WDL_HEAPBUF_TRACE
@@ -218,6 +299,7 @@ class WDL_HeapBuf
           #endif
           if (m_buf) memcpy(m_buf,hb->m_buf,m_size = hb->m_size);
           else m_alloc=0;
+          WDL_HEAPBUF_CHARGE(m_alloc)
         }
         else // copy just the data + size
         {
@@ -247,6 +329,28 @@ class WDL_HeapBuf
     const char *m_tracetype;
   #endif
 
+  #ifdef WDL_HEAPBUF_ACCOUNTING
+    WDL_HeapBuf_Account *m_account;
+
+    void OpenAccount()
+    {
+      if ((m_account = WDL_HeapBuf_Account::Current()) != NULL)
+      {
+        m_account->AddRef();
+        m_account->m_bufs.fetch_add(1,std::memory_order_relaxed);
+      }
+    }
+    void CloseAccount()
+    {
+      if (m_account)
+      {
+        m_account->Charge(-m_alloc);
+        m_account->m_bufs.fetch_sub(1,std::memory_order_relaxed);
+        m_account->Release();
+      }
+    }
+  #endif
+
 };
 
 template<class PTRTYPE> class WDL_TypedBuf 
@@ -18,6 +18,7 @@
 
 #include "lice_combine.h"
 #include "lice_extended.h"
+#include "lice_simd.h"
 
 #ifndef _WIN32
 #include "../swell/swell.h"
@@ -917,6 +918,62 @@ void LICE_GradRect(LICE_IBitmap *dest, int dstx, int dsty, int dstw, int dsth,
 
 #ifndef LICE_NO_BLIT_SUPPORT 
 
+#if defined(LICE_SIMD) && !defined(LICE_FAVOR_SIZE)
+
+// does the first (w&~3) pixels of each row with ROWFUNC, and the rest with COMBFUNC
+template<class COMBFUNC, class ROWFUNC> class _LICE_Template_BlitSIMD
+{
+  public:
+    static void blit(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia)
+    {
+      while (h-->0)
+      {
+        int n=ROWFUNC::doRow(dest,src,w,ia);
+        const LICE_pixel_chan *pin=src + n*sizeof(LICE_pixel);
+        LICE_pixel_chan *pout=dest + n*sizeof(LICE_pixel);
+        while (n++ < w)
+        {
+          COMBFUNC::doPix(pout,pin[LICE_PIXEL_R],pin[LICE_PIXEL_G],pin[LICE_PIXEL_B],pin[LICE_PIXEL_A],ia);
+          pin += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+          pout += sizeof(LICE_pixel)/sizeof(LICE_pixel_chan);
+        }
+        dest+=dest_span;
+        src += src_span;
+      }
+    }
+};
+
+// returns false for the modes that have no row kernel (the caller uses _LICE_Template_Blit2)
+static bool _LICE_Template_BlitSIMD_Dispatch(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int w, int h, int src_span, int dest_span, int ia, int mode)
+{
+  if (ia<=0) return false;
+  switch (mode&(LICE_BLIT_MODE_MASK|LICE_BLIT_USE_ALPHA))
+  {
+    case LICE_BLIT_MODE_COPY:
+      if (ia>=256) return false; // memmove
+      _LICE_Template_BlitSIMD<_LICE_CombinePixelsCopyNoClamp,_LICE_SIMDRowCopy>::blit(dest,src,w,h,src_span,dest_span,ia);
+    return true;
+    case LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA:
+      if (ia==256) _LICE_Template_BlitSIMD<_LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmNoClamp,_LICE_SIMDRowCopySourceAlphaIgnoreAlphaParm>::blit(dest,src,w,h,src_span,dest_span,ia);
+      else if (ia<256) _LICE_Template_BlitSIMD<_LICE_CombinePixelsCopySourceAlphaNoClamp,_LICE_SIMDRowCopySourceAlpha>::blit(dest,src,w,h,src_span,dest_span,ia);
+      else return false;
+    return true;
+#ifndef LICE_DISABLE_BLEND_ADD
+    case LICE_BLIT_MODE_ADD:
+      if (ia>256) return false;
+      _LICE_Template_BlitSIMD<_LICE_CombinePixelsAdd,_LICE_SIMDRowAdd>::blit(dest,src,w,h,src_span,dest_span,ia);
+    return true;
+    case LICE_BLIT_MODE_ADD|LICE_BLIT_USE_ALPHA:
+      if (ia>256) return false;
+      _LICE_Template_BlitSIMD<_LICE_CombinePixelsAddSourceAlpha,_LICE_SIMDRowAddSourceAlpha>::blit(dest,src,w,h,src_span,dest_span,ia);
+    return true;
+#endif
+  }
+  return false;
+}
+
+#endif
+
 static void LICE_BlitInt(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int dsty, const RECT *srcrect, float alpha, int mode, bool allowSc)
 {
   if (!dest || !src || !alpha) return;
@@ -1074,6 +1131,11 @@ static void LICE_BlitInt(LICE_IBitmap *dest, LICE_IBitmap *src, int dstx, int ds
     #else
         #define __LICE__ACTION(comb) _LICE_Template_Blit2<comb>::blit(pdest,psrc,cpsize,i,src_span,dest_span,ia)
     #endif
+
+    #if defined(LICE_SIMD) && !defined(LICE_FAVOR_SIZE)
+        // the row kernels read 4 source pixels before writing 4 dest pixels, so only when they can't overlap
+        if (src != dest && cpsize >= 4 && _LICE_Template_BlitSIMD_Dispatch(pdest,psrc,cpsize,i,src_span,dest_span,ia,mode)) return;
+    #endif
       
         __LICE_ACTION_SRCALPHA(mode,ia,false);
     
@@ -0,0 +1,241 @@
+#ifndef _LICE_SIMD_H_
+#define _LICE_SIMD_H_
+
+/*
+  Cockos WDL - LICE - Lightweight Image Compositing Engine
+  File: lice_simd.h (SSE2/NEON row kernels for LICE_Blit)
+
+  These process 4 pixels at a time and produce exactly the same output as the
+  _LICE_CombinePixels* classes they stand in for (the NoClamp variants, and Add),
+  so the blit path can use them for the bulk of each row and finish the remaining
+  0-3 pixels with the scalar classes.
+
+  SSE2 is part of every x86-64 target (and of x86 builds with /arch:SSE2 or -msse2),
+  and NEON of every AArch64 one, so these are chosen at compile time, not at run time.
+  Define LICE_NO_SIMD to use the scalar code everywhere.
+
+  The 8-bit channels are widened to 16-bit lanes. The scalar code's
+    s + ((d-s)*sc)/256
+  divides a signed value, rounding towards zero, which is done here as
+  sign(d-s) * ((|d-s|*sc)>>8); |d-s|*sc is at most 255*256 so it fits an unsigned
+  16-bit lane.
+*/
+
+#if !defined(LICE_NO_SIMD) && LICE_PIXEL_A == 3 && LICE_PIXEL_R == 2 && LICE_PIXEL_G == 1 && LICE_PIXEL_B == 0
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LICE_SIMD_SSE2
+    #include <emmintrin.h>
+  #elif defined(__aarch64__) || defined(_M_ARM64)
+    #define LICE_SIMD_NEON
+    #include <arm_neon.h>
+  #endif
+#endif
+
+#if defined(LICE_SIMD_SSE2) || defined(LICE_SIMD_NEON)
+#define LICE_SIMD
+
+#ifdef LICE_SIMD_SSE2
+
+// s + sign(d-s)*((|d-s|*sc)>>8) for eight 16-bit channels
+static inline __m128i _LICE_SIMD_Mix(__m128i s, __m128i d, __m128i sc)
+{
+  const __m128i x = _mm_sub_epi16(d,s);
+  const __m128i sgn = _mm_srai_epi16(x,15);
+  __m128i p = _mm_sub_epi16(_mm_xor_si128(x,sgn),sgn);
+  p = _mm_srli_epi16(_mm_mullo_epi16(p,sc),8);
+  return _mm_add_epi16(s,_mm_sub_epi16(_mm_xor_si128(p,sgn),sgn));
+}
+
+// each pixel's alpha in all four of its 16-bit lanes
+static inline __m128i _LICE_SIMD_SpreadAlpha(__m128i v)
+{
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+}
+
+// out, but d for the pixels whose source alpha is 0
+static inline __m128i _LICE_SIMD_KeepTransparent(__m128i out, __m128i d, __m128i s)
+{
+  const __m128i z = _mm_cmpeq_epi32(_mm_and_si128(s,_mm_set1_epi32((int)0xff000000)),_mm_setzero_si128());
+  return _mm_or_si128(_mm_and_si128(z,d),_mm_andnot_si128(z,out));
+}
+
+#define LICE_SIMD_ALPHAMASK16 _mm_set_epi16(-1,0,0,0,-1,0,0,0)
+
+#define LICE_SIMD_ROWLOOP(body) \
+  const int n4 = n & ~3; \
+  const __m128i zero = _mm_setzero_si128(); \
+  for (int x = 0; x < n4; x += 4) { \
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + x*4)); \
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + x*4)); \
+    const __m128i slo = _mm_unpacklo_epi8(s,zero), shi = _mm_unpackhi_epi8(s,zero); \
+    const __m128i dlo = _mm_unpacklo_epi8(d,zero), dhi = _mm_unpackhi_epi8(d,zero); \
+    LICE_SIMD_V16 olo, ohi; \
+    body \
+    _mm_storeu_si128((__m128i *)(dest + x*4), out); \
+  } \
+  return n4;
+
+#define LICE_SIMD_V8 __m128i
+#define LICE_SIMD_V16 __m128i
+#define LICE_SIMD_SET16(v) _mm_set1_epi16((short)(v))
+#define LICE_SIMD_ADD16(a,b) _mm_add_epi16(a,b)
+#define LICE_SIMD_SUB16(a,b) _mm_sub_epi16(a,b)
+#define LICE_SIMD_MULSHR8(a,b) _mm_srli_epi16(_mm_mullo_epi16(a,b),8)
+#define LICE_SIMD_SELECT16(mask,a,b) _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b)) // mask ? a : b
+#define LICE_SIMD_PACK(lo,hi) _mm_packus_epi16(lo,hi)
+
+#else // LICE_SIMD_NEON
+
+static inline int16x8_t _LICE_SIMD_Mix(int16x8_t s, int16x8_t d, int16x8_t sc)
+{
+  const int16x8_t x = vsubq_s16(d,s);
+  const int16x8_t sgn = vshrq_n_s16(x,15);
+  const uint16x8_t p = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_s16(vabsq_s16(x)),vreinterpretq_u16_s16(sc)),8);
+  return vaddq_s16(s,vsubq_s16(veorq_s16(vreinterpretq_s16_u16(p),sgn),sgn));
+}
+
+static inline int16x8_t _LICE_SIMD_SpreadAlpha(int16x8_t v)
+{
+  const uint64x2_t a = vshrq_n_u64(vreinterpretq_u64_s16(v),48);
+  const uint64x2_t a2 = vorrq_u64(a,vshlq_n_u64(a,16));
+  return vreinterpretq_s16_u64(vorrq_u64(a2,vshlq_n_u64(a2,32)));
+}
+
+static inline uint8x16_t _LICE_SIMD_KeepTransparent(uint8x16_t out, uint8x16_t d, uint8x16_t s)
+{
+  const uint32x4_t z = vceqq_u32(vandq_u32(vreinterpretq_u32_u8(s),vdupq_n_u32(0xff000000)),vdupq_n_u32(0));
+  return vbslq_u8(vreinterpretq_u8_u32(z),d,out);
+}
+
+static const short _LICE_SIMD_AlphaMask16[8]={0,0,0,-1,0,0,0,-1};
+#define LICE_SIMD_ALPHAMASK16 vld1q_s16(_LICE_SIMD_AlphaMask16)
+
+#define LICE_SIMD_ROWLOOP(body) \
+  const int n4 = n & ~3; \
+  for (int x = 0; x < n4; x += 4) { \
+    const uint8x16_t s = vld1q_u8(src + x*4); \
+    const uint8x16_t d = vld1q_u8(dest + x*4); \
+    const int16x8_t slo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(s))), shi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(s))); \
+    const int16x8_t dlo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(d))), dhi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(d))); \
+    LICE_SIMD_V16 olo, ohi; \
+    body \
+    vst1q_u8(dest + x*4, out); \
+  } \
+  return n4;
+
+#define LICE_SIMD_V8 uint8x16_t
+#define LICE_SIMD_V16 int16x8_t
+#define LICE_SIMD_SET16(v) vdupq_n_s16((short)(v))
+#define LICE_SIMD_ADD16(a,b) vaddq_s16(a,b)
+#define LICE_SIMD_SUB16(a,b) vsubq_s16(a,b)
+#define LICE_SIMD_MULSHR8(a,b) vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vreinterpretq_u16_s16(a),vreinterpretq_u16_s16(b)),8))
+#define LICE_SIMD_SELECT16(mask,a,b) vbslq_s16(vreinterpretq_u16_s16(mask),a,b)
+#define LICE_SIMD_PACK(lo,hi) vcombine_u8(vqmovun_s16(lo),vqmovun_s16(hi))
+
+#endif
+
+// each of these blends the first (n&~3) pixels of a row and returns how many that was
+
+// _LICE_CombinePixelsCopyNoClamp, 0 < alpha < 256
+class _LICE_SIMDRowCopy
+{
+public:
+  static int doRow(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int alpha)
+  {
+    const int sc = 256-alpha;
+    LICE_SIMD_ROWLOOP(
+      olo = _LICE_SIMD_Mix(slo,dlo,LICE_SIMD_SET16(sc));
+      ohi = _LICE_SIMD_Mix(shi,dhi,LICE_SIMD_SET16(sc));
+      const LICE_SIMD_V8 out = LICE_SIMD_PACK(olo,ohi);
+    )
+  }
+};
+
+// _LICE_CombinePixelsCopySourceAlphaNoClamp, 0 < alpha < 256
+class _LICE_SIMDRowCopySourceAlpha
+{
+public:
+  static int doRow(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int alpha)
+  {
+    LICE_SIMD_ROWLOOP(
+      const LICE_SIMD_V16 sc2lo = LICE_SIMD_MULSHR8(LICE_SIMD_ADD16(_LICE_SIMD_SpreadAlpha(slo),LICE_SIMD_SET16(1)),LICE_SIMD_SET16(alpha));
+      const LICE_SIMD_V16 sc2hi = LICE_SIMD_MULSHR8(LICE_SIMD_ADD16(_LICE_SIMD_SpreadAlpha(shi),LICE_SIMD_SET16(1)),LICE_SIMD_SET16(alpha));
+      olo = _LICE_SIMD_Mix(slo,dlo,LICE_SIMD_SUB16(LICE_SIMD_SET16(256),sc2lo));
+      ohi = _LICE_SIMD_Mix(shi,dhi,LICE_SIMD_SUB16(LICE_SIMD_SET16(256),sc2hi));
+      olo = LICE_SIMD_SELECT16(LICE_SIMD_ALPHAMASK16,LICE_SIMD_ADD16(sc2lo,dlo),olo);
+      ohi = LICE_SIMD_SELECT16(LICE_SIMD_ALPHAMASK16,LICE_SIMD_ADD16(sc2hi,dhi),ohi);
+      const LICE_SIMD_V8 out = _LICE_SIMD_KeepTransparent(LICE_SIMD_PACK(olo,ohi),d,s);
+    )
+  }
+};
+
+// _LICE_CombinePixelsCopySourceAlphaIgnoreAlphaParmNoClamp (a==255 needs no special case, sc=0 copies the source)
+class _LICE_SIMDRowCopySourceAlphaIgnoreAlphaParm
+{
+public:
+  static int doRow(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int alpha)
+  {
+    LICE_SIMD_ROWLOOP(
+      olo = _LICE_SIMD_Mix(slo,dlo,LICE_SIMD_SUB16(LICE_SIMD_SET16(255),_LICE_SIMD_SpreadAlpha(slo)));
+      ohi = _LICE_SIMD_Mix(shi,dhi,LICE_SIMD_SUB16(LICE_SIMD_SET16(255),_LICE_SIMD_SpreadAlpha(shi)));
+      olo = LICE_SIMD_SELECT16(LICE_SIMD_ALPHAMASK16,LICE_SIMD_ADD16(slo,dlo),olo);
+      ohi = LICE_SIMD_SELECT16(LICE_SIMD_ALPHAMASK16,LICE_SIMD_ADD16(shi,dhi),ohi);
+      const LICE_SIMD_V8 out = _LICE_SIMD_KeepTransparent(LICE_SIMD_PACK(olo,ohi),d,s);
+    )
+  }
+};
+
+#ifndef LICE_DISABLE_BLEND_ADD
+
+// _LICE_CombinePixelsAdd, 0 < alpha <= 256
+class _LICE_SIMDRowAdd
+{
+public:
+  static int doRow(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int alpha)
+  {
+    LICE_SIMD_ROWLOOP(
+      olo = LICE_SIMD_ADD16(dlo,LICE_SIMD_MULSHR8(slo,LICE_SIMD_SET16(alpha)));
+      ohi = LICE_SIMD_ADD16(dhi,LICE_SIMD_MULSHR8(shi,LICE_SIMD_SET16(alpha)));
+      const LICE_SIMD_V8 out = LICE_SIMD_PACK(olo,ohi);
+    )
+  }
+};
+
+// _LICE_CombinePixelsAddSourceAlpha, 0 < alpha <= 256
+class _LICE_SIMDRowAddSourceAlpha
+{
+public:
+  static int doRow(LICE_pixel_chan *dest, const LICE_pixel_chan *src, int n, int alpha)
+  {
+    // (alpha*(a+1))/256 is a+1 for alpha=256, which would overflow a 16-bit lane
+    LICE_SIMD_ROWLOOP(
+      LICE_SIMD_V16 alo = LICE_SIMD_ADD16(_LICE_SIMD_SpreadAlpha(slo),LICE_SIMD_SET16(1));
+      LICE_SIMD_V16 ahi = LICE_SIMD_ADD16(_LICE_SIMD_SpreadAlpha(shi),LICE_SIMD_SET16(1));
+      if (alpha < 256)
+      {
+        alo = LICE_SIMD_MULSHR8(alo,LICE_SIMD_SET16(alpha));
+        ahi = LICE_SIMD_MULSHR8(ahi,LICE_SIMD_SET16(alpha));
+      }
+      olo = LICE_SIMD_ADD16(dlo,LICE_SIMD_MULSHR8(slo,alo));
+      ohi = LICE_SIMD_ADD16(dhi,LICE_SIMD_MULSHR8(shi,ahi));
+      const LICE_SIMD_V8 out = _LICE_SIMD_KeepTransparent(LICE_SIMD_PACK(olo,ohi),d,s);
+    )
+  }
+};
+
+#endif // LICE_DISABLE_BLEND_ADD
+
+#undef LICE_SIMD_ROWLOOP
+#undef LICE_SIMD_SET16
+#undef LICE_SIMD_ADD16
+#undef LICE_SIMD_SUB16
+#undef LICE_SIMD_MULSHR8
+#undef LICE_SIMD_SELECT16
+#undef LICE_SIMD_PACK
+#undef LICE_SIMD_ALPHAMASK16
+#undef LICE_SIMD_V8
+#undef LICE_SIMD_V16
+
+#endif // LICE_SIMD
+
+#endif // _LICE_SIMD_H_
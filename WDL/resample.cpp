@@ -33,10 +33,25 @@
   #endif
 #endif
 
+#if !defined(WDL_RESAMPLE_NO_NEON) && !defined(WDL_RESAMPLE_USE_NEON)
+  #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define WDL_RESAMPLE_USE_NEON
+  #endif
+#endif
+
 #ifdef WDL_RESAMPLE_USE_SSE
   #include <emmintrin.h>
 #endif
 
+#ifdef WDL_RESAMPLE_USE_NEON
+  #include <arm_neon.h>
+#endif
+
+// sinc tables for exact ratios (e.g. 44.1k<->48k, 160 phases) are used if they have no more than this many coefficients
+#ifndef WDL_RESAMPLE_MAX_IDEAL_COEFFS
+#define WDL_RESAMPLE_MAX_IDEAL_COEFFS 16384
+#endif
+
 #ifndef PI
 #define PI 3.1415926535897932384626433832795
 #endif
@@ -124,30 +139,52 @@ public:
     memcpy(hsave, hist, sizeof(hist));
   }
 
-  void ApplyBuffer(WDL_ResampleSample *buf, int ns, int nch)
+  void ApplyBuffer(WDL_ResampleSample *buf, int ns, int nch) { ApplyBuffer(buf,1,nch,ns,nch); }
+
+  // channel x starts at buf + x*chstride, its samples are span apart
+  void ApplyBuffer(WDL_ResampleSample *buf, int chstride, int span, int ns, int nch)
+  {
+    const int mode = BeginBuffer();
+    if (mode) for (int x=0; x < nch; x ++) ApplyChannel(buf + x*chstride,ns,span,m_hist.Get() + x*m_filtsz*4,mode);
+  }
+
+  // planar, one pointer per channel
+  void ApplyBuffer(WDL_ResampleSample * const *bufs, int ns, int nch)
+  {
+    const int mode = BeginBuffer();
+    if (mode) for (int x=0; x < nch; x ++) ApplyChannel(bufs[x],ns,1,m_hist.Get() + x*m_filtsz*4,mode);
+  }
+
+private:
+  // updates the fade state, returns 0 to leave the buffer alone, 1 to filter, 2 to fade in and 3 to fade out
+  int BeginBuffer()
   {
-    double *hist = m_hist.Get();
-    const int nf = m_filtsz;
     if (m_state == 0)
     {
-      if (m_fpos >= 1.0) return;
+      if (m_fpos >= 1.0) return 0;
       m_state = 1;
-      for (int x=0; x < nch; x ++) for (int a = 0; a < nf; a ++, hist+=4) ApplyIIRFade(buf+x,ns,nch,hist,0.0,1.0/ns);
+      return 2;
     }
-    else if (m_fpos >= 1.0)
+    if (m_fpos >= 1.0)
     {
-      if (m_state > 0)
-        for (int x=0; x < nch; x ++) for (int a = 0; a < nf; a ++, hist+=4) ApplyIIRFade(buf+x,ns,nch,hist,1.0,-1.0/ns);
+      const int mode = m_state > 0 ? 3 : 0;
       m_state = 0;
+      return mode;
     }
-    else
+    m_state = 1;
+    return 1;
+  }
+
+  void ApplyChannel(WDL_ResampleSample *buf, int ns, int span, double *hist, int mode)
+  {
+    for (int a = 0; a < m_filtsz; a ++, hist+=4)
     {
-      m_state = 1;
-      for (int x=0; x < nch; x ++) for (int a = 0; a < nf; a ++, hist+=4) ApplyIIR(buf+x,ns,nch,hist);
+      if (mode == 1) ApplyIIR(buf,ns,span,hist);
+      else if (mode == 2) ApplyIIRFade(buf,ns,span,hist,0.0,1.0/ns);
+      else ApplyIIRFade(buf,ns,span,hist,1.0,-1.0/ns);
     }
   }
 
-private:
   double m_fpos;
   double m_a1,m_a2;
   double m_b0,m_b1,m_b2;
@@ -1073,6 +1110,174 @@ static void inline SincSample2N(double *outptr, const double *inptr, double frac
 
 #endif // WDL_RESAMPLE_USE_SSE
 
+// mono kernels for float samples and float filters (WDL_RESAMPLE_TYPE=float), used for 1 channel
+// interleaved input and for every channel of planar input. these accumulate in single precision
+#if defined(WDL_RESAMPLE_USE_SSE) && !defined(WDL_RESAMPLE_FULL_SINC_PRECISION)
+
+static inline float wdl_rs_hsum_ps(__m128 v)
+{
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static void inline SincSample1(float *outptr, const float *inptr, double fracpos, const float *filter, int filtsz, int oversize)
+{
+  fracpos *= oversize;
+  const int ifpos=(int)fracpos;
+  fracpos -= ifpos;
+
+  const float *fptr2=filter + (oversize-ifpos) * filtsz;
+  const float *fptr=fptr2 - filtsz;
+  const float *iptr=inptr;
+  int i=filtsz;
+
+  __m128 xmm0 = _mm_setzero_ps();
+  __m128 xmm1 = _mm_setzero_ps();
+  __m128 xmm2;
+
+  while (i >= 4)
+  {
+    xmm2 = _mm_loadu_ps(iptr);
+    xmm0 = _mm_add_ps(xmm0, _mm_mul_ps(_mm_loadu_ps(fptr), xmm2));
+    xmm1 = _mm_add_ps(xmm1, _mm_mul_ps(_mm_loadu_ps(fptr2), xmm2));
+
+    iptr+=4;
+    fptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+
+  if (i) // filtsz is even, so 2 left
+  {
+    xmm2 = _mm_castpd_ps(_mm_load_sd((const double *)iptr));
+    xmm0 = _mm_add_ps(xmm0, _mm_mul_ps(_mm_castpd_ps(_mm_load_sd((const double *)fptr)), xmm2));
+    xmm1 = _mm_add_ps(xmm1, _mm_mul_ps(_mm_castpd_ps(_mm_load_sd((const double *)fptr2)), xmm2));
+  }
+
+  outptr[0]=(float) (wdl_rs_hsum_ps(xmm0)*fracpos + wdl_rs_hsum_ps(xmm1)*(1.0-fracpos));
+}
+
+static void inline SincSample1N(float *outptr, const float *inptr, double fracpos, const float *filter, int filtsz, int oversize)
+{
+  const int ifpos=(int)(fracpos*oversize+0.5);
+
+  const float *fptr2=filter + (oversize-ifpos) * filtsz;
+  const float *iptr=inptr;
+  int i=filtsz;
+
+  __m128 xmm0 = _mm_setzero_ps();
+  __m128 xmm1 = _mm_setzero_ps();
+
+  while (i >= 8)
+  {
+    xmm0 = _mm_add_ps(xmm0, _mm_mul_ps(_mm_loadu_ps(fptr2), _mm_loadu_ps(iptr)));
+    xmm1 = _mm_add_ps(xmm1, _mm_mul_ps(_mm_loadu_ps(fptr2+4), _mm_loadu_ps(iptr+4)));
+
+    iptr+=8;
+    fptr2+=8;
+    i-=8;
+  }
+
+  if (i >= 4)
+  {
+    xmm0 = _mm_add_ps(xmm0, _mm_mul_ps(_mm_loadu_ps(fptr2), _mm_loadu_ps(iptr)));
+    iptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+
+  if (i)
+  {
+    xmm1 = _mm_add_ps(xmm1, _mm_mul_ps(_mm_castpd_ps(_mm_load_sd((const double *)fptr2)),
+                                       _mm_castpd_ps(_mm_load_sd((const double *)iptr))));
+  }
+
+  outptr[0]=wdl_rs_hsum_ps(_mm_add_ps(xmm0, xmm1));
+}
+
+#elif defined(WDL_RESAMPLE_USE_NEON) && !defined(WDL_RESAMPLE_FULL_SINC_PRECISION)
+
+static inline float wdl_rs_hsum_f32(float32x4_t v)
+{
+  float32x2_t r = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+  r = vpadd_f32(r, r);
+  return vget_lane_f32(r, 0);
+}
+
+static void inline SincSample1(float *outptr, const float *inptr, double fracpos, const float *filter, int filtsz, int oversize)
+{
+  fracpos *= oversize;
+  const int ifpos=(int)fracpos;
+  fracpos -= ifpos;
+
+  const float *fptr2=filter + (oversize-ifpos) * filtsz;
+  const float *fptr=fptr2 - filtsz;
+  const float *iptr=inptr;
+  int i=filtsz;
+
+  float32x4_t sum = vdupq_n_f32(0.0f);
+  float32x4_t sum2 = vdupq_n_f32(0.0f);
+
+  while (i >= 4)
+  {
+    const float32x4_t in = vld1q_f32(iptr);
+    sum = vmlaq_f32(sum, vld1q_f32(fptr), in);
+    sum2 = vmlaq_f32(sum2, vld1q_f32(fptr2), in);
+
+    iptr+=4;
+    fptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+
+  if (i) // filtsz is even, so 2 left
+  {
+    const float32x2_t in = vld1_f32(iptr);
+    sum = vcombine_f32(vmla_f32(vget_low_f32(sum), vld1_f32(fptr), in), vget_high_f32(sum));
+    sum2 = vcombine_f32(vmla_f32(vget_low_f32(sum2), vld1_f32(fptr2), in), vget_high_f32(sum2));
+  }
+
+  outptr[0]=(float) (wdl_rs_hsum_f32(sum)*fracpos + wdl_rs_hsum_f32(sum2)*(1.0-fracpos));
+}
+
+static void inline SincSample1N(float *outptr, const float *inptr, double fracpos, const float *filter, int filtsz, int oversize)
+{
+  const int ifpos=(int)(fracpos*oversize+0.5);
+
+  const float *fptr2=filter + (oversize-ifpos) * filtsz;
+  const float *iptr=inptr;
+  int i=filtsz;
+
+  float32x4_t sum = vdupq_n_f32(0.0f);
+  float32x4_t sum2 = vdupq_n_f32(0.0f);
+
+  while (i >= 8)
+  {
+    sum = vmlaq_f32(sum, vld1q_f32(fptr2), vld1q_f32(iptr));
+    sum2 = vmlaq_f32(sum2, vld1q_f32(fptr2+4), vld1q_f32(iptr+4));
+
+    iptr+=8;
+    fptr2+=8;
+    i-=8;
+  }
+
+  if (i >= 4)
+  {
+    sum = vmlaq_f32(sum, vld1q_f32(fptr2), vld1q_f32(iptr));
+    iptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+
+  if (i)
+    sum2 = vcombine_f32(vmla_f32(vget_low_f32(sum2), vld1_f32(fptr2), vld1_f32(iptr)), vget_high_f32(sum2));
+
+  outptr[0]=wdl_rs_hsum_f32(vaddq_f32(sum, sum2));
+}
+
+#endif
+
 
 WDL_Resampler::WDL_Resampler()
 {
@@ -1111,6 +1316,8 @@ void WDL_Resampler::Reset(double fracpos)
   m_fracpos=fracpos; 
   m_samples_in_rsinbuf=0; 
   m_rsinbuf_nch=0;
+  m_rsinbuf_stride=0;
+  m_rsinbuf_planar=false;
   if (m_sinc_ideal_calced == -2) m_sinc_ideal_calced = -1;
   if (m_pre_filter) m_pre_filter->Reset();
   if (m_post_filter) m_post_filter->Reset();
@@ -1180,7 +1387,7 @@ const WDL_SincFilterSample *WDL_Resampler::BuildLowPass(double filtpos, bool *is
         if (out1 > 0 && in1 > 0 && m_sratein == (double)in1 && m_srateout == (double)out1)
         {
           // don't bother finding the GCD if it's lower than is useful
-          int min_cd =  out1 / (2*wantinterp);
+          int min_cd =  out1 / wdl_max(2*wantinterp, WDL_RESAMPLE_MAX_IDEAL_COEFFS/wantsize);
           if (min_cd < 1) min_cd = 1;
 
           int n1 = out1, n2=in1;
@@ -1204,7 +1411,7 @@ const WDL_SincFilterSample *WDL_Resampler::BuildLowPass(double filtpos, bool *is
     else
       ideal_interp = m_sinc_ideal_calced;
 
-    if (ideal_interp > 0 && ideal_interp <= wantinterp*2) // use ideal filter for reduced cpu use even if it means more memory
+    if (ideal_interp > 0 && (ideal_interp <= wantinterp*2 || ideal_interp <= WDL_RESAMPLE_MAX_IDEAL_COEFFS/wantsize)) // use ideal filter for reduced cpu use even if it means more memory
     {
       wantinterp = ideal_interp;
     }
@@ -1321,10 +1528,8 @@ static void wdl_rs_reinterleave_buffer(WDL_ResampleSample *rdptr, int in_nch, in
   }
 }
 
-int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample **inbuffer) 
-{   
-  if (nch < 1) return 0;
-
+void WDL_Resampler::SetupPrePostFilters(int nch)
+{
   if (m_prepost_filtercnt > 0)
   {
     if (!m_pre_filter) m_pre_filter = new WDL_Resampler_Filter;
@@ -1332,6 +1537,32 @@ int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample
     if (!m_post_filter) m_post_filter = new WDL_Resampler_Filter;
     m_post_filter->setParms(m_ratio,m_filterpos,m_filterq, m_prepost_filtercnt,nch);
   }
+}
+
+int WDL_Resampler::CalcSamplesRequested(int out_samples) const
+{
+  int sreq = 0;
+    
+  if (!m_feedmode) sreq = (int)(m_ratio * out_samples) + 4 + (m_sincsize>1 ? m_sincsize : 0) - m_samples_in_rsinbuf;
+  else sreq = out_samples;
+
+  if (sreq<0)sreq=0;
+  return sreq;
+}
+
+int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample **inbuffer) 
+{   
+  if (nch < 1) return 0;
+
+  if (m_rsinbuf_planar)
+  {
+    m_rsinbuf_planar=false;
+    m_rsinbuf_nch=0;
+    m_samples_in_rsinbuf=0;
+    m_filtlatency=0;
+  }
+
+  SetupPrePostFilters(nch);
 
   int fsize=0;
   if (m_sincsize>1) fsize = m_sincsize;
@@ -1350,12 +1581,7 @@ int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample
     }
   }
 
-  int sreq = 0;
-    
-  if (!m_feedmode) sreq = (int)(m_ratio * out_samples) + 4 + fsize - m_samples_in_rsinbuf;
-  else sreq = out_samples;
-
-  if (sreq<0)sreq=0;
+  int sreq = CalcSamplesRequested(out_samples);
   
   // if decreasing channel count, reinterleave before realloc
   if (nch < m_rsinbuf_nch && m_rsinbuf_nch > 0 && m_samples_in_rsinbuf)
@@ -1668,3 +1894,222 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
 
   return ret;
 }
+
+
+bool WDL_Resampler::ResizePlanar(int len, int nch) // keeps the first m_samples_in_rsinbuf samples of each channel
+{
+  const int oldstride = m_rsinbuf_stride, oldnch = m_rsinbuf_nch;
+  const int stride = wdl_max(wdl_max(len,oldstride),1); // only grows, so channels rarely move
+
+  WDL_ResampleSample *p = m_rsinbuf.ResizeOK(stride*nch,false);
+  if (!p) return false;
+
+  const int n = m_samples_in_rsinbuf, keepch = wdl_min(oldnch,nch);
+  int x;
+  if (stride != oldstride && n > 0)
+    for (x = keepch-1; x > 0; x --) memmove(p + x*stride, p + x*oldstride, n*sizeof(WDL_ResampleSample));
+  if (n > 0)
+    for (x = wdl_max(keepch,0); x < nch; x ++) memset(p + x*stride, 0, n*sizeof(WDL_ResampleSample));
+
+  m_rsinbuf_stride = stride;
+  m_rsinbuf_nch = nch;
+  return true;
+}
+
+int WDL_Resampler::ResamplePreparePlanar(int out_samples, int nch, WDL_ResampleSample **inbuffers)
+{
+  if (nch < 1) return 0;
+
+  if (!m_rsinbuf_planar)
+  {
+    m_rsinbuf_planar=true;
+    m_rsinbuf_nch=0;
+    m_rsinbuf_stride=0;
+    m_samples_in_rsinbuf=0;
+    m_filtlatency=0;
+  }
+
+  SetupPrePostFilters(nch);
+
+  const int hfs=m_sincsize>1 ? m_sincsize/2 : 0;
+  if (hfs>1 && m_samples_in_rsinbuf<hfs-1)
+  {
+    m_filtlatency+=hfs-1 - m_samples_in_rsinbuf;
+
+    m_samples_in_rsinbuf=0;
+    if (!ResizePlanar(hfs-1,nch)) return 0;
+    m_samples_in_rsinbuf=hfs-1;
+
+    for (int x = 0; x < nch; x ++)
+      memset(m_rsinbuf.Get() + x*m_rsinbuf_stride,0,m_samples_in_rsinbuf*sizeof(WDL_ResampleSample));
+  }
+
+  int sreq = CalcSamplesRequested(out_samples);
+
+  while (!ResizePlanar(m_samples_in_rsinbuf+sreq,nch))
+  {
+    // todo: notify of error?
+    if (sreq<=4) { sreq=0; ResizePlanar(m_samples_in_rsinbuf,nch); break; }
+    sreq/=2; // try again with half the size
+  }
+
+  for (int x = 0; x < nch; x ++)
+    inbuffers[x] = m_rsinbuf.Get() + x*m_rsinbuf_stride + m_samples_in_rsinbuf;
+
+  m_last_requested=sreq;
+  return sreq;
+}
+
+// resamples one channel of planar input. endpos is the first input position that can't be used
+static int wdl_rs_out_mono(WDL_ResampleSample *outptr, const WDL_ResampleSample *localin, double *srcpos_io, double drspos, int ns, int endpos,
+                           bool sinc, bool isideal, bool interp, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  double srcpos=*srcpos_io;
+  int ret=0;
+  if (sinc)
+  {
+    if (isideal)
+      while (ns--)
+      {
+        int ipos = (int)srcpos;
+        if (ipos >= endpos) break; // quit decoding, not enough input samples
+
+        SincSample1N(outptr++,localin + ipos,srcpos-ipos,filter,filtsz,oversize);
+        srcpos+=drspos;
+        ret++;
+      }
+    else
+      while (ns--)
+      {
+        int ipos = (int)srcpos;
+        if (ipos >= endpos) break; // quit decoding, not enough input samples
+
+        SincSample1(outptr++,localin + ipos,srcpos-ipos,filter,filtsz,oversize);
+        srcpos+=drspos;
+        ret++;
+      }
+  }
+  else if (!interp) // point sampling
+  {
+    while (ns--)
+    {
+      int ipos = (int)srcpos;
+      if (ipos >= endpos) break; // quit decoding, not enough input samples
+
+      *outptr++ = localin[ipos];
+      srcpos+=drspos;
+      ret++;
+    }
+  }
+  else // linear interpolation
+  {
+    while (ns--)
+    {
+      int ipos = (int)srcpos;
+      if (ipos >= endpos) break; // quit decoding, not enough input samples
+
+      double fracpos=srcpos-ipos; 
+      const WDL_ResampleSample *inptr = localin + ipos;
+      *outptr++ = inptr[0]*(1.0-fracpos) + inptr[1]*(fracpos);
+      srcpos+=drspos;
+      ret++;
+    }
+  }
+  *srcpos_io=srcpos;
+  return ret;
+}
+
+int WDL_Resampler::ResampleOutPlanar(WDL_ResampleSample **out, int nsamples_in, int nsamples_out, int nch)
+{
+  if (!m_rsinbuf_planar) return 0;
+  if (nch > m_rsinbuf_nch) nch = m_rsinbuf_nch;
+  if (nch < 1) return 0;
+#ifdef WDL_DENORMAL_WANTS_SCOPED_FTZ
+  WDL_denormal_ftz_scope ftz_force;
+#endif
+
+  if (m_pre_filter && nsamples_in > 0) // filter input
+  {
+    m_pre_filter->ApplyBuffer(m_rsinbuf.Get() + m_samples_in_rsinbuf,m_rsinbuf_stride,1,nsamples_in,nch);
+  }
+
+  // prevent the caller from corrupting the internal state
+  m_samples_in_rsinbuf += nsamples_in < m_last_requested ? nsamples_in : m_last_requested; 
+
+  int rsinbuf_availtemp = m_samples_in_rsinbuf;
+
+  if (nsamples_in < m_last_requested) // flush out to ensure we can deliver
+  {
+    const int fsize=(m_last_requested-nsamples_in)*2 + m_sincsize*2;
+
+    if (ResizePlanar(m_samples_in_rsinbuf+fsize,m_rsinbuf_nch))
+    {
+      for (int x = 0; x < m_rsinbuf_nch; x ++)
+        memset(m_rsinbuf.Get() + x*m_rsinbuf_stride + m_samples_in_rsinbuf,0,fsize*sizeof(WDL_ResampleSample));
+      rsinbuf_availtemp = m_samples_in_rsinbuf+fsize;
+    }
+  }
+
+  const int stride = m_rsinbuf_stride;
+  const double drspos = m_ratio;
+  WDL_ResampleSample *localin = m_rsinbuf.Get();
+
+  const WDL_SincFilterSample *filter=NULL;
+  int filtsz=0, endpos;
+  int outlatadj=0;
+  bool isideal = false;
+
+  if (m_sincsize) // sinc interpolating
+  {
+    if (m_ratio > 1.0) filter=BuildLowPass(1.0 / (m_ratio*1.03), &isideal);
+    else filter=BuildLowPass(1.0, &isideal);
+
+    filtsz=m_filter_coeffs_size;
+    endpos = rsinbuf_availtemp - filtsz - 1;
+    outlatadj=filtsz/2-1;
+
+    if (WDL_NOT_NORMALLY(!filter)) endpos = 0;
+  }
+  else endpos = m_interp ? rsinbuf_availtemp-1 : rsinbuf_availtemp;
+
+  // every channel advances by the same positions
+  int ret=0;
+  double srcpos=m_fracpos;
+  for (int x = 0; x < nch; x ++)
+  {
+    srcpos=m_fracpos;
+    ret = wdl_rs_out_mono(out[x],localin + x*stride,&srcpos,drspos,nsamples_out,endpos,
+                          m_sincsize>0,isideal,m_interp,filter,filtsz,m_lp_oversize);
+  }
+
+  if (ret > 0 && m_post_filter) // filter output
+  {
+    m_post_filter->ApplyBuffer(out,ret,nch);
+  }
+
+  if (ret>0 && rsinbuf_availtemp>m_samples_in_rsinbuf) // we had to pad!!
+  {
+    // check for the case where rsinbuf_availtemp>m_samples_in_rsinbuf, decrease ret down to actual valid samples
+    double adj=(srcpos-m_samples_in_rsinbuf + outlatadj) / drspos;
+    if (adj>0)
+    {
+      ret -= (int) (adj + 0.5);
+      if (ret<0)ret=0;
+    }
+  }
+
+  int isrcpos=(int)srcpos;
+  if (isrcpos > m_samples_in_rsinbuf) isrcpos=m_samples_in_rsinbuf;
+  m_fracpos = srcpos - isrcpos;
+
+  if (m_sincsize && isideal)
+    m_fracpos = floor(m_lp_oversize*m_fracpos + 0.5)/m_lp_oversize;
+
+  m_samples_in_rsinbuf -= isrcpos;
+  if (m_samples_in_rsinbuf <= 0) m_samples_in_rsinbuf=0;
+  else
+    for (int x = 0; x < m_rsinbuf_nch; x ++)
+      memmove(localin + x*stride, localin + x*stride + isrcpos,m_samples_in_rsinbuf*sizeof(WDL_ResampleSample));
+
+  return ret;
+}
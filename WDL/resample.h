@@ -72,10 +72,19 @@ public:
   // returns number of samples successfully outputted to out
   int ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch);
 
+  // planar versions of the above: inbuffers and out are arrays of nch channel pointers, which saves
+  // interleaving and deinterleaving per-voice buffers. each channel is resampled with the mono kernels.
+  // don't mix these with ResamplePrepare()/ResampleOut() without a Reset() in between (the buffered input is dropped)
+  int ResamplePreparePlanar(int req_samples, int nch, WDL_ResampleSample **inbuffers);
+  int ResampleOutPlanar(WDL_ResampleSample **out, int nsamples_in, int nsamples_out, int nch);
+
 
 
 private:
   const WDL_SincFilterSample *BuildLowPass(double filtpos, bool *isIdeal);
+  void SetupPrePostFilters(int nch);
+  int CalcSamplesRequested(int out_samples) const;
+  bool ResizePlanar(int len, int nch);
 
   double m_sratein WDL_FIXALIGN;
   double m_srateout;
@@ -95,6 +104,7 @@ private:
   int m_filtlatency;
   int m_samples_in_rsinbuf;
   int m_rsinbuf_nch;
+  int m_rsinbuf_stride; // planar mode: channel n starts at m_rsinbuf.Get() + n*m_rsinbuf_stride
   int m_lp_oversize;
   int m_sinc_ideal_calced; // -1=not yet calced
 
@@ -102,6 +112,7 @@ private:
   int m_sincoversize;
   bool m_interp;
   bool m_feedmode;
+  bool m_rsinbuf_planar;
 
 };
 
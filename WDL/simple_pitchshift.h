@@ -2,12 +2,42 @@
 #define _WDL_SIMPLEPITCHSHIFT_H_
 
 
+#include <math.h>
 #include "queue.h"
 
 #ifndef WDL_SIMPLEPITCHSHIFT_SAMPLETYPE
 #define WDL_SIMPLEPITCHSHIFT_SAMPLETYPE double
 #endif
 
+// PitchShiftBlock() works out the read positions and crossfade once per frame, then interpolates the channels of the frame
+// (which are contiguous, since the buffers are interleaved) two to a vector when the sample type is double.
+// define WDL_SIMPLEPITCHSHIFT_NO_SIMD to use the scalar code, the results are the same either way
+#if !defined(WDL_SIMPLEPITCHSHIFT_NO_SIMD) && !defined(WDL_SIMPLEPITCHSHIFT_USE_SSE) && !defined(WDL_SIMPLEPITCHSHIFT_USE_NEON)
+  #if defined(__SSE2__) || _M_IX86_FP >= 2 || defined(_M_X64) || defined(_M_AMD64)
+    #define WDL_SIMPLEPITCHSHIFT_USE_SSE
+  #elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define WDL_SIMPLEPITCHSHIFT_USE_NEON
+  #endif
+#endif
+
+#if defined(WDL_SIMPLEPITCHSHIFT_USE_SSE)
+  #include <emmintrin.h>
+  typedef __m128d wdl_pshift_vec;
+  #define wdl_pshift_load(p) _mm_loadu_pd(p)
+  #define wdl_pshift_store(p,v) _mm_storeu_pd((p),(v))
+  #define wdl_pshift_set1(a) _mm_set1_pd(a)
+  #define wdl_pshift_add(a,b) _mm_add_pd(a,b)
+  #define wdl_pshift_mul(a,b) _mm_mul_pd(a,b)
+#elif defined(WDL_SIMPLEPITCHSHIFT_USE_NEON)
+  #include <arm_neon.h>
+  typedef float64x2_t wdl_pshift_vec;
+  #define wdl_pshift_load(p) vld1q_f64(p)
+  #define wdl_pshift_store(p,v) vst1q_f64((p),(v))
+  #define wdl_pshift_set1(a) vdupq_n_f64(a)
+  #define wdl_pshift_add(a,b) vaddq_f64(a,b)
+  #define wdl_pshift_mul(a,b) vmulq_f64(a,b)
+#endif
+
 
 #ifdef WDL_SIMPLEPITCHSHIFT_PARENTCLASS
 class WDL_SimplePitchShifter : public WDL_SIMPLEPITCHSHIFT_PARENTCLASS
@@ -23,6 +53,7 @@ public:
     m_last_tempo=1.0;
     m_last_shift=1.0;
     m_qual=0;
+    m_xfade_shape=0;
 
     Reset();
   }
@@ -35,6 +66,7 @@ public:
     m_pswritepos=0;
     m_latpos=0;
     m_tempo_fracpos=0.0;
+    m_cur_pitch=-1.0;
     m_queue.Clear();
     m_rsbuf.Resize(0,false);
     m_psbuf.Resize(0,false);
@@ -49,7 +81,7 @@ public:
 
   void set_srate(double srate) { m_srate=srate; }
   void set_nch(int nch) { if (m_last_nch!=nch) { m_queue.Clear(); m_last_nch=nch; m_tempo_fracpos=0.0; } }
-  void set_shift(double shift) { m_last_shift=shift; }
+  void set_shift(double shift) { m_last_shift=shift; } // glides from the last shift over the next BufferDone()
   void set_tempo(double tempo) { m_last_tempo=tempo; }
   void set_formant_shift(double shift)
   {
@@ -73,27 +105,54 @@ public:
    m_qual=parm;
  }
 
+ // 0 = linear crossfades between the read positions (default), 1 = equal power, better for uncorrelated material such as
+ // large shifts of noisy or polyphonic input
+ void set_xfade_shape(int shape)
+ {
+   m_xfade_shape=shape;
+   if (shape==1 && !m_xfade_tab.GetSize())
+   {
+     double *tab=m_xfade_tab.Resize(XFADE_TAB_SIZE+2,false);
+     for (int x = 0; x <= XFADE_TAB_SIZE; x ++) tab[x]=sin(x*(3.14159265358979323846*0.5/XFADE_TAB_SIZE));
+     tab[XFADE_TAB_SIZE+1]=1.0; // so that interpolating at 1.0 stays in range
+   }
+ }
+
 #ifdef WDL_SIMPLEPITCHSHIFT_EXTRA_INTERFACE
  WDL_SIMPLEPITCHSHIFT_EXTRA_INTERFACE
 #endif
 
 private:
+  enum { XFADE_TAB_SIZE=256 };
+
   void PitchShiftBlock(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *inputs, WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *outputs, int nch, int length, double pitch, int bsize, int olsize, double srate);
+  template<int NCH, bool EQPOW> void PitchShiftFrames(const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *inputs, WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *outputs, int nch, int length, double pitch, double dpitch, int bsize, int olsize);
+
+  double XfadeGain(double t) const // t in [0,1]
+  {
+    const double p=t*XFADE_TAB_SIZE;
+    const int i=(int)p;
+    const double *tab=m_xfade_tab.Get()+i;
+    return tab[0]+(tab[1]-tab[0])*(p-i);
+  }
 
 
 private:
   double m_pspos WDL_FIXALIGN;
   double m_tempo_fracpos;
   double m_srate,m_last_tempo,m_last_shift;
+  double m_cur_pitch; // the pitch ratio the last block ended at, <0 after Reset()
 
   WDL_TypedBuf<WDL_SIMPLEPITCHSHIFT_SAMPLETYPE> m_psbuf;
   WDL_Queue m_queue;
   WDL_TypedBuf<WDL_SIMPLEPITCHSHIFT_SAMPLETYPE> m_inbuf;
   WDL_TypedBuf<WDL_SIMPLEPITCHSHIFT_SAMPLETYPE> m_rsbuf;
+  WDL_TypedBuf<double> m_xfade_tab; // a quarter sine, for equal power crossfades
 
   int m_pswritepos;
   int m_last_nch;
   int m_qual;
+  int m_xfade_shape;
   int m_hadinput;
 
   int m_latpos;
@@ -241,19 +300,80 @@ int WDL_SimplePitchShifter::GetSamples(int requested_output, WDL_SIMPLEPITCHSHIF
   return requested_output;
 }
 
+// interpolates the frame at frac between r1 and r2, and if r3, crossfades it with the frame at frac between r3 and r4
+template<int NCH> static inline void WDL_SimplePitchShifter_InterpFrame(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *out, int nch,
+  const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r1, const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r2, double frac,
+  const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r3, const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r4, double g1, double g2)
+{
+  if (NCH) nch=NCH;
+  int a=0;
+#if defined(wdl_pshift_load)
+  if (sizeof(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE)==sizeof(double))
+  {
+    const double *d1=(const double *)r1, *d2=(const double *)r2;
+    double *dout=(double *)out;
+    const wdl_pshift_vec vf=wdl_pshift_set1(frac), vf1=wdl_pshift_set1(1-frac);
+    if (r3)
+    {
+      const double *d3=(const double *)r3, *d4=(const double *)r4;
+      const wdl_pshift_vec vg1=wdl_pshift_set1(g1), vg2=wdl_pshift_set1(g2);
+      for (; a+2 <= nch; a += 2)
+      {
+        const wdl_pshift_vec o1=wdl_pshift_add(wdl_pshift_mul(wdl_pshift_load(d1+a),vf1),wdl_pshift_mul(wdl_pshift_load(d2+a),vf));
+        const wdl_pshift_vec o2=wdl_pshift_add(wdl_pshift_mul(wdl_pshift_load(d3+a),vf1),wdl_pshift_mul(wdl_pshift_load(d4+a),vf));
+        wdl_pshift_store(dout+a,wdl_pshift_add(wdl_pshift_mul(o1,vg1),wdl_pshift_mul(vg2,o2)));
+      }
+    }
+    else
+    {
+      for (; a+2 <= nch; a += 2)
+        wdl_pshift_store(dout+a,wdl_pshift_add(wdl_pshift_mul(wdl_pshift_load(d1+a),vf1),wdl_pshift_mul(wdl_pshift_load(d2+a),vf)));
+    }
+  }
+#endif
+  if (r3)
+  {
+    for (; a < nch; a ++)
+      out[a] = (r1[a]*(1-frac)+r2[a]*frac)*g1 + g2*(r3[a]*(1-frac)+r4[a]*frac);
+  }
+  else
+  {
+    for (; a < nch; a ++)
+      out[a] = r1[a]*(1-frac)+r2[a]*frac;
+  }
+}
+
 void WDL_SimplePitchShifter::PitchShiftBlock(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *inputs, WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *outputs, int nch, int length, double pitch, int bsize, int olsize, double srate)
 {
-  double iolsize=1.0/olsize;
+  if (length<1) return;
+
+  // glide from the pitch the last block ended at
+  const double startpitch = m_cur_pitch < 0.0 ? pitch : m_cur_pitch;
+  const double dpitch = (pitch-startpitch)/length;
+  m_cur_pitch = pitch;
+
+  const bool eqpow = m_xfade_shape==1 && m_xfade_tab.GetSize();
+  #define WDL_PSHIFT_DISPATCH(n) \
+    (eqpow ? PitchShiftFrames<n,true>(inputs,outputs,nch,length,startpitch,dpitch,bsize,olsize) : \
+             PitchShiftFrames<n,false>(inputs,outputs,nch,length,startpitch,dpitch,bsize,olsize))
+  switch (nch)
+  {
+    case 1: WDL_PSHIFT_DISPATCH(1); break;
+    case 2: WDL_PSHIFT_DISPATCH(2); break;
+    default: WDL_PSHIFT_DISPATCH(0); break;
+  }
+  #undef WDL_PSHIFT_DISPATCH
+}
 
-  WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *psbuf=m_psbuf.Get();
+template<int NCH, bool EQPOW> void WDL_SimplePitchShifter::PitchShiftFrames(const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *inputs, WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *outputs, int nch, int length, double pitch, double dpitch, int bsize, int olsize)
+{
+  if (NCH) nch=NCH;
+  const double iolsize=1.0/olsize;
 
-  double dpi=pitch;
+  WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *psbuf=m_psbuf.Get();
 
   double pspos=m_pspos;
   int writepos=m_pswritepos;
-  int writeposnch = writepos*nch;
-  int bsizench = bsize*nch;
-  int olsizench = olsize*nch;
 
   int i=length;
   while (i--)
@@ -261,33 +381,21 @@ void WDL_SimplePitchShifter::PitchShiftBlock(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *in
     int ipos1=(int)pspos;
     double frac0=pspos-ipos1;
 
-    ipos1*=nch;
-
-    int ipos2=ipos1+nch;
-    
-    if (ipos2 >= bsizench) ipos2=0;
-
-    int a;
-    for(a=0;a<nch;a++) outputs[a]=(psbuf[ipos1+a]*(1-frac0)+psbuf[ipos2+a]*frac0);      
+    const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r1=psbuf+ipos1*nch;
+    const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r2=ipos1+1 < bsize ? r1+nch : psbuf;
 
+    // the read position is crossfaded to olsize samples further on before it meets the write position
     double tv=pspos;
-    if (dpi >= 1.0)
+    double tfrac=-1.0;
+    if (pitch >= 1.0)
     {
       if (tv > writepos) tv-=bsize;
 
       if (tv >= writepos-olsize && tv < writepos)
       {
-        double tfrac=(writepos-tv)*iolsize;
-        int tmp=ipos1+olsizench;
-        if (tmp>=bsizench) tmp-=bsizench;
-        int tmp2=tmp+nch;
-        if (tmp2 >= bsizench) tmp2=0;
-
-        for(a=0;a<nch;a++) outputs[a]= outputs[a]*tfrac + (1-tfrac)*(psbuf[tmp+a]*(1-frac0)+psbuf[tmp2+a]*frac0);
-
+        tfrac=(writepos-tv)*iolsize;
         if (tv+pitch >= writepos) pspos+=olsize;
       }
-
     }
     else
     {
@@ -295,27 +403,36 @@ void WDL_SimplePitchShifter::PitchShiftBlock(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *in
 
       if (tv >= writepos && tv < writepos+olsize)
       {
-        double tfrac=(tv-writepos)*iolsize;
-        int tmp=ipos1+olsizench;
-        if (tmp>=bsizench) tmp -= bsizench;
-        int tmp2= tmp+nch;
-        if (tmp2 >= bsizench) tmp2=0;
-        for(a=0;a<nch;a++) outputs[a] = outputs[a]*tfrac + (1-tfrac)*(psbuf[tmp+a]*(1-frac0)+psbuf[tmp2+a]*frac0);
-        
+        tfrac=(tv-writepos)*iolsize;
         // this is wrong, but blehhh?
         if (tv+pitch < writepos+1) pspos += olsize;
 //        if (tv+pitch >= writepos+olsize) pspos += olsize;
       }
     }
 
+    if (tfrac >= 0.0)
+    {
+      int tmp=ipos1+olsize;
+      if (tmp>=bsize) tmp-=bsize;
+      const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r3=psbuf+tmp*nch;
+      const WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *r4=tmp+1 < bsize ? r3+nch : psbuf;
+      if (EQPOW)
+        WDL_SimplePitchShifter_InterpFrame<NCH>(outputs,nch,r1,r2,frac0,r3,r4,XfadeGain(tfrac),XfadeGain(1-tfrac));
+      else
+        WDL_SimplePitchShifter_InterpFrame<NCH>(outputs,nch,r1,r2,frac0,r3,r4,tfrac,1-tfrac);
+    }
+    else
+      WDL_SimplePitchShifter_InterpFrame<NCH>(outputs,nch,r1,r2,frac0,NULL,NULL,0.0,0.0);
 
     if ((pspos+=pitch) >= bsize) pspos -= bsize;
+    pitch += dpitch;
 
+    WDL_SIMPLEPITCHSHIFT_SAMPLETYPE *wp=psbuf+writepos*nch;
+    if (NCH==1) wp[0]=inputs[0];
+    else if (NCH==2) { wp[0]=inputs[0]; wp[1]=inputs[1]; }
+    else memcpy(wp,inputs,nch*sizeof(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE));
 
-    memcpy(psbuf+writeposnch,inputs,nch*sizeof(WDL_SIMPLEPITCHSHIFT_SAMPLETYPE));
-
-    writeposnch += nch;
-    if (++writepos >= bsize) writeposnch = writepos=0;
+    if (++writepos >= bsize) writepos=0;
 
     inputs += nch;
     outputs += nch;
@@ -36,6 +36,60 @@
 
 #include "denormal.h"
 
+// ProcessSampleBlock() runs the left and right filters of each comb and allpass in the two lanes of a vector, with all the combs together
+// so that their filter recurrences overlap.
+// define WDL_VERB_NO_SIMD to use the scalar code, the results are the same either way
+#if !defined(WDL_VERB_NO_SIMD) && !defined(WDL_VERB_USE_SSE) && !defined(WDL_VERB_USE_NEON)
+  #if defined(__SSE2__) || _M_IX86_FP >= 2 || defined(_M_X64) || defined(_M_AMD64)
+    #define WDL_VERB_USE_SSE
+  #elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define WDL_VERB_USE_NEON
+  #endif
+#endif
+
+#if defined(WDL_VERB_USE_SSE)
+  #include <emmintrin.h>
+  typedef __m128d wdl_verb_vec;
+  #define wdl_verb_load2(a,b) _mm_loadh_pd(_mm_load_sd(a),(b))
+  #define wdl_verb_store2(a,b,v) do { _mm_storel_pd((a),(v)); _mm_storeh_pd((b),(v)); } while (0)
+  #define wdl_verb_set2(a,b) _mm_set_pd((b),(a))
+  #define wdl_verb_add(a,b) _mm_add_pd(a,b)
+  #define wdl_verb_sub(a,b) _mm_sub_pd(a,b)
+  #define wdl_verb_mul(a,b) _mm_mul_pd(a,b)
+  #define wdl_verb_lane0(v) _mm_cvtsd_f64(v)
+  #define wdl_verb_lane1(v) _mm_cvtsd_f64(_mm_unpackhi_pd((v),(v)))
+  #if !defined(WDL_DENORMAL_FTZMODE) && !defined(WDL_DENORMAL_DO_NOT_FILTER)
+    // same as denormal_filter_double(): zero if the exponent is zero
+    static WDL_DENORMAL_INLINE __m128d wdl_verb_denormal_filter(__m128d a)
+    {
+      const __m128d expmask = _mm_castsi128_pd(_mm_set_epi32(0x7ff00000,0,0x7ff00000,0));
+      return _mm_and_pd(a,_mm_cmpneq_pd(_mm_and_pd(a,expmask),_mm_setzero_pd()));
+    }
+  #else
+    #define wdl_verb_denormal_filter(a) (a)
+  #endif
+#elif defined(WDL_VERB_USE_NEON)
+  #include <arm_neon.h>
+  typedef float64x2_t wdl_verb_vec;
+  #define wdl_verb_load2(a,b) vcombine_f64(vld1_f64(a),vld1_f64(b))
+  #define wdl_verb_store2(a,b,v) do { vst1q_lane_f64((a),(v),0); vst1q_lane_f64((b),(v),1); } while (0)
+  #define wdl_verb_set2(a,b) vcombine_f64(vdup_n_f64(a),vdup_n_f64(b))
+  #define wdl_verb_add(a,b) vaddq_f64(a,b)
+  #define wdl_verb_sub(a,b) vsubq_f64(a,b)
+  #define wdl_verb_mul(a,b) vmulq_f64(a,b)
+  #define wdl_verb_lane0(v) vgetq_lane_f64((v),0)
+  #define wdl_verb_lane1(v) vgetq_lane_f64((v),1)
+  #if !defined(WDL_DENORMAL_FTZMODE) && !defined(WDL_DENORMAL_DO_NOT_FILTER)
+    static WDL_DENORMAL_INLINE float64x2_t wdl_verb_denormal_filter(float64x2_t a)
+    {
+      const uint64x2_t bits = vreinterpretq_u64_f64(a);
+      return vreinterpretq_f64_u64(vandq_u64(bits,vtstq_u64(bits,vdupq_n_u64(0x7ff0000000000000ULL))));
+    }
+  #else
+    #define wdl_verb_denormal_filter(a) (a)
+  #endif
+#endif
+
 class WDL_ReverbAllpass
 {
 public:
@@ -66,6 +120,45 @@ public:
 
 	  return output;
   }
+  // processes this allpass on io0 and r on io1, in place
+  void process_pair(WDL_ReverbAllpass &r, double *io0, double *io1, int ns)
+  {
+    while (ns > 0)
+    {
+      // a run of samples up to where either buffer wraps
+      const int n = wdl_min(ns, wdl_min(buffer.GetSize()-bufidx, r.buffer.GetSize()-r.bufidx));
+      double *b0=buffer.Get()+bufidx, *b1=r.buffer.Get()+r.bufidx;
+      int i;
+#if defined(WDL_VERB_USE_SSE) || defined(WDL_VERB_USE_NEON)
+      const wdl_verb_vec fb = wdl_verb_set2(feedback,r.feedback);
+      for (i = 0; i < n; i ++)
+      {
+        const wdl_verb_vec inp = wdl_verb_load2(io0+i,io1+i);
+        const wdl_verb_vec bufout = wdl_verb_load2(b0+i,b1+i);
+        const wdl_verb_vec buf = wdl_verb_denormal_filter(wdl_verb_add(inp,wdl_verb_mul(bufout,fb)));
+        wdl_verb_store2(b0+i,b1+i,buf);
+        const wdl_verb_vec output = wdl_verb_sub(bufout,inp);
+        wdl_verb_store2(io0+i,io1+i,output);
+      }
+#else
+      for (i = 0; i < n; i ++)
+      {
+        const double inp0=io0[i], inp1=io1[i];
+        const double bufout0=b0[i], bufout1=b1[i];
+        b0[i] = denormal_filter_double(inp0 + (bufout0*feedback));
+        b1[i] = denormal_filter_double(inp1 + (bufout1*r.feedback));
+        io0[i] = bufout0 - inp0;
+        io1[i] = bufout1 - inp1;
+      }
+#endif
+      if ((bufidx += n) >= buffer.GetSize()) bufidx = 0;
+      if ((r.bufidx += n) >= r.buffer.GetSize()) r.bufidx = 0;
+      io0 += n;
+      io1 += n;
+      ns -= n;
+    }
+  }
+
   void Reset() { memset(buffer.Get(),0,buffer.GetSize()*sizeof(double)); }
   void setfeedback(double val) { feedback=val; }
 
@@ -113,6 +206,7 @@ public:
   void setfeedback(double val) { feedback=val; }
 
 private:
+  friend class WDL_ReverbEngine;
 
 	double	feedback;
 	double	filterstore;
@@ -155,40 +249,18 @@ public:
   void ProcessSampleBlock(double *spl0, double *spl1, double *outp0, double *outp1, int ns)
   {
     int x;
-    memset(outp0,0,ns*sizeof(double));
-    memset(outp1,0,ns*sizeof(double));
+    ProcessCombs(spl0,spl1,outp0,outp1,ns);
+
+    // the allpasses don't keep any state in registers from one sample to the next, so each one runs over the whole block in turn
+    for (x = 0; x < sizeof(wdl_verb__allpasstunings)/sizeof(wdl_verb__allpasstunings[0]); x ++)
+      m_allpasses[x][0].process_pair(m_allpasses[x][1],outp0,outp1,ns);
 
-    for (x = 0; x < sizeof(wdl_verb__combtunings)/sizeof(wdl_verb__combtunings[0]); x += 2)
-    {
-      int i=ns;
-      double *p0=outp0,*p1=outp1,*i0=spl0,*i1=spl1;
-      while (i--)
-      {        
-        double a=*i0++,b=*i1++;
-        *p0+=m_combs[x][0].process(a); 
-        *p1+=m_combs[x][1].process(b);
-        *p0+++=m_combs[x+1][0].process(a); 
-        *p1+++=m_combs[x+1][1].process(b);
-      }
-    }
-    for (x = 0; x < sizeof(wdl_verb__allpasstunings)/sizeof(wdl_verb__allpasstunings[0])-2; x += 2)
-    {
-      int i=ns;
-      double *p0=outp0,*p1=outp1;
-      while (i--)
-      {        
-        double tmp=m_allpasses[x][0].process(*p0);
-        double tmp2=m_allpasses[x][1].process(*p1);
-        *p0++=m_allpasses[x+1][0].process(tmp);
-        *p1++=m_allpasses[x+1][1].process(tmp2);
-      }
-    }
     int i=ns;
     double *p0=outp0,*p1=outp1;
     while (i--)
     {        
-      double a=m_allpasses[x+1][0].process(m_allpasses[x][0].process(*p0))*0.015;
-      double b=m_allpasses[x+1][1].process(m_allpasses[x][1].process(*p1))*0.015;
+      double a=*p0*0.015;
+      double b=*p1*0.015;
 
       if (m_wid<0)
       {
@@ -208,6 +280,91 @@ public:
     
   }
 
+  // all the combs run together, sample by sample, so that their filter recurrences overlap. outp0/outp1 receive the sum of their outputs,
+  // added in the same order as ProcessSample()
+  void ProcessCombs(const double *spl0, const double *spl1, double *outp0, double *outp1, int ns)
+  {
+    enum { NCOMBS = sizeof(wdl_verb__combtunings)/sizeof(wdl_verb__combtunings[0]) };
+    int x;
+#if defined(WDL_VERB_USE_SSE) || defined(WDL_VERB_USE_NEON)
+    wdl_verb_vec fs[NCOMBS], dmp[NCOMBS], dmp1[NCOMBS], fb[NCOMBS];
+    for (x = 0; x < NCOMBS; x ++)
+    {
+      WDL_ReverbComb &c0=m_combs[x][0], &c1=m_combs[x][1];
+      fs[x] = wdl_verb_set2(c0.filterstore,c1.filterstore);
+      dmp[x] = wdl_verb_set2(c0.damp,c1.damp);
+      dmp1[x] = wdl_verb_set2(1-c0.damp,1-c1.damp);
+      fb[x] = wdl_verb_set2(c0.feedback,c1.feedback);
+    }
+#endif
+    while (ns > 0)
+    {
+      // a run of samples up to where the first buffer wraps
+      int n = ns;
+      double *b0[NCOMBS], *b1[NCOMBS];
+      for (x = 0; x < NCOMBS; x ++)
+      {
+        WDL_ReverbComb &c0=m_combs[x][0], &c1=m_combs[x][1];
+        n = wdl_min(n, wdl_min(c0.buffer.GetSize()-c0.bufidx, c1.buffer.GetSize()-c1.bufidx));
+        b0[x] = c0.buffer.Get()+c0.bufidx;
+        b1[x] = c1.buffer.Get()+c1.bufidx;
+      }
+
+      int i;
+      for (i = 0; i < n; i ++)
+      {
+#if defined(WDL_VERB_USE_SSE) || defined(WDL_VERB_USE_NEON)
+        // the left and right combs are the two lanes
+        const wdl_verb_vec inp = wdl_verb_load2(spl0+i,spl1+i);
+        wdl_verb_vec sum = wdl_verb_load2(b0[0]+i,b1[0]+i);
+        for (x = 0; x < NCOMBS; x ++)
+        {
+          const wdl_verb_vec output = x ? wdl_verb_load2(b0[x]+i,b1[x]+i) : sum;
+          fs[x] = wdl_verb_denormal_filter(wdl_verb_add(wdl_verb_mul(output,dmp1[x]),wdl_verb_mul(fs[x],dmp[x])));
+          wdl_verb_store2(b0[x]+i,b1[x]+i,wdl_verb_add(inp,wdl_verb_mul(fs[x],fb[x])));
+          if (x) sum = wdl_verb_add(sum,output);
+        }
+        wdl_verb_store2(outp0+i,outp1+i,sum);
+#else
+        const double in0=spl0[i], in1=spl1[i];
+        double sum0=0.0, sum1=0.0;
+        for (x = 0; x < NCOMBS; x ++)
+        {
+          WDL_ReverbComb &c0=m_combs[x][0], &c1=m_combs[x][1];
+          const double output0=b0[x][i], output1=b1[x][i];
+          c0.filterstore = denormal_filter_double((output0*(1-c0.damp)) + (c0.filterstore*c0.damp));
+          c1.filterstore = denormal_filter_double((output1*(1-c1.damp)) + (c1.filterstore*c1.damp));
+          b0[x][i] = in0 + (c0.filterstore*c0.feedback);
+          b1[x][i] = in1 + (c1.filterstore*c1.feedback);
+          sum0 += output0;
+          sum1 += output1;
+        }
+        outp0[i]=sum0;
+        outp1[i]=sum1;
+#endif
+      }
+
+      for (x = 0; x < NCOMBS; x ++)
+      {
+        WDL_ReverbComb &c0=m_combs[x][0], &c1=m_combs[x][1];
+        if ((c0.bufidx += n) >= c0.buffer.GetSize()) c0.bufidx = 0;
+        if ((c1.bufidx += n) >= c1.buffer.GetSize()) c1.bufidx = 0;
+      }
+      spl0 += n;
+      spl1 += n;
+      outp0 += n;
+      outp1 += n;
+      ns -= n;
+    }
+#if defined(WDL_VERB_USE_SSE) || defined(WDL_VERB_USE_NEON)
+    for (x = 0; x < NCOMBS; x ++)
+    {
+      m_combs[x][0].filterstore = wdl_verb_lane0(fs[x]);
+      m_combs[x][1].filterstore = wdl_verb_lane1(fs[x]);
+    }
+#endif
+  }
+
   void ProcessSample(double *spl0, double *spl1)
   {
     int x;
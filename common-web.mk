@@ -70,10 +70,15 @@ CFLAGS = $(INCLUDE_PATHS) \
 -DWDL_NO_DEFINE_MINMAX \
 -DNDEBUG=1
 
+# WebAssembly SIMD128 for the DSP module, which selects the IPLUG_SIMD_WASM kernels in IPlugSIMD.h and the Extras.
+# All current browsers support it, set WAM_SIMD_CFLAGS to nothing in the project's -web.mk to target older ones
+WAM_SIMD_CFLAGS = -msimd128
+
 WAM_CFLAGS = -DWAM_API \
 -DIPLUG_DSP=1 \
 -DNO_IGRAPHICS \
--DSAMPLE_TYPE_FLOAT
+-DSAMPLE_TYPE_FLOAT \
+$(WAM_SIMD_CFLAGS)
 
 WEB_CFLAGS = -DWEB_API \
 -DIPLUG_EDITOR=1
@@ -89,12 +94,10 @@ WEB_EXPORTS = "['_main', '_iplug_fsready', '_iplug_syncfs']"
 # LDFLAGS for both WAM and WEB targets
 LDFLAGS = -s ALLOW_MEMORY_GROWTH=1 --bind
 
-# We can't compile the WASM module synchronously on main thread (.wasm over 4k in size requires async compile on chrome) https://developers.google.com/web/updates/2018/04/loading-wasm
-# and you can't compile asynchronously in AudioWorklet scope
-# The following settings mean the WASM is delivered as BASE64 and included in the MyPluginName-wam.js file.
-WAM_LDFLAGS = -s EXPORTED_RUNTIME_METHODS="['ccall', 'cwrap', 'setValue', 'UTF8ToString']" \
--s BINARYEN_ASYNC_COMPILATION=0 \
--s SINGLE_FILE=1
+# You can't fetch or compile a WASM module asynchronously in AudioWorklet scope, but you can instantiate one that was compiled elsewhere.
+# So the DSP module is built as a separate MyPluginName-wam.wasm, which the main thread compiles with WebAssembly.compileStreaming() while it downloads,
+# and passes to the AudioWorkletProcessor, see IPlug/WEB/Template/scripts/IPlugWAM-module.js
+WAM_LDFLAGS = -s EXPORTED_RUNTIME_METHODS="['ccall', 'cwrap', 'setValue', 'UTF8ToString']"
 #-s ENVIRONMENT=worker
 
 WEB_LDFLAGS = -s EXPORTED_FUNCTIONS=$(WEB_EXPORTS) \